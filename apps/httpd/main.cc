@@ -24,6 +24,7 @@
 #include <seastar/http/handlers.hh>
 #include <seastar/http/function_handlers.hh>
 #include <seastar/http/file_handler.hh>
+#include <seastar/http/cached_handler.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/reactor.hh>
 #include "demo.json.hh"
@@ -59,6 +60,10 @@ void set_routes(routes& r) {
     });
     r.add(operation_type::GET, url("/"), h1);
     r.add(operation_type::GET, url("/jf"), h2);
+    // Rendered once per shard, then sent from the cache
+    r.add(operation_type::GET, url("/health"), new cached_handler(std::make_unique<function_handler>([] (const_req req) {
+        return "{\"status\": \"ok\"}";
+    }, "json")));
     r.add(operation_type::GET, url("/file").remainder("path"),
             new directory_handler("/"));
     demo_json::hello_world.set(r, [] (const_req req) {
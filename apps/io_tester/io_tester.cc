@@ -20,6 +20,7 @@
  */
 #include <seastar/core/app-template.hh>
 #include <seastar/core/distributed.hh>
+#include <seastar/core/emulated_file.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/shared_ptr.hh>
@@ -33,6 +34,8 @@
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/metrics_api.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/io_queue.hh>
+#include <seastar/core/gate.hh>
 #include <seastar/util/later.hh>
 #include <chrono>
 #include <optional>
@@ -56,8 +59,10 @@
 #include <boost/range/adaptor/filtered.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/array.hpp>
+#include <fstream>
 #include <iomanip>
 #include <random>
+#include <sstream>
 #include <yaml-cpp/yaml.h>
 
 using namespace seastar;
@@ -70,7 +75,7 @@ static auto random_seed = std::chrono::duration_cast<std::chrono::microseconds>(
 static thread_local std::default_random_engine random_generator(random_seed);
 
 class context;
-enum class request_type { seqread, seqwrite, randread, randwrite, append, cpu, unlink };
+enum class request_type { seqread, seqwrite, randread, randwrite, append, cpu, unlink, replay };
 
 namespace std {
 
@@ -253,6 +258,10 @@ struct job_config {
     // remaining operations utilize only one file per shard
     std::optional<uint64_t> files_count;
     uint64_t offset_in_bdev;
+    // the trace replayed by replay_io_class_data, and the class of its requests
+    // to replay (all of them if not set)
+    std::optional<std::string> trace;
+    std::optional<std::string> trace_class;
     std::unique_ptr<class_data> gen_class_data();
 };
 
@@ -267,6 +276,22 @@ future<> maybe_close_file(file& f) {
     return f ? f.close() : make_ready_future<>();
 }
 
+// The disk the jobs' files are wrapped with, see --emulate-disk
+static std::optional<emulated_disk::config> emulated_disk_config;
+static thread_local std::unique_ptr<emulated_disk> local_emulated_disk;
+
+file maybe_emulate_disk(file f) {
+    if (!emulated_disk_config) {
+        return f;
+    }
+    if (!local_emulated_disk) {
+        auto cfg = *emulated_disk_config;
+        cfg.seed += this_shard_id();
+        local_emulated_disk = std::make_unique<emulated_disk>(cfg);
+    }
+    return make_emulated_file(std::move(f), *local_emulated_disk);
+}
+
 class class_data {
 protected:
     using accumulator_type = accumulator_set<double, stats<tag::extended_p_square_quantile(quadratic), tag::mean, tag::max>>;
@@ -389,16 +414,20 @@ class class_data {
     future<> issue_requests(std::chrono::steady_clock::time_point stop) {
         _start = std::chrono::steady_clock::now();
         return with_scheduling_group(_sg, [this, stop] {
-            if (rps() == 0) {
-                return issue_requests_in_parallel(stop, parallelism());
-            } else {
-                return issue_requests_at_rate(stop, rps(), parallelism());
-            }
+            return do_issue_requests(stop);
         }).then([this] {
             _total_duration = std::chrono::steady_clock::now() - _start;
         });
     }
 
+    virtual future<> do_issue_requests(std::chrono::steady_clock::time_point stop) {
+        if (rps() == 0) {
+            return issue_requests_in_parallel(stop, parallelism());
+        } else {
+            return issue_requests_at_rate(stop, rps(), parallelism());
+        }
+    }
+
     future<> think() {
         if (_think) {
             return seastar::sleep(std::chrono::duration_cast<std::chrono::microseconds>(_config.shard_info.think_time));
@@ -447,6 +476,7 @@ class class_data {
             { request_type::append , "APPEND" },
             { request_type::cpu , "CPU" },
             { request_type::unlink, "UNLINK" },
+            { request_type::replay, "REPLAY" },
         }[_config.type];;
     }
 
@@ -589,7 +619,7 @@ class io_class_data : public class_data {
         options.append_is_unlikely = true;
 
         return create_and_fill_file(fname, _config.file_size, flags, options).then([this](std::pair<file, uint64_t> p) {
-            _file = std::move(p.first);
+            _file = maybe_emulate_disk(std::move(p.first));
             _last_pos = (req_type() == request_type::append) ? p.second : 0u;
 
             return make_ready_future<>();
@@ -607,7 +637,7 @@ class io_class_data : public class_data {
         }
 
         return open_file_dma(name, flags).then([this] (auto f) {
-            _file = std::move(f);
+            _file = maybe_emulate_disk(std::move(f));
             return _file.size().then([this] (uint64_t size) {
                 auto shard_area_size = align_down<uint64_t>(size / smp::count, 1 << 20);
                 if (_config.offset_in_bdev + _config.file_size > shard_area_size) {
@@ -623,7 +653,7 @@ class io_class_data : public class_data {
         file_open_options options;
         options.append_is_unlikely = true;
         return open_file_dma("/dev/null", open_flags::rw, std::move(options)).then([this] (auto f) {
-            _file = std::move(f);
+            _file = maybe_emulate_disk(std::move(f));
             _is_dev_null = true;
             return make_ready_future<>();
         });
@@ -691,6 +721,118 @@ class write_io_class_data : public io_class_data {
     }
 };
 
+// Issues the reads and writes of a trace recorded with --record-trace (or
+// by any application through io_queue::set_trace_hook()) at the times they
+// were originally issued, regardless of how long the previous ones take.
+// Each line of the trace is
+//
+//   <timestamp in usec>,<shard>,<class>,<offset>,<size>,<read|write>
+//
+// Every shard replays the requests of its own shard number (modulo the
+// number of shards), with the offsets folded into the job's file.
+class replay_io_class_data : public io_class_data {
+    struct trace_entry {
+        std::chrono::microseconds at;
+        uint64_t offset;
+        size_t size;
+        bool write;
+    };
+    std::vector<trace_entry> _trace;
+    gate _in_flight;
+
+    void load_trace() {
+        std::ifstream in(*_config.trace);
+        if (!in) {
+            throw std::runtime_error(format("Cannot open trace {}", *_config.trace));
+        }
+        std::optional<uint64_t> first;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::vector<std::string> fields;
+            boost::split(fields, line, boost::is_any_of(","));
+            if (fields.size() != 6 || (fields[5] != "read" && fields[5] != "write")) {
+                throw std::runtime_error(format("Bad trace line: {}", line));
+            }
+            auto ts = boost::lexical_cast<uint64_t>(fields[0]);
+            // The timeline starts with the first request of any shard
+            if (!first) {
+                first = ts;
+            }
+            if (boost::lexical_cast<unsigned>(fields[1]) % smp::count != this_shard_id()) {
+                continue;
+            }
+            if (_config.trace_class && fields[2] != *_config.trace_class) {
+                continue;
+            }
+            _trace.push_back(trace_entry{
+                .at = std::chrono::microseconds(ts - std::min(ts, *first)),
+                .offset = boost::lexical_cast<uint64_t>(fields[3]),
+                .size = boost::lexical_cast<size_t>(fields[4]),
+                .write = fields[5] == "write",
+            });
+        }
+        std::stable_sort(_trace.begin(), _trace.end(), [] (const trace_entry& a, const trace_entry& b) {
+            return a.at < b.at;
+        });
+    }
+
+    void issue_one(const trace_entry& e, std::chrono::steady_clock::time_point stop) {
+        auto alignment = std::max(_file.disk_read_dma_alignment(), _file.disk_write_dma_alignment());
+        auto size = std::min<uint64_t>(align_up<uint64_t>(std::max<size_t>(e.size, 1), alignment), _config.file_size);
+        auto pos = align_down<uint64_t>(e.offset % (_config.file_size - size + 1), alignment) + _offset;
+        (void)with_gate(_in_flight, [this, size, pos, write = e.write, stop] {
+            auto buf = allocate_aligned_buffer<char>(size, alignment_of_buffers);
+            auto start = std::chrono::steady_clock::now();
+            auto f = write ? _file.dma_write(pos, buf.get(), size) : _file.dma_read(pos, buf.get(), size);
+            return on_io_completed(std::move(f)).then([this, start, stop] (size_t size) {
+                auto now = std::chrono::steady_clock::now();
+                if (now < stop) {
+                    add_result(size, std::chrono::duration_cast<std::chrono::microseconds>(now - start));
+                }
+            }).finally([buf = std::move(buf)] {});
+        }).handle_exception([] (std::exception_ptr ex) {
+            fmt::print("[WARNING]: replayed request failed: {}\n", ex);
+        });
+    }
+
+    static constexpr size_t alignment_of_buffers = 4096;
+public:
+    replay_io_class_data(job_config cfg) : io_class_data(std::move(cfg)) {
+        if (!_config.trace) {
+            throw std::runtime_error("request_type::replay requires specifying 'trace'");
+        }
+    }
+
+    future<> do_start(sstring path, directory_entry_type type) override {
+        load_trace();
+        return io_class_data::do_start(std::move(path), type);
+    }
+
+    future<size_t> issue_request(char *buf, io_intent* intent) override {
+        // Requests come from the trace, see do_issue_requests()
+        abort();
+    }
+
+    future<> do_issue_requests(std::chrono::steady_clock::time_point stop) override {
+        return do_with(size_t(0), [this, stop, start = std::chrono::steady_clock::now()] (size_t& next) {
+            return do_until([this, stop, &next] { return next == _trace.size() || std::chrono::steady_clock::now() > stop; }, [this, stop, start, &next] {
+                const auto& e = _trace[next++];
+                auto due = start + e.at;
+                auto now = std::chrono::steady_clock::now();
+                auto ready = due > now ? _sleep_fn(due, now) : make_ready_future<>();
+                return ready.then([this, &e, stop] {
+                    issue_one(e, stop);
+                });
+            }).then([this] {
+                return _in_flight.close();
+            });
+        });
+    }
+};
+
 class unlink_class_data : public class_data {
 private:
     sstring _dir_path{};
@@ -816,6 +958,8 @@ std::unique_ptr<class_data> job_config::gen_class_data() {
         return std::make_unique<cpu_class_data>(*this);
     } else if (type == request_type::unlink) {
         return std::make_unique<unlink_class_data>(*this);
+    } else if (type == request_type::replay) {
+        return std::make_unique<replay_io_class_data>(*this);
     } else if ((type == request_type::seqread) || (type == request_type::randread)) {
         return std::make_unique<read_io_class_data>(*this);
     } else {
@@ -898,6 +1042,7 @@ struct convert<request_type> {
             { "append", request_type::append},
             { "cpu", request_type::cpu},
             { "unlink", request_type::unlink },
+            { "replay", request_type::replay },
         };
         auto reqstr = node.as<std::string>();
         if (!mappings.count(reqstr)) {
@@ -977,6 +1122,42 @@ struct convert<options> {
     }
 };
 
+template<>
+struct convert<emulated_disk::config> {
+    static bool decode(const Node& node, emulated_disk::config& cfg) {
+        auto duration = [&] (const char* key, emulated_disk::clock_type::duration& d) {
+            if (node[key]) {
+                d = std::chrono::duration_cast<emulated_disk::clock_type::duration>(node[key].as<duration_time>().time);
+            }
+        };
+        auto bytes = [&] (const char* key, uint64_t& b) {
+            if (node[key]) {
+                b = node[key].as<byte_size>().size;
+            }
+        };
+        auto value = [&] <typename T> (const char* key, T& v) {
+            if (node[key]) {
+                v = node[key].as<T>();
+            }
+        };
+        duration("read_latency", cfg.read_latency);
+        duration("write_latency", cfg.write_latency);
+        value("latency_spread", cfg.latency_spread);
+        value("tail_probability", cfg.tail_probability);
+        duration("tail_latency", cfg.tail_latency);
+        bytes("read_bandwidth", cfg.read_bandwidth);
+        bytes("write_bandwidth", cfg.write_bandwidth);
+        value("read_iops", cfg.read_iops);
+        value("write_iops", cfg.write_iops);
+        duration("stall_period", cfg.stall_period);
+        duration("stall_duration", cfg.stall_duration);
+        value("write_amplification", cfg.write_amplification);
+        bytes("amplify_writes_after", cfg.amplify_writes_after);
+        value("seed", cfg.seed);
+        return true;
+    }
+};
+
 template<>
 struct convert<job_config> {
     static bool decode(const Node& node, job_config& cl) {
@@ -999,6 +1180,12 @@ struct convert<job_config> {
         if (node["files_count"]) {
             cl.files_count = node["files_count"].as<uint64_t>();
         }
+        if (node["trace"]) {
+            cl.trace = node["trace"].as<std::string>();
+        }
+        if (node["trace_class"]) {
+            cl.trace_class = node["trace_class"].as<std::string>();
+        }
 
         if (node["shard_info"]) {
             cl.shard_info = node["shard_info"].as<shard_info>();
@@ -1022,6 +1209,7 @@ class context {
     std::chrono::seconds _duration;
 
     semaphore _finished;
+    std::vector<io_queue::trace_record> _trace;
 public:
     context(sstring dir, directory_entry_type dtype, std::vector<job_config> req_config, unsigned duration)
             : _cl(boost::copy_range<std::vector<std::unique_ptr<class_data>>>(req_config
@@ -1054,6 +1242,29 @@ class context {
         });
     }
 
+    // Records the requests the storage's I/O queue sees from now on
+    void start_tracing(dev_t devid) {
+        engine().get_io_queue(devid).set_trace_hook([this] (const io_queue::trace_record& r) noexcept {
+            try {
+                _trace.push_back(r);
+            } catch (...) {
+                // the trace will miss a request
+            }
+        });
+    }
+
+    sstring trace_lines(dev_t devid) {
+        engine().get_io_queue(devid).set_trace_hook({});
+        std::ostringstream out;
+        for (auto& r : _trace) {
+            auto ts = std::chrono::duration_cast<std::chrono::microseconds>(r.timestamp.time_since_epoch()).count();
+            auto cname = internal::scheduling_group_from_index(r.class_id).name();
+            fmt::print(out, "{},{},{},{},{},{}\n", ts, this_shard_id(), cname, r.offset, r.length, r.write ? "write" : "read");
+        }
+        _trace.clear();
+        return sstring(out.str());
+    }
+
     future<> emit_results(YAML::Emitter& out) {
         return _finished.wait(_cl.size()).then([this, &out] {
             for (auto& cl: _cl) {
@@ -1094,6 +1305,8 @@ int main(int ac, char** av) {
         ("duration", bpo::value<unsigned>()->default_value(10), "for how long (in seconds) to run the test")
         ("conf", bpo::value<sstring>()->default_value("./conf.yaml"), "YAML file containing benchmark specification")
         ("keep-files", bpo::value<bool>()->default_value(false), "keep test files, next run may re-use them")
+        ("record-trace", bpo::value<sstring>(), "record the requests issued during the evaluation into a trace file, which a 'replay' job can replay")
+        ("emulate-disk", bpo::value<sstring>(), "YAML file describing a slow disk to emulate on top of the storage")
     ;
 
     distributed<context> ctx;
@@ -1116,6 +1329,9 @@ int main(int ac, char** av) {
             }
 
             keep_files = opts["keep-files"].as<bool>();
+            if (opts.count("emulate-disk")) {
+                emulated_disk_config = YAML::LoadFile(opts["emulate-disk"].as<sstring>()).as<emulated_disk::config>();
+            }
             auto& duration = opts["duration"].as<unsigned>();
             auto& yaml = opts["conf"].as<sstring>();
             YAML::Node doc = YAML::LoadFile(yaml);
@@ -1161,10 +1377,31 @@ int main(int ac, char** av) {
             ctx.invoke_on_all([] (auto& c) {
                 return c.start();
             }).get();
+            std::optional<dev_t> trace_dev;
+            if (opts.count("record-trace")) {
+                auto sd = file_stat(storage).get();
+                trace_dev = *st_type == directory_entry_type::block_device ? sd.rdev : sd.device_id;
+                ctx.invoke_on_all([dev = *trace_dev] (auto& c) {
+                    c.start_tracing(dev);
+                }).get();
+            }
             std::cout << "Starting evaluation..." << std::endl;
             ctx.invoke_on_all([] (auto& c) {
                 return c.issue_requests();
             }).get();
+            if (trace_dev) {
+                auto& fname = opts["record-trace"].as<sstring>();
+                std::ofstream out(fname);
+                out << "# timestamp_us,shard,class,offset,size,op\n";
+                for (unsigned i = 0; i < smp::count; ++i) {
+                    out << ctx.invoke_on(i, [dev = *trace_dev] (auto& c) {
+                        return c.trace_lines(dev);
+                    }).get();
+                }
+                if (!out) {
+                    throw std::runtime_error(format("Failed to write trace {}", fname));
+                }
+            }
             show_results(ctx);
             ctx.stop().get();
         }).or_terminate();
@@ -47,6 +47,8 @@
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/fsqual.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/std-compat.hh>
@@ -189,15 +191,33 @@ struct evaluation_directory {
 struct io_rates {
     float bytes_per_sec = 0;
     float iops = 0;
+    // For the average request latency
+    double latency_sum = 0;
+    uint64_t requests = 0;
     io_rates operator+(const io_rates& a) const {
-        return io_rates{bytes_per_sec + a.bytes_per_sec, iops + a.iops};
+        return io_rates{bytes_per_sec + a.bytes_per_sec, iops + a.iops, latency_sum + a.latency_sum, requests + a.requests};
     }
 
     io_rates& operator+=(const io_rates& a) {
         bytes_per_sec += a.bytes_per_sec;
         iops += a.iops;
+        latency_sum += a.latency_sum;
+        requests += a.requests;
         return *this;
     }
+
+    std::chrono::duration<double> average_latency() const {
+        return std::chrono::duration<double>(requests ? latency_sum / requests : 0);
+    }
+};
+
+// Reads measured while writes were going on
+struct mixed_rates {
+    io_rates read;
+    float write_bytes_per_sec = 0;
+    mixed_rates operator+(const mixed_rates& a) const {
+        return mixed_rates{read + a.read, write_bytes_per_sec + a.write_bytes_per_sec};
+    }
 };
 
 struct row_stats {
@@ -350,6 +370,10 @@ class io_worker {
     uint64_t _max_offset = 0;
     unsigned _requests = 0;
     size_t _buffer_size;
+    // Zero means as fast as the disk goes
+    double _bytes_per_sec_limit = 0;
+    uint64_t _issued_bytes = 0;
+    std::chrono::duration<double> _latency_sum{0};
     std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _start_measuring;
     std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _end_measuring;
     std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _end_load;
@@ -383,19 +407,41 @@ class io_worker {
         return allocate_aligned_buffer<char>(_buffer_size, _buffer_size);
     }
 
+    // Issues the requests no faster than needed to transfer bytes_per_sec
+    void limit_rate(double bytes_per_sec) noexcept {
+        _bytes_per_sec_limit = bytes_per_sec;
+    }
+
     future<> issue_request(char* buf) {
+        if (_bytes_per_sec_limit != 0) {
+            auto due = _start_measuring + std::chrono::duration<double>(_issued_bytes / _bytes_per_sec_limit);
+            _issued_bytes += _buffer_size;
+            auto now = iotune_clock::now();
+            if (due > now) {
+                return seastar::sleep(std::chrono::duration_cast<std::chrono::microseconds>(due - now)).then([this, buf] {
+                    return do_issue_request(buf);
+                });
+            }
+        }
+        return do_issue_request(buf);
+    }
+
+    future<> do_issue_request(char* buf) {
         uint64_t pos = _pos_impl->get_pos();
-        return _req_impl->issue_request(pos, buf, _buffer_size).then([this, pos] (size_t size) {
+        auto start = iotune_clock::now();
+        return _req_impl->issue_request(pos, buf, _buffer_size).then([this, pos, start] (size_t size) {
             auto now = iotune_clock::now();
             _max_offset = std::max(_max_offset, pos + size);
             if ((now > _start_measuring) && (now < _end_measuring)) {
                 _last_time_seen = now;
                 _bytes += size;
                 _requests++;
+                _latency_sum += now - start;
             }
         });
     }
 
+    
     uint64_t max_offset() const noexcept { return _max_offset; }
 
     io_rates get_io_rates() const {
@@ -406,6 +452,8 @@ class io_worker {
         }
         rates.bytes_per_sec = _bytes / t.count();
         rates.iops = _requests / t.count();
+        rates.latency_sum = _latency_sum.count();
+        rates.requests = _requests;
         return rates;
     }
 };
@@ -418,6 +466,8 @@ class test_file {
     uint64_t _file_size;
     file _file;
     uint64_t _forced_random_io_buffer_size;
+    // The background writes of mixed_workload() are not reported
+    std::vector<unsigned> _mixed_write_rates;
 
     std::unique_ptr<position_generator> get_position_generator(size_t buffer_size, pattern access_pattern) {
         if (access_pattern == pattern::sequential) {
@@ -509,6 +559,24 @@ class test_file {
         });
     }
 
+    // Random reads of read_size, with sequential writes of write_size going
+    // on in the background at write_bytes_per_sec
+    future<mixed_rates> mixed_workload(size_t read_size, unsigned read_concurrency, size_t write_size, double write_bytes_per_sec, std::chrono::duration<double> duration, std::vector<unsigned>& rates) {
+        read_size = calculate_buffer_size(pattern::random, read_size, _file.disk_read_dma_alignment());
+        write_size = calculate_buffer_size(pattern::sequential, write_size, _file.disk_write_dma_alignment());
+        auto reader = std::make_unique<io_worker>(read_size, duration, std::make_unique<read_request_issuer>(_file), get_position_generator(read_size, pattern::random), rates);
+        auto writer = std::make_unique<io_worker>(write_size, duration, std::make_unique<write_request_issuer>(_file), get_position_generator(write_size, pattern::sequential), _mixed_write_rates);
+        writer->limit_rate(write_bytes_per_sec);
+        auto read = do_workload(std::move(reader), read_concurrency);
+        auto write = write_bytes_per_sec > 0 ? do_workload(std::move(writer), 2) : make_ready_future<io_rates>();
+        return when_all_succeed(std::move(read), std::move(write)).then_unpack([this] (io_rates read, io_rates write) {
+            _mixed_write_rates.clear();
+            return _file.flush().then([ret = mixed_rates{read, write.bytes_per_sec}] {
+                return ret;
+            });
+        });
+    }
+
     future<> stop() {
         return _file ? _file.close() : make_ready_future<>();
     }
@@ -599,6 +667,20 @@ class iotune_multi_shard_context {
         }, io_rates(), std::plus<io_rates>());
     }
 
+    // The background write bandwidth is split evenly among the shards which
+    // take part in the reads
+    future<mixed_rates> mixed_data(size_t read_size, size_t write_size, double write_bytes_per_sec, std::chrono::duration<double> duration) {
+        unsigned shards = std::min<unsigned>(smp::count, _test_directory.max_iodepth());
+        return _iotune_test_file.map_reduce0([=, this] (test_file& tf) {
+            const auto shard_io_depth = per_shard_io_depth();
+            if (shard_io_depth == 0) {
+                return make_ready_future<mixed_rates>();
+            } else {
+                return tf.mixed_workload(read_size, shard_io_depth, write_size, write_bytes_per_sec / shards, duration, sharded_rates.local());
+            }
+        }, mixed_rates(), std::plus<mixed_rates>());
+    }
+
 private:
     template <typename Fn>
     future<uint64_t> saturate(float rate_threshold, size_t buffer_size, std::chrono::duration<double> duration, Fn&& workload) {
@@ -639,6 +721,18 @@ struct disk_descriptor {
     uint64_t write_bw;
     std::optional<uint64_t> read_sat_len;
     std::optional<uint64_t> write_sat_len;
+    struct request_size_rates {
+        uint64_t size;
+        uint64_t read_iops;
+        uint64_t write_iops;
+    };
+    std::vector<request_size_rates> request_sizes;
+    struct mixed_rates {
+        uint64_t write_bw;
+        uint64_t read_iops;
+        uint64_t read_latency_us;
+    };
+    std::vector<mixed_rates> mixed;
 };
 
 void string_to_file(sstring conf_file, sstring buf) {
@@ -677,6 +771,29 @@ void write_property_file(sstring conf_file, std::vector<disk_descriptor> disk_de
         if (desc.write_sat_len) {
             out << YAML::Key << "write_saturation_length" << YAML::Value << *desc.write_sat_len;
         }
+        if (!desc.request_sizes.empty()) {
+            out << YAML::Key << "request_sizes" << YAML::Value << YAML::BeginSeq;
+            for (auto& rs : desc.request_sizes) {
+                out << YAML::Flow << YAML::BeginMap;
+                out << YAML::Key << "size" << YAML::Value << rs.size;
+                out << YAML::Key << "read_iops" << YAML::Value << rs.read_iops;
+                out << YAML::Key << "write_iops" << YAML::Value << rs.write_iops;
+                out << YAML::EndMap;
+            }
+            out << YAML::EndSeq;
+        }
+        if (!desc.mixed.empty()) {
+            out << YAML::Key << "mixed" << YAML::Value << YAML::BeginSeq;
+            for (auto& m : desc.mixed) {
+                out << YAML::Flow << YAML::BeginMap;
+                out << YAML::Key << "write_bandwidth" << YAML::Value << m.write_bw;
+                out << YAML::Key << "read_iops" << YAML::Value << m.read_iops;
+                // Not used by seastar, for reference only
+                out << YAML::Key << "read_latency_us" << YAML::Value << m.read_latency_us;
+                out << YAML::EndMap;
+            }
+            out << YAML::EndSeq;
+        }
         out << YAML::EndMap;
     }
     out << YAML::EndSeq;
@@ -709,6 +826,7 @@ fs::path mountpoint_of(sstring filename) {
 int main(int ac, char** av) {
     namespace bpo = boost::program_options;
     bool fs_check = false;
+    bool mixed = false;
 
     app_template::config app_cfg;
     app_cfg.name = "IOTune";
@@ -725,6 +843,7 @@ int main(int ac, char** av) {
         ("accuracy", bpo::value<unsigned>()->default_value(3), "acceptable deviation of measurements (percents)")
         ("saturation", bpo::value<sstring>()->default_value(""), "measure saturation lengths (read | write | both) (this is very slow!)")
         ("random-io-buffer-size", bpo::value<unsigned>()->default_value(0), "force buffer size for random write and random read")
+        ("mixed", bpo::bool_switch(&mixed), "also measure random IOPS at several request sizes, and random read IOPS under several background write loads")
     ;
 
     return app.run(ac, av, [&] {
@@ -880,6 +999,34 @@ int main(int ac, char** av) {
                 rates = iotune_tests.get_sharded_worst_rates().get();
                 fmt::print("{} IOPS{}\n", uint64_t(read_iops.iops), accuracy_msg());
 
+                std::vector<disk_descriptor::request_size_rates> request_sizes;
+                std::vector<disk_descriptor::mixed_rates> mixed_rates;
+                if (mixed && random_io_buffer_size != 0u) {
+                    iotune_logger.warn("Not measuring mixed workloads, the random IO buffer size is forced");
+                } else if (mixed) {
+                    uint64_t min_size = test_directory.minimum_io_size();
+                    request_sizes.push_back({min_size, uint64_t(read_iops.iops), uint64_t(write_iops.iops)});
+                    for (uint64_t size = std::max<uint64_t>(min_size * 4, 16 << 10); size <= 128 << 10; size *= 2) {
+                        fmt::print("Measuring random IOPS with {} bytes requests: ", size);
+                        std::cout.flush();
+                        auto w = iotune_tests.write_random_data(size, duration * 0.05).get();
+                        auto r = iotune_tests.read_random_data(size, duration * 0.05).get();
+                        rates = iotune_tests.get_sharded_worst_rates().get();
+                        fmt::print("{} read / {} write IOPS{}\n", uint64_t(r.iops), uint64_t(w.iops), accuracy_msg());
+                        request_sizes.push_back({size, uint64_t(r.iops), uint64_t(w.iops)});
+                    }
+
+                    for (auto fraction : {0.0, 0.25, 0.5, 0.75}) {
+                        fmt::print("Measuring random read IOPS with {}% of the write bandwidth in the background: ", int(fraction * 100));
+                        std::cout.flush();
+                        auto m = iotune_tests.mixed_data(min_size, 128 << 10, write_bw.bytes_per_sec * fraction, duration * 0.05).get();
+                        rates = iotune_tests.get_sharded_worst_rates().get();
+                        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(m.read.average_latency());
+                        fmt::print("{} IOPS, {} us average latency{}\n", uint64_t(m.read.iops), latency.count(), accuracy_msg());
+                        mixed_rates.push_back({uint64_t(m.write_bytes_per_sec), uint64_t(m.read.iops), uint64_t(latency.count())});
+                    }
+                }
+
                 struct disk_descriptor desc;
                 desc.mountpoint = mountpoint;
                 desc.read_iops = read_iops.iops;
@@ -888,6 +1035,8 @@ int main(int ac, char** av) {
                 desc.write_iops = write_iops.iops;
                 desc.write_bw = write_bw.bytes_per_sec;
                 desc.write_sat_len = write_sat;
+                desc.request_sizes = std::move(request_sizes);
+                desc.mixed = std::move(mixed_rates);
                 disk_descriptors.push_back(std::move(desc));
             }
 
@@ -66,6 +66,8 @@ blob := any+ >start_blob $advance_blob;
 maybe_noreply = (sp "noreply" @{ _noreply = true; })? >{ _noreply = false; };
 maybe_expiration = (sp expiration)? >{ _expiration = 0; };
 version_field = u64 %{ _version = _u64; };
+meta_flag = graph+ >mark %{ _meta_flags.emplace_back(str()); };
+meta_flags = (sp meta_flag)*;
 
 insertion_params = sp key sp flags sp expiration sp size maybe_noreply (crlf @{ fcall blob; } ) crlf;
 set = "set" insertion_params @{ _state = state::cmd_set; };
@@ -81,8 +83,12 @@ stats = "stats" crlf @{ _state = state::cmd_stats; };
 stats_hash = "stats hash" crlf @{ _state = state::cmd_stats_hash; };
 incr = "incr" sp key sp u64 maybe_noreply crlf @{ _state = state::cmd_incr; };
 decr = "decr" sp key sp u64 maybe_noreply crlf @{ _state = state::cmd_decr; };
+mg = "mg" sp key meta_flags crlf @{ _state = state::cmd_mg; };
+ms = "ms" sp key sp size meta_flags (crlf @{ fcall blob; } ) crlf @{ _state = state::cmd_ms; };
+md = "md" sp key meta_flags crlf @{ _state = state::cmd_md; };
+mn = "mn" crlf @{ _state = state::cmd_mn; };
 main := (add | replace | set | get | gets | delete | flush | version | cas | stats | incr | decr
-    | stats_hash) >eof{ _state = state::eof; };
+    | stats_hash | mg | ms | md | mn) >eof{ _state = state::eof; };
 
 prepush {
     prepush();
@@ -113,6 +119,10 @@ public:
         cmd_stats_hash,
         cmd_incr,
         cmd_decr,
+        cmd_mg,
+        cmd_ms,
+        cmd_md,
+        cmd_mn,
     };
     state _state;
     uint32_t _u32;
@@ -127,11 +137,15 @@ public:
     sstring _blob;
     bool _noreply;
     std::vector<memcache::item_key> _keys;
+    // Flags of a meta command, each one a letter followed by its token
+    std::vector<sstring> _meta_flags;
 public:
     void init() {
         init_base();
         _state = state::error;
+        _noreply = false;
         _keys.clear();
+        _meta_flags.clear();
         %% write init;
     }
 
@@ -0,0 +1,107 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace memcache {
+
+// Count-min sketch estimating how often keys were used recently, for the
+// admission decisions of W-TinyLFU.
+//
+// Counters are 8 bits wide but saturate at 15, as only relative
+// frequencies of recent uses matter. Once as many uses as ten times the
+// width were recorded, all counters are halved, so that the estimates
+// follow changes in popularity. Halving is spread over the following
+// uses, a few counters at a time, so that no single use walks the whole
+// sketch.
+class frequency_sketch {
+    static constexpr unsigned depth = 4;
+    static constexpr uint8_t max_count = 15;
+    // Counters halved per recorded use, while aging
+    static constexpr size_t age_step = 64;
+    static constexpr std::array<uint64_t, depth> seeds = {
+        0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull, 0x9ae16a3b2f90404full, 0xcbf29ce484222325ull,
+    };
+    std::vector<uint8_t> _counters;
+    size_t _mask;
+    size_t _samples = 0;
+    size_t _sample_limit;
+    // Next counter to halve, or _counters.size() when not aging
+    size_t _aging_pos;
+private:
+    size_t index(size_t hash, unsigned row) const noexcept {
+        uint64_t h = (hash + seeds[row]) * seeds[row];
+        h ^= h >> 32;
+        return row * (_mask + 1) + (h & _mask);
+    }
+
+    void age_some() noexcept {
+        auto end = std::min(_aging_pos + age_step, _counters.size());
+        for (; _aging_pos < end; ++_aging_pos) {
+            _counters[_aging_pos] >>= 1;
+        }
+    }
+public:
+    // @width is rounded up to a power of two, and should be about the
+    // number of items the cache is expected to hold.
+    explicit frequency_sketch(size_t width)
+        : _counters(depth * (size_t(1) << seastar::log2ceil(std::max<size_t>(width, 16))))
+        , _mask(_counters.size() / depth - 1)
+        , _sample_limit(10 * (_mask + 1))
+        , _aging_pos(_counters.size())
+    {}
+
+    void record(size_t hash) noexcept {
+        if (_aging_pos < _counters.size()) {
+            age_some();
+        }
+        bool added = false;
+        for (unsigned row = 0; row < depth; ++row) {
+            auto& c = _counters[index(hash, row)];
+            if (c < max_count) {
+                ++c;
+                added = true;
+            }
+        }
+        if (added && ++_samples == _sample_limit) {
+            // The sketch holds 4 * width counters, so aging is done long
+            // before the next _sample_limit / 2 uses are recorded
+            _samples /= 2;
+            _aging_pos = 0;
+        }
+    }
+
+    unsigned estimate(size_t hash) const noexcept {
+        uint8_t ret = max_count;
+        for (unsigned row = 0; row < depth; ++row) {
+            ret = std::min(ret, _counters[index(hash, row)]);
+        }
+        return ret;
+    }
+};
+
+}
@@ -0,0 +1,361 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace memcache {
+
+// Open addressing hash index of pointers to T, in the spirit of Swiss tables.
+//
+// Slots come in aligned groups of 16, each slot with a control byte holding
+// the low 7 bits of the hash of its element, or a marker for an empty or a
+// deleted slot. A lookup compares the tag with the 16 control bytes of a
+// group at once and touches an element only when its tag matches, probing
+// further groups quadratically until one that has an empty slot.
+//
+// Growing doesn't rehash everything at once: the next table is allocated
+// when the load crosses prepare_load, its control bytes are initialized a
+// chunk at a time, and then the elements are moved over a few groups per
+// insertion or removal. Lookups look into both tables while elements move.
+//
+// HashFn returns the hash of an element, which must be the one passed to
+// find() for a key matching it.
+template <typename T, typename HashFn>
+class hash_index {
+public:
+    static constexpr size_t group_size = 16;
+    static constexpr size_t min_capacity = 1 << 10;
+private:
+    using ctrl_type = int8_t;
+    static constexpr ctrl_type empty = -128;
+    static constexpr ctrl_type deleted = -2;
+    // Loads, out of 8, at which a bigger table starts being prepared, and
+    // past which the current one is grown synchronously
+    static constexpr size_t prepare_load = 6;
+    static constexpr size_t max_load = 7;
+    // Work done per insertion or removal when growing. With these, the
+    // current table never crosses max_load while growing by a factor of 2.
+    static constexpr size_t init_step = 256;
+    static constexpr size_t migrate_step = 2;
+
+    class group {
+        const ctrl_type* _ctrl;
+    public:
+        explicit group(const ctrl_type* ctrl) noexcept : _ctrl(ctrl) {}
+        // Bit i is set for each slot i of the group matching
+#ifdef __SSE2__
+        unsigned match(ctrl_type tag) const noexcept {
+            return match_mask(_mm_cmpeq_epi8(_mm_set1_epi8(tag), load()));
+        }
+        unsigned match_empty() const noexcept {
+            return match(empty);
+        }
+        // Empty and deleted are the only negative values below -1
+        unsigned match_free() const noexcept {
+            return match_mask(_mm_cmpgt_epi8(_mm_set1_epi8(-1), load()));
+        }
+    private:
+        __m128i load() const noexcept {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(_ctrl));
+        }
+        static unsigned match_mask(__m128i v) noexcept {
+            return _mm_movemask_epi8(v);
+        }
+#else
+        unsigned match(ctrl_type tag) const noexcept {
+            return match_if([tag] (ctrl_type c) { return c == tag; });
+        }
+        unsigned match_empty() const noexcept {
+            return match(empty);
+        }
+        unsigned match_free() const noexcept {
+            return match_if([] (ctrl_type c) { return c < -1; });
+        }
+    private:
+        template <typename Pred>
+        unsigned match_if(Pred pred) const noexcept {
+            unsigned mask = 0;
+            for (size_t i = 0; i < group_size; ++i) {
+                mask |= unsigned(pred(_ctrl[i])) << i;
+            }
+            return mask;
+        }
+#endif
+    };
+
+    struct table {
+        size_t capacity = 0;
+        std::unique_ptr<ctrl_type[]> ctrl;
+        std::unique_ptr<T*[]> slots;
+        // live or deleted
+        size_t used = 0;
+        size_t live = 0;
+
+        table() = default;
+        explicit table(size_t cap)
+            : capacity(cap)
+            , ctrl(new ctrl_type[cap])
+            , slots(new T*[cap])
+        {}
+        size_t groups() const noexcept {
+            return capacity / group_size;
+        }
+        bool loaded(size_t load) const noexcept {
+            return used * 8 >= capacity * load;
+        }
+    };
+
+    // Insertions go to _table. _old is the table elements are moved out of,
+    // _next the one being prepared, when not empty.
+    table _table;
+    table _old;
+    table _next;
+    size_t _init_cursor = 0;
+    size_t _migrate_cursor = 0;
+    size_t _resize_failures = 0;
+private:
+    static ctrl_type tag_of(size_t hash) noexcept {
+        return hash & 0x7f;
+    }
+
+    // Calls func(group index) along the probe sequence of hash, until it
+    // returns true or all groups were visited. Triangular steps visit every
+    // group of a power of two number of them.
+    template <typename Func>
+    static void probe(const table& t, size_t hash, Func&& func) {
+        auto mask = t.groups() - 1;
+        auto g = (hash >> 7) & mask;
+        for (size_t step = 1; step <= t.groups(); ++step) {
+            if (func(g)) {
+                return;
+            }
+            g = (g + step) & mask;
+        }
+    }
+
+    // Returns the slot index matching pred, or capacity
+    template <typename Pred>
+    static size_t lookup(const table& t, size_t hash, Pred&& pred) {
+        size_t ret = t.capacity;
+        if (!t.capacity) {
+            return ret;
+        }
+        auto tag = tag_of(hash);
+        probe(t, hash, [&] (size_t g) {
+            group grp(t.ctrl.get() + g * group_size);
+            for (auto m = grp.match(tag); m; m &= m - 1) {
+                auto i = g * group_size + seastar::count_trailing_zeros(m);
+                if (pred(*t.slots[i])) {
+                    ret = i;
+                    return true;
+                }
+            }
+            return grp.match_empty() != 0;
+        });
+        return ret;
+    }
+
+    static bool insert_into(table& t, T& elem, size_t hash) {
+        bool inserted = false;
+        probe(t, hash, [&] (size_t g) {
+            auto m = group(t.ctrl.get() + g * group_size).match_free();
+            if (!m) {
+                return false;
+            }
+            auto i = g * group_size + seastar::count_trailing_zeros(m);
+            if (t.ctrl[i] == empty) {
+                ++t.used;
+            }
+            t.ctrl[i] = tag_of(hash);
+            t.slots[i] = &elem;
+            ++t.live;
+            inserted = true;
+            return true;
+        });
+        return inserted;
+    }
+
+    // A slot can go back to empty when its group has an empty slot, since
+    // then no probe sequence ever went past the group.
+    static void remove_at(table& t, size_t i) noexcept {
+        if (group(t.ctrl.get() + i / group_size * group_size).match_empty()) {
+            t.ctrl[i] = empty;
+            --t.used;
+        } else {
+            t.ctrl[i] = deleted;
+        }
+        --t.live;
+    }
+
+    void start_resize() {
+        // Same size when it's mostly deleted slots that fill the table
+        auto capacity = _table.live * 8 >= _table.capacity * 3 ? _table.capacity * 2 : _table.capacity;
+        try {
+            _next = table(capacity);
+        } catch (const std::bad_alloc&) {
+            _resize_failures++;
+            return;
+        }
+        _init_cursor = 0;
+    }
+
+    void make_step() {
+        if (_next.capacity) {
+            auto n = std::min(init_step, _next.capacity - _init_cursor);
+            std::memset(_next.ctrl.get() + _init_cursor, empty, n);
+            _init_cursor += n;
+            if (_init_cursor == _next.capacity) {
+                _old = std::exchange(_table, std::exchange(_next, table()));
+                _migrate_cursor = 0;
+            }
+        } else if (_old.capacity) {
+            auto end = std::min(_migrate_cursor + migrate_step, _old.groups());
+            for (auto i = _migrate_cursor * group_size; i < end * group_size; ++i) {
+                if (_old.ctrl[i] >= 0) {
+                    auto& elem = *_old.slots[i];
+                    insert_into(_table, elem, HashFn()(elem));
+                    _old.ctrl[i] = deleted;
+                    --_old.live;
+                }
+            }
+            _migrate_cursor = end;
+            if (end == _old.groups()) {
+                _old = table();
+            }
+        }
+    }
+
+    void maybe_grow() {
+        if (!_next.capacity && !_old.capacity && _table.loaded(prepare_load)) {
+            start_resize();
+        }
+        if (__builtin_expect(_table.loaded(max_load), false)) {
+            // Only when growth fell behind, e.g. it failed to allocate
+            while (_next.capacity || _old.capacity) {
+                make_step();
+            }
+        }
+    }
+public:
+    hash_index() : _table(min_capacity) {
+        std::memset(_table.ctrl.get(), empty, _table.capacity);
+    }
+
+    // Returns the element for which eq(key, element) holds, or nullptr
+    template <typename Key, typename Equal>
+    T* find(const Key& key, size_t hash, Equal eq) const {
+        auto pred = [&] (const T& elem) { return eq(key, elem); };
+        auto i = lookup(_table, hash, pred);
+        if (i != _table.capacity) {
+            return _table.slots[i];
+        }
+        i = lookup(_old, hash, pred);
+        return i != _old.capacity ? _old.slots[i] : nullptr;
+    }
+
+    // The element must not be in the index already.
+    // Throws std::bad_alloc when the table is full and can't grow.
+    void insert(T& elem) {
+        make_step();
+        maybe_grow();
+        if (!insert_into(_table, elem, HashFn()(elem))) {
+            throw std::bad_alloc();
+        }
+    }
+
+    // The element must be in the index
+    void erase(T& elem) noexcept {
+        auto hash = HashFn()(elem);
+        auto same = [&elem] (const T& e) { return &e == &elem; };
+        auto i = lookup(_table, hash, same);
+        if (i != _table.capacity) {
+            remove_at(_table, i);
+        } else {
+            remove_at(_old, lookup(_old, hash, same));
+        }
+        make_step();
+    }
+
+    // Calls dispose on each element and empties the index
+    template <typename Func>
+    void clear_and_dispose(Func dispose) {
+        for (auto* t : {&_table, &_old}) {
+            for (size_t i = 0; i < t->capacity; ++i) {
+                if (t->ctrl[i] >= 0) {
+                    dispose(t->slots[i]);
+                }
+            }
+        }
+        _old = table();
+        _next = table();
+        std::memset(_table.ctrl.get(), empty, _table.capacity);
+        _table.used = _table.live = 0;
+    }
+
+    size_t size() const noexcept {
+        return _table.live + _old.live;
+    }
+
+    size_t capacity() const noexcept {
+        return _table.capacity;
+    }
+
+    // Slots of the current table that are neither empty nor live
+    size_t deleted_slots() const noexcept {
+        return _table.used - _table.live;
+    }
+
+    bool resizing() const noexcept {
+        return _next.capacity || _old.capacity;
+    }
+
+    size_t resize_failures() const noexcept {
+        return _resize_failures;
+    }
+
+    // Calls func(n) for each element of the current table, with n the number
+    // of groups probed before the one holding it
+    template <typename Func>
+    void for_each_probe_length(Func func) const {
+        for (size_t i = 0; i < _table.capacity; ++i) {
+            if (_table.ctrl[i] < 0) {
+                continue;
+            }
+            size_t n = 0;
+            probe(_table, HashFn()(*_table.slots[i]), [&] (size_t g) {
+                return g == i / group_size || (++n, false);
+            });
+            func(n);
+        }
+    }
+};
+
+}
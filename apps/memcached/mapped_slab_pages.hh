@@ -0,0 +1,171 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/posix.hh>
+#include <seastar/core/slab.hh>
+#include <seastar/core/sstring.hh>
+#include <cstring>
+#include <vector>
+
+namespace memcache {
+
+using namespace seastar;
+
+// Slab pages in a shared file mapping, e.g. on hugetlbfs or a DAX file
+// system, so that a restarted process finds the items of the previous one.
+//
+// The first page holds a header with the layout of the file, followed by
+// the object size each page was allocated for, zero for free pages. The
+// items themselves are validated by the cache when it restores them.
+class mapped_slab_pages final : public slab_page_allocator {
+    struct header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t page_count;
+        uint64_t page_size;
+        // clock_type minus the wall clock, when the file was last used
+        int64_t wc_to_clock_type_delta;
+        uint32_t object_sizes[];
+    };
+    static constexpr uint64_t file_magic = 0x42414c53434d5353; // "SSMCSLAB"
+    static constexpr uint32_t format_version = 1;
+
+    file_desc _fd;
+    mmap_area _area;
+    size_t _page_size;
+    uint32_t _page_count;
+    std::vector<uint32_t> _free_pages;
+    bool _restored = false;
+    bool _detached = false;
+private:
+    header& hdr() const noexcept {
+        return *reinterpret_cast<header*>(_area.get());
+    }
+
+    char* page(uint32_t i) const noexcept {
+        return _area.get() + (size_t(i) + 1) * _page_size;
+    }
+
+    uint32_t index_of(void* p) const noexcept {
+        return (static_cast<char*>(p) - _area.get()) / _page_size - 1;
+    }
+public:
+    // Maps @page_count slab pages of @page_size bytes from the file at @path,
+    // creating or resetting it when it doesn't have this layout. Blocks, so
+    // it's only meant for start up.
+    mapped_slab_pages(sstring path, uint32_t page_count, size_t page_size)
+        : _fd(file_desc::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600))
+        , _page_size(page_size)
+        , _page_count(page_count)
+    {
+        if (sizeof(header) + sizeof(uint32_t) * page_count > page_size) {
+            throw std::invalid_argument("too many slab pages for a persistent slab file");
+        }
+        auto size = (size_t(page_count) + 1) * page_size;
+        bool reset = _fd.size() != size;
+        if (reset) {
+            // Truncating to zero first makes all the pages read back as zeros
+            _fd.truncate(0);
+            _fd.truncate(size);
+        }
+        _area = _fd.map_shared_rw(size, 0);
+        auto& h = hdr();
+        if (!reset && (h.magic != file_magic || h.version != format_version
+                || h.page_count != page_count || h.page_size != page_size)) {
+            reset = true;
+        }
+        if (reset) {
+            std::memset(&h, 0, page_size);
+            h.version = format_version;
+            h.page_count = page_count;
+            h.page_size = page_size;
+            h.magic = file_magic;
+        }
+        for (uint32_t i = page_count; i-- > 0;) {
+            if (!h.object_sizes[i]) {
+                _free_pages.push_back(i);
+            } else {
+                _restored = true;
+            }
+        }
+    }
+
+    // Whether pages were left by a previous process
+    bool restored() const noexcept {
+        return _restored;
+    }
+
+    // Calls func(page, object_size) for each page left by a previous process.
+    // Pages left alone are released with free_page().
+    template <typename Func>
+    void for_each_restored_page(Func func) {
+        for (uint32_t i = 0; i < _page_count; ++i) {
+            if (hdr().object_sizes[i]) {
+                func(page(i), hdr().object_sizes[i]);
+            }
+        }
+    }
+
+    int64_t previous_wc_to_clock_type_delta() const noexcept {
+        return hdr().wc_to_clock_type_delta;
+    }
+
+    void set_wc_to_clock_type_delta(int64_t delta) noexcept {
+        hdr().wc_to_clock_type_delta = delta;
+    }
+
+    void* allocate_page(size_t page_size, size_t alignment, size_t object_size) override {
+        if (_free_pages.empty() || page_size != _page_size) {
+            return nullptr;
+        }
+        auto i = _free_pages.back();
+        _free_pages.pop_back();
+        // Stale items of the page's previous use must not look valid
+        std::memset(page(i), 0, _page_size);
+        hdr().object_sizes[i] = object_size;
+        return page(i);
+    }
+
+    void reassign_page(void* p, size_t object_size) noexcept override {
+        hdr().object_sizes[index_of(p)] = object_size;
+        // Stale data at the new object offsets must not look like items
+        std::memset(p, 0, _page_size);
+    }
+
+    // Pages freed from now on, as the slab allocator is destroyed, are
+    // kept for the next process.
+    void detach() noexcept {
+        _detached = true;
+    }
+
+    void free_page(void* p) noexcept override {
+        if (_detached) {
+            return;
+        }
+        auto i = index_of(p);
+        hdr().object_sizes[i] = 0;
+        _free_pages.push_back(i);
+    }
+};
+
+}
@@ -19,12 +19,13 @@
  * Copyright 2014-2015 Cloudius Systems
  */
 
-#include <boost/intrusive/unordered_set.hpp>
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive_ptr.hpp>
 #include <boost/lexical_cast.hpp>
+#include <charconv>
 #include <iostream>
 #include <iomanip>
+#include <optional>
 #include <sstream>
 #include <seastar/core/app-template.hh>
 #include <seastar/core/reactor.hh>
@@ -40,6 +41,7 @@
 #include <seastar/core/bitops.hh>
 #include <seastar/core/slab.hh>
 #include <seastar/core/align.hh>
+#include <seastar/core/byteorder.hh>
 #include <seastar/core/print.hh>
 #include <seastar/net/api.hh>
 #include <seastar/net/packet-data-source.hh>
@@ -47,6 +49,9 @@
 #include <seastar/util/log.hh>
 #include "ascii.hh"
 #include "memcached.hh"
+#include "hash_index.hh"
+#include "frequency_sketch.hh"
+#include "mapped_slab_pages.hh"
 #include <unistd.h>
 
 #define PLATFORM "seastar"
@@ -136,15 +141,16 @@ class item : public slab_item_base {
     using duration = expiration::duration;
     static constexpr uint8_t field_alignment = alignof(void*);
 private:
-    using hook_type = bi::unordered_set_member_hook<>;
     // TODO: align shared data to cache line boundary
     version_type _version;
-    hook_type _cache_link;
     bi::list_member_hook<> _timer_link;
     size_t _key_hash;
     expiration _expiry;
     uint32_t _value_size;
     uint32_t _slab_page_index;
+    // live_marker while the item is in the cache, for restoring it from
+    // persistent slab pages
+    uint32_t _live;
     uint16_t _ref_count;
     uint8_t _key_size;
     uint8_t _ascii_prefix_size;
@@ -171,6 +177,62 @@ class item : public slab_item_base {
         // storing value
         memcpy(_data + align_up(_key_size, field_alignment) + align_up(_ascii_prefix_size, field_alignment),
                value.c_str(), _value_size);
+        // Last, so that an item half written when the process died isn't restored
+        __atomic_store_n(&_live, live_marker, __ATOMIC_RELEASE);
+    }
+private:
+    static constexpr uint32_t live_marker = 0x4c495645; // "LIVE"
+    struct restore_tag {};
+
+    // Takes over an item left by a previous process, whose data is kept
+    item(restore_tag, uint32_t slab_page_index, version_type version, size_t key_hash, expiration expiry,
+         uint32_t value_size, uint8_t key_size, uint8_t ascii_prefix_size)
+        : _version(version)
+        , _key_hash(key_hash)
+        , _expiry(expiry)
+        , _value_size(value_size)
+        , _slab_page_index(slab_page_index)
+        , _live(live_marker)
+        , _ref_count(1U)
+        , _key_size(key_size)
+        , _ascii_prefix_size(ascii_prefix_size)
+    {}
+public:
+    // Reconstructs the item a previous process left at @object, holding a
+    // reference for the cache, or returns nullptr if there's no valid one.
+    // @shift converts expiration times to the clock of this process.
+    static item* restore(void* object, uint32_t slab_page_index, size_t object_size, clock_type::duration shift) {
+        auto old = reinterpret_cast<item*>(object);
+        if (__atomic_load_n(&old->_live, __ATOMIC_ACQUIRE) != live_marker) {
+            return nullptr;
+        }
+        auto version = old->_version;
+        auto key_hash = old->_key_hash;
+        auto expiry = old->_expiry;
+        auto value_size = old->_value_size;
+        auto key_size = old->_key_size;
+        auto ascii_prefix_size = old->_ascii_prefix_size;
+        auto size = sizeof(item) + align_up<size_t>(key_size, field_alignment)
+            + align_up<size_t>(ascii_prefix_size, field_alignment) + value_size;
+        if (!key_size || size > object_size
+                || std::hash<std::string_view>()(std::string_view(old->_data, key_size)) != key_hash) {
+            old->kill();
+            return nullptr;
+        }
+        if (expiry.ever_expires()) {
+            expiry._time += shift;
+            if (expiry._time <= clock_type::now()) {
+                old->kill();
+                return nullptr;
+            }
+        }
+        return new (object) item(restore_tag{}, slab_page_index, version, key_hash, expiry,
+                value_size, key_size, ascii_prefix_size);
+    }
+
+    // Called when the item leaves the cache
+    void kill() {
+        __atomic_store_n(&_live, 0U, __ATOMIC_RELAXED);
     }
 
     item(const item&) = delete;
@@ -199,6 +261,21 @@ class item : public slab_item_base {
         return std::string_view(p, _value_size);
     }
 
+    // The flags of the item, as in " <flags> <size>" of the ASCII prefix
+    const std::string_view flags() const {
+        auto prefix = ascii_prefix().substr(1);
+        return prefix.substr(0, prefix.find(' '));
+    }
+
+    // Remaining time to live in seconds, -1 if the item never expires
+    int64_t ttl() {
+        if (!_expiry.ever_expires()) {
+            return -1;
+        }
+        auto left = std::chrono::duration_cast<std::chrono::seconds>(_expiry.to_time_point() - clock_type::now());
+        return std::max<int64_t>(left.count(), 0);
+    }
+
     size_t key_size() const {
         return _key_size;
     }
@@ -368,15 +445,12 @@ struct item_insertion_data {
 
 class cache {
 private:
-    using cache_type = bi::unordered_set<item,
-        bi::member_hook<item, item::hook_type, &item::_cache_link>,
-        bi::power_2_buckets<true>,
-        bi::constant_time_size<true>>;
-    using cache_iterator = typename cache_type::iterator;
-    static constexpr size_t initial_bucket_count = 1 << 10;
-    static constexpr float load_factor = 0.75f;
-    size_t _resize_up_threshold = load_factor * initial_bucket_count;
-    std::vector<cache_type::bucket_type> _buckets;
+    struct item_hash {
+        size_t operator()(const item& it) const noexcept {
+            return hash_value(it);
+        }
+    };
+    using cache_type = hash_index<item, item_hash>;
     cache_type _cache;
     seastar::timer_set<item, &item::_timer_link> _alive;
     timer<clock_type> _timer;
@@ -384,7 +458,17 @@ class cache {
     clock_type::duration _wc_to_clock_type_delta;
     cache_stats _stats;
     timer<clock_type> _flush_timer;
+    // Uses of keys, with the w_tinylfu eviction policy
+    std::optional<frequency_sketch> _sketch;
+    // Owned by the slab allocator, when items are persistent
+    mapped_slab_pages* _persistent_pages = nullptr;
 private:
+    void record_use(const item_key& key) {
+        if (_sketch) {
+            _sketch->record(key.hash());
+        }
+    }
+
     size_t item_size(item& item_ref) {
         constexpr size_t field_alignment = alignof(void*);
         return sizeof(item) +
@@ -415,8 +499,9 @@ class cache {
 
     template <bool IsInCache = true, bool IsInTimerList = true, bool Release = true>
     void erase(item& item_ref) {
+        item_ref.kill();
         if (IsInCache) {
-            _cache.erase(_cache.iterator_to(item_ref));
+            _cache.erase(item_ref);
         }
         if (IsInTimerList) {
             if (item_ref._expiry.ever_expires()) {
@@ -439,6 +524,9 @@ class cache {
         //
         _wc_to_clock_type_delta =
             duration_cast<clock_type::duration>(clock_type::now().time_since_epoch() - system_clock::now().time_since_epoch());
+        if (_persistent_pages) {
+            _persistent_pages->set_wc_to_clock_type_delta(_wc_to_clock_type_delta.count());
+        }
 
         auto exp = _alive.expire(clock_type::now());
         while (!exp.empty()) {
@@ -451,13 +539,13 @@ class cache {
     }
 
     inline
-    cache_iterator find(const item_key& key) {
-        return _cache.find(key, std::hash<item_key>(), item_key_cmp());
+    item* find(const item_key& key) {
+        return _cache.find(key, key.hash(), item_key_cmp());
     }
 
     template <typename Origin>
     inline
-    cache_iterator add_overriding(cache_iterator i, item_insertion_data& insertion) {
+    item* add_overriding(item* i, item_insertion_data& insertion) {
         auto& old_item = *i;
         uint64_t old_item_version = old_item._version;
 
@@ -467,14 +555,12 @@ class cache {
         auto new_item = slab->create(size, Origin::move_if_local(insertion.key), Origin::move_if_local(insertion.ascii_prefix),
             Origin::move_if_local(insertion.data), insertion.expiry, old_item_version + 1);
         intrusive_ptr_add_ref(new_item);
-
-        auto insert_result = _cache.insert(*new_item);
-        assert(insert_result.second);
+        insert(*new_item);
         if (insertion.expiry.ever_expires() && _alive.insert(*new_item)) {
             _timer.rearm(new_item->get_timeout());
         }
         _stats._bytes += size;
-        return insert_result.first;
+        return new_item;
     }
 
     template <typename Origin>
@@ -485,32 +571,67 @@ class cache {
             Origin::move_if_local(insertion.data), insertion.expiry);
         intrusive_ptr_add_ref(new_item);
         auto& item_ref = *new_item;
-        _cache.insert(item_ref);
+        insert(item_ref);
         if (insertion.expiry.ever_expires() && _alive.insert(item_ref)) {
             _timer.rearm(item_ref.get_timeout());
         }
         _stats._bytes += size;
-        maybe_rehash();
     }
 
-    void maybe_rehash() {
-        if (_cache.size() >= _resize_up_threshold) {
-            auto new_size = _cache.bucket_count() * 2;
-            std::vector<cache_type::bucket_type> old_buckets;
-            try {
-                old_buckets = std::exchange(_buckets, std::vector<cache_type::bucket_type>(new_size));
-            } catch (const std::bad_alloc& e) {
-                _stats._resize_failure++;
-                return;
+    // Rebuilds the index from the items that a previous process left in the
+    // persistent slab pages. Items that expired meanwhile, or that belong to
+    // another shard because the number of shards changed, are dropped.
+    void restore_items() {
+        auto shift = _wc_to_clock_type_delta - clock_type::duration(_persistent_pages->previous_wc_to_clock_type_delta());
+        std::vector<item*> restored;
+        _persistent_pages->for_each_restored_page([&] (void* page, size_t object_size) {
+            bool adopted = slab->adopt_page(page, object_size, [&] (void* object, uint32_t slab_page_index) {
+                auto it = item::restore(object, slab_page_index, object_size, shift);
+                if (it && hash_value(*it) % smp::count != this_shard_id()) {
+                    it->kill();
+                    it = nullptr;
+                }
+                if (it) {
+                    restored.push_back(it);
+                }
+                return it;
+            });
+            if (!adopted) {
+                _persistent_pages->free_page(page);
+            }
+        });
+        for (auto it : restored) {
+            _stats._bytes += item_size(*it);
+            auto key = item_key(sstring(it->key()));
+            auto existing = _cache.find(key, key.hash(), item_key_cmp());
+            if (existing) {
+                // Only if the previous process died while replacing it
+                if (existing->_version >= it->_version) {
+                    erase<false, false>(*it);
+                    continue;
+                }
+                erase(*existing);
+            }
+            _cache.insert(*it);
+            if (it->_expiry.ever_expires() && _alive.insert(*it)) {
+                _timer.rearm(it->get_timeout());
             }
-            _cache.rehash(typename cache_type::bucket_traits(_buckets.data(), new_size));
-            _resize_up_threshold = _cache.bucket_count() * load_factor;
+        }
+        std::cout << "shard " << this_shard_id() << ": restored " << _cache.size() << " items\n";
+    }
+
+    void insert(item& item_ref) {
+        try {
+            _cache.insert(item_ref);
+        } catch (const std::bad_alloc&) {
+            // The index is full and couldn't grow
+            intrusive_ptr_release(&item_ref);
+            throw;
         }
     }
 public:
-    cache(uint64_t per_cpu_slab_size, uint64_t slab_page_size)
-        : _buckets(initial_bucket_count)
-        , _cache(cache_type::bucket_traits(_buckets.data(), initial_bucket_count))
+    cache(uint64_t per_cpu_slab_size, uint64_t slab_page_size, slab_eviction_policy eviction_policy, uint64_t expected_items,
+          sstring persistent_dir, std::chrono::milliseconds slab_automove_period)
     {
         using namespace std::chrono;
 
@@ -524,6 +645,30 @@ class cache {
         slab_holder = std::make_unique<slab_allocator<item>>(default_slab_growth_factor, per_cpu_slab_size, slab_page_size,
                 [this](item& item_ref) { erase<true, true, false>(item_ref); _stats._evicted++; });
         slab = slab_holder.get();
+        if (!persistent_dir.empty()) {
+            auto pages = std::make_unique<mapped_slab_pages>(format("{}/memcached-shard-{}.slab", persistent_dir, this_shard_id()),
+                    per_cpu_slab_size / slab_page_size, slab_page_size);
+            _persistent_pages = pages.get();
+            slab->set_page_allocator(std::move(pages));
+        }
+        if (eviction_policy == slab_eviction_policy::w_tinylfu) {
+            // About one counter per item this shard holds
+            _sketch.emplace(expected_items / smp::count);
+            slab->set_eviction_policy(eviction_policy, [this] (item& candidate, item& victim) {
+                return _sketch->estimate(hash_value(candidate)) > _sketch->estimate(hash_value(victim));
+            });
+        } else {
+            slab->set_eviction_policy(eviction_policy);
+        }
+        if (slab_automove_period.count()) {
+            slab->enable_rebalancing(slab_automove_period);
+        }
+        if (_persistent_pages) {
+            if (_persistent_pages->restored()) {
+                restore_items();
+            }
+            _persistent_pages->set_wc_to_clock_type_delta(_wc_to_clock_type_delta.count());
+        }
 #ifdef __DEBUG__
         static bool print_slab_classes = true;
         if (print_slab_classes) {
@@ -534,12 +679,19 @@ class cache {
     }
 
     ~cache() {
+        slab->disable_rebalancing();
+        if (_persistent_pages) {
+            // Leave the items to the next process
+            _flush_timer.cancel();
+            _persistent_pages->detach();
+            return;
+        }
        flush_all();
     }
 
     void flush_all() {
         _flush_timer.cancel();
-        _cache.erase_and_dispose(_cache.begin(), _cache.end(), [this] (item* it) {
+        _cache.clear_and_dispose([this] (item* it) {
             erase<false, true>(*it);
         });
     }
@@ -552,7 +704,7 @@ class cache {
     template <typename Origin = local_origin_tag>
     bool set(item_insertion_data& insertion) {
         auto i = find(insertion.key);
-        if (i != _cache.end()) {
+        if (i) {
             add_overriding<Origin>(i, insertion);
             _stats._set_replaces++;
             return true;
@@ -566,7 +718,7 @@ class cache {
     template <typename Origin = local_origin_tag>
     bool add(item_insertion_data& insertion) {
         auto i = find(insertion.key);
-        if (i != _cache.end()) {
+        if (i) {
             return false;
         }
 
@@ -578,7 +730,7 @@ class cache {
     template <typename Origin = local_origin_tag>
     bool replace(item_insertion_data& insertion) {
         auto i = find(insertion.key);
-        if (i == _cache.end()) {
+        if (!i) {
             return false;
         }
 
@@ -589,7 +741,7 @@ class cache {
 
     bool remove(const item_key& key) {
         auto i = find(key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._delete_misses++;
             return false;
         }
@@ -599,13 +751,29 @@ class cache {
         return true;
     }
 
+    cas_result cas_remove(const item_key& key, item::version_type version) {
+        auto i = find(key);
+        if (!i) {
+            _stats._delete_misses++;
+            return cas_result::not_found;
+        }
+        auto& item_ref = *i;
+        if (item_ref._version != version) {
+            return cas_result::bad_version;
+        }
+        _stats._delete_hits++;
+        erase(item_ref);
+        return cas_result::stored;
+    }
+
     item_ptr get(const item_key& key) {
         auto i = find(key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._get_misses++;
             return nullptr;
         }
         _stats._get_hits++;
+        record_use(key);
         auto& item_ref = *i;
         return item_ptr(&item_ref);
     }
@@ -613,7 +781,7 @@ class cache {
     template <typename Origin = local_origin_tag>
     cas_result cas(item_insertion_data& insertion, item::version_type version) {
         auto i = find(insertion.key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._cas_misses++;
             return cas_result::not_found;
         }
@@ -632,18 +800,19 @@ class cache {
     }
 
     size_t bucket_count() {
-        return _cache.bucket_count();
+        return _cache.capacity();
     }
 
     cache_stats stats() {
         _stats._size = size();
+        _stats._resize_failure = _cache.resize_failures();
         return _stats;
     }
 
     template <typename Origin = local_origin_tag>
     std::pair<item_ptr, bool> incr(item_key& key, uint64_t delta) {
         auto i = find(key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._incr_misses++;
             return {item_ptr{}, false};
         }
@@ -660,13 +829,13 @@ class cache {
             .expiry = item_ref._expiry
         };
         i = add_overriding<local_origin_tag>(i, insertion);
-        return {boost::intrusive_ptr<item>(&*i), true};
+        return {boost::intrusive_ptr<item>(i), true};
     }
 
     template <typename Origin = local_origin_tag>
     std::pair<item_ptr, bool> decr(item_key& key, uint64_t delta) {
         auto i = find(key);
-        if (i == _cache.end()) {
+        if (!i) {
             _stats._decr_misses++;
             return {item_ptr{}, false};
         }
@@ -683,35 +852,36 @@ class cache {
             .expiry = item_ref._expiry
         };
         i = add_overriding<local_origin_tag>(i, insertion);
-        return {boost::intrusive_ptr<item>(&*i), true};
+        return {boost::intrusive_ptr<item>(i), true};
     }
 
     std::pair<unsigned, foreign_ptr<lw_shared_ptr<std::string>>> print_hash_stats() {
         static constexpr unsigned bits = sizeof(size_t) * 8;
         size_t histo[bits + 1] {};
-        size_t max_size = 0;
+        size_t max_probe = 0;
         unsigned max_bucket = 0;
 
-        for (size_t i = 0; i < _cache.bucket_count(); i++) {
-            size_t size = _cache.bucket_size(i);
+        _cache.for_each_probe_length([&] (size_t n) {
             unsigned bucket;
-            if (size == 0) {
+            if (n == 0) {
                 bucket = 0;
             } else {
-                bucket = bits - count_leading_zeros(size);
+                bucket = bits - count_leading_zeros(n);
             }
             max_bucket = std::max(max_bucket, bucket);
-            max_size = std::max(max_size, size);
+            max_probe = std::max(max_probe, n);
             histo[bucket]++;
-        }
+        });
 
         std::stringstream ss;
 
         ss << "size: " << _cache.size() << "\n";
-        ss << "buckets: " << _cache.bucket_count() << "\n";
-        ss << "load: " << format("{:.2f}", (double)_cache.size() / _cache.bucket_count()) << "\n";
-        ss << "max bucket occupancy: " << max_size << "\n";
-        ss << "bucket occupancy histogram:\n";
+        ss << "slots: " << _cache.capacity() << "\n";
+        ss << "load: " << format("{:.2f}", (double)_cache.size() / _cache.capacity()) << "\n";
+        ss << "deleted slots: " << _cache.deleted_slots() << "\n";
+        ss << "resizing: " << (_cache.resizing() ? "yes" : "no") << "\n";
+        ss << "max probe length: " << max_probe << "\n";
+        ss << "probe length histogram (groups skipped):\n";
 
         for (unsigned i = 0; i < (max_bucket + 2); i++) {
             ss << "  ";
@@ -785,12 +955,60 @@ class sharded_cache {
         return _peers.invoke_on(cpu, &cache::remove, std::ref(key));
     }
 
+    // Removes the item only if its version is @version.
+    // The caller must keep @key live until the resulting future resolves.
+    future<cas_result> cas_remove(const item_key& key, item::version_type version) {
+        auto cpu = get_cpu(key);
+        return _peers.invoke_on(cpu, [&key, version] (cache& c) {
+            return c.cas_remove(key, version);
+        });
+    }
+
     // The caller must keep @key live until the resulting future resolves.
     future<item_ptr> get(const item_key& key) {
         auto cpu = get_cpu(key);
         return _peers.invoke_on(cpu, &cache::get, std::ref(key));
     }
 
+    // Looks the keys up with one cross-shard call per owner shard. The items
+    // are returned in the order of @keys, null for the missing ones.
+    // The caller must keep @keys live until the resulting future resolves.
+    future<std::vector<item_ptr>> get_many(const std::vector<item_key>& keys) {
+        std::vector<std::vector<size_t>> by_cpu(smp::count);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            by_cpu[get_cpu(keys[i])].push_back(i);
+        }
+        return do_with(std::move(by_cpu), std::vector<item_ptr>(keys.size()),
+                [this, &keys] (std::vector<std::vector<size_t>>& by_cpu, std::vector<item_ptr>& items) {
+            return parallel_for_each(smp::all_cpus(), [this, &keys, &by_cpu, &items] (unsigned cpu) {
+                auto& indexes = by_cpu[cpu];
+                if (indexes.empty()) {
+                    return make_ready_future<>();
+                }
+                auto lookup = [&keys, &indexes] (cache& c) {
+                    std::vector<item_ptr> found;
+                    found.reserve(indexes.size());
+                    for (auto i : indexes) {
+                        found.emplace_back(c.get(keys[i]));
+                    }
+                    return found;
+                };
+                auto place = [&indexes, &items] (std::vector<item_ptr> found) {
+                    for (size_t i = 0; i < indexes.size(); ++i) {
+                        items[indexes[i]] = std::move(found[i]);
+                    }
+                };
+                if (cpu == this_shard_id()) {
+                    place(lookup(_peers.local()));
+                    return make_ready_future<>();
+                }
+                return _peers.invoke_on(cpu, lookup).then(place);
+            }).then([&items] {
+                return std::move(items);
+            });
+        });
+    }
+
     // The caller must keep @insertion live until the resulting future resolves.
     future<cas_result> cas(item_insertion_data& insertion, item::version_type version) {
         auto cpu = get_cpu(insertion.key);
@@ -862,6 +1080,16 @@ struct system_stats {
     future<> stop() { return make_ready_future<>(); }
 };
 
+template <typename T>
+static optional<T> parse_number(std::string_view token) {
+    T value;
+    auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (token.empty() || ec != std::errc() || ptr != token.data() + token.size()) {
+        return {};
+    }
+    return value;
+}
+
 class ascii_protocol {
 private:
     using this_type = ascii_protocol;
@@ -870,7 +1098,6 @@ class ascii_protocol {
     memcache_ascii_parser _parser;
     item_key _item_key;
     item_insertion_data _insertion;
-    std::vector<item_ptr> _items;
 private:
     static constexpr const char *msg_crlf = "\r\n";
     static constexpr const char *msg_error = "ERROR\r\n";
@@ -886,6 +1113,15 @@ class ascii_protocol {
     static constexpr const char *msg_stat = "STAT ";
     static constexpr const char *msg_out_of_memory = "SERVER_ERROR Out of memory allocating new item\r\n";
     static constexpr const char *msg_error_non_numeric_value = "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n";
+    static constexpr const char *msg_error_invalid_flag = "CLIENT_ERROR invalid flag\r\n";
+    // Meta command responses
+    static constexpr const char *msg_meta_value = "VA ";
+    static constexpr const char *msg_meta_hit = "HD";
+    static constexpr const char *msg_meta_miss = "EN\r\n";
+    static constexpr const char *msg_meta_not_stored = "NS";
+    static constexpr const char *msg_meta_exists = "EX";
+    static constexpr const char *msg_meta_not_found = "NF";
+    static constexpr const char *msg_meta_noop = "MN\r\n";
 private:
     template <bool WithVersion>
     static void append_item(scattered_message<char>& msg, item_ptr item) {
@@ -919,14 +1155,9 @@ class ascii_protocol {
                 return out.write(std::move(msg));
             });
         } else {
-            _items.clear();
-            return parallel_for_each(_parser._keys.begin(), _parser._keys.end(), [this] (const auto& key) {
-                return _cache.get(key).then([this] (auto item) {
-                    _items.emplace_back(std::move(item));
-                });
-            }).then([this, &out] () {
+            return _cache.get_many(_parser._keys).then([&out] (std::vector<item_ptr> items) {
                 scattered_message<char> msg;
-                for (auto& item : _items) {
+                for (auto& item : items) {
                     append_item<WithVersion>(msg, std::move(item));
                 }
                 msg.append_static(msg_end);
@@ -935,6 +1166,189 @@ class ascii_protocol {
         }
     }
 
+    // The return flags of a meta command response, in the order they were
+    // requested. The ones describing the item are only known for mg.
+    sstring meta_return_flags(std::string_view key, item* item = nullptr) {
+        std::string ret;
+        for (auto& f : _parser._meta_flags) {
+            switch (f[0]) {
+            case 'O':
+                fmt::format_to(std::back_inserter(ret), " {}", f);
+                break;
+            case 'k':
+                fmt::format_to(std::back_inserter(ret), " k{}", key);
+                break;
+            case 'c':
+                if (item) {
+                    fmt::format_to(std::back_inserter(ret), " c{}", item->version());
+                }
+                break;
+            case 'f':
+                if (item) {
+                    fmt::format_to(std::back_inserter(ret), " f{}", item->flags());
+                }
+                break;
+            case 's':
+                if (item) {
+                    fmt::format_to(std::back_inserter(ret), " s{}", item->value_size());
+                }
+                break;
+            case 't':
+                if (item) {
+                    fmt::format_to(std::back_inserter(ret), " t{}", item->ttl());
+                }
+                break;
+            }
+        }
+        return sstring(ret);
+    }
+
+    future<> handle_meta_get(output_stream<char>& out) {
+        bool quiet = false;
+        bool with_value = false;
+        for (auto& f : _parser._meta_flags) {
+            switch (f[0]) {
+            case 'q': quiet = true; break;
+            case 'v': with_value = true; break;
+            case 'c': case 'f': case 'k': case 's': case 't': case 'O': break;
+            default: return out.write(msg_error_invalid_flag);
+            }
+        }
+        _system_stats.local()._cmd_get++;
+        return _cache.get(_parser._key).then([this, &out, quiet, with_value] (item_ptr item) {
+            if (!item) {
+                return quiet ? make_ready_future<>() : out.write(msg_meta_miss);
+            }
+            auto flags = meta_return_flags(item->key(), &*item);
+            scattered_message<char> msg;
+            if (with_value) {
+                msg.append(make_sstring(msg_meta_value, to_sstring(item->value_size()), flags, msg_crlf));
+                msg.append_static(item->value());
+                msg.append_static(msg_crlf);
+            } else {
+                msg.append(make_sstring(msg_meta_hit, flags, msg_crlf));
+            }
+            msg.on_delete([item = std::move(item)] {});
+            return out.write(std::move(msg));
+        });
+    }
+
+    future<> meta_respond(output_stream<char>& out, future<const char*> f, bool quiet, sstring flags) {
+        return f.then([&out, quiet, flags = std::move(flags)] (const char* status) {
+            if (quiet && status == msg_meta_hit) {
+                return make_ready_future<>();
+            }
+            return out.write(make_sstring(status, flags, msg_crlf));
+        });
+    }
+
+    future<> handle_meta_set(output_stream<char>& out) {
+        bool quiet = false;
+        optional<item::version_type> version;
+        sstring flags = "0";
+        uint32_t ttl = 0;
+        char mode = 'S';
+        for (auto& f : _parser._meta_flags) {
+            auto token = std::string_view(f).substr(1);
+            switch (f[0]) {
+            case 'q': quiet = true; break;
+            case 'k': case 'O': break;
+            case 'F':
+                if (!parse_number<uint32_t>(token)) {
+                    return out.write(msg_error_invalid_flag);
+                }
+                flags = sstring(token);
+                break;
+            case 'T':
+                if (auto v = parse_number<uint64_t>(token); v && *v <= std::numeric_limits<uint32_t>::max()) {
+                    ttl = *v;
+                    break;
+                }
+                return out.write(msg_error_invalid_flag);
+            case 'C':
+                if (!(version = parse_number<uint64_t>(token))) {
+                    return out.write(msg_error_invalid_flag);
+                }
+                break;
+            case 'M':
+                // Append and prepend aren't supported by the cache
+                if (token.size() == 1 && strchr("SERser", token[0])) {
+                    mode = toupper(token[0]);
+                    break;
+                }
+                return out.write(msg_error_invalid_flag);
+            default:
+                return out.write(msg_error_invalid_flag);
+            }
+        }
+        _system_stats.local()._cmd_set++;
+        auto return_flags = meta_return_flags(_parser._key.key());
+        _insertion = item_insertion_data{
+            .key = std::move(_parser._key),
+            .ascii_prefix = make_sstring(" ", flags, " ", _parser._size_str),
+            .data = std::move(_parser._blob),
+            .expiry = expiration(_cache.get_wc_to_clock_type_delta(), ttl)
+        };
+        future<const char*> f = make_ready_future<const char*>(msg_meta_hit);
+        if (version) {
+            f = _cache.cas(_insertion, *version).then([] (cas_result result) {
+                switch (result) {
+                case cas_result::stored: return msg_meta_hit;
+                case cas_result::not_found: return msg_meta_not_found;
+                case cas_result::bad_version: return msg_meta_exists;
+                }
+                std::abort();
+            });
+        } else if (mode == 'E') {
+            f = _cache.add(_insertion).then([] (bool added) {
+                return added ? msg_meta_hit : msg_meta_not_stored;
+            });
+        } else if (mode == 'R') {
+            f = _cache.replace(_insertion).then([] (bool replaced) {
+                return replaced ? msg_meta_hit : msg_meta_not_stored;
+            });
+        } else {
+            f = _cache.set(_insertion).then([] (bool) {
+                return msg_meta_hit;
+            });
+        }
+        return meta_respond(out, std::move(f), quiet, std::move(return_flags));
+    }
+
+    future<> handle_meta_delete(output_stream<char>& out) {
+        bool quiet = false;
+        optional<item::version_type> version;
+        for (auto& f : _parser._meta_flags) {
+            switch (f[0]) {
+            case 'q': quiet = true; break;
+            case 'k': case 'O': break;
+            case 'C':
+                if (!(version = parse_number<uint64_t>(std::string_view(f).substr(1)))) {
+                    return out.write(msg_error_invalid_flag);
+                }
+                break;
+            default:
+                return out.write(msg_error_invalid_flag);
+            }
+        }
+        future<const char*> f = make_ready_future<const char*>(msg_meta_hit);
+        if (version) {
+            f = _cache.cas_remove(_parser._key, *version).then([] (cas_result result) {
+                switch (result) {
+                case cas_result::stored: return msg_meta_hit;
+                case cas_result::not_found: return msg_meta_not_found;
+                case cas_result::bad_version: return msg_meta_exists;
+                }
+                std::abort();
+            });
+        } else {
+            f = _cache.remove(_parser._key).then([] (bool removed) {
+                return removed ? msg_meta_hit : msg_meta_not_found;
+            });
+        }
+        return meta_respond(out, std::move(f), quiet, meta_return_flags(_parser._key.key()));
+    }
+
     template <typename Value>
     static future<> print_stat(output_stream<char>& out, const char* key, Value value) {
         return out.write(msg_stat)
@@ -1181,6 +1595,18 @@ class ascii_protocol {
                     });
                 }
 
+                case memcache_ascii_parser::state::cmd_mg:
+                    return handle_meta_get(out);
+
+                case memcache_ascii_parser::state::cmd_ms:
+                    return handle_meta_set(out);
+
+                case memcache_ascii_parser::state::cmd_md:
+                    return handle_meta_delete(out);
+
+                case memcache_ascii_parser::state::cmd_mn:
+                    return out.write(msg_meta_noop);
+
                 case memcache_ascii_parser::state::cmd_decr:
                 {
                     auto f = _cache.decr(_parser._key, _parser._u64);
@@ -1219,6 +1645,426 @@ class ascii_protocol {
     };
 };
 
+// The binary protocol. Quiet commands only respond on failure (or never,
+// for getq and getkq misses), so that clients can pipeline them and find
+// out where the responses end with a noop.
+class binary_protocol {
+public:
+    static constexpr uint8_t request_magic = 0x80;
+private:
+    static constexpr uint8_t response_magic = 0x81;
+    static constexpr size_t header_size = 24;
+    static constexpr size_t max_key_length = 250;
+    static constexpr uint32_t max_body_length = default_slab_page_size;
+    // The expiration of incr and decr that disables creating missing items
+    static constexpr uint32_t no_auto_create = 0xffffffff;
+
+    enum class opcode : uint8_t {
+        get = 0x00,
+        set = 0x01,
+        add = 0x02,
+        replace = 0x03,
+        del = 0x04,
+        increment = 0x05,
+        decrement = 0x06,
+        quit = 0x07,
+        flush = 0x08,
+        getq = 0x09,
+        noop = 0x0a,
+        version = 0x0b,
+        getk = 0x0c,
+        getkq = 0x0d,
+        setq = 0x11,
+        addq = 0x12,
+        replaceq = 0x13,
+        delq = 0x14,
+        incrementq = 0x15,
+        decrementq = 0x16,
+        quitq = 0x17,
+        flushq = 0x18,
+    };
+
+    enum class status : uint16_t {
+        ok = 0x00,
+        key_not_found = 0x01,
+        key_exists = 0x02,
+        value_too_large = 0x03,
+        invalid_arguments = 0x04,
+        item_not_stored = 0x05,
+        non_numeric_value = 0x06,
+        unknown_command = 0x81,
+        out_of_memory = 0x82,
+    };
+
+    struct request_header {
+        uint8_t magic;
+        opcode op;
+        uint16_t key_length;
+        uint8_t extras_length;
+        uint32_t body_length;
+        uint32_t opaque;
+        uint64_t cas;
+    };
+
+    sharded_cache& _cache;
+    distributed<system_stats>& _system_stats;
+    request_header _header;
+    temporary_buffer<char> _body;
+    item_key _key;
+    item_insertion_data _insertion;
+    bool _quit = false;
+private:
+    static bool is_quiet(opcode op) {
+        switch (op) {
+        case opcode::getq: case opcode::getkq: case opcode::setq: case opcode::addq:
+        case opcode::replaceq: case opcode::delq: case opcode::incrementq:
+        case opcode::decrementq: case opcode::quitq: case opcode::flushq:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static opcode loud(opcode op) {
+        switch (op) {
+        case opcode::getq: return opcode::get;
+        case opcode::getkq: return opcode::getk;
+        case opcode::setq: return opcode::set;
+        case opcode::addq: return opcode::add;
+        case opcode::replaceq: return opcode::replace;
+        case opcode::delq: return opcode::del;
+        case opcode::incrementq: return opcode::increment;
+        case opcode::decrementq: return opcode::decrement;
+        case opcode::quitq: return opcode::quit;
+        case opcode::flushq: return opcode::flush;
+        default: return op;
+        }
+    }
+
+    static const char* status_message(status st) {
+        switch (st) {
+        case status::ok: return "";
+        case status::key_not_found: return "Not found";
+        case status::key_exists: return "Data exists for key";
+        case status::value_too_large: return "Too large";
+        case status::invalid_arguments: return "Invalid arguments";
+        case status::item_not_stored: return "Not stored";
+        case status::non_numeric_value: return "Non-numeric server-side value for incr or decr";
+        case status::unknown_command: return "Unknown command";
+        case status::out_of_memory: return "Out of memory";
+        }
+        return "";
+    }
+
+    std::string_view extras() const {
+        return std::string_view(_body.get(), _header.extras_length);
+    }
+
+    std::string_view key() const {
+        return std::string_view(_body.get() + _header.extras_length, _header.key_length);
+    }
+
+    std::string_view value() const {
+        auto offset = _header.extras_length + _header.key_length;
+        return std::string_view(_body.get() + offset, _body.size() - offset);
+    }
+
+    sstring make_response_header(status st, size_t extras_length, size_t key_length, size_t value_length, uint64_t cas = 0) {
+        auto ret = uninitialized_string(header_size);
+        auto p = ret.data();
+        p[0] = response_magic;
+        p[1] = uint8_t(_header.op);
+        write_be<uint16_t>(p + 2, key_length);
+        p[4] = extras_length;
+        p[5] = 0;
+        write_be<uint16_t>(p + 6, uint16_t(st));
+        write_be<uint32_t>(p + 8, extras_length + key_length + value_length);
+        write_be<uint32_t>(p + 12, _header.opaque);
+        write_be<uint64_t>(p + 16, cas);
+        return ret;
+    }
+
+    future<> respond(output_stream<char>& out, status st, std::string_view value = {}, uint64_t cas = 0) {
+        if (st != status::ok && value.empty()) {
+            value = status_message(st);
+        }
+        scattered_message<char> msg;
+        msg.append(make_response_header(st, 0, 0, value.size(), cas));
+        msg.append(sstring(value));
+        return out.write(std::move(msg));
+    }
+
+    // Responds to quiet commands on failure only
+    future<> maybe_respond(output_stream<char>& out, status st) {
+        if (st == status::ok && is_quiet(_header.op)) {
+            return make_ready_future<>();
+        }
+        return respond(out, st);
+    }
+
+    future<> handle_get(output_stream<char>& out, bool with_key) {
+        _system_stats.local()._cmd_get++;
+        _key = item_key(sstring(key()));
+        return _cache.get(_key).then([this, &out, with_key] (item_ptr item) {
+            if (!item) {
+                if (is_quiet(_header.op)) {
+                    return make_ready_future<>();
+                }
+                auto message = std::string_view(status_message(status::key_not_found));
+                auto key_length = with_key ? _header.key_length : 0;
+                scattered_message<char> msg;
+                msg.append(make_response_header(status::key_not_found, 0, key_length, message.size()));
+                msg.append(sstring(key().substr(0, key_length)));
+                msg.append_static(message);
+                return out.write(std::move(msg));
+            }
+            auto flags = uninitialized_string(4);
+            write_be<uint32_t>(flags.data(), parse_number<uint32_t>(item->flags()).value_or(0));
+            auto key_length = with_key ? item->key_size() : 0;
+            scattered_message<char> msg;
+            msg.append(make_response_header(status::ok, flags.size(), key_length, item->value_size(), item->version()));
+            msg.append(std::move(flags));
+            if (with_key) {
+                msg.append_static(item->key());
+            }
+            msg.append_static(item->value());
+            msg.on_delete([item = std::move(item)] {});
+            return out.write(std::move(msg));
+        });
+    }
+
+    future<> handle_store(output_stream<char>& out, opcode op) {
+        _system_stats.local()._cmd_set++;
+        auto flags = read_be<uint32_t>(extras().data());
+        auto exptime = read_be<uint32_t>(extras().data() + 4);
+        _insertion = item_insertion_data{
+            .key = item_key(sstring(key())),
+            .ascii_prefix = make_sstring(" ", to_sstring(flags), " ", to_sstring(value().size())),
+            .data = sstring(value()),
+            .expiry = expiration(_cache.get_wc_to_clock_type_delta(), exptime)
+        };
+        // The version of the stored item isn't known here, so responses
+        // carry no CAS value; clients wanting one have to get the item.
+        future<status> f = make_ready_future<status>(status::ok);
+        if (_header.cas) {
+            f = _cache.cas(_insertion, _header.cas).then([] (cas_result result) {
+                switch (result) {
+                case cas_result::stored: return status::ok;
+                case cas_result::not_found: return status::key_not_found;
+                case cas_result::bad_version: return status::key_exists;
+                }
+                std::abort();
+            });
+        } else if (op == opcode::add) {
+            f = _cache.add(_insertion).then([] (bool added) {
+                return added ? status::ok : status::key_exists;
+            });
+        } else if (op == opcode::replace) {
+            f = _cache.replace(_insertion).then([] (bool replaced) {
+                return replaced ? status::ok : status::key_not_found;
+            });
+        } else {
+            f = _cache.set(_insertion).then([] (bool) {
+                return status::ok;
+            });
+        }
+        return f.then([this, &out] (status st) {
+            return maybe_respond(out, st);
+        });
+    }
+
+    future<> handle_delete(output_stream<char>& out) {
+        _key = item_key(sstring(key()));
+        future<status> f = make_ready_future<status>(status::ok);
+        if (_header.cas) {
+            f = _cache.cas_remove(_key, _header.cas).then([] (cas_result result) {
+                switch (result) {
+                case cas_result::stored: return status::ok;
+                case cas_result::not_found: return status::key_not_found;
+                case cas_result::bad_version: return status::key_exists;
+                }
+                std::abort();
+            });
+        } else {
+            f = _cache.remove(_key).then([] (bool removed) {
+                return removed ? status::ok : status::key_not_found;
+            });
+        }
+        return f.then([this, &out] (status st) {
+            return maybe_respond(out, st);
+        });
+    }
+
+    future<> respond_counter(output_stream<char>& out, uint64_t value, uint64_t cas) {
+        if (is_quiet(_header.op)) {
+            return make_ready_future<>();
+        }
+        char buf[8];
+        write_be<uint64_t>(buf, value);
+        return respond(out, status::ok, std::string_view(buf, sizeof(buf)), cas);
+    }
+
+    future<> handle_arithmetic(output_stream<char>& out, opcode op) {
+        auto delta = read_be<uint64_t>(extras().data());
+        auto initial = read_be<uint64_t>(extras().data() + 8);
+        auto exptime = read_be<uint32_t>(extras().data() + 16);
+        _key = item_key(sstring(key()));
+        auto f = op == opcode::increment ? _cache.incr(_key, delta) : _cache.decr(_key, delta);
+        return std::move(f).then([this, &out, op, initial, exptime] (std::pair<item_ptr, bool> result) {
+            auto& item = result.first;
+            if (item && !result.second) {
+                return respond(out, status::non_numeric_value);
+            } else if (item) {
+                return respond_counter(out, item->data_as_integral().value_or(0), item->version());
+            } else if (exptime == no_auto_create) {
+                return respond(out, status::key_not_found);
+            }
+            auto value = to_sstring(initial);
+            _insertion = item_insertion_data{
+                .key = item_key(sstring(key())),
+                .ascii_prefix = make_sstring(" 0 ", to_sstring(value.size())),
+                .data = std::move(value),
+                .expiry = expiration(_cache.get_wc_to_clock_type_delta(), exptime)
+            };
+            return _cache.add(_insertion).then([this, &out, op, initial] (bool added) {
+                if (!added) {
+                    // Lost a race with another client creating it
+                    return handle_arithmetic(out, op);
+                }
+                return respond_counter(out, initial, 0);
+            });
+        });
+    }
+
+    future<> handle_flush(output_stream<char>& out) {
+        _system_stats.local()._cmd_flush++;
+        auto exptime = _header.extras_length ? read_be<uint32_t>(extras().data()) : 0;
+        auto f = exptime ? _cache.flush_at(exptime) : _cache.flush_all();
+        return f.then([this, &out] {
+            return maybe_respond(out, status::ok);
+        });
+    }
+
+    future<> dispatch(output_stream<char>& out) {
+        auto op = loud(_header.op);
+        auto extras_length = _header.extras_length;
+        bool has_key = _header.key_length;
+        bool has_value = !value().empty();
+        auto valid = [&] (uint8_t expected_extras_length, bool needs_key, bool may_have_value = false) {
+            return extras_length == expected_extras_length && has_key == needs_key && (may_have_value || !has_value);
+        };
+        switch (op) {
+        case opcode::get:
+        case opcode::getk:
+            if (!valid(0, true)) {
+                break;
+            }
+            return handle_get(out, op == opcode::getk);
+        case opcode::set:
+        case opcode::add:
+        case opcode::replace:
+            if (!valid(8, true, true)) {
+                break;
+            }
+            return handle_store(out, op);
+        case opcode::del:
+            if (!valid(0, true)) {
+                break;
+            }
+            return handle_delete(out);
+        case opcode::increment:
+        case opcode::decrement:
+            if (!valid(20, true)) {
+                break;
+            }
+            return handle_arithmetic(out, op);
+        case opcode::flush:
+            if (!valid(0, false) && !valid(4, false)) {
+                break;
+            }
+            return handle_flush(out);
+        case opcode::quit:
+            if (!valid(0, false)) {
+                break;
+            }
+            _quit = true;
+            return maybe_respond(out, status::ok);
+        case opcode::noop:
+            if (!valid(0, false)) {
+                break;
+            }
+            return respond(out, status::ok);
+        case opcode::version:
+            if (!valid(0, false)) {
+                break;
+            }
+            return respond(out, status::ok, VERSION_STRING);
+        default:
+            return respond(out, status::unknown_command);
+        }
+        return respond(out, status::invalid_arguments);
+    }
+public:
+    binary_protocol(sharded_cache& cache, distributed<system_stats>& system_stats)
+        : _cache(cache)
+        , _system_stats(system_stats)
+    {}
+
+    // Set after quit, or when the stream can't be parsed any further
+    bool quit() const {
+        return _quit;
+    }
+
+    future<> handle(input_stream<char>& in, output_stream<char>& out) {
+        return in.read_exactly(header_size).then([this, &in, &out] (temporary_buffer<char> buf) -> future<> {
+            if (buf.empty()) {
+                return make_ready_future<>();
+            }
+            if (buf.size() < header_size) {
+                _quit = true;
+                return make_ready_future<>();
+            }
+            auto p = buf.get();
+            _header = request_header{
+                .magic = uint8_t(p[0]),
+                .op = opcode(p[1]),
+                .key_length = read_be<uint16_t>(p + 2),
+                .extras_length = uint8_t(p[4]),
+                .body_length = read_be<uint32_t>(p + 8),
+                .opaque = read_be<uint32_t>(p + 12),
+                .cas = read_be<uint64_t>(p + 16),
+            };
+            if (_header.magic != request_magic
+                    || _header.key_length + _header.extras_length > _header.body_length) {
+                // There's no way to find where the next request starts
+                _quit = true;
+                return make_ready_future<>();
+            }
+            if (_header.body_length > max_body_length || _header.key_length > max_key_length) {
+                auto st = _header.key_length > max_key_length ? status::invalid_arguments : status::value_too_large;
+                return in.skip(_header.body_length).then([this, &out, st] {
+                    return respond(out, st);
+                });
+            }
+            return in.read_exactly(_header.body_length).then([this, &out] (temporary_buffer<char> body) {
+                if (body.size() < _header.body_length) {
+                    _quit = true;
+                    return make_ready_future<>();
+                }
+                _body = std::move(body);
+                return dispatch(out);
+            });
+        }).then_wrapped([this, &out] (auto&& f) -> future<> {
+            try {
+                f.get();
+            } catch (std::bad_alloc& e) {
+                return respond(out, status::out_of_memory);
+            }
+            return make_ready_future<>();
+        });
+    }
+};
+
 class udp_server {
 public:
     static const size_t default_max_datagram_size = 1400;
@@ -1266,15 +2112,18 @@ class udp_server {
         {}
 
         future<> respond(udp_channel& chan) {
+            std::vector<outgoing_datagram> out;
+            out.reserve(_out_bufs.size());
             int i = 0;
-            return do_for_each(_out_bufs.begin(), _out_bufs.end(), [this, i, &chan] (packet& p) mutable {
+            for (auto& p : _out_bufs) {
                 header* out_hdr = p.prepend_header<header>(0);
                 out_hdr->_request_id = _request_id;
                 out_hdr->_sequence_number = i++;
                 out_hdr->_n = _out_bufs.size();
                 *out_hdr = hton(*out_hdr);
-                return chan.send(_src, std::move(p));
-            });
+                out.push_back(outgoing_datagram{_src, std::move(p)});
+            }
+            return chan.send_batch(std::move(out));
         }
     };
 
@@ -1289,36 +2138,44 @@ class udp_server {
         _max_datagram_size = max_datagram_size;
     }
 
-    void start() {
-        _chan = make_bound_datagram_channel({_port});
-        // Run in the background.
-        _task = keep_doing([this] {
-            return _chan.receive().then([this](datagram dgram) {
-                packet& p = dgram.get_data();
-                if (p.len() < sizeof(header)) {
-                    // dropping invalid packet
-                    return make_ready_future<>();
-                }
+    future<> handle(datagram& dgram) {
+        packet& p = dgram.get_data();
+        if (p.len() < sizeof(header)) {
+            // dropping invalid packet
+            return make_ready_future<>();
+        }
 
-                header hdr = ntoh(*p.get_header<header>());
-                p.trim_front(sizeof(hdr));
+        header hdr = ntoh(*p.get_header<header>());
+        p.trim_front(sizeof(hdr));
 
-                auto request_id = hdr._request_id;
-                auto in = as_input_stream(std::move(p));
-                auto conn = make_lw_shared<connection>(dgram.get_src(), request_id, std::move(in),
-                    _max_datagram_size - sizeof(header), _cache, _system_stats);
+        auto request_id = hdr._request_id;
+        auto in = as_input_stream(std::move(p));
+        auto conn = make_lw_shared<connection>(dgram.get_src(), request_id, std::move(in),
+            _max_datagram_size - sizeof(header), _cache, _system_stats);
 
-                if (hdr._n != 1 || hdr._sequence_number != 0) {
-                    return conn->_out.write("CLIENT_ERROR only single-datagram requests supported\r\n").then([this, conn] {
-                        return conn->_out.flush().then([this, conn] {
-                            return conn->respond(_chan).then([conn] {});
-                        });
-                    });
-                }
+        if (hdr._n != 1 || hdr._sequence_number != 0) {
+            return conn->_out.write("CLIENT_ERROR only single-datagram requests supported\r\n").then([this, conn] {
+                return conn->_out.flush().then([this, conn] {
+                    return conn->respond(_chan).then([conn] {});
+                });
+            });
+        }
 
-                return conn->_proto.handle(conn->_in, conn->_out).then([this, conn]() mutable {
-                    return conn->_out.flush().then([this, conn] {
-                        return conn->respond(_chan).then([conn] {});
+        return conn->_proto.handle(conn->_in, conn->_out).then([this, conn]() mutable {
+            return conn->_out.flush().then([this, conn] {
+                return conn->respond(_chan).then([conn] {});
+            });
+        });
+    }
+
+    void start() {
+        _chan = make_bound_datagram_channel({_port});
+        // Run in the background.
+        _task = keep_doing([this] {
+            return _chan.receive_batch().then([this] (std::vector<datagram> dgrams) {
+                return do_with(std::move(dgrams), [this] (std::vector<datagram>& dgrams) {
+                    return do_for_each(dgrams, [this] (datagram& dgram) {
+                        return handle(dgram);
                     });
                 });
             });
@@ -1342,11 +2199,14 @@ class tcp_server {
     distributed<system_stats>& _system_stats;
     uint16_t _port;
     struct connection {
+        enum class protocol { unknown, ascii, binary };
         connected_socket _socket;
         socket_address _addr;
         input_stream<char> _in;
         output_stream<char> _out;
+        protocol _protocol = protocol::unknown;
         ascii_protocol _proto;
+        binary_protocol _binary_proto;
         distributed<system_stats>& _system_stats;
         connection(connected_socket&& socket, socket_address addr, sharded_cache& c, distributed<system_stats>& system_stats)
             : _socket(std::move(socket))
@@ -1354,6 +2214,7 @@ class tcp_server {
             , _in(_socket.input())
             , _out(_socket.output())
             , _proto(c, system_stats)
+            , _binary_proto(c, system_stats)
             , _system_stats(system_stats)
         {
             _system_stats.local()._curr_connections++;
@@ -1362,6 +2223,32 @@ class tcp_server {
         ~connection() {
             _system_stats.local()._curr_connections--;
         }
+        bool done() const {
+            return _in.eof() || _binary_proto.quit();
+        }
+        // The protocol is told by the first byte of the connection, as
+        // binary requests start with a magic byte no ASCII command does
+        future<> detect_protocol() {
+            return _in.consume([this] (temporary_buffer<char> buf) {
+                if (!buf.empty()) {
+                    _protocol = uint8_t(buf[0]) == binary_protocol::request_magic ? protocol::binary : protocol::ascii;
+                }
+                return make_ready_future<consumption_result<char>>(stop_consuming<char>(std::move(buf)));
+            });
+        }
+        future<> handle() {
+            switch (_protocol) {
+            case protocol::ascii:
+                return _proto.handle(_in, _out);
+            case protocol::binary:
+                return _binary_proto.handle(_in, _out);
+            case protocol::unknown:
+                break;
+            }
+            return detect_protocol().then([this] {
+                return _protocol == protocol::unknown ? make_ready_future<>() : handle();
+            });
+        }
     };
 public:
     tcp_server(sharded_cache& cache, distributed<system_stats>& system_stats, uint16_t port = 11211)
@@ -1380,8 +2267,8 @@ class tcp_server {
                 connected_socket fd = std::move(ar.connection);
                 socket_address addr = std::move(ar.remote_address);
                 auto conn = make_lw_shared<connection>(std::move(fd), addr, _cache, _system_stats);
-                (void)do_until([conn] { return conn->_in.eof(); }, [conn] {
-                    return conn->_proto.handle(conn->_in, conn->_out).then([conn] {
+                (void)do_until([conn] { return conn->done(); }, [conn] {
+                    return conn->handle().then([conn] {
                         return conn->_out.flush();
                     });
                 }).finally([conn] {
@@ -1446,6 +2333,16 @@ int main(int ac, char** av) {
              "Maximum memory to be used for items (value in megabytes) (reclaimer is disabled if set)")
         ("slab-page-size", bpo::value<uint64_t>()->default_value(memcache::default_slab_page_size/MB),
              "Size of slab page (value in megabytes)")
+        ("eviction-policy", bpo::value<std::string>()->default_value("lru"),
+             "Order in which items are evicted: lru, slru (segmented LRU) or w-tinylfu (segmented LRU with a frequency based admission window)")
+        ("expected-items", bpo::value<uint64_t>()->default_value(1'000'000),
+             "Number of items the cache is expected to hold, which sizes the frequency sketch of the w-tinylfu eviction policy")
+        ("persistent-dir", bpo::value<std::string>()->default_value(""),
+             "Keep items in files of this directory, e.g. on hugetlbfs or a DAX file system, so that a restarted "
+             "server resumes with the items of the previous one (requires --max-slab-size)")
+        ("slab-automove-period", bpo::value<unsigned>()->default_value(0),
+             "Every so many milliseconds, move a slab page from the slab class with the oldest items to the one evicting "
+             "the most recently used ones, when the former's are more than twice as old (0 disables)")
         ("stats",
              "Print basic statistics periodically (every second)")
         ("port", bpo::value<uint16_t>()->default_value(11211),
@@ -1462,7 +2359,24 @@ int main(int ac, char** av) {
         uint16_t port = config["port"].as<uint16_t>();
         uint64_t per_cpu_slab_size = config["max-slab-size"].as<uint64_t>() * MB;
         uint64_t slab_page_size = config["slab-page-size"].as<uint64_t>() * MB;
-        return cache_peers.start(std::move(per_cpu_slab_size), std::move(slab_page_size)).then([&system_stats] {
+        auto eviction_policy_name = config["eviction-policy"].as<std::string>();
+        slab_eviction_policy eviction_policy;
+        if (eviction_policy_name == "lru") {
+            eviction_policy = slab_eviction_policy::lru;
+        } else if (eviction_policy_name == "slru") {
+            eviction_policy = slab_eviction_policy::segmented_lru;
+        } else if (eviction_policy_name == "w-tinylfu") {
+            eviction_policy = slab_eviction_policy::w_tinylfu;
+        } else {
+            throw std::invalid_argument(format("unknown eviction policy: {}", eviction_policy_name));
+        }
+        sstring persistent_dir = config["persistent-dir"].as<std::string>();
+        if (!persistent_dir.empty() && !per_cpu_slab_size) {
+            throw std::invalid_argument("--persistent-dir requires --max-slab-size");
+        }
+        return cache_peers.start(std::move(per_cpu_slab_size), std::move(slab_page_size), eviction_policy,
+                config["expected-items"].as<uint64_t>(), persistent_dir,
+                std::chrono::milliseconds(config["slab-automove-period"].as<unsigned>())).then([&system_stats] {
             return system_stats.start(memcache::clock_type::now());
         }).then([&] {
             std::cout << PLATFORM << " memcached " << VERSION << "\n";
@@ -21,6 +21,8 @@ import sys
 import os
 import argparse
 import subprocess
+import socket
+import tempfile
 
 DIR_PATH = os.path.dirname(os.path.realpath(__file__))
 
@@ -39,6 +41,48 @@ def run(args, cmd):
         mc.wait()
         print('Memcached killed.')
 
+def call_when_up(request):
+    for _ in range(100):
+        try:
+            with socket.create_connection(('127.0.0.1', 11211)) as s:
+                s.sendall(request)
+                s.shutdown(socket.SHUT_WR)
+                response = b''
+                while True:
+                    data = s.recv(4096)
+                    if not data:
+                        return response
+                    response += data
+        except ConnectionRefusedError:
+            time.sleep(0.1)
+    raise RuntimeError('memcached is not reachable')
+
+def run_warm_restart(args):
+    with tempfile.TemporaryDirectory() as persistent_dir:
+        cmdline = [args.memcached, '--smp=2', '--max-slab-size=16', '--persistent-dir', persistent_dir]
+        keys = ['key%d' % i for i in range(100)]
+        # A graceful stop, then a killed process, both leave their items
+        for stop in ['terminate', 'kill', None]:
+            mc = subprocess.Popen(cmdline)
+            try:
+                if stop == 'terminate':
+                    for key in keys:
+                        assert call_when_up(('set %s 0 0 5\r\nv%s\r\n' % (key, key[3:].zfill(4))).encode()) == b'STORED\r\n'
+                    assert call_when_up(b'set short 0 1 1\r\nx\r\n') == b'STORED\r\n'
+                else:
+                    response = call_when_up(('get %s\r\n' % ' '.join(keys)).encode())
+                    expected = ''.join('VALUE %s 0 5\r\nv%s\r\n' % (key, key[3:].zfill(4)) for key in keys)
+                    assert response == (expected + 'END\r\n').encode(), response
+                    time.sleep(2)
+                    assert call_when_up(b'get short\r\n') == b'END\r\n'
+            finally:
+                if stop == 'kill':
+                    mc.kill()
+                else:
+                    mc.terminate()
+                mc.wait()
+        print('Warm restart test passed.')
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="Seastar test runner")
     parser.add_argument('--fast',  action="store_true", help="Run only fast tests")
@@ -47,3 +91,4 @@ if __name__ == "__main__":
 
     run(args, [])
     run(args, ['-U'])
+    run_warm_restart(args)
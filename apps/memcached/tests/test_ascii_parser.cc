@@ -333,3 +333,50 @@ SEASTAR_TEST_CASE(test_multiple_requests_in_one_stream) {
         });
     });
 }
+
+SEASTAR_TEST_CASE(test_meta_commands_parsing) {
+    return for_each_fragment_size([] (auto make_packet) {
+        return make_ready_future<>()
+                .then([make_packet] {
+            return parse(make_packet({"mg key v f Oabc\r\n"}))
+                    .then([] (auto p) {
+                BOOST_REQUIRE(p->_state == parser_type::state::cmd_mg);
+                BOOST_REQUIRE(p->_key.key() == "key");
+                BOOST_REQUIRE_EQUAL(p->_meta_flags, std::vector<sstring>({"v", "f", "Oabc"}));
+            });
+        }).then([make_packet] {
+            return parse(make_packet({"mg key\r\n"}))
+                    .then([] (auto p) {
+                BOOST_REQUIRE(p->_state == parser_type::state::cmd_mg);
+                BOOST_REQUIRE(p->_key.key() == "key");
+                BOOST_REQUIRE(p->_meta_flags.empty());
+            });
+        }).then([make_packet] {
+            return parse(make_packet({"ms key 3 T10 F5 q\r\nabc\r\n"}))
+                    .then([] (auto p) {
+                BOOST_REQUIRE(p->_state == parser_type::state::cmd_ms);
+                BOOST_REQUIRE(p->_key.key() == "key");
+                BOOST_REQUIRE(p->_size == 3);
+                BOOST_REQUIRE(p->_blob == "abc");
+                BOOST_REQUIRE_EQUAL(p->_meta_flags, std::vector<sstring>({"T10", "F5", "q"}));
+            });
+        }).then([make_packet] {
+            return parse(make_packet({"md key q\r\n"}))
+                    .then([] (auto p) {
+                BOOST_REQUIRE(p->_state == parser_type::state::cmd_md);
+                BOOST_REQUIRE(p->_key.key() == "key");
+                BOOST_REQUIRE_EQUAL(p->_meta_flags, std::vector<sstring>({"q"}));
+            });
+        }).then([make_packet] {
+            return parse(make_packet({"mn\r\n"}))
+                    .then([] (auto p) {
+                BOOST_REQUIRE(p->_state == parser_type::state::cmd_mn);
+            });
+        }).then([make_packet] {
+            return parse(make_packet({"ms key 3\r\nabcd\r\n"}))
+                    .then([] (auto p) {
+                BOOST_REQUIRE(p->_state == parser_type::state::error);
+            });
+        });
+    });
+}
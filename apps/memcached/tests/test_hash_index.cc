@@ -0,0 +1,117 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/core/future.hh>
+#include "hash_index.hh"
+#include <deque>
+#include <unordered_set>
+
+using namespace seastar;
+using namespace memcache;
+
+namespace {
+
+struct element {
+    size_t key;
+};
+
+template <size_t Mask>
+struct masked_hash {
+    size_t operator()(const element& e) const noexcept {
+        return hash_of(e.key);
+    }
+    static size_t hash_of(size_t key) noexcept {
+        return std::hash<size_t>()(key * 0x9e3779b97f4a7c15ull) & Mask;
+    }
+};
+
+struct key_cmp {
+    bool operator()(size_t key, const element& e) const noexcept {
+        return key == e.key;
+    }
+};
+
+template <typename Hash>
+void check_index(size_t count) {
+    hash_index<element, Hash> index;
+    std::deque<element> elements;
+    auto find = [&] (size_t key) {
+        return index.find(key, Hash::hash_of(key), key_cmp());
+    };
+
+    bool resized = false;
+    for (size_t i = 0; i < count; ++i) {
+        elements.push_back(element{i});
+        index.insert(elements.back());
+        resized |= index.resizing();
+        // Elements are found while they move to the bigger table
+        BOOST_REQUIRE_EQUAL(find(i), &elements.back());
+        BOOST_REQUIRE_EQUAL(find(i / 2), &elements[i / 2]);
+    }
+    BOOST_REQUIRE(resized);
+    BOOST_REQUIRE_EQUAL(index.size(), count);
+    BOOST_REQUIRE(find(count) == nullptr);
+
+    for (size_t i = 0; i < count; i += 2) {
+        index.erase(elements[i]);
+    }
+    BOOST_REQUIRE_EQUAL(index.size(), count / 2);
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_REQUIRE_EQUAL(find(i), i % 2 ? &elements[i] : nullptr);
+    }
+
+    // Deleted slots are reused, or purged by a rehash to the same size
+    auto capacity = index.capacity();
+    for (size_t round = 0; round < 8; ++round) {
+        for (size_t i = 0; i < count; i += 2) {
+            index.insert(elements[i]);
+        }
+        for (size_t i = 0; i < count; i += 2) {
+            index.erase(elements[i]);
+        }
+    }
+    BOOST_REQUIRE_LE(index.capacity(), capacity);
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_REQUIRE_EQUAL(find(i), i % 2 ? &elements[i] : nullptr);
+    }
+
+    std::unordered_set<size_t> disposed;
+    index.clear_and_dispose([&] (element* e) {
+        BOOST_REQUIRE(disposed.insert(e->key).second);
+    });
+    BOOST_REQUIRE_EQUAL(disposed.size(), count / 2);
+    BOOST_REQUIRE_EQUAL(index.size(), 0);
+    BOOST_REQUIRE(find(1) == nullptr);
+}
+
+}
+
+SEASTAR_TEST_CASE(test_hash_index_growth) {
+    check_index<masked_hash<~size_t(0)>>(100000);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_hash_index_colliding_hashes) {
+    // Few distinct hashes, so that probe sequences are long and share groups
+    check_index<masked_hash<0x3ff>>(5000);
+    return make_ready_future<>();
+}
@@ -219,6 +219,49 @@ class TcpSpecificTests(MemcacheTest):
             time.sleep(0.1)
             self.assertEqual(curr_connections, int(self.getStat('curr_connections', call_fn=conn)))
 
+    def test_meta_pipeline_with_quiet_mode(self):
+        self.assertEqual(call('ms key1 1 q\r\na\r\nms key2 1 q\r\nb\r\nmg key1 v q\r\nmg nokey v q\r\nmg key2 v q\r\nmn\r\n'),
+            b'VA 1\r\na\r\nVA 1\r\nb\r\nMN\r\n')
+
+    def test_binary_protocol(self):
+        def request(opcode, key=b'', value=b'', extras=b'', cas=0, opaque=0):
+            return struct.pack('>BBHBBHIIQ', 0x80, opcode, len(key), len(extras), 0, 0,
+                len(extras) + len(key) + len(value), opaque, cas) + extras + key + value
+        def parse_responses(data):
+            responses = []
+            while data:
+                magic, opcode, key_length, extras_length, _, status, body_length, opaque, cas = struct.unpack_from('>BBHBBHIIQ', data)
+                self.assertEqual(magic, 0x81)
+                body = data[24:24 + body_length]
+                responses.append((opcode, status, opaque, body[:extras_length], body[extras_length:extras_length + key_length],
+                    body[extras_length + key_length:]))
+                data = data[24 + body_length:]
+            return responses
+        def binary_call(msg):
+            s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            s.settimeout(1)
+            s.connect(server_addr)
+            s.send(msg)
+            s.shutdown(socket.SHUT_WR)
+            data = recv_all(s)
+            s.close()
+            return parse_responses(data)
+
+        set_extras = struct.pack('>II', 7, 0)
+        self.assertEqual(binary_call(request(0x01, b'key', b'hello', set_extras, opaque=1)),
+            [(0x01, 0, 1, b'', b'', b'')])
+        # getkq misses are silent, noop ends the pipeline
+        self.assertEqual(binary_call(request(0x0d, b'nokey', opaque=2) + request(0x0d, b'key', opaque=3) + request(0x0a, opaque=4)),
+            [(0x0d, 0, 3, struct.pack('>I', 7), b'key', b'hello'), (0x0a, 0, 4, b'', b'', b'')])
+        self.assertEqual(binary_call(request(0x00, b'nokey'))[0][1], 0x01)
+        self.assertEqual(binary_call(request(0x02, b'key', b'x', set_extras))[0][1], 0x02)
+        self.assertEqual(binary_call(request(0x11, b'key2', b'1', set_extras) + request(0x05, b'key2', extras=struct.pack('>QQI', 5, 0, 0))),
+            [(0x05, 0, 0, b'', b'', struct.pack('>Q', 6))])
+        self.assertEqual(binary_call(request(0x05, b'counter', extras=struct.pack('>QQI', 1, 10, 0))),
+            [(0x05, 0, 0, b'', b'', struct.pack('>Q', 10))])
+        self.assertEqual(binary_call(request(0x04, b'key') + request(0x04, b'key'))[1][1], 0x01)
+        self.assertEqual(binary_call(request(0xfe))[0][1], 0x81)
+
 class UdpSpecificTests(MemcacheTest):
     def test_large_response_is_split_into_mtu_chunks(self):
         max_datagram_size = 1400
@@ -271,6 +314,18 @@ class TestCommands(MemcacheTest):
         self.delete("key")
         self.delete("key1")
 
+    def test_many_keys_in_get_are_returned_in_order(self):
+        keys = ['key%d' % i for i in range(100)]
+        for i, key in enumerate(keys):
+            if i % 3:
+                self.set(key, 'v%d' % i)
+        expected = ''.join('VALUE %s 0 %d\r\nv%d\r\n' % (key, len('v%d' % i), i)
+                           for i, key in enumerate(keys) if i % 3)
+        self.assertEqual(call('get %s\r\n' % ' '.join(keys)), (expected + 'END\r\n').encode())
+        for i, key in enumerate(keys):
+            if i % 3:
+                self.delete(key)
+
     def test_flush_all(self):
         self.set('key', 'value')
         self.assertEqual(call('flush_all\r\n'), b'OK\r\n')
@@ -535,6 +590,25 @@ class TestCommands(MemcacheTest):
         self.assertEqual(call('set key 0 0 2\r\n09\r\n'), b'STORED\r\n')
         self.assertEqual(call('decr key 1\r\n'), b'8\r\n')
 
+    def test_meta_commands(self):
+        self.assertEqual(call('mg key v\r\n'), b'EN\r\n')
+        self.assertEqual(call('ms key 5 F3 T0\r\nhello\r\n'), b'HD\r\n')
+        self.assertEqual(call('mg key v f s k Oxyz\r\n'), b'VA 5 f3 s5 kkey Oxyz\r\nhello\r\n')
+        self.assertEqual(call('mg key t\r\n'), b'HD t-1\r\n')
+        self.assertEqual(call('ms key 1 ME\r\na\r\n'), b'NS\r\n')
+        self.assertEqual(call('ms missing 1 MR\r\na\r\n'), b'NS\r\n')
+        self.assertEqual(call('ms key 1 MA\r\na\r\n'), b'CLIENT_ERROR invalid flag\r\n')
+
+        m = re.match(r'HD c(?P<version>\d+)', call('mg key c\r\n').decode())
+        version = int(m.group('version'))
+        self.assertEqual(call('ms key 1 C%d\r\na\r\n' % (version + 1)), b'EX\r\n')
+        self.assertEqual(call('ms key 1 C%d\r\na\r\n' % version), b'HD\r\n')
+        self.assertEqual(call('get key\r\n'), b'VALUE key 0 1\r\na\r\nEND\r\n')
+
+        self.assertEqual(call('md key q\r\n'), b'')
+        self.assertEqual(call('md key\r\n'), b'NF\r\n')
+        self.assertEqual(call('mn\r\n'), b'MN\r\n')
+
     def test_incr_and_decr_on_invalid_input(self):
         error_msg = b'CLIENT_ERROR cannot increment or decrement non-numeric value\r\n'
         for cmd in ['incr', 'decr']:
@@ -41,6 +41,9 @@
 #include <seastar/core/sharded.hh>
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/sleep.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/thread_cputime_clock.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/rpc/rpc.hh>
 
 using namespace seastar;
@@ -155,6 +158,25 @@ class uniform_process : public pause_distribution {
     }
 };
 
+class exponential_process : public pause_distribution {
+    std::random_device _rd;
+    std::mt19937 _rng;
+    std::exponential_distribution<double> _exp;
+
+public:
+    // Pauses between the events of a Poisson process with the given rate
+    exponential_process(double rate)
+            : _rng(_rd()), _exp(rate) { }
+
+    std::chrono::duration<double> get() override {
+        return std::chrono::duration<double>(_exp(_rng));
+    }
+};
+
+std::unique_ptr<pause_distribution> make_exponential_pause(double rate) {
+    return std::make_unique<exponential_process>(rate);
+}
+
 struct duration_range {
     std::chrono::duration<double> min;
     std::chrono::duration<double> max;
@@ -184,6 +206,9 @@ struct job_config {
     std::optional<duration_range> sleep_time_range;
     std::optional<std::chrono::duration<double>> timeout;
     size_t payload;
+    // Open-loop mode: requests per second and how they are spread
+    std::optional<double> rate;
+    std::string schedule = "constant";
 
     bool client = false;
     bool server = false;
@@ -245,6 +270,18 @@ struct convert<job_config> {
             if (node["timeout"]) {
                 cfg.timeout = node["timeout"].as<duration_time>().time;
             }
+            if (node["rate"]) {
+                cfg.rate = node["rate"].as<double>();
+                if (*cfg.rate <= 0) {
+                    throw std::runtime_error("rate must be positive");
+                }
+            }
+            if (node["schedule"]) {
+                cfg.schedule = node["schedule"].as<std::string>();
+                if (cfg.schedule != "constant" && cfg.schedule != "poisson") {
+                    throw std::runtime_error("unknown schedule");
+                }
+            }
         } else if (cfg.type == "cpu") {
             if (node["execution_time"]) {
                 cfg.exec_time = node["execution_time"].as<duration_time>().time;
@@ -355,6 +392,21 @@ enum class rpc_verb : int32_t {
 using rpc_protocol = rpc::protocol<serializer, rpc_verb>;
 static std::array<double, 4> quantiles = { 0.5, 0.95, 0.99, 0.999};
 
+// HDR-like latency histogram in nanoseconds, from 128ns to ~68s with
+// 64 linear sub-buckets per power of two (~1.5% precision)
+using latency_histogram = metrics::internal::approximate_exponential_histogram<128, (uint64_t(1) << 36), 64>;
+
+static void emit_histogram(YAML::Emitter& out, const latency_histogram& hist) {
+    out << YAML::Key << "histogram" << YAML::Comment("bucket lower bound in nsec: count");
+    out << YAML::BeginMap;
+    for (size_t i = 0; i < hist.size(); i++) {
+        if (hist.get(i)) {
+            out << YAML::Key << hist.get_bucket_lower_limit(i) << YAML::Value << hist.get(i);
+        }
+    }
+    out << YAML::EndMap;
+}
+
 class job {
 public:
     virtual std::string name() const = 0;
@@ -374,7 +426,15 @@ class job_rpc : public job {
     std::function<future<>(unsigned)> _call;
     std::chrono::steady_clock::time_point _stop;
     uint64_t _total_messages = 0;
+    uint64_t _errors = 0;
     accumulator_type _latencies;
+    latency_histogram _histogram;
+    thread_cputime_clock::duration _cpu_time{};
+
+    void account_latency(std::chrono::steady_clock::duration lat) {
+        _latencies(std::chrono::duration_cast<std::chrono::microseconds>(lat).count());
+        _histogram.add(std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count());
+    }
 
     future<> call_echo(unsigned dummy) {
         auto cln = _rpc.make_client<uint64_t(uint64_t)>(rpc_verb::ECHO);
@@ -429,6 +489,55 @@ class job_rpc : public job {
         co.tcp_nodelay = _ccfg.nodelay;
         co.isolation_cookie = _cfg.sg_name;
         _client = std::make_unique<rpc_protocol::client>(_rpc, co, _caddr);
+        auto cpu_start = thread_cputime_clock::now();
+        return (_cfg.rate ? run_open_loop() : run_closed_loop()).finally([this, cpu_start] {
+            _cpu_time = thread_cputime_clock::now() - cpu_start;
+            return _client->stop();
+        });
+      });
+    }
+
+private:
+    // Sends requests on a schedule that doesn't depend on how fast the
+    // replies come back. Latency is measured from the time a request was
+    // meant to be sent, so a stalled server or a full in-flight window is
+    // accounted for in the latencies rather than hidden by sending less
+    // (coordinated omission). The parallelism caps the requests in flight.
+    future<> run_open_loop() {
+        auto interval = _cfg.schedule == "poisson"
+                ? make_exponential_pause(*_cfg.rate)
+                : make_steady_pause(std::chrono::duration<double>(1 / *_cfg.rate));
+        return do_with(std::move(interval), semaphore(_cfg.parallelism), std::chrono::steady_clock::now(),
+                [this] (auto& interval, semaphore& in_flight, std::chrono::steady_clock::time_point& next) {
+            return do_until([this, &next] {
+                return next > _stop;
+            }, [this, &interval, &in_flight, &next] {
+                auto intended = next;
+                next += interval->template get_as<std::chrono::steady_clock::duration>();
+                auto now = std::chrono::steady_clock::now();
+                auto f = intended > now ? seastar::sleep(intended - now) : make_ready_future<>();
+                return std::move(f).then([&in_flight] {
+                    return get_units(in_flight, 1);
+                }).then([this, intended] (auto units) {
+                    auto id = _total_messages++;
+                    // Replies are collected in the background, in_flight is
+                    // waited for in full before the job finishes
+                    (void)_call(id).then_wrapped([this, intended, units = std::move(units)] (future<> f) {
+                        if (f.failed()) {
+                            f.ignore_ready_future();
+                            _errors++;
+                        } else {
+                            account_latency(std::chrono::steady_clock::now() - intended);
+                        }
+                    });
+                });
+            }).then([this, &in_flight] {
+                return in_flight.wait(_cfg.parallelism);
+            });
+        });
+    }
+
+    future<> run_closed_loop() {
         return parallel_for_each(boost::irange(0u, _cfg.parallelism), [this] (auto dummy) {
           auto f = make_ready_future<>();
           if (_cfg.sleep_time) {
@@ -442,8 +551,7 @@ class job_rpc : public job {
                 _total_messages++;
                 auto now = std::chrono::steady_clock::now();
                 return _call(dummy).then([this, start = now] {
-                    std::chrono::microseconds lat = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
-                    _latencies(lat.count());
+                    account_latency(std::chrono::steady_clock::now() - start);
                 }).then([this] {
                     if (_cfg.sleep_time) {
                         return seastar::sleep(std::chrono::duration_cast<std::chrono::nanoseconds>(*_cfg.sleep_time));
@@ -453,14 +561,20 @@ class job_rpc : public job {
                 });
             });
           });
-        }).finally([this] {
-            return _client->stop();
         });
-      });
     }
 
+public:
     virtual void emit_result(YAML::Emitter& out) const override {
         out << YAML::Key << "messages" << YAML::Value << _total_messages;
+        if (_cfg.rate) {
+            out << YAML::Key << "errors" << YAML::Value << _errors;
+        }
+        if (_total_messages) {
+            // Reactor CPU time of the shard, including whatever else runs on it
+            auto cpu = std::chrono::duration_cast<std::chrono::nanoseconds>(_cpu_time).count();
+            out << YAML::Key << "cpu_per_request" << YAML::Value << cpu / _total_messages << YAML::Comment("nsec");
+        }
         out << YAML::Key << "latencies" << YAML::Comment("usec");
         out << YAML::BeginMap;
         out << YAML::Key << "average" << YAML::Value << (uint64_t)mean(_latencies);
@@ -469,6 +583,7 @@ class job_rpc : public job {
         }
         out << YAML::Key << "max" << YAML::Value << (uint64_t)max(_latencies);
         out << YAML::EndMap;
+        emit_histogram(out, _histogram);
     }
 };
 
@@ -26,9 +26,18 @@
 #include <seastar/core/app-template.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <boost/range/irange.hpp>
 #include <chrono>
+#include <deque>
 
 using namespace seastar;
+using namespace std::chrono_literals;
 
 template <typename... Args>
 void http_debug(const char* fmt, Args&&... args) {
@@ -37,11 +46,30 @@ void http_debug(const char* fmt, Args&&... args) {
 #endif
 }
 
+// HDR-like latency histogram in nanoseconds, from 128ns to ~68s with
+// 64 linear sub-buckets per power of two (~1.5% precision)
+using latency_histogram = metrics::internal::approximate_exponential_histogram<128, (uint64_t(1) << 36), 64>;
+
 class http_client {
+public:
+    using clock_type = steady_clock_type;
+    struct config {
+        unsigned duration;
+        unsigned total_conn;
+        unsigned reqs_per_conn;
+        // Requests in flight per connection
+        unsigned pipeline;
+        // A new connection per request, instead of reusing them
+        bool close_connections;
+        // Requests per second over all shards, 0 for a closed loop
+        double rate;
+        std::string host;
+    };
 private:
-    unsigned _duration;
+    config _cfg;
     unsigned _conn_per_core;
-    unsigned _reqs_per_conn;
+    sstring _request;
+    ipv4_addr _server_addr;
     std::vector<connected_socket> _sockets;
     semaphore _conn_connected{0};
     semaphore _conn_finished{0};
@@ -49,15 +77,23 @@ class http_client {
     bool _timer_based;
     bool _timer_done{false};
     uint64_t _total_reqs{0};
+    uint64_t _unsent_reqs{0};
+    uint64_t _errors{0};
+    latency_histogram _latencies;
+    gate _one_shots;
 public:
-    http_client(unsigned duration, unsigned total_conn, unsigned reqs_per_conn)
-        : _duration(duration)
-        , _conn_per_core(total_conn / smp::count)
-        , _reqs_per_conn(reqs_per_conn)
+    http_client(config cfg)
+        : _cfg(std::move(cfg))
+        , _conn_per_core(_cfg.total_conn / smp::count)
+        , _request(format("GET / HTTP/1.1\r\nHost: {}\r\n{}\r\n", _cfg.host, _cfg.close_connections ? "Connection: close\r\n" : ""))
         , _run_timer([this] { _timer_done = true; })
-        , _timer_based(reqs_per_conn == 0) {
+        , _timer_based(_cfg.reqs_per_conn == 0 || _cfg.rate) {
     }
 
+    // Sends requests on one connection, up to _cfg.pipeline of them before
+    // their responses arrive. Requests are queued with the time they were
+    // meant to start, which their latency is measured from: in the open loop
+    // mode, requests delayed by a slow server count as slow.
     class connection {
     private:
         connected_socket _fd;
@@ -65,7 +101,78 @@ class http_client {
         output_stream<char> _write_buf;
         http_response_parser _parser;
         http_client* _http_client;
+        std::deque<clock_type::time_point> _backlog;
+        std::deque<clock_type::time_point> _in_flight;
+        condition_variable _can_send;
+        condition_variable _can_receive;
+        // No more requests will be queued
+        bool _last{false};
+        uint64_t _nr_issued{0};
         uint64_t _nr_done{0};
+    private:
+        bool drained() const {
+            return _last && _backlog.empty() && _in_flight.empty();
+        }
+
+        future<> send_requests() {
+            return repeat([this] {
+                return _can_send.wait([this] {
+                    return (!_backlog.empty() && _in_flight.size() < _http_client->_cfg.pipeline) || (_last && _backlog.empty());
+                }).then([this] {
+                    if (_backlog.empty()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    // Pipelined requests are written and flushed together
+                    sstring requests;
+                    while (!_backlog.empty() && _in_flight.size() < _http_client->_cfg.pipeline) {
+                        _in_flight.push_back(_backlog.front());
+                        _backlog.pop_front();
+                        requests += _http_client->_request;
+                    }
+                    _can_receive.signal();
+                    return _write_buf.write(requests).then([this] {
+                        return _write_buf.flush();
+                    }).then([] {
+                        return stop_iteration::no;
+                    });
+                });
+            });
+        }
+
+        future<> receive_responses() {
+            return repeat([this] {
+                return _can_receive.wait([this] {
+                    return !_in_flight.empty() || drained();
+                }).then([this] {
+                    if (_in_flight.empty()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    return _http_client->read_response(_read_buf, _parser).then([this] (bool ok) {
+                        if (!ok) {
+                            // The server closed the connection
+                            finish();
+                            _http_client->_unsent_reqs += _in_flight.size();
+                            _in_flight.clear();
+                            _can_send.signal();
+                            return stop_iteration::yes;
+                        }
+                        _http_client->account_latency(clock_type::now() - _in_flight.front());
+                        _in_flight.pop_front();
+                        _nr_done++;
+                        if (!_http_client->open_loop()) {
+                            // Closed loop: each response lets a new request go
+                            if (!_http_client->done(_nr_issued)) {
+                                enqueue(clock_type::now());
+                            } else {
+                                finish();
+                            }
+                        }
+                        _can_send.signal();
+                        return stop_iteration::no;
+                    });
+                });
+            });
+        }
     public:
         connection(connected_socket&& fd, http_client* client)
             : _fd(std::move(fd))
@@ -78,53 +185,176 @@ class http_client {
             return _nr_done;
         }
 
-        future<> do_req() {
-            return _write_buf.write("GET / HTTP/1.1\r\nHost: 127.0.0.1:10000\r\n\r\n").then([this] {
-                return _write_buf.flush();
-            }).then([this] {
-                _parser.init();
-                return _read_buf.consume(_parser).then([this] {
-                    // Read HTTP response header first
-                    if (_parser.eof()) {
-                        return make_ready_future<>();
-                    }
-                    auto _rsp = _parser.get_parsed_response();
-                    auto it = _rsp->_headers.find("Content-Length");
-                    if (it == _rsp->_headers.end()) {
-                        fmt::print("Error: HTTP response does not contain: Content-Length\n");
-                        return make_ready_future<>();
-                    }
-                    auto content_len = std::stoi(it->second);
-                    http_debug("Content-Length = %d\n", content_len);
-                    // Read HTTP response body
-                    return _read_buf.read_exactly(content_len).then([this] (temporary_buffer<char> buf) {
-                        _nr_done++;
-                        http_debug("%s\n", buf.get());
-                        if (_http_client->done(_nr_done)) {
-                            return make_ready_future();
+        void enqueue(clock_type::time_point intended_start) {
+            if (_last) {
+                _http_client->_unsent_reqs++;
+                return;
+            }
+            _backlog.push_back(intended_start);
+            _nr_issued++;
+            _can_send.signal();
+        }
+
+        // Stops queueing requests; those not sent yet are dropped
+        void finish() {
+            if (!_last) {
+                _last = true;
+                _http_client->_unsent_reqs += _backlog.size();
+                _backlog.clear();
+            }
+            _can_send.signal();
+            _can_receive.signal();
+        }
+
+        future<> run() {
+            if (!_http_client->open_loop()) {
+                while (_in_flight.size() + _backlog.size() < _http_client->_cfg.pipeline && !_http_client->done(_nr_issued)) {
+                    enqueue(clock_type::now());
+                }
+            }
+            return when_all_succeed(send_requests(), receive_responses()).discard_result().finally([this] {
+                return _write_buf.close();
+            });
+        }
+    };
+
+private:
+    std::vector<std::unique_ptr<connection>> _connections;
+    size_t _next_connection{0};
+
+    // Reads a response, returns false if the connection was closed instead
+    future<bool> read_response(input_stream<char>& in, http_response_parser& parser) {
+        parser.init();
+        return in.consume(parser).then([&in, &parser] {
+            // Read HTTP response header first
+            if (parser.eof()) {
+                return make_ready_future<bool>(false);
+            }
+            auto _rsp = parser.get_parsed_response();
+            auto it = _rsp->_headers.find("Content-Length");
+            if (it == _rsp->_headers.end()) {
+                return make_exception_future<bool>(std::runtime_error("HTTP response does not contain: Content-Length"));
+            }
+            auto content_len = std::stoi(it->second);
+            http_debug("Content-Length = %d\n", content_len);
+            // Read HTTP response body
+            return in.read_exactly(content_len).then([] (temporary_buffer<char> buf) {
+                http_debug("%s\n", buf.get());
+                return true;
+            });
+        });
+    }
+
+    void account_latency(clock_type::duration latency) {
+        _latencies.add(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    }
+
+    bool open_loop() const {
+        return _cfg.rate;
+    }
+
+    // One request on a connection of its own
+    future<> one_shot(clock_type::time_point intended_start) {
+        return seastar::connect(make_ipv4_address(_server_addr)).then([this, intended_start] (connected_socket fd) {
+            return do_with(std::move(fd), http_response_parser(), [this, intended_start] (connected_socket& fd, http_response_parser& parser) {
+                return do_with(fd.input(), fd.output(), [this, intended_start, &parser] (input_stream<char>& in, output_stream<char>& out) {
+                    return out.write(_request).then([&out] {
+                        return out.flush();
+                    }).then([this, &in, &parser] {
+                        return read_response(in, parser);
+                    }).then([this, intended_start] (bool ok) {
+                        if (ok) {
+                            account_latency(clock_type::now() - intended_start);
+                            _total_reqs++;
                         } else {
-                            return do_req();
+                            _unsent_reqs++;
                         }
+                    }).finally([&out] {
+                        return out.close();
                     });
                 });
             });
+        }).handle_exception([this] (std::exception_ptr) {
+            _errors++;
+        });
+    }
+
+    // Sends a request on one of the connections, or on a new one
+    void issue(clock_type::time_point intended_start) {
+        if (_cfg.close_connections) {
+            (void)with_gate(_one_shots, [this, intended_start] {
+                return one_shot(intended_start);
+            });
+        } else {
+            _connections[_next_connection++ % _connections.size()]->enqueue(intended_start);
         }
-    };
+    }
 
+    // Issues requests at a constant rate, at the times they are due
+    future<> dispatch_at_rate() {
+        auto interval = std::chrono::duration<double>(smp::count / _cfg.rate);
+        auto start = clock_type::now();
+        return do_with(uint64_t(0), [this, interval, start] (uint64_t& n) {
+            return do_until([this] { return _timer_done; }, [this, interval, start, &n] {
+                auto now = clock_type::now();
+                for (;;) {
+                    auto due = start + std::chrono::duration_cast<clock_type::duration>(interval * n);
+                    if (due > now) {
+                        return sleep(std::min<clock_type::duration>(due - now, 1ms));
+                    }
+                    issue(due);
+                    n++;
+                }
+            });
+        }).then([this] {
+            for (auto& c : _connections) {
+                c->finish();
+            }
+        });
+    }
+
+    // Closed loop with a new connection per request
+    future<> run_one_shots() {
+        return parallel_for_each(boost::irange(0u, _conn_per_core), [this] (unsigned) {
+            return do_with(uint64_t(0), [this] (uint64_t& issued) {
+                return do_until([this, &issued] { return done(issued); }, [this, &issued] {
+                    issued++;
+                    return one_shot(clock_type::now());
+                });
+            });
+        });
+    }
+public:
     future<uint64_t> total_reqs() {
         fmt::print("Requests on cpu {:2d}: {:d}\n", this_shard_id(), _total_reqs);
         return make_ready_future<uint64_t>(_total_reqs);
     }
 
+    uint64_t unsent_reqs() const {
+        return _unsent_reqs;
+    }
+
+    uint64_t errors() const {
+        return _errors;
+    }
+
+    latency_histogram latencies() const {
+        return _latencies;
+    }
+
     bool done(uint64_t nr_done) {
         if (_timer_based) {
             return _timer_done;
         } else {
-            return nr_done >= _reqs_per_conn;
+            return nr_done >= _cfg.reqs_per_conn;
         }
     }
 
     future<> connect(ipv4_addr server_addr) {
+        _server_addr = server_addr;
+        if (_cfg.close_connections) {
+            return make_ready_future<>();
+        }
         // Establish all the TCP connections first
         for (unsigned i = 0; i < _conn_per_core; i++) {
             // Connect in the background, signal _conn_connected when done.
@@ -141,28 +371,37 @@ class http_client {
         // All connected, start HTTP request
         http_debug("Established all %6d tcp connections on cpu %3d\n", _conn_per_core, this_shard_id());
         if (_timer_based) {
-            _run_timer.arm(std::chrono::seconds(_duration));
+            _run_timer.arm(std::chrono::seconds(_cfg.duration));
+        }
+        if (_cfg.close_connections && !open_loop()) {
+            return run_one_shots();
         }
         for (auto&& fd : _sockets) {
-            auto conn = new connection(std::move(fd), this);
+            _connections.push_back(std::make_unique<connection>(std::move(fd), this));
+        }
+        for (auto& c : _connections) {
+            auto conn = c.get();
             // Run in the background, signal _conn_finished when done.
-            (void)conn->do_req().then_wrapped([this, conn] (auto&& f) {
+            (void)conn->run().then_wrapped([this, conn] (auto&& f) {
                 http_debug("Finished connection %6d on cpu %3d\n", _conn_finished.current(), this_shard_id());
                 _total_reqs += conn->nr_done();
-                _conn_finished.signal();
-                delete conn;
-                // FIXME: should _conn_finished.signal be called only after this?
-                // nothing seems to synchronize with this background work.
                 try {
                     f.get();
                 } catch (std::exception& ex) {
+                    _errors++;
                     fmt::print("http request error: {}\n", ex.what());
                 }
+                _conn_finished.signal();
             });
         }
 
+        auto dispatched = open_loop() ? dispatch_at_rate() : make_ready_future<>();
         // All finished
-        return _conn_finished.wait(_conn_per_core);
+        return dispatched.then([this] {
+            return _conn_finished.wait(_connections.size());
+        }).then([this] {
+            return _one_shots.close();
+        });
     }
     future<> stop() {
         return make_ready_future();
@@ -180,19 +419,43 @@ int main(int ac, char** av) {
         ("server,s", bpo::value<std::string>()->default_value("192.168.66.100:10000"), "Server address")
         ("conn,c", bpo::value<unsigned>()->default_value(100), "total connections")
         ("reqs,r", bpo::value<unsigned>()->default_value(0), "reqs per connection")
-        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds)");
+        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds)")
+        ("pipeline,p", bpo::value<unsigned>()->default_value(1), "requests in flight per connection (HTTP/1.1 pipelining)")
+        ("connection-mode", bpo::value<std::string>()->default_value("keep-alive"),
+                "keep-alive to reuse connections, close for a new connection per request")
+        ("rate,R", bpo::value<double>()->default_value(0),
+                "requests per second, sent at a constant rate regardless of responses (open loop) for the duration; "
+                "0 sends a new request when a response arrives (closed loop)");
 
     return app.run(ac, av, [&app] () -> future<int> {
         auto& config = app.configuration();
         auto server = config["server"].as<std::string>();
-        auto reqs_per_conn = config["reqs"].as<unsigned>();
-        auto total_conn= config["conn"].as<unsigned>();
-        auto duration = config["duration"].as<unsigned>();
+        http_client::config cfg {
+            .duration = config["duration"].as<unsigned>(),
+            .total_conn = config["conn"].as<unsigned>(),
+            .reqs_per_conn = config["reqs"].as<unsigned>(),
+            .pipeline = config["pipeline"].as<unsigned>(),
+            .close_connections = false,
+            .rate = config["rate"].as<double>(),
+            .host = server,
+        };
+        auto mode = config["connection-mode"].as<std::string>();
 
-        if (total_conn % smp::count != 0) {
+        if (cfg.total_conn % smp::count != 0) {
             fmt::print("Error: conn needs to be n * cpu_nr\n");
             return make_ready_future<int>(-1);
         }
+        if (mode == "close") {
+            cfg.close_connections = true;
+            cfg.pipeline = 1;
+        } else if (mode != "keep-alive") {
+            fmt::print("Error: connection-mode must be keep-alive or close\n");
+            return make_ready_future<int>(-1);
+        }
+        if (cfg.pipeline == 0 || cfg.rate < 0 || (cfg.rate && !cfg.close_connections && cfg.total_conn == 0)) {
+            fmt::print("Error: pipeline needs to be positive, and rate not negative\n");
+            return make_ready_future<int>(-1);
+        }
 
         auto http_clients = new distributed<http_client>;
 
@@ -200,9 +463,14 @@ int main(int ac, char** av) {
         auto started = steady_clock_type::now();
         fmt::print("========== http_client ============\n");
         fmt::print("Server: {}\n", server);
-        fmt::print("Connections: {:d}\n", total_conn);
-        fmt::print("Requests/connection: {}\n", reqs_per_conn == 0 ? "dynamic (timer based)" : std::to_string(reqs_per_conn));
-        return http_clients->start(std::move(duration), std::move(total_conn), std::move(reqs_per_conn)).then([http_clients, server] {
+        fmt::print("Connections: {:d} ({})\n", cfg.total_conn, mode);
+        fmt::print("Pipeline depth: {:d}\n", cfg.pipeline);
+        if (cfg.rate) {
+            fmt::print("Rate: {} requests/sec (open loop)\n", cfg.rate);
+        } else {
+            fmt::print("Requests/connection: {}\n", cfg.reqs_per_conn == 0 ? "dynamic (timer based)" : std::to_string(cfg.reqs_per_conn));
+        }
+        return http_clients->start(std::move(cfg)).then([http_clients, server] {
             return http_clients->invoke_on_all(&http_client::connect, ipv4_addr{server});
         }).then([http_clients] {
             return http_clients->invoke_on_all(&http_client::run);
@@ -213,18 +481,37 @@ int main(int ac, char** av) {
            auto finished = steady_clock_type::now();
            auto elapsed = finished - started;
            auto secs = static_cast<double>(elapsed.count() / 1000000000.0);
-           fmt::print("Total cpus: {:d}\n", smp::count);
-           fmt::print("Total requests: {:d}\n", total_reqs);
-           fmt::print("Total time: {:f}\n", secs);
-           fmt::print("Requests/sec: {:f}\n", static_cast<double>(total_reqs) / secs);
-           fmt::print("==========     done     ============\n");
-           return http_clients->stop().then([http_clients] {
-               // FIXME: If we call engine().exit(0) here to exit when
-               // requests are done. The tcp connection will not be closed
-               // properly, becasue we exit too earily and the FIN packets are
-               // not exchanged.
-                delete http_clients;
-                return make_ready_future<int>(0);
+           return http_clients->map_reduce0(std::mem_fn(&http_client::latencies), latency_histogram(),
+                   [] (latency_histogram a, const latency_histogram& b) {
+               return a.merge(b);
+           }).then([http_clients, total_reqs, secs] (latency_histogram latencies) {
+               return http_clients->map_reduce0([] (const http_client& c) {
+                   return std::make_pair(c.unsent_reqs(), c.errors());
+               }, std::make_pair(uint64_t(0), uint64_t(0)), [] (auto a, auto b) {
+                   return std::make_pair(a.first + b.first, a.second + b.second);
+               }).then([latencies, total_reqs, secs] (std::pair<uint64_t, uint64_t> failed) {
+                   fmt::print("Total cpus: {:d}\n", smp::count);
+                   fmt::print("Total requests: {:d}\n", total_reqs);
+                   fmt::print("Requests not completed: {:d}\n", failed.first);
+                   fmt::print("Errors: {:d}\n", failed.second);
+                   fmt::print("Total time: {:f}\n", secs);
+                   fmt::print("Requests/sec: {:f}\n", static_cast<double>(total_reqs) / secs);
+                   auto usecs = [] (uint64_t ns) { return ns / 1000.0; };
+                   fmt::print("Latency (usec): mean {:.1f} max {:.1f}\n", usecs(latencies.mean()), usecs(latencies.max()));
+                   for (auto q : {0.5, 0.9, 0.99, 0.999, 0.9999}) {
+                       fmt::print("  p{:<7} {:.1f}\n", q * 100, usecs(latencies.quantile(q)));
+                   }
+               });
+           }).then([http_clients] {
+               fmt::print("==========     done     ============\n");
+               return http_clients->stop().then([http_clients] {
+                   // FIXME: If we call engine().exit(0) here to exit when
+                   // requests are done. The tcp connection will not be closed
+                   // properly, becasue we exit too earily and the FIN packets are
+                   // not exchanged.
+                    delete http_clients;
+                    return make_ready_future<int>(0);
+               });
            });
         });
     });
@@ -105,7 +105,9 @@ macro (seastar_find_dependencies)
     numactl # No version information published.
     rt
     ucontext
-    yaml-cpp)
+    yaml-cpp
+    ZLIB
+    zstd)
 
   # Arguments to `find_package` for each 3rd-party dependency.
   # Note that the version specification is a "minimal" version requirement.
@@ -144,6 +146,10 @@ macro (seastar_find_dependencies)
   seastar_set_dep_args (ucontext REQUIRED)
   seastar_set_dep_args (yaml-cpp REQUIRED
     VERSION 0.5.1)
+  seastar_set_dep_args (ZLIB REQUIRED)
+  seastar_set_dep_args (zstd
+    VERSION 1.4.0
+    OPTION ${Seastar_ZSTD})
 
   foreach (third_party ${_seastar_all_dependencies})
     if (NOT _seastar_dep_skip_${third_party})
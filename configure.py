@@ -139,6 +139,8 @@ arg_parser.add_argument('--split-dwarf', dest='split_dwarf', action='store_true'
 arg_parser.add_argument('--compile-commands-json', dest='cc_json', action='store_true',
                         help='Generate a compile_commands.json file for integration with clangd and other tools.')
 arg_parser.add_argument('--heap-profiling', dest='heap_profiling', action='store_true', default=False, help='Enable heap profiling')
+arg_parser.add_argument('--frame-pointers', dest='frame_pointers', action='store_true', default=False,
+                        help='Build with frame pointers, for cheaper backtraces in heap profiling')
 arg_parser.add_argument('--dpdk-machine', default='native', help='Specify the target architecture')
 add_tristate(arg_parser, name='deferred-action-require-noexcept', dest='deferred_action_require_noexcept', help='noexcept requirement for deferred actions', default=True)
 arg_parser.add_argument('--prefix', dest='install_prefix', default='/usr/local', help='Root installation path of Seastar files')
@@ -206,6 +208,7 @@ def configure_mode(mode):
         tr(args.alloc_page_size, 'ALLOC_PAGE_SIZE'),
         tr(args.split_dwarf, 'SPLIT_DWARF'),
         tr(args.heap_profiling, 'HEAP_PROFILING'),
+        tr(args.frame_pointers, 'FRAME_POINTERS'),
         tr(args.deferred_action_require_noexcept, 'DEFERRED_ACTION_REQUIRE_NOEXCEPT'),
         tr(args.unused_result_error, 'UNUSED_RESULT_ERROR'),
         tr(args.debug_shared_ptr, 'DEBUG_SHARED_PTR', value_when_none='default'),
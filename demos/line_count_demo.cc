@@ -27,7 +27,6 @@
 #include <seastar/core/app-template.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <fmt/printf.h>
-#include <algorithm>
 #include <iostream>
 
 using namespace seastar;
@@ -41,16 +40,11 @@ struct reader {
     input_stream<char> is;
     size_t count = 0;
 
-    // for input_stream::consume():
-    using unconsumed_remainder = std::optional<temporary_buffer<char>>;
-    future<unconsumed_remainder> operator()(temporary_buffer<char> data) {
-        if (data.empty()) {
-            return make_ready_future<unconsumed_remainder>(std::move(data));
-        } else {
-            count += std::count(data.begin(), data.end(), '\n');
-            // FIXME: last line without \n?
-            return make_ready_future<unconsumed_remainder>();
-        }
+    future<> count_lines() {
+        return is.consume_lines([this] (temporary_buffer<char>) {
+            ++count;
+            return stop_iteration::no;
+        });
     }
 };
 
@@ -64,7 +58,7 @@ int main(int ac, char** av) {
         auto fname = app.configuration()["file"].as<std::string>();
         return open_file_dma(fname, open_flags::ro).then([] (file f) {
             auto r = make_shared<reader>(std::move(f));
-            return r->is.consume(*r).then([r] {
+            return r->count_lines().then([r] {
                fmt::print("{:d} lines\n", r->count);
                return r->is.close().then([r] {});
             });
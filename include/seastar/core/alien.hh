@@ -24,15 +24,19 @@
 
 #ifndef SEASTAR_MODULE
 #include <atomic>
+#include <cassert>
 #include <concepts>
+#include <cstdint>
 #include <future>
 #include <memory>
+#include <optional>
+#include <tuple>
 #include <type_traits>
-#include <boost/lockfree/queue.hpp>
 #endif
 
 #include <seastar/core/future.hh>
 #include <seastar/core/cacheline.hh>
+#include <seastar/core/internal/mpsc_ring.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/util/modules.hh>
@@ -50,15 +54,17 @@ namespace alien {
 class message_queue {
     static constexpr size_t batch_size = 128;
     static constexpr size_t prefetch_cnt = 2;
+    // Senders wait for the shard to catch up when the ring is full
+    static constexpr size_t ring_size = 4096;
     struct work_item;
     struct lf_queue_remote {
         reactor* remote;
     };
-    using lf_queue_base = boost::lockfree::queue<work_item*>;
+    using lf_queue_base = seastar::internal::mpsc_ring<work_item*>;
     // use inheritence to control placement order
     struct lf_queue : lf_queue_remote, lf_queue_base {
         lf_queue(reactor* remote)
-            : lf_queue_remote{remote}, lf_queue_base{batch_size} {}
+            : lf_queue_remote{remote}, lf_queue_base{ring_size} {}
         void maybe_wakeup();
     } _pending;
     struct alignas(seastar::cache_line_size) {
@@ -231,5 +237,123 @@ std::future<T> submit_to(unsigned shard, Func func) {
     return submit_to(*internal::default_instance, shard, std::move(func));
 }
 
+/// Result of a function submitted with a \ref completion_queue.
+SEASTAR_MODULE_EXPORT
+template <typename T>
+struct completion {
+    using value_type = std::conditional_t<std::is_void_v<T>, std::tuple<>, T>;
+    /// The tag passed to \ref submit_to()
+    uint64_t tag = 0;
+    /// Set if the function failed
+    std::exception_ptr ex;
+    /// Set if the function succeeded
+    std::optional<value_type> value;
+};
+
+/// Collects the results of functions submitted from an alien thread.
+///
+/// Unlike \ref submit_to() returning a \c std::future, which allocates a
+/// shared state and takes a lock per call, the shards push completions into
+/// a lock-free ring, which the alien thread drains in batches with \ref poll().
+/// A completion queue belongs to a single alien thread: only that thread may
+/// submit through it, poll it and wait on it. It must outlive the functions
+/// submitted through it.
+SEASTAR_MODULE_EXPORT
+template <typename T>
+class completion_queue {
+    seastar::internal::mpsc_ring<completion<T>> _ring;
+    // Touched by the alien thread only
+    size_t _in_flight = 0;
+    std::atomic<uint32_t> _signal{0};
+    std::atomic<bool> _sleeping{false};
+public:
+    /// \param capacity how many functions may be in flight at a time
+    explicit completion_queue(size_t capacity) : _ring(capacity) {}
+    completion_queue(const completion_queue&) = delete;
+
+    /// Number of submitted functions whose completion wasn't polled yet
+    size_t in_flight() const noexcept {
+        return _in_flight;
+    }
+    /// Whether \ref submit_to() has to wait for a \ref poll() first
+    bool full() const noexcept {
+        return _in_flight == _ring.capacity();
+    }
+
+    /// Calls \c func with every available completion, returns their number
+    template <typename Func>
+    requires std::invocable<Func, completion<T>&&>
+    size_t poll(Func func) {
+        completion<T> c;
+        size_t nr = 0;
+        while (_ring.try_pop(c)) {
+            --_in_flight;
+            ++nr;
+            func(std::move(c));
+        }
+        return nr;
+    }
+
+    /// Blocks until a completion is available, if any function is in flight
+    void wait() noexcept {
+        while (_in_flight && _ring.empty()) {
+            auto signal = _signal.load(std::memory_order_acquire);
+            _sleeping.store(true, std::memory_order_relaxed);
+            // pairs with the fence in complete()
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_ring.empty()) {
+                _signal.wait(signal);
+            }
+            _sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    /// \cond internal
+    void reserve() noexcept {
+        assert(!full());
+        ++_in_flight;
+    }
+    // Called by the shards
+    void complete(completion<T>&& c) noexcept {
+        // Can't fail, reserve() made room
+        _ring.try_push(std::move(c));
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleeping.load(std::memory_order_relaxed)) {
+            _signal.fetch_add(1, std::memory_order_release);
+            _signal.notify_one();
+        }
+    }
+    /// \endcond
+};
+
+/// Runs a function on a remote shard from an alien thread where engine() is not available,
+/// reporting its result to a \ref completion_queue.
+///
+/// \param instance designates the Seastar instance to process the message
+/// \param shard designates the shard to run the function on
+/// \param cq the queue receiving the result, must not be \ref completion_queue::full()
+/// \param tag identifies the call in the \ref completion
+/// \param func a callable to run on \c shard
+SEASTAR_MODULE_EXPORT
+template<std::invocable Func, typename T = internal::return_type_t<Func>>
+void submit_to(instance& instance, unsigned shard, completion_queue<T>& cq, uint64_t tag, Func func) {
+    cq.reserve();
+    run_on(instance, shard, [&cq, tag, func = std::move(func)] () mutable noexcept {
+        (void)futurize_invoke(func).then_wrapped([&cq, tag] (auto&& result) noexcept {
+            completion<T> c;
+            c.tag = tag;
+            if (result.failed()) {
+                c.ex = result.get_exception();
+            } else if constexpr (std::is_void_v<T>) {
+                result.get();
+                c.value.emplace();
+            } else {
+                c.value.emplace(result.get());
+            }
+            cq.complete(std::move(c));
+        });
+    });
+}
+
 }
 }
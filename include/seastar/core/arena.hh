@@ -0,0 +1,127 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/align.hh>
+#include <seastar/core/deleter.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <memory_resource>
+#endif
+
+namespace seastar {
+
+namespace memory {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup memory-module
+/// @{
+
+/// A bump-pointer allocator for objects which die together
+///
+/// Memory is carved out of blocks obtained from the shard's allocator and
+/// handed out by advancing a pointer, individual deallocations are no-ops
+/// (except for the most recent allocation, which is rolled back). All the
+/// memory is released at once by \ref reset() or by destroying the arena.
+///
+/// The arena is a \c std::pmr::memory_resource, so it can back \c std::pmr
+/// containers, and can allocate \ref temporary_buffer "temporary_buffers",
+/// which keep the memory they point to alive after the arena is reset or
+/// destroyed. Memory obtained otherwise must not be used past that point.
+///
+/// An arena must only be used on the shard which created it.
+class arena final : public std::pmr::memory_resource {
+    struct block {
+        block* next;
+    };
+    // The first block of the current generation, which links the others
+    block* _first = nullptr;
+    char* _pos = nullptr;
+    char* _end = nullptr;
+    char* _last_allocation = nullptr;
+    size_t _block_size;
+    size_t _memory = 0;
+    // Owns the blocks of the current generation, shared with the buffers
+    deleter _blocks_deleter;
+public:
+    static constexpr size_t default_block_size = 32 * 1024;
+
+    /// Constructs an empty arena, which allocates memory from the shard's
+    /// allocator in blocks of \c block_size bytes.
+    explicit arena(size_t block_size = default_block_size) noexcept
+        : _block_size(block_size) {}
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+    ~arena() = default;
+
+    /// Allocates a buffer of \c size elements, aligned to \c alignment. The
+    /// buffer keeps the memory of the arena alive until it is destroyed.
+    template <typename CharType = char>
+    temporary_buffer<CharType> allocate_buffer(size_t size, size_t alignment = 1) {
+        static_assert(sizeof(CharType) == 1, "must allocate byte type");
+        auto p = static_cast<CharType*>(allocate(size, alignment));
+        return temporary_buffer<CharType>(p, size, _blocks_deleter.share());
+    }
+
+    /// Releases all the memory allocated so far, apart from the blocks
+    /// still referenced by buffers, which are released with them.
+    void reset() noexcept;
+
+    /// Returns the number of bytes obtained from the shard's allocator since
+    /// the last \ref reset().
+    size_t memory() const noexcept {
+        return _memory;
+    }
+private:
+    virtual void* do_allocate(size_t bytes, size_t alignment) override {
+        auto p = align_up(_pos, alignment);
+        if (__builtin_expect(_pos && p + bytes <= _end, true)) {
+            _pos = p + bytes;
+            _last_allocation = p;
+            return p;
+        }
+        return allocate_slow(bytes, alignment);
+    }
+    virtual void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (p == _last_allocation && static_cast<char*>(p) + bytes == _pos) {
+            _pos = _last_allocation;
+            _last_allocation = nullptr;
+        }
+    }
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+    void* allocate_slow(size_t bytes, size_t alignment);
+    // Links a new block of \c size usable bytes, returns its start
+    char* add_block(size_t size);
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -0,0 +1,141 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <cstdint>
+#include <unordered_map>
+#endif
+
+namespace seastar {
+
+class cached_file_impl;
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fileio-module
+/// @{
+
+/// Shard-local cache of file pages
+///
+/// Keeps up to a configured amount of page-aligned file data read through
+/// \ref make_cached_file() "cached files", evicting the least recently used
+/// pages when it's full and when the shard runs low on memory. Writes,
+/// truncations and discards through a cached file invalidate the pages they
+/// touch; modifications made to the file by other means are not seen.
+///
+/// A page_cache must only be used on the shard that created it, and must
+/// outlive the files that use it.
+class page_cache {
+public:
+    struct config {
+        /// Maximum number of bytes of cached pages
+        size_t capacity = 64 << 20;
+        /// Size of the cached pages, rounded up to the files' read alignment
+        size_t page_size = 4096;
+        /// Label of the exported metrics
+        sstring name = "default";
+    };
+
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t reclaims = 0;
+    };
+private:
+    struct page_key {
+        uint64_t file_id;
+        uint64_t index;
+        bool operator==(const page_key&) const = default;
+    };
+    struct page_key_hash {
+        size_t operator()(const page_key& k) const noexcept {
+            return std::hash<uint64_t>()(k.file_id * 0x9e3779b97f4a7c15ull ^ k.index);
+        }
+    };
+    struct page : public boost::intrusive::list_base_hook<> {
+        page_key key;
+        temporary_buffer<char> data;
+        page(page_key k, temporary_buffer<char> d) noexcept : key(k), data(std::move(d)) {}
+    };
+    using page_map = std::unordered_map<page_key, page, page_key_hash>;
+    using lru_list = boost::intrusive::list<page, boost::intrusive::constant_time_size<false>>;
+
+    config _config;
+    page_map _pages;
+    // Most recently used first
+    lru_list _lru;
+    size_t _memory = 0;
+    uint64_t _next_file_id = 0;
+    stats _stats;
+    memory::reclaimer _reclaimer;
+    metrics::metric_groups _metrics;
+
+    friend class cached_file_impl;
+public:
+    explicit page_cache(config cfg);
+    page_cache(const page_cache&) = delete;
+    ~page_cache();
+
+    /// Returns the number of bytes of cached data
+    size_t memory() const noexcept {
+        return _memory;
+    }
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+
+    /// Drops all cached pages
+    void clear() noexcept;
+private:
+    uint64_t register_file() noexcept {
+        return _next_file_id++;
+    }
+    // Returns the cached page, or nullptr, and marks it used
+    temporary_buffer<char>* find(uint64_t file_id, uint64_t index) noexcept;
+    void insert(uint64_t file_id, uint64_t index, temporary_buffer<char> data);
+    // Drops the file's pages with indices in [from, to)
+    void invalidate(uint64_t file_id, uint64_t from, uint64_t to) noexcept;
+    void erase(page_map::iterator it) noexcept;
+    size_t evict(size_t bytes) noexcept;
+};
+
+/// Wraps \c f in a file whose reads are served from \c cache when possible
+///
+/// The returned file forwards all other operations to \c f, which it closes
+/// when it's closed itself.
+file make_cached_file(file f, page_cache& cache);
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+/// \file
+
+// Checksummed, and optionally compressed, file streams
+//
+// The data is cut in blocks of a fixed uncompressed size, each written with
+// a header holding its sizes, how it is compressed and the CRC32C checksums
+// of the header and of the stored bytes. An index of the blocks can be appended, so
+// that reading may start anywhere in the uncompressed data.
+#include <seastar/core/file.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/util/modules.hh>
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// How the blocks of a checksummed stream are compressed
+enum class block_compression {
+    none,
+    lz4,
+    zstd,   ///< Only if seastar is built with zstd
+};
+
+/// Whether the compression is available in this build
+bool block_compression_supported(block_compression c) noexcept;
+
+/// Options for \ref make_checksummed_file_output_stream()
+struct checksummed_stream_options {
+    /// Uncompressed size of the blocks, each is checksummed and compressed
+    /// on its own
+    size_t block_size = 65536;
+    block_compression compression = block_compression::none;
+    /// Compression level, 0 for the default of the algorithm. For lz4 this
+    /// is the acceleration factor.
+    int compression_level = 0;
+    /// Append an index of the blocks when the stream is closed, so that
+    /// input streams can start at any offset without reading what's before
+    bool index = true;
+};
+
+/// Thrown when a block of a checksummed stream doesn't match its checksum,
+/// or can't be decoded
+class checksum_mismatch_error : public std::runtime_error {
+    uint64_t _file_offset;
+public:
+    checksum_mismatch_error(uint64_t file_offset, const std::string& what)
+        : std::runtime_error(what), _file_offset(file_offset) {}
+    /// Position of the bad block in the file
+    uint64_t file_offset() const noexcept { return _file_offset; }
+};
+
+/// Create an output_stream writing checksummed blocks starting at the
+/// position zero of a newly created file.
+///
+/// Blocks are only cut when full, so flush() doesn't make the written data
+/// readable, close() does. Blocks that don't shrink are stored as is.
+/// Throws std::invalid_argument if the compression isn't supported.
+/// Closes the file if the stream creation fails.
+future<output_stream<char>> make_checksummed_file_output_stream(
+        file file,
+        checksummed_stream_options options = {},
+        file_output_stream_options file_options = {}) noexcept;
+
+/// Create an input_stream returning the uncompressed data of a file written
+/// by \ref make_checksummed_file_output_stream(), starting at \c offset of
+/// the uncompressed data.
+///
+/// The blocks are verified as they are read, a mismatch fails the read with
+/// \ref checksum_mismatch_error. Without an index in the file, the data
+/// before \c offset is read and dropped.
+input_stream<char> make_checksummed_file_input_stream(
+        file file,
+        uint64_t offset = 0,
+        file_input_stream_options options = {});
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -23,6 +23,11 @@
 
 #ifndef SEASTAR_MODULE
 #include <algorithm>
+#include <concepts>
+#include <cstring>
+#include <memory>
+#include <ranges>
+#include <span>
 #include <type_traits>
 #include <seastar/util/modules.hh>
 #endif
@@ -84,9 +89,14 @@ namespace seastar {
 // chunked_fifo uses uninitialized storage for unoccupied elements, and thus
 // uses move/copy constructors instead of move/copy assignments, which are
 // less efficient.
+//
+// The chunks are allocated with Alloc, rebound to the chunk type, so a
+// stateful allocator (e.g. backed by an arena) can provide their memory.
+// push_back_range() and pop_front_n() move many elements at once, a chunk
+// at a time; trivially copyable elements are copied with memcpy.
 
 SEASTAR_MODULE_EXPORT
-template <typename T, size_t items_per_chunk = 128>
+template <typename T, size_t items_per_chunk = 128, typename Alloc = std::allocator<T>>
 class chunked_fifo {
     static_assert((items_per_chunk & (items_per_chunk - 1)) == 0,
             "chunked_fifo chunk size must be power of two");
@@ -102,6 +112,11 @@ class chunked_fifo {
         unsigned begin;
         unsigned end;
     };
+    static_assert(sizeof(maybe_item) == sizeof(T));
+    using chunk_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<chunk>;
+    using chunk_traits = std::allocator_traits<chunk_allocator>;
+    static_assert(std::is_nothrow_move_constructible_v<chunk_allocator>);
+    [[no_unique_address]] chunk_allocator _alloc;
     // We pop from the chunk at _front_chunk. This chunk is then linked to
     // the following chunks via the "next" link. _back_chunk points to the
     // last chunk in this list, and it is where we push.
@@ -168,7 +183,8 @@ class chunked_fifo {
     using const_iterator = basic_iterator<true>;
 
 public:
-    chunked_fifo() noexcept = default;
+    chunked_fifo() noexcept requires std::default_initializable<Alloc> : _alloc() {}
+    explicit chunked_fifo(Alloc alloc) noexcept : _alloc(std::move(alloc)) {}
     chunked_fifo(chunked_fifo&& x) noexcept;
     chunked_fifo(const chunked_fifo& X) = delete;
     ~chunked_fifo();
@@ -180,8 +196,16 @@ class chunked_fifo {
     const T& back() const noexcept;
     template <typename... A>
     inline void emplace_back(A&&... args);
+    // Appends copies of the elements of r. The chunks needed are allocated
+    // upfront when the size of r is known.
+    template <std::ranges::input_range Range>
+    requires std::constructible_from<T, std::ranges::range_reference_t<Range>>
+    void push_back_range(Range&& r);
     inline T& front() const noexcept;
     inline void pop_front() noexcept;
+    // Moves up to out.size() items from the front into out and pops them.
+    // Returns the number of items moved.
+    size_t pop_front_n(std::span<T> out) noexcept(std::is_nothrow_move_assignable_v<T>);
     inline bool empty() const noexcept;
     inline size_t size() const noexcept;
     void clear() noexcept;
@@ -202,6 +226,8 @@ class chunked_fifo {
     inline const_iterator cbegin() const noexcept;
     inline const_iterator cend() const noexcept;
 private:
+    chunk* new_chunk();
+    void delete_chunk(chunk* c) noexcept;
     void back_chunk_new();
     void front_chunk_delete() noexcept;
     inline void ensure_room_back();
@@ -210,59 +236,59 @@ class chunked_fifo {
 
 };
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <bool IsConst>
 inline
-chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::basic_iterator(chunk_t* c) noexcept : _chunk(c), _item_index(_chunk ? _chunk->begin : 0) {
+chunked_fifo<T, items_per_chunk, Alloc>::basic_iterator<IsConst>::basic_iterator(chunk_t* c) noexcept : _chunk(c), _item_index(_chunk ? _chunk->begin : 0) {
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <bool IsConst>
 inline
-chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::basic_iterator(chunk_t* c, size_t item_index) noexcept : _chunk(c), _item_index(item_index) {
+chunked_fifo<T, items_per_chunk, Alloc>::basic_iterator<IsConst>::basic_iterator(chunk_t* c, size_t item_index) noexcept : _chunk(c), _item_index(item_index) {
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <bool IsConst>
 inline bool
-chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::operator==(const basic_iterator& o) const noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::basic_iterator<IsConst>::operator==(const basic_iterator& o) const noexcept {
     return _chunk == o._chunk && _item_index == o._item_index;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <bool IsConst>
 inline bool
-chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::operator!=(const basic_iterator& o) const noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::basic_iterator<IsConst>::operator!=(const basic_iterator& o) const noexcept {
     return !(*this == o);
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <bool IsConst>
-inline typename chunked_fifo<T, items_per_chunk>::template basic_iterator<IsConst>::pointer
-chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::operator->() const noexcept {
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::template basic_iterator<IsConst>::pointer
+chunked_fifo<T, items_per_chunk, Alloc>::basic_iterator<IsConst>::operator->() const noexcept {
     return &_chunk->items[chunked_fifo::mask(_item_index)].data;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <bool IsConst>
-inline typename chunked_fifo<T, items_per_chunk>::template basic_iterator<IsConst>::reference
-chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::operator*() const noexcept {
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::template basic_iterator<IsConst>::reference
+chunked_fifo<T, items_per_chunk, Alloc>::basic_iterator<IsConst>::operator*() const noexcept {
     return _chunk->items[chunked_fifo::mask(_item_index)].data;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <bool IsConst>
-inline typename chunked_fifo<T, items_per_chunk>::template basic_iterator<IsConst>
-chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::operator++(int) noexcept {
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::template basic_iterator<IsConst>
+chunked_fifo<T, items_per_chunk, Alloc>::basic_iterator<IsConst>::operator++(int) noexcept {
     auto it = *this;
     ++(*this);
     return it;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <bool IsConst>
-typename chunked_fifo<T, items_per_chunk>::template basic_iterator<IsConst>&
-chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::operator++() noexcept {
+typename chunked_fifo<T, items_per_chunk, Alloc>::template basic_iterator<IsConst>&
+chunked_fifo<T, items_per_chunk, Alloc>::basic_iterator<IsConst>::operator++() noexcept {
     ++_item_index;
     if (_item_index == _chunk->end) {
         _chunk = _chunk->next;
@@ -271,10 +297,11 @@ chunked_fifo<T, items_per_chunk>::basic_iterator<IsConst>::operator++() noexcept
     return *this;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline
-chunked_fifo<T, items_per_chunk>::chunked_fifo(chunked_fifo&& x) noexcept
-        : _front_chunk(x._front_chunk)
+chunked_fifo<T, items_per_chunk, Alloc>::chunked_fifo(chunked_fifo&& x) noexcept
+        : _alloc(std::move(x._alloc))
+        , _front_chunk(x._front_chunk)
         , _back_chunk(x._back_chunk)
         , _nchunks(x._nchunks)
         , _free_chunks(x._free_chunks)
@@ -286,10 +313,10 @@ chunked_fifo<T, items_per_chunk>::chunked_fifo(chunked_fifo&& x) noexcept
     x._nfree_chunks = 0;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline
-chunked_fifo<T, items_per_chunk>&
-chunked_fifo<T, items_per_chunk>::operator=(chunked_fifo&& x) noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>&
+chunked_fifo<T, items_per_chunk, Alloc>::operator=(chunked_fifo&& x) noexcept {
     if (&x != this) {
         this->~chunked_fifo();
         new (this) chunked_fifo(std::move(x));
@@ -297,21 +324,21 @@ chunked_fifo<T, items_per_chunk>::operator=(chunked_fifo&& x) noexcept {
     return *this;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline size_t
-chunked_fifo<T, items_per_chunk>::mask(size_t idx) noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::mask(size_t idx) noexcept {
     return idx & (items_per_chunk - 1);
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline bool
-chunked_fifo<T, items_per_chunk>::empty() const noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::empty() const noexcept {
     return _front_chunk == nullptr;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline size_t
-chunked_fifo<T, items_per_chunk>::size() const noexcept{
+chunked_fifo<T, items_per_chunk, Alloc>::size() const noexcept{
     if (_front_chunk == nullptr) {
         return 0;
     } else if (_back_chunk == _front_chunk) {
@@ -324,8 +351,8 @@ chunked_fifo<T, items_per_chunk>::size() const noexcept{
     }
 }
 
-template <typename T, size_t items_per_chunk>
-void chunked_fifo<T, items_per_chunk>::clear() noexcept {
+template <typename T, size_t items_per_chunk, typename Alloc>
+void chunked_fifo<T, items_per_chunk, Alloc>::clear() noexcept {
 #if 1
     while (!empty()) {
         pop_front();
@@ -343,7 +370,7 @@ void chunked_fifo<T, items_per_chunk>::clear() noexcept {
         _front_chunk->items[mask(i)].data.~T();
     }
     chunk *p = _front_chunk->next;
-    delete _front_chunk;
+    delete_chunk(_front_chunk);
     // Delete all the middle chunks (all completely filled)
     if (p) {
         while (p != _back_chunk) {
@@ -354,14 +381,14 @@ void chunked_fifo<T, items_per_chunk>::clear() noexcept {
                 // That should be fine..
                 p->items[i].data.~T();
         }
-            delete p;
+            delete_chunk(p);
             p = nextp;
         }
         // Finally delete back chunk (partially filled)
         for (auto i = _back_chunk->begin; i != _back_chunk->end; ++i) {
             _back_chunk->items[mask(i)].data.~T();
         }
-        delete _back_chunk;
+        delete_chunk(_back_chunk);
     }
     _front_chunk = nullptr;
     _back_chunk = nullptr;
@@ -369,32 +396,46 @@ void chunked_fifo<T, items_per_chunk>::clear() noexcept {
 #endif
 }
 
-template <typename T, size_t items_per_chunk> void
-chunked_fifo<T, items_per_chunk>::shrink_to_fit() noexcept {
+template <typename T, size_t items_per_chunk, typename Alloc> void
+chunked_fifo<T, items_per_chunk, Alloc>::shrink_to_fit() noexcept {
     while (_free_chunks) {
         auto next = _free_chunks->next;
-        delete _free_chunks;
+        delete_chunk(_free_chunks);
         _free_chunks = next;
     }
     _nfree_chunks = 0;
 }
 
-template <typename T, size_t items_per_chunk>
-chunked_fifo<T, items_per_chunk>::~chunked_fifo() {
+template <typename T, size_t items_per_chunk, typename Alloc>
+chunked_fifo<T, items_per_chunk, Alloc>::~chunked_fifo() {
     clear();
     shrink_to_fit();
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::chunk*
+chunked_fifo<T, items_per_chunk, Alloc>::new_chunk() {
+    auto c = chunk_traits::allocate(_alloc, 1);
+    return new (c) chunk;
+}
+
+template <typename T, size_t items_per_chunk, typename Alloc>
+inline void
+chunked_fifo<T, items_per_chunk, Alloc>::delete_chunk(chunk* c) noexcept {
+    c->~chunk();
+    chunk_traits::deallocate(_alloc, c, 1);
+}
+
+template <typename T, size_t items_per_chunk, typename Alloc>
 void
-chunked_fifo<T, items_per_chunk>::back_chunk_new() {
+chunked_fifo<T, items_per_chunk, Alloc>::back_chunk_new() {
     chunk *old = _back_chunk;
     if (_free_chunks) {
         _back_chunk = _free_chunks;
         _free_chunks = _free_chunks->next;
         --_nfree_chunks;
     } else {
-        _back_chunk = new chunk;
+        _back_chunk = new_chunk();
     }
     _back_chunk->next = nullptr;
     _back_chunk->begin = 0;
@@ -409,9 +450,9 @@ chunked_fifo<T, items_per_chunk>::back_chunk_new() {
 }
 
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline void
-chunked_fifo<T, items_per_chunk>::ensure_room_back() {
+chunked_fifo<T, items_per_chunk, Alloc>::ensure_room_back() {
     // If we don't have a back chunk or it's full, we need to create a new one
     if (_back_chunk == nullptr ||
             (_back_chunk->end - _back_chunk->begin) == items_per_chunk) {
@@ -419,15 +460,15 @@ chunked_fifo<T, items_per_chunk>::ensure_room_back() {
     }
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 void
-chunked_fifo<T, items_per_chunk>::undo_room_back() noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::undo_room_back() noexcept {
     // If we failed creating a new item after ensure_room_back() created a
     // new empty chunk, we must remove it, or empty() will be incorrect
     // (either immediately, if the fifo was empty, or when all the items are
     // popped, if it already had items).
     if (_back_chunk->begin == _back_chunk->end) {
-        delete _back_chunk;
+        delete_chunk(_back_chunk);
         --_nchunks;
         if (_nchunks == 0) {
             _back_chunk = nullptr;
@@ -447,10 +488,10 @@ chunked_fifo<T, items_per_chunk>::undo_room_back() noexcept {
 
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 template <typename... Args>
 inline void
-chunked_fifo<T, items_per_chunk>::emplace_back(Args&&... args) {
+chunked_fifo<T, items_per_chunk, Alloc>::emplace_back(Args&&... args) {
     ensure_room_back();
     auto p = &_back_chunk->items[mask(_back_chunk->end)].data;
     try {
@@ -462,9 +503,9 @@ chunked_fifo<T, items_per_chunk>::emplace_back(Args&&... args) {
     ++_back_chunk->end;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline void
-chunked_fifo<T, items_per_chunk>::push_back(const T& data) {
+chunked_fifo<T, items_per_chunk, Alloc>::push_back(const T& data) {
     ensure_room_back();
     auto p = &_back_chunk->items[mask(_back_chunk->end)].data;
     try {
@@ -476,9 +517,9 @@ chunked_fifo<T, items_per_chunk>::push_back(const T& data) {
     ++_back_chunk->end;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline void
-chunked_fifo<T, items_per_chunk>::push_back(T&& data) {
+chunked_fifo<T, items_per_chunk, Alloc>::push_back(T&& data) {
     ensure_room_back();
     auto p = &_back_chunk->items[mask(_back_chunk->end)].data;
     try {
@@ -490,29 +531,29 @@ chunked_fifo<T, items_per_chunk>::push_back(T&& data) {
     ++_back_chunk->end;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline
 T&
-chunked_fifo<T, items_per_chunk>::back() noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::back() noexcept {
     return _back_chunk->items[mask(_back_chunk->end - 1)].data;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline
 const T&
-chunked_fifo<T, items_per_chunk>::back() const noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::back() const noexcept {
     return _back_chunk->items[mask(_back_chunk->end - 1)].data;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline T&
-chunked_fifo<T, items_per_chunk>::front() const noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::front() const noexcept {
     return _front_chunk->items[mask(_front_chunk->begin)].data;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline void
-chunked_fifo<T, items_per_chunk>::front_chunk_delete() noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::front_chunk_delete() noexcept {
     chunk *next = _front_chunk->next;
     // Certain use cases may need to repeatedly allocate and free a chunk -
     // an obvious example is an empty queue to which we push, and then pop,
@@ -531,7 +572,7 @@ chunked_fifo<T, items_per_chunk>::front_chunk_delete() noexcept {
         _free_chunks = _front_chunk;
         ++_nfree_chunks;
     } else {
-        delete _front_chunk;
+        delete_chunk(_front_chunk);
     }
     // If we only had one chunk, _back_chunk is gone too.
     if (_back_chunk == _front_chunk) {
@@ -541,9 +582,9 @@ chunked_fifo<T, items_per_chunk>::front_chunk_delete() noexcept {
     --_nchunks;
 }
 
-template <typename T, size_t items_per_chunk>
+template <typename T, size_t items_per_chunk, typename Alloc>
 inline void
-chunked_fifo<T, items_per_chunk>::pop_front() noexcept {
+chunked_fifo<T, items_per_chunk, Alloc>::pop_front() noexcept {
     front().~T();
     // If the front chunk has become empty, we need to free remove it and use
     // the next one.
@@ -552,8 +593,60 @@ chunked_fifo<T, items_per_chunk>::pop_front() noexcept {
     }
 }
 
-template <typename T, size_t items_per_chunk>
-void chunked_fifo<T, items_per_chunk>::reserve(size_t n) {
+template <typename T, size_t items_per_chunk, typename Alloc>
+template <std::ranges::input_range Range>
+requires std::constructible_from<T, std::ranges::range_reference_t<Range>>
+void chunked_fifo<T, items_per_chunk, Alloc>::push_back_range(Range&& r) {
+    if constexpr (std::ranges::sized_range<Range>) {
+        reserve(size() + std::ranges::size(r));
+    }
+    if constexpr (std::ranges::contiguous_range<Range> && std::ranges::sized_range<Range>
+            && std::is_same_v<std::remove_cv_t<std::ranges::range_value_t<Range>>, T>
+            && std::is_trivially_copyable_v<T>) {
+        auto src = std::ranges::data(r);
+        size_t n = std::ranges::size(r);
+        while (n) {
+            ensure_room_back();
+            // The free items of the back chunk may wrap around
+            size_t room = items_per_chunk - (_back_chunk->end - _back_chunk->begin);
+            size_t k = std::min({n, room, items_per_chunk - mask(_back_chunk->end)});
+            std::memcpy(&_back_chunk->items[mask(_back_chunk->end)].data, src, k * sizeof(T));
+            _back_chunk->end += k;
+            src += k;
+            n -= k;
+        }
+    } else {
+        for (auto&& x : r) {
+            emplace_back(std::forward<decltype(x)>(x));
+        }
+    }
+}
+
+template <typename T, size_t items_per_chunk, typename Alloc>
+size_t
+chunked_fifo<T, items_per_chunk, Alloc>::pop_front_n(std::span<T> out) noexcept(std::is_nothrow_move_assignable_v<T>) {
+    size_t n = 0;
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        while (n < out.size() && _front_chunk) {
+            size_t avail = _front_chunk->end - _front_chunk->begin;
+            size_t k = std::min({out.size() - n, avail, items_per_chunk - mask(_front_chunk->begin)});
+            std::memcpy(out.data() + n, &_front_chunk->items[mask(_front_chunk->begin)].data, k * sizeof(T));
+            n += k;
+            if ((_front_chunk->begin += k) == _front_chunk->end) {
+                front_chunk_delete();
+            }
+        }
+    } else {
+        for (; n < out.size() && !empty(); ++n) {
+            out[n] = std::move(front());
+            pop_front();
+        }
+    }
+    return n;
+}
+
+template <typename T, size_t items_per_chunk, typename Alloc>
+void chunked_fifo<T, items_per_chunk, Alloc>::reserve(size_t n) {
     // reserve() guarantees that (n - size()) additional push()es will
     // succeed without reallocation:
     if (n <= size()) {
@@ -574,46 +667,46 @@ void chunked_fifo<T, items_per_chunk>::reserve(size_t n) {
     }
     needed_chunks -= _nfree_chunks;
     while (needed_chunks--) {
-        chunk *c = new chunk;
+        chunk *c = new_chunk();
         c->next = _free_chunks;
         _free_chunks = c;
         ++_nfree_chunks;
     }
 }
 
-template <typename T, size_t items_per_chunk>
-inline typename chunked_fifo<T, items_per_chunk>::iterator
-chunked_fifo<T, items_per_chunk>::begin() noexcept {
+template <typename T, size_t items_per_chunk, typename Alloc>
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::iterator
+chunked_fifo<T, items_per_chunk, Alloc>::begin() noexcept {
     return iterator(_front_chunk);
 }
 
-template <typename T, size_t items_per_chunk>
-inline typename chunked_fifo<T, items_per_chunk>::iterator
-chunked_fifo<T, items_per_chunk>::end() noexcept {
+template <typename T, size_t items_per_chunk, typename Alloc>
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::iterator
+chunked_fifo<T, items_per_chunk, Alloc>::end() noexcept {
     return iterator(nullptr);
 }
 
-template <typename T, size_t items_per_chunk>
-inline typename chunked_fifo<T, items_per_chunk>::const_iterator
-chunked_fifo<T, items_per_chunk>::begin() const noexcept {
+template <typename T, size_t items_per_chunk, typename Alloc>
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::const_iterator
+chunked_fifo<T, items_per_chunk, Alloc>::begin() const noexcept {
     return const_iterator(_front_chunk);
 }
 
-template <typename T, size_t items_per_chunk>
-inline typename chunked_fifo<T, items_per_chunk>::const_iterator
-chunked_fifo<T, items_per_chunk>::end() const noexcept {
+template <typename T, size_t items_per_chunk, typename Alloc>
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::const_iterator
+chunked_fifo<T, items_per_chunk, Alloc>::end() const noexcept {
     return const_iterator(nullptr);
 }
 
-template <typename T, size_t items_per_chunk>
-inline typename chunked_fifo<T, items_per_chunk>::const_iterator
-chunked_fifo<T, items_per_chunk>::cbegin() const noexcept {
+template <typename T, size_t items_per_chunk, typename Alloc>
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::const_iterator
+chunked_fifo<T, items_per_chunk, Alloc>::cbegin() const noexcept {
     return const_iterator(_front_chunk);
 }
 
-template <typename T, size_t items_per_chunk>
-inline typename chunked_fifo<T, items_per_chunk>::const_iterator
-chunked_fifo<T, items_per_chunk>::cend() const noexcept {
+template <typename T, size_t items_per_chunk, typename Alloc>
+inline typename chunked_fifo<T, items_per_chunk, Alloc>::const_iterator
+chunked_fifo<T, items_per_chunk, Alloc>::cend() const noexcept {
     return const_iterator(nullptr);
 }
 
@@ -26,8 +26,11 @@
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <concepts>
+#include <cstring>
 #include <memory>
 #include <algorithm>
+#include <ranges>
+#include <span>
 #endif
 
 namespace seastar {
@@ -58,6 +61,9 @@ namespace seastar {
 ///     * pop_back() will invalidate end().
 ///
 /// reserve() may also invalidate all iterators and references.
+///
+/// push_back_range() and pop_front_n() move many elements at once; trivially
+/// copyable elements are copied with memcpy.
 SEASTAR_MODULE_EXPORT
 template <typename T, typename Alloc = std::allocator<T>>
 class circular_buffer {
@@ -103,6 +109,14 @@ class circular_buffer {
     void push_back(T&& data);
     template <typename... A>
     void emplace_back(A&&... args);
+    /// Appends copies of the elements of \c r, expanding the storage at most once
+    /// if the size of \c r is known.
+    template <std::ranges::input_range Range>
+    requires std::constructible_from<T, std::ranges::range_reference_t<Range>>
+    void push_back_range(Range&& r);
+    /// Moves up to \c out.size() elements from the front into \c out and pops them.
+    /// \returns the number of elements moved
+    size_t pop_front_n(std::span<T> out) noexcept(std::is_nothrow_move_assignable_v<T>);
     T& front() noexcept;
     const T& front() const noexcept;
     T& back() noexcept;
@@ -126,6 +140,10 @@ class circular_buffer {
     void expand(size_t);
     void maybe_expand(size_t nr = 1);
     size_t mask(size_t idx) const;
+    template <typename Range>
+    static constexpr bool is_memcpy_range = std::ranges::contiguous_range<Range> && std::ranges::sized_range<Range>
+            && std::is_same_v<std::remove_cv_t<std::ranges::range_value_t<Range>>, T>
+            && std::is_trivially_copyable_v<T>;
 
     template<typename CB, typename ValueType>
     struct cbiterator {
@@ -422,6 +440,55 @@ circular_buffer<T, Alloc>::emplace_back(Args&&... args) {
     ++_impl.end;
 }
 
+template <typename T, typename Alloc>
+template <std::ranges::input_range Range>
+requires std::constructible_from<T, std::ranges::range_reference_t<Range>>
+void
+circular_buffer<T, Alloc>::push_back_range(Range&& r) {
+    if constexpr (is_memcpy_range<Range>) {
+        size_t n = std::ranges::size(r);
+        if (!n) {
+            return;
+        }
+        reserve(size() + n);
+        // The free space may wrap around the end of the storage
+        auto start = mask(_impl.end);
+        auto first = std::min(n, _impl.capacity - start);
+        std::memcpy(_impl.storage + start, std::ranges::data(r), first * sizeof(T));
+        std::memcpy(_impl.storage, std::ranges::data(r) + first, (n - first) * sizeof(T));
+        _impl.end += n;
+    } else {
+        if constexpr (std::ranges::sized_range<Range>) {
+            reserve(size() + std::ranges::size(r));
+        }
+        for (auto&& x : r) {
+            emplace_back(std::forward<decltype(x)>(x));
+        }
+    }
+}
+
+template <typename T, typename Alloc>
+size_t
+circular_buffer<T, Alloc>::pop_front_n(std::span<T> out) noexcept(std::is_nothrow_move_assignable_v<T>) {
+    size_t n = std::min(size(), out.size());
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        if (!n) {
+            return 0;
+        }
+        auto start = mask(_impl.begin);
+        auto first = std::min(n, _impl.capacity - start);
+        std::memcpy(out.data(), _impl.storage + start, first * sizeof(T));
+        std::memcpy(out.data() + first, _impl.storage, (n - first) * sizeof(T));
+        _impl.begin += n;
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = std::move(front());
+            pop_front();
+        }
+    }
+    return n;
+}
+
 template <typename T, typename Alloc>
 inline
 T&
@@ -30,32 +30,177 @@
 
 #ifndef SEASTAR_MODULE
 #include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <new>
 #endif
 
 namespace seastar {
 
 namespace internal {
 
+struct coroutine_frame_stats {
+    // Frames reused from the freelists
+    uint64_t recycled = 0;
+    // Frames taken from the allocator
+    uint64_t allocated = 0;
+    // Frames above the largest size class, never recycled
+    uint64_t large = 0;
+};
+
+// Recycles the frames of the coroutines returning futures. Frames are
+// rounded up to size classes, each with a bounded freelist of the frames
+// freed last, so a coroutine called again and again gets its frame without
+// going through the allocator. The freelists are per thread, and hold
+// frames freed on any thread. Debug builds leave the frames to the
+// allocator, so that sanitizers see every one of them.
+class coroutine_frame_pool {
+    static constexpr size_t granularity = 64;
+    static constexpr size_t nr_classes = 32;
+    static constexpr unsigned max_cached = 256;
+    struct free_frame {
+        free_frame* next;
+    };
+    struct freelist {
+        free_frame* head;
+        unsigned count;
+    };
+    freelist _classes[nr_classes];
+    coroutine_frame_stats _stats;
+public:
+    void* allocate(size_t size) {
+        auto idx = (size - 1) / granularity;
+#ifndef SEASTAR_DEBUG
+        if (idx < nr_classes) {
+            auto& fl = _classes[idx];
+            if (auto f = fl.head) {
+                fl.head = f->next;
+                --fl.count;
+                ++_stats.recycled;
+                return f;
+            }
+            ++_stats.allocated;
+            return ::operator new((idx + 1) * granularity);
+        }
+#endif
+        ++(idx < nr_classes ? _stats.allocated : _stats.large);
+        return ::operator new(size);
+    }
+    void deallocate(void* p, size_t size) noexcept {
+        auto idx = (size - 1) / granularity;
+#ifndef SEASTAR_DEBUG
+        if (idx < nr_classes) {
+            auto& fl = _classes[idx];
+            if (fl.count < max_cached) {
+                fl.head = new (p) free_frame{fl.head};
+                ++fl.count;
+            } else {
+                ::operator delete(p, (idx + 1) * granularity);
+            }
+            return;
+        }
+#endif
+        ::operator delete(p, size);
+    }
+    // Returns the cached frames to the allocator
+    void drain() noexcept;
+    const coroutine_frame_stats& stats() const noexcept {
+        return _stats;
+    }
+    static coroutine_frame_pool& local() noexcept;
+};
+
+// Constant initialized and trivially destructible: accessing it costs no
+// initialization check
+extern thread_local coroutine_frame_pool local_coroutine_frame_pool;
+
+inline coroutine_frame_pool& coroutine_frame_pool::local() noexcept {
+    return local_coroutine_frame_pool;
+}
+
+// See reactor_options::coroutine_direct_resume
+extern thread_local bool coroutine_direct_resume;
+extern thread_local unsigned coroutine_direct_resume_depth;
+constexpr unsigned max_coroutine_direct_resume_depth = 16;
+
+inline void set_coroutine_direct_resume(bool enable) noexcept {
+    coroutine_direct_resume = enable;
+}
+
+// Runs the task that waits for a coroutine which just completed, within
+// the task of the coroutine, unless that would run out of task quota, run
+// it in another scheduling group or nest too deep
+inline void resume_or_schedule(task* t) noexcept {
+    if (!t) {
+        return;
+    }
+    if (coroutine_direct_resume_depth < max_coroutine_direct_resume_depth && !need_preempt()
+            && t->group() == current_scheduling_group()) {
+        ++coroutine_direct_resume_depth;
+        t->run_and_dispose();
+        --coroutine_direct_resume_depth;
+    } else {
+        schedule(t);
+    }
+}
+
+// Completes a coroutine. The task waiting for it, if released from the
+// promise when the coroutine returned, runs only once the whole frame, its
+// parameters and promise included, has been destroyed, just as if it had
+// been scheduled.
+struct final_awaiter {
+    task* waiter;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> h) const noexcept {
+        // We live in the frame
+        auto w = waiter;
+        h.destroy();
+        resume_or_schedule(w);
+    }
+    void await_resume() const noexcept { }
+};
+
 template <typename T = void>
 class coroutine_traits_base {
 public:
     class promise_type final : public seastar::task {
         seastar::promise<T> _promise;
+        // The task waiting for the coroutine, to be resumed by final_suspend()
+        task* _waiter = nullptr;
+
+        void release_waiter() noexcept {
+            if (coroutine_direct_resume && !_waiter) {
+                _waiter = _promise.release_waiting_task();
+            }
+        }
     public:
         promise_type() = default;
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+        static void* operator new(size_t size) {
+            return coroutine_frame_pool::local().allocate(size);
+        }
+        static void operator delete(void* p, size_t size) noexcept {
+            coroutine_frame_pool::local().deallocate(p, size);
+        }
+
         template<typename... U>
         void return_value(U&&... value) {
+            release_waiter();
             _promise.set_value(std::forward<U>(value)...);
         }
 
         void return_value(coroutine::exception ce) noexcept {
+            release_waiter();
             _promise.set_exception(std::move(ce.eptr));
         }
 
         void set_exception(std::exception_ptr&& eptr) noexcept {
+            release_waiter();
             _promise.set_exception(std::move(eptr));
         }
 
@@ -65,6 +210,7 @@ class coroutine_traits_base {
         }
 
         void unhandled_exception() noexcept {
+            release_waiter();
             _promise.set_exception(std::current_exception());
         }
 
@@ -73,7 +219,7 @@ class coroutine_traits_base {
         }
 
         std::suspend_never initial_suspend() noexcept { return { }; }
-        std::suspend_never final_suspend() noexcept { return { }; }
+        final_awaiter final_suspend() noexcept { return { _waiter }; }
 
         virtual void run_and_dispose() noexcept override {
             auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
@@ -93,20 +239,38 @@ class coroutine_traits_base<> {
 public:
    class promise_type final : public seastar::task {
         seastar::promise<> _promise;
+        // The task waiting for the coroutine, to be resumed by final_suspend()
+        task* _waiter = nullptr;
+
+        void release_waiter() noexcept {
+            if (coroutine_direct_resume && !_waiter) {
+                _waiter = _promise.release_waiting_task();
+            }
+        }
     public:
         promise_type() = default;
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+        static void* operator new(size_t size) {
+            return coroutine_frame_pool::local().allocate(size);
+        }
+        static void operator delete(void* p, size_t size) noexcept {
+            coroutine_frame_pool::local().deallocate(p, size);
+        }
+
         void return_void() noexcept {
+            release_waiter();
             _promise.set_value();
         }
 
         void set_exception(std::exception_ptr&& eptr) noexcept {
+            release_waiter();
             _promise.set_exception(std::move(eptr));
         }
 
         void unhandled_exception() noexcept {
+            release_waiter();
             _promise.set_exception(std::current_exception());
         }
 
@@ -115,7 +279,7 @@ class coroutine_traits_base<> {
         }
 
         std::suspend_never initial_suspend() noexcept { return { }; }
-        std::suspend_never final_suspend() noexcept { return { }; }
+        final_awaiter final_suspend() noexcept { return { _waiter }; }
 
         virtual void run_and_dispose() noexcept override {
             auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
@@ -0,0 +1,82 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/util/backtrace.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// A stack sampled by the CPU profiler, with the number of times it was
+/// sampled in a scheduling group.
+struct cpu_profile_stack {
+    scheduling_group group;
+    /// Innermost frame first
+    simple_backtrace backtrace;
+    uint64_t samples;
+};
+
+/// \brief Continuous, low frequency CPU profiling of the reactor threads.
+///
+/// Each reactor thread is sampled every \c period of the CPU time it
+/// consumes, by a perf_event task clock, or a thread CPU time timer when
+/// perf events are not available. The signal handler captures the backtrace
+/// of the thread with \ref backtrace(), and the samples are aggregated per
+/// scheduling group and stack in the memory of the shard. The profile can be
+/// served over HTTP, see \ref httpd::cpu_profile_handler.
+///
+/// The profiler can also be started with the \c --cpu-profiler-period-us
+/// option.
+namespace cpu_profiler {
+
+/// Starts sampling on all shards, clearing the profiles collected so far.
+future<> start(std::chrono::microseconds period = std::chrono::microseconds(10101));
+
+/// Stops sampling on all shards, and drops the profiles.
+future<> stop();
+
+/// Returns the sampling period on the current shard, zero when the
+/// profiler isn't running.
+std::chrono::nanoseconds local_period() noexcept;
+
+/// Returns the stacks sampled on the current shard since the profiler was
+/// started.
+std::vector<cpu_profile_stack> local_profile();
+
+/// Returns the number of samples of the current shard that were dropped
+/// because they weren't aggregated fast enough.
+uint64_t local_dropped_samples() noexcept;
+
+}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
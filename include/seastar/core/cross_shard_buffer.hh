@@ -0,0 +1,142 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+template <typename T>
+struct is_temporary_buffer : std::false_type {};
+
+template <typename CharType>
+struct is_temporary_buffer<temporary_buffer<CharType>> : std::true_type {
+    using char_type = CharType;
+};
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+namespace memory {
+
+/// Allocates memory from the pool of another shard.
+///
+/// The allocation runs on \c shard, so the memory is bound to its NUMA
+/// node. A producer can fill a buffer which is then handed to \c shard,
+/// instead of making every access of the consumer a remote one. The memory
+/// is released with ::free(), on any shard.
+///
+/// \param shard shard whose memory is used
+/// \param size number of bytes to allocate
+/// \param alignment alignment of the memory, a power of two; raised to
+///        sizeof(void*) if smaller, as posix_memalign() requires
+/// \return pointer to the memory; fails with std::bad_alloc
+inline
+future<void*> allocate_on_shard(shard_id shard, size_t size, size_t alignment = alignof(std::max_align_t)) {
+    alignment = std::max(alignment, sizeof(void*));
+    auto allocate = [size, alignment] {
+        void* ptr = nullptr;
+        if (::posix_memalign(&ptr, alignment, size)) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    };
+    if (shard == this_shard_id()) {
+        return futurize_invoke(allocate);
+    }
+    return smp::submit_to(shard, std::move(allocate));
+}
+
+}
+
+/// Creates a temporary_buffer in the memory of another shard.
+///
+/// See \ref memory::allocate_on_shard(). The buffer can be dropped on any
+/// shard.
+template <typename CharType = char>
+future<temporary_buffer<CharType>> make_temporary_buffer_on_shard(shard_id shard, size_t size) {
+    return memory::allocate_on_shard(shard, size * sizeof(CharType), alignof(CharType)).then([size] (void* ptr) {
+        return temporary_buffer<CharType>(static_cast<CharType*>(ptr), size, make_free_deleter(ptr));
+    });
+}
+
+/// Buffers smaller than this are not worth copying in migrate_on_receive()
+constexpr size_t default_migrate_on_receive_threshold = 64 * 1024;
+
+/// Moves a large buffer received from another shard to local memory.
+///
+/// When \c buf is at least \c threshold bytes long and lives on another
+/// NUMA node, it is copied to the memory of the current shard, so that the
+/// consumer only pays for the remote accesses once. Otherwise it is returned
+/// as is. Opt in where a buffer is read several times, or kept for long.
+template <typename CharType>
+temporary_buffer<CharType> migrate_on_receive(temporary_buffer<CharType> buf,
+        size_t threshold = default_migrate_on_receive_threshold) {
+    if (buf.size() * sizeof(CharType) < threshold || memory::is_numa_local(buf.get())) {
+        return buf;
+    }
+    return buf.clone();
+}
+
+/// Moves a large buffer owned by another shard to local memory.
+///
+/// Like \ref migrate_on_receive(temporary_buffer<CharType>, size_t), for a
+/// buffer held by a \ref foreign_ptr. When the buffer is copied, the
+/// foreign_ptr is released right away. Otherwise the returned buffer shares
+/// its data and keeps the foreign_ptr, which is released on its shard once
+/// the buffer is dropped.
+template <typename PtrType>
+requires internal::is_temporary_buffer<std::remove_const_t<typename foreign_ptr<PtrType>::element_type>>::value
+auto migrate_on_receive(foreign_ptr<PtrType> p, size_t threshold = default_migrate_on_receive_threshold) {
+    using buffer_type = std::remove_const_t<typename foreign_ptr<PtrType>::element_type>;
+    using char_type = typename internal::is_temporary_buffer<buffer_type>::char_type;
+    if (p->size() * sizeof(char_type) >= threshold && !memory::is_numa_local(p->get())) {
+        return p->clone();
+    }
+    auto data = const_cast<char_type*>(p->get());
+    auto size = p->size();
+    return buffer_type(data, size, make_object_deleter(std::move(p)));
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
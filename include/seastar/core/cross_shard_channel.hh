@@ -0,0 +1,321 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/cacheline.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#endif
+
+namespace seastar {
+
+/// \cond internal
+namespace internal {
+
+// One side of a cross_shard_channel. Endpoints are polled by the shard they
+// are registered on along with the smp queues.
+class cross_shard_channel_endpoint {
+public:
+    virtual ~cross_shard_channel_endpoint() = default;
+    // Publishes local progress and completes waiters, returns true if
+    // work was done
+    virtual bool poll() noexcept = 0;
+    // Returns true if poll() has work to do
+    virtual bool pure_poll() const noexcept = 0;
+};
+
+void register_cross_shard_channel_endpoint(cross_shard_channel_endpoint& ep);
+void unregister_cross_shard_channel_endpoint(cross_shard_channel_endpoint& ep) noexcept;
+bool poll_cross_shard_channels() noexcept;
+bool pure_poll_cross_shard_channels() noexcept;
+
+}
+/// \endcond
+
+/// Bounded single-producer single-consumer channel between two shards.
+///
+/// Items pushed on the producer shard are popped on the consumer shard
+/// without submitting a message per item. The items live in a ring shared
+/// by both shards; each side publishes its position in the ring once a
+/// cache line worth of items was pushed or popped, or when the shard polls
+/// its smp queues, so the two shards only exchange cache lines once per
+/// batch. The poll also completes waiting push() and pop() calls and wakes
+/// up the other shard if it sleeps.
+///
+/// The channel is constructed on the producer shard and must be started
+/// with start() before use, and stopped with stop() before destruction.
+/// push() and try_push() are only allowed on the producer shard, pop() and
+/// try_pop() on the consumer shard. Any number of fibers may push or pop
+/// concurrently on their shard; items keep the order of the calls.
+///
+/// \tparam T type of the items, needs to be nothrow move constructible
+SEASTAR_MODULE_EXPORT
+template <typename T>
+requires std::is_nothrow_move_constructible_v<T>
+class cross_shard_channel {
+    struct slot {
+        union {
+            T value;
+        };
+        slot() noexcept {}
+        ~slot() {}
+    };
+    static constexpr size_t batch_size = std::max<size_t>(1, cache_line_size / sizeof(slot));
+
+    struct pending_push {
+        T value;
+        promise<> pr;
+    };
+
+    class producer final : public internal::cross_shard_channel_endpoint {
+        cross_shard_channel& _ch;
+    public:
+        size_t write = 0;
+        size_t published = 0;
+        size_t cached_head = 0;
+        circular_buffer<pending_push> pending;
+
+        explicit producer(cross_shard_channel& ch) noexcept : _ch(ch) {}
+        virtual bool poll() noexcept override {
+            bool work = false;
+            while (!pending.empty() && _ch.try_store(std::move(pending.front().value))) {
+                pending.front().pr.set_value();
+                pending.pop_front();
+                work = true;
+            }
+            if (write != published) {
+                _ch.publish_tail();
+                work = true;
+            }
+            return work;
+        }
+        virtual bool pure_poll() const noexcept override {
+            return write != published
+                || (!pending.empty() && _ch._head.load(std::memory_order_relaxed) + _ch.capacity() != write);
+        }
+    };
+
+    class consumer final : public internal::cross_shard_channel_endpoint {
+        cross_shard_channel& _ch;
+    public:
+        size_t read = 0;
+        size_t published = 0;
+        size_t cached_tail = 0;
+        circular_buffer<promise<T>> waiters;
+
+        explicit consumer(cross_shard_channel& ch) noexcept : _ch(ch) {}
+        virtual bool poll() noexcept override {
+            bool work = false;
+            while (!waiters.empty()) {
+                auto v = _ch.try_load();
+                if (!v) {
+                    break;
+                }
+                waiters.front().set_value(std::move(*v));
+                waiters.pop_front();
+                work = true;
+            }
+            if (read != published) {
+                _ch.publish_head();
+                work = true;
+            }
+            return work;
+        }
+        virtual bool pure_poll() const noexcept override {
+            return read != published
+                || (!waiters.empty() && _ch._tail.load(std::memory_order_relaxed) != read);
+        }
+    };
+
+    // Each index is written by one side only and read by the other, keep
+    // them, and the state private to each side, on separate cache lines
+    alignas(cache_line_size) std::atomic<size_t> _tail{0};
+    alignas(cache_line_size) std::atomic<size_t> _head{0};
+    alignas(cache_line_size) producer _producer;
+    alignas(cache_line_size) consumer _consumer;
+    std::unique_ptr<slot[]> _ring;
+    size_t _mask;
+    shard_id _producer_shard;
+    shard_id _consumer_shard;
+    bool _started = false;
+private:
+    bool try_store(T&& value) noexcept {
+        auto& p = _producer;
+        if (p.write - p.cached_head == capacity()) {
+            p.cached_head = _head.load(std::memory_order_acquire);
+            if (p.write - p.cached_head == capacity()) {
+                return false;
+            }
+        }
+        new (&_ring[p.write & _mask].value) T(std::move(value));
+        if (++p.write - p.published >= batch_size) {
+            publish_tail();
+        }
+        return true;
+    }
+    std::optional<T> try_load() noexcept {
+        auto& c = _consumer;
+        if (c.read == c.cached_tail) {
+            c.cached_tail = _tail.load(std::memory_order_acquire);
+            if (c.read == c.cached_tail) {
+                return std::nullopt;
+            }
+        }
+        auto& s = _ring[c.read & _mask];
+        std::optional<T> ret(std::move(s.value));
+        s.value.~T();
+        if (++c.read - c.published >= batch_size) {
+            publish_head();
+        }
+        return ret;
+    }
+    void publish_tail() noexcept {
+        _producer.published = _producer.write;
+        _tail.store(_producer.write, std::memory_order_release);
+        wakeup(_consumer_shard);
+    }
+    void publish_head() noexcept {
+        _consumer.published = _consumer.read;
+        _head.store(_consumer.read, std::memory_order_release);
+        wakeup(_producer_shard);
+    }
+    static void wakeup(shard_id other) noexcept {
+        if (other != this_shard_id()) {
+            smp::wakeup(other);
+        }
+    }
+public:
+    /// Constructs a channel from the current shard to \c consumer_shard.
+    ///
+    /// \param consumer_shard shard the items are popped on, may be the
+    ///                       current one
+    /// \param capacity number of items the ring holds, rounded up to a
+    ///                 power of two
+    cross_shard_channel(shard_id consumer_shard, size_t capacity)
+        : _producer(*this)
+        , _consumer(*this)
+        , _ring(new slot[size_t(1) << log2ceil(std::max<size_t>(capacity, 1))])
+        , _mask((size_t(1) << log2ceil(std::max<size_t>(capacity, 1))) - 1)
+        , _producer_shard(this_shard_id())
+        , _consumer_shard(consumer_shard)
+    {
+    }
+
+    cross_shard_channel(const cross_shard_channel&) = delete;
+    cross_shard_channel& operator=(const cross_shard_channel&) = delete;
+
+    ~cross_shard_channel() {
+        assert(!_started);
+        for (auto i = _head.load(std::memory_order_acquire); i != _producer.write; ++i) {
+            _ring[i & _mask].value.~T();
+        }
+    }
+
+    /// Registers both sides of the channel with their shards.
+    ///
+    /// Must be called on the producer shard.
+    future<> start() {
+        internal::register_cross_shard_channel_endpoint(_producer);
+        _started = true;
+        return smp::submit_to(_consumer_shard, [this] {
+            internal::register_cross_shard_channel_endpoint(_consumer);
+        });
+    }
+
+    /// Unregisters both sides of the channel.
+    ///
+    /// Must be called on the producer shard. Pending push() and pop() calls
+    /// fail with \ref broken_promise, items left in the ring are destroyed
+    /// with the channel.
+    future<> stop() {
+        internal::unregister_cross_shard_channel_endpoint(_producer);
+        _producer.pending.clear();
+        return smp::submit_to(_consumer_shard, [this] {
+            internal::unregister_cross_shard_channel_endpoint(_consumer);
+            _consumer.waiters.clear();
+            _head.store(_consumer.read, std::memory_order_release);
+        }).then([this] {
+            _started = false;
+        });
+    }
+
+    /// Number of items the channel holds.
+    size_t capacity() const noexcept {
+        return _mask + 1;
+    }
+
+    /// Pushes an item if there is room for it.
+    ///
+    /// Must be called on the producer shard.
+    ///
+    /// \return false if the channel was full, or earlier pushes are still
+    ///         waiting for room, and the item was not pushed
+    bool try_push(T&& value) noexcept {
+        return _producer.pending.empty() && try_store(std::move(value));
+    }
+
+    /// Pushes an item, waiting for room if the channel is full.
+    ///
+    /// Must be called on the producer shard.
+    ///
+    /// \return a future that resolves once the item is in the channel
+    future<> push(T value) {
+        if (try_push(std::move(value))) {
+            return make_ready_future<>();
+        }
+        _producer.pending.push_back(pending_push{std::move(value), promise<>()});
+        return _producer.pending.back().pr.get_future();
+    }
+
+    /// Pops an item if there is one.
+    ///
+    /// Must be called on the consumer shard.
+    std::optional<T> try_pop() noexcept {
+        if (!_consumer.waiters.empty()) {
+            return std::nullopt;
+        }
+        return try_load();
+    }
+
+    /// Pops an item, waiting for one if the channel is empty.
+    ///
+    /// Must be called on the consumer shard.
+    future<T> pop() {
+        if (auto v = try_pop()) {
+            return make_ready_future<T>(std::move(*v));
+        }
+        _consumer.waiters.emplace_back();
+        return _consumer.waiters.back().get_future();
+    }
+};
+
+}
@@ -191,12 +191,61 @@ make_deleter(Object o) {
 SEASTAR_MODULE_EXPORT_END
 
 /// \cond internal
+namespace internal {
+
+// Freed impls of one type, kept per thread for reuse
+struct deleter_impl_pool {
+    static constexpr unsigned max_cached = 128;
+    struct node {
+        node* next;
+    };
+    node* head = nullptr;
+    unsigned count = 0;
+
+    void* allocate(size_t size) {
+        if (auto n = head) {
+            head = n->next;
+            --count;
+            return n;
+        }
+        return ::operator new(size);
+    }
+    void deallocate(void* p) noexcept {
+        if (count == max_cached) {
+            ::operator delete(p);
+            return;
+        }
+        head = new (p) node{head};
+        ++count;
+    }
+    ~deleter_impl_pool() {
+        while (head) {
+            ::operator delete(std::exchange(head, head->next));
+        }
+        // Impls freed from later thread_local destructors aren't cached
+        count = max_cached;
+    }
+};
+
+}
+
 struct free_deleter_impl final : deleter::impl {
     void* obj;
     free_deleter_impl(void* obj) : impl(deleter()), obj(obj) {}
     free_deleter_impl(const free_deleter_impl&) = delete;
     free_deleter_impl(free_deleter_impl&&) = delete;
     virtual ~free_deleter_impl() override { std::free(obj); }
+
+    // share() converts the deleter of every malloc()ed buffer it is called
+    // on to a free_deleter_impl, recycle them so that slicing buffers
+    // doesn't hit the allocator
+    static inline thread_local internal::deleter_impl_pool pool;
+    static void* operator new(size_t size) {
+        return pool.allocate(size);
+    }
+    static void operator delete(void* p) noexcept {
+        pool.deallocate(p);
+    }
 };
 /// \endcond
 
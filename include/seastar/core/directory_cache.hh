@@ -0,0 +1,126 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+#include <seastar/core/fsnotify.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+#include <seastar/util/noncopyable_function.hh>
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#endif
+
+namespace seastar::experimental {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fsnotifier
+/// @{
+
+/// \brief Shard-local cache of directory listings.
+///
+/// Keeps the entries of watched directories, and their \ref stat_data, up
+/// to date from \ref fsnotifier events, so that finding new or changed
+/// files doesn't take listing and stat'ing the whole directory again.
+/// Only the entries named by events are stat'ed again; a directory is
+/// listed again only when events were lost.
+///
+/// The cache lags behind the file system by the time it takes for events
+/// to be delivered and processed.
+class directory_cache {
+public:
+    using entries_type = std::map<sstring, stat_data>;
+    /// Called when an entry is added or changed, with its new \ref stat_data,
+    /// or removed, with \c nullptr
+    using listener_type = noncopyable_function<void (const sstring& dir, const sstring& name, const stat_data*)>;
+    struct stats {
+        uint64_t events = 0;    ///< Events processed
+        uint64_t stats = 0;     ///< Entries stat'ed
+        uint64_t rescans = 0;   ///< Full listings of a directory
+    };
+private:
+    struct dir_state;
+    fsnotifier _notifier;
+    std::unordered_map<sstring, lw_shared_ptr<dir_state>> _dirs;
+    std::unordered_map<fsnotifier::watch_token, lw_shared_ptr<dir_state>> _by_token;
+    listener_type _listener;
+    unsigned _stat_concurrency;
+    stats _stats;
+    gate _gate;
+    future<> _events;
+private:
+    future<> process_events();
+    void mark_dirty(const lw_shared_ptr<dir_state>& d, sstring name);
+    void rescan(const lw_shared_ptr<dir_state>& d);
+    future<> refresh(lw_shared_ptr<dir_state> d);
+    future<> scan(lw_shared_ptr<dir_state> d);
+    future<> stat_entry(lw_shared_ptr<dir_state> d, const sstring& name);
+    void update(dir_state& d, const sstring& name, std::optional<stat_data> st);
+    void handle(const fsnotifier::event& ev);
+public:
+    /// \param stat_concurrency how many entries are stat'ed in parallel
+    ///
+    /// \note \ref close() must be called before the cache is destroyed
+    explicit directory_cache(unsigned stat_concurrency = 16);
+    ~directory_cache();
+
+    /// Starts caching directory \c dir
+    ///
+    /// \return a future that becomes ready once the directory was listed
+    future<> watch(sstring dir);
+
+    /// Stops caching directory \c dir
+    void unwatch(const sstring& dir);
+
+    /// Entries of a watched directory
+    ///
+    /// A directory that was removed or moved has no entries. Throws
+    /// std::out_of_range if \c dir isn't watched.
+    const entries_type& entries(const sstring& dir) const;
+
+    /// Incremented every time the entries of a watched directory change
+    uint64_t version(const sstring& dir) const;
+
+    /// Sets the function called on every change of the entries
+    void set_listener(listener_type listener);
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+
+    /// Stops processing events and waits for the pending work
+    future<> close();
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -0,0 +1,142 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fileio-module
+/// @{
+
+/// Discards freed ranges of a file in the background
+///
+/// Issuing a discard (TRIM on block devices, hole punching on files) for
+/// every freed range makes for many small, synchronous requests that cause
+/// latency spikes on some SSDs. A discard_batcher accumulates the ranges
+/// instead, merges adjacent and overlapping ones, and discards them in
+/// large pieces from a background fiber, at a limited rate.
+///
+/// Discards are advisory: failures are counted and otherwise ignored.
+/// A discard_batcher must be closed before it's destroyed, and must only
+/// be used on the shard that created it.
+class discard_batcher {
+public:
+    struct config {
+        /// Largest discard issued at once; longer ranges are split
+        uint64_t max_discard_size = 64 << 20;
+        /// Ranges shorter than this wait up to \c max_delay for neighbours
+        /// to merge with before being discarded
+        uint64_t min_discard_size = 1 << 20;
+        /// How long a range may wait before it's discarded anyway
+        std::chrono::milliseconds max_delay = std::chrono::seconds(1);
+        /// Bytes discarded per second at most, zero for unlimited
+        uint64_t bandwidth = 0;
+        /// Scheduling group the discards are issued from
+        scheduling_group sched_group = default_scheduling_group();
+    };
+
+    struct stats {
+        uint64_t ranges_queued = 0;
+        uint64_t discards_issued = 0;
+        uint64_t bytes_discarded = 0;
+        uint64_t failures = 0;
+    };
+private:
+    struct range {
+        uint64_t end;
+        lowres_clock::time_point queued_at;
+    };
+
+    file _file;
+    config _config;
+    using range_map = std::map<uint64_t, range>;
+    // Queued ranges by start offset; they neither overlap nor touch
+    range_map _ranges;
+    // The start offsets of _ranges by length and by age, for pick()
+    std::set<std::pair<uint64_t, uint64_t>> _by_size;
+    std::set<std::pair<lowres_clock::time_point, uint64_t>> _by_age;
+    uint64_t _queued_bytes = 0;
+    bool _in_flight = false;
+    bool _closing = false;
+    unsigned _flushes = 0;
+    condition_variable _work;
+    condition_variable _idle;
+    timer<lowres_clock> _wakeup;
+    lowres_clock::time_point _next_discard_at;
+    stats _stats;
+    future<> _done;
+
+    future<> run();
+    range_map::iterator pick() noexcept;
+    range_map::iterator insert_range(range_map::iterator hint, uint64_t offset, range r);
+    range_map::iterator erase_range(range_map::iterator it) noexcept;
+public:
+    explicit discard_batcher(file f, config cfg);
+    explicit discard_batcher(file f) : discard_batcher(std::move(f), config{}) {}
+    discard_batcher(const discard_batcher&) = delete;
+    ~discard_batcher();
+
+    /// Queues a range of the file for discarding.
+    ///
+    /// \param offset beginning of the range, aligned as \ref file::discard() needs
+    /// \param length length of the range, aligned likewise
+    void discard(uint64_t offset, uint64_t length);
+
+    /// Discards everything queued, without waiting for more ranges to
+    /// merge with.
+    ///
+    /// \return a future which is ready once no ranges are left
+    future<> flush();
+
+    /// Discards everything queued and stops the background fiber.
+    future<> close() noexcept;
+
+    /// Number of bytes queued and not yet discarded
+    uint64_t queued_bytes() const noexcept {
+        return _queued_bytes;
+    }
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
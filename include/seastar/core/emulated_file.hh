@@ -0,0 +1,147 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <random>
+#endif
+
+namespace seastar {
+
+class emulated_file_impl;
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fileio-module
+/// @{
+
+/// Shard-local model of a slow or degraded disk
+///
+/// Files wrapped with \ref make_emulated_file() hold their requests back
+/// as the modelled device would. Each direction is a queue served at the
+/// configured bandwidth and IOPS, and each request adds a random latency
+/// on top. The device stops serving for a while at every stall period.
+/// Writes get more expensive once enough data has been written, the way
+/// flash devices do when garbage collection starts. The requests still
+/// go to the wrapped files, which should be much faster than the model.
+///
+/// This lets tests and io_tester reproduce slow-disk scenarios on any
+/// machine. Note that the delays are added above the I/O scheduler, which
+/// sees the wrapped files' completions. To see the I/O scheduler react to a
+/// slow device, the device's io-properties have to describe it too.
+///
+/// An emulated_disk must only be used on the shard that created it, and
+/// must outlive the files that use it.
+class emulated_disk {
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    struct config {
+        /// Median latency added to reads
+        clock_type::duration read_latency = {};
+        /// Median latency added to writes
+        clock_type::duration write_latency = {};
+        /// Spread of the latencies, the sigma of the log-normal
+        /// distribution they are drawn from. 0 makes them fixed.
+        double latency_spread = 0;
+        /// Probability that a request takes tail_latency longer
+        double tail_probability = 0;
+        clock_type::duration tail_latency = {};
+        /// Bytes per second, 0 for unlimited
+        uint64_t read_bandwidth = 0;
+        uint64_t write_bandwidth = 0;
+        /// Requests per second, 0 for unlimited
+        uint64_t read_iops = 0;
+        uint64_t write_iops = 0;
+        /// Every stall_period, the device stalls for stall_duration
+        clock_type::duration stall_period = {};
+        clock_type::duration stall_duration = {};
+        /// Once amplify_writes_after bytes were written, each write costs
+        /// write_amplification times its size against the write bandwidth
+        double write_amplification = 1;
+        uint64_t amplify_writes_after = 0;
+        /// Seed of the latency distributions, for reproducible runs
+        uint64_t seed = 0;
+    };
+
+    struct stats {
+        uint64_t reads = 0;
+        uint64_t writes = 0;
+        uint64_t read_bytes = 0;
+        uint64_t written_bytes = 0;
+        /// Total time requests were held back
+        clock_type::duration delay = {};
+    };
+private:
+    struct queue {
+        uint64_t bandwidth;
+        uint64_t iops;
+        clock_type::duration latency;
+        // When the device is done with the requests queued so far
+        clock_type::time_point next_free = {};
+    };
+    struct slot {
+        clock_type::time_point start;
+        clock_type::time_point completion;
+    };
+
+    config _config;
+    clock_type::time_point _epoch;
+    queue _reads;
+    queue _writes;
+    std::mt19937_64 _rng;
+    std::normal_distribution<double> _spread;
+    std::bernoulli_distribution _tail;
+    stats _stats;
+
+    friend class emulated_file_impl;
+public:
+    explicit emulated_disk(config cfg);
+    emulated_disk(const emulated_disk&) = delete;
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+private:
+    // Returns when a request of len bytes starts and completes
+    slot schedule(bool write, size_t len) noexcept;
+    // Moves t past the stall it falls in, if any
+    clock_type::time_point skip_stall(clock_type::time_point t) const noexcept;
+    clock_type::duration draw_latency(const queue& q) noexcept;
+    future<> wait_until(clock_type::time_point t);
+};
+
+/// Wraps \c f in a file whose reads and writes are delayed by \c disk
+///
+/// The returned file forwards all operations to \c f, which it closes
+/// when it's closed itself. Flushes wait for the writes queued before.
+file make_emulated_file(file f, emulated_disk& disk);
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
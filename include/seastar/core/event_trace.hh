@@ -0,0 +1,79 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+class http_server;
+}
+
+/// \brief Tracing of the scheduling events of the reactors.
+///
+/// Each shard records the tasks it queues and runs, with their scheduling
+/// groups, the I/O requests it queues, submits and completes, and the
+/// messages it sends to and receives from other shards, into a ring of the
+/// most recent events. The trace can be written in the Chrome trace event
+/// format, that Perfetto and chrome://tracing open: tasks are slices on the
+/// timeline of their shard, and flow arrows link a task to where it was
+/// queued and an smp message to where it was sent. When tracing is off,
+/// recording an event costs a check of a thread local pointer.
+///
+/// Tracing can also be enabled with the \c --event-trace-size option.
+namespace event_trace {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Starts recording on all shards, each shard keeps the last
+/// \c events_per_shard events. Restarting clears the recorded events.
+future<> start(size_t events_per_shard = 1 << 16);
+
+/// Stops recording and drops the recorded events.
+future<> stop();
+
+/// Writes the events recorded on all shards as a Chrome trace JSON document.
+/// Recording goes on while the trace is written.
+future<> write_chrome_trace(output_stream<char>& out);
+
+/// Writes the trace to a file, see \ref write_chrome_trace().
+future<> dump(sstring path);
+
+/// Adds a \c GET handler that returns the trace at \c path.
+future<> add_routes(httpd::http_server& server, sstring path = "/trace");
+
+/// Dumps the trace to \c path when the process receives \c signo, see
+/// \ref dump(). Must be called from a reactor thread.
+void dump_on_signal(int signo, sstring path);
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -34,6 +34,8 @@
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <fmt/format.h>
+#include <iterator>
+#include <span>
 #include <vector>
 #include <boost/range/irange.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -401,6 +403,157 @@ class inheriting_concrete_execution_stage final : public inheriting_execution_st
         return summary;
     }
 };
+/// \brief Execution stage invoking its function once per batch
+///
+/// Unlike concrete_execution_stage, which calls its function once for every
+/// queued operation, vectorized_execution_stage hands the arguments of all
+/// queued operations to the function in a single call. This lets the
+/// function amortize per-call work over the batch, or process the batch with
+/// SIMD instructions, e.g. hash all keys of a batch of lookups at once.
+///
+/// The function receives a contiguous span of argument tuples and a span of
+/// the same length to store the results to, element i of the results
+/// corresponding to element i of the arguments. It is called synchronously;
+/// if it throws, all operations of the batch fail with the exception.
+///
+/// Usage example:
+/// ```
+/// thread_local vectorized_execution_stage<uint64_t, sstring> hash_stage("hash-keys",
+///         [] (std::span<std::tuple<sstring>> keys, std::span<uint64_t> hashes) {
+///     for (size_t i = 0; i < keys.size(); i++) {
+///         hashes[i] = std::hash<sstring>()(std::get<0>(keys[i]));
+///     }
+/// });
+///
+/// future<uint64_t> hash(sstring key) {
+///     return hash_stage(std::move(key));
+/// }
+/// ```
+///
+/// \tparam Result type of the result of a single operation, needs to be
+///                default constructible, or void
+/// \tparam Args argument pack of a single operation, needs to have move
+///              constructor that doesn't throw
+SEASTAR_MODULE_EXPORT
+template<typename Result, typename... Args>
+requires std::is_nothrow_move_constructible_v<std::tuple<Args...>>
+        && (std::is_void_v<Result> || std::is_default_constructible_v<Result>)
+class vectorized_execution_stage final : public execution_stage {
+public:
+    using args_tuple = std::tuple<Args...>;
+    using function_type = std::conditional_t<std::is_void_v<Result>,
+            noncopyable_function<void (std::span<args_tuple>)>,
+            noncopyable_function<void (std::span<args_tuple>, std::span<Result>)>>;
+    static constexpr size_t max_batch_size = 128;
+private:
+    static constexpr size_t max_queue_length = 1024;
+
+    using return_type = future<Result>;
+    using promise_type = promise<Result>;
+    struct no_results {};
+    using results_type = std::conditional_t<std::is_void_v<Result>, no_results, std::vector<Result>>;
+
+    // Queued operations, args and promises at the same index belong together
+    std::vector<args_tuple> _args;
+    std::vector<promise_type> _promises;
+    // The batch being executed, kept apart from the queue so that the
+    // function can enqueue new operations without invalidating its spans
+    std::vector<args_tuple> _batch_args;
+    std::vector<promise_type> _batch_promises;
+    results_type _results;
+
+    function_type _function;
+private:
+    void run_batch() noexcept {
+        try {
+            if constexpr (std::is_void_v<Result>) {
+                _function(std::span<args_tuple>(_batch_args));
+                for (auto& p : _batch_promises) {
+                    p.set_value();
+                }
+            } else {
+                _results.resize(_batch_args.size());
+                _function(std::span<args_tuple>(_batch_args), std::span<Result>(_results));
+                for (size_t i = 0; i < _batch_promises.size(); i++) {
+                    _batch_promises[i].set_value(std::move(_results[i]));
+                }
+            }
+        } catch (...) {
+            auto ex = std::current_exception();
+            for (auto& p : _batch_promises) {
+                p.set_exception(ex);
+            }
+        }
+        if constexpr (!std::is_void_v<Result>) {
+            _results.clear();
+        }
+        _batch_args.clear();
+        _batch_promises.clear();
+    }
+
+    virtual void do_flush() noexcept override {
+        while (!_args.empty()) {
+            auto n = std::min(_args.size(), max_batch_size);
+            // Both fit in the capacity reserved by the constructor
+            std::move(_args.begin(), _args.begin() + n, std::back_inserter(_batch_args));
+            std::move(_promises.begin(), _promises.begin() + n, std::back_inserter(_batch_promises));
+            _args.erase(_args.begin(), _args.begin() + n);
+            _promises.erase(_promises.begin(), _promises.begin() + n);
+            run_batch();
+            _stats.function_calls_executed += n;
+
+            if (internal::scheduler_need_preempt()) {
+                _stats.tasks_preempted++;
+                break;
+            }
+        }
+        _empty = _args.empty();
+    }
+public:
+    explicit vectorized_execution_stage(const sstring& name, scheduling_group sg, function_type f)
+        : execution_stage(name, sg)
+        , _function(std::move(f))
+    {
+        _args.reserve(max_batch_size);
+        _promises.reserve(max_batch_size);
+        _batch_args.reserve(max_batch_size);
+        _batch_promises.reserve(max_batch_size);
+        if constexpr (!std::is_void_v<Result>) {
+            _results.reserve(max_batch_size);
+        }
+    }
+    explicit vectorized_execution_stage(const sstring& name, function_type f)
+        : vectorized_execution_stage(name, scheduling_group(), std::move(f)) {
+    }
+
+    /// Enqueues an operation
+    ///
+    /// Adds the arguments of an operation to the next batch. The arguments
+    /// are moved, lvalue references need to be explicitly wrapped using
+    /// seastar::ref() and are passed to the function as reference wrappers.
+    ///
+    /// \param args arguments of the operation
+    /// \return future containing the result the function stored for the
+    ///         operation
+    return_type operator()(Args... args) {
+        if (_args.size() >= max_queue_length) {
+            do_flush();
+        }
+        _promises.emplace_back();
+        try {
+            _args.emplace_back(std::move(args)...);
+        } catch (...) {
+            _promises.pop_back();
+            throw;
+        }
+        _empty = false;
+        _stats.function_calls_enqueued++;
+        auto f = _promises.back().get_future();
+        flush();
+        return f;
+    }
+};
+
 
 
 /// \cond internal
@@ -27,6 +27,7 @@
 #include <exception>
 #include <memory>
 #include <seastar/core/timer.hh>
+#include <seastar/core/internal/deadline_queue.hh>
 #include <seastar/core/lowres_clock.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/util/modules.hh>
@@ -61,24 +62,28 @@ class expiring_fifo {
     using clock = Clock;
     using time_point = typename Clock::time_point;
 private:
-    struct entry {
+    // Entries with a timeout wait in the shard's deadline queue, which
+    // shares one timer among all entries with the same timeout
+    struct entry final : internal::deadline_waiter {
         std::optional<T> payload; // disengaged means that it's expired
-        timer<Clock> tr;
+        expiring_fifo* ef = nullptr;
         entry(T&& payload_) : payload(std::move(payload_)) {}
         entry(const T& payload_) : payload(payload_) {}
-        entry(T payload_, expiring_fifo& ef, time_point timeout)
+        entry(T payload_, expiring_fifo& ef_, time_point timeout)
                 : payload(std::move(payload_))
-                , tr([this, &ef] {
-                    ef._on_expiry(*payload);
-                    payload = std::nullopt;
-                    --ef._size;
-                    ef.drop_expired_front();
-                })
+                , ef(&ef_)
         {
-            tr.arm(timeout);
+            internal::deadline_queue<Clock>::local().add(*this, timeout);
         }
         entry(entry&& x) = delete;
         entry(const entry& x) = delete;
+        virtual void on_deadline() noexcept override {
+            auto& fifo = *ef;
+            fifo._on_expiry(*payload);
+            payload = std::nullopt;
+            --fifo._size;
+            fifo.drop_expired_front();
+        }
     };
 
     // If engaged, represents the first element.
@@ -216,6 +216,7 @@ class fair_group {
 
     token_bucket_t _token_bucket;
     const capacity_t _per_tick_threshold;
+    const capacity_t _lease_capacity;
 
 public:
 
@@ -245,6 +246,13 @@ class fair_group {
         double min_tokens = 0.0;
         double limit_min_tokens = 0.0;
         std::chrono::duration<double> rate_limit_duration = std::chrono::milliseconds(1);
+        /*
+         * When non-zero, queues grab this much capacity ahead of time and
+         * dispatch from it locally, touching the shared rovers once per
+         * lease rather than once per request. Unused leases are refunded
+         * when the queue runs dry.
+         */
+        std::chrono::duration<double> lease_duration = std::chrono::duration<double>(0);
     };
 
     explicit fair_group(config cfg, unsigned nr_queues);
@@ -252,13 +260,21 @@ class fair_group {
 
     capacity_t maximum_capacity() const noexcept { return _token_bucket.limit(); }
     capacity_t per_tick_grab_threshold() const noexcept { return _per_tick_threshold; }
+    capacity_t lease_capacity() const noexcept { return _lease_capacity; }
     capacity_t grab_capacity(capacity_t cap) noexcept;
+    void refund_capacity(capacity_t cap) noexcept;
     clock_type::time_point replenished_ts() const noexcept { return _token_bucket.replenished_ts(); }
     void replenish_capacity(clock_type::time_point now) noexcept;
     void maybe_replenish_capacity(clock_type::time_point& local_ts) noexcept;
 
     capacity_t capacity_deficiency(capacity_t from) const noexcept;
 
+    // Scales the replenish rate relative to the configured capacity, the
+    // bucket's limit stays intact
+    void update_rate_factor(double factor) noexcept {
+        _token_bucket.update_rate(fixed_point_factor * factor);
+    }
+
     std::chrono::duration<double> rate_limit_duration() const noexcept {
         std::chrono::duration<double, rate_resolution> dur((double)_token_bucket.limit() / _token_bucket.rate());
         return std::chrono::duration_cast<std::chrono::duration<double>>(dur);
@@ -345,12 +361,19 @@ class fair_queue {
     struct pending {
         capacity_t head;
         capacity_t cap;
+        capacity_t lease;
 
-        pending(capacity_t t, capacity_t c) noexcept : head(t), cap(c) {}
+        pending(capacity_t t, capacity_t c, capacity_t l) noexcept : head(t), cap(c), lease(l) {}
     };
 
     std::optional<pending> _pending;
 
+    /*
+     * Capacity grabbed from the group in advance (see fair_group::config::lease_duration)
+     * that requests can be dispatched from without touching the group
+     */
+    capacity_t _lease = 0;
+
     void push_priority_class(priority_class_data& pc) noexcept;
     void push_priority_class_from_idle(priority_class_data& pc) noexcept;
     void pop_priority_class(priority_class_data& pc) noexcept;
@@ -360,6 +383,7 @@ class fair_queue {
     enum class grab_result { grabbed, cant_preempt, pending };
     grab_result grab_capacity(const fair_queue_entry& ent) noexcept;
     grab_result grab_pending_capacity(const fair_queue_entry& ent) noexcept;
+    void refund_lease() noexcept;
 public:
     /// Constructs a fair queue with configuration parameters \c cfg.
     ///
@@ -80,6 +80,32 @@ struct stat_data {
     std::chrono::system_clock::time_point time_changed;   // Time of last status change (either content or attributes)
 };
 
+/// A directory entry, as yielded by \ref file::experimental_list_directory_entries()
+///
+/// Refers to memory owned by the listing, and is only valid until the
+/// listing is resumed.
+struct directory_entry_view {
+    /// Name of the file in a directory entry.  Will never be "." or "..".  Only the last component is included.
+    std::string_view name;
+    /// Type of the directory entry, if known.
+    std::optional<directory_entry_type> type;
+    /// Information about the entry, not following symbolic links, if it was
+    /// requested with \ref list_directory_options::stat. Null if the entry
+    /// was removed before it could be looked at.
+    const stat_data* stat = nullptr;
+};
+
+/// Options for \ref file::experimental_list_directory_entries()
+struct list_directory_options {
+    /// Size of the buffer the directory is read into. Each read returns as
+    /// many entries as fit in it.
+    size_t buffer_size = 128 << 10;
+    /// Whether to also look up the information of every entry. It is done for
+    /// all the entries of a buffer at once, asynchronously if the reactor
+    /// backend supports it and with a single syscall thread round trip if not.
+    bool stat = false;
+};
+
 /// File open options
 ///
 /// Options used to configure an open file.
@@ -135,6 +161,7 @@ class file_impl {
     virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent*) = 0;
     virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent*) = 0;
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent*) = 0;
+    virtual future<size_t> write_dma_and_flush(uint64_t pos, const void* buffer, size_t len, io_intent*);
 #else
     virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) = 0;
     virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) = 0;
@@ -175,6 +202,7 @@ class file_impl {
     // due to https://github.com/scylladb/seastar/issues/1913, we cannot use
     // buffered generator yet.
     virtual coroutine::experimental::generator<directory_entry> experimental_list_directory();
+    virtual coroutine::experimental::generator<directory_entry_view> experimental_list_directory_entries(list_directory_options opts);
 };
 
 future<shared_ptr<file_impl>> make_file_impl(int fd, file_open_options options, int oflags, struct stat st) noexcept;
@@ -527,6 +555,28 @@ class file {
         return dma_write_impl(pos, std::move(iov), internal::maybe_priority_class_ref(), intent);
     }
 
+#if SEASTAR_API_LEVEL >= 7
+    /// Performs a DMA write from the specified buffer, then makes all the
+    /// data written so far stable on persistent storage.
+    ///
+    /// Equivalent to \ref dma_write() followed by \ref flush(), but the
+    /// implementation may issue both at once (the io_uring reactor
+    /// backend links them), saving a round trip through the reactor.
+    ///
+    /// \param pos offset to write into.  Must be aligned to \ref disk_write_dma_alignment.
+    /// \param buffer aligned address of buffer to read from.  Buffer must exists
+    ///               until the future is made ready.
+    /// \param len number of bytes to write.  Must be aligned.
+    /// \param intent the IO intention confirmation (\ref seastar::io_intent)
+    ///
+    /// \return a future representing the number of bytes actually written.  A short
+    ///         write may happen due to an I/O error.
+    template <typename CharType>
+    future<size_t> dma_write_and_flush(uint64_t pos, const CharType* buffer, size_t len, io_intent* intent = nullptr) noexcept {
+        return dma_write_and_flush_impl(pos, reinterpret_cast<const uint8_t*>(buffer), len, intent);
+    }
+#endif
+
     /// Causes any previously written data to be made stable on persistent storage.
     ///
     /// Prior to a flush, written data may or may not survive a power failure.  After
@@ -693,6 +743,15 @@ class file {
     // buffered generator yet.
     coroutine::experimental::generator<directory_entry> experimental_list_directory();
 
+    /// Returns a directory listing, given that this file object is a directory.
+    ///
+    /// Unlike \ref experimental_list_directory(), the entries refer to the
+    /// buffer the directory is read into, so listing doesn't allocate per
+    /// entry. This matters for directories with very many files.
+    ///
+    /// \param opts how to read the directory, and whether to look up every entry
+    coroutine::experimental::generator<directory_entry_view> experimental_list_directory_entries(list_directory_options opts = {});
+
 #if SEASTAR_API_LEVEL < 7
     /**
      * Read a data bulk containing the provided addresses range that starts at
@@ -762,6 +821,11 @@ class file {
     future<size_t>
     dma_write_impl(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
 
+#if SEASTAR_API_LEVEL >= 7
+    future<size_t>
+    dma_write_and_flush_impl(uint64_t pos, const uint8_t* buffer, size_t len, io_intent* intent) noexcept;
+#endif
+
     future<temporary_buffer<uint8_t>>
     dma_read_impl(uint64_t pos, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
 
@@ -88,6 +88,8 @@ class fsnotifier {
         oneshot = IN_ONESHOT,           // listen for only a single notification, after which the 
                                         // token will be invalid
         ignored = IN_IGNORED,           // generated when a token or the file being watched is deleted 
+        overflow = IN_Q_OVERFLOW,       // The event queue overflowed and events were lost (the
+                                        // token of the event is -1)
         onlydir = IN_ONLYDIR,           // Watch pathname only if it is a directory; the error ENOT‐
                                         // DIR results if pathname is not a directory.  Using this
                                         // flag provides an application with a race-free way of
@@ -30,6 +30,7 @@
 // interface to files, while retaining the zero-copy characteristics of
 // seastar files.
 #include <seastar/core/file.hh>
+#include <seastar/core/future.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/internal/api-level.hh>
@@ -37,6 +38,8 @@
 
 #ifndef SEASTAR_MODULE
 #include <cstdint>
+#include <map>
+#include <utility>
 #endif
 
 namespace seastar {
@@ -60,6 +63,12 @@ class file_input_stream_history {
 struct file_input_stream_options {
     size_t buffer_size = 8192;    ///< I/O buffer size
     unsigned read_ahead = 0;      ///< Maximum number of extra read-ahead operations
+    /// Size the read-ahead by the measured read latency and the rate at which
+    /// the stream is consumed, up to \c read_ahead (or \c default_adaptive_read_ahead
+    /// if it is zero), and skip the gaps of strided access patterns instead of
+    /// reading them.
+    bool adaptive_read_ahead = false;
+    static constexpr unsigned default_adaptive_read_ahead = 8;
 #if SEASTAR_API_LEVEL < 7
     ::seastar::io_priority_class io_priority_class = default_priority_class();
 #endif
@@ -90,6 +99,91 @@ input_stream<char> make_file_input_stream(
 input_stream<char> make_file_input_stream(
         file file, file_input_stream_options = {});
 
+/// Options for \ref make_mmap_input_stream()
+struct mmap_input_stream_options {
+    size_t buffer_size = 128 << 10; ///< Size of the buffers returned by the stream
+    size_t read_ahead = 1 << 20;    ///< How far ahead of the reader pages are faulted in
+};
+
+/// Creates an input_stream reading a range of a file through a read-only
+/// memory mapping, for read-mostly files that are not modified while mapped.
+///
+/// The buffers returned point into the mapping, which is kept until all of
+/// them are released. The pages are faulted in from the syscall thread ahead
+/// of the reader, so that accessing the buffers doesn't stall the reactor, and
+/// are read through the page cache rather than with direct I/O. Files that
+/// can't be mapped are read with \ref make_file_input_stream(). The stream
+/// ends at the end of the file if the range goes past it.
+input_stream<char> make_mmap_input_stream(
+        file file, uint64_t offset, uint64_t len, mmap_input_stream_options options = {});
+
+/// Creates an input_stream reading a whole file through a read-only memory
+/// mapping, see \ref make_mmap_input_stream(file, uint64_t, uint64_t, mmap_input_stream_options).
+input_stream<char> make_mmap_input_stream(
+        file file, mmap_input_stream_options options = {});
+
+/// Bound on the memory of the buffers being written behind by a set of file
+/// output streams
+///
+/// Output streams opened with a budget account their buffers from the moment
+/// they're put into the stream until they are written to the file. Once the
+/// budget is used up, writers are held back until the writes of any of the
+/// streams complete, and then let in one buffer at a time in decreasing
+/// \ref file_output_stream_options::dirty_priority "priority" order (and in
+/// arrival order within a priority), rather than each stream flushing at its
+/// own pace. Waiting writers of lower priority can be delayed indefinitely
+/// by a steady stream of higher priority writes.
+///
+/// A budget is typically shared by all the streams of a shard. It must only be
+/// used on the shard that created it, and must outlive the streams using it.
+class write_behind_budget {
+    struct waiter {
+        size_t bytes;
+        promise<> pr;
+    };
+    struct waiter_order {
+        // Higher priority first, then by arrival
+        bool operator()(const std::pair<unsigned, uint64_t>& a, const std::pair<unsigned, uint64_t>& b) const noexcept {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        }
+    };
+    size_t _limit;
+    size_t _dirty = 0;
+    uint64_t _next_seq = 0;
+    uint64_t _throttled = 0;
+    std::map<std::pair<unsigned, uint64_t>, waiter, waiter_order> _waiters;
+
+    friend class file_data_sink_impl;
+public:
+    /// Constructs a budget of \c limit bytes
+    explicit write_behind_budget(size_t limit) noexcept : _limit(limit) {}
+    write_behind_budget(const write_behind_budget&) = delete;
+    ~write_behind_budget();
+
+    size_t limit() const noexcept {
+        return _limit;
+    }
+    /// Returns the number of bytes put into the streams and not yet written
+    size_t dirty() const noexcept {
+        return _dirty;
+    }
+    /// Returns the number of writers currently held back
+    size_t waiters() const noexcept {
+        return _waiters.size();
+    }
+    /// Returns the number of times a writer was held back
+    uint64_t throttled() const noexcept {
+        return _throttled;
+    }
+private:
+    bool fits(size_t bytes) const noexcept {
+        // A buffer larger than the whole budget is let in alone
+        return _dirty == 0 || _dirty + bytes <= _limit;
+    }
+    future<> acquire(size_t bytes, unsigned priority);
+    void release(size_t bytes) noexcept;
+};
+
 struct file_output_stream_options {
     // For small files, setting preallocation_size can make it impossible for XFS to find
     // an aligned extent. On the other hand, without it, XFS will divide the file into
@@ -101,6 +195,8 @@ struct file_output_stream_options {
     unsigned buffer_size = 65536;
     unsigned preallocation_size = 0; ///< Preallocate extents. For large files, set to a large number (a few megabytes) to reduce fragmentation
     unsigned write_behind = 1; ///< Number of buffers to write in parallel
+    write_behind_budget* dirty_budget = nullptr; ///< Budget shared with other streams for the unwritten buffers, if null only write_behind limits them
+    unsigned dirty_priority = 0; ///< Order in which writers held back by dirty_budget are let in, higher first
 #if SEASTAR_API_LEVEL < 7
     ::seastar::io_priority_class io_priority_class = default_priority_class();
 #endif
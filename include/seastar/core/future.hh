@@ -857,6 +857,12 @@ class promise_base {
 
     /// Returns the task which is waiting for this promise to resolve, or nullptr.
     task* waiting_task() const noexcept { return _task; }
+
+    /// \cond internal
+    /// Detaches the task waiting for this promise, which the caller then
+    /// has to run or schedule once the promise is resolved.
+    task* release_waiting_task() noexcept { return std::exchange(_task, nullptr); }
+    /// \endcond
 };
 
 /// \brief A promise with type but no local data.
@@ -966,6 +972,7 @@ class promise : private internal::promise_base_with_type<T> {
 
     /// Returns the task which is waiting for this promise to resolve, or nullptr.
     using internal::promise_base::waiting_task;
+    using internal::promise_base::release_waiting_task;
 
     /// \brief Gets the promise's associated future.
     ///
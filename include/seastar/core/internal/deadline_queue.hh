@@ -0,0 +1,199 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <map>
+#include <utility>
+#endif
+#include <seastar/core/abort_source.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/manual_clock.hh>
+#include <seastar/core/timer.hh>
+
+namespace seastar {
+
+namespace internal {
+
+struct deadline_bucket;
+
+// An operation waiting for a deadline in a deadline_queue. Unlinks itself
+// when destroyed.
+class deadline_waiter {
+    using hook_type = boost::intrusive::list_member_hook<>;
+    hook_type _link;
+    deadline_bucket* _bucket = nullptr;
+    friend struct deadline_bucket;
+    template <typename Clock>
+    friend class deadline_queue;
+public:
+    deadline_waiter() noexcept = default;
+    deadline_waiter(const deadline_waiter&) = delete;
+    virtual ~deadline_waiter() {
+        unlink();
+    }
+    // Called when the deadline is reached, after the waiter was unlinked.
+    // May destroy this or other waiters.
+    virtual void on_deadline() noexcept = 0;
+    bool linked() const noexcept {
+        return _bucket != nullptr;
+    }
+    inline void unlink() noexcept;
+};
+
+class deadline_queue_base {
+protected:
+    ~deadline_queue_base() = default;
+public:
+    virtual void remove(deadline_bucket& b) noexcept = 0;
+};
+
+// The waiters for one deadline. It's removed from its queue with its last
+// waiter, so a queue only holds deadlines somebody waits for.
+struct deadline_bucket {
+    using waiter_list = boost::intrusive::list<deadline_waiter,
+            boost::intrusive::member_hook<deadline_waiter, deadline_waiter::hook_type, &deadline_waiter::_link>,
+            boost::intrusive::constant_time_size<false>>;
+    deadline_queue_base& queue;
+    waiter_list waiters;
+    // Being expired, removed by the queue once done
+    bool expiring = false;
+
+    explicit deadline_bucket(deadline_queue_base& q) noexcept : queue(q) {}
+    void add(deadline_waiter& w) noexcept {
+        w._bucket = this;
+        waiters.push_back(w);
+    }
+    deadline_waiter& pop_front() noexcept {
+        auto& w = waiters.front();
+        waiters.pop_front();
+        w._bucket = nullptr;
+        return w;
+    }
+    void remove(deadline_waiter& w) noexcept {
+        waiters.erase(waiters.iterator_to(w));
+        w._bucket = nullptr;
+        if (waiters.empty() && !expiring) {
+            queue.remove(*this);
+        }
+    }
+};
+
+void deadline_waiter::unlink() noexcept {
+    if (_bucket) {
+        _bucket->remove(*this);
+    }
+}
+
+// Per shard list of deadlines, each shared by all the waiters for it, and a
+// single timer armed for the earliest one. Waiting for a deadline which is
+// already in the list costs no timer operation, which makes the queue fit
+// for large numbers of timeouts computed from lowres_clock, most of which
+// share their deadline with others.
+//
+// The reactor owns a queue for each clock timers support, see local().
+template <typename Clock>
+class deadline_queue final : private deadline_queue_base {
+    using time_point = typename Clock::time_point;
+    struct bucket : deadline_bucket {
+        time_point deadline;
+        bucket(deadline_queue& q, time_point d) noexcept : deadline_bucket(q), deadline(d) {}
+    };
+    std::map<time_point, bucket> _deadlines;
+    timer<Clock> _timer;
+private:
+    void expire() noexcept {
+        auto now = Clock::now();
+        while (!_deadlines.empty() && _deadlines.begin()->first <= now) {
+            auto it = _deadlines.begin();
+            auto& b = it->second;
+            b.expiring = true;
+            while (!b.waiters.empty()) {
+                b.pop_front().on_deadline();
+            }
+            _deadlines.erase(it);
+        }
+        if (!_deadlines.empty()) {
+            _timer.rearm(_deadlines.begin()->first);
+        }
+    }
+
+    virtual void remove(deadline_bucket& b) noexcept override {
+        // The timer is left armed if it was the earliest deadline, it
+        // expires nothing then, but cancelling a wait stays cheap
+        _deadlines.erase(static_cast<bucket&>(b).deadline);
+    }
+public:
+    deadline_queue() noexcept : _timer(default_scheduling_group(), [this] { expire(); }) {}
+    deadline_queue(const deadline_queue&) = delete;
+    ~deadline_queue() {
+        // Waiters outliving the reactor are never woken up
+        for (auto& [deadline, b] : _deadlines) {
+            while (!b.waiters.empty()) {
+                b.pop_front();
+            }
+        }
+    }
+
+    // Links w into the list of waiters for deadline
+    void add(deadline_waiter& w, time_point deadline) {
+        // Deadlines mostly come in increasing order
+        auto it = _deadlines.try_emplace(_deadlines.end(), deadline, *this, deadline);
+        it->second.add(w);
+        if (it == _deadlines.begin()) {
+            _timer.rearm(deadline);
+        }
+    }
+
+    size_t deadlines() const noexcept {
+        return _deadlines.size();
+    }
+
+    static deadline_queue& local() noexcept;
+};
+
+template <> deadline_queue<steady_clock_type>& deadline_queue<steady_clock_type>::local() noexcept;
+template <> deadline_queue<lowres_clock>& deadline_queue<lowres_clock>::local() noexcept;
+template <> deadline_queue<manual_clock>& deadline_queue<manual_clock>::local() noexcept;
+
+// An abort source aborted when the deadline is reached, for containers
+// expiring their elements through abort sources. Like abort_on_expiry, but
+// the timer is shared.
+template <typename Clock>
+class abort_on_deadline final : public deadline_waiter {
+    seastar::abort_source _as;
+public:
+    explicit abort_on_deadline(typename Clock::time_point deadline) {
+        deadline_queue<Clock>::local().add(*this, deadline);
+    }
+    void on_deadline() noexcept override {
+        _as.request_abort();
+    }
+    seastar::abort_source& abort_source() noexcept {
+        return _as;
+    }
+};
+
+}
+
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/shard_id.hh>
+#ifndef SEASTAR_MODULE
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <boost/intrusive/list.hpp>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// Per-shard pool of I/O buffers.
+//
+// Buffers of 4K to 1M, rounded up to a power of two and naturally aligned, are
+// carved out of 2MB regions which are themselves 2MB aligned and advised to be
+// backed by huge pages, so a large scan touches few TLB entries and all I/O
+// memory of a shard sits in a small number of long-lived regions. Each region
+// serves a single size class; it is given back once all its buffers are free
+// and its class has another free region to spare.
+//
+// Buffers may be released on any shard, foreign ones are handed back to the
+// owner through a lock-free list.
+class dma_buffer_pool {
+public:
+    static constexpr size_t min_buffer_size = 4096;
+    static constexpr size_t max_buffer_size = 1 << 20;
+    static constexpr size_t region_size = 2 << 20;
+    static constexpr unsigned nr_size_classes = 9; // 4K, 8K, ..., 1M
+
+    struct stats {
+        uint64_t allocations = 0;
+        uint64_t fallback_allocations = 0;
+        size_t regions = 0;
+    };
+private:
+    struct free_buffer {
+        free_buffer* next;
+    };
+    struct region : public boost::intrusive::list_base_hook<> {
+        char* base;
+        unsigned size_class;
+        unsigned nr_free;
+        free_buffer* free_list = nullptr;
+    };
+    using region_list = boost::intrusive::list<region, boost::intrusive::constant_time_size<true>>;
+    struct size_class {
+        // Regions with at least one free buffer, fully free ones at the back
+        region_list partial;
+        unsigned nr_empty = 0;
+    };
+    shard_id _owner = this_shard_id();
+    std::array<size_class, nr_size_classes> _classes;
+    std::unordered_map<uintptr_t, std::unique_ptr<region>> _regions;
+    std::atomic<free_buffer*> _foreign_frees = nullptr;
+    stats _stats;
+public:
+    dma_buffer_pool() = default;
+    dma_buffer_pool(const dma_buffer_pool&) = delete;
+
+    // Returns a buffer of at least \c size bytes, aligned to \c alignment,
+    // from the pool if it has a size class for it, from the general
+    // allocator otherwise.
+    temporary_buffer<char> allocate(size_t alignment, size_t size);
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+private:
+    static unsigned size_class_of(size_t size) noexcept;
+    static size_t buffer_size_of(unsigned size_class) noexcept {
+        return min_buffer_size << size_class;
+    }
+    char* allocate_buffer(unsigned size_class);
+    void free(char* p) noexcept;
+    void free_foreign(char* p) noexcept;
+    void drain_foreign_frees() noexcept;
+    void release_region(region& r) noexcept;
+};
+
+dma_buffer_pool& local_dma_buffer_pool();
+
+// Allocates an I/O buffer of \c size elements aligned to \c alignment from
+// the current shard's dma_buffer_pool.
+template <typename CharType>
+temporary_buffer<CharType> allocate_dma_buffer(size_t alignment, size_t size) {
+    static_assert(sizeof(CharType) == 1, "must allocate byte type");
+    auto buf = local_dma_buffer_pool().allocate(alignment, size);
+    auto p = reinterpret_cast<CharType*>(buf.get_write());
+    return temporary_buffer<CharType>(p, size, buf.release());
+}
+
+}
+
+}
@@ -30,6 +30,7 @@
 #include <seastar/core/bitops.hh>
 #include <limits>
 #include <array>
+#include <stdexcept>
 
 namespace seastar::metrics::internal {
 /**
@@ -405,4 +406,201 @@ class time_estimated_histogram : public approximate_exponential_histogram<512, 3
 inline time_estimated_histogram time_estimated_histogram_merge(time_estimated_histogram a, const time_estimated_histogram& b) {
     return a.merge(b);
 }
+
+/*!
+ * \brief estimated histogram for short duration values, in microseconds
+ * Covers the range of 4us to 16s with a precision of 4, e.g. for the time
+ * tasks spend waiting to run.
+ */
+class short_time_estimated_histogram : public approximate_exponential_histogram<4, 16777216, 4> {
+public:
+    template<typename T>
+    void add(const T& latency) {
+        approximate_exponential_histogram<4, 16777216, 4>::add(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    }
+};
+
+/*!
+ * \brief sparse exponential histogram
+ *
+ * The buckets follow the layout of Prometheus native histograms and
+ * OpenTelemetry exponential histograms: with a schema (scale) s, bucket i
+ * holds the values in (2^((i-1)/2^s), 2^(i/2^s)], so each power of two is
+ * split into 2^s buckets. Values up to the zero threshold are counted in
+ * a separate zero bucket.
+ *
+ * Unlike approximate_exponential_histogram, there are no fixed limits, only
+ * the range of buckets that were hit is kept. When that range grows beyond
+ * max_buckets, the schema is reduced, merging each pair of buckets.
+ *
+ * Like every metric, a histogram belongs to a shard and is updated without
+ * atomics or locks; add() only allocates when the range of buckets grows.
+ */
+class sparse_exponential_histogram {
+public:
+    static constexpr int32_t min_schema = -4;
+    static constexpr int32_t max_schema = 8;
+private:
+    int32_t _schema;
+    double _zero_threshold;
+    size_t _max_buckets;
+    // Bucket id of _buckets[0]
+    int32_t _offset = 0;
+    std::vector<uint64_t> _buckets;
+    uint64_t _zero_count = 0;
+    uint64_t _count = 0;
+    double _sum = 0;
+
+    static int32_t downscale_id(int32_t id, int32_t by) noexcept {
+        // Bucket i of schema s is part of bucket ceil(i / 2) of schema s - 1
+        return ((int64_t(id) - 1) >> by) + 1;
+    }
+
+    void downscale(int32_t by) {
+        if (by <= 0) {
+            return;
+        }
+        if (!_buckets.empty()) {
+            auto offset = downscale_id(_offset, by);
+            std::vector<uint64_t> buckets(downscale_id(_offset + int32_t(_buckets.size()) - 1, by) - offset + 1);
+            for (size_t i = 0; i < _buckets.size(); i++) {
+                buckets[downscale_id(_offset + int32_t(i), by) - offset] += _buckets[i];
+            }
+            _offset = offset;
+            _buckets = std::move(buckets);
+        }
+        _schema -= by;
+    }
+
+    // Makes room for bucket id, reducing the schema if needed. Returns the id
+    // in the resulting schema.
+    int32_t make_room(int32_t id) {
+        if (_buckets.empty()) {
+            _offset = id;
+            _buckets.resize(1);
+            return id;
+        }
+        int32_t lo = std::min<int32_t>(_offset, id);
+        int32_t hi = std::max<int32_t>(_offset + int32_t(_buckets.size()) - 1, id);
+        int32_t by = 0;
+        while (_schema - by > min_schema && size_t(downscale_id(hi, by) - downscale_id(lo, by)) >= _max_buckets) {
+            by++;
+        }
+        downscale(by);
+        id = downscale_id(id, by);
+        if (id < _offset) {
+            _buckets.insert(_buckets.begin(), _offset - id, 0);
+            _offset = id;
+        } else if (size_t(id - _offset) >= _buckets.size()) {
+            _buckets.resize(id - _offset + 1);
+        }
+        return id;
+    }
+public:
+    explicit sparse_exponential_histogram(int32_t schema = 3, double zero_threshold = 0, size_t max_buckets = 160)
+            : _schema(schema), _zero_threshold(zero_threshold), _max_buckets(std::max<size_t>(max_buckets, 1)) {
+        if (schema < min_schema || schema > max_schema) {
+            throw std::invalid_argument(format("Invalid native histogram schema {}", schema));
+        }
+    }
+
+    /*!
+     * \brief Returns the id of the bucket holding a positive value with the given schema
+     */
+    static int32_t bucket_id(double v, int32_t schema) noexcept {
+        return int32_t(std::ceil(std::log2(v) * std::ldexp(1.0, schema)));
+    }
+
+    /*!
+     * \brief Add a value to the histogram
+     *
+     * Negative values are not supported and are counted in the zero bucket.
+     */
+    void add(double v) {
+        _count++;
+        _sum += v;
+        if (v <= _zero_threshold || !std::isfinite(v)) {
+            _zero_count++;
+            return;
+        }
+        auto id = bucket_id(v, _schema);
+        if (_buckets.empty() || id < _offset || size_t(id - _offset) >= _buckets.size()) {
+            id = make_room(id);
+        }
+        _buckets[id - _offset]++;
+    }
+
+    template<typename Rep, typename Period>
+    void add(std::chrono::duration<Rep, Period> d) {
+        add(std::chrono::duration<double>(d).count());
+    }
+
+    /*!
+     * \brief merge a histogram to the current one, using the coarser schema of the two
+     */
+    sparse_exponential_histogram& merge(const sparse_exponential_histogram& o) {
+        downscale(_schema - o._schema);
+        auto by = o._schema - _schema;
+        for (size_t i = 0; i < o._buckets.size(); i++) {
+            if (o._buckets[i]) {
+                auto id = make_room(downscale_id(o._offset + int32_t(i), by));
+                _buckets[id - _offset] += o._buckets[i];
+                by = o._schema - _schema;
+            }
+        }
+        _zero_count += o._zero_count;
+        _count += o._count;
+        _sum += o._sum;
+        return *this;
+    }
+
+    int32_t schema() const noexcept {
+        return _schema;
+    }
+
+    uint64_t count() const noexcept {
+        return _count;
+    }
+
+    double sum() const noexcept {
+        return _sum;
+    }
+
+    uint64_t zero_count() const noexcept {
+        return _zero_count;
+    }
+
+    /*!
+     * \brief returns the count in the bucket with the given id
+     */
+    uint64_t get(int32_t id) const noexcept {
+        if (id < _offset || size_t(id - _offset) >= _buckets.size()) {
+            return 0;
+        }
+        return _buckets[id - _offset];
+    }
+
+    /*!
+     * \brief returns the upper limit (inclusive) of the bucket with the given id
+     */
+    double get_bucket_upper_limit(int32_t id) const noexcept {
+        return std::exp2(std::ldexp(double(id), -_schema));
+    }
+
+    seastar::metrics::histogram to_metrics_histogram() const {
+        seastar::metrics::histogram res;
+        res.sample_count = _count;
+        res.sample_sum = _sum;
+        res.native_histogram = seastar::metrics::native_histogram_info{_schema, _offset, _zero_count, _zero_threshold};
+        res.buckets.resize(_buckets.size());
+        uint64_t cummulative_count = _zero_count;
+        for (size_t i = 0; i < _buckets.size(); i++) {
+            cummulative_count += _buckets[i];
+            res.buckets[i].count = cummulative_count;
+            res.buckets[i].upper_bound = get_bucket_upper_limit(_offset + int32_t(i));
+        }
+        return res;
+    }
+};
+
 }
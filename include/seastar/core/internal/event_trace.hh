@@ -0,0 +1,91 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+enum class trace_event_type : uint8_t {
+    task_queued,
+    task_run,
+    task_done,
+    io_queued,
+    io_submit,
+    io_complete,
+    smp_send,
+    smp_receive,
+    smp_complete,
+};
+
+struct trace_event {
+    // steady_clock, in nanoseconds
+    int64_t ts;
+    // Address of the task, I/O request or smp message
+    const void* id;
+    // std::type_info of the task for task_run
+    const void* ref;
+    trace_event_type type;
+    uint8_t sg;
+    // Peer shard of smp events, direction of I/O events (1 for writes)
+    uint16_t aux;
+    // Length of I/O requests
+    uint32_t size;
+};
+
+// Keeps the last events of a shard, see event_trace::start()
+class event_trace_ring {
+    std::unique_ptr<trace_event[]> _events;
+    size_t _mask;
+    uint64_t _next = 0;
+public:
+    explicit event_trace_ring(size_t size);
+    void record(trace_event_type type, const void* id, const void* ref, unsigned sg, unsigned aux, uint32_t size) noexcept {
+        auto ts = std::chrono::steady_clock::now().time_since_epoch() / std::chrono::nanoseconds(1);
+        _events[_next++ & _mask] = trace_event{ts, id, ref, type, uint8_t(sg), uint16_t(aux), size};
+    }
+    // The recorded events, oldest first
+    std::vector<trace_event> events() const;
+};
+
+// Set on the shards the events are recorded on
+extern thread_local event_trace_ring* local_event_trace;
+
+// Starts recording on the current shard
+void start_local_event_trace(size_t size);
+
+inline void trace(trace_event_type type, const void* id, const void* ref = nullptr, unsigned sg = 0, unsigned aux = 0, uint32_t size = 0) noexcept {
+    if (__builtin_expect(local_event_trace != nullptr, false)) {
+        local_event_trace->record(type, id, ref, sg, aux, size);
+    }
+}
+
+}
+
+}
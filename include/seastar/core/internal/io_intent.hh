@@ -65,10 +65,25 @@ class cancellable_queue {
             cq.push_back(*this);
         }
 
-        void maybe_dequeue() noexcept {
-            if (_ref != nullptr) {
-                _ref->pop_front();
+        // Returns the queue the link was on, if any
+        cancellable_queue* maybe_dequeue() noexcept {
+            auto cq = _ref;
+            if (cq != nullptr) {
+                cq->pop_front();
             }
+            return cq;
+        }
+    };
+
+    /*
+     * A request that was dispatched to the kernel. Cancelling it tries to
+     * stop it in flight and gives its capacity back to the queue right
+     * away, see io_queue::cancel_dispatched_request()
+     */
+    class in_flight_link : public bi::list_base_hook<bi::link_mode<bi::auto_unlink>> {
+    public:
+        void enqueue(cancellable_queue& cq) noexcept {
+            cq._in_flight.push_back(*this);
         }
     };
 
@@ -81,6 +96,7 @@ class cancellable_queue {
 
     link* _first;
     list_of_links_t _rest;
+    bi::list<in_flight_link, bi::constant_time_size<false>> _in_flight;
 
     void push_back(link& il) noexcept;
     void pop_front() noexcept;
@@ -31,6 +31,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+struct statx;
+
 namespace seastar {
 extern logger io_log;
 
@@ -38,9 +40,16 @@ namespace internal {
 
 class io_request {
 public:
-    enum class operation { read, readv, write, writev, fdatasync, recv, recvmsg, send, sendmsg, accept, connect, poll_add, poll_remove, cancel };
+    enum class operation { read, readv, write, writev, fdatasync, recv, recvmsg, send, sendmsg, accept, connect, poll_add, poll_remove, cancel,
+                           openat, statx, renameat, unlinkat, fallocate, nvme_cmd };
+    // NVMe I/O command set opcodes of nvme_cmd requests
+    static constexpr uint8_t nvme_cmd_write = 0x01;
+    static constexpr uint8_t nvme_cmd_read = 0x02;
 private:
     operation _op;
+    // write/writev only: the data is to be made stable with fdatasync
+    // right after the write, as part of the same request
+    bool _fdatasync_after = false;
     // the upper layers give us void pointers, but storing void pointers here is just
     // dangerous. The constructors seem to be happy to convert other pointers to void*,
     // even if they are marked as explicit, and then you end up losing approximately 3 hours
@@ -101,6 +110,53 @@ class io_request {
         int fd;
         char* addr;
     };
+    // File metadata operations, only generated for backends which can run
+    // them asynchronously (see reactor_backend::have_async_metadata_ops())
+    struct openat_op {
+        int dirfd;
+        char* path;
+        int flags;
+        mode_t mode;
+    };
+    struct statx_op {
+        int dirfd;
+        char* path;
+        int flags;
+        unsigned mask;
+        struct ::statx* buf;
+    };
+    struct renameat_op {
+        int old_dirfd;
+        char* old_path;
+        int new_dirfd;
+        char* new_path;
+        unsigned flags;
+    };
+    struct unlinkat_op {
+        int dirfd;
+        char* path;
+        int flags;
+    };
+    struct fallocate_op {
+        int fd;
+        int mode;
+        uint64_t offset;
+        uint64_t length;
+    };
+    // NVMe read or write sent to a namespace's generic char device
+    // (/dev/ngXnY) with IORING_OP_URING_CMD, see nvme_passthrough_file_impl.
+    // Positions and sizes are in bytes, and multiples of the LBA size.
+    struct nvme_cmd_op {
+        int fd;
+        uint32_t nsid;
+        uint8_t opcode;
+        uint8_t lba_shift;
+        // Force unit access, the data is stable when the command completes
+        bool fua;
+        uint64_t pos;
+        char* addr;
+        size_t size;
+    };
     union {
         read_op _read;
         readv_op _readv;
@@ -116,6 +172,12 @@ class io_request {
         poll_add_op _poll_add;
         poll_remove_op _poll_remove;
         cancel_op _cancel;
+        openat_op _openat;
+        statx_op _statx;
+        renameat_op _renameat;
+        unlinkat_op _unlinkat;
+        fallocate_op _fallocate;
+        nvme_cmd_op _nvme_cmd;
     };
 
 public:
@@ -279,6 +341,83 @@ class io_request {
         return req;
     }
 
+    static io_request make_openat(int dirfd, const char* path, int flags, mode_t mode) {
+        io_request req;
+        req._op = operation::openat;
+        req._openat = {
+          .dirfd = dirfd,
+          .path = const_cast<char*>(path),
+          .flags = flags,
+          .mode = mode,
+        };
+        return req;
+    }
+
+    static io_request make_statx(int dirfd, const char* path, int flags, unsigned mask, struct ::statx* buf) {
+        io_request req;
+        req._op = operation::statx;
+        req._statx = {
+          .dirfd = dirfd,
+          .path = const_cast<char*>(path),
+          .flags = flags,
+          .mask = mask,
+          .buf = buf,
+        };
+        return req;
+    }
+
+    static io_request make_renameat(int old_dirfd, const char* old_path, int new_dirfd, const char* new_path, unsigned flags) {
+        io_request req;
+        req._op = operation::renameat;
+        req._renameat = {
+          .old_dirfd = old_dirfd,
+          .old_path = const_cast<char*>(old_path),
+          .new_dirfd = new_dirfd,
+          .new_path = const_cast<char*>(new_path),
+          .flags = flags,
+        };
+        return req;
+    }
+
+    static io_request make_unlinkat(int dirfd, const char* path, int flags) {
+        io_request req;
+        req._op = operation::unlinkat;
+        req._unlinkat = {
+          .dirfd = dirfd,
+          .path = const_cast<char*>(path),
+          .flags = flags,
+        };
+        return req;
+    }
+
+    static io_request make_fallocate(int fd, int mode, uint64_t offset, uint64_t length) {
+        io_request req;
+        req._op = operation::fallocate;
+        req._fallocate = {
+          .fd = fd,
+          .mode = mode,
+          .offset = offset,
+          .length = length,
+        };
+        return req;
+    }
+
+    static io_request make_nvme_cmd(int fd, uint32_t nsid, uint8_t opcode, unsigned lba_shift, uint64_t pos, const void* address, size_t size, bool fua) {
+        io_request req;
+        req._op = operation::nvme_cmd;
+        req._nvme_cmd = {
+          .fd = fd,
+          .nsid = nsid,
+          .opcode = opcode,
+          .lba_shift = uint8_t(lba_shift),
+          .fua = fua,
+          .pos = pos,
+          .addr = const_cast<char*>(reinterpret_cast<const char*>(address)),
+          .size = size,
+        };
+        return req;
+    }
+
     bool is_read() const {
         switch (_op) {
         case operation::read:
@@ -286,6 +425,8 @@ class io_request {
         case operation::recvmsg:
         case operation::recv:
             return true;
+        case operation::nvme_cmd:
+            return _nvme_cmd.opcode == nvme_cmd_read;
         default:
             return false;
         }
@@ -298,11 +439,27 @@ class io_request {
         case operation::send:
         case operation::sendmsg:
             return true;
+        case operation::nvme_cmd:
+            return _nvme_cmd.opcode == nvme_cmd_write;
         default:
             return false;
         }
     }
 
+    void set_fdatasync_after() noexcept {
+        assert(_op == operation::write || _op == operation::writev);
+        _fdatasync_after = true;
+    }
+
+    bool fdatasync_after() const noexcept {
+        return _fdatasync_after;
+    }
+
+    io_request without_fdatasync_after() && noexcept {
+        _fdatasync_after = false;
+        return std::move(*this);
+    }
+
     sstring opname() const;
 
     operation opcode() const {
@@ -353,6 +510,24 @@ class io_request {
         if constexpr (Op == operation::cancel) {
             return _cancel;
         }
+        if constexpr (Op == operation::openat) {
+            return _openat;
+        }
+        if constexpr (Op == operation::statx) {
+            return _statx;
+        }
+        if constexpr (Op == operation::renameat) {
+            return _renameat;
+        }
+        if constexpr (Op == operation::unlinkat) {
+            return _unlinkat;
+        }
+        if constexpr (Op == operation::fallocate) {
+            return _fallocate;
+        }
+        if constexpr (Op == operation::nvme_cmd) {
+            return _nvme_cmd;
+        }
     }
 
     struct part;
@@ -394,6 +569,7 @@ class io_request {
         return sub_req;
     }
     std::vector<part> split_iovec(size_t max_length);
+    std::vector<part> split_nvme_cmd(size_t max_length);
 };
 
 struct io_request::part {
@@ -0,0 +1,115 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/cacheline.hh>
+#ifndef SEASTAR_MODULE
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// Bounded multi-producer single-consumer ring (Vyukov's bounded queue).
+//
+// Each slot carries a sequence number telling whether it is free for the
+// producer claiming position pos (seq == pos) or holds the element pushed at
+// position pos (seq == pos + 1). Producers claim positions with a CAS on the
+// tail; the consumer only stores to the slots it frees.
+template <typename T>
+requires std::is_nothrow_default_constructible_v<T> && std::is_nothrow_move_assignable_v<T>
+class mpsc_ring {
+    struct slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+    std::unique_ptr<slot[]> _slots;
+    size_t _mask;
+    alignas(cache_line_size) std::atomic<size_t> _tail{0};
+    alignas(cache_line_size) size_t _head = 0;
+private:
+    slot& at(size_t pos) noexcept {
+        return _slots[pos & _mask];
+    }
+    const slot& at(size_t pos) const noexcept {
+        return _slots[pos & _mask];
+    }
+public:
+    // capacity is rounded up to a power of two
+    explicit mpsc_ring(size_t capacity)
+        : _slots(new slot[size_t(1) << log2ceil(capacity)])
+        , _mask((size_t(1) << log2ceil(capacity)) - 1) {
+        for (size_t i = 0; i <= _mask; ++i) {
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    mpsc_ring(const mpsc_ring&) = delete;
+
+    size_t capacity() const noexcept {
+        return _mask + 1;
+    }
+
+    // Any thread; returns false if the ring is full
+    bool try_push(T&& v) noexcept {
+        auto pos = _tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto& s = at(pos);
+            auto diff = intptr_t(s.seq.load(std::memory_order_acquire)) - intptr_t(pos);
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.value = std::move(v);
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only
+    bool empty() const noexcept {
+        return at(_head).seq.load(std::memory_order_acquire) != _head + 1;
+    }
+    bool try_pop(T& v) noexcept {
+        auto& s = at(_head);
+        if (s.seq.load(std::memory_order_acquire) != _head + 1) {
+            return false;
+        }
+        v = std::move(s.value);
+        s.seq.store(_head + capacity(), std::memory_order_release);
+        ++_head;
+        return true;
+    }
+};
+
+}
+
+}
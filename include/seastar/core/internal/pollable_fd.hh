@@ -46,6 +46,7 @@ SEASTAR_MODULE_EXPORT_END
 namespace internal {
 
 class buffer_allocator;
+class zerocopy_send_state;
 
 }
 
@@ -109,6 +110,11 @@ class pollable_fd_state {
     future<> write_all(const uint8_t* buffer, size_t size);
     future<size_t> write_some(net::packet& p);
     future<> write_all(net::packet& p);
+    // Sends without copying the data into the socket buffers. The sent parts of
+    // the packet are kept in \c zc until the kernel is done with them, see
+    // wait_zerocopy_sends().
+    future<> write_all_zerocopy(net::packet& p, internal::zerocopy_send_state& zc);
+    future<> wait_zerocopy_sends(internal::zerocopy_send_state& zc);
     future<> readable();
     future<> writeable();
     future<> readable_or_writeable();
@@ -117,6 +123,9 @@ class pollable_fd_state {
     future<temporary_buffer<char>> recv_some(internal::buffer_allocator* ba);
     future<size_t> sendmsg(struct msghdr *msg);
     future<size_t> recvmsg(struct msghdr *msg);
+    // Both return the number of messages transferred, at least one
+    future<size_t> sendmmsg(struct mmsghdr* msgs, unsigned n);
+    future<size_t> recvmmsg(struct mmsghdr* msgs, unsigned n);
     future<size_t> sendto(socket_address addr, const void* buf, size_t len);
     future<> poll_rdhup();
 
@@ -164,6 +173,12 @@ class pollable_fd {
     future<> write_all(net::packet& p) {
         return _s->write_all(p);
     }
+    future<> write_all_zerocopy(net::packet& p, internal::zerocopy_send_state& zc) {
+        return _s->write_all_zerocopy(p, zc);
+    }
+    future<> wait_zerocopy_sends(internal::zerocopy_send_state& zc) {
+        return _s->wait_zerocopy_sends(zc);
+    }
     future<> readable() {
         return _s->readable();
     }
@@ -188,6 +203,12 @@ class pollable_fd {
     future<size_t> recvmsg(struct msghdr *msg) {
         return _s->recvmsg(msg);
     }
+    future<size_t> sendmmsg(struct mmsghdr* msgs, unsigned n) {
+        return _s->sendmmsg(msgs, n);
+    }
+    future<size_t> recvmmsg(struct mmsghdr* msgs, unsigned n) {
+        return _s->recvmmsg(msgs, n);
+    }
     future<size_t> sendto(socket_address addr, const void* buf, size_t len) {
         return _s->sendto(addr, buf, len);
     }
@@ -24,6 +24,7 @@
 #endif
 
 #include <seastar/core/align.hh>
+#include <seastar/core/internal/dma_buffer_pool.hh>
 #include <seastar/core/internal/io_intent.hh>
 #include <seastar/core/temporary_buffer.hh>
 
@@ -36,7 +37,7 @@ struct file_read_state {
 
     file_read_state(uint64_t offset, uint64_t front, size_t to_read,
             size_t memory_alignment, size_t disk_alignment, io_intent* intent)
-    : buf(tmp_buf_type::aligned(memory_alignment,
+    : buf(allocate_dma_buffer<CharType>(memory_alignment,
                                 align_up(to_read, disk_alignment)))
     , _offset(offset)
     , _to_read(to_read)
@@ -32,6 +32,7 @@
 #include <linux/perf_event.h>
 #endif
 #include <seastar/core/posix.hh>
+#include <seastar/core/metrics.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/scheduling.hh>
 #include <seastar/util/modules.hh>
@@ -53,6 +54,30 @@ struct cpu_stall_detector_config {
 
 // Detects stalls in continuations that run for too long
 class cpu_stall_detector {
+public:
+    // What a stall is attributed to, from the resource usage of the reactor
+    // thread during the stall. Without this, a stall caused by e.g. a major
+    // page fault is blamed on whatever code happened to be running.
+    enum class stall_cause {
+        user_code,      // on the CPU, in user space
+        kernel,         // on the CPU, in syscalls, minor page faults or memory reclaim
+        page_faults,    // off the CPU, waiting for major page faults
+        preemption,     // off the CPU, preempted by other threads or the hypervisor
+        blocking,       // off the CPU, blocked in syscalls
+        count,
+    };
+    struct usage_snapshot {
+        sched_clock::duration user{};
+        sched_clock::duration system{};
+        uint64_t minor_faults = 0;
+        uint64_t major_faults = 0;
+        uint64_t voluntary_switches = 0;
+        uint64_t involuntary_switches = 0;
+        // Time spent runnable but waiting for a CPU, from schedstat
+        sched_clock::duration runqueue_wait{};
+    };
+    static stall_cause classify(const usage_snapshot& start, const usage_snapshot& end, sched_clock::duration wall) noexcept;
+    static const char* cause_name(stall_cause c) noexcept;
 protected:
     std::atomic<uint64_t> _last_tasks_processed_seen{};
     unsigned _stall_detector_reports_per_minute;
@@ -69,6 +94,11 @@ class cpu_stall_detector {
     sched_clock::duration _threshold;
     sched_clock::duration _slack;
     cpu_stall_detector_config _config;
+    // /proc/self/task/<tid>/schedstat, kept open so that it can be read
+    // from the signal handler
+    int _schedstat_fd = -1;
+    usage_snapshot _run_started_usage{};
+    seastar::metrics::counter_array<stall_cause> _reported_by_cause;
     seastar::metrics::metric_groups _metrics;
     friend reactor;
     virtual bool is_spurious_signal() {
@@ -80,11 +110,12 @@ class cpu_stall_detector {
     virtual void arm_timer() = 0;
     void report_suppressions(sched_clock::time_point now);
     void reset_suppression_state(sched_clock::time_point now);
+    usage_snapshot take_usage_snapshot() const noexcept;
 public:
     using clock_type = thread_cputime_clock;
 public:
     explicit cpu_stall_detector(cpu_stall_detector_config cfg = {});
-    virtual ~cpu_stall_detector() = default;
+    virtual ~cpu_stall_detector();
     static int signal_number() { return SIGRTMIN + 1; }
     void start_task_run(sched_clock::time_point now);
     void end_task_run(sched_clock::time_point now);
@@ -0,0 +1,103 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/shard_id.hh>
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <array>
+#include <atomic>
+#include <mutex>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// A unit of work submitted with smp::submit_stealable(). It is queued on the
+// submitting (origin) shard and either runs there in its turn, or is taken
+// over by an idle shard on the same NUMA node. In the latter case the result
+// is shipped back to the origin shard, where the item is destroyed.
+class stealable_work : public boost::intrusive::list_base_hook<> {
+public:
+    const shard_id origin = this_shard_id();
+    const scheduling_group sg = current_scheduling_group();
+
+    virtual ~stealable_work() = default;
+    // Called in the context of \c sg, on the origin shard or on a thief.
+    virtual void run() noexcept = 0;
+};
+
+// Per-shard queue of stealable work, one list per scheduling group so the
+// origin shard keeps running each item in its own group. Accessed by the
+// owning shard and by its NUMA siblings, hence the lock.
+class stealable_work_queue {
+    using list_type = boost::intrusive::list<stealable_work, boost::intrusive::constant_time_size<false>>;
+    std::mutex _lock;
+    std::array<list_type, max_scheduling_groups()> _items;
+    std::atomic<size_t> _size = 0;
+    unsigned _next_steal = 0;
+public:
+    void push(stealable_work& w) noexcept {
+        std::lock_guard _(_lock);
+        _items[internal::scheduling_group_index(w.sg)].push_back(w);
+        _size.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Takes the oldest item of the given group, nullptr if it was stolen.
+    stealable_work* pop(scheduling_group sg) noexcept {
+        std::lock_guard _(_lock);
+        auto& l = _items[internal::scheduling_group_index(sg)];
+        return l.empty() ? nullptr : take(l);
+    }
+    // Takes the oldest item of any group, round-robin between them.
+    stealable_work* steal() noexcept {
+        if (empty()) {
+            return nullptr;
+        }
+        std::lock_guard _(_lock);
+        for (unsigned i = 0; i < _items.size(); i++) {
+            auto& l = _items[_next_steal++ % _items.size()];
+            if (!l.empty()) {
+                return take(l);
+            }
+        }
+        return nullptr;
+    }
+    bool empty() const noexcept {
+        return _size.load(std::memory_order_relaxed) == 0;
+    }
+private:
+    stealable_work* take(list_type& l) noexcept {
+        auto& w = l.front();
+        l.pop_front();
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        return &w;
+    }
+};
+
+// Queues \c w on the current shard, takes ownership of it unless it throws.
+void submit_stealable_work(stealable_work& w);
+
+}
+
+}
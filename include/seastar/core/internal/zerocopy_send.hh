@@ -0,0 +1,62 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/net/packet.hh>
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// Packets sent with zero-copy send (MSG_ZEROCOPY or IORING_OP_SENDMSG_ZC).
+// The kernel keeps referencing their memory after the send itself completed,
+// so they are held here until it notifies us that it no longer does.
+class zerocopy_send_state : public enable_lw_shared_from_this<zerocopy_send_state> {
+public:
+    // MSG_ZEROCOPY: the kernel numbers successful zero-copy sends on a socket
+    // sequentially from 0, and reports ranges of completed ones on the
+    // socket error queue.
+    uint32_t next_seq = 0;
+    std::unordered_map<uint32_t, net::packet> pending;
+    // IORING_OP_SENDMSG_ZC: the completion keeps the packet, we only count
+    // the requests the kernel hasn't notified yet.
+    unsigned in_flight = 0;
+    std::optional<promise<>> drained;
+
+    void notified() noexcept {
+        if (--in_flight == 0 && drained) {
+            drained->set_value();
+            drained.reset();
+        }
+    }
+};
+
+}
+
+}
@@ -0,0 +1,141 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+#include <seastar/core/future.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <exception>
+#include <sys/uio.h>
+#include <vector>
+#endif
+
+namespace seastar {
+
+class io_intent;
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fileio-module
+/// @{
+
+/// A set of DMA reads and writes, possibly to different files, submitted together
+///
+/// The operations added to a batch are all issued by a single call to
+/// \ref submit(), so they reach the I/O queues in the same task and are
+/// dispatched to the disk by the same reactor poll, together with adjacent
+/// reads merged, instead of trickling in as their callers get to run. The
+/// batch completes once all of its operations do; the outcome of each one is
+/// then available through \ref bytes() and \ref failed().
+///
+/// The caller gets a single future for the whole batch, and the results are
+/// kept in the batch. Each operation still goes through \ref file::dma_read()
+/// or \ref file::dma_write() internally, and so has a future of its own,
+/// for the batch to work with any file implementation, layered ones
+/// included. Operations which complete at once cost no continuation.
+///
+/// The same alignment rules as for \ref file::dma_read() and
+/// \ref file::dma_write() apply to every operation. The buffers and the
+/// batch itself must be kept alive until the future returned by
+/// \ref submit() resolves.
+class io_batch {
+    enum class op_kind : uint8_t { read, write };
+    struct op {
+        file f;
+        uint64_t pos;
+        char* buffer;
+        size_t len;
+        // Used instead of buffer and len by vectored operations
+        std::vector<iovec> iov;
+        op_kind kind;
+        size_t result = 0;
+        std::exception_ptr ex;
+    };
+    std::vector<op> _ops;
+    size_t _pending = 0;
+    promise<> _done;
+public:
+    io_batch() = default;
+    io_batch(const io_batch&) = delete;
+    io_batch(io_batch&&) = delete;
+
+    /// Preallocates room for \c n operations
+    void reserve(size_t n) {
+        _ops.reserve(n);
+    }
+
+    /// Adds a read of \c len bytes from \c pos in \c f into \c buffer
+    ///
+    /// \return the index of the operation in the batch
+    size_t add_read(file& f, uint64_t pos, void* buffer, size_t len);
+    /// Adds a read from \c pos in \c f into the \c iov scatter list
+    ///
+    /// \return the index of the operation in the batch
+    size_t add_read(file& f, uint64_t pos, std::vector<iovec> iov);
+    /// Adds a write of \c len bytes from \c buffer to \c pos in \c f
+    ///
+    /// \return the index of the operation in the batch
+    size_t add_write(file& f, uint64_t pos, const void* buffer, size_t len);
+    /// Adds a write of the \c iov gather list to \c pos in \c f
+    ///
+    /// \return the index of the operation in the batch
+    size_t add_write(file& f, uint64_t pos, std::vector<iovec> iov);
+
+    /// Returns the number of operations in the batch
+    size_t size() const noexcept {
+        return _ops.size();
+    }
+
+    /// Issues all the operations of the batch
+    ///
+    /// \param intent an optional cancellation intent, applied to all operations
+    /// \return a future which resolves once all the operations completed. It
+    ///         doesn't fail when some of them did, check \ref failed() for that.
+    future<> submit(io_intent* intent = nullptr) noexcept;
+
+    /// Returns whether the i-th operation failed
+    bool failed(size_t i) const noexcept {
+        return bool(_ops[i].ex);
+    }
+
+    /// Returns the number of bytes transferred by the i-th operation, or
+    /// throws the exception it failed with
+    size_t bytes(size_t i) const;
+
+    /// Drops all the operations, so that the batch can be filled again. Must
+    /// not be called while a submission is in progress.
+    void clear() noexcept {
+        _ops.clear();
+    }
+private:
+    size_t add(file& f, uint64_t pos, char* buffer, size_t len, std::vector<iovec> iov, op_kind kind);
+    future<size_t> issue(op& o, io_intent* intent) noexcept;
+    void complete(op& o, future<size_t> f) noexcept;
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
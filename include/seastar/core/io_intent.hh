@@ -90,6 +90,12 @@ class io_intent {
     /// Explicitly cancels all the requests attached to this intent
     /// so far. The respective futures are resolved into the \ref
     /// cancelled_error "cancelled_error"
+    ///
+    /// Requests already dispatched to the disk give their share of the
+    /// queue's capacity back right away, and the kernel is asked to stop
+    /// them (with io_uring). Their futures are only resolved when the kernel
+    /// is done with them, since it may still access their buffers until then.
+    /// The result is dropped even if they completed.
     void cancel() noexcept {
         _refs.clear();
         _intents.clear();
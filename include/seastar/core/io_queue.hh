@@ -23,6 +23,8 @@
 
 #ifndef SEASTAR_MODULE
 #include <boost/container/static_vector.hpp>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <vector>
@@ -34,6 +36,8 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/internal/io_request.hh>
 #include <seastar/core/lowres_clock.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/util/noncopyable_function.hh>
 #include <seastar/util/spinlock.hh>
 #include <seastar/util/modules.hh>
 
@@ -117,6 +121,8 @@ class io_queue {
     size_t _requests_executing = 0;
     uint64_t _requests_dispatched = 0;
     uint64_t _requests_completed = 0;
+    // Capacity of the requests queued or executing, see pending_time()
+    fair_queue_entry::capacity_t _pending_capacity = 0;
 
     // Flow monitor
     uint64_t _prev_dispatched = 0;
@@ -126,11 +132,67 @@ class io_queue {
 
     void update_flow_ratio() noexcept;
 
+    // Device latency monitor, feeds the group's adaptive rate
+    struct completion_latency {
+        std::chrono::duration<double> total = std::chrono::duration<double>(0);
+        uint64_t count = 0;
+    };
+    std::array<completion_latency, 2> _completion_latency;
+
+    void account_completion_latency(stream_id stream, std::chrono::duration<double> lat) noexcept;
+    void update_adaptive_rate() noexcept;
+
+    // Reads dispatched during the current poll, see config::coalesce_reads
+    struct staged_read {
+        io_desc_read_write* desc;
+        internal::io_request req;
+    };
+    std::vector<staged_read> _staged_reads;
+    uint64_t _coalesced_reads = 0;
+
+    void flush_staged_reads() noexcept;
+    bool submit_coalesced_reads(staged_read* begin, staged_read* end) noexcept;
+
     metrics::metric_groups _metric_groups;
 public:
 
     using clock_type = std::chrono::steady_clock;
 
+    // A read or write submitted to the queue, as reported to the trace hook
+    struct trace_record {
+        clock_type::time_point timestamp;
+        // Index of the scheduling group the request was submitted from
+        unsigned class_id;
+        bool write;
+        uint64_t offset;
+        size_t length;
+    };
+    // Called synchronously, on the queue's shard, for every request before
+    // it is queued. Must be cheap and must not throw.
+    using trace_hook = noncopyable_function<void(const trace_record&) noexcept>;
+private:
+    trace_hook _trace_hook;
+
+    void trace(internal::priority_class pc, bool write, const internal::io_request& req, size_t len) noexcept;
+public:
+
+    // Timeline of a sampled request, see config::request_sample_rate
+    struct sampled_request {
+        clock_type::time_point queued;
+        // When the request left the fair queue and was handed to the sink
+        clock_type::time_point dispatched;
+        clock_type::time_point completed;
+        unsigned class_id;
+        bool write;
+        size_t length;
+    };
+private:
+    unsigned _sample_countdown;
+    // Ring of the most recent sampled requests, see config::request_log_size
+    std::vector<sampled_request> _sampled_requests;
+    size_t _sampled_requests_head = 0;
+public:
+
     // We want to represent the fact that write requests are (maybe) more expensive
     // than read requests. To avoid dealing with floating point math we will scale one
     // read request to be counted by this amount.
@@ -142,8 +204,17 @@ class io_queue {
     static constexpr unsigned read_request_base_count = 128;
     static constexpr unsigned block_size_shift = 9;
 
+    // Cost of a single request of the given length, in seconds of the
+    // group's capacity, as measured by iotune at several request sizes
+    struct request_cost {
+        size_t length;
+        double seconds;
+    };
+
     struct config {
         dev_t devid;
+        // Number of IO groups the device is split into, across all shards
+        unsigned num_io_groups = 1;
         unsigned long req_count_rate = std::numeric_limits<int>::max();
         unsigned long blocks_count_rate = std::numeric_limits<int>::max();
         unsigned disk_req_write_to_read_multiplier = read_request_base_count;
@@ -157,6 +228,29 @@ class io_queue {
         unsigned flow_ratio_ticks = 100;
         double flow_ratio_ema_factor = 0.95;
         double flow_ratio_backpressure_threshold = 1.1;
+        // Adjust the groups' rates so that the observed device latency
+        // stays within rate_limit_duration, see io_group::adjust_rate()
+        bool adaptive_rate = false;
+        double adaptive_rate_min_factor = 0.1;
+        double adaptive_rate_max_factor = 2.0;
+        // Merge reads of adjacent file ranges dispatched in the same poll
+        // into a single vectored read
+        bool coalesce_reads = false;
+        std::chrono::duration<double> capacity_lease_duration = std::chrono::duration<double>(0);
+        // Measured costs of reads and writes, sorted by length. When present,
+        // they replace the linear per-request plus per-block model for
+        // requests up to the longest measured length, see request_tokens()
+        std::vector<request_cost> read_costs;
+        std::vector<request_cost> write_costs;
+        // How much more writes cost when mixed with reads than they do alone,
+        // derived from iotune's read-under-write-load measurements
+        double write_interference_factor = 1.0;
+        // Record the queue and device time of one in this many requests
+        // into per-class histograms, 0 disables sampling
+        unsigned request_sample_rate = 0;
+        // How many of the most recent sampled requests to keep for
+        // sampled_requests()
+        size_t request_log_size = 0;
     };
 
     io_queue(io_group_ptr group, internal::io_sink& sink);
@@ -173,6 +267,10 @@ class io_queue {
     void cancel_request(queued_io_request& req) noexcept;
     void complete_cancelled_request(queued_io_request& req) noexcept;
     void complete_request(io_desc_read_write& desc) noexcept;
+    void complete_request(io_desc_read_write& desc, std::chrono::duration<double> lat) noexcept;
+    void cancel_dispatched_request(io_desc_read_write& desc) noexcept;
+    bool sample_request() noexcept;
+    void log_sampled_request(const sampled_request& sr) noexcept;
 
     [[deprecated("I/O queue users should not track individual requests, but resources (weight, size) passing through the queue")]]
     size_t queued_requests() const {
@@ -185,6 +283,18 @@ class io_queue {
         return _requests_executing;
     }
 
+    // Whether requests are queued or sent to disk and not yet returned
+    bool has_pending_requests() const noexcept {
+        return _queued_requests || _requests_executing;
+    }
+
+    // Time the device would take to serve the requests this shard queued
+    // or has executing, as estimated from the configured disk properties.
+    // Unlike request counts, comparable across devices.
+    std::chrono::duration<double> pending_time() const noexcept {
+        return std::chrono::duration<double>(fair_group::capacity_tokens(_pending_capacity));
+    }
+
     // Dispatch requests that are pending in the I/O queue
     void poll_io_queue();
 
@@ -196,6 +306,7 @@ class io_queue {
 
     void update_shares_for_class(internal::priority_class pc, size_t new_shares);
     future<> update_bandwidth_for_class(internal::priority_class pc, uint64_t new_bandwidth);
+    future<> update_limits_for_class(internal::priority_class pc, io_limits limits);
     void rename_priority_class(internal::priority_class pc, sstring new_name);
     void throttle_priority_class(const priority_class_data& pc) noexcept;
     void unthrottle_priority_class(const priority_class_data& pc) noexcept;
@@ -208,6 +319,15 @@ class io_queue {
     request_limits get_request_limits() const noexcept;
     const config& get_config() const noexcept;
 
+    // Installs a hook which sees every request submitted to this queue, e.g.
+    // to record a trace for replaying with io_tester. An empty hook removes it.
+    void set_trace_hook(trace_hook hook) noexcept {
+        _trace_hook = std::move(hook);
+    }
+
+    // Returns the most recent sampled requests, oldest first
+    std::vector<sampled_request> sampled_requests() const;
+
 private:
     static fair_queue::config make_fair_queue_config(const config& cfg, sstring label);
     void register_stats(sstring name, priority_class_data& pc);
@@ -233,8 +353,23 @@ class io_group {
     util::spinlock _lock;
     const shard_id _allocated_on;
 
+    /*
+     * Closed-loop rate control state, one per fair group. Queues report
+     * the average device latency they observed for the last period, the
+     * queue on the group's shard then picks the worst value and scales
+     * the group's rate so that it stays within the latency goal.
+     */
+    struct adaptive_rate {
+        std::atomic<uint64_t> worst_latency_ns = 0;
+        // Written by the group's shard, read by the metrics of all
+        std::atomic<double> factor = 1.0;
+    };
+    std::array<adaptive_rate, 2> _adaptive_rate;
+
     static fair_group::config make_fair_group_config(const io_queue::config& qcfg) noexcept;
     priority_class_data& find_or_create_class(internal::priority_class pc);
+    void report_latency(unsigned idx, std::chrono::duration<double> lat) noexcept;
+    void adjust_rate(unsigned idx) noexcept;
 };
 
 inline const io_queue::config& io_queue::get_config() const noexcept {
@@ -28,6 +28,12 @@
 #include <seastar/core/loop.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/util/variant_utils.hh>
+#ifndef SEASTAR_MODULE
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#endif
 
 namespace seastar {
 
@@ -77,6 +83,15 @@ future<> output_stream<CharType>::write(scattered_message<CharType> msg) noexcep
 template<typename CharType>
 future<>
 output_stream<CharType>::zero_copy_put(net::packet p) noexcept {
+    if (_gather_writes) {
+        return gather(std::move(p));
+    }
+    return sink_put(std::move(p));
+}
+
+template<typename CharType>
+future<>
+output_stream<CharType>::sink_put(net::packet p) noexcept {
     // if flush is scheduled, disable it, so it will not try to write in parallel
     _flush = false;
     if (_flushing) {
@@ -110,10 +125,42 @@ output_stream<CharType>::zero_copy_split_and_put(net::packet p) noexcept {
     });
 }
 
+// Appends to the data gathered for the next flush. The gathered data is put
+// early if a syscall couldn't take more fragments, or if it grew large,
+// to push back on writers that don't flush.
+template<typename CharType>
+future<>
+output_stream<CharType>::gather(net::packet p) noexcept {
+  try {
+    if (_gathered) {
+        _gathered.append(std::move(p));
+    } else {
+        _gathered = std::move(p);
+    }
+    if (_gathered.nr_frags() >= IOV_MAX || _gathered.len() >= 16 * _size) {
+        return sink_put(std::exchange(_gathered, net::packet::make_null_packet()));
+    }
+    return make_ready_future<>();
+  } catch (...) {
+    return current_exception_as_future();
+  }
+}
+
 template<typename CharType>
 future<> output_stream<CharType>::write(net::packet p) noexcept {
     static_assert(std::is_same_v<CharType, char>, "packet works on char");
   try {
+    if (_gather_writes && p.len() != 0) {
+        // Buffered and zero-copy data can be mixed, they are sent in order
+        if (_end) {
+            _buf.trim(_end);
+            _end = 0;
+            net::packet head(std::move(_buf));
+            head.append(std::move(p));
+            p = std::move(head);
+        }
+        return gather(std::move(p));
+    }
     if (p.len() != 0) {
         assert(!_end && "Mixing buffered writes and zero-copy writes not supported yet");
 
@@ -143,7 +190,7 @@ future<> output_stream<CharType>::write(temporary_buffer<CharType> p) noexcept {
     if (p.empty()) {
         return make_ready_future<>();
     }
-    assert(!_end && "Mixing buffered writes and zero-copy writes not supported yet");
+    assert((_gather_writes || !_end) && "Mixing buffered writes and zero-copy writes not supported yet");
     return write(net::packet(std::move(p)));
   } catch (...) {
     return current_exception_as_future();
@@ -250,6 +297,108 @@ input_stream<CharType>::consume(Consumer& consumer) noexcept(std::is_nothrow_mov
     return consume(std::ref(consumer));
 }
 
+namespace internal {
+
+// Consumer splitting the stream at delimiters, for input_stream::consume_until()
+template <typename CharType, typename Func>
+class delimited_consumer {
+    using tmp_buf = temporary_buffer<CharType>;
+    using result_type = consumption_result<CharType>;
+    Func _func;
+    CharType _delimiter;
+    bool _strip_cr;
+    size_t _max_size;
+    // Start of a piece spanning buffers
+    std::vector<tmp_buf> _partial;
+    size_t _partial_size = 0;
+private:
+    tmp_buf take_piece(tmp_buf tail) {
+        if (_partial.empty()) {
+            return tail;
+        }
+        tmp_buf piece(_partial_size + tail.size());
+        auto p = piece.get_write();
+        for (auto& b : _partial) {
+            p = std::copy(b.begin(), b.end(), p);
+        }
+        std::copy(tail.begin(), tail.end(), p);
+        _partial.clear();
+        _partial_size = 0;
+        return piece;
+    }
+    future<stop_iteration> deliver(tmp_buf piece) {
+        if (_strip_cr && !piece.empty() && piece[piece.size() - 1] == CharType('\r')) {
+            piece.trim(piece.size() - 1);
+        }
+        return futurize_invoke(_func, std::move(piece));
+    }
+    future<result_type> process(tmp_buf buf) {
+        while (!buf.empty()) {
+            auto p = static_cast<const CharType*>(std::memchr(buf.get(), _delimiter, buf.size()));
+            if (!p) {
+                if (_partial_size + buf.size() > _max_size) {
+                    return seastar::make_exception_future<result_type>(std::length_error("delimited piece too long"));
+                }
+                _partial_size += buf.size();
+                _partial.push_back(std::move(buf));
+                return make_ready_future<result_type>(continue_consuming{});
+            }
+            size_t len = p - buf.get();
+            if (_partial_size + len > _max_size) {
+                return seastar::make_exception_future<result_type>(std::length_error("delimited piece too long"));
+            }
+            auto piece = take_piece(buf.share(0, len));
+            buf.trim_front(len + 1);
+            auto f = deliver(std::move(piece));
+            if (!f.available() || f.failed()) {
+                return f.then([this, buf = std::move(buf)] (stop_iteration stop) mutable {
+                    if (stop) {
+                        return make_ready_future<result_type>(stop_consuming<CharType>(std::move(buf)));
+                    }
+                    return process(std::move(buf));
+                });
+            }
+            if (f.get()) {
+                return make_ready_future<result_type>(stop_consuming<CharType>(std::move(buf)));
+            }
+        }
+        return make_ready_future<result_type>(continue_consuming{});
+    }
+public:
+    delimited_consumer(Func func, CharType delimiter, bool strip_cr, size_t max_size)
+        : _func(std::move(func)), _delimiter(delimiter), _strip_cr(strip_cr), _max_size(max_size) {}
+    future<result_type> operator()(tmp_buf buf) {
+        if (!buf.empty()) {
+            return process(std::move(buf));
+        }
+        // End of stream
+        if (!_partial_size) {
+            return make_ready_future<result_type>(stop_consuming<CharType>(std::move(buf)));
+        }
+        return deliver(take_piece(tmp_buf())).then([] (stop_iteration) {
+            return make_ready_future<result_type>(stop_consuming<CharType>(tmp_buf()));
+        });
+    }
+};
+
+}
+
+template <typename CharType>
+template <typename Func>
+requires DelimitedPieceConsumer<Func, CharType>
+future<>
+input_stream<CharType>::consume_until(CharType delimiter, Func func, size_t max_size) noexcept {
+    return consume(internal::delimited_consumer<CharType, Func>(std::move(func), delimiter, false, max_size));
+}
+
+template <typename CharType>
+template <typename Func>
+requires DelimitedPieceConsumer<Func, CharType>
+future<>
+input_stream<CharType>::consume_lines(Func func, size_t max_size) noexcept {
+    return consume(internal::delimited_consumer<CharType, Func>(std::move(func), CharType('\n'), true, max_size));
+}
+
 template <typename CharType>
 future<temporary_buffer<CharType>>
 input_stream<CharType>::read_up_to(size_t n) noexcept {
@@ -414,6 +563,27 @@ void add_to_flush_poller(output_stream<char>& x) noexcept;
 
 template <typename CharType>
 future<> output_stream<CharType>::do_flush() noexcept {
+    if (_gather_writes) {
+      try {
+        if (_end) {
+            _buf.trim(_end);
+            _end = 0;
+            if (_gathered) {
+                _gathered = net::packet(std::move(_gathered), std::move(_buf));
+            } else {
+                _gathered = net::packet(std::move(_buf));
+            }
+        }
+        if (!_gathered) {
+            return _fd.flush();
+        }
+        return _fd.put(std::exchange(_gathered, net::packet::make_null_packet())).then([this] {
+            return _fd.flush();
+        });
+      } catch (...) {
+        return current_exception_as_future();
+      }
+    }
     if (_end) {
         _buf.trim(_end);
         _end = 0;
@@ -452,6 +622,13 @@ output_stream<CharType>::flush() noexcept {
 template <typename CharType>
 future<>
 output_stream<CharType>::put(temporary_buffer<CharType> buf) noexcept {
+    if (_gather_writes) {
+        try {
+            return gather(net::packet(std::move(buf)));
+        } catch (...) {
+            return current_exception_as_future();
+        }
+    }
     // if flush is scheduled, disable it, so it will not try to write in parallel
     _flush = false;
     if (_flushing) {
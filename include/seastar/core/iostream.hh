@@ -36,6 +36,7 @@
 #pragma once
 
 #include <seastar/core/future.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/core/scattered_message.hh>
 #include <seastar/util/std-compat.hh>
@@ -43,6 +44,7 @@
 #ifndef SEASTAR_MODULE
 #include <boost/intrusive/slist.hpp>
 #include <algorithm>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <variant>
@@ -272,6 +274,12 @@ concept ObsoleteInputStreamConsumer = requires (Consumer c) {
     { c(temporary_buffer<CharType>{}) } -> std::same_as<future<std::optional<temporary_buffer<CharType>>>>;
 };
 
+// Callback of input_stream::consume_until() and consume_lines(), receiving
+// the pieces of the stream and telling whether to stop
+template <typename Func, typename CharType>
+concept DelimitedPieceConsumer = std::invocable<Func, temporary_buffer<CharType>>
+    && std::same_as<futurize_t<std::invoke_result_t<Func, temporary_buffer<CharType>>>, future<stop_iteration>>;
+
 /// Buffers data from a data_source and provides a stream interface to the user.
 ///
 /// \note All methods must be called sequentially.  That is, no method may be
@@ -314,6 +322,24 @@ class input_stream final {
     template <typename Consumer>
     requires InputStreamConsumer<Consumer, CharType> || ObsoleteInputStreamConsumer<Consumer, CharType>
     future<> consume(Consumer& c) noexcept(std::is_nothrow_move_constructible_v<Consumer>);
+    /// Splits the stream at each \c delimiter and calls \c func with every
+    /// piece, delimiter excluded, until \c func returns \c stop_iteration::yes
+    /// or the end of the stream. A last piece not followed by a delimiter is
+    /// passed too.
+    ///
+    /// Pieces within a buffer of the stream are slices of it, only pieces
+    /// spanning buffers are copied. The rest of the buffer in which \c func
+    /// asked to stop stays in the stream.
+    ///
+    /// \throws std::length_error if a piece is longer than \c max_size
+    template <typename Func>
+    requires DelimitedPieceConsumer<Func, CharType>
+    future<> consume_until(CharType delimiter, Func func, size_t max_size = std::numeric_limits<size_t>::max()) noexcept;
+    /// Like \ref consume_until() with a \c '\\n' delimiter, also stripping the
+    /// \c '\\r' of lines ending with \c "\\r\\n".
+    template <typename Func>
+    requires DelimitedPieceConsumer<Func, CharType>
+    future<> consume_lines(Func func, size_t max_size = std::numeric_limits<size_t>::max()) noexcept;
     /// Returns true if the end-of-file flag is set on the stream.
     /// Note that the eof flag is only set after a previous attempt to read
     /// from the stream noticed the end of the stream. In other words, it is
@@ -340,6 +366,22 @@ class input_stream final {
     }
     /// Ignores n next bytes from the stream.
     future<> skip(uint64_t n) noexcept;
+    /// Frees the buffer kept from the last read, if all its data was consumed.
+    ///
+    /// What is left of a received buffer after its data was consumed still
+    /// holds the memory of the whole buffer, until the next read replaces
+    /// it. Connections which may wait long for their next message can call
+    /// this before waiting, so that idle connections hold no buffers; the
+    /// next read allocates a new one.
+    ///
+    /// \returns true if no data was buffered, so nothing is held anymore
+    bool release_idle_buffer() noexcept {
+        if (!_buf.empty()) {
+            return false;
+        }
+        _buf = {};
+        return true;
+    }
 
     /// Detaches the underlying \c data_source from the \c input_stream.
     ///
@@ -361,6 +403,10 @@ struct output_stream_options {
     bool trim_to_size = false; ///< Make sure that buffers put into sink haven't
                                ///< grown larger than the configured size
     bool batch_flushes = false; ///< Try to merge flushes with each other
+    bool gather_writes = false; ///< Hand everything written between flushes
+                                ///< to the data sink as a single packet, so
+                                ///< that it can be sent with one gather write.
+                                ///< Ignored when trim_to_size is set.
 };
 
 /// Facilitates data buffering before it's handed over to data_sink.
@@ -385,6 +431,9 @@ class output_stream final {
     size_t _end = 0;
     bool _trim_to_size = false;
     bool _batch_flushes = false;
+    bool _gather_writes = false;
+    // Data written since the last flush, when gathering writes
+    net::packet _gathered = net::packet::make_null_packet();
     std::optional<promise<>> _in_batch;
     bool _flush = false;
     bool _flushing = false;
@@ -399,13 +448,16 @@ class output_stream final {
     future<> do_flush() noexcept;
     future<> zero_copy_put(net::packet p) noexcept;
     future<> zero_copy_split_and_put(net::packet p) noexcept;
+    future<> sink_put(net::packet p) noexcept;
+    future<> gather(net::packet p) noexcept;
     [[gnu::noinline]]
     future<> slow_write(const CharType* buf, size_t n) noexcept;
 public:
     using char_type = CharType;
     output_stream() noexcept = default;
     output_stream(data_sink fd, size_t size, output_stream_options opts = {}) noexcept
-        : _fd(std::move(fd)), _size(size), _trim_to_size(opts.trim_to_size), _batch_flushes(opts.batch_flushes && _fd.can_batch_flushes()) {}
+        : _fd(std::move(fd)), _size(size), _trim_to_size(opts.trim_to_size), _batch_flushes(opts.batch_flushes && _fd.can_batch_flushes())
+        , _gather_writes(opts.gather_writes && !opts.trim_to_size) {}
     [[deprecated("use output_stream_options instead of booleans")]]
     output_stream(data_sink fd, size_t size, bool trim_to_size, bool batch_flushes = false) noexcept
         : _fd(std::move(fd)), _size(size), _trim_to_size(trim_to_size), _batch_flushes(batch_flushes && _fd.can_batch_flushes()) {}
@@ -417,7 +469,7 @@ class output_stream final {
         if (_batch_flushes) {
             assert(!_in_batch && "Was this stream properly closed?");
         } else {
-            assert(!_end && !_zc_bufs && "Was this stream properly closed?");
+            assert(!_end && !_zc_bufs && !_gathered && "Was this stream properly closed?");
         }
     }
     future<> write(const char_type* buf, size_t n) noexcept;
@@ -0,0 +1,132 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+/// \file
+
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/util/modules.hh>
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <memory>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Options for \ref log_file::open()
+struct log_file_options {
+    /// Size of the segments, the files the log is made of. A record can't
+    /// be larger than a segment.
+    uint64_t segment_size = 32 << 20;
+    /// Disk blocks of the active segment are allocated this far ahead of the
+    /// writes, in the background
+    uint64_t preallocation_size = 4 << 20;
+    /// Upper bound of the records written by a single group commit
+    size_t max_commit_size = 1 << 20;
+    /// Number of released segments kept for reuse. They are zeroed in
+    /// advance, so that writing to them doesn't change the file metadata.
+    unsigned recycled_segments = 2;
+    /// Open the segments with O_DSYNC instead of syncing after each write
+    bool dsync = false;
+    /// Export metrics with this value of the \p log label, if not empty
+    sstring metrics_name;
+};
+
+/// Position of a record in a \ref log_file
+struct log_position {
+    uint64_t segment;   ///< Id of the segment holding the record
+    uint64_t offset;    ///< Offset of the record in the segment
+};
+
+/// Append-only, durable log, for commit and write-ahead logs
+///
+/// The log is a sequence of segment files in a directory, named
+/// \p log-<id> with increasing ids. Records appended while a write is in
+/// flight are batched into the next one, which is issued along with a
+/// data sync (linked to it with the io_uring backend), so that concurrent
+/// appenders share the cost of syncing. Each record is written as is, at
+/// the position it is reported at, and the rest of a segment is zeroes:
+/// framing records and telling where they end is up to the caller.
+///
+/// Segments are filled one after the other, and the next one is prepared
+/// in the background. Old segments are dropped with \ref release_segments().
+class log_file {
+public:
+    /// \cond internal
+    class impl;
+    /// \endcond
+    struct stats {
+        uint64_t records = 0;           ///< Records written
+        uint64_t bytes = 0;             ///< Bytes of records written
+        uint64_t commits = 0;           ///< Writes, each followed by a sync
+        uint64_t segments_created = 0;  ///< Segments created anew
+        uint64_t segments_recycled = 0; ///< Segments reused from released ones
+    };
+private:
+    std::unique_ptr<impl> _impl;
+    explicit log_file(std::unique_ptr<impl> impl) noexcept;
+public:
+    log_file(log_file&&) noexcept;
+    log_file& operator=(log_file&&) noexcept;
+    ~log_file();
+
+    /// Opens the log in directory \c dir, which must exist.
+    ///
+    /// Segments already in the directory are left alone, new records go to
+    /// a segment with a larger id.
+    static future<log_file> open(sstring dir, log_file_options options = {});
+
+    /// Appends a record
+    ///
+    /// \return the position of the record, once it is durable. If a write
+    ///         fails, so do all the appends after it.
+    future<log_position> append(temporary_buffer<char> record);
+
+    /// Id of the segment records are currently appended to
+    uint64_t active_segment() const noexcept;
+
+    /// Path of the file of a segment
+    sstring segment_path(uint64_t segment) const;
+
+    /// Drops the full segments with ids below \c segment, including the
+    /// ones found when opening the log. They are recycled, or removed when
+    /// enough segments are kept for reuse.
+    future<> release_segments(uint64_t segment);
+
+    /// Waits for the pending appends and closes the log
+    future<> close();
+
+    const stats& get_stats() const noexcept;
+
+    /// Time from \ref append() to the record being durable, in microseconds
+    const metrics::internal::short_time_estimated_histogram& commit_latency() const noexcept;
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -232,10 +232,48 @@ class reclaimer {
     reclaimer_scope scope() const { return _scope; }
 };
 
+// Lets the owner of movable objects cooperate with defragment(): while a
+// defragmentation pass runs, the callback is expected to move the objects
+// for which should_relocate() returns true, by allocating a copy and freeing
+// the original, and to return the number of objects it moved. The copies are
+// placed in the densest spans of their size class, so that the sparse ones
+// empty and can be merged back into larger free ranges.
+class relocator {
+public:
+    using relocate_fn = std::function<size_t ()>;
+private:
+    relocate_fn _relocate;
+public:
+    explicit relocator(relocate_fn relocate);
+    ~relocator();
+    size_t do_relocate() { return _relocate(); }
+};
+
+// Returns true if \c ptr is a small object of the current shard which lives
+// in a sparsely used span, and so should be moved by its relocator. Always
+// false outside a defragmentation pass.
+bool should_relocate(const void* ptr) noexcept;
+
+// Returns the objects cached in the small object pools to their spans,
+// then runs the relocators. Spans which become unused are given back and
+// coalesced with their free neighbours, making room for large allocations.
+//
+// Returns the number of bytes given back to the page allocator.
+size_t defragment();
+
+// Gives the free memory of the current shard back to the kernel, in whole
+// huge pages. The memory stays reserved for the shard and is faulted back in
+// when allocated again; memory which is still backed is allocated first.
+//
+// Returns the number of bytes released by this call.
+size_t release_free_memory() noexcept;
+
 extern std::pmr::polymorphic_allocator<char>* malloc_allocator;
 
 // Call periodically to recycle objects that were freed
-// on cpu other than the one they were allocated on.
+// on cpu other than the one they were allocated on, and
+// to send back the objects of other cpus freed on this one,
+// which are queued up in batches.
 //
 // Returns @true if any work was actually performed.
 bool drain_cross_cpu_freelist();
@@ -250,6 +288,26 @@ bool drain_cross_cpu_freelist();
 void set_reclaim_hook(
         std::function<void (std::function<void ()>)> hook);
 
+namespace internal {
+
+// Memory charged to scheduling groups, by index. Allocations served directly
+// by the page allocator (larger than the biggest small pool size class) are
+// charged to the scheduling group current when they are made.
+size_t scheduling_group_memory_usage(unsigned sg_index) noexcept;
+size_t scheduling_group_memory_soft_limit(unsigned sg_index) noexcept;
+void set_scheduling_group_memory_soft_limit(unsigned sg_index, size_t limit) noexcept;
+// Calls \c func for each group whose usage went back under its soft limit
+// since the last call. Returns true if there was any.
+bool drain_scheduling_group_memory_events(const std::function<void (unsigned)>& func);
+
+// File descriptor of the hugetlbfs file backing the memory of the current
+// shard, or -1 when it's anonymous memory. The range of get_memory_layout()
+// is mapped from offset 0 of the file, so it can be shared with another
+// process, e.g. a vhost-user backend.
+int memory_backing_fd() noexcept;
+
+}
+
 /// \endcond
 
 SEASTAR_MODULE_EXPORT_BEGIN
@@ -348,6 +406,14 @@ struct memory_layout {
 // Supported only when seastar allocator is enabled.
 memory::memory_layout get_memory_layout();
 
+/// Returns whether accessing \c ptr from the current shard stays on its
+/// NUMA node.
+///
+/// False only when \c ptr was allocated by a shard whose memory is bound to
+/// another node than the memory of the current shard. Memory not allocated
+/// by seastar, or whose node isn't known, is assumed to be local.
+bool is_numa_local(const void* ptr) noexcept;
+
 /// Returns the size of free memory in bytes.
 size_t free_memory();
 
@@ -437,6 +503,23 @@ struct allocation_site {
     }
 };
 
+/// Memory held by one of the small object pools (size classes) of the
+/// current shard.
+struct small_pool_stats {
+    size_t object_size = 0; ///< size of the objects served by the pool
+    size_t span_size = 0; ///< preferred size of the spans the pool allocates, in bytes
+    size_t objects_in_use = 0; ///< number of live objects
+    size_t memory = 0; ///< bytes in spans owned by the pool
+    size_t unused = 0; ///< bytes of free objects in these spans, i.e. fragmentation
+};
+
+/// @brief Returns the state of each small object pool of this shard
+///
+/// Pools are ordered by increasing object size. Unlike \ref stats() this
+/// walks the pools' spans, so it is meant for diagnostics rather than
+/// frequent polling. Returns an empty vector with the default allocator.
+std::vector<small_pool_stats> get_small_pool_stats();
+
 /// @brief If memory sampling is on returns the current sampled memory live set
 ///
 /// If there is tracked allocations (because heap profiling was on earlier)
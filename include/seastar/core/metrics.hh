@@ -22,13 +22,17 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <array>
+#include <concepts>
 #include <functional>
 #include <limits>
 #include <map>
 #include <type_traits>
 #include <variant>
+#include <vector>
 #include <fmt/format.h>
 #endif
+#include <seastar/core/cacheline.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/metrics_registration.hh>
@@ -249,6 +253,110 @@ class label {
         return key;
     }
 };
+
+/*!
+ * \brief A monotonic counter to register with make_counter()
+ *
+ * Updating it is a plain increment, with no indirection. The metric
+ * refers to the counter, so it must outlive the registration and can't
+ * be copied or moved.
+ *
+ * \code
+ * metrics::counter _requests;
+ * _metrics.add_group("server", {sm::make_counter("requests", _requests, sm::description("Requests served"))});
+ * ...
+ * ++_requests;
+ * \endcode
+ */
+class counter {
+    uint64_t _value = 0;
+public:
+    using metric_value_tag = void;
+    counter() noexcept = default;
+    counter(const counter&) = delete;
+    counter& operator=(const counter&) = delete;
+    void inc(uint64_t n = 1) noexcept {
+        _value += n;
+    }
+    counter& operator++() noexcept {
+        ++_value;
+        return *this;
+    }
+    counter& operator+=(uint64_t n) noexcept {
+        _value += n;
+        return *this;
+    }
+    uint64_t value() const noexcept {
+        return _value;
+    }
+};
+
+/*!
+ * \brief A value that can go up and down, to register with make_gauge()
+ *
+ * Same as \ref counter, it must outlive the registration.
+ */
+class gauge {
+    double _value = 0;
+public:
+    using metric_value_tag = void;
+    gauge() noexcept = default;
+    gauge(const gauge&) = delete;
+    gauge& operator=(const gauge&) = delete;
+    void set(double v) noexcept {
+        _value = v;
+    }
+    void inc(double n = 1) noexcept {
+        _value += n;
+    }
+    void dec(double n = 1) noexcept {
+        _value -= n;
+    }
+    double value() const noexcept {
+        return _value;
+    }
+};
+
+/*!
+ * \brief Counters of the values of an enum, to register with make_counters()
+ *
+ * The enum values stand for the values of a label, which are bound at
+ * compile time instead of looked up on update. The counters are laid out
+ * contiguously and start on a cache line of their own, so that a hot path
+ * updating several of them touches as few lines as possible, and so that
+ * scraping reads them in one pass.
+ *
+ * \code
+ * enum class op { read, write, count };
+ * metrics::counter_array<op> _ops;
+ * _metrics.add_group("server", sm::make_counters("ops", _ops, sm::description("Operations"),
+ *         sm::label("op"), {"read", "write"}));
+ * ...
+ * _ops.inc(op::read);
+ * \endcode
+ */
+template <typename Enum, size_t N = size_t(Enum::count)>
+requires std::is_enum_v<Enum>
+class alignas(cache_line_size) counter_array {
+    std::array<uint64_t, N> _values{};
+public:
+    counter_array() noexcept = default;
+    counter_array(const counter_array&) = delete;
+    counter_array& operator=(const counter_array&) = delete;
+    static constexpr size_t size() noexcept {
+        return N;
+    }
+    void inc(Enum e, uint64_t n = 1) noexcept {
+        _values[size_t(e)] += n;
+    }
+    uint64_t value(Enum e) const noexcept {
+        return _values[size_t(e)];
+    }
+    const std::array<uint64_t, N>& values() const noexcept {
+        return _values;
+    }
+};
+
 SEASTAR_MODULE_EXPORT_END
 
 /*!
@@ -279,6 +387,18 @@ struct real_counter_type_traits<true, T> {
     using type = std::invoke_result_t<T>;
 };
 
+// counter, gauge and the like
+template <typename T>
+concept bound_value = requires (const T& v) {
+    typename T::metric_value_tag;
+    { v.value() } -> std::convertible_to<double>;
+};
+
+template <bound_value T>
+struct real_counter_type_traits<false, T> {
+    using type = decltype(std::declval<const T&>().value());
+};
+
 template <typename T>
 struct counter_type_traits {
     using real_traits = real_counter_type_traits<std::is_invocable_v<T>, T>;
@@ -415,12 +535,19 @@ metric_function make_function(T val, data_type dt) {
     };
 }
 
-template<typename T, typename = std::enable_if_t<!std::is_invocable_v<T>>>
+template<typename T, typename = std::enable_if_t<!std::is_invocable_v<T> && !bound_value<std::remove_const_t<T>>>>
 metric_function make_function(T& val, data_type dt) {
     return [dt, &val] {
         return metric_value(val, dt);
     };
 }
+
+template<bound_value T>
+metric_function make_function(const T& val, data_type dt) {
+    return [dt, &val] {
+        return metric_value(val.value(), dt);
+    };
+}
 }
 
 extern const bool metric_disabled;
@@ -678,6 +805,28 @@ impl::metric_definition_impl make_total_operations(metric_name_type name,
     return make_counter(name, std::forward<T>(val), d, labels).set_type("total_operations");
 }
 
+/*!
+ * \brief create a counter metric for each value of a \ref counter_array
+ *
+ * Each counter is labeled with \p l, whose value for counter \c i is \p label_values[i].
+ * The result is passed to metric_groups::add_group().
+ */
+template<typename Enum, size_t N>
+std::vector<metric_definition> make_counters(metric_name_type name,
+        const counter_array<Enum, N>& counters, description d, const label& l,
+        const std::array<sstring, N>& label_values, std::vector<label_instance> labels = {}) {
+    std::vector<metric_definition> ret;
+    ret.reserve(N);
+    for (size_t i = 0; i < N; ++i) {
+        auto instance_labels = labels;
+        instance_labels.push_back(l(label_values[i]));
+        const uint64_t& value = counters.values()[i];
+        ret.emplace_back(impl::metric_definition_impl(name, {impl::data_type::COUNTER, "counter"},
+                impl::make_function(value, impl::data_type::COUNTER), d, std::move(instance_labels)));
+    }
+    return ret;
+}
+
 /*! @} */
 }
 }
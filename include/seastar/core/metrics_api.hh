@@ -327,6 +327,19 @@ using value_map = std::map<sstring, metric_family>;
 
 using metric_metadata_fifo = std::deque<metric_info>;
 
+/*!
+ * \brief pre-rendered text exposition of the metrics of a family
+ *
+ * Holds the "name{labels} " prefix of each metric, in the order of
+ * metric_family_metadata::metrics, so that a scrape only has to format
+ * the values. The key identifies the prefix and extra label it was
+ * rendered with.
+ */
+struct rendered_metric_names {
+    sstring key;
+    std::vector<sstring> names;
+};
+
 /*!
  * \brief holds a metric family metadata
  *
@@ -342,6 +355,8 @@ using metric_metadata_fifo = std::deque<metric_info>;
 struct metric_family_metadata {
     metric_family_info mf;
     metric_metadata_fifo metrics;
+    // Filled on the first text scrape, dropped with the metadata
+    lw_shared_ptr<const rendered_metric_names> rendered_names = {};
 };
 
 using value_vector = std::deque<metric_value>;
@@ -57,6 +57,10 @@ struct native_histogram_info {
     int32_t schema;
     // min_id is the first bucket id of a given schema.
     int32_t min_id;
+    // Number of values in the zero bucket, [-zero_threshold, zero_threshold].
+    // They are included in the cumulative count of every bucket.
+    uint64_t zero_count = 0;
+    double zero_threshold = 0;
 };
 
 /*!
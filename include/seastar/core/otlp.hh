@@ -0,0 +1,122 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <tuple>
+#endif
+#include <seastar/core/abort_source.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/metrics_api.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/socket_defs.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace tls { class certificate_credentials; }
+namespace http::experimental { class client; }
+
+namespace otlp {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/*!
+ * Holds the OTLP exporter configuration
+ */
+struct config {
+    socket_address endpoint; //!< Address of the OTLP/HTTP collector
+    sstring host; //!< Host header, defaults to the address of the endpoint
+    sstring path = "/v1/metrics"; //!< Path the metrics are posted to
+    shared_ptr<tls::certificate_credentials> credentials; //!< When set, the collector is reached over https
+    std::chrono::milliseconds interval = std::chrono::seconds(10); //!< Time between pushes
+    sstring prefix = "seastar"; //!< A prefix that will be added to metric names
+    std::map<sstring, sstring> resource_attributes; //!< Attributes of the pushed resource, e.g. service.name
+    bool delta = true; //!< Push counters and histograms with delta temporality, cumulative otherwise
+    bool aggregate_shards = true; //!< Sum the values of all shards, dropping the shard label
+    bool compress = true; //!< gzip the payload
+};
+
+/*!
+ * \brief Pushes metrics to an OpenTelemetry collector over OTLP/HTTP
+ *
+ * The exporter runs on the shard it is started on. Every interval it
+ * collects the values of all shards, aggregates them over the shard label
+ * and the aggregate labels of each metric family, and posts them as a
+ * protobuf encoded ExportMetricsServiceRequest.
+ *
+ * With delta temporality, counters and histograms are reported as the
+ * change since the last successful push, so a failed push is covered by
+ * the next one. Gauges and summaries are always reported as they are.
+ */
+class exporter {
+    struct series_key {
+        sstring family;
+        metrics::impl::labels_type labels;
+        bool operator<(const series_key& o) const {
+            return std::tie(family, labels) < std::tie(o.family, o.labels);
+        }
+    };
+    config _cfg;
+    std::unique_ptr<http::experimental::client> _client;
+    std::map<series_key, metrics::impl::metric_value> _last;
+    std::chrono::system_clock::time_point _start;
+    std::chrono::system_clock::time_point _last_push;
+    abort_source _as;
+    std::optional<future<>> _loop;
+public:
+    explicit exporter(config cfg);
+    ~exporter();
+    exporter(const exporter&) = delete;
+
+    /// Starts pushing every \ref config::interval
+    future<> start();
+    /// Stops pushing, waits for a push in progress
+    future<> stop();
+    /// Pushes the current values now
+    future<> push();
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+namespace internal {
+
+// The change of a histogram since prev, or the histogram itself if it was
+// reset, e.g. by re-registering the metric
+metrics::histogram histogram_delta(const metrics::histogram& cur, const metrics::histogram& prev);
+// The change of a counter since prev, or the counter itself if it was reset
+double counter_delta(double cur, double prev);
+// cur as reported with delta temporality, given the value of the series at
+// the last push. Series that are new, or whose type changed, are reported
+// as they are, and so are gauges and summaries.
+metrics::impl::metric_value to_delta(const metrics::impl::metric_value& cur, const metrics::impl::metric_value* prev);
+
+}
+
+}
+
+}
@@ -254,6 +254,15 @@ class file_desc {
         throw_system_error_on(r == -1, "recvmsg");
         return { size_t(r) };
     }
+    // Returns the number of messages received
+    std::optional<size_t> recvmmsg(mmsghdr* msgs, unsigned n, int flags) {
+        auto r = ::recvmmsg(_fd, msgs, n, flags, nullptr);
+        if (r == -1 && errno == EAGAIN) {
+            return {};
+        }
+        throw_system_error_on(r == -1, "recvmmsg");
+        return { size_t(r) };
+    }
     std::optional<size_t> send(const void* buffer, size_t len, int flags) {
         auto r = ::send(_fd, buffer, len, flags);
         if (r == -1 && errno == EAGAIN) {
@@ -278,6 +287,15 @@ class file_desc {
         throw_system_error_on(r == -1, "sendmsg");
         return { size_t(r) };
     }
+    // Returns the number of messages sent
+    std::optional<size_t> sendmmsg(mmsghdr* msgs, unsigned n, int flags) {
+        auto r = ::sendmmsg(_fd, msgs, n, flags);
+        if (r == -1 && errno == EAGAIN) {
+            return {};
+        }
+        throw_system_error_on(r == -1, "sendmmsg");
+        return { size_t(r) };
+    }
     void bind(sockaddr& sa, socklen_t sl) {
         auto r = ::bind(_fd, &sa, sl);
         throw_system_error_on(r == -1, "bind");
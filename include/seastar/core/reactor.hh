@@ -43,6 +43,8 @@
 #include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor_config.hh>
+#include <seastar/core/resource_limits.hh>
+#include <seastar/core/steal_time.hh>
 #include <seastar/core/scattered_message.hh>
 #include <seastar/core/scheduling.hh>
 #include <seastar/core/scheduling_specific.hh>
@@ -72,6 +74,8 @@
 #include <chrono>
 #include <cstring>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
@@ -128,11 +132,17 @@ class reactor_backend_selector;
 class reactor_backend;
 struct pollfn;
 
+template <typename T>
+struct syscall_result;
+
 namespace internal {
 
 class reactor_stall_sampler;
 class cpu_stall_detector;
 class buffer_allocator;
+class zerocopy_send_state;
+template <typename Clock>
+class deadline_queue;
 class priority_class;
 class poller;
 
@@ -140,6 +150,12 @@ size_t scheduling_group_count();
 
 void increase_thrown_exceptions_counter() noexcept;
 
+// Charge socket I/O to the current scheduling group, see
+// scheduling_group::set_network_bandwidth_limit(). The returned future is
+// ready unless the group is over its limit.
+future<> charge_network_send(size_t bytes) noexcept;
+future<> charge_network_receive(size_t bytes) noexcept;
+
 }
 
 class kernel_completion;
@@ -158,8 +174,10 @@ class io_completion : public kernel_completion {
 SEASTAR_MODULE_EXPORT
 class reactor {
 private:
+    struct sched_entity;
     struct task_queue;
-    using task_queue_list = circular_buffer_fixed_capacity<task_queue*, 1 << log2ceil(max_scheduling_groups())>;
+    struct task_queue_group;
+    using task_queue_list = circular_buffer_fixed_capacity<sched_entity*, 1 << log2ceil(max_scheduling_groups())>;
     using pollfn = seastar::pollfn;
 
     class signal_pollfn;
@@ -174,11 +192,19 @@ class reactor {
     class io_queue_submission_pollfn;
     class syscall_pollfn;
     class execution_stage_pollfn;
+    class work_stealing_pollfn;
+    class memory_soft_limit_pollfn;
+    class rcu_pollfn;
     friend class manual_clock;
     friend class file_data_source_impl; // for fstream statistics
     friend class internal::reactor_stall_sampler;
+    friend class resource_limits_subscription;
+    friend const resource_limits& current_resource_limits() noexcept;
+    friend class steal_time_subscription;
+    friend const steal_time_sample& last_steal_time_sample() noexcept;
     friend class preempt_io_context;
     friend struct hrtimer_aio_completion;
+    friend class reactor_backend;
     friend class reactor_backend_epoll;
     friend class reactor_backend_aio;
     friend class reactor_backend_uring;
@@ -236,7 +262,22 @@ class reactor {
     std::unique_ptr<reactor_backend> _backend;
 #endif
     sigset_t _active_sigmask; // holds sigmask while sleeping with sig disabled
-    std::vector<pollfn*> _pollers;
+    // A registered poller, and when to poll it next with --poller-max-deferral-us
+    struct registered_poller {
+        static constexpr unsigned max_backoff = 63;
+        pollfn* fn;
+        // Polls left to skip, and polls to skip after the next miss
+        unsigned skip = 0;
+        unsigned backoff = 0;
+        // Skipped in the current poll_once()
+        bool deferred = false;
+        lowres_clock::time_point last_poll{};
+    };
+    std::vector<registered_poller> _pollers;
+    std::chrono::nanoseconds _poller_max_deferral{0};
+    uint64_t _poller_calls = 0;
+    uint64_t _poller_hits = 0;
+    uint64_t _poller_deferrals = 0;
 
     static constexpr unsigned max_aio_per_queue = 128;
     static constexpr unsigned max_queues = 8;
@@ -246,7 +287,6 @@ class reactor {
     std::unordered_map<dev_t, std::unique_ptr<io_queue>> _io_queues;
     // ... when dispatched all requests get into this single sink
     internal::io_sink _io_sink;
-    unsigned _num_io_groups = 0;
 
     std::vector<noncopyable_function<future<> ()>> _exit_funcs;
     unsigned _id = 0;
@@ -266,22 +306,74 @@ class reactor {
     std::unique_ptr<internal::cpu_stall_detector> _cpu_stall_detector;
 
     unsigned _max_task_backlog = 1000;
+    unsigned _queueing_delay_sample_rate = 0;
+    bool _sched_cpu_accounting = false;
+    struct cpu_usage {
+        sched_clock::duration user;
+        sched_clock::duration system;
+        uint64_t involuntary_context_switches;
+    };
+    cpu_usage _cpu_usage_mark = {};
+    // Work from smp::submit_stealable(), and the shards on our NUMA node
+    // allowed to take it over (empty unless --work-stealing is on).
+    internal::stealable_work_queue _stealable_work;
+    std::vector<reactor*> _work_stealing_siblings;
+    // Waiting on scheduling_group::wait_for_memory()
+    std::array<std::vector<promise<>>, max_scheduling_groups()> _memory_soft_limit_waiters;
     timer_set<timer<>, &timer<>::_link> _timers;
     timer_set<timer<>, &timer<>::_link>::timer_list_t _expired_timers;
-    timer_set<timer<lowres_clock>, &timer<lowres_clock>::_link> _lowres_timers;
-    timer_set<timer<lowres_clock>, &timer<lowres_clock>::_link>::timer_list_t _expired_lowres_timers;
+    timer_wheel<timer<lowres_clock>, &timer<lowres_clock>::_link, &timer<lowres_clock>::_wheel_slot> _lowres_timers;
+    timer_wheel<timer<lowres_clock>, &timer<lowres_clock>::_link, &timer<lowres_clock>::_wheel_slot>::timer_list_t _expired_lowres_timers;
     timer_set<timer<manual_clock>, &timer<manual_clock>::_link> _manual_timers;
     timer_set<timer<manual_clock>, &timer<manual_clock>::_link>::timer_list_t _expired_manual_timers;
+    // Shared timeouts, see internal::deadline_queue
+    std::unique_ptr<internal::deadline_queue<steady_clock_type>> _steady_deadlines;
+    std::unique_ptr<internal::deadline_queue<lowres_clock>> _lowres_deadlines;
+    std::unique_ptr<internal::deadline_queue<manual_clock>> _manual_deadlines;
     io_stats _io_stats;
     uint64_t _fsyncs = 0;
     uint64_t _cxx_exceptions = 0;
     uint64_t _abandoned_failed_futures = 0;
-    struct task_queue {
-        explicit task_queue(unsigned id, sstring name, sstring shortname, float shares);
+    // Period over which CPU limits are enforced
+    static constexpr sched_clock::duration cpu_limit_period = std::chrono::milliseconds(20);
+    // What the scheduler picks from by vruntime: a task queue, or a group of
+    // them created by a scheduling_supergroup
+    struct sched_entity {
+        explicit sched_entity(float shares, task_queue_group* parent, bool is_group);
         int64_t _vruntime = 0;
         float _shares;
         int64_t _reciprocal_shares_times_2_power_32;
         bool _active = false;
+        const bool _is_group;
+        task_queue_group* _parent;
+        // CPU limit: runtime allowed per cpu_limit_period, and the runtime
+        // charged in the period _period
+        float _cpu_limit = 1;
+        sched_clock::duration _cpu_quota = sched_clock::duration::max();
+        sched_clock::duration _period_runtime = {};
+        uint64_t _period = 0;
+        bool _throttled = false;
+        int64_t to_vruntime(sched_clock::duration runtime) const;
+        void set_shares(float shares) noexcept;
+        void set_cpu_limit(float fraction) noexcept;
+        // Charges runtime to the CPU limit, returns whether it is exhausted
+        bool charge_cpu_limit(sched_clock::duration runtime, sched_clock::time_point now) noexcept;
+        struct indirect_compare;
+    };
+    struct task_queue_group : sched_entity {
+        explicit task_queue_group(unsigned id, sstring name, float shares);
+        uint8_t _id;
+        sstring _name;
+        unsigned _nr_task_queues = 0;
+        int64_t _last_vruntime = 0;
+        task_queue_list _active_task_queues;
+        task_queue_list _activating_task_queues;
+        bool has_more_tasks() const noexcept {
+            return _active_task_queues.size() + _activating_task_queues.size();
+        }
+    };
+    struct task_queue : sched_entity {
+        explicit task_queue(unsigned id, sstring name, sstring shortname, float shares, task_queue_group* parent = nullptr);
         uint8_t _id;
         sched_clock::time_point _ts; // to help calculating wait/starve-times
         sched_clock::duration _runtime = {};
@@ -294,12 +386,55 @@ class reactor {
         // chars are used.
         static constexpr size_t shortname_size = 4;
         sstring _shortname;
-        int64_t to_vruntime(sched_clock::duration runtime) const;
-        void set_shares(float shares) noexcept;
-        struct indirect_compare;
         sched_clock::duration _time_spent_on_task_quota_violations = {};
+        sched_clock::time_point _throttled_since;
+        sched_clock::duration _throttled_time = {};
+        // Latency-critical queues are run earliest _due first, ahead of the
+        // others, for up to _deadline_quota per cpu_limit_period
+        sched_clock::duration _deadline = sched_clock::duration::max();
+        sched_clock::duration _deadline_quota = {};
+        sched_clock::duration _deadline_runtime = {};
+        uint64_t _deadline_period = 0;
+        sched_clock::time_point _due;
+        uint64_t _deadline_misses = 0;
+        bool within_deadline_budget(sched_clock::time_point now) noexcept;
+        // Split of _runtime, with --sched-cpu-accounting
+        sched_clock::duration _cpu_user_time = {};
+        sched_clock::duration _cpu_system_time = {};
+        sched_clock::duration _steal_time = {};
+        uint64_t _involuntary_context_switches = 0;
+        // Socket I/O charged to the group, and its bandwidth limit
+        struct network_direction {
+            uint64_t bytes = 0;
+            uint64_t calls = 0;
+            uint64_t limit = 0; // bytes per second, 0 when unlimited
+            std::chrono::steady_clock::time_point next; // when the charged bytes are paid for
+            std::chrono::steady_clock::duration throttled = {};
+            future<> charge(size_t n) noexcept;
+        };
+        network_direction _net_send;
+        network_direction _net_receive;
+        // Queueing delay sampling: a single task at a time is timestamped
+        // when queued, and accounted for when it is run.
+        const task* _sampled_task = nullptr;
+        sched_clock::time_point _sampled_task_queued;
+        unsigned _tasks_until_sample = 0;
+        metrics::internal::short_time_estimated_histogram _queueing_delay;
         seastar::metrics::metric_groups _metrics;
         void rename(sstring new_name, sstring new_shortname);
+        void maybe_sample(const task* t, unsigned sample_rate) noexcept {
+            if (!_sampled_task && _tasks_until_sample-- == 0) {
+                _sampled_task = t;
+                _sampled_task_queued = sched_clock::now();
+                _tasks_until_sample = sample_rate - 1;
+            }
+        }
+        void on_run(const task* t) noexcept {
+            if (__builtin_expect(t == _sampled_task, false)) {
+                _queueing_delay.add(sched_clock::now() - _sampled_task_queued);
+                _sampled_task = nullptr;
+            }
+        }
     private:
         void register_stats();
     };
@@ -309,8 +444,20 @@ class reactor {
     int64_t _last_vruntime = 0;
     task_queue_list _active_task_queues;
     task_queue_list _activating_task_queues;
+    task_queue_list _deadline_task_queues;
+    boost::container::static_vector<std::unique_ptr<task_queue_group>, max_scheduling_groups()> _task_queue_groups;
+    // Entities over their CPU limit, released at the next period
+    boost::container::static_vector<sched_entity*, 2 * max_scheduling_groups()> _throttled_entities;
+    timer<> _cpu_limit_timer;
     task_queue* _at_destroy_tasks;
     sched_clock::duration _task_quota;
+    // Adaptive task quota, see --max-task-quota-ms: the quota grows towards
+    // _max_task_quota while tasks are CPU bound, and goes back to _task_quota
+    // when latency matters
+    sched_clock::duration _max_task_quota;
+    sched_clock::duration _current_task_quota;
+    unsigned _cpu_bound_runs = 0;
+    bool _ran_latency_critical = false;
     task* _current_task = nullptr;
     /// Handler that will be called when there is no task to execute on cpu.
     /// It represents a low priority work.
@@ -325,12 +472,48 @@ class reactor {
     lowres_clock::time_point _lowres_next_timeout = lowres_clock::time_point::max();
     std::optional<pollable_fd> _aio_eventfd;
     const bool _reuseport;
+    bool _busy_poll_warned = false;
     circular_buffer<double> _loads;
     double _load = 0;
     sched_clock::duration _total_idle{0};
     sched_clock::duration _total_sleep;
     sched_clock::time_point _start_time = now();
     std::chrono::nanoseconds _max_poll_time = calculate_poll_time();
+    // With --adaptive-idle-poll: average time from going idle to having
+    // work, and the polling time derived from it
+    bool _adaptive_idle_poll = false;
+    std::chrono::nanoseconds _idle_gap_estimate{0};
+    std::chrono::nanoseconds _adaptive_poll_time = _max_poll_time;
+    std::chrono::milliseconds _memory_defragment_interval{0};
+    sched_clock::time_point _last_memory_defragment = _start_time;
+    std::chrono::milliseconds _memory_release_interval{0};
+    sched_clock::time_point _last_memory_release = _start_time;
+    // With --cgroup-poll-interval-ms: the cgroup limits and how the shard
+    // adapts to them. Under a CPU quota, the shard pauses once it was busy
+    // for its share of the quota in a window of cpu_quota_window.
+    static constexpr sched_clock::duration cpu_quota_window = std::chrono::milliseconds(20);
+    std::chrono::milliseconds _cgroup_poll_interval{0};
+    timer<lowres_clock> _cgroup_poll_timer;
+    resource_limits _resource_limits;
+    boost::intrusive::list<resource_limits_subscription, boost::intrusive::constant_time_size<false>> _resource_limits_subscriptions;
+    std::optional<size_t> _initial_memory_limit;
+    size_t _default_min_free_memory = 0;
+    double _cpu_quota_fraction = 1;
+    sched_clock::time_point _cpu_quota_window_start;
+    sched_clock::duration _cpu_quota_window_idle{0};
+    uint64_t _cpu_quota_pauses = 0;
+    // With --steal-time-sample-interval-ms: the last sample, and the
+    // counters it was computed from
+    std::chrono::milliseconds _steal_time_sample_interval{0};
+    timer<lowres_clock> _steal_time_sample_timer;
+    steal_time_sample _last_steal_time_sample;
+    sched_clock::time_point _steal_time_sample_time;
+    sched_clock::duration _total_runqueue_wait{0};
+    uint64_t _total_involuntary_switches = 0;
+    std::optional<uint64_t> _cpu_steal_ticks;
+    int _steal_time_cpu = -1;
+    sched_clock::duration _total_hypervisor_steal{0};
+    boost::intrusive::list<steal_time_subscription, boost::intrusive::constant_time_size<false>> _steal_time_subscriptions;
     output_stream<char>::batch_flush_list_t _flush_batching;
     std::atomic<bool> _sleeping alignas(seastar::cache_line_size){0};
     pthread_t _thread_id alignas(seastar::cache_line_size) = pthread_self();
@@ -346,6 +529,7 @@ class reactor {
     static std::chrono::nanoseconds calculate_poll_time();
     static void block_notifier(int);
     bool flush_pending_aio();
+    void wake_memory_soft_limit_waiters(unsigned sg_index) noexcept;
     steady_clock_type::time_point next_pending_aio() const noexcept;
     bool reap_kernel_completions();
     bool flush_tcp_batches();
@@ -365,6 +549,7 @@ class reactor {
      *         execution.
      */
     bool poll_once();
+    bool poll(registered_poller& p, lowres_clock::time_point now);
     bool pure_poll_once();
 public:
     /// Register a user-defined signal handler
@@ -404,14 +589,30 @@ class reactor {
     bool posix_reuseport_detect();
     void run_some_tasks();
     void activate(task_queue& tq);
-    void insert_active_task_queue(task_queue* tq);
-    task_queue* pop_active_task_queue(sched_clock::time_point now);
-    void insert_activating_task_queues();
+    void activate(task_queue_group& g);
+    void make_runnable(sched_entity& e, sched_clock::time_point now);
+    void throttle(sched_entity& e, sched_clock::time_point now);
+    void unthrottle_entities() noexcept;
+    static void insert_active_task_queue(task_queue_list& atq, sched_entity* e);
+    static sched_entity* pop_active_task_queue(task_queue_list& atq);
+    static void insert_activating_task_queues(task_queue_list& atq, task_queue_list& activating);
+    void insert_deadline_task_queue(task_queue& tq, sched_clock::time_point now);
     void account_runtime(task_queue& tq, sched_clock::duration runtime);
+    void adapt_task_quota(bool preempted) noexcept;
+    bool io_in_flight() const noexcept;
+    void mark_cpu_usage() noexcept;
+    void account_cpu_usage(task_queue& tq, sched_clock::duration runtime) noexcept;
     void account_idle(sched_clock::duration idletime);
+    void idle_relax(sched_clock::duration idletime) noexcept;
+    void poll_cgroup_limits();
+    void set_resource_limits(const resource_limits& limits) noexcept;
+    void pace_to_cpu_quota() noexcept;
+    void sample_steal_time();
     void allocate_scheduling_group_specific_data(scheduling_group sg, scheduling_group_key key);
     future<> rename_scheduling_group_specific_data(scheduling_group sg);
-    future<> init_scheduling_group(scheduling_group sg, sstring name, sstring shortname, float shares);
+    future<> init_scheduling_group(scheduling_group sg, sstring name, sstring shortname, float shares, scheduling_supergroup parent);
+    void init_scheduling_supergroup(scheduling_supergroup sg, sstring name, float shares);
+    void destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept;
     future<> init_new_scheduling_group_key(scheduling_group_key key, scheduling_group_key_config cfg);
     future<> destroy_scheduling_group(scheduling_group sg) noexcept;
     uint64_t tasks_processed() const;
@@ -436,6 +637,10 @@ class reactor {
     do_send(pollable_fd_state& fd, const void* buffer, size_t size);
     future<size_t>
     do_sendmsg(pollable_fd_state& fd, net::packet& p);
+    future<size_t>
+    do_sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p, internal::zerocopy_send_state& zc);
+    future<> do_wait_zerocopy_sends(pollable_fd_state& fd, internal::zerocopy_send_state& zc);
+    void reap_zerocopy_completions(pollable_fd_state& fd, internal::zerocopy_send_state& zc);
 
     future<temporary_buffer<char>>
     do_recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba);
@@ -476,6 +681,7 @@ class reactor {
 
     /// @private
     future<> update_bandwidth_for_queues(internal::priority_class pc, uint64_t bandwidth);
+    future<> update_limits_for_queues(internal::priority_class pc, io_limits limits);
     /// @private
     void rename_queues(internal::priority_class pc, sstring new_name);
     /// @private
@@ -494,6 +700,10 @@ class reactor {
 
     pollable_fd make_pollable_fd(socket_address sa, int proto);
 
+    /// @private
+    /// Applies the configured network busy polling to a socket
+    void set_busy_poll(file_desc& fd);
+
     future<> posix_connect(pollable_fd pfd, socket_address sa, socket_address local);
 
     future<> send_all(pollable_fd_state& fd, const void* buffer, size_t size);
@@ -619,6 +829,31 @@ class reactor {
     future<> send_all_part(pollable_fd_state& fd, const void* buffer, size_t size, size_t completed);
 
     future<> fdatasync(int fd) noexcept;
+    // Called by posix_file_impl for every file descriptor that may be used
+    // for disk I/O, and before it is closed. Lets the backend keep kernel-side
+    // state (e.g. io_uring fixed files) for the descriptor.
+    void register_file(int fd) noexcept;
+    void unregister_file(int fd) noexcept;
+    // Whether writes can carry the following fdatasync along
+    // (io_request::set_fdatasync_after()), see file::dma_write_and_flush()
+    bool can_link_fdatasync() const noexcept;
+    // Whether file metadata operations can go through submit_metadata_op()
+    // instead of the syscall thread pool
+    bool have_async_metadata_ops() const noexcept;
+    // Asks the kernel to stop an I/O request it's running, if the backend
+    // can. The request still completes through desc, with -ECANCELED or
+    // its result.
+    void cancel_io(io_completion* desc) noexcept;
+    // Whether NVMe passthrough commands (io_request::make_nvme_cmd()) can be
+    // submitted, sets up the backend for them on first call
+    bool enable_nvme_passthrough() noexcept;
+    // Runs an openat, statx, renameat, unlinkat or fallocate request in the
+    // kernel, bypassing the I/O queues. The memory the request points to must
+    // be kept alive until the returned future resolves.
+    future<syscall_result<int>> submit_metadata_op(internal::io_request req) noexcept;
+    // Looks up the entries names of the directory dirfd, not following
+    // symbolic links, into out. Entries which don't exist are left disengaged.
+    future<> stat_directory_entries(int dirfd, std::span<const char* const> names, std::span<std::optional<stat_data>> out) noexcept;
 
     void add_timer(timer<steady_clock_type>*) noexcept;
     bool queue_timer(timer<steady_clock_type>*) noexcept;
@@ -637,18 +872,28 @@ class reactor {
     friend class pollable_fd_state;
     friend class posix_file_impl;
     friend class blockdev_file_impl;
+    friend class nvme_passthrough_file_impl;
+    friend class posix_buffered_file_impl;
     friend class timer<>;
     friend class timer<lowres_clock>;
     friend class timer<manual_clock>;
+    template <typename Clock>
+    friend class internal::deadline_queue;
     friend class smp;
     friend class smp_message_queue;
     friend class internal::poller;
     friend class scheduling_group;
+    friend class scheduling_supergroup;
     friend void internal::add_to_flush_poller(output_stream<char>& os) noexcept;
     friend void seastar::internal::increase_thrown_exceptions_counter() noexcept;
+    friend future<> internal::charge_network_send(size_t bytes) noexcept;
+    friend future<> internal::charge_network_receive(size_t bytes) noexcept;
+    friend void internal::submit_stealable_work(internal::stealable_work& w);
     friend void report_failed_future(const std::exception_ptr& eptr) noexcept;
     metrics::metric_groups _metric_groups;
-    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
+    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept;
+    friend future<scheduling_supergroup> create_scheduling_supergroup(sstring name, float shares) noexcept;
+    friend future<> seastar::destroy_scheduling_supergroup(scheduling_supergroup) noexcept;
     friend future<> seastar::destroy_scheduling_group(scheduling_group) noexcept;
     friend future<> seastar::rename_scheduling_group(scheduling_group sg, sstring new_name, sstring new_shortname) noexcept;
     friend future<scheduling_group_key> scheduling_group_key_create(scheduling_group_key_config cfg) noexcept;
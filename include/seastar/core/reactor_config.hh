@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <seastar/core/resource.hh>
 #include <seastar/util/program-options.hh>
 #include <seastar/util/memory_diagnostics.hh>
 #include <seastar/util/modules.hh>
@@ -31,6 +32,14 @@ namespace seastar {
 struct reactor_config {
     bool auto_handle_sigint_sigterm = true;
     unsigned max_networking_aio_io_control_blocks = 10000;
+    bool io_uring_fixed_io = false;
+    bool io_uring_multishot = false;
+    bool io_uring_sqpoll = false;
+    resource::cpuset io_uring_sqpoll_cpuset;
+    bool io_uring_iopoll = false;
+    unsigned syscall_threads = 1;
+    unsigned net_busy_poll_us = 0;
+    unsigned net_busy_poll_budget = 0;
 };
 /// \endcond
 
@@ -54,6 +63,23 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Reduce for overprovisioned environments or laptops.
     program_options::value<unsigned> idle_poll_time_us;
+    /// \brief Adapt the idle polling time to how soon work arrives.
+    ///
+    /// The reactor polls for up to twice the average time work takes to
+    /// arrive once it is idle, within \ref idle_poll_time_us, and sleeps
+    /// right away when work usually comes later than that. Past the first
+    /// microseconds, it waits between polls in a light power saving state
+    /// (\c tpause) on CPUs which support it, instead of spinning.
+    program_options::value<bool> adaptive_idle_poll;
+    /// \brief Max time (us) a poller that keeps finding no work may be skipped.
+    ///
+    /// Pollers which found no work on their last polls are polled on fewer
+    /// and fewer iterations of the reactor loop, while work keeps coming
+    /// from elsewhere, but never go unpolled for longer than this. All are
+    /// polled before the reactor goes idle.
+    ///
+    /// Default: 0 (poll every poller on every iteration).
+    program_options::value<unsigned> poller_max_deferral_us;
     /// \brief Busy-poll for disk I/O.
     ///
     /// Reduces latency and increases throughput.
@@ -62,6 +88,23 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 0.5.
     program_options::value<double> task_quota_ms;
+    /// \brief Max time (ms) between polls, for the adaptive task quota.
+    ///
+    /// When set above task_quota_ms, the task quota grows up to this value
+    /// while the reactor runs CPU bound tasks only, to reduce the polling
+    /// and preemption overhead, and goes back to task_quota_ms as soon as
+    /// latency-critical scheduling groups run or I/O is in flight.
+    ///
+    /// Default: task_quota_ms value (the quota doesn't adapt).
+    program_options::value<double> max_task_quota_ms;
+    /// \brief Resolution (ms) of the timer wheel holding lowres_clock timers.
+    ///
+    /// Timers based on lowres_clock expire up to this much after their
+    /// timeout. A coarse resolution, e.g. 10ms, makes large numbers of
+    /// timeouts which are mostly cancelled or re-armed cheaper.
+    ///
+    /// Default: 0.1.
+    program_options::value<double> lowres_timer_resolution_ms;
     /// \brief Max time (ms) IO operations must take.
     ///
     /// Default: 1.5 * task_quota_ms value
@@ -74,12 +117,134 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 1.1
     program_options::value<double> io_flow_ratio_threshold;
+    /// \brief Time (us) worth of I/O capacity a shard grabs at once.
+    ///
+    /// Shards lease that much capacity from their I/O group and dispatch
+    /// requests from it locally, which reduces contention on the group when
+    /// many shards share it. Unused leases are given back when the shard's
+    /// queue runs dry. Capped at the shard's per-tick share of the group.
+    ///
+    /// Default: 0 (grab capacity per request).
+    program_options::value<unsigned> io_capacity_lease_us;
+    /// \brief Adjust the disk capacity to the observed device latency.
+    ///
+    /// Instead of relying on the rates from io-properties alone, scale them
+    /// down when requests take longer than \ref io_latency_goal_ms on the
+    /// device and back up (up to twice the configured rates) when they are
+    /// well within it. Meant for devices whose performance changes over
+    /// time, like throttled cloud disks.
+    ///
+    /// Default: false.
+    program_options::value<bool> io_adaptive_rate;
+    /// \brief Merge adjacent reads into one I/O.
+    ///
+    /// Reads of adjacent ranges of the same file dispatched in the same poll
+    /// are submitted as a single vectored read into the callers' buffers,
+    /// up to the maximum read request length.
+    ///
+    /// Default: false.
+    program_options::value<bool> io_coalesce_reads;
+    /// \brief Sample the queue and device time of one in every N I/O requests.
+    ///
+    /// The time sampled requests spent in the I/O queue, and then in the disk,
+    /// is exported as per-class histograms of each I/O queue.
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> io_request_sample_rate;
+    /// \brief Keep a log of the most recent sampled I/O requests.
+    ///
+    /// The log holds up to this many requests per I/O queue, with the times
+    /// they were queued, dispatched and completed at, see
+    /// \ref io_queue::sampled_requests().
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> io_request_log_size;
     /// \brief Maximum number of task backlog to allow.
     ///
     /// When the number of tasks grow above this, we stop polling (e.g. I/O)
     /// until it goes back below the limit.
     /// Default: 1000.
     program_options::value<unsigned> max_task_backlog;
+    /// \brief Sample the time tasks wait in their scheduling group's queue
+    /// before they run, for one in every N tasks.
+    ///
+    /// Exported as the \p scheduler_queueing_delay histogram of each
+    /// scheduling group. Zero disables sampling.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> queueing_delay_sample_rate;
+    /// \brief Account the CPU time each scheduling group actually got, as
+    /// opposed to the wall clock time it ran for.
+    ///
+    /// Exported as the \p scheduler_cpu_user_ms, \p scheduler_cpu_system_ms,
+    /// \p scheduler_steal_time_ms and \p scheduler_involuntary_context_switches
+    /// counters of each scheduling group. Costs a getrusage() call each time
+    /// a scheduling group is run.
+    ///
+    /// Default: false.
+    program_options::value<bool> sched_cpu_accounting;
+    /// \brief Number of the most recent scheduling, I/O and smp events each
+    /// shard records, see \ref event_trace.
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> event_trace_size;
+    /// \brief Sample the reactor threads for the CPU profiler every this many
+    /// microseconds of CPU time, see \ref cpu_profiler.
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> cpu_profiler_period_us;
+    /// \brief Let idle shards run work submitted with smp::submit_stealable()
+    /// on other shards of the same NUMA node.
+    ///
+    /// Default: false.
+    program_options::value<bool> work_stealing;
+    /// \brief Resume the awaiter of a coroutine directly when the coroutine
+    /// completes, instead of scheduling it as a new task.
+    ///
+    /// The awaiter then runs within the task of the coroutine, once its
+    /// locals are destroyed, if the task quota isn't exhausted, it belongs
+    /// to the same scheduling group, and not too many resumptions are nested
+    /// already. Which saves a trip through the task queue per await, but the
+    /// awaiter no longer waits behind the tasks already queued.
+    ///
+    /// Default: false.
+    program_options::value<bool> coroutine_direct_resume;
+    /// \brief Minimum time in milliseconds between two passes of
+    /// memory::defragment(), which are run when the shard is about to sleep.
+    ///
+    /// Zero disables idle-time defragmentation.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> memory_defragment_interval_ms;
+    /// \brief Minimum time in milliseconds between two calls to
+    /// memory::release_free_memory(), which are made when the shard is about
+    /// to sleep.
+    ///
+    /// Useful when running without \ref smp_options::hugepages, to keep the
+    /// resident memory of the shard close to its use. Zero disables it.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> memory_release_interval_ms;
+    /// \brief Interval in milliseconds between reads of the cgroup CPU
+    /// quota and memory limit.
+    ///
+    /// Changes are published through \ref current_resource_limits().
+    /// Under a CPU quota lower than the number of shards, shards pause
+    /// before the CFS bandwidth controller would throttle them; when the
+    /// memory limit shrinks, shards keep more memory free and return it
+    /// to the kernel. Zero disables tracking.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> cgroup_poll_interval_ms;
+    /// \brief Interval in milliseconds between samples of the time the
+    /// shard lost to hypervisor steal time and to preemption by other
+    /// threads.
+    ///
+    /// Samples are exported as metrics and through
+    /// \ref steal_time_subscription. Zero disables sampling.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> steal_time_sample_interval_ms;
     /// \brief Threshold in milliseconds over which the reactor is considered
     /// blocked if no progress is made.
     ///
@@ -109,6 +274,16 @@ struct reactor_options : public program_options::option_group {
     /// with a small data set.
     /// Default: \p false.
     program_options::value<bool> kernel_page_cache;
+    /// \brief Number of threads serving each syscall queue of a shard.
+    ///
+    /// Blocking system calls are offloaded to helper threads, with separate
+    /// queues for metadata operations (open, rename, unlink, stat, ...) and
+    /// data operations (fdatasync, ftruncate, fallocate, buffered I/O, ...),
+    /// so that slow calls of one kind don't delay the other. Each queue is
+    /// served by this many threads.
+    ///
+    /// Default: 1.
+    program_options::value<unsigned> syscall_threads;
     /// \brief Run in an overprovisioned environment (such as docker or a laptop).
     ///
     /// Equivalent to:
@@ -154,6 +329,75 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 10000.
     program_options::value<unsigned> max_networking_io_control_blocks;
+    /// \brief Register the shard's memory and open files with io_uring.
+    ///
+    /// Disk reads and writes are then submitted as fixed-buffer operations
+    /// on fixed files, which saves the kernel from pinning pages and looking
+    /// up the file table on every request. Pins all of the shard's memory.
+    /// Only valid for the \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_fixed_io;
+    /// \brief Use multishot accept and multishot receive for sockets.
+    ///
+    /// A single request then keeps accepting connections or receiving data
+    /// into a kernel-managed ring of buffers, instead of a poll followed by an
+    /// accept or receive. Idle sockets do not hold on to receive buffers.
+    /// Requires Linux 6.0 or later. Only valid for the \p io_uring reactor
+    /// backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_multishot;
+    /// \brief Submit io_uring requests from a kernel polling thread (\p IORING_SETUP_SQPOLL).
+    ///
+    /// The reactor then only makes the \p io_uring_enter system call to wake
+    /// the poller up after it went idle. Each shard gets its own poller thread,
+    /// which burns a CPU while the shard is busy; see \ref io_uring_sqpoll_cpuset
+    /// for where it runs. Requires Linux 5.11 or later. Only valid for the
+    /// \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_sqpoll;
+    /// \brief CPUs to pin the \p io_uring submission queue poller threads to
+    /// (in cpuset(7) format).
+    ///
+    /// Shards are assigned CPUs from the set round-robin. Meant for a set of
+    /// housekeeping CPUs excluded from \ref smp_options::cpuset.
+    ///
+    /// Default: the hyperthread sibling of the shard's CPU, if there is one.
+    program_options::value<resource::cpuset> io_uring_sqpoll_cpuset;
+    /// \brief Poll for the completions of disk I/O to NVMe devices (\p IORING_SETUP_IOPOLL).
+    ///
+    /// Reads and writes of files opened with \p O_DIRECT on block devices
+    /// with polled queues (\p /sys/block/<dev>/queue/io_poll, see the
+    /// \p poll_queues parameter of the nvme driver) go to a second ring,
+    /// whose completions the reactor polls for instead of waiting for an
+    /// interrupt. The reactor doesn't sleep while such requests are in
+    /// flight. Only valid for the \p io_uring reactor backend (see
+    /// \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_iopoll;
+    /// \brief Busy poll network devices for up to this many microseconds.
+    ///
+    /// Sets \p SO_BUSY_POLL and \p SO_PREFER_BUSY_POLL on the sockets of the
+    /// posix stack, and the matching busy poll parameters of the reactor's
+    /// epoll instance or io_uring, so that the reactor's polling runs the
+    /// NAPI poll of the RX queues its sockets are served by instead of waiting
+    /// for an interrupt. Receiving on an empty socket polls the queue
+    /// once. Works best with hardware interrupts deferred on the device
+    /// (\p napi_defer_hard_irqs and \p gro_flush_timeout), and with each
+    /// shard's connections coming from a single RX queue (see
+    /// \ref server_socket::load_balancing_algorithm::incoming_cpu), as epoll
+    /// polls only one queue at a time. Values above \p net.core.busy_read need
+    /// \p CAP_NET_ADMIN.
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> net_busy_poll_us;
+    /// \brief Maximum number of packets each busy poll processes.
+    ///
+    /// Default: 0 (the kernel's default, 8).
+    program_options::value<unsigned> net_busy_poll_budget;
     /// \brief Enable seastar heap profiling.
     ///
     /// Allocations will be sampled every N bytes on average. Zero means off.
@@ -0,0 +1,171 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/smp.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <memory>
+#include <utility>
+#endif
+
+namespace seastar {
+
+/// \cond internal
+namespace internal {
+
+// Quiescent state based reclamation.
+//
+// Every shard passes a quiescent state on each iteration of its poll loop,
+// since no task is running then, and is quiescent for as long as it sleeps.
+// Memory retired by rcu_retire() is reclaimed, on the retiring shard,
+// once every shard has passed a quiescent state after the retirement.
+void rcu_retire(void* p, void (*reclaim)(void*) noexcept);
+// Called by the reactor
+void rcu_quiescent_state() noexcept;
+bool rcu_reclaim() noexcept;
+bool rcu_has_retired() noexcept;
+void rcu_enter_idle() noexcept;
+void rcu_exit_idle() noexcept;
+
+}
+/// \endcond
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// A read-mostly value shared by all shards.
+///
+/// Instead of a copy of the value on each shard, or a \ref foreign_ptr
+/// and a cross-shard hop for each access, all shards read the same
+/// instance, without any locking or atomic read-modify-write. Updates
+/// publish a new version of the value, and the previous one is destroyed
+/// once every shard has gone through its poll loop, so that no reader may
+/// still be using it. This suits tables which are looked up often and
+/// rarely changed, like routing tables or configuration.
+///
+/// \code
+/// using routing_table = std::unordered_map<sstring, endpoint>;
+/// replicated<routing_table> routes(load_routes());
+///
+/// // on any shard
+/// auto it = routes->find(key);
+///
+/// // on the owner shard
+/// routes.update([&] (routing_table& t) { t[key] = ep; });
+/// \endcode
+///
+/// \note A reference obtained from \ref get() is only valid until the
+///       task which obtained it returns to the reactor: it must not be used
+///       after a preemption point, like a continuation or a \c co_await.
+///       Look the value up again after waiting.
+/// \note The value is allocated on, and updates and destruction happen on,
+///       the shard that constructed the \c replicated object. The object
+///       itself must outlive the readers on all shards.
+template <typename T>
+class replicated {
+    std::atomic<const T*> _current;
+    shard_id _owner;
+private:
+    static void reclaim(void* p) noexcept {
+        delete static_cast<const T*>(p);
+    }
+    void retire(const T* old) {
+        try {
+            internal::rcu_retire(const_cast<T*>(old), reclaim);
+        } catch (...) {
+            // Readers may still use old, leaking it is the only safe option
+        }
+    }
+public:
+    /// Constructs the first version of the value.
+    explicit replicated(T value)
+        : _current(new T(std::move(value)))
+        , _owner(this_shard_id()) {
+    }
+    /// Constructs the first version of the value in place.
+    template <typename... Args>
+    explicit replicated(std::in_place_t, Args&&... args)
+        : _current(new T(std::forward<Args>(args)...))
+        , _owner(this_shard_id()) {
+    }
+    replicated(const replicated&) = delete;
+    replicated& operator=(const replicated&) = delete;
+    /// Must be called on the owner shard; the current version is destroyed
+    /// once readers on all shards are done with it.
+    ~replicated() {
+        assert(this_shard_id() == _owner);
+        retire(_current.load(std::memory_order_relaxed));
+    }
+
+    /// Returns the current version of the value, see the class documentation
+    /// for how long the reference is valid.
+    ///
+    /// Can be called on any shard.
+    const T& get() const noexcept {
+        return *_current.load(std::memory_order_acquire);
+    }
+    const T& operator*() const noexcept {
+        return get();
+    }
+    const T* operator->() const noexcept {
+        return &get();
+    }
+
+    /// Publishes a new version of the value.
+    ///
+    /// Readers see either the previous version or the new one. Must be
+    /// called on the owner shard.
+    void publish(T value) {
+        assert(this_shard_id() == _owner);
+        auto next = new T(std::move(value));
+        retire(_current.exchange(next, std::memory_order_seq_cst));
+    }
+
+    /// Publishes a modified copy of the current version.
+    ///
+    /// \param func called with a copy of the current version to modify.
+    /// Must be called on the owner shard.
+    template <typename Func>
+    requires std::invocable<Func, T&>
+    void update(Func&& func) {
+        T next = get();
+        std::forward<Func>(func)(next);
+        publish(std::move(next));
+    }
+
+    /// Returns the shard which owns the value.
+    shard_id owner() const noexcept {
+        return _owner;
+    }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
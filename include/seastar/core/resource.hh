@@ -99,6 +99,8 @@ struct configuration {
     bool assign_orphan_cpus = false;
     std::vector<dev_t> devices;
     unsigned num_io_groups;
+    // Per device overrides of num_io_groups
+    std::unordered_map<dev_t, unsigned> device_num_io_groups;
     hwloc::internal::topology_holder topology;
 };
 
@@ -0,0 +1,76 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/util/modules.hh>
+#include <seastar/util/noncopyable_function.hh>
+
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <cstddef>
+#include <optional>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Resource limits the process' cgroup imposes.
+///
+/// Container orchestrators (for instance Kubernetes vertical pod autoscaling)
+/// may change them while the application runs. They are tracked when
+/// \c --cgroup-poll-interval-ms is set; otherwise they're all unset.
+struct resource_limits {
+    /// CPUs worth of time the CFS bandwidth controller allows the process
+    /// (\c cpu.max in cgroups v2), if limited.
+    std::optional<double> cpus;
+    /// Memory the process may use (\c memory.max in cgroups v2), if limited.
+    std::optional<size_t> memory;
+
+    bool operator==(const resource_limits&) const = default;
+};
+
+/// Returns the last resource limits read from the cgroup.
+const resource_limits& current_resource_limits() noexcept;
+
+/// Calls a function on the current shard whenever the cgroup resource
+/// limits change. The callback is unregistered when the subscription
+/// is destroyed.
+class resource_limits_subscription : public boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>> {
+public:
+    using callback_type = noncopyable_function<void (const resource_limits&) noexcept>;
+private:
+    callback_type _callback;
+public:
+    explicit resource_limits_subscription(callback_type callback);
+    resource_limits_subscription(const resource_limits_subscription&) = delete;
+    resource_limits_subscription& operator=(const resource_limits_subscription&) = delete;
+    /// \cond internal
+    void notify(const resource_limits& limits) noexcept {
+        _callback(limits);
+    }
+    /// \endcond
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -0,0 +1,283 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#endif
+
+namespace seastar {
+
+/// \addtogroup future-util
+/// @{
+
+/// Wraps an error, to construct a \ref result holding it.
+SEASTAR_MODULE_EXPORT
+template <typename E>
+class unexpected {
+    E _error;
+public:
+    explicit unexpected(E error) noexcept(std::is_nothrow_move_constructible_v<E>) : _error(std::move(error)) {}
+    E& error() & noexcept { return _error; }
+    const E& error() const & noexcept { return _error; }
+    E&& error() && noexcept { return std::move(_error); }
+};
+
+template <typename E>
+unexpected(E) -> unexpected<E>;
+
+/// Thrown by \ref result::value() when the result holds an error.
+SEASTAR_MODULE_EXPORT
+template <typename E>
+class bad_result_access : public std::exception {
+    E _error;
+public:
+    explicit bad_result_access(E error) : _error(std::move(error)) {}
+    const E& error() const noexcept { return _error; }
+    virtual const char* what() const noexcept override { return "bad result access"; }
+};
+
+/// Either a value of type \c T or an error of type \c E, like C++23's
+/// \c std::expected.
+///
+/// Errors that are expected to happen under load (like timeouts, overload
+/// or a missing key) can be returned as a \c future<result<T, E>>, which
+/// propagates them through continuations (see \ref then_ok()) and
+/// coroutines (with \c co_return \c unexpected(e)) without allocating or
+/// throwing an exception. Failed futures are still used for the
+/// unexpected ones.
+///
+/// \tparam T the value type, can be \c void
+/// \tparam E the error type, e.g. an \c std::error_code or an enum
+SEASTAR_MODULE_EXPORT
+template <typename T, typename E>
+class result {
+public:
+    using value_type = T;
+    using error_type = E;
+private:
+    using stored_type = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+    std::variant<stored_type, E> _v;
+public:
+    /// Holds a default constructed value (or nothing, for \c void)
+    result() requires std::is_default_constructible_v<stored_type> : _v(std::in_place_index<0>) {}
+    template <typename U = stored_type>
+    requires (!std::is_void_v<T> && std::is_constructible_v<stored_type, U&&>
+            && !std::is_same_v<std::remove_cvref_t<U>, result>
+            && !std::is_same_v<std::remove_cvref_t<U>, std::in_place_t>)
+    result(U&& value) noexcept(std::is_nothrow_constructible_v<stored_type, U&&>)
+        : _v(std::in_place_index<0>, std::forward<U>(value)) {}
+    template <typename... A>
+    explicit result(std::in_place_t, A&&... a) : _v(std::in_place_index<0>, std::forward<A>(a)...) {}
+    template <typename G>
+    requires std::is_constructible_v<E, G&&>
+    result(unexpected<G> error) noexcept(std::is_nothrow_constructible_v<E, G&&>)
+        : _v(std::in_place_index<1>, std::move(error).error()) {}
+
+    bool has_value() const noexcept { return _v.index() == 0; }
+    explicit operator bool() const noexcept { return has_value(); }
+
+    /// The value; throws \ref bad_result_access if there is an error
+    decltype(auto) value() & { check(); return get_value(); }
+    decltype(auto) value() const & { check(); return get_value(); }
+    decltype(auto) value() && { check(); return std::move(*this).get_value(); }
+
+    /// The value, which must be there
+    decltype(auto) operator*() & noexcept { return get_value(); }
+    decltype(auto) operator*() const & noexcept { return get_value(); }
+    decltype(auto) operator*() && noexcept { return std::move(*this).get_value(); }
+    auto operator->() noexcept requires (!std::is_void_v<T>) { return &std::get<0>(_v); }
+    auto operator->() const noexcept requires (!std::is_void_v<T>) { return &std::get<0>(_v); }
+
+    template <typename U>
+    requires (!std::is_void_v<T>)
+    T value_or(U&& alternative) const & { return has_value() ? std::get<0>(_v) : static_cast<T>(std::forward<U>(alternative)); }
+    template <typename U>
+    requires (!std::is_void_v<T>)
+    T value_or(U&& alternative) && { return has_value() ? std::get<0>(std::move(_v)) : static_cast<T>(std::forward<U>(alternative)); }
+
+    /// The error, which must be there
+    E& error() & noexcept { return *std::get_if<1>(&_v); }
+    const E& error() const & noexcept { return *std::get_if<1>(&_v); }
+    E&& error() && noexcept { return std::move(*std::get_if<1>(&_v)); }
+
+    bool operator==(const result&) const = default;
+private:
+    void check() const {
+        if (!has_value()) {
+            throw bad_result_access<E>(error());
+        }
+    }
+    decltype(auto) get_value() & noexcept {
+        if constexpr (!std::is_void_v<T>) {
+            return *std::get_if<0>(&_v);
+        }
+    }
+    decltype(auto) get_value() const & noexcept {
+        if constexpr (!std::is_void_v<T>) {
+            return *std::get_if<0>(&_v);
+        }
+    }
+    decltype(auto) get_value() && noexcept {
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*std::get_if<0>(&_v));
+        }
+    }
+};
+
+/// \cond internal
+namespace internal {
+
+template <typename T>
+struct is_result : std::false_type {};
+template <typename T, typename E>
+struct is_result<result<T, E>> : std::true_type {};
+
+// What a continuation of a result<T, E> returning R (a value, a result or
+// a future of either) makes of it: a future<result<U, E>>
+template <typename R, typename E>
+struct result_continuation {
+    using type = result<R, E>;
+};
+template <typename U, typename E>
+struct result_continuation<result<U, E>, E> {
+    using type = result<U, E>;
+};
+template <typename U, typename E>
+struct result_continuation<future<U>, E> {
+    using type = typename result_continuation<U, E>::type;
+};
+
+template <typename T, typename Func>
+struct invoke_on_value {
+    using type = std::invoke_result_t<Func, T&&>;
+};
+template <typename Func>
+struct invoke_on_value<void, Func> {
+    using type = std::invoke_result_t<Func>;
+};
+
+template <typename Res, typename Func, typename... A>
+future<Res> invoke_for_result(Func& func, A&&... a) noexcept {
+    using ret = std::invoke_result_t<Func, A&&...>;
+    if constexpr (is_future<ret>::value) {
+        if constexpr (std::is_same_v<ret, future<Res>>) {
+            return futurize_invoke(func, std::forward<A>(a)...);
+        } else {
+            return futurize_invoke(func, std::forward<A>(a)...).then([] (auto&&... v) {
+                return Res(std::forward<decltype(v)>(v)...);
+            });
+        }
+    } else if constexpr (is_result<ret>::value) {
+        return futurize_invoke(func, std::forward<A>(a)...);
+    } else if constexpr (std::is_void_v<ret>) {
+        return futurize_invoke(func, std::forward<A>(a)...).then([] {
+            return Res();
+        });
+    } else {
+        return futurize_invoke(func, std::forward<A>(a)...).then([] (ret v) {
+            return Res(std::move(v));
+        });
+    }
+}
+
+}
+/// \endcond
+
+/// Continues a future holding a \ref result with \c func, which is called
+/// with the value only; an error goes straight to the returned future.
+///
+/// \c func can return a plain value, a \ref result with the same error
+/// type, or a future of either. Exceptions (from \c f or \c func) fail
+/// the returned future as usual.
+///
+/// \return a \c future<result<U, E>>, for the \c U that \c func returns
+SEASTAR_MODULE_EXPORT
+template <typename T, typename E, typename Func>
+auto then_ok(future<result<T, E>> f, Func func) noexcept {
+    using ret = typename internal::invoke_on_value<T, Func>::type;
+    using res = typename internal::result_continuation<ret, E>::type;
+    return f.then([func = std::move(func)] (result<T, E> r) mutable -> future<res> {
+        if (!r) {
+            return make_ready_future<res>(unexpected(std::move(r).error()));
+        }
+        if constexpr (std::is_void_v<T>) {
+            return internal::invoke_for_result<res>(func);
+        } else {
+            return internal::invoke_for_result<res>(func, std::move(r).value());
+        }
+    });
+}
+
+/// Continues a future holding a \ref result with \c func, which is called
+/// with the error only, to recover from it; a value goes straight to the
+/// returned future.
+///
+/// \c func can return a value, a \ref result<T, E>, or a future of either.
+SEASTAR_MODULE_EXPORT
+template <typename T, typename E, typename Func>
+future<result<T, E>> then_error(future<result<T, E>> f, Func func) noexcept {
+    return f.then([func = std::move(func)] (result<T, E> r) mutable -> future<result<T, E>> {
+        if (r) {
+            return make_ready_future<result<T, E>>(std::move(r));
+        }
+        return internal::invoke_for_result<result<T, E>>(func, std::move(r).error());
+    });
+}
+
+/// Turns a future holding a \ref result into a plain future, for callers
+/// that deal with errors as exceptions. An error is converted into an
+/// exception by \c to_exception, which gets the error and returns an
+/// \c std::exception_ptr or an exception object.
+SEASTAR_MODULE_EXPORT
+template <typename T, typename E, typename Func>
+future<T> result_to_exception(future<result<T, E>> f, Func to_exception) noexcept {
+    return f.then([to_exception = std::move(to_exception)] (result<T, E> r) mutable -> future<T> {
+        if (!r) {
+            return make_exception_future<T>(to_exception(std::move(r).error()));
+        }
+        if constexpr (std::is_void_v<T>) {
+            return make_ready_future<>();
+        } else {
+            return make_ready_future<T>(std::move(r).value());
+        }
+    });
+}
+
+/// Like \ref result_to_exception(), with \ref bad_result_access as the
+/// exception.
+SEASTAR_MODULE_EXPORT
+template <typename T, typename E>
+future<T> result_to_exception(future<result<T, E>> f) noexcept {
+    return result_to_exception(std::move(f), [] (E e) {
+        return bad_result_access<E>(std::move(e));
+    });
+}
+
+/// @}
+
+}
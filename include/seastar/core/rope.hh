@@ -0,0 +1,241 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <vector>
+#endif
+
+namespace seastar {
+
+/// A string made of a sequence of \ref temporary_buffer fragments.
+///
+/// Appending a buffer or another rope moves or shares fragments instead of
+/// copying their contents, so a message assembled from many pieces (headers,
+/// values read from a cache, ...) is copied at most once, when it is
+/// linearized, or not at all if its fragments are handed to a stream or a
+/// packet. Like \ref temporary_buffer, a rope shouldn't be held indefinitely,
+/// and the contents of its fragments shouldn't be modified once shared.
+///
+/// \tparam CharType underlying character type (must be a variant of \c char).
+SEASTAR_MODULE_EXPORT
+template <typename CharType>
+class basic_rope {
+public:
+    using char_type = CharType;
+    using fragment = temporary_buffer<CharType>;
+    using fragment_vector = std::vector<fragment>;
+    using string_view_type = std::basic_string_view<CharType>;
+    using const_iterator = typename fragment_vector::const_iterator;
+private:
+    fragment_vector _fragments;
+    size_t _size = 0;
+public:
+    basic_rope() noexcept = default;
+    /// Creates a rope from a single fragment, without copying it.
+    explicit basic_rope(fragment f) {
+        append(std::move(f));
+    }
+    /// Creates a rope holding a copy of \c s.
+    explicit basic_rope(string_view_type s) {
+        append(s);
+    }
+    basic_rope(basic_rope&&) noexcept = default;
+    basic_rope& operator=(basic_rope&&) noexcept = default;
+
+    /// Total number of characters.
+    size_t size() const noexcept {
+        return _size;
+    }
+    bool empty() const noexcept {
+        return !_size;
+    }
+    /// The fragments, in order; none of them is empty.
+    const fragment_vector& fragments() const noexcept {
+        return _fragments;
+    }
+    const_iterator begin() const noexcept {
+        return _fragments.begin();
+    }
+    const_iterator end() const noexcept {
+        return _fragments.end();
+    }
+
+    /// Appends a fragment, without copying it.
+    basic_rope& append(fragment f) {
+        if (f) {
+            _size += f.size();
+            _fragments.push_back(std::move(f));
+        }
+        return *this;
+    }
+    /// Appends the fragments of another rope, without copying them.
+    basic_rope& append(basic_rope&& r) {
+        if (_fragments.empty()) {
+            *this = std::move(r);
+            return *this;
+        }
+        _fragments.reserve(_fragments.size() + r._fragments.size());
+        std::move(r._fragments.begin(), r._fragments.end(), std::back_inserter(_fragments));
+        _size += r._size;
+        r._fragments.clear();
+        r._size = 0;
+        return *this;
+    }
+    /// Appends a copy of \c s. Prefer building larger pieces first, each
+    /// call adds a fragment.
+    basic_rope& append(string_view_type s) {
+        if (!s.empty()) {
+            fragment f(s.size());
+            std::copy(s.begin(), s.end(), f.get_write());
+            append(std::move(f));
+        }
+        return *this;
+    }
+    template <typename T>
+    requires requires (basic_rope& r, T&& x) { r.append(std::forward<T>(x)); }
+    basic_rope& operator+=(T&& x) {
+        return append(std::forward<T>(x));
+    }
+
+    /// Returns a rope sharing the fragments of this one.
+    basic_rope share() {
+        return share(0, _size);
+    }
+    /// Returns a rope sharing the characters in [pos, pos + len).
+    basic_rope share(size_t pos, size_t len) {
+        basic_rope ret;
+        for (auto& f : _fragments) {
+            if (!len) {
+                break;
+            }
+            if (pos >= f.size()) {
+                pos -= f.size();
+                continue;
+            }
+            auto n = std::min(len, f.size() - pos);
+            ret.append(f.share(pos, n));
+            pos = 0;
+            len -= n;
+        }
+        return ret;
+    }
+    /// Drops the first \c n characters.
+    void trim_front(size_t n) noexcept {
+        n = std::min(n, _size);
+        _size -= n;
+        auto it = _fragments.begin();
+        while (n && n >= it->size()) {
+            n -= it->size();
+            ++it;
+        }
+        if (n) {
+            it->trim_front(n);
+        }
+        _fragments.erase(_fragments.begin(), it);
+    }
+
+    /// Returns the contents as a single buffer, sharing it if there is a
+    /// single fragment.
+    fragment linearize() {
+        if (_fragments.size() == 1) {
+            return _fragments.front().share();
+        }
+        fragment ret(_size);
+        auto p = ret.get_write();
+        for (auto& f : _fragments) {
+            p = std::copy(f.begin(), f.end(), p);
+        }
+        return ret;
+    }
+    /// Copies the contents into a string.
+    template <typename String = basic_sstring<CharType, uint32_t, 15>>
+    String to_string() const {
+        String ret(typename String::initialized_later(), _size);
+        auto p = ret.begin();
+        for (auto& f : _fragments) {
+            p = std::copy(f.begin(), f.end(), p);
+        }
+        return ret;
+    }
+    /// Releases the fragments, e.g. to write them to a stream.
+    fragment_vector release() && noexcept {
+        _size = 0;
+        return std::move(_fragments);
+    }
+
+    bool operator==(string_view_type s) const noexcept {
+        if (s.size() != _size) {
+            return false;
+        }
+        for (auto& f : _fragments) {
+            if (string_view_type(f.get(), f.size()) != s.substr(0, f.size())) {
+                return false;
+            }
+            s.remove_prefix(f.size());
+        }
+        return true;
+    }
+    bool operator==(const basic_rope& o) const noexcept {
+        if (o._size != _size) {
+            return false;
+        }
+        // Compare the overlapping parts of the fragments of both sides
+        auto a = _fragments.begin();
+        auto b = o._fragments.begin();
+        size_t a_pos = 0, b_pos = 0;
+        while (a != _fragments.end()) {
+            auto n = std::min(a->size() - a_pos, b->size() - b_pos);
+            if (std::memcmp(a->get() + a_pos, b->get() + b_pos, n)) {
+                return false;
+            }
+            if ((a_pos += n) == a->size()) {
+                ++a;
+                a_pos = 0;
+            }
+            if ((b_pos += n) == b->size()) {
+                ++b;
+                b_pos = 0;
+            }
+        }
+        return true;
+    }
+};
+
+SEASTAR_MODULE_EXPORT
+template <typename CharType>
+inline basic_rope<CharType> operator+(basic_rope<CharType>&& a, basic_rope<CharType>&& b) {
+    a.append(std::move(b));
+    return std::move(a);
+}
+
+SEASTAR_MODULE_EXPORT
+using rope = basic_rope<char>;
+
+}
@@ -23,6 +23,7 @@
 
 #ifndef SEASTAR_MODULE
 #include <chrono>
+#include <cstdint>
 #include <concepts>
 #include <functional>
 #include <typeindex>
@@ -44,9 +45,25 @@ class future;
 class reactor;
 
 class scheduling_group;
+class scheduling_supergroup;
 class scheduling_group_key;
 
 using sched_clock = std::chrono::steady_clock;
+
+/// IO limits of a scheduling group, see \ref scheduling_group::update_io_limits()
+///
+/// Each limit is a token bucket: after an idle period, the group may
+/// dispatch up to the burst above the rate.
+struct io_limits {
+    /// Bytes per second, zero for unlimited
+    uint64_t bandwidth = 0;
+    /// Bytes the group may dispatch at once above the bandwidth
+    uint64_t bandwidth_burst = 10 << 20;
+    /// Requests per second, zero for unlimited
+    uint64_t iops = 0;
+    /// Requests the group may dispatch at once above the IOPS rate
+    uint64_t iops_burst = 100;
+};
 SEASTAR_MODULE_EXPORT_END
 
 namespace internal {
@@ -91,6 +108,44 @@ future<scheduling_group> create_scheduling_group(sstring name, float shares) noe
 /// \return a scheduling group that can be used on any shard
 future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
 
+/// Creates a scheduling group within a scheduling supergroup.
+///
+/// The group competes for CPU time with the other groups of the supergroup,
+/// according to their shares, for the time the supergroup gets according to
+/// its own shares. The operation is global and affects all shards.
+///
+/// \param name A name that identifies the group; will be used as a label
+///             in the group's metrics
+/// \param shortname A name that identifies the group; will be printed in the
+///                  logging message aside of the shard id, truncated to 4
+///                  characters.
+/// \param shares number of shares of the supergroup's CPU time allotted to the group
+/// \param parent the supergroup the group belongs to; groups created with
+///               the default constructed supergroup are top level groups
+/// \return a scheduling group that can be used on any shard
+future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept;
+
+/// Creates a scheduling supergroup with a specified number of shares.
+///
+/// A supergroup competes for CPU time with the top level scheduling groups,
+/// and subdivides the time it gets among the groups created within it, see
+/// \ref create_scheduling_group(sstring, sstring, float, scheduling_supergroup).
+/// Supergroups don't nest. The operation is global and affects all shards.
+///
+/// \param name A name that identifies the supergroup
+/// \param shares number of shares of the CPU time allotted to the supergroup
+/// \return a scheduling supergroup that can be used on any shard
+future<scheduling_supergroup> create_scheduling_supergroup(sstring name, float shares) noexcept;
+
+/// Destroys a scheduling supergroup.
+///
+/// The groups created within the supergroup must have been destroyed before.
+/// The operation is global and affects all shards.
+///
+/// \param sg The scheduling supergroup to be destroyed
+/// \return a future that is ready when the supergroup has been torn down
+future<> destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept;
+
 /// Destroys a scheduling group.
 ///
 /// Destroys a \ref scheduling_group previously created with create_scheduling_group().
@@ -279,6 +334,43 @@ template<typename T>
 T& scheduling_group_get_specific(scheduling_group sg, scheduling_group_key key);
 
 
+/// \brief A group of scheduling groups sharing a part of the CPU
+///
+/// The default constructed supergroup stands for the top level, which
+/// holds the supergroups and the groups created without one.
+class scheduling_supergroup {
+    unsigned _id;
+private:
+    explicit scheduling_supergroup(unsigned id) noexcept : _id(id) {}
+public:
+    /// Creates a `scheduling_supergroup` object denoting the top level
+    constexpr scheduling_supergroup() noexcept : _id(0) {}
+    bool operator==(scheduling_supergroup x) const noexcept { return _id == x._id; }
+    bool operator!=(scheduling_supergroup x) const noexcept { return _id != x._id; }
+    bool is_root() const noexcept { return _id == 0; }
+    /// Returns the name of the supergroup; must not be called on the top level
+    const sstring& name() const noexcept;
+    /// Adjusts the number of shares allotted to the supergroup, locally to the shard
+    ///
+    /// Must not be called on the top level.
+    void set_shares(float shares) noexcept;
+    /// Returns the number of shares the supergroup has on the calling shard
+    float get_shares() const noexcept;
+    /// Caps the CPU time of the supergroup (all its groups together), see
+    /// \ref scheduling_group::set_cpu_limit()
+    ///
+    /// Must not be called on the top level.
+    void set_cpu_limit(float fraction) noexcept;
+    /// Returns the CPU limit of the supergroup on the calling shard
+    float get_cpu_limit() const noexcept;
+
+    friend future<scheduling_supergroup> create_scheduling_supergroup(sstring name, float shares) noexcept;
+    friend future<> destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept;
+    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept;
+    friend class reactor;
+    friend class scheduling_group;
+};
+
 /// \brief Identifies function calls that are accounted as a group
 ///
 /// A `scheduling_group` is a tag that can be used to mark a function call.
@@ -327,6 +419,96 @@ class scheduling_group {
     /// the calling shard
     float get_shares() const noexcept;
 
+    /// Returns the supergroup the group was created in
+    scheduling_supergroup get_supergroup() const noexcept;
+
+    /// Caps the CPU time of the group
+    ///
+    /// Shares divide the CPU time among the groups that have work, so a
+    /// group gets all of it when the others are idle. A CPU limit is a hard
+    /// cap instead: once the group ran for \c fraction of a scheduling
+    /// period (20ms), it isn't run again until the next period, even if
+    /// the shard would be idle otherwise. The cap may be exceeded by up to
+    /// a task quota per period. The limit is local to the shard.
+    ///
+    /// \param fraction the fraction of the CPU the group may use, in the
+    ///                 (0, 1] range; 1 removes the limit.
+    void set_cpu_limit(float fraction) noexcept;
+
+    /// Returns the CPU limit of the group on the calling shard
+    float get_cpu_limit() const noexcept;
+
+    /// Makes the group latency-critical
+    ///
+    /// The queues of latency-critical groups are run ahead of the other
+    /// groups, earliest deadline first, where the deadline of a queue is
+    /// \c deadline after it got work. Work queued into such a group preempts
+    /// the task queue running at the time, after its current task. To keep
+    /// the other groups from starving, this only holds for \c budget of each
+    /// scheduling period (20ms); beyond it the group is scheduled by its
+    /// shares, like the others. CPU limits still apply. The setting is local
+    /// to the shard.
+    ///
+    /// \param deadline how soon work queued into the group should run
+    /// \param budget fraction of the CPU the group may take ahead of the others
+    void set_latency_critical(std::chrono::microseconds deadline, float budget = 0.25) noexcept;
+
+    /// Makes the group scheduled by its shares only, see \ref set_latency_critical()
+    void clear_latency_critical() noexcept;
+
+    /// Returns whether the group is latency-critical on the calling shard
+    bool is_latency_critical() const noexcept;
+
+    /// Sets a soft limit on the memory allocated in the context of the group
+    ///
+    /// Allocations are charged to the scheduling group current when they are
+    /// made, until they are freed. Only allocations larger than the allocator's
+    /// small object size classes (16K) are charged. Allocations never fail
+    /// because of the limit: it is up to the group's users to throttle
+    /// themselves, see \ref wait_for_memory(). The limit is local to the shard.
+    ///
+    /// \param limit the limit in bytes, use \c std::numeric_limits<size_t>::max()
+    ///              to remove it.
+    void set_memory_soft_limit(size_t limit) noexcept;
+
+    /// Returns the memory charged to the group on this shard, see \ref set_memory_soft_limit()
+    size_t memory_usage() const noexcept;
+
+    /// Waits until the memory charged to the group on this shard is below
+    /// its soft limit
+    ///
+    /// \return a future which is ready right away if the group is under its
+    ///         limit, or once enough of its memory has been freed
+    future<> wait_for_memory() const;
+
+    /// Network usage of a group, see \ref get_network_usage()
+    struct network_usage {
+        uint64_t bytes_sent = 0;
+        uint64_t bytes_received = 0;
+        /// Send and receive calls on sockets
+        uint64_t sends = 0;
+        uint64_t receives = 0;
+        /// Time sends and receives were delayed by the bandwidth limits
+        std::chrono::nanoseconds send_throttled{};
+        std::chrono::nanoseconds receive_throttled{};
+    };
+
+    /// Caps the network bandwidth of the group
+    ///
+    /// Bytes sent and received through connected sockets, of both the posix
+    /// and the native stacks, are charged to the scheduling group current
+    /// when they are sent or received. Once a group is over its rate, its
+    /// sends are delayed, and so are its reads, which lets TCP flow control
+    /// push back on the peer. Bursts of up to 10ms worth of the rate go
+    /// through. The limits are local to the shard.
+    ///
+    /// \param send_bytes_per_second the rate of bytes sent, 0 removes the limit
+    /// \param receive_bytes_per_second the rate of bytes received, 0 removes the limit
+    void set_network_bandwidth_limit(uint64_t send_bytes_per_second, uint64_t receive_bytes_per_second) noexcept;
+
+    /// Returns the network usage of the group on this shard
+    network_usage get_network_usage() const noexcept;
+
 #if SEASTAR_API_LEVEL >= 7
     /// \brief Updates the current IO bandwidth for a given scheduling group
     ///
@@ -336,9 +518,20 @@ class scheduling_group {
     /// \param bandwidth the new bandwidth value in bytes/second
     /// \return a future that is ready when the bandwidth update is applied
     future<> update_io_bandwidth(uint64_t bandwidth) const;
+
+    /// \brief Updates the IO bandwidth and IOPS limits of the scheduling group
+    ///
+    /// Like \ref update_io_bandwidth(), the limits are NOT shard-local: all
+    /// shards together cannot dispatch more, whatever the load of other
+    /// groups. Requests over a limit wait in the queue, where they don't
+    /// hold back other groups.
+    ///
+    /// \param limits the new limits
+    /// \return a future that is ready when the limits are applied
+    future<> update_io_limits(io_limits limits) const;
 #endif
 
-    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
+    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept;
     friend future<> destroy_scheduling_group(scheduling_group sg) noexcept;
     friend future<> rename_scheduling_group(scheduling_group sg, sstring new_name, sstring new_shortname) noexcept;
     friend class reactor;
@@ -60,6 +60,7 @@
 #include <filesystem>
 #include <optional>
 #include <string_view>
+#include <vector>
 #endif
 
 namespace seastar {
@@ -75,6 +76,7 @@ class socket;
 class connected_socket;
 class socket_address;
 struct listen_options;
+struct connect_options;
 enum class transport;
 
 // file.hh
@@ -154,6 +156,54 @@ future<connected_socket> connect(socket_address sa);
 /// \return a \ref connected_socket object, or an exception
 future<connected_socket> connect(socket_address sa, socket_address local, transport proto);
 
+/// Establishes a connection to any of the given addresses
+///
+/// Races connection attempts as in RFC 8305 ("Happy Eyeballs"): the
+/// addresses are tried in order, with address families interleaved, and
+/// a new attempt starts whenever the previous one fails or has not
+/// completed after the attempt delay. The first attempt to succeed wins,
+/// and the others are aborted.
+///
+/// \param addrs addresses to connect to, in order of preference, usually
+///              as resolved by DNS
+/// \param opts options controlling the connection attempts
+///
+/// \return a \ref connected_socket object, or the exception of the last
+///         attempt to fail when all of them do
+future<connected_socket> connect_any(std::vector<socket_address> addrs, const connect_options& opts);
+
+/// Establishes a connection to any of the given addresses
+///
+/// \see connect_any(std::vector<socket_address> addrs, const connect_options& opts)
+future<connected_socket> connect_any(std::vector<socket_address> addrs);
+
+
+/// Creates a pair of connected unix domain stream sockets
+///
+/// The sockets can pass file descriptors to each other, see
+/// \ref connected_socket::send_fds().
+///
+/// \return the two ends of the connection, see socketpair(2)
+std::tuple<connected_socket, connected_socket> make_unix_socket_pair();
+
+/// Takes over a connected stream socket
+///
+/// For example one passed by another process, see
+/// \ref connected_socket::take_received_fds(). The socket is handled by
+/// the posix stack whatever the network stack, and made non-blocking.
+///
+/// \param fd a connected TCP, SCTP or unix domain stream socket
+/// \return a \ref connected_socket object owning \c fd
+connected_socket make_connected_socket(file_desc fd);
+
+/// Takes over a listening stream socket
+///
+/// Like \ref make_connected_socket(), for listening sockets. Connections
+/// are accepted on the calling shard.
+///
+/// \param fd a listening TCP, SCTP or unix domain stream socket
+/// \return a \ref server_socket object owning \c fd
+server_socket make_server_socket(file_desc fd);
 
 /// Creates a socket object suitable for establishing stream-oriented connections
 ///
@@ -234,6 +284,14 @@ net::datagram_channel make_bound_datagram_channel(const socket_address& local);
 /// The file name is not guaranteed to be stable on disk, unless the
 /// containing directory is sync'ed.
 ///
+/// \note
+/// The generic char device of an NVMe namespace (\c /dev/ngXnY) is opened
+/// for NVMe passthrough: reads and writes are sent to the device as NVMe
+/// commands with io_uring, bypassing the block layer, and are queued on the
+/// I/O queue of the namespace's block device. This needs the io_uring
+/// reactor backend, and a namespace formatted without per-block metadata.
+/// \c open_flags::dsync writes use force unit access.
+///
 /// \relates file
 future<file> open_file_dma(std::string_view name, open_flags flags) noexcept;
 
@@ -428,6 +486,24 @@ future<uint64_t> fs_avail(std::string_view name) noexcept;
 ///
 /// \param name name of the file to inspect
 future<uint64_t> fs_free(std::string_view name) noexcept;
+
+/// How \ref choose_directory() spreads files over directories
+enum class io_placement_policy {
+    /// Each of the directories in turn
+    round_robin,
+    /// The directory whose device has the least work pending from the
+    /// current shard, relative to the device's configured capacity
+    least_loaded,
+    /// The directory whose file system has the most space available
+    most_space,
+};
+
+/// Picks one of several directories to place a new file in, e.g. one per
+/// disk of a JBOD.
+///
+/// \param directories candidate directories, must not be empty
+/// \param policy how to pick
+future<sstring> choose_directory(std::vector<sstring> directories, io_placement_policy policy = io_placement_policy::least_loaded) noexcept;
 /// @}
 
 namespace experimental {
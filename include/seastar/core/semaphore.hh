@@ -28,6 +28,7 @@
 #include <seastar/core/abortable_fifo.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/core/abort_on_expiry.hh>
+#include <seastar/core/internal/deadline_queue.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <cassert>
@@ -163,7 +164,9 @@ class basic_semaphore : private ExceptionFactory {
     struct entry {
         promise<> pr;
         size_t nr;
-        std::optional<abort_on_expiry<clock>> timer;
+        // Waiters with the same deadline share a timer, so that waking up
+        // many of them doesn't cancel a timer for each
+        std::optional<internal::abort_on_deadline<clock>> timer;
         entry(promise<>&& pr_, size_t nr_) noexcept : pr(std::move(pr_)), nr(nr_) {}
     };
     struct expiry_handler {
@@ -0,0 +1,116 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/util/modules.hh>
+#include <seastar/util/noncopyable_function.hh>
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <tuple>
+#include <utility>
+#include <vector>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// Starts and stops a set of services in dependency order.
+///
+/// Each service is added along with the services it depends on, which must
+/// have been added before. start() starts every service as soon as its
+/// dependencies are up, so independent services start concurrently instead
+/// of one after the other, and a slow \ref sharded service only holds back
+/// the services which depend on it. stop() is the reverse: a service stops
+/// once the services depending on it are stopped.
+///
+/// \code
+/// service_graph g;
+/// auto db = g.add(database);
+/// auto cache = g.add(cache_service);
+/// g.add(api_server, {db, cache}, std::ref(database), std::ref(cache_service));
+/// co_await g.start();
+/// \endcode
+class service_graph {
+public:
+    /// Identifies a service added to the graph.
+    using service_id = size_t;
+private:
+    struct service {
+        noncopyable_function<future<> ()> start;
+        noncopyable_function<future<> ()> stop;
+        std::vector<service_id> deps;
+        bool started = false;
+    };
+    std::vector<service> _services;
+public:
+    /// Adds a service started and stopped by the given functions.
+    ///
+    /// \param start starts the service, after the services in \c deps
+    /// \param stop stops the service, after the services depending on it; called
+    ///        only if \c start succeeded
+    /// \param deps the services this service depends on
+    /// \return the id to pass in the dependencies of the services depending on it
+    /// \throws std::invalid_argument if a dependency wasn't added to this graph
+    service_id add(noncopyable_function<future<> ()> start, noncopyable_function<future<> ()> stop, std::vector<service_id> deps = {});
+
+    /// Adds a \ref sharded service.
+    ///
+    /// It is started by \ref sharded::start() with the given arguments, and
+    /// stopped by \ref sharded::stop(). The \c sharded object must outlive
+    /// the graph being stopped.
+    template <typename Service, typename... Args>
+    service_id add(sharded<Service>& s, std::vector<service_id> deps = {}, Args&&... args) {
+        return add([&s, args = std::make_tuple(std::forward<Args>(args)...)] () mutable {
+            return std::apply([&s] (auto&&... args) {
+                return s.start(std::move(args)...);
+            }, std::move(args));
+        }, [&s] {
+            return s.stop();
+        }, std::move(deps));
+    }
+
+    /// Starts all the services.
+    ///
+    /// If a service fails to start, the services depending on it are not
+    /// started, the ones which did start are stopped, and the returned
+    /// future fails with the exception of the first service, in the order
+    /// they were added, which failed to start.
+    future<> start();
+
+    /// Stops the started services.
+    ///
+    /// All of them are stopped, even if some fail to; the returned future
+    /// then fails with one of their exceptions.
+    future<> stop();
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
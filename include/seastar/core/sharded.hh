@@ -303,6 +303,30 @@ class sharded {
       }
     }
 
+    /// Invoke a function on all instances of `Service` through a fan-out tree.
+    ///
+    /// Like invoke_on_all(), but the calling shard only messages one shard per
+    /// group of \ref smp::fan_out_groups(), which relays to the others, see
+    /// \ref smp::invoke_on_all_hierarchical().
+    ///
+    /// \param options the options to forward to the \ref smp::submit_to()
+    ///         calls behind the scenes.
+    /// \param func function to be invoked on all shards
+    /// \return Future that becomes ready once all calls have completed
+    future<> invoke_on_all_hierarchical(smp_submit_to_options options, std::function<future<> (Service&)> func) noexcept {
+        return smp::invoke_on_all_hierarchical(options, [this, func = std::move(func)] {
+            return func(*get_local_service());
+        });
+    }
+
+    /// Invoke a function on all instances of `Service` through a fan-out tree.
+    ///
+    /// Passes the default \ref smp_submit_to_options to the
+    /// \ref smp::submit_to() called behind the scenes.
+    future<> invoke_on_all_hierarchical(std::function<future<> (Service&)> func) noexcept {
+        return invoke_on_all_hierarchical(smp_submit_to_options{}, std::move(func));
+    }
+
     /// Invoke a callable on all instances of  \c Service except the instance
     /// which is allocated on current shard.
     ///
@@ -407,6 +431,24 @@ class sharded {
                             std::move(reduce));
     }
 
+    /// Like map_reduce0(), but reduces the results through a fan-out tree.
+    ///
+    /// Results are first reduced within each group of \ref smp::fan_out_groups()
+    /// on one of its shards, so the calling shard only receives one partial
+    /// result per group, see \ref smp::map_reduce_hierarchical().
+    ///
+    /// \tparam  Reduce an associative binary function taking two Initial values
+    ///          and returning an Initial
+    template <typename Mapper, typename Initial, typename Reduce>
+    inline
+    future<Initial>
+    map_reduce0_hierarchical(Mapper map, Initial initial, Reduce reduce) {
+        return smp::map_reduce_hierarchical([this, map = std::move(map)] {
+            auto inst = get_local_service();
+            return std::invoke(map, *inst);
+        }, std::move(initial), std::move(reduce));
+    }
+
     /// The const version of \ref map_reduce0(Mapper map, Initial initial, Reduce reduce)
     template <typename Mapper, typename Initial, typename Reduce>
     inline
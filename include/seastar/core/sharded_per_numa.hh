@@ -0,0 +1,182 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <boost/range/irange.hpp>
+#include <cassert>
+#include <concepts>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <vector>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// Template helper to distribute a service across NUMA nodes.
+///
+/// Like \ref sharded, but with one instance of \c Service per NUMA node
+/// rather than per shard. Each instance is created, stopped and destroyed
+/// by the first shard of its node, so that its memory is local to the
+/// node, and all the shards of the node use it through \ref local(). This
+/// suits caches and lookup tables whose per-shard copies would cost too
+/// much memory, while sharing a single copy would make the shards of the
+/// other nodes cross the interconnect on each access.
+///
+/// \note Unlike with \ref sharded, the shards of a node call the instance
+///       concurrently, from different threads. The service must synchronize
+///       its own state, for instance by not modifying it after start(), or
+///       by keeping it in a \ref replicated.
+template <typename Service>
+class sharded_per_numa {
+    // Indexed by smp::numa_node_of()
+    std::vector<std::unique_ptr<Service>> _instances;
+private:
+    static shard_id node_leader(unsigned node) noexcept {
+        return smp::numa_node_shards()[node].front();
+    }
+    static auto all_nodes() noexcept {
+        return boost::irange<unsigned>(0, smp::numa_node_shards().size());
+    }
+public:
+    /// Constructs an empty \c sharded_per_numa object. No instances of the
+    /// service are created.
+    sharded_per_numa() noexcept = default;
+    sharded_per_numa(const sharded_per_numa&) = delete;
+    sharded_per_numa& operator=(const sharded_per_numa&) = delete;
+    /// Destroys a \c sharded_per_numa object. Must not be called if
+    /// the service is running.
+    ~sharded_per_numa() {
+        assert(_instances.empty());
+    }
+
+    /// Starts \c Service by constructing an instance on the first shard of
+    /// every NUMA node.
+    ///
+    /// \param args arguments to be copied to \c Service's constructor
+    /// \return a \ref seastar::future<> that becomes ready when all instances
+    ///         have been constructed.
+    template <typename... Args>
+    future<> start(Args&&... args) noexcept {
+      try {
+        _instances.resize(smp::numa_node_shards().size());
+        return parallel_for_each(all_nodes(), [this, args = std::make_tuple(std::forward<Args>(args)...)] (unsigned node) {
+            return smp::submit_to(node_leader(node), [this, node, args] () mutable {
+                _instances[node] = std::apply([] (auto&&... args) {
+                    return std::make_unique<Service>(std::move(args)...);
+                }, std::move(args));
+            });
+        }).handle_exception([this] (std::exception_ptr ex) {
+            return stop().then([ex = std::move(ex)] () mutable {
+                return make_exception_future<>(std::move(ex));
+            });
+        });
+      } catch (...) {
+        return current_exception_as_future();
+      }
+    }
+
+    /// Stops all started instances and destroys them.
+    ///
+    /// For every started instance, its \c stop() method is called, if it
+    /// exists, and then the instance is destroyed, on its node's first shard.
+    future<> stop() noexcept {
+      try {
+        return parallel_for_each(all_nodes(), [this] (unsigned node) {
+            return smp::submit_to(node_leader(node), [this, node] {
+                if (!_instances[node]) {
+                    return make_ready_future<>();
+                }
+                return internal::stop_sharded_instance(*_instances[node]).finally([this, node] {
+                    _instances[node].reset();
+                });
+            });
+        }).finally([this] {
+            _instances.clear();
+        });
+      } catch (...) {
+        return current_exception_as_future();
+      }
+    }
+
+    /// Returns a reference to the instance of the calling shard's NUMA node.
+    Service& local() noexcept {
+        return *_instances[smp::numa_node_of(this_shard_id())];
+    }
+    const Service& local() const noexcept {
+        return *_instances[smp::numa_node_of(this_shard_id())];
+    }
+
+    /// Checks whether the instance of the calling shard's NUMA node was started.
+    bool local_is_initialized() const noexcept {
+        return !_instances.empty() && _instances[smp::numa_node_of(this_shard_id())];
+    }
+
+    /// Invokes a callable on the instance of the calling shard's NUMA node,
+    /// on the calling shard.
+    ///
+    /// \param func a callable with signature `Value (Service&)` or
+    ///             `future<Value> (Service&)` (for some `Value` type)
+    /// \return the result of \c func, as a future.
+    template <typename Func>
+    requires std::invocable<Func, Service&>
+    futurize_t<std::invoke_result_t<Func, Service&>>
+    invoke_on_numa_local(Func&& func) noexcept {
+        return futurize_invoke(std::forward<Func>(func), local());
+    }
+
+    /// Invokes a callable on every instance, on the first shard of its node.
+    ///
+    /// \param func a callable with signature `void (Service&)` or
+    ///             `future<> (Service&)`, copied for each node.
+    /// \return a future that becomes ready once all calls have completed.
+    template <typename Func>
+    requires std::invocable<Func, Service&> && std::copy_constructible<Func>
+    future<> invoke_on_all(Func func) noexcept {
+      try {
+        return parallel_for_each(all_nodes(), [this, func = std::move(func)] (unsigned node) {
+            return smp::submit_to(node_leader(node), [this, node, func] () mutable {
+                return futurize_invoke(func, *_instances[node]).discard_result();
+            });
+        });
+      } catch (...) {
+        return current_exception_as_future();
+      }
+    }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -28,9 +28,13 @@
 #include <assert.h>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <memory>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/align.hh>
 #include <seastar/core/memory.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/timer.hh>
 
 namespace seastar {
 
@@ -123,8 +127,54 @@ struct slab_page_desc {
     friend class slab_allocator;
 };
 
+/*
+ * Provides the memory of slab pages, e.g. from a file mapping so that
+ * items outlive the process. The default one uses aligned_alloc().
+ */
+class slab_page_allocator {
+public:
+    virtual ~slab_page_allocator() = default;
+    // Returns nullptr on failure
+    virtual void* allocate_page(size_t page_size, size_t alignment, size_t object_size) = 0;
+    virtual void free_page(void* page) noexcept = 0;
+    // The page now holds objects of another size
+    virtual void reassign_page(void* page, size_t object_size) noexcept {}
+};
+
+class malloc_slab_page_allocator final : public slab_page_allocator {
+public:
+    void* allocate_page(size_t page_size, size_t alignment, size_t object_size) override {
+        return aligned_alloc(alignment, page_size);
+    }
+    void free_page(void* page) noexcept override {
+        ::free(page);
+    }
+};
+
+/*
+ * Order in which the items of a slab class are evicted.
+ */
+enum class slab_eviction_policy {
+    // Least recently used first.
+    lru,
+    // Segmented LRU: items used again after their insertion move to a
+    // protected segment (80% of the items), which is only evicted from
+    // once the probationary one is empty.
+    segmented_lru,
+    // W-TinyLFU: new items enter a small LRU window (1% of the items).
+    // When eviction is needed while the window is full, the window's
+    // least recent item competes with the main segmented LRU's victim, and
+    // the admission function, typically backed by a frequency sketch,
+    // decides which one stays.
+    w_tinylfu,
+};
+
 class slab_item_base {
     boost::intrusive::list_member_hook<> _lru_link;
+    enum class segment : uint8_t { probation, protected_, window };
+    segment _segment = segment::probation;
+    // In milliseconds of lowres_clock, wrapping around
+    uint32_t _last_access = 0;
 
     template<typename Item>
     friend class slab_class;
@@ -136,30 +186,143 @@ class slab_class {
     boost::intrusive::list<slab_page_desc,
         boost::intrusive::member_hook<slab_page_desc, boost::intrusive::list_member_hook<>,
         &slab_page_desc::_free_pages_link>> _free_slab_pages;
-    boost::intrusive::list<slab_item_base,
+    using lru_list = boost::intrusive::list<slab_item_base,
         boost::intrusive::member_hook<slab_item_base, boost::intrusive::list_member_hook<>,
-        &slab_item_base::_lru_link>> _lru;
+        &slab_item_base::_lru_link>>;
+    using segment = slab_item_base::segment;
+    // The only segment with the lru policy
+    lru_list _lru;
+    lru_list _protected;
+    lru_list _window;
+    size_t _lru_items = 0;
+    size_t _protected_items = 0;
+    size_t _window_items = 0;
+    slab_eviction_policy _policy = slab_eviction_policy::lru;
+    size_t _pages = 0;
+    // Evictions, and age of the last evicted item, for rebalancing pages
+    uint64_t _evictions = 0;
+    uint64_t _evictions_at_mark = 0;
+    uint32_t _last_eviction_age = 0;
     size_t _size; // size of objects
     uint8_t _slab_class_id;
 private:
+    static uint32_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(lowres_clock::now().time_since_epoch()).count();
+    }
+
+    lru_list& list_of(segment s) {
+        switch (s) {
+        case segment::probation: return _lru;
+        case segment::protected_: return _protected;
+        case segment::window: return _window;
+        }
+        abort();
+    }
+
+    size_t& items_of(segment s) {
+        switch (s) {
+        case segment::probation: return _lru_items;
+        case segment::protected_: return _protected_items;
+        case segment::window: return _window_items;
+        }
+        abort();
+    }
+
+    size_t items() const {
+        return _lru_items + _protected_items + _window_items;
+    }
+
+    void push_front(slab_item_base& item_ref, segment s) {
+        item_ref._segment = s;
+        list_of(s).push_front(item_ref);
+        items_of(s)++;
+    }
+
+    void unlink(slab_item_base& item_ref) {
+        auto& list = list_of(item_ref._segment);
+        list.erase(list.iterator_to(item_ref));
+        items_of(item_ref._segment)--;
+    }
+
+    size_t window_limit() const {
+        return std::max<size_t>(1, items() / 100);
+    }
+
+    size_t protected_limit() const {
+        return (items() - _window_items) * 4 / 5;
+    }
+
+    // Moves the least recent items of the window and of the protected
+    // segment to the probationary one, until they fit their share.
+    void rebalance() {
+        while (_window_items > window_limit()) {
+            auto& item_ref = _window.back();
+            unlink(item_ref);
+            push_front(item_ref, segment::probation);
+        }
+        while (_protected_items > protected_limit()) {
+            auto& item_ref = _protected.back();
+            unlink(item_ref);
+            push_front(item_ref, segment::probation);
+        }
+    }
+
     template<typename... Args>
     inline
     Item* create_item(void *object, uint32_t slab_page_index, Args&&... args) {
         Item *new_item = new(object) Item(slab_page_index, std::forward<Args>(args)...);
-        _lru.push_front(reinterpret_cast<slab_item_base&>(*new_item));
+        auto& item_ref = reinterpret_cast<slab_item_base&>(*new_item);
+        item_ref._last_access = now_ms();
+        if (_policy == slab_eviction_policy::w_tinylfu) {
+            push_front(item_ref, segment::window);
+            rebalance();
+        } else {
+            push_front(item_ref, segment::probation);
+        }
         return new_item;
     }
 
+    slab_item_base* main_victim() {
+        if (!_lru.empty()) {
+            return &_lru.back();
+        }
+        return _protected.empty() ? nullptr : &_protected.back();
+    }
+
+    // With w_tinylfu, when the window is full, its least recent item is
+    // the candidate for the main segments; it is the victim unless the
+    // admission function prefers it to the main segments' victim.
+    slab_item_base* pick_victim(std::function<bool (Item& candidate, Item& victim)>& admit_func) {
+        auto victim = main_victim();
+        if (_policy != slab_eviction_policy::w_tinylfu || _window.empty() || _window_items < window_limit()) {
+            return victim ? victim : (_window.empty() ? nullptr : &_window.back());
+        }
+        auto& candidate = _window.back();
+        if (!victim) {
+            return &candidate;
+        }
+        if (admit_func && admit_func(reinterpret_cast<Item&>(candidate), reinterpret_cast<Item&>(*victim))) {
+            unlink(candidate);
+            push_front(candidate, segment::probation);
+            return victim;
+        }
+        return &candidate;
+    }
+
     inline
-    std::pair<void *, uint32_t> evict_lru_item(std::function<void (Item& item_ref)>& erase_func) {
-        if (_lru.empty()) {
+    std::pair<void *, uint32_t> evict_lru_item(std::function<void (Item& item_ref)>& erase_func,
+                                               std::function<bool (Item& candidate, Item& victim)>& admit_func) {
+        auto victim_base = pick_victim(admit_func);
+        if (!victim_base) {
             return { nullptr, 0U };
         }
 
-        Item& victim = reinterpret_cast<Item&>(_lru.back());
+        Item& victim = reinterpret_cast<Item&>(*victim_base);
         uint32_t index = victim.get_slab_page_index();
         assert(victim.is_unlocked());
-        _lru.erase(_lru.iterator_to(reinterpret_cast<slab_item_base&>(victim)));
+        unlink(*victim_base);
+        _evictions++;
+        _last_eviction_age = now_ms() - victim_base->_last_access;
         // WARNING: You need to make sure that erase_func will not release victim back to slab.
         erase_func(victim);
 
@@ -175,6 +338,13 @@ class slab_class {
     ~slab_class() {
         _free_slab_pages.clear();
         _lru.clear();
+        _protected.clear();
+        _window.clear();
+    }
+
+    void set_eviction_policy(slab_eviction_policy policy) {
+        assert(!items());
+        _policy = policy;
     }
 
     size_t size() const {
@@ -186,7 +356,7 @@ class slab_class {
     }
 
     bool has_no_slab_pages() const {
-        return _lru.empty();
+        return !items();
     }
 
     template<typename... Args>
@@ -203,12 +373,12 @@ class slab_class {
     }
 
     template<typename... Args>
-    Item *create_from_new_page(uint64_t max_object_size, uint32_t slab_page_index,
+    Item *create_from_new_page(uint64_t max_object_size, uint32_t slab_page_index, slab_page_allocator& pages,
                                std::function<void (slab_page_desc& desc)> insert_slab_page_desc,
                                Args&&... args) {
         // allocate slab page.
         constexpr size_t alignment = std::alignment_of_v<Item>;
-        void *slab_page = aligned_alloc(alignment, max_object_size);
+        void *slab_page = pages.allocate_page(max_object_size, alignment, _size);
         if (!slab_page) {
             throw std::bad_alloc{};
         }
@@ -219,11 +389,12 @@ class slab_class {
             auto objects = max_object_size / _size;
             desc = new slab_page_desc(slab_page, objects, _size, _slab_class_id, slab_page_index);
         } catch (const std::bad_alloc& e) {
-            ::free(slab_page);
+            pages.free_page(slab_page);
             throw std::bad_alloc{};
         }
 
         _free_slab_pages.push_front(*desc);
+        _pages++;
         insert_slab_page_desc(*desc);
 
         // first object from the allocated slab page is returned.
@@ -231,8 +402,9 @@ class slab_class {
     }
 
     template<typename... Args>
-    Item *create_from_lru(std::function<void (Item& item_ref)>& erase_func, Args&&... args) {
-        auto ret = evict_lru_item(erase_func);
+    Item *create_from_lru(std::function<void (Item& item_ref)>& erase_func,
+                          std::function<bool (Item& candidate, Item& victim)>& admit_func, Args&&... args) {
+        auto ret = evict_lru_item(erase_func, admit_func);
         if (!ret.first) {
             throw std::bad_alloc{};
         }
@@ -241,7 +413,7 @@ class slab_class {
 
     void free_item(Item *item, slab_page_desc& desc) {
         void *object = item;
-        _lru.erase(_lru.iterator_to(reinterpret_cast<slab_item_base&>(*item)));
+        unlink(reinterpret_cast<slab_item_base&>(*item));
         desc.free_object(object);
         if (desc.size() == 1) {
             // push back desc into the list of slab pages with free objects.
@@ -250,19 +422,80 @@ class slab_class {
     }
 
     void touch_item(Item *item) {
-        auto& item_ref = reinterpret_cast<slab_item_base&>(*item);
-        _lru.erase(_lru.iterator_to(item_ref));
-        _lru.push_front(item_ref);
+        remove_item_from_lru(item);
+        insert_item_into_lru(item);
     }
 
     void remove_item_from_lru(Item *item) {
-        auto& item_ref = reinterpret_cast<slab_item_base&>(*item);
-        _lru.erase(_lru.iterator_to(item_ref));
+        unlink(reinterpret_cast<slab_item_base&>(*item));
     }
 
+    // Inserts back an item that was used: items of the window stay there,
+    // the others are protected unless the policy is lru.
     void insert_item_into_lru(Item *item) {
         auto& item_ref = reinterpret_cast<slab_item_base&>(*item);
-        _lru.push_front(item_ref);
+        item_ref._last_access = now_ms();
+        if (_policy == slab_eviction_policy::lru) {
+            push_front(item_ref, segment::probation);
+        } else if (item_ref._segment == segment::window) {
+            push_front(item_ref, segment::window);
+        } else {
+            push_front(item_ref, segment::protected_);
+            rebalance();
+        }
+    }
+
+    // Links an item of an adopted page, see slab_allocator::adopt_page()
+    void adopt_item(Item* item) {
+        auto& item_ref = reinterpret_cast<slab_item_base&>(*item);
+        item_ref._last_access = now_ms();
+        push_front(item_ref, segment::probation);
+    }
+
+    size_t pages() const {
+        return _pages;
+    }
+
+    void page_added() {
+        _pages++;
+    }
+
+    void page_removed() {
+        _pages--;
+    }
+
+    // The item that would be evicted next, if any
+    Item* oldest_item() {
+        auto victim = main_victim();
+        if (!victim && !_window.empty()) {
+            victim = &_window.back();
+        }
+        return reinterpret_cast<Item*>(victim);
+    }
+
+    // Time since the oldest item was used, or the maximum if the class
+    // holds no items
+    uint32_t oldest_item_age() {
+        auto item = oldest_item();
+        return item ? now_ms() - reinterpret_cast<slab_item_base*>(item)->_last_access : std::numeric_limits<uint32_t>::max();
+    }
+
+    uint32_t last_eviction_age() const {
+        return _last_eviction_age;
+    }
+
+    // Evictions since the previous call
+    uint64_t mark_evictions() {
+        return _evictions - std::exchange(_evictions_at_mark, _evictions);
+    }
+
+    slab_page_desc* any_free_page() {
+        return _free_slab_pages.empty() ? nullptr : &_free_slab_pages.back();
+    }
+
+    void add_desc_to_free_list(slab_page_desc& desc) {
+        assert(desc.slab_class_id() == _slab_class_id);
+        _free_slab_pages.push_back(desc);
     }
 
     void remove_desc_from_free_list(slab_page_desc& desc) {
@@ -279,6 +512,9 @@ class slab_allocator {
     seastar::metrics::metric_groups _metrics;
     // erase_func() is used to remove the item from the cache using slab.
     std::function<void (Item& item_ref)> _erase_func;
+    // admit_func() decides whether an item leaving the window of the
+    // w_tinylfu policy should replace the main segments' victim.
+    std::function<bool (Item& candidate, Item& victim)> _admit_func;
     std::vector<slab_page_desc*> _slab_pages_vector;
     boost::intrusive::list<slab_page_desc,
         boost::intrusive::member_hook<slab_page_desc, boost::intrusive::list_member_hook<>,
@@ -288,19 +524,16 @@ class slab_allocator {
     struct collectd_stats {
         uint64_t allocs;
         uint64_t frees;
-    } _stats;
+        uint64_t page_moves;
+    } _stats{};
+    timer<lowres_clock> _rebalance_timer;
     memory::reclaimer *_reclaimer = nullptr;
     bool _reclaimed = false;
+    std::unique_ptr<slab_page_allocator> _pages = std::make_unique<malloc_slab_page_allocator>();
 private:
-    memory::reclaiming_result evict_lru_slab_page() {
-        if (_slab_page_desc_lru.empty()) {
-            // NOTE: Nothing to evict. If this happens, it implies that all
-            // slab pages in the slab are being used at the same time.
-            // That being said, this event is very unlikely to happen.
-            return memory::reclaiming_result::reclaimed_nothing;
-        }
-        // get descriptor of the least-recently-used slab page and related info.
-        auto& desc = _slab_page_desc_lru.back();
+    // Erases the items of a slab page, none of which may be locked, and
+    // detaches the page from its slab class, which is returned.
+    slab_class<Item>* release_slab_page(slab_page_desc& desc) {
         assert(desc.refcnt() == 0);
         uint8_t slab_class_id = desc.slab_class_id();
         auto slab_class = get_slab_class(slab_class_id);
@@ -313,10 +546,10 @@ class slab_allocator {
             // and sort the array of free objects for binary search later on.
             std::sort(free_objects.begin(), free_objects.end());
         }
-        // remove desc from the list of slab page descriptors.
-        _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
-        // remove desc from the slab page vector.
-        _slab_pages_vector[desc.index()] = nullptr;
+        if (_reclaimer) {
+            // remove desc from the list of slab page descriptors.
+            _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
+        }
 
         // Iterate through objects in the slab page and if the object is an allocated
         // item, the item should be removed from LRU and then erased.
@@ -337,14 +570,52 @@ class slab_allocator {
             _erase_func(*item);
             _stats.frees++;
         }
+        slab_class->page_removed();
+        return slab_class;
+    }
+
+    memory::reclaiming_result evict_lru_slab_page() {
+        if (_slab_page_desc_lru.empty()) {
+            // NOTE: Nothing to evict. If this happens, it implies that all
+            // slab pages in the slab are being used at the same time.
+            // That being said, this event is very unlikely to happen.
+            return memory::reclaiming_result::reclaimed_nothing;
+        }
+        // get descriptor of the least-recently-used slab page and related info.
+        auto& desc = _slab_page_desc_lru.back();
+        void *slab_page = desc.slab_page();
+        release_slab_page(desc);
+        // remove desc from the slab page vector.
+        _slab_pages_vector[desc.index()] = nullptr;
 #ifdef SEASTAR_DEBUG
         printf("lru slab page eviction succeeded! desc_empty?=%d\n", desc.empty());
 #endif
-        ::free(slab_page); // free slab page object
+        _pages->free_page(slab_page); // free slab page object
         delete &desc; // free its descriptor
         return memory::reclaiming_result::reclaimed_something;
     }
 
+    // Gives the page of @desc, emptied, to @dst
+    void move_slab_page(slab_page_desc& desc, slab_class<Item>& dst) {
+        void *slab_page = desc.slab_page();
+        auto index = desc.index();
+        release_slab_page(desc);
+        delete &desc;
+        _slab_pages_vector[index] = nullptr;
+        _pages->reassign_page(slab_page, dst.size());
+
+        auto new_desc = new slab_page_desc(slab_page, _max_object_size / dst.size(), dst.size(), get_class_id(dst), index);
+        // unlike for a new page, the first object isn't used right away
+        new_desc->free_object(slab_page);
+        _slab_pages_vector[index] = new_desc;
+        if (_reclaimer) {
+            _slab_page_desc_lru.push_front(*new_desc);
+        }
+        dst.add_desc_to_free_list(*new_desc);
+        dst.page_added();
+        _stats.page_moves++;
+    }
+
     /*
      * Reclaim the least recently used slab page that is unused.
      */
@@ -391,6 +662,10 @@ class slab_allocator {
         return &_slab_classes[dist];
     }
 
+    uint8_t get_class_id(const slab_class<Item>& sc) const {
+        return &sc - _slab_classes.data();
+    }
+
     slab_class<Item>* get_slab_class(const uint8_t slab_class_id) {
         assert(slab_class_id >= 0 && slab_class_id < _slab_classes.size());
         return &_slab_classes[slab_class_id];
@@ -401,6 +676,7 @@ class slab_allocator {
         _metrics.add_group("slab", {
             sm::make_counter("malloc_total_operations", sm::description("Total number of slab malloc operations"), _stats.allocs),
             sm::make_counter("free_total_operations", sm::description("Total number of slab free operations"), _stats.frees),
+            sm::make_counter("page_moves_total_operations", sm::description("Total number of slab pages moved to another slab class"), _stats.page_moves),
             sm::make_gauge("malloc_objects", sm::description("Number of slab created objects currently in memory"), [this] {
                 return _stats.allocs - _stats.frees;
             })
@@ -446,12 +722,134 @@ class slab_allocator {
             if (!desc) {
                 continue;
             }
-            ::free(desc->slab_page());
+            _pages->free_page(desc->slab_page());
             delete desc;
         }
         delete _reclaimer;
     }
 
+    /**
+     * Set the order in which items are evicted, before any is created.
+     */
+    void set_eviction_policy(slab_eviction_policy policy, std::function<bool (Item& candidate, Item& victim)> admit_func = {}) {
+        for (auto& slab_class : _slab_classes) {
+            slab_class.set_eviction_policy(policy);
+        }
+        _admit_func = std::move(admit_func);
+    }
+
+    /**
+     * Take slab pages from @pages, before any is allocated.
+     */
+    void set_page_allocator(std::unique_ptr<slab_page_allocator> pages) {
+        assert(_slab_pages_vector.empty());
+        _pages = std::move(pages);
+    }
+
+    /**
+     * Adopt a slab page that already holds items, e.g. one of a mapping
+     * left by a previous process, given the object size it was allocated
+     * for. For each object, restore(object, slab_page_index) reconstructs
+     * the item in place and returns it, or returns nullptr if the object is
+     * free. Returns false, leaving the page alone, when no slab class has
+     * this object size.
+     */
+    template<typename Restore>
+    bool adopt_page(void* slab_page, size_t object_size, Restore restore) {
+        auto slab_class = get_slab_class(object_size);
+        if (!slab_class || slab_class->size() != object_size || (!_reclaimer && !_available_slab_pages)) {
+            return false;
+        }
+        auto objects = _max_object_size / object_size;
+        auto index = _slab_pages_vector.size();
+        auto desc = new slab_page_desc(slab_page, objects, object_size, get_class_id(*slab_class), index);
+        auto& free_objects = desc->free_objects();
+        free_objects.clear();
+        _slab_pages_vector.push_back(desc);
+        if (_available_slab_pages > 0) {
+            _available_slab_pages--;
+        }
+        auto object = reinterpret_cast<uintptr_t>(slab_page);
+        for (auto i = 0u; i < objects; i++, object += object_size) {
+            Item* item = restore(reinterpret_cast<void*>(object), uint32_t(index));
+            if (item) {
+                slab_class->adopt_item(item);
+                _stats.allocs++;
+            } else {
+                free_objects.push_back(object);
+            }
+        }
+        if (_reclaimer) {
+            _slab_page_desc_lru.push_front(*desc);
+        }
+        if (!desc->empty()) {
+            slab_class->add_desc_to_free_list(*desc);
+        }
+        slab_class->page_added();
+        return true;
+    }
+
+    /**
+     * Move one slab page between slab classes, if the memory is unevenly
+     * used: the destination is the class whose evictions, since the
+     * previous call, were of the most recently used items, and the source
+     * the class whose least recently used item is the oldest, if it is
+     * more than @age_ratio times older than the destination's recently
+     * evicted items. Classes keep at least one page. The items of the
+     * moved page are evicted. Returns whether a page moved.
+     */
+    bool rebalance(double age_ratio = 2.0) {
+        slab_class<Item>* dst = nullptr;
+        for (auto& sc : _slab_classes) {
+            if (sc.mark_evictions() && (!dst || sc.last_eviction_age() < dst->last_eviction_age())) {
+                dst = &sc;
+            }
+        }
+        if (!dst) {
+            return false;
+        }
+        slab_class<Item>* src = nullptr;
+        uint32_t src_age = 0;
+        for (auto& sc : _slab_classes) {
+            if (&sc == dst || sc.pages() < 2) {
+                continue;
+            }
+            auto age = sc.oldest_item_age();
+            if (!src || age > src_age) {
+                src = &sc;
+                src_age = age;
+            }
+        }
+        if (!src || src_age <= age_ratio * dst->last_eviction_age()) {
+            return false;
+        }
+        // The page of the oldest item, or, for a class without items, any
+        slab_page_desc* desc;
+        if (auto item = src->oldest_item()) {
+            desc = &get_slab_page_desc(item);
+        } else {
+            desc = src->any_free_page();
+        }
+        if (!desc || desc->refcnt()) {
+            return false;
+        }
+        move_slab_page(*desc, *dst);
+        return true;
+    }
+
+    /**
+     * Call rebalance(@age_ratio) every @period in the background, on the
+     * shard of the allocator.
+     */
+    void enable_rebalancing(lowres_clock::duration period, double age_ratio = 2.0) {
+        _rebalance_timer.set_callback([this, age_ratio] { rebalance(age_ratio); });
+        _rebalance_timer.rearm_periodic(period);
+    }
+
+    void disable_rebalancing() {
+        _rebalance_timer.cancel();
+    }
+
     /**
      * Create an item from a given slab class based on requested size.
      */
@@ -469,7 +867,7 @@ class slab_allocator {
         } else {
             if (can_allocate_page(*slab_class)) {
                 auto index_to_insert = _slab_pages_vector.size();
-                item = slab_class->create_from_new_page(_max_object_size, index_to_insert,
+                item = slab_class->create_from_new_page(_max_object_size, index_to_insert, *_pages,
                     [this](slab_page_desc& desc) {
                         if (_reclaimer) {
                             // insert desc into the LRU list of slab page descriptors.
@@ -484,7 +882,7 @@ class slab_allocator {
                 }
                 _stats.allocs++;
             } else if (_erase_func) {
-                item = slab_class->create_from_lru(_erase_func, std::forward<Args>(args)...);
+                item = slab_class->create_from_lru(_erase_func, _admit_func, std::forward<Args>(args)...);
             }
         }
         return item;
@@ -492,13 +890,10 @@ class slab_allocator {
 
     void lock_item(Item *item) {
         auto& desc = get_slab_page_desc(item);
-        if (_reclaimer) {
-            auto& refcnt = desc.refcnt();
-
-            if (++refcnt == 1) {
-                // remove slab page descriptor from list of slab page descriptors.
-                _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
-            }
+        auto& refcnt = desc.refcnt();
+        if (++refcnt == 1 && _reclaimer) {
+            // remove slab page descriptor from list of slab page descriptors.
+            _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
         }
         // remove item from the lru of its slab class.
         auto slab_class = get_slab_class(desc.slab_class_id());
@@ -507,13 +902,10 @@ class slab_allocator {
 
     void unlock_item(Item *item) {
         auto& desc = get_slab_page_desc(item);
-        if (_reclaimer) {
-            auto& refcnt = desc.refcnt();
-
-            if (--refcnt == 0) {
-                // insert slab page descriptor back into list of slab page descriptors.
-                _slab_page_desc_lru.push_front(desc);
-            }
+        auto& refcnt = desc.refcnt();
+        if (--refcnt == 0 && _reclaimer) {
+            // insert slab page descriptor back into list of slab page descriptors.
+            _slab_page_desc_lru.push_front(desc);
         }
         // insert item into the lru of its slab class.
         auto slab_class = get_slab_class(desc.slab_class_id());
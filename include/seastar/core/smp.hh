@@ -23,12 +23,14 @@
 
 #include <seastar/core/future.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/map_reduce.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor_config.hh>
 #include <seastar/core/resource.hh>
 #include <seastar/core/shard_id.hh>
+#include <seastar/core/internal/stealable_work.hh>
 #include <seastar/util/modules.hh>
 
 #ifndef SEASTAR_MODULE
@@ -186,6 +188,7 @@ smp_service_group_semaphore& get_smp_service_groups_semaphore(unsigned ssg_id, s
 class smp_message_queue {
     static constexpr size_t queue_length = 128;
     static constexpr size_t batch_size = 16;
+    static constexpr size_t max_request_batch_size = queue_length / 4;
     static constexpr size_t prefetch_cnt = 2;
     struct work_item;
     struct lf_queue_remote {
@@ -207,6 +210,10 @@ class smp_message_queue {
         size_t _last_snt_batch = 0;
         size_t _last_cmpl_batch = 0;
         size_t _current_queue_length = 0;
+        size_t _request_batch_size = 1;
+        // steady_clock nanoseconds
+        int64_t _request_batch_started = 0;
+        int64_t _request_batch_wait = 0;
     };
     // keep this between two structures with statistics
     // this makes sure that they have at least one cache line
@@ -224,7 +231,23 @@ class smp_message_queue {
         virtual void fail_with(std::exception_ptr) = 0;
         void process();
         virtual void complete() = 0;
+        // Destroys the item and frees its memory, on the sending shard
+        virtual void dispose() noexcept = 0;
     };
+    struct work_item_disposer {
+        void operator()(work_item* wi) const noexcept {
+            wi->dispose();
+        }
+    };
+    using work_item_ptr = std::unique_ptr<work_item, work_item_disposer>;
+    // Small work items live in fixed size slots, which the sending shard
+    // recycles after processing the response, so that steady state calls
+    // don't allocate
+    static constexpr size_t work_item_slot_size = 256;
+    static constexpr size_t max_free_work_item_slots = queue_length;
+    std::vector<void*> _free_work_item_slots;
+    void* allocate_work_item_slot();
+    void free_work_item_slot(void* slot) noexcept;
     template <typename Func>
     struct async_work_item : work_item {
         smp_message_queue& _queue;
@@ -266,6 +289,19 @@ class smp_message_queue {
             }
         }
         future_type get_future() { return _promise.get_future(); }
+        static constexpr bool pooled() noexcept {
+            return sizeof(async_work_item) <= work_item_slot_size
+                    && alignof(async_work_item) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+        }
+        virtual void dispose() noexcept override {
+            if constexpr (pooled()) {
+                auto& queue = _queue;
+                this->~async_work_item();
+                queue.free_work_item_slot(this);
+            } else {
+                delete this;
+            }
+        }
     };
     union tx_side {
         tx_side() {}
@@ -282,9 +318,15 @@ class smp_message_queue {
     template <typename Func>
     futurize_t<std::invoke_result_t<Func>> submit(shard_id t, smp_submit_to_options options, Func&& func) noexcept {
         memory::scoped_critical_alloc_section _;
-        auto wi = std::make_unique<async_work_item<Func>>(*this, options.service_group, std::forward<Func>(func));
+        using item_type = async_work_item<Func>;
+        item_type* wi;
+        if constexpr (item_type::pooled()) {
+            wi = new (allocate_work_item_slot()) item_type(*this, options.service_group, std::forward<Func>(func));
+        } else {
+            wi = new item_type(*this, options.service_group, std::forward<Func>(func));
+        }
         auto fut = wi->get_future();
-        submit_item(t, options.timeout, std::move(wi));
+        submit_item(t, options.timeout, work_item_ptr(wi));
         return fut;
     }
     void start(unsigned cpuid);
@@ -295,9 +337,10 @@ class smp_message_queue {
     void stop();
 private:
     void work();
-    void submit_item(shard_id t, smp_timeout_clock::time_point timeout, std::unique_ptr<work_item> wi);
+    void submit_item(shard_id t, smp_timeout_clock::time_point timeout, work_item_ptr wi);
     void respond(work_item* wi);
     void move_pending();
+    size_t request_batch_size() const noexcept;
     void flush_request_batch();
     void flush_response_batch();
     bool has_unflushed_responses() const;
@@ -323,6 +366,10 @@ class smp : public std::enable_shared_from_this<smp> {
     std::unique_ptr<smp_message_queue*[], qs_deleter> _qs_owner;
     static thread_local smp_message_queue**_qs;
     static thread_local std::thread::id _tmain;
+    static std::vector<std::vector<shard_id>> _fan_out_groups;
+    static std::vector<size_t> _shard_fan_out_group;
+    static std::vector<std::vector<shard_id>> _numa_node_shards;
+    static std::vector<unsigned> _shard_numa_node;
     bool _using_dpdk = false;
 
 private:
@@ -393,8 +440,27 @@ class smp : public std::enable_shared_from_this<smp> {
     static futurize_t<std::invoke_result_t<Func>> submit_to(unsigned t, Func&& func) noexcept {
         return submit_to(t, default_smp_service_group(), std::forward<Func>(func));
     }
+    /// Runs a function on the current core, or on an idle core of the same NUMA node.
+    ///
+    /// The function is queued in the current scheduling group. If, before its
+    /// turn comes, another core on the same NUMA node runs out of work, that
+    /// core may run it instead (in the same scheduling group), and the result
+    /// is delivered back to the calling core. Work stealing is disabled unless
+    /// the reactor is started with \c --work-stealing, in which case this
+    /// behaves like a plain task submission.
+    ///
+    /// \param func a callable to run, it must be self-contained, i.e. fit for
+    ///          smp::submit_to(): it may run on any core of this NUMA node,
+    ///          but is moved and destroyed on the calling core.
+    /// \return whatever \c func returns, as a future<>
+    template <typename Func>
+    static futurize_t<std::invoke_result_t<Func>> submit_stealable(Func&& func) noexcept;
     static bool poll_queues();
     static bool pure_poll_queues();
+    /// \cond internal
+    // Wakes shard t up if it sleeps, so that it polls its queues
+    static void wakeup(shard_id t) noexcept;
+    /// \endcond
     static boost::integer_range<unsigned> all_cpus() noexcept {
         return boost::irange(0u, count);
     }
@@ -428,6 +494,92 @@ class smp : public std::enable_shared_from_this<smp> {
     static future<> invoke_on_all(Func&& func) noexcept {
         return invoke_on_all(smp_submit_to_options{}, std::forward<Func>(func));
     }
+    /// Invokes func on all shards through a fan-out tree.
+    ///
+    /// Like invoke_on_all(), but instead of messaging every shard itself, the
+    /// calling shard only messages one shard in each group of \ref fan_out_groups(),
+    /// which in turn runs \c func on the members of its group and reports back
+    /// once they are all done. This bounds the number of messages any single
+    /// shard sends and receives, at the cost of an extra hop.
+    ///
+    /// \param options the options to forward to the \ref smp::submit_to()
+    ///         calls behind the scenes.
+    /// \param func the function to be invoked on each shard. May return void or
+    ///         future<>. Each async invocation will work with a separate copy
+    ///         of \c func.
+    /// \returns a future that resolves when all async invocations finish.
+    template<typename Func>
+    requires std::is_nothrow_move_constructible_v<Func> && std::is_copy_constructible_v<Func>
+    static future<> invoke_on_all_hierarchical(smp_submit_to_options options, Func func) noexcept {
+        static_assert(std::is_same_v<future<>, typename futurize<std::invoke_result_t<Func>>::type>, "bad Func signature");
+        return parallel_for_each(boost::irange<size_t>(0, _fan_out_groups.size()), [options, &func] (size_t g) {
+            return smp::submit_to(fan_out_group_leader(g), options, [options, func, g] {
+                return parallel_for_each(_fan_out_groups[g], [options, &func] (shard_id id) {
+                    return smp::submit_to(id, options, Func(func));
+                });
+            });
+        });
+    }
+    /// Invokes func on all shards through a fan-out tree.
+    ///
+    /// Passes the default \ref smp_submit_to_options to the
+    /// \ref smp::submit_to() called behind the scenes.
+    template<typename Func>
+    requires std::is_nothrow_move_constructible_v<Func> && std::is_copy_constructible_v<Func>
+    static future<> invoke_on_all_hierarchical(Func func) noexcept {
+        return invoke_on_all_hierarchical(smp_submit_to_options{}, std::move(func));
+    }
+    /// Runs \c map on all shards and reduces the results through a fan-out tree.
+    ///
+    /// The results of the members of each group of \ref fan_out_groups() are
+    /// reduced on one shard of the group, and only these partial results are
+    /// sent to the calling shard, where they are reduced into \c initial.
+    ///
+    /// \param map callable with the signature `Initial ()` or `future<Initial> ()`,
+    ///        copied to each shard
+    /// \param initial initial value used as the first input to \c reduce.
+    /// \param reduce binary function taking two Initial values and returning an
+    ///        Initial. Since results are reduced in groups first it must be
+    ///        associative.
+    /// \return the reduced result
+    template <typename Mapper, typename Initial, typename Reduce>
+    requires std::is_copy_constructible_v<Mapper> && std::is_copy_constructible_v<Reduce>
+    static future<Initial> map_reduce_hierarchical(Mapper map, Initial initial, Reduce reduce) {
+        auto reduce_group = [map = std::move(map), reduce] (size_t g) {
+            return smp::submit_to(fan_out_group_leader(g), [map, reduce, g] {
+                // Only the root starts from initial, other partials start empty
+                return ::seastar::map_reduce(_fan_out_groups[g], [&map] (shard_id id) {
+                    return smp::submit_to(id, Mapper(map));
+                }, std::optional<Initial>(), [reduce] (std::optional<Initial> acc, Initial v) mutable -> std::optional<Initial> {
+                    return acc ? std::invoke(reduce, std::move(*acc), std::move(v)) : std::move(v);
+                }).then([] (std::optional<Initial> acc) {
+                    return std::move(*acc);
+                });
+            });
+        };
+        return ::seastar::map_reduce(boost::irange<size_t>(0, _fan_out_groups.size()), std::move(reduce_group),
+                std::move(initial), std::move(reduce));
+    }
+    /// Shards grouped for \ref invoke_on_all_hierarchical() and \ref map_reduce_hierarchical().
+    ///
+    /// Shards of the same NUMA node are grouped together, in chunks of at most
+    /// \ref max_fan_out_group_size consecutive shards, which usually share a
+    /// last-level cache as well.
+    static const std::vector<std::vector<shard_id>>& fan_out_groups() noexcept {
+        return _fan_out_groups;
+    }
+    static constexpr size_t max_fan_out_group_size = 16;
+    /// The shards of each NUMA node the shards run on.
+    ///
+    /// Nodes are numbered from 0 in increasing order of their system node
+    /// ids, and only nodes with shards are listed.
+    static const std::vector<std::vector<shard_id>>& numa_node_shards() noexcept {
+        return _numa_node_shards;
+    }
+    /// Returns the index in \ref numa_node_shards() of the node of shard \c id.
+    static unsigned numa_node_of(shard_id id) noexcept {
+        return _shard_numa_node[id];
+    }
     /// Invokes func on all other shards.
     ///
     /// \param cpu_id the cpu on which **not** to run the function.
@@ -479,10 +631,59 @@ class smp : public std::enable_shared_from_this<smp> {
     void allocate_reactor(unsigned id, reactor_backend_selector rbs, reactor_config cfg);
     void create_thread(std::function<void ()> thread_loop);
     unsigned adjust_max_networking_aio_io_control_blocks(unsigned network_iocbs);
+    // The calling shard stands in for the leader of its own group
+    static shard_id fan_out_group_leader(size_t g) noexcept {
+        return g == _shard_fan_out_group[this_shard_id()] ? this_shard_id() : _fan_out_groups[g].front();
+    }
 public:
     static unsigned count;
 };
 
 SEASTAR_MODULE_EXPORT_END
 
+namespace internal {
+
+template <typename Func>
+class stealable_work_impl final : public stealable_work {
+    using futurator = futurize<std::invoke_result_t<Func>>;
+    using future_type = typename futurator::type;
+    Func _func;
+    typename futurator::promise_type _pr;
+public:
+    explicit stealable_work_impl(Func&& func) : _func(std::move(func)) {}
+    future_type get_future() noexcept {
+        return _pr.get_future();
+    }
+    virtual void run() noexcept override {
+        auto f = futurator::invoke(_func);
+        if (this_shard_id() == origin) {
+            std::move(f).forward_to(std::move(_pr));
+            delete this;
+            return;
+        }
+        // Stolen: complete the promise and destroy ourselves back home
+        (void)std::move(f).then_wrapped([this] (future_type f) {
+            return smp::submit_to(origin, [this, f = std::move(f)] () mutable {
+                std::move(f).forward_to(std::move(_pr));
+                delete this;
+            });
+        });
+    }
+};
+
+}
+
+template <typename Func>
+futurize_t<std::invoke_result_t<Func>> smp::submit_stealable(Func&& func) noexcept {
+    using futurator = futurize<std::invoke_result_t<Func>>;
+    try {
+        auto w = std::make_unique<internal::stealable_work_impl<std::decay_t<Func>>>(std::forward<Func>(func));
+        internal::submit_stealable_work(*w);
+        // Only the origin shard touches the promise, so this can't race with a thief
+        return w.release()->get_future();
+    } catch (...) {
+        return futurator::make_exception_future(std::current_exception());
+    }
+}
+
 }
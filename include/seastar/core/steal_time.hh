@@ -0,0 +1,91 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/util/modules.hh>
+#include <seastar/util/noncopyable_function.hh>
+
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <chrono>
+#include <cstdint>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Time the current shard wanted to run but couldn't, over one sampling
+/// interval of \c --steal-time-sample-interval-ms.
+struct steal_time_sample {
+    /// Length of the sampling interval.
+    std::chrono::nanoseconds interval{};
+    /// Time the hypervisor ran something else on the shard's virtual CPU
+    /// (the steal column of \c /proc/stat).
+    std::chrono::nanoseconds hypervisor_steal{};
+    /// Time the reactor thread was runnable but waited for the CPU behind
+    /// other threads, from \c schedstat.
+    std::chrono::nanoseconds runqueue_wait{};
+    /// Number of times the reactor thread was preempted.
+    uint64_t involuntary_switches = 0;
+
+    /// Fraction of the interval lost to steal time and preemption.
+    double steal_ratio() const noexcept {
+        return interval.count() ? double((hypervisor_steal + runqueue_wait).count()) / interval.count() : 0;
+    }
+};
+
+/// Returns the last steal time sample of the current shard.
+const steal_time_sample& last_steal_time_sample() noexcept;
+
+/// Calls a function on the current shard when its steal ratio (see
+/// \ref steal_time_sample::steal_ratio()) rises to a threshold, and when
+/// it falls back below it, e.g. to shed load or to lower the shares of
+/// background scheduling groups meanwhile. The callback is unregistered
+/// when the subscription is destroyed.
+class steal_time_subscription : public boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>> {
+public:
+    /// Called with \c true when the ratio reached the threshold, and
+    /// with \c false when it fell back below it.
+    using callback_type = noncopyable_function<void (bool high, const steal_time_sample& sample) noexcept>;
+private:
+    double _threshold;
+    bool _high = false;
+    callback_type _callback;
+public:
+    steal_time_subscription(double threshold, callback_type callback);
+    steal_time_subscription(const steal_time_subscription&) = delete;
+    steal_time_subscription& operator=(const steal_time_subscription&) = delete;
+    /// \cond internal
+    void notify(const steal_time_sample& sample) noexcept {
+        bool high = sample.steal_ratio() >= _threshold;
+        if (high != _high) {
+            _high = high;
+            _callback(high, sample);
+        }
+    }
+    /// \endcond
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -94,12 +94,14 @@ class thread_context final : private task {
     struct stack_deleter {
         void operator()(char *ptr) const noexcept;
         int valgrind_id;
-        stack_deleter(int valgrind_id);
+        size_t size;
+        stack_deleter(int valgrind_id, size_t size);
     };
     using stack_holder = std::unique_ptr<char[], stack_deleter>;
 
     stack_holder _stack;
-    noncopyable_function<void ()> _func;
+    using func_type = basic_noncopyable_function<void (), 64>;
+    func_type _func;
     jmp_buf_link _context;
     promise<> _done;
     bool _joined = false;
@@ -118,7 +120,7 @@ class thread_context final : private task {
     stack_holder make_stack(size_t stack_size);
     virtual void run_and_dispose() noexcept override; // from task class
 public:
-    thread_context(thread_attributes attr, noncopyable_function<void ()> func);
+    thread_context(thread_attributes attr, func_type func);
     ~thread_context();
     void switch_in();
     void switch_out();
@@ -130,6 +132,7 @@ class thread_context final : private task {
     friend void thread_impl::switch_in(thread_context*);
     friend void thread_impl::switch_out(thread_context*);
     friend scheduling_group thread_impl::sched_group(const thread_context*);
+    friend thread_impl::stack_bounds thread_impl::current_stack() noexcept;
 };
 
 /// \endcond
@@ -72,6 +72,15 @@ inline bool should_yield() {
 
 scheduling_group sched_group(const thread_context*);
 
+// Address range of the stack the current code runs on, the one of the
+// current seastar thread, or of the reactor thread. Both are zero if
+// unknown.
+struct stack_bounds {
+    uintptr_t low = 0;
+    uintptr_t high = 0;
+};
+stack_bounds current_stack() noexcept;
+
 void yield();
 void switch_in(thread_context* to);
 void switch_out(thread_context* from);
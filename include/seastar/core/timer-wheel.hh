@@ -0,0 +1,310 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/bitset-iter.hh>
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#endif
+
+namespace seastar {
+
+/**
+ * A hierarchical hashed timing wheel, holding and expiring timers with the
+ * same interface as timer_set.
+ *
+ * Time is divided in ticks of a configurable resolution, and timeouts are
+ * rounded up to the next tick, so timers never expire early but may expire
+ * up to one tick late. Each level of the wheel has 64 slots, the slots of
+ * level n covering 64^n ticks each. A timer is put in the level of the most
+ * significant 6 bit group in which its tick differs from the current tick,
+ * so that inserting and removing a timer is O(1). As time advances, the
+ * timers of a slot of a higher level are redistributed to the lower levels
+ * once the slot is reached. Timers beyond the last level wait in an
+ * overflow list.
+ *
+ * A coarse resolution trades expiry precision for less redistribution,
+ * which suits large populations of timeouts that are mostly cancelled or
+ * re-armed before they expire.
+ *
+ * The template type "Timer" should have a method named get_timeout() which
+ * returns Timer::time_point which denotes timer's expiration, and a member
+ * in which the wheel records the slot the timer is in.
+ */
+template<typename Timer, boost::intrusive::list_member_hook<> Timer::*link, uint16_t Timer::*slot>
+class timer_wheel {
+public:
+    using time_point = typename Timer::time_point;
+    using timer_list_t = boost::intrusive::list<Timer, boost::intrusive::member_hook<Timer, boost::intrusive::list_member_hook<>, link>>;
+private:
+    using duration = typename Timer::duration;
+    using tick_t = uint64_t;
+
+    static constexpr unsigned slot_bits = 6;
+    static constexpr unsigned slots_per_level = 1u << slot_bits;
+    static constexpr unsigned n_levels = 6;
+    static constexpr tick_t max_tick = std::numeric_limits<tick_t>::max();
+
+    // The first slot holds timers which are due, the last one the
+    // timers beyond the last level.
+    static constexpr uint16_t due_slot = 0;
+    static constexpr uint16_t overflow_slot = 1 + n_levels * slots_per_level;
+
+    std::array<timer_list_t, overflow_slot + 1> _slots;
+    std::array<uint64_t, n_levels> _occupied{};
+    duration _resolution;
+    tick_t _current = 0;
+    // May be earlier than the actual next expiry, after a removal
+    tick_t _next = max_tick;
+    size_t _size = 0;
+private:
+    tick_t tick_of_timeout(time_point tp) const noexcept {
+        auto ts = tp.time_since_epoch().count();
+        if (ts <= 0) {
+            return 0;
+        }
+        auto res = _resolution.count();
+        return ts / res + (ts % res != 0);
+    }
+
+    tick_t tick_of_now(time_point tp) const noexcept {
+        auto ts = tp.time_since_epoch().count();
+        return ts <= 0 ? 0 : ts / _resolution.count();
+    }
+
+    time_point time_of(tick_t tick) const noexcept {
+        if (tick > tick_t(std::numeric_limits<typename duration::rep>::max() / _resolution.count())) {
+            return time_point::max();
+        }
+        return time_point(duration(typename duration::rep(tick) * _resolution.count()));
+    }
+
+    uint16_t slot_of(tick_t tick) const noexcept {
+        if (tick <= _current) {
+            return due_slot;
+        }
+        auto level = (std::numeric_limits<tick_t>::digits - 1 - bitsets::count_leading_zeros(tick ^ _current)) / slot_bits;
+        if (level >= n_levels) {
+            return overflow_slot;
+        }
+        return 1 + level * slots_per_level + ((tick >> (level * slot_bits)) & (slots_per_level - 1));
+    }
+
+    void place(Timer& timer, tick_t tick) noexcept {
+        auto s = slot_of(tick);
+        _slots[s].push_back(timer);
+        timer.*slot = s;
+        if (s != due_slot && s != overflow_slot) {
+            _occupied[(s - 1) / slots_per_level] |= uint64_t(1) << ((s - 1) % slots_per_level);
+        }
+    }
+
+    // Returns the first populated slot after the due one and the tick at
+    // which it starts, or overflow_slot + 1 if there is none. All slots of
+    // a level start after the whole range of the levels below it.
+    std::pair<uint16_t, tick_t> next_slot() const noexcept {
+        for (unsigned level = 0; level < n_levels; ++level) {
+            if (_occupied[level]) {
+                auto idx = bitsets::count_trailing_zeros(_occupied[level]);
+                auto shift = level * slot_bits;
+                auto above = shift + slot_bits;
+                tick_t start = ((_current >> above) << above) | (tick_t(idx) << shift);
+                return {uint16_t(1 + level * slots_per_level + idx), start};
+            }
+        }
+        if (!_slots[overflow_slot].empty()) {
+            constexpr auto shift = n_levels * slot_bits;
+            return {overflow_slot, ((_current >> shift) + 1) << shift};
+        }
+        return {overflow_slot + 1, max_tick};
+    }
+
+    tick_t compute_next() const noexcept {
+        if (!_slots[due_slot].empty()) {
+            return _current;
+        }
+        return next_slot().second;
+    }
+public:
+    explicit timer_wheel(duration resolution = duration(1)) noexcept
+        : _resolution(std::max(resolution, duration(1)))
+    {
+    }
+
+    ~timer_wheel() {
+        for (auto&& list : _slots) {
+            while (!list.empty()) {
+                auto& timer = *list.begin();
+                timer.cancel();
+            }
+        }
+    }
+
+    /**
+     * Changes the resolution of the wheel, redistributing the timers in it.
+     */
+    void set_resolution(duration resolution) noexcept
+    {
+        timer_list_t timers;
+        for (auto&& list : _slots) {
+            timers.splice(timers.end(), list);
+        }
+        _occupied = {};
+        _resolution = std::max(resolution, duration(1));
+        _current = 0;
+        _next = max_tick;
+        _size = 0;
+        while (!timers.empty()) {
+            auto& timer = *timers.begin();
+            timers.pop_front();
+            insert(timer);
+        }
+    }
+
+    duration resolution() const noexcept {
+        return _resolution;
+    }
+
+    /**
+     * Adds timer to the active set.
+     *
+     * Has the same contract as timer_set::insert().
+     */
+    bool insert(Timer& timer) noexcept
+    {
+        auto tick = tick_of_timeout(timer.get_timeout());
+        place(timer, tick);
+        ++_size;
+        if (tick < _next) {
+            _next = tick;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Removes timer from the active set.
+     *
+     * Has the same contract as timer_set::remove().
+     */
+    void remove(Timer& timer) noexcept
+    {
+        auto s = timer.*slot;
+        auto& list = _slots[s];
+        list.erase(list.iterator_to(timer));
+        if (list.empty() && s != due_slot && s != overflow_slot) {
+            _occupied[(s - 1) / slots_per_level] &= ~(uint64_t(1) << ((s - 1) % slots_per_level));
+        }
+        --_size;
+    }
+
+    /**
+     * Expires active timers.
+     *
+     * Has the same contract as timer_set::expire(). Timers expire once the
+     * tick their timeout is rounded up to is reached.
+     */
+    timer_list_t expire(time_point now) noexcept
+    {
+        timer_list_t exp;
+        auto target = tick_of_now(now);
+
+        if (target < _current) {
+            abort();
+        }
+
+        exp.splice(exp.end(), _slots[due_slot]);
+        for (;;) {
+            auto [s, start] = next_slot();
+            if (start > target) {
+                break;
+            }
+            _current = start;
+            timer_list_t list;
+            list.splice(list.end(), _slots[s]);
+            if (s != overflow_slot) {
+                _occupied[(s - 1) / slots_per_level] &= ~(uint64_t(1) << ((s - 1) % slots_per_level));
+            }
+            while (!list.empty()) {
+                auto& timer = *list.begin();
+                list.pop_front();
+                auto tick = tick_of_timeout(timer.get_timeout());
+                if (tick <= _current) {
+                    exp.push_back(timer);
+                } else {
+                    place(timer, tick);
+                }
+            }
+        }
+
+        _current = target;
+        _size -= exp.size();
+        _next = compute_next();
+        return exp;
+    }
+
+    /**
+     * Returns a time point at which expire() should be called
+     * in order to ensure timers are expired in a timely manner.
+     */
+    time_point get_next_timeout() const noexcept
+    {
+        return time_of(std::max(_current, _next));
+    }
+
+    /**
+     * Clears the active set.
+     */
+    void clear() noexcept
+    {
+        for (auto&& list : _slots) {
+            list.clear();
+        }
+        _occupied = {};
+        _next = max_tick;
+        _size = 0;
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    /**
+     * Returns true if and only if there are no timers in the active set.
+     */
+    bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    time_point now() noexcept {
+        return Timer::clock::now();
+    }
+};
+
+}
@@ -24,6 +24,7 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/scheduling.hh>
 #include <seastar/core/timer-set.hh>
+#include <seastar/core/timer-wheel.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
@@ -86,7 +87,9 @@ class timer {
     typedef typename Clock::duration duration;
     typedef Clock clock;
 private:
-    using callback_t = noncopyable_function<void()>;
+    // Timers are often armed with callbacks capturing a few pointers and
+    // sizes, keep those inline
+    using callback_t = basic_noncopyable_function<void(), 64>;
     boost::intrusive::list_member_hook<> _link;
     scheduling_group _sg;
     callback_t _callback;
@@ -95,6 +98,8 @@ class timer {
     bool _armed = false;
     bool _queued = false;
     bool _expired = false;
+    // Slot of the timer in a timer_wheel
+    uint16_t _wheel_slot = 0;
     void readd_periodic() noexcept;
     void arm_state(time_point until, std::optional<duration> period) noexcept {
         assert(!_armed);
@@ -113,7 +118,7 @@ class timer {
     /// \note care should be taken when moving a timer whose callback captures `this`,
     ///       since the object pointed to by `this` may have been moved as well.
     timer(timer&& t) noexcept : _sg(t._sg), _callback(std::move(t._callback)), _expiry(std::move(t._expiry)), _period(std::move(t._period)),
-            _armed(t._armed), _queued(t._queued), _expired(t._expired) {
+            _armed(t._armed), _queued(t._queued), _expired(t._expired), _wheel_slot(t._wheel_slot) {
         _link.swap_nodes(t._link);
         t._queued = false;
         t._armed = false;
@@ -122,12 +127,12 @@ class timer {
     ///
     /// \param sg Scheduling group to run the callback under.
     /// \param callback function (with signature `void ()`) to execute after the timer is armed and expired.
-    timer(scheduling_group sg, noncopyable_function<void ()>&& callback) noexcept : _sg(sg), _callback{std::move(callback)} {
+    timer(scheduling_group sg, callback_t&& callback) noexcept : _sg(sg), _callback{std::move(callback)} {
     }
     /// Constructs a timer with a callback. The timer is not armed.
     ///
     /// \param callback function (with signature `void ()`) to execute after the timer is armed and expired.
-    explicit timer(noncopyable_function<void ()>&& callback) noexcept : timer(current_scheduling_group(), std::move(callback)) {
+    explicit timer(callback_t&& callback) noexcept : timer(current_scheduling_group(), std::move(callback)) {
     }
     /// Destroys the timer. The timer is cancelled if armed.
     ~timer();
@@ -135,14 +140,14 @@ class timer {
     ///
     /// \param sg the scheduling group under which the callback will be executed.
     /// \param callback the callback to be executed when the timer expires.
-    void set_callback(scheduling_group sg, noncopyable_function<void ()>&& callback) noexcept {
+    void set_callback(scheduling_group sg, callback_t&& callback) noexcept {
         _sg = sg;
         _callback = std::move(callback);
     }
     /// Sets the callback function to be called when the timer expires.
     ///
     /// \param callback the callback to be executed when the timer expires.
-    void set_callback(noncopyable_function<void ()>&& callback) noexcept {
+    void set_callback(callback_t&& callback) noexcept {
         set_callback(current_scheduling_group(), std::move(callback));
     }
     /// Sets the timer expiration time.
@@ -219,6 +224,7 @@ class timer {
     }
     friend class reactor;
     friend class timer_set<timer, &timer::_link>;
+    friend class timer_wheel<timer, &timer::_link, &timer::_wheel_slot>;
 };
 
 extern template class timer<steady_clock_type>;
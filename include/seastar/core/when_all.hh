@@ -28,6 +28,7 @@
 #include <seastar/util/tuple_utils.hh>
 #include <seastar/util/critical_alloc_section.hh>
 #include <seastar/util/modules.hh>
+#include <algorithm>
 #include <cstddef>
 #include <exception>
 #include <tuple>
@@ -266,25 +267,64 @@ struct identity_futures_vector {
     }
 };
 
-// Internal function for when_all().
+// Shared state of when_all() over a vector of futures.
+//
+// Like when_all_state, only one continuation is scheduled at a time, and it
+// is the state itself: each resolved future is written back into its slot
+// in _futures, so waiting doesn't allocate anything per element. Futures are
+// waited for in reverse order; if they complete in order, waiting for the
+// last one finds the rest ready.
 template <typename ResolvedVectorTransform, typename Future>
-inline
-typename ResolvedVectorTransform::future_type
-complete_when_all(std::vector<Future>&& futures, typename std::vector<Future>::iterator pos) noexcept {
-    // If any futures are already ready, skip them.
-    while (pos != futures.end() && pos->available()) {
-        ++pos;
-    }
-    // Done?
-    if (pos == futures.end()) {
-        return ResolvedVectorTransform::run(std::move(futures));
-    }
-    // Wait for unready future, store, and continue.
-    return pos->then_wrapped([futures = std::move(futures), pos] (auto fut) mutable {
-        *pos++ = std::move(fut);
-        return complete_when_all<ResolvedVectorTransform>(std::move(futures), pos);
-    });
-}
+class when_all_vector_state final : private continuation_base_from_future_t<Future> {
+    using futurator = futurize<Future>;
+    std::vector<Future> _futures;
+    size_t _nr_remain;
+    typename ResolvedVectorTransform::future_type::promise_type _result;
+private:
+    explicit when_all_vector_state(std::vector<Future>&& futures) noexcept
+            : _futures(std::move(futures)), _nr_remain(_futures.size()) {
+    }
+    void wait_for_one() noexcept {
+        while (_nr_remain) {
+            auto& f = _futures[_nr_remain - 1];
+            if (!f.available()) {
+                internal::set_callback(std::move(f), static_cast<continuation_base_from_future_t<Future>*>(this));
+                return;
+            }
+            --_nr_remain;
+        }
+        ResolvedVectorTransform::run(std::move(_futures)).forward_to(std::move(_result));
+        delete this;
+    }
+    virtual void run_and_dispose() noexcept override {
+        auto& f = _futures[_nr_remain - 1];
+        if (__builtin_expect(this->_state.failed(), false)) {
+            f = futurator::make_exception_future(std::move(this->_state).get_exception());
+        } else {
+            f = futurator::from_tuple(std::move(this->_state).get_value());
+        }
+        this->_state = {};
+        --_nr_remain;
+        wait_for_one();
+    }
+    task* waiting_task() noexcept override { return _result.waiting_task(); }
+public:
+    static typename ResolvedVectorTransform::future_type wait_all(std::vector<Future>&& futures) noexcept {
+        // Skip over the futures that are ready already
+        auto nr_ready = std::find_if(futures.rbegin(), futures.rend(), [] (const Future& f) { return !f.available(); }) - futures.rbegin();
+        if (size_t(nr_ready) == futures.size()) {
+            return ResolvedVectorTransform::run(std::move(futures));
+        }
+        auto state = [&] () noexcept {
+            memory::scoped_critical_alloc_section _;
+            return new when_all_vector_state(std::move(futures));
+        }();
+        state->_nr_remain -= nr_ready;
+        auto ret = state->_result.get_future();
+        state->wait_for_one();
+        return ret;
+    }
+};
 
 template<typename ResolvedVectorTransform, typename FutureIterator>
 inline auto
@@ -301,7 +341,7 @@ do_when_all(FutureIterator begin, FutureIterator end) noexcept {
     // Important to invoke the *begin here, in case it's a function iterator,
     // so we launch all computation in parallel.
     std::move(begin, end, std::back_inserter(ret));
-    return complete_when_all<ResolvedVectorTransform>(std::move(ret), ret.begin());
+    return when_all_vector_state<ResolvedVectorTransform, typename itraits::value_type>::wait_all(std::move(ret));
 }
 
 } // namespace internal
@@ -542,11 +582,7 @@ template <typename T>
 inline auto
 when_all_succeed(std::vector<future<T>>&& futures) noexcept {
     using result_transform = internal::extract_values_from_futures_vector<future<T>>;
-    try {
-        return internal::complete_when_all<result_transform>(std::move(futures), futures.begin());
-    } catch (...) {
-        return result_transform::current_exception_as_future();
-    }
+    return internal::when_all_vector_state<result_transform, future<T>>::wait_all(std::move(futures));
 }
 
 /// @}
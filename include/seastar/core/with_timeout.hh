@@ -29,6 +29,7 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/core/timer.hh>
+#include <seastar/core/internal/deadline_queue.hh>
 #include <seastar/util/modules.hh>
 #endif
 
@@ -72,6 +73,48 @@ future<T...> with_timeout(std::chrono::time_point<Clock, Duration> timeout, futu
     return result;
 }
 
+/// \brief Wait for either a future, or a deadline, whichever comes first
+///
+/// Like \ref with_timeout(), but instead of arming a timer per call, links
+/// the call into a per shard list of deadlines shared by all calls with the
+/// same deadline. Only the earliest deadline has a timer armed. This makes
+/// large numbers of short lived timeouts cheaper, especially when they are
+/// computed from \ref lowres_clock and so often coincide.
+///
+/// Note that timing out doesn't cancel any tasks associated with the original future.
+/// It also doesn't cancel the callback registerred on it.
+///
+/// \param deadline time point after which the returned future should be failed
+/// \param f future to wait for
+///
+/// \return a future which will be either resolved with f or a timeout exception
+SEASTAR_MODULE_EXPORT
+template<typename ExceptionFactory = default_timeout_exception_factory, typename Clock, typename Duration, typename... T>
+future<T...> with_deadline(std::chrono::time_point<Clock, Duration> deadline, future<T...> f) {
+    if (f.available()) {
+        return f;
+    }
+    struct waiter final : internal::deadline_waiter {
+        promise<T...> pr;
+        virtual void on_deadline() noexcept override {
+            pr.set_exception(std::make_exception_ptr(ExceptionFactory::timeout()));
+        }
+    };
+    auto w = std::make_unique<waiter>();
+    auto result = w->pr.get_future();
+    internal::deadline_queue<Clock>::local().add(*w, deadline);
+    // Future is returned indirectly.
+    (void)f.then_wrapped([w = std::move(w)] (auto&& f) mutable {
+        if (w->linked()) {
+            w->unlink();
+            f.forward_to(std::move(w->pr));
+        } else {
+            f.ignore_ready_future();
+        }
+    });
+    return result;
+}
+
 /// @}
 
 } // namespace seastar
@@ -23,6 +23,7 @@
 
 #include <cassert>
 #include <coroutine>
+#include <new>
 #include <optional>
 #include <utility>
 #include <seastar/core/future.hh>
@@ -97,6 +98,10 @@ class generator_unbuffered_promise final : public seastar::task {
         assert(!_generator);
         _generator = g;
     }
+    // the generator was moved
+    void rebind_generator(generator_type* g) noexcept {
+        _generator = g;
+    }
 
     suspend_always initial_suspend() const noexcept { return {}; }
     suspend_never final_suspend() const noexcept {
@@ -193,6 +198,10 @@ class generator_buffered_promise final : public seastar::task {
         assert(!_generator);
         _generator = g;
     }
+    // the generator was moved
+    void rebind_generator(generator_type* g) noexcept {
+        _generator = g;
+    }
 
     suspend_always initial_suspend() const noexcept { return {}; }
     suspend_never final_suspend() const noexcept {
@@ -335,13 +344,18 @@ class generator {
     generator(const generator&) = delete;
     generator(generator&& other) noexcept
         : _coro{std::exchange(other._coro, {})}
-        , _buffer_capacity{other._buffer_capacity} {}
+        , _promise{std::exchange(other._promise, nullptr)}
+        , _values{std::move(other._values)}
+        , _buffer_capacity{other._buffer_capacity}
+        , _exception{std::exchange(other._exception, nullptr)} {
+        if (_promise) {
+            _promise->rebind_generator(this);
+        }
+    }
     generator& operator=(generator&& other) noexcept {
         if (std::addressof(other) != this) {
-            auto old_coro = std::exchange(_coro, std::exchange(other._coro, {}));
-            if (old_coro) {
-                old_coro.destroy();
-            }
+            this->~generator();
+            new (this) generator(std::move(other));
         }
         return *this;
     }
@@ -425,13 +439,18 @@ class generator<T, std::optional> {
     }
     generator(const generator&) = delete;
     generator(generator&& other) noexcept
-        : _coro{std::exchange(other._coro, {})} {}
+        : _coro{std::exchange(other._coro, {})}
+        , _promise{std::exchange(other._promise, nullptr)}
+        , _maybe_value{std::exchange(other._maybe_value, std::nullopt)}
+        , _exception{std::exchange(other._exception, nullptr)} {
+        if (_promise) {
+            _promise->rebind_generator(this);
+        }
+    }
     generator& operator=(generator&& other) noexcept {
         if (std::addressof(other) != this) {
-            auto old_coro = std::exchange(_coro, std::exchange(other._coro, {}));
-            if (old_coro) {
-                old_coro.destroy();
-            }
+            this->~generator();
+            new (this) generator(std::move(other));
         }
         return *this;
     }
@@ -0,0 +1,279 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <concepts>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/pipe.hh>
+#include <seastar/core/queue.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/coroutine/generator.hh>
+#include <seastar/util/defer.hh>
+
+/// \file
+///
+/// Adaptors composing \ref seastar::coroutine::experimental::generator "generators"
+/// into pipelines.
+///
+/// \ref map(), \ref filter() and \ref batch() transform a generator in
+/// lockstep with its consumer. \ref buffer(), \ref merge() and
+/// \ref parallel_map() run their sources in the background, up to a bounded
+/// number of elements ahead of the consumer, so that a stage waiting for I/O
+/// overlaps with the work of the stages after it.
+///
+/// All adaptors take their sources by value and return an unbuffered
+/// generator. Destroying the returned generator stops the background
+/// sources at their next element.
+///
+/// Example
+///
+/// ```
+/// auto rows = buffer(read_rows(file), 64);
+/// auto keys = parallel_map(filter(std::move(rows), is_live), 16, lookup_key);
+/// while (auto key = co_await keys()) {
+///     process(*key);
+/// }
+/// ```
+
+namespace seastar::coroutine::experimental {
+
+namespace internal {
+
+template <typename Func, typename T>
+using generator_map_result_t = typename futurize_t<std::invoke_result_t<Func&, T&&>>::value_type;
+
+// State shared by the background producers of a pipeline stage and the
+// generator consuming their elements
+template <typename T>
+struct generator_pipeline_state {
+    // std::nullopt marks the end of the elements, or the failure in ex
+    queue<std::optional<T>> q;
+    std::exception_ptr ex;
+    unsigned producers = 0;
+
+    explicit generator_pipeline_state(size_t capacity) : q(capacity) {}
+    void stop() noexcept {
+        q.abort(std::make_exception_ptr(broken_pipe_exception()));
+    }
+};
+
+template <typename T, template <typename> class Container>
+future<> feed_pipeline(generator<T, Container> source, lw_shared_ptr<generator_pipeline_state<T>> st) {
+    bool last = false;
+    try {
+        while (auto v = co_await source()) {
+            co_await st->q.push_eventually(std::move(v));
+        }
+        last = --st->producers == 0;
+    } catch (...) {
+        // Fails the consumer, unless it is gone already
+        if (!st->ex) {
+            st->ex = std::current_exception();
+        }
+        last = true;
+    }
+    if (last) {
+        try {
+            co_await st->q.push_eventually(std::nullopt);
+        } catch (...) {
+            // The consumer is gone
+        }
+    }
+}
+
+template <typename T>
+generator<T> drain_pipeline(lw_shared_ptr<generator_pipeline_state<T>> st) {
+    auto stop_producers = defer([st] () noexcept { st->stop(); });
+    while (auto v = co_await st->q.pop_eventually()) {
+        co_yield std::move(*v);
+    }
+    if (st->ex) {
+        std::rethrow_exception(st->ex);
+    }
+}
+
+template <typename U, typename Func>
+struct parallel_map_state : generator_pipeline_state<future<U>> {
+    Func func;
+    // Limits the number of invocations of func in progress
+    semaphore concurrency;
+
+    parallel_map_state(Func&& func, size_t concurrency)
+        : generator_pipeline_state<future<U>>(concurrency + 1)
+        , func(std::move(func))
+        , concurrency(concurrency) {
+    }
+};
+
+template <typename U, typename T, template <typename> class Container, typename Func>
+future<> feed_parallel_map(generator<T, Container> source, lw_shared_ptr<parallel_map_state<U, Func>> st) {
+    try {
+        while (auto v = co_await source()) {
+            co_await st->concurrency.wait();
+            co_await st->q.push_eventually(futurize_invoke(st->func, std::move(*v)));
+        }
+    } catch (...) {
+        if (!st->ex) {
+            st->ex = std::current_exception();
+        }
+    }
+    try {
+        co_await st->q.push_eventually(std::nullopt);
+    } catch (...) {
+        // The consumer is gone
+    }
+}
+
+template <typename U, typename Func>
+generator<U> drain_parallel_map(lw_shared_ptr<parallel_map_state<U, Func>> st) {
+    auto stop_producer = defer([st] () noexcept {
+        st->concurrency.broken();
+        st->stop();
+    });
+    while (auto f = co_await st->q.pop_eventually()) {
+        auto v = co_await std::move(*f);
+        st->concurrency.signal();
+        co_yield std::move(v);
+    }
+    if (st->ex) {
+        std::rethrow_exception(st->ex);
+    }
+}
+
+} // namespace internal
+
+/// Applies \c func to each element of \c source.
+///
+/// \param source the generator to transform
+/// \param func called with each element, returning the transformed element
+///             or a future of it; it isn't called for the next element
+///             before this one is consumed.
+template <typename T, template <typename> class Container, typename Func>
+requires std::invocable<Func&, T&&>
+generator<internal::generator_map_result_t<Func, T>>
+map(generator<T, Container> source, Func func) {
+    while (auto v = co_await source()) {
+        auto mapped = co_await futurize_invoke(func, std::move(*v));
+        co_yield std::move(mapped);
+    }
+}
+
+/// Passes on the elements of \c source for which \c pred is true.
+///
+/// \param source the generator to filter
+/// \param pred called with each element, returning \c bool or \c future<bool>
+template <typename T, template <typename> class Container, typename Pred>
+requires std::invocable<Pred&, const T&>
+generator<T>
+filter(generator<T, Container> source, Pred pred) {
+    while (auto v = co_await source()) {
+        bool keep = co_await futurize_invoke(pred, std::as_const(*v));
+        if (keep) {
+            co_yield std::move(*v);
+        }
+    }
+}
+
+/// Groups the elements of \c source into vectors of \c n elements.
+///
+/// The last vector holds the remaining elements, and may be shorter.
+template <typename T, template <typename> class Container>
+generator<std::vector<T>>
+batch(generator<T, Container> source, size_t n) {
+    std::vector<T> b;
+    b.reserve(n);
+    while (auto v = co_await source()) {
+        b.push_back(std::move(*v));
+        if (b.size() >= n) {
+            co_yield std::exchange(b, {});
+            b.reserve(n);
+        }
+    }
+    if (!b.empty()) {
+        co_yield std::move(b);
+    }
+}
+
+/// Reads \c source in the background, up to \c n elements ahead of the consumer.
+///
+/// \c source starts running right away, rather than on the first read of
+/// the returned generator. An exception from \c source is rethrown after
+/// the elements that preceded it are consumed.
+template <typename T, template <typename> class Container>
+generator<T>
+buffer(generator<T, Container> source, size_t n) {
+    auto st = make_lw_shared<internal::generator_pipeline_state<T>>(n);
+    st->producers = 1;
+    // The producer only stops when the consumer does, see drain_pipeline()
+    (void)internal::feed_pipeline(std::move(source), st);
+    return internal::drain_pipeline(std::move(st));
+}
+
+/// Interleaves the elements of \c sources, in the order they are produced.
+///
+/// Each source runs in the background, and up to \c n elements produced by
+/// all of them are buffered. The returned generator ends after all sources
+/// do, or with the first exception from any of them.
+template <typename T, template <typename> class Container>
+generator<T>
+merge(std::vector<generator<T, Container>> sources, size_t n = 1) {
+    auto st = make_lw_shared<internal::generator_pipeline_state<T>>(n);
+    st->producers = sources.size();
+    if (sources.empty()) {
+        st->q.push(std::nullopt);
+    }
+    for (auto& source : sources) {
+        (void)internal::feed_pipeline(std::move(source), st);
+    }
+    return internal::drain_pipeline(std::move(st));
+}
+
+/// Applies \c func to up to \c concurrency elements of \c source at a time.
+///
+/// \c source is read in the background, and \c func is called for the next
+/// element as soon as fewer than \c concurrency calls are in progress. The
+/// results are passed on in the order of the elements of \c source. An
+/// exception from \c func ends the returned generator when its result is
+/// reached.
+///
+/// \param source the generator to transform
+/// \param concurrency maximum number of calls to \c func in progress, at least 1
+/// \param func called with each element, returning a future of the transformed
+///             element (or the transformed element itself)
+template <typename T, template <typename> class Container, typename Func>
+requires std::invocable<Func&, T&&>
+generator<internal::generator_map_result_t<Func, T>>
+parallel_map(generator<T, Container> source, size_t concurrency, Func func) {
+    using result_type = internal::generator_map_result_t<Func, T>;
+    auto st = make_lw_shared<internal::parallel_map_state<result_type, Func>>(std::move(func), concurrency);
+    (void)internal::feed_parallel_map(std::move(source), st);
+    return internal::drain_parallel_map(std::move(st));
+}
+
+} // namespace seastar::coroutine::experimental
@@ -0,0 +1,100 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#endif
+
+namespace seastar {
+
+namespace httpd {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Limits of an \ref admission_controller
+struct admission_config {
+    /// Requests handled at once
+    size_t max_concurrency;
+    /// Requests waiting for their turn, further ones are rejected right away
+    size_t max_queue_length = 0;
+    /// How long a request waits for its turn before it is rejected
+    std::chrono::milliseconds max_queue_time = std::chrono::milliseconds(0);
+    /// Retry-After of the replies to rejected requests
+    std::chrono::seconds retry_after = std::chrono::seconds(1);
+};
+
+/// Counters of the requests that weren't admitted right away
+struct admission_stats {
+    /// Requests that waited for their turn
+    uint64_t queued = 0;
+    /// Requests that were rejected
+    uint64_t shed = 0;
+};
+
+/// Admission control of HTTP requests
+///
+/// Admits up to \ref admission_config::max_concurrency requests at once.
+/// Requests over the limit wait in a FIFO queue that is bounded both in
+/// length and in time; the others are shed, which the server answers with
+/// 503 Service Unavailable before reading the request body.
+class admission_controller : public enable_lw_shared_from_this<admission_controller> {
+    admission_config _cfg;
+    semaphore _slots;
+public:
+    /// Held while an admitted request is handled
+    class permit {
+        lw_shared_ptr<admission_controller> _controller;
+        semaphore_units<> _units;
+    public:
+        permit() noexcept = default;
+        permit(lw_shared_ptr<admission_controller> controller, semaphore_units<> units) noexcept
+            : _controller(std::move(controller)), _units(std::move(units)) {}
+    };
+
+    explicit admission_controller(admission_config cfg);
+
+    const admission_config& config() const noexcept {
+        return _cfg;
+    }
+
+    /// Requests waiting for their turn
+    size_t queued() const noexcept {
+        return _slots.waiters();
+    }
+
+    /// Resolves to a permit once the request may be handled, or to
+    /// \c std::nullopt if it is to be shed
+    future<std::optional<permit>> admit(admission_stats& stats);
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#endif
+
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/http/handlers.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/**
+ * Serves the replies of another handler from a cache.
+ *
+ * Successful replies with a string body are serialized once, headers and
+ * body, and then sent again as they are for the requests with the same
+ * method, URL (query string included) and values of the configured request
+ * headers. Replies get an ETag, unless the handler set one, and requests
+ * with a matching If-None-Match are answered with 304 Not Modified.
+ *
+ * Like the routes it is registered in, the cache belongs to a shard: the
+ * invalidation functions have to be called on every shard.
+ *
+ * Usage: routes.put(GET, "/health", new cached_handler(std::make_unique<function_handler>(...)));
+ */
+class cached_handler : public handler_base {
+public:
+    struct config {
+        /// Request headers the replies depend on, e.g. Accept
+        std::vector<sstring> vary;
+        /// How long replies are served from the cache, until invalidated if unset
+        std::optional<lowres_clock::duration> max_age;
+        /// Replies beyond that many aren't cached
+        size_t max_entries = 1024;
+    };
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t not_modified = 0;
+    };
+private:
+    struct entry {
+        sstring url;
+        sstring etag;
+        temporary_buffer<char> headers;
+        temporary_buffer<char> body;
+        lowres_clock::time_point expires;
+    };
+    std::unique_ptr<handler_base> _handler;
+    config _cfg;
+    std::unordered_map<sstring, entry> _entries;
+    // Replies rendered before an invalidation aren't cached
+    uint64_t _generation = 0;
+    stats _stats;
+private:
+    sstring make_key(const http::request& req) const;
+    entry render(http::reply& rep, sstring url) const;
+    std::unique_ptr<http::reply> serve(entry& e, const sstring& if_none_match, std::unique_ptr<http::reply> rep);
+public:
+    explicit cached_handler(std::unique_ptr<handler_base> handler);
+    cached_handler(std::unique_ptr<handler_base> handler, config cfg);
+
+    future<std::unique_ptr<http::reply>> handle(const sstring& path,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override;
+
+    /// Drops the cached replies of a URL, path and query string
+    void invalidate(std::string_view url);
+    /// Drops all the cached replies
+    void invalidate();
+
+    size_t size() const noexcept {
+        return _entries.size();
+    }
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -23,11 +23,20 @@
 
 #ifndef SEASTAR_MODULE
 #include <boost/intrusive/list.hpp>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #endif
 #include <seastar/net/api.hh>
+#include <seastar/net/srv_balancer.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/core/condition-variable.hh>
+#include <seastar/core/gate.hh>
 #include <seastar/core/iostream.hh>
+#include <seastar/core/lowres_clock.hh>
 #include <seastar/util/modules.hh>
 
 namespace bi = boost::intrusive;
@@ -53,6 +62,8 @@ class client_ref {
     ~client_ref();
     client_ref(client_ref&& o) noexcept : _c(std::exchange(o._c, nullptr)) {}
     client_ref(const client_ref&) = delete;
+    // Wakes up the requests waiting for a connection
+    void notify() noexcept;
 };
 
 }
@@ -134,6 +145,76 @@ class connection : public enable_shared_from_this<connection> {
     future<reply_ptr> recv_reply();
 };
 
+/**
+ * \brief Class http2_connection multiplexes HTTP requests over an HTTP/2 connection
+ *
+ * Every request is sent as a stream of its own, so that as many of them as the server
+ * allows can be in flight over the connection at the same time. The server is assumed
+ * to speak HTTP/2: plain connections use prior knowledge, while TLS ones should offer
+ * "h2" with \ref tls::certificate_credentials::set_alpn_protocols().
+ *
+ * Response bodies are flow controlled, the server can only send ahead of what the
+ * body streams have consumed by the stream and connection windows.
+ */
+
+class http2_connection : public enable_shared_from_this<http2_connection> {
+    friend class client;
+    class impl;
+    using reply_ptr = std::unique_ptr<reply>;
+
+    internal::client_ref _ref;
+    std::unique_ptr<impl> _impl;
+
+public:
+    /**
+     * \brief Create an HTTP/2 connection
+     *
+     * Construct the connection over the provided \fd transport socket, and send the
+     * connection preface. The \scheme goes into the :scheme pseudo header of requests.
+     *
+     */
+    http2_connection(connected_socket&& fd, internal::client_ref cr, sstring scheme = "http");
+    ~http2_connection();
+
+    /**
+     * \brief Send the request and wait for response
+     *
+     * Sends the provided request on a new stream and returns a future that resolves
+     * into the server response head and a stream of its body. The body stream must
+     * be drained or destroyed for the stream to be released.
+     *
+     * Trailing headers of responses are not reported.
+     *
+     * \param rq -- request to be sent
+     *
+     */
+    future<std::pair<reply, input_stream<char>>> make_request(request rq);
+
+    /**
+     * \brief Returns the number of streams in flight
+     */
+    unsigned active_requests() const noexcept;
+
+    /**
+     * \brief Returns whether one more request fits the server stream limit
+     *
+     * False as well once the connection failed or the server sent GOAWAY.
+     */
+    bool can_make_request() const noexcept;
+
+    /**
+     * \brief Closes the connection
+     *
+     * Connection must be closed regardless of whether requests failed or not. Requests
+     * still in flight fail.
+     */
+    future<> close();
+
+private:
+    bool usable() const noexcept;
+    future<std::pair<reply_ptr, input_stream<char>>> do_make_request(request rq);
+};
+
 /**
  * \brief Factory that provides transport for \ref client
  *
@@ -154,6 +235,30 @@ class connection_factory {
     virtual ~connection_factory() {}
 };
 
+/**
+ * \brief Connection factory spreading connections across balanced endpoints
+ *
+ * Each new connection goes to the endpoint picked by the \ref net::srv_balancer,
+ * which is reported the connect time and failures. Since the client reuses
+ * connections, requests are spread as the connections are. To balance every
+ * request, keep a client per endpoint and send through
+ * net::srv_balancer::with_endpoint().
+ */
+class balanced_connection_factory : public connection_factory {
+    shared_ptr<net::srv_balancer> _balancer;
+    shared_ptr<tls::certificate_credentials> _creds;
+    sstring _host;
+public:
+    /**
+     * \param balancer -- the endpoints to connect to
+     * \param creds -- when set, connections use TLS with these credentials
+     * \param host -- the TLS server name
+     */
+    explicit balanced_connection_factory(shared_ptr<net::srv_balancer> balancer,
+            shared_ptr<tls::certificate_credentials> creds = {}, sstring host = {});
+    virtual future<connected_socket> make() override;
+};
+
 /**
  * \brief Class client wraps communications using HTTP protocol
  *
@@ -170,21 +275,75 @@ class client {
     using connections_list_t = bi::list<connection, bi::member_hook<connection, typename connection::hook_t, &connection::_hook>, bi::constant_time_size<false>>;
     static constexpr unsigned default_max_connections = 100;
 
+public:
+    /**
+     * \brief The protocol a client speaks over its connections
+     *
+     * With \c http2, the connections are \ref http2_connection ones, each carrying
+     * many requests at a time, so that much fewer of them are needed.
+     */
+    enum class protocol { http1_1, http2 };
+
+    /**
+     * \brief Retries and hedging of idempotent requests
+     *
+     * Only applies to requests which can be sent again: with an idempotent method
+     * (GET, HEAD, PUT, DELETE, OPTIONS or TRACE) and either no body writer or a
+     * body streamed from a file, see request::write_body(). A request is retried
+     * when it fails before its reply head arrives, e.g. on a keep-alive connection
+     * the server closed. Once the reply handler is called, failures are final.
+     */
+    struct retry_options {
+        /// Times a failed request is sent again
+        unsigned max_retries = 0;
+        /// Delay before the first retry, doubled for each next one
+        std::chrono::milliseconds backoff = std::chrono::milliseconds(10);
+        /// Sends a second, hedged, copy of a request whose reply takes longer than
+        /// this quantile (e.g. 0.95) of the recent reply latencies, on another
+        /// connection; the first reply wins and the other connection is closed.
+        /// Zero disables hedging.
+        double hedge_quantile = 0;
+        /// Lower bound of the hedging delay
+        std::chrono::milliseconds min_hedge_delay = std::chrono::milliseconds(1);
+    };
+
+private:
+    struct attempt;
+    using clock_type = lowres_clock;
+    // Latencies of the last reply heads, to choose the hedging delay
+    static constexpr size_t latency_samples = 128;
+    static constexpr size_t min_latency_samples = 16;
+
     std::unique_ptr<connection_factory> _new_connections;
+    protocol _protocol;
     unsigned _nr_connections = 0;
     unsigned _max_connections;
     unsigned long _total_new_connections = 0;
     condition_variable _wait_con;
     connections_list_t _pool;
+    retry_options _retry;
+    std::array<clock_type::duration, latency_samples> _latencies;
+    size_t _nr_latencies = 0;
+    unsigned long _total_retries = 0;
+    unsigned long _total_hedged = 0;
+    // Hedged requests left behind by the winning one
+    gate _background;
 
     using connection_ptr = seastar::shared_ptr<connection>;
+    using http2_connection_ptr = seastar::shared_ptr<http2_connection>;
+    std::vector<http2_connection_ptr> _http2_connections;
 
     future<connection_ptr> get_connection();
     future<> put_connection(connection_ptr con);
     future<> shrink_connections();
-
-    template <std::invocable<connection&> Fn>
-    auto with_connection(Fn&& fn);
+    future<http2_connection_ptr> get_http2_connection();
+    future<> drop_http2_connection(http2_connection_ptr con);
+    future<> close_http2_connections();
+    future<> close_connections();
+    future<attempt> send(request req);
+    future<attempt> send_hedged(const request& req);
+    future<attempt> send_with_retries(request req);
+    std::optional<clock_type::duration> hedge_delay() const;
 
 public:
     using reply_handler = noncopyable_function<future<>(const reply&, input_stream<char>&& body)>;
@@ -195,9 +354,10 @@ class client {
      * socket
      *
      * \param addr -- host address to connect to
+     * \param proto -- protocol to speak, HTTP/2 being with prior knowledge
      *
      */
-    explicit client(socket_address addr);
+    explicit client(socket_address addr, protocol proto = protocol::http1_1);
 
     /**
      * \brief Construct a secure client
@@ -208,9 +368,11 @@ class client {
      * \param addr -- host address to connect to
      * \param creds -- credentials
      * \param host -- optional host name
+     * \param proto -- protocol to speak, for HTTP/2 the credentials should offer "h2"
+     *        with ALPN
      *
      */
-    client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host = {});
+    client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host = {}, protocol proto = protocol::http1_1);
 
     /**
      * \brief Construct a client with connection factory
@@ -220,9 +382,11 @@ class client {
      * may re-use the sockets on its own
      *
      * \param f -- the factory pointer
+     * \param max_connections -- the maximum number of connections
+     * \param proto -- protocol to speak over the connections
      *
      */
-    explicit client(std::unique_ptr<connection_factory> f, unsigned max_connections = default_max_connections);
+    explicit client(std::unique_ptr<connection_factory> f, unsigned max_connections = default_max_connections, protocol proto = protocol::http1_1);
 
     /**
      * \brief Send the request and handle the response
@@ -249,6 +413,27 @@ class client {
      */
     future<> set_maximum_connections(unsigned nr);
 
+    /**
+     * \brief Configures retries and hedging of idempotent requests
+     *
+     * By default, requests are neither retried nor hedged
+     */
+    void set_retry_options(retry_options opts) noexcept {
+        _retry = opts;
+    }
+
+    /**
+     * \brief Opens connections ahead of requests
+     *
+     * Opens connections until \c nr of them are idle, or the maximum number of
+     * connections is reached, so that the next requests don't wait for connection
+     * setup, e.g. the TLS handshake. With HTTP/2, opens one connection if there is
+     * none.
+     *
+     * \param nr -- the number of idle connections to reach
+     */
+    future<> warm_up(unsigned nr);
+
     /**
      * \brief Closes the client
      *
@@ -266,6 +451,8 @@ class client {
 
     /**
      * \brief Returns the number of idle connections
+     *
+     * HTTP/2 connections are never idle, they are shared by requests
      */
 
     unsigned idle_connections_nr() const noexcept {
@@ -282,6 +469,91 @@ class client {
     unsigned long total_new_connections_nr() const noexcept {
         return _total_new_connections;
     }
+
+    /**
+     * \brief Returns the total number of requests sent again after a failure
+     */
+
+    unsigned long total_retries_nr() const noexcept {
+        return _total_retries;
+    }
+
+    /**
+     * \brief Returns the total number of hedged copies of requests sent
+     */
+
+    unsigned long total_hedged_nr() const noexcept {
+        return _total_hedged;
+    }
+};
+
+/**
+ * \brief Class client_pool keeps a \ref client per endpoint
+ *
+ * Each endpoint, e.g. a "host:port" string, gets its connections pooled and limited
+ * by its own client, which the factory makes when the endpoint is first used. So that
+ * requests to a new endpoint don't all wait for connection setup, the pool warms each
+ * client up to a target of idle connections in the background.
+ */
+
+class client_pool {
+public:
+    using client_factory = noncopyable_function<std::unique_ptr<client>(const sstring& endpoint)>;
+
+private:
+    client_factory _factory;
+    unsigned _warm_connections;
+    std::unordered_map<sstring, std::unique_ptr<client>> _clients;
+    gate _warm_ups;
+
+    void start_warm_up(const sstring& endpoint, client& c);
+
+public:
+    /**
+     * \brief Construct a pool of clients
+     *
+     * \param factory -- makes the client of an endpoint, configured with its maximum
+     *        number of connections, protocol and retry options
+     * \param warm_connections -- the number of idle connections to open for every
+     *        endpoint ahead of requests
+     */
+    explicit client_pool(client_factory factory, unsigned warm_connections = 0);
+
+    /**
+     * \brief Returns the client of an endpoint
+     *
+     * Makes it on first use, and starts warming it up
+     */
+    client& get(const sstring& endpoint);
+
+    /**
+     * \brief Send the request to an endpoint and handle the response
+     *
+     * \see client::make_request()
+     */
+    future<> make_request(const sstring& endpoint, request req, client::reply_handler handle, std::optional<reply::status_type> expected = std::nullopt);
+
+    /**
+     * \brief Opens connections of all endpoints up to the warm target again
+     *
+     * E.g. after the server closed idle ones
+     */
+    future<> warm_up();
+
+    /**
+     * \brief Closes the clients of all endpoints
+     *
+     * Pool must be closed before destruction unconditionally
+     */
+    future<> close();
+
+    /**
+     * \brief Returns the number of endpoints
+     */
+
+    size_t endpoints_nr() const noexcept {
+        return _clients.size();
+    }
 };
 
 } // experimental namespace
@@ -0,0 +1,93 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <optional>
+#include <string_view>
+#include <vector>
+#endif
+#include <seastar/core/iostream.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace http {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+struct reply;
+
+/// Content codings a server can compress replies with
+enum class content_encoding { gzip, deflate, zstd };
+
+/// Whether the library was built with support for the encoding
+///
+/// zstd is optional, gzip and deflate are always available.
+bool content_encoding_supported(content_encoding enc) noexcept;
+
+/// Name of the encoding, as it appears in Content-Encoding
+std::string_view to_string(content_encoding enc) noexcept;
+
+/// Compression of replies, see \ref httpd::http_server::set_compression()
+///
+/// The encoding is negotiated with the request's Accept-Encoding header,
+/// and the body is compressed while the body writer streams it, so a reply
+/// is never held whole in memory.
+struct compression_config {
+    /// Encodings to offer, most preferred first. The unsupported ones are
+    /// skipped.
+    std::vector<content_encoding> encodings = { content_encoding::zstd, content_encoding::gzip, content_encoding::deflate };
+    /// Compression level, 0 selects the default level of each encoding
+    int level = 0;
+    /// Replies known to be shorter are sent as they are. Streamed replies
+    /// are always compressed, their size is not known in advance.
+    size_t min_size = 1024;
+    /// Scheduling group the compression runs in
+    scheduling_group group = default_scheduling_group();
+};
+
+/// Returns a stream that compresses what is written to it into \c out
+///
+/// Flushing the stream flushes the compressor too, so that what was written
+/// so far can be decompressed on the other side. Closing it ends the
+/// compressed stream and closes \c out.
+output_stream<char> make_compressing_output_stream(output_stream<char>&& out, content_encoding enc, int level = 0,
+        scheduling_group group = default_scheduling_group());
+
+SEASTAR_MODULE_EXPORT_END
+
+namespace internal {
+
+// Picks the encoding to use from an Accept-Encoding header value
+std::optional<content_encoding> negotiate_content_encoding(std::string_view accept_encoding,
+        const std::vector<content_encoding>& encodings);
+
+// Makes the reply compress its body, if the reply and the client allow
+void compress_reply(reply& rep, std::string_view method, std::string_view accept_encoding, const compression_config& cfg);
+
+}
+
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/http/handlers.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/**
+ * Serves the stacks sampled by the CPU profiler, see cpu_profiler::start().
+ *
+ * By default the reply is a pprof profile of all shards, with the
+ * scheduling group and the shard of each sample as labels. pprof
+ * symbolizes it with the binaries of the mappings. With format=folded,
+ * the reply lists the stacks in the folded format of flamegraph.pl, one
+ * "group;outermost;...;innermost count" line per stack.
+ *
+ * Query parameters:
+ *  - shard: only report this shard
+ *  - format=folded: reply with folded stacks
+ *
+ * Usage: routes.put(GET, "/profile/cpu", new cpu_profile_handler());
+ */
+class cpu_profile_handler : public handler_base {
+public:
+    future<std::unique_ptr<http::reply>> handle(const sstring& path,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override;
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
@@ -101,6 +101,8 @@ class file_interaction_handler : public handler_base {
 
     /**
      * read a file from the disk and return it in the replay.
+     * Unless a transformer is set, single range requests are honored and the
+     * file is sent with sendfile() when the connection allows.
      * @param file the full path to a file on the disk
      * @param req the reuest
      * @param rep the reply
@@ -109,6 +111,11 @@ class file_interaction_handler : public handler_base {
             std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep);
     file_transformer* transformer;
 
+private:
+    future<std::unique_ptr<http::reply>> read_region(sstring file_name, sstring extension,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep);
+protected:
+
     output_stream<char> get_stream(std::unique_ptr<http::request> req,
             const sstring& extension, output_stream<char>&& s);
 };
@@ -28,6 +28,7 @@
 #include <queue>
 #include <bitset>
 #include <limits>
+#include <optional>
 #include <cctype>
 #include <vector>
 #include <boost/intrusive/list.hpp>
@@ -41,9 +42,11 @@
 #include <seastar/core/distributed.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/modules.hh>
+#include <seastar/http/compression.hh>
 #include <seastar/http/routes.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/core/shared_ptr.hh>
@@ -62,6 +65,10 @@ class http_server;
 SEASTAR_MODULE_EXPORT
 class http_stats;
 
+namespace internal {
+class http2_connection;
+}
+
 using namespace std::chrono_literals;
 
 SEASTAR_MODULE_EXPORT_BEGIN
@@ -87,6 +94,26 @@ class connection : public boost::intrusive::list_base_hook<> {
     queue<std::unique_ptr<http::reply>> _replies { 10 };
     bool _done = false;
     const bool _tls;
+    // Switch to HTTP/2 once the HTTP/1 loops are done
+    bool _http2 = false;
+    // The preface request line was parsed as an HTTP/1 request
+    bool _http2_preface_started = false;
+    // Request that upgraded the connection to h2c
+    std::unique_ptr<http::request> _upgraded_req;
+    // Pipelined requests being handled, and the last of them to push its
+    // reply. Each one waits for the one before, so replies keep their order.
+    semaphore _pipeline_slots{0};
+    future<> _pipeline_tail = make_ready_future<>();
+private:
+    bool can_pipeline(const http::request& req) const;
+    future<> read_pipelined(std::unique_ptr<http::request> req);
+    future<> reply_pipelined(std::unique_ptr<http::request> req, std::unique_ptr<input_stream<char>> content_stream,
+            future<> previous, semaphore_units<> slot, admission_controller::permit permit);
+    future<> drain_pipeline();
+    future<std::unique_ptr<http::reply>> handle_request(std::unique_ptr<http::request> req);
+    // Resolves to nullopt once the request was answered with a 503
+    future<std::optional<admission_controller::permit>> admit(const http::request& req);
+    future<> shed(const http::request& req, std::chrono::seconds retry_after);
 public:
     [[deprecated("use connection(http_server&, connected_socket&&, bool tls)")]]
     connection(http_server& server, connected_socket&& fd, socket_address, bool tls) 
@@ -116,6 +143,7 @@ class connection : public boost::intrusive::list_base_hook<> {
     void on_new_connection();
 
     future<> process();
+    future<> process_http2();
     void shutdown();
     future<> read();
     future<> read_one();
@@ -130,6 +158,8 @@ class connection : public boost::intrusive::list_base_hook<> {
     void generate_error_reply_and_close(std::unique_ptr<http::request> req, http::reply::status_type status, const sstring& msg);
 
     future<> write_body();
+    future<> send_file_body();
+    future<> send_prerendered();
 
     output_stream<char>& out();
 };
@@ -144,11 +174,19 @@ class http_server {
     uint64_t _requests_served = 0;
     uint64_t _read_errors = 0;
     uint64_t _respond_errors = 0;
+    // Replies whose body went out with connected_socket::send_file()
+    uint64_t _files_sent = 0;
+    // Connections waiting for a request without a read buffer
+    uint64_t _parked_connections = 0;
     shared_ptr<seastar::tls::server_credentials> _credentials;
     sstring _date = http_date();
     timer<> _date_format_timer { [this] {_date = http_date();} };
     size_t _content_length_limit = std::numeric_limits<size_t>::max();
     bool _content_streaming = false;
+    size_t _pipeline_depth = 1;
+    lw_shared_ptr<admission_controller> _admission;
+    admission_stats _admission_stats;
+    std::optional<http::compression_config> _compression;
     gate _task_gate;
 public:
     routes _routes;
@@ -194,6 +232,42 @@ class http_server {
 
     void set_content_streaming(bool b);
 
+    size_t get_pipeline_depth() const;
+
+    /*!
+     * \brief handle pipelined requests concurrently
+     *
+     * Up to \c depth requests of a connection are handed to their handlers
+     * at once, while the replies are still sent in the order the requests
+     * came in. With content streaming, and for requests expecting a
+     * 100-continue or an upgrade, requests are handled one at a time.
+     * Takes effect for new connections, the default of 1 handles all
+     * requests one at a time.
+     */
+    void set_pipeline_depth(size_t depth);
+
+    /*!
+     * \brief limit the requests handled at once
+     *
+     * Requests over the limit wait for their turn in a queue bounded by
+     * \ref admission_config, or are answered with 503 Service Unavailable
+     * and a Retry-After header before their body is read. Limits of a
+     * route, set with routes::set_admission(), replace the server wide
+     * ones. Pass std::nullopt to remove the limits.
+     */
+    void set_admission(std::optional<admission_config> cfg);
+
+    const std::optional<http::compression_config>& get_compression() const;
+
+    /*!
+     * \brief compress replies
+     *
+     * Replies are compressed with the encoding negotiated with the client's
+     * Accept-Encoding header, unless the handler set a Content-Encoding of
+     * its own. Disabled by default, pass std::nullopt to disable it again.
+     */
+    void set_compression(std::optional<http::compression_config> cfg);
+
     future<> listen(socket_address addr, server_credentials_ptr credentials);
     future<> listen(socket_address addr, listen_options lo, server_credentials_ptr credentials);
     future<> listen(socket_address addr, listen_options lo);
@@ -208,6 +282,10 @@ class http_server {
     uint64_t requests_served() const;
     uint64_t read_errors() const;
     uint64_t reply_errors() const;
+    uint64_t files_sent() const;
+    uint64_t requests_queued() const;
+    uint64_t requests_shed() const;
+    uint64_t parked_connections() const;
     // Write the current date in the specific "preferred format" defined in
     // RFC 7231, Section 7.1.1.1.
     static sstring http_date();
@@ -215,6 +293,7 @@ class http_server {
     future<> do_accept_one(int which, bool with_tls);
     boost::intrusive::list<connection> _connections;
     friend class seastar::httpd::connection;
+    friend class seastar::httpd::internal::http2_connection;
     friend class http_server_tester;
 };
 
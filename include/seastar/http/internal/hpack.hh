@@ -0,0 +1,99 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/sstring.hh>
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#endif
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+// HPACK, the header compression of HTTP/2 (RFC 7541)
+
+class hpack_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// The decoded header list of a block is larger than the limit. The block was
+// decoded in full, so the decoder can still be used.
+class hpack_header_list_too_large : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Decodes the header blocks of a connection, keeping its dynamic table
+class hpack_decoder {
+public:
+    using header = std::pair<sstring, sstring>;
+private:
+    std::deque<header> _table;
+    size_t _table_size = 0;
+    size_t _max_table_size;
+    // The limit of _max_table_size, from our SETTINGS_HEADER_TABLE_SIZE
+    size_t _table_size_limit;
+private:
+    const header& lookup(uint64_t index) const;
+    void insert(header h);
+    void evict(size_t max_size);
+public:
+    explicit hpack_decoder(size_t max_table_size = 4096)
+        : _max_table_size(max_table_size), _table_size_limit(max_table_size) {}
+    // Throws hpack_error, after which the decoder can't be used anymore.
+    //
+    // Entries of the dynamic table can be referenced any number of times,
+    // so the header list may be much larger than the block. Its size, as
+    // defined for SETTINGS_MAX_HEADER_LIST_SIZE, is limited to
+    // max_list_size: the rest of the block is still decoded to keep the
+    // table in sync, without producing more headers, then
+    // hpack_header_list_too_large is thrown.
+    std::vector<header> decode(std::string_view block, size_t max_list_size = std::numeric_limits<size_t>::max());
+    size_t table_size() const noexcept {
+        return _table_size;
+    }
+};
+
+// Appends to header blocks using the static table only, so that header
+// blocks can be produced in any order and don't depend on each other
+void hpack_encode(std::string& block, std::string_view name, std::string_view value);
+
+// Huffman coding of string literals (RFC 7541 section 5.2)
+std::string huffman_encode(std::string_view s);
+sstring huffman_decode(std::string_view s);
+
+}
+
+}
+
+}
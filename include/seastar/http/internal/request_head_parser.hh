@@ -0,0 +1,46 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+namespace seastar {
+
+namespace http {
+
+struct request;
+
+namespace internal {
+
+// Parses a request head (the request line and the header fields, up to and
+// including the empty line) that is entirely contained in [begin, end).
+//
+// This is the fast path of http_request_parser: the head is scanned with
+// vector instructions and only the parsed fields are copied into req.
+// Returns the end of the head, or nullptr when the head is incomplete or
+// uses syntax left to the full parser (obs-fold, control characters,
+// malformed input, too many fields), in which case req is left untouched.
+const char* parse_request_head(const char* begin, const char* end, request& req);
+
+}
+
+}
+
+}
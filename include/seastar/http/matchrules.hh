@@ -112,6 +112,14 @@ class match_rule {
         return *this;
     }
 
+    const std::vector<matcher*>& matchers() const noexcept {
+        return _match_list;
+    }
+
+    handler_base* handler() const noexcept {
+        return _handler;
+    }
+
 private:
     std::vector<matcher*> _match_list;
     handler_base* _handler;
@@ -0,0 +1,57 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/http/handlers.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/**
+ * Serves the allocator state of every shard as JSON.
+ *
+ * For each shard the reply lists the small object pools (size classes)
+ * with their live objects, memory and unused (fragmented) memory, see
+ * memory::get_small_pool_stats(), and, if heap profiling is on, the
+ * sampled allocation sites, see memory::sampled_memory_profile().
+ *
+ * Query parameters:
+ *  - shard: only report this shard
+ *  - sites=false: leave out the allocation sites
+ *
+ * Usage: routes.put(GET, "/memory", new memory_handler());
+ */
+class memory_handler : public handler_base {
+public:
+    future<std::unique_ptr<http::reply>> handle(const sstring& path,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override;
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
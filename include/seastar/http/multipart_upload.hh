@@ -0,0 +1,75 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <functional>
+#endif
+#include <seastar/core/file.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/http/client.hh>
+#include <seastar/http/request.hh>
+
+namespace seastar {
+
+namespace http {
+
+namespace experimental {
+
+/**
+ * \brief Options of upload_file()
+ */
+struct multipart_upload_options {
+    /// Files up to this size are uploaded with a single PUT, bigger ones
+    /// are split in parts of this size (the last one may be shorter)
+    uint64_t part_size = 64 << 20;
+    /// Number of parts being uploaded at the same time
+    unsigned parallelism = 4;
+    /// Called on every request before it is sent, once its query
+    /// parameters and body are set, e.g. to sign it
+    std::function<void(request&)> decorate;
+};
+
+/**
+ * \brief Upload a file to an S3-compatible endpoint
+ *
+ * Small files are uploaded with a single PUT. Bigger ones use the multipart
+ * upload protocol: the upload is initiated, the parts are streamed from the
+ * file in parallel, see request::write_body(), and the upload is completed
+ * with the list of the parts' ETags. When anything fails the upload is
+ * aborted, so that the endpoint drops the parts, and the error is rethrown.
+ *
+ * \param c -- the client connected to the endpoint
+ * \param host -- the value of the Host header
+ * \param path -- the path of the object
+ * \param f -- the file to upload, it must be kept open until the returned future resolves
+ * \param opts -- upload options
+ */
+future<> upload_file(client& c, sstring host, sstring path, file f, multipart_upload_options opts = {});
+
+} // experimental namespace
+
+} // http namespace
+
+} // seastar namespace
@@ -32,8 +32,11 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <optional>
+#include <string_view>
 #include <unordered_map>
 #endif
+#include <seastar/core/file.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/http/mime_types.hh>
 #include <seastar/core/iostream.hh>
@@ -49,11 +52,22 @@ namespace httpd {
 
 class connection;
 class routes;
+class cached_handler;
+namespace internal {
+class http2_connection;
+}
 
 }
 
 namespace http {
 
+struct reply;
+struct compression_config;
+
+namespace internal {
+void compress_reply(reply& rep, std::string_view method, std::string_view accept_encoding, const compression_config& cfg);
+}
+
 /**
  * A reply to be sent to a client.
  */
@@ -92,6 +106,7 @@ struct reply {
         payload_too_large = 413, //!< payload_too_large
         uri_too_long = 414, //!< uri_too_long
         unsupported_media_type = 415, //!< unsupported_media_type
+        range_not_satisfiable = 416, //!< range_not_satisfiable
         expectation_failed = 417, //!< expectation_failed
         unprocessable_entity = 422, //!< unprocessable_entity
         upgrade_required = 426, //!< upgrade_required
@@ -217,13 +232,57 @@ struct reply {
      */
     void write_body(const sstring& content_type, sstring content);
 
+    /*!
+     * \brief Send a region of a file as the reply
+     *
+     * Over plaintext HTTP/1.1 connections of the posix stack, the region is
+     * sent with sendfile(), without being copied through user space. Otherwise
+     * it is read and streamed like with a body writer. The reply takes over
+     * the file and closes it.
+     *
+     * \param content_type - is used to choose the content type of the body. Use the file extension
+     *  you would have used for such a content, (i.e. "txt", "html", "json", etc')
+     * \param f - the file to send
+     * \param offset - where the region starts
+     * \param length - length of the region
+     */
+    void write_body(const sstring& content_type, file f, uint64_t offset, uint64_t length);
+
+    /*!
+     * \brief Send serialized headers and body, shared with other replies
+     *
+     * The buffers are sent as they are, without being copied, after the
+     * headers of the reply, which should then only hold the ones the
+     * connection sets (Server, Date...). Such replies aren't compressed.
+     *
+     * \param headers - "Name: value\r\n" lines, the Content-Length of the body included
+     * \param body - the message content
+     */
+    void write_prerendered(temporary_buffer<char> headers, temporary_buffer<char> body);
+
 private:
+    struct file_region {
+        file f;
+        uint64_t offset;
+        uint64_t length;
+    };
+
     future<> write_reply_to_connection(httpd::connection& con);
     future<> write_reply_headers(httpd::connection& connection);
 
     noncopyable_function<future<>(output_stream<char>&&)> _body_writer;
+    // Set along with a _body_writer that streams the same region
+    std::optional<file_region> _file_region;
+    struct prerendered {
+        temporary_buffer<char> headers;
+        temporary_buffer<char> body;
+    };
+    std::optional<prerendered> _prerendered;
     friend class httpd::routes;
     friend class httpd::connection;
+    friend class httpd::internal::http2_connection;
+    friend class httpd::cached_handler;
+    friend void internal::compress_reply(reply& rep, std::string_view method, std::string_view accept_encoding, const compression_config& cfg);
 };
 
 std::ostream& operator<<(std::ostream& os, reply::status_type st);
@@ -32,6 +32,7 @@
 
 #include <seastar/core/iostream.hh>
 #include <seastar/core/sstring.hh>
+#include <memory>
 #include <string>
 #include <vector>
 #include <strings.h>
@@ -43,9 +44,12 @@
 
 namespace seastar {
 
+class connected_socket;
+class file;
+
 namespace http {
 
-namespace experimental { class connection; }
+namespace experimental { class connection; class client; }
 
 /**
  * A request received from a client.
@@ -257,6 +261,25 @@ struct request {
      */
     void write_body(const sstring& content_type, size_t len, noncopyable_function<future<>(output_stream<char>&&)>&& body_writer);
 
+    /**
+     * \brief Send a region of a file as the message body
+     *
+     * \param content_type - is used to choose the content type of the body. Use the file extension
+     *  you would have used for such a content, (i.e. "txt", "html", "json", etc')
+     * \param f - the file to send, which must stay open until the request completes
+     * \param offset - offset of the region in the file
+     * \param len - length of the region
+     *
+     * The file is read with large DMA reads and the buffers are handed to the connection
+     * without copying them. Over plaintext connections of the posix stack, the file is
+     * sent with sendfile(2) instead, not passing through user space at all.
+     *
+     * Message would use plain encoding with Content-Length header set to \c len. Sending
+     * the request resolves with exceptional future if the file is shorter.
+     *
+     */
+    void write_body(const sstring& content_type, file f, uint64_t offset, uint64_t len);
+
     /**
      * \brief Make request send Expect header
      *
@@ -287,10 +310,22 @@ struct request {
     static request make(httpd::operation_type type, sstring host, sstring path);
 
 private:
+    struct file_body;
+    std::shared_ptr<file_body> _file_body; // for client, see write_body()
+
     void add_query_param(std::string_view param);
     sstring request_line() const;
     future<> write_request_headers(output_stream<char>& out) const;
+    // Sends the file body right to the socket, past the flushed stream
+    future<> send_file_body(connected_socket& cs, output_stream<char>& out) const;
+    // Whether a client request can be sent again, see copy()
+    bool can_copy() const noexcept {
+        return !body_writer || _file_body;
+    }
+    // Copies a client request, to send it again
+    request copy() const;
     friend class experimental::connection;
+    friend class experimental::client;
 };
 
 } // namespace httpd
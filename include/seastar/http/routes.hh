@@ -23,9 +23,11 @@
 
 #ifndef SEASTAR_MODULE
 #include <boost/program_options/variables_map.hpp>
+#include <memory>
 #include <unordered_map>
 #endif
 
+#include <seastar/http/admission.hh>
 #include <seastar/http/matchrules.hh>
 #include <seastar/http/handlers.hh>
 #include <seastar/http/common.hh>
@@ -71,12 +73,21 @@ class url {
 
 struct path_description;
 
+namespace internal {
+class route_trie;
+}
+
 /**
  * routes object do the request dispatching according to the url.
  * It uses two decision mechanism exact match, if a url matches exactly
  * (an optional leading slash is permitted) it is choosen
  * If not, the matching rules are used.
  * matching rules are evaluated by their insertion order
+ *
+ * Rules made of string and parameter matchers are compiled into a trie
+ * of path segments on the first lookup after the rules changed, so that
+ * a lookup doesn't depend on the number of rules. A rule must not be
+ * modified after it was added.
  */
 class routes {
 public:
@@ -111,6 +122,7 @@ class routes {
      */
     routes& add(match_rule* rule, operation_type type = GET) {
         _rules[type][_rover++] = rule;
+        _stale[type] = true;
         return *this;
     }
 
@@ -164,6 +176,26 @@ class routes {
     handler_base* get_handler(operation_type type, const sstring& url,
             parameters& params);
 
+    /**
+     * Limit the requests a handler serves at once
+     *
+     * The server rejects the requests over the limit before reading their
+     * body. A handler's limit replaces the server wide one, if any, see
+     * http_server::set_admission().
+     * @param handler a handler that was added to the routes
+     * @param cfg the limits, std::nullopt to remove them
+     * @return it self
+     */
+    routes& set_admission(handler_base* handler, std::optional<admission_config> cfg);
+
+    /**
+     * Return the admission controller of the handler a request is routed to
+     * @param type the http operation type
+     * @param url the request url, without the query
+     * @return the controller, or nullptr if the handler has no limits
+     */
+    lw_shared_ptr<admission_controller> get_admission(operation_type type, const sstring& url);
+
 private:
     /**
      * Normalize the url to remove the last / if exists
@@ -175,11 +207,15 @@ class routes {
     sstring normalize_url(const sstring& url);
 
     std::unordered_map<sstring, handler_base*> _map[NUM_OPERATION];
+    std::unordered_map<handler_base*, lw_shared_ptr<admission_controller>> _admission;
 public:
     using rule_cookie = uint64_t;
 private:
     rule_cookie _rover = 0;
     std::map<rule_cookie, match_rule*> _rules[NUM_OPERATION];
+    // _rules compiled for lookups, rebuilt when stale
+    std::unique_ptr<internal::route_trie> _tries[NUM_OPERATION];
+    bool _stale[NUM_OPERATION] = {};
     //default Handler -- for any HTTP Method and Path (/*)
     handler_base* _default_handler = nullptr;
 public:
@@ -229,6 +265,7 @@ class routes {
     rule_cookie add_cookie(match_rule* rule, operation_type type) {
         auto pos = _rover++;
         _rules[type][pos] = rule;
+        _stale[type] = true;
         return pos;
     }
 
@@ -0,0 +1,125 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <charconv>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <fmt/core.h>
+#endif
+
+#include <seastar/core/sstring.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/http/request.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+
+/// Typed access to request parameters, as used by the handlers
+/// seastar-json2code.py generates. Values are parsed where the request
+/// keeps them, without copies, and malformed ones raise bad_param_exception.
+namespace typed_params {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Parses the value of parameter \c name as a T: std::string_view, sstring,
+/// bool ("true", "false", "1" or "0") or an arithmetic type.
+template <typename T>
+T parse(std::string_view name, std::string_view value) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        return value;
+    } else if constexpr (std::is_same_v<T, sstring>) {
+        return sstring(value);
+    } else if constexpr (std::is_same_v<T, bool>) {
+        if (value == "true" || value == "1") {
+            return true;
+        }
+        if (value == "false" || value == "0") {
+            return false;
+        }
+    } else {
+        static_assert(std::is_arithmetic_v<T>, "unsupported parameter type");
+        T v;
+        auto end = value.data() + value.size();
+        auto [ptr, ec] = std::from_chars(value.data(), end, v);
+        if (ec == std::errc() && ptr == end && !value.empty()) {
+            return v;
+        }
+    }
+    throw bad_param_exception(fmt::format("Invalid value '{}' of parameter '{}'", value, name));
+}
+
+/// The query parameter \c name, if the request has it
+template <typename T>
+std::optional<T> query_param(const http::request& req, const sstring& name) {
+    auto it = req.query_parameters.find(name);
+    if (it == req.query_parameters.end()) {
+        return std::nullopt;
+    }
+    return parse<T>(name, it->second);
+}
+
+/// The path parameter \c name, if the matched route has it.
+///
+/// Only values with escaped characters are decoded, into a copy, so it
+/// can't be returned as a std::string_view.
+template <typename T>
+requires (!std::is_same_v<T, std::string_view>)
+std::optional<T> path_param(const http::request& req, const sstring& name) {
+    if (!req.param.exists(name)) {
+        return std::nullopt;
+    }
+    // The matcher keeps the leading '/'
+    auto raw = std::string_view(req.param.at(name));
+    if (raw.starts_with('/')) {
+        raw.remove_prefix(1);
+    }
+    if (raw.find('%') == std::string_view::npos) {
+        return parse<T>(name, raw);
+    }
+    sstring decoded;
+    if (!http::internal::path_decode(raw, decoded)) {
+        throw bad_param_exception(fmt::format("Invalid encoding of parameter '{}'", name));
+    }
+    return parse<T>(name, decoded);
+}
+
+/// The value of a parameter the handler requires
+template <typename T>
+T required(std::optional<T> value, const char* name) {
+    if (!value) {
+        throw missing_param_exception(name);
+    }
+    return std::move(*value);
+}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
+
+}
@@ -233,68 +233,64 @@ class formatter {
 
 
 
+    // The write() overloads of scalars format straight into the stream's
+    // buffer, without building a string first.
+
     /**
-     * return a json formatted string
+     * write a json formatted string
      * @param str the string to format
-     * @return the given string in a json format
+     * @return a future that resolves once the string was written
      */
-    static future<> write(output_stream<char>& s, const sstring& str) {
-        return s.write(to_json(str));
-    }
+    static future<> write(output_stream<char>& s, const sstring& str);
 
     /**
-     * return a json formatted int
+     * write a json formatted int
      * @param n the int to format
-     * @return the given int in a json format
+     * @return a future that resolves once the int was written
      */
-    static future<> write(output_stream<char>& s, int n) {
-        return s.write(to_json(n));
-    }
+    static future<> write(output_stream<char>& s, int n);
 
     /**
-     * return a json formatted long
+     * write a json formatted unsigned
+     * @param n the unsigned to format
+     * @return a future that resolves once the unsigned was written
+     */
+    static future<> write(output_stream<char>& s, unsigned n);
+
+    /**
+     * write a json formatted long
      * @param n the long to format
-     * @return the given long in a json format
+     * @return a future that resolves once the long was written
      */
-    static future<> write(output_stream<char>& s, long n) {
-        return s.write(to_json(n));
-    }
+    static future<> write(output_stream<char>& s, long n);
 
     /**
-     * return a json formatted float
+     * write a json formatted float
      * @param f the float to format
-     * @return the given float in a json format
+     * @return a future that resolves once the float was written
      */
-    static future<> write(output_stream<char>& s, float f) {
-        return s.write(to_json(f));
-    }
+    static future<> write(output_stream<char>& s, float f);
 
     /**
-     * return a json formatted double
+     * write a json formatted double
      * @param d the double to format
-     * @return the given double in a json format
+     * @return a future that resolves once the double was written
      */
-    static future<> write(output_stream<char>& s, double d) {
-        return s.write(to_json(d));
-    }
+    static future<> write(output_stream<char>& s, double d);
 
     /**
-     * return a json formatted char* (treated as string)
+     * write a json formatted char* (treated as string)
      * @param str the char* to format
-     * @return the given char* in a json format
+     * @return a future that resolves once the string was written
      */
-    static future<> write(output_stream<char>& s, const char* str) {
-        return s.write(to_json(str));
-    }
+    static future<> write(output_stream<char>& s, const char* str);
 
     /**
-     * return a json formatted bool
+     * write a json formatted bool
      * @param d the bool to format
-     * @return the given bool in a json format
+     * @return a future that resolves once the bool was written
      */
-    static future<> write(output_stream<char>& s, bool d) {
-        return s.write(to_json(d));
-    }
+    static future<> write(output_stream<char>& s, bool d);
 
     /**
      * return a json formatted list of a given vector of params
@@ -335,13 +331,11 @@ class formatter {
      }
 
     /**
-     * return a json formatted unsigned long
+     * write a json formatted unsigned long
      * @param l unsigned long to format
-     * @return the given unsigned long in a json format
+     * @return a future that resolves once the unsigned long was written
      */
-    static future<> write(output_stream<char>& s, unsigned long l) {
-      return s.write(to_json(l));
-     }
+    static future<> write(output_stream<char>& s, unsigned long l);
 };
 
 }
@@ -0,0 +1,152 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#endif
+
+#include <seastar/core/future.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace json {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Thrown by \ref stream_parser on malformed input
+class parse_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+enum class token_type {
+    begin_object,
+    end_object,
+    begin_array,
+    end_array,
+    key,
+    string,
+    number,
+    boolean,
+    null,
+    /// The document was consumed
+    end,
+};
+
+struct token {
+    token_type type;
+    /// Decoded text of keys and strings, text of numbers, and \c true,
+    /// \c false or \c null for literals. Empty for the other tokens.
+    ///
+    /// Valid until the next call to \ref stream_parser::next() or
+    /// \ref stream_parser::skip(). Points into the stream's buffers unless
+    /// the token had to be decoded or spanned buffers.
+    std::string_view value;
+};
+
+/// Pull parser of a single JSON document read from an input_stream
+///
+/// Tokens are returned one at a time as the stream is read, so a handler
+/// can consume a large request body, e.g. \ref http::request::content_stream,
+/// without buffering it. The nesting of objects and arrays is validated;
+/// interpreting the values is up to the caller.
+///
+/// \code
+/// json::stream_parser parser(*req->content_stream);
+/// for (auto t = co_await parser.next(); t.type != json::token_type::end; t = co_await parser.next()) {
+///     ...
+/// }
+/// \endcode
+class stream_parser {
+public:
+    struct config {
+        /// Longest key, string or number, after decoding
+        size_t max_token_size = 1 << 20;
+        /// Deepest nesting of objects and arrays
+        unsigned max_depth = 64;
+    };
+private:
+    enum class state {
+        start,
+        value,
+        first_value_or_end,
+        key,
+        key_or_end,
+        colon,
+        comma_or_end,
+        done,
+    };
+    input_stream<char>& _in;
+    config _cfg;
+    temporary_buffer<char> _buf;
+    // Holds tokens which span buffers or contain escapes
+    std::string _scratch;
+    // '{' or '[' per open container
+    std::vector<char> _stack;
+    state _state = state::start;
+    token_type _last = token_type::end;
+    size_t _offset = 0;
+    bool _eof = false;
+public:
+    explicit stream_parser(input_stream<char>& in) : stream_parser(in, config{}) {}
+    stream_parser(input_stream<char>& in, config cfg);
+
+    /// Reads the next token
+    ///
+    /// Resolves to a token of type \ref token_type::end once the document
+    /// and any trailing whitespace were consumed, and fails with
+    /// \ref parse_error on malformed input.
+    future<token> next();
+    /// Skips the rest of the object or array opened by the last token.
+    /// Does nothing after other tokens.
+    future<> skip();
+    /// Number of objects and arrays currently open
+    unsigned depth() const noexcept {
+        return _stack.size();
+    }
+private:
+    future<bool> fill();
+    future<char> get_char();
+    future<std::string_view> parse_string();
+    future<std::string_view> parse_number();
+    future<> parse_literal(std::string_view literal);
+    void consume(size_t n) noexcept;
+    void push(char c);
+    void pop() noexcept;
+    void value_done() noexcept;
+    void check_size() const;
+    [[noreturn]] void fail(std::string_view what) const;
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
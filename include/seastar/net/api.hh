@@ -43,6 +43,9 @@
 
 namespace seastar {
 
+class file;
+class file_desc;
+
 inline
 bool is_ip_unspecified(const ipv4_addr& addr) noexcept {
     return addr.is_ip_unspecified();
@@ -113,6 +116,12 @@ class datagram final {
 
 using udp_datagram = datagram;
 
+/// A datagram to send with \ref datagram_channel::send_batch()
+struct outgoing_datagram {
+    socket_address dst;
+    packet p;
+};
+
 class datagram_channel {
 private:
     std::unique_ptr<datagram_channel_impl> _impl;
@@ -126,9 +135,44 @@ class datagram_channel {
 
     socket_address local_address() const;
 
+    static constexpr size_t default_batch_size = 32;
+
     future<datagram> receive();
+    /// Receives up to \c max datagrams with a single future
+    ///
+    /// Waits until at least one datagram is available, and returns it
+    /// together with the ones which already arrived after it.
+    future<std::vector<datagram>> receive_batch(size_t max = default_batch_size);
     future<> send(const socket_address& dst, const char* msg);
     future<> send(const socket_address& dst, packet p);
+    /// Sends several datagrams, possibly to different destinations, with a
+    /// single future
+    future<> send_batch(std::vector<outgoing_datagram> datagrams);
+    /// Sends \c p as a run of datagrams of \c segment_size bytes each (the
+    /// last one may be shorter) to the same destination
+    ///
+    /// Uses UDP generic segmentation offload where available, so that the
+    /// whole run costs a single system call.
+    future<> send_segmented(const socket_address& dst, packet p, uint16_t segment_size);
+    /// Lets the kernel coalesce datagrams of a flow on receive (UDP_GRO)
+    ///
+    /// When enabled, a received datagram may carry several consecutive
+    /// datagrams from the same source, each in its own fragment of
+    /// \ref datagram::get_data(), so that they can be iterated over without
+    /// copying.
+    ///
+    /// \return false if the channel doesn't support receive coalescing,
+    ///         in which case datagrams keep being received one by one
+    bool set_gro(bool enable);
+    /// Timestamps received datagrams (SO_TIMESTAMPING)
+    ///
+    /// When enabled, the \ref packet::timestamp() of a received datagram is
+    /// when the NIC received it, if the NIC and its driver support hardware
+    /// timestamps and they are enabled on the interface, or else when the
+    /// kernel received it.
+    ///
+    /// \return false if the channel can't timestamp datagrams
+    bool set_timestamping(bool enable);
     bool is_closed() const;
     /// Causes a pending receive() to complete (possibly with an exception)
     void shutdown_input();
@@ -170,6 +214,22 @@ struct connected_socket_input_stream_config final {
     unsigned max_buffer_size = 128 * 1024;
 };
 
+/// Configuration for buffered connected_socket output operations
+///
+/// Like \ref connected_socket_input_stream_config, this is a hint to the
+/// implementation and may be ignored.
+struct connected_socket_output_stream_config final {
+    /// How much data to buffer
+    unsigned buffer_size = 8192;
+    /// Send without copying the data into the kernel socket buffers
+    /// (MSG_ZEROCOPY, or IORING_OP_SENDMSG_ZC with the io_uring backend).
+    /// The sent buffers are released only when the kernel no longer
+    /// references them, that is once the peer acknowledged the data, and
+    /// closing the stream waits for that. Only pays off for large writes;
+    /// ignored by sockets that don't support it (e.g. unix domain sockets).
+    bool zero_copy = false;
+};
+
 /// Distinguished name
 struct session_dn {
     sstring subject;
@@ -206,6 +266,11 @@ class connected_socket {
     /// Gets an object that sends data to the remote endpoint.
     /// \param buffer_size how much data to buffer
     output_stream<char> output(size_t buffer_size = 8192);
+    /// Gets the output stream.
+    ///
+    /// Gets an object that sends data to the remote endpoint.
+    /// \param cssc output stream configuration
+    output_stream<char> output(connected_socket_output_stream_config cssc);
     /// Sets the TCP_NODELAY option (disabling Nagle's algorithm)
     void set_nodelay(bool nodelay);
     /// Gets the TCP_NODELAY option (Nagle's algorithm)
@@ -247,6 +312,49 @@ class connected_socket {
     /// This is useful to abort operations on a socket that is not making
     /// progress due to a peer failure.
     void shutdown_input();
+    /// Checks whether \ref send_file() can send the file
+    ///
+    /// Only plain sockets of the posix stack can, and only files of the
+    /// local file system.
+    bool can_send_file(file& f) const noexcept;
+    /// Sends a region of a file without copying it through user space
+    ///
+    /// Uses sendfile(2), see \ref can_send_file(). Data written to the
+    /// output stream must be flushed beforehand. Fails if the file is
+    /// shorter than \c pos + \c len.
+    ///
+    /// \param f the file to send
+    /// \param pos offset of the region in the file
+    /// \param len length of the region
+    future<> send_file(file& f, uint64_t pos, uint64_t len);
+    /// Checks whether \ref send_fds() can pass file descriptors
+    ///
+    /// Only unix domain sockets of the posix stack can.
+    bool can_pass_fds() const noexcept;
+    /// Passes file descriptors to the peer
+    ///
+    /// The descriptors are attached to \c data, which is sent with
+    /// \c SCM_RIGHTS (see unix(7)) and must not be empty. Data written to
+    /// the output stream must be flushed beforehand, and the output stream
+    /// must not be used until the returned future resolves, so that
+    /// \c data keeps its place in the stream. The descriptors are closed
+    /// once sent; pass duplicates to keep using them.
+    ///
+    /// \param fds the file descriptors to pass, at most 253
+    /// \param data the data the descriptors are attached to
+    future<> send_fds(std::vector<file_desc> fds, temporary_buffer<char> data);
+    /// Takes the file descriptors passed by the peer
+    ///
+    /// Returns the descriptors received so far, in the order they were
+    /// sent. The descriptors passed with some data are received once the
+    /// input stream returned the first byte of that data.
+    std::vector<file_desc> take_received_fds();
+    /// Duplicates the file descriptor of the socket
+    ///
+    /// Allows passing a connection to another process, e.g. with
+    /// \ref send_fds(). Only sockets of the posix stack have one, others
+    /// throw \c std::system_error with \c ENOTSUP.
+    file_desc dup_fd() const;
     /// Check whether the \c connected_socket is initialized.
     ///
     /// \return true if this \c connected_socket socket_address is bound initialized
@@ -338,6 +446,17 @@ class server_socket {
         port,
         // This algorithm distributes all new connections to listen_options::fixed_cpu shard only.
         fixed,
+        // This algorithm sends new connections to the shard running on the CPU that received
+        // the connection request (SO_INCOMING_CPU), so that a connection is processed where its
+        // packets arrive. With SO_REUSEPORT, the choice is made by the kernel with a BPF program,
+        // which needs the permission to load one; otherwise the kernel picks a socket by hash.
+        // Connections arriving on a CPU without a shard are distributed as with
+        // connection_distribution. Meaningful only when shards are pinned to their CPUs.
+        incoming_cpu,
+        // Like connection_distribution, but with SO_REUSEPORT the kernel itself sends new
+        // connections to the shard with the fewest, with a BPF program. Needs the permission
+        // to load one; otherwise the kernel picks a socket by hash.
+        least_connections,
         default_ = connection_distribution
     };
     /// Constructs a \c server_socket without being bound to any address
@@ -375,6 +494,13 @@ class server_socket {
     /// \see listen(socket_address sa, listen_options opts)
     socket_address local_address() const noexcept;
 
+    /// Duplicates the file descriptor of the listening socket
+    ///
+    /// Allows passing the socket to another process, e.g. with
+    /// \ref connected_socket::send_fds(). Only sockets of the posix stack
+    /// have one, others throw \c std::system_error with \c ENOTSUP.
+    file_desc dup_fd() const;
+
     /// Check whether the \c server_socket is listening on any address.
     ///
     /// \return true if this \c socket_address is bound to an address,
@@ -402,6 +528,15 @@ struct listen_options {
     }
 };
 
+/// Options of \ref connect_any()
+struct connect_options {
+    /// Time to wait for an attempt before starting the next one in parallel
+    /// (the "Connection Attempt Delay" of RFC 8305)
+    std::chrono::milliseconds attempt_delay = std::chrono::milliseconds(250);
+    socket_address local = {};
+    transport proto = transport::TCP;
+};
+
 class network_interface {
 private:
     shared_ptr<net::network_interface_impl> _impl;
@@ -426,9 +561,18 @@ class network_interface {
     bool supports_ipv6() const;
 };
 
+namespace net {
+class dns_resolver;
+}
+
 class network_stack {
+    // Resolves the cached lookups of all shards that are directed to this
+    // one, see net::dns_resolver::cache_options::shard
+    std::unique_ptr<net::dns_resolver> _shared_resolver;
+    friend class net::dns_resolver;
 public:
-    virtual ~network_stack() {}
+    network_stack();
+    virtual ~network_stack();
     virtual server_socket listen(socket_address sa, listen_options opts) = 0;
     // FIXME: local parameter assumes ipv4 for now, fix when adding other AF
     future<connected_socket> connect(socket_address sa, socket_address = {}, transport proto = transport::TCP);
@@ -456,6 +600,10 @@ class network_stack {
      * return by value.
      */
     virtual std::vector<network_interface> network_interfaces();
+
+    /// Releases what the stack owns besides its sockets, called when
+    /// the reactor stops.
+    future<> close();
 };
 
 struct network_stack_entry {
@@ -28,6 +28,7 @@
 #include <seastar/net/net.hh>
 #include <seastar/core/byteorder.hh>
 #include <seastar/net/ethernet.hh>
+#include <seastar/net/neighbor_cache.hh>
 #include <seastar/util/modules.hh>
 
 namespace seastar {
@@ -92,7 +93,6 @@ class arp_for : public arp_for_protocol {
     using l2addr = ethernet_address;
     using l3addr = typename L3::address_type;
 private:
-    static constexpr auto max_waiters = 512;
     enum oper {
         op_request = 1,
         op_reply = 2,
@@ -136,14 +136,9 @@ class arp_for : public arp_for_protocol {
             return 8 + 2 * (l2addr::size() + l3addr::size());
         }
     };
-    struct resolution {
-        std::vector<promise<l2addr>> _waiters;
-        timer<> _timeout_timer;
-    };
 private:
     l3addr _l3self = L3::broadcast_address();
-    std::unordered_map<l3addr, l2addr> _table;
-    std::unordered_map<l3addr, resolution> _in_progress;
+    neighbor_cache<l3addr> _table;
 private:
     packet make_query_packet(l3addr paddr);
     virtual future<> received(packet p) override;
@@ -152,17 +147,33 @@ class arp_for : public arp_for_protocol {
     void send(l2addr to, packet p);
 public:
     future<> send_query(const l3addr& paddr);
-    explicit arp_for(arp& a) : arp_for_protocol(a, L3::arp_protocol_type()) {
-        _table[L3::broadcast_address()] = ethernet::broadcast_address();
+    explicit arp_for(arp& a)
+        : arp_for_protocol(a, L3::arp_protocol_type())
+        , _table([this] (const l3addr& paddr, std::optional<l2addr> known) {
+            // Entries are refreshed with a unicast query (RFC1122, 2.3.2.1)
+            send(known.value_or(ethernet::broadcast_address()), make_query_packet(paddr));
+        }) {
+        _table.add_permanent(L3::broadcast_address(), ethernet::broadcast_address());
     }
     future<ethernet_address> lookup(const l3addr& addr);
     void learn(l2addr l2, l3addr l3);
     void run();
     void set_self_addr(l3addr addr) {
-        _table.erase(_l3self);
-        _table[addr] = l2self();
+        if (_l3self != L3::broadcast_address()) {
+            _table.erase(_l3self);
+        }
+        _table.add_permanent(addr, l2self());
         _l3self = addr;
     }
+    void set_reachable_time(std::chrono::seconds t) {
+        _table.set_reachable_time(t);
+    }
+    size_t size() const noexcept {
+        return _table.size();
+    }
+    const typename neighbor_cache<l3addr>::stats& get_stats() const noexcept {
+        return _table.get_stats();
+    }
     friend class arp;
 };
 
@@ -197,67 +208,16 @@ arp_for<L3>::send_query(const l3addr& paddr) {
     return make_ready_future<>();
 }
 
-class arp_error : public std::runtime_error {
-public:
-    arp_error(const std::string& msg) : std::runtime_error(msg) {}
-};
-
-class arp_timeout_error : public arp_error {
-public:
-    arp_timeout_error() : arp_error("ARP timeout") {}
-};
-
-class arp_queue_full_error : public arp_error {
-public:
-    arp_queue_full_error() : arp_error("ARP waiter's queue is full") {}
-};
-
 template <typename L3>
 future<ethernet_address>
 arp_for<L3>::lookup(const l3addr& paddr) {
-    auto i = _table.find(paddr);
-    if (i != _table.end()) {
-        return make_ready_future<ethernet_address>(i->second);
-    }
-    auto j = _in_progress.find(paddr);
-    auto first_request = j == _in_progress.end();
-    auto& res = first_request ? _in_progress[paddr] : j->second;
-
-    if (first_request) {
-        res._timeout_timer.set_callback([paddr, this, &res] {
-            // FIXME: future is discarded
-            (void)send_query(paddr);
-            for (auto& w : res._waiters) {
-                w.set_exception(arp_timeout_error());
-            }
-            res._waiters.clear();
-        });
-        res._timeout_timer.arm_periodic(std::chrono::seconds(1));
-        // FIXME: future is discarded
-        (void)send_query(paddr);
-    }
-
-    if (res._waiters.size() >= max_waiters) {
-        return make_exception_future<ethernet_address>(arp_queue_full_error());
-    }
-
-    res._waiters.emplace_back();
-    return res._waiters.back().get_future();
+    return _table.lookup(paddr);
 }
 
 template <typename L3>
 void
 arp_for<L3>::learn(l2addr hwaddr, l3addr paddr) {
-    _table[paddr] = hwaddr;
-    auto i = _in_progress.find(paddr);
-    if (i != _in_progress.end()) {
-        auto& res = i->second;
-        res._timeout_timer.cancel();
-        for (auto &&pr : res._waiters) {
-            pr.set_value(hwaddr);
-        }
-        _in_progress.erase(i);
-    }
+    _table.learn(paddr, hwaddr);
 }
 
 template <typename L3>
@@ -273,6 +233,18 @@ arp_for<L3>::received(packet p) {
     }
     switch (h.oper) {
     case op_request:
+        // Updates the entry of a known sender (RFC826 merge), which takes
+        // gratuitous ARP announcing a moved address into account, and
+        // learns who asks for us, since they are about to send to us.
+        // Probes (RFC5227) have no sender address yet.
+        if (h.sender_paddr != l3addr() && h.sender_paddr != _l3self) {
+            auto known = _table.get(h.sender_paddr);
+            if (h.target_paddr == _l3self || (known && *known != h.sender_hwaddr)) {
+                arp_learn(h.sender_hwaddr, h.sender_paddr);
+            } else if (known) {
+                learn(h.sender_hwaddr, h.sender_paddr);
+            }
+        }
         return handle_request(&h);
     case op_reply:
         arp_learn(h.sender_hwaddr, h.sender_paddr);
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include <unordered_map>
 #include <memory>
@@ -75,6 +76,30 @@ struct srv_record {
  */
 class dns_resolver {
 public:
+    /**
+     * Caching of get_host_by_name() results.
+     *
+     * Successful lookups are kept for the TTL of their records, capped to
+     * max_ttl, and names that don't exist for negative_ttl. Concurrent
+     * lookups of a name share a single query, and a cached name that is
+     * looked up after refresh_ahead of its TTL has passed is queried again
+     * in the background, so that hot names never expire.
+     *
+     * Since c-ares only reports TTLs through ares_getaddrinfo(), cached
+     * lookups go through it; with no family, both IPv4 and IPv6 addresses
+     * are returned.
+     */
+    struct cache_options {
+        std::chrono::seconds max_ttl = std::chrono::seconds(300);
+        std::chrono::seconds negative_ttl = std::chrono::seconds(5);
+        // Fraction of the TTL after which a hit refreshes the entry
+        float refresh_ahead = 0.8;
+        size_t max_entries = 10000;
+        // When set, lookups of all shards are resolved and cached by a
+        // resolver on this shard, created with the options of the first
+        // resolver to use it.
+        std::optional<unsigned> shard;
+    };
     struct options {
         std::optional<bool>
             use_tcp_query;
@@ -86,6 +111,8 @@ class dns_resolver {
             tcp_port, udp_port;
         std::optional<std::vector<sstring>>
             domains;
+        std::optional<cache_options>
+            cache;
     };
 
     enum class srv_proto {
@@ -126,6 +153,12 @@ class dns_resolver {
                                         const sstring& service,
                                         const sstring& domain);
 
+    /**
+     * Number of queries sent to the name servers. Lookups answered
+     * from the cache, or by a query already in flight, don't count.
+     */
+    uint64_t queries() const noexcept;
+
     /**
      * Shuts the object down. Great for tests.
      */
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <seastar/net/config.hh>
 #include <seastar/net/net.hh>
@@ -41,6 +42,24 @@ struct dpdk_options : public program_options::option_group {
     ///
     /// Default: \p on.
     program_options::value<std::string> hw_fc;
+    /// \brief Interval in milliseconds between rebalancing rounds of the RSS
+    /// redirection table.
+    ///
+    /// Moves RSS buckets from the busiest queues to the least busy ones,
+    /// according to the packets received. Established connections stay on
+    /// their shard. Needs as many queues as shards.
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> rss_rebalance_interval;
+    /// \brief Steer the connections the native stack opens to their shard
+    /// with rte_flow rules (on / off).
+    ///
+    /// Keeps them from being forwarded to their shard in software once RSS
+    /// rebalancing moves their bucket. Needs as many queues as shards and
+    /// a NIC that can match TCP flows exactly.
+    ///
+    /// Default: \p off.
+    program_options::value<std::string> hw_flow_steering;
 
     /// \cond internal
     dpdk_options(program_options::option_group* parent_group);
@@ -57,7 +76,10 @@ std::unique_ptr<net::device> create_dpdk_net_device(
                                     uint16_t port_idx = 0,
                                     uint16_t num_queues = 1,
                                     bool use_lro = true,
-                                    bool enable_fc = true);
+                                    bool enable_fc = true,
+                                    std::chrono::milliseconds rss_rebalance_interval = std::chrono::milliseconds(0),
+                                    bool hw_timestamps = false,
+                                    bool flow_steering = false);
 
 std::unique_ptr<net::device> create_dpdk_net_device(
                                     const net::hw_config& hw_cfg);
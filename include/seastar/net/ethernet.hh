@@ -72,6 +72,9 @@ struct ethernet_address {
     static constexpr size_t size() noexcept {
         return 6;
     }
+    bool operator==(const ethernet_address& x) const noexcept {
+        return mac == x.mac;
+    }
 } __attribute__((packed));
 
 std::ostream& operator<<(std::ostream& os, ethernet_address ea);
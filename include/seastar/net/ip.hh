@@ -76,7 +76,11 @@ struct ipv4_traits {
     static void udp_pseudo_header_checksum(checksummer& csum, ipv4_address src, ipv4_address dst, uint16_t len) {
         csum.sum_many(src.ip.raw, dst.ip.raw, uint8_t(0), uint8_t(ip_protocol_num::udp), len);
     }
+    static void hash_address(forward_hash& hash_data, ipv4_address a) {
+        hash_data.push_back(hton(a.ip));
+    }
     static constexpr uint8_t ip_hdr_len_min = ipv4_hdr_len_min;
+    static constexpr sa_family_t address_family = AF_INET;
 };
 
 template <ip_protocol_num ProtoNum>
@@ -122,10 +126,10 @@ struct l4connid {
                 && foreign_port == x.foreign_port;
     }
 
-    uint32_t hash(rss_key_type rss_key) {
+    uint32_t hash(rss_key_type rss_key) const {
         forward_hash hash_data;
-        hash_data.push_back(hton(foreign_ip.ip));
-        hash_data.push_back(hton(local_ip.ip));
+        InetTraits::hash_address(hash_data, foreign_ip);
+        InetTraits::hash_address(hash_data, local_ip);
         hash_data.push_back(hton(foreign_port));
         hash_data.push_back(hton(local_port));
         return toeplitz_hash(rss_key, hash_data);
@@ -315,9 +319,30 @@ class ipv4 {
     timer<lowres_clock> _frag_timer;
     circular_buffer<l3_protocol::l3packet> _packetq;
     unsigned _pkt_provider_idx = 0;
+    // Software GRO: in-order TCP segments of a flow received in the same
+    // poll are held here and merged, until a task run after the poll
+    // delivers them
+    struct gro_flow {
+        packet p;
+        ipv4_address src;
+        ipv4_address dst;
+        uint32_t next_seq;
+    };
+    static constexpr size_t _gro_max_flows = 8;
+    std::vector<gro_flow> _gro_flows;
+    bool _gro = false;
+    bool _gro_flush_scheduled = false;
+    bool _tso = false;
+    uint64_t _gro_merged = 0;
+    uint64_t _tso_segments = 0;
     metrics::metric_groups _metrics;
 private:
     future<> handle_received_packet(packet p, ethernet_address from);
+    // Returns true if the segment was held for merging
+    bool gro_receive(packet& p, ipv4_address src, ipv4_address dst);
+    void gro_deliver(gro_flow& f);
+    void gro_flush();
+    void send_segmented(ipv4_address to, packet p, ethernet_address e_dst);
     bool forward(forward_hash& out_hash_data, packet& p, size_t off);
     std::optional<l3_protocol::l3packet> get_packet();
     bool in_my_netmask(ipv4_address a) const;
@@ -336,6 +361,10 @@ class ipv4 {
     explicit ipv4(interface* netif);
     void set_host_address(ipv4_address ip);
     ipv4_address host_address() const;
+    // The address packets sent to \c to originate from
+    ipv4_address source_address(ipv4_address to) const {
+        return _host_address;
+    }
     void set_gw_address(ipv4_address ip);
     ipv4_address gw_address() const;
     void set_netmask_address(ipv4_address ip);
@@ -348,7 +377,23 @@ class ipv4 {
     // But for now, a simple single raw pointer suffices
     void set_packet_filter(ip_packet_filter *);
     ip_packet_filter * packet_filter() const;
+    /// Merges in-order TCP segments received in the same poll before
+    /// passing them to the TCP layer
+    void set_sw_gro(bool enable) {
+        _gro = enable;
+    }
+    /// Splits large TCP segments in software when the device can't, so
+    /// that TCP hands down as much data per segment as with TSO
+    void set_sw_tso(bool enable) {
+        _tso = enable;
+    }
+    bool sw_tso() const {
+        return _tso;
+    }
     void send(ipv4_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst);
+    // Hands a received TCP segment, stripped of its IP header, over to
+    // the stack on another shard
+    void forward_tcp(unsigned cpu, packet p, ipv4_address from, ipv4_address to);
     tcp<ipv4_traits>& get_tcp() { return *_tcp._tcp; }
     ipv4_udp& get_udp() { return _udp; }
     void register_l4(proto_type id, ip_protocol* handler);
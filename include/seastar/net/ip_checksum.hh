@@ -40,6 +40,9 @@ struct checksummer {
     bool odd = false;
     void sum(const char* data, size_t len);
     void sum(const packet& p);
+    /// Copies \c len bytes from \c src to \c dst and adds them to the
+    /// checksum, in a single pass over the data
+    void sum_copy(char* dst, const char* src, size_t len);
     void sum(uint8_t data) {
         if (!odd) {
             csum += data << 8;
@@ -0,0 +1,237 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+#endif
+
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/net/const.hh>
+#include <seastar/net/ethernet.hh>
+#include <seastar/net/ip.hh>
+#include <seastar/net/ip_checksum.hh>
+#include <seastar/net/ipv6_address.hh>
+#include <seastar/net/neighbor_cache.hh>
+#include <seastar/net/net.hh>
+
+namespace seastar {
+
+namespace net {
+
+class ipv6;
+template <ip_protocol_num ProtoNum>
+class ipv6_l4;
+
+template <typename InetTraits>
+class tcp;
+
+struct ipv6_traits {
+    using address_type = ipv6_address;
+    using inet_type = ipv6_l4<ip_protocol_num::tcp>;
+    struct l4packet {
+        ipv6_address to;
+        packet p;
+        ethernet_address e_dst;
+        ip_protocol_num proto_num;
+    };
+    using packet_provider_type = std::function<std::optional<l4packet> ()>;
+    // RFC8200, 8.1
+    static void pseudo_header_checksum(checksummer& csum, ip_protocol_num proto, const ipv6_address& src, const ipv6_address& dst, uint32_t len) {
+        csum.sum(reinterpret_cast<const char*>(src.ip.data()), src.size());
+        csum.sum(reinterpret_cast<const char*>(dst.ip.data()), dst.size());
+        csum.sum_many(len, uint16_t(0), uint16_t(proto));
+    }
+    static void tcp_pseudo_header_checksum(checksummer& csum, const ipv6_address& src, const ipv6_address& dst, uint16_t len) {
+        pseudo_header_checksum(csum, ip_protocol_num::tcp, src, dst, len);
+    }
+    static void udp_pseudo_header_checksum(checksummer& csum, const ipv6_address& src, const ipv6_address& dst, uint16_t len) {
+        pseudo_header_checksum(csum, ip_protocol_num::udp, src, dst, len);
+    }
+    static void hash_address(forward_hash& hash_data, const ipv6_address& a) {
+        for (auto b : a.ip) {
+            hash_data.push_back(b);
+        }
+    }
+    static constexpr uint8_t ip_hdr_len_min = ipv6_hdr_len_min;
+    static constexpr sa_family_t address_family = AF_INET6;
+};
+
+template <ip_protocol_num ProtoNum>
+class ipv6_l4 {
+public:
+    ipv6& _inet;
+public:
+    ipv6_l4(ipv6& inet) : _inet(inet) {}
+    void register_packet_provider(ipv6_traits::packet_provider_type func);
+    future<ethernet_address> get_l2_dst_address(ipv6_address to);
+    const ipv6& inet() const {
+        return _inet;
+    }
+};
+
+struct ipv6_hdr {
+    // Version, traffic class and flow label
+    packed<uint32_t> ver_tc_flow;
+    packed<uint16_t> payload_len;
+    uint8_t next_header;
+    uint8_t hop_limit;
+    ipv6_address src_ip;
+    ipv6_address dst_ip;
+    template <typename Adjuster>
+    auto adjust_endianness(Adjuster a) {
+        return a(ver_tc_flow, payload_len);
+    }
+    uint8_t version() const { return uint32_t(ver_tc_flow) >> 28; }
+} __attribute__((packed));
+
+/// IPv6 layer of the native stack.
+///
+/// The interface always has a link-local address derived from its MAC
+/// address, and optionally a statically configured global one; there is
+/// no SLAAC nor DHCPv6. Link-layer addresses are resolved with neighbor
+/// discovery (RFC4861), which also answers the solicitations of our
+/// addresses. Hop-by-hop options, destination options, routing headers
+/// with no segments left and atomic fragments are skipped on receive,
+/// other extension headers make the packet dropped: the stack doesn't
+/// reassemble fragments, TCP sizes its segments to the MTU. TCP and
+/// ICMPv6 echo are supported.
+class ipv6 {
+public:
+    using clock_type = lowres_clock;
+    using address_type = ipv6_address;
+    static constexpr unsigned default_prefix_length = 64;
+private:
+    interface* _netif;
+    std::vector<ipv6_traits::packet_provider_type> _pkt_providers;
+    unsigned _pkt_provider_idx = 0;
+    ipv6_address _link_local_address;
+    // Unspecified when only the link-local address is used
+    ipv6_address _host_address;
+    unsigned _prefix_length = default_prefix_length;
+    ipv6_address _gw_address;
+    l3_protocol _l3;
+    ipv6_l4<ip_protocol_num::tcp> _tcp_l4;
+    std::unique_ptr<tcp<ipv6_traits>> _tcp;
+    neighbor_cache<ipv6_address> _neighbors;
+    // ICMPv6 messages, neighbor discovery included
+    circular_buffer<ipv6_traits::l4packet> _icmp_packetq;
+    semaphore _icmp_queue_space = {212992};
+    circular_buffer<l3_protocol::l3packet> _packetq;
+    struct {
+        uint64_t dropped_extension_headers = 0;
+        uint64_t neighbor_solicitations_sent = 0;
+        uint64_t neighbor_solicitations_received = 0;
+        uint64_t neighbor_advertisements_received = 0;
+    } _stats;
+    metrics::metric_groups _metrics;
+private:
+    future<> handle_received_packet(packet p, ethernet_address from);
+    bool forward(forward_hash& out_hash_data, packet& p, size_t off);
+    std::optional<l3_protocol::l3packet> get_packet();
+    bool is_my_address(const ipv6_address& a) const;
+    bool on_link(const ipv6_address& a) const;
+    void icmp_received(packet p, ethernet_address from, const ipv6_hdr& h);
+    void handle_neighbor_solicitation(packet& p, ethernet_address from, const ipv6_hdr& h);
+    void handle_neighbor_advertisement(packet& p, const ipv6_hdr& h);
+    // Unicast to the known address of the target when refreshing its entry
+    void send_neighbor_solicitation(const ipv6_address& target, std::optional<ethernet_address> known);
+    // Checksums an ICMPv6 message and queues it for sending
+    void send_icmp(const ipv6_address& to, packet p, ethernet_address e_dst);
+    future<ethernet_address> resolve(const ipv6_address& addr);
+public:
+    explicit ipv6(interface* netif);
+    ~ipv6();
+    void set_host_address(ipv6_address ip, unsigned prefix_length = default_prefix_length);
+    /// The global address if one is configured, the link-local one otherwise
+    ipv6_address host_address() const;
+    ipv6_address link_local_address() const {
+        return _link_local_address;
+    }
+    /// The address packets sent to \c to originate from
+    ipv6_address source_address(const ipv6_address& to) const;
+    void set_gw_address(ipv6_address ip);
+    ipv6_address gw_address() const;
+    interface* netif() const {
+        return _netif;
+    }
+    const net::hw_features& hw_features() const { return _netif->hw_features(); }
+    // Large TCP segments are only handed down when the device segments them
+    bool sw_tso() const {
+        return false;
+    }
+    void send(const ipv6_address& to, ip_protocol_num proto_num, packet p, ethernet_address e_dst);
+    // Hands a received TCP segment, stripped of its IP header, over to
+    // the stack on another shard
+    void forward_tcp(unsigned cpu, packet p, ipv6_address from, ipv6_address to);
+    tcp<ipv6_traits>& get_tcp() { return *_tcp; }
+    void register_packet_provider(ipv6_traits::packet_provider_type&& func) {
+        _pkt_providers.push_back(std::move(func));
+    }
+    future<ethernet_address> get_l2_dst_address(const ipv6_address& to);
+    void learn(ethernet_address l2, ipv6_address l3);
+    void set_reachable_time(std::chrono::seconds t) {
+        _neighbors.set_reachable_time(t);
+    }
+
+    /// fe80::/64 address with the modified EUI-64 interface identifier of \c mac
+    static ipv6_address make_link_local_address(ethernet_address mac);
+    static ipv6_address solicited_node_address(const ipv6_address& a);
+    static ethernet_address multicast_ethernet_address(const ipv6_address& a);
+    /// Walks the extension headers from \c off, where the header \c next
+    /// starts, and returns the upper-layer protocol and the offset of its
+    /// header, or nothing if the packet should be dropped
+    static std::optional<std::pair<uint8_t, size_t>> upper_layer(packet& p, size_t off, uint8_t next);
+};
+
+template <ip_protocol_num ProtoNum>
+inline
+void ipv6_l4<ProtoNum>::register_packet_provider(ipv6_traits::packet_provider_type func) {
+    _inet.register_packet_provider([func = std::move(func)] {
+        auto l4p = func();
+        if (l4p) {
+            l4p.value().proto_num = ProtoNum;
+        }
+        return l4p;
+    });
+}
+
+template <ip_protocol_num ProtoNum>
+inline
+future<ethernet_address> ipv6_l4<ProtoNum>::get_l2_dst_address(ipv6_address to) {
+    return _inet.get_l2_dst_address(to);
+}
+
+// Teaches all the shards a neighbor's link-layer address, since the
+// advertisements reach whichever shard their addresses hash to
+void ndisc_learn(ethernet_address l2, ipv6_address l3);
+
+}
+
+}
@@ -24,6 +24,7 @@
 #include <seastar/net/net.hh>
 #include <seastar/net/virtio.hh>
 #include <seastar/net/dpdk.hh>
+#include <seastar/net/xdp.hh>
 #include <seastar/util/program-options.hh>
 
 namespace seastar {
@@ -52,6 +53,23 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// Default: \p 255.255.255.0.
     program_options::value<std::string> netmask_ipv4_addr;
+    /// \brief Static global IPv6 address to use.
+    ///
+    /// Only the link-local address derived from the MAC address is used
+    /// when empty.
+    ///
+    /// Default: empty.
+    program_options::value<std::string> host_ipv6_addr;
+    /// \brief Prefix length of the static IPv6 address.
+    ///
+    /// Default: 64.
+    program_options::value<unsigned> ipv6_prefix_length;
+    /// \brief Static IPv6 gateway to use.
+    ///
+    /// All destinations are considered on-link when empty.
+    ///
+    /// Default: empty.
+    program_options::value<std::string> gw_ipv6_addr;
     /// \brief Default size of the UDPv4 per-channel packet queue.
     ///
     /// Default: \ref ipv4_udp::default_queue_size.
@@ -76,6 +94,31 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// Default: \p on.
     program_options::value<std::string> lro;
+    /// \brief Merge in-order TCP segments of a flow in software before
+    /// processing them.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> sw_gro;
+    /// \brief Segment large TCP packets in software when the device doesn't
+    /// support TSO.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> sw_tso;
+    /// \brief TCP congestion control algorithm (reno/cubic/bbr).
+    ///
+    /// Can be changed per connection by setting the \c TCP_CONGESTION socket
+    /// option.
+    ///
+    /// Default: \p reno.
+    program_options::value<std::string> tcp_congestion_control;
+    /// \brief Timestamp packets, and export histograms of the time from
+    /// the NIC to the application and from the application to the device.
+    ///
+    /// Uses the NIC's receive timestamps when the device supports them
+    /// (DPDK), or else timestamps packets when they're polled.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> packet_timestamps;
 
     /// Virtio configuration.
     virtio_options virtio_opts;
@@ -83,6 +126,8 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// \note Unused when seastar is compiled without DPDK support.
     dpdk_options dpdk_opts;
+    /// AF_XDP configuration.
+    xdp_options xdp_opts;
 
     /// \cond internal
     bool _hugepages;
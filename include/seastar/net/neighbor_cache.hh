@@ -0,0 +1,303 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#endif
+
+#include <seastar/core/future.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/net/ethernet.hh>
+
+namespace seastar {
+
+namespace net {
+
+class arp_error : public std::runtime_error {
+public:
+    arp_error(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+class arp_timeout_error : public arp_error {
+public:
+    arp_timeout_error() : arp_error("ARP timeout") {}
+};
+
+class arp_queue_full_error : public arp_error {
+public:
+    arp_queue_full_error() : arp_error("ARP waiter's queue is full") {}
+};
+
+/// Link-layer addresses of the neighbors of an L3 protocol, for ARP and
+/// IPv6 neighbor discovery.
+///
+/// Entries are kept in a flat open addressing table, sized up front, so
+/// that looking a known neighbor up on the transmit path takes a probe or
+/// two and no allocation. An entry stays valid for the reachable time
+/// after it was learned. Lookups during the last fifth of that period
+/// query the neighbor at its known address in the background, so that
+/// the entry of an active neighbor is renewed before it expires instead
+/// of its traffic stalling on a new resolution.
+///
+/// The lookups of an unknown neighbor share one resolution, which queries
+/// it up to \ref max_probes times and releases all its waiters at once.
+///
+/// Failures are reported with \ref arp_timeout_error and
+/// \ref arp_queue_full_error whatever the protocol.
+template <typename L3Addr>
+class neighbor_cache {
+public:
+    using clock_type = lowres_clock;
+    using l2addr = ethernet_address;
+    using l3addr = L3Addr;
+    /// Sends a query for an address: to its known link-layer address when
+    /// refreshing an entry, to everyone concerned otherwise
+    using query_func = std::function<void (const l3addr&, std::optional<l2addr>)>;
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t refreshes = 0;
+        uint64_t expired = 0;
+        uint64_t timeouts = 0;
+    };
+    static constexpr size_t max_waiters = 512;
+    static constexpr unsigned max_probes = 3;
+    static constexpr std::chrono::seconds probe_interval{1};
+    static constexpr std::chrono::seconds default_reachable_time{300};
+private:
+    struct entry {
+        l3addr l3;
+        l2addr l2;
+        clock_type::time_point expires;
+        // Lookups from this point on refresh the entry
+        clock_type::time_point refresh;
+        bool used = false;
+    };
+    struct resolution {
+        std::vector<promise<l2addr>> _waiters;
+        timer<> _timer;
+        unsigned _probes = 0;
+    };
+    query_func _query;
+    // Power of two sized, at most three quarters full
+    std::vector<entry> _entries;
+    size_t _size = 0;
+    clock_type::duration _reachable_time = default_reachable_time;
+    std::unordered_map<l3addr, resolution> _in_progress;
+    stats _stats;
+private:
+    static size_t table_size(size_t capacity) noexcept {
+        size_t n = 8;
+        while (n * 3 < capacity * 4) {
+            n *= 2;
+        }
+        return n;
+    }
+    size_t next(size_t i) const noexcept {
+        return (i + 1) & (_entries.size() - 1);
+    }
+    size_t slot_of(const l3addr& a) const noexcept {
+        return std::hash<l3addr>()(a) & (_entries.size() - 1);
+    }
+    entry* find(const l3addr& a) noexcept {
+        for (auto i = slot_of(a); _entries[i].used; i = next(i)) {
+            if (_entries[i].l3 == a) {
+                return &_entries[i];
+            }
+        }
+        return nullptr;
+    }
+    // Rebuilds the table with n slots, without the expired entries
+    void rehash(size_t n) {
+        auto now = clock_type::now();
+        auto old = std::exchange(_entries, std::vector<entry>(n));
+        _size = 0;
+        for (auto& e : old) {
+            if (e.used && now < e.expires) {
+                auto i = slot_of(e.l3);
+                while (_entries[i].used) {
+                    i = next(i);
+                }
+                _entries[i] = e;
+                ++_size;
+            }
+        }
+    }
+    entry& insert(const l3addr& a) {
+        if (auto e = find(a)) {
+            return *e;
+        }
+        if ((_size + 1) * 4 > _entries.size() * 3) {
+            rehash(_entries.size());
+            if ((_size + 1) * 4 > _entries.size() * 3) {
+                rehash(_entries.size() * 2);
+            }
+        }
+        auto i = slot_of(a);
+        while (_entries[i].used) {
+            i = next(i);
+        }
+        auto& e = _entries[i];
+        e = entry{};
+        e.l3 = a;
+        e.used = true;
+        ++_size;
+        return e;
+    }
+    void erase_entry(entry* e) noexcept {
+        // Backward shift deletion: moves the following entries of the
+        // cluster that would become unreachable into the hole
+        auto i = size_t(e - _entries.data());
+        _entries[i].used = false;
+        --_size;
+        for (auto j = next(i); _entries[j].used; j = next(j)) {
+            auto k = slot_of(_entries[j].l3);
+            bool reachable = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (!reachable) {
+                _entries[i] = _entries[j];
+                _entries[j].used = false;
+                i = j;
+            }
+        }
+    }
+    void probe(const l3addr& a, resolution& res) {
+        if (res._probes++ == max_probes) {
+            res._timer.cancel();
+            ++_stats.timeouts;
+            for (auto& w : res._waiters) {
+                w.set_exception(arp_timeout_error());
+            }
+            res._waiters.clear();
+            return;
+        }
+        _query(a, std::nullopt);
+    }
+    future<l2addr> resolve(const l3addr& a) {
+        auto [i, first_request] = _in_progress.try_emplace(a);
+        auto& res = i->second;
+        if (first_request) {
+            res._timer.set_callback([this, a, &res] { probe(a, res); });
+        }
+        if (!res._timer.armed()) {
+            // New, or the previous resolution timed out
+            res._probes = 0;
+            res._timer.arm_periodic(probe_interval);
+            probe(a, res);
+        }
+        if (res._waiters.size() >= max_waiters) {
+            return make_exception_future<l2addr>(arp_queue_full_error());
+        }
+        res._waiters.emplace_back();
+        return res._waiters.back().get_future();
+    }
+public:
+    explicit neighbor_cache(query_func query, size_t capacity = 256)
+        : _query(std::move(query))
+        , _entries(table_size(capacity)) {
+    }
+    neighbor_cache(const neighbor_cache&) = delete;
+
+    future<l2addr> lookup(const l3addr& a) {
+        auto now = clock_type::now();
+        if (auto e = find(a)) {
+            if (now < e->expires) {
+                ++_stats.hits;
+                if (now >= e->refresh) {
+                    // Queried again every probe interval until answered
+                    e->refresh = now + probe_interval;
+                    ++_stats.refreshes;
+                    _query(a, e->l2);
+                }
+                return make_ready_future<l2addr>(e->l2);
+            }
+            ++_stats.expired;
+            erase_entry(e);
+        }
+        ++_stats.misses;
+        return resolve(a);
+    }
+    /// Returns the address of a neighbor with a valid entry
+    std::optional<l2addr> get(const l3addr& a) noexcept {
+        auto e = find(a);
+        if (e && clock_type::now() < e->expires) {
+            return e->l2;
+        }
+        return std::nullopt;
+    }
+    void learn(const l3addr& a, l2addr l2) {
+        auto& e = insert(a);
+        if (e.expires == clock_type::time_point::max() && e.refresh == clock_type::time_point::max()) {
+            // Permanent
+            return;
+        }
+        auto now = clock_type::now();
+        e.l2 = l2;
+        e.expires = now + _reachable_time;
+        e.refresh = now + _reachable_time * 4 / 5;
+        if (_in_progress.empty()) {
+            return;
+        }
+        auto i = _in_progress.find(a);
+        if (i != _in_progress.end()) {
+            auto& res = i->second;
+            res._timer.cancel();
+            for (auto&& pr : res._waiters) {
+                pr.set_value(l2);
+            }
+            _in_progress.erase(i);
+        }
+    }
+    /// Adds an entry which never expires nor gets overridden
+    void add_permanent(const l3addr& a, l2addr l2) {
+        auto& e = insert(a);
+        e.l2 = l2;
+        e.expires = clock_type::time_point::max();
+        e.refresh = clock_type::time_point::max();
+    }
+    void erase(const l3addr& a) noexcept {
+        if (auto e = find(a)) {
+            erase_entry(e);
+        }
+    }
+    void set_reachable_time(clock_type::duration d) noexcept {
+        _reachable_time = d;
+    }
+    size_t size() const noexcept {
+        return _size;
+    }
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+};
+
+}
+
+}
@@ -26,6 +26,7 @@
 #include <seastar/core/queue.hh>
 #include <seastar/core/stream.hh>
 #include <seastar/core/metrics_registration.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/net/toeplitz.hh>
 #include <seastar/net/ethernet.hh>
 #include <seastar/net/packet.hh>
@@ -72,6 +73,26 @@ class forward_hash {
     }
 };
 
+// Reports the RSS hash of every flow the local stack has state for
+using flow_census_type = std::function<void (const std::function<void (uint32_t hash)>&)>;
+
+// A TCP or UDP flow of the local stack, for the device to steer. The
+// addresses are as InetTraits::hash_address() puts them in a hash.
+struct flow_tuple {
+    ip_protocol_num proto;
+    bool ipv6 = false;
+    forward_hash local_ip;
+    forward_hash foreign_ip;
+    uint16_t local_port = 0;
+    uint16_t foreign_port = 0;
+};
+
+// A rule of the device steering a flow to a queue, removed when destroyed
+class flow_steering_rule {
+public:
+    virtual ~flow_steering_rule() {}
+};
+
 struct hw_features {
     // Enable tx ip header checksum offload
     bool tx_csum_ip_offload = false;
@@ -123,6 +144,7 @@ class interface {
     ethernet_address _hw_address;
     net::hw_features _hw_features;
     std::vector<l3_protocol::packet_provider_type> _pkt_providers;
+    bool _timestamps = false;
 private:
     future<> dispatch_packet(packet p);
 public:
@@ -134,6 +156,22 @@ class interface {
             std::function<bool (forward_hash&, packet&, size_t)> forward);
     void forward(unsigned cpuid, packet p);
     unsigned hash2cpu(uint32_t hash);
+    std::optional<unsigned> previous_flow_owner(uint32_t hash);
+    std::unique_ptr<flow_steering_rule> steer_flow(const flow_tuple& flow);
+    /// Timestamps packets to measure the latency the stack adds
+    ///
+    /// Received packets the device didn't timestamp are timestamped when
+    /// they're polled, and packets being sent when the application hands
+    /// them to TCP or UDP.
+    void set_packet_timestamps(bool enable) {
+        _timestamps = enable;
+    }
+    bool packet_timestamps() const noexcept {
+        return _timestamps;
+    }
+    // Called when the application reads the data of a packet
+    void account_rx_latency(const packet& p);
+    void register_flow_census(flow_census_type func);
     void register_packet_provider(l3_protocol::packet_provider_type func) {
         _pkt_providers.push_back(std::move(func));
     }
@@ -207,17 +245,24 @@ struct qp_stats {
             uint64_t total;        // total number of erroneous packets
             uint64_t csum;         // packets with bad checksum
         } bad;
+
+        // From the timestamp of a packet to the application reading it
+        metrics::internal::short_time_estimated_histogram latency;
     } rx;
 
     struct {
         struct qp_stats_good good;
         uint64_t linearized;       // number of packets that were linearized
+        // From the application sending a packet to the device queue
+        metrics::internal::short_time_estimated_histogram latency;
     } tx;
 };
 
 class qp {
     using packet_provider_type = std::function<std::optional<packet> ()>;
     std::vector<packet_provider_type> _pkt_providers;
+    // One per transport, e.g. TCP over IPv4 and over IPv6
+    std::vector<flow_census_type> _flow_census;
     std::optional<std::array<uint8_t, 128>> _sw_reta;
     circular_buffer<packet> _proxy_packetq;
     stream<packet> _rx_stream;
@@ -256,6 +301,19 @@ class qp {
     void register_packet_provider(packet_provider_type func) {
         _pkt_providers.push_back(std::move(func));
     }
+    void register_flow_census(flow_census_type func) {
+        _flow_census.push_back(std::move(func));
+    }
+    void flow_census(const std::function<void (uint32_t hash)>& visit) {
+        for (auto& census : _flow_census) {
+            census(visit);
+        }
+    }
+    void account_rx_latency(const packet& p) {
+        if (auto ts = p.timestamp()) {
+            _stats.rx.latency.add(std::chrono::system_clock::now() - *ts);
+        }
+    }
     bool poll_tx();
     friend class device;
 };
@@ -301,6 +359,19 @@ class device {
         // not necessary be true in the future
         return forward_dst(hash2qid(hash), [hash] { return hash; });
     }
+    // Shard that used to receive the flows of this hash before the device
+    // redirected them here, if any. Flows it still has state for are
+    // forwarded back to it.
+    virtual std::optional<unsigned> previous_flow_owner(uint32_t hash) {
+        return std::nullopt;
+    }
+    // Delivers the packets of a flow to the queue of this shard whatever
+    // their RSS hash, so that they aren't forwarded to it once the device
+    // moves their RSS bucket elsewhere. Returns nullptr if it can't. The
+    // rule has to be destroyed on this shard.
+    virtual std::unique_ptr<flow_steering_rule> steer_flow(const flow_tuple& flow) {
+        return nullptr;
+    }
 };
 
 }
@@ -29,10 +29,12 @@
 #ifndef SEASTAR_MODULE
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <iosfwd>
 #include <memory>
+#include <new>
 #include <optional>
 #include <vector>
 #endif
@@ -52,10 +54,14 @@ struct offload_info {
     ip_protocol_num protocol = ip_protocol_num::unused;
     bool needs_csum = false;
     uint8_t ip_hdr_len = 20;
+    // The IP header is an IPv6 one, with no checksum of its own
+    bool ipv6 = false;
     uint8_t tcp_hdr_len = 20;
     uint8_t udp_hdr_len = 8;
     bool needs_ip_csum = false;
     bool reassembled = false;
+    // The L4 checksum was already verified, e.g. by software GRO
+    bool rx_csum_verified = false;
     uint16_t tso_seg_size = 0;
     // HW stripped VLAN header (CPU order)
     std::optional<uint16_t> vlan_tci;
@@ -107,6 +113,7 @@ class packet final {
         uint16_t _allocated_frags;
         offload_info _offload_info;
         std::optional<uint32_t> _rss_hash;
+        std::optional<std::chrono::system_clock::time_point> _timestamp;
         char _data[internal_data_size]; // only _frags[0] may use
         unsigned _headroom = internal_data_size; // in _data
         // FIXME: share _data/_frags space
@@ -132,6 +139,7 @@ class packet final {
             n->_headroom = old->_headroom;
             n->_offload_info = old->_offload_info;
             n->_rss_hash = old->_rss_hash;
+            n->_timestamp = old->_timestamp;
             std::copy(old->_frags, old->_frags + old->_nr_frags, n->_frags);
             old->copy_internal_fragment_to(n.get());
             return n;
@@ -147,18 +155,17 @@ class packet final {
             }
             return copy(old.get(), std::max<size_t>(old->_nr_frags + extra_frags, 2 * old->_nr_frags));
         }
-        void* operator new(size_t size, size_t nr_frags = default_nr_frags) {
-            assert(nr_frags == uint16_t(nr_frags));
-            return ::operator new(size + nr_frags * sizeof(fragment));
-        }
+        // Objects of the default size are recycled through a per-shard
+        // cache, so that a steady stream of packets doesn't allocate
+        void* operator new(size_t size, size_t nr_frags = default_nr_frags);
         // Matching the operator new above
-        void operator delete(void* ptr, size_t) {
-            return ::operator delete(ptr);
-        }
+        void operator delete(void* ptr, size_t nr_frags);
         // Since the above "placement delete" hides the global one, expose it
         void operator delete(void* ptr) {
             return ::operator delete(ptr);
         }
+        // Reads _allocated_frags to find whether the object came from the cache
+        void operator delete(impl* ptr, std::destroying_delete_t);
 
         bool using_internal_data() const noexcept {
             return _nr_frags
@@ -288,6 +295,18 @@ class packet final {
     std::optional<uint32_t> set_rss_hash(uint32_t hash) noexcept {
         return _impl->_rss_hash = hash;
     }
+    // For received packets, when the NIC (or the kernel, if the NIC can't)
+    // received it; for packets being sent, when the application handed it
+    // to the stack. Only set when timestamping is enabled.
+    std::optional<std::chrono::system_clock::time_point> timestamp() const noexcept {
+        return _impl->_timestamp;
+    }
+    void set_timestamp(std::chrono::system_clock::time_point ts) noexcept {
+        _impl->_timestamp = ts;
+    }
+    void reset_timestamp() noexcept {
+        _impl->_timestamp.reset();
+    }
     // Call `func` for each fragment, avoiding data copies when possible
     // `func` is called with a temporary_buffer<char> parameter
     template <typename Func>
@@ -622,6 +641,7 @@ packet packet::share(size_t offset, size_t len) {
         offset = 0;
     }
     n._impl->_offload_info = _impl->_offload_info;
+    n._impl->_timestamp = _impl->_timestamp;
     assert(!n._impl->_deleter);
     n._impl->_deleter = _impl->_deleter.share();
     return n;
@@ -21,6 +21,9 @@
 
 #pragma once
 #ifndef SEASTAR_MODULE
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <unordered_set>
 #endif
 #include <seastar/core/sharded.hh>
@@ -28,6 +31,7 @@
 #include <seastar/net/stack.hh>
 #include <seastar/core/polymorphic_temporary_buffer.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
+#include <seastar/core/internal/zerocopy_send.hh>
 #include <seastar/util/program-options.hh>
 
 #include <unordered_set>
@@ -108,6 +112,52 @@ class conntrack {
     }
 };
 
+// Steers the connections of a SO_REUSEPORT group, made of one listening
+// socket per shard, with a BPF program: to the shard running on the CPU that
+// received the connection request, or to the shard with the fewest
+// connections. Shared by the shards listening on the same address.
+class reuseport_steering {
+    server_socket::load_balancing_algorithm _lba;
+    std::tuple<int, socket_address> _key;
+    // Listening socket of each shard
+    file_desc _sockets;
+    // Shard to steer to: per CPU for incoming_cpu, at index 0 for
+    // least_connections
+    file_desc _shards;
+    file_desc _prog;
+    // Open connections of each shard, -1 while it isn't listening
+    std::unique_ptr<std::atomic<int>[]> _connections;
+    // Serializes updates of the least loaded shard
+    std::mutex _mutex;
+    uint32_t _least_loaded;
+private:
+    file_desc load_program();
+    void update_least_loaded();
+public:
+    // Accounts an open connection of a least_connections group
+    class connection {
+        std::shared_ptr<reuseport_steering> _steering;
+        shard_id _shard = 0;
+    public:
+        connection() = default;
+        explicit connection(std::shared_ptr<reuseport_steering> steering);
+        connection(connection&&) = default;
+        ~connection();
+    };
+
+    reuseport_steering(server_socket::load_balancing_algorithm lba, std::tuple<int, socket_address> key);
+    ~reuseport_steering();
+    // Returns the steering of an address, or nullptr when the kernel or
+    // the process privileges don't allow it
+    static std::shared_ptr<reuseport_steering> get(int protocol, socket_address sa, server_socket::load_balancing_algorithm lba);
+    server_socket::load_balancing_algorithm lba() const noexcept {
+        return _lba;
+    }
+    // Adds the listening socket of the current shard to the group
+    void add_socket(file_desc& fd);
+    void remove_socket();
+};
+
 class posix_data_source_impl final : public data_source_impl, private internal::buffer_allocator {
     std::pmr::polymorphic_allocator<char>* _buffer_allocator;
     pollable_fd _fd;
@@ -124,10 +174,21 @@ class posix_data_source_impl final : public data_source_impl, private internal::
 };
 
 class posix_data_sink_impl : public data_sink_impl {
+    // Smaller sends are copied even in zero-copy mode, since the page
+    // pinning and the completion notification cost more than the copy
+    static constexpr size_t zerocopy_min_size = 16384;
     pollable_fd _fd;
     packet _p;
+    lw_shared_ptr<internal::zerocopy_send_state> _zc; // null unless zero-copy
+    // put() once charged to the scheduling group
+    future<> do_put(packet p);
+    future<> do_put(temporary_buffer<char> buf);
 public:
     explicit posix_data_sink_impl(pollable_fd fd) : _fd(std::move(fd)) {}
+    // The socket must have SO_ZEROCOPY enabled
+    struct zero_copy_tag {};
+    posix_data_sink_impl(pollable_fd fd, zero_copy_tag)
+            : _fd(std::move(fd)), _zc(make_lw_shared<internal::zerocopy_send_state>()) {}
     using data_sink_impl::put;
     future<> put(packet p) override;
     future<> put(temporary_buffer<char> buf) override;
@@ -182,6 +243,7 @@ class posix_server_socket_impl : public server_socket_impl {
     virtual future<accept_result> accept() override;
     virtual void abort_accept() override;
     virtual socket_address local_address() const override;
+    virtual file_desc dup_fd() const override;
 };
 
 class posix_reuseport_server_socket_impl : public server_socket_impl {
@@ -189,12 +251,17 @@ class posix_reuseport_server_socket_impl : public server_socket_impl {
     int _protocol;
     pollable_fd _lfd;
     std::pmr::polymorphic_allocator<char>* _allocator;
+    std::shared_ptr<reuseport_steering> _steering;
 public:
     explicit posix_reuseport_server_socket_impl(int protocol, socket_address sa, pollable_fd lfd,
-        std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) : _sa(sa), _protocol(protocol), _lfd(std::move(lfd)), _allocator(allocator) {}
+        std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator,
+        std::shared_ptr<reuseport_steering> steering = nullptr)
+            : _sa(sa), _protocol(protocol), _lfd(std::move(lfd)), _allocator(allocator), _steering(std::move(steering)) {}
+    ~posix_reuseport_server_socket_impl();
     virtual future<accept_result> accept() override;
     virtual void abort_accept() override;
     virtual socket_address local_address() const override;
+    virtual file_desc dup_fd() const override;
 };
 
 class posix_network_stack : public network_stack {
@@ -202,6 +269,7 @@ class posix_network_stack : public network_stack {
     const bool _reuseport;
 protected:
     std::pmr::polymorphic_allocator<char>* _allocator;
+    server_socket listen_reuseport(int protocol, socket_address sa, listen_options opts);
 public:
     explicit posix_network_stack(const program_options::option_group& opts, std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator);
     virtual server_socket listen(socket_address sa, listen_options opts) override;
@@ -0,0 +1,69 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#endif
+#include <seastar/net/api.hh>
+#include <seastar/net/socket_defs.hh>
+
+namespace seastar {
+
+namespace net {
+
+/// \addtogroup networking-module
+/// @{
+
+/// Options of a shared memory listener, see \ref shm_listen()
+struct shm_listen_options {
+    /// Size of each of the two ring buffers of a connection, a power of two
+    /// no smaller than 4096.
+    size_t ring_size = 1 << 20;
+    int listen_backlog = 100;
+};
+
+/// \brief Listens for shared memory connections from processes of the same host
+///
+/// Connections are established over the unix domain socket at \c sa ,
+/// through which the server hands the client a memfd holding a ring buffer
+/// for each direction, and eventfds to signal the peer. From then on data
+/// is copied through the rings, without going through the kernel's network
+/// stack, and the unix socket only serves to detect that the peer is gone.
+///
+/// The returned sockets are byte streams like TCP ones, so protocols built
+/// on \ref connected_socket, like \ref rpc, can use them unchanged:
+///
+///     rpc::protocol<serializer>::server server(proto, net::shm_listen(addr));
+///     rpc::protocol<serializer>::client client(proto, rpc::client_options{}, net::make_shm_socket(), addr);
+///
+/// Socket options (nodelay, keepalive, ...) are accepted and ignored.
+server_socket shm_listen(socket_address sa, shm_listen_options opts = {});
+
+/// Creates a \ref socket connecting to \ref shm_listen() servers
+socket make_shm_socket();
+
+/// @}
+
+}
+
+}
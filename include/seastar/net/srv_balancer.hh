@@ -0,0 +1,178 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+#include <vector>
+#endif
+#include <seastar/core/future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/dns.hh>
+#include <seastar/net/socket_defs.hh>
+
+namespace seastar {
+
+namespace net {
+
+/// \brief Client side load balancing across the targets of DNS SRV records
+///
+/// Endpoints are used in SRV priority order: the endpoints of the lowest
+/// priority are used as long as any of them is healthy. Among those, two
+/// endpoints are drawn at random in proportion to their SRV weights and the
+/// one with the lower expected completion time is picked (power of two
+/// choices). The expected completion time is the endpoint's latency, a
+/// peak-sensitive EWMA of the samples reported through leases, times the
+/// number of its outstanding leases plus one. Endpoints failing several
+/// times in a row are ejected for a while.
+///
+/// The balancer is not thread safe and must outlive its leases.
+class srv_balancer {
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    struct config {
+        /// Time constant of the latency EWMA. Samples above the current
+        /// latency replace it at once.
+        std::chrono::milliseconds decay_time = std::chrono::seconds(10);
+        /// Latency charged for a failure
+        std::chrono::milliseconds failure_penalty = std::chrono::seconds(1);
+        /// Consecutive failures that eject an endpoint
+        unsigned max_failures = 3;
+        /// How long an endpoint stays ejected
+        std::chrono::milliseconds ejection_time = std::chrono::seconds(10);
+    };
+
+    struct endpoint {
+        socket_address address;
+        unsigned short priority = 0;
+        unsigned short weight = 0;
+    };
+
+    struct endpoint_stats {
+        socket_address address;
+        unsigned short priority;
+        unsigned short weight;
+        /// Zero until the first sample
+        std::chrono::duration<double> latency;
+        unsigned outstanding;
+        uint64_t picks;
+        bool ejected;
+    };
+
+private:
+    struct state {
+        endpoint ep;
+        double latency = 0; // seconds
+        bool sampled = false;
+        clock_type::time_point stamp;
+        unsigned outstanding = 0;
+        unsigned failures = 0;
+        clock_type::time_point ejected_until;
+        uint64_t picks = 0;
+
+        explicit state(endpoint e) noexcept : ep(std::move(e)) {}
+    };
+
+    config _cfg;
+    // Sorted by priority
+    std::vector<lw_shared_ptr<state>> _endpoints;
+    std::default_random_engine _rng;
+
+    void record(state& s, clock_type::duration latency, bool success) noexcept;
+    size_t pick_weighted(const std::vector<size_t>& candidates);
+    double cost(const state& s, double unsampled) const noexcept;
+
+public:
+    /// \brief An endpoint picked by acquire()
+    ///
+    /// Counts as outstanding on its endpoint until destroyed. Completing it
+    /// reports a latency sample, measured from acquisition or from the
+    /// previous completion.
+    class lease {
+        srv_balancer* _balancer = nullptr;
+        lw_shared_ptr<state> _state;
+        clock_type::time_point _start;
+
+        lease(srv_balancer* b, lw_shared_ptr<state> s) noexcept;
+        friend class srv_balancer;
+    public:
+        lease() noexcept = default;
+        lease(lease&&) noexcept = default;
+        lease& operator=(lease&& o) noexcept;
+        ~lease();
+
+        explicit operator bool() const noexcept { return bool(_state); }
+        const socket_address& address() const noexcept { return _state->ep.address; }
+        /// Reports the time since acquisition or the previous completion
+        void complete(bool success) noexcept;
+        /// Reports the given latency
+        void complete(bool success, clock_type::duration latency) noexcept;
+    };
+
+    srv_balancer();
+    explicit srv_balancer(config cfg);
+    srv_balancer(const srv_balancer&) = delete;
+
+    /// Replaces the endpoints. Endpoints with an address already known
+    /// keep their latency and outstanding leases.
+    void set_endpoints(std::vector<endpoint> endpoints);
+
+    /// Sets the endpoints to the targets of the SRV records of the service,
+    /// each resolved to one address. Records whose target can't be
+    /// resolved are skipped.
+    future<> resolve(dns_resolver::srv_proto proto, const sstring& service, const sstring& domain);
+
+    /// Picks an endpoint, throws std::runtime_error when there are none
+    lease acquire();
+
+    /// \brief Runs \c func on a picked endpoint
+    ///
+    /// Reports the time the returned future took to resolve, and whether it
+    /// failed.
+    template <typename Func>
+    requires std::is_invocable_v<Func, const socket_address&>
+    futurize_t<std::invoke_result_t<Func, const socket_address&>> with_endpoint(Func func) {
+        using futurator = futurize<std::invoke_result_t<Func, const socket_address&>>;
+        return futurator::invoke([this, func = std::move(func)] () mutable {
+            auto l = acquire();
+            auto f = futurator::invoke(func, l.address());
+            return f.then_wrapped([l = std::move(l)] (auto f) mutable {
+                l.complete(!f.failed());
+                return f;
+            });
+        });
+    }
+
+    size_t size() const noexcept {
+        return _endpoints.size();
+    }
+    std::vector<endpoint_stats> get_stats() const;
+};
+
+}
+
+}
@@ -36,6 +36,7 @@ class connected_socket_impl {
     virtual data_source source() = 0;
     virtual data_source source(connected_socket_input_stream_config csisc);
     virtual data_sink sink() = 0;
+    virtual data_sink sink(connected_socket_output_stream_config cssc);
     virtual void shutdown_input() = 0;
     virtual void shutdown_output() = 0;
     virtual void set_nodelay(bool nodelay) = 0;
@@ -49,6 +50,16 @@ class connected_socket_impl {
     virtual socket_address local_address() const noexcept = 0;
     virtual socket_address remote_address() const noexcept = 0;
     virtual future<> wait_input_shutdown() = 0;
+    virtual bool can_send_file(file& f) const noexcept {
+        return false;
+    }
+    virtual future<> send_file(file& f, uint64_t pos, uint64_t len);
+    virtual bool can_pass_fds() const noexcept {
+        return false;
+    }
+    virtual future<> send_fds(std::vector<file_desc> fds, temporary_buffer<char> data);
+    virtual std::vector<file_desc> take_received_fds();
+    virtual file_desc dup_fd() const;
 };
 
 class socket_impl {
@@ -70,6 +81,7 @@ class server_socket_impl {
     virtual future<accept_result> accept() = 0;
     virtual void abort_accept() = 0;
     virtual socket_address local_address() const = 0;
+    virtual file_desc dup_fd() const;
 };
 
 class datagram_channel_impl {
@@ -77,8 +89,18 @@ class datagram_channel_impl {
     virtual ~datagram_channel_impl() {}
     virtual socket_address local_address() const = 0;
     virtual future<datagram> receive() = 0;
+    // Defaults to a single receive()
+    virtual future<std::vector<datagram>> receive_batch(size_t max);
     virtual future<> send(const socket_address& dst, const char* msg) = 0;
     virtual future<> send(const socket_address& dst, packet p) = 0;
+    // Defaults to sending the datagrams one by one
+    virtual future<> send_batch(std::vector<outgoing_datagram> datagrams);
+    // Defaults to slicing the packet and sending a batch
+    virtual future<> send_segmented(const socket_address& dst, packet p, uint16_t segment_size);
+    // Receive coalescing is not supported by default
+    virtual bool set_gro(bool enable) { return false; }
+    // Receive timestamps are not supported by default
+    virtual bool set_timestamping(bool enable) { return false; }
     virtual void shutdown_input() = 0;
     virtual void shutdown_output() = 0;
     virtual bool is_closed() const = 0;
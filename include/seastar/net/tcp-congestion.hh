@@ -0,0 +1,86 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#endif
+
+namespace seastar {
+
+namespace net {
+
+/// Congestion window of a native stack TCP sender
+///
+/// The window is maintained by the connection, which also implements
+/// fast retransmit and fast recovery. A \ref tcp_congestion_control is
+/// consulted whenever the window grows or shrinks.
+struct tcp_congestion_window {
+    // Congestion window, in bytes
+    uint32_t cwnd;
+    // Slow start threshold, in bytes
+    uint32_t ssthresh;
+    // Sender maximum segment size
+    uint32_t mss;
+};
+
+/// Congestion control algorithm of a native stack TCP connection
+///
+/// Modelled after Linux's tcp_congestion_ops. Each connection owns its own
+/// instance, so implementations can keep per-connection state.
+class tcp_congestion_control {
+public:
+    using clock_type = lowres_clock;
+    /// Round trip times are measured with a high resolution clock: on a
+    /// LAN they are well below the granularity of lowres_clock.
+    using rtt_type = std::chrono::microseconds;
+
+    virtual ~tcp_congestion_control() = default;
+    /// Name of the algorithm, as accepted by \ref make_tcp_congestion_control()
+    virtual std::string_view name() const noexcept = 0;
+    /// Called once the connection is established, or when the algorithm is
+    /// switched, with the initial (or current) window already set.
+    virtual void init(tcp_congestion_window& w) {}
+    /// Called when new data is acknowledged outside of loss recovery. Grows
+    /// the window.
+    virtual void cong_avoid(tcp_congestion_window& w, uint32_t acked_bytes) = 0;
+    /// Called on a loss event (fast retransmit or retransmission timeout).
+    /// Returns the new slow start threshold.
+    virtual uint32_t ssthresh(const tcp_congestion_window& w, uint32_t flight_size) = 0;
+    /// Called with every round trip time sample
+    virtual void rtt_sample(rtt_type rtt) {}
+};
+
+/// Creates a congestion control algorithm by name
+///
+/// Known names are \c reno, \c cubic and \c bbr. Throws
+/// \c std::invalid_argument on an unknown name.
+std::unique_ptr<tcp_congestion_control> make_tcp_congestion_control(std::string_view name);
+
+}
+
+}
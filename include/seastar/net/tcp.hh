@@ -26,6 +26,7 @@
 #include <map>
 #include <functional>
 #include <deque>
+#include <array>
 #include <chrono>
 #include <random>
 #include <stdexcept>
@@ -42,6 +43,7 @@
 #include <seastar/net/ip.hh>
 #include <seastar/net/const.hh>
 #include <seastar/net/packet-util.hh>
+#include <seastar/net/tcp-congestion.hh>
 #include <seastar/util/std-compat.hh>
 
 namespace seastar {
@@ -95,8 +97,8 @@ void tcp_debug(const char* fmt, Args&&... args) {
 
 struct tcp_option {
     // The kind and len field are fixed and defined in TCP protocol
-    enum class option_kind: uint8_t { mss = 2, win_scale = 3, sack = 4, timestamps = 8,  nop = 1, eol = 0 };
-    enum class option_len:  uint8_t { mss = 4, win_scale = 3, sack = 2, timestamps = 10, nop = 1, eol = 1 };
+    enum class option_kind: uint8_t { mss = 2, win_scale = 3, sack = 4, sack_blocks = 5, timestamps = 8,  nop = 1, eol = 0 };
+    enum class option_len:  uint8_t { mss = 4, win_scale = 3, sack = 2, sack_blocks = 2, timestamps = 10, nop = 1, eol = 1 };
     static void write(char* p, option_kind kind, option_len len) {
         p[0] = static_cast<uint8_t>(kind);
         if (static_cast<uint8_t>(len) > 1) {
@@ -141,6 +143,37 @@ struct tcp_option {
             tcp_option::write(p, kind, len);
         }
     };
+    // Left and right edges of the blocks of data received beyond the
+    // cumulative acknowledgment (RFC2018)
+    struct sack_blocks {
+        static constexpr option_kind kind = option_kind::sack_blocks;
+        static constexpr option_len len = option_len::sack_blocks;
+        static constexpr uint8_t block_len = 8;
+        static constexpr unsigned max_blocks = 4;
+        std::array<std::pair<uint32_t, uint32_t>, max_blocks> blocks;
+        unsigned nr_blocks = 0;
+        static tcp_option::sack_blocks read(const char* p) {
+            tcp_option::sack_blocks x;
+            auto n = std::min(unsigned((uint8_t(p[1]) - uint8_t(len)) / block_len), max_blocks);
+            for (; x.nr_blocks < n; x.nr_blocks++) {
+                auto b = p + uint8_t(len) + x.nr_blocks * block_len;
+                x.blocks[x.nr_blocks] = {read_be<uint32_t>(b), read_be<uint32_t>(b + 4)};
+            }
+            return x;
+        }
+        uint8_t size() const {
+            return nr_blocks ? uint8_t(len) + nr_blocks * block_len : 0;
+        }
+        void write(char* p) const {
+            p[0] = static_cast<uint8_t>(kind);
+            p[1] = size();
+            for (unsigned i = 0; i < nr_blocks; i++) {
+                auto b = p + uint8_t(len) + i * block_len;
+                write_be<uint32_t>(b, blocks[i].first);
+                write_be<uint32_t>(b + 4, blocks[i].second);
+            }
+        }
+    };
     struct timestamps {
         static constexpr option_kind kind = option_kind::timestamps;
         static constexpr option_len len = option_len::timestamps;
@@ -189,6 +222,9 @@ struct tcp_option {
     uint16_t _local_mss;
     uint8_t _remote_win_scale = 0;
     uint8_t _local_win_scale = 0;
+    // SACK blocks of the last segment parsed, and the ones to send
+    sack_blocks _remote_sack_blocks;
+    sack_blocks _local_sack_blocks;
 };
 inline char*& operator+=(char*& x, tcp_option::option_len len) { x += uint8_t(len); return x; }
 inline const char*& operator+=(const char*& x, tcp_option::option_len len) { x += uint8_t(len); return x; }
@@ -290,6 +326,7 @@ using tcp_packet_merger = packet_merger<tcp_seq, tcp_tag>;
 template <typename InetTraits>
 class tcp {
 public:
+    using inet_traits = InetTraits;
     using ipaddr = typename InetTraits::address_type;
     using inet_type = typename InetTraits::inet_type;
     using connid = l4connid<InetTraits>;
@@ -301,6 +338,8 @@ class tcp {
 
     class tcb : public enable_lw_shared_from_this<tcb> {
         using clock_type = lowres_clock;
+        // Transmit times, for RTT samples finer than clock_type can give
+        using rtt_clock_type = std::chrono::steady_clock;
         static constexpr tcp_state CLOSED         = tcp_state::CLOSED;
         static constexpr tcp_state LISTEN         = tcp_state::LISTEN;
         static constexpr tcp_state SYN_SENT       = tcp_state::SYN_SENT;
@@ -325,7 +364,11 @@ class tcp {
             packet p;
             uint16_t data_len;
             unsigned nr_transmits;
-            clock_type::time_point tx_time;
+            rtt_clock_type::time_point tx_time;
+            // Covered by a SACK block of the peer
+            bool sacked = false;
+            // Retransmitted during the current SACK based loss recovery
+            bool sack_retransmitted = false;
         };
         struct send {
             tcp_seq unacknowledged;
@@ -354,11 +397,11 @@ class tcp {
             // Smoothed round-trip time
             std::chrono::milliseconds srtt;
             bool first_rto_sample = true;
-            clock_type::time_point syn_tx_time;
+            rtt_clock_type::time_point syn_tx_time;
             // Congestion window
-            uint32_t cwnd;
+            uint32_t cwnd = 0;
             // Slow start threshold
-            uint32_t ssthresh;
+            uint32_t ssthresh = 0;
             // Duplicated ACKs
             uint16_t dupacks = 0;
             unsigned syn_retransmit = 0;
@@ -380,12 +423,16 @@ class tcp {
             // The total size of data stored in std::deque<packet> data
             size_t data_size = 0;
             tcp_packet_merger out_of_order;
+            // Sequence number of the last segment received out of order,
+            // whose block is reported first in SACK options
+            tcp_seq last_out_of_order;
             std::optional<promise<>> _data_received_promise;
             // The maximun memory buffer size allowed for receiving
             // Currently, it is the same as default receive window size when window scaling is enabled
             size_t max_receive_buf_size = 3737600;
         } _rcv;
         tcp_option _option;
+        std::unique_ptr<tcp_congestion_control> _cc;
         timer<lowres_clock> _delayed_ack;
         // Retransmission timeout
         std::chrono::milliseconds _rto{1000};
@@ -412,8 +459,16 @@ class tcp {
         };
         static isn_secret _isn_secret;
         tcp_seq get_isn();
+        // The MSS values a SYN cookie can encode, the largest one not above
+        // the peer's is used
+        static constexpr std::array<uint16_t, 8> syn_cookie_mss = {536, 1220, 1300, 1400, 1440, 1460, 4312, 8960};
+        static uint32_t syn_cookie_hash(const connid& id, uint32_t t, tcp_seq seg_seq, unsigned mss_index);
         circular_buffer<typename InetTraits::l4packet> _packetq;
         bool _poll_active = false;
+        // Passive open not handed to the listener yet
+        bool _pending_accept = false;
+        // Keeps the segments of an active open on this shard, see connect()
+        std::unique_ptr<flow_steering_rule> _steering;
         uint32_t get_default_receive_window_size() {
             // Linux's default window size
             constexpr uint32_t size = 29200;
@@ -427,9 +482,18 @@ class tcp {
     public:
         tcb(tcp& t, connid id);
         void input_handle_listen_state(tcp_hdr* th, packet p);
+        // Handles the ACK completing a handshake answered with a SYN cookie
+        void input_handle_syn_cookie(tcp_hdr* th, uint16_t mss, packet p);
         void input_handle_syn_sent_state(tcp_hdr* th, packet p);
+        // SYN cookies (RFC 4987) answer the SYNs a full listener can't
+        // keep a TCB for. The cookie is the ISN of the <SYN,ACK>: a
+        // 64 seconds counter, the MSS and a keyed hash of them and of the
+        // connection. Window scaling and SACK are not kept.
+        static tcp_seq make_syn_cookie(const connid& id, tcp_seq seg_seq, uint16_t mss);
+        // Returns the MSS of the cookie acknowledged by seg_ack, if valid
+        static std::optional<uint16_t> check_syn_cookie(const connid& id, tcp_seq seg_seq, tcp_seq seg_ack);
         void input_handle_other_state(tcp_hdr* th, packet p);
-        void output_one(bool data_retransmit = false);
+        void output_one(bool data_retransmit = false, size_t seg_index = 0);
         future<> wait_for_data();
         future<> wait_input_shutdown();
         void abort_reader() noexcept;
@@ -471,7 +535,24 @@ class tcp {
         tcp_state& state() {
             return _state;
         }
+        void set_congestion_control(std::string_view name) {
+            _cc = make_tcp_congestion_control(name);
+            update_congestion_window([this] (tcp_congestion_window& w) { _cc->init(w); });
+        }
+        std::string_view congestion_control() const noexcept {
+            return _cc->name();
+        }
     private:
+        template <typename Func>
+        void update_congestion_window(Func&& func) {
+            tcp_congestion_window w{_snd.cwnd, _snd.ssthresh, _snd.mss};
+            func(w);
+            _snd.cwnd = w.cwnd;
+            _snd.ssthresh = w.ssthresh;
+        }
+        uint32_t loss_ssthresh(uint32_t flight_size) {
+            return _cc->ssthresh(tcp_congestion_window{_snd.cwnd, _snd.ssthresh, _snd.mss}, flight_size);
+        }
         void respond_with_reset(tcp_hdr* th);
         bool merge_out_of_order();
         void insert_out_of_order(tcp_seq seq, packet p);
@@ -479,9 +560,9 @@ class tcp {
         bool should_send_ack(uint16_t seg_len);
         void clear_delayed_ack() noexcept;
         packet get_transmit_packet();
-        void retransmit_one() {
+        void retransmit_one(size_t seg_index = 0) {
             bool data_retransmit = true;
-            output_one(data_retransmit);
+            output_one(data_retransmit, seg_index);
         }
         void start_retransmit_timer() {
             auto now = clock_type::now();
@@ -508,7 +589,10 @@ class tcp {
         void persist();
         void retransmit();
         void fast_retransmit();
-        void update_rto(clock_type::time_point tx_time);
+        void sack_retransmit();
+        void update_sack_scoreboard();
+        void fill_sack_blocks();
+        void update_rto(rtt_clock_type::time_point tx_time);
         void update_cwnd(uint32_t acked_bytes);
         void cleanup();
         uint32_t can_send() {
@@ -577,13 +661,13 @@ class tcp {
         }
         void do_syn_sent() {
             _state = SYN_SENT;
-            _snd.syn_tx_time = clock_type::now();
+            _snd.syn_tx_time = rtt_clock_type::now();
             // Send <SYN> to remote
             output();
         }
         void do_syn_received() {
             _state = SYN_RECEIVED;
-            _snd.syn_tx_time = clock_type::now();
+            _snd.syn_tx_time = rtt_clock_type::now();
             // Send <SYN,ACK> to remote
             output();
         }
@@ -644,6 +728,11 @@ class tcp {
             return uint16_t(_state) & uint16_t(state);
         }
         void exit_fast_recovery() {
+            if (_snd.dupacks >= 3) {
+                for (auto& seg : _snd.data) {
+                    seg.sack_retransmitted = false;
+                }
+            }
             _snd.dupacks = 0;
             _snd.limited_transfer = 0;
             _snd.partial_ack = 0;
@@ -659,10 +748,15 @@ class tcp {
     std::random_device _rd;
     std::default_random_engine _e;
     std::uniform_int_distribution<uint16_t> _port_dist{41952, 65535};
+    std::string _congestion_control = "reno";
     circular_buffer<std::pair<lw_shared_ptr<tcb>, ethernet_address>> _poll_tcbs;
     // queue for packets that do not belong to any tcb
-    circular_buffer<ipv4_traits::l4packet> _packetq;
+    circular_buffer<typename InetTraits::l4packet> _packetq;
     semaphore _queue_space = {212992};
+    uint64_t _syn_cookies_sent = 0;
+    uint64_t _syn_cookies_accepted = 0;
+    uint64_t _syn_cookies_invalid = 0;
+    uint64_t _listen_overflows = 0;
     metrics::metric_groups _metrics;
 public:
     const inet_type& inet() const {
@@ -712,6 +806,12 @@ class tcp {
         uint16_t local_port() {
             return _tcb->_local_port;
         }
+        void set_congestion_control(std::string_view name) {
+            _tcb->set_congestion_control(name);
+        }
+        std::string_view congestion_control() const noexcept {
+            return _tcb->congestion_control();
+        }
         void shutdown_connect();
         void close_read() noexcept;
         void close_write() noexcept;
@@ -721,6 +821,8 @@ class tcp {
         uint16_t _port;
         queue<connection> _q;
         size_t _pending = 0;
+        // When the backlog last overflowed, and SYNs got cookies
+        std::optional<lowres_clock::time_point> _last_overflow;
     private:
         listener(tcp& t, uint16_t port, size_t queue_length)
             : _tcp(t), _port(port), _q(queue_length) {
@@ -728,7 +830,7 @@ class tcp {
         }
     public:
         listener(listener&& x)
-            : _tcp(x._tcp), _port(x._port), _q(std::move(x._q)) {
+            : _tcp(x._tcp), _port(x._port), _q(std::move(x._q)), _pending(x._pending), _last_overflow(x._last_overflow) {
             _tcp._listening[_port] = this;
             x._port = 0;
         }
@@ -746,6 +848,13 @@ class tcp {
             _q.abort(std::make_exception_ptr(std::system_error(ECONNABORTED, std::system_category())));
         }
         bool full() { return _pending + _q.size() >= _q.max_size(); }
+        bool accept_queue_full() { return _q.size() >= _q.max_size(); }
+        void note_overflow() { _last_overflow = lowres_clock::now(); }
+        // Cookies sent at the last overflow may still come back, see
+        // tcb::check_syn_cookie()
+        bool overflowed_recently() const {
+            return _last_overflow && lowres_clock::now() - *_last_overflow <= std::chrono::seconds(128);
+        }
         void inc_pending() { _pending++; }
         void dec_pending() { _pending--; }
 
@@ -764,6 +873,13 @@ class tcp {
     listener listen(uint16_t port, size_t queue_length = 100);
     connection connect(socket_address sa);
     const net::hw_features& hw_features() const { return _inet._inet.hw_features(); }
+    bool sw_tso() const { return _inet._inet.sw_tso(); }
+    /// Selects the congestion control algorithm of new connections
+    void set_congestion_control(std::string name) {
+        // Throws on unknown names
+        make_tcp_congestion_control(name);
+        _congestion_control = std::move(name);
+    }
     future<> poll_tcb(ipaddr to, lw_shared_ptr<tcb> tcb);
     void add_connected_tcb(lw_shared_ptr<tcb> tcbp, uint16_t local_port) {
         auto it = _listening.find(local_port);
@@ -772,9 +888,19 @@ class tcp {
             it->second->dec_pending();
         }
     }
+    // A passive open failed before it was accepted
+    void drop_pending(uint16_t local_port) {
+        auto it = _listening.find(local_port);
+        if (it != _listening.end() && it->second->_pending) {
+            it->second->dec_pending();
+        }
+    }
 private:
     void send_packet_without_tcb(ipaddr from, ipaddr to, packet p);
+    void send_control_packet(packet p, uint8_t hdr_len, ipaddr local_ip, ipaddr foreign_ip);
     void respond_with_reset(tcp_hdr* rth, ipaddr local_ip, ipaddr foreign_ip);
+    void respond_with_syn_cookie(tcp_hdr* rth, packet& p, const connid& id);
+    void accept_syn_cookie(listener& l, const connid& id, tcp_hdr* th, uint16_t mss, packet p);
     friend class listener;
 };
 
@@ -784,12 +910,28 @@ tcp<InetTraits>::tcp(inet_type& inet)
     , _e(_rd()) {
     namespace sm = metrics;
 
+    auto family = sm::label("family")(InetTraits::address_family == AF_INET ? "ipv4" : "ipv6");
     _metrics.add_group("tcp", {
-        sm::make_counter("linearizations", [] { return tcp_packet_merger::linearizations(); },
-                        sm::description("Counts a number of times a buffer linearization was invoked during the buffers merge process. "
-                                        "Divide it by a total TCP receive packet rate to get an everage number of lineraizations per TCP packet."))
+        sm::make_counter("syn_cookies_sent", _syn_cookies_sent,
+                        sm::description("Counts SYNs answered with a SYN cookie, because the backlog of their listener was full"), {family}),
+        sm::make_counter("syn_cookies_accepted", _syn_cookies_accepted,
+                        sm::description("Counts connections established from a valid SYN cookie"), {family}),
+        sm::make_counter("syn_cookies_invalid", _syn_cookies_invalid,
+                        sm::description("Counts ACKs to a listening port which carried no valid SYN cookie while its backlog had recently overflowed, which were dropped"), {family}),
+        sm::make_counter("listen_overflows", _listen_overflows,
+                        sm::description("Counts handshakes completed with a SYN cookie which were dropped, because the accept queue was full"), {family}),
     });
 
+    // The merger is shared by the address families, the IPv4 instance
+    // reports it
+    if constexpr (InetTraits::address_family == AF_INET) {
+        _metrics.add_group("tcp", {
+            sm::make_counter("linearizations", [] { return tcp_packet_merger::linearizations(); },
+                            sm::description("Counts a number of times a buffer linearization was invoked during the buffers merge process. "
+                                            "Divide it by a total TCP receive packet rate to get an everage number of lineraizations per TCP packet."))
+        });
+    }
+
     _inet.register_packet_provider([this, tcb_polled = 0u] () mutable {
         std::optional<typename InetTraits::l4packet> l4p;
         auto c = _poll_tcbs.size();
@@ -813,6 +955,13 @@ tcp<InetTraits>::tcp(inet_type& inet)
         }
         return l4p;
     });
+
+    _inet._inet.netif()->register_flow_census([this] (const std::function<void (uint32_t)>& visit) {
+        auto rss_key = _inet._inet.netif()->rss_key();
+        for (auto& [id, tcbp] : _tcbs) {
+            visit(id.hash(rss_key));
+        }
+    });
 }
 
 template <typename InetTraits>
@@ -830,9 +979,9 @@ auto tcp<InetTraits>::listen(uint16_t port, size_t queue_length) -> listener {
 template <typename InetTraits>
 auto tcp<InetTraits>::connect(socket_address sa) -> connection {
     connid id;
-    auto src_ip = _inet._inet.host_address();
-    auto dst_ip = ipv4_address(sa);
-    auto dst_port = net::ntoh(sa.u.in.sin_port);
+    auto dst_ip = ipaddr(sa);
+    auto src_ip = _inet._inet.source_address(dst_ip);
+    auto dst_port = sa.port();
 
     if (smp::count > 1) {
         do {
@@ -874,7 +1023,7 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
         return;
     }
 
-    if (!hw_features().rx_csum_offload) {
+    if (!hw_features().rx_csum_offload && !p.offload_info_ref().rx_csum_verified) {
         checksummer csum;
         InetTraits::tcp_pseudo_header_checksum(csum, from, to, p.len());
         csum.sum(p);
@@ -887,8 +1036,17 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
     auto tcbi = _tcbs.find(id);
     lw_shared_ptr<tcb> tcbp;
     if (tcbi == _tcbs.end()) {
+        if (!h.f_syn || h.f_ack) {
+            // The device may have redirected the flow here while the shard
+            // that used to receive it still has the connection
+            auto netif = _inet._inet.netif();
+            auto owner = netif->previous_flow_owner(id.hash(netif->rss_key()));
+            if (owner) {
+                return _inet._inet.forward_tcp(*owner, std::move(p), from, to);
+            }
+        }
         auto listener = _listening.find(id.local_port);
-        if (listener == _listening.end() || listener->second->full()) {
+        if (listener == _listening.end()) {
             // 1) In CLOSE state
             // 1.1 all data in the incoming segment is discarded.  An incoming
             // segment containing a RST is discarded. An incoming segment not
@@ -906,19 +1064,36 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
             }
             // 2.2 second check for an ACK
             if (h.f_ack) {
-                // Any acknowledgment is bad if it arrives on a connection
-                // still in the LISTEN state.
+                // Unless it completes a handshake answered with a SYN
+                // cookie, any acknowledgment is bad if it arrives on a
+                // connection still in the LISTEN state.
                 // <SEQ=SEG.ACK><CTL=RST>
+                // Cookies are only looked for while the listener may
+                // have sent some, so that ACKs can't be used to guess
+                // them the rest of the time. Bad ones are dropped, like
+                // the ACKs of a flood.
+                if (!h.f_syn && listener->second->overflowed_recently()) {
+                    if (auto mss = tcb::check_syn_cookie(id, h.seq, h.ack)) {
+                        return accept_syn_cookie(*listener->second, id, &h, *mss, std::move(p));
+                    }
+                    _syn_cookies_invalid++;
+                    return;
+                }
                 return respond_with_reset(&h, id.local_ip, id.foreign_ip);
             }
             // 2.3 third check for a SYN
             if (h.f_syn) {
+                if (listener->second->full()) {
+                    // Answer without keeping anything
+                    listener->second->note_overflow();
+                    return respond_with_syn_cookie(&h, p, id);
+                }
                 // check the security
                 // NOTE: Ignored for now
                 tcbp = make_lw_shared<tcb>(*this, id);
                 _tcbs.insert({id, tcbp});
-                // TODO: we need to remove the tcb and decrease the pending if
-                // it stays SYN_RECEIVED state forever.
+                // The tcb gives the pending slot back if the handshake
+                // fails, see tcb::cleanup()
                 listener->second->inc_pending();
 
                 return tcbp->input_handle_listen_state(&h, std::move(p));
@@ -948,7 +1123,7 @@ void tcp<InetTraits>::send_packet_without_tcb(ipaddr from, ipaddr to, packet p)
     if (_queue_space.try_wait(p.len())) { // drop packets that do not fit the queue
         // FIXME: future is discarded
         (void)_inet.get_l2_dst_address(to).then([this, to, p = std::move(p)] (ethernet_address e_dst) mutable {
-                _packetq.emplace_back(ipv4_traits::l4packet{to, std::move(p), e_dst, ip_protocol_num::tcp});
+                _packetq.emplace_back(typename InetTraits::l4packet{to, std::move(p), e_dst, ip_protocol_num::tcp});
         });
     }
 }
@@ -969,6 +1144,7 @@ tcp<InetTraits>::tcb::tcb(tcp& t, connid id)
     , _foreign_ip(id.foreign_ip)
     , _local_port(id.local_port)
     , _foreign_port(id.foreign_port)
+    , _cc(make_tcp_congestion_control(t._congestion_control))
     , _delayed_ack([this] { _nr_full_seg_received = 0; output(); })
     , _retransmit([this] { retransmit(); })
     , _persist([this] { persist(); }) {
@@ -1002,9 +1178,60 @@ void tcp<InetTraits>::respond_with_reset(tcp_hdr* rth, ipaddr local_ip, ipaddr f
     h.checksum = 0;
     h.write(th);
 
+    send_control_packet(std::move(p), tcp_hdr::len, local_ip, foreign_ip);
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::respond_with_syn_cookie(tcp_hdr* rth, packet& syn, const connid& id) {
+    auto opt_len = rth->data_offset * 4 - tcp_hdr::len;
+    auto opt_start = reinterpret_cast<uint8_t*>(syn.get_header(0, rth->data_offset * 4)) + tcp_hdr::len;
+    tcp_option option;
+    option.parse(opt_start, opt_start + opt_len);
+
+    // <SEQ=cookie><ACK=SEG.SEQ+1><CTL=SYN,ACK>, with our MSS only
+    constexpr uint8_t hdr_len = tcp_hdr::len + uint8_t(tcp_option::option_len::mss);
+    packet p;
+    auto th = p.prepend_uninitialized_header(hdr_len);
+    auto h = tcp_hdr{};
+    h.src_port = rth->dst_port;
+    h.dst_port = rth->src_port;
+    h.seq = tcb::make_syn_cookie(id, rth->seq, option._remote_mss);
+    h.ack = rth->seq + 1;
+    h.f_syn = true;
+    h.f_ack = true;
+    // Linux's default window, unscaled
+    h.window = 29200;
+    h.data_offset = hdr_len / 4;
+    h.checksum = 0;
+    h.write(th);
+    auto mss = tcp_option::mss();
+    mss.mss = hw_features().mtu - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min;
+    mss.write(th + tcp_hdr::len);
+
+    _syn_cookies_sent++;
+    send_control_packet(std::move(p), hdr_len, id.local_ip, id.foreign_ip);
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::accept_syn_cookie(listener& l, const connid& id, tcp_hdr* th, uint16_t mss, packet p) {
+    if (l.accept_queue_full()) {
+        // Like the lost ACK of a handshake, the peer retransmits
+        _listen_overflows++;
+        return;
+    }
+    _syn_cookies_accepted++;
+    auto tcbp = make_lw_shared<tcb>(*this, id);
+    _tcbs.insert({id, tcbp});
+    l.inc_pending();
+    tcbp->input_handle_syn_cookie(th, mss, std::move(p));
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::send_control_packet(packet p, uint8_t hdr_len, ipaddr local_ip, ipaddr foreign_ip) {
+    auto th = p.get_header(0, hdr_len);
     checksummer csum;
     offload_info oi;
-    InetTraits::tcp_pseudo_header_checksum(csum, local_ip, foreign_ip, tcp_hdr::len);
+    InetTraits::tcp_pseudo_header_checksum(csum, local_ip, foreign_ip, hdr_len);
     uint16_t checksum;
     if (hw_features().tx_csum_l4_offload) {
         checksum = ~csum.get();
@@ -1017,7 +1244,7 @@ void tcp<InetTraits>::respond_with_reset(tcp_hdr* rth, ipaddr local_ip, ipaddr f
     tcp_hdr::write_nbo_checksum(th, checksum);
 
     oi.protocol = ip_protocol_num::tcp;
-    oi.tcp_hdr_len = tcp_hdr::len;
+    oi.tcp_hdr_len = hdr_len;
     p.set_offload_info(oi);
 
     send_packet_without_tcb(local_ip, foreign_ip, std::move(p));
@@ -1110,6 +1337,7 @@ void tcp<InetTraits>::tcb::init_from_options(tcp_hdr* th, uint8_t* opt_start, ui
 
     // Setup initial slow start threshold
     _snd.ssthresh = th->window << _snd.window_scale;
+    update_congestion_window([this] (tcp_congestion_window& w) { _cc->init(w); });
 }
 
 template <typename InetTraits>
@@ -1138,9 +1366,70 @@ void tcp<InetTraits>::tcb::input_handle_listen_state(tcp_hdr* th, packet p) {
 
     tcp_debug("listen: LISTEN -> SYN_RECEIVED\n");
     init_from_options(th, opt_start, opt_end);
+    _pending_accept = true;
     do_syn_received();
 }
 
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::input_handle_syn_cookie(tcp_hdr* th, uint16_t mss, packet p) {
+    // As if the SYN had been received, and our <SYN,ACK> sent
+    _rcv.initial = th->seq - 1;
+    _rcv.next = th->seq;
+    _rcv.urgent = _rcv.next;
+    _snd.initial = th->ack - 1;
+    _snd.unacknowledged = _snd.initial;
+    _snd.next = th->ack;
+    _snd.recover = _snd.initial;
+
+    tcp_debug("listen: LISTEN -> SYN_RECEIVED (cookie)\n");
+    _option._remote_mss = mss;
+    init_from_options(th, nullptr, nullptr);
+    _pending_accept = true;
+    _state = SYN_RECEIVED;
+    _snd.syn_tx_time = rtt_clock_type::now();
+    input_handle_other_state(th, std::move(p));
+}
+
+template <typename InetTraits>
+tcp_seq tcp<InetTraits>::tcb::make_syn_cookie(const connid& id, tcp_seq seg_seq, uint16_t mss) {
+    using namespace std::chrono;
+    uint32_t t = duration_cast<seconds>(clock_type::now().time_since_epoch()).count() / 64;
+    unsigned mss_index = 0;
+    while (mss_index + 1 < syn_cookie_mss.size() && syn_cookie_mss[mss_index + 1] <= mss) {
+        ++mss_index;
+    }
+    auto hash = syn_cookie_hash(id, t, seg_seq, mss_index);
+    return make_seq((t % 32) << 27 | mss_index << 24 | (hash & 0xffffff));
+}
+
+template <typename InetTraits>
+std::optional<uint16_t> tcp<InetTraits>::tcb::check_syn_cookie(const connid& id, tcp_seq seg_seq, tcp_seq seg_ack) {
+    using namespace std::chrono;
+    uint32_t now = duration_cast<seconds>(clock_type::now().time_since_epoch()).count() / 64;
+    auto cookie = (seg_ack - 1).raw;
+    unsigned mss_index = (cookie >> 24) & 7;
+    // Valid for up to two counter periods
+    uint32_t t = now - ((now - (cookie >> 27)) % 32);
+    if (now - t > 1 || (syn_cookie_hash(id, t, seg_seq - 1, mss_index) & 0xffffff) != (cookie & 0xffffff)) {
+        return std::nullopt;
+    }
+    return syn_cookie_mss[mss_index];
+}
+
+template <typename InetTraits>
+uint32_t tcp<InetTraits>::tcb::syn_cookie_hash(const connid& id, uint32_t t, tcp_seq seg_seq, unsigned mss_index) {
+    uint32_t hash[4];
+    uint32_t data[] = {uint32_t(id.local_port) << 16 | id.foreign_port, t, seg_seq.raw, mss_index};
+    gnutls_hash_hd_t md5_hash_handle;
+    gnutls_hash_init(&md5_hash_handle, GNUTLS_DIG_MD5);
+    gnutls_hash(md5_hash_handle, &id.local_ip, sizeof(id.local_ip));
+    gnutls_hash(md5_hash_handle, &id.foreign_ip, sizeof(id.foreign_ip));
+    gnutls_hash(md5_hash_handle, data, sizeof(data));
+    gnutls_hash(md5_hash_handle, _isn_secret.key, sizeof(_isn_secret.key));
+    gnutls_hash_deinit(md5_hash_handle, hash);
+    return hash[0];
+}
+
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::input_handle_syn_sent_state(tcp_hdr* th, packet p) {
     auto opt_len = th->data_offset * 4 - tcp_hdr::len;
@@ -1214,6 +1503,11 @@ void tcp<InetTraits>::tcb::input_handle_syn_sent_state(tcp_hdr* th, packet p) {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
+    if (_option._sack_received) {
+        auto opt_len = th->data_offset * 4 - tcp_hdr::len;
+        auto opt_start = reinterpret_cast<uint8_t*>(p.get_header(0, th->data_offset * 4)) + tcp_hdr::len;
+        _option.parse(opt_start, opt_start + opt_len);
+    }
     p.trim_front(th->data_offset * 4);
     bool do_output = false;
     bool do_output_data = false;
@@ -1308,6 +1602,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
             if (_snd.unacknowledged <= seg_ack && seg_ack <= _snd.next) {
                 tcp_debug("SYN_RECEIVED -> ESTABLISHED\n");
                 do_established();
+                _pending_accept = false;
                 _tcp.add_connected_tcb(this->shared_from_this(), _local_port);
             } else {
                 // <SEQ=SEG.ACK><CTL=RST>
@@ -1333,6 +1628,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
         if (in_state(ESTABLISHED | CLOSE_WAIT)){
             // When we are in zero window probing phase and packets_out = 0 we bypass "duplicated ack" check
             auto packets_out = _snd.next - _snd.unacknowledged - _snd.zero_window_probing_out;
+            update_sack_scoreboard();
             // If SND.UNA < SEG.ACK =< SND.NXT then, set SND.UNA <- SEG.ACK.
             if (_snd.unacknowledged < seg_ack && seg_ack <= _snd.next) {
                 // Remote ACKed data we sent
@@ -1422,7 +1718,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     if (seg_ack - 1 > _snd.recover) {
                         _snd.recover = _snd.next - 1;
                         // RFC5681 Step 3.2
-                        _snd.ssthresh = std::max((flight_size() - _snd.limited_transfer) / 2, 2 * smss);
+                        _snd.ssthresh = loss_ssthresh(flight_size() - _snd.limited_transfer);
                         fast_retransmit();
                     } else {
                         // Do not enter fast retransmit and do not reset ssthresh
@@ -1434,6 +1730,11 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     _snd.cwnd += smss;
                     // RFC5681 Step 3.5
                     do_output_data = true;
+                    // RFC6675: with SACK, holes beyond the first one are
+                    // repaired without waiting for partial ACKs
+                    if (_option._sack_received) {
+                        fast_retransmit();
+                    }
                 }
             } else if (seg_ack > _snd.next) {
                 // If the ACK acks something not yet sent (SEG.ACK > SND.NXT)
@@ -1584,11 +1885,13 @@ packet tcp<InetTraits>::tcb::get_transmit_packet() {
     auto can_send = this->can_send();
     // Max number of TCP payloads we can pass to NIC
     uint32_t len;
-    if (_tcp.hw_features().tx_tso) {
+    if (_tcp.hw_features().tx_tso || _tcp.sw_tso()) {
         // FIXME: Info tap device the size of the splitted packet
         len = _tcp.hw_features().max_packet_len - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min;
     } else {
         len = std::min(uint16_t(_tcp.hw_features().mtu - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min), _snd.mss);
+        // Leave room for the SACK blocks
+        len -= _option.get_size(false, true);
     }
     can_send = std::min(can_send, len);
     // easy case: one small packet
@@ -1625,16 +1928,27 @@ packet tcp<InetTraits>::tcb::get_transmit_packet() {
 }
 
 template <typename InetTraits>
-void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
+void tcp<InetTraits>::tcb::output_one(bool data_retransmit, size_t seg_index) {
     if (in_state(CLOSED)) {
         return;
     }
 
-    packet p = data_retransmit ? _snd.data.front().p.share() : get_transmit_packet();
+    fill_sack_blocks();
+    packet p = data_retransmit ? _snd.data[seg_index].p.share() : get_transmit_packet();
+    if (data_retransmit) {
+        // Only the first transmission tells the latency of the stack
+        p.reset_timestamp();
+    }
     packet clone = p.share();  // early clone to prevent share() from calling packet::unuse_internal_data() on header.
     uint16_t len = p.len();
     bool syn_on = syn_needs_on();
     bool ack_on = ack_needs_on();
+    if (data_retransmit && !_tcp.hw_features().tx_tso
+            && len + _option.get_size(false, true) > local_mss()) {
+        // Segments were sized without room for options, don't make them
+        // need fragmentation
+        _option._local_sack_blocks.nr_blocks = 0;
+    }
 
     auto options_size = _option.get_size(syn_on, ack_on);
     auto th = p.prepend_uninitialized_header(tcp_hdr::len + options_size);
@@ -1654,6 +1968,9 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
     tcp_seq seq;
     if (data_retransmit) {
         seq = _snd.unacknowledged;
+        for (size_t i = 0; i < seg_index; i++) {
+            seq += _snd.data[i].p.len();
+        }
     } else {
         seq = syn_on ? _snd.initial : _snd.next;
         _snd.next += len;
@@ -1678,39 +1995,47 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
 
     oi.tcp_hdr_len = tcp_hdr::len + options_size;
 
-    if (_tcp.hw_features().tx_csum_l4_offload) {
-        oi.needs_csum = true;
-
-        //
-        // tx checksum offloading: both virtio-net's VIRTIO_NET_F_CSUM dpdk's
-        // PKT_TX_TCP_CKSUM - requires th->checksum to be initialized to ones'
-        // complement sum of the pseudo header.
-        //
-        // For TSO the csum should be calculated for a pseudo header with
-        // segment length set to 0. All the rest is the same as for a TCP Tx
-        // CSUM offload case.
-        //
-        if (_tcp.hw_features().tx_tso && len > _snd.mss) {
-            oi.tso_seg_size = _snd.mss;
+    // Leave room for the options in the segments software TSO produces
+    uint16_t sw_seg_size = std::min(_snd.mss, local_mss()) - options_size;
+    if (!_tcp.hw_features().tx_tso && len > sw_seg_size) {
+        // Software TSO: the IP layer splits the segment and checksums
+        // each of the resulting ones
+        oi.tso_seg_size = sw_seg_size;
+    } else {
+        if (_tcp.hw_features().tx_csum_l4_offload) {
+            oi.needs_csum = true;
+
+            //
+            // tx checksum offloading: both virtio-net's VIRTIO_NET_F_CSUM dpdk's
+            // PKT_TX_TCP_CKSUM - requires th->checksum to be initialized to ones'
+            // complement sum of the pseudo header.
+            //
+            // For TSO the csum should be calculated for a pseudo header with
+            // segment length set to 0. All the rest is the same as for a TCP Tx
+            // CSUM offload case.
+            //
+            if (_tcp.hw_features().tx_tso && len > _snd.mss) {
+                oi.tso_seg_size = _snd.mss;
+            } else {
+                pseudo_hdr_seg_len = tcp_hdr::len + options_size + len;
+            }
         } else {
             pseudo_hdr_seg_len = tcp_hdr::len + options_size + len;
+            oi.needs_csum = false;
         }
-    } else {
-        pseudo_hdr_seg_len = tcp_hdr::len + options_size + len;
-        oi.needs_csum = false;
-    }
 
-    InetTraits::tcp_pseudo_header_checksum(csum, _local_ip, _foreign_ip,
-                                           pseudo_hdr_seg_len);
+        InetTraits::tcp_pseudo_header_checksum(csum, _local_ip, _foreign_ip,
+                                               pseudo_hdr_seg_len);
 
-    uint16_t checksum;
-    if (_tcp.hw_features().tx_csum_l4_offload) {
-        checksum = ~csum.get();
-    } else {
-        csum.sum(p);
-        checksum = csum.get();
+        uint16_t checksum;
+        if (_tcp.hw_features().tx_csum_l4_offload) {
+            checksum = ~csum.get();
+        } else {
+            csum.sum(p);
+            checksum = csum.get();
+        }
+        tcp_hdr::write_nbo_checksum(th, checksum);
     }
-    tcp_hdr::write_nbo_checksum(th, checksum);
 
     oi.protocol = ip_protocol_num::tcp;
 
@@ -1721,7 +2046,7 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
         if (len) {
             unsigned nr_transmits = 0;
             _snd.data.emplace_back(unacked_segment{std::move(clone),
-                                   len, nr_transmits, now});
+                                   len, nr_transmits, rtt_clock_type::now()});
         }
         if (!_retransmit.armed()) {
             start_retransmit_timer(now);
@@ -1789,13 +2114,29 @@ void tcp<InetTraits>::tcb::connect() {
     _rcv.mss = _option._local_mss = local_mss();
     _rcv.window = get_default_receive_window_size();
 
+    // The local port was chosen so that the RSS hash of the connection
+    // lands on this shard; pin it here in case the device moves it later
+    auto netif = _tcp._inet._inet.netif();
+    if (netif->hw_queues_count() > 1) {
+        flow_tuple flow{ip_protocol_num::tcp, InetTraits::address_family == AF_INET6};
+        InetTraits::hash_address(flow.local_ip, _local_ip);
+        InetTraits::hash_address(flow.foreign_ip, _foreign_ip);
+        flow.local_port = _local_port;
+        flow.foreign_port = _foreign_port;
+        _steering = netif->steer_flow(flow);
+    }
+
     do_syn_sent();
 }
 
 template <typename InetTraits>
 packet tcp<InetTraits>::tcb::read() {
     packet p;
+    auto netif = _tcp._inet._inet.netif();
     for (auto&& q : _rcv.data) {
+        if (netif->packet_timestamps()) {
+            netif->account_rx_latency(q);
+        }
         p.append(std::move(q));
     }
     _rcv.data_size = 0;
@@ -1820,6 +2161,9 @@ future<> tcp<InetTraits>::tcb::send(packet p) {
         return make_exception_future<>(tcp_reset_error());
     }
 
+    if (_tcp._inet._inet.netif()->packet_timestamps() && !p.timestamp()) {
+        p.set_timestamp(std::chrono::system_clock::now());
+    }
     auto len = p.len();
     _snd.current_queue_space += len;
     _snd.unsent_len += len;
@@ -1932,6 +2276,7 @@ bool tcp<InetTraits>::tcb::merge_out_of_order() {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::insert_out_of_order(tcp_seq seg, packet p) {
+    _rcv.last_out_of_order = seg;
     _rcv.out_of_order.merge(seg, std::move(p));
 }
 
@@ -1990,6 +2335,12 @@ void tcp<InetTraits>::tcb::retransmit() {
         return;
     }
 
+    // RFC2018: the receiver may discard SACKed data, so after a timeout
+    // don't rely on what it reported
+    for (auto& seg : _snd.data) {
+        seg.sacked = false;
+    }
+
     // If there are unacked data, retransmit the earliest segment
     auto& unacked_seg = _snd.data.front();
 
@@ -1997,7 +2348,7 @@ void tcp<InetTraits>::tcb::retransmit() {
     // Update ssthresh only for the first retransmit
     uint32_t smss = _snd.mss;
     if (unacked_seg.nr_transmits == 0) {
-        _snd.ssthresh = std::max(flight_size() / 2, 2 * smss);
+        _snd.ssthresh = loss_ssthresh(flight_size());
     }
     // RFC6582 Step 4
     _snd.recover = _snd.next - 1;
@@ -2021,17 +2372,100 @@ void tcp<InetTraits>::tcb::retransmit() {
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::fast_retransmit() {
     if (!_snd.data.empty()) {
-        auto& unacked_seg = _snd.data.front();
-        unacked_seg.nr_transmits++;
-        retransmit_one();
+        if (_option._sack_received) {
+            sack_retransmit();
+        } else {
+            auto& unacked_seg = _snd.data.front();
+            unacked_seg.nr_transmits++;
+            retransmit_one();
+        }
         output();
     }
 }
 
 template <typename InetTraits>
-void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
+void tcp<InetTraits>::tcb::sack_retransmit() {
+    // RFC6675 NextSeg(): retransmit the first segment which is neither
+    // SACKed nor already retransmitted during this recovery, and which is
+    // deemed lost, i.e. has more than (DupThresh - 1) * SMSS SACKed bytes
+    // above it. The first unacknowledged segment always is.
+    uint32_t sacked_above = 0;
+    for (auto& seg : _snd.data) {
+        if (seg.sacked) {
+            sacked_above += seg.p.len();
+        }
+    }
+    for (size_t i = 0; i < _snd.data.size(); i++) {
+        auto& seg = _snd.data[i];
+        if (seg.sacked) {
+            sacked_above -= seg.p.len();
+        } else if (!seg.sack_retransmitted && (i == 0 || sacked_above > 2 * uint32_t(_snd.mss))) {
+            seg.sack_retransmitted = true;
+            seg.nr_transmits++;
+            retransmit_one(i);
+            return;
+        }
+    }
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::update_sack_scoreboard() {
+    auto& sack = _option._remote_sack_blocks;
+    if (!sack.nr_blocks) {
+        return;
+    }
+    for (unsigned i = 0; i < sack.nr_blocks; i++) {
+        auto left = tcp_seq{sack.blocks[i].first};
+        auto right = tcp_seq{sack.blocks[i].second};
+        // Ignore blocks outside of the data in flight
+        if (!(_snd.unacknowledged < left && left < right && right <= _snd.next)) {
+            continue;
+        }
+        auto seq = _snd.unacknowledged;
+        for (auto& seg : _snd.data) {
+            auto end = seq + seg.p.len();
+            if (right <= seq) {
+                break;
+            }
+            if (left <= seq && end <= right) {
+                seg.sacked = true;
+            }
+            seq = end;
+        }
+    }
+    sack.nr_blocks = 0;
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::fill_sack_blocks() {
+    auto& sack = _option._local_sack_blocks;
+    sack.nr_blocks = 0;
+    if (!_option._sack_received || _rcv.out_of_order.map.empty()) {
+        return;
+    }
+    auto add = [&sack] (tcp_seq beg, const packet& p) {
+        sack.blocks[sack.nr_blocks++] = {beg.raw, (beg + p.len()).raw};
+    };
+    // RFC2018: the first block reports the most recently received segment
+    auto last = _rcv.out_of_order.map.upper_bound(_rcv.last_out_of_order);
+    if (last != _rcv.out_of_order.map.begin()) {
+        --last;
+    }
+    add(last->first, last->second);
+    for (auto it = _rcv.out_of_order.map.begin(); it != _rcv.out_of_order.map.end()
+            && sack.nr_blocks < sack.max_blocks; ++it) {
+        if (it != last) {
+            add(it->first, it->second);
+        }
+    }
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::update_rto(rtt_clock_type::time_point tx_time) {
+    auto rtt = rtt_clock_type::now() - tx_time;
+    _cc->rtt_sample(std::chrono::duration_cast<tcp_congestion_control::rtt_type>(rtt));
     // Update RTO according to RFC6298
-    auto R = std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now() - tx_time);
+    auto R = std::chrono::duration_cast<std::chrono::milliseconds>(rtt);
     if (_snd.first_rto_sample) {
         _snd.first_rto_sample = false;
         // RTTVAR <- R/2
@@ -2056,15 +2490,9 @@ void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::update_cwnd(uint32_t acked_bytes) {
-    uint32_t smss = _snd.mss;
-    if (_snd.cwnd < _snd.ssthresh) {
-        // In slow start phase
-        _snd.cwnd += std::min(acked_bytes, smss);
-    } else {
-        // In congestion avoidance phase
-        uint32_t round_up = 1;
-        _snd.cwnd += std::max(round_up, smss * smss / _snd.cwnd);
-    }
+    update_congestion_window([this, acked_bytes] (tcp_congestion_window& w) {
+        _cc->cong_avoid(w, acked_bytes);
+    });
 }
 
 template <typename InetTraits>
@@ -2076,6 +2504,10 @@ void tcp<InetTraits>::tcb::cleanup() {
     _rcv.data.clear();
     stop_retransmit_timer();
     clear_delayed_ack();
+    if (std::exchange(_pending_accept, false)) {
+        _tcp.drop_pending(_local_port);
+    }
+    _steering.reset();
     remove_from_tcbs();
 }
 
@@ -2087,13 +2519,13 @@ tcp_seq tcp<InetTraits>::tcb::get_isn() {
     //   M is the 4 microsecond timer
     using namespace std::chrono;
     uint32_t hash[4];
-    hash[0] = _local_ip.ip;
-    hash[1] = _foreign_ip.ip;
-    hash[2] = (_local_port << 16) + _foreign_port;
+    uint32_t ports = (_local_port << 16) + _foreign_port;
     gnutls_hash_hd_t md5_hash_handle;
     // GnuTLS digests do not init at all, so this should never fail.
     gnutls_hash_init(&md5_hash_handle, GNUTLS_DIG_MD5);
-    gnutls_hash(md5_hash_handle, hash, 3 * sizeof(hash[0]));
+    gnutls_hash(md5_hash_handle, &_local_ip, sizeof(_local_ip));
+    gnutls_hash(md5_hash_handle, &_foreign_ip, sizeof(_foreign_ip));
+    gnutls_hash(md5_hash_handle, &ports, sizeof(ports));
     gnutls_hash(md5_hash_handle, _isn_secret.key, sizeof(_isn_secret.key));
     // reuse "hash" for the output of digest
     assert(sizeof(hash) == gnutls_hash_get_len(GNUTLS_DIG_MD5));
@@ -21,17 +21,25 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <chrono>
 #include <functional>
 #include <unordered_set>
 #include <map>
+#include <memory>
+#include <optional>
+#include <vector>
 #include <boost/any.hpp>
 #include <fmt/format.h>
 #endif
 
 #include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
 #include <seastar/core/internal/api-level.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/sharded.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/shared_ptr.hh>
+#include <seastar/core/timer.hh>
 #include <seastar/net/socket_defs.hh>
 #include <seastar/net/inet_address.hh>
 #include <seastar/util/std-compat.hh>
@@ -157,6 +165,73 @@ namespace tls {
      */
     using dn_callback = noncopyable_function<void(session_type type, sstring subject, sstring issuer)>;
 
+    /**
+     * Where and how many TLS handshakes run at once, see
+     * certificate_credentials::set_handshake_scheduling().
+     */
+    struct handshake_scheduling {
+        /// Scheduling group the handshakes, including their crypto, run in
+        scheduling_group group;
+        /// Maximum number of handshakes in progress at once, the next ones wait
+        size_t max_concurrency = 64;
+        /// Label of the exported metrics. They also get an "instance" label,
+        /// the lowest index not taken by other credentials of the same name
+        /// on the shard, so credentials may share a name.
+        sstring name = "default";
+    };
+
+    /**
+     * Successful peer certificate verifications, shared by all shards.
+     *
+     * Attach the same cache to the credentials of every shard, see
+     * certificate_credentials::set_verification_cache(). A chain the
+     * credentials verified then doesn't need verifying again by any of
+     * them until the entry expires, which is after the TTL or when a
+     * certificate of the chain expires, whichever comes first.
+     *
+     * Entries are keyed by the whole chain the peer sent, the expected
+     * server name, and the trust, CRLs and priority of the credentials.
+     * Credentials whose trust or CRLs change, including reloadable ones,
+     * thus stop matching the entries of their previous configuration.
+     * Callbacks set with set_dn_verification_callback() still run for
+     * every handshake.
+     *
+     * \code
+     * auto cache = std::make_shared<tls::verification_cache>(tls::verification_cache::config{});
+     * creds.invoke_on_all([cache] (tls::server_credentials& c) {
+     *     c.set_verification_cache(cache);
+     * }).get();
+     * \endcode
+     */
+    class verification_cache {
+    public:
+        struct config {
+            /// How long a verification is trusted for
+            std::chrono::seconds ttl = std::chrono::minutes(5);
+            /// Maximum number of entries, the oldest ones are evicted first
+            size_t capacity = 4096;
+        };
+
+        explicit verification_cache(config cfg);
+        ~verification_cache();
+
+        verification_cache(const verification_cache&) = delete;
+        verification_cache& operator=(const verification_cache&) = delete;
+
+        /// Forgets all verifications, e.g. after a certificate was revoked
+        void clear();
+        /// Number of entries, including expired ones not evicted yet
+        size_t size() const;
+        /// Verifications found in the cache, on all shards
+        uint64_t hits() const;
+        /// Verifications done since they weren't in the cache, on all shards
+        uint64_t misses() const;
+    private:
+        class impl;
+        friend class session;
+        std::unique_ptr<impl> _impl;
+    };
+
     /**
      * Holds certificates and keys.
      *
@@ -182,6 +257,20 @@ namespace tls {
         void set_x509_key(const blob& cert, const blob& key, x509_crt_format) override;
         void set_simple_pkcs12(const blob&, x509_crt_format, const sstring& password) override;
 
+        /**
+         * Sets a certificate (chain) whose private key stays on a PKCS#11
+         * token, e.g. an HSM or a crypto accelerator.
+         *
+         * The handshake signatures are then computed by the token. It is
+         * called synchronously, so the handshake takes the shard for as long
+         * as the token takes to sign, see \ref set_handshake_scheduling().
+         * Requires GnuTLS with p11-kit support.
+         *
+         * \param key_url the \c pkcs11: URL (RFC 7512) of the key, with its PIN
+         *        as \c pin-value or \c pin-source attribute if the token needs one
+         */
+        void set_x509_key_url(const blob& cert, const sstring& key_url, x509_crt_format);
+
         /**
          * Loads default system cert trust file
          * into this object.
@@ -198,6 +287,15 @@ namespace tls {
          */
         void set_priority_string(const sstring&);
 
+        /**
+         * Application protocols to offer (clients) or accept (servers) with
+         * the ALPN extension, e.g. "h2" and "http/1.1", in order of
+         * preference. Servers pick by their own preference.
+         *
+         * The negotiated protocol is returned by \ref get_alpn_protocol().
+         */
+        void set_alpn_protocols(std::vector<sstring>);
+
         /**
          * Register a callback for receiving Distinguished Name (DN) information
          * during the TLS handshake, extracted from the certificate as sent by the peer.
@@ -221,12 +319,31 @@ namespace tls {
          */
         void set_dn_verification_callback(dn_callback);
 
+        /**
+         * Runs the handshakes of sessions using these credentials in a
+         * dedicated scheduling group, at most a given number at a time.
+         *
+         * This keeps a storm of new connections, and their expensive public
+         * key operations, from starving the established ones, which only
+         * compete with the handshakes through the group's shares. The number
+         * of handshakes in progress and waiting is exported as metrics.
+         */
+        void set_handshake_scheduling(handshake_scheduling);
+
+        /**
+         * Skips verifying peer certificate chains these credentials, or
+         * those of other shards sharing the cache, recently accepted.
+         * An empty pointer detaches the cache.
+         */
+        void set_verification_cache(std::shared_ptr<verification_cache>);
+
     private:
         class impl;
         friend class session;
         friend class server_session;
         friend class server_credentials;
         friend class credentials_builder;
+        friend class session_resume_manager;
         template<typename Base>
         friend class reloadable_credentials;
         shared_ptr<impl> _impl;
@@ -277,6 +394,73 @@ namespace tls {
         void set_session_resume_mode(session_resume_mode);
     };
 
+    /**
+     * Session resumption state shared by the servers of all shards.
+     *
+     * Run as a sharded<session_resume_manager>, and attach the server
+     * credentials of each shard to its local instance. The attached
+     * credentials then issue session tickets, for both TLS 1.3 and TLS 1.2,
+     * encrypted with a key common to all shards, so that a client can
+     * resume its session on whatever shard it reconnects to. The key is
+     * replaced on all shards every key_rotation_interval, which invalidates
+     * the tickets issued with the previous one.
+     *
+     * Optionally, the TLS 1.2 sessions of clients that don't support tickets
+     * are kept in a cache shared by all shards as well.
+     *
+     * \code
+     * sharded<tls::session_resume_manager> resume;
+     * resume.start(tls::session_resume_manager::config{}).get();
+     * resume.invoke_on_all([&] (tls::session_resume_manager& m) {
+     *     m.attach(*server_creds.local());
+     * }).get();
+     * resume.invoke_on(0, &tls::session_resume_manager::start).get();
+     * \endcode
+     *
+     * The manager must outlive the credentials attached to it.
+     */
+    class session_resume_manager : public peering_sharded_service<session_resume_manager> {
+    public:
+        struct config {
+            /// How often to replace the ticket key
+            std::chrono::seconds key_rotation_interval = std::chrono::hours(12);
+            /// How long the issued tickets and cached sessions can be resumed for
+            std::chrono::seconds session_lifetime = std::chrono::hours(6);
+            /// Maximum number of sessions kept in the cache, 0 disables it
+            size_t session_cache_capacity = 0;
+        };
+
+        explicit session_resume_manager(config cfg);
+        ~session_resume_manager();
+
+        /**
+         * Generates the first key, sets up the session cache and starts
+         * rotating the key. Must be called on one shard only, after all the
+         * instances were constructed.
+         */
+        future<> start();
+        future<> stop();
+
+        /**
+         * Replaces the ticket key on all shards.
+         */
+        future<> rotate_key();
+
+        /**
+         * Makes sessions of \c creds use the shared ticket key and cache.
+         */
+        void attach(server_credentials& creds);
+    private:
+        class session_cache;
+        friend class session;
+
+        const config _config;
+        std::vector<uint8_t> _key;
+        std::shared_ptr<session_cache> _cache;
+        timer<> _rotation;
+        gate _gate;
+    };
+
     class reloadable_credentials_base;
 
     using reload_callback = std::function<void(const std::unordered_set<sstring>&, std::exception_ptr)>;
@@ -305,10 +489,18 @@ namespace tls {
         future<> set_x509_key_file(const sstring& cf, const sstring& kf, x509_crt_format) override;
         future<> set_simple_pkcs12_file(const sstring& pkcs12file, x509_crt_format, const sstring& password) override;
 
+        /// See certificate_credentials::set_x509_key_url(). Only the
+        /// certificate file is watched by reloadable credentials.
+        void set_x509_key_url(const blob& cert, const sstring& key_url, x509_crt_format);
+        future<> set_x509_key_url_file(const sstring& cf, const sstring& key_url, x509_crt_format);
+
         future<> set_system_trust();
         void set_client_auth(client_auth);
         void set_priority_string(const sstring&);
+        void set_alpn_protocols(std::vector<sstring>);
         void set_session_resume_mode(session_resume_mode);
+        void set_handshake_scheduling(handshake_scheduling);
+        void set_verification_cache(std::shared_ptr<verification_cache>);
 
         void apply_to(certificate_credentials&) const;
 
@@ -325,7 +517,10 @@ namespace tls {
         std::multimap<sstring, boost::any> _blobs;
         client_auth _client_auth = client_auth::NONE;
         session_resume_mode _session_resume_mode = session_resume_mode::NONE;
+        std::optional<handshake_scheduling> _handshake_scheduling;
+        std::shared_ptr<verification_cache> _verification_cache;
         sstring _priority;
+        std::vector<sstring> _alpn_protocols;
     };
 
     using session_data = std::vector<uint8_t>;
@@ -340,6 +535,41 @@ namespace tls {
         /// \brief Optional session resume data. Must be retrieved via 
         /// get_session_resume_data below.
         session_data session_resume_data;
+
+        /// \brief Whether to have the kernel encrypt outgoing records (kTLS).
+        ///
+        /// After the handshake the write keys are handed to the kernel, which
+        /// then frames and encrypts everything written to the socket, or has
+        /// the NIC do so. Only TLS 1.2 and 1.3 with AES-GCM or ChaCha20-Poly1305
+        /// are supported, the session silently keeps encrypting in userspace
+        /// when the cipher, the socket or the kernel (the \c tls module) don't
+        /// support offloading, see \ref check_kernel_tls_offload().
+        ///
+        /// An offloaded session can't send TLS alerts, so it closes without a
+        /// close_notify, and fails if the peer asks for a renegotiation or for
+        /// a TLS 1.3 key update. Reading is still done in userspace.
+        bool kernel_tls_offload = false;
+
+        /// \brief Whether to buffer writes until they are flushed.
+        ///
+        /// Data written in several puts, e.g. by an output_stream batching
+        /// its flushes, is then packed into full records instead of each put
+        /// getting records of its own. Records which fill up are still sent
+        /// right away.
+        bool coalesce_writes = false;
+
+        /// \brief Size of the records sent while ramping up.
+        ///
+        /// A record can only be decrypted once it was fully received, so
+        /// small records let the peer start on the first bytes of a response
+        /// before the rest arrived. Fits one TCP segment by default.
+        size_t initial_record_size = 1400;
+        /// \brief How much data to send in \ref initial_record_size records
+        /// before switching to full size ones.
+        ///
+        /// The ramp up starts over when the connection wasn't written to for
+        /// a second. 0 disables it, all records are full size.
+        size_t record_ramp_up_bytes = 0;
     };
 
     /**
@@ -486,6 +716,27 @@ namespace tls {
     */
     future<bool> check_session_is_resumed(connected_socket& socket);
 
+    /**
+     * Returns the application protocol negotiated with ALPN, see
+     * \ref certificate_credentials::set_alpn_protocols(), or nullopt if
+     * the peer didn't take part in it. Will force handshake if not already
+     * done.
+     *
+     * If the socket is not connected a system_error exception will be thrown.
+     * If the socket is not a TLS socket an exception will be thrown.
+    */
+    future<std::optional<sstring>> get_alpn_protocol(connected_socket& socket);
+
+    /**
+     * Checks if the output of the socket is encrypted by the kernel, see
+     * \ref tls_options::kernel_tls_offload. Will force handshake if not
+     * already done.
+     *
+     * If the socket is not connected a system_error exception will be thrown.
+     * If the socket is not a TLS socket an exception will be thrown.
+    */
+    future<bool> check_kernel_tls_offload(connected_socket& socket);
+
     /**
      * Get session resume data from a connected client socket. Will force handshake if not already done.
      * 
@@ -44,6 +44,7 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <algorithm>
 #include <cstdint>
 #include <string_view>
 #include <vector>
@@ -77,26 +78,81 @@ static constexpr uint8_t default_rsskey_52bytes_v[] = {
 
 static constexpr rss_key_type default_rsskey_52bytes{default_rsskey_52bytes_v, sizeof(default_rsskey_52bytes_v)};
 
+/// Toeplitz hash with a precomputed key schedule
+///
+/// The hash is linear in the data, so it is the XOR of the hashes of each
+/// of its bytes, which only depend on the byte's value and offset. Those
+/// are looked up in a table built from the key, one entry per byte
+/// instead of one step per bit.
+class toeplitz_hasher {
+    std::vector<uint8_t> _key;
+    // _table[i * 256 + b] is the hash of byte b at offset i of the data.
+    // Bytes past the key don't contribute to the hash.
+    std::vector<uint32_t> _table;
+private:
+    // The 32 bits of the key starting at bit offset, zero extended
+    uint32_t window(size_t offset) const noexcept {
+        uint64_t w = 0;
+        for (size_t i = offset / 8; i < offset / 8 + 5; i++) {
+            w = (w << 8) | (i < _key.size() ? _key[i] : 0);
+        }
+        return w >> (8 - offset % 8);
+    }
+public:
+    explicit toeplitz_hasher(rss_key_type key)
+        : _key(key.begin(), key.end())
+        , _table(_key.size() * 256) {
+        for (size_t i = 0; i < _key.size(); i++) {
+            uint32_t* t = &_table[i * 256];
+            for (unsigned bit = 0; bit < 8; bit++) {
+                t[0x80 >> bit] = window(i * 8 + bit);
+            }
+            for (unsigned b = 1; b < 256; b++) {
+                auto low = b & -b;
+                t[b] = t[low] ^ (b == low ? 0 : t[b ^ low]);
+            }
+        }
+    }
+    rss_key_type key() const noexcept {
+        return rss_key_type(_key.data(), _key.size());
+    }
+    template<typename T>
+    uint32_t operator()(const T& data) const noexcept {
+        uint32_t hash = 0;
+        size_t n = std::min<size_t>(data.size(), _key.size());
+        for (size_t i = 0; i < n; i++) {
+            hash ^= _table[i * 256 + uint8_t(data[i])];
+        }
+        return hash;
+    }
+};
+
+namespace internal {
+
+// Hashers are built on first use of a key on each shard; there is about
+// one key per device.
+inline const toeplitz_hasher& toeplitz_hasher_for(rss_key_type key) {
+    static thread_local std::vector<toeplitz_hasher> hashers;
+    static thread_local size_t last = 0;
+    if (last < hashers.size() && hashers[last].key() == key) {
+        return hashers[last];
+    }
+    for (last = 0; last < hashers.size(); last++) {
+        if (hashers[last].key() == key) {
+            return hashers[last];
+        }
+    }
+    hashers.emplace_back(key);
+    return hashers.back();
+}
+
+}
+
 template<typename T>
 inline uint32_t
 toeplitz_hash(rss_key_type key, const T& data)
 {
-	uint32_t hash = 0, v;
-
-	/* XXXRW: Perhaps an assertion about key length vs. data length? */
-
-	v = (key[0]<<24) + (key[1]<<16) + (key[2] <<8) + key[3];
-	for (unsigned i = 0; i < data.size(); i++) {
-		for (unsigned b = 0; b < 8; b++) {
-			if (data[i] & (1<<(7-b)))
-				hash ^= v;
-			v <<= 1;
-			if ((i + 4) < key.size() &&
-			    (key[i+4] & (1<<(7-b))))
-				v |= 1;
-		}
-	}
-	return (hash);
+	return internal::toeplitz_hasher_for(key)(data);
 }
 
 }
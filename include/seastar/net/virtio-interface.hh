@@ -107,6 +107,27 @@
  * };
  */
 
+/* The packed ring layout replaces the three areas above by a single ring of
+ * descriptors, whose flags carry the driver's and the device's wrap counters,
+ * and two event suppression structures.
+ *
+ * struct vring_packed
+ * {
+ *      // Descriptors (16 bytes each): addr, len, id, flags
+ *      struct vring_packed_desc desc[num];
+ *
+ *      // Driver (then device) event suppression: off_wrap, flags
+ *      struct vring_packed_desc_event driver;
+ *      struct vring_packed_desc_event device;
+ * };
+ */
+#define VRING_PACKED_DESC_F_AVAIL       7
+#define VRING_PACKED_DESC_F_USED        15
+#define VRING_PACKED_EVENT_FLAG_ENABLE  0x0
+#define VRING_PACKED_EVENT_FLAG_DISABLE 0x1
+#define VRING_PACKED_EVENT_FLAG_DESC    0x2
+#define VRING_PACKED_EVENT_F_WRAP_CTR   15
+
 #endif
 
 #define VIRTIO_NET_F_CSUM (1 << 0)
@@ -54,6 +54,18 @@ struct virtio_options : public program_options::option_group {
     ///
     /// Default: 256.
     program_options::value<unsigned> virtio_ring_size;
+    /// \brief Use packed virtqueues when the backend supports them (on / off).
+    ///
+    /// Only vhost-user backends do, vhost-net always uses split virtqueues.
+    ///
+    /// Default: \p on.
+    program_options::value<std::string> packed_ring;
+    /// \brief Unix socket of a vhost-user backend, e.g. OVS-DPDK or SPDK.
+    ///
+    /// The backend is used instead of vhost-net and a tap device when set.
+    /// The backend needs access to the memory of the packets, so this requires
+    /// \p --hugepages.
+    program_options::value<std::string> vhost_user;
 
     /// \cond internal
     virtio_options(program_options::option_group* parent_group);
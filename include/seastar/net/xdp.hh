@@ -0,0 +1,70 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <memory>
+#endif
+#include <seastar/net/net.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/program-options.hh>
+
+namespace seastar {
+
+namespace net {
+
+/// AF_XDP configuration.
+///
+/// The native stack takes the packets of the first hardware queues of a
+/// network interface, one per shard, through AF_XDP sockets, while the
+/// interface stays bound to its kernel driver. Traffic on the other queues
+/// is still handled by the kernel, as is traffic arriving before the stack
+/// is up.
+struct xdp_options : public program_options::option_group {
+    /// \brief Network interface to attach to, e.g. \p eth0.
+    ///
+    /// AF_XDP is used instead of virtio when set.
+    program_options::value<std::string> xdp_interface;
+    /// \brief Use the driver's zero-copy mode (on / off / auto).
+    ///
+    /// With \p auto, falls back to copy mode when the driver doesn't
+    /// support zero-copy.
+    ///
+    /// Default: \p auto.
+    program_options::value<std::string> xdp_zero_copy;
+    /// \brief Size of the AF_XDP rings (must be power-of-two).
+    ///
+    /// Default: 2048.
+    program_options::value<unsigned> xdp_ring_size;
+
+    /// \cond internal
+    xdp_options(program_options::option_group* parent_group);
+    /// \endcond
+};
+
+}
+
+/// \cond internal
+std::unique_ptr<net::device> create_xdp_net_device(const net::xdp_options& opts);
+/// \endcond
+
+}
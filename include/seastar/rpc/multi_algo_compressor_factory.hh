@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <boost/range/adaptor/filtered.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/algorithm/string.hpp>
 #include <seastar/core/sstring.hh>
@@ -40,7 +41,10 @@ class multi_algo_compressor_factory : public rpc::compressor::factory {
 
 public:
     multi_algo_compressor_factory(std::vector<const rpc::compressor::factory*> factories) : _factories(std::move(factories)) {
-        _features =  boost::algorithm::join(_factories | boost::adaptors::transformed(std::mem_fn(&rpc::compressor::factory::supported)), sstring(","));
+        // Factories of algorithms that aren't built in advertise nothing
+        _features =  boost::algorithm::join(_factories
+                | boost::adaptors::transformed(std::mem_fn(&rpc::compressor::factory::supported))
+                | boost::adaptors::filtered([] (const sstring& name) { return !name.empty(); }), sstring(","));
     }
     multi_algo_compressor_factory(std::initializer_list<const rpc::compressor::factory*> factories) :
         multi_algo_compressor_factory(std::vector<const rpc::compressor::factory*>(std::move(factories))) {}
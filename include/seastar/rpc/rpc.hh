@@ -27,8 +27,10 @@
 #include <variant>
 #include <boost/intrusive/list.hpp>
 #include <seastar/core/future.hh>
+#include <seastar/core/abort_source.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/net/api.hh>
+#include <seastar/net/srv_balancer.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/condition-variable.hh>
@@ -39,6 +41,8 @@
 #include <seastar/core/queue.hh>
 #include <seastar/core/weak_ptr.hh>
 #include <seastar/core/scheduling.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/internal/deadline_queue.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/log.hh>
 
@@ -106,11 +110,90 @@ struct resource_limits {
     isolation_function_alternatives isolate_connection = default_isolate_connection;
 };
 
+/// \brief Adaptive compression of RPC frames
+///
+/// Once a compressor is negotiated every frame is compressed, which wastes
+/// CPU on payloads that are already compressed or encrypted. With adaptive
+/// compression frames smaller than \ref min_size are sent as is, and the
+/// compression ratio is sampled per verb: a verb whose frames don't shrink
+/// below \ref max_ratio of their size is sent uncompressed, except for one
+/// frame in \ref probe_interval which checks whether it became
+/// compressible again.
+///
+/// Uncompressed frames are only sent if the peer supports them, which is
+/// negotiated. The ratio is sampled on the sending side, so requests are
+/// sampled by the client and replies by the server.
+struct adaptive_compression_config {
+    size_t min_size = 512;          ///< Frames smaller than that are never compressed
+    double max_ratio = 0.9;         ///< Verbs whose compressed size exceeds this fraction of the original ones aren't compressed
+    unsigned probe_interval = 64;   ///< One in that many frames of an incompressible verb is compressed nevertheless
+};
+
+/// \brief Batching of small requests
+///
+/// Clients sending floods of tiny messages (no_wait verbs especially) pay
+/// for a write and a flush per message. With batching, requests up to
+/// \ref max_frame_size are held back for up to \ref max_delay, or until
+/// \ref max_bytes accumulate, and then written at once. Larger requests
+/// flush the batch first, so requests are still sent in order. A request
+/// that expects a reply may see its latency grow by \ref max_delay.
+struct request_batching_config {
+    std::chrono::microseconds max_delay{100}; ///< How long a request may wait for others
+    size_t max_bytes = 16 * 1024;             ///< The batch is written once it is that big
+    size_t max_frame_size = 1024;             ///< Larger requests aren't batched
+    /// Compress a batch as a single frame, if compression is negotiated and
+    /// the server supports it, rather than each request on its own.
+    bool compress_together = true;
+};
+
+/// \brief Flow control of RPC streams
+///
+/// Without flow control a stream receiver that falls behind stops reading
+/// the connection once it buffers \ref max_stream_buffers_memory bytes or
+/// \ref max_queued_stream_buffers elements. With flow control, negotiated
+/// when the stream is set up, each side advertises a \ref window: the peer
+/// doesn't send more than that many bytes of elements before the receiver
+/// returns credits, as the source consumes them. Small elements queued
+/// behind a frame being written are also packed in a single frame.
+///
+/// Flow control is used when both the client and the server configure it.
+struct stream_flow_control_config {
+    size_t window = 1024 * 1024;        ///< Bytes of elements the receiver buffers
+    size_t max_packed_size = 16 * 1024; ///< Elements are packed in frames up to that size, 0 disables packing
+};
+
+/// \brief Per-verb latency histograms
+///
+/// The aggregate \ref stats don't tell which verb is slow. When enabled,
+/// clients export a histogram of the round trip time of each verb, and
+/// servers export histograms of the time a request waits for resources
+/// before its handler runs and of the time until its reply is sent, along
+/// with the number of requests in flight. The histograms are exported per
+/// metrics domain, so all clients (or servers) of a domain on a shard share
+/// them, and the configuration of the first one to use a domain applies.
+///
+/// To keep the number of metrics bounded, verbs beyond \ref max_verbs and
+/// peers beyond \ref max_peers are accounted under the \c other label.
+struct verb_stats_config {
+    size_t max_verbs = 64;  ///< Verbs having their own label
+    size_t max_peers = 0;   ///< Peers having their own label, with 0 the histograms aren't broken down per peer
+};
+
+/// Selects the shard of the server that handles a request, see
+/// \ref client_options::shard_routing
+struct target_shard {
+    unsigned id;
+};
+
 struct client_options {
     std::optional<net::tcp_keepalive_params> keepalive;
     bool tcp_nodelay = true;
     bool reuseaddr = false;
     compressor::factory* compressor_factory = nullptr;
+    /// Skips compression of frames that aren't worth it, see \ref adaptive_compression_config
+    std::optional<adaptive_compression_config> adaptive_compression;
+    /// Writes small requests together, see \ref request_batching_config
+    std::optional<request_batching_config> batching;
     bool send_timeout_data = true;
     connection_id stream_parent = invalid_connection_id;
     /// Configures how this connection is isolated from other connection on the same server.
@@ -118,6 +201,28 @@ struct client_options {
     /// \see resource_limits::isolate_connection
     sstring isolation_cookie;
     sstring metrics_domain = "default";
+    /// Exports per-verb round trip times, see \ref verb_stats_config
+    std::optional<verb_stats_config> verb_stats;
+    /// Flow control of the streams of this client, see \ref stream_flow_control_config
+    std::optional<stream_flow_control_config> stream_flow_control;
+    /// \brief Tag requests with the shard that handles them
+    ///
+    /// A connection from every shard to every shard of each peer makes
+    /// for N*N connections per pair of nodes. With shard routing, a verb
+    /// called with a \ref target_shard is handled by that shard of the
+    /// server: the shard that accepted the connection passes the request
+    /// over with \ref smp::submit_to() to the server of the same
+    /// \ref server_options::streaming_domain, and its reply back. Verbs
+    /// called without one are handled by the shard that accepted the
+    /// connection. The connection fails if the server has no streaming
+    /// domain, and requires \ref send_timeout_data. Handlers of routed
+    /// requests get a \ref client_info of their shard, which doesn't
+    /// share the auxiliary data of the one of the connection.
+    ///
+    /// Clients on other shards may send their requests through this
+    /// client, see the \ref client constructor taking a \c foreign_ptr,
+    /// so that a few connections serve all shards of a pair of nodes.
+    bool shard_routing = false;
 };
 
 /// @}
@@ -150,6 +255,8 @@ class server;
 
 struct server_options {
     compressor::factory* compressor_factory = nullptr;
+    /// Skips compression of replies that aren't worth it, see \ref adaptive_compression_config
+    std::optional<adaptive_compression_config> adaptive_compression;
     bool tcp_nodelay = true;
     std::optional<streaming_domain_type> streaming_domain;
     server_socket::load_balancing_algorithm load_balancing_algorithm = server_socket::load_balancing_algorithm::default_;
@@ -158,6 +265,11 @@ struct server_options {
     // Returning false will refuse the incoming connection. 
     // Returning true will allow the mechanism to proceed.
     std::function<bool(const socket_address&)> filter_connection = {};
+    sstring metrics_domain = "default";
+    /// Exports per-verb handling times, see \ref verb_stats_config
+    std::optional<verb_stats_config> verb_stats;
+    /// Flow control of the streams of this server, see \ref stream_flow_control_config
+    std::optional<stream_flow_control_config> stream_flow_control;
 };
 
 /// @}
@@ -179,6 +291,10 @@ enum class protocol_features : uint32_t {
     CONNECTION_ID = 2,
     STREAM_PARENT = 3,
     ISOLATION = 4,
+    UNCOMPRESSED_FRAMES = 5,
+    BATCHED_FRAMES = 6,
+    STREAM_FLOW_CONTROL = 7,
+    SHARD_ROUTING = 8,
 };
 
 // internal representation of feature data
@@ -238,6 +354,77 @@ class logger {
     void operator()(const socket_address& addr, log_level level, std::string_view str) const;
 };
 
+/// \cond internal
+// Decides whether a frame is worth compressing, see adaptive_compression_config
+class adaptive_compression_policy {
+    struct verb_state {
+        // Moving average of the compressed to original size ratio
+        double ratio = 0;
+        unsigned skipped = 0;
+        bool sampled = false;
+        bool incompressible = false;
+    };
+    adaptive_compression_config _cfg;
+    std::unordered_map<uint64_t, verb_state> _verbs;
+public:
+    explicit adaptive_compression_policy(const adaptive_compression_config& cfg) noexcept : _cfg(cfg) {}
+    // Frames without a verb (stream and empty frames) are always compressed
+    // if they're big enough
+    bool should_compress(std::optional<uint64_t> verb, size_t size);
+    void sample(std::optional<uint64_t> verb, size_t size, size_t compressed_size);
+};
+
+// Latencies of one verb (and peer), see verb_stats_config
+struct verb_stats_entry {
+    using histogram = metrics::internal::short_time_estimated_histogram;
+    histogram latency;
+    histogram queue_wait;
+    uint64_t in_flight = 0;
+};
+
+// Stream frames carry an element, credits or several elements, see
+// stream_flow_control_config
+enum class stream_frame_type { data, credits, packed };
+
+// The entries of a metrics domain, defined in rpc.cc
+class verb_stats_domain;
+
+// Accounts a request in its verb_stats_entry, if it has one. The latency
+// of a queued request is measured from the moment its handler starts, see
+// dequeued(); until then it accounts the time spent waiting.
+class verb_stats_tracker {
+    using clock_type = std::chrono::steady_clock;
+    verb_stats_entry* _e;
+    clock_type::time_point _start;
+    bool _queued;
+public:
+    explicit verb_stats_tracker(verb_stats_entry* e, bool queued = false) noexcept : _e(e), _queued(queued) {
+        if (_e) {
+            _e->in_flight++;
+            _start = clock_type::now();
+        }
+    }
+    verb_stats_tracker(verb_stats_tracker&& o) noexcept : _e(std::exchange(o._e, nullptr)), _start(o._start), _queued(o._queued) {}
+    verb_stats_tracker& operator=(verb_stats_tracker&&) = delete;
+    ~verb_stats_tracker() {
+        if (_e) {
+            _e->in_flight--;
+            if (!_queued) {
+                _e->latency.add(clock_type::now() - _start);
+            }
+        }
+    }
+    void dequeued() noexcept {
+        if (_e && _queued) {
+            auto now = clock_type::now();
+            _e->queue_wait.add(now - _start);
+            _start = now;
+            _queued = false;
+        }
+    }
+};
+/// \endcond
+
 class connection {
 protected:
     connected_socket _fd;
@@ -257,7 +444,16 @@ class connection {
         snd_buf buf;
         promise<> done;
         cancellable* pcancel = nullptr;
-        outgoing_entry(snd_buf b) : buf(std::move(b)) {}
+        // Verb of the request, or of the request being replied to
+        std::optional<uint64_t> verb;
+        // Writes the pending batch rather than a frame
+        bool flush_batch = false;
+        // Resolves once the batch the frame was added to is written
+        std::optional<future<>> batch_written;
+        // Number of stream elements in buf if it may be packed with others,
+        // see stream_flow_control_config
+        unsigned stream_elements = 0;
+        outgoing_entry(snd_buf b, std::optional<uint64_t> v = {}) : buf(std::move(b)), verb(v) {}
 
         outgoing_entry(outgoing_entry&&) = delete;
         outgoing_entry(const outgoing_entry&) = delete;
@@ -283,8 +479,45 @@ class connection {
     outgoing_entry::container_t _outgoing_queue;
     size_t _outgoing_queue_size = 0;
     std::unique_ptr<compressor> _compressor;
+    // Set once the peer accepts uncompressed frames on a compressed connection
+    bool _uncompressed_frames = false;
+    std::optional<adaptive_compression_policy> _compression_policy;
+    // Small frames written together, see request_batching_config
+    std::optional<request_batching_config> _batching;
+    // Set once the peer accepts several frames in a compressed one
+    bool _batch_compress_together = false;
+    std::vector<temporary_buffer<char>> _batch;
+    size_t _batch_size = 0;
+    // One per frame in _batch, resolved once the batch is written
+    std::vector<promise<>> _batch_waiters;
+    timer<> _batch_timer;
+    // What is left of a received compressed frame holding several frames
+    struct batched_frames {
+        input_stream<char> in;
+        size_t left;
+    };
+    std::optional<batched_frames> _batched_frames;
+    // Stream flow control, see stream_flow_control_config. The peer
+    // accepts _stream_credits more bytes of elements, and our window is
+    // _stream_window, or 0 without flow control
+    std::optional<semaphore> _stream_credits;
+    size_t _stream_peer_window = 0;
+    size_t _stream_window = 0;
+    size_t _stream_max_packed = 0;
+    // Bytes of elements consumed and not yet returned to the peer
+    size_t _stream_unreturned = 0;
+    future<> _stream_credits_returned = make_ready_future<>();
+    // Resolves once the last element is queued, so that the elements
+    // waiting for credits keep their order
+    future<> _stream_queued = make_ready_future<>();
+    // Set when verb_stats_config is enabled; entries are looked up once
+    // per verb
+    verb_stats_domain* _verb_stats = nullptr;
+    std::unordered_map<uint64_t, verb_stats_entry*> _verb_stats_entries;
     bool _propagate_timeout = false;
     bool _timeout_negotiated = false;
+    // Request frames carry their target shard, see client_options::shard_routing
+    bool _shard_routing = false;
     // stream related fields
     bool _is_stream = false;
     connection_id _id = invalid_connection_id;
@@ -304,18 +537,27 @@ class connection {
         return _is_stream;
     }
 
-    snd_buf compress(snd_buf buf);
+    snd_buf compress(snd_buf buf, std::optional<uint64_t> verb = {});
     future<> send_buffer(snd_buf buf);
-    future<> send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout = {}, cancellable* cancel = nullptr);
+    future<> send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout = {}, cancellable* cancel = nullptr, std::optional<uint64_t> verb = {});
+    future<> enqueue(std::unique_ptr<outgoing_entry> p, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel);
     future<> send_entry(outgoing_entry& d) noexcept;
+    future<> add_to_batch(outgoing_entry& d);
+    future<> flush_batch();
+    void enable_batching(const request_batching_config& cfg);
     future<> stop_send_loop(std::exception_ptr ex);
-    future<std::optional<rcv_buf>>  read_stream_frame_compressed(input_stream<char>& in);
+    future<std::tuple<stream_frame_type, std::optional<rcv_buf>>> read_stream_frame_compressed(input_stream<char>& in);
     bool stream_check_twoway_closed() const noexcept {
         return _sink_closed && _source_closed;
     }
     future<> stream_close();
     future<> stream_process_incoming(rcv_buf&&);
     future<> handle_stream_frame();
+    void enable_stream_flow_control(const stream_flow_control_config& cfg, const sstring& peer_window);
+    future<> stream_send(snd_buf buf);
+    future<> send_stream_element(snd_buf buf);
+    void return_stream_credits(size_t bytes);
+    verb_stats_entry* find_verb_stats(uint64_t verb);
 
 public:
     connection(connected_socket&& fd, const logger& l, void* s, connection_id id = invalid_connection_id) : connection(l, s, id) {
@@ -326,6 +568,10 @@ class connection {
     size_t outgoing_queue_length() const noexcept {
         return _outgoing_queue_size;
     }
+    // Latencies of a verb, or nullptr when they aren't exported
+    verb_stats_entry* get_verb_stats(uint64_t verb) {
+        return _verb_stats ? find_verb_stats(verb) : nullptr;
+    }
 
     void set_socket(connected_socket&& fd);
     future<> send_negotiation_frame(feature_map features);
@@ -374,6 +620,8 @@ class connection {
 
     template <typename FrameType>
     future<typename FrameType::return_type> read_frame_compressed(socket_address info, std::unique_ptr<compressor>& compressor, input_stream<char>& in);
+    template <typename FrameType>
+    future<typename FrameType::return_type> read_batched_frame(socket_address info);
     friend class client;
     template<typename Serializer, typename... Out>
     friend class sink_impl;
@@ -424,12 +672,18 @@ class source_impl : public source<In...>::impl {
 class client : public rpc::connection, public weakly_referencable<client> {
     socket _socket;
     id_type _message_id = 1;
-    struct reply_handler_base {
-        timer<rpc_clock_type> t;
+    // Waits for its timeout in the shard's deadline queue, so that calls
+    // sharing their timeout also share a timer
+    struct reply_handler_base : internal::deadline_waiter {
+        client* owner = nullptr;
+        id_type id = 0;
         cancellable* pcancel = nullptr;
         virtual void operator()(client&, id_type, rcv_buf data) = 0;
         virtual void timeout() {}
         virtual void cancel() {}
+        virtual void on_deadline() noexcept override {
+            owner->wait_timed_out(id);
+        }
         virtual ~reply_handler_base() {
             if (pcancel) {
                 pcancel->cancel_wait = std::function<void()>();
@@ -477,18 +731,39 @@ class client : public rpc::connection, public weakly_referencable<client> {
         virtual ~reply_handler() {}
     };
 private:
+    // The reply to a request sent on behalf of a client on another shard
+    struct forwarded_reply {
+        bool exception = false;
+        foreign_ptr<std::unique_ptr<rcv_buf>> data;
+    };
+    struct forwarding_handler final : reply_handler_base {
+        promise<forwarded_reply> p;
+        bool done = false;
+        virtual void operator()(client&, id_type msg_id, rcv_buf data) override;
+        virtual void timeout() override;
+        virtual ~forwarding_handler();
+    };
+
     std::unordered_map<id_type, std::unique_ptr<reply_handler_base>> _outstanding;
     socket_address _server_addr, _local_addr;
     client_options _options;
     weak_ptr<client> _parent; // for stream clients
+    // The client whose connection this one sends its requests through
+    foreign_ptr<shared_ptr<client>> _shared;
+    net::srv_balancer::lease _endpoint; // when balanced
 
     metrics _metrics;
 
 private:
+    client(const logger& l, void* s, client_options options, socket socket, const socket_address& addr, const socket_address& local,
+            net::srv_balancer::lease* endpoint);
     future<> negotiate_protocol(feature_map map);
     void negotiate(feature_map server_features);
     future<std::tuple<int64_t, std::optional<rcv_buf>>>
     read_response_frame_compressed(input_stream<char>& in);
+    future<forwarded_reply> forward(uint64_t type, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, std::optional<unsigned> shard, bool one_way);
+    void forward_request(uint64_t type, int64_t id, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, std::optional<unsigned> shard, bool one_way);
+    void handle_forwarded_reply(id_type id, future<forwarded_reply> f);
 public:
     /**
      * Create client object which will attempt to connect to the remote address.
@@ -514,12 +789,44 @@ class client : public rpc::connection, public weakly_referencable<client> {
     client(const logger& l, void* s, socket socket, const socket_address& addr, const socket_address& local = {});
     client(const logger& l, void* s, client_options options, socket socket, const socket_address& addr, const socket_address& local = {});
 
+    /**
+     * Create client object which will attempt to connect to an endpoint
+     * picked by a \ref net::srv_balancer.
+     *
+     * The endpoint counts as outstanding while the client exists. The
+     * balancer is reported the time it took to connect and negotiate, and
+     * connection failures.
+     *
+     * @param l \ref seastar::logger to use for logging error messages
+     * @param s an optional connection serializer
+     * @param endpoint the endpoint to connect to, see net::srv_balancer::acquire()
+     * @param local the local address of this client
+     */
+    client(const logger& l, void* s, client_options options, net::srv_balancer::lease endpoint, const socket_address& local = {});
+
+    /**
+     * Create client object which sends its requests through the connection
+     * of a client living on another shard, see \ref client_options::shard_routing.
+     *
+     * Replies and timeouts are handled on this shard, and the verbs may be
+     * called with a \ref target_shard if the shared client routes requests.
+     * Streams aren't supported. The shared client has to be stopped after
+     * the clients sending through it.
+     *
+     * @param l \ref seastar::logger to use for logging error messages
+     * @param s an optional connection serializer
+     * @param shared the client whose connection is used
+     */
+    client(const logger& l, void* s, client_options options, foreign_ptr<shared_ptr<client>> shared);
+
     stats get_stats() const;
     size_t incoming_queue_length() const noexcept {
         return _outstanding.size();
     }
 
     auto next_message_id() { return _message_id++; }
+    // Whether verbs may be called with a target_shard
+    bool shard_routing() const noexcept { return _options.shard_routing; }
     void wait_for_reply(id_type id, std::unique_ptr<reply_handler_base>&& h, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel);
     void wait_timed_out(id_type id);
     future<> stop() noexcept;
@@ -544,6 +851,7 @@ class client : public rpc::connection, public weakly_referencable<client> {
             client_options o = _options;
             o.stream_parent = this->get_connection_id();
             o.send_timeout_data = false;
+            o.shard_routing = false;
             o.metrics_domain += "_stream";
             auto c = make_shared<client>(_logger, _serializer, o, std::move(socket), _server_addr, _local_addr);
             c->_parent = this->weak_from_this();
@@ -569,7 +877,12 @@ class client : public rpc::connection, public weakly_referencable<client> {
         return make_stream_sink<Serializer, Out...>(make_socket());
     }
 
-    future<> request(uint64_t type, int64_t id, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout = {}, cancellable* cancel = nullptr);
+    /// Sends a request frame, \p buf has \ref request_frame_headroom bytes
+    /// for its header. The request is handled by \p shard of the server,
+    /// if given, see \ref client_options::shard_routing. A \p one_way
+    /// request doesn't expect a reply.
+    future<> request(uint64_t type, int64_t id, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout = {}, cancellable* cancel = nullptr,
+            std::optional<unsigned> shard = {}, bool one_way = false);
 };
 
 class protocol_base;
@@ -583,16 +896,32 @@ class server {
         client_info _info;
         connection_id _parent_id = invalid_connection_id;
         std::optional<isolation_config> _isolation_config;
+        // Aborted when the connection goes down, see handler_abort_source
+        abort_source _abort_source;
+        // Requests passed to other shards, and the shards they went to,
+        // see client_options::shard_routing
+        gate _routed_requests;
+        std::vector<bool> _routed_to;
+        // Set on the connections that handle requests routed from the
+        // origin connection on another shard, which sends their replies
+        connection* _origin = nullptr;
+        gate _routed_replies;
     private:
         future<> negotiate_protocol();
-        future<std::tuple<std::optional<uint64_t>, uint64_t, int64_t, std::optional<rcv_buf>>>
+        future<std::tuple<std::optional<uint64_t>, uint64_t, int64_t, std::optional<uint32_t>, std::optional<rcv_buf>>>
         read_request_frame_compressed(input_stream<char>& in);
         future<feature_map> negotiate(feature_map requested);
         future<> send_unknown_verb_reply(std::optional<rpc_clock_type::time_point> timeout, int64_t msg_id, uint64_t type);
+        future<> send_exception_reply(std::optional<rpc_clock_type::time_point> timeout, int64_t msg_id, sstring what);
+        future<> dispatch_request(std::optional<rpc_clock_type::time_point> timeout, uint64_t type, int64_t msg_id, rcv_buf data);
+        future<> route_request(unsigned shard, std::optional<rpc_clock_type::time_point> timeout, uint64_t type, int64_t msg_id, rcv_buf data);
+        future<> stop_routing();
     public:
         connection(server& s, connected_socket&& fd, socket_address&& addr, const logger& l, void* seralizer, connection_id id);
+        // A connection handling the requests of origin, which lives on another shard
+        connection(server& s, connection& origin, const logger& l, void* serializer);
         future<> process();
-        future<> respond(int64_t msg_id, snd_buf&& data, std::optional<rpc_clock_type::time_point> timeout);
+        future<> respond(int64_t msg_id, snd_buf&& data, std::optional<rpc_clock_type::time_point> timeout, std::optional<uint64_t> verb = {});
         client_info& info() { return _info; }
         const client_info& info() const { return _info; }
         stats get_stats() const {
@@ -620,11 +949,17 @@ class server {
         server& get_server() {
             return _info.server;
         }
+        abort_source& get_abort_source() noexcept {
+            return _abort_source;
+        }
         const server& get_server() const {
             return _info.server;
         }
         future<> deregister_this_stream();
         future<> abort_all_streams();
+        /// \cond internal
+        future<> stop_routed() noexcept;
+        /// \endcond
     };
 private:
     protocol_base& _proto;
@@ -632,6 +967,9 @@ class server {
     resource_limits _limits;
     rpc_semaphore _resources_available;
     std::unordered_map<connection_id, shared_ptr<connection>> _conns;
+    // Connections of other shards whose requests are routed here, by the id
+    // of the origin connection
+    std::unordered_map<connection_id, shared_ptr<connection>> _routed_conns;
     promise<> _ss_stopped;
     gate _reply_gate;
     server_options _options;
@@ -677,6 +1015,10 @@ class server {
      * @param id the ID of the connection to abort.
      */
     void abort_connection(connection_id id);
+    /// \cond internal
+    shared_ptr<connection> routed_connection(connection& origin);
+    future<> drop_routed_connection(connection_id id);
+    /// \endcond
     gate& reply_gate() {
         return _reply_gate;
     }
@@ -697,6 +1039,8 @@ class protocol_base {
 public:
     virtual ~protocol_base() {};
     virtual shared_ptr<server::connection> make_server_connection(rpc::server& server, connected_socket fd, socket_address addr, connection_id id) = 0;
+    // The connection handling requests routed from origin on another shard
+    virtual shared_ptr<server::connection> make_routed_connection(rpc::server& server, server::connection& origin) = 0;
 protected:
     friend class server;
 
@@ -840,6 +1184,26 @@ class protocol final : public protocol_base {
             rpc::client(p.get_logger(), &p._serializer, std::move(socket), addr, local) {}
         client(protocol& p, client_options options, socket socket, const socket_address& addr, const socket_address& local = {}) :
             rpc::client(p.get_logger(), &p._serializer, options, std::move(socket), addr, local) {}
+
+        /**
+         * Create client object which will attempt to connect to an endpoint
+         * picked by the balancer.
+         *
+         * @param balancer the endpoints to pick from, it must outlive the client
+         * @param local the local address of this client
+         */
+        client(protocol& p, client_options options, net::srv_balancer& balancer, const socket_address& local = {}) :
+            rpc::client(p.get_logger(), &p._serializer, options, balancer.acquire(), local) {}
+
+        /**
+         * Create client object which sends its requests through the
+         * connection of a client on another shard.
+         *
+         * @param shared the client whose connection is used, it must be
+         *        stopped after this one
+         */
+        client(protocol& p, client_options options, foreign_ptr<shared_ptr<rpc::client>> shared) :
+            rpc::client(p.get_logger(), &p._serializer, options, std::move(shared)) {}
     };
 
     friend server;
@@ -869,7 +1233,10 @@ class protocol final : public protocol_base {
     ///     signature of the verb.
     /// \param t the verb to register the handler for.
     /// \param func the callable to be called when the verb is invoked by the
-    ///     remote.
+    ///     remote. Besides the verb parameters it may take a `client_info&`,
+    ///     followed by an `opt_time_point` holding the deadline of the
+    ///     request, followed by an `abort_source&` which is aborted when the
+    ///     deadline passes or the connection is closed.
     ///
     /// \returns a client, a callable that can be used to invoke the verb. See
     ///     make_client(). The client can be discarded, in fact this is what
@@ -932,6 +1299,10 @@ class protocol final : public protocol_base {
         return make_shared<rpc::server::connection>(server, std::move(fd), std::move(addr), _logger, &_serializer, id);
     }
 
+    shared_ptr<rpc::server::connection> make_routed_connection(rpc::server& server, rpc::server::connection& origin) override {
+        return make_shared<rpc::server::connection>(server, origin, _logger, &_serializer);
+    }
+
     bool has_handler(MsgType msg_id);
 
     /// Checks if any there are handlers registered.
@@ -60,6 +60,10 @@ struct dont_want_client_info {};
 struct do_want_time_point {};
 struct dont_want_time_point {};
 
+// tags to tell whether we want an abort_source& parameter
+struct do_want_abort_source {};
+struct dont_want_abort_source {};
+
 // General case
 template <typename Ret, typename... In>
 struct signature<Ret (In...)> {
@@ -68,6 +72,7 @@ struct signature<Ret (In...)> {
     using clean = signature;
     using want_client_info = dont_want_client_info;
     using want_time_point = dont_want_time_point;
+    using want_abort_source = dont_want_abort_source;
 };
 
 // Specialize 'clean' for handlers that receive client_info
@@ -78,6 +83,7 @@ struct signature<Ret (const client_info&, In...)> {
     using clean = signature<Ret (In...)>;
     using want_client_info = do_want_client_info;
     using want_time_point = dont_want_time_point;
+    using want_abort_source = dont_want_abort_source;
 };
 
 template <typename Ret, typename... In>
@@ -87,6 +93,7 @@ struct signature<Ret (client_info&, In...)> {
     using clean = signature<Ret (In...)>;
     using want_client_info = do_want_client_info;
     using want_time_point = dont_want_time_point;
+    using want_abort_source = dont_want_abort_source;
 };
 
 // Specialize 'clean' for handlers that receive client_info and opt_time_point
@@ -97,6 +104,7 @@ struct signature<Ret (const client_info&, opt_time_point, In...)> {
     using clean = signature<Ret (In...)>;
     using want_client_info = do_want_client_info;
     using want_time_point = do_want_time_point;
+    using want_abort_source = dont_want_abort_source;
 };
 
 template <typename Ret, typename... In>
@@ -106,6 +114,7 @@ struct signature<Ret (client_info&, opt_time_point, In...)> {
     using clean = signature<Ret (In...)>;
     using want_client_info = do_want_client_info;
     using want_time_point = do_want_time_point;
+    using want_abort_source = dont_want_abort_source;
 };
 
 // Specialize 'clean' for handlers that receive opt_time_point
@@ -116,6 +125,41 @@ struct signature<Ret (opt_time_point, In...)> {
     using clean = signature<Ret (In...)>;
     using want_client_info = dont_want_client_info;
     using want_time_point = do_want_time_point;
+    using want_abort_source = dont_want_abort_source;
+};
+
+// Specialize 'clean' for handlers that receive client_info, opt_time_point
+// and an abort_source, which is aborted once the deadline passes or the
+// connection is closed
+template <typename Ret, typename... In>
+struct signature<Ret (const client_info&, opt_time_point, abort_source&, In...)> {
+    using ret_type = Ret;
+    using arg_types = std::tuple<In...>;
+    using clean = signature<Ret (In...)>;
+    using want_client_info = do_want_client_info;
+    using want_time_point = do_want_time_point;
+    using want_abort_source = do_want_abort_source;
+};
+
+template <typename Ret, typename... In>
+struct signature<Ret (client_info&, opt_time_point, abort_source&, In...)> {
+    using ret_type = Ret;
+    using arg_types = std::tuple<In...>;
+    using clean = signature<Ret (In...)>;
+    using want_client_info = do_want_client_info;
+    using want_time_point = do_want_time_point;
+    using want_abort_source = do_want_abort_source;
+};
+
+// Specialize 'clean' for handlers that receive opt_time_point and an abort_source
+template <typename Ret, typename... In>
+struct signature<Ret (opt_time_point, abort_source&, In...)> {
+    using ret_type = Ret;
+    using arg_types = std::tuple<In...>;
+    using clean = signature<Ret (In...)>;
+    using want_client_info = dont_want_client_info;
+    using want_time_point = do_want_time_point;
+    using want_abort_source = do_want_abort_source;
 };
 
 template <typename T>
@@ -173,6 +217,51 @@ maybe_add_time_point(do_want_time_point, opt_time_point& otp, std::tuple<In...>&
     return std::tuple_cat(std::make_tuple(otp), std::move(args));
 }
 
+// Aborts a handler once the deadline of its request passes, or its
+// connection is closed
+class handler_abort_source {
+    abort_source _as;
+    timer<rpc_clock_type> _timer;
+    optimized_optional<abort_source::subscription> _sub;
+public:
+    handler_abort_source(abort_source& connection_as, opt_time_point timeout)
+            : _timer([this] { _as.request_abort_ex(timeout_error()); })
+            , _sub(connection_as.subscribe([this] () noexcept { _as.request_abort_ex(closed_error()); })) {
+        if (!_sub) {
+            _as.request_abort_ex(closed_error());
+        } else if (timeout) {
+            _timer.arm(*timeout);
+        }
+    }
+    abort_source& get() noexcept {
+        return _as;
+    }
+};
+
+inline std::unique_ptr<handler_abort_source>
+make_handler_abort_source(dont_want_abort_source, server::connection&, opt_time_point) {
+    return nullptr;
+}
+
+inline std::unique_ptr<handler_abort_source>
+make_handler_abort_source(do_want_abort_source, server::connection& c, opt_time_point timeout) {
+    return std::make_unique<handler_abort_source>(c.get_abort_source(), timeout);
+}
+
+template <typename... In>
+inline
+std::tuple<In...>
+maybe_add_abort_source(dont_want_abort_source, handler_abort_source*, std::tuple<In...>&& args) {
+    return std::move(args);
+}
+
+template <typename... In>
+inline
+std::tuple<std::reference_wrapper<abort_source>, In...>
+maybe_add_abort_source(do_want_abort_source, handler_abort_source* as, std::tuple<In...>&& args) {
+    return std::tuple_cat(std::make_tuple(std::ref(as->get())), std::move(args));
+}
+
 inline sstring serialize_connection_id(const connection_id& id) {
     sstring p = uninitialized_string(sizeof(id));
     auto c = p.data();
@@ -236,6 +325,15 @@ struct marshall_one {
             put_connection_id(arg.get_id(), out);
         }
     };
+    template<std::same_as<fragmented_buffer> T> struct helper<T> {
+        static void doit(Serializer&, Output& out, const fragmented_buffer& arg) {
+            auto size = cpu_to_le(uint32_t(arg.size()));
+            out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            for (auto& f : arg.fragments()) {
+                out.write(f.get(), f.size());
+            }
+        }
+    };
     template <typename... T> struct helper<tuple<T...>> {
         static void doit(Serializer& serializer, Output& out, const tuple<T...>& arg) {
             auto do_do_marshall = [&serializer, &out] (const auto&... args) {
@@ -278,17 +376,17 @@ inline snd_buf marshall(Serializer& serializer, size_t head_space, const T&... a
 }
 
 template <typename Serializer, typename Input, typename... T>
-std::tuple<T...> do_unmarshall(connection& c, Input& in);
+std::tuple<T...> do_unmarshall(connection& c, Input& in, rcv_buf& src);
 
 template<typename Serializer, typename Input>
 struct unmarshal_one {
     template<typename T> struct helper {
-        static T doit(connection& c, Input& in) {
+        static T doit(connection& c, Input& in, rcv_buf&) {
             return read(c.serializer<Serializer>(), in, type<T>());
         }
     };
     template<typename T> struct helper<optional<T>> {
-        static optional<T> doit(connection& c, Input& in) {
+        static optional<T> doit(connection& c, Input& in, rcv_buf&) {
             if (in.size()) {
                 return optional<T>(read(c.serializer<Serializer>(), in, type<typename remove_optional<T>::type>()));
             } else {
@@ -297,8 +395,8 @@ struct unmarshal_one {
         }
     };
     template<typename T> struct helper<std::reference_wrapper<const T>> {
-        static T doit(connection& c, Input& in) {
-            return helper<T>::doit(c, in);
+        static T doit(connection& c, Input& in, rcv_buf& src) {
+            return helper<T>::doit(c, in, src);
         }
     };
     static connection_id get_connection_id(Input& in) {
@@ -307,24 +405,35 @@ struct unmarshal_one {
         return deserialize_connection_id(id);
     }
     template<typename... T> struct helper<sink<T...>> {
-        static sink<T...> doit(connection& c, Input& in) {
+        static sink<T...> doit(connection& c, Input& in, rcv_buf&) {
             return sink<T...>(make_shared<sink_impl<Serializer, T...>>(c.get_stream(get_connection_id(in))));
         }
     };
     template<typename... T> struct helper<source<T...>> {
-        static source<T...> doit(connection& c, Input& in) {
+        static source<T...> doit(connection& c, Input& in, rcv_buf&) {
             return source<T...>(make_shared<source_impl<Serializer, T...>>(c.get_stream(get_connection_id(in))));
         }
     };
+    template<std::same_as<fragmented_buffer> T> struct helper<T> {
+        static fragmented_buffer doit(connection&, Input& in, rcv_buf& src) {
+            uint32_t size;
+            in.read(reinterpret_cast<char*>(&size), sizeof(size));
+            size = le_to_cpu(size);
+            // Shares the bytes of the frame at the position of the stream
+            auto pos = src.size - in.size();
+            in.skip(size);
+            return src.share(pos, size);
+        }
+    };
     template <typename... T> struct helper<tuple<T...>> {
-        static tuple<T...> doit(connection& c, Input& in) {
-            return do_unmarshall<Serializer, Input, T...>(c, in);
+        static tuple<T...> doit(connection& c, Input& in, rcv_buf& src) {
+            return do_unmarshall<Serializer, Input, T...>(c, in, src);
         }
     };
 };
 
 template <typename Serializer, typename Input, typename... T>
-inline std::tuple<T...> do_unmarshall(connection& c, Input& in) {
+inline std::tuple<T...> do_unmarshall(connection& c, Input& in, rcv_buf& src) {
     // Argument order processing is unspecified, but we need to deserialize
     // left-to-right. So we deserialize into something that can be lazily
     // constructed (and can conditionally destroy itself if we only constructed some
@@ -332,7 +441,7 @@ inline std::tuple<T...> do_unmarshall(connection& c, Input& in) {
     std::tuple<std::optional<T>...> temporary;
     return std::apply([&] (auto&... args) {
         // Comma-expression preserves left-to-right order
-        (..., (args = unmarshal_one<Serializer, Input>::template helper<typename std::remove_reference_t<decltype(args)>::value_type>::doit(c, in)));
+        (..., (args = unmarshal_one<Serializer, Input>::template helper<typename std::remove_reference_t<decltype(args)>::value_type>::doit(c, in, src)));
         return std::tuple(std::move(*args)...);
     }, temporary);
 }
@@ -340,7 +449,7 @@ inline std::tuple<T...> do_unmarshall(connection& c, Input& in) {
 template <typename Serializer, typename... T>
 inline std::tuple<T...> unmarshall(connection& c, rcv_buf input) {
     auto in = make_deserializer_stream(input);
-    return do_unmarshall<Serializer, decltype(in), T...>(c, in);
+    return do_unmarshall<Serializer, decltype(in), T...>(c, in, input);
 }
 
 inline std::exception_ptr unmarshal_exception(rcv_buf& d) {
@@ -455,8 +564,9 @@ relative_timeout_to_absolute(rpc_clock_type::duration relative) {
     return now + std::min(relative, rpc_clock_type::time_point::max() - now);
 }
 
-// Refer to struct request_frame for more details
-static constexpr size_t request_frame_headroom = 28;
+// Refer to struct request_frame for more details, the first 4 bytes are
+// only used with shard routing
+static constexpr size_t request_frame_headroom = 32;
 
 // Returns lambda that can be used to send rpc messages.
 // The lambda gets client connection and rpc parameters as arguments, marshalls them sends
@@ -467,34 +577,53 @@ auto send_helper(MsgType xt, signature<Ret (InArgs...)> xsig) {
     struct shelper {
         MsgType t;
         signature<Ret (InArgs...)> sig;
-        auto send(rpc::client& dst, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel, const InArgs&... args) {
+        auto send(rpc::client& dst, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel, std::optional<unsigned> shard, const InArgs&... args) {
             if (dst.error()) {
                 using cleaned_ret_type = typename wait_signature<Ret>::cleaned_type;
                 return futurize<cleaned_ret_type>::make_exception_future(closed_error());
             }
+            if (shard && !dst.shard_routing()) {
+                using cleaned_ret_type = typename wait_signature<Ret>::cleaned_type;
+                return futurize<cleaned_ret_type>::make_exception_future(std::logic_error("RPC client doesn't route requests to shards"));
+            }
 
             // send message
             auto msg_id = dst.next_message_id();
             snd_buf data = marshall(dst.template serializer<Serializer>(), request_frame_headroom, args...);
+            verb_stats_tracker tracker(dst.get_verb_stats(uint64_t(t)));
 
             // prepare reply handler, if return type is now_wait_type this does nothing, since no reply will be sent
             using wait = wait_signature_t<Ret>;
-            return when_all(dst.request(uint64_t(t), msg_id, std::move(data), timeout, cancel), wait_for_reply<Serializer>(wait(), timeout, cancel, dst, msg_id, sig)).then([] (auto r) {
+            constexpr bool one_way = std::is_same_v<wait, no_wait_type>;
+            return when_all(dst.request(uint64_t(t), msg_id, std::move(data), timeout, cancel, shard, one_way), wait_for_reply<Serializer>(wait(), timeout, cancel, dst, msg_id, sig)).then([tracker = std::move(tracker)] (auto r) {
                     std::get<0>(r).ignore_ready_future();
                     return std::move(std::get<1>(r)); // return future of wait_for_reply
             });
         }
         auto operator()(rpc::client& dst, const InArgs&... args) {
-            return send(dst, {}, nullptr, args...);
+            return send(dst, {}, nullptr, {}, args...);
         }
         auto operator()(rpc::client& dst, rpc_clock_type::time_point timeout, const InArgs&... args) {
-            return send(dst, timeout, nullptr, args...);
+            return send(dst, timeout, nullptr, {}, args...);
         }
         auto operator()(rpc::client& dst, rpc_clock_type::duration timeout, const InArgs&... args) {
-            return send(dst, relative_timeout_to_absolute(timeout), nullptr, args...);
+            return send(dst, relative_timeout_to_absolute(timeout), nullptr, {}, args...);
         }
         auto operator()(rpc::client& dst, cancellable& cancel, const InArgs&... args) {
-            return send(dst, {}, &cancel, args...);
+            return send(dst, {}, &cancel, {}, args...);
+        }
+        // Handled by the given shard of the server, see client_options::shard_routing
+        auto operator()(rpc::client& dst, target_shard shard, const InArgs&... args) {
+            return send(dst, {}, nullptr, shard.id, args...);
+        }
+        auto operator()(rpc::client& dst, target_shard shard, rpc_clock_type::time_point timeout, const InArgs&... args) {
+            return send(dst, timeout, nullptr, shard.id, args...);
+        }
+        auto operator()(rpc::client& dst, target_shard shard, rpc_clock_type::duration timeout, const InArgs&... args) {
+            return send(dst, relative_timeout_to_absolute(timeout), nullptr, shard.id, args...);
+        }
+        auto operator()(rpc::client& dst, target_shard shard, cancellable& cancel, const InArgs&... args) {
+            return send(dst, {}, &cancel, shard.id, args...);
         }
 
     };
@@ -506,7 +635,7 @@ static constexpr size_t response_frame_headroom = 12;
 
 template<typename Serializer, typename RetTypes>
 inline future<> reply(wait_type, future<RetTypes>&& ret, int64_t msg_id, shared_ptr<server::connection> client,
-        std::optional<rpc_clock_type::time_point> timeout) {
+        std::optional<rpc_clock_type::time_point> timeout, uint64_t verb) {
     if (!client->error()) {
         snd_buf data;
         try {
@@ -529,7 +658,7 @@ inline future<> reply(wait_type, future<RetTypes>&& ret, int64_t msg_id, shared_
             msg_id = -msg_id;
         }
 
-        return client->respond(msg_id, std::move(data), timeout);
+        return client->respond(msg_id, std::move(data), timeout, verb);
     } else {
         ret.ignore_ready_future();
         return make_ready_future<>();
@@ -538,7 +667,7 @@ inline future<> reply(wait_type, future<RetTypes>&& ret, int64_t msg_id, shared_
 
 // specialization for no_wait_type which does not send a reply
 template<typename Serializer>
-inline future<> reply(no_wait_type, future<no_wait_type>&& r, int64_t msgid, shared_ptr<server::connection> client, std::optional<rpc_clock_type::time_point>) {
+inline future<> reply(no_wait_type, future<no_wait_type>&& r, int64_t msgid, shared_ptr<server::connection> client, std::optional<rpc_clock_type::time_point>, uint64_t) {
     try {
         r.get();
     } catch (std::exception& ex) {
@@ -547,10 +676,12 @@ inline future<> reply(no_wait_type, future<no_wait_type>&& r, int64_t msgid, sha
     return make_ready_future<>();
 }
 
-template<typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint, typename Func, typename ArgsTuple>
-inline futurize_t<Ret> apply(Func& func, client_info& info, opt_time_point time_point, WantClientInfo wci, WantTimePoint wtp, signature<Ret (InArgs...)>, ArgsTuple&& args) {
+template<typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint, typename WantAbortSource, typename Func, typename ArgsTuple>
+inline futurize_t<Ret> apply(Func& func, client_info& info, opt_time_point time_point, handler_abort_source* as,
+        WantClientInfo wci, WantTimePoint wtp, WantAbortSource was, signature<Ret (InArgs...)>, ArgsTuple&& args) {
     using futurator = futurize<Ret>;
-    return futurator::apply(func, maybe_add_client_info(wci, info, maybe_add_time_point(wtp, time_point, std::forward<ArgsTuple>(args))));
+    return futurator::apply(func, maybe_add_client_info(wci, info, maybe_add_time_point(wtp, time_point,
+            maybe_add_abort_source(was, as, std::forward<ArgsTuple>(args)))));
 }
 
 // lref_to_cref is a helper that encapsulates lvalue reference in std::ref() or does nothing otherwise
@@ -566,35 +697,47 @@ auto lref_to_cref(T& x) {
 
 // Creates lambda to handle RPC message on a server.
 // The lambda unmarshalls all parameters, calls a handler, marshall return values and sends them back to a client
-template <typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint>
-auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, WantTimePoint) {
+template <typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint, typename WantAbortSource>
+auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, WantTimePoint, WantAbortSource, uint64_t verb) {
     using signature = decltype(sig);
     using wait_style = wait_signature_t<Ret>;
-    return [func = lref_to_cref(std::forward<Func>(func))](shared_ptr<server::connection> client,
+    return [func = lref_to_cref(std::forward<Func>(func)), verb](shared_ptr<server::connection> client,
                                                            std::optional<rpc_clock_type::time_point> timeout,
                                                            int64_t msg_id,
                                                            rcv_buf data,
                                                            gate::holder guard) mutable {
+        if (timeout && *timeout <= rpc_clock_type::now()) {
+            // The caller has given up already
+            client->get_stats_internal().expired++;
+            return make_ready_future();
+        }
         auto memory_consumed = client->estimate_request_size(data.size);
+        verb_stats_tracker tracker(client->get_verb_stats(verb), true);
         if (memory_consumed > client->max_request_size()) {
             auto err = format("request size {:d} large than memory limit {:d}", memory_consumed, client->max_request_size());
             client->get_logger()(client->peer_address(), err);
             // FIXME: future is discarded
-            (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, err = std::move(err)] {
-                return reply<Serializer>(wait_style(), futurize<Ret>::make_exception_future(std::runtime_error(err.c_str())), msg_id, client, timeout).handle_exception([client, msg_id] (std::exception_ptr eptr) {
+            (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, verb, err = std::move(err)] {
+                return reply<Serializer>(wait_style(), futurize<Ret>::make_exception_future(std::runtime_error(err.c_str())), msg_id, client, timeout, verb).handle_exception([client, msg_id] (std::exception_ptr eptr) {
                     client->get_logger()(client->info(), msg_id, format("got exception while processing an oversized message: {}", eptr));
                 });
             }).handle_exception_type([] (gate_closed_exception&) {/* ignore */});
             return make_ready_future();
         }
         // note: apply is executed asynchronously with regards to networking so we cannot chain futures here by doing "return apply()"
-        auto f = client->wait_for_resources(memory_consumed, timeout).then([client, timeout, msg_id, data = std::move(data), &func, g = std::move(guard)] (auto permit) mutable {
+        auto f = client->wait_for_resources(memory_consumed, timeout).then([client, timeout, msg_id, verb, data = std::move(data), &func, g = std::move(guard), tracker = std::move(tracker)] (auto permit) mutable {
+                if (timeout && *timeout <= rpc_clock_type::now()) {
+                    client->get_stats_internal().expired++;
+                    return;
+                }
+                tracker.dequeued();
                 // FIXME: future is discarded
-                (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, data = std::move(data), permit = std::move(permit), &func] () mutable {
+                (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, verb, data = std::move(data), permit = std::move(permit), &func, tracker = std::move(tracker)] () mutable {
                     try {
                         auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
-                        return apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args)).then_wrapped([client, timeout, msg_id, permit = std::move(permit)] (futurize_t<Ret> ret) mutable {
-                            return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout).handle_exception([permit = std::move(permit), client, msg_id] (std::exception_ptr eptr) {
+                        auto as = make_handler_abort_source(WantAbortSource(), *client, timeout);
+                        return apply(func, client->info(), timeout, as.get(), WantClientInfo(), WantTimePoint(), WantAbortSource(), signature(), std::move(args)).then_wrapped([client, timeout, msg_id, verb, permit = std::move(permit), tracker = std::move(tracker), as = std::move(as)] (futurize_t<Ret> ret) mutable {
+                            return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout, verb).handle_exception([permit = std::move(permit), client, msg_id, tracker = std::move(tracker)] (std::exception_ptr eptr) {
                                 client->get_logger()(client->info(), msg_id, format("got exception while processing a message: {}", eptr));
                             });
                         });
@@ -606,7 +749,9 @@ auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, Wa
         });
 
         if (timeout) {
-            f = f.handle_exception_type([] (semaphore_timed_out&) { /* ignore */ });
+            f = f.handle_exception_type([client] (semaphore_timed_out&) {
+                client->get_stats_internal().expired++;
+            });
         }
 
         return f;
@@ -673,8 +818,9 @@ auto protocol<Serializer, MsgType>::register_handler(MsgType t, scheduling_group
     using clean_sig_type = typename sig_type::clean;
     using want_client_info = typename sig_type::want_client_info;
     using want_time_point = typename sig_type::want_time_point;
+    using want_abort_source = typename sig_type::want_abort_source;
     auto recv = recv_helper<Serializer>(clean_sig_type(), std::forward<Func>(func),
-            want_client_info(), want_time_point());
+            want_client_info(), want_time_point(), want_abort_source(), uint64_t(t));
     register_receiver(t, rpc_handler{sg, make_copyable_function(std::move(recv)), {}});
     return make_client(clean_sig_type(), t);
 }
@@ -758,11 +904,11 @@ future<> sink_impl<Serializer, Out...>::operator()(const Out&... args) {
             }
 
             last_seq_num = seq_num;
-            auto ret_fut = con->send(std::move(local_data), {}, nullptr);
+            auto ret_fut = con->stream_send(std::move(local_data));
             while (!out_of_order_bufs.empty() && out_of_order_bufs.begin()->first == (last_seq_num + 1)) {
                 auto it = out_of_order_bufs.begin();
                 last_seq_num = it->first;
-                auto fut = con->send(std::move(it->second.data), {}, nullptr);
+                auto fut = con->stream_send(std::move(it->second.data));
                 fut.forward_to(std::move(it->second.pr));
                 out_of_order_bufs.erase(it);
             }
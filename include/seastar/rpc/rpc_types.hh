@@ -60,6 +60,8 @@ struct stats {
     counter_type sent_messages = 0;
     counter_type wait_reply = 0;
     counter_type timeout = 0;
+    // Requests dropped by a server, their deadline having passed
+    counter_type expired = 0;
 };
 
 class connection_id {
@@ -235,6 +237,8 @@ struct cancellable {
     }
 };
 
+class fragmented_buffer;
+
 struct rcv_buf {
     uint32_t size = 0;
     std::optional<semaphore_units<>> su;
@@ -245,6 +249,51 @@ struct rcv_buf {
     explicit rcv_buf(temporary_buffer<char> b) : size(b.size()), bufs(std::move(b)) {};
     explicit rcv_buf(std::vector<temporary_buffer<char>> bufs, size_t size)
         : size(size), bufs(std::move(bufs)) {};
+
+    // Returns len bytes starting at pos, sharing the underlying fragments.
+    fragmented_buffer share(size_t pos, size_t len);
+};
+
+/// Bytes of a verb argument or reply, sharing the frame they arrived in.
+///
+/// A handler taking a \c fragmented_buffer gets the fragments of the
+/// received frame instead of a copy, so large payloads can be forwarded
+/// or written out without touching them. The fragments keep the frame's
+/// memory alive for as long as they live, but it is only accounted
+/// against the server's memory limit until the handler's future resolves.
+///
+/// On the wire, it is a little endian 32-bit length followed by the bytes;
+/// the serializer is not involved.
+class fragmented_buffer {
+    std::vector<temporary_buffer<char>> _fragments;
+    size_t _size = 0;
+public:
+    fragmented_buffer() = default;
+    explicit fragmented_buffer(temporary_buffer<char> b) : _size(b.size()) {
+        if (_size) {
+            _fragments.push_back(std::move(b));
+        }
+    }
+    explicit fragmented_buffer(std::vector<temporary_buffer<char>> fragments) noexcept : _fragments(std::move(fragments)) {
+        for (auto& f : _fragments) {
+            _size += f.size();
+        }
+    }
+    size_t size() const noexcept {
+        return _size;
+    }
+    bool empty() const noexcept {
+        return !_size;
+    }
+    const std::vector<temporary_buffer<char>>& fragments() const noexcept {
+        return _fragments;
+    }
+    std::vector<temporary_buffer<char>> release() && noexcept {
+        _size = 0;
+        return std::move(_fragments);
+    }
+    /// Returns the bytes in one buffer, copying them only if fragmented.
+    temporary_buffer<char> linearize();
 };
 
 struct snd_buf {
@@ -0,0 +1,120 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/rpc/rpc_types.hh>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace seastar {
+
+namespace rpc {
+
+/// A dictionary for \ref zstd_compressor, trained with e.g. `zstd --train`
+/// on samples of the messages, or raw content the messages are likely to
+/// repeat.
+///
+/// Both sides of a connection have to be given the same dictionary under
+/// the same id for it to be used. The dictionary is read only once created,
+/// so a single one can serve the factories of all shards.
+class zstd_dictionary {
+    uint32_t _id;
+    int _level;
+    ZSTD_CDict_s* _cdict;
+    ZSTD_DDict_s* _ddict;
+public:
+    /// \param id identifies the dictionary in the negotiation
+    /// \param data the dictionary
+    /// \param level compression level messages are compressed with
+    zstd_dictionary(uint32_t id, const temporary_buffer<char>& data, int level = 1);
+    zstd_dictionary(const zstd_dictionary&) = delete;
+    ~zstd_dictionary();
+    uint32_t id() const noexcept {
+        return _id;
+    }
+    int level() const noexcept {
+        return _level;
+    }
+    /// \cond internal
+    ZSTD_CDict_s* cdict() const noexcept {
+        return _cdict;
+    }
+    ZSTD_DDict_s* ddict() const noexcept {
+        return _ddict;
+    }
+    /// \endcond
+};
+
+/// zstd compression of RPC messages
+///
+/// Every message is compressed into a zstd frame of its own. Fragmented
+/// messages are fed to zstd's streaming interface fragment by fragment, and
+/// decompressed into fragments, so nothing is linearized.
+///
+/// zstd is an optional dependency, see \ref available().
+class zstd_compressor final : public compressor {
+    int _level;
+    const zstd_dictionary* _dict;
+    ZSTD_CCtx_s* _cctx;
+    ZSTD_DCtx_s* _dctx;
+public:
+    /// Negotiates zstd, with a dictionary or without. Give a
+    /// \ref multi_algo_compressor_factory a factory per dictionary, most
+    /// preferred first, and one without to fall back to plain zstd when no
+    /// dictionary is shared with the peer.
+    class factory final : public rpc::compressor::factory {
+        int _level;
+        const zstd_dictionary* _dict;
+        sstring _name;
+    public:
+        /// \param level compression level, 1 to 3 trade little speed for
+        /// a good ratio
+        explicit factory(int level = 1);
+        /// The dictionary must outlive the factory and the compressors it
+        /// negotiates
+        explicit factory(const zstd_dictionary& dict);
+        virtual const sstring& supported() const override;
+        virtual std::unique_ptr<rpc::compressor> negotiate(sstring feature, bool is_server) const override;
+    };
+
+    /// Whether seastar was built with zstd. When not, the factories
+    /// advertise and negotiate nothing.
+    static bool available() noexcept;
+
+    explicit zstd_compressor(int level = 1, const zstd_dictionary* dict = nullptr);
+    zstd_compressor(const zstd_compressor&) = delete;
+    ~zstd_compressor();
+    snd_buf compress(size_t head_space, snd_buf data) override;
+    rcv_buf decompress(rcv_buf data) override;
+    sstring name() const override;
+};
+
+}
+
+}
@@ -23,12 +23,17 @@
 
 #include <atomic>
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include <fmt/format.h>
 
 #include <seastar/core/coroutine.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/util/later.hh>
 #include <seastar/testing/linux_perf_event.hh>
 
 using namespace seastar;
@@ -40,6 +45,9 @@ struct config;
 
 using clock_type = std::chrono::steady_clock;
 
+// Latencies of single iterations in nanoseconds, ~3% precision
+using latency_histogram = seastar::metrics::internal::approximate_exponential_histogram<32, (uint64_t(1) << 36), 32>;
+
 class perf_stats {
 public:
     uint64_t allocations = 0;
@@ -127,6 +135,7 @@ class performance_test {
     struct run_result {
         clock_type::duration duration;
         perf_stats stats;
+        std::optional<latency_histogram> latencies;
     };
 protected:
     [[gnu::always_inline]] [[gnu::hot]]
@@ -139,6 +148,11 @@ class performance_test {
         _single_run_iterations += n;
     }
 
+    // Iterations left to the run, or 0 once it has to stop
+    uint64_t max_single_run_iterations() const {
+        return _max_single_run_iterations.load(std::memory_order_relaxed);
+    }
+
     virtual void set_up() = 0;
     virtual void tear_down() noexcept = 0;
     virtual future<run_result> do_single_run() = 0;
@@ -221,7 +235,8 @@ class time_measurement {
     }
 };
 
-extern time_measurement measure_time;
+// Per shard, for the tests running on all of them
+extern thread_local time_measurement measure_time;
 
 namespace {
 
@@ -312,12 +327,161 @@ class concrete_performance_test final : public performance_test {
     using performance_test::performance_test;
 };
 
-void register_test(std::unique_ptr<performance_test>);
+// Runs the test concurrently on all the shards, each with its own instance
+// of it. The iterations of a run are split between the shards, and the time
+// of the run is the one of the slowest shard: the result is the cost of an
+// iteration with all the shards loaded.
+template<typename Test>
+class concrete_sharded_performance_test final : public performance_test {
+    struct shard_state {
+        Test test;
+        linux_perf_event instructions_retired_counter = linux_perf_event::user_instructions_retired();
+        linux_perf_event cpu_cycles_retired_counter = linux_perf_event::user_cpu_cycles_retired();
+        uint64_t iterations = 0;
+        run_result result;
+    };
+    // Indexed by shard, each created, used and destroyed on its shard
+    std::vector<std::unique_ptr<shard_state>> _shards;
+private:
+    bool shard_done(const shard_state& s, uint64_t budget) const {
+        return s.iterations >= budget || !this->max_single_run_iterations();
+    }
+
+    future<> run_on_shard(uint64_t budget) {
+        auto& s = *_shards[this_shard_id()];
+        s.iterations = 0;
+        s.instructions_retired_counter.enable();
+        s.cpu_cycles_retired_counter.enable();
+        measure_time.start_run(&s.instructions_retired_counter, &s.cpu_cycles_retired_counter);
+        using ret_type = decltype(s.test.run());
+        future<> f = make_ready_future<>();
+        if constexpr (is_future<ret_type>::value) {
+            f = do_until([this, &s, budget] { return shard_done(s, budget); }, [&s] {
+                if constexpr (std::is_same_v<ret_type, future<>>) {
+                    s.iterations++;
+                    return s.test.run();
+                } else {
+                    return s.test.run().then([&s] (size_t n) {
+                        s.iterations += n;
+                    });
+                }
+            });
+        } else {
+            while (!shard_done(s, budget)) {
+                if constexpr (std::is_void_v<ret_type>) {
+                    s.test.run();
+                    s.iterations++;
+                } else {
+                    s.iterations += s.test.run();
+                }
+            }
+        }
+        return f.then([&s] {
+            s.result = measure_time.stop_run();
+        }).finally([&s] {
+            s.instructions_retired_counter.disable();
+            s.cpu_cycles_retired_counter.disable();
+        });
+    }
+protected:
+    virtual void set_up() override {
+        _shards.resize(smp::count);
+        smp::invoke_on_all([this] {
+            _shards[this_shard_id()] = std::make_unique<shard_state>();
+        }).get();
+    }
+
+    virtual void tear_down() noexcept override {
+        smp::invoke_on_all([this] {
+            _shards[this_shard_id()].reset();
+        }).get();
+        _shards.clear();
+    }
 
+    virtual future<run_result> do_single_run() override {
+        auto max = this->max_single_run_iterations();
+        auto budget = max / smp::count + (max % smp::count != 0);
+        return smp::invoke_on_all([this, budget] {
+            // Let the other shards get their request before this one
+            // starts a loop that may not yield
+            return yield().then([this, budget] {
+                return run_on_shard(budget);
+            });
+        }).then([this] {
+            run_result ret{clock_type::duration::zero(), perf_stats()};
+            for (auto& s : _shards) {
+                ret.duration = std::max(ret.duration, s->result.duration);
+                ret.stats += s->result.stats;
+                this->next_iteration(s->iterations);
+            }
+            return ret;
+        });
+    }
+public:
+    using performance_test::performance_test;
+};
+
+// Times each iteration of the test, which returns either void or future<>,
+// on top of the run as a whole, and reports the distribution of their
+// latencies.
 template<typename Test>
+class concrete_latency_performance_test final : public performance_test {
+    std::optional<Test> _test;
+    latency_histogram _latencies;
+private:
+    void account(clock_type::time_point start) {
+        _latencies.add(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+    }
+protected:
+    virtual void set_up() override {
+        _test.emplace();
+    }
+
+    virtual void tear_down() noexcept override {
+        _test = std::nullopt;
+    }
+
+    virtual future<run_result> do_single_run() override {
+        _latencies.clear();
+        _instructions_retired_counter.enable();
+        _cpu_cycles_retired_counter.enable();
+        measure_time.start_run(&_instructions_retired_counter, &_cpu_cycles_retired_counter);
+        future<> f = make_ready_future<>();
+        if constexpr (is_future<decltype(_test->run())>::value) {
+            f = do_until([this] { return this->stop_iteration(); }, [this] {
+                this->next_iteration(1);
+                auto start = clock_type::now();
+                return _test->run().then([this, start] {
+                    account(start);
+                });
+            });
+        } else {
+            while (!this->stop_iteration()) {
+                this->next_iteration(1);
+                auto start = clock_type::now();
+                _test->run();
+                account(start);
+            }
+        }
+        return f.then([this] {
+            auto ret = measure_time.stop_run();
+            ret.latencies = _latencies;
+            return ret;
+        }).finally([this] {
+            _instructions_retired_counter.disable();
+            _cpu_cycles_retired_counter.disable();
+        });
+    }
+public:
+    using performance_test::performance_test;
+};
+
+void register_test(std::unique_ptr<performance_test>);
+
+template<typename Test, template <typename> class Runner = concrete_performance_test>
 struct test_registrar {
     test_registrar(const std::string& test_group, const std::string& test_case) {
-        auto test = std::make_unique<concrete_performance_test<Test>>(test_case, test_group);
+        auto test = std::make_unique<Runner<Test>>(test_case, test_group);
         performance_test::register_test(std::move(test));
     }
 };
@@ -374,6 +538,46 @@ void do_not_optimize(const T& v)
     [[gnu::always_inline]] auto test_##test_group##_##test_case::run()
 
 
+// PERF_TEST_SHARDED and PERF_TEST_SHARDED_F run the test on all the shards
+// at the same time, with an instance of the fixture per shard, and report
+// the cost of an iteration under that load.
+//
+// PERF_TEST_LATENCY and PERF_TEST_LATENCY_F also report the latency
+// percentiles of single iterations. Their functions return `void` or
+// `future<>`, one iteration each.
+
+#define PERF_TEST_SHARDED_F(test_group, test_case) \
+    struct test_##test_group##_##test_case : test_group { \
+        [[gnu::always_inline]] inline auto run(); \
+    }; \
+    static ::perf_tests::internal::test_registrar<test_##test_group##_##test_case, ::perf_tests::internal::concrete_sharded_performance_test> \
+    test_##test_group##_##test_case##_registrar(#test_group, #test_case); \
+    [[gnu::always_inline]] auto test_##test_group##_##test_case::run()
+
+#define PERF_TEST_SHARDED(test_group, test_case) \
+    struct test_##test_group##_##test_case { \
+        [[gnu::always_inline]] inline auto run(); \
+    }; \
+    static ::perf_tests::internal::test_registrar<test_##test_group##_##test_case, ::perf_tests::internal::concrete_sharded_performance_test> \
+    test_##test_group##_##test_case##_registrar(#test_group, #test_case); \
+    [[gnu::always_inline]] auto test_##test_group##_##test_case::run()
+
+#define PERF_TEST_LATENCY_F(test_group, test_case) \
+    struct test_##test_group##_##test_case : test_group { \
+        [[gnu::always_inline]] inline auto run(); \
+    }; \
+    static ::perf_tests::internal::test_registrar<test_##test_group##_##test_case, ::perf_tests::internal::concrete_latency_performance_test> \
+    test_##test_group##_##test_case##_registrar(#test_group, #test_case); \
+    [[gnu::always_inline]] auto test_##test_group##_##test_case::run()
+
+#define PERF_TEST_LATENCY(test_group, test_case) \
+    struct test_##test_group##_##test_case { \
+        [[gnu::always_inline]] inline auto run(); \
+    }; \
+    static ::perf_tests::internal::test_registrar<test_##test_group##_##test_case, ::perf_tests::internal::concrete_latency_performance_test> \
+    test_##test_group##_##test_case##_registrar(#test_group, #test_case); \
+    [[gnu::always_inline]] auto test_##test_group##_##test_case::run()
+
 #define PERF_TEST_C(test_group, test_case) \
     struct test_##test_group##_##test_case : test_group { \
         inline future<> run(); \
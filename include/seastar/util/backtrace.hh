@@ -76,6 +76,37 @@ void backtrace(Func&& func) noexcept(noexcept(func(frame()))) {
 #endif
 }
 
+namespace internal {
+
+// Stores up to size return addresses of the current call stack by walking
+// the frame pointer chain, and returns their number. Returns -1 if seastar
+// isn't built with frame pointers (Seastar_FRAME_POINTERS), or if the
+// bounds of the current stack aren't known.
+int walk_frame_pointers(uintptr_t* buffer, size_t size) noexcept;
+
+}
+
+// Like backtrace(), but walks the frame pointers when seastar is built
+// with them, which is much cheaper than unwinding with the DWARF tables.
+// Frames of code built without frame pointers are skipped, so this is
+// meant for sampling; crash reports should use backtrace(). From a signal
+// handler the walk can't cross the signal frame, and loses the frames of
+// the interrupted code, so stall reports use backtrace() too.
+SEASTAR_MODULE_EXPORT
+template<typename Func>
+void fast_backtrace(Func&& func) noexcept(noexcept(func(frame()))) {
+    constexpr size_t max_backtrace = 100;
+    uintptr_t buffer[max_backtrace];
+    int n = internal::walk_frame_pointers(buffer, max_backtrace);
+    if (n < 0) {
+        backtrace(std::forward<Func>(func));
+        return;
+    }
+    for (int i = 0; i < n; ++i) {
+        func(decorate(buffer[i] - 1));
+    }
+}
+
 // Represents a call stack of a single thread.
 SEASTAR_MODULE_EXPORT
 class simple_backtrace {
@@ -93,6 +124,7 @@ class simple_backtrace {
 
     size_t hash() const noexcept { return _hash; }
     char delimeter() const noexcept { return _delimeter; }
+    const vector_type& frames() const noexcept { return _frames; }
 
     friend std::ostream& operator<<(std::ostream& out, const simple_backtrace&);
 
@@ -197,6 +229,9 @@ tasktrace current_tasktrace() noexcept;
 // Collects backtrace only within the currently executing task.
 simple_backtrace current_backtrace_tasklocal() noexcept;
 
+// Like current_backtrace_tasklocal(), but collected with fast_backtrace().
+simple_backtrace fast_backtrace_tasklocal() noexcept;
+
 std::ostream& operator<<(std::ostream& out, const tasktrace& b);
 
 namespace internal {
@@ -0,0 +1,44 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <cstdint>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Extends the CRC32C (Castagnoli) checksum \c crc with \c len bytes.
+///
+/// Start with a \c crc of 0; the checksum of a buffer split in parts is
+/// the one of its parts fed in order. Uses the SSE4.2 \c crc32
+/// instruction, carry-less multiplication to run three streams in
+/// parallel, or the ARMv8 CRC instructions, when available.
+uint32_t crc32c(uint32_t crc, const char* data, size_t len) noexcept;
+
+SEASTAR_MODULE_EXPORT_END
+
+}
@@ -88,6 +88,28 @@ struct options : public program_options::option_group {
     ///
     /// Default: \p true.
     program_options::value<bool> log_with_color;
+    /// Write log messages from a dedicated thread, see \ref logger::set_async().
+    ///
+    /// Default: \p false.
+    program_options::value<bool> logger_async;
+    /// Size of the buffer of each thread with asynchronous logging, in bytes.
+    ///
+    /// Default: 1MB.
+    program_options::value<unsigned> logger_async_buffer_size;
+    /// Write messages synchronously instead of dropping them when the buffer
+    /// is full.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> logger_async_write_through;
+    /// Format log messages on the writer thread of the asynchronous logging,
+    /// see \ref logger::set_deferred_formatting().
+    ///
+    /// Default: \p false.
+    program_options::value<bool> logger_deferred_formatting;
+    /// Write log messages to the output stream as JSON objects.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> logger_json;
     /// \cond internal
     options(program_options::option_group* parent_group);
     /// \endcond
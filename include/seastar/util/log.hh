@@ -32,8 +32,12 @@
 #include <unordered_map>
 #include <exception>
 #include <iosfwd>
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <mutex>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <boost/lexical_cast.hpp>
 #include <fmt/core.h>
@@ -103,6 +107,8 @@ class logger {
     static std::atomic<bool> _ostream;
     static std::atomic<bool> _syslog;
     static unsigned _shard_field_width;
+    static std::atomic<bool> _deferred_formatting;
+    class async_backend;
 #ifdef SEASTAR_BUILD_SHARED_LIBS
     static thread_local bool silent;
 #else
@@ -141,6 +147,7 @@ class logger {
                            compat::source_location loc = compat::source_location::current()) noexcept
             : format(format)
             , loc(loc)
+            , is_literal(true)
         {}
         /// construct format_info from an instance of \c format_string
         ///
@@ -167,6 +174,9 @@ class logger {
         {}
         fmt::format_string<Args...> format;
         compat::source_location loc;
+        // The format string outlives the program's threads, so a deferred
+        // message can refer to it
+        bool is_literal = false;
     };
 #ifdef __cpp_lib_type_identity
     template <typename T>
@@ -209,8 +219,69 @@ class logger {
 
 private:
 
+    // Deferred formatting: the arguments of these types are copied into the
+    // record of the message, and formatted by the writer thread of the
+    // asynchronous logging.
+    struct deferred_args {
+        template <typename T>
+        static constexpr bool is_string =
+                std::is_same_v<std::decay_t<T>, const char*> || std::is_same_v<std::decay_t<T>, char*> ||
+                std::is_same_v<std::remove_cvref_t<T>, std::string> || std::is_same_v<std::remove_cvref_t<T>, std::string_view> ||
+                std::is_same_v<std::remove_cvref_t<T>, sstring>;
+        template <typename T>
+        static constexpr bool is_capturable = is_string<T> ||
+                std::is_arithmetic_v<std::remove_cvref_t<T>> || std::is_enum_v<std::remove_cvref_t<T>>;
+        template <typename T>
+        using stored_t = std::conditional_t<is_string<T>, std::string_view, std::remove_cvref_t<T>>;
+        using render_fn = internal::log_buf::inserter_iterator (*)(internal::log_buf::inserter_iterator, std::string_view, const char*);
+
+        template <typename T>
+        static internal::log_buf::inserter_iterator encode(internal::log_buf::inserter_iterator it, const T& v) {
+            if constexpr (is_string<T>) {
+                std::string_view s;
+                if constexpr (std::is_pointer_v<std::decay_t<T>>) {
+                    const char* c = v;
+                    s = c ? std::string_view(c) : std::string_view("(null)");
+                } else {
+                    s = v;
+                }
+                uint32_t len = s.size();
+                it = std::copy_n(reinterpret_cast<const char*>(&len), sizeof(len), it);
+                return std::copy_n(s.data(), len, it);
+            } else {
+                return std::copy_n(reinterpret_cast<const char*>(&v), sizeof(v), it);
+            }
+        }
+        template <typename T>
+        static T decode(const char*& p) noexcept {
+            if constexpr (std::is_same_v<T, std::string_view>) {
+                uint32_t len;
+                std::memcpy(&len, p, sizeof(len));
+                std::string_view s(p + sizeof(len), len);
+                p += sizeof(len) + len;
+                return s;
+            } else {
+                T v;
+                std::memcpy(&v, p, sizeof(v));
+                p += sizeof(v);
+                return v;
+            }
+        }
+        template <typename... Args>
+        static internal::log_buf::inserter_iterator render(internal::log_buf::inserter_iterator it, std::string_view format, const char* p) {
+            // Braced initialization decodes the arguments in order
+            std::tuple<stored_t<Args>...> values{decode<stored_t<Args>>(p)...};
+            return std::apply([&] (const auto&... v) {
+                return fmt::format_to(it, fmt::runtime(format), v...);
+            }, values);
+        }
+    };
+
     // We can't use an std::function<> as it potentially allocates.
     void do_log(log_level level, log_writer& writer);
+    // Queues the message to be formatted by the writer thread when
+    // asynchronous logging is enabled, formats it right away otherwise
+    void do_log_deferred(log_level level, fmt::string_view format, deferred_args::render_fn render, log_writer& args_writer);
     void failed_to_log(std::exception_ptr ex,
                        fmt::string_view fmt,
                        compat::source_location loc) noexcept;
@@ -294,6 +365,18 @@ class logger {
     void log(log_level level, format_info_t<Args...> fmt, Args&&... args) noexcept {
         if (is_enabled(level)) {
             try {
+#ifdef SEASTAR_LOGGER_COMPILE_TIME_FMT
+                if constexpr ((deferred_args::is_capturable<Args> && ...)) {
+                    if (fmt.is_literal && _deferred_formatting.load(std::memory_order_relaxed)) {
+                        lambda_log_writer args_writer([&] (internal::log_buf::inserter_iterator it) {
+                            ((it = deferred_args::encode(it, args)), ...);
+                            return it;
+                        });
+                        do_log_deferred(level, fmt::string_view(fmt.format), &deferred_args::render<Args...>, args_writer);
+                        return;
+                    }
+                }
+#endif
                 lambda_log_writer writer([&] (internal::log_buf::inserter_iterator it) {
 #if defined(SEASTAR_LOGGER_COMPILE_TIME_FMT) || FMT_VERSION < 80000
                     return fmt::format_to(it, fmt.format, std::forward<Args>(args)...);
@@ -487,6 +570,47 @@ class logger {
     ///
     /// \note this is a noop if fmtlib's version is less than 6.0
     static void set_with_color(bool enabled) noexcept;
+
+    /// What asynchronous logging does when a thread's buffer is full
+    enum class overflow_policy {
+        /// drop the message; the number of dropped messages is logged later
+        drop,
+        /// write the message synchronously, as without asynchronous logging
+        write_through,
+    };
+
+    /// Enable/disable asynchronous logging
+    ///
+    /// When enabled, messages are formatted by the logging thread into a
+    /// buffer of its own, and a dedicated writer thread writes them to the
+    /// ostream and syslog in batches, so that a slow sink doesn't stall
+    /// the reactor. Messages of different threads can be written out of
+    /// order. Disabling waits for the buffered messages to be written.
+    ///
+    /// \param buffer_size the size of the buffer of each thread, in bytes
+    static void set_async(bool enabled, size_t buffer_size = 1 << 20, overflow_policy policy = overflow_policy::drop);
+
+    /// Number of messages dropped because a buffer of the asynchronous
+    /// logging was full
+    static uint64_t async_dropped_messages() noexcept;
+
+    /// Enable/disable deferred formatting
+    ///
+    /// With asynchronous logging, a message whose arguments are all numbers,
+    /// enums or strings isn't formatted by the logging thread: its format
+    /// string and a copy of its arguments are queued, and the writer thread
+    /// formats them. Other messages are formatted right away, as are all
+    /// messages when the format strings aren't checked at compile time
+    /// (SEASTAR_LOGGER_COMPILE_TIME_FMT), since the format string of a
+    /// deferred message has to be a literal.
+    static void set_deferred_formatting(bool enabled) noexcept;
+
+    /// Write messages to the ostream as JSON objects, one per line
+    ///
+    /// An object holds the level, the timestamp (unless disabled), the shard
+    /// and scheduling group, the logger name and the message. Messages sent
+    /// to syslog are not affected.
+    static void set_json_format(bool enabled) noexcept;
 };
 
 /// \brief used to keep a static registry of loggers
@@ -568,6 +692,11 @@ struct logging_settings final {
     bool with_color;
     logger_timestamp_style stdout_timestamp_style = logger_timestamp_style::real;
     logger_ostream_type logger_ostream = logger_ostream_type::cerr;
+    bool async = false;
+    size_t async_buffer_size = 1 << 20;
+    logger::overflow_policy async_overflow_policy = logger::overflow_policy::drop;
+    bool deferred_formatting = false;
+    bool json_format = false;
 };
 
 /// Shortcut for configuring the logging system all at once.
@@ -33,15 +33,29 @@
 
 namespace seastar {
 
+SEASTAR_MODULE_EXPORT_BEGIN
+
+template <typename Signature, size_t InlineSize = 32>
+class basic_noncopyable_function;
+
+/// A clone of \c std::function, but only invokes the move constructor
+/// of the contained function. Function objects of up to 32 bytes are
+/// stored inline, larger ones are allocated.
+///
+/// \see basic_noncopyable_function for a different inline capacity
 template <typename Signature>
-class noncopyable_function;
+using noncopyable_function = basic_noncopyable_function<Signature>;
+
+SEASTAR_MODULE_EXPORT_END
 
 namespace internal {
 
+template <size_t NrDirect>
 class noncopyable_function_base {
 private:
     noncopyable_function_base() = default;
-    static constexpr size_t nr_direct = 32;
+    static constexpr size_t nr_direct = NrDirect;
+    static_assert(nr_direct >= sizeof(void*), "inline capacity can't hold a pointer");
     union [[gnu::may_alias]] storage {
         char direct[nr_direct];
         void* indirect;
@@ -79,8 +93,8 @@ class noncopyable_function_base {
 private:
     storage _storage;
 
-    template <typename Signature>
-    friend class seastar::noncopyable_function;
+    template <typename Signature, size_t InlineSize>
+    friend class seastar::basic_noncopyable_function;
 };
 
 template<typename FirstArg = void, typename... RemainingArgs>
@@ -102,9 +116,27 @@ struct is_nothrow_if_object<> {
 
 /// A clone of \c std::function, but only invokes the move constructor
 /// of the contained function.
+///
+/// Function objects of up to \c InlineSize bytes, which are nothrow move
+/// constructible, are stored inline, larger ones are allocated. A larger
+/// inline capacity suits function objects which are created often and
+/// capture more than a few pointers, at the cost of a larger object.
+///
+/// \tparam InlineSize inline capacity, in bytes
 SEASTAR_MODULE_EXPORT
-template <typename Ret, typename... Args, bool Noexcept>
-class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal::noncopyable_function_base {
+template <typename Ret, typename... Args, bool Noexcept, size_t InlineSize>
+class basic_noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize> : private internal::noncopyable_function_base<InlineSize> {
+    using base = internal::noncopyable_function_base<InlineSize>;
+    using noncopyable_function = basic_noncopyable_function;
+    using noncopyable_function_base = base;
+    using move_type = typename base::move_type;
+    using destroy_type = typename base::destroy_type;
+    using base::nr_direct;
+    using base::empty_move;
+    using base::empty_destroy;
+    using base::indirect_move;
+    using base::trivial_direct_destroy;
+    using storage = typename base::storage;
     using call_type = Ret (*)(const noncopyable_function* func, Args...);
     struct vtable {
         const call_type call;
@@ -135,7 +167,7 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
         static constexpr move_type select_move_thunk() {
             bool can_trivially_move = std::is_trivially_move_constructible_v<Func>
                     && std::is_trivially_destructible_v<Func>;
-            return can_trivially_move ? trivial_direct_move<internal::used_size<Func>::value> : move;
+            return can_trivially_move ? base::template trivial_direct_move<internal::used_size<Func>::value> : move;
         }
         static void destroy(noncopyable_function_base* func) {
             access(func)->~Func();
@@ -178,34 +210,34 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
     template <typename Func>
     struct vtable_for : select_vtable_for<Func, is_direct<Func>()> {};
 public:
-    noncopyable_function() noexcept : _vtable(&_s_empty_vtable) {}
+    basic_noncopyable_function() noexcept : _vtable(&_s_empty_vtable) {}
     template <typename Func>
     requires std::is_invocable_r_v<Ret, Func, Args...>
-    noncopyable_function(Func func) {
+    basic_noncopyable_function(Func func) {
         static_assert(!Noexcept || noexcept(std::declval<Func>()(std::declval<Args>()...)));
         vtable_for<Func>::initialize(std::move(func), this);
         _vtable = &vtable_for<Func>::s_vtable;
     }
     template <typename Object, typename... AllButFirstArg>
-    noncopyable_function(Ret (Object::*member)(AllButFirstArg...) noexcept(Noexcept)) : noncopyable_function(std::mem_fn(member)) {}
+    basic_noncopyable_function(Ret (Object::*member)(AllButFirstArg...) noexcept(Noexcept)) : basic_noncopyable_function(std::mem_fn(member)) {}
     template <typename Object, typename... AllButFirstArg>
-    noncopyable_function(Ret (Object::*member)(AllButFirstArg...) const noexcept(Noexcept)) : noncopyable_function(std::mem_fn(member)) {}
+    basic_noncopyable_function(Ret (Object::*member)(AllButFirstArg...) const noexcept(Noexcept)) : basic_noncopyable_function(std::mem_fn(member)) {}
 
-    ~noncopyable_function() {
+    ~basic_noncopyable_function() {
         _vtable->destroy(this);
     }
 
-    noncopyable_function(const noncopyable_function&) = delete;
-    noncopyable_function& operator=(const noncopyable_function&) = delete;
+    basic_noncopyable_function(const basic_noncopyable_function&) = delete;
+    basic_noncopyable_function& operator=(const basic_noncopyable_function&) = delete;
 
-    noncopyable_function(noncopyable_function&& x) noexcept : _vtable(std::exchange(x._vtable, &_s_empty_vtable)) {
+    basic_noncopyable_function(basic_noncopyable_function&& x) noexcept : _vtable(std::exchange(x._vtable, &_s_empty_vtable)) {
         _vtable->move(&x, this);
     }
 
-    noncopyable_function& operator=(noncopyable_function&& x) noexcept {
+    basic_noncopyable_function& operator=(basic_noncopyable_function&& x) noexcept {
         if (this != &x) {
-            this->~noncopyable_function();
-            new (this) noncopyable_function(std::move(x));
+            this->~basic_noncopyable_function();
+            new (this) basic_noncopyable_function(std::move(x));
         }
         return *this;
     }
@@ -221,16 +253,15 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
 };
 
 
-template <typename Ret, typename... Args, bool Noexcept>
+template <typename Ret, typename... Args, bool Noexcept, size_t InlineSize>
 template <typename Func>
-const typename noncopyable_function<Ret (Args...) noexcept(Noexcept)>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept)>::direct_vtable_for<Func>::s_vtable
-        = noncopyable_function<Ret (Args...) noexcept(Noexcept)>::direct_vtable_for<Func>::make_vtable();
+const typename basic_noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::vtable basic_noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::direct_vtable_for<Func>::s_vtable
+        = basic_noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::direct_vtable_for<Func>::make_vtable();
 
 
-template <typename Ret, typename... Args, bool Noexcept>
+template <typename Ret, typename... Args, bool Noexcept, size_t InlineSize>
 template <typename Func>
-const typename noncopyable_function<Ret (Args...) noexcept(Noexcept)>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept)>::indirect_vtable_for<Func>::s_vtable
-        = noncopyable_function<Ret (Args...) noexcept(Noexcept)>::indirect_vtable_for<Func>::make_vtable();
+const typename basic_noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::vtable basic_noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::indirect_vtable_for<Func>::s_vtable
+        = basic_noncopyable_function<Ret (Args...) noexcept(Noexcept), InlineSize>::indirect_vtable_for<Func>::make_vtable();
 
 }
-
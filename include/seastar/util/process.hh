@@ -81,6 +81,21 @@ class process {
     input_stream<char> cout();
     /// Return an writable stream which provides stderr output from the child process
     input_stream<char> cerr();
+    /// Move the stdout output of the child process to \c out
+    ///
+    /// The output is moved with \c splice(2), without being copied through
+    /// user space, until the child process closes its stdout. \c out can be
+    /// a pipe, a socket, e.g. from \ref connected_socket::dup_fd(), or a
+    /// regular file, which is written at its current position, and must not
+    /// be opened with \c O_APPEND. Writes to regular files go to the page
+    /// cache, and may block the reactor if it's full.
+    ///
+    /// \returns the number of bytes moved
+    future<uint64_t> splice_cout(file_desc out);
+    /// Move the stderr output of the child process to \c out
+    ///
+    /// \see splice_cout()
+    future<uint64_t> splice_cerr(file_desc out);
     struct wait_exited {
         int exit_code;
     };
@@ -93,8 +93,10 @@ requires std::is_nothrow_copy_constructible_v<T> && supports_wrapping_arithmetic
 class shared_token_bucket {
     using rate_resolution = std::chrono::duration<double, Period>;
 
-    T _replenish_rate;
-    const T _replenish_limit;
+    // Both can be updated on the fly by one shard while others replenish,
+    // the exact moment a new value is seen doesn't matter
+    std::atomic<T> _replenish_rate;
+    std::atomic<T> _replenish_limit;
     const T _replenish_threshold;
     std::atomic<typename Clock::time_point> _replenished;
 
@@ -150,7 +152,7 @@ class shared_token_bucket {
             , _replenish_threshold(std::clamp(threshold, (T)1, limit))
             // pretend it was replenished yesterday to spot overflows early
             , _replenished(Clock::now() - std::chrono::hours(add_replenish_iffset ? 24 : 0))
-            , _rovers(_replenish_limit)
+            , _rovers(limit)
     {}
 
     T grab(T tokens) noexcept {
@@ -161,6 +163,11 @@ class shared_token_bucket {
         _rovers.release(tokens);
     }
 
+    // Puts back tokens that were grabbed, but turned out not to be needed
+    void refund(T tokens) noexcept {
+        fetch_add(_rovers.head, std::min(tokens, _rovers.max_extra(limit())));
+    }
+
     void replenish(typename Clock::time_point now) noexcept {
         auto ts = _replenished.load(std::memory_order_relaxed);
 
@@ -176,7 +183,7 @@ class shared_token_bucket {
                 return; // next time or another shard
             }
 
-            fetch_add(_rovers.head, std::min(extra, _rovers.max_extra(_replenish_limit)));
+            fetch_add(_rovers.head, std::min(extra, _rovers.max_extra(limit())));
         }
     }
 
@@ -193,22 +200,28 @@ class shared_token_bucket {
     template <typename Rep, typename Per>
     T accumulated_in(const std::chrono::duration<Rep, Per> delta) const noexcept {
        auto delta_at_rate = std::min(rate_cast(delta), max_delta);
-       return accumulated(_replenish_rate, delta_at_rate);
+       return accumulated(rate(), delta_at_rate);
     }
 
     // Estimated time to process the given amount of tokens
     // (peer of accumulated_in helper)
     rate_resolution duration_for(T tokens) const noexcept {
-        return rate_resolution(double(tokens) / _replenish_rate);
+        return rate_resolution(double(tokens) / rate());
     }
 
-    T rate() const noexcept { return _replenish_rate; }
-    T limit() const noexcept { return _replenish_limit; }
+    T rate() const noexcept { return _replenish_rate.load(std::memory_order_relaxed); }
+    T limit() const noexcept { return _replenish_limit.load(std::memory_order_relaxed); }
     T threshold() const noexcept { return _replenish_threshold; }
     typename Clock::time_point replenished_ts() const noexcept { return _replenished; }
 
     void update_rate(T rate) noexcept {
-        _replenish_rate = std::min(rate, max_rate);
+        _replenish_rate.store(std::min(rate, max_rate), std::memory_order_relaxed);
+    }
+
+    // Capped buckets size their ceiling rover after the limit, so only
+    // uncapped ones can change it on the fly
+    void update_limit(T limit) noexcept requires (Capped == capped_release::no) {
+        _replenish_limit.store(std::max(limit, _replenish_threshold), std::memory_order_relaxed);
     }
 };
 
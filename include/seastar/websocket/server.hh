@@ -23,13 +23,18 @@
 
 #include <map>
 #include <functional>
+#include <memory>
+#include <optional>
 
 #include <seastar/http/request_parser.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/net/api.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/condition-variable.hh>
 #include <seastar/core/gate.hh>
 #include <seastar/core/queue.hh>
+#include <seastar/core/semaphore.hh>
 #include <seastar/core/when_all.hh>
 
 namespace seastar::experimental::websocket {
@@ -37,6 +42,7 @@ namespace seastar::experimental::websocket {
 using handler_t = std::function<future<>(input_stream<char>&, output_stream<char>&)>;
 
 class server;
+class permessage_deflate;
 
 /// \defgroup websocket WebSocket
 /// \addtogroup websocket
@@ -67,6 +73,24 @@ enum opcodes {
     INVALID = 0xFF,
 };
 
+/*!
+ * \brief permessage-deflate (RFC 7692) settings, see \ref server::set_deflate()
+ *
+ * The extension is negotiated per connection, with the clients that offer
+ * it. A context takeover is disabled when either side asks for it.
+ */
+struct deflate_config {
+    /// Reset the compressor after every message sent. Costs compression
+    /// ratio, saves the memory of the window between messages.
+    bool server_no_context_takeover = false;
+    /// Ask clients to reset their compressor after every message
+    bool client_no_context_takeover = false;
+    /// Compression level, 0 selects zlib's default
+    int level = 0;
+    /// Shorter messages are sent uncompressed
+    size_t min_size = 64;
+};
+
 struct frame_header {
     static constexpr uint8_t FIN = 7;
     static constexpr uint8_t RSV1 = 6;
@@ -137,6 +161,12 @@ class websocket_parser {
     uint64_t _payload_length;
     uint32_t _masking_key;
     buff_t _result;
+    // Whether the payload of the last frame was consumed entirely
+    bool _frame_done = false;
+    // Whether RSV1 may mark compressed messages
+    bool _compression = false;
+    // Whether the data message being received is compressed
+    bool _compressed = false;
 
     static future<consumption_result_t> dont_stop() {
         return make_ready_future<consumption_result_t>(continue_consuming{});
@@ -162,6 +192,15 @@ class websocket_parser {
     bool eof() { return _cstate == connection_state::closed; }
     opcodes opcode() const;
     buff_t result();
+    /// Accept RSV1 on the first frame of data messages, once permessage-deflate
+    /// was negotiated
+    void enable_compression() noexcept { _compression = true; }
+    /// Whether the result() is the end of the frame's payload
+    bool frame_done() const noexcept { return _frame_done; }
+    /// Whether the frame is the last one of its message
+    bool fin() const noexcept { return _header && _header->fin; }
+    /// Whether the data message the result() belongs to is compressed
+    bool compressed() const noexcept { return _compressed; }
 };
 
 /*!
@@ -245,6 +284,19 @@ class connection : public boost::intrusive::list_base_hook<> {
 
     sstring _subprotocol;
     handler_t _handler;
+    // Deletes the permessage_deflate defined by the implementation
+    struct deflate_deleter {
+        void operator()(permessage_deflate* d) const noexcept;
+    };
+    std::unique_ptr<permessage_deflate, deflate_deleter> _deflate;
+
+    // Frames broadcast by the server, see server::broadcast()
+    circular_buffer<temporary_buffer<char>> _broadcasts;
+    condition_variable _broadcast_cv;
+    // Closed for not keeping up with the broadcasts
+    bool _evicted = false;
+    // Keeps frames of the handler and broadcasts from interleaving
+    semaphore _send_sem{1};
 public:
     /*!
      * \param server owning \ref server
@@ -279,13 +331,27 @@ class connection : public boost::intrusive::list_base_hook<> {
 protected:
     future<> read_loop();
     future<> read_one();
+    future<> read_data();
     future<> read_http_upgrade_request();
     future<> response_loop();
+    future<> broadcast_loop();
     void on_new_connection();
     /*!
      * \brief Packs buff in websocket frame and sends it to the client.
      */
     future<> send_data(opcodes opcode, temporary_buffer<char>&& buff);
+    /*!
+     * \brief Sends a frame encoded by the server.
+     */
+    future<> send_frame(temporary_buffer<char> frame);
+    /*!
+     * \brief Queues a broadcast frame, unless too many are queued already.
+     */
+    bool enqueue_broadcast(temporary_buffer<char> frame, size_t max_pending);
+    // Whether messages compressed without a context can be sent as they are
+    bool accepts_shared_compression() const noexcept;
+
+    friend class server;
 
 };
 
@@ -299,6 +365,9 @@ class server {
     std::vector<server_socket> _listeners;
     boost::intrusive::list<connection> _connections;
     std::map<std::string, handler_t> _handlers;
+    std::optional<deflate_config> _deflate_config;
+    size_t _max_pending_broadcasts = 1024;
+    size_t _evicted_connections = 0;
     gate _task_gate;
 public:
     /*!
@@ -322,6 +391,43 @@ class server {
 
     void register_handler(std::string&& name, handler_t handler);
 
+    /*!
+     * \brief Enables permessage-deflate for the connections established
+     * later on, or disables it with \c std::nullopt.
+     *
+     * Compressed messages are inflated as their frames arrive, so a
+     * handler reads large messages without them being assembled first.
+     */
+    void set_deflate(std::optional<deflate_config> cfg);
+
+    /*!
+     * \brief Sends a message to all the connections of a subprotocol.
+     *
+     * The message is framed once, and compressed once for the connections
+     * which negotiated permessage-deflate without server context takeover;
+     * all the connections share the frame. Connections which already have
+     * \ref set_max_pending_broadcasts() messages queued are too slow to
+     * keep up, and are closed.
+     *
+     * Only the connections of the calling shard are reached.
+     *
+     * \returns the number of connections the message was queued to
+     */
+    size_t broadcast(std::string_view subprotocol, temporary_buffer<char> message, opcodes opcode = opcodes::BINARY);
+
+    /*!
+     * \brief Sets how many broadcast messages a connection may have queued
+     * before it's deemed too slow and closed. Defaults to 1024.
+     */
+    void set_max_pending_broadcasts(size_t n) noexcept;
+
+    /*!
+     * \brief Number of connections closed for not keeping up with broadcasts
+     */
+    size_t evicted_connections() const noexcept {
+        return _evicted_connections;
+    }
+
     friend class connection;
 protected:
     void accept(server_socket &listener);
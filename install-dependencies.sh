@@ -39,6 +39,8 @@ debian_packages=(
     xfslibs-dev
     libgnutls28-dev
     liblz4-dev
+    zlib1g-dev
+    libzstd-dev
     libsctp-dev
     liburing-dev
     gcc
@@ -79,6 +81,8 @@ redhat_packages=(
     gnutls-devel
     lksctp-tools-devel
     lz4-devel
+    zlib-devel
+    libzstd-devel
     liburing-devel
     gcc
     make
@@ -171,6 +175,8 @@ arch_packages=(
     gnutls
     lksctp-tools
     lz4
+    zlib
+    zstd
     make
     meson
     python-pyelftools
@@ -213,6 +219,8 @@ opensuse_packages=(
     libgnutls-devel
     libgnutlsxx28
     liblz4-devel
+    zlib-devel
+    libzstd-devel
     libnuma-devel
     lksctp-tools-devel
     meson
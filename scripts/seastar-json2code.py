@@ -177,26 +177,101 @@ class Parameter:
     def name(self):
         return self.definition['name']
 
+    @property
+    def location(self):
+        # both swagger 1.2 'paramType' and swagger 2.0 'in' attributes are
+        # supported
+        return self.definition.get("paramType", self.definition.get("in"))
+
     @property
     def is_required(self):
         # check if a parameter is query required.
         # It will return true if the required flag is set
-        # and if it is a query parameter, both swagger 1.2 'paramType' and
-        # swagger 2.0 'in' attributes are supported
+        # and if it is a query parameter
         if "required" not in self.definition:
             return False
         if not self.definition["required"]:
             return False
-        if self.definition.get("paramType") == "query":
-            return True
-        if self.definition.get("in") == "query":
-            return True
-        return False
+        return self.location == "query"
 
     @property
     def enum(self):
         return self.definition.get('enum')
 
+    @property
+    def type(self):
+        return self.definition.get('type')
+
+    @property
+    def description(self):
+        return self.definition.get('description')
+
+
+# the C++ types the typed accessors parse parameters as, other
+# types are returned as strings
+param_types = {'int': 'int', 'long': 'long', 'float': 'float',
+               'double': 'double', 'boolean': 'bool'}
+
+
+def generate_param_accessor(param):
+    '''
+    Returns the member of the params struct of an operation that returns
+    the given path or query parameter as its declared type
+    '''
+    name = param.name
+    in_path = param.location == "path"
+    if in_path:
+        # path parameters may have to be decoded
+        getter = f'typed_params::path_param<sstring>(req, "{name}")'
+    else:
+        getter = f'typed_params::query_param<std::string_view>(req, "{name}")'
+    if param.enum is not None:
+        value_type = name
+        convert = f'str2{name}'
+    else:
+        value_type = param_types.get(param.type)
+        convert = None
+        if value_type is not None:
+            getter = getter.replace('<sstring>', f'<{value_type}>')
+            getter = getter.replace('<std::string_view>', f'<{value_type}>')
+        else:
+            value_type = 'sstring' if in_path else 'std::string_view'
+    required = in_path or param.is_required
+    if required:
+        value = f'typed_params::required({getter}, "{name}")'
+        if convert:
+            value = f'{convert}({value})'
+        return_type = value_type
+        body = f'return {value};'
+    else:
+        return_type = f'std::optional<{value_type}>'
+        if convert:
+            body = f'auto v = {getter};\n        return v ? {return_type}({convert}(*v)) : std::nullopt;'
+        else:
+            body = f'return {getter};'
+    ident = re.sub(r'\W', '_', name)
+    comment = f'/// {param.description}\n    ' if param.description else ''
+    return Template('''\
+    $comment$return_type get_$ident() const {
+        $body
+    }
+''').substitute(comment=comment, return_type=return_type, ident=ident, body=body)
+
+
+def generate_params_struct(nickname, params):
+    accessors = ''.join(generate_param_accessor(param) for param in params)
+    return Template('''\
+namespace ns_$nickname {
+/**
+ * The path and query parameters of $nickname, as their declared types
+ */
+struct params {
+    const http::request& req;
+
+$accessors};
+}
+''').substitute(nickname=nickname, accessors=accessors)
+
 
 def add_path(f, path, details):
     if "summary" in details:
@@ -264,7 +339,7 @@ def generate_code_from_enum(nickname, type_name, enums):
         enum class $type_name {
             $enum_list
         };
-        $type_name str2$type_name(const sstring& str);
+        $type_name str2$type_name(std::string_view str);
    }
    ''').substitute(nickname=nickname,
                    type_name=type_name,
@@ -272,8 +347,8 @@ def generate_code_from_enum(nickname, type_name, enums):
 
     name_list = ',\n'.join(f'"{enum}"' for enum in enums)
     parse_func = Template('''\
-    $type_name str2$type_name(const sstring& str) {
-        static const sstring arr[] = {
+    $type_name str2$type_name(std::string_view str) {
+        static constexpr std::string_view arr[] = {
             $name_list
         };
         int i;
@@ -343,6 +418,7 @@ $enum_wrapper
 ''').substitute(nickname=nickname, enum_wrapper=enum_wrapper.rstrip())
     funcs = ""
     required_query_params = []
+    url_params = []
     for param in oper.get("parameters", []):
         query_param = Parameter(param)
         if query_param.is_required:
@@ -353,6 +429,10 @@ $enum_wrapper
                                                             query_param.enum)
             enum_definitions += enum_decl
             funcs += parse_func
+        if query_param.location in ("path", "query"):
+            url_params.append(query_param)
+    if url_params:
+        enum_definitions += generate_params_struct(nickname, url_params)
     fprint(ccfile, '\n,'.join(f'"{param.name}"' for param in required_query_params))
     fprintln(ccfile, '});')
     fprintln(hfile, enum_definitions)
@@ -535,9 +615,10 @@ def create_h_file(data, hfile_name, api_name, init_method, base_api):
     print_h_file_headers(hfile, api_name)
     add_include(hfile, ['<seastar/core/sstring.hh>',
                         '<seastar/json/json_elements.hh>',
-                        '<seastar/http/json_path.hh>'])
+                        '<seastar/http/json_path.hh>',
+                        '<seastar/http/typed_params.hh>'])
 
-    add_include(hfile, ['<iostream>', '<boost/range/irange.hpp>'])
+    add_include(hfile, ['<iostream>', '<optional>', '<string_view>', '<boost/range/irange.hpp>'])
     open_namespace(hfile, "seastar")
     open_namespace(hfile, "httpd")
     open_namespace(hfile, api_name)
@@ -28,6 +28,7 @@ module;
 #include <atomic>
 #include <iterator>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #ifdef SEASTAR_MODULE
@@ -61,10 +62,12 @@ message_queue::lf_queue::maybe_wakeup() {
 }
 
 void message_queue::submit_item(std::unique_ptr<message_queue::work_item> item) {
-    if (!_pending.push(item.get())) {
-        throw std::bad_alloc();
+    auto wi = item.release();
+    while (!_pending.try_push(std::move(wi))) {
+        // The shard is behind, make sure it's awake and let it drain the ring
+        _pending.maybe_wakeup();
+        std::this_thread::yield();
     }
-    item.release();
     _pending.maybe_wakeup();
     ++_sent.value;
 }
@@ -78,7 +81,7 @@ size_t message_queue::process_queue(lf_queue& q, Func process) {
     // copy batch to local memory in order to minimize
     // time in which cross-cpu data is accessed
     work_item* wi;
-    if (!q.pop(wi)) {
+    if (!q.try_pop(wi)) {
         return 0;
     }
     work_item* items[batch_size + prefetch_cnt];
@@ -86,7 +89,7 @@ size_t message_queue::process_queue(lf_queue& q, Func process) {
     // access with potential cache miss the second pop may cause
     prefetch<2>(wi);
     size_t nr = 0;
-    while (nr < batch_size && q.pop(items[nr])) {
+    while (nr < batch_size && q.try_pop(items[nr])) {
         ++nr;
     }
     std::fill(std::begin(items) + nr, std::begin(items) + nr + prefetch_cnt, nr ? items[nr - 1] : wi);
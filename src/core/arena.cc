@@ -0,0 +1,89 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <cstdlib>
+#include <new>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/arena.hh>
+#endif
+
+namespace seastar {
+
+namespace memory {
+
+void* arena::allocate_slow(size_t bytes, size_t alignment) {
+    auto needed = bytes + alignment - 1;
+    if (needed > _block_size / 4) {
+        // Give large objects a block of their own rather than waste the
+        // rest of the current one
+        return align_up(add_block(needed), alignment);
+    }
+    auto start = add_block(_block_size - sizeof(block));
+    _pos = start;
+    _end = start + _block_size - sizeof(block);
+    return do_allocate(bytes, alignment);
+}
+
+char* arena::add_block(size_t size) {
+    auto b = static_cast<block*>(std::malloc(sizeof(block) + size));
+    if (!b) {
+        throw std::bad_alloc();
+    }
+    if (!_first) {
+        b->next = nullptr;
+        try {
+            _blocks_deleter = make_deleter([first = b] {
+                for (auto b = first; b;) {
+                    auto next = b->next;
+                    std::free(b);
+                    b = next;
+                }
+            });
+        } catch (...) {
+            std::free(b);
+            throw;
+        }
+        _first = b;
+    } else {
+        b->next = _first->next;
+        _first->next = b;
+    }
+    _memory += sizeof(block) + size;
+    return reinterpret_cast<char*>(b + 1);
+}
+
+void arena::reset() noexcept {
+    _blocks_deleter = deleter();
+    _first = nullptr;
+    _pos = _end = _last_allocation = nullptr;
+    _memory = 0;
+}
+
+}
+
+}
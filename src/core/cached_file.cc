@@ -0,0 +1,436 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <coroutine>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <sys/uio.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/cached_file.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/util/noncopyable_function.hh>
+#endif
+
+namespace seastar {
+
+page_cache::page_cache(config cfg)
+        : _config(std::move(cfg))
+        , _reclaimer([this] (memory::reclaimer::request r) {
+            auto evictions = _stats.evictions;
+            evict(r.bytes_to_reclaim);
+            _stats.reclaims += _stats.evictions - evictions;
+            return _stats.evictions != evictions ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+        }, memory::reclaimer_scope::async)
+{
+    namespace sm = seastar::metrics;
+    auto name_l = sm::label("name")(_config.name);
+    _metrics.add_group("page_cache", {
+        sm::make_counter("hits", _stats.hits, sm::description("Number of page reads served from the cache"), {name_l}),
+        sm::make_counter("misses", _stats.misses, sm::description("Number of page reads that went to the file"), {name_l}),
+        sm::make_counter("evictions", _stats.evictions, sm::description("Number of pages evicted to make room or free memory"), {name_l}),
+        sm::make_counter("reclaims", _stats.reclaims, sm::description("Number of pages evicted because the shard was low on memory"), {name_l}),
+        sm::make_gauge("bytes", [this] { return _memory; }, sm::description("Number of bytes of cached data"), {name_l}),
+    });
+}
+
+page_cache::~page_cache() {
+    clear();
+}
+
+void page_cache::clear() noexcept {
+    _lru.clear();
+    _pages.clear();
+    _memory = 0;
+}
+
+temporary_buffer<char>* page_cache::find(uint64_t file_id, uint64_t index) noexcept {
+    auto it = _pages.find(page_key{file_id, index});
+    if (it == _pages.end()) {
+        _stats.misses++;
+        return nullptr;
+    }
+    _stats.hits++;
+    auto& p = it->second;
+    _lru.erase(_lru.iterator_to(p));
+    _lru.push_front(p);
+    return &p.data;
+}
+
+void page_cache::insert(uint64_t file_id, uint64_t index, temporary_buffer<char> data) {
+    auto size = data.size();
+    page_key key{file_id, index};
+    auto [it, inserted] = _pages.try_emplace(key, key, std::move(data));
+    if (!inserted) {
+        return;
+    }
+    _lru.push_front(it->second);
+    _memory += size;
+    if (_memory > _config.capacity) {
+        evict(_memory - _config.capacity);
+    }
+}
+
+void page_cache::erase(page_map::iterator it) noexcept {
+    _lru.erase(_lru.iterator_to(it->second));
+    _memory -= it->second.data.size();
+    _pages.erase(it);
+}
+
+void page_cache::invalidate(uint64_t file_id, uint64_t from, uint64_t to) noexcept {
+    if (to - from <= _pages.size()) {
+        for (auto i = from; i < to; i++) {
+            auto it = _pages.find(page_key{file_id, i});
+            if (it != _pages.end()) {
+                erase(it);
+            }
+        }
+        return;
+    }
+
+    for (auto it = _pages.begin(); it != _pages.end(); ) {
+        auto next = std::next(it);
+        if (it->first.file_id == file_id && it->first.index >= from && it->first.index < to) {
+            erase(it);
+        }
+        it = next;
+    }
+}
+
+size_t page_cache::evict(size_t bytes) noexcept {
+    size_t freed = 0;
+    while (freed < bytes && !_lru.empty()) {
+        auto& p = _lru.back();
+        freed += p.data.size();
+        _stats.evictions++;
+        erase(_pages.find(p.key));
+    }
+    return freed;
+}
+
+class cached_file_impl final : public layered_file_impl {
+    page_cache& _cache;
+    const uint64_t _id;
+    const size_t _page_size;
+    // Bumped around every modification, reads that raced with one don't
+    // populate the cache
+    uint64_t _generation = 0;
+    // The last page of the file, if it was cached while shorter than a page.
+    // It goes stale when the file is extended past it, without the
+    // extending write touching it.
+    std::optional<uint64_t> _eof_page;
+
+    using read_fn = noncopyable_function<future<size_t> (uint64_t pos, std::vector<iovec> iov)>;
+    using pages = std::vector<temporary_buffer<char>>;
+
+    uint64_t page_of(uint64_t pos) const noexcept {
+        return pos / _page_size;
+    }
+
+    void invalidate(uint64_t pos, uint64_t len) noexcept {
+        _generation++;
+        if (len == 0) {
+            return;
+        }
+        auto last = len > std::numeric_limits<uint64_t>::max() - pos ? std::numeric_limits<uint64_t>::max() : pos + len - 1;
+        _cache.invalidate(_id, page_of(pos), page_of(last) + 1);
+        if (_eof_page && *_eof_page <= page_of(last)) {
+            // Either in the range or before it, where a write would extend
+            // the file past it
+            _cache.invalidate(_id, *_eof_page, *_eof_page + 1);
+            _eof_page = std::nullopt;
+        }
+    }
+
+    // Returns the pages first..last, cut short past the end of file
+    future<pages> get_pages(uint64_t first, uint64_t last, read_fn read) {
+        pages ret(last - first + 1);
+        for (auto i = first; i <= last; i++) {
+            if (auto p = _cache.find(_id, i)) {
+                ret[i - first] = p->share();
+            }
+        }
+
+        auto generation = _generation;
+        // Read each run of missing pages with a single vectored read
+        for (size_t i = 0; i < ret.size(); ) {
+            if (ret[i]) {
+                i++;
+                continue;
+            }
+            auto end = i;
+            std::vector<iovec> iov;
+            pages bufs;
+            while (end < ret.size() && !ret[end]) {
+                bufs.push_back(temporary_buffer<char>::aligned(_memory_dma_alignment, _page_size));
+                iov.push_back(iovec{bufs.back().get_write(), _page_size});
+                end++;
+            }
+            auto size = co_await read((first + i) * _page_size, std::move(iov));
+            for (auto j = i; j < end; j++) {
+                auto n = std::min(size, _page_size);
+                size -= n;
+                if (n == 0) {
+                    ret.resize(j);
+                    co_return ret;
+                }
+                auto& b = bufs[j - i];
+                b.trim(n);
+                if (generation == _generation) {
+                    _cache.insert(_id, first + j, b.share());
+                    if (n < _page_size) {
+                        _eof_page = first + j;
+                    }
+                }
+                ret[j] = std::move(b);
+                if (n < _page_size) {
+                    ret.resize(j + 1);
+                    co_return ret;
+                }
+            }
+            i = end;
+        }
+        co_return ret;
+    }
+
+    // Hands [pos, pos + len) out of the pages starting at page_of(pos) to
+    // copy(), up to the end of file, returns the number of bytes handed out
+    template <typename Func>
+    size_t copy_out(const pages& ps, uint64_t pos, size_t len, Func&& copy) const {
+        size_t done = 0;
+        size_t off = pos % _page_size;
+        for (auto& p : ps) {
+            if (done == len || off >= p.size()) {
+                break;
+            }
+            auto n = std::min(p.size() - off, len - done);
+            copy(p.get() + off, n);
+            done += n;
+            if (p.size() < _page_size) {
+                break;
+            }
+            off = 0;
+        }
+        return done;
+    }
+
+    future<size_t> do_read_dma(uint64_t pos, void* buffer, size_t len, read_fn read) {
+        if (len == 0) {
+            co_return 0;
+        }
+        auto ps = co_await get_pages(page_of(pos), page_of(pos + len - 1), std::move(read));
+        auto dst = static_cast<char*>(buffer);
+        co_return copy_out(ps, pos, len, [&dst] (const char* src, size_t n) {
+            dst = std::copy_n(src, n, dst);
+        });
+    }
+
+    future<size_t> do_read_dma(uint64_t pos, std::vector<iovec> iov, read_fn read) {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        if (len == 0) {
+            co_return 0;
+        }
+        auto ps = co_await get_pages(page_of(pos), page_of(pos + len - 1), std::move(read));
+        size_t idx = 0;
+        size_t off = 0;
+        co_return copy_out(ps, pos, len, [&] (const char* src, size_t n) {
+            while (n) {
+                auto& v = iov[idx];
+                auto m = std::min(n, v.iov_len - off);
+                std::memcpy(static_cast<char*>(v.iov_base) + off, src, m);
+                src += m;
+                n -= m;
+                off += m;
+                if (off == v.iov_len) {
+                    idx++;
+                    off = 0;
+                }
+            }
+        });
+    }
+
+    future<temporary_buffer<uint8_t>> do_dma_read_bulk(uint64_t offset, size_t range_size, read_fn read) {
+        if (range_size == 0) {
+            co_return temporary_buffer<uint8_t>();
+        }
+        auto ps = co_await get_pages(page_of(offset), page_of(offset + range_size - 1), std::move(read));
+        auto off = offset % _page_size;
+        if (!ps.empty() && off + range_size <= ps.front().size()) {
+            // Within a single page, no need to copy
+            auto b = ps.front().share(off, range_size);
+            co_return temporary_buffer<uint8_t>(reinterpret_cast<uint8_t*>(b.get_write()), b.size(), b.release());
+        }
+        auto buf = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, range_size);
+        auto dst = buf.get_write();
+        auto n = copy_out(ps, offset, range_size, [&dst] (const char* src, size_t n) {
+            dst = std::copy_n(reinterpret_cast<const uint8_t*>(src), n, dst);
+        });
+        buf.trim(n);
+        co_return buf;
+    }
+
+    future<size_t> do_write(uint64_t pos, size_t len, noncopyable_function<future<size_t> ()> write) {
+        invalidate(pos, len);
+        auto ret = co_await write();
+        // Reads that started during the write may have seen the old data
+        invalidate(pos, len);
+        co_return ret;
+    }
+
+    read_fn reader(io_intent* intent) {
+        return [this, intent] (uint64_t pos, std::vector<iovec> iov) {
+            return _underlying_file.dma_read(pos, std::move(iov), intent);
+        };
+    }
+
+#if SEASTAR_API_LEVEL < 7
+    read_fn reader(const io_priority_class& pc, io_intent* intent) {
+        return [this, &pc, intent] (uint64_t pos, std::vector<iovec> iov) {
+            return _underlying_file.dma_read(pos, std::move(iov), pc, intent);
+        };
+    }
+#endif
+
+public:
+    cached_file_impl(file f, page_cache& cache)
+            : layered_file_impl(std::move(f))
+            , _cache(cache)
+            , _id(cache.register_file())
+            , _page_size(align_up<size_t>(std::max<size_t>(cache._config.page_size, 1), _disk_read_dma_alignment))
+    {
+    }
+
+#if SEASTAR_API_LEVEL >= 7
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) override {
+        return do_write(pos, len, [this, pos, buffer, len, intent] {
+            return _underlying_file.dma_write(pos, static_cast<const char*>(buffer), len, intent);
+        });
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return do_write(pos, len, [this, pos, iov = std::move(iov), intent] () mutable {
+            return _underlying_file.dma_write(pos, std::move(iov), intent);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) override {
+        return do_read_dma(pos, buffer, len, reader(intent));
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        return do_read_dma(pos, std::move(iov), reader(intent));
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) override {
+        return do_dma_read_bulk(offset, range_size, reader(intent));
+    }
+#else
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
+        return write_dma(pos, buffer, len, pc, nullptr);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return write_dma(pos, std::move(iov), pc, nullptr);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return read_dma(pos, buffer, len, pc, nullptr);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return read_dma(pos, std::move(iov), pc, nullptr);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return dma_read_bulk(offset, range_size, pc, nullptr);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) override {
+        return do_write(pos, len, [this, pos, buffer, len, &pc, intent] {
+            return _underlying_file.dma_write(pos, static_cast<const char*>(buffer), len, pc, intent);
+        });
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return do_write(pos, len, [this, pos, iov = std::move(iov), &pc, intent] () mutable {
+            return _underlying_file.dma_write(pos, std::move(iov), pc, intent);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) override {
+        return do_read_dma(pos, buffer, len, reader(pc, intent));
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) override {
+        return do_read_dma(pos, std::move(iov), reader(pc, intent));
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent* intent) override {
+        return do_dma_read_bulk(offset, range_size, reader(pc, intent));
+    }
+#endif
+
+    virtual future<> flush() override {
+        return _underlying_file.flush();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat();
+    }
+    virtual future<> truncate(uint64_t length) override {
+        invalidate(length, std::numeric_limits<uint64_t>::max());
+        co_await _underlying_file.truncate(length);
+        invalidate(length, std::numeric_limits<uint64_t>::max());
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        invalidate(offset, length);
+        co_await _underlying_file.discard(offset, length);
+        invalidate(offset, length);
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        return _underlying_file.allocate(position, length);
+    }
+    virtual future<uint64_t> size() override {
+        return _underlying_file.size();
+    }
+    virtual future<> close() override {
+        invalidate(0, std::numeric_limits<uint64_t>::max());
+        return _underlying_file.close();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+};
+
+file make_cached_file(file f, page_cache& cache) {
+    return file(make_shared<cached_file_impl>(std::move(f), cache));
+}
+
+}
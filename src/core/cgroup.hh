@@ -34,12 +34,24 @@ using cpuset = std::set<unsigned>;
 
 optional<cpuset> cpu_set();
 size_t memory_limit();
+// CPUs worth of time the CFS bandwidth controller allows, if limited.
+// No controller means no quota.
+optional<double> cpu_quota();
+// The quota of cgroups v2's cpu.max, "<quota> <period>" with a quota of
+// "max" when unlimited
+optional<double> parse_cpu_max(const std::string& cpu_max);
+// The quota of cgroups v1, split in the cpu.cfs_quota_us and
+// cpu.cfs_period_us files of the controller's directory, with a quota of
+// -1 when unlimited
+optional<double> cpu_quota_v1(const std::string& dir);
 
 template <typename T>
 optional<T> read_setting_as(std::string path);
 
+// With missing_ok, a setting whose file doesn't exist is quietly reported
+// as unset, as controllers that aren't enabled have no files
 template <typename T>
-optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname);
+optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname, bool missing_ok = false);
 }
 
 }
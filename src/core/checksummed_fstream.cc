@@ -0,0 +1,411 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <lz4.h>
+#ifdef SEASTAR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <fmt/core.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/checksummed_fstream.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/util/crc32c.hh>
+#endif
+
+namespace seastar {
+
+namespace {
+
+// Block layout, little endian:
+//   u32 stored size, u32 uncompressed size, u8 type, u8[3] zero,
+//   u32 CRC32C of the above, u32 CRC32C of the stored bytes, stored bytes
+//
+// The index is a block of its own, holding (uncompressed offset, file
+// offset) pairs of u64, followed by the footer:
+//   u64 file offset of the index block, u32 magic, u32 CRC32C of the above
+constexpr size_t header_size = 20;
+constexpr size_t footer_size = 16;
+constexpr uint32_t footer_magic = 0x534b4353; // "SCKS"
+
+enum class block_type : uint8_t {
+    raw = 0,
+    lz4 = 1,
+    zstd = 2,
+    index = 0x80,
+};
+
+void encode_header(char* p, size_t stored_size, size_t raw_size, block_type type, const char* data) noexcept {
+    write_le<uint32_t>(p, stored_size);
+    write_le<uint32_t>(p + 4, raw_size);
+    write_le<uint32_t>(p + 8, uint8_t(type));
+    write_le<uint32_t>(p + 12, crc32c(0, p, 12));
+    write_le<uint32_t>(p + 16, crc32c(0, data, stored_size));
+}
+
+block_type to_block_type(block_compression c) noexcept {
+    switch (c) {
+    case block_compression::none: return block_type::raw;
+    case block_compression::lz4: return block_type::lz4;
+    case block_compression::zstd: return block_type::zstd;
+    }
+    return block_type::raw;
+}
+
+size_t max_compressed_size(block_compression c, size_t size) noexcept {
+    switch (c) {
+    case block_compression::none:
+        return size;
+    case block_compression::lz4:
+        return LZ4_compressBound(size);
+    case block_compression::zstd:
+#ifdef SEASTAR_HAVE_ZSTD
+        return ZSTD_compressBound(size);
+#else
+        break;
+#endif
+    }
+    return size;
+}
+
+// Returns the compressed size, or 0 if the block doesn't shrink
+size_t compress(block_compression c, int level, const char* src, size_t size, char* dst, size_t capacity) {
+    size_t ret = 0;
+    switch (c) {
+    case block_compression::none:
+        break;
+    case block_compression::lz4:
+        ret = LZ4_compress_fast(src, dst, size, capacity, std::max(level, 1));
+        break;
+    case block_compression::zstd:
+#ifdef SEASTAR_HAVE_ZSTD
+        ret = ZSTD_compress(dst, capacity, src, size, level);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error(fmt::format("ZSTD_compress failed: {}", ZSTD_getErrorName(ret)));
+        }
+#endif
+        break;
+    }
+    return ret < size ? ret : 0;
+}
+
+checksum_mismatch_error bad_block(uint64_t file_offset, std::string_view what) {
+    return checksum_mismatch_error(file_offset, fmt::format("Bad block at file offset {}: {}", file_offset, what));
+}
+
+struct block {
+    block_type type;
+    size_t raw_size;
+    temporary_buffer<char> data;
+};
+
+// Checks the header and the stored bytes, which follow it in data
+block verify_block(const char* header, temporary_buffer<char> data, uint64_t file_offset) {
+    if (crc32c(0, header, 12) != read_le<uint32_t>(header + 12)) {
+        throw bad_block(file_offset, "header checksum mismatch");
+    }
+    if (data.size() != read_le<uint32_t>(header)) {
+        throw bad_block(file_offset, "truncated");
+    }
+    if (crc32c(0, data.get(), data.size()) != read_le<uint32_t>(header + 16)) {
+        throw bad_block(file_offset, "checksum mismatch");
+    }
+    return block{block_type(read_le<uint32_t>(header + 8)), read_le<uint32_t>(header + 4), std::move(data)};
+}
+
+temporary_buffer<char> decompress(block b, uint64_t file_offset) {
+    if (b.type == block_type::raw) {
+        if (b.data.size() != b.raw_size) {
+            throw bad_block(file_offset, "size mismatch");
+        }
+        return std::move(b.data);
+    }
+    temporary_buffer<char> ret(b.raw_size);
+    bool ok = false;
+    switch (b.type) {
+    case block_type::lz4:
+        ok = LZ4_decompress_safe(b.data.get(), ret.get_write(), b.data.size(), ret.size()) == int(ret.size());
+        break;
+    case block_type::zstd:
+#ifdef SEASTAR_HAVE_ZSTD
+        ok = ZSTD_decompress(ret.get_write(), ret.size(), b.data.get(), b.data.size()) == ret.size();
+        break;
+#else
+        throw bad_block(file_offset, "zstd compression is not supported");
+#endif
+    default:
+        throw bad_block(file_offset, fmt::format("unknown block type {}", uint8_t(b.type)));
+    }
+    if (!ok) {
+        throw bad_block(file_offset, "decompression failed");
+    }
+    return ret;
+}
+
+class checksummed_data_sink_impl final : public data_sink_impl {
+    output_stream<char> _out;
+    checksummed_stream_options _options;
+    temporary_buffer<char> _block;
+    size_t _filled = 0;
+    uint64_t _raw_offset = 0;
+    uint64_t _file_offset = 0;
+    std::vector<char> _index;
+private:
+    future<> write_block(const char* data, size_t size, block_type type) {
+        temporary_buffer<char> compressed;
+        if (type == block_type::raw && _options.compression != block_compression::none) {
+            compressed = temporary_buffer<char>(max_compressed_size(_options.compression, size));
+            auto n = compress(_options.compression, _options.compression_level, data, size, compressed.get_write(), compressed.size());
+            if (n) {
+                compressed.trim(n);
+                data = compressed.get();
+                type = to_block_type(_options.compression);
+            }
+        }
+        auto stored_size = data == compressed.get() ? compressed.size() : size;
+        char header[header_size];
+        encode_header(header, stored_size, size, type, data);
+        if (type != block_type::index) {
+            _index.resize(_index.size() + 16);
+            write_le<uint64_t>(_index.data() + _index.size() - 16, _raw_offset);
+            write_le<uint64_t>(_index.data() + _index.size() - 8, _file_offset);
+            _raw_offset += size;
+        }
+        _file_offset += header_size + stored_size;
+        co_await _out.write(header, header_size);
+        co_await _out.write(data, stored_size);
+    }
+    future<> finish() {
+        if (_filled) {
+            co_await write_block(_block.get(), _filled, block_type::raw);
+            _filled = 0;
+        }
+        if (_options.index) {
+            auto index_offset = _file_offset;
+            co_await write_block(_index.data(), _index.size(), block_type::index);
+            char footer[footer_size];
+            write_le<uint64_t>(footer, index_offset);
+            write_le<uint32_t>(footer + 8, footer_magic);
+            write_le<uint32_t>(footer + 12, crc32c(0, footer, 12));
+            co_await _out.write(footer, footer_size);
+        }
+    }
+public:
+    checksummed_data_sink_impl(output_stream<char>&& out, checksummed_stream_options options)
+        : _out(std::move(out)), _options(options), _block(options.block_size)
+    {}
+    virtual future<> put(net::packet p) override {
+        auto block_size = _options.block_size;
+        for (auto& f : p.fragments()) {
+            const char* data = f.base;
+            size_t size = f.size;
+            while (size) {
+                // Full blocks are compressed and checksummed in place
+                if (!_filled && size >= block_size) {
+                    co_await write_block(data, block_size, block_type::raw);
+                    data += block_size;
+                    size -= block_size;
+                    continue;
+                }
+                auto n = std::min(size, block_size - _filled);
+                std::copy_n(data, n, _block.get_write() + _filled);
+                _filled += n;
+                data += n;
+                size -= n;
+                if (_filled == block_size) {
+                    co_await write_block(_block.get(), block_size, block_type::raw);
+                    _filled = 0;
+                }
+            }
+        }
+    }
+    virtual future<> close() override {
+        std::exception_ptr ex;
+        try {
+            co_await finish();
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await _out.close();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return _options.block_size;
+    }
+};
+
+class checksummed_data_source_impl final : public data_source_impl {
+    file _file;
+    uint64_t _offset;
+    file_input_stream_options _options;
+    input_stream<char> _in;
+    bool _started = false;
+    bool _eof = false;
+    uint64_t _file_offset = 0;
+    uint64_t _skip = 0;
+private:
+    // Looks up the block holding _offset in the index, if the file has one
+    future<> seek() {
+        auto size = co_await _file.size();
+        if (size < footer_size + header_size) {
+            co_return;
+        }
+        auto footer = co_await _file.dma_read<char>(size - footer_size, footer_size);
+        if (footer.size() != footer_size
+                || read_le<uint32_t>(footer.get() + 8) != footer_magic
+                || crc32c(0, footer.get(), 12) != read_le<uint32_t>(footer.get() + 12)) {
+            co_return;
+        }
+        auto index_offset = read_le<uint64_t>(footer.get());
+        if (index_offset > size - footer_size - header_size) {
+            throw bad_block(index_offset, "index out of the file");
+        }
+        auto buf = co_await _file.dma_read<char>(index_offset, size - footer_size - index_offset);
+        if (buf.size() < header_size) {
+            throw bad_block(index_offset, "truncated");
+        }
+        auto index = verify_block(buf.get(), buf.share(header_size, buf.size() - header_size), index_offset);
+        if (index.type != block_type::index || index.data.size() % 16) {
+            throw bad_block(index_offset, "not an index");
+        }
+        auto entries = index.data.size() / 16;
+        auto raw_offset_of = [&] (size_t i) {
+            return read_le<uint64_t>(index.data.get() + i * 16);
+        };
+        // The last block starting at or before _offset
+        size_t lo = 0, hi = entries;
+        while (lo < hi) {
+            auto mid = (lo + hi) / 2;
+            if (raw_offset_of(mid) <= _offset) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == 0) {
+            // No data blocks, go straight to the index
+            _file_offset = index_offset;
+            _skip = 0;
+            co_return;
+        }
+        _file_offset = read_le<uint64_t>(index.data.get() + (lo - 1) * 16 + 8);
+        _skip = _offset - raw_offset_of(lo - 1);
+    }
+    future<> start() {
+        _skip = _offset;
+        if (_offset) {
+            co_await seek();
+        }
+        _in = make_file_input_stream(_file, _file_offset, _options);
+        _started = true;
+    }
+public:
+    checksummed_data_source_impl(file f, uint64_t offset, file_input_stream_options options)
+        : _file(std::move(f)), _offset(offset), _options(options)
+    {}
+    virtual future<temporary_buffer<char>> get() override {
+        if (!_started) {
+            co_await start();
+        }
+        while (!_eof) {
+            auto header = co_await _in.read_exactly(header_size);
+            if (header.empty()) {
+                _eof = true;
+                break;
+            }
+            if (header.size() < header_size) {
+                throw bad_block(_file_offset, "truncated header");
+            }
+            if (crc32c(0, header.get(), 12) != read_le<uint32_t>(header.get() + 12)) {
+                throw bad_block(_file_offset, "header checksum mismatch");
+            }
+            auto stored = co_await _in.read_exactly(read_le<uint32_t>(header.get()));
+            auto block_offset = _file_offset;
+            _file_offset += header_size + stored.size();
+            auto b = verify_block(header.get(), std::move(stored), block_offset);
+            if (b.type == block_type::index) {
+                _eof = true;
+                break;
+            }
+            auto data = decompress(std::move(b), block_offset);
+            if (_skip) {
+                auto n = std::min<uint64_t>(_skip, data.size());
+                data.trim_front(n);
+                _skip -= n;
+            }
+            if (!data.empty()) {
+                co_return data;
+            }
+        }
+        co_return temporary_buffer<char>();
+    }
+    virtual future<> close() override {
+        if (!_started) {
+            return make_ready_future<>();
+        }
+        return _in.close();
+    }
+};
+
+}
+
+bool block_compression_supported(block_compression c) noexcept {
+#ifndef SEASTAR_HAVE_ZSTD
+    if (c == block_compression::zstd) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+future<output_stream<char>> make_checksummed_file_output_stream(file f, checksummed_stream_options options, file_output_stream_options file_options) noexcept {
+    if (!block_compression_supported(options.compression)) {
+        co_await f.close();
+        throw std::invalid_argument("Block compression is not supported by this build");
+    }
+    if (!options.block_size || options.block_size > std::numeric_limits<uint32_t>::max()) {
+        co_await f.close();
+        throw std::invalid_argument(fmt::format("Invalid checksummed stream block size: {}", options.block_size));
+    }
+    auto out = co_await make_file_output_stream(std::move(f), file_options);
+    co_return output_stream<char>(data_sink(std::make_unique<checksummed_data_sink_impl>(std::move(out), options)));
+}
+
+input_stream<char> make_checksummed_file_input_stream(file f, uint64_t offset, file_input_stream_options options) {
+    return input_stream<char>(data_source(std::make_unique<checksummed_data_source_impl>(std::move(f), offset, options)));
+}
+
+}
@@ -0,0 +1,50 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+#ifdef SEASTAR_MODULE
+module;
+#include <new>
+module seastar;
+#else
+#include <seastar/core/coroutine.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+thread_local coroutine_frame_pool local_coroutine_frame_pool;
+thread_local bool coroutine_direct_resume = false;
+thread_local unsigned coroutine_direct_resume_depth = 0;
+
+void coroutine_frame_pool::drain() noexcept {
+    for (size_t idx = 0; idx < nr_classes; ++idx) {
+        auto& fl = _classes[idx];
+        while (auto f = fl.head) {
+            fl.head = f->next;
+            ::operator delete(f, (idx + 1) * granularity);
+        }
+        fl.count = 0;
+    }
+}
+
+}
+
+}
@@ -0,0 +1,292 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/cpu_profiler.hh>
+#include <seastar/core/internal/cpu_profiler.hh>
+
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/util/log.hh>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace seastar {
+
+extern seastar::logger seastar_logger;
+
+namespace cpu_profiler {
+
+namespace {
+
+int signal_number() {
+    return SIGRTMIN + 2;
+}
+
+class profiler {
+    static constexpr size_t max_frames = simple_backtrace::vector_type::static_capacity;
+    // Samples are aggregated once a second, this is plenty at the default
+    // period of ~10ms
+    static constexpr size_t pending_capacity = 256;
+
+    struct pending_sample {
+        unsigned sg;
+        unsigned nr_frames;
+        std::array<frame, max_frames> frames;
+    };
+    struct stack_key {
+        unsigned sg;
+        simple_backtrace backtrace;
+        bool operator==(const stack_key&) const noexcept = default;
+    };
+    struct stack_key_hash {
+        size_t operator()(const stack_key& k) const noexcept {
+            return k.backtrace.hash() * 31 + k.sg;
+        }
+    };
+
+    std::chrono::nanoseconds _period;
+    std::optional<file_desc> _perf_event;
+    std::optional<timer_t> _posix_timer;
+    // The signal handler appends samples at _head, they are aggregated
+    // from _tail. Both run on the reactor thread, so signal fences order
+    // them.
+    std::unique_ptr<pending_sample[]> _pending;
+    std::atomic<size_t> _head = { 0 };
+    std::atomic<size_t> _tail = { 0 };
+    std::atomic<uint64_t> _dropped = { 0 };
+    std::unordered_map<stack_key, uint64_t, stack_key_hash> _stacks;
+    timer<lowres_clock> _aggregate_timer;
+
+    static thread_local profiler* _signal_target;
+
+    static void on_signal(int, siginfo_t*, void* uc) noexcept {
+        if (auto p = _signal_target) {
+            p->sample(static_cast<ucontext_t*>(uc));
+        }
+    }
+
+    static uintptr_t interrupted_pc(ucontext_t* uc) noexcept {
+#if defined(__x86_64__)
+        return uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+        return uc->uc_mcontext.pc;
+#else
+        return 0;
+#endif
+    }
+
+    void sample(ucontext_t* uc) noexcept {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_relaxed) == pending_capacity) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto& s = _pending[head % pending_capacity];
+        s.sg = internal::scheduling_group_index(current_scheduling_group());
+        s.nr_frames = 0;
+        // The frames up to the signal trampoline are the profiler's own,
+        // they're dropped once the interrupted frame is found. backtrace()
+        // reports return addresses minus one.
+        auto pc = interrupted_pc(uc) - 1;
+        bool found = false;
+        backtrace([&] (frame f) {
+            if (!found && f.so->begin + f.addr == pc) {
+                found = true;
+                s.nr_frames = 0;
+            }
+            if (s.nr_frames < max_frames) {
+                s.frames[s.nr_frames++] = f;
+            }
+        });
+        std::atomic_signal_fence(std::memory_order_release);
+        _head.store(head + 1, std::memory_order_relaxed);
+    }
+
+    void start_perf_event() {
+        ::perf_event_attr pea = {
+            .type = PERF_TYPE_SOFTWARE,
+            .size = sizeof(pea),
+            .config = PERF_COUNT_SW_TASK_CLOCK,
+            .sample_period = uint64_t(_period.count()),
+            .disabled = 1,
+            // Allowed with the default perf_event_paranoid setting
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+            .wakeup_events = 1,
+        };
+        int fd = syscall(__NR_perf_event_open, &pea, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        throw_system_error_on(fd == -1, "perf_event_open");
+        auto desc = file_desc::from_fd(fd);
+        struct f_owner_ex owner = {
+            .type = F_OWNER_TID,
+            .pid = static_cast<pid_t>(syscall(SYS_gettid)),
+        };
+        throw_system_error_on(::fcntl(fd, F_SETOWN_EX, &owner) == -1, "fcntl(F_SETOWN_EX)");
+        throw_system_error_on(::fcntl(fd, F_SETSIG, signal_number()) == -1, "fcntl(F_SETSIG)");
+        auto flags = ::fcntl(fd, F_GETFL);
+        throw_system_error_on(flags == -1, "fcntl(F_GETFL)");
+        throw_system_error_on(::fcntl(fd, F_SETFL, flags | O_ASYNC) == -1, "fcntl(F_SETFL)");
+        throw_system_error_on(::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) == -1, "ioctl(PERF_EVENT_IOC_ENABLE)");
+        _perf_event = std::move(desc);
+    }
+
+    void start_posix_timer() {
+        struct sigevent sev = {};
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_signo = signal_number();
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+        sev.sigev_notify_thread_id = syscall(SYS_gettid);
+        timer_t t;
+        throw_system_error_on(timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &t) == -1, "timer_create");
+        _posix_timer = t;
+        struct itimerspec its = {};
+        its.it_interval.tv_sec = _period.count() / 1'000'000'000;
+        its.it_interval.tv_nsec = _period.count() % 1'000'000'000;
+        its.it_value = its.it_interval;
+        throw_system_error_on(timer_settime(t, 0, &its, nullptr) == -1, "timer_settime");
+    }
+public:
+    explicit profiler(std::chrono::nanoseconds period)
+            : _period(std::max(period, std::chrono::nanoseconds(std::chrono::microseconds(100))))
+            , _pending(new pending_sample[pending_capacity])
+            , _aggregate_timer([this] { aggregate(); }) {
+        // The first call of backtrace() allocates, make it outside of the
+        // signal handler
+        backtrace([] (frame) {});
+        struct sigaction sa = {};
+        sa.sa_sigaction = &profiler::on_signal;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigfillset(&sa.sa_mask);
+        throw_system_error_on(sigaction(signal_number(), &sa, nullptr) == -1, "sigaction");
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, signal_number());
+        throw_pthread_error(::pthread_sigmask(SIG_UNBLOCK, &mask, nullptr));
+
+        _signal_target = this;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        try {
+            start_perf_event();
+        } catch (...) {
+            seastar_logger.info0("Failed to create the perf_event of the CPU profiler, falling back to a posix timer: {}", std::current_exception());
+            start_posix_timer();
+        }
+        _aggregate_timer.arm_periodic(std::chrono::seconds(1));
+    }
+
+    ~profiler() {
+        _perf_event.reset();
+        if (_posix_timer) {
+            timer_delete(*_posix_timer);
+        }
+        _signal_target = nullptr;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    void aggregate() {
+        auto head = _head.load(std::memory_order_relaxed);
+        std::atomic_signal_fence(std::memory_order_acquire);
+        for (auto tail = _tail.load(std::memory_order_relaxed); tail != head; tail++) {
+            auto& s = _pending[tail % pending_capacity];
+            simple_backtrace::vector_type frames(s.frames.begin(), s.frames.begin() + s.nr_frames);
+            ++_stacks[stack_key{s.sg, simple_backtrace(std::move(frames))}];
+        }
+        std::atomic_signal_fence(std::memory_order_release);
+        _tail.store(head, std::memory_order_relaxed);
+    }
+
+    std::chrono::nanoseconds period() const noexcept {
+        return _period;
+    }
+
+    uint64_t dropped() const noexcept {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    std::vector<cpu_profile_stack> profile() {
+        aggregate();
+        std::vector<cpu_profile_stack> ret;
+        ret.reserve(_stacks.size());
+        for (auto& [key, samples] : _stacks) {
+            ret.push_back(cpu_profile_stack{internal::scheduling_group_from_index(key.sg), key.backtrace, samples});
+        }
+        return ret;
+    }
+};
+
+thread_local profiler* profiler::_signal_target = nullptr;
+
+thread_local std::unique_ptr<profiler> local_profiler;
+
+}
+
+future<> start(std::chrono::microseconds period) {
+    return smp::invoke_on_all([period] {
+        internal::start_local_cpu_profiler(period);
+    });
+}
+
+future<> stop() {
+    return smp::invoke_on_all([] {
+        internal::stop_local_cpu_profiler();
+    });
+}
+
+std::chrono::nanoseconds local_period() noexcept {
+    return local_profiler ? local_profiler->period() : std::chrono::nanoseconds(0);
+}
+
+std::vector<cpu_profile_stack> local_profile() {
+    return local_profiler ? local_profiler->profile() : std::vector<cpu_profile_stack>();
+}
+
+uint64_t local_dropped_samples() noexcept {
+    return local_profiler ? local_profiler->dropped() : 0;
+}
+
+}
+
+void internal::start_local_cpu_profiler(std::chrono::nanoseconds period) {
+    cpu_profiler::local_profiler.reset();
+    cpu_profiler::local_profiler = std::make_unique<cpu_profiler::profiler>(period);
+}
+
+void internal::stop_local_cpu_profiler() noexcept {
+    cpu_profiler::local_profiler.reset();
+}
+
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#include <algorithm>
+#include <vector>
+module seastar;
+#else
+#include <algorithm>
+#include <vector>
+#include <seastar/core/cross_shard_channel.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+static thread_local std::vector<cross_shard_channel_endpoint*> cross_shard_channel_endpoints;
+
+void register_cross_shard_channel_endpoint(cross_shard_channel_endpoint& ep) {
+    cross_shard_channel_endpoints.push_back(&ep);
+}
+
+void unregister_cross_shard_channel_endpoint(cross_shard_channel_endpoint& ep) noexcept {
+    auto& eps = cross_shard_channel_endpoints;
+    eps.erase(std::remove(eps.begin(), eps.end(), &ep), eps.end());
+}
+
+bool poll_cross_shard_channels() noexcept {
+    bool work = false;
+    for (auto ep : cross_shard_channel_endpoints) {
+        work |= ep->poll();
+    }
+    return work;
+}
+
+bool pure_poll_cross_shard_channels() noexcept {
+    return std::any_of(cross_shard_channel_endpoints.begin(), cross_shard_channel_endpoints.end(), [] (auto ep) {
+        return ep->pure_poll();
+    });
+}
+
+}
+
+}
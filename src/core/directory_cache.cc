@@ -0,0 +1,302 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/directory_cache.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/coroutine/generator.hh>
+#include <seastar/util/log.hh>
+#endif
+
+namespace seastar {
+
+extern logger seastar_logger;
+
+namespace experimental {
+
+struct directory_cache::dir_state {
+    sstring path;
+    std::optional<fsnotifier::watch> w;
+    entries_type entries;
+    uint64_t version = 0;
+    // Entries named by events, to be stat'ed again
+    std::unordered_set<sstring> dirty;
+    bool scanning = false;
+    bool rescan_pending = false;
+    bool refreshing = false;
+    // Unwatched, removed or moved away
+    bool gone = false;
+};
+
+static const auto watched_events = fsnotifier::flags::create_child
+        | fsnotifier::flags::delete_child
+        | fsnotifier::flags::move
+        | fsnotifier::flags::close_write
+        | fsnotifier::flags::attrib
+        | fsnotifier::flags::delete_self
+        | fsnotifier::flags::move_self
+        | fsnotifier::flags::onlydir;
+
+directory_cache::directory_cache(unsigned stat_concurrency)
+    : _stat_concurrency(std::max(stat_concurrency, 1u))
+    , _events(process_events())
+{}
+
+directory_cache::~directory_cache() = default;
+
+void directory_cache::update(dir_state& d, const sstring& name, std::optional<stat_data> st) {
+    auto it = d.entries.find(name);
+    if (st) {
+        if (it == d.entries.end()) {
+            it = d.entries.emplace(name, *st).first;
+        } else {
+            it->second = *st;
+        }
+    } else if (it != d.entries.end()) {
+        d.entries.erase(it);
+    } else {
+        return;
+    }
+    ++d.version;
+    if (_listener) {
+        _listener(d.path, name, st ? &*st : nullptr);
+    }
+}
+
+future<> directory_cache::stat_entry(lw_shared_ptr<dir_state> d, const sstring& name) {
+    ++_stats.stats;
+    std::optional<stat_data> st;
+    try {
+        st = co_await file_stat(d->path + "/" + name, follow_symlink::no);
+    } catch (...) {
+        // Most likely removed again since the event, drop it either way
+    }
+    if (!d->gone) {
+        update(*d, name, std::move(st));
+    }
+}
+
+future<> directory_cache::refresh(lw_shared_ptr<dir_state> d) {
+    d->refreshing = true;
+    while (!d->dirty.empty() && !d->gone && !d->scanning) {
+        auto dirty = std::exchange(d->dirty, {});
+        std::vector<sstring> names(dirty.begin(), dirty.end());
+        co_await max_concurrent_for_each(names, _stat_concurrency, [this, d] (const sstring& name) {
+            return stat_entry(d, name);
+        });
+    }
+    d->refreshing = false;
+}
+
+void directory_cache::mark_dirty(const lw_shared_ptr<dir_state>& d, sstring name) {
+    d->dirty.insert(std::move(name));
+    if (d->refreshing || d->scanning || _gate.is_closed()) {
+        return;
+    }
+    (void)with_gate(_gate, [this, d] {
+        return refresh(d);
+    }).handle_exception([d] (std::exception_ptr ex) {
+        seastar_logger.warn("Failed to refresh the entries of {}: {}", d->path, ex);
+    });
+}
+
+future<> directory_cache::scan(lw_shared_ptr<dir_state> d) {
+    d->scanning = true;
+    std::exception_ptr ex;
+    try {
+        do {
+            d->rescan_pending = false;
+            ++_stats.rescans;
+            std::unordered_set<sstring> names;
+            auto dir = co_await open_directory(d->path);
+            try {
+                auto lister = dir.experimental_list_directory();
+                while (auto de = co_await lister()) {
+                    names.insert(std::move(de->name));
+                }
+            } catch (...) {
+                ex = std::current_exception();
+            }
+            co_await dir.close();
+            if (ex) {
+                break;
+            }
+            if (d->gone) {
+                break;
+            }
+            std::vector<sstring> removed;
+            for (auto& [name, st] : d->entries) {
+                if (!names.contains(name)) {
+                    removed.push_back(name);
+                }
+            }
+            for (auto& name : removed) {
+                update(*d, name, std::nullopt);
+            }
+            d->dirty.merge(names);
+            d->scanning = false;
+            co_await refresh(d);
+            d->scanning = true;
+        } while (d->rescan_pending && !d->gone);
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    d->scanning = false;
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+    // Events that came while scanning
+    if (!d->dirty.empty() && !d->gone) {
+        co_await refresh(d);
+    }
+}
+
+void directory_cache::rescan(const lw_shared_ptr<dir_state>& d) {
+    if (d->scanning) {
+        d->rescan_pending = true;
+        return;
+    }
+    if (_gate.is_closed()) {
+        return;
+    }
+    (void)with_gate(_gate, [this, d] {
+        return scan(d);
+    }).handle_exception([d] (std::exception_ptr ex) {
+        seastar_logger.warn("Failed to list {}: {}", d->path, ex);
+    });
+}
+
+void directory_cache::handle(const fsnotifier::event& ev) {
+    ++_stats.events;
+    if ((ev.mask & fsnotifier::flags::overflow) != fsnotifier::flags{}) {
+        // Events were lost, only listing again tells what changed
+        for (auto& [path, d] : _dirs) {
+            rescan(d);
+        }
+        return;
+    }
+    auto it = _by_token.find(ev.id);
+    if (it == _by_token.end()) {
+        return;
+    }
+    auto d = it->second;
+    if ((ev.mask & (fsnotifier::flags::delete_self | fsnotifier::flags::move_self | fsnotifier::flags::ignored)) != fsnotifier::flags{}) {
+        _by_token.erase(it);
+        d->gone = true;
+        d->dirty.clear();
+        while (!d->entries.empty()) {
+            auto name = d->entries.begin()->first;
+            update(*d, name, std::nullopt);
+        }
+        d->w.reset();
+        return;
+    }
+    if (!ev.name.empty()) {
+        mark_dirty(d, ev.name);
+    }
+}
+
+future<> directory_cache::process_events() {
+    while (_notifier.active()) {
+        std::vector<fsnotifier::event> events;
+        try {
+            events = co_await _notifier.wait();
+        } catch (...) {
+            if (_notifier.active()) {
+                seastar_logger.error("Failed to read directory events, the cache is no longer updated: {}", std::current_exception());
+            }
+            break;
+        }
+        for (auto& ev : events) {
+            handle(ev);
+        }
+    }
+}
+
+future<> directory_cache::watch(sstring dir) {
+    if (_dirs.contains(dir)) {
+        co_return;
+    }
+    auto d = make_lw_shared<dir_state>();
+    d->path = dir;
+    // Watch first, so that no change is missed while listing
+    d->w.emplace(co_await _notifier.create_watch(dir, watched_events));
+    _by_token.emplace(d->w->token(), d);
+    _dirs.emplace(std::move(dir), d);
+    auto holder = _gate.hold();
+    co_await scan(d);
+}
+
+void directory_cache::unwatch(const sstring& dir) {
+    auto it = _dirs.find(dir);
+    if (it == _dirs.end()) {
+        return;
+    }
+    auto d = std::move(it->second);
+    _dirs.erase(it);
+    d->gone = true;
+    if (d->w) {
+        _by_token.erase(d->w->token());
+        d->w.reset();
+    }
+}
+
+const directory_cache::entries_type& directory_cache::entries(const sstring& dir) const {
+    return _dirs.at(dir)->entries;
+}
+
+uint64_t directory_cache::version(const sstring& dir) const {
+    return _dirs.at(dir)->version;
+}
+
+void directory_cache::set_listener(listener_type listener) {
+    _listener = std::move(listener);
+}
+
+future<> directory_cache::close() {
+    for (auto& [path, d] : _dirs) {
+        d->gone = true;
+    }
+    _notifier.shutdown();
+    co_await std::exchange(_events, make_ready_future<>());
+    co_await _gate.close();
+    _by_token.clear();
+    _dirs.clear();
+}
+
+}
+
+}
@@ -0,0 +1,188 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <coroutine>
+#include <iterator>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/discard_batcher.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/util/log.hh>
+#endif
+
+namespace seastar {
+
+extern logger seastar_logger;
+
+discard_batcher::discard_batcher(file f, config cfg)
+        : _file(std::move(f))
+        , _config(std::move(cfg))
+        , _wakeup([this] { _work.signal(); })
+        , _done(with_scheduling_group(_config.sched_group, [this] { return run(); }))
+{
+}
+
+discard_batcher::~discard_batcher() {
+    assert(_closing);
+}
+
+void discard_batcher::discard(uint64_t offset, uint64_t length) {
+    if (!length) {
+        return;
+    }
+    _stats.ranges_queued++;
+    auto end = offset + length;
+    auto queued_at = lowres_clock::now();
+    auto absorb = [&] (range_map::iterator it) {
+        offset = std::min(offset, it->first);
+        end = std::max(end, it->second.end);
+        queued_at = std::min(queued_at, it->second.queued_at);
+        _queued_bytes -= it->second.end - it->first;
+        return erase_range(it);
+    };
+
+    auto it = _ranges.upper_bound(offset);
+    if (it != _ranges.begin() && std::prev(it)->second.end >= offset) {
+        it = absorb(std::prev(it));
+    }
+    while (it != _ranges.end() && it->first <= end) {
+        it = absorb(it);
+    }
+    insert_range(it, offset, range{end, queued_at});
+    _queued_bytes += end - offset;
+    _work.signal();
+}
+
+discard_batcher::range_map::iterator discard_batcher::insert_range(range_map::iterator hint, uint64_t offset, range r) {
+    auto it = _ranges.emplace_hint(hint, offset, r);
+    try {
+        _by_size.emplace(r.end - offset, offset);
+        _by_age.emplace(r.queued_at, offset);
+    } catch (...) {
+        erase_range(it);
+        throw;
+    }
+    return it;
+}
+
+discard_batcher::range_map::iterator discard_batcher::erase_range(range_map::iterator it) noexcept {
+    _by_size.erase({it->second.end - it->first, it->first});
+    _by_age.erase({it->second.queued_at, it->first});
+    return _ranges.erase(it);
+}
+
+// The largest range if it's long enough, else the oldest one if it's waited
+// long enough
+discard_batcher::range_map::iterator discard_batcher::pick() noexcept {
+    if (_closing || _flushes) {
+        return _ranges.begin();
+    }
+    if (!_by_size.empty() && _by_size.rbegin()->first >= _config.min_discard_size) {
+        return _ranges.find(_by_size.rbegin()->second);
+    }
+    if (!_by_age.empty()) {
+        auto due = _by_age.begin()->first + _config.max_delay;
+        if (due <= lowres_clock::now()) {
+            return _ranges.find(_by_age.begin()->second);
+        }
+        _wakeup.rearm(due);
+    }
+    return _ranges.end();
+}
+
+future<> discard_batcher::run() {
+    while (true) {
+        auto it = pick();
+        if (it == _ranges.end()) {
+            if (_ranges.empty()) {
+                _idle.broadcast();
+                if (_closing) {
+                    co_return;
+                }
+            }
+            co_await _work.wait();
+            continue;
+        }
+        auto now = lowres_clock::now();
+        if (_next_discard_at > now) {
+            // Ranges may change meanwhile, pick again afterwards
+            co_await sleep(_next_discard_at - now);
+            continue;
+        }
+
+        auto offset = it->first;
+        auto length = std::min(it->second.end - offset, _config.max_discard_size);
+        auto rest = it->second;
+        erase_range(it);
+        if (offset + length != rest.end) {
+            insert_range(_ranges.end(), offset + length, rest);
+        }
+        _queued_bytes -= length;
+
+        _in_flight = true;
+        try {
+            co_await _file.discard(offset, length);
+            _stats.discards_issued++;
+            _stats.bytes_discarded += length;
+        } catch (...) {
+            _stats.failures++;
+            seastar_logger.debug("Failed to discard {} bytes at {}: {}", length, offset, std::current_exception());
+        }
+        _in_flight = false;
+
+        if (_config.bandwidth) {
+            auto cost = std::chrono::duration<double>(double(length) / _config.bandwidth);
+            _next_discard_at = std::max(_next_discard_at, now) + std::chrono::duration_cast<lowres_clock::duration>(cost);
+        }
+    }
+}
+
+future<> discard_batcher::flush() {
+    ++_flushes;
+    _work.signal();
+    try {
+        co_await _idle.wait([this] { return _ranges.empty() && !_in_flight; });
+    } catch (...) {
+        --_flushes;
+        throw;
+    }
+    --_flushes;
+}
+
+future<> discard_batcher::close() noexcept {
+    _closing = true;
+    _wakeup.cancel();
+    _work.signal();
+    co_await std::move(_done);
+}
+
+}
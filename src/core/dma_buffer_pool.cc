@@ -0,0 +1,179 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <bit>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/internal/dma_buffer_pool.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/deleter.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+unsigned dma_buffer_pool::size_class_of(size_t size) noexcept {
+    size = std::max(size, min_buffer_size);
+    return std::bit_width(size - 1) - std::bit_width(min_buffer_size - 1);
+}
+
+temporary_buffer<char> dma_buffer_pool::allocate(size_t alignment, size_t size) {
+    auto sc = size_class_of(size);
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    if (size <= max_buffer_size && alignment <= buffer_size_of(sc)) {
+        auto p = allocate_buffer(sc);
+        try {
+            auto d = make_deleter([this, p] {
+                if (this_shard_id() == _owner) {
+                    this->free(p);
+                } else {
+                    free_foreign(p);
+                }
+            });
+            _stats.allocations++;
+            return temporary_buffer<char>(p, size, std::move(d));
+        } catch (...) {
+            this->free(p);
+            throw;
+        }
+    }
+#endif
+    // Out of the pool's size classes, or debug builds where the sanitizers
+    // should see every buffer
+    _stats.fallback_allocations++;
+    return temporary_buffer<char>::aligned(alignment, size);
+}
+
+char* dma_buffer_pool::allocate_buffer(unsigned sc) {
+    drain_foreign_frees();
+    auto& cls = _classes[sc];
+    auto buffers_per_region = region_size / buffer_size_of(sc);
+    if (cls.partial.empty()) {
+        auto base = static_cast<char*>(::aligned_alloc(region_size, region_size));
+        if (!base) {
+            throw std::bad_alloc();
+        }
+        ::madvise(base, region_size, MADV_HUGEPAGE);
+        std::unique_ptr<region> r;
+        try {
+            r = std::make_unique<region>();
+            _regions.reserve(_regions.size() + 1);
+        } catch (...) {
+            ::free(base);
+            throw;
+        }
+        r->base = base;
+        r->size_class = sc;
+        r->nr_free = buffers_per_region;
+        // Thread the free list through the buffers, lowest address first
+        for (auto i = buffers_per_region; i > 0; i--) {
+            auto b = reinterpret_cast<free_buffer*>(base + (i - 1) * buffer_size_of(sc));
+            b->next = r->free_list;
+            r->free_list = b;
+        }
+        cls.partial.push_front(*r);
+        cls.nr_empty++;
+        _regions.emplace(reinterpret_cast<uintptr_t>(base), std::move(r));
+        _stats.regions++;
+    }
+    auto& r = cls.partial.front();
+    if (r.nr_free == buffers_per_region) {
+        cls.nr_empty--;
+    }
+    auto b = r.free_list;
+    r.free_list = b->next;
+    if (--r.nr_free == 0) {
+        cls.partial.pop_front();
+    }
+    return reinterpret_cast<char*>(b);
+}
+
+void dma_buffer_pool::free(char* p) noexcept {
+    auto it = _regions.find(align_down(reinterpret_cast<uintptr_t>(p), region_size));
+    assert(it != _regions.end());
+    auto& r = *it->second;
+    auto& cls = _classes[r.size_class];
+    auto b = reinterpret_cast<free_buffer*>(p);
+    b->next = r.free_list;
+    r.free_list = b;
+    if (r.nr_free++ == 0) {
+        // Partially used regions go first, to keep the others free
+        cls.partial.push_front(r);
+    }
+    if (r.nr_free == region_size / buffer_size_of(r.size_class)) {
+        if (cls.nr_empty) {
+            release_region(r);
+        } else {
+            cls.partial.erase(cls.partial.iterator_to(r));
+            cls.partial.push_back(r);
+            cls.nr_empty++;
+        }
+    }
+}
+
+void dma_buffer_pool::release_region(region& r) noexcept {
+    _classes[r.size_class].partial.erase(_classes[r.size_class].partial.iterator_to(r));
+    auto base = r.base;
+    _regions.erase(reinterpret_cast<uintptr_t>(base));
+    ::free(base);
+    _stats.regions--;
+}
+
+void dma_buffer_pool::free_foreign(char* p) noexcept {
+    auto b = reinterpret_cast<free_buffer*>(p);
+    b->next = _foreign_frees.load(std::memory_order_relaxed);
+    while (!_foreign_frees.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+void dma_buffer_pool::drain_foreign_frees() noexcept {
+    if (!_foreign_frees.load(std::memory_order_relaxed)) {
+        return;
+    }
+    auto b = _foreign_frees.exchange(nullptr, std::memory_order_acquire);
+    while (b) {
+        auto next = b->next;
+        free(reinterpret_cast<char*>(b));
+        b = next;
+    }
+}
+
+dma_buffer_pool& local_dma_buffer_pool() {
+    // Never destroyed: buffers may outlive the shard's thread_locals, e.g.
+    // when released on another shard during shutdown.
+    static thread_local dma_buffer_pool* pool = new dma_buffer_pool();
+    return *pool;
+}
+
+}
+
+}
@@ -0,0 +1,243 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <coroutine>
+#include <vector>
+#include <sys/uio.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/emulated_file.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/sleep.hh>
+#endif
+
+namespace seastar {
+
+emulated_disk::emulated_disk(config cfg)
+        : _config(std::move(cfg))
+        , _epoch(clock_type::now())
+        , _reads{_config.read_bandwidth, _config.read_iops, _config.read_latency}
+        , _writes{_config.write_bandwidth, _config.write_iops, _config.write_latency}
+        , _rng(_config.seed)
+        , _tail(std::clamp(_config.tail_probability, 0.0, 1.0))
+{
+}
+
+emulated_disk::clock_type::time_point
+emulated_disk::skip_stall(clock_type::time_point t) const noexcept {
+    if (_config.stall_period <= clock_type::duration::zero() || _config.stall_duration <= clock_type::duration::zero()) {
+        return t;
+    }
+    auto phase = (t - _epoch) % _config.stall_period;
+    // The stall is at the end of each period
+    auto stall_start = _config.stall_period - std::min(_config.stall_duration, _config.stall_period);
+    return phase < stall_start ? t : t + (_config.stall_period - phase);
+}
+
+emulated_disk::clock_type::duration
+emulated_disk::draw_latency(const queue& q) noexcept {
+    auto latency = std::chrono::duration<double>(q.latency);
+    if (_config.latency_spread > 0) {
+        latency *= std::exp(_config.latency_spread * _spread(_rng));
+    }
+    if (_tail(_rng)) {
+        latency += _config.tail_latency;
+    }
+    return std::chrono::duration_cast<clock_type::duration>(latency);
+}
+
+emulated_disk::slot
+emulated_disk::schedule(bool write, size_t len) noexcept {
+    auto& q = write ? _writes : _reads;
+    double cost_bytes = len;
+    if (write) {
+        if (_stats.written_bytes >= _config.amplify_writes_after) {
+            cost_bytes *= std::max(_config.write_amplification, 1.0);
+        }
+        _stats.writes++;
+        _stats.written_bytes += len;
+    } else {
+        _stats.reads++;
+        _stats.read_bytes += len;
+    }
+
+    std::chrono::duration<double> cost{};
+    if (q.bandwidth) {
+        cost = std::max(cost, std::chrono::duration<double>(cost_bytes / q.bandwidth));
+    }
+    if (q.iops) {
+        cost = std::max(cost, std::chrono::duration<double>(1.0 / q.iops));
+    }
+    auto start = skip_stall(std::max(clock_type::now(), q.next_free));
+    q.next_free = start + std::chrono::duration_cast<clock_type::duration>(cost);
+    return slot{start, skip_stall(q.next_free + draw_latency(q))};
+}
+
+future<> emulated_disk::wait_until(clock_type::time_point t) {
+    auto now = clock_type::now();
+    if (t > now) {
+        _stats.delay += t - now;
+        co_await seastar::sleep(t - now);
+    }
+}
+
+class emulated_file_impl final : public layered_file_impl {
+    emulated_disk& _disk;
+
+    static size_t iov_size(const std::vector<iovec>& iov) noexcept {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return len;
+    }
+
+    template <typename Func>
+    auto emulate(bool write, size_t len, Func func) -> decltype(func()) {
+        auto s = _disk.schedule(write, len);
+        co_await _disk.wait_until(s.start);
+        auto ret = co_await func();
+        co_await _disk.wait_until(s.completion);
+        co_return ret;
+    }
+
+public:
+    emulated_file_impl(file f, emulated_disk& disk)
+            : layered_file_impl(std::move(f))
+            , _disk(disk)
+    {
+    }
+
+#if SEASTAR_API_LEVEL >= 7
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) override {
+        return emulate(true, len, [this, pos, buffer, len, intent] {
+            return _underlying_file.dma_write(pos, static_cast<const char*>(buffer), len, intent);
+        });
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        auto len = iov_size(iov);
+        return emulate(true, len, [this, pos, iov = std::move(iov), intent] () mutable {
+            return _underlying_file.dma_write(pos, std::move(iov), intent);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) override {
+        return emulate(false, len, [this, pos, buffer, len, intent] {
+            return _underlying_file.dma_read(pos, static_cast<char*>(buffer), len, intent);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        auto len = iov_size(iov);
+        return emulate(false, len, [this, pos, iov = std::move(iov), intent] () mutable {
+            return _underlying_file.dma_read(pos, std::move(iov), intent);
+        });
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) override {
+        return emulate(false, range_size, [this, offset, range_size, intent] {
+            return _underlying_file.dma_read_bulk<uint8_t>(offset, range_size, intent);
+        });
+    }
+#else
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
+        return write_dma(pos, buffer, len, pc, nullptr);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return write_dma(pos, std::move(iov), pc, nullptr);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return read_dma(pos, buffer, len, pc, nullptr);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return read_dma(pos, std::move(iov), pc, nullptr);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return dma_read_bulk(offset, range_size, pc, nullptr);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) override {
+        return emulate(true, len, [this, pos, buffer, len, &pc, intent] {
+            return _underlying_file.dma_write(pos, static_cast<const char*>(buffer), len, pc, intent);
+        });
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) override {
+        auto len = iov_size(iov);
+        return emulate(true, len, [this, pos, iov = std::move(iov), &pc, intent] () mutable {
+            return _underlying_file.dma_write(pos, std::move(iov), pc, intent);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) override {
+        return emulate(false, len, [this, pos, buffer, len, &pc, intent] {
+            return _underlying_file.dma_read(pos, static_cast<char*>(buffer), len, pc, intent);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) override {
+        auto len = iov_size(iov);
+        return emulate(false, len, [this, pos, iov = std::move(iov), &pc, intent] () mutable {
+            return _underlying_file.dma_read(pos, std::move(iov), pc, intent);
+        });
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent* intent) override {
+        return emulate(false, range_size, [this, offset, range_size, &pc, intent] {
+            return _underlying_file.dma_read_bulk<uint8_t>(offset, range_size, pc, intent);
+        });
+    }
+#endif
+
+    virtual future<> flush() override {
+        co_await _disk.wait_until(_disk._writes.next_free);
+        co_await _underlying_file.flush();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat();
+    }
+    virtual future<> truncate(uint64_t length) override {
+        return _underlying_file.truncate(length);
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return _underlying_file.discard(offset, length);
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        return _underlying_file.allocate(position, length);
+    }
+    virtual future<uint64_t> size() override {
+        return _underlying_file.size();
+    }
+    virtual future<> close() override {
+        return _underlying_file.close();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+};
+
+file make_emulated_file(file f, emulated_disk& disk) {
+    return file(make_shared<emulated_file_impl>(std::move(f), disk));
+}
+
+}
@@ -0,0 +1,261 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/event_trace.hh>
+#include <seastar/core/internal/event_trace.hh>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/handlers.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/util/log.hh>
+#include <fmt/format.h>
+#include <bit>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace seastar {
+
+extern seastar::logger seastar_logger;
+
+namespace internal {
+
+thread_local event_trace_ring* local_event_trace = nullptr;
+
+event_trace_ring::event_trace_ring(size_t size)
+    : _events(new trace_event[std::bit_ceil(std::max<size_t>(size, 1))])
+    , _mask(std::bit_ceil(std::max<size_t>(size, 1)) - 1)
+{}
+
+std::vector<trace_event> event_trace_ring::events() const {
+    auto size = _mask + 1;
+    auto first = _next > size ? _next - size : 0;
+    std::vector<trace_event> ret;
+    ret.reserve(_next - first);
+    for (auto i = first; i != _next; i++) {
+        ret.push_back(_events[i & _mask]);
+    }
+    return ret;
+}
+
+}
+
+namespace event_trace {
+
+namespace {
+
+thread_local std::unique_ptr<internal::event_trace_ring> local_ring;
+
+}
+
+}
+
+void internal::start_local_event_trace(size_t size) {
+    local_event_trace = nullptr;
+    event_trace::local_ring = std::make_unique<event_trace_ring>(size);
+    local_event_trace = event_trace::local_ring.get();
+}
+
+namespace event_trace {
+
+using internal::trace_event;
+using internal::trace_event_type;
+
+namespace {
+
+// Renders the events of a shard as Chrome trace events
+class chrome_trace_renderer {
+    unsigned _shard;
+    std::unordered_map<const void*, sstring> _task_names;
+    fmt::memory_buffer& _out;
+
+    static sstring json_escape(std::string_view s) {
+        std::string ret;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                ret += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20) {
+                ret += c;
+            }
+        }
+        return sstring(ret);
+    }
+    const sstring& task_name(const void* ti) {
+        auto it = _task_names.find(ti);
+        if (it == _task_names.end()) {
+            auto name = ti ? pretty_type_name(*static_cast<const std::type_info*>(ti)) : sstring("task");
+            it = _task_names.emplace(ti, json_escape(name)).first;
+        }
+        return it->second;
+    }
+    void event(const trace_event& e, std::string_view ph, std::string_view cat, std::string_view name) {
+        fmt::format_to(std::back_inserter(_out), ",\n{{\"ph\":\"{}\",\"cat\":\"{}\",\"name\":\"{}\",\"ts\":{}.{:03d},\"pid\":0,\"tid\":{}",
+                ph, cat, name, e.ts / 1000, e.ts % 1000, _shard);
+    }
+    void flow(const trace_event& e, std::string_view ph, std::string_view cat) {
+        event(e, ph, cat, cat);
+        fmt::format_to(std::back_inserter(_out), ",\"id\":\"{}\"{}}}", fmt::ptr(e.id), ph == "f" ? ",\"bp\":\"e\"" : "");
+    }
+    void async(const trace_event& e, std::string_view ph, std::string_view name) {
+        event(e, ph, "io", name);
+        fmt::format_to(std::back_inserter(_out), ",\"id\":\"{}\",\"args\":{{\"size\":{}}}}}", fmt::ptr(e.id), e.size);
+    }
+    void point(const trace_event& e, std::string_view cat, std::string_view name) {
+        event(e, "X", cat, name);
+        fmt::format_to(std::back_inserter(_out), ",\"dur\":0,\"args\":{{\"shard\":{}}}}}", e.aux);
+    }
+public:
+    chrome_trace_renderer(unsigned shard, fmt::memory_buffer& out) : _shard(shard), _out(out) {}
+
+    void render(const trace_event& e) {
+        switch (e.type) {
+        case trace_event_type::task_queued:
+            flow(e, "s", "task");
+            break;
+        case trace_event_type::task_run: {
+            flow(e, "f", "task");
+            event(e, "B", "task", task_name(e.ref));
+            auto group = json_escape(internal::scheduling_group_from_index(e.sg).name());
+            fmt::format_to(std::back_inserter(_out), ",\"args\":{{\"group\":\"{}\"}}}}", group);
+            break;
+        }
+        case trace_event_type::task_done:
+            event(e, "E", "task", "task");
+            _out.push_back('}');
+            break;
+        case trace_event_type::io_queued:
+            async(e, "b", "queued");
+            break;
+        case trace_event_type::io_submit:
+            async(e, "e", "queued");
+            async(e, "b", e.aux ? "write" : "read");
+            break;
+        case trace_event_type::io_complete:
+            async(e, "e", e.aux ? "write" : "read");
+            break;
+        case trace_event_type::smp_send:
+            point(e, "smp", "smp send");
+            flow(e, "s", "smp");
+            break;
+        case trace_event_type::smp_receive:
+            point(e, "smp", "smp receive");
+            flow(e, "f", "smp");
+            flow(e, "s", "smp reply");
+            break;
+        case trace_event_type::smp_complete:
+            point(e, "smp", "smp complete");
+            flow(e, "f", "smp reply");
+            break;
+        }
+    }
+};
+
+class trace_handler : public httpd::handler_base {
+public:
+    future<std::unique_ptr<http::reply>> handle(const sstring& path,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override {
+        rep->write_body("json", [] (output_stream<char>&& s) {
+            return do_with(std::move(s), [] (output_stream<char>& s) {
+                return write_chrome_trace(s).finally([&s] {
+                    return s.close();
+                });
+            });
+        });
+        return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+    }
+};
+
+}
+
+future<> start(size_t events_per_shard) {
+    return smp::invoke_on_all([events_per_shard] {
+        internal::start_local_event_trace(events_per_shard);
+    });
+}
+
+future<> stop() {
+    return smp::invoke_on_all([] {
+        internal::local_event_trace = nullptr;
+        local_ring.reset();
+    });
+}
+
+future<> write_chrome_trace(output_stream<char>& out) {
+    co_await out.write("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+            "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":0,\"args\":{\"name\":\"seastar\"}}");
+    for (unsigned shard = 0; shard < smp::count; shard++) {
+        auto events = co_await smp::submit_to(shard, [] {
+            return local_ring ? local_ring->events() : std::vector<trace_event>();
+        });
+        fmt::memory_buffer buf;
+        fmt::format_to(std::back_inserter(buf), ",\n{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":{},\"args\":{{\"name\":\"shard {}\"}}}}", shard, shard);
+        chrome_trace_renderer renderer(shard, buf);
+        for (auto& e : events) {
+            renderer.render(e);
+            if (buf.size() >= 64 * 1024) {
+                co_await out.write(buf.data(), buf.size());
+                buf.clear();
+            }
+        }
+        co_await out.write(buf.data(), buf.size());
+    }
+    co_await out.write("\n]}\n");
+    co_await out.flush();
+}
+
+future<> dump(sstring path) {
+    auto f = co_await open_file_dma(path, open_flags::wo | open_flags::create | open_flags::truncate);
+    auto out = co_await make_file_output_stream(std::move(f));
+    std::exception_ptr ex;
+    try {
+        co_await write_chrome_trace(out);
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    co_await out.close();
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+}
+
+future<> add_routes(httpd::http_server& server, sstring path) {
+    server._routes.put(httpd::GET, path, new trace_handler());
+    return make_ready_future<>();
+}
+
+void dump_on_signal(int signo, sstring path) {
+    engine().handle_signal(signo, [path] {
+        seastar_logger.info("Writing the event trace to {}", path);
+        // Runs from the reactor's signal poller
+        (void)dump(path).handle_exception([path] (std::exception_ptr ex) {
+            seastar_logger.warn("Failed to write the event trace to {}: {}", path, ex);
+        });
+    });
+}
+
+}
+
+}
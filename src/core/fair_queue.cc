@@ -108,6 +108,7 @@ fair_group::fair_group(config cfg, unsigned nr_queues)
                         tokens_capacity(cfg.min_tokens)
                        )
         , _per_tick_threshold(_token_bucket.limit() / nr_queues)
+        , _lease_capacity(std::min(_token_bucket.accumulated_in(cfg.lease_duration), _per_tick_threshold))
 {
     if (tokens_capacity(cfg.min_tokens) > _token_bucket.threshold()) {
         throw std::runtime_error("Fair-group replenisher limit is lower than threshold");
@@ -119,6 +120,10 @@ auto fair_group::grab_capacity(capacity_t cap) noexcept -> capacity_t {
     return _token_bucket.grab(cap);
 }
 
+void fair_group::refund_capacity(capacity_t cap) noexcept {
+    _token_bucket.refund(cap);
+}
+
 void fair_group::replenish_capacity(clock_type::time_point now) noexcept {
     _token_bucket.replenish(now);
 }
@@ -169,6 +174,7 @@ fair_queue::fair_queue(fair_group& group, config cfg)
 }
 
 fair_queue::~fair_queue() {
+    refund_lease();
     for (const auto& fq : _priority_classes) {
         assert(!fq);
     }
@@ -239,6 +245,7 @@ auto fair_queue::grab_pending_capacity(const fair_queue_entry& ent) noexcept ->
         return grab_result::cant_preempt;
     }
 
+    _lease = _pending->lease;
     _pending.reset();
     return grab_result::grabbed;
 }
@@ -249,15 +256,32 @@ auto fair_queue::grab_capacity(const fair_queue_entry& ent) noexcept -> grab_res
     }
 
     capacity_t cap = ent._capacity;
-    capacity_t want_head = _group.grab_capacity(cap);
+    if (_lease >= cap) {
+        _lease -= cap;
+        return grab_result::grabbed;
+    }
+
+    // Top the lease up in the same go, the remainder of the current one
+    // goes to this request
+    capacity_t lease = std::min(_group.lease_capacity(), _group.maximum_capacity() - cap);
+    capacity_t want_head = _group.grab_capacity(cap - _lease + lease);
+    _lease = 0;
     if (_group.capacity_deficiency(want_head)) {
-        _pending.emplace(want_head, cap);
+        _pending.emplace(want_head, cap, lease);
         return grab_result::pending;
     }
 
+    _lease = lease;
     return grab_result::grabbed;
 }
 
+void fair_queue::refund_lease() noexcept {
+    if (_lease) {
+        _group.refund_capacity(_lease);
+        _lease = 0;
+    }
+}
+
 void fair_queue::register_priority_class(class_id id, uint32_t shares) {
     if (id >= _priority_classes.size()) {
         _priority_classes.resize(id + 1);
@@ -390,6 +414,11 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
     for (auto&& h : preempt) {
         push_priority_class(*h);
     }
+
+    // Nothing left to dispatch, let other queues use the lease
+    if (_handles.empty() && !_pending) {
+        refund_lease();
+    }
 }
 
 std::vector<seastar::metrics::impl::metric_definition_impl> fair_queue::metrics(class_id c) {
@@ -27,6 +27,7 @@
 #include <deque>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 #include <sys/uio.h>
 
@@ -88,6 +89,18 @@ class posix_file_impl : public file_impl {
             bool nowait_works);
 public:
     virtual ~posix_file_impl() override;
+    // Returns the posix implementation of the file, if it has one
+    static posix_file_impl* of(file& f) noexcept;
+    // Sends up to len bytes from pos to a non-blocking socket with
+    // sendfile(2). Runs in the syscall thread, so that page cache misses
+    // don't stall the reactor. Returns nullopt when the socket is full.
+    future<std::optional<size_t>> send_to(int socket_fd, uint64_t pos, size_t len) noexcept;
+    // Maps len bytes from pos read-only; the mapping goes away with the
+    // returned buffer and all the buffers shared from it
+    future<temporary_buffer<char>> map(uint64_t pos, size_t len) noexcept;
+    // Faults in the pages of a mapping from the syscall thread; errors are
+    // ignored, the pages are then faulted in on access
+    static future<> prefault(const char* p, size_t len) noexcept;
     future<> flush() noexcept override;
     future<struct stat> stat() noexcept override;
     future<> truncate(uint64_t length) noexcept override;
@@ -104,6 +117,7 @@ class posix_file_impl : public file_impl {
     virtual std::unique_ptr<seastar::file_handle_impl> dup() override;
     virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override;
     virtual coroutine::experimental::generator<directory_entry> experimental_list_directory() override;
+    virtual coroutine::experimental::generator<directory_entry_view> experimental_list_directory_entries(list_directory_options opts) override;
 
 #if SEASTAR_API_LEVEL >= 7
     virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) noexcept override = 0;
@@ -175,8 +189,14 @@ class posix_file_impl : public file_impl {
 #endif
 
 protected:
+    io_queue& get_io_queue() const noexcept {
+        return _io_queue;
+    }
     future<size_t> do_write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
     future<size_t> do_write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+#if SEASTAR_API_LEVEL >= 7
+    future<size_t> do_write_dma_and_flush(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept;
+#endif
     future<size_t> do_read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
     future<size_t> do_read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
     future<temporary_buffer<uint8_t>> do_dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
@@ -211,6 +231,9 @@ class posix_file_real_impl final : public posix_file_impl {
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) noexcept override {
         return dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref{}, intent);
     }
+    virtual future<size_t> write_dma_and_flush(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return do_write_dma_and_flush(pos, buffer, len, intent);
+    }
 #else
     using posix_file_impl::read_dma;
     virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override {
@@ -233,6 +256,70 @@ class posix_file_real_impl final : public posix_file_impl {
 #endif
 };
 
+// Files which couldn't be switched to O_DIRECT (tmpfs, overlayfs, some NFS
+// setups, or all files with --kernel-page-cache) go through the page cache,
+// where linux-aio would block the reactor. Their reads and writes are
+// attempted on the reactor with RWF_NOWAIT, which succeeds when the data
+// is cached (or can be copied to the cache), and are offloaded to the
+// syscall thread only if they'd block.
+//
+// They bypass the I/O queues on purpose: the queues pace requests by what
+// the disk can take, while these are mostly served from memory and the
+// rest is paced by the kernel's writeback. None of the methods may submit
+// to get_io_queue(). Intents are still honoured, as the queues do it: a
+// request whose intent is cancelled before it completes fails with
+// cancelled_error, and the result of one already offloaded is dropped.
+class posix_buffered_file_impl final : public posix_file_impl {
+    // Cleared if the kernel or the filesystem doesn't support RWF_NOWAIT
+    bool _nowait_reads = true;
+    bool _nowait_writes = true;
+
+    future<size_t> do_io(bool write, uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept;
+    future<size_t> do_io(bool write, uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept;
+public:
+    posix_buffered_file_impl(int fd, open_flags of, file_open_options options, const internal::fs_info& fsi, dev_t device_id)
+        : posix_file_impl(fd, of, std::move(options), device_id, fsi) {}
+    posix_buffered_file_impl(int fd, open_flags of, std::atomic<unsigned>* refcount, dev_t device_id,
+            uint32_t memory_dma_alignment, uint32_t disk_read_dma_alignment, uint32_t disk_write_dma_alignment, uint32_t disk_overwrite_dma_alignment, bool nowait_works)
+        : posix_file_impl(fd, of, refcount, device_id, memory_dma_alignment, disk_read_dma_alignment, disk_write_dma_alignment, disk_overwrite_dma_alignment, nowait_works) {}
+#if SEASTAR_API_LEVEL >= 7
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) noexcept override {
+        return do_io(false, pos, buffer, len, intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return do_io(false, pos, std::move(iov), intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return do_io(true, pos, buffer, len, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return do_io(true, pos, std::move(iov), intent);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) noexcept override {
+        return do_dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref{}, intent);
+    }
+#else
+    using posix_file_impl::read_dma;
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return do_io(false, pos, buffer, len, intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return do_io(false, pos, std::move(iov), intent);
+    }
+    using posix_file_impl::write_dma;
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return do_io(true, pos, buffer, len, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return do_io(true, pos, std::move(iov), intent);
+    }
+    using posix_file_impl::dma_read_bulk;
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return do_dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref(pc), intent);
+    }
+#endif
+};
+
 // The Linux XFS implementation is challenged wrt. append: a write that changes
 // eof will be blocked by any other concurrent AIO operation to the same file, whether
 // it changes file size or not. Furthermore, ftruncate() will also block and be blocked
@@ -418,4 +505,74 @@ class blockdev_file_impl final : public posix_file_impl {
 
 };
 
+// A raw NVMe namespace, opened through its generic char device (/dev/ngXnY).
+// Reads and writes are NVMe commands sent with io_uring passthrough
+// (IORING_OP_URING_CMD) and bypass the block layer, but still go through the
+// I/O queue of the namespace's block device, so fair queuing applies.
+// Needs the io_uring reactor backend.
+class nvme_passthrough_file_impl final : public posix_file_impl {
+    uint32_t _nsid;
+    unsigned _lba_shift;
+    uint64_t _size;
+
+    future<size_t> do_io(uint8_t opcode, uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> do_io(uint8_t opcode, uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<int> do_io_command(uint8_t opcode, void* data, uint32_t data_len, uint32_t cdw10, uint32_t cdw11) noexcept;
+
+    future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+
+public:
+    nvme_passthrough_file_impl(int fd, open_flags, file_open_options options, dev_t device_id, uint32_t nsid, unsigned lba_shift, uint64_t size);
+    // Identifies the namespace of the char device open at fd; its I/O is
+    // queued on block_dev
+    static future<shared_ptr<file_impl>> make(int fd, file_open_options options, int flags, dev_t block_dev) noexcept;
+    future<> flush() noexcept override;
+    future<> truncate(uint64_t length) noexcept override;
+    future<> discard(uint64_t offset, uint64_t length) noexcept override;
+    future<uint64_t> size() noexcept override;
+    virtual future<> allocate(uint64_t position, uint64_t length) noexcept override;
+    virtual std::unique_ptr<seastar::file_handle_impl> dup() override;
+#if SEASTAR_API_LEVEL >= 7
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) noexcept override {
+        return read_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return read_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) noexcept override {
+        return dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> write_dma_and_flush(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override;
+#else
+    using posix_file_impl::read_dma;
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return read_dma(pos, buffer, len, internal::maybe_priority_class_ref(pc), intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return read_dma(pos, std::move(iov), internal::maybe_priority_class_ref(pc), intent);
+    }
+    using posix_file_impl::write_dma;
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref(pc), intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref(pc), intent);
+    }
+    using posix_file_impl::dma_read_bulk;
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent* intent) noexcept override {
+        return dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref(pc), intent);
+    }
+#endif
+};
+
 }
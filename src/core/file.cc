@@ -30,6 +30,7 @@ module;
 #include <filesystem>
 #include <functional>
 #include <memory>
+#include <numeric>
 #include <optional>
 #include <vector>
 
@@ -40,7 +41,11 @@ module;
 #include <linux/types.h> // for xfs, below
 #include <linux/fs.h> // BLKBSZGET
 #include <linux/major.h>
+#include <linux/nvme_ioctl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <xfs/linux.h>
@@ -58,6 +63,7 @@ module;
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/internal/dma_buffer_pool.hh>
 #include <seastar/core/internal/read_state.hh>
 #include <seastar/core/internal/uname.hh>
 #include <seastar/core/reactor.hh>
@@ -67,8 +73,10 @@ module seastar;
 #include <seastar/util/later.hh>
 #include <seastar/util/internal/magic.hh>
 #include <seastar/util/internal/iovec_utils.hh>
+#include <seastar/util/read_first_line.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/queue.hh>
+#include <seastar/core/when_all.hh>
 #include "core/file-impl.hh"
 #include "core/syscall_result.hh"
 #include "core/thread_pool.hh"
@@ -127,6 +135,7 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
         , _fd(fd)
 {
     configure_io_lengths();
+    engine().register_file(_fd);
 }
 
 posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options, dev_t device_id, const internal::fs_info& fsi)
@@ -136,6 +145,9 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
 }
 
 posix_file_impl::~posix_file_impl() {
+    if (_fd != -1) {
+        engine().unregister_file(_fd);
+    }
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         return;
     }
@@ -194,6 +206,72 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, std::atomic<unsigned>* re
     _disk_write_dma_alignment = disk_write_dma_alignment;
     _disk_overwrite_dma_alignment = disk_overwrite_dma_alignment;
     configure_io_lengths();
+    engine().register_file(_fd);
+}
+
+posix_file_impl*
+posix_file_impl::of(file& f) noexcept {
+    return dynamic_cast<posix_file_impl*>(get_file_impl(f));
+}
+
+future<std::optional<size_t>>
+posix_file_impl::send_to(int socket_fd, uint64_t pos, size_t len) noexcept {
+    return engine()._thread_pool->submit<syscall_result<ssize_t>>(syscall_kind::data, [fd = _fd, socket_fd, pos, len] {
+        off_t off = pos;
+        return wrap_syscall<ssize_t>(::sendfile(socket_fd, fd, &off, len));
+    }).then([] (syscall_result<ssize_t> sr) {
+        if (sr.result == -1 && (sr.error == EAGAIN || sr.error == EWOULDBLOCK)) {
+            return std::optional<size_t>();
+        }
+        sr.throw_if_error();
+        return std::optional<size_t>(sr.result);
+    });
+}
+
+static size_t mmap_page_size() noexcept {
+    static const size_t size = ::sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+future<temporary_buffer<char>>
+posix_file_impl::map(uint64_t pos, size_t len) noexcept {
+    // The mapping has to start at a page boundary
+    auto start = align_down<uint64_t>(pos, mmap_page_size());
+    auto delta = pos - start;
+    return engine()._thread_pool->submit<syscall_result<void*>>(syscall_kind::metadata, [fd = _fd, start, size = delta + len] {
+        return wrap_syscall<void*>(::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, start));
+    }).then([delta, len] (syscall_result<void*> sr) {
+        if (sr.result == MAP_FAILED) {
+            sr.throw_if_error();
+        }
+        auto base = static_cast<char*>(sr.result);
+        return temporary_buffer<char>(base + delta, len, make_deleter([base, size = delta + len] {
+            ::munmap(base, size);
+        }));
+    });
+}
+
+future<>
+posix_file_impl::prefault(const char* p, size_t len) noexcept {
+    auto start = align_down(reinterpret_cast<uintptr_t>(p), uintptr_t(mmap_page_size()));
+    auto end = reinterpret_cast<uintptr_t>(p) + len;
+    return engine()._thread_pool->submit<syscall_result<int>>(syscall_kind::data, [start, end] {
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+        auto r = ::madvise(reinterpret_cast<void*>(start), end - start, MADV_POPULATE_READ);
+        if (r == -1 && errno == EINVAL) {
+            // Kernels before 5.14; read a byte of every page instead
+            ::madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+            for (auto a = start; a < end; a += mmap_page_size()) {
+                (void)*reinterpret_cast<const volatile char*>(a);
+            }
+            r = 0;
+        }
+        return wrap_syscall<int>(r);
+    }).then_wrapped([] (future<syscall_result<int>> f) {
+        f.ignore_ready_future();
+    });
 }
 
 future<>
@@ -218,7 +296,7 @@ posix_file_impl::stat() noexcept {
 
 future<>
 posix_file_impl::truncate(uint64_t length) noexcept {
-    return engine()._thread_pool->submit<syscall_result<int>>([this, length] {
+    return engine()._thread_pool->submit<syscall_result<int>>(syscall_kind::data, [this, length] {
         return wrap_syscall<int>(::ftruncate(_fd, length));
     }).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
@@ -270,7 +348,7 @@ posix_file_impl::fcntl_short(int op, uintptr_t arg) noexcept {
 
 future<>
 posix_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
-    return engine()._thread_pool->submit<syscall_result<int>>([this, offset, length] () mutable {
+    return engine()._thread_pool->submit<syscall_result<int>>(syscall_kind::data, [this, offset, length] () mutable {
         return wrap_syscall<int>(::fallocate(_fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
             offset, length));
     }).then([] (syscall_result<int> sr) {
@@ -287,7 +365,17 @@ posix_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
     if (!supported) {
         return make_ready_future<>();
     }
-    return engine()._thread_pool->submit<syscall_result<int>>([this, position, length] () mutable {
+    if (engine().have_async_metadata_ops()) {
+        auto req = internal::io_request::make_fallocate(_fd, FALLOC_FL_ZERO_RANGE|FALLOC_FL_KEEP_SIZE, position, length);
+        return engine().submit_metadata_op(std::move(req)).then([] (syscall_result<int> sr) {
+            if (sr.result == -1 && sr.error == EOPNOTSUPP) {
+                supported = false;
+                return;
+            }
+            sr.throw_if_error();
+        });
+    }
+    return engine()._thread_pool->submit<syscall_result<int>>(syscall_kind::data, [this, position, length] () mutable {
         auto ret = ::fallocate(_fd, FALLOC_FL_ZERO_RANGE|FALLOC_FL_KEEP_SIZE, position, length);
         if (ret == -1 && errno == EOPNOTSUPP) {
             ret = 0;
@@ -320,6 +408,7 @@ posix_file_impl::close() noexcept {
     }
     auto fd = _fd;
     _fd = -1;  // Prevent a concurrent close (which is illegal) from closing another file's fd
+    engine().unregister_file(fd);
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         _refcount = nullptr;
         return make_ready_future<>();
@@ -334,7 +423,7 @@ posix_file_impl::close() noexcept {
     } else {
         closed = std::invoke([fd] () noexcept {
             try {
-                return engine()._thread_pool->submit<syscall_result<int>>([fd] {
+                return engine()._thread_pool->submit<syscall_result<int>>(syscall_kind::data, [fd] {
                     return wrap_syscall<int>(::close(fd));
                 });
             } catch (...) {
@@ -428,6 +517,48 @@ coroutine::experimental::generator<directory_entry> posix_file_impl::experimenta
     return make_list_directory_generator(_fd);
 }
 
+coroutine::experimental::generator<directory_entry_view> posix_file_impl::experimental_list_directory_entries(list_directory_options opts) {
+    // linux_dirent64 needs 8 byte alignment, and the buffer must fit the longest name
+    auto buf = temporary_buffer<char>::aligned(alignof(linux_dirent64), std::max<size_t>(opts.buffer_size, sizeof(linux_dirent64) + NAME_MAX + 1));
+    // Reused across reads, so that big directories don't allocate per buffer
+    std::vector<const linux_dirent64*> ents;
+    std::vector<const char*> names;
+    std::vector<std::optional<stat_data>> stats;
+
+    while (true) {
+        auto size = co_await engine().read_directory(_fd, buf.get_write(), buf.size());
+        if (size == 0) {
+            co_return;
+        }
+
+        ents.clear();
+        for (const char* b = buf.get(); b < buf.get() + size; ) {
+            const auto de = reinterpret_cast<const linux_dirent64*>(b);
+            b += de->d_reclen;
+            std::string_view name(de->d_name);
+            if (name == "." || name == "..") {
+                continue;
+            }
+            ents.push_back(de);
+        }
+        if (opts.stat) {
+            names.clear();
+            for (auto de : ents) {
+                names.push_back(de->d_name);
+            }
+            stats.resize(ents.size());
+            co_await engine().stat_directory_entries(_fd, names, stats);
+        }
+        for (size_t i = 0; i < ents.size(); i++) {
+            directory_entry_view ret{ents[i]->d_name, dirent_type(*ents[i])};
+            if (opts.stat && stats[i]) {
+                ret.stat = &*stats[i];
+            }
+            co_yield ret;
+        }
+    }
+}
+
 subscription<directory_entry>
 posix_file_impl::list_directory(std::function<future<> (directory_entry de)> next) {
     static constexpr size_t buffer_size = 8192;
@@ -491,6 +622,22 @@ posix_file_impl::do_write_dma(uint64_t pos, std::vector<iovec> iov, internal::ma
     return _io_queue.submit_io_write(internal::priority_class(io_priority_class), len, std::move(req), intent, std::move(iov));
 }
 
+#if SEASTAR_API_LEVEL >= 7
+future<size_t>
+posix_file_impl::do_write_dma_and_flush(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept {
+    if ((_open_flags & open_flags::dsync) != open_flags{}) {
+        return do_write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent);
+    }
+    if (!engine().can_link_fdatasync()) {
+        return file_impl::write_dma_and_flush(pos, buffer, len, intent);
+    }
+    ++engine()._fsyncs;
+    auto req = internal::io_request::make_write(_fd, pos, buffer, len, _nowait_works);
+    req.set_fdatasync_after();
+    return _io_queue.submit_io_write(internal::priority_class(internal::maybe_priority_class_ref{}), len, std::move(req), intent);
+}
+#endif
+
 future<size_t>
 posix_file_impl::do_read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref io_priority_class, io_intent* intent) noexcept {
     auto req = internal::io_request::make_read(_fd, pos, buffer, len, _nowait_works);
@@ -529,6 +676,62 @@ posix_file_real_impl::dma_read_bulk(uint64_t offset, size_t range_size, internal
     return posix_file_impl::do_dma_read_bulk(offset, range_size, pc, intent);
 }
 
+future<size_t>
+posix_buffered_file_impl::do_io(bool write, uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept {
+    try {
+        return do_io(write, pos, std::vector<iovec>{iovec{const_cast<void*>(buffer), len}}, intent);
+    } catch (...) {
+        return current_exception_as_future<size_t>();
+    }
+}
+
+future<size_t>
+posix_buffered_file_impl::do_io(bool write, uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept {
+    size_t done = 0;
+#ifdef RWF_NOWAIT
+    bool& nowait = write ? _nowait_writes : _nowait_reads;
+    if (nowait) {
+        auto r = write ? ::pwritev2(_fd, iov.data(), iov.size(), pos, RWF_NOWAIT)
+                       : ::preadv2(_fd, iov.data(), iov.size(), pos, RWF_NOWAIT);
+        if (r >= 0) {
+            done = r;
+            // A read returning nothing is at eof, a short one may have
+            // stopped at a page which isn't cached, or at eof too; the
+            // syscall thread tells.
+            if ((!write && r == 0) || done == internal::iovec_len(iov)) {
+                return make_ready_future<size_t>(done);
+            }
+            pos += done;
+            auto it = iov.begin();
+            for (size_t skip = done; skip; ) {
+                if (skip >= it->iov_len) {
+                    skip -= it->iov_len;
+                    ++it;
+                } else {
+                    it->iov_base = static_cast<char*>(it->iov_base) + skip;
+                    it->iov_len -= skip;
+                    skip = 0;
+                }
+            }
+            iov.erase(iov.begin(), it);
+        } else if (errno == EOPNOTSUPP) {
+            nowait = false;
+        } else if (errno != EAGAIN) {
+            return make_exception_future<size_t>(std::system_error(errno, std::system_category(), write ? "pwritev2" : "preadv2"));
+        }
+    }
+#endif
+    // The syscall thread can't be stopped, so a cancelled request only
+    // learns about it once it's back
+    return engine()._thread_pool->submit<syscall_result<ssize_t>>(syscall_kind::data, [fd = _fd, write, pos, iov = std::move(iov)] {
+        return wrap_syscall<ssize_t>(write ? ::pwritev(fd, iov.data(), iov.size(), pos) : ::preadv(fd, iov.data(), iov.size(), pos));
+    }).then([done, iref = internal::intent_reference(intent)] (syscall_result<ssize_t> sr) {
+        iref.retrieve();
+        sr.throw_if_error();
+        return make_ready_future<size_t>(done + sr.result);
+    });
+}
+
 future<temporary_buffer<uint8_t>>
 posix_file_impl::do_dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
     using tmp_buf_type = typename internal::file_read_state<uint8_t>::tmp_buf_type;
@@ -596,7 +799,7 @@ posix_file_impl::read_maybe_eof(uint64_t pos, size_t len, internal::maybe_priori
     // We have to allocate a new aligned buffer to make sure we don't get
     // an EINVAL error due to unaligned destination buffer.
     //
-    temporary_buffer<uint8_t> buf = temporary_buffer<uint8_t>::aligned(
+    temporary_buffer<uint8_t> buf = internal::allocate_dma_buffer<uint8_t>(
                _memory_dma_alignment, align_up(len, size_t(_disk_read_dma_alignment)));
 
     // try to read a single bulk from the given position
@@ -653,7 +856,7 @@ blockdev_file_impl::truncate(uint64_t length) noexcept {
 
 future<>
 blockdev_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
-    return engine()._thread_pool->submit<syscall_result<int>>([this, offset, length] () mutable {
+    return engine()._thread_pool->submit<syscall_result<int>>(syscall_kind::data, [this, offset, length] () mutable {
         uint64_t range[2] { offset, length };
         return wrap_syscall<int>(::ioctl(_fd, BLKDISCARD, &range));
     }).then([] (syscall_result<int> sr) {
@@ -693,6 +896,182 @@ blockdev_file_impl::dma_read_bulk(uint64_t offset, size_t range_size, internal::
     return posix_file_impl::do_dma_read_bulk(offset, range_size, pc, intent);
 }
 
+nvme_passthrough_file_impl::nvme_passthrough_file_impl(int fd, open_flags f, file_open_options options, dev_t device_id, uint32_t nsid, unsigned lba_shift, uint64_t size)
+        : posix_file_impl(fd, f, options, device_id, false)
+        , _nsid(nsid)
+        , _lba_shift(lba_shift)
+        , _size(size) {
+    _disk_read_dma_alignment = 1u << lba_shift;
+    _disk_write_dma_alignment = 1u << lba_shift;
+    _disk_overwrite_dma_alignment = 1u << lba_shift;
+}
+
+future<size_t>
+nvme_passthrough_file_impl::do_io(uint8_t opcode, uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    const bool write = opcode == internal::io_request::nvme_cmd_write;
+    // Commands address whole logical blocks, like O_DIRECT wants it
+    if ((pos | len) & ((uint64_t(1) << _lba_shift) - 1)) {
+        return make_exception_future<size_t>(std::system_error(EINVAL, std::system_category()));
+    }
+    if (pos >= _size || len > _size - pos) {
+        if (write) {
+            return make_exception_future<size_t>(std::system_error(ENOSPC, std::system_category()));
+        }
+        // Short read at the end of the namespace
+        len = pos < _size ? _size - pos : 0;
+    }
+    if (len == 0) {
+        return make_ready_future<size_t>(0);
+    }
+    bool fua = write && (flags() & open_flags::dsync) != open_flags{};
+    auto req = internal::io_request::make_nvme_cmd(_fd, _nsid, opcode, _lba_shift, pos, buffer, len, fua);
+    auto& ioq = get_io_queue();
+    return write
+            ? ioq.submit_io_write(internal::priority_class(pc), len, std::move(req), intent)
+            : ioq.submit_io_read(internal::priority_class(pc), len, std::move(req), intent);
+}
+
+future<size_t>
+nvme_passthrough_file_impl::do_io(uint8_t opcode, uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    // Each iovec is a command of its own, they all go in parallel
+    try {
+        std::vector<future<size_t>> parts;
+        parts.reserve(iov.size());
+        for (auto& v : iov) {
+            parts.push_back(do_io(opcode, pos, v.iov_base, v.iov_len, pc, intent));
+            pos += v.iov_len;
+        }
+        return when_all_succeed(parts.begin(), parts.end()).then([] (std::vector<size_t> sizes) {
+            return std::accumulate(sizes.begin(), sizes.end(), size_t(0));
+        });
+    } catch (...) {
+        return current_exception_as_future<size_t>();
+    }
+}
+
+// Commands that don't move much data and are rare enough not to deserve the
+// ring, e.g. flush and deallocate
+future<int>
+nvme_passthrough_file_impl::do_io_command(uint8_t opcode, void* data, uint32_t data_len, uint32_t cdw10, uint32_t cdw11) noexcept {
+    return engine()._thread_pool->submit<syscall_result<int>>(syscall_kind::data, [this, opcode, data, data_len, cdw10, cdw11] {
+        ::nvme_passthru_cmd cmd = {};
+        cmd.opcode = opcode;
+        cmd.nsid = _nsid;
+        cmd.addr = reinterpret_cast<uintptr_t>(data);
+        cmd.data_len = data_len;
+        cmd.cdw10 = cdw10;
+        cmd.cdw11 = cdw11;
+        return wrap_syscall<int>(::ioctl(_fd, NVME_IOCTL_IO_CMD, &cmd));
+    }).then([opcode] (syscall_result<int> sr) {
+        sr.throw_if_error();
+        if (sr.result > 0) {
+            throw std::system_error(EIO, std::system_category(), fmt::format("NVMe command 0x{:x} failed with status 0x{:x}", opcode, sr.result));
+        }
+        return sr.result;
+    });
+}
+
+future<>
+nvme_passthrough_file_impl::flush() noexcept {
+    static constexpr uint8_t nvme_cmd_flush = 0x00;
+    ++engine()._fsyncs;
+    return do_io_command(nvme_cmd_flush, nullptr, 0, 0, 0).discard_result();
+}
+
+future<>
+nvme_passthrough_file_impl::truncate(uint64_t length) noexcept {
+    return make_ready_future<>();
+}
+
+future<>
+nvme_passthrough_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
+    static constexpr uint8_t nvme_cmd_dsm = 0x09;
+    static constexpr uint32_t nvme_dsm_deallocate = 1u << 2;
+    // A single Dataset Management range; the command takes up to 2^32 blocks
+    struct dsm_range {
+        uint32_t cattr;
+        uint32_t nlb;
+        uint64_t slba;
+    };
+    auto first = align_up(offset, uint64_t(1) << _lba_shift) >> _lba_shift;
+    auto last = align_down(std::min(offset + length, _size), uint64_t(1) << _lba_shift) >> _lba_shift;
+    if (last <= first) {
+        return make_ready_future<>();
+    }
+    return do_with(dsm_range{}, uint64_t(first), [this, last] (dsm_range& range, uint64_t& lba) {
+        return repeat([this, last, &range, &lba] () {
+            if (lba >= last) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto nlb = std::min<uint64_t>(last - lba, std::numeric_limits<uint32_t>::max());
+            range = { .cattr = 0, .nlb = uint32_t(nlb), .slba = lba };
+            lba += nlb;
+            return do_io_command(nvme_cmd_dsm, &range, sizeof(range), 0, nvme_dsm_deallocate).then([] (int) {
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
+future<>
+nvme_passthrough_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
+    // nothing to do for a raw namespace
+    return make_ready_future<>();
+}
+
+future<uint64_t>
+nvme_passthrough_file_impl::size() noexcept {
+    return make_ready_future<uint64_t>(_size);
+}
+
+std::unique_ptr<seastar::file_handle_impl>
+nvme_passthrough_file_impl::dup() {
+    // The handle would reopen it as a regular file; open the char device
+    // on every shard instead
+    throw std::system_error(ENOTSUP, std::system_category(), "dup() of NVMe passthrough files is not supported");
+}
+
+future<size_t>
+nvme_passthrough_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return do_io(internal::io_request::nvme_cmd_write, pos, buffer, len, pc, intent);
+}
+
+future<size_t>
+nvme_passthrough_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return do_io(internal::io_request::nvme_cmd_write, pos, std::move(iov), pc, intent);
+}
+
+future<size_t>
+nvme_passthrough_file_impl::read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return do_io(internal::io_request::nvme_cmd_read, pos, buffer, len, pc, intent);
+}
+
+future<size_t>
+nvme_passthrough_file_impl::read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return do_io(internal::io_request::nvme_cmd_read, pos, std::move(iov), pc, intent);
+}
+
+future<temporary_buffer<uint8_t>>
+nvme_passthrough_file_impl::dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    return posix_file_impl::do_dma_read_bulk(offset, range_size, pc, intent);
+}
+
+#if SEASTAR_API_LEVEL >= 7
+future<size_t>
+nvme_passthrough_file_impl::write_dma_and_flush(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept {
+    // Force unit access makes the data stable with the write itself
+    if (pos >= _size || len > _size - pos || ((pos | len) & ((uint64_t(1) << _lba_shift) - 1))) {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent);
+    }
+    if (len == 0) {
+        return make_ready_future<size_t>(0);
+    }
+    ++engine()._fsyncs;
+    auto req = internal::io_request::make_nvme_cmd(_fd, _nsid, internal::io_request::nvme_cmd_write, _lba_shift, pos, buffer, len, true);
+    return get_io_queue().submit_io_write(internal::priority_class(internal::maybe_priority_class_ref{}), len, std::move(req), intent);
+}
+#endif
+
 append_challenged_posix_file_impl::append_challenged_posix_file_impl(int fd, open_flags f, file_open_options options, const internal::fs_info& fsi, dev_t device_id)
         : posix_file_impl(fd, f, options, device_id, fsi)
         , _max_size_changing_ops(fsi.append_concurrency)
@@ -1030,10 +1409,22 @@ posix_file_handle_impl::clone() const {
     return ret;
 }
 
+// Whether I/O to a regular file goes through the page cache
+static bool is_buffered(int fd) noexcept {
+    auto r = ::fcntl(fd, F_GETFL);
+    return r != -1 && !(r & O_DIRECT);
+}
+
 shared_ptr<file_impl>
 posix_file_handle_impl::to_file() && {
-    auto ret = ::seastar::make_shared<posix_file_real_impl>(_fd, _open_flags, _refcount, _device_id,
-            _memory_dma_alignment, _disk_read_dma_alignment, _disk_write_dma_alignment, _disk_overwrite_dma_alignment, _nowait_works);
+    shared_ptr<file_impl> ret;
+    if (is_buffered(_fd)) {
+        ret = ::seastar::make_shared<posix_buffered_file_impl>(_fd, _open_flags, _refcount, _device_id,
+                _memory_dma_alignment, _disk_read_dma_alignment, _disk_write_dma_alignment, _disk_overwrite_dma_alignment, _nowait_works);
+    } else {
+        ret = ::seastar::make_shared<posix_file_real_impl>(_fd, _open_flags, _refcount, _device_id,
+                _memory_dma_alignment, _disk_read_dma_alignment, _disk_write_dma_alignment, _disk_overwrite_dma_alignment, _nowait_works);
+    }
     _fd = -1;
     _refcount = nullptr;
     return ret;
@@ -1054,6 +1445,97 @@ xfs_concurrency_from_kernel_version() {
     return 0;
 }
 
+// If rdev is the generic char device of an NVMe namespace (/dev/ngXnY),
+// returns the device number of its block device (/dev/nvmeXnY), whose I/O
+// queue it uses, or rdev itself if there is no such block device
+static std::optional<dev_t> nvme_generic_block_device(dev_t rdev) {
+    auto sys = fs::path(fmt::format("/sys/dev/char/{}:{}", major(rdev), minor(rdev)));
+    std::error_code ec;
+    if (fs::read_symlink(sys / "subsystem", ec).filename() != "nvme-generic" || ec) {
+        return std::nullopt;
+    }
+    auto name = fs::read_symlink(sys, ec).filename().string();
+    if (ec || !name.starts_with("ng")) {
+        return rdev;
+    }
+    try {
+        auto dev = read_first_line(fs::path("/sys/class/block") / ("nvme" + name.substr(2)) / "dev");
+        unsigned maj, min;
+        if (std::sscanf(dev.c_str(), "%u:%u", &maj, &min) == 2) {
+            return makedev(maj, min);
+        }
+    } catch (...) {
+    }
+    return rdev;
+}
+
+struct nvme_namespace_info {
+    uint32_t nsid;
+    unsigned lba_shift;
+    uint64_t size;
+};
+
+// Reads the namespace id, the size and the LBA format of the namespace
+// (Identify Namespace data structure, NVMe base specification)
+static syscall_result_extra<nvme_namespace_info> identify_nvme_namespace(int fd) {
+    static constexpr uint8_t nvme_admin_identify = 0x06;
+    nvme_namespace_info info{};
+    int nsid = ::ioctl(fd, NVME_IOCTL_ID);
+    if (nsid <= 0) {
+        return wrap_syscall(-1, info);
+    }
+    info.nsid = nsid;
+    auto id = allocate_aligned_buffer<uint8_t>(4096, 4096);
+    ::nvme_admin_cmd cmd = {};
+    cmd.opcode = nvme_admin_identify;
+    cmd.nsid = info.nsid;
+    cmd.addr = reinterpret_cast<uintptr_t>(id.get());
+    cmd.data_len = 4096;
+    auto r = ::ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
+    if (r != 0) {
+        if (r > 0) {
+            errno = EIO;
+        }
+        return wrap_syscall(-1, info);
+    }
+    auto le = [&] (unsigned off, unsigned bytes) {
+        uint64_t v = 0;
+        for (unsigned i = 0; i < bytes; ++i) {
+            v |= uint64_t(id[off + i]) << (8 * i);
+        }
+        return v;
+    };
+    uint64_t nsze = le(0, 8);
+    uint8_t flbas = id[26];
+    unsigned format = (flbas & 0xf) | ((flbas >> 5) & 0x3) << 4;
+    auto lbaf = 128 + 4 * format;
+    unsigned metadata_size = le(lbaf, 2);
+    info.lba_shift = id[lbaf + 2];
+    info.size = nsze << info.lba_shift;
+    if (metadata_size != 0 || info.lba_shift < 9) {
+        // Formats with per block metadata would need a metadata buffer
+        // with every command
+        errno = ENOTSUP;
+        return wrap_syscall(-1, info);
+    }
+    return wrap_syscall(0, info);
+}
+
+future<shared_ptr<file_impl>>
+nvme_passthrough_file_impl::make(int fd, file_open_options options, int flags, dev_t block_dev) noexcept {
+    if (!engine().enable_nvme_passthrough()) {
+        return make_exception_future<shared_ptr<file_impl>>(std::system_error(ENOTSUP, std::system_category(),
+                "NVMe passthrough needs the io_uring reactor backend"));
+    }
+    return engine()._thread_pool->submit<syscall_result_extra<nvme_namespace_info>>([fd] {
+        return identify_nvme_namespace(fd);
+    }).then([fd, options = std::move(options), flags, block_dev] (syscall_result_extra<nvme_namespace_info> sr) {
+        sr.throw_if_error();
+        auto& ns = sr.extra;
+        return shared_ptr<file_impl>(make_shared<nvme_passthrough_file_impl>(fd, open_flags(flags), options, block_dev, ns.nsid, ns.lba_shift, ns.size));
+    });
+}
+
 future<shared_ptr<file_impl>>
 make_file_impl(int fd, file_open_options options, int flags, struct stat st) noexcept {
     if (S_ISBLK(st.st_mode)) {
@@ -1066,6 +1548,12 @@ make_file_impl(int fd, file_open_options options, int flags, struct stat st) noe
         return make_ready_future<shared_ptr<file_impl>>(make_shared<blockdev_file_impl>(fd, open_flags(flags), options, st.st_rdev, block_size));
     }
 
+    if (S_ISCHR(st.st_mode)) {
+        if (auto block_dev = nvme_generic_block_device(st.st_rdev)) {
+            return nvme_passthrough_file_impl::make(fd, std::move(options), flags, *block_dev);
+        }
+    }
+
     if (S_ISDIR(st.st_mode)) {
         // Directories don't care about block size, so we need not
         // query it here. Just provide something reasonable.
@@ -1130,6 +1618,10 @@ make_file_impl(int fd, file_open_options options, int flags, struct stat st) noe
         });
     return get_fs_info.then([st_dev, fd, flags, options = std::move(options)] () mutable {
         const internal::fs_info& fsi = s_fstype[st_dev];
+        // The append quirks of linux-aio don't apply to buffered syscalls
+        if (is_buffered(fd)) {
+            return make_ready_future<shared_ptr<file_impl>>(make_shared<posix_buffered_file_impl>(fd, open_flags(flags), std::move(options), fsi, st_dev));
+        }
         if (!fsi.append_challenged || options.append_is_unlikely || ((flags & O_ACCMODE) == O_RDONLY)) {
             return make_ready_future<shared_ptr<file_impl>>(make_shared<posix_file_real_impl>(fd, open_flags(flags), std::move(options), fsi, st_dev));
         }
@@ -1165,6 +1657,10 @@ coroutine::experimental::generator<directory_entry> file::experimental_list_dire
     return _file_impl->experimental_list_directory();
 }
 
+coroutine::experimental::generator<directory_entry_view> file::experimental_list_directory_entries(list_directory_options opts) {
+    return _file_impl->experimental_list_directory_entries(opts);
+}
+
 future<int> file::ioctl(uint64_t cmd, void* argp) noexcept {
     return _file_impl->ioctl(cmd, argp);
 }
@@ -1307,6 +1803,17 @@ file::dma_write_impl(uint64_t pos, const uint8_t* buffer, size_t len, internal::
   }
 }
 
+#if SEASTAR_API_LEVEL >= 7
+future<size_t>
+file::dma_write_and_flush_impl(uint64_t pos, const uint8_t* buffer, size_t len, io_intent* intent) noexcept {
+  try {
+    return _file_impl->write_dma_and_flush(pos, buffer, len, intent);
+  } catch (...) {
+    return current_exception_as_future<size_t>();
+  }
+}
+#endif
+
 future<size_t> file::dma_read_impl(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
   try {
 #if SEASTAR_API_LEVEL >= 7
@@ -1392,6 +1899,29 @@ coroutine::experimental::generator<directory_entry> file_impl::experimental_list
     return make_list_directory_fallback_generator(*this);
 }
 
+static coroutine::experimental::generator<directory_entry_view> make_list_directory_entries_fallback_generator(file_impl& me) {
+    auto lister = me.experimental_list_directory();
+    while (auto de = co_await lister()) {
+        co_yield directory_entry_view{de->name, de->type};
+    }
+}
+
+coroutine::experimental::generator<directory_entry_view> file_impl::experimental_list_directory_entries(list_directory_options opts) {
+    // Without a directory descriptor there is nothing to look the entries up
+    // relative to, so opts.stat is ignored
+    return make_list_directory_entries_fallback_generator(*this);
+}
+
+#if SEASTAR_API_LEVEL >= 7
+future<size_t> file_impl::write_dma_and_flush(uint64_t pos, const void* buffer, size_t len, io_intent* intent) {
+    return write_dma(pos, buffer, len, intent).then([this] (size_t written) {
+        return flush().then([written] {
+            return written;
+        });
+    });
+}
+#endif
+
 future<int> file_impl::ioctl(uint64_t cmd, void* argp) noexcept {
     return make_exception_future<int>(std::runtime_error("this file type does not support ioctl"));
 }
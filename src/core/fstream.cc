@@ -28,6 +28,8 @@ module;
 #include <malloc.h>
 #include <string.h>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <ratio>
 #include <optional>
 #include <utility>
@@ -42,6 +44,8 @@ module seastar;
 #include <seastar/core/reactor.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/internal/dma_buffer_pool.hh>
+#include "core/file-impl.hh"
 #endif
 
 namespace seastar {
@@ -89,6 +93,8 @@ class file_data_source_impl : public data_source_impl {
         uint64_t _pos;
         uint64_t _size;
         future<temporary_buffer<char>> _ready;
+        // The gap the consumer is expected to skip after this read (strided mode)
+        uint64_t _skip_after = 0;
 
         issued_read(uint64_t pos, uint64_t size, future<temporary_buffer<char>> f)
             : _pos(pos), _size(size), _ready(std::move(f)) { }
@@ -108,6 +114,28 @@ class file_data_source_impl : public data_source_impl {
     bool _in_slow_start = false;
     io_intent _intent;
     using unused_ratio_target = std::ratio<25, 100>;
+
+    // Adaptive read-ahead, see file_input_stream_options::adaptive_read_ahead
+    using clock_type = std::chrono::steady_clock;
+    std::chrono::duration<double> _read_latency = std::chrono::duration<double>(0);
+    std::chrono::duration<double> _consume_interval = std::chrono::duration<double>(0);
+    clock_type::time_point _last_get;
+    // Where the consumer is, _pos is where the next read-ahead starts
+    uint64_t _consumer_pos;
+    // Strided access detection: the consumer repeatedly reads a record and
+    // skips a gap of the same sizes. Once detected, only the records are
+    // read and the consumer is expected to skip the gaps
+    struct stride {
+        uint64_t record = 0;
+        uint64_t gap = 0;
+        bool operator==(const stride&) const = default;
+    };
+    stride _stride;
+    unsigned _stride_repeats = 0;
+    uint64_t _consumed_since_skip = 0;
+    bool _strided = false;
+    uint64_t _expected_skip = 0;
+    static constexpr unsigned stride_detect_repeats = 2;
 private:
     size_t minimal_buffer_size() const {
         return std::min(std::max(_options.buffer_size / 4, size_t(8192)), _options.buffer_size);
@@ -125,6 +153,66 @@ class file_data_source_impl : public data_source_impl {
             }
         }
     }
+    unsigned max_read_ahead() const noexcept {
+        return _options.adaptive_read_ahead && !_options.read_ahead
+               ? file_input_stream_options::default_adaptive_read_ahead
+               : _options.read_ahead;
+    }
+    template <typename Rep, typename Period>
+    static void update_moving_average(std::chrono::duration<double>& avg, std::chrono::duration<Rep, Period> sample) noexcept {
+        auto s = std::chrono::duration_cast<std::chrono::duration<double>>(sample);
+        avg = avg.count() == 0 ? s : avg * 0.75 + s * 0.25;
+    }
+    // Keep enough reads in flight to cover the read latency at the rate the
+    // consumer asks for buffers. A consumer that stops for longer than the
+    // reads take pulls the average interval up and the read-ahead down, so
+    // prefetching fades out instead of piling up buffers nobody reads.
+    void adapt_read_ahead() noexcept {
+        auto now = clock_type::now();
+        if (_last_get != clock_type::time_point()) {
+            update_moving_average(_consume_interval, now - _last_get);
+        }
+        _last_get = now;
+        if (_read_latency.count() == 0 || _consume_interval.count() == 0 || _in_slow_start) {
+            return;
+        }
+        auto wanted = std::ceil(_read_latency / _consume_interval);
+        _current_read_ahead = std::min<double>(wanted, max_read_ahead());
+    }
+    void note_skip(uint64_t n) {
+        stride s{_consumed_since_skip, n};
+        _consumed_since_skip = 0;
+        if (s == _stride) {
+            _stride_repeats++;
+        } else {
+            _stride = s;
+            _stride_repeats = 0;
+        }
+        // Gaps smaller than a block are cheaper to read than to skip
+        if (!_strided && _stride_repeats >= stride_detect_repeats
+                && s.record && s.record <= _options.buffer_size && s.gap >= _file.disk_read_dma_alignment()) {
+            // Re-issue what was read ahead contiguously, now skipping the gaps
+            rewind_read_aheads(_consumer_pos);
+            _strided = true;
+        }
+    }
+    // Drops all read-aheads and restarts reading at \c pos, leaving the
+    // strided mode
+    void rewind_read_aheads(uint64_t pos) {
+        uint64_t dropped = 0;
+        for (auto&& c : _read_buffers) {
+            _reactor._io_stats.fstream_read_aheads_discarded += 1;
+            _reactor._io_stats.fstream_read_ahead_discarded_bytes += c._size;
+            dropped += c._size;
+            ignore_read_future(std::move(c._ready));
+        }
+        _read_buffers.clear();
+        _remain += _pos - pos;
+        _pos = pos;
+        _strided = false;
+        _expected_skip = 0;
+        update_history_unused(dropped);
+    }
     unsigned get_initial_read_ahead() const {
         return _options.dynamic_adjustments
                ? std::min(_options.dynamic_adjustments->read_ahead, _options.read_ahead)
@@ -217,6 +305,7 @@ class file_data_source_impl : public data_source_impl {
 public:
     file_data_source_impl(file f, uint64_t offset, uint64_t len, file_input_stream_options options)
             : _file(std::move(f)), _options(options), _pos(offset), _remain(len), _current_read_ahead(get_initial_read_ahead())
+            , _consumer_pos(offset)
     {
         _options.buffer_size = select_buffer_size(_options.buffer_size, _file.disk_read_max_length());
         _current_buffer_size = _options.buffer_size;
@@ -230,12 +319,21 @@ class file_data_source_impl : public data_source_impl {
         assert(_reads_in_progress == 0);
     }
     virtual future<temporary_buffer<char>> get() override {
-        if (!_read_buffers.empty() && !_read_buffers.front()._ready.available()) {
+        if (_expected_skip) {
+            // The consumer wants the gap after all
+            rewind_read_aheads(_consumer_pos);
+        }
+        if (_options.adaptive_read_ahead) {
+            adapt_read_ahead();
+        } else if (!_read_buffers.empty() && !_read_buffers.front()._ready.available()) {
             try_increase_read_ahead();
         }
         issue_read_aheads(1);
         auto ret = std::move(_read_buffers.front());
         _read_buffers.pop_front();
+        _consumer_pos = ret._pos + ret._size;
+        _consumed_since_skip += ret._size;
+        _expected_skip = ret._skip_after;
         update_history_consumed(ret._size);
         _reactor._io_stats.fstream_reads += 1;
         _reactor._io_stats.fstream_read_bytes += ret._size;
@@ -246,6 +344,18 @@ class file_data_source_impl : public data_source_impl {
         return std::move(ret._ready);
     }
     virtual future<temporary_buffer<char>> skip(uint64_t n) override {
+        if (_expected_skip) {
+            if (n == _expected_skip) {
+                _consumer_pos += n;
+                _expected_skip = 0;
+                return make_ready_future<temporary_buffer<char>>();
+            }
+            rewind_read_aheads(_consumer_pos);
+        }
+        if (_options.adaptive_read_ahead) {
+            note_skip(n);
+        }
+        _consumer_pos += n;
         uint64_t dropped = 0;
         while (n) {
             if (_read_buffers.empty()) {
@@ -313,14 +423,20 @@ class file_data_source_impl : public data_source_impl {
             // Also avoid reading beyond _remain.
             uint64_t align = _file.disk_read_dma_alignment();
             auto start = align_down(_pos, align);
-            auto end = std::min(align_up(start + _current_buffer_size, align), _pos + _remain);
+            auto end = _strided
+                    ? std::min(_pos + _stride.record, _pos + _remain)
+                    : std::min(align_up(start + _current_buffer_size, align), _pos + _remain);
             auto len = end - start;
             auto actual_size = std::min(end - _pos, _remain);
+            auto issued = _options.adaptive_read_ahead ? clock_type::now() : clock_type::time_point();
             _read_buffers.emplace_back(_pos, actual_size, futurize_invoke([&] {
                     return _file.dma_read_bulk_impl(start, len, get_io_priority(_options), &_intent);
             }).then_wrapped(
-                    [this, start, pos = _pos, remain = _remain] (future<temporary_buffer<uint8_t>> ret) {
+                    [this, start, pos = _pos, remain = _remain, issued] (future<temporary_buffer<uint8_t>> ret) {
                 --_reads_in_progress;
+                if (issued != clock_type::time_point()) {
+                    update_moving_average(_read_latency, clock_type::now() - issued);
+                }
                 if (_done && !_reads_in_progress) {
                     _done->set_value();
                 }
@@ -345,6 +461,12 @@ class file_data_source_impl : public data_source_impl {
             }));
             _remain -= end - _pos;
             _pos = end;
+            if (_strided) {
+                auto gap = std::min(_stride.gap, _remain);
+                _read_buffers.back()._skip_after = gap;
+                _remain -= gap;
+                _pos += gap;
+            }
         };
     }
 };
@@ -372,6 +494,139 @@ input_stream<char> make_file_input_stream(
     return make_file_input_stream(std::move(f), 0, std::move(options));
 }
 
+// Hands out slices of a read-only mapping of the file. The consumer only
+// gets buffers whose pages were faulted in by the syscall thread.
+class mmap_data_source_impl final : public data_source_impl {
+    file _file;
+    uint64_t _offset;
+    uint64_t _len;
+    mmap_input_stream_options _options;
+    bool _mapped = false;
+    temporary_buffer<char> _map;
+    size_t _pos = 0;
+    // Up to where page-ins were requested and completed
+    size_t _requested = 0;
+    size_t _populated = 0;
+    future<> _prefault = make_ready_future<>();
+private:
+    future<> map() {
+        // Pages past the end of the file can't be touched, whatever the
+        // length asked for
+        auto len = _file.size().then([this] (uint64_t size) {
+            return std::min(_len, size - std::min(size, _offset));
+        });
+        return len.then([this] (uint64_t len) {
+            _mapped = true;
+            if (!len) {
+                return make_ready_future<>();
+            }
+            return posix_file_impl::of(_file)->map(_offset, len).then([this] (temporary_buffer<char> m) {
+                _map = std::move(m);
+            });
+        });
+    }
+    future<> populate(size_t to) {
+        if (to <= _requested) {
+            return make_ready_future<>();
+        }
+        auto from = std::exchange(_requested, to);
+        return posix_file_impl::prefault(_map.get() + from, to - from).then([this, to] {
+            _populated = std::max(_populated, to);
+        });
+    }
+    temporary_buffer<char> next_buffer(size_t n) {
+        auto buf = _map.share(_pos, n);
+        _pos += n;
+        auto want = std::min(_map.size(), _pos + _options.read_ahead);
+        if (_requested < want && _prefault.available()) {
+            _prefault = populate(want);
+        }
+        return buf;
+    }
+public:
+    mmap_data_source_impl(file f, uint64_t offset, uint64_t len, mmap_input_stream_options options)
+        : _file(std::move(f)), _offset(offset), _len(len), _options(options) {
+    }
+    virtual future<temporary_buffer<char>> get() override {
+        if (!_mapped) {
+            return map().then([this] {
+                return get();
+            });
+        }
+        if (_pos == _map.size()) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        size_t n = std::min(_options.buffer_size, _map.size() - _pos);
+        if (_populated < _pos + n) {
+            return std::exchange(_prefault, make_ready_future<>()).then([this, n] {
+                return populate(_pos + n);
+            }).then([this, n] {
+                return next_buffer(n);
+            });
+        }
+        return make_ready_future<temporary_buffer<char>>(next_buffer(n));
+    }
+    virtual future<temporary_buffer<char>> skip(uint64_t n) override {
+        if (!_mapped) {
+            return map().then([this, n] {
+                return skip(n);
+            });
+        }
+        _pos += std::min<uint64_t>(n, _map.size() - _pos);
+        _requested = std::max(_requested, _pos);
+        return make_ready_future<temporary_buffer<char>>();
+    }
+    virtual future<> close() override {
+        return std::exchange(_prefault, make_ready_future<>()).then([this] {
+            // The buffers still held keep the mapping
+            _map = {};
+        });
+    }
+};
+
+input_stream<char> make_mmap_input_stream(
+        file f, uint64_t offset, uint64_t len, mmap_input_stream_options options) {
+    if (!posix_file_impl::of(f)) {
+        file_input_stream_options fopts;
+        fopts.buffer_size = options.buffer_size;
+        return make_file_input_stream(std::move(f), offset, len, std::move(fopts));
+    }
+    return input_stream<char>(data_source(std::make_unique<mmap_data_source_impl>(std::move(f), offset, len, options)));
+}
+
+input_stream<char> make_mmap_input_stream(
+        file f, mmap_input_stream_options options) {
+    return make_mmap_input_stream(std::move(f), 0, std::numeric_limits<uint64_t>::max(), options);
+}
+
+
+write_behind_budget::~write_behind_budget() {
+    assert(_waiters.empty());
+}
+
+future<> write_behind_budget::acquire(size_t bytes, unsigned priority) {
+    // Don't overtake writers already held back, even if this one fits
+    if (_waiters.empty() && fits(bytes)) {
+        _dirty += bytes;
+        return make_ready_future<>();
+    }
+    ++_throttled;
+    auto it = _waiters.emplace(std::make_pair(priority, _next_seq++), waiter{bytes, promise<>()}).first;
+    return it->second.pr.get_future();
+}
+
+void write_behind_budget::release(size_t bytes) noexcept {
+    _dirty -= bytes;
+    while (!_waiters.empty()) {
+        auto it = _waiters.begin();
+        if (!fits(it->second.bytes)) {
+            break;
+        }
+        _dirty += it->second.bytes;
+        it->second.pr.set_value();
+        _waiters.erase(it);
+    }
+}
 
 class file_data_sink_impl : public data_sink_impl {
     file _file;
@@ -388,14 +643,24 @@ class file_data_sink_impl : public data_sink_impl {
     }
     future<> put(net::packet data) override { abort(); }
     virtual temporary_buffer<char> allocate_buffer(size_t size) override {
-        return temporary_buffer<char>::aligned(_file.memory_dma_alignment(), size);
+        return internal::allocate_dma_buffer<char>(_file.memory_dma_alignment(), size);
     }
     using data_sink_impl::put;
     virtual future<> put(temporary_buffer<char> buf) override {
         uint64_t pos = _pos;
         _pos += buf.size();
+        if (!_options.dirty_budget) {
+            return write_behind(pos, std::move(buf));
+        }
+        // Hold the writer back until the budget has room for the buffer
+        return _options.dirty_budget->acquire(buf.size(), _options.dirty_priority).then([this, pos, buf = std::move(buf)] () mutable {
+            return write_behind(pos, std::move(buf));
+        });
+    }
+private:
+    future<> write_behind(uint64_t pos, temporary_buffer<char> buf) {
         if (!_options.write_behind) {
-            return do_put(pos, std::move(buf));
+            return write(pos, std::move(buf));
         }
         // Write behind strategy:
         //
@@ -404,12 +669,13 @@ class file_data_sink_impl : public data_sink_impl {
         // 3. If we've already seen a failure, don't issue more writes.
         return _write_behind_sem.wait().then([this, pos, buf = std::move(buf)] () mutable {
             if (_failed) {
+                release_dirty(buf.size());
                 _write_behind_sem.signal();
                 auto ret = std::move(_background_writes_done);
                 _background_writes_done = make_ready_future<>();
                 return ret;
             }
-            auto this_write_done = do_put(pos, std::move(buf)).finally([this] {
+            auto this_write_done = write(pos, std::move(buf)).finally([this] {
                 _write_behind_sem.signal();
             });
             _background_writes_done = when_all(std::move(_background_writes_done), std::move(this_write_done))
@@ -430,7 +696,21 @@ class file_data_sink_impl : public data_sink_impl {
             return make_ready_future<>();
         });
     }
-private:
+    void release_dirty(size_t size) noexcept {
+        if (_options.dirty_budget) {
+            _options.dirty_budget->release(size);
+        }
+    }
+    // Writes the buffer, returning its size to the dirty budget once done
+    future<> write(uint64_t pos, temporary_buffer<char> buf) noexcept {
+        if (!_options.dirty_budget) {
+            return do_put(pos, std::move(buf));
+        }
+        auto size = buf.size();
+        return do_put(pos, std::move(buf)).finally([this, size] {
+            release_dirty(size);
+        });
+    }
     future<> do_put(uint64_t pos, temporary_buffer<char> buf) noexcept {
       try {
         // put() must usually be of chunks multiple of file::dma_alignment.
@@ -0,0 +1,131 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <exception>
+#include <vector>
+#include <sys/uio.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/io_batch.hh>
+#include <seastar/core/io_intent.hh>
+#endif
+
+namespace seastar {
+
+size_t io_batch::add(file& f, uint64_t pos, char* buffer, size_t len, std::vector<iovec> iov, op_kind kind) {
+    _ops.push_back(op{f, pos, buffer, len, std::move(iov), kind});
+    return _ops.size() - 1;
+}
+
+size_t io_batch::add_read(file& f, uint64_t pos, void* buffer, size_t len) {
+    return add(f, pos, static_cast<char*>(buffer), len, {}, op_kind::read);
+}
+
+size_t io_batch::add_read(file& f, uint64_t pos, std::vector<iovec> iov) {
+    return add(f, pos, nullptr, 0, std::move(iov), op_kind::read);
+}
+
+size_t io_batch::add_write(file& f, uint64_t pos, const void* buffer, size_t len) {
+    return add(f, pos, static_cast<char*>(const_cast<void*>(buffer)), len, {}, op_kind::write);
+}
+
+size_t io_batch::add_write(file& f, uint64_t pos, std::vector<iovec> iov) {
+    return add(f, pos, nullptr, 0, std::move(iov), op_kind::write);
+}
+
+future<size_t> io_batch::issue(op& o, io_intent* intent) noexcept {
+    // The scatter list is only needed until the request is queued, so hand
+    // over a copy and keep the original for resubmissions of the batch
+    if (o.kind == op_kind::read) {
+        if (o.buffer) {
+            return o.f.dma_read<char>(o.pos, o.buffer, o.len, intent);
+        }
+        try {
+            return o.f.dma_read(o.pos, o.iov, intent);
+        } catch (...) {
+            return current_exception_as_future<size_t>();
+        }
+    } else {
+        if (o.buffer) {
+            return o.f.dma_write<char>(o.pos, o.buffer, o.len, intent);
+        }
+        try {
+            return o.f.dma_write(o.pos, o.iov, intent);
+        } catch (...) {
+            return current_exception_as_future<size_t>();
+        }
+    }
+}
+
+void io_batch::complete(op& o, future<size_t> f) noexcept {
+    if (f.failed()) {
+        o.ex = f.get_exception();
+    } else {
+        o.result = f.get();
+    }
+    if (--_pending == 0) {
+        _done.set_value();
+    }
+}
+
+future<> io_batch::submit(io_intent* intent) noexcept {
+    if (_ops.empty()) {
+        return make_ready_future<>();
+    }
+    _done = promise<>();
+    auto ret = _done.get_future();
+    // Hold a reference for the loop itself, so that operations completing
+    // synchronously don't resolve the batch before all of them are issued
+    _pending = _ops.size() + 1;
+    for (auto& o : _ops) {
+        o.result = 0;
+        o.ex = nullptr;
+        auto f = issue(o, intent);
+        if (f.available()) {
+            complete(o, std::move(f));
+        } else {
+            // The batch is kept alive by the caller until ret resolves
+            (void)f.then_wrapped([this, &o] (future<size_t> f) noexcept {
+                complete(o, std::move(f));
+            });
+        }
+    }
+    if (--_pending == 0) {
+        _done.set_value();
+    }
+    return ret;
+}
+
+size_t io_batch::bytes(size_t i) const {
+    auto& o = _ops[i];
+    if (o.ex) {
+        std::rethrow_exception(o.ex);
+    }
+    return o.result;
+}
+
+}
@@ -23,6 +23,7 @@
 module;
 #endif
 
+#include <algorithm>
 #include <compare>
 #include <atomic>
 #include <cassert>
@@ -49,6 +50,8 @@ module seastar;
 #include <seastar/core/metrics.hh>
 #include <seastar/core/linux-aio.hh>
 #include <seastar/core/internal/io_desc.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/internal/event_trace.hh>
 #include <seastar/core/internal/io_sink.hh>
 #include <seastar/core/io_priority_class.hh>
 #include <seastar/util/log.hh>
@@ -75,7 +78,14 @@ struct io_group::priority_class_data {
 
     static constexpr uint64_t bandwidth_burst_in_blocks = 10 << (20 - io_queue::block_size_shift); // 10MB
     static constexpr uint64_t bandwidth_threshold_in_blocks = 128 << (10 - io_queue::block_size_shift); // 128kB
+    static constexpr uint64_t iops_burst = 100;
+    static constexpr uint64_t iops_threshold = 4;
     token_bucket_t tb;
+    // Requests, only consulted when limited not to touch it on every dispatch.
+    // The class data is shared by the shards of the group, all of which
+    // apply limit updates.
+    token_bucket_t ops_tb;
+    std::atomic<bool> ops_limited = false;
 
     uint64_t tokens(size_t length) const noexcept {
         return length >> io_queue::block_size_shift;
@@ -90,8 +100,24 @@ struct io_group::priority_class_data {
         tb.update_rate(tokens(bandwidth));
     }
 
+    void update_limits(const io_limits& limits) {
+        if (limits.iops > ops_tb.max_rate) {
+            throw std::runtime_error(format("Too large IOPS rate, maximum is {}", ops_tb.max_rate));
+        }
+        if (limits.bandwidth) {
+            update_bandwidth(limits.bandwidth);
+        } else {
+            tb.update_rate(std::numeric_limits<uint64_t>::max());
+        }
+        tb.update_limit(std::max<uint64_t>(tokens(limits.bandwidth_burst), 1));
+        ops_tb.update_rate(limits.iops ? limits.iops : std::numeric_limits<uint64_t>::max());
+        ops_tb.update_limit(std::max<uint64_t>(limits.iops_burst, 1));
+        ops_limited.store(limits.iops != 0, std::memory_order_relaxed);
+    }
+
     priority_class_data() noexcept
             : tb(std::numeric_limits<uint64_t>::max(), bandwidth_burst_in_blocks, bandwidth_threshold_in_blocks)
+            , ops_tb(std::numeric_limits<uint64_t>::max(), iops_burst, iops_threshold)
     {
     }
 };
@@ -116,16 +142,37 @@ class io_queue::priority_class_data {
     std::chrono::duration<double> _total_execution_time;
     std::chrono::duration<double> _starvation_time;
     io_queue::clock_type::time_point _activated;
+    // Fed by sampled requests only, see io_queue::config::request_sample_rate
+    metrics::internal::short_time_estimated_histogram _sampled_queue_time;
+    metrics::internal::short_time_estimated_histogram _sampled_device_time;
 
     io_group::priority_class_data& _group;
     size_t _replenish_head;
+    size_t _replenish_ops_head;
     timer<lowres_clock> _replenish;
 
+    // How long until both buckets cover what was grabbed from them
+    std::chrono::microseconds throttle_time() const noexcept {
+        std::chrono::duration<double> wait{0};
+        if (auto delta = _group.tb.deficiency(_replenish_head); delta > 0) {
+            wait = _group.tb.duration_for(delta);
+        }
+        if (_group.ops_limited.load(std::memory_order_relaxed)) {
+            if (auto delta = _group.ops_tb.deficiency(_replenish_ops_head); delta > 0) {
+                wait = std::max(wait, _group.ops_tb.duration_for(delta));
+            }
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(wait);
+    }
+
     void try_to_replenish() noexcept {
-        _group.tb.replenish(io_queue::clock_type::now());
-        auto delta = _group.tb.deficiency(_replenish_head);
-        if (delta > 0) {
-            _replenish.arm(std::chrono::duration_cast<std::chrono::microseconds>(_group.tb.duration_for(delta)));
+        auto now = io_queue::clock_type::now();
+        _group.tb.replenish(now);
+        if (_group.ops_limited.load(std::memory_order_relaxed)) {
+            _group.ops_tb.replenish(now);
+        }
+        if (_group.tb.deficiency(_replenish_head) > 0 || (_group.ops_limited.load(std::memory_order_relaxed) && _group.ops_tb.deficiency(_replenish_ops_head) > 0)) {
+            _replenish.arm(throttle_time());
         } else {
             _queue.unthrottle_priority_class(*this);
         }
@@ -141,6 +188,12 @@ class io_queue::priority_class_data {
         io_log.debug("Updated {} class bandwidth to {}MB/s", _pc.id(), bandwidth >> 20);
     }
 
+    void update_limits(const io_limits& limits) {
+        _group.update_limits(limits);
+        io_log.debug("Updated {} class limits to {}MB/s ({}MB burst), {} IOPS ({} burst)", _pc.id(),
+                limits.bandwidth >> 20, limits.bandwidth_burst >> 20, limits.iops, limits.iops_burst);
+    }
+
     priority_class_data(internal::priority_class pc, uint32_t shares, io_queue& q, io_group::priority_class_data& pg)
         : _queue(q)
         , _pc(pc)
@@ -152,6 +205,8 @@ class io_queue::priority_class_data {
         , _total_execution_time(0)
         , _starvation_time(0)
         , _group(pg)
+        , _replenish_head(0)
+        , _replenish_ops_head(0)
         , _replenish([this] { try_to_replenish(); })
     {
     }
@@ -177,11 +232,16 @@ class io_queue::priority_class_data {
 
         auto tokens = _group.tokens(dnl.length());
         auto ph = _group.tb.grab(tokens);
-        auto delta = _group.tb.deficiency(ph);
-        if (delta > 0) {
+        bool throttle = _group.tb.deficiency(ph) > 0;
+        if (_group.ops_limited.load(std::memory_order_relaxed)) {
+            auto oh = _group.ops_tb.grab(1);
+            throttle |= _group.ops_tb.deficiency(oh) > 0;
+            _replenish_ops_head = oh;
+        }
+        if (throttle) {
             _queue.throttle_priority_class(*this);
             _replenish_head = ph;
-            _replenish.arm(std::chrono::duration_cast<std::chrono::microseconds>(_group.tb.duration_for(delta)));
+            _replenish.arm(throttle_time());
         }
     }
 
@@ -208,22 +268,45 @@ class io_queue::priority_class_data {
         _splits.add(dnl.length());
     }
 
+    void on_sampled(io_queue::clock_type::duration queue_time, io_queue::clock_type::duration device_time) noexcept {
+        _sampled_queue_time.add(queue_time);
+        _sampled_device_time.add(device_time);
+    }
+
     fair_queue::class_id fq_class() const noexcept { return _pc.id(); }
 
     std::vector<seastar::metrics::impl::metric_definition_impl> metrics();
     metrics::metric_groups metric_groups;
 };
 
-class io_desc_read_write final : public io_completion {
+class io_desc_read_write final : public io_completion, public internal::cancellable_queue::in_flight_link {
     io_queue& _ioq;
     io_queue::priority_class_data& _pclass;
     io_queue::clock_type::time_point _ts;
+    // Set on dispatch for sampled requests, when _ts moves to the dispatch time
+    io_queue::clock_type::time_point _queued_ts;
     const stream_id _stream;
     const io_direction_and_length _dnl;
     const fair_queue_entry::capacity_t _fq_capacity;
+    const bool _sampled;
+    // Cancelled after dispatch, the capacity is returned already and the
+    // completion resolves the future with cancelled_error
+    bool _cancelled = false;
     promise<size_t> _pr;
     iovec_keeper _iovs;
 
+    void log_sample(io_queue::clock_type::time_point now) noexcept {
+        _pclass.on_sampled(_ts - _queued_ts, now - _ts);
+        _ioq.log_sampled_request(io_queue::sampled_request{
+            .queued = _queued_ts,
+            .dispatched = _ts,
+            .completed = now,
+            .class_id = _pclass.fq_class(),
+            .write = _dnl.rw_idx() == io_direction_write,
+            .length = _dnl.length(),
+        });
+    }
+
 public:
     io_desc_read_write(io_queue& ioq, io_queue::priority_class_data& pc, stream_id stream, io_direction_and_length dnl, fair_queue_entry::capacity_t cap, iovec_keeper iovs)
         : _ioq(ioq)
@@ -232,13 +315,24 @@ class io_desc_read_write final : public io_completion {
         , _stream(stream)
         , _dnl(dnl)
         , _fq_capacity(cap)
+        , _sampled(ioq.sample_request())
         , _iovs(std::move(iovs))
     {
         io_log.trace("dev {} : req {} queue  len {} capacity {}", _ioq.dev_id(), fmt::ptr(this), _dnl.length(), _fq_capacity);
+        record_trace(internal::trace_event_type::io_queued);
+    }
+
+    void record_trace(internal::trace_event_type type) const noexcept {
+        internal::trace(type, this, nullptr, 0, _dnl.rw_idx() == io_direction_write, _dnl.length());
     }
 
     virtual void set_exception(std::exception_ptr eptr) noexcept override {
+        if (_cancelled) {
+            complete_cancelled();
+            return;
+        }
         io_log.trace("dev {} : req {} error", _ioq.dev_id(), fmt::ptr(this));
+        record_trace(internal::trace_event_type::io_complete);
         _pclass.on_error();
         _ioq.complete_request(*this);
         _pr.set_exception(eptr);
@@ -246,10 +340,19 @@ class io_desc_read_write final : public io_completion {
     }
 
     virtual void complete(size_t res) noexcept override {
+        if (_cancelled) {
+            complete_cancelled();
+            return;
+        }
         io_log.trace("dev {} : req {} complete", _ioq.dev_id(), fmt::ptr(this));
+        record_trace(internal::trace_event_type::io_complete);
         auto now = io_queue::clock_type::now();
-        _pclass.on_complete(std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts));
-        _ioq.complete_request(*this);
+        auto lat = std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts);
+        _pclass.on_complete(lat);
+        if (_sampled) [[unlikely]] {
+            log_sample(now);
+        }
+        _ioq.complete_request(*this, lat);
         _pr.set_value(res);
         delete this;
     }
@@ -260,10 +363,31 @@ class io_desc_read_write final : public io_completion {
         delete this;
     }
 
+    // The kernel may still access the buffers until the request completes,
+    // so the caller only gets the cancellation with the completion. Only the
+    // capacity is given back right away.
+    void cancel_in_flight() noexcept {
+        io_log.trace("dev {} : req {} cancel in flight", _ioq.dev_id(), fmt::ptr(this));
+        _cancelled = true;
+        _pclass.on_cancel();
+        _ioq.cancel_dispatched_request(*this);
+    }
+
+    void complete_cancelled() noexcept {
+        record_trace(internal::trace_event_type::io_complete);
+        _ioq.complete_request(*this);
+        _pr.set_exception(std::make_exception_ptr(default_io_exception_factory::cancelled()));
+        delete this;
+    }
+
+    bool cancelled() const noexcept { return _cancelled; }
+
     void dispatch() noexcept {
         io_log.trace("dev {} : req {} submit", _ioq.dev_id(), fmt::ptr(this));
+        record_trace(internal::trace_event_type::io_submit);
         auto now = io_queue::clock_type::now();
         _pclass.on_dispatch(_dnl, std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts));
+        _queued_ts = _ts;
         _ts = now;
     }
 
@@ -275,6 +399,46 @@ class io_desc_read_write final : public io_completion {
     stream_id stream() const noexcept { return _stream; }
 };
 
+// Completion of a vectored read that serves several adjacent reads, the
+// result is handed out to them in file order
+class coalesced_read final : public io_completion {
+    struct part {
+        io_completion* desc;
+        size_t size;
+    };
+    std::vector<part> _parts;
+    std::vector<::iovec> _iovecs;
+
+public:
+    explicit coalesced_read(size_t nr) {
+        _parts.reserve(nr);
+        _iovecs.reserve(nr);
+    }
+
+    void add(io_completion* desc, char* addr, size_t size) noexcept {
+        _parts.push_back({ desc, size });
+        _iovecs.push_back({ addr, size });
+    }
+
+    std::vector<::iovec>& iovecs() noexcept { return _iovecs; }
+
+    virtual void complete(size_t res) noexcept override {
+        for (auto& p : _parts) {
+            auto r = std::min(res, p.size);
+            res -= r;
+            p.desc->complete(r);
+        }
+        delete this;
+    }
+
+    virtual void set_exception(std::exception_ptr eptr) noexcept override {
+        for (auto& p : _parts) {
+            p.desc->set_exception(eptr);
+        }
+        delete this;
+    }
+};
+
 class queued_io_request : private internal::io_request {
     io_queue& _ioq;
     const stream_id _stream;
@@ -303,7 +467,9 @@ class queued_io_request : private internal::io_request {
             return;
         }
 
-        _intent.maybe_dequeue();
+        if (auto cq = _intent.maybe_dequeue()) {
+            _desc->enqueue(*cq);
+        }
         _desc->dispatch();
         _ioq.submit_request(_desc.release(), std::move(*this));
         delete this;
@@ -351,7 +517,8 @@ priority_class::priority_class(internal::maybe_priority_class_ref pc) noexcept :
 
 cancellable_queue::cancellable_queue(cancellable_queue&& o) noexcept
         : _first(std::exchange(o._first, nullptr))
-        , _rest(std::move(o._rest)) {
+        , _rest(std::move(o._rest))
+        , _in_flight(std::move(o._in_flight)) {
     if (_first != nullptr) {
         _first->_ref = this;
     }
@@ -361,6 +528,7 @@ cancellable_queue& cancellable_queue::operator=(cancellable_queue&& o) noexcept
     if (this != &o) {
         _first = std::exchange(o._first, nullptr);
         _rest = std::move(o._rest);
+        _in_flight = std::move(o._in_flight);
         if (_first != nullptr) {
             _first->_ref = this;
         }
@@ -373,6 +541,11 @@ cancellable_queue::~cancellable_queue() {
         queued_io_request::from_cq_link(*_first).cancel();
         pop_front();
     }
+    while (!_in_flight.empty()) {
+        auto& desc = static_cast<io_desc_read_write&>(_in_flight.front());
+        _in_flight.pop_front();
+        desc.cancel_in_flight();
+    }
 }
 
 void cancellable_queue::push_back(link& il) noexcept {
@@ -426,6 +599,9 @@ std::vector<io_request::part> io_request::split(size_t max_length) {
     if (_op == operation::readv || _op == operation::writev) {
         return split_iovec(max_length);
     }
+    if (_op == operation::nvme_cmd) {
+        return split_nvme_cmd(max_length);
+    }
 
     seastar_logger.error("Invalid operation for split: {}", static_cast<int>(_op));
     std::abort();
@@ -496,6 +672,29 @@ std::vector<io_request::part> io_request::split_iovec(size_t max_length) {
     return parts;
 }
 
+std::vector<io_request::part> io_request::split_nvme_cmd(size_t max_length) {
+    std::vector<part> ret;
+    const auto& op = _nvme_cmd;
+    // Commands address whole logical blocks
+    max_length = std::max(max_length >> op.lba_shift, size_t(1)) << op.lba_shift;
+    ret.reserve((op.size + max_length - 1) / max_length);
+
+    size_t off = 0;
+    do {
+        size_t len = std::min(op.size - off, max_length);
+        io_request sub_req;
+        sub_req._op = _op;
+        sub_req._nvme_cmd = op;
+        sub_req._nvme_cmd.pos = op.pos + off;
+        sub_req._nvme_cmd.addr = op.addr + off;
+        sub_req._nvme_cmd.size = len;
+        ret.push_back({ std::move(sub_req), len, {} });
+        off += len;
+    } while (off < op.size);
+
+    return ret;
+}
+
 sstring io_request::opname() const {
     switch (_op) {
     case io_request::operation::fdatasync:
@@ -526,6 +725,18 @@ sstring io_request::opname() const {
         return "poll remove";
     case io_request::operation::cancel:
         return "cancel";
+    case io_request::operation::openat:
+        return "openat";
+    case io_request::operation::statx:
+        return "statx";
+    case io_request::operation::renameat:
+        return "renameat";
+    case io_request::operation::unlinkat:
+        return "unlinkat";
+    case io_request::operation::fallocate:
+        return "fallocate";
+    case io_request::operation::nvme_cmd:
+        return _nvme_cmd.opcode == nvme_cmd_read ? "nvme read" : "nvme write";
     }
     std::abort();
 }
@@ -554,7 +765,74 @@ void
 io_queue::complete_request(io_desc_read_write& desc) noexcept {
     _requests_executing--;
     _requests_completed++;
+    if (!desc.cancelled()) {
+        _pending_capacity -= desc.capacity();
+        _streams[desc.stream()].notify_request_finished(desc.capacity());
+    }
+}
+
+void
+io_queue::cancel_dispatched_request(io_desc_read_write& desc) noexcept {
+    // The device may still be busy with it, but other requests shouldn't wait
+    // for that; the kernel is asked to stop it, if it can
+    _pending_capacity -= desc.capacity();
     _streams[desc.stream()].notify_request_finished(desc.capacity());
+    engine().cancel_io(&desc);
+}
+
+void
+io_queue::complete_request(io_desc_read_write& desc, std::chrono::duration<double> lat) noexcept {
+    account_completion_latency(desc.stream(), lat);
+    complete_request(desc);
+}
+
+bool io_queue::sample_request() noexcept {
+    if (_sample_countdown == 0 || --_sample_countdown != 0) {
+        return false;
+    }
+    _sample_countdown = get_config().request_sample_rate;
+    return true;
+}
+
+void io_queue::log_sampled_request(const sampled_request& sr) noexcept {
+    if (_sampled_requests.empty()) {
+        return;
+    }
+    _sampled_requests[_sampled_requests_head++ % _sampled_requests.size()] = sr;
+}
+
+std::vector<io_queue::sampled_request> io_queue::sampled_requests() const {
+    std::vector<sampled_request> ret;
+    auto size = _sampled_requests.size();
+    auto nr = std::min<size_t>(_sampled_requests_head, size);
+    ret.reserve(nr);
+    for (size_t i = _sampled_requests_head - nr; i != _sampled_requests_head; i++) {
+        ret.push_back(_sampled_requests[i % size]);
+    }
+    return ret;
+}
+
+void io_queue::account_completion_latency(stream_id stream, std::chrono::duration<double> lat) noexcept {
+    auto& cl = _completion_latency[stream];
+    cl.total += lat;
+    cl.count++;
+}
+
+void io_queue::update_adaptive_rate() noexcept {
+    if (!get_config().adaptive_rate) {
+        return;
+    }
+
+    for (stream_id s = 0; s < _streams.size(); s++) {
+        auto& cl = _completion_latency[s];
+        if (cl.count != 0) {
+            _group->report_latency(s, cl.total / cl.count);
+            cl = completion_latency{};
+        }
+        if (_group->_allocated_on == this_shard_id()) {
+            _group->adjust_rate(s);
+        }
+    }
 }
 
 fair_queue::config io_queue::make_fair_queue_config(const config& iocfg, sstring label) {
@@ -567,9 +845,11 @@ io_queue::io_queue(io_group_ptr group, internal::io_sink& sink)
     : _priority_classes()
     , _group(std::move(group))
     , _sink(sink)
-    , _flow_ratio_update([this] { update_flow_ratio(); })
+    , _flow_ratio_update([this] { update_flow_ratio(); update_adaptive_rate(); })
 {
     auto& cfg = get_config();
+    _sample_countdown = cfg.request_sample_rate;
+    _sampled_requests.resize(cfg.request_sample_rate != 0 ? cfg.request_log_size : 0);
     if (cfg.duplex) {
         static_assert(internal::io_direction_and_length::write_idx == 0);
         _streams.emplace_back(_group->_fgs[0], make_fair_queue_config(cfg, "write"));
@@ -588,7 +868,22 @@ io_queue::io_queue(io_group_ptr group, internal::io_sink& sink)
         sm::make_gauge("flow_ratio", [this] { return _flow_ratio; },
                 sm::description("Ratio of dispatch rate to completion rate. Is expected to be 1.0+ growing larger on reactor stalls or (!) disk problems"),
                 { owner_l, mnt_l, group_l }),
+        sm::make_counter("coalesced_reads", [this] { return _coalesced_reads; },
+                sm::description("Number of reads served as part of a vectored read of adjacent ranges"),
+                { owner_l, mnt_l, group_l }),
+        sm::make_gauge("pending_time_sec", [this] { return pending_time().count(); },
+                sm::description("Estimated time the device needs to serve the requests queued or executing on this shard, comparable across devices"),
+                { owner_l, mnt_l, group_l }),
     });
+    // Streams are rate controlled separately
+    for (stream_id s = 0; s < _streams.size(); s++) {
+        auto stream_l = sm::label("stream")(cfg.duplex ? (s == internal::io_direction_and_length::write_idx ? "write" : "read") : "rw");
+        _metric_groups.add_group("io_queue", {
+            sm::make_gauge("rate_factor", [this, s] { return _group->_adaptive_rate[s].factor.load(std::memory_order_relaxed); },
+                    sm::description("Factor the configured disk capacity is scaled by to keep device latency within the goal (1.0 unless adaptive rate is on)"),
+                    { owner_l, mnt_l, group_l, stream_l }),
+        });
+    }
 }
 
 fair_group::config io_group::make_fair_group_config(const io_queue::config& qcfg) noexcept {
@@ -601,9 +896,51 @@ fair_group::config io_group::make_fair_group_config(const io_queue::config& qcfg
     double limit_min_size = std::max(io_queue::read_request_base_count, qcfg.disk_blocks_write_to_read_multiplier) * qcfg.block_count_limit_min;
     cfg.limit_min_tokens = limit_min_weight / qcfg.req_count_rate + limit_min_size / qcfg.blocks_count_rate;
     cfg.rate_limit_duration = qcfg.rate_limit_duration;
+    cfg.lease_duration = qcfg.capacity_lease_duration;
     return cfg;
 }
 
+void io_group::report_latency(unsigned idx, std::chrono::duration<double> lat) noexcept {
+    uint64_t lat_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count();
+    auto& worst = _adaptive_rate[idx].worst_latency_ns;
+    auto cur = worst.load(std::memory_order_relaxed);
+    while (cur < lat_ns && !worst.compare_exchange_weak(cur, lat_ns, std::memory_order_relaxed)) {
+    }
+}
+
+// AIMD on the group's rate: back off quickly when the device is slower than
+// the latency goal, probe for more capacity slowly when it is well within it.
+// Periods without any completions leave the rate as it is.
+void io_group::adjust_rate(unsigned idx) noexcept {
+    static constexpr double backoff = 0.8;
+    static constexpr double probe = 1.05;
+    static constexpr double headroom = 0.75;
+
+    auto& ar = _adaptive_rate[idx];
+    auto lat_ns = ar.worst_latency_ns.exchange(0, std::memory_order_relaxed);
+    if (lat_ns == 0) {
+        return;
+    }
+
+    auto lat = std::chrono::duration<double>(std::chrono::nanoseconds(lat_ns));
+    auto goal = _config.rate_limit_duration;
+    auto old_factor = ar.factor.load(std::memory_order_relaxed);
+    auto factor = old_factor;
+    if (lat > goal) {
+        factor *= backoff;
+    } else if (lat < goal * headroom) {
+        factor *= probe;
+    }
+    factor = std::clamp(factor, _config.adaptive_rate_min_factor, _config.adaptive_rate_max_factor);
+
+    if (factor != old_factor) {
+        io_log.debug("dev {} : latency {:.3f}ms (goal {:.3f}ms), rate factor {:.3f} -> {:.3f}",
+                _config.devid, lat.count() * 1000, goal.count() * 1000, old_factor, factor);
+        ar.factor.store(factor, std::memory_order_relaxed);
+        _fgs[idx].update_rate_factor(factor);
+    }
+}
+
 std::chrono::duration<double> io_group::io_latency_goal() const noexcept {
     return _fgs.front().rate_limit_duration();
 }
@@ -816,7 +1153,13 @@ std::vector<seastar::metrics::impl::metric_definition_impl> io_queue::priority_c
             sm::make_gauge("delay", [this] {
                 return _queue_time.count();
             }, sm::description("random delay time in the queue")),
-            sm::make_gauge("shares", _shares, sm::description("current amount of shares"))
+            sm::make_gauge("shares", _shares, sm::description("current amount of shares")),
+            sm::make_histogram("sampled_queue_time", [this] {
+                return _sampled_queue_time.to_metrics_histogram();
+            }, sm::description("Sampled time requests spent in the queue before being dispatched, in microseconds (see --io-request-sample-rate)")).set_skip_when_empty(),
+            sm::make_histogram("sampled_device_time", [this] {
+                return _sampled_device_time.to_metrics_histogram();
+            }, sm::description("Sampled time requests spent in the disk after being dispatched, in microseconds (see --io-request-sample-rate)")).set_skip_when_empty(),
     });
 }
 
@@ -915,8 +1258,33 @@ double internal::request_tokens(io_direction_and_length dnl, const io_queue::con
     };
 
     const auto& m = mult[dnl.rw_idx()];
+    const auto& costs = dnl.rw_idx() == io_direction_write ? cfg.write_costs : cfg.read_costs;
+    const double factor = dnl.rw_idx() == io_direction_write ? cfg.write_interference_factor : 1.0;
+
+    auto size_tokens = [&m, &cfg] (size_t length) {
+        return double(m.size) * (length >> io_queue::block_size_shift) / cfg.blocks_count_rate;
+    };
+
+    if (costs.empty()) {
+        return factor * (double(m.weight) / cfg.req_count_rate + size_tokens(dnl.length()));
+    }
 
-    return double(m.weight) / cfg.req_count_rate + double(m.size) * (dnl.length() >> io_queue::block_size_shift) / cfg.blocks_count_rate;
+    // Interpolate between the measured lengths, and past the longest one
+    // charge the extra length at the streaming bandwidth
+    auto it = std::lower_bound(costs.begin(), costs.end(), dnl.length(), [] (const io_queue::request_cost& c, size_t len) {
+        return c.length < len;
+    });
+    double tokens;
+    if (it == costs.begin()) {
+        tokens = it->seconds;
+    } else if (it == costs.end()) {
+        const auto& last = costs.back();
+        tokens = last.seconds + size_tokens(dnl.length() - last.length);
+    } else {
+        const auto& lo = *std::prev(it);
+        tokens = lo.seconds + (it->seconds - lo.seconds) * double(dnl.length() - lo.length) / (it->length - lo.length);
+    }
+    return factor * tokens;
 }
 
 fair_queue_entry::capacity_t io_queue::request_capacity(io_direction_and_length dnl) const noexcept {
@@ -956,6 +1324,7 @@ future<size_t> io_queue::queue_one_request(internal::priority_class pc, io_direc
         queued_req.release();
         pclass.on_queue();
         _queued_requests++;
+        _pending_capacity += cap;
         return fut;
     });
 }
@@ -967,6 +1336,18 @@ future<size_t> io_queue::queue_request(internal::priority_class pc, io_direction
         return queue_one_request(std::move(pc), dnl, std::move(req), intent, std::move(iovs));
     }
 
+    if (req.fdatasync_after()) {
+        // The parts may complete in any order, so the sync can only follow all of them
+        int fd = req.opcode() == internal::io_request::operation::write
+                ? req.as<internal::io_request::operation::write>().fd
+                : req.as<internal::io_request::operation::writev>().fd;
+        return queue_request(std::move(pc), dnl, std::move(req).without_fdatasync_after(), intent, std::move(iovs)).then([fd] (size_t written) {
+            return engine().fdatasync(fd).then([written] {
+                return written;
+            });
+        });
+    }
+
     std::vector<internal::io_request::part> parts;
     lw_shared_ptr<std::vector<future<size_t>>> p;
 
@@ -1019,10 +1400,44 @@ future<size_t> io_queue::queue_request(internal::priority_class pc, io_direction
     });
 }
 
+void io_queue::trace(internal::priority_class pc, bool write, const internal::io_request& req, size_t len) noexcept {
+    using o = internal::io_request::operation;
+    uint64_t pos;
+    switch (req.opcode()) {
+    case o::read:
+        pos = req.as<o::read>().pos;
+        break;
+    case o::readv:
+        pos = req.as<o::readv>().pos;
+        break;
+    case o::write:
+        pos = req.as<o::write>().pos;
+        break;
+    case o::writev:
+        pos = req.as<o::writev>().pos;
+        break;
+    case o::nvme_cmd:
+        pos = req.as<o::nvme_cmd>().pos;
+        break;
+    default:
+        return;
+    }
+    _trace_hook(trace_record{
+        .timestamp = clock_type::now(),
+        .class_id = pc.id(),
+        .write = write,
+        .offset = pos,
+        .length = len,
+    });
+}
+
 future<size_t> io_queue::submit_io_read(internal::priority_class pc, size_t len, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept {
     auto& r = engine();
     ++r._io_stats.aio_reads;
     r._io_stats.aio_read_bytes += len;
+    if (_trace_hook) [[unlikely]] {
+        trace(pc, false, req, len);
+    }
     return queue_request(std::move(pc), io_direction_and_length(io_direction_read, len), std::move(req), intent, std::move(iovs));
 }
 
@@ -1030,6 +1445,9 @@ future<size_t> io_queue::submit_io_write(internal::priority_class pc, size_t len
     auto& r = engine();
     ++r._io_stats.aio_writes;
     r._io_stats.aio_write_bytes += len;
+    if (_trace_hook) [[unlikely]] {
+        trace(pc, true, req, len);
+    }
     return queue_request(std::move(pc), io_direction_and_length(io_direction_write, len), std::move(req), intent, std::move(iovs));
 }
 
@@ -1039,17 +1457,88 @@ void io_queue::poll_io_queue() {
             queued_io_request::from_fq_entry(fqe).dispatch();
         });
     }
+    flush_staged_reads();
 }
 
 void io_queue::submit_request(io_desc_read_write* desc, internal::io_request req) noexcept {
     _queued_requests--;
     _requests_executing++;
     _requests_dispatched++;
+    if (get_config().coalesce_reads && req.opcode() == internal::io_request::operation::read) {
+        try {
+            _staged_reads.push_back(staged_read{ desc, std::move(req) });
+            return;
+        } catch (...) {
+            // submit it alone
+        }
+    }
     _sink.submit(desc, std::move(req));
 }
 
+void io_queue::flush_staged_reads() noexcept {
+    static constexpr size_t max_coalesced_reads = 64;
+
+    if (_staged_reads.empty()) {
+        return;
+    }
+
+    using read_op = internal::io_request::operation;
+    std::sort(_staged_reads.begin(), _staged_reads.end(), [] (const staged_read& a, const staged_read& b) {
+        const auto& ra = a.req.as<read_op::read>();
+        const auto& rb = b.req.as<read_op::read>();
+        return std::tie(ra.fd, ra.pos) < std::tie(rb.fd, rb.pos);
+    });
+
+    auto max_length = get_request_limits().max_read;
+    auto* end = _staged_reads.data() + _staged_reads.size();
+    for (auto* run = _staged_reads.data(); run != end; ) {
+        const auto& first = run->req.as<read_op::read>();
+        auto length = first.size;
+        auto* next = run + 1;
+        while (next != end && size_t(next - run) < max_coalesced_reads) {
+            const auto& r = next->req.as<read_op::read>();
+            if (r.fd != first.fd || r.pos != first.pos + length || length + r.size > max_length) {
+                break;
+            }
+            length += r.size;
+            next++;
+        }
+
+        if (next - run == 1 || !submit_coalesced_reads(run, next)) {
+            for (auto* sr = run; sr != next; sr++) {
+                _sink.submit(sr->desc, std::move(sr->req));
+            }
+        }
+        run = next;
+    }
+    _staged_reads.clear();
+}
+
+bool io_queue::submit_coalesced_reads(staged_read* begin, staged_read* end) noexcept {
+    using read_op = internal::io_request::operation;
+    std::unique_ptr<coalesced_read> cr;
+    try {
+        cr = std::make_unique<coalesced_read>(end - begin);
+    } catch (...) {
+        return false;
+    }
+
+    const auto& first = begin->req.as<read_op::read>();
+    bool nowait_works = true;
+    for (auto* sr = begin; sr != end; sr++) {
+        const auto& r = sr->req.as<read_op::read>();
+        cr->add(sr->desc, r.addr, r.size);
+        nowait_works &= r.nowait_works;
+    }
+    _coalesced_reads += end - begin;
+    auto req = internal::io_request::make_readv(first.fd, first.pos, cr->iovecs(), nowait_works);
+    _sink.submit(cr.release(), std::move(req));
+    return true;
+}
+
 void io_queue::cancel_request(queued_io_request& req) noexcept {
     _queued_requests--;
+    _pending_capacity -= req.queue_entry().capacity();
     _streams[req.stream()].notify_request_cancelled(req.queue_entry());
 }
 
@@ -1079,6 +1568,15 @@ io_queue::update_shares_for_class(internal::priority_class pc, size_t new_shares
     }
 }
 
+future<> io_queue::update_limits_for_class(internal::priority_class pc, io_limits limits) {
+    return futurize_invoke([this, pc, limits] {
+        if (_group->_allocated_on == this_shard_id()) {
+            auto& pclass = find_or_create_class(pc);
+            pclass.update_limits(limits);
+        }
+    });
+}
+
 future<> io_queue::update_bandwidth_for_class(internal::priority_class pc, uint64_t new_bandwidth) {
     return futurize_invoke([this, pc, new_bandwidth] {
         if (_group->_allocated_on == this_shard_id()) {
@@ -0,0 +1,490 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <fmt/core.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/align.hh>
+#include <seastar/core/chunked_fifo.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/log_file.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/coroutine/generator.hh>
+#endif
+
+namespace seastar {
+
+namespace {
+
+constexpr std::string_view segment_prefix = "log-";
+constexpr std::string_view recycled_prefix = "recycled-";
+// Released segments being zeroed, not usable yet
+constexpr std::string_view dirty_suffix = ".dirty";
+constexpr size_t zero_buffer_size = 1 << 20;
+
+std::optional<uint64_t> parse_id(std::string_view name, std::string_view prefix) {
+    if (!name.starts_with(prefix)) {
+        return std::nullopt;
+    }
+    name.remove_prefix(prefix.size());
+    uint64_t id;
+    auto [p, ec] = std::from_chars(name.data(), name.data() + name.size(), id);
+    if (ec != std::errc() || p != name.data() + name.size()) {
+        return std::nullopt;
+    }
+    return id;
+}
+
+}
+
+class log_file::impl {
+    using clock_type = std::chrono::steady_clock;
+    struct segment {
+        uint64_t id;
+        file f;
+        // Disk blocks are allocated up to here
+        uint64_t allocated = 0;
+    };
+    struct pending_record {
+        temporary_buffer<char> data;
+        promise<log_position> pr;
+        clock_type::time_point queued;
+    };
+
+    sstring _dir;
+    log_file_options _options;
+    uint64_t _next_id = 0;
+    uint64_t _next_recycled_id = 0;
+    std::optional<segment> _active;
+    std::optional<future<segment>> _next;
+    // End of the records in the active segment
+    uint64_t _pos = 0;
+    // Records in the last, partial, block of the active segment, which
+    // the next commit writes again
+    temporary_buffer<char> _tail;
+    future<> _allocating = make_ready_future<>();
+    chunked_fifo<pending_record> _queue;
+    condition_variable _work;
+    std::exception_ptr _error;
+    bool _closing = false;
+    future<> _writer = make_ready_future<>();
+    std::set<uint64_t> _full;
+    std::deque<sstring> _recycled;
+    unsigned _recycling = 0;
+    stats _stats;
+    metrics::internal::short_time_estimated_histogram _latency;
+    metrics::metric_groups _metrics;
+private:
+    open_flags segment_flags() const noexcept {
+        return open_flags::rw | (_options.dsync ? open_flags::dsync : open_flags{});
+    }
+
+    future<> allocate(segment& s, uint64_t end) {
+        end = std::min(align_up(end, uint64_t(s.f.disk_write_dma_alignment())), _options.segment_size);
+        if (end > s.allocated) {
+            co_await s.f.allocate(s.allocated, end - s.allocated);
+            s.allocated = std::max(s.allocated, end);
+        }
+    }
+
+    // Makes sure the blocks up to end are allocated, and that the next
+    // ones are being allocated in the background
+    future<> allocate_ahead(uint64_t end) {
+        auto& s = *_active;
+        if (end > s.allocated) {
+            co_await std::exchange(_allocating, make_ready_future<>());
+            co_await allocate(s, end);
+        }
+        if (_allocating.available() && s.allocated < _options.segment_size && s.allocated - end < _options.preallocation_size / 2) {
+            co_await std::exchange(_allocating, make_ready_future<>());
+            _allocating = allocate(s, s.allocated + _options.preallocation_size);
+        }
+    }
+
+    future<segment> prepare(uint64_t id) {
+        auto path = segment_path(id);
+        segment s{id};
+        if (!_recycled.empty()) {
+            auto from = std::move(_recycled.front());
+            _recycled.pop_front();
+            co_await rename_file(from, path);
+            s.f = co_await open_file_dma(path, segment_flags());
+            s.allocated = _options.segment_size;
+            ++_stats.segments_recycled;
+        } else {
+            s.f = co_await open_file_dma(path, segment_flags() | open_flags::create | open_flags::exclusive);
+            std::exception_ptr ex;
+            try {
+                // A fixed size spares appends updating it
+                co_await s.f.truncate(_options.segment_size);
+                co_await allocate(s, _options.preallocation_size);
+            } catch (...) {
+                ex = std::current_exception();
+            }
+            if (ex) {
+                co_await s.f.close();
+                std::rethrow_exception(ex);
+            }
+            ++_stats.segments_created;
+        }
+        co_await sync_directory(_dir);
+        co_return s;
+    }
+
+    future<> roll() {
+        co_await std::exchange(_allocating, make_ready_future<>());
+        auto old = std::move(*_active);
+        _active.reset();
+        _full.insert(old.id);
+        co_await old.f.close();
+        auto next = std::move(*_next);
+        _next.reset();
+        _active = co_await std::move(next);
+        _next.emplace(prepare(_next_id++));
+        _pos = 0;
+        _tail = {};
+    }
+
+    future<> write(file& f, uint64_t pos, const char* buf, size_t len) {
+#if SEASTAR_API_LEVEL >= 7
+        auto written = co_await f.dma_write_and_flush(pos, buf, len);
+#else
+        auto written = co_await f.dma_write(pos, buf, len);
+        co_await f.flush();
+#endif
+        if (written != len) {
+            throw std::runtime_error(fmt::format("Short write to {}: {} out of {} bytes", segment_path(_active->id), written, len));
+        }
+    }
+
+    future<> commit() {
+        if (_pos + _queue.front().data.size() > _options.segment_size) {
+            co_await roll();
+        }
+        auto& f = _active->f;
+        auto alignment = f.disk_write_dma_alignment();
+        auto end = _pos;
+        size_t count = 0;
+        for (auto& r : _queue) {
+            auto next = end + r.data.size();
+            if (count && (next > _options.segment_size || next - _pos > _options.max_commit_size)) {
+                break;
+            }
+            end = next;
+            ++count;
+        }
+        co_await allocate_ahead(end);
+
+        auto start = align_down(_pos, uint64_t(alignment));
+        auto len = align_up(end, uint64_t(alignment)) - start;
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), len);
+        auto p = std::copy(_tail.begin(), _tail.end(), buf.get_write());
+        auto it = _queue.begin();
+        for (size_t i = 0; i < count; ++i, ++it) {
+            p = std::copy(it->data.begin(), it->data.end(), p);
+        }
+        std::fill(p, buf.get_write() + len, 0);
+        co_await write(f, start, buf.get(), len);
+
+        auto now = clock_type::now();
+        auto offset = _pos;
+        for (size_t i = 0; i < count; ++i) {
+            auto r = std::move(_queue.front());
+            _queue.pop_front();
+            _latency.add(now - r.queued);
+            r.pr.set_value(log_position{_active->id, offset});
+            offset += r.data.size();
+            _stats.bytes += r.data.size();
+        }
+        _stats.records += count;
+        ++_stats.commits;
+        _pos = end;
+        auto tail_start = align_down(end, uint64_t(alignment));
+        _tail = temporary_buffer<char>(buf.get() + (tail_start - start), end - tail_start);
+    }
+
+    void fail(std::exception_ptr ex) noexcept {
+        _error = ex;
+        while (!_queue.empty()) {
+            _queue.front().pr.set_exception(ex);
+            _queue.pop_front();
+        }
+    }
+
+    future<> run() {
+        for (;;) {
+            co_await _work.wait([this] { return !_queue.empty() || _closing; });
+            if (_queue.empty()) {
+                co_return;
+            }
+            try {
+                co_await commit();
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        }
+    }
+
+    future<> zero(sstring path) {
+        auto f = co_await open_file_dma(path, open_flags::rw);
+        std::exception_ptr ex;
+        try {
+            // Writing the whole segment converts its unwritten extents, so
+            // that writes to it don't have to
+            auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), zero_buffer_size);
+            std::fill(buf.get_write(), buf.get_write() + buf.size(), 0);
+            for (uint64_t pos = 0; pos < _options.segment_size; pos += buf.size()) {
+                auto len = std::min<uint64_t>(buf.size(), _options.segment_size - pos);
+                co_await f.dma_write(pos, buf.get(), len);
+            }
+            co_await f.flush();
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await f.close();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+    }
+
+    future<> recycle(uint64_t id) {
+        auto path = segment_path(id);
+        if (_recycled.size() + _recycling >= _options.recycled_segments) {
+            co_await remove_file(path);
+            co_return;
+        }
+        sstring clean = fmt::format("{}/{}{}", _dir, recycled_prefix, _next_recycled_id++);
+        auto dirty = clean + sstring(dirty_suffix);
+        ++_recycling;
+        std::exception_ptr ex;
+        try {
+            co_await rename_file(path, dirty);
+            co_await zero(dirty);
+            co_await rename_file(dirty, clean);
+            co_await sync_directory(_dir);
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        --_recycling;
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+        _recycled.push_back(std::move(clean));
+    }
+
+    // Picks up the segments and recycled files left in the directory
+    future<> scan() {
+        auto dir = co_await open_directory(_dir);
+        std::vector<sstring> recycled;
+        std::vector<sstring> dirty;
+        std::exception_ptr ex;
+        try {
+            auto lister = dir.experimental_list_directory();
+            while (auto de = co_await lister()) {
+                std::string_view name = de->name;
+                if (auto id = parse_id(name, segment_prefix)) {
+                    _full.insert(*id);
+                    _next_id = std::max(_next_id, *id + 1);
+                } else if (name.starts_with(recycled_prefix) && name.ends_with(dirty_suffix)) {
+                    dirty.push_back(fmt::format("{}/{}", _dir, name));
+                } else if (auto id = parse_id(name, recycled_prefix)) {
+                    recycled.push_back(fmt::format("{}/{}", _dir, name));
+                    _next_recycled_id = std::max(_next_recycled_id, *id + 1);
+                }
+            }
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await dir.close();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+        for (auto& path : dirty) {
+            co_await remove_file(path);
+        }
+        for (auto& path : recycled) {
+            auto size = co_await file_size(path);
+            if (_recycled.size() < _options.recycled_segments && size == _options.segment_size) {
+                _recycled.push_back(std::move(path));
+            } else {
+                co_await remove_file(path);
+            }
+        }
+    }
+
+    void register_metrics() {
+        if (_options.metrics_name.empty()) {
+            return;
+        }
+        namespace sm = seastar::metrics;
+        auto log_l = sm::label("log")(_options.metrics_name);
+        _metrics.add_group("log_file", {
+            sm::make_counter("records", _stats.records, sm::description("Records written"), {log_l}),
+            sm::make_counter("bytes", _stats.bytes, sm::description("Bytes of records written"), {log_l}),
+            sm::make_counter("commits", _stats.commits, sm::description("Writes, each followed by a sync"), {log_l}),
+            sm::make_counter("segments_created", _stats.segments_created, sm::description("Segments created anew"), {log_l}),
+            sm::make_counter("segments_recycled", _stats.segments_recycled, sm::description("Segments reused from released ones"), {log_l}),
+            sm::make_queue_length("queued_records", [this] { return _queue.size(); }, sm::description("Records waiting for a commit"), {log_l}),
+            sm::make_histogram("commit_latency", [this] {
+                return _latency.to_metrics_histogram();
+            }, sm::description("Time from appending a record to it being durable, in microseconds"), {log_l}),
+        });
+    }
+public:
+    impl(sstring dir, log_file_options options)
+        : _dir(std::move(dir)), _options(std::move(options))
+    {}
+
+    future<> start() {
+        co_await scan();
+        _active = co_await prepare(_next_id++);
+        _next.emplace(prepare(_next_id++));
+        register_metrics();
+        _writer = run();
+    }
+
+    future<log_position> append(temporary_buffer<char> record) {
+        if (_error) {
+            return make_exception_future<log_position>(_error);
+        }
+        if (_closing) {
+            return make_exception_future<log_position>(std::runtime_error(fmt::format("Log {} is closed", _dir)));
+        }
+        if (record.size() > _options.segment_size) {
+            return make_exception_future<log_position>(std::invalid_argument(
+                    fmt::format("Record of {} bytes doesn't fit in a segment of {} bytes", record.size(), _options.segment_size)));
+        }
+        _queue.push_back(pending_record{std::move(record), promise<log_position>(), clock_type::now()});
+        auto fut = _queue.back().pr.get_future();
+        _work.signal();
+        return fut;
+    }
+
+    uint64_t active_segment() const noexcept {
+        return _active ? _active->id : _next_id;
+    }
+
+    sstring segment_path(uint64_t id) const {
+        return fmt::format("{}/{}{}", _dir, segment_prefix, id);
+    }
+
+    future<> release_segments(uint64_t before) {
+        while (!_full.empty() && *_full.begin() < before) {
+            auto id = *_full.begin();
+            _full.erase(_full.begin());
+            co_await recycle(id);
+        }
+    }
+
+    future<> close() {
+        _closing = true;
+        _work.broadcast();
+        co_await std::exchange(_writer, make_ready_future<>());
+        _metrics.clear();
+        // Allocation failures were reported to the appenders
+        co_await std::exchange(_allocating, make_ready_future<>()).handle_exception([] (std::exception_ptr) {});
+        if (_active) {
+            co_await _active->f.close();
+            _active.reset();
+        }
+        if (_next) {
+            // Never written to, so drop it
+            auto next = std::move(*_next);
+            _next.reset();
+            co_await std::move(next).then([this] (segment s) {
+                return s.f.close().then([this, id = s.id] {
+                    return remove_file(segment_path(id));
+                });
+            }).handle_exception([] (std::exception_ptr) {});
+        }
+    }
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+
+    const metrics::internal::short_time_estimated_histogram& commit_latency() const noexcept {
+        return _latency;
+    }
+};
+
+log_file::log_file(std::unique_ptr<impl> impl) noexcept : _impl(std::move(impl)) {}
+log_file::log_file(log_file&&) noexcept = default;
+log_file& log_file::operator=(log_file&&) noexcept = default;
+log_file::~log_file() = default;
+
+future<log_file> log_file::open(sstring dir, log_file_options options) {
+    if (!options.segment_size || options.segment_size % 4096) {
+        throw std::invalid_argument(fmt::format("Log segment size must be a multiple of 4096, not {}", options.segment_size));
+    }
+    auto impl = std::make_unique<log_file::impl>(std::move(dir), std::move(options));
+    co_await impl->start();
+    co_return log_file(std::move(impl));
+}
+
+future<log_position> log_file::append(temporary_buffer<char> record) {
+    return _impl->append(std::move(record));
+}
+
+uint64_t log_file::active_segment() const noexcept {
+    return _impl->active_segment();
+}
+
+sstring log_file::segment_path(uint64_t segment) const {
+    return _impl->segment_path(segment);
+}
+
+future<> log_file::release_segments(uint64_t segment) {
+    return _impl->release_segments(segment);
+}
+
+future<> log_file::close() {
+    return _impl->close();
+}
+
+const log_file::stats& log_file::get_stats() const noexcept {
+    return _impl->get_stats();
+}
+
+const metrics::internal::short_time_estimated_histogram& log_file::commit_latency() const noexcept {
+    return _impl->commit_latency();
+}
+
+}
@@ -123,6 +123,7 @@ module seastar;
 #include <seastar/core/bitops.hh>
 #include <seastar/core/align.hh>
 #include <seastar/core/posix.hh>
+#include <seastar/core/scheduling.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/util/backtrace.hh>
 #endif
@@ -237,6 +238,8 @@ struct page;
 class page_list;
 
 static std::atomic<bool> live_cpus[max_cpus];
+// NUMA node the memory of each shard is bound to, plus one; zero if unknown
+static std::atomic<unsigned> shard_numa_node[max_cpus];
 
 using std::optional;
 
@@ -319,11 +322,14 @@ unsigned object_cpu_id(const void* ptr) {
     return (reinterpret_cast<uintptr_t>(ptr) >> cpu_id_shift) & 0xff;
 }
 
+class small_pool;
+
 class page_list_link {
     uint32_t _prev;
     uint32_t _next;
     friend class page_list;
     friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
+    friend small_pool_stats get_small_pool_stats(const small_pool& sp) noexcept;
 };
 
 constexpr size_t mem_base_alloc = size_t(1) << 44;
@@ -367,16 +373,19 @@ constexpr size_t next_page_aligned(size_t size) {
     return (size + (page_size - 1)) & ~(page_size - 1);
 }
 
-class small_pool;
-
 struct free_object {
     free_object* next;
 };
 
 struct page {
-    bool free;
+    bool free : 1;
+    // For the head of a free span, whether it was given back to the kernel
+    bool released : 1;
     uint8_t offset_in_span;
-    uint16_t nr_small_alloc;
+    union {
+        uint16_t nr_small_alloc; // if used in a small_pool
+        uint16_t group; // for the head of large allocations: index + 1 of the scheduling group charged, or 0
+    };
     uint32_t span_size; // in pages, if we're the head or the tail
     page_list_link link;
     small_pool* pool;  // if used in a small_pool
@@ -424,7 +433,39 @@ class page_list {
         }
         _front = ary[_front].link._next;
     }
+    void push_back(page* ary, page& span) {
+        auto idx = &span - ary;
+        if (_back) {
+            ary[_back].link._next = idx;
+        } else {
+            _front = idx;
+        }
+        span.link._prev = _back;
+        span.link._next = 0;
+        _back = idx;
+    }
+    // Moves the spans matching \c pred to the back of the list, in order.
+    template <typename Pred>
+    void move_to_back_if(page* ary, Pred pred) {
+        if (empty()) {
+            return;
+        }
+        auto last = _back;
+        auto idx = _front;
+        while (true) {
+            auto next = ary[idx].link._next;
+            if (idx != _back && pred(ary[idx])) {
+                erase(ary, ary[idx]);
+                push_back(ary, ary[idx]);
+            }
+            if (idx == last) {
+                break;
+            }
+            idx = next;
+        }
+    }
     friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
+    friend small_pool_stats get_small_pool_stats(const small_pool& sp) noexcept;
 };
 
 class small_pool {
@@ -447,6 +488,8 @@ class small_pool {
     bool _sampled_pool = false;
 #endif
     page_list _span_list;
+    // _min_free and _max_free, while defragmenting
+    std::pair<unsigned, unsigned> _saved_free_limits;
     static constexpr unsigned idx_frac_bits = 2;
 public:
     explicit small_pool(unsigned object_size, bool is_sampled) noexcept;
@@ -466,11 +509,18 @@ class small_pool {
     static constexpr unsigned size_to_idx(unsigned size);
     static constexpr unsigned idx_to_size(unsigned idx);
     allocation_site_ptr& alloc_site_holder(void* ptr);
+    // Returns the pool's free list to the spans, releasing the unused ones.
+    void release_free_objects();
+    // See cpu_pages::defragment()
+    void start_defragmenting();
+    void stop_defragmenting();
+    bool is_sparse(const page& span) const;
 private:
     inline void* pop_free();
     [[gnu::noinline]] void* add_more_objects();
     void trim_free_list();
     friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
+    friend small_pool_stats get_small_pool_stats(const small_pool& sp) noexcept;
 };
 
 // index 0b0001'1100 -> size (1 << 4) + 0b11 << (4 - 2)
@@ -549,6 +599,15 @@ struct cross_cpu_free_item {
     cross_cpu_free_item* next;
 };
 
+// Objects of another shard freed on this one, returned to their owner
+// together with a single atomic operation
+struct cross_cpu_free_batch {
+    cross_cpu_free_item* head = nullptr;
+    cross_cpu_free_item* tail = nullptr;
+    unsigned size = 0;
+    bool pending = false; // listed in cpu_pages::xcpu_pending_batches
+};
+
 struct cpu_pages {
     small_pool_array<false> small_pools;
     uint32_t min_free_pages = 20000000 / page_size;
@@ -561,8 +620,23 @@ struct cpu_pages {
     unsigned cpu_id = -1U;
     std::function<void (std::function<void ()>)> reclaim_hook;
     std::vector<reclaimer*> reclaimers;
+    std::vector<relocator*> relocators;
+    struct group_memory {
+        size_t usage = 0;
+        size_t soft_limit = std::numeric_limits<size_t>::max();
+        bool back_under_soft_limit = false;
+    };
+    std::array<group_memory, max_scheduling_groups()> groups;
+    bool groups_back_under_soft_limit = false;
+    bool defragmenting = false;
+    // Cleared on hugetlbfs backed memory, or when the kernel refuses to drop pages
+    bool can_release_memory = true;
     static constexpr unsigned nr_span_lists = 32;
     page_list free_spans[nr_span_lists];  // contains aligned spans with span_size == 2^idx
+    static constexpr unsigned cross_cpu_free_batch_size = 32;
+    std::array<cross_cpu_free_batch, max_cpus> xcpu_free_batches;
+    std::array<uint16_t, max_cpus> xcpu_pending_batches;
+    unsigned nr_xcpu_pending_batches = 0;
     alignas(seastar::cache_line_size) std::atomic<cross_cpu_free_item*> xcpu_freelist;
     static std::atomic<unsigned> cpu_id_gen;
     static cpu_pages* all_cpus[max_cpus];
@@ -592,9 +666,11 @@ struct cpu_pages {
     page* find_and_unlink_span(unsigned nr_pages);
     page* find_and_unlink_span_reclaiming(unsigned n_pages);
     void free_large(void* ptr);
+    void charge_group(page* span) noexcept;
+    void uncharge_group(page* span, uint32_t nr_pages) noexcept;
     bool grow_span(pageidx& start, uint32_t& nr_pages, unsigned idx);
     void free_span(pageidx start, uint32_t nr_pages);
-    void free_span_no_merge(pageidx start, uint32_t nr_pages);
+    void free_span_no_merge(pageidx start, uint32_t nr_pages, bool released = false);
     void free_span_unaligned(pageidx start, uint32_t nr_pages);
     void free(void* ptr);
     void free(void* ptr, size_t size);
@@ -603,6 +679,10 @@ struct cpu_pages {
     static void do_foreign_free(void* ptr);
     void shrink(void* ptr, size_t new_size);
     static void free_cross_cpu(unsigned cpu_id, void* ptr);
+    static void push_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail);
+    void queue_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* p);
+    void flush_cross_cpu_free_batch(unsigned cpu_id);
+    bool flush_cross_cpu_free_batches();
     bool drain_cross_cpu_freelist();
     size_t object_size(void* ptr);
 
@@ -614,6 +694,11 @@ struct cpu_pages {
     bool is_initialized() const;
     bool initialize();
     reclaiming_result run_reclaimers(reclaimer_scope, size_t pages_to_reclaim);
+    template <typename Func>
+    void for_each_small_pool(Func func);
+    bool release_small_pool_free_objects();
+    size_t defragment();
+    size_t release_free_memory() noexcept;
     void schedule_reclaim();
     void set_reclaim_hook(std::function<void (std::function<void ()>)> hook);
     void set_min_free_pages(size_t pages);
@@ -712,15 +797,21 @@ cpu_pages::link(page_list& list, page* span) {
     list.push_front(pages, *span);
 }
 
-void cpu_pages::free_span_no_merge(uint32_t span_start, uint32_t nr_pages) {
+void cpu_pages::free_span_no_merge(uint32_t span_start, uint32_t nr_pages, bool released) {
     assert(nr_pages);
     nr_free_pages += nr_pages;
     auto span = &pages[span_start];
     auto span_end = &pages[span_start + nr_pages - 1];
     span->free = span_end->free = true;
     span->span_size = span_end->span_size = nr_pages;
+    span->released = released;
     auto idx = index_of(nr_pages);
-    link(free_spans[idx], span);
+    if (released) {
+        // Reuse memory which is still backed first, see release_free_memory()
+        free_spans[idx].push_back(pages, *span);
+    } else {
+        link(free_spans[idx], span);
+    }
 }
 
 bool cpu_pages::grow_span(uint32_t& span_start, uint32_t& nr_pages, unsigned idx) {
@@ -784,12 +875,18 @@ cpu_pages::find_and_unlink_span(unsigned n_pages) {
 
 page*
 cpu_pages::find_and_unlink_span_reclaiming(unsigned n_pages) {
+    bool released_free_objects = false;
     while (true) {
         auto span = find_and_unlink_span(n_pages);
         if (span) {
             return span;
         }
         if (run_reclaimers(reclaimer_scope::sync, n_pages) == reclaiming_result::reclaimed_nothing) {
+            // Free memory may be there, but split by spans which are only
+            // kept alive by the small pools' free lists.
+            if (!std::exchange(released_free_objects, true) && release_small_pool_free_objects()) {
+                continue;
+            }
             return nullptr;
         }
     }
@@ -820,16 +917,18 @@ cpu_pages::allocate_large_and_trim(unsigned n_pages, bool should_sample) {
     }
     auto span_size = span->span_size;
     auto span_idx = span - pages;
+    auto released = span->released;
     nr_free_pages -= span->span_size;
     while (span_size >= n_pages * 2) {
         span_size /= 2;
         auto other_span_idx = span_idx + span_size;
-        free_span_no_merge(other_span_idx, span_size);
+        free_span_no_merge(other_span_idx, span_size, released);
     }
     auto span_end = &pages[span_idx + span_size - 1];
     span->free = span_end->free = false;
     span->span_size = span_end->span_size = span_size;
     span->pool = nullptr;
+    span->group = 0;
 #ifdef SEASTAR_HEAPPROF
     if (should_sample) {
         auto alloc_site = add_alloc_site(span->span_size * page_size);
@@ -934,7 +1033,7 @@ disable_backtrace_temporarily::disable_backtrace_temporarily()
 static
 simple_backtrace get_backtrace() noexcept {
     disable_backtrace_temporarily dbt;
-    return current_backtrace_tasklocal();
+    return fast_backtrace_tasklocal();
 }
 
 static
@@ -994,9 +1093,30 @@ maybe_disable_transparent_hugepages(void* addr, size_t len) {
     }
 }
 
+void cpu_pages::charge_group(page* span) noexcept {
+    auto g = seastar::internal::scheduling_group_index(current_scheduling_group());
+    span->group = g + 1;
+    groups[g].usage += size_t(span->span_size) * page_size;
+}
+
+void cpu_pages::uncharge_group(page* span, uint32_t nr_pages) noexcept {
+    if (!span->group) {
+        return;
+    }
+    auto& g = groups[span->group - 1];
+    auto was_over = g.usage >= g.soft_limit;
+    g.usage -= size_t(nr_pages) * page_size;
+    if (was_over && g.usage < g.soft_limit) {
+        // Picked up by the reactor in a safe place, we may be deep in free()
+        g.back_under_soft_limit = true;
+        groups_back_under_soft_limit = true;
+    }
+}
+
 void cpu_pages::free_large(void* ptr) {
     pageidx idx = (reinterpret_cast<char*>(ptr) - mem()) / page_size;
     page* span = &pages[idx];
+    uncharge_group(span, span->span_size);
 #ifdef SEASTAR_HEAPPROF
     if (span->alloc_site) {
         auto alloc_site = span->alloc_site;
@@ -1031,21 +1151,75 @@ void cpu_pages::free_cross_cpu(unsigned cpu_id, void* ptr) {
         return;
     }
     auto p = reinterpret_cast<cross_cpu_free_item*>(ptr);
+    alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
+    if (is_reactor_thread) {
+        // Reactors flush their batches when polling, see drain_cross_cpu_freelist()
+        cpu_mem.queue_cross_cpu_free(cpu_id, p);
+    } else {
+        push_cross_cpu_free(cpu_id, p, p);
+    }
+}
+
+void cpu_pages::push_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail) {
     auto& list = all_cpus[cpu_id]->xcpu_freelist;
     auto old = list.load(std::memory_order_relaxed);
     do {
-        p->next = old;
-    } while (!list.compare_exchange_weak(old, p, std::memory_order_release, std::memory_order_relaxed));
-    alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
+        tail->next = old;
+    } while (!list.compare_exchange_weak(old, head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void cpu_pages::queue_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* p) {
+    auto& b = xcpu_free_batches[cpu_id];
+    if (!b.head) {
+        b.tail = p;
+    }
+    p->next = b.head;
+    b.head = p;
+    if (!b.pending) {
+        b.pending = true;
+        xcpu_pending_batches[nr_xcpu_pending_batches++] = cpu_id;
+    }
+    if (++b.size == cross_cpu_free_batch_size) {
+        flush_cross_cpu_free_batch(cpu_id);
+    }
+}
+
+void cpu_pages::flush_cross_cpu_free_batch(unsigned cpu_id) {
+    auto& b = xcpu_free_batches[cpu_id];
+    // The owner may have gone away since the objects were queued
+    if (live_cpus[cpu_id].load(std::memory_order_relaxed)) {
+        push_cross_cpu_free(cpu_id, b.head, b.tail);
+    }
+    b.head = b.tail = nullptr;
+    b.size = 0;
+}
+
+bool cpu_pages::flush_cross_cpu_free_batches() {
+    if (!nr_xcpu_pending_batches) {
+        return false;
+    }
+    for (unsigned i = 0; i < nr_xcpu_pending_batches; ++i) {
+        auto cpu_id = xcpu_pending_batches[i];
+        if (xcpu_free_batches[cpu_id].head) {
+            flush_cross_cpu_free_batch(cpu_id);
+        }
+        xcpu_free_batches[cpu_id].pending = false;
+    }
+    nr_xcpu_pending_batches = 0;
+    return true;
 }
 
 bool cpu_pages::drain_cross_cpu_freelist() {
+    auto flushed = flush_cross_cpu_free_batches();
     if (!xcpu_freelist.load(std::memory_order_relaxed)) {
-        return false;
+        return flushed;
     }
     auto p = xcpu_freelist.exchange(nullptr, std::memory_order_acquire);
     while (p) {
         auto n = p->next;
+        // The batch was built on a single shard, the next object is
+        // likely still cold here
+        __builtin_prefetch(n);
         alloc_stats::increment_local(alloc_stats::types::frees);
         free(p);
         p = n;
@@ -1190,6 +1364,7 @@ void cpu_pages::shrink(void* ptr, size_t new_size) {
         alloc_site->size += new_size_pages * page_size;
     }
 #endif
+    uncharge_group(span, old_size_pages - new_size_pages);
     span->span_size = new_size_pages;
     span[new_size_pages - 1].free = false;
     span[new_size_pages - 1].span_size = new_size_pages;
@@ -1198,6 +1373,7 @@ void cpu_pages::shrink(void* ptr, size_t new_size) {
 }
 
 cpu_pages::~cpu_pages() {
+    flush_cross_cpu_free_batches();
     if (is_initialized()) {
         live_cpus[cpu_id].store(false, std::memory_order_relaxed);
     }
@@ -1345,6 +1521,81 @@ reclaiming_result cpu_pages::run_reclaimers(reclaimer_scope scope, size_t n_page
     return result;
 }
 
+template <typename Func>
+void cpu_pages::for_each_small_pool(Func func) {
+    for (unsigned i = 0; i < small_pools.nr_small_pools; i++) {
+        func(small_pools[i]);
+        func(sampled_small_pools[i]);
+    }
+}
+
+bool cpu_pages::release_small_pool_free_objects() {
+    auto free_before = nr_free_pages;
+    for_each_small_pool([] (small_pool& sp) {
+        sp.release_free_objects();
+    });
+    return nr_free_pages > free_before;
+}
+
+size_t cpu_pages::defragment() {
+    if (defragmenting) {
+        return 0;
+    }
+    drain_cross_cpu_freelist();
+    auto free_before = nr_free_pages;
+    defragmenting = true;
+    for_each_small_pool([] (small_pool& sp) {
+        sp.start_defragmenting();
+    });
+    auto stop = [this] {
+        for_each_small_pool([] (small_pool& sp) {
+            sp.stop_defragmenting();
+        });
+        defragmenting = false;
+    };
+    try {
+        for (auto&& r : relocators) {
+            r->do_relocate();
+        }
+    } catch (...) {
+        stop();
+        throw;
+    }
+    stop();
+    // Relocation may have required new spans
+    return nr_free_pages > free_before ? (nr_free_pages - free_before) * page_size : 0;
+}
+
+size_t cpu_pages::release_free_memory() noexcept {
+    if (!can_release_memory) {
+        return 0;
+    }
+    // Only whole huge pages are dropped, so they are faulted back in as huge
+    // pages rather than being left for khugepaged to collapse. Free spans are
+    // aligned to their size, so any span of a huge page or more will do.
+    size_t released = 0;
+    for (auto idx = index_of(huge_page_size / page_size); idx < nr_span_lists; ++idx) {
+        auto& list = free_spans[idx];
+        // Released spans are kept at the back
+        while (!list.empty() && !list.front(pages).released) {
+            auto& span = list.front(pages);
+            auto start = mem() + (&span - pages) * page_size;
+            auto size = size_t(span.span_size) * page_size;
+            if (::madvise(start, size, MADV_DONTNEED) != 0) {
+                // Most likely locked memory, don't retry
+                seastar_memory_logger.warn("Cannot return free memory to the system: {}", std::strerror(errno));
+                can_release_memory = false;
+                return released;
+            }
+            span.released = true;
+            list.pop_front(pages);
+            list.push_back(pages, span);
+            released += size;
+        }
+    }
+    return released;
+}
+
 void cpu_pages::schedule_reclaim() {
     current_min_free_pages = 0;
     reclaim_hook([this] {
@@ -1457,7 +1708,8 @@ small_pool::deallocate(void* object) {
 
 void*
 small_pool::add_more_objects() {
-    auto goal = (_min_free + _max_free) / 2;
+    // The limits are zero while defragmenting, still get one span's worth
+    auto goal = std::max((_min_free + _max_free) / 2, 1u);
     while (!_span_list.empty() && _free_count < goal) {
         page& span = _span_list.front(get_cpu_mem().pages);
         _span_list.pop_front(get_cpu_mem().pages);
@@ -1524,6 +1776,37 @@ small_pool::trim_free_list() {
     }
 }
 
+void
+small_pool::release_free_objects() {
+    auto limits = std::make_pair(_min_free, _max_free);
+    _min_free = _max_free = 0;
+    trim_free_list();
+    std::tie(_min_free, _max_free) = limits;
+}
+
+bool
+small_pool::is_sparse(const page& span) const {
+    return span.nr_small_alloc * 4 < span.span_size * page_size / _object_size;
+}
+
+void
+small_pool::start_defragmenting() {
+    // Without a free list, objects freed while defragmenting go straight back
+    // to their spans, and allocations are served from the span list, whose
+    // densest spans come first.
+    _saved_free_limits = std::make_pair(_min_free, _max_free);
+    _min_free = _max_free = 0;
+    trim_free_list();
+    _span_list.move_to_back_if(get_cpu_mem().pages, [this] (const page& span) {
+        return is_sparse(span);
+    });
+}
+
+void
+small_pool::stop_defragmenting() {
+    std::tie(_min_free, _max_free) = _saved_free_limits;
+}
+
 void
 abort_on_underflow(size_t size) {
     if (std::make_signed_t<size_t>(size) < 0) {
@@ -1539,15 +1822,24 @@ inline void* allocate_large(size_t size, bool should_sample) {
     if ((size_t(size_in_pages) << page_bits) < size) {
         return nullptr; // (size + page_size - 1) caused an overflow
     }
-    return get_cpu_mem().allocate_large(size_in_pages, should_sample);
-
+    auto& cpu_mem = get_cpu_mem();
+    auto ptr = cpu_mem.allocate_large(size_in_pages, should_sample);
+    if (ptr) {
+        cpu_mem.charge_group(cpu_mem.to_page(ptr));
+    }
+    return ptr;
 }
 
 void* allocate_large_aligned(size_t align, size_t size, bool should_sample) {
     abort_on_underflow(size);
     unsigned size_in_pages = (size + page_size - 1) >> page_bits;
     unsigned align_in_pages = std::max(align, page_size) >> page_bits;
-    return get_cpu_mem().allocate_large_aligned(align_in_pages, size_in_pages, should_sample);
+    auto& cpu_mem = get_cpu_mem();
+    auto ptr = cpu_mem.allocate_large_aligned(align_in_pages, size_in_pages, should_sample);
+    if (ptr) {
+        cpu_mem.charge_group(cpu_mem.to_page(ptr));
+    }
+    return ptr;
 }
 
 void free_large(void* ptr) {
@@ -1816,6 +2108,67 @@ reclaimer::~reclaimer() {
     r.erase(std::find(r.begin(), r.end(), this));
 }
 
+relocator::relocator(relocate_fn relocate)
+    : _relocate(std::move(relocate)) {
+    get_cpu_mem().relocators.push_back(this);
+}
+
+relocator::~relocator() {
+    auto& r = get_cpu_mem().relocators;
+    r.erase(std::find(r.begin(), r.end(), this));
+}
+
+bool should_relocate(const void* ptr) noexcept {
+    auto& cpu_mem = get_cpu_mem();
+    auto p = const_cast<void*>(ptr);
+    if (!cpu_mem.defragmenting || !cpu_mem.is_local_pointer(p)) {
+        return false;
+    }
+    auto span = cpu_mem.to_page(p);
+    if (!span->pool) {
+        return false;
+    }
+    span -= span->offset_in_span;
+    return span->pool->is_sparse(*span);
+}
+
+size_t defragment() {
+    return get_cpu_mem().defragment();
+}
+
+size_t release_free_memory() noexcept {
+    return get_cpu_mem().release_free_memory();
+}
+
+namespace internal {
+
+size_t scheduling_group_memory_usage(unsigned sg_index) noexcept {
+    return get_cpu_mem().groups[sg_index].usage;
+}
+
+size_t scheduling_group_memory_soft_limit(unsigned sg_index) noexcept {
+    return get_cpu_mem().groups[sg_index].soft_limit;
+}
+
+void set_scheduling_group_memory_soft_limit(unsigned sg_index, size_t limit) noexcept {
+    get_cpu_mem().groups[sg_index].soft_limit = limit;
+}
+
+bool drain_scheduling_group_memory_events(const std::function<void (unsigned)>& func) {
+    auto& cpu_mem = get_cpu_mem();
+    if (!std::exchange(cpu_mem.groups_back_under_soft_limit, false)) {
+        return false;
+    }
+    for (unsigned i = 0; i < cpu_mem.groups.size(); ++i) {
+        if (std::exchange(cpu_mem.groups[i].back_under_soft_limit, false)) {
+            func(i);
+        }
+    }
+    return true;
+}
+
+}
+
 void set_large_allocation_warning_threshold(size_t threshold) {
     get_cpu_mem().large_allocation_warning_threshold = threshold;
 }
@@ -1832,6 +2185,9 @@ void configure_minimal() {
     init_cpu_mem();
 }
 
+// The hugetlbfs file backing the memory of this shard, if any
+static thread_local lw_shared_ptr<file_desc> memory_backing;
+
 internal::numa_layout
 configure(std::vector<resource::memory> m, bool mbind,
         bool transparent_hugepages,
@@ -1859,10 +2215,13 @@ configure(std::vector<resource::memory> m, bool mbind,
         // std::function is copyable, but file_desc is not, so we must use
         // a shared_ptr to allow sys_alloc to be copied around
         auto fdp = make_lw_shared<file_desc>(file_desc::temporary(*hugetlbfs_path));
+        memory_backing = fdp;
         sys_alloc = [fdp] (void* where, size_t how_much) {
             return allocate_hugetlbfs_memory(*fdp, where, how_much);
         };
         get_cpu_mem().replace_memory_backing(sys_alloc);
+        // Dropping pages of a shared file mapping doesn't free them
+        get_cpu_mem().can_release_memory = false;
     }
     get_cpu_mem().resize(total, sys_alloc);
     size_t pos = 0;
@@ -1891,6 +2250,14 @@ configure(std::vector<resource::memory> m, bool mbind,
 #endif
         pos += x.bytes;
     }
+    // The shard's memory may span several nodes when one of them ran out;
+    // take the one holding most of it as its home.
+    auto home = std::max_element(m.begin(), m.end(), [] (const resource::memory& a, const resource::memory& b) {
+        return a.bytes < b.bytes;
+    });
+    if (home != m.end()) {
+        shard_numa_node[get_cpu_mem().cpu_id].store(home->nodeid + 1, std::memory_order_relaxed);
+    }
     return ret_layout;
 }
 
@@ -1913,6 +2280,27 @@ memory_layout get_memory_layout() {
     return get_cpu_mem().memory_layout();
 }
 
+namespace internal {
+
+int memory_backing_fd() noexcept {
+    return memory_backing ? memory_backing->get() : -1;
+}
+
+}
+
+bool is_numa_local(const void* ptr) noexcept {
+    if (!is_seastar_memory(const_cast<void*>(ptr))) {
+        return true;
+    }
+    auto owner = object_cpu_id(ptr);
+    if (owner == get_cpu_mem().cpu_id) {
+        return true;
+    }
+    auto owner_node = shard_numa_node[owner].load(std::memory_order_relaxed);
+    auto local_node = shard_numa_node[get_cpu_mem().cpu_id].load(std::memory_order_relaxed);
+    return !owner_node || !local_node || owner_node == local_node;
+}
+
 size_t min_free_memory() {
     return get_cpu_mem().min_free_pages * page_size;
 }
@@ -2010,6 +2398,53 @@ static human_readable_value to_hr_number(uint64_t number) {
     return to_human_readable_value(number, 1000, 10000, suffixes);
 }
 
+small_pool_stats get_small_pool_stats(const small_pool& sp) noexcept {
+    // For the small pools, there are two types of free objects:
+    // Pool freelist objects are poitned to by sp._free and their count is sp._free_count
+    // Span freelist objects are those removed from the pool freelist when that list
+    // becomes too large: they are instead attached to the spans allocated to this
+    // pool. To count this second category, we iterate over the spans below.
+    uint32_t span_freelist_objs = 0;
+    auto front = sp._span_list._front;
+    while (front) {
+        auto& span = get_cpu_mem().pages[front];
+        auto capacity_in_objects = span.span_size * page_size / sp.object_size();
+        span_freelist_objs += capacity_in_objects - span.nr_small_alloc;
+        front = span.link._next;
+    }
+    const auto free_objs = sp._free_count + span_freelist_objs; // pool + span free objects
+    small_pool_stats sps;
+    sps.object_size = sp.object_size();
+    sps.span_size = sp._span_sizes.preferred * page_size;
+    sps.objects_in_use = sp._pages_in_use * page_size / sp.object_size() - free_objs;
+    sps.memory = sp._pages_in_use * page_size;
+    sps.unused = free_objs * sp.object_size();
+    return sps;
+}
+
+// Doesn't allocate, so it can be used when dumping diagnostics on allocation failure
+template <typename Func>
+static void for_each_small_pool_stats(Func func) {
+    for (unsigned i = 0; i < get_cpu_mem().small_pools.nr_small_pools; i++) {
+        auto& sp = get_cpu_mem().small_pools[i];
+        // We don't use pools too small to fit a free_object, so skip these, they
+        // are always empty.
+        if (sp.object_size() < sizeof(free_object)) {
+            continue;
+        }
+        func(get_small_pool_stats(sp));
+    }
+}
+
+std::vector<small_pool_stats> get_small_pool_stats() {
+    std::vector<small_pool_stats> ret;
+    ret.reserve(get_cpu_mem().small_pools.nr_small_pools);
+    for_each_small_pool_stats([&ret] (const small_pool_stats& sps) {
+        ret.push_back(sps);
+    });
+    return ret;
+}
+
 seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator it) {
     auto free_mem = get_cpu_mem().nr_free_pages * page_size;
     auto total_mem = get_cpu_mem().nr_pages * page_size;
@@ -2032,41 +2467,17 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
 
     it = fmt::format_to(it, "Small pools:\n");
     it = fmt::format_to(it, "objsz spansz usedobj memory unused wst%\n");
-    for (unsigned i = 0; i < get_cpu_mem().small_pools.nr_small_pools; i++) {
-        auto& sp = get_cpu_mem().small_pools[i];
-        // We don't use pools too small to fit a free_object, so skip these, they
-        // are always empty.
-        if (sp.object_size() < sizeof(free_object)) {
-            continue;
-        }
-
-        // For the small pools, there are two types of free objects:
-        // Pool freelist objects are poitned to by sp._free and their count is sp._free_count
-        // Span freelist objects are those removed from the pool freelist when that list
-        // becomes too large: they are instead attached to the spans allocated to this
-        // pool. To count this second category, we iterate over the spans below.
-        uint32_t span_freelist_objs = 0;
-        auto front = sp._span_list._front;
-        while (front) {
-            auto& span = get_cpu_mem().pages[front];
-            auto capacity_in_objects = span.span_size * page_size / sp.object_size();
-            span_freelist_objs += capacity_in_objects - span.nr_small_alloc;
-            front = span.link._next;
-        }
-        const auto free_objs = sp._free_count + span_freelist_objs; // pool + span free objects
-        const auto use_count = sp._pages_in_use * page_size / sp.object_size() - free_objs;
-        auto memory = sp._pages_in_use * page_size;
-        const auto unused = free_objs * sp.object_size();
-        const auto wasted_percent = memory ? unused * 100 / memory : 0;
+    for_each_small_pool_stats([&it] (const small_pool_stats& sps) {
+        const auto wasted_percent = sps.memory ? sps.unused * 100 / sps.memory : 0;
         it = fmt::format_to(it,
                 "{:>5}  {:>5}   {:>5}  {:>5}  {:>5} {:>4}\n",
-                sp.object_size(),
-                to_hr_size(sp._span_sizes.preferred * page_size),
-                to_hr_number(use_count),
-                to_hr_size(memory),
-                to_hr_size(unused),
+                sps.object_size,
+                to_hr_size(sps.span_size),
+                to_hr_number(sps.objects_in_use),
+                to_hr_size(sps.memory),
+                to_hr_size(sps.unused),
                 unsigned(wasted_percent));
-    }
+    });
     it = fmt::format_to(it, "\nPage spans:\n");
     it = fmt::format_to(it, "index  size  free  used spans\n");
 
@@ -2597,6 +3008,10 @@ std::vector<allocation_site> sampled_memory_profile() {
     return {};
 }
 
+std::vector<small_pool_stats> get_small_pool_stats() {
+    return {};
+}
+
 size_t sampled_memory_profile(allocation_site* output, size_t size) {
     return 0;
 }
@@ -2627,6 +3042,43 @@ reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaim
 reclaimer::~reclaimer() {
 }
 
+relocator::relocator(relocate_fn relocate) {
+}
+
+relocator::~relocator() {
+}
+
+bool should_relocate(const void* ptr) noexcept {
+    return false;
+}
+
+size_t defragment() {
+    return 0;
+}
+
+size_t release_free_memory() noexcept {
+    return 0;
+}
+
+namespace internal {
+
+size_t scheduling_group_memory_usage(unsigned sg_index) noexcept {
+    return 0;
+}
+
+size_t scheduling_group_memory_soft_limit(unsigned sg_index) noexcept {
+    return std::numeric_limits<size_t>::max();
+}
+
+void set_scheduling_group_memory_soft_limit(unsigned sg_index, size_t limit) noexcept {
+}
+
+bool drain_scheduling_group_memory_events(const std::function<void (unsigned)>& func) {
+    return false;
+}
+
+}
+
 void set_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
 }
 
@@ -2656,6 +3108,18 @@ memory_layout get_memory_layout() {
     throw std::runtime_error("get_memory_layout() not supported");
 }
 
+namespace internal {
+
+int memory_backing_fd() noexcept {
+    return -1;
+}
+
+}
+
+bool is_numa_local(const void* ptr) noexcept {
+    return true;
+}
+
 size_t min_free_memory() {
     return 0;
 }
@@ -23,6 +23,7 @@
 module;
 #endif
 
+#include <cmath>
 #include <memory>
 #include <regex>
 #include <random>
@@ -568,10 +569,66 @@ relabel_config::relabel_action relabel_config_action(const std::string& action)
     return relabel_config::relabel_action::replace;
 }
 
+// Cumulative counts of a native histogram, indexed by bucket id in the
+// given (same or coarser) schema
+static std::vector<uint64_t> native_cumulative_counts(const histogram& h, int32_t schema, int32_t lo, int32_t hi) {
+    auto& native = *h.native_histogram;
+    auto by = native.schema - schema;
+    std::vector<uint64_t> res(hi - lo, native.zero_count);
+    for (size_t i = 0; i < h.buckets.size(); i++) {
+        int32_t id = ((int64_t(native.min_id) + int64_t(i) - 1) >> by) + 1;
+        res[id - lo] = h.buckets[i].count;
+    }
+    // Counts are cumulative, buckets out of the histogram's range hold the
+    // count of the buckets below them
+    for (size_t i = 1; i < res.size(); i++) {
+        res[i] = std::max(res[i], res[i - 1]);
+    }
+    return res;
+}
+
+// Merges native histograms whose buckets don't line up, e.g. sparse
+// histograms that were hit in different ranges or were downscaled
+static void merge_native_histogram(histogram& a, const histogram& b) {
+    auto schema = std::min(a.native_histogram->schema, b.native_histogram->schema);
+    auto range = [schema] (const histogram& h) {
+        auto by = h.native_histogram->schema - schema;
+        int32_t lo = ((int64_t(h.native_histogram->min_id) - 1) >> by) + 1;
+        int32_t hi = ((int64_t(h.native_histogram->min_id) + int64_t(h.buckets.size()) - 2) >> by) + 2;
+        return std::make_pair(lo, std::max(lo, hi));
+    };
+    auto [alo, ahi] = range(a);
+    auto [blo, bhi] = range(b);
+    int32_t lo = a.buckets.empty() ? blo : (b.buckets.empty() ? alo : std::min(alo, blo));
+    int32_t hi = a.buckets.empty() ? bhi : (b.buckets.empty() ? ahi : std::max(ahi, bhi));
+    auto ac = native_cumulative_counts(a, schema, lo, hi);
+    auto bc = native_cumulative_counts(b, schema, lo, hi);
+    a.buckets.resize(hi - lo);
+    for (int32_t id = lo; id < hi; id++) {
+        auto& bucket = a.buckets[id - lo];
+        bucket.count = ac[id - lo] + bc[id - lo];
+        bucket.upper_bound = std::exp2(std::ldexp(double(id), -schema));
+    }
+    a.native_histogram->schema = schema;
+    a.native_histogram->min_id = lo;
+    a.native_histogram->zero_count += b.native_histogram->zero_count;
+    a.native_histogram->zero_threshold = std::max(a.native_histogram->zero_threshold, b.native_histogram->zero_threshold);
+    a.sample_count += b.sample_count;
+    a.sample_sum += b.sample_sum;
+}
+
 histogram& histogram::operator+=(const histogram& c) {
     if (c.sample_count == 0) {
         return *this;
     }
+    if (native_histogram && c.native_histogram && (native_histogram->schema != c.native_histogram->schema ||
+            native_histogram->min_id != c.native_histogram->min_id || buckets.size() != c.buckets.size())) {
+        merge_native_histogram(*this, c);
+        return *this;
+    }
+    if (native_histogram && c.native_histogram) {
+        native_histogram->zero_count += c.native_histogram->zero_count;
+    }
     for (size_t i = 0; i < c.buckets.size(); i++) {
         if (buckets.size() <= i) {
             buckets.push_back(c.buckets[i]);
@@ -0,0 +1,377 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/otlp.hh>
+#include "proto/otlp_metrics.pb.h"
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/http/client.hh>
+#include <seastar/http/compression.hh>
+#include <seastar/http/request.hh>
+#include <seastar/net/tls.hh>
+#include <seastar/util/log.hh>
+#include <seastar/util/short_streams.hh>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/range/irange.hpp>
+#include <fmt/format.h>
+
+namespace seastar {
+
+extern seastar::logger seastar_logger;
+
+namespace otlp {
+
+namespace pb = seastar::otlp;
+namespace mi = metrics::impl;
+
+namespace {
+
+// Cumulative count of h at an upper bound of another layout of the same
+// histogram, for the buckets of a histogram that was since extended or
+// downscaled
+uint64_t cumulative_count_at(const metrics::histogram& h, double bound) {
+    uint64_t count = h.native_histogram ? h.native_histogram->zero_count : 0;
+    for (auto& b : h.buckets) {
+        if (b.upper_bound > bound * (1 + 1e-9)) {
+            break;
+        }
+        count = b.count;
+    }
+    return count;
+}
+
+}
+
+namespace internal {
+
+metrics::histogram histogram_delta(const metrics::histogram& cur, const metrics::histogram& prev) {
+    if (cur.sample_count < prev.sample_count) {
+        return cur;
+    }
+    metrics::histogram res = cur;
+    res.sample_count -= prev.sample_count;
+    res.sample_sum -= prev.sample_sum;
+    if (res.native_histogram && prev.native_histogram) {
+        res.native_histogram->zero_count -= std::min(res.native_histogram->zero_count, prev.native_histogram->zero_count);
+    }
+    bool same_layout = cur.buckets.size() == prev.buckets.size();
+    for (size_t i = 0; same_layout && i < cur.buckets.size(); i++) {
+        same_layout = cur.buckets[i].upper_bound == prev.buckets[i].upper_bound;
+    }
+    uint64_t floor = res.native_histogram ? res.native_histogram->zero_count : 0;
+    for (size_t i = 0; i < res.buckets.size(); i++) {
+        auto prev_count = same_layout ? prev.buckets[i].count : cumulative_count_at(prev, cur.buckets[i].upper_bound);
+        auto& count = res.buckets[i].count;
+        count = std::max(count - std::min(count, prev_count), floor);
+        floor = count;
+    }
+    return res;
+}
+
+double counter_delta(double cur, double prev) {
+    return cur < prev ? cur : cur - prev;
+}
+
+mi::metric_value to_delta(const mi::metric_value& cur, const mi::metric_value* prev) {
+    if (!prev || prev->type() != cur.type()) {
+        return cur;
+    }
+    switch (cur.type()) {
+    case mi::data_type::COUNTER:
+    case mi::data_type::REAL_COUNTER:
+        return mi::metric_value(counter_delta(cur.d(), prev->d()), cur.type());
+    case mi::data_type::HISTOGRAM:
+        return mi::metric_value(histogram_delta(cur.get_histogram(), prev->get_histogram()), cur.type());
+    default:
+        return cur;
+    }
+}
+
+}
+
+namespace {
+
+// Values of all shards, aggregated per metric family and labels
+struct aggregated_family {
+    const mi::metric_family_info* info;
+    std::map<mi::labels_type, mi::metric_value> values;
+};
+
+using aggregated_families = std::map<sstring, aggregated_family>;
+
+uint64_t to_unix_nano(std::chrono::system_clock::time_point tp) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+}
+
+void add_attribute(google::protobuf::RepeatedPtrField<pb::KeyValue>* attributes, const sstring& key, const sstring& value) {
+    auto kv = attributes->Add();
+    kv->set_key(key);
+    kv->mutable_value()->set_string_value(value);
+}
+
+void add_attributes(google::protobuf::RepeatedPtrField<pb::KeyValue>* attributes, const mi::labels_type& labels) {
+    for (auto& [key, value] : labels) {
+        add_attribute(attributes, key, value);
+    }
+}
+
+void fill_histogram(pb::Metric& metric, const metrics::histogram& h, const mi::labels_type& labels, uint64_t start, uint64_t now, bool delta) {
+    if (h.native_histogram) {
+        auto mh = metric.mutable_exponential_histogram();
+        mh->set_aggregation_temporality(delta ? pb::AGGREGATION_TEMPORALITY_DELTA : pb::AGGREGATION_TEMPORALITY_CUMULATIVE);
+        auto dp = mh->add_data_points();
+        add_attributes(dp->mutable_attributes(), labels);
+        dp->set_start_time_unix_nano(start);
+        dp->set_time_unix_nano(now);
+        dp->set_count(h.sample_count);
+        dp->set_sum(h.sample_sum);
+        dp->set_scale(h.native_histogram->schema);
+        dp->set_zero_count(h.native_histogram->zero_count);
+        dp->set_zero_threshold(h.native_histogram->zero_threshold);
+        // OTLP bucket i is (base^i, base^(i+1)], Prometheus' is (base^(i-1), base^i]
+        auto positive = dp->mutable_positive();
+        positive->set_offset(h.native_histogram->min_id - 1);
+        uint64_t prev = h.native_histogram->zero_count;
+        for (auto& b : h.buckets) {
+            positive->add_bucket_counts(b.count - prev);
+            prev = b.count;
+        }
+        if (h.sample_count > prev) {
+            // Values past the last bucket, counted by approximate histograms
+            positive->add_bucket_counts(h.sample_count - prev);
+        }
+        return;
+    }
+    auto mh = metric.mutable_histogram();
+    mh->set_aggregation_temporality(delta ? pb::AGGREGATION_TEMPORALITY_DELTA : pb::AGGREGATION_TEMPORALITY_CUMULATIVE);
+    auto dp = mh->add_data_points();
+    add_attributes(dp->mutable_attributes(), labels);
+    dp->set_start_time_unix_nano(start);
+    dp->set_time_unix_nano(now);
+    dp->set_count(h.sample_count);
+    dp->set_sum(h.sample_sum);
+    uint64_t prev = 0;
+    for (auto& b : h.buckets) {
+        dp->add_explicit_bounds(b.upper_bound);
+        dp->add_bucket_counts(b.count - std::min(b.count, prev));
+        prev = std::max(prev, b.count);
+    }
+    dp->add_bucket_counts(h.sample_count - std::min(h.sample_count, prev));
+}
+
+void fill_summary(pb::Metric& metric, const metrics::histogram& h, const mi::labels_type& labels, uint64_t start, uint64_t now) {
+    auto dp = metric.mutable_summary()->add_data_points();
+    add_attributes(dp->mutable_attributes(), labels);
+    dp->set_start_time_unix_nano(start);
+    dp->set_time_unix_nano(now);
+    dp->set_count(h.sample_count);
+    dp->set_sum(h.sample_sum);
+    for (auto& b : h.buckets) {
+        auto q = dp->add_quantile_values();
+        q->set_quantile(b.upper_bound);
+        q->set_value(b.count);
+    }
+}
+
+void fill_number(google::protobuf::RepeatedPtrField<pb::NumberDataPoint>* points, const mi::metric_value& value, double v,
+        const mi::labels_type& labels, uint64_t start, uint64_t now) {
+    auto dp = points->Add();
+    add_attributes(dp->mutable_attributes(), labels);
+    dp->set_start_time_unix_nano(start);
+    dp->set_time_unix_nano(now);
+    if (value.type() == mi::data_type::COUNTER) {
+        dp->set_as_int(mi::metric_value(v, mi::data_type::COUNTER).i());
+    } else {
+        dp->set_as_double(v);
+    }
+}
+
+}
+
+exporter::exporter(config cfg)
+        : _cfg(std::move(cfg))
+        , _start(std::chrono::system_clock::now())
+        , _last_push(_start)
+{
+    if (_cfg.host.empty()) {
+        _cfg.host = fmt::format("{}", _cfg.endpoint);
+    }
+}
+
+exporter::~exporter() = default;
+
+future<> exporter::start() {
+    if (_cfg.credentials) {
+        _client = std::make_unique<http::experimental::client>(_cfg.endpoint, _cfg.credentials, _cfg.host);
+    } else {
+        _client = std::make_unique<http::experimental::client>(_cfg.endpoint);
+    }
+    _loop = do_until([this] { return _as.abort_requested(); }, [this] {
+        return sleep_abortable(_cfg.interval, _as).then([this] {
+            return push();
+        }).handle_exception([] (std::exception_ptr ep) {
+            try {
+                std::rethrow_exception(std::move(ep));
+            } catch (const sleep_aborted&) {
+            } catch (...) {
+                seastar_logger.warn("otlp: failed to push metrics: {}", std::current_exception());
+            }
+        });
+    });
+    return make_ready_future<>();
+}
+
+future<> exporter::stop() {
+    _as.request_abort();
+    auto f = _loop ? std::exchange(_loop, std::nullopt).value() : make_ready_future<>();
+    return f.finally([this] {
+        return _client ? _client->close() : make_ready_future<>();
+    });
+}
+
+future<> exporter::push() {
+    std::vector<foreign_ptr<mi::values_reference>> values(smp::count);
+    co_await parallel_for_each(boost::irange(0u, smp::count), [&values] (unsigned shard) {
+        return smp::submit_to(shard, [] {
+            return mi::get_values();
+        }).then([&values, shard] (auto res) {
+            values[shard] = std::move(res);
+        });
+    });
+    auto now = std::chrono::system_clock::now();
+    auto start_ns = to_unix_nano(_cfg.delta ? _last_push : _start);
+    auto now_ns = to_unix_nano(now);
+
+    // Both loops go over every series, and yield between families
+    aggregated_families families;
+    for (auto& shard : values) {
+        auto& metadata = *shard->metadata;
+        for (size_t i = 0; i < metadata.size(); i++) {
+            auto& mf = metadata[i];
+            auto& family = families.try_emplace(mf.mf.name, aggregated_family{&mf.mf, {}}).first->second;
+            for (size_t j = 0; j < mf.metrics.size(); j++) {
+                auto& value = shard->values[i][j];
+                auto& info = mf.metrics[j];
+                if (info.should_skip_when_empty && value.is_empty()) {
+                    continue;
+                }
+                mi::labels_type labels;
+                for (auto& [key, label] : info.id.labels()) {
+                    if (boost::algorithm::starts_with(key, "__")
+                            || (_cfg.aggregate_shards && key == metrics::shard_label.name())
+                            || std::find(mf.mf.aggregate_labels.begin(), mf.mf.aggregate_labels.end(), key) != mf.mf.aggregate_labels.end()) {
+                        continue;
+                    }
+                    labels.emplace(key, label);
+                }
+                auto [it, inserted] = family.values.try_emplace(std::move(labels), value);
+                if (!inserted) {
+                    it->second += value;
+                }
+            }
+            co_await coroutine::maybe_yield();
+        }
+    }
+
+    pb::ExportMetricsServiceRequest req;
+    auto rm = req.add_resource_metrics();
+    for (auto& [key, value] : _cfg.resource_attributes) {
+        add_attribute(rm->mutable_resource()->mutable_attributes(), key, value);
+    }
+    auto sm = rm->add_scope_metrics();
+    sm->mutable_scope()->set_name("seastar");
+    std::map<series_key, mi::metric_value> last;
+    for (auto& entry : families) {
+        auto& name = entry.first;
+        auto& family = entry.second;
+        if (family.values.empty()) {
+            continue;
+        }
+        auto& metric = *sm->add_metrics();
+        metric.set_name(fmt::format("{}_{}", _cfg.prefix, name));
+        metric.set_description(family.info->d.str());
+        for (auto& [labels, value] : family.values) {
+            const mi::metric_value* prev = nullptr;
+            if (_cfg.delta) {
+                auto it = _last.find(series_key{name, labels});
+                prev = it != _last.end() ? &it->second : nullptr;
+            }
+            switch (value.type()) {
+            case mi::data_type::GAUGE:
+                fill_number(metric.mutable_gauge()->mutable_data_points(), value, value.d(), labels, start_ns, now_ns);
+                break;
+            case mi::data_type::COUNTER:
+            case mi::data_type::REAL_COUNTER: {
+                auto sum = metric.mutable_sum();
+                sum->set_is_monotonic(true);
+                sum->set_aggregation_temporality(_cfg.delta ? pb::AGGREGATION_TEMPORALITY_DELTA : pb::AGGREGATION_TEMPORALITY_CUMULATIVE);
+                fill_number(sum->mutable_data_points(), value, internal::to_delta(value, prev).d(), labels, start_ns, now_ns);
+                break;
+            }
+            case mi::data_type::HISTOGRAM:
+                fill_histogram(metric, internal::to_delta(value, prev).get_histogram(), labels, start_ns, now_ns, _cfg.delta);
+                break;
+            case mi::data_type::SUMMARY:
+                fill_summary(metric, value.get_histogram(), labels, to_unix_nano(_start), now_ns);
+                break;
+            }
+            if (_cfg.delta) {
+                last.emplace(series_key{name, labels}, value);
+            }
+        }
+        co_await coroutine::maybe_yield();
+    }
+
+    auto body = req.SerializeAsString();
+    auto rq = http::request::make("POST", _cfg.host, _cfg.path);
+    if (_cfg.compress) {
+        rq._headers["Content-Encoding"] = "gzip";
+        rq.write_body("application/x-protobuf", [body = std::move(body)] (output_stream<char>&& out) mutable {
+            return do_with(http::make_compressing_output_stream(std::move(out), http::content_encoding::gzip), std::move(body),
+                    [] (output_stream<char>& out, std::string& body) {
+                return out.write(body.data(), body.size()).finally([&out] {
+                    return out.close();
+                });
+            });
+        });
+    } else {
+        rq.write_body("application/x-protobuf", sstring(body.data(), body.size()));
+    }
+    co_await _client->make_request(std::move(rq), [] (const http::reply&, input_stream<char>&& in) {
+        return do_with(std::move(in), [] (input_stream<char>& in) {
+            return util::skip_entire_stream(in).finally([&in] {
+                return in.close();
+            });
+        });
+    }, http::reply::status_type::ok);
+    // Only advance once the collector has the values, so the next deltas
+    // cover a failed push
+    _last = std::move(last);
+    _last_push = now;
+}
+
+}
+
+}
@@ -32,11 +32,19 @@
 namespace seastar::internal {
 
 // Responsible for pre-faulting in memory so soft page fault latency doesn't impact applications
+//
+// Runs in the background, while the application starts. Each NUMA node gets
+// several workers, since faulting in memory is mostly serialized per thread,
+// and each worker goes round-robin over the shard ranges it was given, so
+// that the beginning of every shard's memory, which is allocated first, is
+// faulted in early.
 class memory_prefaulter {
+    // Workers per NUMA node, bounded by the node's shards and CPUs
+    static constexpr unsigned max_workers_per_node = 8;
     std::atomic<bool> _stop_request = false;
     std::vector<posix_thread> _worker_threads;
     // Keep this in object scope to avoid allocating in worker thread
-    std::unordered_map<unsigned, std::vector<memory::internal::memory_range>> _layout_by_node_id;
+    std::vector<std::vector<memory::internal::memory_range>> _ranges_by_worker;
 public:
     explicit memory_prefaulter(const resource::resources& res, memory::internal::numa_layout layout);
     ~memory_prefaulter();
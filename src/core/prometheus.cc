@@ -113,14 +113,18 @@ static void fill_old_type_histogram(const metrics::histogram& h, ::io::prometheu
 static void fill_native_type_histogram(const metrics::histogram& h, ::io::prometheus::client::Histogram* mh) {
     mh->set_sample_count(h.sample_count);
     mh->set_sample_sum(h.sample_sum);
-    size_t id = h.native_histogram.value().min_id;
+    auto& native = h.native_histogram.value();
+    int32_t id = native.min_id;
 
-    mh->set_schema(h.native_histogram.value().schema);
+    mh->set_schema(native.schema);
+    mh->set_zero_threshold(native.zero_threshold);
+    mh->set_zero_count(native.zero_count);
     double last_bucket = 0;
-    double count = 0;
+    // The zero bucket is part of the cumulative counts
+    double count = native.zero_count;
 
     size_t length = 0;
-    size_t last_bucket_id = 0;
+    int32_t last_bucket_id = 0;
     ::io::prometheus::client::BucketSpan* bucket_span = nullptr;
     for (auto b : h.buckets) {
         // Metrics histograms are aggregated histograms
@@ -719,71 +723,195 @@ class metric_aggregate_by_labels {
     }
 };
 
-std::string get_value_as_string(std::stringstream& s, const mi::metric_value& value) noexcept {
+std::string get_value_as_string(std::string_view series, const mi::metric_value& value) noexcept {
     std::string value_str;
     try {
         value_str = to_str(value);
     } catch (const std::range_error& e) {
-        seastar_logger.debug("prometheus: get_value_as_string: {}: {}", s.str(), e.what());
+        seastar_logger.debug("prometheus: get_value_as_string: {}: {}", series, e.what());
         value_str = "NaN";
     } catch (...) {
         auto ex = std::current_exception();
         // print this error as it's ignored later on by `connection::start_response`
-        seastar_logger.error("prometheus: get_value_as_string: {}: {}", s.str(), ex);
+        seastar_logger.error("prometheus: get_value_as_string: {}: {}", series, ex);
         std::rethrow_exception(std::move(ex));
     }
     return value_str;
 }
 
-future<> write_text_representation(output_stream<char>& out, const config& ctx, const metric_family_range& m, bool show_help, bool enable_aggregation, std::function<bool(const mi::labels_type&)> filter) {
-    return seastar::async([&ctx, &out, &m, show_help, enable_aggregation, filter] () mutable {
-        bool found = false;
+using aggregated_values_map = std::unordered_map<std::map<sstring, sstring>, mi::metric_value>;
+
+/*!
+ * \brief the text exposition of the metric families of one shard
+ *
+ * Every shard renders its own metrics, so that the shard serving the
+ * scrape only has to stream the results in metric family order. Families
+ * that are aggregated over labels are aggregated on each shard, and only
+ * the per-shard aggregates are merged by the serving shard.
+ */
+struct shard_text_families {
+    struct family {
+        // Families can have many series, their text is kept in bounded
+        // chunks not to need large contiguous allocations
+        static constexpr size_t chunk_size = 16 << 10;
+
+        const mi::metric_family_info* info;
+        std::vector<std::string> text;
+        aggregated_values_map aggregated;
+
+        void append(std::string_view data) {
+            if (text.empty() || text.back().size() + data.size() > chunk_size) {
+                text.emplace_back().reserve(std::max(chunk_size, data.size()));
+            }
+            text.back().append(data);
+        }
+    };
+    // Keeps the metadata the families point to alive
+    mi::values_reference values;
+    std::vector<family> families;
+};
+
+static sstring rendered_names_key(const config& ctx) {
+    return ctx.label ? ctx.prefix + "\n" + ctx.label->key() + "=" + ctx.label->value() : ctx.prefix;
+}
+
+static lw_shared_ptr<const mi::rendered_metric_names> get_rendered_names(mi::metric_family_metadata& metadata, const sstring& name, const sstring& key, const config& ctx) {
+    if (metadata.rendered_names && metadata.rendered_names->key == key) {
+        return metadata.rendered_names;
+    }
+    mi::rendered_metric_names rendered;
+    rendered.key = key;
+    rendered.names.reserve(metadata.metrics.size());
+    std::stringstream s;
+    for (auto& info : metadata.metrics) {
+        s.str("");
+        add_name(s, name, info.id.labels(), ctx);
+        rendered.names.emplace_back(s.str());
+    }
+    // Replaced rather than updated, a concurrent scrape may still use it
+    metadata.rendered_names = make_lw_shared<const mi::rendered_metric_names>(std::move(rendered));
+    return metadata.rendered_names;
+}
+
+static bool family_name_matches(const sstring& family_name, const sstring& metric_family_name, bool prefix) {
+    if (metric_family_name == "") {
+        return true;
+    }
+    return prefix ? boost::algorithm::starts_with(family_name, metric_family_name) : family_name == metric_family_name;
+}
+
+static future<foreign_ptr<std::unique_ptr<shard_text_families>>> render_text_families(const config& ctx, const sstring& metric_family_name, bool prefix,
+        bool enable_aggregation, const std::function<bool(const mi::labels_type&)>& filter) {
+    return seastar::async([&ctx, &metric_family_name, prefix, enable_aggregation, &filter] {
+        auto res = std::make_unique<shard_text_families>();
+        res->values = mi::get_values().release();
+        auto key = rendered_names_key(ctx);
         std::stringstream s;
-        for (metric_family& metric_family : m) {
-            auto name = ctx.prefix + "_" + metric_family.name();
-            found = false;
-            metric_aggregate_by_labels aggregated_values(metric_family.metadata().aggregate_labels);
-            bool should_aggregate = enable_aggregation && !metric_family.metadata().aggregate_labels.empty();
-            metric_family.foreach_metric([&s, &out, &ctx, &found, &name, &metric_family, &aggregated_values, should_aggregate, show_help, &filter](const mi::metric_value& value, const mi::metric_info& value_info) mutable {
-                s.clear();
-                s.str("");
+        auto& values = res->values->values;
+        auto& metadata = *res->values->metadata;
+        for (size_t i = 0; i < metadata.size(); i++) {
+            auto& mf_metadata = metadata[i];
+            if (!family_name_matches(mf_metadata.mf.name, metric_family_name, prefix)) {
+                continue;
+            }
+            auto name = ctx.prefix + "_" + mf_metadata.mf.name;
+            auto names = get_rendered_names(mf_metadata, name, key, ctx);
+            bool should_aggregate = enable_aggregation && !mf_metadata.mf.aggregate_labels.empty();
+            metric_aggregate_by_labels aggregated_values(mf_metadata.mf.aggregate_labels);
+            shard_text_families::family family{&mf_metadata.mf, {}, {}};
+            bool found = false;
+            for (size_t j = 0; j < mf_metadata.metrics.size(); j++) {
+                auto& value = values[i][j];
+                auto& value_info = mf_metadata.metrics[j];
                 if ((value_info.should_skip_when_empty && value.is_empty()) || !filter(value_info.id.labels())) {
-                    return;
-                }
-                if (!found) {
-                    if (show_help && metric_family.metadata().d.str() != "") {
-                        s << "# HELP " << name << " " <<  metric_family.metadata().d.str() << '\n';
-                    }
-                    s << "# TYPE " << name << " " << to_str(metric_family.metadata().type) << '\n';
-                    found = true;
+                    continue;
                 }
+                found = true;
                 if (should_aggregate) {
                     aggregated_values.add(value, value_info.id.labels());
-                } else if (value.type() == mi::data_type::SUMMARY) {
-                    write_summary(s, ctx, name, value.get_histogram(), value_info.id.labels());
-                } else if (value.type() == mi::data_type::HISTOGRAM) {
-                    write_histogram(s, ctx, name, value.get_histogram(), value_info.id.labels());
+                } else if (value.type() == mi::data_type::SUMMARY || value.type() == mi::data_type::HISTOGRAM) {
+                    s.str("");
+                    if (value.type() == mi::data_type::SUMMARY) {
+                        write_summary(s, ctx, name, value.get_histogram(), value_info.id.labels());
+                    } else {
+                        write_histogram(s, ctx, name, value.get_histogram(), value_info.id.labels());
+                    }
+                    family.append(s.view());
                 } else {
-                    add_name(s, name, value_info.id.labels(), ctx);
-                    s << get_value_as_string(s, value) << '\n';
+                    auto& series = names->names[j];
+                    family.append(series);
+                    family.append(get_value_as_string(series, value));
+                    family.append("\n");
                 }
-                out.write(s.str()).get();
                 thread::maybe_yield();
+            }
+            if (found) {
+                family.aggregated = aggregated_values.get_values();
+                res->families.emplace_back(std::move(family));
+            }
+        }
+        return make_foreign(std::move(res));
+    });
+}
+
+future<> write_text_representation(output_stream<char>& out, const config& ctx, const sstring& metric_family_name, bool prefix, bool show_help, bool enable_aggregation, std::function<bool(const mi::labels_type&)> filter) {
+    return seastar::async([&ctx, &out, &metric_family_name, prefix, show_help, enable_aggregation, filter = std::move(filter)] {
+        std::vector<foreign_ptr<std::unique_ptr<shard_text_families>>> shards(smp::count);
+        parallel_for_each(boost::irange(0u, smp::count), [&] (unsigned shard) {
+            return smp::submit_to(shard, [&] {
+                return render_text_families(ctx, metric_family_name, prefix, enable_aggregation, filter);
+            }).then([&shards, shard] (auto res) {
+                shards[shard] = std::move(res);
             });
-            if (!aggregated_values.empty()) {
-                for (auto&& h : aggregated_values.get_values()) {
-                    s.clear();
-                    s.str("");
-                    if (h.second.type() == mi::data_type::HISTOGRAM) {
-                        write_histogram(s, ctx, name, h.second.get_histogram(), h.first);
-                    } else {
-                        add_name(s, name, h.first, ctx);
-                        s << get_value_as_string(s, h.second) << '\n';
-                    }
-                    out.write(s.str()).get();
-                    thread::maybe_yield();
+        }).get();
+
+        // The families of every shard are sorted by name, merge them so
+        // that each family is reported as one group
+        std::vector<size_t> positions(smp::count, 0);
+        std::stringstream s;
+        while (true) {
+            const mi::metric_family_info* info = nullptr;
+            for (unsigned shard = 0; shard < smp::count; shard++) {
+                auto& families = shards[shard]->families;
+                if (positions[shard] < families.size() && (!info || families[positions[shard]].info->name < info->name)) {
+                    info = families[positions[shard]].info;
+                }
+            }
+            if (!info) {
+                break;
+            }
+            auto name = ctx.prefix + "_" + info->name;
+            s.str("");
+            if (show_help && info->d.str() != "") {
+                s << "# HELP " << name << " " << info->d.str() << '\n';
+            }
+            s << "# TYPE " << name << " " << to_str(info->type) << '\n';
+            out.write(s.str()).get();
+            metric_aggregate_by_labels aggregated_values(info->aggregate_labels);
+            for (unsigned shard = 0; shard < smp::count; shard++) {
+                auto& families = shards[shard]->families;
+                if (positions[shard] >= families.size() || families[positions[shard]].info->name != info->name) {
+                    continue;
+                }
+                auto& family = families[positions[shard]++];
+                for (auto& chunk : family.text) {
+                    out.write(chunk.data(), chunk.size()).get();
+                }
+                for (auto& [labels, value] : family.aggregated) {
+                    aggregated_values.add(value, labels);
+                }
+            }
+            for (auto&& h : aggregated_values.get_values()) {
+                s.str("");
+                if (h.second.type() == mi::data_type::HISTOGRAM) {
+                    write_histogram(s, ctx, name, h.second.get_histogram(), h.first);
+                } else {
+                    add_name(s, name, h.first, ctx);
+                    s << get_value_as_string(name, h.second) << '\n';
                 }
+                out.write(s.str()).get();
             }
+            thread::maybe_yield();
         }
     });
 }
@@ -901,11 +1029,15 @@ class metrics_handler : public httpd::handler_base  {
         rep->write_body(is_protobuf_format ? "proto" : "txt", [this, is_protobuf_format, metric_family_name, prefix, show_help, enable_aggregation, filter] (output_stream<char>&& s) {
             return do_with(metrics_families_per_shard(), output_stream<char>(std::move(s)),
                     [this, is_protobuf_format, prefix, &metric_family_name, show_help, enable_aggregation, filter] (metrics_families_per_shard& families, output_stream<char>& s) mutable {
-                return get_map_value(families).then([&s, &families, this, is_protobuf_format, prefix, &metric_family_name, show_help, enable_aggregation, filter]() mutable {
+                if (!is_protobuf_format) {
+                    return write_text_representation(s, _ctx, metric_family_name, prefix, show_help, enable_aggregation, filter).finally([&s] () mutable {
+                        return s.close();
+                    });
+                }
+                return get_map_value(families).then([&s, &families, this, prefix, &metric_family_name, enable_aggregation, filter]() mutable {
                     return do_with(get_range(families, metric_family_name, prefix),
-                            [&s, this, is_protobuf_format, show_help, enable_aggregation, filter](metric_family_range& m) {
-                        return (is_protobuf_format) ?  write_protobuf_representation(s, _ctx, m, enable_aggregation, filter) :
-                                write_text_representation(s, _ctx, m, show_help, enable_aggregation, filter);
+                            [&s, this, enable_aggregation, filter](metric_family_range& m) {
+                        return write_protobuf_representation(s, _ctx, m, enable_aggregation, filter);
                     });
                 }).finally([&s] () mutable {
                     return s.close();
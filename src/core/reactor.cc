@@ -30,7 +30,9 @@ module;
 #include <cmath>
 #include <exception>
 #include <filesystem>
+#include <map>
 #include <fstream>
+#include <sstream>
 #include <regex>
 #include <thread>
 
@@ -40,6 +42,8 @@ module;
 #include <sys/vfs.h>
 #include <sys/statfs.h>
 #include <sys/statvfs.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
@@ -50,6 +54,11 @@ module;
 #include <sys/eventfd.h>
 #include <poll.h>
 #include <netinet/in.h>
+#include <linux/errqueue.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 #include <boost/lexical_cast.hpp>
 #include <boost/thread/barrier.hpp>
 #include <boost/algorithm/string/classification.hpp>
@@ -130,6 +139,9 @@ module seastar;
 #else
 #include <seastar/core/abort_on_ebadf.hh>
 #include <seastar/core/alien.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/cross_shard_channel.hh>
+#include <seastar/core/replicated.hh>
 #include <seastar/core/exception_hacks.hh>
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/io_queue.hh>
@@ -155,8 +167,12 @@ module seastar;
 #include <seastar/core/when_all.hh>
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
+#include <seastar/core/internal/cpu_profiler.hh>
+#include <seastar/core/internal/deadline_queue.hh>
+#include <seastar/core/internal/event_trace.hh>
 #include <seastar/core/internal/io_desc.hh>
 #include <seastar/core/internal/uname.hh>
+#include <seastar/core/internal/zerocopy_send.hh>
 #include <seastar/core/internal/stall_detector.hh>
 #include <seastar/core/internal/run_in_background.hh>
 #include <seastar/net/native-stack.hh>
@@ -200,6 +216,20 @@ struct mountpoint_params {
     uint64_t write_saturation_length = std::numeric_limits<uint64_t>::max();
     bool duplex = false;
     float rate_factor = 1.0;
+    // Overrides --num-io-groups for this device
+    unsigned num_io_groups = 0;
+    // Measured by iotune --mixed
+    struct request_size_rates {
+        uint64_t size;
+        uint64_t read_iops;
+        uint64_t write_iops;
+    };
+    std::vector<request_size_rates> request_sizes;
+    struct mixed_rates {
+        uint64_t write_bandwidth;
+        uint64_t read_iops;
+    };
+    std::vector<mixed_rates> mixed;
 };
 
 }
@@ -226,6 +256,32 @@ struct convert<seastar::mountpoint_params> {
         if (node["rate_factor"]) {
             mp.rate_factor = node["rate_factor"].as<float>();
         }
+        if (node["num_io_groups"]) {
+            mp.num_io_groups = node["num_io_groups"].as<unsigned>();
+            if (!mp.num_io_groups) {
+                throw std::runtime_error(fmt::format("num_io_groups of {} must be greater than zero", mp.mountpoint));
+            }
+        }
+        if (node["request_sizes"]) {
+            for (auto&& n : node["request_sizes"]) {
+                mp.request_sizes.push_back({
+                    .size = parse_memory_size(n["size"].as<std::string>()),
+                    .read_iops = parse_memory_size(n["read_iops"].as<std::string>()),
+                    .write_iops = parse_memory_size(n["write_iops"].as<std::string>()),
+                });
+            }
+            std::sort(mp.request_sizes.begin(), mp.request_sizes.end(), [] (const auto& a, const auto& b) {
+                return a.size < b.size;
+            });
+        }
+        if (node["mixed"]) {
+            for (auto&& n : node["mixed"]) {
+                mp.mixed.push_back({
+                    .write_bandwidth = parse_memory_size(n["write_bandwidth"].as<std::string>()),
+                    .read_iops = parse_memory_size(n["read_iops"].as<std::string>()),
+                });
+            }
+        }
         return true;
     }
 };
@@ -268,9 +324,29 @@ void reactor::update_shares_for_queues(internal::priority_class pc, uint32_t sha
 }
 
 future<> reactor::update_bandwidth_for_queues(internal::priority_class pc, uint64_t bandwidth) {
-    return smp::invoke_on_all([pc, bandwidth = bandwidth / _num_io_groups] {
+    // Each IO group of a device has its own bucket, devices may have
+    // different numbers of them
+    return smp::invoke_on_all([pc, bandwidth] {
         return parallel_for_each(engine()._io_queues, [pc, bandwidth] (auto& queue) {
-            return queue.second->update_bandwidth_for_class(pc, bandwidth);
+            return queue.second->update_bandwidth_for_class(pc, bandwidth / queue.second->get_config().num_io_groups);
+        });
+    });
+}
+
+future<> reactor::update_limits_for_queues(internal::priority_class pc, io_limits limits) {
+    return smp::invoke_on_all([pc, limits] {
+        return parallel_for_each(engine()._io_queues, [pc, limits] (auto& queue) {
+            auto nr_groups = queue.second->get_config().num_io_groups;
+            // A share rounded down to zero would mean unlimited
+            auto share = [nr_groups] (uint64_t v) -> uint64_t {
+                return v ? std::max<uint64_t>(v / nr_groups, 1) : 0;
+            };
+            auto group_limits = limits;
+            group_limits.bandwidth = share(limits.bandwidth);
+            group_limits.bandwidth_burst = share(limits.bandwidth_burst);
+            group_limits.iops = share(limits.iops);
+            group_limits.iops_burst = share(limits.iops_burst);
+            return queue.second->update_limits_for_class(pc, group_limits);
         });
     });
 }
@@ -403,6 +479,95 @@ reactor::do_sendmsg(pollable_fd_state& fd, net::packet& p) {
     });
 }
 
+void
+reactor::reap_zerocopy_completions(pollable_fd_state& fd, internal::zerocopy_send_state& zc) {
+    while (!zc.pending.empty()) {
+        char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+        ::msghdr mh = {};
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        auto r = ::recvmsg(fd.fd.get(), &mh, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (r == -1 && errno == EAGAIN) {
+            return;
+        }
+        throw_system_error_on(r == -1, "recvmsg(MSG_ERRQUEUE)");
+        for (auto cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                    && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            sock_extended_err serr;
+            std::memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+            if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // [ee_info, ee_data] is an inclusive range of sequence numbers
+            for (uint32_t seq = serr.ee_info; ; ++seq) {
+                zc.pending.erase(seq);
+                if (seq == serr.ee_data) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+future<size_t>
+reactor::do_sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p, internal::zerocopy_send_state& zc) {
+    return writeable(fd).then([this, &fd, &p, &zc] () mutable {
+        reap_zerocopy_completions(fd, zc);
+
+        ::msghdr mh = {};
+        mh.msg_iov = reinterpret_cast<iovec*>(p.fragment_array());
+        mh.msg_iovlen = std::min<size_t>(p.nr_frags(), IOV_MAX);
+        auto r = ::sendmsg(fd.fd.get(), &mh, MSG_NOSIGNAL | MSG_ZEROCOPY);
+        bool copied = false;
+        if (r == -1 && errno == ENOBUFS) {
+            // Too many zero-copy sends are waiting for their notification
+            // (net.core.optmem_max), copy this one.
+            r = ::sendmsg(fd.fd.get(), &mh, MSG_NOSIGNAL);
+            copied = true;
+        }
+        if (r == -1 && errno == EAGAIN) {
+            return do_sendmsg_zerocopy(fd, p, zc);
+        }
+        throw_system_error_on(r == -1, "sendmsg");
+        if (!copied) {
+            zc.pending.emplace(zc.next_seq++, p.share(0, r));
+        }
+        if (size_t(r) == p.len()) {
+            fd.speculate_epoll(EPOLLOUT);
+        }
+        return make_ready_future<size_t>(r);
+    });
+}
+
+future<>
+reactor::do_wait_zerocopy_sends(pollable_fd_state& fd, internal::zerocopy_send_state& zc) {
+    reap_zerocopy_completions(fd, zc);
+    if (zc.pending.empty()) {
+        return make_ready_future<>();
+    }
+    // The notifications arrive once the peer acknowledged the data, on the
+    // socket error queue, which makes the socket report POLLERR
+    return _backend->poll_error(fd).then([this, &fd, &zc, pending = zc.pending.size()] {
+        reap_zerocopy_completions(fd, zc);
+        if (zc.pending.size() < pending) {
+            return do_wait_zerocopy_sends(fd, zc);
+        }
+        // Nothing was on the error queue, so the socket itself failed
+        int err = fd.fd.getsockopt<int>(SOL_SOCKET, SO_ERROR);
+        if (err) {
+            return make_exception_future<>(std::system_error(err, std::system_category(), "zero-copy send"));
+        }
+        // A hangup keeps the socket polling as failed, until the kernel
+        // frees the data, and notifies us
+        return seastar::sleep(std::chrono::milliseconds(1)).then([this, &fd, &zc] {
+            return do_wait_zerocopy_sends(fd, zc);
+        });
+    });
+}
+
 future<>
 reactor::send_all_part(pollable_fd_state& fd, const void* buffer, size_t len, size_t completed) {
     if (completed == len) {
@@ -476,6 +641,20 @@ future<> pollable_fd_state::write_all(net::packet& p) {
     });
 }
 
+future<> pollable_fd_state::write_all_zerocopy(net::packet& p, internal::zerocopy_send_state& zc) {
+    return engine()._backend->sendmsg_zerocopy(*this, p, zc).then([this, &p, &zc] (size_t size) {
+        if (p.len() == size) {
+            return make_ready_future<>();
+        }
+        p.trim_front(size);
+        return write_all_zerocopy(p, zc);
+    });
+}
+
+future<> pollable_fd_state::wait_zerocopy_sends(internal::zerocopy_send_state& zc) {
+    return engine()._backend->wait_zerocopy_sends(*this, zc);
+}
+
 future<> pollable_fd_state::readable() {
     return engine().readable(*this);
 }
@@ -541,6 +720,36 @@ future<size_t> pollable_fd_state::sendmsg(struct msghdr* msg) {
     });
 }
 
+future<size_t> pollable_fd_state::recvmmsg(struct mmsghdr* msgs, unsigned n) {
+    maybe_no_more_recv();
+    return engine().readable(*this).then([this, msgs, n] {
+        auto r = fd.recvmmsg(msgs, n, 0);
+        if (!r) {
+            return recvmmsg(msgs, n);
+        }
+        // Unless the batch was filled up, the queue was drained
+        if (*r == n) {
+            speculate_epoll(EPOLLIN);
+        }
+        return make_ready_future<size_t>(*r);
+    });
+}
+
+future<size_t> pollable_fd_state::sendmmsg(struct mmsghdr* msgs, unsigned n) {
+    maybe_no_more_send();
+    return engine().writeable(*this).then([this, msgs, n] () mutable {
+        auto r = fd.sendmmsg(msgs, n, 0);
+        if (!r) {
+            return sendmmsg(msgs, n);
+        }
+        // See the comment about speculation in sendmsg().
+        if (*r == n) {
+            speculate_epoll(EPOLLOUT);
+        }
+        return make_ready_future<size_t>(*r);
+    });
+}
+
 future<size_t> pollable_fd_state::sendto(socket_address addr, const void* buf, size_t len) {
     maybe_no_more_send();
     return engine().writeable(*this).then([this, buf, len, addr] () mutable {
@@ -940,9 +1149,21 @@ static sstring shorten_name(const sstring& name, size_t length) {
     return shortname;
 }
 
-reactor::task_queue::task_queue(unsigned id, sstring name, sstring shortname, float shares)
+reactor::sched_entity::sched_entity(float shares, task_queue_group* parent, bool is_group)
         : _shares(std::max(shares, 1.0f))
         , _reciprocal_shares_times_2_power_32((uint64_t(1) << 32) / _shares)
+        , _is_group(is_group)
+        , _parent(parent) {
+}
+
+reactor::task_queue_group::task_queue_group(unsigned id, sstring name, float shares)
+        : sched_entity(shares, nullptr, true)
+        , _id(id)
+        , _name(std::move(name)) {
+}
+
+reactor::task_queue::task_queue(unsigned id, sstring name, sstring shortname, float shares, task_queue_group* parent)
+        : sched_entity(shares, parent, false)
         , _id(id)
         , _ts(now()) {
     rename(name, shortname);
@@ -967,6 +1188,21 @@ reactor::task_queue::register_stats() {
             return std::chrono::duration_cast<std::chrono::milliseconds>(_starvetime).count();
         }, sm::description("Accumulated starvation time of this task queue; an increment rate of 1000ms per second indicates the scheduler feels really bad"),
             {group_label}),
+        sm::make_counter("cpu_user_ms", [this] {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(_cpu_user_time).count();
+        }, sm::description("Accumulated user CPU time of this task queue, see --sched-cpu-accounting"),
+            {group_label}).set_skip_when_empty(),
+        sm::make_counter("cpu_system_ms", [this] {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(_cpu_system_time).count();
+        }, sm::description("Accumulated system CPU time of this task queue, see --sched-cpu-accounting"),
+            {group_label}).set_skip_when_empty(),
+        sm::make_counter("steal_time_ms", [this] {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::max(_steal_time, sched_clock::duration::zero())).count();
+        }, sm::description("Accumulated time this task queue ran without getting the CPU (hypervisor steal, preemption or blocking in the kernel); the part of runtime_ms that isn't CPU time"),
+            {group_label}).set_skip_when_empty(),
+        sm::make_counter("involuntary_context_switches", _involuntary_context_switches,
+                sm::description("Count of times the reactor thread was preempted by the kernel while running this task queue, see --sched-cpu-accounting"),
+                {group_label}).set_skip_when_empty(),
         sm::make_counter("tasks_processed", _tasks_processed,
                 sm::description("Count of tasks executing on this queue; indicates together with runtime_ms indicates length of tasks"),
                 {group_label}),
@@ -976,10 +1212,37 @@ reactor::task_queue::register_stats() {
         sm::make_gauge("shares", [this] { return _shares; },
                 sm::description("Shares allocated to this queue"),
                 {group_label}),
+        sm::make_counter("cpu_throttled_ms", [this] {
+                return _throttled_time / 1ms;
+        }, sm::description("Accumulated time this task queue had work but was held back by its CPU limit, see scheduling_group::set_cpu_limit()"),
+           {group_label}).set_skip_when_empty(),
+        sm::make_counter("network_bytes_sent", _net_send.bytes,
+                sm::description("Total bytes this task queue sent through sockets"),
+                {group_label}).set_skip_when_empty(),
+        sm::make_counter("network_bytes_received", _net_receive.bytes,
+                sm::description("Total bytes this task queue received through sockets"),
+                {group_label}).set_skip_when_empty(),
+        sm::make_counter("network_sends", _net_send.calls,
+                sm::description("Total socket send calls of this task queue"),
+                {group_label}).set_skip_when_empty(),
+        sm::make_counter("network_receives", _net_receive.calls,
+                sm::description("Total socket receive calls of this task queue"),
+                {group_label}).set_skip_when_empty(),
+        sm::make_counter("network_throttled_ms", [this] {
+                return (_net_send.throttled + _net_receive.throttled) / 1ms;
+        }, sm::description("Accumulated time socket I/O of this task queue was delayed by its network bandwidth limit, see scheduling_group::set_network_bandwidth_limit()"),
+           {group_label}).set_skip_when_empty(),
+        sm::make_counter("deadline_misses", _deadline_misses,
+                sm::description("Count of times this latency-critical task queue ran after its deadline, see scheduling_group::set_latency_critical()"),
+                {group_label}).set_skip_when_empty(),
         sm::make_counter("time_spent_on_task_quota_violations_ms", [this] {
                 return _time_spent_on_task_quota_violations / 1ms;
         }, sm::description("Total amount in milliseconds we were in violation of the task quota"),
            {group_label}),
+        sm::make_histogram("queueing_delay", [this] {
+                return _queueing_delay.to_metrics_histogram();
+        }, sm::description("Sampled time tasks of this queue waited to run after they were made runnable, in microseconds (see --queueing-delay-sample-rate)"),
+           {group_label}).set_skip_when_empty(),
     });
     _metrics = std::exchange(new_metrics, {});
 }
@@ -1005,35 +1268,342 @@ __attribute__((no_sanitize("undefined"))) // multiplication below may overflow;
 #endif
 inline
 int64_t
-reactor::task_queue::to_vruntime(sched_clock::duration runtime) const {
+reactor::sched_entity::to_vruntime(sched_clock::duration runtime) const {
     auto scaled = (runtime.count() * _reciprocal_shares_times_2_power_32) >> 32;
     // Prevent overflow from returning ridiculous values
     return std::max<int64_t>(scaled, 0);
 }
 
 void
-reactor::task_queue::set_shares(float shares) noexcept {
+reactor::sched_entity::set_shares(float shares) noexcept {
     _shares = std::max(shares, 1.0f);
     _reciprocal_shares_times_2_power_32 = (uint64_t(1) << 32) / _shares;
 }
 
+void
+reactor::sched_entity::set_cpu_limit(float fraction) noexcept {
+    // A limit below a hundredth is less than a task quota per period
+    _cpu_limit = std::clamp(fraction, 0.01f, 1.0f);
+    if (_cpu_limit < 1) {
+        _cpu_quota = std::chrono::duration_cast<sched_clock::duration>(cpu_limit_period * double(_cpu_limit));
+    } else {
+        _cpu_quota = sched_clock::duration::max();
+    }
+}
+
+bool
+reactor::task_queue::within_deadline_budget(sched_clock::time_point now) noexcept {
+    if (_deadline == sched_clock::duration::max()) {
+        return false;
+    }
+    uint64_t period = now.time_since_epoch() / cpu_limit_period;
+    if (period != _deadline_period) {
+        _deadline_period = period;
+        _deadline_runtime = {};
+    }
+    return _deadline_runtime < _deadline_quota;
+}
+
+bool
+reactor::sched_entity::charge_cpu_limit(sched_clock::duration runtime, sched_clock::time_point now) noexcept {
+    if (_cpu_quota == sched_clock::duration::max()) {
+        return false;
+    }
+    uint64_t period = now.time_since_epoch() / cpu_limit_period;
+    if (period != _period) {
+        _period = period;
+        _period_runtime = {};
+    }
+    _period_runtime += runtime;
+    return _period_runtime >= _cpu_quota;
+}
+
 void
 reactor::account_runtime(task_queue& tq, sched_clock::duration runtime) {
-    if (runtime > (2 * _task_quota)) {
+    if (runtime > (2 * _current_task_quota)) {
         _stalls_histogram.add(runtime);
-        tq._time_spent_on_task_quota_violations += runtime - _task_quota;
+        tq._time_spent_on_task_quota_violations += runtime - _current_task_quota;
     }
     tq._vruntime += tq.to_vruntime(runtime);
     tq._runtime += runtime;
 }
 
+bool
+reactor::io_in_flight() const noexcept {
+    for (auto& [dev, ioq] : _io_queues) {
+        if (ioq->has_pending_requests()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+reactor::adapt_task_quota(bool preempted) noexcept {
+    // Grow after this many runs in a row ended by the quota
+    static constexpr unsigned cpu_bound_runs_to_grow = 8;
+    auto quota = _current_task_quota;
+    if (std::exchange(_ran_latency_critical, false) || !_deadline_task_queues.empty() || io_in_flight()) {
+        // Completions and latency-critical work wait for the quota to expire
+        _cpu_bound_runs = 0;
+        quota = _task_quota;
+    } else if (!preempted) {
+        _cpu_bound_runs = 0;
+    } else if (++_cpu_bound_runs == cpu_bound_runs_to_grow) {
+        _cpu_bound_runs = 0;
+        quota = std::min(2 * _current_task_quota, _max_task_quota);
+    }
+    if (quota != _current_task_quota) {
+        sched_print("task quota {} usec", quota / 1us);
+        _current_task_quota = quota;
+        _task_quota_timer.timerfd_settime(0, seastar::posix::to_relative_itimerspec(quota, quota));
+    }
+}
+
+inline
+sched_clock::duration
+timeval_to_duration(::timeval tv) {
+    return std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec);
+}
+
+void
+reactor::mark_cpu_usage() noexcept {
+    struct ::rusage ru;
+    ::getrusage(RUSAGE_THREAD, &ru);
+    _cpu_usage_mark = {timeval_to_duration(ru.ru_utime), timeval_to_duration(ru.ru_stime), uint64_t(ru.ru_nivcsw)};
+}
+
+void
+reactor::account_cpu_usage(task_queue& tq, sched_clock::duration runtime) noexcept {
+    auto start = _cpu_usage_mark;
+    mark_cpu_usage();
+    auto user = _cpu_usage_mark.user - start.user;
+    auto system = _cpu_usage_mark.system - start.system;
+    tq._cpu_user_time += user;
+    tq._cpu_system_time += system;
+    // Whatever wasn't spent on the CPU was stolen by the hypervisor, other
+    // threads, or by blocking in the kernel (e.g. major page faults). The
+    // CPU time is reported at microsecond granularity, so single runs can
+    // go slightly negative; it evens out in the sum.
+    tq._steal_time += runtime - user - system;
+    tq._involuntary_context_switches += _cpu_usage_mark.involuntary_context_switches - start.involuntary_context_switches;
+}
+
 void
 reactor::account_idle(sched_clock::duration runtime) {
-    // anything to do here?
+    if (!_adaptive_idle_poll) {
+        return;
+    }
+    _idle_gap_estimate = (_idle_gap_estimate * 7 + std::chrono::duration_cast<std::chrono::nanoseconds>(runtime)) / 8;
+    if (2 * _idle_gap_estimate <= _max_poll_time) {
+        _adaptive_poll_time = std::max<std::chrono::nanoseconds>(2 * _idle_gap_estimate, 1us);
+    } else {
+        // Work usually comes after we'd have gone to sleep, polling for
+        // long would mostly burn the CPU for nothing
+        _adaptive_poll_time = _max_poll_time / 8;
+    }
+}
+
+namespace {
+
+#if defined(__x86_64__)
+
+bool have_waitpkg() noexcept {
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 5));
+}
+
+// Waits in C0.2 for about a microsecond, or until an interrupt
+[[gnu::target("waitpkg")]]
+void timed_pause() noexcept {
+    _tpause(0, __rdtsc() + 2000);
+}
+
+#else
+
+bool have_waitpkg() noexcept {
+    return false;
+}
+
+void timed_pause() noexcept {
+}
+
+#endif
+
+}
+
+void
+reactor::idle_relax(sched_clock::duration idletime) noexcept {
+    // Wake-ups right after going idle are the common case, spin through
+    // them; the deeper wait costs a little latency
+    static constexpr auto spin_time = 5us;
+    static const bool waitpkg = have_waitpkg();
+    if (_adaptive_idle_poll && waitpkg && idletime > spin_time) {
+        timed_pause();
+    } else {
+        internal::cpu_relax();
+    }
+}
+
+void
+reactor::poll_cgroup_limits() {
+    run_in_background(_thread_pool->submit<resource_limits>(syscall_kind::metadata, [] {
+        resource_limits limits;
+        limits.cpus = cgroup::cpu_quota();
+        auto memory = cgroup::memory_limit();
+        if (memory != std::numeric_limits<size_t>::max()) {
+            limits.memory = memory;
+        }
+        return limits;
+    }).then([this] (resource_limits limits) {
+        if (limits == _resource_limits && _initial_memory_limit) {
+            return make_ready_future<>();
+        }
+        seastar_logger.info("cgroup limits: {} cpus, {} bytes of memory",
+                limits.cpus ? fmt::to_string(*limits.cpus) : "unlimited",
+                limits.memory ? fmt::to_string(*limits.memory) : "unlimited");
+        return smp::invoke_on_all([limits] {
+            engine().set_resource_limits(limits);
+        });
+    }).finally([this] {
+        _cgroup_poll_timer.arm(_cgroup_poll_interval);
+    }));
+}
+
+void
+reactor::set_resource_limits(const resource_limits& limits) noexcept {
+    if (!_initial_memory_limit) {
+        // Memory was sized after the limit seen at startup, only react
+        // to it shrinking since
+        _initial_memory_limit = limits.memory.value_or(std::numeric_limits<size_t>::max());
+    }
+    _resource_limits = limits;
+
+    _cpu_quota_fraction = std::min(1.0, limits.cpus.value_or(smp::count) / smp::count);
+    _cpu_quota_window_start = now();
+    _cpu_quota_window_idle = _total_idle;
+
+    size_t excess = 0;
+    if (limits.memory && *limits.memory < *_initial_memory_limit) {
+        excess = (*_initial_memory_limit - *limits.memory) / smp::count;
+        excess = std::min(excess, memory::stats().total_memory() / 2);
+    }
+    try {
+        memory::set_min_free_pages((_default_min_free_memory + excess) / memory::page_size);
+    } catch (...) {
+        seastar_logger.warn("Failed to adapt to the cgroup memory limit: {}", std::current_exception());
+    }
+    if (excess) {
+        memory::release_free_memory();
+    }
+
+    for (auto& s : _resource_limits_subscriptions) {
+        s.notify(_resource_limits);
+    }
+}
+
+void
+reactor::pace_to_cpu_quota() noexcept {
+    // The CFS bandwidth controller stops the whole cgroup once the quota
+    // is used up, for the rest of its period (typically 100ms). Pausing
+    // each shard for a short while once it used its share of the quota
+    // keeps latency bounded by the window instead.
+    auto t = now();
+    auto elapsed = t - _cpu_quota_window_start;
+    if (elapsed >= cpu_quota_window) {
+        _cpu_quota_window_start = t;
+        _cpu_quota_window_idle = _total_idle;
+        return;
+    }
+    auto busy = elapsed - (_total_idle - _cpu_quota_window_idle);
+    if (busy < std::chrono::duration_cast<sched_clock::duration>(cpu_quota_window * _cpu_quota_fraction)) {
+        return;
+    }
+    _cpu_stall_detector->start_sleep();
+    std::this_thread::sleep_for(cpu_quota_window - elapsed);
+    _cpu_stall_detector->end_sleep();
+    auto wakeup = now();
+    _total_idle += wakeup - t;
+    _total_sleep += wakeup - t;
+    ++_cpu_quota_pauses;
+    _cpu_quota_window_start = wakeup;
+    _cpu_quota_window_idle = _total_idle;
+}
+
+// Steal time of a CPU, in USER_HZ ticks
+static std::optional<uint64_t> read_cpu_steal_ticks(int cpu) {
+    std::ifstream stat("/proc/stat");
+    auto prefix = fmt::format("cpu{} ", cpu);
+    std::string line;
+    while (std::getline(stat, line)) {
+        if (line.starts_with(prefix)) {
+            // cpuN user nice system idle iowait irq softirq steal ...
+            std::istringstream fields(line.substr(prefix.size()));
+            uint64_t value = 0;
+            for (unsigned i = 0; i < 8 && fields >> value; ++i) {
+            }
+            if (fields) {
+                return value;
+            }
+            break;
+        }
+    }
+    return std::nullopt;
+}
+
+void
+reactor::sample_steal_time() {
+    auto t = now();
+    auto usage = _cpu_stall_detector->take_usage_snapshot();
+    auto cpu = ::sched_getcpu();
+    run_in_background(_thread_pool->submit<std::optional<uint64_t>>(syscall_kind::metadata, [cpu] {
+        return read_cpu_steal_ticks(cpu);
+    }).then([this, t, usage, cpu] (std::optional<uint64_t> ticks) {
+        static const long ticks_per_second = ::sysconf(_SC_CLK_TCK);
+        steal_time_sample sample;
+        sample.interval = t - _steal_time_sample_time;
+        sample.runqueue_wait = usage.runqueue_wait - _total_runqueue_wait;
+        sample.involuntary_switches = usage.involuntary_switches - _total_involuntary_switches;
+        // A shard that migrated to another CPU has no baseline there
+        if (ticks && _cpu_steal_ticks && cpu == _steal_time_cpu && ticks_per_second > 0) {
+            sample.hypervisor_steal = std::chrono::nanoseconds(std::chrono::seconds(*ticks - *_cpu_steal_ticks)) / ticks_per_second;
+        }
+        _steal_time_sample_time = t;
+        _total_runqueue_wait = usage.runqueue_wait;
+        _total_involuntary_switches = usage.involuntary_switches;
+        _cpu_steal_ticks = ticks;
+        _steal_time_cpu = cpu;
+        _total_hypervisor_steal += sample.hypervisor_steal;
+        _last_steal_time_sample = sample;
+        for (auto& s : _steal_time_subscriptions) {
+            s.notify(_last_steal_time_sample);
+        }
+    }).finally([this] {
+        _steal_time_sample_timer.arm(_steal_time_sample_interval);
+    }));
+}
+
+const steal_time_sample& last_steal_time_sample() noexcept {
+    return engine()._last_steal_time_sample;
+}
+
+steal_time_subscription::steal_time_subscription(double threshold, callback_type callback)
+        : _threshold(threshold)
+        , _callback(std::move(callback)) {
+    engine()._steal_time_subscriptions.push_back(*this);
 }
 
-struct reactor::task_queue::indirect_compare {
-    bool operator()(const task_queue* tq1, const task_queue* tq2) const {
+const resource_limits& current_resource_limits() noexcept {
+    return engine()._resource_limits;
+}
+
+resource_limits_subscription::resource_limits_subscription(callback_type callback)
+        : _callback(std::move(callback)) {
+    engine()._resource_limits_subscriptions.push_back(*this);
+}
+
+struct reactor::sched_entity::indirect_compare {
+    bool operator()(const sched_entity* tq1, const sched_entity* tq2) const {
         return tq1->_vruntime < tq2->_vruntime;
     }
 };
@@ -1053,7 +1623,7 @@ reactor::reactor(std::shared_ptr<smp> smp, alien::instance& alien, unsigned id,
     , _cpu_started(0)
     , _cpu_stall_detector(internal::make_cpu_stall_detector())
     , _reuseport(posix_reuseport_detect())
-    , _thread_pool(std::make_unique<thread_pool>(*this, seastar::format("syscall-{}", id))) {
+    , _thread_pool(std::make_unique<thread_pool>(*this, seastar::format("syscall-{}", id), cfg.syscall_threads)) {
     /*
      * The _backend assignment is here, not on the initialization list as
      * the chosen backend constructor may want to handle signals and thus
@@ -1064,6 +1634,12 @@ reactor::reactor(std::shared_ptr<smp> smp, alien::instance& alien, unsigned id,
     _task_queues.push_back(std::make_unique<task_queue>(0, "main", "main", 1000));
     _task_queues.push_back(std::make_unique<task_queue>(1, "atexit", "exit", 1000));
     _at_destroy_tasks = _task_queues.back().get();
+    // Supergroup 0 is the top level, which has no group
+    _task_queue_groups.emplace_back();
+    _cpu_limit_timer.set_callback([this] { unthrottle_entities(); });
+    _steady_deadlines = std::make_unique<internal::deadline_queue<steady_clock_type>>();
+    _lowres_deadlines = std::make_unique<internal::deadline_queue<lowres_clock>>();
+    _manual_deadlines = std::make_unique<internal::deadline_queue<manual_clock>>();
     set_need_preempt_var(&_preemption_monitor);
     seastar::thread_impl::init();
     _backend->start_tick();
@@ -1085,6 +1661,7 @@ reactor::reactor(std::shared_ptr<smp> smp, alien::instance& alien, unsigned id,
 }
 
 reactor::~reactor() {
+    internal::stop_local_cpu_profiler();
     sigset_t mask;
     sigemptyset(&mask);
     sigaddset(&mask, internal::cpu_stall_detector::signal_number());
@@ -1092,6 +1669,10 @@ reactor::~reactor() {
     assert(r == 0);
 
     _backend->stop_tick();
+    // Their timers must go while the timer lists are still there
+    _steady_deadlines.reset();
+    _lowres_deadlines.reset();
+    _manual_deadlines.reset();
     auto eraser = [](auto& list) {
         while (!list.empty()) {
             auto& timer = *list.begin();
@@ -1120,6 +1701,7 @@ reactor::~reactor() {
             }
         }
     }
+    internal::coroutine_frame_pool::local().drain();
 }
 
 reactor::sched_stats
@@ -1180,12 +1762,95 @@ cpu_stall_detector::cpu_stall_detector(cpu_stall_detector_config cfg)
 
     namespace sm = seastar::metrics;
 
+    auto schedstat = fmt::format("/proc/self/task/{}/schedstat", syscall(SYS_gettid));
+    _schedstat_fd = ::open(schedstat.c_str(), O_RDONLY | O_CLOEXEC);
+
     _metrics.add_group("stall_detector", {
             sm::make_counter("reported", _total_reported, sm::description("Total number of reported stalls, look in the traces for the exact reason"))});
+    std::array<sstring, size_t(stall_cause::count)> causes;
+    for (size_t i = 0; i < causes.size(); ++i) {
+        causes[i] = cause_name(stall_cause(i));
+    }
+    _metrics.add_group("stall_detector", sm::make_counters("reported_by_cause", _reported_by_cause,
+            sm::description("Number of reported stalls by likely cause, as classified from the resource usage of the reactor thread during the stall"),
+            sm::label("cause"), causes));
 
     // note: if something is added here that can, it should take care to destroy _timer.
 }
 
+cpu_stall_detector::~cpu_stall_detector() {
+    if (_schedstat_fd != -1) {
+        ::close(_schedstat_fd);
+    }
+}
+
+// Async-signal safe
+cpu_stall_detector::usage_snapshot
+cpu_stall_detector::take_usage_snapshot() const noexcept {
+    usage_snapshot ret;
+    struct ::rusage ru;
+    if (::getrusage(RUSAGE_THREAD, &ru) == 0) {
+        ret.user = timeval_to_duration(ru.ru_utime);
+        ret.system = timeval_to_duration(ru.ru_stime);
+        ret.minor_faults = ru.ru_minflt;
+        ret.major_faults = ru.ru_majflt;
+        ret.voluntary_switches = ru.ru_nvcsw;
+        ret.involuntary_switches = ru.ru_nivcsw;
+    }
+    // "<time on cpu> <time waiting on a runqueue> <timeslices>", in ns
+    char buf[64];
+    auto n = _schedstat_fd != -1 ? ::pread(_schedstat_fd, buf, sizeof(buf), 0) : -1;
+    if (n > 0) {
+        auto p = buf, end = buf + n;
+        auto skip_number = [&] {
+            while (p != end && *p >= '0' && *p <= '9') {
+                ++p;
+            }
+        };
+        skip_number();
+        if (p != end && *p == ' ') {
+            ++p;
+            uint64_t wait = 0;
+            while (p != end && *p >= '0' && *p <= '9') {
+                wait = wait * 10 + (*p++ - '0');
+            }
+            ret.runqueue_wait = std::chrono::nanoseconds(wait);
+        }
+    }
+    return ret;
+}
+
+cpu_stall_detector::stall_cause
+cpu_stall_detector::classify(const usage_snapshot& start, const usage_snapshot& end, sched_clock::duration wall) noexcept {
+    auto user = end.user - start.user;
+    auto system = end.system - start.system;
+    auto off_cpu = wall - user - system;
+    if (off_cpu > user + system) {
+        auto runqueue_wait = end.runqueue_wait - start.runqueue_wait;
+        if (end.major_faults != start.major_faults) {
+            return stall_cause::page_faults;
+        } else if (2 * runqueue_wait > off_cpu
+                || end.involuntary_switches - start.involuntary_switches > end.voluntary_switches - start.voluntary_switches) {
+            return stall_cause::preemption;
+        }
+        return stall_cause::blocking;
+    }
+    return system > user ? stall_cause::kernel : stall_cause::user_code;
+}
+
+const char*
+cpu_stall_detector::cause_name(stall_cause c) noexcept {
+    switch (c) {
+    case stall_cause::user_code: return "user_code";
+    case stall_cause::kernel: return "kernel";
+    case stall_cause::page_faults: return "page_faults";
+    case stall_cause::preemption: return "preemption";
+    case stall_cause::blocking: return "blocking";
+    case stall_cause::count: break;
+    }
+    return "unknown";
+}
+
 cpu_stall_detector_posix_timer::cpu_stall_detector_posix_timer(cpu_stall_detector_config cfg) : cpu_stall_detector(cfg) {
     struct sigevent sev = {};
     sev.sigev_notify = SIGEV_THREAD_ID;
@@ -1282,6 +1947,7 @@ void cpu_stall_detector::start_task_run(sched_clock::time_point now) {
         report_suppressions(now);
         _report_at = 1;
         _run_started_at = now;
+        _run_started_usage = take_usage_snapshot();
         _rearm_timer_at = now + _threshold * _report_at;
         arm_timer();
     }
@@ -1472,8 +2138,11 @@ std::unique_ptr<cpu_stall_detector> make_cpu_stall_detector(cpu_stall_detector_c
 
 void cpu_stall_detector::generate_trace() {
     auto delta = reactor::now() - _run_started_at;
+    auto usage = take_usage_snapshot();
+    auto cause = classify(_run_started_usage, usage, delta);
 
     _total_reported++;
+    _reported_by_cause.inc(cause);
     if (_config.report) {
         _config.report();
         return;
@@ -1482,7 +2151,23 @@ void cpu_stall_detector::generate_trace() {
     backtrace_buffer buf;
     buf.append("Reactor stalled for ");
     buf.append_decimal(uint64_t(delta / 1ms));
-    buf.append(" ms");
+    buf.append(" ms (user ");
+    buf.append_decimal(uint64_t((usage.user - _run_started_usage.user) / 1ms));
+    buf.append(" ms, system ");
+    buf.append_decimal(uint64_t((usage.system - _run_started_usage.system) / 1ms));
+    buf.append(" ms, runqueue wait ");
+    buf.append_decimal(uint64_t((usage.runqueue_wait - _run_started_usage.runqueue_wait) / 1ms));
+    buf.append(" ms, ");
+    buf.append_decimal(usage.major_faults - _run_started_usage.major_faults);
+    buf.append(" major and ");
+    buf.append_decimal(usage.minor_faults - _run_started_usage.minor_faults);
+    buf.append(" minor faults, ");
+    buf.append_decimal(usage.voluntary_switches - _run_started_usage.voluntary_switches);
+    buf.append(" voluntary and ");
+    buf.append_decimal(usage.involuntary_switches - _run_started_usage.involuntary_switches);
+    buf.append(" involuntary context switches, likely cause: ");
+    buf.append(cause_name(cause));
+    buf.append(")");
     print_with_backtrace(buf, _config.oneline);
     maybe_report_kernel_trace();
 }
@@ -1604,6 +2289,15 @@ void reactor::configure(const reactor_options& opts) {
     _handle_sigint = !opts.no_handle_interrupt;
     auto task_quota = opts.task_quota_ms.get_value() * 1ms;
     _task_quota = std::chrono::duration_cast<sched_clock::duration>(task_quota);
+    _current_task_quota = _task_quota;
+    _max_task_quota = _task_quota;
+    if (opts.max_task_quota_ms) {
+        auto max_task_quota = opts.max_task_quota_ms.get_value() * 1ms;
+        _max_task_quota = std::max(_task_quota, std::chrono::duration_cast<sched_clock::duration>(max_task_quota));
+    }
+    auto lowres_timer_resolution = opts.lowres_timer_resolution_ms.get_value() * 1ms;
+    _lowres_timers.set_resolution(std::chrono::duration_cast<lowres_clock::duration>(lowres_timer_resolution));
+    _lowres_next_timeout = _lowres_timers.empty() ? lowres_clock::time_point::max() : _lowres_timers.get_next_timeout();
 
     auto blocked_time = opts.blocked_reactor_notify_ms.get_value() * 1ms;
     internal::cpu_stall_detector_config csdc;
@@ -1613,13 +2307,29 @@ void reactor::configure(const reactor_options& opts) {
     _cpu_stall_detector->update_config(csdc);
 
     _max_task_backlog = opts.max_task_backlog.get_value();
+    _queueing_delay_sample_rate = opts.queueing_delay_sample_rate.get_value();
+    _sched_cpu_accounting = opts.sched_cpu_accounting.get_value();
+    if (auto size = opts.event_trace_size.get_value()) {
+        internal::start_local_event_trace(size);
+    }
+    if (auto period = opts.cpu_profiler_period_us.get_value()) {
+        internal::start_local_cpu_profiler(period * 1us);
+    }
     _max_poll_time = opts.idle_poll_time_us.get_value() * 1us;
+    _memory_defragment_interval = std::chrono::milliseconds(opts.memory_defragment_interval_ms.get_value());
+    _memory_release_interval = std::chrono::milliseconds(opts.memory_release_interval_ms.get_value());
+    _cgroup_poll_interval = std::chrono::milliseconds(opts.cgroup_poll_interval_ms.get_value());
+    _steal_time_sample_interval = std::chrono::milliseconds(opts.steal_time_sample_interval_ms.get_value());
+    _default_min_free_memory = memory::min_free_memory();
     if (opts.poll_mode) {
         _max_poll_time = std::chrono::nanoseconds::max();
     }
     if (opts.overprovisioned && opts.idle_poll_time_us.defaulted() && !opts.poll_mode) {
         _max_poll_time = 0us;
     }
+    _adaptive_idle_poll = opts.adaptive_idle_poll.get_value() && !opts.poll_mode;
+    _adaptive_poll_time = _max_poll_time;
+    _poller_max_deferral = opts.poller_max_deferral_us.get_value() * 1us;
     set_strict_dma(!opts.relaxed_dma);
     if (!opts.poll_aio.get_value() || (opts.poll_aio.defaulted() && opts.overprovisioned)) {
         _aio_eventfd = pollable_fd(file_desc::eventfd(0, 0));
@@ -1629,6 +2339,7 @@ void reactor::configure(const reactor_options& opts) {
     _force_io_getevents_syscall = opts.force_aio_syscalls.get_value();
     aio_nowait_supported = opts.linux_aio_nowait.get_value();
     _have_aio_fsync = opts.aio_fsync.get_value();
+    internal::set_coroutine_direct_resume(opts.coroutine_direct_resume.get_value());
 }
 
 pollable_fd
@@ -1656,6 +2367,10 @@ reactor::posix_listen(socket_address sa, listen_options opts) {
     }
 
     file_desc fd = file_desc::socket(sa.u.sa.sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, specific_protocol);
+    if (!sa.is_af_unix()) {
+        // Inherited by the accepted sockets
+        set_busy_poll(fd);
+    }
     if (opts.reuse_address) {
         fd.setsockopt(SOL_SOCKET, SO_REUSEADDR, 1);
     }
@@ -1737,9 +2452,28 @@ pollable_fd
 reactor::make_pollable_fd(socket_address sa, int proto) {
     int maybe_nonblock = _backend->do_blocking_io() ? 0 : SOCK_NONBLOCK;
     file_desc fd = file_desc::socket(sa.u.sa.sa_family, SOCK_STREAM | maybe_nonblock | SOCK_CLOEXEC, proto);
+    if (!sa.is_af_unix()) {
+        set_busy_poll(fd);
+    }
     return pollable_fd(std::move(fd));
 }
 
+void
+reactor::set_busy_poll(file_desc& fd) {
+    if (!_cfg.net_busy_poll_us) {
+        return;
+    }
+    int usecs = _cfg.net_busy_poll_us;
+    int prefer = 1;
+    int budget = _cfg.net_busy_poll_budget;
+    bool ok = ::setsockopt(fd.get(), SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == 0
+            && ::setsockopt(fd.get(), SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == 0
+            && (!budget || ::setsockopt(fd.get(), SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget)) == 0);
+    if (!ok && !std::exchange(_busy_poll_warned, true)) {
+        seastar_logger.warn("Failed to enable busy polling of sockets: {}", std::system_error(errno, std::system_category()).what());
+    }
+}
+
 future<>
 reactor::posix_connect(pollable_fd pfd, socket_address sa, socket_address local) {
 #ifdef IP_BIND_ADDRESS_NO_PORT
@@ -1852,72 +2586,90 @@ size_t sanitize_iovecs(std::vector<iovec>& iov, size_t disk_alignment) noexcept
 
 }
 
+// The part of open_file_dma() which runs once the file is open: upgrades it
+// to O_DIRECT and applies the extent size hint. Takes ownership of fd, which
+// is closed on failure.
+static syscall_result_extra<struct stat>
+finish_open_file_dma(int fd, int open_flags, const file_open_options& options, bool strict_o_direct, bool kernel_page_cache) {
+    // We want O_DIRECT, except in three cases:
+    //   - tmpfs (which doesn't support it, but works fine anyway)
+    //   - strict_o_direct == false (where we forgive it being not supported)
+    //   - kernel_page_cache == true (where we disable it for short-lived test processes)
+    // Because open() with O_DIRECT will fail, we open it without O_DIRECT, try
+    // to update it to O_DIRECT with fcntl(), and if that fails, see if we
+    // can forgive it.
+    auto is_tmpfs = [] (int fd) {
+        struct ::statfs buf;
+        auto r = ::fstatfs(fd, &buf);
+        if (r == -1) {
+            return false;
+        }
+        return buf.f_type == internal::fs_magic::tmpfs;
+    };
+    // Char devices, e.g. NVMe passthrough ones, don't go through the page
+    // cache in the first place
+    auto is_char_device = [] (int fd) {
+        struct stat st;
+        return ::fstat(fd, &st) == 0 && S_ISCHR(st.st_mode);
+    };
+    struct stat st;
+    auto close_fd = defer([fd] () noexcept { ::close(fd); });
+    int o_direct_flag = kernel_page_cache ? 0 : O_DIRECT;
+    int r = ::fcntl(fd, F_SETFL, open_flags | o_direct_flag);
+    if (r == -1  && strict_o_direct) {
+        auto maybe_ret = wrap_syscall(r, st);  // capture errno (should be EINVAL)
+        if (!is_tmpfs(fd) && !is_char_device(fd)) {
+            return maybe_ret;
+        }
+    }
+    if (options.extent_allocation_size_hint && !kernel_page_cache) {
+        fsxattr attr = {};
+        int r = ::ioctl(fd, XFS_IOC_FSGETXATTR, &attr);
+        // xfs delayed allocation is disabled when extent size hints are present.
+        // This causes tons of xfs log fsyncs. Given that extent size hints are
+        // unneeded when delayed allocation is available (which is the case
+        // when not using O_DIRECT), disable them.
+        //
+        // Ignore error; may be !xfs, and just a hint anyway
+        if (r != -1) {
+            attr.fsx_xflags |= XFS_XFLAG_EXTSIZE;
+            attr.fsx_extsize = std::min(options.extent_allocation_size_hint,
+                                file_open_options::max_extent_allocation_size_hint);
+
+            attr.fsx_extsize = align_up<uint32_t>(attr.fsx_extsize, file_open_options::min_extent_size_hint_alignment);
+
+            // Ignore error; may be !xfs, and just a hint anyway
+            ::ioctl(fd, XFS_IOC_FSSETXATTR, &attr);
+        }
+    }
+    r = ::fstat(fd, &st);
+    if (r == -1) {
+        return wrap_syscall(r, st);
+    }
+    close_fd.cancel();
+    return wrap_syscall(fd, st);
+}
+
 future<file>
 reactor::open_file_dma(std::string_view nameref, open_flags flags, file_open_options options) noexcept {
-    return do_with(static_cast<int>(flags), std::move(options), [this, nameref] (auto& open_flags, file_open_options& options) {
-        sstring name(nameref);
-        return _thread_pool->submit<syscall_result_extra<struct stat>>([this, name, &open_flags, &options, strict_o_direct = _strict_o_direct, bypass_fsync = _bypass_fsync] () mutable {
-            // We want O_DIRECT, except in three cases:
-            //   - tmpfs (which doesn't support it, but works fine anyway)
-            //   - strict_o_direct == false (where we forgive it being not supported)
-            //   - _kernel_page_cache == true (where we disable it for short-lived test processes)
-            // Because open() with O_DIRECT will fail, we open it without O_DIRECT, try
-            // to update it to O_DIRECT with fcntl(), and if that fails, see if we
-            // can forgive it.
-            auto is_tmpfs = [] (int fd) {
-                struct ::statfs buf;
-                auto r = ::fstatfs(fd, &buf);
-                if (r == -1) {
-                    return false;
-                }
-                return buf.f_type == internal::fs_magic::tmpfs;
-            };
-            open_flags |= O_CLOEXEC;
-            if (bypass_fsync) {
-                open_flags &= ~O_DSYNC;
-            }
-            struct stat st;
-            auto mode = static_cast<mode_t>(options.create_permissions);
+    return do_with(static_cast<int>(flags), std::move(options), sstring(nameref), [this] (auto& open_flags, file_open_options& options, const sstring& name) {
+        open_flags |= O_CLOEXEC;
+        if (_bypass_fsync) {
+            open_flags &= ~O_DSYNC;
+        }
+        auto mode = static_cast<mode_t>(options.create_permissions);
+        // The fcntl(), fstatfs() and fstat() following the open, and the
+        // ioctl()s of the extent size hint, can block just like the open, so
+        // they run with it in the thread pool rather than after an async
+        // openat() on the reactor
+        return _thread_pool->submit<syscall_result_extra<struct stat>>([&name, &open_flags, &options, mode, strict_o_direct = _strict_o_direct, kernel_page_cache = _kernel_page_cache] {
             int fd = ::open(name.c_str(), open_flags, mode);
             if (fd == -1) {
+                struct stat st;
                 return wrap_syscall(fd, st);
             }
-            auto close_fd = defer([fd] () noexcept { ::close(fd); });
-            int o_direct_flag = _kernel_page_cache ? 0 : O_DIRECT;
-            int r = ::fcntl(fd, F_SETFL, open_flags | o_direct_flag);
-            if (r == -1  && strict_o_direct) {
-                auto maybe_ret = wrap_syscall(r, st);  // capture errno (should be EINVAL)
-                if (!is_tmpfs(fd)) {
-                    return maybe_ret;
-                }
-            }
-            if (fd != -1 && options.extent_allocation_size_hint && !_kernel_page_cache) {
-                fsxattr attr = {};
-                int r = ::ioctl(fd, XFS_IOC_FSGETXATTR, &attr);
-                // xfs delayed allocation is disabled when extent size hints are present.
-                // This causes tons of xfs log fsyncs. Given that extent size hints are
-                // unneeded when delayed allocation is available (which is the case
-                // when not using O_DIRECT), disable them.
-                //
-                // Ignore error; may be !xfs, and just a hint anyway
-                if (r != -1) {
-                    attr.fsx_xflags |= XFS_XFLAG_EXTSIZE;
-                    attr.fsx_extsize = std::min(options.extent_allocation_size_hint,
-                                        file_open_options::max_extent_allocation_size_hint);
-
-                    attr.fsx_extsize = align_up<uint32_t>(attr.fsx_extsize, file_open_options::min_extent_size_hint_alignment);
-
-                    // Ignore error; may be !xfs, and just a hint anyway
-                    ::ioctl(fd, XFS_IOC_FSSETXATTR, &attr);
-                }
-            }
-            r = ::fstat(fd, &st);
-            if (r == -1) {
-                return wrap_syscall(r, st);
-            }
-            close_fd.cancel();
-            return wrap_syscall(fd, st);
-        }).then([&options, name = std::move(name), &open_flags] (syscall_result_extra<struct stat> sr) {
+            return finish_open_file_dma(fd, open_flags, options, strict_o_direct, kernel_page_cache);
+        }).then([&options, &name, &open_flags] (syscall_result_extra<struct stat> sr) {
             sr.throw_fs_exception_if_error("open failed", name);
             return make_file_impl(sr.result, options, open_flags, sr.extra);
         }).then([] (shared_ptr<file_impl> impl) {
@@ -1930,6 +2682,19 @@ future<>
 reactor::remove_file(std::string_view pathname) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([this, pathname] {
+        if (have_async_metadata_ops()) {
+            return do_with(sstring(pathname), [this] (const sstring& pathname) {
+                return submit_metadata_op(internal::io_request::make_unlinkat(AT_FDCWD, pathname.c_str(), 0)).then([this, &pathname] (syscall_result<int> sr) {
+                    // Like remove(3), fall back to rmdir for directories
+                    if (sr.result == -1 && sr.error == EISDIR) {
+                        return submit_metadata_op(internal::io_request::make_unlinkat(AT_FDCWD, pathname.c_str(), AT_REMOVEDIR));
+                    }
+                    return make_ready_future<syscall_result<int>>(sr);
+                }).then([&pathname] (syscall_result<int> sr) {
+                    sr.throw_fs_exception_if_error("remove failed", pathname);
+                });
+            });
+        }
         return _thread_pool->submit<syscall_result<int>>([pathname = sstring(pathname)] {
             return wrap_syscall<int>(::remove(pathname.c_str()));
         }).then([pathname = sstring(pathname)] (syscall_result<int> sr) {
@@ -1943,6 +2708,14 @@ future<>
 reactor::rename_file(std::string_view old_pathname, std::string_view new_pathname) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([this, old_pathname, new_pathname] {
+        if (have_async_metadata_ops()) {
+            return do_with(sstring(old_pathname), sstring(new_pathname), [this] (const sstring& old_pathname, const sstring& new_pathname) {
+                auto req = internal::io_request::make_renameat(AT_FDCWD, old_pathname.c_str(), AT_FDCWD, new_pathname.c_str(), 0);
+                return submit_metadata_op(std::move(req)).then([&old_pathname, &new_pathname] (syscall_result<int> sr) {
+                    sr.throw_fs_exception_if_error("rename failed",  old_pathname, new_pathname);
+                });
+            });
+        }
         return _thread_pool->submit<syscall_result<int>>([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] {
             return wrap_syscall<int>(::rename(old_pathname.c_str(), new_pathname.c_str()));
         }).then([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] (syscall_result<int> sr) {
@@ -2042,6 +2815,53 @@ timespec_to_time_point(const timespec& ts) {
     return std::chrono::system_clock::time_point(d);
 }
 
+static stat_data
+stat_to_stat_data(const struct stat& st) {
+    stat_data sd;
+    sd.device_id = st.st_dev;
+    sd.inode_number = st.st_ino;
+    sd.mode = st.st_mode;
+    sd.type = stat_to_entry_type(st.st_mode);
+    sd.number_of_links = st.st_nlink;
+    sd.uid = st.st_uid;
+    sd.gid = st.st_gid;
+    sd.rdev = st.st_rdev;
+    sd.size = st.st_size;
+    sd.block_size = st.st_blksize;
+    sd.allocated_size = st.st_blocks * 512UL;
+    sd.time_accessed = timespec_to_time_point(st.st_atim);
+    sd.time_modified = timespec_to_time_point(st.st_mtim);
+    sd.time_changed = timespec_to_time_point(st.st_ctim);
+    return sd;
+}
+
+using statx_buffer = struct ::statx;
+
+static std::chrono::system_clock::time_point
+statx_timestamp_to_time_point(const struct ::statx_timestamp& ts) {
+    return timespec_to_time_point(timespec{ts.tv_sec, ts.tv_nsec});
+}
+
+static stat_data
+statx_to_stat_data(const statx_buffer& stx) {
+    stat_data sd;
+    sd.device_id = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    sd.inode_number = stx.stx_ino;
+    sd.mode = stx.stx_mode;
+    sd.type = stat_to_entry_type(stx.stx_mode);
+    sd.number_of_links = stx.stx_nlink;
+    sd.uid = stx.stx_uid;
+    sd.gid = stx.stx_gid;
+    sd.rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+    sd.size = stx.stx_size;
+    sd.block_size = stx.stx_blksize;
+    sd.allocated_size = stx.stx_blocks * 512UL;
+    sd.time_accessed = statx_timestamp_to_time_point(stx.stx_atime);
+    sd.time_modified = statx_timestamp_to_time_point(stx.stx_mtime);
+    sd.time_changed = statx_timestamp_to_time_point(stx.stx_ctime);
+    return sd;
+}
+
 future<size_t> reactor::read_directory(int fd, char* buffer, size_t buffer_size) {
     return _thread_pool->submit<syscall_result<long>>([fd, buffer, buffer_size] () {
         auto ret = ::syscall(__NR_getdents64, fd, reinterpret_cast<linux_dirent64*>(buffer), buffer_size);
@@ -2152,7 +2972,14 @@ reactor::spawn(std::string_view pathname,
                 sigemptyset(&mask_signals);
                 r = ::posix_spawnattr_setsigmask(&attr, &mask_signals);
                 throw_pthread_error(r);
-                r = ::posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+                short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_USEVFORK
+                // Don't copy the page tables of the reactor. glibc 2.24 and
+                // later always spawn with CLONE_VM | CLONE_VFORK, older ones
+                // only when asked to.
+                flags |= POSIX_SPAWN_USEVFORK;
+#endif
+                r = ::posix_spawnattr_setflags(&attr, flags);
                 throw_pthread_error(r);
 
                 return _thread_pool->submit<syscall_result<int>>([&child_pid, &pathname, &actions, &attr,
@@ -2252,6 +3079,16 @@ future<stat_data>
 reactor::file_stat(std::string_view pathname, follow_symlink follow) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([pathname, follow, this] {
+        if (have_async_metadata_ops()) {
+            return do_with(sstring(pathname), statx_buffer{}, [this, follow] (const sstring& pathname, statx_buffer& stx) {
+                int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+                auto req = internal::io_request::make_statx(AT_FDCWD, pathname.c_str(), flags, STATX_BASIC_STATS, &stx);
+                return submit_metadata_op(std::move(req)).then([&pathname, &stx] (syscall_result<int> sr) {
+                    sr.throw_fs_exception_if_error("stat failed", pathname);
+                    return make_ready_future<stat_data>(statx_to_stat_data(stx));
+                });
+            });
+        }
         return _thread_pool->submit<syscall_result_extra<struct stat>>([pathname = sstring(pathname), follow] {
             struct stat st;
             auto stat_syscall = follow ? stat : lstat;
@@ -2259,27 +3096,58 @@ reactor::file_stat(std::string_view pathname, follow_symlink follow) noexcept {
             return wrap_syscall(ret, st);
         }).then([pathname = sstring(pathname)] (syscall_result_extra<struct stat> sr) {
             sr.throw_fs_exception_if_error("stat failed", pathname);
-            struct stat& st = sr.extra;
-            stat_data sd;
-            sd.device_id = st.st_dev;
-            sd.inode_number = st.st_ino;
-            sd.mode = st.st_mode;
-            sd.type = stat_to_entry_type(st.st_mode);
-            sd.number_of_links = st.st_nlink;
-            sd.uid = st.st_uid;
-            sd.gid = st.st_gid;
-            sd.rdev = st.st_rdev;
-            sd.size = st.st_size;
-            sd.block_size = st.st_blksize;
-            sd.allocated_size = st.st_blocks * 512UL;
-            sd.time_accessed = timespec_to_time_point(st.st_atim);
-            sd.time_modified = timespec_to_time_point(st.st_mtim);
-            sd.time_changed = timespec_to_time_point(st.st_ctim);
-            return make_ready_future<stat_data>(std::move(sd));
+            return make_ready_future<stat_data>(stat_to_stat_data(sr.extra));
         });
     });
 }
 
+future<>
+reactor::stat_directory_entries(int dirfd, std::span<const char* const> names, std::span<std::optional<stat_data>> out) noexcept {
+    auto found = [] (const syscall_result<int>& sr) {
+        // The entry may have been removed since the directory was read
+        if (sr.result == -1 && sr.error != ENOENT) {
+            sr.throw_if_error();
+        }
+        return sr.result != -1;
+    };
+    if (have_async_metadata_ops()) {
+        // Submit all the lookups before waiting for any, so that they go to
+        // the kernel together
+        std::vector<statx_buffer> bufs(names.size());
+        std::vector<future<syscall_result<int>>> results;
+        results.reserve(names.size());
+        for (size_t i = 0; i < names.size(); i++) {
+            results.push_back(submit_metadata_op(internal::io_request::make_statx(dirfd, names[i], AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS, &bufs[i])));
+        }
+        std::exception_ptr ex;
+        for (size_t i = 0; i < names.size(); i++) {
+            try {
+                auto sr = co_await std::move(results[i]);
+                out[i] = found(sr) ? std::make_optional(statx_to_stat_data(bufs[i])) : std::nullopt;
+            } catch (...) {
+                // Keep waiting, the kernel still writes into bufs
+                ex = std::current_exception();
+            }
+        }
+        if (ex) {
+            std::rethrow_exception(std::move(ex));
+        }
+        co_return;
+    }
+    std::vector<struct stat> sts(names.size());
+    std::vector<syscall_result<int>> results;
+    results.reserve(names.size());
+    co_await _thread_pool->submit<int>([dirfd, names, &sts, &results] {
+        for (size_t i = 0; i < names.size(); i++) {
+            results.push_back(wrap_syscall<int>(::fstatat(dirfd, names[i], &sts[i], AT_SYMLINK_NOFOLLOW)));
+        }
+        return 0;
+    });
+    for (size_t i = 0; i < names.size(); i++) {
+        out[i] = found(results[i]) ? std::make_optional(stat_to_stat_data(sts[i])) : std::nullopt;
+    }
+}
+
 future<uint64_t>
 reactor::file_size(std::string_view pathname) noexcept {
     return file_stat(pathname, follow_symlink::yes).then([] (stat_data sd) {
@@ -2455,7 +3323,7 @@ reactor::fdatasync(int fd) noexcept {
             return fut;
         });
     }
-    return _thread_pool->submit<syscall_result<int>>([fd] {
+    return _thread_pool->submit<syscall_result<int>>(syscall_kind::data, [fd] {
         return wrap_syscall<int>(::fdatasync(fd));
     }).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
@@ -2463,6 +3331,73 @@ reactor::fdatasync(int fd) noexcept {
     });
 }
 
+void
+reactor::register_file(int fd) noexcept {
+    _backend->register_file(fd);
+}
+
+void
+reactor::unregister_file(int fd) noexcept {
+    _backend->unregister_file(fd);
+}
+
+bool
+reactor::can_link_fdatasync() const noexcept {
+    return !_bypass_fsync && _backend->can_link_fdatasync();
+}
+
+bool
+reactor::have_async_metadata_ops() const noexcept {
+    return _backend->have_async_metadata_ops();
+}
+
+void
+reactor::cancel_io(io_completion* desc) noexcept {
+    _backend->cancel_io(desc);
+}
+
+bool
+reactor::enable_nvme_passthrough() noexcept {
+    return _backend->enable_nvme_passthrough();
+}
+
+future<syscall_result<int>>
+reactor::submit_metadata_op(internal::io_request req) noexcept {
+    // Like fsync_io_desc, doesn't go through the I/O queue and deletes itself
+    struct metadata_io_desc final : public io_completion {
+        promise<syscall_result<int>> _pr;
+    public:
+        virtual void complete(size_t res) noexcept override {
+            _pr.set_value(static_cast<int>(res), 0);
+            delete this;
+        }
+
+        virtual void set_exception(std::exception_ptr eptr) noexcept override {
+            // Hand the error over the same way the syscall thread pool would,
+            // so that callers report it with their own context
+            try {
+                std::rethrow_exception(eptr);
+            } catch (std::system_error& e) {
+                _pr.set_value(-1, e.code().value());
+            } catch (...) {
+                _pr.set_exception(std::current_exception());
+            }
+            delete this;
+        }
+
+        future<syscall_result<int>> get_future() {
+            return _pr.get_future();
+        }
+    };
+
+    return futurize_invoke([this, req = std::move(req)] () mutable {
+        auto desc = new metadata_io_desc;
+        auto fut = desc->get_future();
+        _io_sink.submit(desc, std::move(req));
+        return fut;
+    });
+}
+
 // Note: terminate if arm_highres_timer throws
 // `when` should always be valid
 #ifndef HAVE_OSV
@@ -2539,6 +3474,25 @@ void reactor::del_timer(timer<manual_clock>* tmr) noexcept {
     }
 }
 
+namespace internal {
+
+template <>
+deadline_queue<steady_clock_type>& deadline_queue<steady_clock_type>::local() noexcept {
+    return *engine()._steady_deadlines;
+}
+
+template <>
+deadline_queue<lowres_clock>& deadline_queue<lowres_clock>::local() noexcept {
+    return *engine()._lowres_deadlines;
+}
+
+template <>
+deadline_queue<manual_clock>& deadline_queue<manual_clock>::local() noexcept {
+    return *engine()._manual_deadlines;
+}
+
+}
+
 void reactor::at_exit(noncopyable_function<future<> ()> func) {
     assert(!_stopping);
     _exit_funcs.push_back(std::move(func));
@@ -2609,10 +3563,34 @@ void reactor::register_metrics() {
             // total_operations value:DERIVE:0:U
             sm::make_counter("tasks_processed", std::bind(&reactor::tasks_processed, this), sm::description("Total tasks processed")),
             sm::make_counter("polls", _polls, sm::description("Number of times pollers were executed")),
+            sm::make_counter("poller_calls", _poller_calls,
+                    sm::description("Number of calls to individual pollers, with --poller-max-deferral-us")),
+            sm::make_counter("poller_hits", _poller_hits,
+                    sm::description("Number of calls to individual pollers which found work, with --poller-max-deferral-us")),
+            sm::make_counter("poller_deferrals", _poller_deferrals,
+                    sm::description("Number of times a poller which kept finding no work was skipped, see --poller-max-deferral-us")),
+            sm::make_counter("coroutine_frames_recycled", [] { return internal::coroutine_frame_pool::local().stats().recycled; },
+                    sm::description("Coroutine frames reused from the per shard freelists")),
+            sm::make_counter("coroutine_frames_allocated", [] {
+                auto& stats = internal::coroutine_frame_pool::local().stats();
+                return stats.allocated + stats.large;
+            }, sm::description("Coroutine frames taken from the allocator")),
             sm::make_gauge("timers_pending", std::bind(&decltype(_timers)::size, &_timers), sm::description("Number of tasks in the timer-pending queue")),
             sm::make_gauge("utilization", [this] { return (1-_load)  * 100; }, sm::description("CPU utilization")),
+            sm::make_gauge("task_quota_us", [this] { return _current_task_quota / 1us; },
+                    sm::description("Current task quota in microseconds, see --max-task-quota-ms")),
+            sm::make_counter("cpu_quota_pauses", _cpu_quota_pauses,
+                    sm::description("Number of times the shard paused to stay within the cgroup CPU quota, see --cgroup-poll-interval-ms")),
             sm::make_counter("cpu_busy_ms", [this] () -> int64_t { return total_busy_time() / 1ms; },
                     sm::description("Total cpu busy time in milliseconds")),
+            sm::make_counter("hypervisor_steal_time_ms", [this] () -> int64_t { return _total_hypervisor_steal / 1ms; },
+                    sm::description("Total time the hypervisor ran something else on the virtual CPU of the shard, see --steal-time-sample-interval-ms")),
+            sm::make_counter("runqueue_wait_time_ms", [this] () -> int64_t { return _total_runqueue_wait / 1ms; },
+                    sm::description("Total time the reactor thread was runnable but waited for the CPU behind other threads, see --steal-time-sample-interval-ms")),
+            sm::make_counter("involuntary_context_switches", _total_involuntary_switches,
+                    sm::description("Total number of times the reactor thread was preempted, see --steal-time-sample-interval-ms")),
+            sm::make_gauge("steal_ratio", [this] { return _last_steal_time_sample.steal_ratio(); },
+                    sm::description("Fraction of the last sampling interval lost to steal time and preemption, see --steal-time-sample-interval-ms")),
             sm::make_counter("cpu_steal_time_ms", [this] () -> int64_t { return total_steal_time() / 1ms; },
                     sm::description("Total steal time, the time in which some other process was running while Seastar was not trying to run (not sleeping)."
                                      "Because this is in userspace, some time that could be legitimally thought as steal time is not accounted as such. For example, if we are sleeping and can wake up but the kernel hasn't woken us up yet.")),
@@ -2629,11 +3607,23 @@ void reactor::register_metrics() {
             // total_operations value:DERIVE:0:U
             sm::make_counter("fsyncs", _fsyncs, sm::description("Total number of fsync operations")),
             // total_operations value:DERIVE:0:U
-            sm::make_counter("io_threaded_fallbacks", std::bind(&thread_pool::operation_count, _thread_pool.get()),
+            sm::make_counter("io_threaded_fallbacks", [this] { return _thread_pool->operation_count(); },
                     sm::description("Total number of io-threaded-fallbacks operations")),
 
     });
 
+    std::vector<sm::metric_definition> syscall_metrics;
+    for (auto [kind, name] : {std::pair(syscall_kind::metadata, "metadata"), std::pair(syscall_kind::data, "data")}) {
+        auto kind_label = sm::label("syscall_kind")(name);
+        syscall_metrics.push_back(sm::make_counter("syscall_operations", [this, kind] { return _thread_pool->operation_count(kind); },
+                sm::description("Total number of system calls of this kind offloaded to the syscall threads"), {kind_label}));
+        syscall_metrics.push_back(sm::make_queue_length("syscall_queue_length", [this, kind] { return _thread_pool->queue_length(kind); },
+                sm::description("Number of system calls of this kind submitted to the syscall threads and not yet completed"), {kind_label}));
+        syscall_metrics.push_back(sm::make_histogram("syscall_latency", [this, kind] { return _thread_pool->latency_histogram(kind); },
+                sm::description("A histogram of the time from submission to completion of the system calls of this kind"), {kind_label}).set_skip_when_empty());
+    }
+    _metric_groups.add_group("reactor", syscall_metrics);
+
     _metric_groups.add_group("memory", {
             sm::make_counter("malloc_operations", [] { return memory::stats().mallocs(); },
                     sm::description("Total number of malloc operations")),
@@ -2647,6 +3637,40 @@ void reactor::register_metrics() {
             sm::make_counter("malloc_failed", [] { return memory::stats().failed_allocations(); }, sm::description("Total count of failed memory allocations"))
     });
 
+    // Walking the small pools isn't free, so their metrics share a snapshot.
+    // They're summed over the size classes not to export a few dozen series
+    // per shard, memory_handler has the breakdown.
+    struct small_pools_snapshot {
+        lowres_clock::time_point taken;
+        memory::small_pool_stats total = sum();
+        static memory::small_pool_stats sum() {
+            memory::small_pool_stats total;
+            for (auto& sp : memory::get_small_pool_stats()) {
+                total.objects_in_use += sp.objects_in_use;
+                total.memory += sp.memory;
+                total.unused += sp.unused;
+            }
+            return total;
+        }
+        const memory::small_pool_stats& get() {
+            auto now = lowres_clock::now();
+            if (now - taken >= 1s) {
+                total = sum();
+                taken = now;
+            }
+            return total;
+        }
+    };
+    auto small_pools = make_lw_shared<small_pools_snapshot>();
+    _metric_groups.add_group("memory", {
+            sm::make_gauge("small_pool_objects", [small_pools] { return small_pools->get().objects_in_use; },
+                    sm::description("Number of live objects in the small object pools")),
+            sm::make_current_bytes("small_pool_memory", [small_pools] { return small_pools->get().memory; },
+                    sm::description("Memory held by the small object pools")),
+            sm::make_current_bytes("small_pool_unused_memory", [small_pools] { return small_pools->get().unused; },
+                    sm::description("Memory held by free objects of the small object pools, i.e. fragmentation")),
+    });
+
     _metric_groups.add_group("reactor", {
             sm::make_counter("logging_failures", [] { return logging_failures; }, sm::description("Total number of logging failures")),
             // total_operations value:DERIVE:0:U
@@ -2692,9 +3716,14 @@ void reactor::run_tasks(task_queue& tq) {
         tasks.pop_front();
         STAP_PROBE(seastar, reactor_run_tasks_single_start);
         internal::task_histogram_add_task(*tsk);
+        tq.on_run(tsk);
+        if (__builtin_expect(internal::local_event_trace != nullptr, false)) {
+            internal::local_event_trace->record(internal::trace_event_type::task_run, tsk, &typeid(*tsk), tq._id, 0, 0);
+        }
         _current_task = tsk;
         tsk->run_and_dispose();
         _current_task = nullptr;
+        internal::trace(internal::trace_event_type::task_done, tsk);
         STAP_PROBE(seastar, reactor_run_tasks_single_end);
         ++tq._tasks_processed;
         ++_global_tasks_processed;
@@ -2893,11 +3922,65 @@ class reactor::io_queue_submission_pollfn final : public reactor::pollfn {
 // doesn't have any side effects.
 //
 // We'll take care of those items when we wake up for another reason.
-class reactor::drain_cross_cpu_freelist_pollfn final : public simple_pollfn<true> {
+// The items we queued for other cpus are sent before going to sleep
+// though, so they are not held back for as long as we sleep.
+class reactor::drain_cross_cpu_freelist_pollfn final : public reactor::pollfn {
 public:
     virtual bool poll() final override {
         return memory::drain_cross_cpu_freelist();
     }
+    virtual bool pure_poll() override final {
+        return poll();
+    }
+    virtual bool try_enter_interrupt_mode() override final {
+        memory::drain_cross_cpu_freelist();
+        return true;
+    }
+    virtual void exit_interrupt_mode() override final {
+    }
+};
+
+// Scheduling groups are not told about their memory going back under the
+// soft limit from within free(), the allocator only flags them.
+class reactor::memory_soft_limit_pollfn final : public simple_pollfn<true> {
+    reactor& _r;
+public:
+    memory_soft_limit_pollfn(reactor& r) : _r(r) {}
+    virtual bool poll() final override {
+        return memory::internal::drain_scheduling_group_memory_events([this] (unsigned sg_index) {
+            _r.wake_memory_soft_limit_waiters(sg_index);
+        });
+    }
+};
+
+// Each poll loop iteration is a quiescent state for replicated<T>, as is
+// sleeping.
+class reactor::rcu_pollfn final : public reactor::pollfn {
+public:
+    rcu_pollfn() {
+        internal::rcu_exit_idle();
+    }
+    ~rcu_pollfn() {
+        internal::rcu_enter_idle();
+    }
+    virtual bool poll() final override {
+        internal::rcu_quiescent_state();
+        return internal::rcu_has_retired() && internal::rcu_reclaim();
+    }
+    virtual bool pure_poll() final override {
+        return false;
+    }
+    virtual bool try_enter_interrupt_mode() override final {
+        // Nothing would reclaim retired memory while sleeping
+        if (internal::rcu_has_retired()) {
+            return false;
+        }
+        internal::rcu_enter_idle();
+        return true;
+    }
+    virtual void exit_interrupt_mode() override final {
+        internal::rcu_exit_idle();
+    }
 };
 
 class reactor::lowres_timer_pollfn final : public reactor::pollfn {
@@ -2991,7 +4074,41 @@ class reactor::execution_stage_pollfn final : public reactor::pollfn {
         // returned false (idle), there's no more work to do.
         return true;
     }
-    virtual void exit_interrupt_mode() override { }
+    virtual void exit_interrupt_mode() override { }
+};
+
+class reactor::work_stealing_pollfn final : public reactor::pollfn {
+    reactor& _r;
+    unsigned _next = 0;
+public:
+    work_stealing_pollfn(reactor& r) : _r(r) {}
+    virtual bool poll() final override {
+        // Only steal when we'd otherwise be idle
+        if (_r.have_more_tasks()) {
+            return false;
+        }
+        auto& siblings = _r._work_stealing_siblings;
+        for (unsigned i = 0; i < siblings.size(); i++) {
+            auto& victim = siblings[_next++ % siblings.size()]->_stealable_work;
+            if (auto w = victim.steal()) {
+                _r.add_task(make_task(w->sg, [w] { w->run(); }));
+                return true;
+            }
+        }
+        return false;
+    }
+    virtual bool pure_poll() override final {
+        return std::any_of(_r._work_stealing_siblings.begin(), _r._work_stealing_siblings.end(), [] (reactor* r) {
+            return !r->_stealable_work.empty();
+        });
+    }
+    virtual bool try_enter_interrupt_mode() override {
+        // Best effort: if work arrives while we fall asleep, its origin
+        // shard will simply run it itself.
+        return !pure_poll();
+    }
+    virtual void exit_interrupt_mode() override final {
+    }
 };
 
 class reactor::syscall_pollfn final : public reactor::pollfn {
@@ -3052,13 +4169,12 @@ void reactor::stop_aio_eventfd_loop() {
 inline
 bool
 reactor::have_more_tasks() const {
-    return _active_task_queues.size() + _activating_task_queues.size();
+    return _active_task_queues.size() + _activating_task_queues.size() + _deadline_task_queues.size();
 }
 
-void reactor::insert_active_task_queue(task_queue* tq) {
+void reactor::insert_active_task_queue(task_queue_list& atq, sched_entity* tq) {
     tq->_active = true;
-    auto& atq = _active_task_queues;
-    auto less = task_queue::indirect_compare();
+    auto less = sched_entity::indirect_compare();
     if (atq.empty() || less(atq.back(), tq)) {
         // Common case: idle->working
         // Common case: CPU intensive task queue going to the back
@@ -3075,39 +4191,71 @@ void reactor::insert_active_task_queue(task_queue* tq) {
     }
 }
 
-reactor::task_queue* reactor::pop_active_task_queue(sched_clock::time_point now) {
-    task_queue* tq = _active_task_queues.front();
-    _active_task_queues.pop_front();
-    tq->_starvetime += now - tq->_ts;
+reactor::sched_entity* reactor::pop_active_task_queue(task_queue_list& atq) {
+    sched_entity* tq = atq.front();
+    atq.pop_front();
     return tq;
 }
 
 void
-reactor::insert_activating_task_queues() {
+reactor::insert_activating_task_queues(task_queue_list& atq, task_queue_list& activating) {
     // Quadratic, but since we expect the common cases in insert_active_task_queue() to dominate, faster
-    for (auto&& tq : _activating_task_queues) {
-        insert_active_task_queue(tq);
+    for (auto&& tq : activating) {
+        insert_active_task_queue(atq, tq);
     }
-    _activating_task_queues.clear();
+    activating.clear();
 }
 
 void reactor::add_task(task* t) noexcept {
     auto sg = t->group();
     auto* q = _task_queues[sg._id].get();
     bool was_empty = q->_q.empty();
-    q->_q.push_back(std::move(t));
+    q->_q.push_back(t);
+    internal::trace(internal::trace_event_type::task_queued, t, nullptr, sg._id);
+    if (__builtin_expect(_queueing_delay_sample_rate != 0, false)) {
+        q->maybe_sample(t, _queueing_delay_sample_rate);
+    }
     shuffle(q->_q.back(), q->_q);
     if (was_empty) {
         activate(*q);
     }
 }
 
+void internal::submit_stealable_work(stealable_work& w) {
+    auto& r = engine();
+    if (r._work_stealing_siblings.empty()) {
+        r.add_task(make_task(w.sg, [&w] { w.run(); }));
+        return;
+    }
+    r._stealable_work.push(w);
+    // Every queued item gets a task on the origin shard; if a sibling got to
+    // the item first, the task finds nothing to do.
+    r.add_task(make_task(w.sg, [&r, sg = w.sg] {
+        if (auto w = r._stealable_work.pop(sg)) {
+            w->run();
+        }
+    }));
+    // Wake up one sleeping sibling to take it, see lf_queue::maybe_wakeup()
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    for (auto sibling : r._work_stealing_siblings) {
+        if (sibling->_sleeping.load(std::memory_order_relaxed)) {
+            sibling->_sleeping.store(false, std::memory_order_relaxed);
+            sibling->wakeup();
+            break;
+        }
+    }
+}
+
 void reactor::add_urgent_task(task* t) noexcept {
     memory::scoped_critical_alloc_section _;
     auto sg = t->group();
     auto* q = _task_queues[sg._id].get();
     bool was_empty = q->_q.empty();
-    q->_q.push_front(std::move(t));
+    q->_q.push_front(t);
+    internal::trace(internal::trace_event_type::task_queued, t, nullptr, sg._id);
+    if (__builtin_expect(_queueing_delay_sample_rate != 0, false)) {
+        q->maybe_sample(t, _queueing_delay_sample_rate);
+    }
     shuffle(q->_q.front(), q->_q);
     if (was_empty) {
         activate(*q);
@@ -3150,23 +4298,73 @@ reactor::run_some_tasks() {
     sched_clock::time_point t_run_completed = now();
     STAP_PROBE(seastar, reactor_run_tasks_start);
     _cpu_stall_detector->start_task_run(t_run_completed);
+    if (__builtin_expect(_sched_cpu_accounting, false)) {
+        mark_cpu_usage();
+    }
     do {
         auto t_run_started = t_run_completed;
-        insert_activating_task_queues();
-        task_queue* tq = pop_active_task_queue(t_run_started);
+        insert_activating_task_queues(_active_task_queues, _activating_task_queues);
+        task_queue* tq;
+        // Set when a supergroup was picked, rather than a queue
+        task_queue_group* g = nullptr;
+        bool by_deadline = !_deadline_task_queues.empty();
+        if (by_deadline) {
+            tq = static_cast<task_queue*>(pop_active_task_queue(_deadline_task_queues));
+            _ran_latency_critical = true;
+            if (t_run_started > tq->_due) {
+                tq->_deadline_misses++;
+            }
+        } else {
+            sched_entity* e = pop_active_task_queue(_active_task_queues);
+            _last_vruntime = std::max(e->_vruntime, _last_vruntime);
+            if (e->_is_group) {
+                // The supergroup got the CPU, its own queues compete for it
+                g = static_cast<task_queue_group*>(e);
+                insert_activating_task_queues(g->_active_task_queues, g->_activating_task_queues);
+                e = pop_active_task_queue(g->_active_task_queues);
+                g->_last_vruntime = std::max(e->_vruntime, g->_last_vruntime);
+            }
+            tq = static_cast<task_queue*>(e);
+        }
+        tq->_starvetime += t_run_started - tq->_ts;
         sched_print("running tq {} {}", (void*)tq, tq->_name);
-        _last_vruntime = std::max(tq->_vruntime, _last_vruntime);
         run_tasks(*tq);
         t_run_completed = now();
         auto delta = t_run_completed - t_run_started;
         account_runtime(*tq, delta);
+        if (__builtin_expect(_sched_cpu_accounting, false)) {
+            account_cpu_usage(*tq, delta);
+        }
         sched_print("run complete ({} {}); time consumed {} usec; final vruntime {} empty {}",
                 (void*)tq, tq->_name, delta / 1us, tq->_vruntime, tq->_q.empty());
         tq->_ts = t_run_completed;
-        if (!tq->_q.empty()) {
-            insert_active_task_queue(tq);
-        } else {
+        if (by_deadline && tq->within_deadline_budget(t_run_started)) {
+            tq->_deadline_runtime += delta;
+        }
+        bool over_limit = tq->charge_cpu_limit(delta, t_run_completed);
+        if (tq->_q.empty()) {
             tq->_active = false;
+        } else if (over_limit) {
+            throttle(*tq, t_run_completed);
+        } else if (tq->_deadline != sched_clock::duration::max()) {
+            // By deadline again, or by vruntime once over budget
+            make_runnable(*tq, t_run_completed);
+        } else {
+            insert_active_task_queue(g ? g->_active_task_queues : _active_task_queues, tq);
+        }
+        bool parent_over_limit = false;
+        if (tq->_parent) {
+            tq->_parent->_vruntime += tq->_parent->to_vruntime(delta);
+            parent_over_limit = tq->_parent->charge_cpu_limit(delta, t_run_completed);
+        }
+        if (g) {
+            if (!g->has_more_tasks()) {
+                g->_active = false;
+            } else if (parent_over_limit) {
+                throttle(*g, t_run_completed);
+            } else {
+                insert_active_task_queue(_active_task_queues, g);
+            }
         }
         // We must not use internal::scheduler_need_preempt() below,
         // since in debug mode we'll never have two successive calls
@@ -3176,6 +4374,9 @@ reactor::run_some_tasks() {
         // Settle on a regular need_preempt(), which will return true in
         // debug mode.
     } while (have_more_tasks() && !need_preempt());
+    if (_max_task_quota != _task_quota) {
+        adapt_task_quota(have_more_tasks());
+    }
     _cpu_stall_detector->end_task_run(t_run_completed);
     STAP_PROBE(seastar, reactor_run_tasks_end);
     *internal::current_scheduling_group_ptr() = default_scheduling_group(); // Prevent inheritance from last group run
@@ -3194,14 +4395,85 @@ reactor::activate(task_queue& tq) {
     // bound later.
     //
     // FIXME: different scheduling groups have different sensitivity to jitter, take advantage
-    if (_last_vruntime > tq._vruntime) {
-        sched_print("tq {} {} losing vruntime {} due to sleep", (void*)&tq, tq._name, _last_vruntime - tq._vruntime);
+    auto last_vruntime = tq._parent ? tq._parent->_last_vruntime : _last_vruntime;
+    if (last_vruntime > tq._vruntime) {
+        sched_print("tq {} {} losing vruntime {} due to sleep", (void*)&tq, tq._name, last_vruntime - tq._vruntime);
     }
-    tq._vruntime = std::max(_last_vruntime, tq._vruntime);
+    tq._vruntime = std::max(last_vruntime, tq._vruntime);
     auto now = reactor::now();
     tq._waittime += now - tq._ts;
     tq._ts = now;
-    _activating_task_queues.push_back(&tq);
+    make_runnable(tq, now);
+}
+
+void
+reactor::activate(task_queue_group& g) {
+    if (g._active) {
+        return;
+    }
+    g._vruntime = std::max(_last_vruntime, g._vruntime);
+    make_runnable(g, reactor::now());
+}
+
+void
+reactor::make_runnable(sched_entity& e, sched_clock::time_point now) {
+    e._active = true;
+    if (e.charge_cpu_limit({}, now)) {
+        throttle(e, now);
+    } else if (!e._is_group && static_cast<task_queue&>(e).within_deadline_budget(now)
+            && !(e._parent && e._parent->charge_cpu_limit({}, now))) {
+        insert_deadline_task_queue(static_cast<task_queue&>(e), now);
+    } else if (e._parent) {
+        e._parent->_activating_task_queues.push_back(&e);
+        activate(*e._parent);
+    } else {
+        _activating_task_queues.push_back(&e);
+    }
+}
+
+void
+reactor::insert_deadline_task_queue(task_queue& tq, sched_clock::time_point now) {
+    tq._due = now + tq._deadline;
+    auto& dtq = _deadline_task_queues;
+    dtq.push_back(&tq);
+    for (size_t i = dtq.size() - 1; i > 0 && static_cast<task_queue*>(dtq[i - 1])->_due > tq._due; --i) {
+        std::swap(dtq[i - 1], dtq[i]);
+    }
+    if (_current_task) {
+        // Let it run after the current task, rather than at the end of the quota
+        request_preemption();
+    }
+}
+
+void
+reactor::throttle(sched_entity& e, sched_clock::time_point now) {
+    // Stays active, so that it isn't queued again until released
+    e._throttled = true;
+    if (!e._is_group) {
+        static_cast<task_queue&>(e)._throttled_since = now;
+    }
+    _throttled_entities.push_back(&e);
+    if (!_cpu_limit_timer.armed()) {
+        _cpu_limit_timer.arm(sched_clock::time_point(cpu_limit_period * (e._period + 1)));
+    }
+}
+
+void
+reactor::unthrottle_entities() noexcept {
+    auto now = reactor::now();
+    auto throttled = std::exchange(_throttled_entities, {});
+    for (auto e : throttled) {
+        e->_throttled = false;
+        if (!e->_is_group) {
+            auto& tq = static_cast<task_queue&>(*e);
+            tq._throttled_time += now - tq._throttled_since;
+        } else if (!static_cast<task_queue_group*>(e)->has_more_tasks()) {
+            // Its queues are held back too, they activate it when released
+            e->_active = false;
+            continue;
+        }
+        make_runnable(*e, now);
+    }
 }
 
 void reactor::service_highres_timer() noexcept {
@@ -3273,6 +4545,9 @@ int reactor::do_run() {
     // Wait for network stack in the background and then signal all cpus.
     (void)_network_stack_ready->then([this] (std::unique_ptr<network_stack> stack) {
         _network_stack = std::move(stack);
+        if (!_stopping) {
+            at_exit([this] { return _network_stack->close(); });
+        }
         return smp::invoke_on_all([] {
             engine()._cpu_started.signal();
         });
@@ -3280,9 +4555,16 @@ int reactor::do_run() {
 
     poller syscall_poller(std::make_unique<syscall_pollfn>(*this));
 
+    std::optional<poller> work_stealing_poller;
+    if (!_work_stealing_siblings.empty()) {
+        work_stealing_poller.emplace(std::make_unique<work_stealing_pollfn>(*this));
+    }
+
     poller drain_cross_cpu_freelist(std::make_unique<drain_cross_cpu_freelist_pollfn>());
+    poller memory_soft_limit_poller(std::make_unique<memory_soft_limit_pollfn>(*this));
 
     poller expire_lowres_timers(std::make_unique<lowres_timer_pollfn>(*this));
+    poller rcu_poller(std::make_unique<rcu_pollfn>());
     poller sig_poller(std::make_unique<signal_pollfn>(*this));
 
     using namespace std::chrono_literals;
@@ -3305,9 +4587,22 @@ int reactor::do_run() {
     });
     load_timer.arm_periodic(1s);
 
-    itimerspec its = seastar::posix::to_relative_itimerspec(_task_quota, _task_quota);
+    if (_steal_time_sample_interval.count()) {
+        _steal_time_sample_time = now();
+        auto usage = _cpu_stall_detector->take_usage_snapshot();
+        _total_runqueue_wait = usage.runqueue_wait;
+        _total_involuntary_switches = usage.involuntary_switches;
+        _steal_time_sample_timer.set_callback([this] { sample_steal_time(); });
+        _steal_time_sample_timer.arm(_steal_time_sample_interval);
+    }
+
+    if (_id == 0 && _cgroup_poll_interval.count()) {
+        _cgroup_poll_timer.set_callback([this] { poll_cgroup_limits(); });
+        poll_cgroup_limits();
+    }
+
+    itimerspec its = seastar::posix::to_relative_itimerspec(_current_task_quota, _current_task_quota);
     _task_quota_timer.timerfd_settime(0, its);
-    auto& task_quote_itimerspec = its;
 
     struct sigaction sa_block_notifier = {};
     sa_block_notifier.sa_handler = &reactor::block_notifier;
@@ -3325,6 +4620,9 @@ int reactor::do_run() {
     };
     while (true) {
         run_some_tasks();
+        if (_cpu_quota_fraction < 1) {
+            pace_to_cpu_quota();
+        }
         if (_stopped) {
             load_timer.cancel();
             // Final tasks may include sending the last response to cpu 0, so run them
@@ -3369,8 +4667,22 @@ int reactor::do_run() {
                 report_exception("Exception while running idle cpu handler", std::current_exception());
             }
             if (go_to_sleep) {
-                internal::cpu_relax();
-                if (idle_end - idle_start > _max_poll_time) {
+                idle_relax(idle_end - idle_start);
+                if (idle_end - idle_start > (_adaptive_idle_poll ? _adaptive_poll_time : _max_poll_time)) {
+                    if (_memory_defragment_interval.count() && idle_end - _last_memory_defragment >= _memory_defragment_interval) {
+                        _last_memory_defragment = idle_end;
+                        try {
+                            memory::defragment();
+                        } catch (...) {
+                            report_exception("Exception while defragmenting memory", std::current_exception());
+                        }
+                        // Relocators may have left work behind, poll again before sleeping
+                        continue;
+                    }
+                    if (_memory_release_interval.count() && idle_end - _last_memory_release >= _memory_release_interval) {
+                        _last_memory_release = idle_end;
+                        memory::release_free_memory();
+                    }
                     // Turn off the task quota timer to avoid spurious wakeups
                     struct itimerspec zero_itimerspec = {};
                     _task_quota_timer.timerfd_settime(0, zero_itimerspec);
@@ -3381,7 +4693,7 @@ int reactor::do_run() {
                     // We may have slept for a while, so freshen idle_end
                     idle_end = now();
                     _total_sleep += idle_end - start_sleep;
-                    _task_quota_timer.timerfd_settime(0, task_quote_itimerspec);
+                    _task_quota_timer.timerfd_settime(0, seastar::posix::to_relative_itimerspec(_current_task_quota, _current_task_quota));
                 }
             } else {
                 // We previously ran pure_check_for_work(), might not actually have performed
@@ -3401,10 +4713,10 @@ int reactor::do_run() {
 void
 reactor::sleep() {
     for (auto i = _pollers.begin(); i != _pollers.end(); ++i) {
-        auto ok = (*i)->try_enter_interrupt_mode();
+        auto ok = i->fn->try_enter_interrupt_mode();
         if (!ok) {
             while (i != _pollers.begin()) {
-                (*--i)->exit_interrupt_mode();
+                (--i)->fn->exit_interrupt_mode();
             }
             return;
         }
@@ -3413,15 +4725,55 @@ reactor::sleep() {
     _backend->wait_and_process_events(&_active_sigmask);
 
     for (auto i = _pollers.rbegin(); i != _pollers.rend(); ++i) {
-        (*i)->exit_interrupt_mode();
+        i->fn->exit_interrupt_mode();
+    }
+}
+
+bool
+reactor::poll(registered_poller& p, lowres_clock::time_point now) {
+    _poller_calls++;
+    p.deferred = false;
+    p.last_poll = now;
+    if (p.fn->poll()) {
+        _poller_hits++;
+        p.skip = p.backoff = 0;
+        return true;
     }
+    // Skip 1, 3, 7... polls after consecutive misses
+    p.skip = p.backoff;
+    p.backoff = std::min(2 * p.backoff + 1, registered_poller::max_backoff);
+    return false;
 }
 
 bool
 reactor::poll_once() {
     bool work = false;
-    for (auto c : _pollers) {
-        work |= c->poll();
+    if (!_poller_max_deferral.count()) {
+        for (auto& p : _pollers) {
+            work |= p.fn->poll();
+        }
+        return work;
+    }
+
+    // lowres_clock was just updated by the loop
+    auto now = lowres_clock::now();
+    bool deferred = false;
+    for (auto& p : _pollers) {
+        if (p.skip && now - p.last_poll < _poller_max_deferral) {
+            p.skip--;
+            p.deferred = deferred = true;
+            _poller_deferrals++;
+            continue;
+        }
+        work |= poll(p, now);
+    }
+    // Don't report idle without having polled everyone
+    if (!work && deferred) {
+        for (auto& p : _pollers) {
+            if (p.deferred) {
+                work |= poll(p, now);
+            }
+        }
     }
 
     return work;
@@ -3429,8 +4781,8 @@ reactor::poll_once() {
 
 bool
 reactor::pure_poll_once() {
-    for (auto c : _pollers) {
-        if (c->pure_poll()) {
+    for (auto& p : _pollers) {
+        if (p.fn->pure_poll()) {
             return true;
         }
     }
@@ -3475,15 +4827,19 @@ class poller::deregistration_task final : public task {
 }
 
 void reactor::register_poller(pollfn* p) {
-    _pollers.push_back(p);
+    _pollers.push_back(registered_poller{p});
 }
 
 void reactor::unregister_poller(pollfn* p) {
-    _pollers.erase(std::find(_pollers.begin(), _pollers.end(), p));
+    _pollers.erase(std::find_if(_pollers.begin(), _pollers.end(), [p] (const registered_poller& rp) { return rp.fn == p; }));
 }
 
 void reactor::replace_poller(pollfn* old, pollfn* neww) {
-    std::replace(_pollers.begin(), _pollers.end(), old, neww);
+    for (auto& rp : _pollers) {
+        if (rp.fn == old) {
+            rp.fn = neww;
+        }
+    }
 }
 
 namespace internal {
@@ -3551,9 +4907,12 @@ syscall_work_queue::syscall_work_queue()
 }
 
 void syscall_work_queue::submit_item(std::unique_ptr<syscall_work_queue::work_item> item) {
+    item->submitted = std::chrono::steady_clock::now();
+    ++_in_flight;
     (void)_queue_has_room.wait().then_wrapped([this, item = std::move(item)] (future<> f) mutable {
         // propagate wait failure via work_item
         if (f.failed()) {
+            --_in_flight;
             item->set_exception(f.get_exception());
             return;
         }
@@ -3568,11 +4927,14 @@ unsigned syscall_work_queue::complete() {
     auto nr = _completed.consume_all([&] (work_item* wi) {
         *end++ = wi;
     });
+    auto now = nr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
     for (auto p = tmp_buf.data(); p != end; ++p) {
         auto wi = *p;
+        _latency.add(now - wi->submitted);
         wi->complete();
         delete wi;
     }
+    _in_flight -= nr;
     _queue_has_room.signal(nr);
     return nr;
 }
@@ -3589,12 +4951,38 @@ smp_message_queue::~smp_message_queue()
     if (_pending.remote != _completed.remote) {
         _tx.a.~aa();
     }
+    for (auto slot : _free_work_item_slots) {
+        ::operator delete(slot);
+    }
+}
+
+void* smp_message_queue::allocate_work_item_slot() {
+    if (!_free_work_item_slots.empty()) {
+        auto slot = _free_work_item_slots.back();
+        _free_work_item_slots.pop_back();
+        return slot;
+    }
+    // So that recycling never allocates
+    _free_work_item_slots.reserve(max_free_work_item_slots);
+    return ::operator new(work_item_slot_size);
+}
+
+void smp_message_queue::free_work_item_slot(void* slot) noexcept {
+    if (_free_work_item_slots.size() < _free_work_item_slots.capacity()) {
+        _free_work_item_slots.push_back(slot);
+    } else {
+        ::operator delete(slot);
+    }
 }
 
 void smp_message_queue::stop() {
     _metrics.clear();
 }
 
+static int64_t steady_clock_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 void smp_message_queue::move_pending() {
     auto begin = _tx.a.pending_fifo.cbegin();
     auto end = _tx.a.pending_fifo.cend();
@@ -3608,6 +4996,16 @@ void smp_message_queue::move_pending() {
     _current_queue_length += nr;
     _last_snt_batch = nr;
     _sent += nr;
+    auto now = steady_clock_ns();
+    _request_batch_wait += now - _request_batch_started;
+    _request_batch_started = now;
+}
+
+size_t smp_message_queue::request_batch_size() const noexcept {
+    // Send right away to an idle destination to keep latency low. As it
+    // backs up, let batches grow, so that both sides touch the shared
+    // queue (and bounce its cache lines) less often.
+    return std::clamp<size_t>(_current_queue_length / 4, 1, max_request_batch_size);
 }
 
 bool smp_message_queue::pure_poll_tx() const {
@@ -3616,23 +5014,28 @@ bool smp_message_queue::pure_poll_tx() const {
     return !const_cast<lf_queue&>(_completed).empty();
 }
 
-void smp_message_queue::submit_item(shard_id t, smp_timeout_clock::time_point timeout, std::unique_ptr<smp_message_queue::work_item> item) {
+void smp_message_queue::submit_item(shard_id t, smp_timeout_clock::time_point timeout, work_item_ptr item) {
   // matching signal() in process_completions()
   auto ssg_id = internal::smp_service_group_id(item->ssg);
   auto& sem = get_smp_service_groups_semaphore(ssg_id, t);
   // Future indirectly forwarded to `item`.
-  (void)get_units(sem, 1, timeout).then_wrapped([this, item = std::move(item)] (future<smp_service_group_semaphore_units> units_fut) mutable {
+  (void)get_units(sem, 1, timeout).then_wrapped([this, t, item = std::move(item)] (future<smp_service_group_semaphore_units> units_fut) mutable {
     if (units_fut.failed()) {
         item->fail_with(units_fut.get_exception());
         ++_compl;
         ++_last_cmpl_batch;
         return;
     }
+    if (_tx.a.pending_fifo.empty()) {
+        _request_batch_started = steady_clock_ns();
+    }
     _tx.a.pending_fifo.push_back(item.get());
+    internal::trace(internal::trace_event_type::smp_send, item.get(), nullptr, 0, t);
     // no exceptions from this point
     item.release();
     units_fut.get().release();
-    if (_tx.a.pending_fifo.size() >= batch_size) {
+    _request_batch_size = request_batch_size();
+    if (_tx.a.pending_fifo.size() >= _request_batch_size) {
         move_pending();
     }
   });
@@ -3717,10 +5120,11 @@ size_t smp_message_queue::process_queue(lf_queue& q, Func process) {
 
 size_t smp_message_queue::process_completions(shard_id t) {
     auto nr = process_queue<prefetch_cnt*2>(_completed, [t] (work_item* wi) {
+        internal::trace(internal::trace_event_type::smp_complete, wi, nullptr, 0, t);
         wi->complete();
         auto ssg_id = internal::smp_service_group_id(wi->ssg);
         get_smp_service_groups_semaphore(ssg_id, t).signal();
-        delete wi;
+        wi->dispose();
     });
     _current_queue_length -= nr;
     _compl += nr;
@@ -3737,6 +5141,7 @@ void smp_message_queue::flush_request_batch() {
 
 size_t smp_message_queue::process_incoming() {
     auto nr = process_queue<prefetch_cnt>(_pending, [] (work_item* wi) {
+        internal::trace(internal::trace_event_type::smp_receive, wi);
         wi->process();
     });
     _received += nr;
@@ -3756,6 +5161,9 @@ void smp_message_queue::start(unsigned cpuid) {
             sm::make_queue_length("receive_batch_queue_length", _last_rcv_batch, sm::description("Current receive batch queue length"), {sm::shard_label(instance)})(sm::metric_disabled),
             sm::make_queue_length("complete_batch_queue_length", _last_cmpl_batch, sm::description("Current complete batch queue length"), {sm::shard_label(instance)})(sm::metric_disabled),
             sm::make_queue_length("send_queue_length", _current_queue_length, sm::description("Current send queue length"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_queue_length("send_batch_size", _request_batch_size, sm::description("Current number of messages accumulated before a send batch is flushed"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_counter("send_batch_wait_time", [this] { return std::chrono::duration<double>(std::chrono::nanoseconds(_request_batch_wait)).count(); },
+                    sm::description("Total time in seconds messages waited for their send batch to be flushed"), {sm::shard_label(instance)})(sm::metric_disabled),
             // total_operations value:DERIVE:0:U
             sm::make_counter("total_received_messages", _received, sm::description("Total number of received messages"), {sm::shard_label(instance)})(sm::metric_disabled),
             // total_operations value:DERIVE:0:U
@@ -3866,12 +5274,52 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , poll_mode(*this, "poll-mode", "poll continuously (100% cpu use)")
     , idle_poll_time_us(*this, "idle-poll-time-us", reactor::calculate_poll_time() / 1us,
                 "idle polling time in microseconds (reduce for overprovisioned environments or laptops)")
+    , adaptive_idle_poll(*this, "adaptive-idle-poll", false,
+                "adapt the idle polling time (up to idle-poll-time-us) to how soon work arrives, and wait in a power saving state between polls where supported")
+    , poller_max_deferral_us(*this, "poller-max-deferral-us", 0,
+                "Max time (us) a poller that keeps finding no work is skipped for, while others find work (0: poll all on every iteration)")
     , poll_aio(*this, "poll-aio", true,
                 "busy-poll for disk I/O (reduces latency and increases throughput)")
     , task_quota_ms(*this, "task-quota-ms", 0.5, "Max time (ms) between polls")
+    , max_task_quota_ms(*this, "max-task-quota-ms", {},
+                "Max time (ms) between polls while only CPU bound tasks run, for an adaptive task quota (task-quota-ms if not set)")
+    , lowres_timer_resolution_ms(*this, "lowres-timer-resolution-ms", 0.1,
+                "Resolution (ms) of the timer wheel holding lowres_clock timers, which expire up to this much late")
     , io_latency_goal_ms(*this, "io-latency-goal-ms", {}, "Max time (ms) io operations must take (1.5 * task-quota-ms if not set)")
     , io_flow_ratio_threshold(*this, "io-flow-rate-threshold", 1.1, "Dispatch rate to completion rate threshold")
+    , io_capacity_lease_us(*this, "io-capacity-lease-us", 0,
+                "Time (us) worth of I/O capacity a shard grabs from its I/O group at once (0: grab per request)")
+    , io_adaptive_rate(*this, "io-adaptive-rate", false,
+                "Scale the io-properties rates to keep the observed device latency within io-latency-goal-ms")
+    , io_coalesce_reads(*this, "io-coalesce-reads", false,
+                "Merge reads of adjacent file ranges dispatched together into a single vectored read")
+    , io_request_sample_rate(*this, "io-request-sample-rate", 0,
+                "Sample the time spent in the I/O queue and in the disk for one in every N I/O requests (0: disabled)."
+                " Exported as per-class histograms.")
+    , io_request_log_size(*this, "io-request-log-size", 0,
+                "Number of the most recent sampled I/O requests each I/O queue keeps a log of (0: disabled)")
     , max_task_backlog(*this, "max-task-backlog", 1000, "Maximum number of task backlog to allow; above this we ignore I/O")
+    , queueing_delay_sample_rate(*this, "queueing-delay-sample-rate", 0,
+                "Sample the time tasks wait in their scheduling group's queue before they run, for one in every N tasks (0: disabled)."
+                " Exported as a per-scheduling-group histogram.")
+    , sched_cpu_accounting(*this, "sched-cpu-accounting", false,
+                "Account the user, system and steal CPU time of each scheduling group, at the cost of a getrusage() call each time a group runs")
+    , event_trace_size(*this, "event-trace-size", 0,
+                "Number of the most recent task, I/O and smp events each shard records for event_trace::write_chrome_trace() (0: disabled)")
+    , cpu_profiler_period_us(*this, "cpu-profiler-period-us", 0,
+                "Sample the stacks of the reactor threads for the CPU profiler every this many microseconds of CPU time (0: disabled)")
+    , work_stealing(*this, "work-stealing", false,
+                "Let idle shards run work submitted with smp::submit_stealable() on other shards of the same NUMA node")
+    , coroutine_direct_resume(*this, "coroutine-direct-resume", false,
+                "Resume the awaiter of a completed coroutine within the coroutine's task, instead of scheduling it, while the task quota allows")
+    , memory_defragment_interval_ms(*this, "memory-defragment-interval-ms", 0,
+                "Minimum time (ms) between passes returning sparsely used small object spans to the page allocator, run when the shard is idle (0: disabled)")
+    , memory_release_interval_ms(*this, "memory-release-interval-ms", 0,
+                "Minimum time (ms) between passes returning free memory to the kernel in whole huge pages, run when the shard is idle (0: disabled)")
+    , cgroup_poll_interval_ms(*this, "cgroup-poll-interval-ms", 0,
+                "Interval (ms) between reads of the cgroup CPU quota and memory limit, which shards adapt to (0: disabled)")
+    , steal_time_sample_interval_ms(*this, "steal-time-sample-interval-ms", 0,
+                "Interval (ms) between samples of the hypervisor steal time and run queue wait time of each shard (0: disabled)")
     , blocked_reactor_notify_ms(*this, "blocked-reactor-notify-ms", 25, "threshold in miliseconds over which the reactor is considered blocked if no progress is made")
     , blocked_reactor_reports_per_minute(*this, "blocked-reactor-reports-per-minute", 5, "Maximum number of backtraces reported by stall detector per minute")
     , blocked_reactor_report_format_oneline(*this, "blocked-reactor-report-format-oneline", true, "Print a simplified backtrace on a single line")
@@ -3882,6 +5330,9 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , kernel_page_cache(*this, "kernel-page-cache", false,
                 "Use the kernel page cache. This disables DMA (O_DIRECT)."
                 " Useful for short-lived functional tests with a small data set.")
+    , syscall_threads(*this, "syscall-threads", 1,
+                "Number of threads serving each of the syscall queues (one for metadata operations such as open or rename,"
+                " one for data operations such as fdatasync or ftruncate) of a shard")
     , overprovisioned(*this, "overprovisioned", "run in an overprovisioned environment (such as docker or a laptop); equivalent to --idle-poll-time-us 0 --thread-affinity 0 --poll-aio 0")
     , abort_on_seastar_bad_alloc(*this, "abort-on-seastar-bad-alloc", "abort when seastar allocator cannot allocate memory")
     , force_aio_syscalls(*this, "force-aio-syscalls", false,
@@ -3899,6 +5350,27 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , max_networking_io_control_blocks(*this, "max-networking-io-control-blocks", 10000,
                 "Maximum number of I/O control blocks (IOCBs) to allocate per shard. This translates to the number of sockets supported per shard."
                 " Requires tuning /proc/sys/fs/aio-max-nr. Only valid for the linux-aio reactor backend (see --reactor-backend).")
+    , io_uring_fixed_io(*this, "io-uring-fixed-io", false,
+                "Register the shard's memory and open files with io_uring and use fixed buffers and files for disk I/O."
+                " Pins all of the shard's memory. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_multishot(*this, "io-uring-multishot", false,
+                "Use multishot accept and multishot receive into a kernel-managed buffer ring for sockets."
+                " Requires Linux 6.0 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_sqpoll(*this, "io-uring-sqpoll", false,
+                "Submit io_uring requests from a kernel polling thread (IORING_SETUP_SQPOLL), saving the io_uring_enter system call."
+                " The poller thread of each shard burns a CPU while the shard is busy; see --io-uring-sqpoll-cpuset."
+                " Requires Linux 5.11 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_sqpoll_cpuset(*this, "io-uring-sqpoll-cpuset", {},
+                "CPUs to pin the io_uring submission queue poller threads to, assigned to shards round-robin"
+                " (in cpuset(7) list format (ex: 0,1-3,7); default: the hyperthread sibling of the shard's CPU)")
+    , io_uring_iopoll(*this, "io-uring-iopoll", false,
+                "Poll for the completions of O_DIRECT reads and writes to block devices with polled queues (IORING_SETUP_IOPOLL)"
+                " instead of waiting for interrupts. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , net_busy_poll_us(*this, "net-busy-poll-us", 0,
+                "Busy poll network devices from sockets and the reactor for up to this many microseconds (SO_BUSY_POLL, SO_PREFER_BUSY_POLL)"
+                " instead of waiting for interrupts (0: disabled)")
+    , net_busy_poll_budget(*this, "net-busy-poll-budget", 0,
+                "Maximum number of packets processed per network busy poll (0: kernel default)")
 #ifdef SEASTAR_HEAPPROF
     , heapprof(*this, "heapprof", 0, "Enable seastar heap profiling. Sample every ARG bytes. 0 means off")
 #else
@@ -3950,6 +5422,10 @@ thread_local std::unique_ptr<reactor, reactor_deleter> reactor_holder;
 thread_local smp_message_queue** smp::_qs;
 thread_local std::thread::id smp::_tmain;
 unsigned smp::count = 0;
+std::vector<std::vector<shard_id>> smp::_fan_out_groups;
+std::vector<size_t> smp::_shard_fan_out_group;
+std::vector<std::vector<shard_id>> smp::_numa_node_shards;
+std::vector<unsigned> smp::_shard_numa_node;
 
 void smp::start_all_queues()
 {
@@ -4105,6 +5581,11 @@ class disk_config_params {
     std::unordered_map<dev_t, mountpoint_params> _mountpoints;
     std::chrono::duration<double> _latency_goal;
     double _flow_ratio_backpressure_threshold;
+    std::chrono::duration<double> _capacity_lease_duration;
+    bool _adaptive_rate;
+    bool _coalesce_reads;
+    unsigned _request_sample_rate;
+    unsigned _request_log_size;
 
 public:
     explicit disk_config_params(unsigned max_queues) noexcept
@@ -4117,6 +5598,26 @@ class disk_config_params {
 
     unsigned num_io_groups() const noexcept { return _num_io_groups; }
 
+    // The linear model expects writes at a fraction of the write bandwidth
+    // to take the same fraction of the disk's read capacity away. Devices
+    // where the measured read IOPS drop faster than that under write load
+    // get their writes charged more, by the worst ratio seen.
+    static double write_interference_factor(const mountpoint_params& p) noexcept {
+        double factor = 1.0;
+        if (p.read_req_rate == std::numeric_limits<uint64_t>::max() || p.write_bytes_rate == std::numeric_limits<uint64_t>::max()) {
+            return factor;
+        }
+        for (auto& m : p.mixed) {
+            if (m.write_bandwidth == 0) {
+                continue;
+            }
+            double expected = double(m.write_bandwidth) / p.write_bytes_rate;
+            double lost = 1.0 - std::min(double(m.read_iops) / p.read_req_rate, 1.0);
+            factor = std::max(factor, lost / expected);
+        }
+        return factor;
+    }
+
     std::chrono::duration<double> latency_goal() const {
         return _latency_goal;
     }
@@ -4133,6 +5634,11 @@ class disk_config_params {
         seastar_logger.debug("latency_goal: {}", latency_goal().count());
         _flow_ratio_backpressure_threshold = reactor_opts.io_flow_ratio_threshold.get_value();
         seastar_logger.debug("flow-ratio threshold: {}", _flow_ratio_backpressure_threshold);
+        _capacity_lease_duration = std::chrono::microseconds(reactor_opts.io_capacity_lease_us.get_value());
+        _adaptive_rate = reactor_opts.io_adaptive_rate.get_value();
+        _coalesce_reads = reactor_opts.io_coalesce_reads.get_value();
+        _request_sample_rate = reactor_opts.io_request_sample_rate.get_value();
+        _request_log_size = reactor_opts.io_request_log_size.get_value();
 
         if (smp_opts.num_io_groups) {
             _num_io_groups = smp_opts.num_io_groups.get_value();
@@ -4181,6 +5687,17 @@ class disk_config_params {
                     d.write_bytes_rate *= d.rate_factor;
                     d.read_req_rate *= d.rate_factor;
                     d.write_req_rate *= d.rate_factor;
+                    for (auto& rs : d.request_sizes) {
+                        rs.read_iops *= d.rate_factor;
+                        rs.write_iops *= d.rate_factor;
+                        if (rs.size == 0 || rs.read_iops == 0 || rs.write_iops == 0) {
+                            throw std::runtime_error(fmt::format("Request sizes and their rates must not be zero"));
+                        }
+                    }
+                    for (auto& m : d.mixed) {
+                        m.write_bandwidth *= d.rate_factor;
+                        m.read_iops *= d.rate_factor;
+                    }
 
                     if (d.read_bytes_rate == 0 || d.write_bytes_rate == 0 ||
                             d.read_req_rate == 0 || d.write_req_rate == 0) {
@@ -4204,6 +5721,7 @@ class disk_config_params {
         struct io_queue::config cfg;
 
         cfg.devid = devid;
+        cfg.num_io_groups = nr_groups;
 
         if (p.read_bytes_rate != std::numeric_limits<uint64_t>::max()) {
             cfg.blocks_count_rate = (io_queue::read_request_base_count * (unsigned long)per_io_group(p.read_bytes_rate, nr_groups)) >> io_queue::block_size_shift;
@@ -4219,10 +5737,20 @@ class disk_config_params {
         if (p.write_saturation_length != std::numeric_limits<uint64_t>::max()) {
             cfg.disk_write_saturation_length = p.write_saturation_length;
         }
+        for (auto& rs : p.request_sizes) {
+            cfg.read_costs.push_back({rs.size, 1.0 / per_io_group(rs.read_iops, nr_groups)});
+            cfg.write_costs.push_back({rs.size, 1.0 / per_io_group(rs.write_iops, nr_groups)});
+        }
+        cfg.write_interference_factor = write_interference_factor(p);
         cfg.mountpoint = p.mountpoint;
         cfg.duplex = p.duplex;
         cfg.rate_limit_duration = latency_goal();
         cfg.flow_ratio_backpressure_threshold = _flow_ratio_backpressure_threshold;
+        cfg.capacity_lease_duration = _capacity_lease_duration;
+        cfg.adaptive_rate = _adaptive_rate;
+        cfg.coalesce_reads = _coalesce_reads;
+        cfg.request_sample_rate = _request_sample_rate;
+        cfg.request_log_size = _request_log_size;
         // Block count limit should not be less than the minimal IO size on the device
         // On the other hand, even this is not good enough -- in the worst case the
         // scheduler will self-tune to allow for the single 64k request, while it would
@@ -4235,6 +5763,17 @@ class disk_config_params {
     auto device_ids() {
         return boost::adaptors::keys(_mountpoints);
     }
+
+    // Devices which don't follow --num-io-groups
+    std::unordered_map<dev_t, unsigned> device_num_io_groups() const {
+        std::unordered_map<dev_t, unsigned> ret;
+        for (auto& [dev, p] : _mountpoints) {
+            if (p.num_io_groups) {
+                ret.emplace(dev, p.num_io_groups);
+            }
+        }
+        return ret;
+    }
 };
 
 unsigned smp::adjust_max_networking_aio_io_control_blocks(unsigned network_iocbs)
@@ -4406,6 +5945,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
         rc.devices.push_back(id);
     }
     rc.num_io_groups = disk_config.num_io_groups();
+    rc.device_num_io_groups = disk_config.device_num_io_groups();
 
 #ifdef SEASTAR_HAVE_HWLOC
     if (smp_opts.allow_cpus_in_remote_numa_nodes.get_value()) {
@@ -4440,6 +5980,16 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     reactor_config reactor_cfg;
     reactor_cfg.auto_handle_sigint_sigterm = reactor_opts._auto_handle_sigint_sigterm;
     reactor_cfg.max_networking_aio_io_control_blocks = adjust_max_networking_aio_io_control_blocks(reactor_opts.max_networking_io_control_blocks.get_value());
+    reactor_cfg.io_uring_fixed_io = reactor_opts.io_uring_fixed_io.get_value();
+    reactor_cfg.io_uring_multishot = reactor_opts.io_uring_multishot.get_value();
+    reactor_cfg.io_uring_sqpoll = reactor_opts.io_uring_sqpoll.get_value();
+    reactor_cfg.io_uring_iopoll = reactor_opts.io_uring_iopoll.get_value();
+    reactor_cfg.syscall_threads = reactor_opts.syscall_threads.get_value();
+    reactor_cfg.net_busy_poll_us = reactor_opts.net_busy_poll_us.get_value();
+    reactor_cfg.net_busy_poll_budget = reactor_opts.net_busy_poll_budget.get_value();
+    if (reactor_opts.io_uring_sqpoll_cpuset) {
+        reactor_cfg.io_uring_sqpoll_cpuset = reactor_opts.io_uring_sqpoll_cpuset.get_value();
+    }
 
     std::mutex mtx;
 
@@ -4462,6 +6012,33 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     }
 #endif
 
+    auto node_of = [&allocations] (shard_id s) {
+        return allocations[s].mem.empty() ? 0u : allocations[s].mem.front().nodeid;
+    };
+    std::map<unsigned, std::vector<shard_id>> node_shards;
+    for (shard_id s = 0; s < smp::count; s++) {
+        node_shards[node_of(s)].push_back(s);
+    }
+    _numa_node_shards.clear();
+    _shard_numa_node.resize(smp::count);
+    for (auto& [node, shards] : node_shards) {
+        for (auto s : shards) {
+            _shard_numa_node[s] = _numa_node_shards.size();
+        }
+        _numa_node_shards.push_back(shards);
+    }
+    _fan_out_groups.clear();
+    _shard_fan_out_group.resize(smp::count);
+    for (auto& [node, shards] : node_shards) {
+        for (size_t b = 0; b < shards.size(); b += max_fan_out_group_size) {
+            auto e = std::min(b + max_fan_out_group_size, shards.size());
+            for (size_t i = b; i < e; i++) {
+                _shard_fan_out_group[shards[i]] = _fan_out_groups.size();
+            }
+            _fan_out_groups.emplace_back(shards.begin() + b, shards.begin() + e);
+        }
+    }
+
     // Better to put it into the smp class, but at smp construction time
     // correct smp::count is not known.
     boost::barrier reactors_registered(smp::count);
@@ -4508,13 +6085,6 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
             auto queue = std::move(io_info.queues[shard]);
             assert(queue);
             engine()._io_queues.emplace(dev, std::move(queue));
-
-            auto num_io_groups = io_info.groups.size();
-            if (engine()._num_io_groups == 0) {
-                engine()._num_io_groups = num_io_groups;
-            } else if (engine()._num_io_groups != num_io_groups) {
-                throw std::logic_error(format("Number of IO-groups mismatch, {} != {}", engine()._num_io_groups, num_io_groups));
-            }
         }
     };
 
@@ -4597,6 +6167,16 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
 #endif
 
     reactors_registered.wait();
+    if (reactor_opts.work_stealing.get_value()) {
+        // Other shards wait on smp_queues_constructed, so it's safe to set up theirs too
+        for (shard_id s = 0; s < smp::count; s++) {
+            for (shard_id sibling = 0; sibling < smp::count; sibling++) {
+                if (sibling != s && node_of(sibling) == node_of(s)) {
+                    reactors[s]->_work_stealing_siblings.push_back(reactors[sibling]);
+                }
+            }
+        }
+    }
     _qs_owner = decltype(smp::_qs_owner){new smp_message_queue* [smp::count], qs_deleter{}};
     _qs = _qs_owner.get();
     for(unsigned i = 0; i < smp::count; i++) {
@@ -4638,6 +6218,7 @@ bool smp::poll_queues() {
             got += txq.process_completions(i);
         }
     }
+    got += internal::poll_cross_shard_channels();
     return got != 0;
 }
 
@@ -4653,7 +6234,12 @@ bool smp::pure_poll_queues() {
             }
         }
     }
-    return false;
+    return internal::pure_poll_cross_shard_channels();
+}
+
+void smp::wakeup(shard_id t) noexcept {
+    // The requests this shard sends to t wake t up
+    _qs[t][this_shard_id()]._pending.maybe_wakeup();
 }
 
 __thread reactor* local_engine;
@@ -4721,6 +6307,112 @@ future<connected_socket> connect(socket_address sa, socket_address local, transp
     return engine().connect(sa, local, proto);
 }
 
+namespace {
+
+class connection_race : public enable_lw_shared_from_this<connection_race> {
+    struct attempt {
+        socket sock;
+        bool pending = true;
+    };
+    std::vector<socket_address> _addrs;
+    connect_options _opts;
+    std::vector<attempt> _attempts;
+    size_t _failed = 0;
+    bool _won = false;
+    promise<connected_socket> _done;
+    timer<> _delay;
+public:
+    connection_race(std::vector<socket_address> addrs, const connect_options& opts)
+        : _opts(opts)
+        , _delay([this] { start_next(); })
+    {
+        // RFC 8305 section 4: alternate address families, starting with
+        // the one of the most preferred address
+        auto family = addrs.front().family();
+        auto other = std::stable_partition(addrs.begin(), addrs.end(), [family] (const socket_address& a) {
+            return a.family() == family;
+        });
+        auto a = addrs.begin();
+        auto b = other;
+        while (a != other || b != addrs.end()) {
+            if (a != other) {
+                _addrs.push_back(*a++);
+            }
+            if (b != addrs.end()) {
+                _addrs.push_back(*b++);
+            }
+        }
+        _attempts.reserve(_addrs.size());
+    }
+
+    future<connected_socket> get_future() {
+        return _done.get_future();
+    }
+
+    // Continuations of the attempts keep the race alive, and the timer is
+    // cancelled once it's decided
+    static void start_next(lw_shared_ptr<connection_race> r) {
+        if (r->_won || r->_attempts.size() == r->_addrs.size()) {
+            return;
+        }
+        auto i = r->_attempts.size();
+        r->_attempts.push_back(attempt{make_socket()});
+        if (r->_attempts.size() < r->_addrs.size()) {
+            r->_delay.arm(r->_opts.attempt_delay);
+        }
+        (void)r->_attempts[i].sock.connect(r->_addrs[i], r->_opts.local, r->_opts.proto).then_wrapped([r, i] (future<connected_socket> f) {
+            r->_attempts[i].pending = false;
+            if (f.failed()) {
+                auto ep = f.get_exception();
+                if (r->_won) {
+                    return;
+                }
+                if (++r->_failed == r->_addrs.size()) {
+                    r->_delay.cancel();
+                    r->_done.set_exception(std::move(ep));
+                    return;
+                }
+                // Don't wait for the delay to try the next address
+                r->_delay.cancel();
+                start_next(r);
+                return;
+            }
+            if (r->_won) {
+                return;
+            }
+            r->_won = true;
+            r->_delay.cancel();
+            for (auto& a : r->_attempts) {
+                if (a.pending) {
+                    a.sock.shutdown();
+                }
+            }
+            r->_done.set_value(f.get());
+        });
+    }
+private:
+    void start_next() {
+        // Only armed while an attempt is pending, which holds a reference
+        start_next(shared_from_this());
+    }
+};
+
+}
+
+future<connected_socket> connect_any(std::vector<socket_address> addrs, const connect_options& opts) {
+    if (addrs.empty()) {
+        return make_exception_future<connected_socket>(std::invalid_argument("No address to connect to"));
+    }
+    auto r = make_lw_shared<connection_race>(std::move(addrs), opts);
+    auto f = r->get_future();
+    connection_race::start_next(std::move(r));
+    return f;
+}
+
+future<connected_socket> connect_any(std::vector<socket_address> addrs) {
+    return connect_any(std::move(addrs), connect_options{});
+}
+
 socket make_socket() {
     return engine().net().socket();
 }
@@ -4833,11 +6525,13 @@ std::chrono::nanoseconds reactor::total_steal_time() {
 static std::atomic<unsigned long> s_used_scheduling_group_ids_bitmap{3}; // 0=main, 1=atexit
 static std::atomic<unsigned long> s_next_scheduling_group_specific_key{0};
 
+static std::atomic<unsigned long> s_used_scheduling_supergroup_ids_bitmap{1}; // 0=top level
+
 static
 int
-allocate_scheduling_group_id() noexcept {
+allocate_scheduling_group_id(std::atomic<unsigned long>& used_ids_bitmap = s_used_scheduling_group_ids_bitmap) noexcept {
     static_assert(max_scheduling_groups() <= std::numeric_limits<unsigned long>::digits, "more scheduling groups than available bits");
-    auto b = s_used_scheduling_group_ids_bitmap.load(std::memory_order_relaxed);
+    auto b = used_ids_bitmap.load(std::memory_order_relaxed);
     auto nb = b;
     unsigned i = 0;
     do {
@@ -4846,7 +6540,7 @@ allocate_scheduling_group_id() noexcept {
         }
         i = count_trailing_zeros(~b);
         nb = b | (1ul << i);
-    } while (!s_used_scheduling_group_ids_bitmap.compare_exchange_weak(b, nb, std::memory_order_relaxed));
+    } while (!used_ids_bitmap.compare_exchange_weak(b, nb, std::memory_order_relaxed));
     return i;
 }
 
@@ -4858,8 +6552,8 @@ allocate_scheduling_group_specific_key() noexcept {
 
 static
 void
-deallocate_scheduling_group_id(unsigned id) noexcept {
-    s_used_scheduling_group_ids_bitmap.fetch_and(~(1ul << id), std::memory_order_relaxed);
+deallocate_scheduling_group_id(unsigned id, std::atomic<unsigned long>& used_ids_bitmap = s_used_scheduling_group_ids_bitmap) noexcept {
+    used_ids_bitmap.fetch_and(~(1ul << id), std::memory_order_relaxed);
 }
 
 void
@@ -4893,12 +6587,16 @@ reactor::rename_scheduling_group_specific_data(scheduling_group sg) {
 }
 
 future<>
-reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, sstring shortname, float shares) {
+reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, sstring shortname, float shares, scheduling_supergroup parent) {
     auto& sg_data = _scheduling_group_specific_data;
     auto& this_sg = sg_data.per_scheduling_group_data[sg._id];
     this_sg.queue_is_initialized = true;
+    auto* group = _task_queue_groups[parent._id].get();
     _task_queues.resize(std::max<size_t>(_task_queues.size(), sg._id + 1));
-    _task_queues[sg._id] = std::make_unique<task_queue>(sg._id, name, shortname, shares);
+    _task_queues[sg._id] = std::make_unique<task_queue>(sg._id, name, shortname, shares, group);
+    if (group) {
+        group->_nr_task_queues++;
+    }
     unsigned long num_keys = s_next_scheduling_group_specific_key.load(std::memory_order_relaxed);
 
     return with_scheduling_group(sg, [this, num_keys, sg] () {
@@ -4954,11 +6652,32 @@ reactor::destroy_scheduling_group(scheduling_group sg) noexcept {
         auto& sg_data = _scheduling_group_specific_data;
         auto& this_sg = sg_data.per_scheduling_group_data[sg._id];
         this_sg.queue_is_initialized = false;
-        _task_queues[sg._id].reset();
+        auto& tq = _task_queues[sg._id];
+        if (tq->_parent) {
+            tq->_parent->_nr_task_queues--;
+        }
+        _throttled_entities.erase(std::remove(_throttled_entities.begin(), _throttled_entities.end(), tq.get()), _throttled_entities.end());
+        tq.reset();
+        // The index may be reused by a new group, which starts without a limit
+        memory::internal::set_scheduling_group_memory_soft_limit(sg._id, std::numeric_limits<size_t>::max());
+        wake_memory_soft_limit_waiters(sg._id);
     });
 
 }
 
+void
+reactor::init_scheduling_supergroup(scheduling_supergroup sg, sstring name, float shares) {
+    _task_queue_groups.resize(std::max<size_t>(_task_queue_groups.size(), sg._id + 1));
+    _task_queue_groups[sg._id] = std::make_unique<task_queue_group>(sg._id, std::move(name), shares);
+}
+
+void
+reactor::destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept {
+    auto* group = _task_queue_groups[sg._id].get();
+    _throttled_entities.erase(std::remove(_throttled_entities.begin(), _throttled_entities.end(), group), _throttled_entities.end());
+    _task_queue_groups[sg._id].reset();
+}
+
 #ifdef SEASTAR_BUILD_SHARED_LIBS
 namespace internal {
 
@@ -5014,14 +6733,157 @@ scheduling_group::set_shares(float shares) noexcept {
 #endif
 }
 
+scheduling_supergroup
+scheduling_group::get_supergroup() const noexcept {
+    auto* group = engine()._task_queues[_id]->_parent;
+    return scheduling_supergroup(group ? group->_id : 0);
+}
+
+void
+scheduling_group::set_cpu_limit(float fraction) noexcept {
+    engine()._task_queues[_id]->set_cpu_limit(fraction);
+}
+
+float
+scheduling_group::get_cpu_limit() const noexcept {
+    return engine()._task_queues[_id]->_cpu_limit;
+}
+
+void
+scheduling_group::set_latency_critical(std::chrono::microseconds deadline, float budget) noexcept {
+    auto& tq = *engine()._task_queues[_id];
+    tq._deadline = deadline;
+    tq._deadline_quota = std::chrono::duration_cast<sched_clock::duration>(reactor::cpu_limit_period * double(std::clamp(budget, 0.0f, 1.0f)));
+}
+
+void
+scheduling_group::clear_latency_critical() noexcept {
+    engine()._task_queues[_id]->_deadline = sched_clock::duration::max();
+}
+
+bool
+scheduling_group::is_latency_critical() const noexcept {
+    return engine()._task_queues[_id]->_deadline != sched_clock::duration::max();
+}
+
+const sstring&
+scheduling_supergroup::name() const noexcept {
+    return engine()._task_queue_groups[_id]->_name;
+}
+
+float
+scheduling_supergroup::get_shares() const noexcept {
+    return engine()._task_queue_groups[_id]->_shares;
+}
+
+void
+scheduling_supergroup::set_shares(float shares) noexcept {
+    engine()._task_queue_groups[_id]->set_shares(shares);
+}
+
+void
+scheduling_supergroup::set_cpu_limit(float fraction) noexcept {
+    engine()._task_queue_groups[_id]->set_cpu_limit(fraction);
+}
+
+float
+scheduling_supergroup::get_cpu_limit() const noexcept {
+    return engine()._task_queue_groups[_id]->_cpu_limit;
+}
+
+void
+scheduling_group::set_memory_soft_limit(size_t limit) noexcept {
+    memory::internal::set_scheduling_group_memory_soft_limit(_id, limit);
+    engine().wake_memory_soft_limit_waiters(_id);
+}
+
+future<>
+reactor::task_queue::network_direction::charge(size_t n) noexcept {
+    static constexpr std::chrono::steady_clock::duration burst = 10ms;
+    bytes += n;
+    calls++;
+    if (!limit) {
+        return make_ready_future<>();
+    }
+    // The bytes are paid for at the rate of the limit, from the time the
+    // previous ones were; idle time builds up a credit of up to a burst
+    auto now = std::chrono::steady_clock::now();
+    auto cost = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(double(n) / limit));
+    next = std::max(next, now - burst) + cost;
+    if (next <= now) {
+        return make_ready_future<>();
+    }
+    auto delay = next - now;
+    throttled += delay;
+    return futurize_invoke([delay] { return seastar::sleep(delay); });
+}
+
+future<> internal::charge_network_send(size_t bytes) noexcept {
+    return engine()._task_queues[internal::scheduling_group_index(current_scheduling_group())]->_net_send.charge(bytes);
+}
+
+future<> internal::charge_network_receive(size_t bytes) noexcept {
+    return engine()._task_queues[internal::scheduling_group_index(current_scheduling_group())]->_net_receive.charge(bytes);
+}
+
+void
+scheduling_group::set_network_bandwidth_limit(uint64_t send_bytes_per_second, uint64_t receive_bytes_per_second) noexcept {
+    auto& tq = *engine()._task_queues[_id];
+    tq._net_send.limit = send_bytes_per_second;
+    tq._net_receive.limit = receive_bytes_per_second;
+}
+
+scheduling_group::network_usage
+scheduling_group::get_network_usage() const noexcept {
+    auto& tq = *engine()._task_queues[_id];
+    return network_usage{
+        .bytes_sent = tq._net_send.bytes,
+        .bytes_received = tq._net_receive.bytes,
+        .sends = tq._net_send.calls,
+        .receives = tq._net_receive.calls,
+        .send_throttled = tq._net_send.throttled,
+        .receive_throttled = tq._net_receive.throttled,
+    };
+}
+
+size_t scheduling_group::memory_usage() const noexcept {
+    return memory::internal::scheduling_group_memory_usage(_id);
+}
+
+future<> scheduling_group::wait_for_memory() const {
+    if (memory_usage() < memory::internal::scheduling_group_memory_soft_limit(_id)) {
+        return make_ready_future<>();
+    }
+    auto& waiters = engine()._memory_soft_limit_waiters[_id];
+    waiters.emplace_back();
+    return waiters.back().get_future();
+}
+
+void reactor::wake_memory_soft_limit_waiters(unsigned sg_index) noexcept {
+    if (memory::internal::scheduling_group_memory_usage(sg_index) >= memory::internal::scheduling_group_memory_soft_limit(sg_index)) {
+        return;
+    }
+    auto waiters = std::exchange(_memory_soft_limit_waiters[sg_index], {});
+    for (auto& w : waiters) {
+        w.set_value();
+    }
+}
+
 #if SEASTAR_API_LEVEL >= 7
 future<> scheduling_group::update_io_bandwidth(uint64_t bandwidth) const {
     return engine().update_bandwidth_for_queues(internal::priority_class(*this), bandwidth);
 }
+
+future<> scheduling_group::update_io_limits(io_limits limits) const {
+    return engine().update_limits_for_queues(internal::priority_class(*this), limits);
+}
 #endif
 
 future<scheduling_group>
-create_scheduling_group(sstring name, sstring shortname, float shares) noexcept {
+create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept {
+    if (!parent.is_root() && (parent._id >= engine()._task_queue_groups.size() || !engine()._task_queue_groups[parent._id])) {
+        return make_exception_future<scheduling_group>(std::invalid_argument(fmt::format("The scheduling supergroup of {} does not exist", name)));
+    }
     auto aid = allocate_scheduling_group_id();
     if (aid < 0) {
         return make_exception_future<scheduling_group>(std::runtime_error(fmt::format("Scheduling group limit exceeded while creating {}", name)));
@@ -5029,13 +6891,47 @@ create_scheduling_group(sstring name, sstring shortname, float shares) noexcept
     auto id = static_cast<unsigned>(aid);
     assert(id < max_scheduling_groups());
     auto sg = scheduling_group(id);
-    return smp::invoke_on_all([sg, name, shortname, shares] {
-        return engine().init_scheduling_group(sg, name, shortname, shares);
+    return smp::invoke_on_all([sg, name, shortname, shares, parent] {
+        return engine().init_scheduling_group(sg, name, shortname, shares, parent);
     }).then([sg] {
         return make_ready_future<scheduling_group>(sg);
     });
 }
 
+future<scheduling_group>
+create_scheduling_group(sstring name, sstring shortname, float shares) noexcept {
+    return create_scheduling_group(std::move(name), std::move(shortname), shares, scheduling_supergroup());
+}
+
+future<scheduling_supergroup>
+create_scheduling_supergroup(sstring name, float shares) noexcept {
+    auto aid = allocate_scheduling_group_id(s_used_scheduling_supergroup_ids_bitmap);
+    if (aid < 0) {
+        return make_exception_future<scheduling_supergroup>(std::runtime_error(fmt::format("Scheduling supergroup limit exceeded while creating {}", name)));
+    }
+    auto sg = scheduling_supergroup(static_cast<unsigned>(aid));
+    return smp::invoke_on_all([sg, name, shares] {
+        engine().init_scheduling_supergroup(sg, name, shares);
+    }).then([sg] {
+        return make_ready_future<scheduling_supergroup>(sg);
+    });
+}
+
+future<>
+destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept {
+    if (sg.is_root()) {
+        return make_exception_future<>(make_backtraced_exception_ptr<std::runtime_error>("Attempt to destroy the top level scheduling supergroup"));
+    }
+    if (engine()._task_queue_groups[sg._id]->_nr_task_queues) {
+        return make_exception_future<>(make_backtraced_exception_ptr<std::runtime_error>("Attempt to destroy a scheduling supergroup that still has scheduling groups"));
+    }
+    return smp::invoke_on_all([sg] {
+        engine().destroy_scheduling_supergroup(sg);
+    }).then([sg] {
+        deallocate_scheduling_group_id(sg._id, s_used_scheduling_supergroup_ids_bitmap);
+    });
+}
+
 future<scheduling_group>
 create_scheduling_group(sstring name, float shares) noexcept {
     return create_scheduling_group(name, {}, shares);
@@ -5098,12 +6994,6 @@ void add_to_flush_poller(output_stream<char>& os) noexcept {
     engine()._flush_batching.push_back(os);
 }
 
-inline
-sched_clock::duration
-timeval_to_duration(::timeval tv) {
-    return std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec);
-}
-
 class reactor_stall_sampler : public reactor::pollfn {
     sched_clock::time_point _run_start;
     ::rusage _run_start_rusage;
@@ -26,20 +26,30 @@ module;
 #include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <thread>
+#include <unordered_map>
 #include <utility>
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <poll.h>
 #include <sys/syscall.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
 #include <boost/container/small_vector.hpp>
 #include <fmt/core.h>
 
 #ifdef SEASTAR_HAVE_URING
 #include <liburing.h>
+#if defined(IORING_SETUP_SQE128) && __has_include(<linux/nvme_ioctl.h>)
+#include <linux/nvme_ioctl.h>
+#define SEASTAR_HAVE_URING_NVME_PASSTHROUGH
+#endif
 #endif
 
 #ifdef HAVE_OSV
@@ -53,12 +63,17 @@ module seastar;
 #include "core/thread_pool.hh"
 #include "core/syscall_result.hh"
 #include <seastar/core/internal/buffer_allocator.hh>
+#include <seastar/core/aligned_buffer.hh>
+#include <seastar/core/circular_buffer.hh>
 #include <seastar/util/internal/iovec_utils.hh>
 #include <seastar/core/internal/uname.hh>
+#include <seastar/core/internal/zerocopy_send.hh>
+#include <seastar/core/memory.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/read_first_line.hh>
+#include <seastar/util/internal/magic.hh>
 #endif
 
 namespace seastar {
@@ -258,7 +273,7 @@ void aio_storage_context::schedule_retry() {
         }
         return false;
     }, [this] {
-        return _r._thread_pool->submit<syscall_result<int>>([this] () mutable {
+        return _r._thread_pool->submit<syscall_result<int>>(syscall_kind::data, [this] () mutable {
             auto r = io_submit(_io_context, _aio_retries.size(), _aio_retries.data());
             return wrap_syscall<int>(r);
         }).then_wrapped([this] (future<syscall_result<int>> f) {
@@ -462,6 +477,16 @@ bool preempt_io_context::service_preempting_io() {
     return did_work;
 }
 
+future<size_t>
+reactor_backend::sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p, internal::zerocopy_send_state& zc) {
+    return engine().do_sendmsg_zerocopy(fd, p, zc);
+}
+
+future<>
+reactor_backend::wait_zerocopy_sends(pollable_fd_state& fd, internal::zerocopy_send_state& zc) {
+    return engine().do_wait_zerocopy_sends(fd, zc);
+}
+
 file_desc reactor_backend_aio::make_timerfd() {
     return file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
 }
@@ -568,6 +593,9 @@ class aio_pollable_fd_state : public pollable_fd_state {
 
     internal::linux_abi::iocb _iocb_pollrdhup;
     pollable_fd_state_completion _completion_pollrdhup;
+
+    internal::linux_abi::iocb _iocb_pollerr;
+    pollable_fd_state_completion _completion_pollerr;
 public:
     pollable_fd_state_completion* get_desc(int events) {
         if (events & POLLIN) {
@@ -576,6 +604,9 @@ class aio_pollable_fd_state : public pollable_fd_state {
         if (events & POLLOUT) {
             return &_completion_pollout;
         }
+        if (events & POLLERR) {
+            return &_completion_pollerr;
+        }
         return &_completion_pollrdhup;
     }
     internal::linux_abi::iocb* get_iocb(int events) {
@@ -585,6 +616,9 @@ class aio_pollable_fd_state : public pollable_fd_state {
         if (events & POLLOUT) {
             return &_iocb_pollout;
         }
+        if (events & POLLERR) {
+            return &_iocb_pollerr;
+        }
         return &_iocb_pollrdhup;
     }
     explicit aio_pollable_fd_state(file_desc fd, speculation speculate)
@@ -633,6 +667,10 @@ future<> reactor_backend_aio::poll_rdhup(pollable_fd_state& fd) {
     return poll(fd, POLLRDHUP);
 }
 
+future<> reactor_backend_aio::poll_error(pollable_fd_state& fd) {
+    return poll(fd, POLLERR);
+}
+
 void reactor_backend_aio::forget(pollable_fd_state& fd) noexcept {
     auto* pfd = static_cast<aio_pollable_fd_state*>(&fd);
     delete pfd;
@@ -712,6 +750,18 @@ reactor_backend_aio::make_pollable_fd_state(file_desc fd, pollable_fd::speculati
     return pollable_fd_state_ptr(new aio_pollable_fd_state(std::move(fd), std::move(speculate)));
 }
 
+// Busy poll parameters of an epoll instance, from Linux 6.9's eventpoll.h
+#ifndef EPIOCSPARAMS
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#endif
+
 reactor_backend_epoll::reactor_backend_epoll(reactor& r)
         : _r(r)
         , _steady_clock_timer_reactor_thread(file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC))
@@ -727,6 +777,18 @@ reactor_backend_epoll::reactor_backend_epoll(reactor& r)
     event.data.ptr = &_steady_clock_timer_reactor_thread;
     ret = ::epoll_ctl(_epollfd.get(), EPOLL_CTL_ADD, _steady_clock_timer_reactor_thread.get(), &event);
     throw_system_error_on(ret == -1);
+    if (_r._cfg.net_busy_poll_us) {
+        // Makes epoll_pwait() poll the RX queue of the sockets it last
+        // reported, once per reactor poll when the reactor doesn't sleep
+        epoll_params params = {};
+        params.busy_poll_usecs = _r._cfg.net_busy_poll_us;
+        params.busy_poll_budget = _r._cfg.net_busy_poll_budget;
+        params.prefer_busy_poll = 1;
+        if (::ioctl(_epollfd.get(), EPIOCSPARAMS, &params) == -1) {
+            seastar_logger.warn("Failed to enable busy polling of epoll (requires Linux 6.9 or later): {}",
+                    std::system_error(errno, std::system_category()).what());
+        }
+    }
 }
 
 void
@@ -863,9 +925,10 @@ reactor_backend_epoll::wait_and_process(int timeout, const sigset_t* active_sigm
             // send/recv/accept/connect handle the specific error.
             evt.events = pfd->events_requested;
         }
-        auto events = evt.events & (EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+        auto events = evt.events & (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLERR);
         auto events_to_remove = has_error ? pfd->events_requested : events & ~pfd->events_requested;
         complete_epoll_event(*pfd, events, EPOLLRDHUP);
+        complete_epoll_event(*pfd, events, EPOLLERR);
         if (pfd->events_rw) {
             // accept() signals normal completions via EPOLLIN, but errors (due to shutdown())
             // via EPOLLOUT|EPOLLHUP, so we have to wait for both EPOLLIN and EPOLLOUT with the
@@ -891,6 +954,7 @@ class epoll_pollable_fd_state : public pollable_fd_state {
     pollable_fd_state_completion _pollin;
     pollable_fd_state_completion _pollout;
     pollable_fd_state_completion _pollrdhup;
+    pollable_fd_state_completion _pollerr;
 
     pollable_fd_state_completion* get_desc(int events) {
         if (events & EPOLLIN) {
@@ -899,6 +963,9 @@ class epoll_pollable_fd_state : public pollable_fd_state {
         if (events & EPOLLOUT) {
             return &_pollout;
         }
+        if (events & EPOLLERR) {
+            return &_pollerr;
+        }
         return &_pollrdhup;
     }
 public:
@@ -1017,6 +1084,10 @@ future<> reactor_backend_epoll::poll_rdhup(pollable_fd_state& fd) {
     return get_epoll_future(fd, POLLRDHUP);
 }
 
+future<> reactor_backend_epoll::poll_error(pollable_fd_state& fd) {
+    return get_epoll_future(fd, EPOLLERR);
+}
+
 void reactor_backend_epoll::forget(pollable_fd_state& fd) noexcept {
     if (fd.events_epoll) {
         ::epoll_ctl(_epollfd.get(), EPOLL_CTL_DEL, fd.fd.get(), nullptr);
@@ -1193,12 +1264,34 @@ reactor_backend_osv::make_pollable_fd_state(file_desc fd, pollable_fd::speculati
 
 #ifdef SEASTAR_HAVE_URING
 
+// Multishot accept/recv and provided buffer rings need liburing 2.4 (and the
+// io_uring.h it ships)
+#if defined(IORING_RECV_MULTISHOT) && defined(IOU_PBUF_RING_MMAP)
+#define SEASTAR_HAVE_URING_MULTISHOT
+#endif
+
+// IORING_OP_SENDMSG_ZC and its notification CQEs
+#ifdef IORING_CQE_F_NOTIF
+#define SEASTAR_HAVE_URING_SEND_ZC
+#endif
+
+// io_uring_register_napi()
+#if defined(IO_URING_CHECK_VERSION)
+#if !IO_URING_CHECK_VERSION(2, 6)
+#define SEASTAR_HAVE_URING_NAPI
+#endif
+#endif
+
 static
 std::optional<::io_uring>
-try_create_uring(unsigned queue_len, bool throw_on_error) {
+try_create_uring(unsigned queue_len, bool throw_on_error, ::io_uring_params params = {}) {
     auto required_features =
             IORING_FEAT_SUBMIT_STABLE
             | IORING_FEAT_NODROP;
+    if (params.flags & IORING_SETUP_SQPOLL) {
+        // The poller thread has to be able to use regular (not registered) files, linux 5.11
+        required_features |= IORING_FEAT_SQPOLL_NONFIXED;
+    }
     auto required_ops = {
             IORING_OP_POLL_ADD, // linux 5.1
             IORING_OP_READV,
@@ -1219,7 +1312,6 @@ try_create_uring(unsigned queue_len, bool throw_on_error) {
         }
     };
 
-    auto params = ::io_uring_params{};
     ::io_uring ring;
     auto err = ::io_uring_queue_init_params(queue_len, &ring, &params);
     if (err != 0) {
@@ -1297,17 +1389,64 @@ class reactor_backend_uring final : public reactor_backend {
     // memory, but otherwise it doesn't matter.
     static constexpr unsigned s_queue_len = 200;  
     reactor& _r;
+    bool _sqpoll = false; // set up by create_uring(), before _uring
     ::io_uring _uring;
     bool _did_work_while_getting_sqe = false;
     bool _has_pending_submissions = false;
     file_desc _hrtimer_timerfd;
     preempt_io_context _preempt_io_context;
 
+    // Multishot requests post several CQEs for a single SQE, and the CQE flags
+    // tell whether more are coming (IORING_CQE_F_MORE) and which provided buffer
+    // was used. Their user_data is tagged with s_multishot_tag so that the
+    // completion processing passes the flags along.
+    static constexpr uintptr_t s_multishot_tag = 1;
+    class multishot_completion {
+    protected:
+        ~multishot_completion() = default;
+    public:
+        virtual void complete_with(ssize_t res, unsigned flags) = 0;
+        uint64_t user_data() const noexcept {
+            return reinterpret_cast<uintptr_t>(this) | s_multishot_tag;
+        }
+    };
+
+    // Used for requests whose result we're not interested in, e.g. cancellations
+    class ignore_completion final : public kernel_completion {
+    public:
+        virtual void complete_with(ssize_t res) override {}
+    };
+    ignore_completion _ignore_completion;
+
+    // Whether the kernel can run openat, statx, renameat, unlinkat and
+    // fallocate requests (Linux 5.11 and later)
+    bool _metadata_ops = false;
+
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    class provided_buffers;
+    class multishot_accept;
+    class multishot_recv;
+    bool _multishot = false;
+    lw_shared_ptr<provided_buffers> _provided_buffers;
+#endif
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+    class send_zc_completion;
+    bool _send_zc = false;
+#endif
+
     class uring_pollable_fd_state : public pollable_fd_state {
         pollable_fd_state_completion _completion_pollin;
         pollable_fd_state_completion _completion_pollout;
         pollable_fd_state_completion _completion_pollrdhup;
+        pollable_fd_state_completion _completion_pollerr;
     public:
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        // Created on first use. When the fd is forgotten while they still have
+        // a request in the ring they are orphaned, and delete themselves once
+        // the kernel posts the final CQE.
+        multishot_accept* _multishot_accept = nullptr;
+        multishot_recv* _multishot_recv = nullptr;
+#endif
         explicit uring_pollable_fd_state(file_desc desc, speculation speculate)
                 : pollable_fd_state(std::move(desc), std::move(speculate)) {
         }
@@ -1316,6 +1455,8 @@ class reactor_backend_uring final : public reactor_backend {
                 return &_completion_pollin;
             } else if (events & POLLOUT) {
                 return &_completion_pollout;
+            } else if (events & POLLERR) {
+                return &_completion_pollerr;
             } else {
                 return &_completion_pollrdhup;
             }
@@ -1369,11 +1510,111 @@ class reactor_backend_uring final : public reactor_backend {
 
     hrtimer_completion _hrtimer_completion;
     smp_wakeup_completion _smp_wakeup_completion;
+
+    // Fixed buffers and files (--io-uring-fixed-io). The shard's memory is
+    // registered as a sequence of buffers of s_fixed_buffer_size (the kernel
+    // limit for a single registered buffer), and files are registered into a
+    // sparse table of s_fixed_files slots as posix_file_impl-s are created.
+    static constexpr size_t s_fixed_buffer_size = size_t(1) << 30;
+    static constexpr unsigned s_fixed_files = 1024;
+    struct fixed_file {
+        unsigned slot;
+        unsigned refs;
+    };
+    uintptr_t _fixed_buffers_start = 0;
+    uintptr_t _fixed_buffers_end = 0;
+    std::unordered_map<int, fixed_file> _fixed_files;
+    std::vector<unsigned> _free_fixed_file_slots;
+
+    // Polled completions (--io-uring-iopoll). Reads and writes of O_DIRECT
+    // files on devices with polled queues go to a ring set up with
+    // IORING_SETUP_IOPOLL, which posts no completions by itself: they are
+    // reaped from the poll loop, which doesn't sleep while any is pending.
+    std::optional<::io_uring> _iopoll_uring;
+    unsigned _iopoll_in_flight = 0;
+    bool _iopoll_pending_submissions = false;
+    std::unordered_map<int, unsigned> _polled_files; // fd -> references
+    std::unordered_map<dev_t, bool> _pollable_devices;
+
+    // NVMe passthrough commands (nvme_cmd requests) need a ring with 128
+    // byte SQEs and 32 byte CQEs, set up when the first passthrough file is
+    // opened. Like polled completions, the poll loop reaps them and doesn't
+    // sleep while any is in flight.
+    std::optional<::io_uring> _nvme_uring;
+    bool _nvme_uring_failed = false;
+    unsigned _nvme_in_flight = 0;
+    bool _nvme_pending_submissions = false;
 private:
     static file_desc make_timerfd() {
         return file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
     }
 
+    void probe_metadata_ops() {
+        auto probe = ::io_uring_get_probe_ring(&_uring);
+        if (!probe) {
+            return;
+        }
+        auto free_probe = defer([&] () noexcept { ::io_uring_free_probe(probe); });
+        _metadata_ops = true;
+        for (auto op : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_RENAMEAT, IORING_OP_UNLINKAT, IORING_OP_FALLOCATE}) {
+            _metadata_ops &= bool(::io_uring_opcode_supported(probe, op));
+        }
+    }
+
+    void setup_fixed_io() {
+        memory::memory_layout ml;
+        try {
+            ml = memory::get_memory_layout();
+        } catch (...) {
+            seastar_logger.warn("io_uring fixed buffers need the seastar allocator, not using fixed I/O");
+            return;
+        }
+        std::vector<::iovec> iovs;
+        for (auto p = ml.start; p < ml.end; p += s_fixed_buffer_size) {
+            iovs.push_back(::iovec{reinterpret_cast<void*>(p), std::min<size_t>(s_fixed_buffer_size, ml.end - p)});
+        }
+        auto r = ::io_uring_register_buffers(&_uring, iovs.data(), iovs.size());
+        if (r < 0) {
+            seastar_logger.warn("Failed to register io_uring fixed buffers ({}), not using fixed I/O", std::error_code(-r, std::system_category()).message());
+            return;
+        }
+        std::vector<int> files(s_fixed_files, -1);
+        r = ::io_uring_register_files(&_uring, files.data(), files.size());
+        if (r < 0) {
+            seastar_logger.warn("Failed to register io_uring fixed files ({}), not using fixed I/O", std::error_code(-r, std::system_category()).message());
+            ::io_uring_unregister_buffers(&_uring);
+            return;
+        }
+        _fixed_buffers_start = ml.start;
+        _fixed_buffers_end = ml.end;
+        _free_fixed_file_slots.reserve(s_fixed_files);
+        for (unsigned slot = s_fixed_files; slot > 0; slot--) {
+            _free_fixed_file_slots.push_back(slot - 1);
+        }
+    }
+
+    // Returns the index of the registered buffer fully containing [addr, addr + size),
+    // or -1 if there's no such
+    int fixed_buffer_index(const void* addr, size_t size) const noexcept {
+        auto start = reinterpret_cast<uintptr_t>(addr);
+        if (start < _fixed_buffers_start || start + size > _fixed_buffers_end || size == 0) {
+            return -1;
+        }
+        auto idx = (start - _fixed_buffers_start) / s_fixed_buffer_size;
+        if ((start + size - 1 - _fixed_buffers_start) / s_fixed_buffer_size != idx) {
+            return -1;
+        }
+        return idx;
+    }
+
+    const fixed_file* find_fixed_file(int fd) const noexcept {
+        if (_fixed_files.empty()) {
+            return nullptr;
+        }
+        auto i = _fixed_files.find(fd);
+        return i != _fixed_files.end() ? &i->second : nullptr;
+    }
+
     // Can fail if the completion queue is full
     ::io_uring_sqe* try_get_sqe() {
         return ::io_uring_get_sqe(&_uring);
@@ -1394,6 +1635,10 @@ class reactor_backend_uring final : public reactor_backend {
         ::io_uring_sqe* sqe;
         while (__builtin_expect((sqe = try_get_sqe()) == nullptr, false)) {
             do_flush_submission_ring();
+            if (_sqpoll) {
+                // The ring is full of requests the poller thread hasn't picked up yet
+                ::io_uring_sqring_wait(&_uring);
+            }
             do_process_kernel_completions_step();
             _did_work_while_getting_sqe = true;
         }
@@ -1410,17 +1655,49 @@ class reactor_backend_uring final : public reactor_backend {
     }
 
     void submit_io_request(const internal::io_request& req, io_completion* completion) {
+        if (req.opcode() == internal::io_request::operation::nvme_cmd) {
+            submit_nvme_command(req, completion);
+            return;
+        }
+        if (req.fdatasync_after()) {
+            submit_write_and_fdatasync(req, completion);
+            return;
+        }
+        if (__builtin_expect(!_polled_files.empty(), false) && is_polled(req)) {
+            submit_polled_io_request(req, completion);
+            return;
+        }
         auto sqe = get_sqe();
+        prep_io_request(sqe, req);
+        ::io_uring_sqe_set_data(sqe, completion);
+
+        _has_pending_submissions = true;
+    }
+
+    // Fixed buffers and files are the ones registered with _uring
+    void prep_io_request(::io_uring_sqe* sqe, const internal::io_request& req, bool fixed = true) {
         using o = internal::io_request::operation;
         switch (req.opcode()) {
             case o::read: {
                 const auto& op = req.as<io_request::operation::read>();
-                ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+                auto ff = fixed ? find_fixed_file(op.fd) : nullptr;
+                int idx = ff ? fixed_buffer_index(op.addr, op.size) : -1;
+                if (idx >= 0) {
+                    ::io_uring_prep_read_fixed(sqe, op.fd, op.addr, op.size, op.pos, idx);
+                } else {
+                    ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+                }
                 break;
             }
             case o::write: {
                 const auto& op = req.as<io_request::operation::write>();
-                ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+                auto ff = fixed ? find_fixed_file(op.fd) : nullptr;
+                int idx = ff ? fixed_buffer_index(op.addr, op.size) : -1;
+                if (idx >= 0) {
+                    ::io_uring_prep_write_fixed(sqe, op.fd, op.addr, op.size, op.pos, idx);
+                } else {
+                    ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+                }
                 break;
             }
             case o::readv: {
@@ -1468,6 +1745,33 @@ class reactor_backend_uring final : public reactor_backend {
                 ::io_uring_prep_connect(sqe, op.fd, op.sockaddr, op.socklen);
                 break;
             }
+            case o::openat: {
+                const auto& op = req.as<o::openat>();
+                ::io_uring_prep_openat(sqe, op.dirfd, op.path, op.flags, op.mode);
+                break;
+            }
+            case o::statx: {
+                const auto& op = req.as<o::statx>();
+                ::io_uring_prep_statx(sqe, op.dirfd, op.path, op.flags, op.mask, op.buf);
+                break;
+            }
+            case o::renameat: {
+                const auto& op = req.as<o::renameat>();
+                ::io_uring_prep_renameat(sqe, op.old_dirfd, op.old_path, op.new_dirfd, op.new_path, op.flags);
+                break;
+            }
+            case o::unlinkat: {
+                const auto& op = req.as<o::unlinkat>();
+                ::io_uring_prep_unlinkat(sqe, op.dirfd, op.path, op.flags);
+                break;
+            }
+            case o::fallocate: {
+                const auto& op = req.as<o::fallocate>();
+                ::io_uring_prep_fallocate(sqe, op.fd, op.mode, op.offset, op.length);
+                break;
+            }
+            case o::nvme_cmd:
+                // Goes to _nvme_uring, see submit_nvme_command()
             case o::poll_add:
             case o::poll_remove:
             case o::cancel:
@@ -1477,11 +1781,185 @@ class reactor_backend_uring final : public reactor_backend {
                 seastar_logger.error("Invalid operation for iocb: {}", req.opname());
                 abort();
         }
+        if (auto ff = fixed ? find_fixed_file(sqe->fd) : nullptr) {
+            sqe->fd = ff->slot;
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+    }
+
+    bool is_polled(const internal::io_request& req) const noexcept {
+        using o = internal::io_request::operation;
+        int fd;
+        switch (req.opcode()) {
+        case o::read: fd = req.as<o::read>().fd; break;
+        case o::write: fd = req.as<o::write>().fd; break;
+        case o::readv: fd = req.as<o::readv>().fd; break;
+        case o::writev: fd = req.as<o::writev>().fd; break;
+        default: return false;
+        }
+        return _polled_files.contains(fd);
+    }
+
+    void submit_polled_io_request(const internal::io_request& req, io_completion* completion) {
+        auto ring = &*_iopoll_uring;
+        ::io_uring_sqe* sqe;
+        while ((sqe = ::io_uring_get_sqe(ring)) == nullptr) {
+            ::io_uring_submit(ring);
+            reap_polled_completions();
+            _did_work_while_getting_sqe = true;
+        }
+        prep_io_request(sqe, req, false);
         ::io_uring_sqe_set_data(sqe, completion);
+        _iopoll_in_flight++;
+        _iopoll_pending_submissions = true;
+    }
+
+    // Returns true if completions were processed
+    bool reap_polled_completions() {
+        if (!_iopoll_in_flight) {
+            return false;
+        }
+        auto ring = &*_iopoll_uring;
+        ::io_uring_cqe* cqe;
+        // On an IOPOLL ring, this enters the kernel to poll the device queues
+        if (::io_uring_peek_cqe(ring, &cqe) != 0) {
+            return false;
+        }
+        struct ::io_uring_cqe* buf[s_queue_len];
+        auto n = ::io_uring_peek_batch_cqe(ring, buf, s_queue_len);
+        _iopoll_in_flight -= n;
+        do_process_ready_kernel_completions(buf, n);
+        ::io_uring_cq_advance(ring, n);
+        return n != 0;
+    }
+
+    // The CQE of a passthrough command carries the NVMe status rather than a
+    // byte count: 0 on success, positive for a device error
+    class nvme_command final : public kernel_completion {
+        io_completion* _completion;
+        size_t _size;
+    public:
+        nvme_command(io_completion* completion, size_t size) noexcept
+                : _completion(completion), _size(size) {}
+        virtual void complete_with(ssize_t res) override {
+            _completion->complete_with(res == 0 ? ssize_t(_size) : res > 0 ? -EIO : res);
+            delete this;
+        }
+    };
+
+    void submit_nvme_command(const internal::io_request& req, io_completion* completion) {
+#ifdef SEASTAR_HAVE_URING_NVME_PASSTHROUGH
+        const auto& op = req.as<internal::io_request::operation::nvme_cmd>();
+        auto desc = new nvme_command(completion, op.size);
+        auto ring = &*_nvme_uring;
+        ::io_uring_sqe* sqe;
+        while ((sqe = ::io_uring_get_sqe(ring)) == nullptr) {
+            ::io_uring_submit(ring);
+            reap_nvme_completions();
+            _did_work_while_getting_sqe = true;
+        }
+        // A 128 byte SQE, the command goes in its second half
+        std::memset(sqe, 0, 2 * sizeof(*sqe));
+        sqe->opcode = IORING_OP_URING_CMD;
+        sqe->fd = op.fd;
+        sqe->cmd_op = NVME_URING_CMD_IO;
+        auto cmd = reinterpret_cast<::nvme_uring_cmd*>(sqe->cmd);
+        uint64_t slba = op.pos >> op.lba_shift;
+        cmd->opcode = op.opcode;
+        cmd->nsid = op.nsid;
+        cmd->addr = reinterpret_cast<uintptr_t>(op.addr);
+        cmd->data_len = op.size;
+        cmd->cdw10 = slba & 0xffffffff;
+        cmd->cdw11 = slba >> 32;
+        // Zero-based number of logical blocks
+        cmd->cdw12 = ((op.size >> op.lba_shift) - 1) | (op.fua ? 1u << 30 : 0);
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(desc));
+        _nvme_in_flight++;
+        _nvme_pending_submissions = true;
+#else
+        completion->complete_with(-EOPNOTSUPP);
+#endif
+    }
+
+    // Returns true if completions were processed
+    bool reap_nvme_completions() {
+        if (!_nvme_in_flight) {
+            return false;
+        }
+        struct ::io_uring_cqe* buf[s_queue_len];
+        auto n = ::io_uring_peek_batch_cqe(&*_nvme_uring, buf, s_queue_len);
+        _nvme_in_flight -= n;
+        do_process_ready_kernel_completions(buf, n);
+        ::io_uring_cq_advance(&*_nvme_uring, n);
+        return n != 0;
+    }
+
+    // A write followed by an fdatasync of the same file, linked with
+    // IOSQE_IO_LINK so that the kernel starts the sync as soon as the write
+    // completes. The io_completion gets the write result after the sync.
+    class write_and_fdatasync final {
+        struct part final : public kernel_completion {
+            write_and_fdatasync& parent;
+            const bool is_sync;
+            part(write_and_fdatasync& p, bool s) noexcept : parent(p), is_sync(s) {}
+            virtual void complete_with(ssize_t res) override {
+                if (is_sync) {
+                    parent.synced(res);
+                } else {
+                    parent._written = res;
+                }
+            }
+        };
+        reactor_backend_uring& _be;
+        io_completion* _completion;
+        int _fd;
+        ssize_t _written = 0;
+        bool _resubmitted = false;
+    public:
+        part _write{*this, false};
+        part _sync{*this, true};
+
+        write_and_fdatasync(reactor_backend_uring& be, io_completion* completion, int fd) noexcept
+                : _be(be), _completion(completion), _fd(fd) {}
+        void synced(ssize_t res) {
+            if (res == -ECANCELED && _written >= 0 && !_resubmitted) {
+                // A short write breaks the link, sync what was written
+                _resubmitted = true;
+                _be.prep_fdatasync(_be.get_sqe(), _fd, _sync);
+                return;
+            }
+            _completion->complete_with(_written < 0 || res >= 0 ? _written : res);
+            delete this;
+        }
+    };
 
+    void prep_fdatasync(::io_uring_sqe* sqe, int fd, kernel_completion& completion) {
+        prep_io_request(sqe, internal::io_request::make_fdatasync(fd));
+        ::io_uring_sqe_set_data(sqe, &completion);
         _has_pending_submissions = true;
     }
 
+    void submit_write_and_fdatasync(const internal::io_request& req, io_completion* completion) {
+        int fd = req.opcode() == internal::io_request::operation::write
+                ? req.as<internal::io_request::operation::write>().fd
+                : req.as<internal::io_request::operation::writev>().fd;
+        // Both entries have to go in the same submission, or the link is lost
+        while (::io_uring_sq_space_left(&_uring) < 2) {
+            do_flush_submission_ring();
+            if (_sqpoll) {
+                ::io_uring_sqring_wait(&_uring);
+            }
+            do_process_kernel_completions_step();
+            _did_work_while_getting_sqe = true;
+        }
+        auto desc = new write_and_fdatasync(*this, completion, fd);
+        auto sqe = get_sqe();
+        prep_io_request(sqe, req);
+        sqe->flags |= IOSQE_IO_LINK;
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(&desc->_write));
+        prep_fdatasync(get_sqe(), fd, desc->_sync);
+    }
+
     // Returns true if any work was done
     bool queue_pending_file_io() {
         return _r._io_sink.drain([&] (const internal::io_request& req, io_completion* completion) -> bool {
@@ -1496,11 +1974,372 @@ class reactor_backend_uring final : public reactor_backend {
     void do_process_ready_kernel_completions(::io_uring_cqe** buf, size_t nr) {
         for (auto p = buf; p != buf + nr; ++p) {
             auto cqe = *p;
+            if (cqe->user_data & s_multishot_tag) {
+                auto completion = reinterpret_cast<multishot_completion*>(cqe->user_data & ~s_multishot_tag);
+                completion->complete_with(cqe->res, cqe->flags);
+                continue;
+            }
             auto completion = reinterpret_cast<kernel_completion*>(cqe->user_data);
             completion->complete_with(cqe->res);
         }
     }
 
+    void cancel_multishot(const multishot_completion& c) {
+        auto sqe = get_sqe();
+        ::io_uring_prep_cancel(sqe, reinterpret_cast<void*>(c.user_data()), 0);
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(&_ignore_completion));
+        _has_pending_submissions = true;
+    }
+
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    // A ring of receive buffers the kernel picks from for multishot recv
+    // (IORING_REGISTER_PBUF_RING). The buffers are handed out to the user
+    // as temporary_buffer-s without copying, and return to the ring when
+    // released. Outlives the ring if the user still holds some of them.
+    class provided_buffers : public enable_lw_shared_from_this<provided_buffers> {
+        ::io_uring* _ring;
+        ::io_uring_buf_ring* _br = nullptr;
+        std::unique_ptr<char[], free_deleter> _mem;
+        unsigned _available = 0;
+    public:
+        static constexpr int group_id = 0;
+        static constexpr unsigned nr_buffers = 256; // must be a power of two
+        static constexpr size_t buffer_size = 16384;
+
+        explicit provided_buffers(::io_uring& ring)
+                : _ring(&ring)
+                , _mem(allocate_aligned_buffer<char>(nr_buffers * buffer_size, 4096)) {
+            int err = 0;
+            _br = ::io_uring_setup_buf_ring(_ring, nr_buffers, group_id, 0, &err);
+            if (!_br) {
+                throw std::system_error(-err, std::system_category(), "io_uring_setup_buf_ring");
+            }
+            for (unsigned bid = 0; bid < nr_buffers; bid++) {
+                recycle(bid);
+            }
+        }
+        // Called when the ring is destroyed
+        void detach() noexcept {
+            if (_br) {
+                ::io_uring_free_buf_ring(_ring, _br, nr_buffers, group_id);
+                _br = nullptr;
+            }
+        }
+        unsigned available() const noexcept {
+            return _br ? _available : 0;
+        }
+        temporary_buffer<char> take(unsigned bid, size_t len) {
+            auto d = make_deleter([self = shared_from_this(), bid] { self->recycle(bid); });
+            _available--;
+            return temporary_buffer<char>(_mem.get() + bid * buffer_size, len, std::move(d));
+        }
+        void recycle(unsigned bid) noexcept {
+            if (!_br) {
+                return;
+            }
+            ::io_uring_buf_ring_add(_br, _mem.get() + bid * buffer_size, buffer_size, bid, ::io_uring_buf_ring_mask(nr_buffers), 0);
+            ::io_uring_buf_ring_advance(_br, 1);
+            _available++;
+        }
+    };
+
+    // Keeps a multishot accept armed on a listening socket. Connections
+    // accepted while nobody is waiting are queued.
+    class multishot_accept final : public multishot_completion {
+        pollable_fd_state* _listenfd; // nullptr once orphaned
+        circular_buffer<int> _fds;
+        std::exception_ptr _ex;
+        std::optional<promise<std::tuple<pollable_fd, socket_address>>> _waiter;
+        bool _armed = false;
+
+        static std::tuple<pollable_fd, socket_address> make_accepted(int fd) {
+            auto desc = file_desc::from_fd(fd);
+            // Multishot accept cannot report the peer address, since all the
+            // CQEs would share the same buffer
+            socket_address sa;
+            if (::getpeername(fd, &sa.as_posix_sockaddr(), &sa.addr_length) == -1) {
+                sa = socket_address();
+            }
+            return {pollable_fd(std::move(desc), pollable_fd::speculation(EPOLLOUT)), std::move(sa)};
+        }
+        std::exception_ptr make_error(ssize_t res) noexcept {
+            try {
+                if (res == -EINVAL) {
+                    // The chances are that we shutting down the connection.
+                    _listenfd->maybe_no_more_recv();
+                }
+                throw_kernel_error(res);
+            } catch (...) {
+                return std::current_exception();
+            }
+            return nullptr;
+        }
+    public:
+        explicit multishot_accept(pollable_fd_state& listenfd) noexcept : _listenfd(&listenfd) {}
+        future<std::tuple<pollable_fd, socket_address>> accept(reactor_backend_uring& be) {
+            _listenfd->maybe_no_more_recv();
+            if (!_fds.empty()) {
+                auto fd = _fds.front();
+                _fds.pop_front();
+                return make_ready_future<std::tuple<pollable_fd, socket_address>>(make_accepted(fd));
+            }
+            if (_ex) {
+                return make_exception_future<std::tuple<pollable_fd, socket_address>>(std::exchange(_ex, nullptr));
+            }
+            if (!_armed) {
+                auto sqe = be.get_sqe();
+                ::io_uring_prep_multishot_accept(sqe, _listenfd->fd.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                sqe->user_data = user_data();
+                be._has_pending_submissions = true;
+                _armed = true;
+            }
+            _waiter.emplace();
+            return _waiter->get_future();
+        }
+        virtual void complete_with(ssize_t res, unsigned flags) override {
+            if (!(flags & IORING_CQE_F_MORE)) {
+                _armed = false;
+            }
+            if (!_listenfd) {
+                if (res >= 0) {
+                    ::close(res);
+                }
+                if (!_armed) {
+                    delete this;
+                }
+                return;
+            }
+            if (res >= 0) {
+                if (_waiter) {
+                    try {
+                        _waiter->set_value(make_accepted(res));
+                    } catch (...) {
+                        _waiter->set_exception(std::current_exception());
+                    }
+                    _waiter.reset();
+                } else {
+                    try {
+                        _fds.push_back(res);
+                    } catch (...) {
+                        ::close(res);
+                    }
+                }
+            } else if (res != -ECANCELED) {
+                auto ex = make_error(res);
+                if (_waiter) {
+                    _waiter->set_exception(std::move(ex));
+                    _waiter.reset();
+                } else {
+                    _ex = std::move(ex);
+                }
+            } else if (_waiter && !_armed) {
+                _waiter->set_exception(make_error(-ECONNABORTED));
+                _waiter.reset();
+            }
+        }
+        void orphan(reactor_backend_uring& be) noexcept {
+            _listenfd = nullptr;
+            for (auto fd : _fds) {
+                ::close(fd);
+            }
+            _fds.clear();
+            if (!_armed) {
+                delete this;
+                return;
+            }
+            be.cancel_multishot(*this);
+        }
+    };
+
+    // Keeps a multishot recv armed on a socket while the user reads from it.
+    // Data received while nobody is waiting is queued, and the request is
+    // cancelled if the user doesn't keep up so that a single slow socket
+    // cannot drain the shared buffer ring; TCP flow control takes over then.
+    class multishot_recv final : public multishot_completion {
+        static constexpr size_t max_ready = 4;
+        reactor_backend_uring& _be;
+        pollable_fd_state* _fd; // nullptr once orphaned
+        lw_shared_ptr<provided_buffers> _bufs;
+        circular_buffer<temporary_buffer<char>> _ready;
+        std::exception_ptr _ex;
+        std::optional<promise<temporary_buffer<char>>> _waiter;
+        internal::buffer_allocator* _waiter_ba = nullptr;
+        bool _armed = false;
+        bool _cancelling = false;
+        bool _eof = false;
+
+        void deliver(temporary_buffer<char> buf) {
+            if (_waiter) {
+                _waiter->set_value(std::move(buf));
+                _waiter.reset();
+            } else {
+                _ready.push_back(std::move(buf));
+            }
+        }
+        void fail(std::exception_ptr ex) noexcept {
+            if (_waiter) {
+                _waiter->set_exception(std::move(ex));
+                _waiter.reset();
+            } else {
+                _ex = std::move(ex);
+            }
+        }
+    public:
+        multishot_recv(reactor_backend_uring& be, pollable_fd_state& fd, lw_shared_ptr<provided_buffers> bufs) noexcept
+                : _be(be), _fd(&fd), _bufs(std::move(bufs)) {}
+        // Whether data (or an error, or a request that is going to bring either)
+        // is pending, so that a plain recv would reorder the stream
+        bool busy() const noexcept {
+            return _armed || !_ready.empty() || _ex || _eof;
+        }
+        future<temporary_buffer<char>> recv(internal::buffer_allocator* ba) {
+            if (!_ready.empty()) {
+                auto buf = std::move(_ready.front());
+                _ready.pop_front();
+                return make_ready_future<temporary_buffer<char>>(std::move(buf));
+            }
+            if (_ex) {
+                return make_exception_future<temporary_buffer<char>>(std::exchange(_ex, nullptr));
+            }
+            if (_eof) {
+                return make_ready_future<temporary_buffer<char>>();
+            }
+            if (!_armed) {
+                if (!_bufs->available()) {
+                    return _be.submit_recv(*_fd, ba);
+                }
+                auto sqe = _be.get_sqe();
+                ::io_uring_prep_recv_multishot(sqe, _fd->fd.get(), nullptr, 0, 0);
+                sqe->flags |= IOSQE_BUFFER_SELECT;
+                sqe->buf_group = provided_buffers::group_id;
+                sqe->user_data = user_data();
+                _be._has_pending_submissions = true;
+                _armed = true;
+            }
+            _waiter.emplace();
+            _waiter_ba = ba;
+            return _waiter->get_future();
+        }
+        virtual void complete_with(ssize_t res, unsigned flags) override {
+            if (!(flags & IORING_CQE_F_MORE)) {
+                _armed = false;
+                _cancelling = false;
+            }
+            if (res > 0) {
+                unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                try {
+                    auto buf = _bufs->take(bid, res);
+                    if (_fd) {
+                        deliver(std::move(buf));
+                    }
+                } catch (...) {
+                    _bufs->recycle(bid);
+                    fail(std::current_exception());
+                }
+            } else if (res == 0) {
+                _eof = true;
+                if (_waiter) {
+                    deliver(temporary_buffer<char>());
+                }
+            } else if (res != -ENOBUFS && res != -ECANCELED) {
+                try {
+                    throw_kernel_error(res);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            }
+            if (!_fd) {
+                if (!_armed) {
+                    delete this;
+                }
+                return;
+            }
+            if (!_armed && _waiter) {
+                // The ring ran dry (ENOBUFS) or we cancelled; serve the waiter with a plain recv
+                _be.submit_recv(*_fd, _waiter_ba).forward_to(std::move(*_waiter));
+                _waiter.reset();
+            } else if (_armed && !_cancelling && _ready.size() >= max_ready) {
+                _cancelling = true;
+                _be.cancel_multishot(*this);
+            }
+        }
+        void orphan() noexcept {
+            _fd = nullptr;
+            _ready.clear();
+            if (!_armed) {
+                delete this;
+                return;
+            }
+            if (!_cancelling) {
+                _cancelling = true;
+                _be.cancel_multishot(*this);
+            }
+        }
+    };
+
+    void setup_multishot() {
+        if (!kernel_uname().whitelisted({"6.0"})) {
+            seastar_logger.warn("io_uring multishot accept and recv need Linux 6.0 or later, not using them");
+            return;
+        }
+        try {
+            _provided_buffers = make_lw_shared<provided_buffers>(_uring);
+        } catch (...) {
+            seastar_logger.warn("Failed to set up io_uring provided buffers ({}), not using multishot recv", std::current_exception());
+        }
+        _multishot = true;
+    }
+#endif
+
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+    // IORING_OP_SENDMSG_ZC posts the result of the send first, and, if it
+    // went through (IORING_CQE_F_MORE), a notification CQE once the kernel
+    // released the data. The packet is held until then.
+    class send_zc_completion final : public multishot_completion {
+        net::packet _p;
+        ::msghdr _mh = {};
+        lw_shared_ptr<internal::zerocopy_send_state> _zc;
+        std::optional<promise<size_t>> _result;
+        const size_t _to_write;
+        pollable_fd_state& _fd;
+    public:
+        send_zc_completion(pollable_fd_state& fd, net::packet p, lw_shared_ptr<internal::zerocopy_send_state> zc)
+                : _p(std::move(p)), _zc(std::move(zc)), _result(std::in_place), _to_write(_p.len()), _fd(fd) {
+            _mh.msg_iov = reinterpret_cast<iovec*>(_p.fragment_array());
+            _mh.msg_iovlen = std::min<size_t>(_p.nr_frags(), IOV_MAX);
+            _zc->in_flight++;
+        }
+        const ::msghdr* msghdr() const noexcept {
+            return &_mh;
+        }
+        future<size_t> get_future() {
+            return _result->get_future();
+        }
+        virtual void complete_with(ssize_t res, unsigned flags) override {
+            if (_result) {
+                // The fd may be gone by the time the notification arrives
+                if (res < 0) {
+                    try {
+                        throw_kernel_error(res);
+                    } catch (...) {
+                        _result->set_exception(std::current_exception());
+                    }
+                } else {
+                    if (size_t(res) == _to_write) {
+                        _fd.speculate_epoll(EPOLLOUT);
+                    }
+                    _result->set_value(res);
+                }
+                _result.reset();
+            }
+            if (!(flags & IORING_CQE_F_MORE)) {
+                _zc->notified();
+                delete this;
+            }
+        }
+    };
+#endif
+
     // Returns true if completions were processed
     bool do_process_kernel_completions_step() {
         struct ::io_uring_cqe* buf[s_queue_len];
@@ -1525,10 +2364,194 @@ class reactor_backend_uring final : public reactor_backend {
         _r._io_sink.submit(desc.release(), std::move(req));
         return fut;
     }
+    // The CPU to pin the shard's submission queue poller thread to
+    static std::optional<unsigned> sqpoll_cpu(const reactor& r) {
+        auto& cpus = r._cfg.io_uring_sqpoll_cpuset;
+        if (!cpus.empty()) {
+            return *std::next(cpus.begin(), r._id % cpus.size());
+        }
+        auto cpu = ::sched_getcpu();
+        if (cpu < 0) {
+            return std::nullopt;
+        }
+        try {
+            auto siblings = resource::parse_cpuset(read_first_line(fmt::format("/sys/devices/system/cpu/cpu{}/topology/thread_siblings_list", cpu)));
+            if (siblings) {
+                for (auto sibling : *siblings) {
+                    if (sibling != unsigned(cpu)) {
+                        return sibling;
+                    }
+                }
+            }
+        } catch (...) {
+            seastar_logger.debug("Failed to read the hyperthread siblings of cpu {}: {}", cpu, std::current_exception());
+        }
+        return std::nullopt;
+    }
+
+    // The ring busy polls the RX queues of its sockets while waiting for
+    // completions, and from the submission queue poller thread
+    void setup_napi() {
+#ifdef SEASTAR_HAVE_URING_NAPI
+        ::io_uring_napi napi = {};
+        napi.busy_poll_to = _r._cfg.net_busy_poll_us;
+        napi.prefer_busy_poll = 1;
+        auto r = ::io_uring_register_napi(&_uring, &napi);
+        if (r < 0) {
+            seastar_logger.warn("Failed to enable busy polling of io_uring (requires Linux 6.9 or later): {}",
+                    std::system_error(-r, std::system_category()).what());
+        }
+#else
+        seastar_logger.warn("Busy polling of io_uring needs liburing 2.6 or later, only sockets busy poll");
+#endif
+    }
+
+    void setup_iopoll() {
+        auto params = ::io_uring_params{};
+        params.flags |= IORING_SETUP_IOPOLL;
+        try {
+            _iopoll_uring = try_create_uring(s_queue_len, true, params).value();
+        } catch (...) {
+            seastar_logger.warn("Failed to set up an io_uring for polled completions ({}), not using it", std::current_exception());
+        }
+    }
+
+    bool setup_nvme_passthrough() noexcept {
+#ifdef SEASTAR_HAVE_URING_NVME_PASSTHROUGH
+        auto params = ::io_uring_params{};
+        params.flags |= IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+        try {
+            auto ring = try_create_uring(s_queue_len, true, params).value();
+            auto probe = ::io_uring_get_probe_ring(&ring);
+            bool supported = probe && ::io_uring_opcode_supported(probe, IORING_OP_URING_CMD);
+            if (probe) {
+                ::io_uring_free_probe(probe);
+            }
+            if (!supported) {
+                ::io_uring_queue_exit(&ring);
+                seastar_logger.warn("io_uring doesn't support IORING_OP_URING_CMD (requires Linux 5.19 or later), NVMe passthrough is not available");
+                return false;
+            }
+            _nvme_uring = ring;
+            return true;
+        } catch (...) {
+            seastar_logger.warn("Failed to set up an io_uring for NVMe passthrough ({}), not using it", std::current_exception());
+        }
+#else
+        seastar_logger.warn("NVMe passthrough needs liburing and kernel headers from Linux 5.19 or later");
+#endif
+        return false;
+    }
+
+    // Whether the device has polled queues; a partition's queue is its disk's
+    bool pollable_device(dev_t dev) {
+        auto i = _pollable_devices.find(dev);
+        if (i != _pollable_devices.end()) {
+            return i->second;
+        }
+        namespace fs = std::filesystem;
+        auto sys = fs::path(fmt::format("/sys/dev/block/{}:{}", major(dev), minor(dev)));
+        bool pollable = false;
+        for (auto queue : {sys / "queue", sys / ".." / "queue"}) {
+            if (fs::exists(queue / "io_poll")) {
+                pollable = read_first_line_as<unsigned>(queue / "io_poll") != 0;
+                break;
+            }
+        }
+        seastar_logger.debug("Block device {}:{} {} polled queues", major(dev), minor(dev), pollable ? "has" : "has no");
+        _pollable_devices.emplace(dev, pollable);
+        return pollable;
+    }
+
+    // Block devices, and files of filesystems whose direct I/O supports
+    // polling, opened with O_DIRECT
+    bool pollable_file(int fd) {
+        auto flags = ::fcntl(fd, F_GETFL);
+        if (flags == -1 || !(flags & O_DIRECT)) {
+            return false;
+        }
+        struct ::stat st;
+        if (::fstat(fd, &st) == -1) {
+            return false;
+        }
+        if (S_ISBLK(st.st_mode)) {
+            return pollable_device(st.st_rdev);
+        }
+        struct ::statfs sfs;
+        if (!S_ISREG(st.st_mode) || ::fstatfs(fd, &sfs) == -1) {
+            return false;
+        }
+        if (sfs.f_type != internal::fs_magic::xfs && sfs.f_type != internal::fs_magic::ext4) {
+            return false;
+        }
+        return pollable_device(st.st_dev);
+    }
+
+    void register_polled_file(int fd) noexcept {
+        auto i = _polled_files.find(fd);
+        if (i != _polled_files.end()) {
+            i->second++;
+            return;
+        }
+        try {
+            if (pollable_file(fd)) {
+                _polled_files.emplace(fd, 1);
+            }
+        } catch (...) {
+            seastar_logger.debug("Not polling the completions of fd {}: {}", fd, std::current_exception());
+        }
+    }
+
+    void register_fixed_file(int fd) noexcept {
+        auto i = _fixed_files.find(fd);
+        if (i != _fixed_files.end()) {
+            i->second.refs++;
+            return;
+        }
+        if (_free_fixed_file_slots.empty()) {
+            // Either fixed I/O is off, or all slots are taken by hotter (older) files
+            return;
+        }
+        auto slot = _free_fixed_file_slots.back();
+        if (::io_uring_register_files_update(&_uring, slot, &fd, 1) < 0) {
+            return;
+        }
+        try {
+            _fixed_files.emplace(fd, fixed_file{slot, 1});
+            _free_fixed_file_slots.pop_back();
+        } catch (...) {
+            int none = -1;
+            ::io_uring_register_files_update(&_uring, slot, &none, 1);
+        }
+    }
+
+    ::io_uring create_uring(reactor& r) {
+        if (r._cfg.io_uring_sqpoll) {
+            auto params = ::io_uring_params{};
+            params.flags |= IORING_SETUP_SQPOLL;
+            // Keep polling for a while after the last submission instead of
+            // making the next one pay for the wakeup
+            params.sq_thread_idle = 100; // ms
+            auto cpu = sqpoll_cpu(r);
+            if (cpu) {
+                params.flags |= IORING_SETUP_SQ_AFF;
+                params.sq_thread_cpu = *cpu;
+            }
+            try {
+                auto ring = try_create_uring(s_queue_len, true, params).value();
+                _sqpoll = true;
+                seastar_logger.debug("io_uring submission queue poller thread {}", cpu ? fmt::format("pinned to cpu {}", *cpu) : "not pinned");
+                return ring;
+            } catch (...) {
+                seastar_logger.warn("Failed to set up io_uring submission queue polling ({}), not using it", std::current_exception());
+            }
+        }
+        return try_create_uring(s_queue_len, true).value();
+    }
 public:
     explicit reactor_backend_uring(reactor& r)
             : _r(r)
-            , _uring(try_create_uring(s_queue_len, true).value())
+            , _uring(create_uring(r))
             , _hrtimer_timerfd(make_timerfd())
             , _preempt_io_context(_r, _r._task_quota_timer, _hrtimer_timerfd)
             , _hrtimer_completion(_r, _hrtimer_timerfd)
@@ -1537,23 +2560,104 @@ class reactor_backend_uring final : public reactor_backend {
         // expired when it really hasn't, we don't want to block in read(tfd, ...).
         auto tfd = _r._task_quota_timer.get();
         ::fcntl(tfd, F_SETFL, ::fcntl(tfd, F_GETFL) | O_NONBLOCK);
+        if (_r._cfg.io_uring_fixed_io) {
+            setup_fixed_io();
+        }
+        probe_metadata_ops();
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_r._cfg.io_uring_multishot) {
+            setup_multishot();
+        }
+#endif
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+        _send_zc = kernel_uname().whitelisted({"6.1"});
+#endif
+        if (_r._cfg.net_busy_poll_us) {
+            setup_napi();
+        }
+        if (_r._cfg.io_uring_iopoll) {
+            setup_iopoll();
+        }
     }
     ~reactor_backend_uring() {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_provided_buffers) {
+            _provided_buffers->detach();
+        }
+#endif
+        if (_iopoll_uring) {
+            ::io_uring_queue_exit(&*_iopoll_uring);
+        }
+        if (_nvme_uring) {
+            ::io_uring_queue_exit(&*_nvme_uring);
+        }
         ::io_uring_queue_exit(&_uring);
     }
+    virtual bool can_link_fdatasync() const noexcept override {
+        return true;
+    }
+    virtual bool have_async_metadata_ops() const noexcept override {
+        return _metadata_ops;
+    }
+    virtual void cancel_io(io_completion* desc) noexcept override {
+        // Only matches requests on _uring that were submitted with desc as
+        // their user data; coalesced, linked, polled or passthrough ones
+        // run to completion
+        auto sqe = get_sqe();
+        ::io_uring_prep_cancel(sqe, static_cast<void*>(desc), 0);
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(&_ignore_completion));
+        _has_pending_submissions = true;
+    }
+    virtual bool enable_nvme_passthrough() noexcept override {
+        if (!_nvme_uring && !_nvme_uring_failed) {
+            _nvme_uring_failed = !setup_nvme_passthrough();
+        }
+        return bool(_nvme_uring);
+    }
+    virtual void register_file(int fd) noexcept override {
+        if (_iopoll_uring) {
+            register_polled_file(fd);
+        }
+        register_fixed_file(fd);
+    }
+    virtual void unregister_file(int fd) noexcept override {
+        if (auto p = _polled_files.find(fd); p != _polled_files.end() && --p->second == 0) {
+            _polled_files.erase(p);
+        }
+        auto i = _fixed_files.find(fd);
+        if (i == _fixed_files.end() || --i->second.refs > 0) {
+            return;
+        }
+        // In-flight requests hold their own reference on the file, so the
+        // slot can be reused right away
+        int none = -1;
+        ::io_uring_register_files_update(&_uring, i->second.slot, &none, 1);
+        _free_fixed_file_slots.push_back(i->second.slot);
+        _fixed_files.erase(i);
+    }
     virtual bool reap_kernel_completions() override {
-        return do_process_kernel_completions();
+        bool did_work = do_process_kernel_completions();
+        did_work |= reap_polled_completions();
+        did_work |= reap_nvme_completions();
+        return did_work;
     }
     virtual bool kernel_submit_work() override {
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
         did_work |= queue_pending_file_io();
         did_work |= ::io_uring_submit(&_uring);
+        if (std::exchange(_iopoll_pending_submissions, false)) {
+            did_work |= ::io_uring_submit(&*_iopoll_uring) > 0;
+        }
+        if (std::exchange(_nvme_pending_submissions, false)) {
+            did_work |= ::io_uring_submit(&*_nvme_uring) > 0;
+        }
         return did_work;
     }
     virtual bool kernel_events_can_sleep() const override {
-        // We never need to spin while I/O is in flight.
-        return true;
+        // Only polled and passthrough completions need spinning while
+        // they're in flight
+        return _iopoll_in_flight == 0 && _nvme_in_flight == 0;
     }
     virtual void wait_and_process_events(const sigset_t* active_sigmask) override {
         _smp_wakeup_completion.maybe_rearm(*this);
@@ -1591,11 +2695,35 @@ class reactor_backend_uring final : public reactor_backend {
     virtual future<> poll_rdhup(pollable_fd_state& fd) override {
         return poll(fd, POLLRDHUP);
     }
+    virtual future<> poll_error(pollable_fd_state& fd) override {
+        return poll(fd, POLLERR);
+    }
     virtual void forget(pollable_fd_state& fd) noexcept override {
         auto* pfd = static_cast<uring_pollable_fd_state*>(&fd);
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (pfd->_multishot_accept) {
+            pfd->_multishot_accept->orphan(*this);
+        }
+        if (pfd->_multishot_recv) {
+            pfd->_multishot_recv->orphan();
+        }
+#endif
         delete pfd;
     }
     virtual future<std::tuple<pollable_fd, socket_address>> accept(pollable_fd_state& listenfd) override {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_multishot) {
+            auto& ufd = static_cast<uring_pollable_fd_state&>(listenfd);
+            try {
+                if (!ufd._multishot_accept) {
+                    ufd._multishot_accept = new multishot_accept(listenfd);
+                }
+                return ufd._multishot_accept->accept(*this);
+            } catch (...) {
+                return current_exception_as_future<std::tuple<pollable_fd, socket_address>>();
+            }
+        }
+#endif
         if (listenfd.take_speculation(POLLIN)) {
             try {
                 listenfd.maybe_no_more_recv();
@@ -1892,7 +3020,37 @@ class reactor_backend_uring final : public reactor_backend {
         return submit_request(std::move(desc), std::move(req));
     }
 
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p, internal::zerocopy_send_state& zc) override {
+        if (!_send_zc) {
+            return reactor_backend::sendmsg_zerocopy(fd, p, zc);
+        }
+        auto desc = new send_zc_completion(fd, p.share(), zc.shared_from_this());
+        auto fut = desc->get_future();
+        auto sqe = get_sqe();
+        ::io_uring_prep_sendmsg_zc(sqe, fd.fd.get(), desc->msghdr(), MSG_NOSIGNAL);
+        sqe->user_data = desc->user_data();
+        _has_pending_submissions = true;
+        return fut;
+    }
+    virtual future<> wait_zerocopy_sends(pollable_fd_state& fd, internal::zerocopy_send_state& zc) override {
+        if (zc.in_flight == 0) {
+            return reactor_backend::wait_zerocopy_sends(fd, zc);
+        }
+        zc.drained.emplace();
+        return zc.drained->get_future().then([this, &fd, &zc] {
+            return wait_zerocopy_sends(fd, zc);
+        });
+    }
+#endif
+
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        auto& ufd = static_cast<uring_pollable_fd_state&>(fd);
+        if (ufd._multishot_recv && ufd._multishot_recv->busy()) {
+            return ufd._multishot_recv->recv(ba);
+        }
+#endif
         if (fd.take_speculation(POLLIN)) {
             auto buffer = ba->allocate_buffer();
             try {
@@ -1908,6 +3066,22 @@ class reactor_backend_uring final : public reactor_backend {
                 return current_exception_as_future<temporary_buffer<char>>();
             }
         }
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_provided_buffers && _provided_buffers->available()) {
+            try {
+                if (!ufd._multishot_recv) {
+                    ufd._multishot_recv = new multishot_recv(*this, fd, _provided_buffers);
+                }
+                return ufd._multishot_recv->recv(ba);
+            } catch (...) {
+                return current_exception_as_future<temporary_buffer<char>>();
+            }
+        }
+#endif
+        return submit_recv(fd, ba);
+    }
+
+    future<temporary_buffer<char>> submit_recv(pollable_fd_state& fd, internal::buffer_allocator* ba) {
         class recv_completion final : public io_completion {
             pollable_fd_state& _fd;
             temporary_buffer<char> _buffer;
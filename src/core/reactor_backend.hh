@@ -47,6 +47,7 @@
 namespace seastar {
 
 class reactor;
+class io_completion;
 
 // FIXME: merge it with storage context below. At this point the
 // main thing to do is unify the iocb list
@@ -197,6 +198,9 @@ class reactor_backend {
     virtual future<> writeable(pollable_fd_state& fd) = 0;
     virtual future<> readable_or_writeable(pollable_fd_state& fd) = 0;
     virtual future<> poll_rdhup(pollable_fd_state& fd) = 0;
+    // Resolves once the fd has a pending error, or something on its error
+    // queue, like the notifications of zero-copy sends
+    virtual future<> poll_error(pollable_fd_state& fd) = 0;
     virtual void forget(pollable_fd_state& fd) noexcept = 0;
 
     virtual future<std::tuple<pollable_fd, socket_address>>
@@ -209,10 +213,36 @@ class reactor_backend {
     virtual future<size_t> sendmsg(pollable_fd_state& fd, net::packet& p) = 0;
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) = 0;
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) = 0;
+    // Zero-copy send, MSG_ZEROCOPY with notifications on the socket error queue by default
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p, internal::zerocopy_send_state& zc);
+    virtual future<> wait_zerocopy_sends(pollable_fd_state& fd, internal::zerocopy_send_state& zc);
 
     virtual bool do_blocking_io() const {
         return false;
     }
+    // Notifies the backend that fd is going to be used for disk I/O, and that
+    // it is about to be closed, respectively. Calls are paired, but the same
+    // fd can be registered several times (e.g. by a dup()-ed file).
+    virtual void register_file(int fd) noexcept {}
+    virtual void unregister_file(int fd) noexcept {}
+    // Whether the backend can complete write requests with fdatasync_after()
+    virtual bool can_link_fdatasync() const noexcept {
+        return false;
+    }
+    // Whether the backend can run openat, statx, renameat, unlinkat and
+    // fallocate io_request-s, instead of them being offloaded to the syscall
+    // thread pool
+    virtual bool have_async_metadata_ops() const noexcept {
+        return false;
+    }
+    // Tries to cancel the in-flight request completing into desc, without
+    // blocking. The request still completes, possibly with -ECANCELED.
+    virtual void cancel_io(io_completion* desc) noexcept {}
+    // Prepares the backend for nvme_cmd io_request-s, returns whether it
+    // can run them
+    virtual bool enable_nvme_passthrough() noexcept {
+        return false;
+    }
     virtual void signal_received(int signo, siginfo_t* siginfo, void* ignore) = 0;
     virtual void start_tick() = 0;
     virtual void stop_tick() = 0;
@@ -264,6 +294,7 @@ class reactor_backend_epoll : public reactor_backend {
     virtual future<> writeable(pollable_fd_state& fd) override;
     virtual future<> readable_or_writeable(pollable_fd_state& fd) override;
     virtual future<> poll_rdhup(pollable_fd_state& fd) override;
+    virtual future<> poll_error(pollable_fd_state& fd) override;
     virtual void forget(pollable_fd_state& fd) noexcept override;
 
     virtual future<std::tuple<pollable_fd, socket_address>>
@@ -314,6 +345,7 @@ class reactor_backend_aio : public reactor_backend {
     virtual future<> writeable(pollable_fd_state& fd) override;
     virtual future<> readable_or_writeable(pollable_fd_state& fd) override;
     virtual future<> poll_rdhup(pollable_fd_state& fd) override;
+    virtual future<> poll_error(pollable_fd_state& fd) override;
     virtual void forget(pollable_fd_state& fd) noexcept override;
 
     virtual future<std::tuple<pollable_fd, socket_address>>
@@ -0,0 +1,141 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <vector>
+module seastar;
+#else
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <seastar/core/cacheline.hh>
+#include <seastar/core/replicated.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+namespace {
+
+// Same limit as the allocator's
+constexpr unsigned max_shards = 256;
+
+// Incremented by two on each quiescent state of the shard, and odd while the
+// shard is idle (or not running its poll loop at all). A shard has been
+// quiescent since a snapshot of its epoch if the snapshot is odd, or if the
+// epoch changed since.
+struct alignas(cache_line_size) shard_epoch {
+    std::atomic<uint64_t> value{1};
+};
+
+shard_epoch epochs[max_shards];
+
+struct retired {
+    void* p;
+    void (*reclaim)(void*) noexcept;
+    std::vector<uint64_t> snapshot;
+};
+
+struct retired_list {
+    std::deque<retired> items;
+    ~retired_list() {
+        // Only reached when the shard is gone
+        for (auto& r : items) {
+            r.reclaim(r.p);
+        }
+    }
+};
+
+thread_local retired_list retired_items;
+
+bool grace_period_elapsed(const std::vector<uint64_t>& snapshot) noexcept {
+    for (unsigned i = 0; i < snapshot.size(); ++i) {
+        auto then = snapshot[i];
+        if (!(then & 1) && epochs[i].value.load(std::memory_order_acquire) == then) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+void rcu_retire(void* p, void (*reclaim)(void*) noexcept) {
+    std::vector<uint64_t> snapshot;
+    snapshot.reserve(smp::count);
+    for (unsigned i = 0; i < smp::count; ++i) {
+        // Pairs with the one in rcu_exit_idle(): a shard seen idle here
+        // reads the published pointer once it wakes up
+        snapshot.push_back(epochs[i].value.load(std::memory_order_seq_cst));
+    }
+    retired_items.items.push_back(retired{p, reclaim, std::move(snapshot)});
+}
+
+void rcu_quiescent_state() noexcept {
+    auto& e = epochs[this_shard_id()].value;
+    // Only this shard writes its epoch
+    e.store(e.load(std::memory_order_relaxed) + 2, std::memory_order_release);
+}
+
+bool rcu_reclaim() noexcept {
+    auto& items = retired_items.items;
+    bool work = false;
+    // Retirements are checked in order, which is cheap and at worst
+    // delays some reclamation by a poll loop iteration
+    while (!items.empty() && grace_period_elapsed(items.front().snapshot)) {
+        auto r = std::move(items.front());
+        items.pop_front();
+        r.reclaim(r.p);
+        work = true;
+    }
+    return work;
+}
+
+bool rcu_has_retired() noexcept {
+    return !retired_items.items.empty();
+}
+
+void rcu_enter_idle() noexcept {
+    auto& e = epochs[this_shard_id()].value;
+    assert(!(e.load(std::memory_order_relaxed) & 1));
+    e.store(e.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void rcu_exit_idle() noexcept {
+    auto& e = epochs[this_shard_id()].value;
+    assert(e.load(std::memory_order_relaxed) & 1);
+    e.store(e.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    // Readers which run from now on must see whatever was published by a
+    // writer which saw this shard idle
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+}
+
+}
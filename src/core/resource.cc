@@ -116,10 +116,55 @@ optional<cpuset> cpu_set() {
 size_t memory_limit() {
     return read_setting_V1V2_as<size_t>(
                              "memory/memory.limit_in_bytes",
-                             "memory.max")
+                             "memory.max", true)
         .value_or(std::numeric_limits<size_t>::max());
 }
 
+optional<double> cpu_quota() {
+    // Polled periodically, so an absent controller must not warn
+    auto setting = read_setting_V1V2_as<std::string>("cpu/cpu.cfs_quota_us", "cpu.max", true);
+    if (!setting) {
+        return std::nullopt;
+    }
+    // Only v2's cpu.max holds both the quota and the period
+    if (setting->find(' ') != std::string::npos) {
+        return parse_cpu_max(*setting);
+    }
+    return cpu_quota_v1("/sys/fs/cgroup/cpu");
+}
+
+optional<double> parse_cpu_max(const std::string& cpu_max) {
+    std::vector<std::string> fields;
+    boost::split(fields, cpu_max, boost::is_any_of(" "), boost::token_compress_on);
+    if (fields.size() == 2) {
+        if (fields[0] == "max") {
+            return std::nullopt;
+        }
+        try {
+            auto quota = boost::lexical_cast<long>(fields[0]);
+            auto period = boost::lexical_cast<long>(fields[1]);
+            if (quota > 0 && period > 0) {
+                return double(quota) / period;
+            }
+        } catch (...) {
+        }
+    }
+    seastar_logger.warn("Malformed cgroups CPU quota ({}).", cpu_max);
+    return std::nullopt;
+}
+
+optional<double> cpu_quota_v1(const std::string& dir) {
+    auto quota = read_setting_as<long>(dir + "/cpu.cfs_quota_us");
+    if (!quota || *quota < 0) {
+        return std::nullopt;
+    }
+    auto period = read_setting_as<long>(dir + "/cpu.cfs_period_us");
+    if (!period || *period <= 0) {
+        return std::nullopt;
+    }
+    return double(*quota) / *period;
+}
+
 template <typename T>
 optional<T> read_setting_as(std::string path) {
     try {
@@ -189,16 +234,20 @@ static optional<fs::path> locate_lowest_cgroup2(fs::path lowest_subdir, std::str
  * requested settings.
  */
 template <typename T>
-optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname) {
+optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname, bool missing_ok) {
     // on v2-systems, cg2_path will be initialized with the leaf cgroup that
     // controls this process
     static optional<fs::path> cg2_path{cgroup2_path_my_pid()};
 
     if (cg2_path) {
         // this is a v2 system
+        auto path = locate_lowest_cgroup2(*cg2_path, cg2_fname);
+        if (!path && missing_ok) {
+            return std::nullopt;
+        }
         seastar::sstring line;
         try {
-            line = read_first_line(locate_lowest_cgroup2(*cg2_path, cg2_fname).value());
+            line = read_first_line(path.value());
         } catch (...) {
             seastar_logger.warn("Could not read cgroups v2 file ({}).", cg2_fname);
             return std::nullopt;
@@ -214,8 +263,12 @@ optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname) {
     }
 
     // try cgroups v1:
+    auto path = fs::path{"/sys/fs/cgroup"} / cg1_path;
+    if (missing_ok && !fs::exists(path)) {
+        return std::nullopt;
+    }
     try {
-        auto line = read_first_line(fs::path{"/sys/fs/cgroup"} / cg1_path);
+        auto line = read_first_line(path);
         return boost::lexical_cast<T>(line);
     } catch (...) {
         seastar_logger.warn("Could not parse cgroups v1 file ({}).", cg1_path);
@@ -686,7 +739,9 @@ resources allocate(configuration& c) {
 
     unsigned last_node_idx = 0;
     for (auto devid : c.devices) {
-        ret.ioq_topology.emplace(devid, allocate_io_queues(topology, ret.cpus, cpu_to_node, c.num_io_groups, last_node_idx));
+        auto it = c.device_num_io_groups.find(devid);
+        auto num_io_groups = it != c.device_num_io_groups.end() ? it->second : c.num_io_groups;
+        ret.ioq_topology.emplace(devid, allocate_io_queues(topology, ret.cpus, cpu_to_node, num_io_groups, last_node_idx));
     }
 
     ret.numa_node_id_to_cpuset = numa_node_id_to_cpuset(topology);
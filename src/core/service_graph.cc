@@ -0,0 +1,123 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#include <exception>
+#include <stdexcept>
+#include <vector>
+module seastar;
+#else
+#include <exception>
+#include <stdexcept>
+#include <vector>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/print.hh>
+#include <seastar/core/service_graph.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/coroutine/as_future.hh>
+#include <seastar/coroutine/exception.hh>
+#endif
+
+namespace seastar {
+
+service_graph::service_id service_graph::add(noncopyable_function<future<> ()> start, noncopyable_function<future<> ()> stop, std::vector<service_id> deps) {
+    for (auto dep : deps) {
+        if (dep >= _services.size()) {
+            throw std::invalid_argument(format("service_graph: unknown dependency {}", dep));
+        }
+    }
+    _services.push_back(service{std::move(start), std::move(stop), std::move(deps)});
+    return _services.size() - 1;
+}
+
+future<> service_graph::start() {
+    // Dependencies come first, so their futures already exist
+    std::vector<shared_future<>> started;
+    started.reserve(_services.size());
+    for (auto& s : _services) {
+        std::vector<future<>> deps;
+        deps.reserve(s.deps.size());
+        for (auto dep : s.deps) {
+            deps.push_back(started[dep].get_future());
+        }
+        started.emplace_back(when_all_succeed(deps.begin(), deps.end()).then([&s] {
+            return s.start();
+        }).then([&s] {
+            s.started = true;
+        }));
+    }
+
+    std::exception_ptr ex;
+    for (auto& f : started) {
+        auto r = co_await coroutine::as_future(f.get_future());
+        if (r.failed() && !ex) {
+            ex = r.get_exception();
+        } else {
+            r.ignore_ready_future();
+        }
+    }
+    if (ex) {
+        auto f = co_await coroutine::as_future(stop());
+        f.ignore_ready_future();
+        co_await coroutine::return_exception_ptr(std::move(ex));
+    }
+}
+
+future<> service_graph::stop() {
+    std::vector<std::vector<service_id>> dependents(_services.size());
+    for (service_id id = 0; id < _services.size(); ++id) {
+        for (auto dep : _services[id].deps) {
+            dependents[dep].push_back(id);
+        }
+    }
+
+    // Dependents come last, so walk backwards
+    std::vector<shared_future<>> stopped(_services.size(), make_ready_future<>());
+    for (service_id id = _services.size(); id-- > 0;) {
+        std::vector<future<>> after;
+        for (auto d : dependents[id]) {
+            after.push_back(stopped[d].get_future().handle_exception([] (std::exception_ptr) {}));
+        }
+        auto& s = _services[id];
+        stopped[id] = when_all(after.begin(), after.end()).then([&s] (auto) {
+            if (!s.started) {
+                return make_ready_future<>();
+            }
+            s.started = false;
+            return s.stop();
+        });
+    }
+
+    std::exception_ptr ex;
+    for (auto& f : stopped) {
+        auto r = co_await coroutine::as_future(f.get_future());
+        if (r.failed()) {
+            ex = r.get_exception();
+        }
+    }
+    if (ex) {
+        co_await coroutine::return_exception_ptr(std::move(ex));
+    }
+}
+
+}
@@ -23,6 +23,8 @@ module;
 #endif
 
 #include <boost/range/algorithm/find_if.hpp>
+#include <algorithm>
+#include <map>
 #include <memory>
 #include <vector>
 #include <regex>
@@ -200,15 +202,16 @@ get_huge_page_size() {
 }
 
 internal::memory_prefaulter::memory_prefaulter(const resource::resources& res, memory::internal::numa_layout layout) {
+    std::map<unsigned, std::vector<memory::internal::memory_range>> layout_by_node_id;
     for (auto& range : layout.ranges) {
-        _layout_by_node_id[range.numa_node_id].push_back(std::move(range));
+        layout_by_node_id[range.numa_node_id].push_back(std::move(range));
     }
-    auto page_size = getpagesize();
-    auto huge_page_size_opt = get_huge_page_size();
-    for (auto& numa_node_id_and_ranges : _layout_by_node_id) {
-        auto& numa_node_id = numa_node_id_and_ranges.first;
-        auto& ranges = numa_node_id_and_ranges.second;
+    // Split the ranges of each node among its workers before starting any,
+    // the workers refer to their vectors
+    std::vector<posix_thread::attr> worker_attrs;
+    for (auto& [numa_node_id, ranges] : layout_by_node_id) {
         posix_thread::attr a;
+        size_t nr_cpus = 1;
         auto i = res.numa_node_id_to_cpuset.find(numa_node_id);
         if (i != res.numa_node_id_to_cpuset.end()) {
             cpu_set_t cpuset;
@@ -217,8 +220,20 @@ internal::memory_prefaulter::memory_prefaulter(const resource::resources& res, m
                 CPU_SET(cpu, &cpuset);
             }
             a.set(cpuset);
+            nr_cpus = std::max<size_t>(i->second.size(), 1);
+        }
+        auto nr_workers = std::min({ranges.size(), nr_cpus, size_t(max_workers_per_node)});
+        auto first = _ranges_by_worker.size();
+        _ranges_by_worker.resize(first + nr_workers);
+        for (size_t r = 0; r < ranges.size(); ++r) {
+            _ranges_by_worker[first + r % nr_workers].push_back(ranges[r]);
         }
-        _worker_threads.emplace_back(a, [this, &ranges, page_size, huge_page_size_opt] {
+        worker_attrs.resize(worker_attrs.size() + nr_workers, a);
+    }
+    auto page_size = getpagesize();
+    auto huge_page_size_opt = get_huge_page_size();
+    for (size_t w = 0; w < _ranges_by_worker.size(); ++w) {
+        _worker_threads.emplace_back(worker_attrs[w], [this, &ranges = _ranges_by_worker[w], page_size, huge_page_size_opt] {
             work(ranges, page_size, huge_page_size_opt);
         });
     }
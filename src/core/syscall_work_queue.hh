@@ -24,11 +24,13 @@
 #include <seastar/core/internal/pollable_fd.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/noncopyable_function.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <boost/lockfree/spsc_queue.hpp>
+#include <chrono>
 #endif
 
 namespace seastar {
@@ -42,7 +44,12 @@ class syscall_work_queue {
     lf_queue _completed;
     writeable_eventfd _start_eventfd;
     semaphore _queue_has_room = { queue_length };
+    // Submitted and not yet completed, including those waiting for room
+    unsigned _in_flight = 0;
+    // From submission to completion, as seen by the reactor
+    metrics::internal::short_time_estimated_histogram _latency;
     struct work_item {
+        std::chrono::steady_clock::time_point submitted;
         virtual ~work_item() {}
         virtual void process() = 0;
         virtual void complete() = 0;
@@ -82,6 +89,9 @@ class syscall_work_queue {
     // Returns the number of requests handled.
     unsigned complete();
     void submit_item(std::unique_ptr<syscall_work_queue::work_item> wi);
+    unsigned in_flight() const noexcept {
+        return _in_flight;
+    }
 
     friend class thread_pool;
 };
@@ -25,17 +25,26 @@ module;
 
 #include <ucontext.h>
 #include <setjmp.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <valgrind/valgrind.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cassert>
 #include <algorithm>
+#include <cstring>
 #include <exception>
+#include <new>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 #include <boost/intrusive/list.hpp>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
 #include <seastar/core/thread.hh>
+#include <seastar/core/align.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor.hh>
 #endif
@@ -47,6 +56,9 @@ namespace seastar {
 thread_local jmp_buf_link g_unthreaded_context;
 thread_local jmp_buf_link* g_current_context;
 
+// The stack of the reactor thread, see thread_impl::current_stack()
+static thread_local thread_impl::stack_bounds reactor_stack;
+
 #ifdef SEASTAR_ASAN_ENABLED
 
 namespace {
@@ -179,7 +191,97 @@ static size_t get_stack_size(thread_attributes attr) {
 #endif
 }
 
-thread_context::thread_context(thread_attributes attr, noncopyable_function<void ()> func)
+namespace {
+
+// Recycles thread stacks, so that short lived threads don't pay for an
+// allocation, and in builds with stack guards for two mprotect() calls,
+// each time.
+//
+// Stacks come from the memory allocator. Up to max_cached_per_size free
+// stacks of each size are kept as they are, their pages still committed,
+// since they are about to be reused anyway. Stacks returned beyond that
+// go back to the allocator.
+class stack_pool {
+    static constexpr size_t max_cached_per_size = 16;
+    // Free stacks of each size
+    std::unordered_map<size_t, std::vector<char*>> _free;
+private:
+    static size_t alignment() noexcept {
+#ifdef SEASTAR_THREAD_STACK_GUARDS
+        return getpagesize();
+#else
+        return 16; // ABI requirement on x86_64
+#endif
+    }
+    static void protect_guard(char* stack) {
+#ifdef SEASTAR_THREAD_STACK_GUARDS
+        // The guard page is readable, for the stack guard test to be able
+        // to tell reads from writes
+        auto r = ::mprotect(stack, getpagesize(), PROT_READ);
+        throw_system_error_on(r != 0, "mprotect");
+#endif
+    }
+    static void release(char* stack) noexcept {
+#ifdef SEASTAR_THREAD_STACK_GUARDS
+        auto r = ::mprotect(stack, getpagesize(), PROT_READ | PROT_WRITE);
+        assert(r == 0);
+#endif
+        ::free(stack);
+    }
+public:
+    ~stack_pool() {
+        for (auto& [size, stacks] : _free) {
+            for (auto stack : stacks) {
+                release(stack);
+            }
+        }
+    }
+    size_t round_size(size_t size) const noexcept {
+        return align_up(size, alignment());
+    }
+    // size must be rounded with round_size()
+    char* allocate(size_t size) {
+        auto& stacks = _free[size];
+        if (!stacks.empty()) {
+            auto stack = stacks.back();
+            stacks.pop_back();
+            return stack;
+        }
+        auto stack = static_cast<char*>(::aligned_alloc(alignment(), size));
+        if (stack == nullptr) {
+            throw std::bad_alloc();
+        }
+        try {
+            protect_guard(stack);
+        } catch (...) {
+            ::free(stack);
+            throw;
+        }
+        return stack;
+    }
+    void free(char* stack, size_t size) noexcept {
+        auto it = _free.find(size);
+        if (it == _free.end() || it->second.size() >= max_cached_per_size) {
+            release(stack);
+            return;
+        }
+        // The thread may have unprotected the guard page, see thread_test
+        try {
+            protect_guard(stack);
+        } catch (...) {
+            release(stack);
+            return;
+        }
+        // Doesn't allocate, since allocate() popped the stack from there
+        it->second.push_back(stack);
+    }
+};
+
+thread_local stack_pool local_stack_pool;
+
+}
+
+thread_context::thread_context(thread_attributes attr, func_type func)
         : task(attr.sched_group.value_or(current_scheduling_group()))
         , _stack(make_stack(get_stack_size(attr)))
         , _func(std::move(func)) {
@@ -188,45 +290,27 @@ thread_context::thread_context(thread_attributes attr, noncopyable_function<void
 }
 
 thread_context::~thread_context() {
-#ifdef SEASTAR_THREAD_STACK_GUARDS
-    auto mp_result = mprotect(_stack.get(), getpagesize(), PROT_READ | PROT_WRITE);
-    assert(mp_result == 0);
-#endif
     _all_threads.erase(_all_threads.iterator_to(*this));
 }
 
-thread_context::stack_deleter::stack_deleter(int valgrind_id) : valgrind_id(valgrind_id) {}
+thread_context::stack_deleter::stack_deleter(int valgrind_id, size_t size) : valgrind_id(valgrind_id), size(size) {}
 
 thread_context::stack_holder
 thread_context::make_stack(size_t stack_size) {
-#ifdef SEASTAR_THREAD_STACK_GUARDS
-    size_t page_size = getpagesize();
-    size_t alignment = page_size;
-#else
-    size_t alignment = 16; // ABI requirement on x86_64
-#endif
-    void* mem = ::aligned_alloc(alignment, stack_size);
-    if (mem == nullptr) {
-        throw std::bad_alloc();
-    }
-    int valgrind_id = VALGRIND_STACK_REGISTER(mem, reinterpret_cast<char*>(mem) + stack_size);
-    auto stack = stack_holder(new (mem) char[stack_size], stack_deleter(valgrind_id));
+    stack_size = local_stack_pool.round_size(stack_size);
+    char* mem = local_stack_pool.allocate(stack_size);
+    int valgrind_id = VALGRIND_STACK_REGISTER(mem, mem + stack_size);
+    auto stack = stack_holder(new (mem) char[stack_size], stack_deleter(valgrind_id, stack_size));
 #ifdef SEASTAR_ASAN_ENABLED
     // Avoid ASAN false positive due to garbage on stack
     std::memset(stack.get(), 0, stack_size);
 #endif
-
-#ifdef SEASTAR_THREAD_STACK_GUARDS
-    auto mp_status = mprotect(stack.get(), page_size, PROT_READ);
-    throw_system_error_on(mp_status != 0, "mprotect");
-#endif
-
     return stack;
 }
 
 void thread_context::stack_deleter::operator()(char* ptr) const noexcept {
     VALGRIND_STACK_DEREGISTER(valgrind_id);
-    free(ptr);
+    local_stack_pool.free(ptr, size);
 }
 
 void
@@ -335,6 +419,30 @@ void init() {
     g_unthreaded_context.link = nullptr;
     g_unthreaded_context.thread = nullptr;
     g_current_context = &g_unthreaded_context;
+
+    // Looked up here, as pthread_getattr_np() isn't async-signal-safe
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void* addr;
+        size_t size;
+        if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+            reactor_stack.low = reinterpret_cast<uintptr_t>(addr);
+            reactor_stack.high = reactor_stack.low + size;
+        }
+        pthread_attr_destroy(&attr);
+    }
+}
+
+stack_bounds current_stack() noexcept {
+    if (!g_current_context) {
+        return {};
+    }
+    auto thread = g_current_context->thread;
+    if (!thread) {
+        return reactor_stack;
+    }
+    auto low = reinterpret_cast<uintptr_t>(thread->_stack.get());
+    return {low, low + thread->_stack.get_deleter().size};
 }
 
 scheduling_group
@@ -22,15 +22,19 @@
 
 #ifdef SEASTAR_MODULE
 module;
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <array>
+#include <memory>
+#include <vector>
 #include <pthread.h>
 #include <signal.h>
 module seastar;
 #else
 #include <seastar/core/reactor.hh>
+#include <seastar/core/print.hh>
 #include "core/thread_pool.hh"
 #endif
 
@@ -38,15 +42,65 @@ namespace seastar {
 
 /* not yet implemented for OSv. TODO: do the notification like we do class smp. */
 #ifndef HAVE_OSV
-thread_pool::thread_pool(reactor& r, sstring name) : _reactor(r), _worker_thread([this, name] { work(name); }) {
+thread_pool::worker::worker(thread_pool& pool, sstring name)
+    : thread([this, &pool, name] { pool.work(*this, name); }) {
 }
 
-void thread_pool::work(sstring name) {
+thread_pool::thread_pool(reactor& r, sstring name, unsigned threads_per_kind) : _reactor(r) {
+    static constexpr char kind_tag[nr_kinds] = {'m', 'd'};
+    threads_per_kind = std::max(threads_per_kind, 1u);
+    for (unsigned k = 0; k < nr_kinds; k++) {
+        for (unsigned i = 0; i < threads_per_kind; i++) {
+            _workers[k].push_back(std::make_unique<worker>(*this, seastar::format("{}-{}{}", name, kind_tag[k], i)));
+        }
+    }
+}
+
+thread_pool::worker& thread_pool::pick_worker(syscall_kind kind) noexcept {
+    auto& workers = _workers[unsigned(kind)];
+    auto* best = workers.front().get();
+    for (auto& w : workers) {
+        if (w->wq.in_flight() < best->wq.in_flight()) {
+            best = w.get();
+        }
+    }
+    return *best;
+}
+
+unsigned thread_pool::complete() {
+    unsigned nr = 0;
+    for (auto& workers : _workers) {
+        for (auto& w : workers) {
+            nr += w->wq.complete();
+        }
+    }
+    return nr;
+}
+
+unsigned thread_pool::queue_length(syscall_kind kind) const noexcept {
+    unsigned nr = 0;
+    for (auto& w : _workers[unsigned(kind)]) {
+        nr += w->wq.in_flight();
+    }
+    return nr;
+}
+
+metrics::histogram thread_pool::latency_histogram(syscall_kind kind) const {
+    auto& workers = _workers[unsigned(kind)];
+    auto h = workers.front()->wq._latency;
+    for (auto it = std::next(workers.begin()); it != workers.end(); ++it) {
+        h.merge((*it)->wq._latency);
+    }
+    return h.to_metrics_histogram();
+}
+
+void thread_pool::work(worker& w, sstring name) {
     pthread_setname_np(pthread_self(), name.c_str());
     sigset_t mask;
     sigfillset(&mask);
     auto r = ::pthread_sigmask(SIG_BLOCK, &mask, NULL);
     throw_pthread_error(r);
+    auto& inter_thread_wq = w.wq;
     std::array<syscall_work_queue::work_item*, syscall_work_queue::queue_length> tmp_buf;
     while (true) {
         uint64_t count;
@@ -76,8 +130,12 @@ void thread_pool::work(sstring name) {
 
 thread_pool::~thread_pool() {
     _stopped.store(true, std::memory_order_relaxed);
-    inter_thread_wq._start_eventfd.signal(1);
-    _worker_thread.join();
+    for (auto& workers : _workers) {
+        for (auto& w : workers) {
+            w->wq._start_eventfd.signal(1);
+            w->thread.join();
+        }
+    }
 }
 #endif
 
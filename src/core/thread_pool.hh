@@ -22,30 +22,61 @@
 #pragma once
 
 #include "syscall_work_queue.hh"
+#include <seastar/core/metrics_types.hh>
+#include <seastar/core/posix.hh>
+#ifndef SEASTAR_MODULE
+#include <array>
+#include <memory>
+#include <vector>
+#endif
 
 namespace seastar {
 
 class reactor;
 
+// Blocking system calls are offloaded to threads, with separate queues for
+// the two kinds, so that slow ones of one kind (e.g. fsync) don't hold back
+// the other (e.g. open).
+enum class syscall_kind : unsigned {
+    metadata, // open, rename, unlink, stat, mkdir, ...
+    data,     // fdatasync, ftruncate, fallocate, buffered reads and writes, ...
+};
+
 class thread_pool {
+    static constexpr unsigned nr_kinds = 2;
     reactor& _reactor;
     uint64_t _aio_threaded_fallbacks = 0;
 #ifndef HAVE_OSV
-    syscall_work_queue inter_thread_wq;
-    posix_thread _worker_thread;
+    struct worker {
+        syscall_work_queue wq;
+        posix_thread thread;
+        worker(thread_pool& pool, sstring name);
+    };
+    // Per kind, each worker thread serving its own queue
+    std::array<std::vector<std::unique_ptr<worker>>, nr_kinds> _workers;
+    std::array<uint64_t, nr_kinds> _operations = {};
     std::atomic<bool> _stopped = { false };
     std::atomic<bool> _main_thread_idle = { false };
 public:
-    explicit thread_pool(reactor& r, sstring thread_name);
+    thread_pool(reactor& r, sstring thread_name, unsigned threads_per_kind = 1);
     ~thread_pool();
     template <typename T, typename Func>
     future<T> submit(Func func) noexcept {
+        return submit<T>(syscall_kind::metadata, std::move(func));
+    }
+    template <typename T, typename Func>
+    future<T> submit(syscall_kind kind, Func func) noexcept {
         ++_aio_threaded_fallbacks;
-        return inter_thread_wq.submit<T>(std::move(func));
+        ++_operations[unsigned(kind)];
+        return pick_worker(kind).wq.submit<T>(std::move(func));
     }
     uint64_t operation_count() const { return _aio_threaded_fallbacks; }
+    uint64_t operation_count(syscall_kind kind) const { return _operations[unsigned(kind)]; }
+    // Operations of that kind submitted and not yet completed
+    unsigned queue_length(syscall_kind kind) const noexcept;
+    metrics::histogram latency_histogram(syscall_kind kind) const;
 
-    unsigned complete() { return inter_thread_wq.complete(); }
+    unsigned complete();
     // Before we enter interrupt mode, we must make sure that the syscall thread will properly
     // generate signals to wake us up. This means we need to make sure that all modifications to
     // the pending and completed fields in the inter_thread_wq are visible to all threads.
@@ -62,9 +93,15 @@ class thread_pool {
 public:
     template <typename T, typename Func>
     future<T> submit(Func func) { std::cerr << "thread_pool not yet implemented on osv\n"; abort(); }
+    template <typename T, typename Func>
+    future<T> submit(syscall_kind, Func func) { return submit<T>(std::move(func)); }
 #endif
 private:
-    void work(sstring thread_name);
+#ifndef HAVE_OSV
+    // The least loaded worker of that kind
+    worker& pick_worker(syscall_kind kind) noexcept;
+    void work(worker& w, sstring thread_name);
+#endif
 };
 
 
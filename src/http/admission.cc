@@ -0,0 +1,61 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#include <optional>
+module seastar;
+#else
+#include <seastar/http/admission.hh>
+#endif
+
+namespace seastar {
+
+namespace httpd {
+
+admission_controller::admission_controller(admission_config cfg)
+    : _cfg(cfg)
+    , _slots(cfg.max_concurrency)
+{}
+
+future<std::optional<admission_controller::permit>> admission_controller::admit(admission_stats& stats) {
+    using ret_type = std::optional<permit>;
+    if (auto units = try_get_units(_slots, 1)) {
+        return make_ready_future<ret_type>(permit(shared_from_this(), std::move(*units)));
+    }
+    if (_slots.waiters() >= _cfg.max_queue_length || _cfg.max_queue_time.count() <= 0) {
+        ++stats.shed;
+        return make_ready_future<ret_type>();
+    }
+    ++stats.queued;
+    return get_units(_slots, 1, _cfg.max_queue_time).then_wrapped([self = shared_from_this(), &stats] (future<semaphore_units<>> f) {
+        try {
+            return ret_type(permit(self, f.get()));
+        } catch (const semaphore_timed_out&) {
+            ++stats.shed;
+            return ret_type();
+        }
+    });
+}
+
+}
+
+}
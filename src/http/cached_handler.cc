@@ -0,0 +1,182 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/http/cached_handler.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/http/request.hh>
+#endif
+
+namespace seastar {
+
+namespace httpd {
+
+namespace {
+
+bool is_connection_header(std::string_view name) {
+    // Set by the connection for every reply, or computed when sending
+    for (std::string_view h : {"Server", "Date", "Connection", "Content-Length", "Transfer-Encoding"}) {
+        if (std::equal(name.begin(), name.end(), h.begin(), h.end(), [] (char a, char b) { return ::tolower(a) == ::tolower(b); })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// RFC9110 13.1.2, with the weak comparison
+bool etag_matches(std::string_view if_none_match, std::string_view etag) {
+    auto strip_weak = [] (std::string_view tag) {
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        return tag;
+    };
+    etag = strip_weak(etag);
+    while (!if_none_match.empty()) {
+        auto tag = if_none_match.substr(0, if_none_match.find(','));
+        if_none_match.remove_prefix(std::min(if_none_match.size(), tag.size() + 1));
+        auto begin = tag.find_first_not_of(" \t");
+        if (begin == std::string_view::npos) {
+            continue;
+        }
+        tag = tag.substr(begin, tag.find_last_not_of(" \t") - begin + 1);
+        if (tag == "*" || strip_weak(tag) == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+cached_handler::cached_handler(std::unique_ptr<handler_base> handler)
+    : cached_handler(std::move(handler), config{})
+{}
+
+cached_handler::cached_handler(std::unique_ptr<handler_base> handler, config cfg)
+    : _handler(std::move(handler))
+    , _cfg(std::move(cfg))
+{}
+
+sstring cached_handler::make_key(const http::request& req) const {
+    const sstring separator(1, '\0');
+    sstring key = req._method + separator + req._url;
+    for (auto& h : _cfg.vary) {
+        key += separator + req.get_header(h);
+    }
+    return key;
+}
+
+cached_handler::entry cached_handler::render(http::reply& rep, sstring url) const {
+    entry e;
+    e.url = std::move(url);
+    e.etag = rep.get_header("ETag");
+    if (e.etag.empty()) {
+        e.etag = fmt::format("\"{:016x}\"", std::hash<std::string_view>()(rep._content));
+        rep._headers["ETag"] = e.etag;
+    }
+    sstring headers;
+    for (auto& [name, value] : rep._headers) {
+        if (!is_connection_header(name)) {
+            headers += name + ": " + value + "\r\n";
+        }
+    }
+    headers += "Content-Length: " + to_sstring(rep._content.size()) + "\r\n";
+    e.headers = temporary_buffer<char>(headers.data(), headers.size());
+    e.body = temporary_buffer<char>(rep._content.data(), rep._content.size());
+    if (_cfg.max_age) {
+        e.expires = lowres_clock::now() + *_cfg.max_age;
+    }
+    return e;
+}
+
+std::unique_ptr<http::reply> cached_handler::serve(entry& e, const sstring& if_none_match, std::unique_ptr<http::reply> rep) {
+    std::erase_if(rep->_headers, [] (auto& h) {
+        return !is_connection_header(h.first);
+    });
+    rep->_content = {};
+    if (!if_none_match.empty() && etag_matches(if_none_match, e.etag)) {
+        ++_stats.not_modified;
+        rep->set_status(http::reply::status_type::not_modified);
+        rep->add_header("ETag", e.etag);
+        return rep;
+    }
+    rep->set_status(http::reply::status_type::ok);
+    rep->write_prerendered(e.headers.share(), e.body.share());
+    return rep;
+}
+
+future<std::unique_ptr<http::reply>> cached_handler::handle(const sstring& path,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+    auto key = make_key(*req);
+    auto if_none_match = req->get_header("If-None-Match");
+    if (auto it = _entries.find(key); it != _entries.end()) {
+        if (!_cfg.max_age || lowres_clock::now() < it->second.expires) {
+            ++_stats.hits;
+            return make_ready_future<std::unique_ptr<http::reply>>(serve(it->second, if_none_match, std::move(rep)));
+        }
+        _entries.erase(it);
+    }
+    ++_stats.misses;
+    auto url = req->_url;
+    return _handler->handle(path, std::move(req), std::move(rep)).then(
+            [this, key = std::move(key), url = std::move(url), if_none_match = std::move(if_none_match), generation = _generation] (std::unique_ptr<http::reply> rep) mutable {
+        if (rep->_status != http::reply::status_type::ok || rep->_body_writer) {
+            return rep;
+        }
+        auto e = render(*rep, std::move(url));
+        rep = serve(e, if_none_match, std::move(rep));
+        if (generation == _generation && _entries.size() < _cfg.max_entries) {
+            _entries.insert_or_assign(std::move(key), std::move(e));
+        }
+        return rep;
+    });
+}
+
+void cached_handler::invalidate(std::string_view url) {
+    ++_generation;
+    std::erase_if(_entries, [url] (auto& e) {
+        return e.second.url == url;
+    });
+}
+
+void cached_handler::invalidate() {
+    ++_generation;
+    _entries.clear();
+}
+
+}
+
+}
@@ -23,6 +23,7 @@
 module;
 #endif
 
+#include <algorithm>
 #include <concepts>
 #include <memory>
 #include <optional>
@@ -32,7 +33,10 @@ module;
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/timer.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/net/tls.hh>
@@ -61,6 +65,10 @@ client_ref::~client_ref() {
     }
 }
 
+void client_ref::notify() noexcept {
+    _c->_wait_con.broadcast();
+}
+
 }
 
 namespace experimental {
@@ -75,6 +83,9 @@ connection::connection(connected_socket&& fd, internal::client_ref cr)
 }
 
 future<> connection::write_body(const request& req) {
+    if (req._file_body) {
+        return req.send_file_body(_fd, _write_buf);
+    }
     if (req.body_writer) {
         if (req.content_length != 0) {
             return req.body_writer(internal::make_http_content_length_output_stream(_write_buf, req.content_length, req._bytes_written)).then([&req] {
@@ -205,8 +216,8 @@ class basic_connection_factory : public connection_factory {
     }
 };
 
-client::client(socket_address addr)
-        : client(std::make_unique<basic_connection_factory>(std::move(addr)))
+client::client(socket_address addr, protocol proto)
+        : client(std::make_unique<basic_connection_factory>(std::move(addr)), default_max_connections, proto)
 {
 }
 
@@ -226,13 +237,36 @@ class tls_connection_factory : public connection_factory {
     }
 };
 
-client::client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host)
-        : client(std::make_unique<tls_connection_factory>(std::move(addr), std::move(creds), std::move(host)))
+client::client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host, protocol proto)
+        : client(std::make_unique<tls_connection_factory>(std::move(addr), std::move(creds), std::move(host)), default_max_connections, proto)
+{
+}
+
+balanced_connection_factory::balanced_connection_factory(shared_ptr<net::srv_balancer> balancer,
+        shared_ptr<tls::certificate_credentials> creds, sstring host)
+        : _balancer(std::move(balancer))
+        , _creds(std::move(creds))
+        , _host(std::move(host))
 {
 }
 
-client::client(std::unique_ptr<connection_factory> f, unsigned max_connections)
+future<connected_socket> balanced_connection_factory::make() {
+    auto endpoint = _balancer->acquire();
+    try {
+        auto fd = co_await (_creds
+                ? tls::connect(_creds, endpoint.address(), tls::tls_options{.server_name = _host})
+                : seastar::connect(endpoint.address(), {}, transport::TCP));
+        endpoint.complete(true);
+        co_return fd;
+    } catch (...) {
+        endpoint.complete(false);
+        throw;
+    }
+}
+
+client::client(std::unique_ptr<connection_factory> f, unsigned max_connections, protocol proto)
         : _new_connections(std::move(f))
+        , _protocol(proto)
         , _max_connections(max_connections)
 {
 }
@@ -271,11 +305,98 @@ future<> client::put_connection(connection_ptr con) {
     return con->close().finally([con] {});
 }
 
+future<client::http2_connection_ptr> client::get_http2_connection() {
+    // Connections can't be reused past a failure or GOAWAY, but those
+    // still in use go away with their last request
+    std::vector<http2_connection_ptr> unusable;
+    std::erase_if(_http2_connections, [&unusable] (const http2_connection_ptr& con) {
+        if (!con->usable() && !con->active_requests()) {
+            unusable.push_back(con);
+            return true;
+        }
+        return false;
+    });
+    for (auto& con : unusable) {
+        (void)drop_http2_connection(std::move(con));
+    }
+
+    http2_connection_ptr best;
+    for (auto& con : _http2_connections) {
+        if (con->can_make_request() && (!best || con->active_requests() < best->active_requests())) {
+            best = con;
+        }
+    }
+    // New connections are only opened once the server limits the streams
+    if (best) {
+        return make_ready_future<http2_connection_ptr>(std::move(best));
+    }
+
+    if (_nr_connections >= _max_connections) {
+        return _wait_con.wait().then([this] {
+            return get_http2_connection();
+        });
+    }
+
+    _total_new_connections++;
+    return _new_connections->make().then([this, cr = internal::client_ref(this)] (connected_socket cs) mutable {
+        return do_with(std::move(cs), [this, cr = std::move(cr)] (connected_socket& cs) mutable {
+            return futurize_invoke([&cs] { return tls::get_alpn_protocol(cs); }).then_wrapped([this, &cs, cr = std::move(cr)] (future<std::optional<sstring>> f) mutable {
+                sstring scheme = "https";
+                try {
+                    auto proto = f.get();
+                    if (proto && *proto != "h2") {
+                        throw std::runtime_error(format("Server negotiated {} instead of HTTP/2", *proto));
+                    }
+                } catch (const std::invalid_argument&) {
+                    // Not a TLS socket
+                    scheme = "http";
+                }
+                http_log.trace("created new http/2 connection {}", cs.local_address());
+                auto con = seastar::make_shared<http2_connection>(std::move(cs), std::move(cr), std::move(scheme));
+                _http2_connections.push_back(con);
+                _wait_con.broadcast();
+                return con;
+            });
+        });
+    });
+}
+
+future<> client::drop_http2_connection(http2_connection_ptr con) {
+    std::erase(_http2_connections, con);
+    return con->close().handle_exception([] (std::exception_ptr ex) {
+        http_log.debug("failed to close http/2 connection: {}", ex);
+    }).finally([con] {});
+}
+
+future<> client::close_http2_connections() {
+    if (_http2_connections.empty()) {
+        return make_ready_future<>();
+    }
+
+    return drop_http2_connection(_http2_connections.back()).then([this] {
+        return close_http2_connections();
+    });
+}
+
 future<> client::shrink_connections() {
     if (_nr_connections <= _max_connections) {
         return make_ready_future<>();
     }
 
+    if (_protocol == protocol::http2) {
+        auto it = std::find_if(_http2_connections.begin(), _http2_connections.end(), [] (const http2_connection_ptr& con) {
+            return !con->active_requests();
+        });
+        if (it != _http2_connections.end()) {
+            return drop_http2_connection(*it).then([this] {
+                return shrink_connections();
+            });
+        }
+        return _wait_con.wait().then([this] {
+            return shrink_connections();
+        });
+    }
+
     if (!_pool.empty()) {
         connection_ptr con = _pool.front().shared_from_this();
         _pool.pop_front();
@@ -300,53 +421,266 @@ future<> client::set_maximum_connections(unsigned nr) {
     return shrink_connections();
 }
 
-template <std::invocable<connection&> Fn>
-auto client::with_connection(Fn&& fn) {
-    return get_connection().then([this, fn = std::move(fn)] (connection_ptr con) mutable {
-        return fn(*con).finally([this, con = std::move(con)] () mutable {
-            return put_connection(std::move(con));
+static future<> handle_reply(std::unique_ptr<reply> reply, input_stream<char> in, client::reply_handler handle, std::optional<reply::status_type> expected) {
+    auto& rep = *reply;
+    if (expected.has_value() && rep._status != expected.value()) {
+        if (!http_log.is_enabled(log_level::debug)) {
+            return make_exception_future<>(httpd::unexpected_status_error(rep._status));
+        }
+
+        return do_with(std::move(in), [reply = std::move(reply)] (auto& in) mutable {
+            return util::read_entire_stream_contiguous(in).then([reply = std::move(reply)] (auto message) {
+                http_log.debug("request finished with {}: {}", reply->_status, message);
+                return make_exception_future<>(httpd::unexpected_status_error(reply->_status));
+            });
         });
-    });
+    }
+
+    return handle(rep, std::move(in)).finally([reply = std::move(reply)] {});
 }
 
-future<> client::make_request(request req, reply_handler handle, std::optional<reply::status_type> expected) {
-    return with_connection([req = std::move(req), handle = std::move(handle), expected] (connection& con) mutable {
-        return con.do_make_request(std::move(req)).then([&con, expected, handle = std::move(handle)] (connection::reply_ptr reply) mutable {
-            auto& rep = *reply;
-            if (expected.has_value() && rep._status != expected.value()) {
-                if (!http_log.is_enabled(log_level::debug)) {
-                    return make_exception_future<>(httpd::unexpected_status_error(rep._status));
-                }
+// The reply head of a request and its body, which holds the connection
+// until released
+struct client::attempt {
+    std::unique_ptr<reply> rep;
+    input_stream<char> body;
+    noncopyable_function<future<>(bool failed)> release;
+};
 
-                return do_with(con.in(rep), [reply = std::move(reply)] (auto& in) mutable {
-                    return util::read_entire_stream_contiguous(in).then([reply = std::move(reply)] (auto message) {
-                        http_log.debug("request finished with {}: {}", reply->_status, message);
-                        return make_exception_future<>(httpd::unexpected_status_error(reply->_status));
-                    });
-                });
+future<client::attempt> client::send(request req) {
+    if (_protocol == protocol::http2) {
+        auto con = co_await get_http2_connection();
+        auto release = [this, con] (bool) {
+            if (!con->usable() && !con->active_requests() && std::find(_http2_connections.begin(), _http2_connections.end(), con) != _http2_connections.end()) {
+                return drop_http2_connection(con);
             }
+            return make_ready_future<>();
+        };
+        std::exception_ptr ex;
+        try {
+            auto response = co_await con->do_make_request(std::move(req));
+            co_return attempt{std::move(response.first), std::move(response.second), std::move(release)};
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await release(true);
+        std::rethrow_exception(ex);
+    }
+
+    auto con = co_await get_connection();
+    auto release = [this, con] (bool failed) {
+        if (failed) {
+            con->_persistent = false;
+        }
+        return put_connection(con);
+    };
+    std::exception_ptr ex;
+    try {
+        auto rep = co_await con->do_make_request(std::move(req));
+        auto in = con->in(*rep);
+        co_return attempt{std::move(rep), std::move(in), std::move(release)};
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    co_await release(true);
+    std::rethrow_exception(ex);
+}
+
+static bool can_send_again(const request& req) {
+    static const std::array<std::string_view, 6> idempotent = { "GET", "HEAD", "PUT", "DELETE", "OPTIONS", "TRACE" };
+    return std::find(idempotent.begin(), idempotent.end(), std::string_view(req._method)) != idempotent.end();
+}
+
+std::optional<client::clock_type::duration> client::hedge_delay() const {
+    if (_retry.hedge_quantile <= 0 || _nr_latencies < min_latency_samples) {
+        return std::nullopt;
+    }
+    auto n = std::min(_nr_latencies, latency_samples);
+    std::array<clock_type::duration, latency_samples> samples;
+    std::copy_n(_latencies.begin(), n, samples.begin());
+    auto q = samples.begin() + std::min<size_t>(n * _retry.hedge_quantile, n - 1);
+    std::nth_element(samples.begin(), q, samples.begin() + n);
+    return std::max<clock_type::duration>(*q, _retry.min_hedge_delay);
+}
 
-            return handle(rep, con.in(rep)).finally([reply = std::move(reply)] {});
-        }).handle_exception([&con] (auto ex) mutable {
-            con._persistent = false;
-            return make_exception_future<>(std::move(ex));
+future<client::attempt> client::send_hedged(const request& req) {
+    // Owned by the attempts in flight. The hedge timer only points to it,
+    // it dies with the race.
+    struct race : enable_lw_shared_from_this<race> {
+        promise<attempt> pr;
+        timer<> hedge;
+        unsigned pending = 0;
+        bool done = false;
+    };
+
+    auto launch = [this] (lw_shared_ptr<race> r, request rq) {
+        ++r->pending;
+        auto start = clock_type::now();
+        (void)with_gate(_background, [this, r, start, rq = std::move(rq)] () mutable {
+            return send(std::move(rq)).then_wrapped([this, r, start] (future<attempt> f) {
+                --r->pending;
+                if (f.failed()) {
+                    auto ex = f.get_exception();
+                    // The other copy may still succeed
+                    if (!r->done && !r->pending) {
+                        r->done = true;
+                        r->hedge.cancel();
+                        r->pr.set_exception(std::move(ex));
+                    }
+                    return make_ready_future<>();
+                }
+                auto a = f.get();
+                if (r->done) {
+                    // Lost the race, the connection is closed with the reply pending
+                    return a.release(true);
+                }
+                _latencies[_nr_latencies++ % latency_samples] = clock_type::now() - start;
+                r->done = true;
+                r->hedge.cancel();
+                r->pr.set_value(std::move(a));
+                return make_ready_future<>();
+            });
         });
-    });
+    };
+
+    auto r = make_lw_shared<race>();
+    auto f = r->pr.get_future();
+    if (auto delay = hedge_delay()) {
+        r->hedge.set_callback([this, rp = r.get(), &req, launch] {
+            _total_hedged++;
+            launch(rp->shared_from_this(), req.copy());
+        });
+        r->hedge.arm(*delay);
+    }
+    launch(std::move(r), req.copy());
+    return f;
+}
+
+future<client::attempt> client::send_with_retries(request req) {
+    auto backoff = _retry.backoff;
+    for (unsigned retries = 0; ; retries++) {
+        std::exception_ptr ex;
+        try {
+            co_return co_await send_hedged(req);
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        if (retries >= _retry.max_retries) {
+            std::rethrow_exception(ex);
+        }
+        http_log.debug("retrying {} {} in {}ms: {}", req._method, req._url, backoff.count(), ex);
+        _total_retries++;
+        co_await seastar::sleep(backoff);
+        backoff *= 2;
+    }
+}
+
+future<> client::make_request(request req, reply_handler handle, std::optional<reply::status_type> expected) {
+    auto a = co_await (can_send_again(req) && req.can_copy() && (_retry.max_retries || _retry.hedge_quantile > 0)
+            ? send_with_retries(std::move(req)) : send(std::move(req)));
+    std::exception_ptr ex;
+    try {
+        co_await handle_reply(std::move(a.rep), std::move(a.body), std::move(handle), expected);
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    co_await a.release(bool(ex));
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+}
+
+future<> client::warm_up(unsigned nr) {
+    if (_protocol == protocol::http2) {
+        if (nr && _http2_connections.empty() && _nr_connections < _max_connections) {
+            co_await get_http2_connection();
+        }
+        co_return;
+    }
+
+    while (_pool.size() < nr && _nr_connections < _max_connections) {
+        internal::client_ref cr(this);
+        _total_new_connections++;
+        auto cs = co_await _new_connections->make();
+        http_log.trace("created new http connection {} ahead of requests", cs.local_address());
+        auto con = seastar::make_shared<connection>(std::move(cs), std::move(cr));
+        _pool.push_back(*con);
+        _wait_con.signal();
+    }
 }
 
 future<> client::close() {
+    return _background.close().then([this] {
+        return close_connections();
+    });
+}
+
+future<> client::close_connections() {
     if (_pool.empty()) {
-        return make_ready_future<>();
+        return close_http2_connections();
     }
 
     connection_ptr con = _pool.front().shared_from_this();
     _pool.pop_front();
     http_log.trace("closing connection {}", con->_fd.local_address());
     return con->close().then([this, con] {
-        return close();
+        return close_connections();
+    });
+}
+
+client_pool::client_pool(client_factory factory, unsigned warm_connections)
+        : _factory(std::move(factory))
+        , _warm_connections(warm_connections)
+{
+}
+
+void client_pool::start_warm_up(const sstring& endpoint, client& c) {
+    if (!_warm_connections) {
+        return;
+    }
+    (void)with_gate(_warm_ups, [this, &c] {
+        return c.warm_up(_warm_connections);
+    }).handle_exception([endpoint] (std::exception_ptr ex) {
+        http_log.debug("failed to warm up connections to {}: {}", endpoint, ex);
     });
 }
 
+client& client_pool::get(const sstring& endpoint) {
+    auto [it, inserted] = _clients.try_emplace(endpoint);
+    if (inserted) {
+        try {
+            it->second = _factory(endpoint);
+        } catch (...) {
+            _clients.erase(it);
+            throw;
+        }
+        start_warm_up(endpoint, *it->second);
+    }
+    return *it->second;
+}
+
+future<> client_pool::make_request(const sstring& endpoint, request req, client::reply_handler handle, std::optional<reply::status_type> expected) {
+    return futurize_invoke([&] {
+        return get(endpoint).make_request(std::move(req), std::move(handle), expected);
+    });
+}
+
+future<> client_pool::warm_up() {
+    return parallel_for_each(_clients, [this] (auto& ep) {
+        return with_gate(_warm_ups, [this, &c = *ep.second] {
+            return c.warm_up(_warm_connections);
+        });
+    });
+}
+
+future<> client_pool::close() {
+    co_await _warm_ups.close();
+    for (auto& [endpoint, c] : _clients) {
+        co_await c->close();
+    }
+    _clients.clear();
+}
+
 } // experimental namespace
 } // http namespace
 } // seastar namespace
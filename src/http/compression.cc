@@ -0,0 +1,332 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+#ifdef SEASTAR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <fmt/core.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/http/compression.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/util/string_utils.hh>
+#endif
+
+namespace seastar {
+
+namespace http {
+
+namespace {
+
+enum class flush_mode { none, flush, finish };
+
+class compressor {
+public:
+    virtual ~compressor() = default;
+    // Appends what the compressor produced to out
+    virtual void compress(const char* data, size_t size, flush_mode mode, std::vector<temporary_buffer<char>>& out) = 0;
+};
+
+class zlib_compressor final : public compressor {
+    static constexpr size_t chunk_size = 16 * 1024;
+    z_stream _zs = {};
+public:
+    zlib_compressor(bool gzip, int level) {
+        level = level ? std::clamp(level, Z_BEST_SPEED, Z_BEST_COMPRESSION) : Z_DEFAULT_COMPRESSION;
+        // The window bits select the zlib (RFC 1950) or the gzip (RFC 1952) wrapper
+        auto ret = deflateInit2(&_zs, level, Z_DEFLATED, gzip ? MAX_WBITS + 16 : MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        if (ret == Z_MEM_ERROR) {
+            throw std::bad_alloc();
+        } else if (ret != Z_OK) {
+            throw std::runtime_error(fmt::format("deflateInit2 failed: {}", ret));
+        }
+    }
+    ~zlib_compressor() {
+        deflateEnd(&_zs);
+    }
+    void compress(const char* data, size_t size, flush_mode mode, std::vector<temporary_buffer<char>>& out) override {
+        int flush = mode == flush_mode::finish ? Z_FINISH : mode == flush_mode::flush ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        _zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _zs.avail_in = size;
+        for (;;) {
+            temporary_buffer<char> buf(chunk_size);
+            _zs.next_out = reinterpret_cast<Bytef*>(buf.get_write());
+            _zs.avail_out = buf.size();
+            auto ret = deflate(&_zs, flush);
+            if (ret == Z_STREAM_ERROR) {
+                throw std::runtime_error("deflate failed");
+            }
+            auto avail = _zs.avail_out;
+            if (avail < buf.size()) {
+                buf.trim(buf.size() - avail);
+                out.push_back(std::move(buf));
+            }
+            // Space left over means all the input was taken and, when
+            // flushing, all the output was produced
+            if (avail || ret == Z_BUF_ERROR || ret == Z_STREAM_END) {
+                break;
+            }
+        }
+    }
+};
+
+#ifdef SEASTAR_HAVE_ZSTD
+class zstd_compressor final : public compressor {
+    ZSTD_CCtx* _cctx;
+public:
+    explicit zstd_compressor(int level) : _cctx(ZSTD_createCCtx()) {
+        if (!_cctx) {
+            throw std::bad_alloc();
+        }
+        // 0 is the default level, out of range ones are clamped by the library
+        ZSTD_CCtx_setParameter(_cctx, ZSTD_c_compressionLevel, level);
+    }
+    ~zstd_compressor() {
+        ZSTD_freeCCtx(_cctx);
+    }
+    void compress(const char* data, size_t size, flush_mode mode, std::vector<temporary_buffer<char>>& out) override {
+        auto directive = mode == flush_mode::finish ? ZSTD_e_end : mode == flush_mode::flush ? ZSTD_e_flush : ZSTD_e_continue;
+        ZSTD_inBuffer in = { data, size, 0 };
+        for (;;) {
+            temporary_buffer<char> buf(ZSTD_CStreamOutSize());
+            ZSTD_outBuffer o = { buf.get_write(), buf.size(), 0 };
+            auto remaining = ZSTD_compressStream2(_cctx, &o, &in, directive);
+            if (ZSTD_isError(remaining)) {
+                throw std::runtime_error(fmt::format("ZSTD_compressStream2 failed: {}", ZSTD_getErrorName(remaining)));
+            }
+            if (o.pos) {
+                buf.trim(o.pos);
+                out.push_back(std::move(buf));
+            }
+            if (directive == ZSTD_e_continue ? in.pos == in.size : !remaining) {
+                break;
+            }
+        }
+    }
+};
+#endif
+
+std::unique_ptr<compressor> make_compressor(content_encoding enc, int level) {
+    switch (enc) {
+    case content_encoding::gzip:
+        return std::make_unique<zlib_compressor>(true, level);
+    case content_encoding::deflate:
+        return std::make_unique<zlib_compressor>(false, level);
+    case content_encoding::zstd:
+#ifdef SEASTAR_HAVE_ZSTD
+        return std::make_unique<zstd_compressor>(level);
+#else
+        break;
+#endif
+    }
+    throw std::invalid_argument(fmt::format("Unsupported content encoding: {}", to_string(enc)));
+}
+
+class compressing_sink final : public data_sink_impl {
+    static constexpr size_t buffer_size_v = 32 * 1024;
+    output_stream<char> _out;
+    std::unique_ptr<compressor> _compressor;
+    scheduling_group _group;
+private:
+    future<> process(const char* data, size_t size, flush_mode mode) {
+        std::vector<temporary_buffer<char>> produced;
+        co_await with_scheduling_group(_group, [&] {
+            _compressor->compress(data, size, mode, produced);
+        });
+        for (auto& buf : produced) {
+            co_await _out.write(std::move(buf));
+        }
+    }
+public:
+    compressing_sink(output_stream<char>&& out, std::unique_ptr<compressor> c, scheduling_group group)
+        : _out(std::move(out)), _compressor(std::move(c)), _group(group)
+    {}
+    virtual future<> put(net::packet p) override {
+        // A large fragment is compressed a chunk at a time, so that it
+        // doesn't stall the reactor
+        for (auto& f : p.fragments()) {
+            for (size_t off = 0; off < f.size; off += buffer_size_v) {
+                co_await process(f.base + off, std::min(buffer_size_v, f.size - off), flush_mode::none);
+                co_await coroutine::maybe_yield();
+            }
+        }
+    }
+    virtual future<> flush() override {
+        co_await process(nullptr, 0, flush_mode::flush);
+        co_await _out.flush();
+    }
+    virtual future<> close() override {
+        std::exception_ptr ex;
+        try {
+            co_await process(nullptr, 0, flush_mode::finish);
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await _out.close();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return buffer_size_v;
+    }
+};
+
+std::string_view trim(std::string_view s) {
+    auto b = s.find_first_not_of(" \t");
+    if (b == std::string_view::npos) {
+        return {};
+    }
+    return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+}
+
+}
+
+bool content_encoding_supported(content_encoding enc) noexcept {
+#ifndef SEASTAR_HAVE_ZSTD
+    if (enc == content_encoding::zstd) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+std::string_view to_string(content_encoding enc) noexcept {
+    switch (enc) {
+    case content_encoding::gzip: return "gzip";
+    case content_encoding::deflate: return "deflate";
+    case content_encoding::zstd: return "zstd";
+    }
+    return "identity";
+}
+
+output_stream<char> make_compressing_output_stream(output_stream<char>&& out, content_encoding enc, int level, scheduling_group group) {
+    return output_stream<char>(data_sink(std::make_unique<compressing_sink>(std::move(out), make_compressor(enc, level), group)));
+}
+
+namespace internal {
+
+std::optional<content_encoding> negotiate_content_encoding(std::string_view accept_encoding, const std::vector<content_encoding>& encodings) {
+    seastar::internal::case_insensitive_cmp eq;
+    // RFC 9110, section 12.5.3. Codings not mentioned are not acceptable,
+    // unless "*" is.
+    auto qvalue = [&] (std::string_view name) {
+        std::optional<float> wildcard;
+        std::string_view rest = accept_encoding;
+        while (!rest.empty()) {
+            auto comma = rest.find(',');
+            auto item = rest.substr(0, comma);
+            rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+            auto semi = item.find(';');
+            auto coding = trim(item.substr(0, semi));
+            float q = 1;
+            if (semi != std::string_view::npos) {
+                auto param = trim(item.substr(semi + 1));
+                if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                    q = strtof(sstring(param.substr(2)).c_str(), nullptr);
+                }
+            }
+            if (eq(sstring(coding), sstring(name)) || (name == "gzip" && eq(sstring(coding), "x-gzip"))) {
+                return q;
+            }
+            if (coding == "*") {
+                wildcard = q;
+            }
+        }
+        return wildcard.value_or(0);
+    };
+    std::optional<content_encoding> best;
+    float best_q = 0;
+    for (auto enc : encodings) {
+        if (!content_encoding_supported(enc)) {
+            continue;
+        }
+        // Ties go to the encoding preferred by the server
+        auto q = qvalue(to_string(enc));
+        if (q > best_q) {
+            best = enc;
+            best_q = q;
+        }
+    }
+    return best;
+}
+
+void compress_reply(reply& rep, std::string_view method, std::string_view accept_encoding, const compression_config& cfg) {
+    auto status = static_cast<int>(rep._status);
+    if (method == "HEAD" || status < 200 || status == 204 || status == 206 || status == 304 || rep._headers.contains("Content-Encoding") || rep._prerendered) {
+        return;
+    }
+    if (!rep._body_writer && rep._content.size() < cfg.min_size) {
+        return;
+    }
+    // Caches must keep the compressed and plain variants apart
+    auto& vary = rep._headers["Vary"];
+    if (vary.empty()) {
+        vary = "Accept-Encoding";
+    } else if (vary.find("Accept-Encoding") == sstring::npos) {
+        vary += ", Accept-Encoding";
+    }
+    auto enc = negotiate_content_encoding(accept_encoding, cfg.encodings);
+    if (!enc) {
+        return;
+    }
+
+    rep._headers["Content-Encoding"] = sstring(to_string(*enc));
+    rep._headers.erase("Content-Length");
+    auto writer = std::move(rep._body_writer);
+    // The file can't be sent as it is anymore
+    rep._file_region.reset();
+    if (!writer) {
+        writer = [content = std::exchange(rep._content, {})] (output_stream<char>&& out) mutable {
+            return do_with(std::move(out), std::move(content), [] (output_stream<char>& out, sstring& content) {
+                return out.write(content).finally([&out] {
+                    return out.close();
+                });
+            });
+        };
+    }
+    rep._body_writer = [writer = std::move(writer), enc = *enc, level = cfg.level, group = cfg.group] (output_stream<char>&& out) mutable {
+        return writer(make_compressing_output_stream(std::move(out), enc, level, group));
+    };
+}
+
+}
+
+}
+
+}
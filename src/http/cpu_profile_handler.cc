@@ -0,0 +1,188 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/http/cpu_profile_handler.hh>
+#include "proto/profile.pb.h"
+
+#include <seastar/core/cpu_profiler.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/exception.hh>
+#include <boost/range/irange.hpp>
+#include <fmt/format.h>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+namespace seastar {
+
+namespace httpd {
+
+namespace pb = seastar::pprof;
+
+namespace {
+
+struct shard_profile {
+    unsigned shard;
+    std::chrono::nanoseconds period;
+    std::vector<cpu_profile_stack> stacks;
+};
+
+sstring folded_profile(const std::vector<shard_profile>& profiles) {
+    fmt::memory_buffer out;
+    auto it = std::back_inserter(out);
+    for (auto& p : profiles) {
+        for (auto& s : p.stacks) {
+            it = fmt::format_to(it, "{}", s.group.name());
+            auto& frames = s.backtrace.frames();
+            // Frames are printed as in backtraces, for seastar-addr2line
+            for (auto f = frames.rbegin(); f != frames.rend(); ++f) {
+                if (f->so->name.empty()) {
+                    it = fmt::format_to(it, ";0x{:x}", f->addr);
+                } else {
+                    it = fmt::format_to(it, ";{}+0x{:x}", f->so->name, f->addr);
+                }
+            }
+            it = fmt::format_to(it, " {}\n", s.samples);
+        }
+    }
+    return sstring(out.data(), out.size());
+}
+
+class pprof_builder {
+    pb::Profile _profile;
+    std::unordered_map<std::string, int64_t> _strings;
+    std::unordered_map<const shared_object*, uint64_t> _mappings;
+    std::unordered_map<uintptr_t, uint64_t> _locations;
+
+    int64_t string_id(std::string_view s) {
+        auto [it, inserted] = _strings.emplace(std::string(s), _strings.size());
+        if (inserted) {
+            _profile.add_string_table(it->first);
+        }
+        return it->second;
+    }
+    void add_value_type(pb::ValueType* vt, std::string_view type, std::string_view unit) {
+        vt->set_type(string_id(type));
+        vt->set_unit(string_id(unit));
+    }
+    uint64_t mapping_id(const shared_object* so) {
+        auto [it, inserted] = _mappings.emplace(so, _mappings.size() + 1);
+        if (inserted) {
+            auto m = _profile.add_mapping();
+            m->set_id(it->second);
+            m->set_memory_start(so->begin);
+            m->set_memory_limit(so->end);
+            // The executable has no name
+            std::error_code ec;
+            auto name = so->name.empty() ? std::filesystem::read_symlink("/proc/self/exe", ec).string() : std::string(so->name);
+            m->set_filename(string_id(name));
+        }
+        return it->second;
+    }
+    uint64_t location_id(const frame& f) {
+        auto address = f.so->begin + f.addr;
+        auto [it, inserted] = _locations.emplace(address, _locations.size() + 1);
+        if (inserted) {
+            auto l = _profile.add_location();
+            l->set_id(it->second);
+            l->set_mapping_id(mapping_id(f.so));
+            l->set_address(address);
+        }
+        return it->second;
+    }
+public:
+    pprof_builder() {
+        string_id("");
+        add_value_type(_profile.add_sample_type(), "samples", "count");
+        add_value_type(_profile.add_sample_type(), "cpu", "nanoseconds");
+        _profile.set_time_nanos(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+    void add(const shard_profile& p) {
+        if (p.period.count() && !_profile.period()) {
+            add_value_type(_profile.mutable_period_type(), "cpu", "nanoseconds");
+            _profile.set_period(p.period.count());
+        }
+        for (auto& s : p.stacks) {
+            auto sample = _profile.add_sample();
+            for (auto& f : s.backtrace.frames()) {
+                sample->add_location_id(location_id(f));
+            }
+            sample->add_value(s.samples);
+            sample->add_value(s.samples * p.period.count());
+            auto group = sample->add_label();
+            group->set_key(string_id("scheduling_group"));
+            group->set_str(string_id(s.group.name()));
+            auto shard = sample->add_label();
+            shard->set_key(string_id("shard"));
+            shard->set_num(p.shard);
+        }
+    }
+    std::string serialize() const {
+        return _profile.SerializeAsString();
+    }
+};
+
+}
+
+future<std::unique_ptr<http::reply>> cpu_profile_handler::handle(const sstring& path,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+    bool folded = req->get_query_param("format") == "folded";
+    std::vector<unsigned> shards;
+    if (auto shard = req->get_query_param("shard"); !shard.empty()) {
+        unsigned id;
+        try {
+            id = std::stoul(shard);
+        } catch (...) {
+            throw bad_param_exception(fmt::format("Invalid shard {}", shard));
+        }
+        if (id >= smp::count) {
+            throw bad_param_exception(fmt::format("Invalid shard {}", shard));
+        }
+        shards.push_back(id);
+    } else {
+        shards.assign(smp::all_cpus().begin(), smp::all_cpus().end());
+    }
+    std::vector<shard_profile> profiles(shards.size());
+    co_await parallel_for_each(boost::irange<size_t>(0, shards.size()), [&] (size_t i) {
+        return smp::submit_to(shards[i], [] {
+            return shard_profile{this_shard_id(), cpu_profiler::local_period(), cpu_profiler::local_profile()};
+        }).then([&profiles, i] (shard_profile p) {
+            profiles[i] = std::move(p);
+        });
+    });
+    if (folded) {
+        rep->write_body("txt", folded_profile(profiles));
+    } else {
+        pprof_builder builder;
+        for (auto& p : profiles) {
+            builder.add(p);
+        }
+        auto body = builder.serialize();
+        rep->write_body("bin", sstring(body.data(), body.size()));
+    }
+    co_return std::move(rep);
+}
+
+}
+
+}
@@ -24,8 +24,11 @@ module;
 #endif
 
 #include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <string_view>
 
 #ifdef SEASTAR_MODULE
 module seastar;
@@ -36,13 +39,68 @@ module seastar;
 #include <seastar/core/fstream.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/app-template.hh>
+#include <seastar/core/coroutine.hh>
 #include <seastar/http/exception.hh>
+#include <seastar/util/string_utils.hh>
 #endif
 
 namespace seastar {
 
 namespace httpd {
 
+namespace {
+
+struct byte_range {
+    bool satisfiable;
+    uint64_t first;
+    uint64_t last;
+};
+
+std::optional<uint64_t> parse_position(std::string_view s) {
+    uint64_t v;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (s.empty() || ec != std::errc() || end != s.data() + s.size()) {
+        return std::nullopt;
+    }
+    return v;
+}
+
+// RFC 9110, section 14.1.2. Only a single range is supported, requests for
+// several of them are answered with the whole file, as is an invalid Range.
+std::optional<byte_range> parse_range(std::string_view header, uint64_t size) {
+    constexpr std::string_view unit = "bytes=";
+    if (header.size() <= unit.size() || !seastar::internal::case_insensitive_cmp()(sstring(header.substr(0, unit.size())), sstring(unit))) {
+        return std::nullopt;
+    }
+    auto spec = header.substr(unit.size());
+    auto dash = spec.find('-');
+    if (spec.find(',') != std::string_view::npos || dash == std::string_view::npos) {
+        return std::nullopt;
+    }
+    if (dash == 0) {
+        // The last n bytes
+        auto n = parse_position(spec.substr(1));
+        if (!n) {
+            return std::nullopt;
+        }
+        if (*n == 0 || size == 0) {
+            return byte_range{false, 0, 0};
+        }
+        return byte_range{true, size - std::min(*n, size), size - 1};
+    }
+    auto first = parse_position(spec.substr(0, dash));
+    auto last = dash + 1 < spec.size() ? parse_position(spec.substr(dash + 1)) : std::optional<uint64_t>(size - 1);
+    if (!first || !last || *last < *first) {
+        return std::nullopt;
+    }
+    if (*first >= size) {
+        return byte_range{false, 0, 0};
+    }
+    return byte_range{true, *first, std::min(*last, size - 1)};
+}
+
+}
+
 directory_handler::directory_handler(const sstring& doc_root,
         file_transformer* transformer)
         : file_interaction_handler(transformer), doc_root(doc_root) {
@@ -97,6 +155,9 @@ future<std::unique_ptr<http::reply>> file_interaction_handler::read(
         sstring file_name, std::unique_ptr<http::request> req,
         std::unique_ptr<http::reply> rep) {
     sstring extension = get_extension(file_name);
+    if (!transformer) {
+        return read_region(std::move(file_name), std::move(extension), std::move(req), std::move(rep));
+    }
     rep->write_body(extension, [req = std::move(req), extension, file_name, this] (output_stream<char>&& s) mutable {
         return do_with(get_stream(std::move(req), extension, std::move(s)),
                 [file_name] (output_stream<char>& os) {
@@ -114,6 +175,38 @@ future<std::unique_ptr<http::reply>> file_interaction_handler::read(
     return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
 }
 
+future<std::unique_ptr<http::reply>> file_interaction_handler::read_region(
+        sstring file_name, sstring extension, std::unique_ptr<http::request> req,
+        std::unique_ptr<http::reply> rep) {
+    auto f = co_await open_file_dma(file_name, open_flags::ro);
+    uint64_t size = co_await f.size().handle_exception([f] (std::exception_ptr ex) mutable {
+        return f.close().then([ex = std::move(ex)] {
+            return make_exception_future<uint64_t>(std::move(ex));
+        });
+    });
+    uint64_t offset = 0;
+    uint64_t length = size;
+    rep->add_header("Accept-Ranges", "bytes");
+    // Without validators of our own, a conditional range can't be trusted
+    auto range_header = req->get_header("Range");
+    if (!range_header.empty() && req->get_header("If-Range").empty()) {
+        if (auto range = parse_range(range_header, size)) {
+            if (!range->satisfiable) {
+                co_await f.close();
+                rep->add_header("Content-Range", format("bytes */{}", size));
+                rep->set_status(http::reply::status_type::range_not_satisfiable).done();
+                co_return std::move(rep);
+            }
+            offset = range->first;
+            length = range->last - range->first + 1;
+            rep->add_header("Content-Range", format("bytes {}-{}/{}", range->first, range->last, size));
+            rep->set_status(http::reply::status_type::partial_content);
+        }
+    }
+    rep->write_body(extension, std::move(f), offset, length);
+    co_return std::move(rep);
+}
+
 bool file_interaction_handler::redirect_if_needed(const http::request& req,
         http::reply& rep) const {
     if (req._url.length() == 0 || req._url.back() != '/') {
@@ -0,0 +1,465 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/http/internal/hpack.hh>
+#endif
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+namespace {
+
+struct static_entry {
+    std::string_view name;
+    std::string_view value;
+};
+
+// RFC 7541 Appendix A, entries are 1-based
+constexpr std::array<static_entry, 61> static_table = {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+struct huffman_code {
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541 Appendix B, indexed by symbol
+constexpr std::array<huffman_code, 256> huffman_codes = {{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+}};
+
+constexpr huffman_code huffman_eos = {0x3fffffff, 30};
+
+// Decoding tree of the Huffman code. Children are node indexes when
+// positive, and -(symbol + 1) for leaves.
+class huffman_tree {
+    std::vector<std::array<int16_t, 2>> _nodes;
+    void add(unsigned sym, huffman_code c) {
+        size_t node = 0;
+        for (int bit = c.bits - 1; bit >= 0; bit--) {
+            auto b = (c.code >> bit) & 1;
+            if (bit == 0) {
+                _nodes[node][b] = -int16_t(sym + 1);
+            } else {
+                if (_nodes[node][b] == 0) {
+                    _nodes[node][b] = _nodes.size();
+                    _nodes.push_back({0, 0});
+                }
+                node = _nodes[node][b];
+            }
+        }
+    }
+public:
+    static constexpr unsigned eos = 256;
+
+    huffman_tree() {
+        _nodes.reserve(512);
+        _nodes.push_back({0, 0});
+        for (unsigned sym = 0; sym < huffman_codes.size(); sym++) {
+            add(sym, huffman_codes[sym]);
+        }
+        add(eos, huffman_eos);
+    }
+    int16_t child(size_t node, unsigned bit) const noexcept {
+        return _nodes[node][bit];
+    }
+};
+
+uint64_t decode_int(std::string_view& in, unsigned prefix_bits) {
+    if (in.empty()) {
+        throw hpack_error("truncated integer");
+    }
+    const uint64_t max_prefix = (1u << prefix_bits) - 1;
+    uint64_t v = uint8_t(in[0]) & max_prefix;
+    in.remove_prefix(1);
+    if (v < max_prefix) {
+        return v;
+    }
+    for (unsigned shift = 0; ; shift += 7) {
+        if (in.empty()) {
+            throw hpack_error("truncated integer");
+        }
+        // Nothing a header block encodes gets anywhere near 2^32
+        if (shift > 28) {
+            throw hpack_error("integer overflow");
+        }
+        uint8_t b = in[0];
+        in.remove_prefix(1);
+        v += uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return v;
+        }
+    }
+}
+
+void encode_int(std::string& out, uint8_t first, unsigned prefix_bits, uint64_t v) {
+    const uint64_t max_prefix = (1u << prefix_bits) - 1;
+    if (v < max_prefix) {
+        out.push_back(char(first | v));
+        return;
+    }
+    out.push_back(char(first | max_prefix));
+    v -= max_prefix;
+    while (v >= 0x80) {
+        out.push_back(char(0x80 | (v & 0x7f)));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+sstring decode_string(std::string_view& in) {
+    if (in.empty()) {
+        throw hpack_error("truncated string");
+    }
+    bool huffman = in[0] & 0x80;
+    auto len = decode_int(in, 7);
+    if (len > in.size()) {
+        throw hpack_error("truncated string");
+    }
+    auto s = in.substr(0, len);
+    in.remove_prefix(len);
+    return huffman ? huffman_decode(s) : sstring(s.data(), s.size());
+}
+
+void encode_string(std::string& out, std::string_view s) {
+    size_t bits = 0;
+    for (unsigned char c : s) {
+        bits += huffman_codes[c].bits;
+    }
+    if ((bits + 7) / 8 < s.size()) {
+        encode_int(out, 0x80, 7, (bits + 7) / 8);
+        out += huffman_encode(s);
+    } else {
+        encode_int(out, 0, 7, s.size());
+        out += s;
+    }
+}
+
+size_t entry_size(const hpack_decoder::header& h) noexcept {
+    return 32 + h.first.size() + h.second.size();
+}
+
+}
+
+std::string huffman_encode(std::string_view s) {
+    std::string out;
+    uint64_t acc = 0;
+    unsigned bits = 0;
+    for (unsigned char c : s) {
+        auto code = huffman_codes[c];
+        acc = (acc << code.bits) | code.code;
+        bits += code.bits;
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back(char(acc >> bits));
+        }
+        acc &= (uint64_t(1) << bits) - 1;
+    }
+    if (bits) {
+        // Padded with the most significant bits of EOS
+        out.push_back(char((acc << (8 - bits)) | ((1u << (8 - bits)) - 1)));
+    }
+    return out;
+}
+
+sstring huffman_decode(std::string_view s) {
+    static const huffman_tree tree;
+    std::string out;
+    out.reserve(s.size() * 8 / 5);
+    size_t node = 0;
+    // Bits since the last symbol, and whether they were all ones, as
+    // padding must be
+    unsigned pending = 0;
+    bool ones = true;
+    for (unsigned char byte : s) {
+        for (int bit = 7; bit >= 0; bit--) {
+            unsigned b = (byte >> bit) & 1;
+            auto next = tree.child(node, b);
+            if (next < 0) {
+                unsigned sym = -next - 1;
+                if (sym == huffman_tree::eos) {
+                    throw hpack_error("EOS in Huffman encoded string");
+                }
+                out.push_back(char(sym));
+                node = 0;
+                pending = 0;
+                ones = true;
+            } else {
+                node = next;
+                pending++;
+                ones = ones && b;
+            }
+        }
+    }
+    if (pending > 7 || !ones) {
+        throw hpack_error("invalid Huffman padding");
+    }
+    return sstring(out.data(), out.size());
+}
+
+const hpack_decoder::header& hpack_decoder::lookup(uint64_t index) const {
+    static const auto statics = [] {
+        std::vector<header> h;
+        for (auto& e : static_table) {
+            h.emplace_back(sstring(e.name), sstring(e.value));
+        }
+        return h;
+    }();
+    if (index == 0) {
+        throw hpack_error("header index 0");
+    }
+    if (index <= statics.size()) {
+        return statics[index - 1];
+    }
+    index -= statics.size() + 1;
+    if (index >= _table.size()) {
+        throw hpack_error("header index out of range");
+    }
+    return _table[index];
+}
+
+void hpack_decoder::evict(size_t max_size) {
+    while (_table_size > max_size) {
+        _table_size -= entry_size(_table.back());
+        _table.pop_back();
+    }
+}
+
+void hpack_decoder::insert(header h) {
+    auto size = entry_size(h);
+    if (size > _max_table_size) {
+        // Not an error, the table just ends up empty
+        evict(0);
+        return;
+    }
+    evict(_max_table_size - size);
+    _table_size += size;
+    _table.push_front(std::move(h));
+}
+
+std::vector<hpack_decoder::header> hpack_decoder::decode(std::string_view in, size_t max_list_size) {
+    std::vector<header> headers;
+    size_t list_size = 0;
+    bool too_large = false;
+    auto literal = [&] (unsigned prefix_bits) {
+        auto index = decode_int(in, prefix_bits);
+        sstring name = index ? lookup(index).first : decode_string(in);
+        return header(std::move(name), decode_string(in));
+    };
+    auto append = [&] (const header& h) {
+        list_size += entry_size(h);
+        too_large |= list_size > max_list_size;
+        if (!too_large) {
+            headers.push_back(h);
+        }
+    };
+    while (!in.empty()) {
+        uint8_t b = in[0];
+        if (b & 0x80) {
+            append(lookup(decode_int(in, 7)));
+        } else if (b & 0x40) {
+            auto h = literal(6);
+            append(h);
+            insert(std::move(h));
+        } else if (b & 0x20) {
+            auto size = decode_int(in, 5);
+            if (size > _table_size_limit) {
+                throw hpack_error("table size update exceeds the limit");
+            }
+            _max_table_size = size;
+            evict(size);
+        } else {
+            // Without indexing, or never indexed
+            append(literal(4));
+        }
+    }
+    if (too_large) {
+        throw hpack_header_list_too_large(fmt::format("header list larger than {} bytes", max_list_size));
+    }
+    return headers;
+}
+
+void hpack_encode(std::string& block, std::string_view name, std::string_view value) {
+    size_t name_index = 0;
+    for (size_t i = 0; i < static_table.size(); i++) {
+        if (static_table[i].name == name) {
+            if (static_table[i].value == value) {
+                encode_int(block, 0x80, 7, i + 1);
+                return;
+            }
+            if (!name_index) {
+                name_index = i + 1;
+            }
+        }
+    }
+    // Literal without indexing
+    encode_int(block, 0, 4, name_index);
+    if (!name_index) {
+        encode_string(block, name);
+    }
+    encode_string(block, value);
+}
+
+}
+
+}
+
+}
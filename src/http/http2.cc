@@ -0,0 +1,712 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/print.hh>
+#include <seastar/net/packet-data-source.hh>
+#include <seastar/util/log.hh>
+#include "http/http2.hh"
+#include "http/http2_frame.hh"
+#endif
+
+namespace seastar {
+
+extern logger hlogger;
+
+namespace httpd {
+
+namespace internal {
+
+namespace {
+
+using namespace http::internal::http2;
+
+constexpr uint32_t max_concurrent_streams = 100;
+
+class stream_reset : public std::runtime_error {
+public:
+    stream_reset() : std::runtime_error("HTTP/2 stream reset") {}
+};
+
+// HTTP2-Settings is base64url encoded, without padding
+std::string base64url_decode(std::string_view in) {
+    std::string out;
+    uint32_t acc = 0;
+    unsigned bits = 0;
+    for (char c : in) {
+        int v;
+        if (c >= 'A' && c <= 'Z') {
+            v = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            v = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            v = c - '0' + 52;
+        } else if (c == '-') {
+            v = 62;
+        } else if (c == '_') {
+            v = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            throw connection_error(protocol_error, "invalid HTTP2-Settings");
+        }
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(char(acc >> bits));
+        }
+    }
+    return out;
+}
+
+}
+
+// Sends what a reply body writer produces as DATA frames
+class http2_connection::data_sink_impl final : public seastar::data_sink_impl {
+    http2_connection& _conn;
+    stream& _s;
+public:
+    data_sink_impl(http2_connection& conn, stream& s) noexcept : _conn(conn), _s(s) {}
+    virtual future<> put(net::packet p) override {
+        for (auto& f : p.fragments()) {
+            co_await _conn.write_data(_s, f.base, f.size, false);
+        }
+    }
+    virtual future<> close() override {
+        return _conn.write_data(_s, nullptr, 0, true);
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return _conn._max_frame_size;
+    }
+};
+
+http2_connection::http2_connection(connection& conn, http_server& server, input_stream<char>& in, output_stream<char>& out,
+        socket_address client_addr, socket_address server_addr, bool tls)
+    : _conn(conn)
+    , _server(server)
+    , _in(in)
+    , _out(out)
+    , _client_addr(std::move(client_addr))
+    , _server_addr(std::move(server_addr))
+    , _tls(tls)
+{}
+
+future<> http2_connection::process(std::unique_ptr<http::request> upgraded, bool preface_started) {
+    std::optional<uint32_t> error;
+    try {
+        if (upgraded) {
+            apply_settings(base64url_decode(upgraded->get_header("HTTP2-Settings")));
+        }
+        std::string settings;
+        append_setting(settings, settings_max_concurrent_streams, max_concurrent_streams);
+        append_setting(settings, settings_enable_push, 0);
+        append_setting(settings, settings_max_header_list_size, max_header_list_size);
+        co_await write_frame(frame_settings, 0, 0, settings);
+        if (upgraded) {
+            // The request was received in full, it can't have had a body
+            auto s = make_lw_shared<stream>();
+            s->id = 1;
+            s->send_window = _initial_window_size;
+            s->remote_closed = true;
+            upgraded->_version = "2.0";
+            s->req = std::move(upgraded);
+            _last_stream_id = 1;
+            _streams.emplace(1, s);
+            dispatch(std::move(s));
+        }
+        co_await read_preface(preface_started);
+        co_await read_frames();
+    } catch (const connection_error& e) {
+        hlogger.debug("HTTP/2 connection error: {}", e.what());
+        error = e.code();
+    } catch (...) {
+        hlogger.debug("HTTP/2 read exception encountered: {}", std::current_exception());
+    }
+    _closing = true;
+    _window_changed.broadcast();
+    if (error) {
+        try {
+            co_await write_goaway(*error);
+        } catch (...) {
+            // The connection is going away anyway
+        }
+    }
+    co_await _streams_gate.close();
+}
+
+future<> http2_connection::read_preface(bool started) {
+    auto expected = started ? client_preface.substr(client_preface.find("SM")) : client_preface;
+    auto buf = co_await _in.read_exactly(expected.size());
+    if (std::string_view(buf.get(), buf.size()) != expected) {
+        throw connection_error(protocol_error, "invalid client preface");
+    }
+}
+
+future<> http2_connection::read_frames() {
+    for (;;) {
+        auto header = co_await _in.read_exactly(frame_header_size);
+        if (header.size() < frame_header_size) {
+            co_return;
+        }
+        auto [length, type, flags, id] = read_frame_header(header.get());
+        // We never raise SETTINGS_MAX_FRAME_SIZE
+        if (length > default_max_frame_size) {
+            throw connection_error(frame_size_error, "frame too large");
+        }
+        auto payload = co_await _in.read_exactly(length);
+        if (payload.size() < length) {
+            co_return;
+        }
+        co_await handle_frame(type, flags, id, std::move(payload));
+    }
+}
+
+future<> http2_connection::handle_frame(uint8_t type, uint8_t flags, uint32_t id, temporary_buffer<char> payload) {
+    if (_continued_stream && (type != frame_continuation || id != _continued_stream)) {
+        throw connection_error(protocol_error, "expected CONTINUATION");
+    }
+    switch (type) {
+    case frame_data:
+        return handle_data(flags, id, std::move(payload));
+    case frame_headers:
+        return handle_headers(flags, id, std::move(payload));
+    case frame_priority:
+        // Streams are served as they come
+        if (!id) {
+            throw connection_error(protocol_error, "PRIORITY on stream 0");
+        }
+        return make_ready_future<>();
+    case frame_rst_stream:
+        if (!id || id > _last_stream_id) {
+            throw connection_error(protocol_error, "RST_STREAM on an idle stream");
+        }
+        if (payload.size() != 4) {
+            throw connection_error(frame_size_error, "invalid RST_STREAM");
+        }
+        reset_stream(id);
+        return make_ready_future<>();
+    case frame_settings:
+        return handle_settings(flags, id, std::move(payload));
+    case frame_push_promise:
+        throw connection_error(protocol_error, "PUSH_PROMISE from a client");
+    case frame_ping:
+        if (id) {
+            throw connection_error(protocol_error, "PING on a stream");
+        }
+        if (payload.size() != 8) {
+            throw connection_error(frame_size_error, "invalid PING");
+        }
+        if (flags & flag_ack) {
+            return make_ready_future<>();
+        }
+        return do_with(std::move(payload), [this] (temporary_buffer<char>& payload) {
+            return write_frame(frame_ping, flag_ack, 0, std::string_view(payload.get(), payload.size()));
+        });
+    case frame_goaway:
+        if (id) {
+            throw connection_error(protocol_error, "GOAWAY on a stream");
+        }
+        // Streams already started are still served
+        _goaway_received = true;
+        return make_ready_future<>();
+    case frame_window_update:
+        return handle_window_update(id, std::move(payload));
+    case frame_continuation:
+        if (!_continued_stream) {
+            throw connection_error(protocol_error, "unexpected CONTINUATION");
+        }
+        if (_header_block.size() + payload.size() > max_header_block_size) {
+            throw connection_error(enhance_your_calm, "header block too large");
+        }
+        _header_block.append(payload.get(), payload.size());
+        if (flags & flag_end_headers) {
+            _continued_stream = 0;
+            return handle_header_block(_continued_flags, id);
+        }
+        return make_ready_future<>();
+    default:
+        // Unknown frame types must be ignored
+        return make_ready_future<>();
+    }
+}
+
+future<> http2_connection::handle_data(uint8_t flags, uint32_t id, temporary_buffer<char> payload) {
+    if (!id) {
+        throw connection_error(protocol_error, "DATA on stream 0");
+    }
+    uint32_t length = payload.size();
+    strip_padding(flags, payload);
+    // Bodies are buffered before the request is dispatched anyway, so
+    // the windows are replenished as soon as data arrives
+    if (length) {
+        co_await write_window_update(0, length);
+    }
+    auto it = _streams.find(id);
+    if (it == _streams.end() || it->second->remote_closed) {
+        if (id > _last_stream_id) {
+            throw connection_error(protocol_error, "DATA on an idle stream");
+        }
+        co_return co_await write_rst_stream(id, stream_closed);
+    }
+    auto s = it->second;
+    if (!s->discard) {
+        s->body_size += payload.size();
+        if (s->body_size > _server.get_content_length_limit()) {
+            auto limit = _server.get_content_length_limit();
+            reply_early(s, http::reply::status_type::payload_too_large,
+                    format("Content length limit ({}) exceeded: {}", limit, s->body_size));
+        } else if (!payload.empty()) {
+            s->body.push_back(std::move(payload));
+        }
+    }
+    if (flags & flag_end_stream) {
+        s->remote_closed = true;
+        if (!s->discard) {
+            dispatch(std::move(s));
+        }
+    } else if (length && !s->discard) {
+        co_await write_window_update(id, length);
+    }
+}
+
+future<> http2_connection::handle_headers(uint8_t flags, uint32_t id, temporary_buffer<char> payload) {
+    if (!id || !(id & 1)) {
+        throw connection_error(protocol_error, "HEADERS on a server stream");
+    }
+    strip_padding(flags, payload);
+    if (flags & flag_priority) {
+        if (payload.size() < 5) {
+            throw connection_error(frame_size_error, "invalid HEADERS priority");
+        }
+        payload.trim_front(5);
+    }
+    _header_block.assign(payload.get(), payload.size());
+    if (flags & flag_end_headers) {
+        return handle_header_block(flags, id);
+    }
+    _continued_stream = id;
+    _continued_flags = flags;
+    return make_ready_future<>();
+}
+
+future<> http2_connection::handle_header_block(uint8_t flags, uint32_t id) {
+    std::vector<http::internal::hpack_decoder::header> headers;
+    bool too_large = false;
+    try {
+        headers = _decoder.decode(_header_block, max_header_list_size);
+    } catch (const http::internal::hpack_header_list_too_large&) {
+        too_large = true;
+    } catch (const http::internal::hpack_error& e) {
+        throw connection_error(compression_error, e.what());
+    }
+    _header_block.clear();
+
+    if (auto it = _streams.find(id); it != _streams.end()) {
+        auto s = it->second;
+        if (too_large) {
+            reset_stream(id);
+            co_return co_await write_rst_stream(id, enhance_your_calm);
+        }
+        if (s->remote_closed) {
+            co_return co_await write_rst_stream(id, stream_closed);
+        }
+        if (!(flags & flag_end_stream)) {
+            throw connection_error(protocol_error, "trailers without END_STREAM");
+        }
+        s->remote_closed = true;
+        if (!s->discard) {
+            for (auto& [name, value] : headers) {
+                s->req->trailing_headers[name] = value;
+            }
+            dispatch(std::move(s));
+        }
+        co_return;
+    }
+    if (id <= _last_stream_id) {
+        throw connection_error(stream_closed, "HEADERS on a closed stream");
+    }
+    _last_stream_id = id;
+    if (_goaway_received) {
+        co_return;
+    }
+    if (too_large) {
+        co_return co_await write_rst_stream(id, enhance_your_calm);
+    }
+    if (_streams.size() >= max_concurrent_streams) {
+        co_return co_await write_rst_stream(id, refused_stream);
+    }
+
+    auto req = std::make_unique<http::request>();
+    bool malformed = false;
+    for (auto& [name, value] : headers) {
+        if (!name.empty() && name[0] == ':') {
+            if (name == ":method") {
+                req->_method = value;
+            } else if (name == ":path") {
+                req->_url = value;
+            } else if (name == ":authority") {
+                req->_headers["Host"] = value;
+            } else if (name != ":scheme") {
+                malformed = true;
+            }
+            continue;
+        }
+        auto [h, inserted] = req->_headers.emplace(name, value);
+        if (!inserted) {
+            h->second += sstring(name == "cookie" ? "; " : ",") + value;
+        }
+    }
+    if (malformed || req->_method.empty() || req->_url.empty()) {
+        co_return co_await write_rst_stream(id, protocol_error);
+    }
+    req->_version = "2.0";
+    req->content_length = strtol(req->get_header("Content-Length").c_str(), nullptr, 10);
+
+    auto s = make_lw_shared<stream>();
+    s->id = id;
+    s->send_window = _initial_window_size;
+    s->req = std::move(req);
+    _streams.emplace(id, s);
+    if (s->req->content_length > _server.get_content_length_limit()) {
+        auto limit = _server.get_content_length_limit();
+        reply_early(s, http::reply::status_type::payload_too_large,
+                format("Content length limit ({}) exceeded: {}", limit, s->req->content_length));
+    }
+    if (flags & flag_end_stream) {
+        s->remote_closed = true;
+        if (!s->discard) {
+            dispatch(std::move(s));
+        }
+    }
+}
+
+future<> http2_connection::handle_settings(uint8_t flags, uint32_t id, temporary_buffer<char> payload) {
+    if (id) {
+        throw connection_error(protocol_error, "SETTINGS on a stream");
+    }
+    if (flags & flag_ack) {
+        if (!payload.empty()) {
+            throw connection_error(frame_size_error, "SETTINGS ACK with a payload");
+        }
+        return make_ready_future<>();
+    }
+    if (payload.size() % 6) {
+        throw connection_error(frame_size_error, "invalid SETTINGS");
+    }
+    apply_settings(std::string_view(payload.get(), payload.size()));
+    return write_frame(frame_settings, flag_ack, 0, {});
+}
+
+void http2_connection::apply_settings(std::string_view payload) {
+    for (size_t i = 0; i + 6 <= payload.size(); i += 6) {
+        auto id = read_be<uint16_t>(payload.data() + i);
+        auto value = read_be<uint32_t>(payload.data() + i + 2);
+        switch (id) {
+        case settings_enable_push:
+            if (value > 1) {
+                throw connection_error(protocol_error, "invalid SETTINGS_ENABLE_PUSH");
+            }
+            break;
+        case settings_initial_window_size: {
+            if (value > max_window_size) {
+                throw connection_error(flow_control_error, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+            auto delta = int64_t(value) - _initial_window_size;
+            for (auto& [_, s] : _streams) {
+                s->send_window += delta;
+            }
+            _initial_window_size = value;
+            _window_changed.broadcast();
+            break;
+        }
+        case settings_max_frame_size:
+            if (value < default_max_frame_size || value > 0xffffff) {
+                throw connection_error(protocol_error, "invalid SETTINGS_MAX_FRAME_SIZE");
+            }
+            _max_frame_size = value;
+            break;
+        default:
+            // The encoder doesn't use the dynamic table, so the header
+            // table size doesn't matter, nor do limits on pushes
+            break;
+        }
+    }
+}
+
+future<> http2_connection::handle_window_update(uint32_t id, temporary_buffer<char> payload) {
+    if (payload.size() != 4) {
+        throw connection_error(frame_size_error, "invalid WINDOW_UPDATE");
+    }
+    auto increment = read_be<uint32_t>(payload.get()) & 0x7fffffff;
+    if (!id) {
+        if (!increment) {
+            throw connection_error(protocol_error, "zero WINDOW_UPDATE");
+        }
+        _send_window += increment;
+        if (_send_window > max_window_size) {
+            throw connection_error(flow_control_error, "connection window overflow");
+        }
+    } else {
+        auto it = _streams.find(id);
+        if (it == _streams.end()) {
+            // Updates may race with the stream closing
+            return make_ready_future<>();
+        }
+        auto& s = *it->second;
+        s.send_window += increment;
+        if (!increment || s.send_window > max_window_size) {
+            reset_stream(id);
+            return write_rst_stream(id, increment ? flow_control_error : protocol_error);
+        }
+    }
+    _window_changed.broadcast();
+    return make_ready_future<>();
+}
+
+void http2_connection::reset_stream(uint32_t id) {
+    auto it = _streams.find(id);
+    if (it != _streams.end()) {
+        it->second->reset = true;
+        _streams.erase(it);
+        _window_changed.broadcast();
+    }
+}
+
+void http2_connection::dispatch(lw_shared_ptr<stream> s) {
+    net::packet body;
+    for (auto& buf : s->body) {
+        body = net::packet(std::move(body), std::move(buf));
+    }
+    s->body.clear();
+    auto& req = *s->req;
+    req.content_length = s->body_size;
+    if (_server.get_content_streaming()) {
+        s->content_stream = net::as_input_stream(std::move(body));
+    } else {
+        body.linearize();
+        if (body.len()) {
+            auto& f = body.frag(0);
+            req.content = sstring(f.base, f.size);
+        }
+        s->content_stream = net::as_input_stream(net::packet());
+    }
+    req.content_stream = &s->content_stream;
+    req._server_address = _server_addr;
+    req._client_address = _client_addr;
+    if (_tls) {
+        req.protocol_name = "https";
+    }
+    (void)with_gate(_streams_gate, [this, s = std::move(s)] () mutable {
+        return handle_stream(std::move(s), nullptr);
+    });
+}
+
+void http2_connection::reply_early(lw_shared_ptr<stream> s, http::reply::status_type status, sstring msg) {
+    s->discard = true;
+    s->body.clear();
+    auto rep = std::make_unique<http::reply>();
+    rep->set_version("2.0");
+    rep->set_status(status, std::move(msg));
+    _conn.set_headers(*rep);
+    rep->done();
+    (void)with_gate(_streams_gate, [this, s = std::move(s), rep = std::move(rep)] () mutable {
+        return handle_stream(std::move(s), std::move(rep));
+    });
+}
+
+future<> http2_connection::handle_stream(lw_shared_ptr<stream> s, std::unique_ptr<http::reply> rep) {
+    ++_server._requests_served;
+    try {
+        if (!rep) {
+            auto resp = std::make_unique<http::reply>();
+            resp->set_version("2.0");
+            _conn.set_headers(*resp);
+            sstring url = s->req->parse_query_param();
+            sstring method = s->req->_method;
+            sstring accept_encoding = s->req->get_header("Accept-Encoding");
+            rep = co_await _server._routes.handle(url, std::move(s->req), std::move(resp));
+            rep->set_version("2.0").done();
+            if (_server._compression) {
+                http::internal::compress_reply(*rep, method, accept_encoding, *_server._compression);
+            }
+        }
+        co_await write_reply(*s, *rep);
+    } catch (...) {
+        if (!s->reset && !_closing) {
+            _server._respond_errors++;
+            hlogger.debug("HTTP/2 response exception encountered: {}", std::current_exception());
+            reset_stream(s->id);
+            (void)write_rst_stream(s->id, internal_error).handle_exception([] (std::exception_ptr) {});
+        }
+    }
+    if (auto it = _streams.find(s->id); it != _streams.end() && it->second == s) {
+        _streams.erase(it);
+    }
+}
+
+future<> http2_connection::write_reply(stream& s, http::reply& rep) {
+    std::string block;
+    http::internal::hpack_encode(block, ":status", std::to_string(int(rep._status)));
+    auto add_header = [&] (std::string_view name, std::string_view value) {
+        // Header names are lowercase in HTTP/2
+        std::string lname(name.size(), '\0');
+        std::transform(name.begin(), name.end(), lname.begin(), [] (unsigned char c) { return std::tolower(c); });
+        // Like over HTTP/1, the length of a whole body is ours to set
+        if (is_connection_specific(lname) || (lname == "content-length" && !rep._body_writer)) {
+            return;
+        }
+        http::internal::hpack_encode(block, lname, value);
+    };
+    for (auto& [name, value] : rep._headers) {
+        add_header(name, value);
+    }
+    std::string_view content = rep._content;
+    if (rep._prerendered) {
+        std::string_view lines(rep._prerendered->headers.get(), rep._prerendered->headers.size());
+        while (!lines.empty()) {
+            auto line = lines.substr(0, lines.find("\r\n"));
+            lines.remove_prefix(std::min(lines.size(), line.size() + 2));
+            auto colon = line.find(':');
+            if (colon != std::string_view::npos) {
+                auto value = line.substr(colon + 1);
+                value.remove_prefix(std::min(value.size(), value.find_first_not_of(' ')));
+                add_header(line.substr(0, colon), value);
+            }
+        }
+        content = std::string_view(rep._prerendered->body.get(), rep._prerendered->body.size());
+    }
+    if (!rep._body_writer) {
+        http::internal::hpack_encode(block, "content-length", std::to_string(content.size()));
+    }
+    bool has_body = rep._body_writer || !content.empty();
+
+    std::vector<std::string> frames;
+    std::string_view rest = block;
+    uint8_t type = frame_headers;
+    uint8_t flags = has_body ? 0 : flag_end_stream;
+    do {
+        auto fragment = rest.substr(0, _max_frame_size);
+        rest.remove_prefix(fragment.size());
+        frames.push_back(make_frame(type, flags | (rest.empty() ? flag_end_headers : 0), s.id, fragment));
+        type = frame_continuation;
+        flags = 0;
+    } while (!rest.empty());
+    if (s.reset) {
+        throw stream_reset();
+    }
+    co_await write_frames(std::move(frames));
+
+    if (rep._body_writer) {
+        co_await rep._body_writer(output_stream<char>(data_sink(std::make_unique<data_sink_impl>(*this, s))));
+    } else if (has_body) {
+        co_await write_data(s, content.data(), content.size(), true);
+    }
+}
+
+future<> http2_connection::write_data(stream& s, const char* data, size_t size, bool end_stream) {
+    if (!size && !end_stream) {
+        co_return;
+    }
+    do {
+        co_await _window_changed.wait([&] {
+            return _closing || s.reset || !size || std::min(_send_window, s.send_window) > 0;
+        });
+        if (_closing || s.reset) {
+            throw stream_reset();
+        }
+        size_t chunk = size ? std::min<int64_t>({int64_t(size), int64_t(_max_frame_size), _send_window, s.send_window}) : 0;
+        _send_window -= chunk;
+        s.send_window -= chunk;
+        bool last = end_stream && chunk == size;
+        co_await write_frame(frame_data, last ? flag_end_stream : 0, s.id, std::string_view(data, chunk));
+        data += chunk;
+        size -= chunk;
+    } while (size);
+}
+
+future<> http2_connection::write_frame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload) {
+    auto units = co_await get_units(_write_sem, 1);
+    char header[frame_header_size];
+    write_frame_header(header, payload.size(), type, flags, id);
+    co_await _out.write(header, sizeof(header));
+    if (!payload.empty()) {
+        co_await _out.write(payload.data(), payload.size());
+    }
+    // Whoever writes last flushes for all
+    if (!_write_sem.waiters()) {
+        co_await _out.flush();
+    }
+}
+
+future<> http2_connection::write_frames(std::vector<std::string> frames) {
+    auto units = co_await get_units(_write_sem, 1);
+    for (auto& frame : frames) {
+        co_await _out.write(frame.data(), frame.size());
+    }
+    if (!_write_sem.waiters()) {
+        co_await _out.flush();
+    }
+}
+
+future<> http2_connection::write_rst_stream(uint32_t id, uint32_t error) {
+    char payload[4];
+    write_be<uint32_t>(payload, error);
+    co_await write_frame(frame_rst_stream, 0, id, std::string_view(payload, sizeof(payload)));
+}
+
+future<> http2_connection::write_goaway(uint32_t error) {
+    char payload[8];
+    write_be<uint32_t>(payload, _last_stream_id);
+    write_be<uint32_t>(payload + 4, error);
+    co_await write_frame(frame_goaway, 0, 0, std::string_view(payload, sizeof(payload)));
+}
+
+future<> http2_connection::write_window_update(uint32_t id, uint32_t increment) {
+    char payload[4];
+    write_be<uint32_t>(payload, increment);
+    co_await write_frame(frame_window_update, 0, id, std::string_view(payload, sizeof(payload)));
+}
+
+}
+
+}
+
+}
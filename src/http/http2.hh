@@ -0,0 +1,141 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#endif
+
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/http/internal/hpack.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/http/request.hh>
+
+namespace seastar {
+
+namespace httpd {
+
+namespace internal {
+
+// Serves an HTTP/2 (RFC 9113) connection, once the HTTP/1 connection it
+// started as found the client speaks it: by prior knowledge, by upgrading
+// from HTTP/1.1 (h2c) or by TLS ALPN (h2).
+//
+// Streams are dispatched to the server routes like HTTP/1 requests, each
+// in its own fiber, once their request body has been fully received.
+class http2_connection {
+    struct stream {
+        uint32_t id;
+        std::unique_ptr<http::request> req;
+        std::vector<temporary_buffer<char>> body;
+        size_t body_size = 0;
+        input_stream<char> content_stream;
+        int64_t send_window;
+        // END_STREAM was received
+        bool remote_closed = false;
+        // Neither side may send anymore
+        bool reset = false;
+        // Rejected, DATA still in flight is dropped
+        bool discard = false;
+    };
+    class data_sink_impl;
+
+    connection& _conn;
+    http_server& _server;
+    input_stream<char>& _in;
+    output_stream<char>& _out;
+    socket_address _client_addr;
+    socket_address _server_addr;
+    bool _tls;
+
+    http::internal::hpack_decoder _decoder;
+    std::unordered_map<uint32_t, lw_shared_ptr<stream>> _streams;
+    uint32_t _last_stream_id = 0;
+    // Stream of the header block being received, while it continues
+    // in CONTINUATION frames
+    uint32_t _continued_stream = 0;
+    uint8_t _continued_flags = 0;
+    std::string _header_block;
+
+    // Peer settings
+    uint32_t _max_frame_size = 16384;
+    int64_t _initial_window_size = 65535;
+    int64_t _send_window = 65535;
+    condition_variable _window_changed;
+
+    semaphore _write_sem{1};
+    gate _streams_gate;
+    // No new streams are accepted
+    bool _goaway_received = false;
+    // Stop sending, the connection is going away
+    bool _closing = false;
+private:
+    future<> read_preface(bool started);
+    future<> read_frames();
+    future<> handle_frame(uint8_t type, uint8_t flags, uint32_t id, temporary_buffer<char> payload);
+    future<> handle_data(uint8_t flags, uint32_t id, temporary_buffer<char> payload);
+    future<> handle_headers(uint8_t flags, uint32_t id, temporary_buffer<char> payload);
+    future<> handle_header_block(uint8_t flags, uint32_t id);
+    future<> handle_settings(uint8_t flags, uint32_t id, temporary_buffer<char> payload);
+    future<> handle_window_update(uint32_t id, temporary_buffer<char> payload);
+    void apply_settings(std::string_view payload);
+    void reset_stream(uint32_t id);
+    void dispatch(lw_shared_ptr<stream> s);
+    void reply_early(lw_shared_ptr<stream> s, http::reply::status_type status, sstring msg);
+    // Replies with rep, or with what the routes make of the request
+    future<> handle_stream(lw_shared_ptr<stream> s, std::unique_ptr<http::reply> rep);
+    future<> write_reply(stream& s, http::reply& rep);
+    future<> write_data(stream& s, const char* data, size_t size, bool end_stream);
+    future<> write_frame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload);
+    // Writes already framed frames back to back
+    future<> write_frames(std::vector<std::string> frames);
+    future<> write_rst_stream(uint32_t id, uint32_t error);
+    future<> write_goaway(uint32_t error);
+    future<> write_window_update(uint32_t id, uint32_t increment);
+public:
+    http2_connection(connection& conn, http_server& server, input_stream<char>& in, output_stream<char>& out,
+            socket_address client_addr, socket_address server_addr, bool tls);
+    // Serves the connection until the client closes it or goes away.
+    //
+    // \param upgraded The HTTP/1.1 request that upgraded the connection,
+    //        served as stream 1
+    // \param preface_started Whether the first line of the client preface
+    //        was already consumed as an HTTP/1 request line
+    future<> process(std::unique_ptr<http::request> upgraded, bool preface_started);
+};
+
+}
+
+}
+
+}
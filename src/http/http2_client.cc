@@ -0,0 +1,811 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/print.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/http/client.hh>
+#include <seastar/http/internal/hpack.hh>
+#include <seastar/http/request.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/util/log.hh>
+#include "http/http2_frame.hh"
+#endif
+
+namespace seastar {
+
+extern logger http_log;
+
+namespace http {
+namespace experimental {
+
+using namespace http::internal::http2;
+
+namespace {
+
+// Receive windows, large enough not to throttle a single stream on
+// a fast link
+constexpr int64_t stream_window = 1 << 20;
+constexpr int64_t connection_window = 16 << 20;
+// Until the server tells otherwise
+constexpr uint32_t default_max_concurrent_streams = 100;
+
+class stream_reset : public std::runtime_error {
+public:
+    stream_reset() : std::runtime_error("HTTP/2 stream reset") {}
+};
+
+}
+
+class http2_connection::impl {
+public:
+    struct stream {
+        uint32_t id = 0;
+        int64_t send_window = 0;
+        promise<reply_ptr> head;
+        bool head_received = false;
+        std::deque<temporary_buffer<char>> body;
+        condition_variable body_changed;
+        // Consumed, and not returned to the server yet
+        size_t unacked = 0;
+        // END_STREAM was sent
+        bool local_closed = false;
+        // END_STREAM was received
+        bool remote_closed = false;
+        std::exception_ptr error;
+    };
+    class body_source;
+    class body_sink;
+private:
+    connected_socket _fd;
+    input_stream<char> _in;
+    output_stream<char> _out;
+    sstring _scheme;
+    internal::client_ref& _ref;
+
+    http::internal::hpack_decoder _decoder;
+    std::unordered_map<uint32_t, lw_shared_ptr<stream>> _streams;
+    // Requests waiting for their stream to be opened
+    unsigned _pending = 0;
+    uint32_t _next_stream_id = 1;
+    uint32_t _continued_stream = 0;
+    uint8_t _continued_flags = 0;
+    std::string _header_block;
+    size_t _unacked = 0;
+
+    // Server settings
+    uint32_t _max_concurrent_streams = default_max_concurrent_streams;
+    uint32_t _max_frame_size = default_max_frame_size;
+    int64_t _initial_window_size = default_window_size;
+    int64_t _send_window = default_window_size;
+    condition_variable _window_changed;
+
+    semaphore _write_sem{1};
+    gate _background;
+    bool _goaway = false;
+    // Set once the connection is broken
+    std::exception_ptr _error;
+    future<> _reader = make_ready_future<>();
+private:
+    future<> run();
+    future<> read_frames();
+    future<> handle_frame(uint8_t type, uint8_t flags, uint32_t id, temporary_buffer<char> payload);
+    future<> handle_data(uint8_t flags, uint32_t id, temporary_buffer<char> payload);
+    future<> handle_header_block(uint8_t flags, uint32_t id);
+    future<> handle_settings(uint8_t flags, temporary_buffer<char> payload);
+    future<> handle_window_update(uint32_t id, temporary_buffer<char> payload);
+    void handle_goaway(temporary_buffer<char> payload);
+    void fail_stream(lw_shared_ptr<stream> s, std::exception_ptr ex);
+    void maybe_release(stream& s);
+    void background(noncopyable_function<future<>()> fn);
+    future<> write_headers(lw_shared_ptr<stream> s, std::string block, bool end_stream);
+    future<> write_frame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload);
+    // Writes already framed data
+    future<> write_raw(std::string data);
+    future<> write_rst_stream(uint32_t id, uint32_t error);
+    future<> write_window_update(uint32_t id, uint32_t increment);
+public:
+    impl(connected_socket fd, sstring scheme, internal::client_ref& ref);
+    void start() {
+        _reader = run();
+    }
+    future<std::pair<reply_ptr, lw_shared_ptr<stream>>> make_request(request req);
+    future<> write_data(stream& s, const char* data, size_t size, bool end_stream);
+    // Returns consumed body bytes to the flow control windows
+    void consumed(stream& s, size_t size);
+    void cancel(lw_shared_ptr<stream> s);
+    unsigned active_requests() const noexcept {
+        return _streams.size() + _pending;
+    }
+    bool usable() const noexcept {
+        return !_error && !_goaway && _next_stream_id <= 0x7fffffff;
+    }
+    bool can_make_request() const noexcept {
+        return usable() && active_requests() < _max_concurrent_streams;
+    }
+    future<> close();
+};
+
+// The body of a response, as DATA frames arrive
+class http2_connection::impl::body_source final : public data_source_impl {
+    shared_ptr<http2_connection> _con;
+    lw_shared_ptr<stream> _s;
+public:
+    body_source(shared_ptr<http2_connection> con, lw_shared_ptr<stream> s) noexcept
+        : _con(std::move(con)), _s(std::move(s))
+    {}
+    ~body_source() {
+        if (!_s->remote_closed && !_s->error) {
+            // Abandoned before the end
+            _con->_impl->cancel(_s);
+        }
+    }
+    virtual future<temporary_buffer<char>> get() override {
+        co_await _s->body_changed.wait([this] {
+            return !_s->body.empty() || _s->remote_closed || _s->error;
+        });
+        if (!_s->body.empty()) {
+            auto buf = std::move(_s->body.front());
+            _s->body.pop_front();
+            _con->_impl->consumed(*_s, buf.size());
+            co_return buf;
+        }
+        if (_s->remote_closed) {
+            co_return temporary_buffer<char>();
+        }
+        std::rethrow_exception(_s->error);
+    }
+};
+
+// Sends what a request body writer produces as DATA frames
+class http2_connection::impl::body_sink final : public data_sink_impl {
+    impl& _impl;
+    stream& _s;
+public:
+    body_sink(impl& i, stream& s) noexcept : _impl(i), _s(s) {}
+    virtual future<> put(net::packet p) override {
+        for (auto& f : p.fragments()) {
+            co_await _impl.write_data(_s, f.base, f.size, false);
+        }
+    }
+    virtual future<> close() override {
+        return _impl.write_data(_s, nullptr, 0, true);
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return _impl._max_frame_size;
+    }
+};
+
+http2_connection::impl::impl(connected_socket fd, sstring scheme, internal::client_ref& ref)
+    : _fd(std::move(fd))
+    , _in(_fd.input())
+    , _out(_fd.output())
+    , _scheme(std::move(scheme))
+    , _ref(ref)
+{}
+
+future<> http2_connection::impl::run() {
+    std::optional<uint32_t> goaway;
+    try {
+        std::string settings;
+        append_setting(settings, settings_enable_push, 0);
+        append_setting(settings, settings_initial_window_size, stream_window);
+        append_setting(settings, settings_max_header_list_size, max_header_list_size);
+        char increment[4];
+        write_be<uint32_t>(increment, connection_window - default_window_size);
+        std::string preface(client_preface);
+        preface += make_frame(frame_settings, 0, 0, settings);
+        preface += make_frame(frame_window_update, 0, 0, std::string_view(increment, sizeof(increment)));
+        co_await write_raw(std::move(preface));
+        co_await read_frames();
+        _error = std::make_exception_ptr(std::runtime_error("HTTP/2 connection closed"));
+    } catch (const connection_error& e) {
+        http_log.debug("HTTP/2 connection error: {}", e.what());
+        goaway = e.code();
+        _error = std::current_exception();
+    } catch (...) {
+        _error = std::current_exception();
+    }
+    if (goaway) {
+        char payload[8];
+        write_be<uint32_t>(payload, 0);
+        write_be<uint32_t>(payload + 4, *goaway);
+        co_await write_frame(frame_goaway, 0, 0, std::string_view(payload, sizeof(payload))).handle_exception([] (std::exception_ptr) {});
+    }
+    auto streams = std::exchange(_streams, {});
+    for (auto& [_, s] : streams) {
+        fail_stream(s, _error);
+    }
+    _window_changed.broadcast();
+    _ref.notify();
+}
+
+future<> http2_connection::impl::read_frames() {
+    for (;;) {
+        auto header = co_await _in.read_exactly(frame_header_size);
+        if (header.size() < frame_header_size) {
+            co_return;
+        }
+        auto [length, type, flags, id] = read_frame_header(header.get());
+        // We never raise SETTINGS_MAX_FRAME_SIZE
+        if (length > default_max_frame_size) {
+            throw connection_error(frame_size_error, "frame too large");
+        }
+        auto payload = co_await _in.read_exactly(length);
+        if (payload.size() < length) {
+            co_return;
+        }
+        co_await handle_frame(type, flags, id, std::move(payload));
+    }
+}
+
+future<> http2_connection::impl::handle_frame(uint8_t type, uint8_t flags, uint32_t id, temporary_buffer<char> payload) {
+    if (_continued_stream && (type != frame_continuation || id != _continued_stream)) {
+        throw connection_error(protocol_error, "expected CONTINUATION");
+    }
+    switch (type) {
+    case frame_data:
+        return handle_data(flags, id, std::move(payload));
+    case frame_headers:
+        if (!id) {
+            throw connection_error(protocol_error, "HEADERS on stream 0");
+        }
+        strip_padding(flags, payload);
+        if (flags & flag_priority) {
+            if (payload.size() < 5) {
+                throw connection_error(frame_size_error, "invalid HEADERS priority");
+            }
+            payload.trim_front(5);
+        }
+        _header_block.assign(payload.get(), payload.size());
+        if (flags & flag_end_headers) {
+            return handle_header_block(flags, id);
+        }
+        _continued_stream = id;
+        _continued_flags = flags;
+        return make_ready_future<>();
+    case frame_continuation:
+        if (!_continued_stream) {
+            throw connection_error(protocol_error, "unexpected CONTINUATION");
+        }
+        if (_header_block.size() + payload.size() > max_header_block_size) {
+            throw connection_error(enhance_your_calm, "header block too large");
+        }
+        _header_block.append(payload.get(), payload.size());
+        if (flags & flag_end_headers) {
+            _continued_stream = 0;
+            return handle_header_block(_continued_flags, id);
+        }
+        return make_ready_future<>();
+    case frame_rst_stream: {
+        if (payload.size() != 4) {
+            throw connection_error(frame_size_error, "invalid RST_STREAM");
+        }
+        auto it = _streams.find(id);
+        if (it != _streams.end()) {
+            auto s = it->second;
+            auto error = read_be<uint32_t>(payload.get());
+            if (error == no_error && s->remote_closed) {
+                // The response is complete, the server just doesn't want
+                // the rest of the request body
+                _streams.erase(it);
+                _window_changed.broadcast();
+                _ref.notify();
+            } else {
+                fail_stream(std::move(s), std::make_exception_ptr(std::runtime_error(
+                        format("HTTP/2 stream reset by the server with error {}", error))));
+            }
+        }
+        return make_ready_future<>();
+    }
+    case frame_settings:
+        if (id) {
+            throw connection_error(protocol_error, "SETTINGS on a stream");
+        }
+        return handle_settings(flags, std::move(payload));
+    case frame_push_promise:
+        throw connection_error(protocol_error, "PUSH_PROMISE while disabled");
+    case frame_ping:
+        if (id) {
+            throw connection_error(protocol_error, "PING on a stream");
+        }
+        if (payload.size() != 8) {
+            throw connection_error(frame_size_error, "invalid PING");
+        }
+        if (flags & flag_ack) {
+            return make_ready_future<>();
+        }
+        return do_with(std::move(payload), [this] (temporary_buffer<char>& payload) {
+            return write_frame(frame_ping, flag_ack, 0, std::string_view(payload.get(), payload.size()));
+        });
+    case frame_goaway:
+        if (id) {
+            throw connection_error(protocol_error, "GOAWAY on a stream");
+        }
+        handle_goaway(std::move(payload));
+        return make_ready_future<>();
+    case frame_window_update:
+        return handle_window_update(id, std::move(payload));
+    default:
+        // PRIORITY, and unknown frame types which must be ignored
+        return make_ready_future<>();
+    }
+}
+
+future<> http2_connection::impl::handle_data(uint8_t flags, uint32_t id, temporary_buffer<char> payload) {
+    if (!id) {
+        throw connection_error(protocol_error, "DATA on stream 0");
+    }
+    size_t length = payload.size();
+    strip_padding(flags, payload);
+    auto it = _streams.find(id);
+    if (it == _streams.end() || it->second->remote_closed) {
+        // Cancelled, only the connection window is to be given back
+        _unacked += length;
+        if (_unacked >= connection_window / 2) {
+            co_await write_window_update(0, std::exchange(_unacked, 0));
+        }
+        co_return;
+    }
+    auto s = it->second;
+    if (length > payload.size()) {
+        consumed(*s, length - payload.size());
+    }
+    if (!payload.empty()) {
+        s->body.push_back(std::move(payload));
+    }
+    if (flags & flag_end_stream) {
+        s->remote_closed = true;
+        maybe_release(*s);
+    }
+    s->body_changed.broadcast();
+}
+
+future<> http2_connection::impl::handle_header_block(uint8_t flags, uint32_t id) {
+    std::vector<http::internal::hpack_decoder::header> headers;
+    bool too_large = false;
+    try {
+        headers = _decoder.decode(_header_block, max_header_list_size);
+    } catch (const http::internal::hpack_header_list_too_large&) {
+        too_large = true;
+    } catch (const http::internal::hpack_error& e) {
+        throw connection_error(compression_error, e.what());
+    }
+    _header_block.clear();
+
+    auto it = _streams.find(id);
+    if (it == _streams.end()) {
+        // Cancelled, the block only mattered to the decoder
+        co_return;
+    }
+    auto s = it->second;
+    if (too_large) {
+        fail_stream(s, std::make_exception_ptr(std::runtime_error("HTTP/2 response headers too large")));
+        co_return co_await write_rst_stream(id, enhance_your_calm);
+    }
+    if (!s->head_received) {
+        auto rep = std::make_unique<reply>();
+        int status = 0;
+        for (auto& [name, value] : headers) {
+            if (name == ":status") {
+                status = strtol(value.c_str(), nullptr, 10);
+            } else if (name.empty() || name[0] != ':') {
+                auto [h, inserted] = rep->_headers.emplace(name, value);
+                if (!inserted) {
+                    h->second += sstring(",") + value;
+                }
+            }
+        }
+        if (status >= 100 && status < 200) {
+            // Informational, the response is yet to come
+            co_return;
+        }
+        if (status < 200 || status > 999) {
+            fail_stream(s, std::make_exception_ptr(std::runtime_error("Invalid response")));
+            co_return co_await write_rst_stream(id, protocol_error);
+        }
+        rep->_status = static_cast<reply::status_type>(status);
+        rep->_version = "2.0";
+        rep->content_length = strtol(rep->get_header("Content-Length").c_str(), nullptr, 10);
+        s->head_received = true;
+        s->head.set_value(std::move(rep));
+    }
+    // Otherwise these are trailers, which are not reported
+    if (flags & flag_end_stream) {
+        s->remote_closed = true;
+        maybe_release(*s);
+        s->body_changed.broadcast();
+    }
+}
+
+future<> http2_connection::impl::handle_settings(uint8_t flags, temporary_buffer<char> payload) {
+    if (flags & flag_ack) {
+        if (!payload.empty()) {
+            throw connection_error(frame_size_error, "SETTINGS ACK with a payload");
+        }
+        co_return;
+    }
+    if (payload.size() % 6) {
+        throw connection_error(frame_size_error, "invalid SETTINGS");
+    }
+    for (size_t i = 0; i < payload.size(); i += 6) {
+        auto id = read_be<uint16_t>(payload.get() + i);
+        auto value = read_be<uint32_t>(payload.get() + i + 2);
+        switch (id) {
+        case settings_max_concurrent_streams:
+            _max_concurrent_streams = value;
+            _ref.notify();
+            break;
+        case settings_initial_window_size: {
+            if (value > max_window_size) {
+                throw connection_error(flow_control_error, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+            auto delta = int64_t(value) - _initial_window_size;
+            for (auto& [_, s] : _streams) {
+                s->send_window += delta;
+            }
+            _initial_window_size = value;
+            _window_changed.broadcast();
+            break;
+        }
+        case settings_max_frame_size:
+            if (value < default_max_frame_size || value > 0xffffff) {
+                throw connection_error(protocol_error, "invalid SETTINGS_MAX_FRAME_SIZE");
+            }
+            _max_frame_size = value;
+            break;
+        default:
+            // Requests don't use the dynamic table, whatever its size
+            break;
+        }
+    }
+    co_await write_frame(frame_settings, flag_ack, 0, {});
+}
+
+future<> http2_connection::impl::handle_window_update(uint32_t id, temporary_buffer<char> payload) {
+    if (payload.size() != 4) {
+        throw connection_error(frame_size_error, "invalid WINDOW_UPDATE");
+    }
+    auto increment = read_be<uint32_t>(payload.get()) & 0x7fffffff;
+    if (!id) {
+        if (!increment) {
+            throw connection_error(protocol_error, "zero WINDOW_UPDATE");
+        }
+        _send_window += increment;
+        if (_send_window > max_window_size) {
+            throw connection_error(flow_control_error, "connection window overflow");
+        }
+    } else if (auto it = _streams.find(id); it != _streams.end()) {
+        auto s = it->second;
+        s->send_window += increment;
+        if (!increment || s->send_window > max_window_size) {
+            fail_stream(s, std::make_exception_ptr(std::runtime_error("HTTP/2 flow control error")));
+            return write_rst_stream(id, increment ? flow_control_error : protocol_error);
+        }
+    }
+    _window_changed.broadcast();
+    return make_ready_future<>();
+}
+
+void http2_connection::impl::handle_goaway(temporary_buffer<char> payload) {
+    if (payload.size() < 8) {
+        throw connection_error(frame_size_error, "invalid GOAWAY");
+    }
+    auto last_stream_id = read_be<uint32_t>(payload.get()) & 0x7fffffff;
+    _goaway = true;
+    // Later streams were not processed and can be retried elsewhere
+    std::vector<lw_shared_ptr<stream>> refused;
+    for (auto& [id, s] : _streams) {
+        if (id > last_stream_id) {
+            refused.push_back(s);
+        }
+    }
+    for (auto& s : refused) {
+        fail_stream(s, std::make_exception_ptr(std::runtime_error("HTTP/2 stream refused by GOAWAY")));
+    }
+    _ref.notify();
+}
+
+void http2_connection::impl::fail_stream(lw_shared_ptr<stream> s, std::exception_ptr ex) {
+    if (!s->error) {
+        s->error = std::move(ex);
+    }
+    if (!s->head_received) {
+        s->head_received = true;
+        s->head.set_exception(s->error);
+    }
+    s->body_changed.broadcast();
+    _window_changed.broadcast();
+    if (auto it = _streams.find(s->id); it != _streams.end() && it->second == s) {
+        _streams.erase(it);
+        _ref.notify();
+    }
+}
+
+void http2_connection::impl::maybe_release(stream& s) {
+    if (s.local_closed && s.remote_closed && _streams.erase(s.id)) {
+        _ref.notify();
+    }
+}
+
+void http2_connection::impl::cancel(lw_shared_ptr<stream> s) {
+    auto id = s->id;
+    bool open = _streams.contains(id);
+    fail_stream(std::move(s), std::make_exception_ptr(stream_reset()));
+    if (open && !_error) {
+        background([this, id] {
+            return write_rst_stream(id, http::internal::http2::cancel);
+        });
+    }
+}
+
+void http2_connection::impl::consumed(stream& s, size_t size) {
+    _unacked += size;
+    if (_unacked >= connection_window / 2) {
+        background([this, increment = std::exchange(_unacked, 0)] {
+            return write_window_update(0, increment);
+        });
+    }
+    if (!s.remote_closed) {
+        s.unacked += size;
+        if (s.unacked >= stream_window / 2) {
+            background([this, id = s.id, increment = std::exchange(s.unacked, 0)] {
+                return write_window_update(id, increment);
+            });
+        }
+    }
+}
+
+void http2_connection::impl::background(noncopyable_function<future<>()> fn) {
+    if (_background.is_closed()) {
+        return;
+    }
+    (void)with_gate(_background, std::move(fn)).handle_exception([] (std::exception_ptr ex) {
+        http_log.debug("HTTP/2 write failed: {}", ex);
+    });
+}
+
+future<std::pair<http2_connection::reply_ptr, lw_shared_ptr<http2_connection::impl::stream>>>
+http2_connection::impl::make_request(request req) {
+    if (!usable()) {
+        throw std::runtime_error("HTTP/2 connection is not usable");
+    }
+    std::string block;
+    http::internal::hpack_encode(block, ":method", req._method);
+    http::internal::hpack_encode(block, ":scheme", _scheme);
+    if (auto host = req.get_header("Host"); !host.empty()) {
+        http::internal::hpack_encode(block, ":authority", host);
+    }
+    auto path = req.format_url();
+    http::internal::hpack_encode(block, ":path", path.empty() ? "/" : path);
+    for (auto& [name, value] : req._headers) {
+        // Header names are lowercase in HTTP/2
+        std::string lname(name.size(), '\0');
+        std::transform(name.begin(), name.end(), lname.begin(), [] (unsigned char c) { return std::tolower(c); });
+        if (is_connection_specific(lname) || lname == "host" || lname == "content-length") {
+            continue;
+        }
+        http::internal::hpack_encode(block, lname, value);
+    }
+    if (req.content_length != 0) {
+        if (!req.body_writer && req.content.empty()) {
+            throw std::runtime_error("Request body writer not set and content is empty");
+        }
+        http::internal::hpack_encode(block, "content-length", std::to_string(req.content_length));
+    }
+    bool has_body = req.body_writer || !req.content.empty();
+
+    auto s = make_lw_shared<stream>();
+    auto head = s->head.get_future();
+    ++_pending;
+    std::exception_ptr ex;
+    try {
+        co_await write_headers(s, std::move(block), !has_body);
+        if (req.body_writer) {
+            co_await req.body_writer(output_stream<char>(data_sink(std::make_unique<body_sink>(*this, *s))));
+        } else if (has_body) {
+            co_await write_data(*s, req.content.data(), req.content.size(), true);
+        }
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    if (ex) {
+        if (!s->id) {
+            --_pending;
+        }
+        // The server may respond before taking the whole body
+        if (!s->head_received || s->error) {
+            cancel(s);
+            (void)head.then_wrapped([] (auto f) { f.ignore_ready_future(); });
+            std::rethrow_exception(ex);
+        }
+    }
+    auto rep = co_await std::move(head);
+    co_return std::make_pair(std::move(rep), std::move(s));
+}
+
+future<> http2_connection::impl::write_headers(lw_shared_ptr<stream> s, std::string block, bool end_stream) {
+    auto units = co_await get_units(_write_sem, 1);
+    if (!usable()) {
+        throw std::runtime_error("HTTP/2 connection is not usable");
+    }
+    // Stream identifiers must be used in order
+    --_pending;
+    s->id = _next_stream_id;
+    _next_stream_id += 2;
+    s->send_window = _initial_window_size;
+    s->local_closed = end_stream;
+    _streams.emplace(s->id, s);
+
+    std::string_view rest = block;
+    uint8_t type = frame_headers;
+    uint8_t flags = end_stream ? flag_end_stream : 0;
+    do {
+        auto fragment = rest.substr(0, _max_frame_size);
+        rest.remove_prefix(fragment.size());
+        auto frame = make_frame(type, flags | (rest.empty() ? flag_end_headers : 0), s->id, fragment);
+        co_await _out.write(frame.data(), frame.size());
+        type = frame_continuation;
+        flags = 0;
+    } while (!rest.empty());
+    if (!_write_sem.waiters()) {
+        co_await _out.flush();
+    }
+}
+
+future<> http2_connection::impl::write_data(stream& s, const char* data, size_t size, bool end_stream) {
+    if (!size && !end_stream) {
+        co_return;
+    }
+    do {
+        co_await _window_changed.wait([&] {
+            return _error || s.error || !size || std::min(_send_window, s.send_window) > 0;
+        });
+        if (_error || s.error) {
+            throw stream_reset();
+        }
+        size_t chunk = size ? std::min<int64_t>({int64_t(size), int64_t(_max_frame_size), _send_window, s.send_window}) : 0;
+        _send_window -= chunk;
+        s.send_window -= chunk;
+        bool last = end_stream && chunk == size;
+        co_await write_frame(frame_data, last ? flag_end_stream : 0, s.id, std::string_view(data, chunk));
+        data += chunk;
+        size -= chunk;
+        if (last) {
+            s.local_closed = true;
+            maybe_release(s);
+        }
+    } while (size);
+}
+
+future<> http2_connection::impl::write_frame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload) {
+    auto units = co_await get_units(_write_sem, 1);
+    char header[frame_header_size];
+    write_frame_header(header, payload.size(), type, flags, id);
+    co_await _out.write(header, sizeof(header));
+    if (!payload.empty()) {
+        co_await _out.write(payload.data(), payload.size());
+    }
+    // Whoever writes last flushes for all
+    if (!_write_sem.waiters()) {
+        co_await _out.flush();
+    }
+}
+
+future<> http2_connection::impl::write_raw(std::string data) {
+    auto units = co_await get_units(_write_sem, 1);
+    co_await _out.write(data.data(), data.size());
+    if (!_write_sem.waiters()) {
+        co_await _out.flush();
+    }
+}
+
+future<> http2_connection::impl::write_rst_stream(uint32_t id, uint32_t error) {
+    char payload[4];
+    write_be<uint32_t>(payload, error);
+    co_await write_frame(frame_rst_stream, 0, id, std::string_view(payload, sizeof(payload)));
+}
+
+future<> http2_connection::impl::write_window_update(uint32_t id, uint32_t increment) {
+    char payload[4];
+    write_be<uint32_t>(payload, increment);
+    co_await write_frame(frame_window_update, 0, id, std::string_view(payload, sizeof(payload)));
+}
+
+future<> http2_connection::impl::close() {
+    if (!_error) {
+        char payload[8];
+        write_be<uint32_t>(payload, 0);
+        write_be<uint32_t>(payload + 4, no_error);
+        co_await write_frame(frame_goaway, 0, 0, std::string_view(payload, sizeof(payload))).handle_exception([] (std::exception_ptr) {});
+    }
+    _fd.shutdown_input();
+    co_await std::move(_reader);
+    co_await _background.close();
+    co_await _out.close().handle_exception([] (std::exception_ptr ex) {
+        http_log.debug("HTTP/2 connection close failed: {}", ex);
+    });
+    co_await _in.close().handle_exception([] (std::exception_ptr) {});
+}
+
+http2_connection::http2_connection(connected_socket&& fd, internal::client_ref cr, sstring scheme)
+        : _ref(std::move(cr))
+        , _impl(std::make_unique<impl>(std::move(fd), std::move(scheme), _ref))
+{
+    _impl->start();
+}
+
+http2_connection::~http2_connection() = default;
+
+future<std::pair<http2_connection::reply_ptr, input_stream<char>>> http2_connection::do_make_request(request rq) {
+    return _impl->make_request(std::move(rq)).then([this] (auto response) {
+        auto body = input_stream<char>(data_source(std::make_unique<impl::body_source>(shared_from_this(), std::move(response.second))));
+        return std::make_pair(std::move(response.first), std::move(body));
+    });
+}
+
+future<std::pair<reply, input_stream<char>>> http2_connection::make_request(request rq) {
+    return do_make_request(std::move(rq)).then([] (auto response) {
+        return std::make_pair(std::move(*response.first), std::move(response.second));
+    });
+}
+
+unsigned http2_connection::active_requests() const noexcept {
+    return _impl->active_requests();
+}
+
+bool http2_connection::can_make_request() const noexcept {
+    return _impl->can_make_request();
+}
+
+bool http2_connection::usable() const noexcept {
+    return _impl->usable();
+}
+
+future<> http2_connection::close() {
+    return _impl->close();
+}
+
+} // experimental namespace
+} // http namespace
+} // seastar namespace
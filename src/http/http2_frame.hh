@@ -0,0 +1,175 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#endif
+
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/temporary_buffer.hh>
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+// HTTP/2 framing (RFC 9113 section 4), shared by the server and the client
+namespace http2 {
+
+enum frame_type : uint8_t {
+    frame_data = 0x0,
+    frame_headers = 0x1,
+    frame_priority = 0x2,
+    frame_rst_stream = 0x3,
+    frame_settings = 0x4,
+    frame_push_promise = 0x5,
+    frame_ping = 0x6,
+    frame_goaway = 0x7,
+    frame_window_update = 0x8,
+    frame_continuation = 0x9,
+};
+
+enum frame_flags : uint8_t {
+    flag_end_stream = 0x1,
+    flag_ack = 0x1,
+    flag_end_headers = 0x4,
+    flag_padded = 0x8,
+    flag_priority = 0x20,
+};
+
+enum settings_id : uint16_t {
+    settings_header_table_size = 0x1,
+    settings_enable_push = 0x2,
+    settings_max_concurrent_streams = 0x3,
+    settings_initial_window_size = 0x4,
+    settings_max_frame_size = 0x5,
+    settings_max_header_list_size = 0x6,
+};
+
+enum error_code : uint32_t {
+    no_error = 0x0,
+    protocol_error = 0x1,
+    internal_error = 0x2,
+    flow_control_error = 0x3,
+    stream_closed = 0x5,
+    frame_size_error = 0x6,
+    refused_stream = 0x7,
+    cancel = 0x8,
+    compression_error = 0x9,
+    enhance_your_calm = 0xb,
+};
+
+constexpr size_t frame_header_size = 9;
+constexpr uint32_t default_max_frame_size = 16384;
+constexpr int64_t default_window_size = 65535;
+constexpr int64_t max_window_size = 0x7fffffff;
+constexpr size_t max_header_block_size = 1 << 20;
+// Our SETTINGS_MAX_HEADER_LIST_SIZE, a header block may decode to much more
+// than its size
+constexpr size_t max_header_list_size = 64 << 10;
+constexpr std::string_view client_preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// Tears down the whole connection with a GOAWAY
+class connection_error : public std::runtime_error {
+    uint32_t _code;
+public:
+    connection_error(uint32_t code, const char* msg) : std::runtime_error(msg), _code(code) {}
+    uint32_t code() const noexcept {
+        return _code;
+    }
+};
+
+struct frame_header {
+    uint32_t length;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t stream_id;
+};
+
+inline frame_header read_frame_header(const char* p) noexcept {
+    auto u = reinterpret_cast<const uint8_t*>(p);
+    return frame_header{
+        .length = (uint32_t(u[0]) << 16) | (uint32_t(u[1]) << 8) | u[2],
+        .type = u[3],
+        .flags = u[4],
+        .stream_id = read_be<uint32_t>(p + 5) & 0x7fffffff,
+    };
+}
+
+inline void write_frame_header(char* p, uint32_t length, uint8_t type, uint8_t flags, uint32_t id) noexcept {
+    p[0] = char(length >> 16);
+    p[1] = char(length >> 8);
+    p[2] = char(length);
+    p[3] = char(type);
+    p[4] = char(flags);
+    write_be<uint32_t>(p + 5, id & 0x7fffffff);
+}
+
+inline std::string make_frame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload) {
+    std::string frame(frame_header_size, '\0');
+    write_frame_header(frame.data(), payload.size(), type, flags, id);
+    frame += payload;
+    return frame;
+}
+
+inline void append_setting(std::string& payload, uint16_t id, uint32_t value) {
+    char p[6];
+    write_be<uint16_t>(p, id);
+    write_be<uint32_t>(p + 2, value);
+    payload.append(p, sizeof(p));
+}
+
+// Strips the Pad Length field and the padding of DATA and HEADERS frames
+inline void strip_padding(uint8_t flags, temporary_buffer<char>& payload) {
+    if (!(flags & flag_padded)) {
+        return;
+    }
+    if (payload.empty()) {
+        throw connection_error(protocol_error, "missing pad length");
+    }
+    size_t pad = uint8_t(payload[0]);
+    payload.trim_front(1);
+    if (pad > payload.size()) {
+        throw connection_error(protocol_error, "padding exceeds the frame");
+    }
+    payload.trim(payload.size() - pad);
+}
+
+// Header fields that don't exist in HTTP/2 (RFC 9113 section 8.2.2),
+// with lowercase names
+inline bool is_connection_specific(std::string_view name) noexcept {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+            || name == "transfer-encoding" || name == "upgrade";
+}
+
+}
+
+}
+
+}
+
+}
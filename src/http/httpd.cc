@@ -42,6 +42,7 @@ module seastar;
 #include <seastar/core/sstring.hh>
 #include <seastar/core/app-template.hh>
 #include <seastar/core/circular_buffer.hh>
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/when_all.hh>
@@ -53,6 +54,7 @@ module seastar;
 #include <seastar/util/short_streams.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/string_utils.hh>
+#include "http/http2.hh"
 #endif
 
 
@@ -74,7 +76,11 @@ http_stats::http_stats(http_server& server, const sstring& name)
             sm::make_gauge("connections_current", [&server] { return server.current_connections(); }, sm::description("The current number of open  connections"), labels),
             sm::make_counter("read_errors", [&server] { return server.read_errors(); }, sm::description("The total number of errors while reading http requests"), labels),
             sm::make_counter("reply_errors", [&server] { return server.reply_errors(); }, sm::description("The total number of errors while replying to http"), labels),
-            sm::make_counter("requests_served", [&server] { return server.requests_served(); }, sm::description("The total number of http requests served"), labels)
+            sm::make_counter("requests_served", [&server] { return server.requests_served(); }, sm::description("The total number of http requests served"), labels),
+            sm::make_counter("requests_queued", [&server] { return server.requests_queued(); }, sm::description("The total number of http requests that waited for admission"), labels),
+            sm::make_counter("requests_shed", [&server] { return server.requests_shed(); }, sm::description("The total number of http requests rejected by admission control"), labels),
+            sm::make_counter("files_sent", [&server] { return server.files_sent(); }, sm::description("The total number of replies whose body was sent from a file with sendfile"), labels),
+            sm::make_gauge("connections_parked", [&server] { return server.parked_connections(); }, sm::description("The current number of connections waiting for a request without holding a read buffer"), labels)
     });
 }
 
@@ -98,6 +104,11 @@ future<> connection::do_response_loop() {
 }
 
 future<> connection::start_response() {
+    // A file region comes with a body writer streaming it, for connections
+    // which can't send files
+    if (_resp->_file_region && _fd.can_send_file(_resp->_file_region->f)) {
+        return send_file_body();
+    }
     if (_resp->_body_writer) {
         return _resp->write_reply_to_connection(*this).then_wrapped([this] (auto f) {
             if (f.failed()) {
@@ -135,6 +146,9 @@ future<> connection::start_response() {
             return make_ready_future<>();
         });
     }
+    if (_resp->_prerendered) {
+        return send_prerendered();
+    }
     set_headers(*_resp);
     _resp->_headers["Content-Length"] = to_sstring(
             _resp->_content.size());
@@ -162,6 +176,7 @@ void connection::on_new_connection() {
     ++_server._current_connections;
     _fd.set_nodelay(true);
     _server._connections.push_back(*this);
+    _pipeline_slots.signal(_server._pipeline_depth);
 }
 
 future<> connection::read() {
@@ -173,7 +188,9 @@ future<> connection::read() {
             _server._read_errors++;
         }
         f.ignore_ready_future();
-        return _replies.push_eventually( {});
+        return drain_pipeline().then([this] {
+            return _replies.push_eventually( {});
+        });
     });
 }
 
@@ -203,7 +220,6 @@ set_request_content(std::unique_ptr<http::request> req, input_stream<char>* cont
 
 void connection::generate_error_reply_and_close(std::unique_ptr<http::request> req, http::reply::status_type status, const sstring& msg) {
     auto resp = std::make_unique<http::reply>();
-    // TODO: Handle HTTP/2.0 when it releases
     resp->set_version(req->_version);
     resp->set_status(status, msg);
     resp->done();
@@ -213,13 +229,30 @@ void connection::generate_error_reply_and_close(std::unique_ptr<http::request> r
 
 future<> connection::read_one() {
     _parser.init();
-    return _read_buf.consume(_parser).then([this] () mutable {
+    // Keep-alive connections may idle for long, don't let them hold on to
+    // the buffer the last request was received in
+    auto parked = _read_buf.release_idle_buffer();
+    if (parked) {
+        ++_server._parked_connections;
+    }
+    return _read_buf.consume(_parser).finally([this, parked] {
+        if (parked) {
+            --_server._parked_connections;
+        }
+    }).then([this] () mutable {
         if (_parser.eof()) {
             _done = true;
             return make_ready_future<>();
         }
-        ++_server._requests_served;
         std::unique_ptr<http::request> req = _parser.get_parsed_request();
+        if (!_parser.failed() && req->_method == "PRI" && req->_version == "2.0") {
+            // HTTP/2 with prior knowledge, the rest of the preface follows
+            _http2 = true;
+            _http2_preface_started = true;
+            _done = true;
+            return make_ready_future<>();
+        }
+        ++_server._requests_served;
 
         req->_server_address = this->_server_addr;
         req->_client_address = this->_client_addr;
@@ -227,6 +260,11 @@ future<> connection::read_one() {
         if (_tls) {
             req->protocol_name = "https";
         }
+        if (can_pipeline(*req)) {
+            return read_pipelined(std::move(req));
+        }
+        // Replies to the requests before go first
+        return drain_pipeline().then([this, req = std::move(req)] () mutable {
         if (_parser.failed()) {
             if (req->_version.empty()) {
                 // we might have failed to parse even the version
@@ -253,6 +291,28 @@ future<> connection::read_one() {
             return make_ready_future<>();
         }
 
+        if (!_tls && req->_version == "1.1" && req->content_length == 0 && encoding.empty()
+                && seastar::internal::case_insensitive_cmp()(req->get_header("Upgrade"), "h2c")
+                && !req->get_header("HTTP2-Settings").empty()) {
+            // The request is served as the first HTTP/2 stream (RFC 7540, section 3.2)
+            return _replies.not_full().then([this, req = std::move(req)] () mutable {
+                auto upgrade_reply = std::make_unique<http::reply>();
+                upgrade_reply->set_version(req->_version);
+                upgrade_reply->set_status(http::reply::status_type::switching_protocols);
+                upgrade_reply->_headers["Connection"] = "Upgrade";
+                upgrade_reply->_headers["Upgrade"] = "h2c";
+                upgrade_reply->done();
+                _replies.push(std::move(upgrade_reply));
+                _upgraded_req = std::move(req);
+                _http2 = true;
+                _done = true;
+            });
+        }
+
+        return admit(*req).then([this, req = std::move(req)] (std::optional<admission_controller::permit> permit) mutable {
+        if (!permit) {
+            return make_ready_future<>();
+        }
         auto maybe_reply_continue = [this, req = std::move(req)] () mutable {
             if (req->_version == "1.1" && seastar::internal::case_insensitive_cmp()(req->get_header("Expect"), "100-continue")){
                 return _replies.not_full().then([req = std::move(req), this] () mutable {
@@ -294,13 +354,125 @@ future<> connection::read_one() {
                     generate_error_reply_and_close(std::move(err_req), e.status(), e.str());
                 });
             });
+        }).finally([permit = std::move(*permit)] {});
+        });
+        });
+    });
+}
+
+bool connection::can_pipeline(const http::request& req) const {
+    if (_server._pipeline_depth <= 1 || _parser.failed() || _server.get_content_streaming()) {
+        return false;
+    }
+    auto encoding = req.get_header("Transfer-Encoding");
+    return strtoul(req.get_header("Content-Length").c_str(), nullptr, 10) <= _server.get_content_length_limit()
+            && (encoding.empty() || seastar::internal::case_insensitive_cmp()(encoding, "chunked"))
+            && req.get_header("Expect").empty() && req.get_header("Upgrade").empty();
+}
+
+future<> connection::read_pipelined(std::unique_ptr<http::request> req) {
+    auto permit = co_await admit(*req);
+    if (!permit) {
+        co_return;
+    }
+    req->content_length = strtol(req->get_header("Content-Length").c_str(), nullptr, 10);
+    // The body is read before the next request is, the handler gets the
+    // stream at its end
+    auto content_stream = std::make_unique<input_stream<char>>(make_content_stream(req.get(), _read_buf));
+    auto version = req->_version;
+    std::optional<std::pair<http::reply::status_type, sstring>> error;
+    try {
+        req = co_await set_request_content(std::move(req), content_stream.get(), false);
+    } catch (const base_exception& e) {
+        error.emplace(e.status(), e.str());
+    }
+    if (error) {
+        co_await drain_pipeline();
+        auto err_req = std::make_unique<http::request>();
+        err_req->_version = version;
+        generate_error_reply_and_close(std::move(err_req), error->first, error->second);
+        co_return;
+    }
+    _done = !req->should_keep_alive();
+    auto slot = co_await get_units(_pipeline_slots, 1);
+    auto previous = std::exchange(_pipeline_tail, make_ready_future<>());
+    _pipeline_tail = reply_pipelined(std::move(req), std::move(content_stream), std::move(previous), std::move(slot), std::move(*permit));
+}
+
+future<> connection::reply_pipelined(std::unique_ptr<http::request> req, std::unique_ptr<input_stream<char>> content_stream,
+        future<> previous, semaphore_units<> slot, admission_controller::permit permit) {
+    auto version = req->_version;
+    std::unique_ptr<http::reply> rep;
+    try {
+        rep = co_await handle_request(std::move(req));
+    } catch (...) {
+        rep = _server._routes.exception_reply(std::current_exception());
+        rep->set_version(version).done();
+    }
+    co_await std::move(previous);
+    try {
+        co_await _replies.not_full();
+        _replies.push(std::move(rep));
+    } catch (...) {
+        // The replies were aborted, the connection is closing
+    }
+}
+
+future<std::optional<admission_controller::permit>> connection::admit(const http::request& req) {
+    using ret_type = std::optional<admission_controller::permit>;
+    auto controller = _server._routes.get_admission(str2type(req._method), req._url.substr(0, req._url.find('?')));
+    if (!controller) {
+        controller = _server._admission;
+    }
+    if (!controller) {
+        return make_ready_future<ret_type>(admission_controller::permit());
+    }
+    return controller->admit(_server._admission_stats).then([this, &req, controller] (ret_type permit) {
+        if (permit) {
+            return make_ready_future<ret_type>(std::move(permit));
+        }
+        return drain_pipeline().then([this, &req, controller] {
+            return shed(req, controller->config().retry_after);
+        }).then([] {
+            return ret_type();
         });
     });
 }
 
+future<> connection::shed(const http::request& req, std::chrono::seconds retry_after) {
+    auto resp = std::make_unique<http::reply>();
+    set_headers(*resp);
+    resp->set_version(req._version);
+    resp->set_status(http::reply::status_type::service_unavailable);
+    resp->_headers["Retry-After"] = to_sstring(retry_after.count());
+    resp->done();
+    // The body wasn't read, so the next request can't be found
+    if (!req.should_keep_alive() || strtol(req.get_header("Content-Length").c_str(), nullptr, 10) || !req.get_header("Transfer-Encoding").empty()) {
+        _done = true;
+    }
+    return _replies.not_full().then([this, resp = std::move(resp)] () mutable {
+        _replies.push(std::move(resp));
+    });
+}
+
+future<> connection::drain_pipeline() {
+    return std::exchange(_pipeline_tail, make_ready_future<>());
+}
+
 future<> connection::process() {
-    // Launch read and write "threads" simultaneously:
-    return when_all(read(), respond()).then(
+    auto negotiated = _tls
+            ? futurize_invoke([this] { return tls::get_alpn_protocol(_fd); })
+            : make_ready_future<std::optional<sstring>>();
+    return negotiated.handle_exception([] (std::exception_ptr e) {
+        // A failed handshake fails the first read as well
+        return std::optional<sstring>();
+    }).then([this] (std::optional<sstring> protocol) {
+      if (protocol == "h2") {
+        _http2 = true;
+        return make_ready_future<>();
+      }
+      // Launch read and write "threads" simultaneously:
+      return when_all(read(), respond()).then(
             [] (std::tuple<future<>, future<>> joined) {
         try {
             std::get<0>(joined).get();
@@ -313,12 +485,26 @@ future<> connection::process() {
             hlogger.debug("Response exception encountered: {}", std::current_exception());
         }
         return make_ready_future<>();
+      });
+    }).then([this] {
+        return _http2 ? process_http2() : make_ready_future<>();
     }).finally([this]{
         return _read_buf.close().handle_exception([](std::exception_ptr e) {
             hlogger.debug("Close exception encountered: {}", e);
         });
     });
 }
+
+future<> connection::process_http2() {
+    auto h2 = std::make_unique<internal::http2_connection>(*this, _server, _read_buf, _write_buf,
+            _client_addr, _server_addr, _tls);
+    auto f = h2->process(std::move(_upgraded_req), _http2_preface_started);
+    return f.finally([this, h2 = std::move(h2)] {
+        return _write_buf.close().handle_exception([](std::exception_ptr e) {
+            hlogger.debug("Close exception encountered: {}", e);
+        });
+    });
+}
 void connection::shutdown() {
     _fd.shutdown_input();
     _fd.shutdown_output();
@@ -335,7 +521,51 @@ future<> connection::respond() {
             _server._respond_errors++;
         }
         f.ignore_ready_future();
-        return _write_buf.close();
+        // With HTTP/2 the stream stays open for the frames that follow
+        return _http2 ? make_ready_future<>() : _write_buf.close();
+    });
+}
+
+future<> connection::send_file_body() {
+    set_headers(*_resp);
+    _resp->_headers["Content-Length"] = to_sstring(_resp->_file_region->length);
+    _resp->_headers.erase("Transfer-Encoding");
+    return _write_buf.write(_resp->_response_line.data(),
+            _resp->_response_line.size()).then([this] {
+        return _resp->write_reply_headers(*this);
+    }).then([this] {
+        return _write_buf.write("\r\n", 2);
+    }).then([this] {
+        // The headers must reach the socket before the file does
+        return _write_buf.flush();
+    }).then([this] {
+        auto& region = *_resp->_file_region;
+        ++_server._files_sent;
+        return _fd.send_file(region.f, region.offset, region.length);
+    }).finally([this] {
+        return _resp->_file_region->f.close();
+    }).then([this] {
+        _resp.reset();
+    });
+}
+
+future<> connection::send_prerendered() {
+    set_headers(*_resp);
+    // The length is part of the serialized headers
+    _resp->_headers.erase("Content-Length");
+    return _write_buf.write(_resp->_response_line.data(),
+            _resp->_response_line.size()).then([this] {
+        return _resp->write_reply_headers(*this);
+    }).then([this] {
+        return _write_buf.write(_resp->_prerendered->headers.share());
+    }).then([this] {
+        return _write_buf.write("\r\n", 2);
+    }).then([this] {
+        return _write_buf.write(_resp->_prerendered->body.share());
+    }).then([this] {
+        return _write_buf.flush();
+    }).then([this] {
+        _resp.reset();
     });
 }
 
@@ -350,6 +580,15 @@ void connection::set_headers(http::reply& resp) {
 }
 
 future<bool> connection::generate_reply(std::unique_ptr<http::request> req) {
+    bool keep_alive = req->should_keep_alive();
+    return handle_request(std::move(req)).then([this, keep_alive] (std::unique_ptr<http::reply> rep) {
+        // Caller guarantees enough room
+        this->_replies.push(std::move(rep));
+        return make_ready_future<bool>(!keep_alive);
+    });
+}
+
+future<std::unique_ptr<http::reply>> connection::handle_request(std::unique_ptr<http::request> req) {
     auto resp = std::make_unique<http::reply>();
     resp->set_version(req->_version);
     set_headers(*resp);
@@ -360,12 +599,15 @@ future<bool> connection::generate_reply(std::unique_ptr<http::request> req) {
 
     sstring url = req->parse_query_param();
     sstring version = req->_version;
+    sstring method = req->_method;
+    sstring accept_encoding = req->get_header("Accept-Encoding");
     return _server._routes.handle(url, std::move(req), std::move(resp)).
-    // Caller guarantees enough room
-    then([this, keep_alive , version = std::move(version)](std::unique_ptr<http::reply> rep) {
+    then([this, version = std::move(version), method = std::move(method), accept_encoding = std::move(accept_encoding)](std::unique_ptr<http::reply> rep) {
         rep->set_version(version).done();
-        this->_replies.push(std::move(rep));
-        return make_ready_future<bool>(!keep_alive);
+        if (_server._compression) {
+            http::internal::compress_reply(*rep, method, accept_encoding, *_server._compression);
+        }
+        return rep;
     });
 }
 
@@ -389,6 +631,26 @@ void http_server::set_content_streaming(bool b) {
     _content_streaming = b;
 }
 
+size_t http_server::get_pipeline_depth() const {
+    return _pipeline_depth;
+}
+
+void http_server::set_pipeline_depth(size_t depth) {
+    _pipeline_depth = std::max<size_t>(depth, 1);
+}
+
+void http_server::set_admission(std::optional<admission_config> cfg) {
+    _admission = cfg ? make_lw_shared<admission_controller>(*cfg) : nullptr;
+}
+
+const std::optional<http::compression_config>& http_server::get_compression() const {
+    return _compression;
+}
+
+void http_server::set_compression(std::optional<http::compression_config> cfg) {
+    _compression = std::move(cfg);
+}
+
 future<> http_server::listen(socket_address addr, listen_options lo, 
             server_credentials_ptr listener_credentials) {
     if (listener_credentials) {
@@ -478,6 +740,21 @@ uint64_t http_server::read_errors() const {
 uint64_t http_server::reply_errors() const {
     return _respond_errors;
 }
+uint64_t http_server::files_sent() const {
+    return _files_sent;
+}
+
+uint64_t http_server::requests_queued() const {
+    return _admission_stats.queued;
+}
+
+uint64_t http_server::requests_shed() const {
+    return _admission_stats.shed;
+}
+
+uint64_t http_server::parked_connections() const {
+    return _parked_connections;
+}
 
 // Write the current date in the specific "preferred format" defined in
 // RFC 7231, Section 7.1.1.1, a.k.a. IMF (Internet Message Format) fixdate.
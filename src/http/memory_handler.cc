@@ -0,0 +1,110 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <memory>
+#include <vector>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/http/memory_handler.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/json/formatter.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/smp.hh>
+#endif
+
+namespace seastar {
+
+namespace httpd {
+
+// Keys are literals, values go through the json formatter so that strings
+// (the backtraces) are escaped
+static sstring shard_memory_report(bool with_sites) {
+    using json::formatter;
+    fmt::memory_buffer out;
+    auto it = std::back_inserter(out);
+    auto st = memory::stats();
+    it = fmt::format_to(it, R"({{"shard":{},"total_memory":{},"free_memory":{},"small_pools":[)",
+            formatter::to_json(this_shard_id()), formatter::to_json(st.total_memory()), formatter::to_json(st.free_memory()));
+    const char* sep = "";
+    for (auto& sp : memory::get_small_pool_stats()) {
+        it = fmt::format_to(it, R"({}{{"object_size":{},"span_size":{},"objects":{},"memory":{},"unused":{}}})",
+                sep, formatter::to_json(sp.object_size), formatter::to_json(sp.span_size), formatter::to_json(sp.objects_in_use),
+                formatter::to_json(sp.memory), formatter::to_json(sp.unused));
+        sep = ",";
+    }
+    it = fmt::format_to(it, "]");
+    if (with_sites) {
+        it = fmt::format_to(it, R"(,"allocation_sites":[)");
+        sep = "";
+        for (auto& site : memory::sampled_memory_profile()) {
+            it = fmt::format_to(it, R"({}{{"count":{},"size":{},"backtrace":{}}})",
+                    sep, formatter::to_json(site.count), formatter::to_json(site.size),
+                    formatter::to_json(sstring(fmt::to_string(site.backtrace))));
+            sep = ",";
+        }
+        it = fmt::format_to(it, "]");
+    }
+    it = fmt::format_to(it, "}}");
+    return sstring(out.data(), out.size());
+}
+
+future<std::unique_ptr<http::reply>> memory_handler::handle(const sstring& path,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+    bool with_sites = req->get_query_param("sites") != "false";
+    std::vector<unsigned> shards;
+    if (auto shard = req->get_query_param("shard"); !shard.empty()) {
+        unsigned id;
+        try {
+            id = std::stoul(shard);
+        } catch (...) {
+            throw bad_param_exception(fmt::format("Invalid shard {}", shard));
+        }
+        if (id >= smp::count) {
+            throw bad_param_exception(fmt::format("Invalid shard {}", shard));
+        }
+        shards.push_back(id);
+    } else {
+        shards.assign(smp::all_cpus().begin(), smp::all_cpus().end());
+    }
+    std::vector<sstring> reports(shards.size());
+    co_await parallel_for_each(boost::irange<size_t>(0, shards.size()), [&] (size_t i) {
+        return smp::submit_to(shards[i], [with_sites] {
+            return shard_memory_report(with_sites);
+        }).then([&reports, i] (sstring report) {
+            reports[i] = std::move(report);
+        });
+    });
+    rep->write_body("json", fmt::format(R"({{"shards":[{}]}})", fmt::join(reports, ",")));
+    co_return std::move(rep);
+}
+
+}
+
+}
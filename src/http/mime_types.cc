@@ -36,6 +36,7 @@ struct mapping {
         { "txt", "text/plain" },
         { "ico", "image/x-icon" },
         { "bin", "application/octet-stream" },
+        { "xml", "application/xml" },
         { "proto", "application/vnd.google.protobuf; proto=io.prometheus.client.MetricFamily; encoding=delimited"},
 };
 
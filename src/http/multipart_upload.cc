@@ -0,0 +1,170 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <exception>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <boost/range/irange.hpp>
+#include <fmt/core.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/http/multipart_upload.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/util/log.hh>
+#include <seastar/util/short_streams.hh>
+#endif
+
+namespace seastar {
+extern logger http_log;
+namespace http {
+namespace experimental {
+
+namespace {
+
+// Called on the complete request, a signer must see its query and body
+request decorated(const multipart_upload_options& opts, request req) {
+    if (opts.decorate) {
+        opts.decorate(req);
+    }
+    return req;
+}
+
+// Returns the XML response body, since errors of CompleteMultipartUpload
+// may arrive with the 200 status
+future<sstring> send_and_read(client& c, request req) {
+    sstring body;
+    co_await c.make_request(std::move(req), [&body] (const reply&, input_stream<char>&& in) {
+        return do_with(std::move(in), [&body] (input_stream<char>& in) {
+            return util::read_entire_stream_contiguous(in).then([&body] (sstring b) {
+                body = std::move(b);
+            });
+        });
+    }, reply::status_type::ok);
+    co_return body;
+}
+
+sstring xml_element(std::string_view body, std::string_view name) {
+    auto open = fmt::format("<{}>", name);
+    auto start = body.find(open);
+    if (start == std::string_view::npos) {
+        return "";
+    }
+    start += open.size();
+    auto end = body.find(fmt::format("</{}>", name), start);
+    if (end == std::string_view::npos) {
+        return "";
+    }
+    return sstring(body.substr(start, end - start));
+}
+
+}
+
+future<> upload_file(client& c, sstring host, sstring path, file f, multipart_upload_options opts) {
+    if (opts.part_size == 0 || opts.parallelism == 0) {
+        throw std::invalid_argument("multipart upload part size and parallelism must be positive");
+    }
+    auto size = co_await f.size();
+    if (size <= opts.part_size) {
+        auto req = request::make("PUT", host, path);
+        req.write_body("bin", f, 0, size);
+        co_await c.make_request(decorated(opts, std::move(req)), [] (const reply&, input_stream<char>&& in) {
+            return do_with(std::move(in), [] (input_stream<char>& in) {
+                return util::skip_entire_stream(in);
+            });
+        }, reply::status_type::ok);
+        co_return;
+    }
+
+    auto init = request::make("POST", host, path);
+    init.query_parameters["uploads"] = "";
+    auto upload_id = xml_element(co_await send_and_read(c, decorated(opts, std::move(init))), "UploadId");
+    if (upload_id.empty()) {
+        throw std::runtime_error(fmt::format("no UploadId in the response to initiating the upload of {}", path));
+    }
+
+    std::exception_ptr ex;
+    try {
+        auto nr_parts = (size + opts.part_size - 1) / opts.part_size;
+        std::vector<sstring> etags(nr_parts);
+        co_await max_concurrent_for_each(boost::irange<uint64_t>(0, nr_parts), opts.parallelism, [&] (uint64_t part) {
+            auto req = request::make("PUT", host, path);
+            req.query_parameters["partNumber"] = to_sstring(part + 1);
+            req.query_parameters["uploadId"] = upload_id;
+            auto offset = part * opts.part_size;
+            req.write_body("bin", f, offset, std::min(opts.part_size, size - offset));
+            return c.make_request(decorated(opts, std::move(req)), [&etags, part] (const reply& rep, input_stream<char>&& in) {
+                etags[part] = rep.get_header("ETag");
+                return do_with(std::move(in), [] (input_stream<char>& in) {
+                    return util::skip_entire_stream(in);
+                });
+            }, reply::status_type::ok);
+        });
+
+        sstring parts = "<CompleteMultipartUpload>";
+        for (uint64_t part = 0; part < nr_parts; part++) {
+            if (etags[part].empty()) {
+                throw std::runtime_error(fmt::format("no ETag in the response to uploading part {} of {}", part + 1, path));
+            }
+            parts += fmt::format("<Part><PartNumber>{}</PartNumber><ETag>{}</ETag></Part>", part + 1, etags[part]);
+        }
+        parts += "</CompleteMultipartUpload>";
+
+        auto complete = request::make("POST", host, path);
+        complete.query_parameters["uploadId"] = upload_id;
+        complete.write_body("xml", std::move(parts));
+        auto body = co_await send_and_read(c, decorated(opts, std::move(complete)));
+        if (body.find("<Error>") != sstring::npos) {
+            throw std::runtime_error(fmt::format("completing the upload of {} failed: {}", path, xml_element(body, "Message")));
+        }
+        co_return;
+    } catch (...) {
+        ex = std::current_exception();
+    }
+
+    http_log.debug("Aborting upload {} of {}: {}", upload_id, path, ex);
+    auto abort = request::make("DELETE", host, path);
+    abort.query_parameters["uploadId"] = upload_id;
+    try {
+        co_await c.make_request(decorated(opts, std::move(abort)), [] (const reply&, input_stream<char>&& in) {
+            return do_with(std::move(in), [] (input_stream<char>& in) {
+                return util::skip_entire_stream(in);
+            });
+        });
+    } catch (...) {
+        http_log.debug("Failed to abort upload {} of {}: {}", upload_id, path, std::current_exception());
+    }
+    std::rethrow_exception(ex);
+}
+
+} // experimental namespace
+} // http namespace
+} // seastar namespace
@@ -40,6 +40,7 @@ module seastar;
 #include <seastar/http/httpd.hh>
 #include <seastar/http/common.hh>
 #include <seastar/http/response_parser.hh>
+#include <seastar/core/fstream.hh>
 #include <seastar/core/loop.hh>
 #endif
 
@@ -79,6 +80,7 @@ const sstring length_required = "411 Length Required";
 const sstring payload_too_large = "413 Payload Too Large";
 const sstring uri_too_long = "414 URI Too Long";
 const sstring unsupported_media_type = "415 Unsupported Media Type";
+const sstring range_not_satisfiable = "416 Range Not Satisfiable";
 const sstring expectation_failed = "417 Expectation Failed";
 const sstring unprocessable_entity = "422 Unprocessable Entity";
 const sstring upgrade_required = "426 Upgrade Required";
@@ -153,6 +155,8 @@ static const sstring& to_string(reply::status_type status) {
         return uri_too_long;
     case reply::status_type::unsupported_media_type:
         return unsupported_media_type;
+    case reply::status_type::range_not_satisfiable:
+        return range_not_satisfiable;
     case reply::status_type::expectation_failed:
         return expectation_failed;
     case reply::status_type::unprocessable_entity:
@@ -199,6 +203,23 @@ void reply::write_body(const sstring& content_type, sstring content) {
     done(content_type);
 }
 
+void reply::write_body(const sstring& content_type, file f, uint64_t offset, uint64_t length) {
+    write_body(content_type, [f, offset, length] (output_stream<char>&& out) {
+        return do_with(std::move(out), make_file_input_stream(f, offset, length), [] (output_stream<char>& os, input_stream<char>& is) {
+            return copy(is, os).then([&os] {
+                return os.close();
+            }).finally([&is] {
+                return is.close();
+            });
+        });
+    });
+    _file_region = file_region{std::move(f), offset, length};
+}
+
+void reply::write_prerendered(temporary_buffer<char> headers, temporary_buffer<char> body) {
+    _prerendered = prerendered{std::move(headers), std::move(body)};
+}
+
 future<> reply::write_reply_to_connection(httpd::connection& con) {
     add_header("Transfer-Encoding", "chunked");
     return con.out().write(response_line()).then([this, &con] () mutable {
@@ -24,12 +24,17 @@ module;
 #endif
 
 #include <cassert>
+#include <stdexcept>
 #include <string_view>
 #include <utility>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/net/api.hh>
 #include <seastar/http/request.hh>
 #include <seastar/http/url.hh>
 #include <seastar/http/common.hh>
@@ -116,6 +121,105 @@ void request::write_body(const sstring& content_type, size_t len, noncopyable_fu
     this->body_writer = std::move(body_writer);
 }
 
+struct request::file_body {
+    file f;
+    uint64_t offset;
+    uint64_t len;
+
+    static constexpr size_t read_size = 128 * 1024;
+    static constexpr unsigned read_ahead = 4;
+
+    input_stream<char> make_input_stream() const {
+        return make_file_input_stream(f, offset, len, file_input_stream_options{ .buffer_size = read_size, .read_ahead = read_ahead });
+    }
+
+    // Writes the body to a stream, without copying the buffers when it is
+    // flushed and allows it
+    future<> write(output_stream<char>& out) const {
+        auto in = make_input_stream();
+        uint64_t written = 0;
+        std::exception_ptr ex;
+        try {
+            while (true) {
+                auto buf = co_await in.read();
+                if (buf.empty()) {
+                    break;
+                }
+                written += buf.size();
+                co_await out.write(std::move(buf));
+            }
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await in.close();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+        if (written != len) {
+            throw std::runtime_error(format("partial request body write, need {} sent {}", len, written));
+        }
+    }
+
+    // Writes the body to a stream of a connection that can't take the file as
+    // is, see send_file_body()
+    static noncopyable_function<future<>(output_stream<char>&&)> make_writer(std::shared_ptr<file_body> fb) {
+        return [fb = std::move(fb)] (output_stream<char>&& out) -> future<> {
+            output_stream<char> o = std::move(out);
+            std::exception_ptr ex;
+            try {
+                auto in = fb->make_input_stream();
+                co_await seastar::copy(in, o).finally([&in] {
+                    return in.close();
+                });
+                co_await o.flush();
+            } catch (...) {
+                ex = std::current_exception();
+            }
+            co_await o.close();
+            if (ex) {
+                std::rethrow_exception(ex);
+            }
+        };
+    }
+};
+
+void request::write_body(const sstring& content_type, file f, uint64_t offset, uint64_t len) {
+    set_content_type(content_type);
+    content_length = len;
+    _file_body = std::make_shared<file_body>(file_body{std::move(f), offset, len});
+    this->body_writer = file_body::make_writer(_file_body);
+}
+
+request request::copy() const {
+    assert(can_copy());
+    request rq;
+    rq._method = _method;
+    rq._url = _url;
+    rq._version = _version;
+    rq.content_type_class = content_type_class;
+    rq.content_length = content_length;
+    rq._headers = _headers;
+    rq.query_parameters = query_parameters;
+    rq.content = content;
+    rq.protocol_name = protocol_name;
+    if (_file_body) {
+        rq._file_body = _file_body;
+        rq.body_writer = file_body::make_writer(_file_body);
+    }
+    return rq;
+}
+
+future<> request::send_file_body(connected_socket& cs, output_stream<char>& out) const {
+    auto fb = _file_body;
+    co_await out.flush();
+    if (cs.can_send_file(fb->f)) {
+        co_await cs.send_file(fb->f, fb->offset, fb->len);
+    } else {
+        co_await fb->write(out);
+    }
+    _bytes_written = fb->len;
+}
+
 void request::set_expects_continue() {
     _headers["Expect"] = "100-continue";
 }
@@ -0,0 +1,249 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/http/internal/request_head_parser.hh>
+#include <seastar/http/request.hh>
+#endif
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+namespace {
+
+// The two delimiter classes the head is scanned for. A URI ends at a space,
+// a field value at the CR of its line; both stop at control characters, so
+// that the full parser gets to reject (or accept) the unusual cases.
+enum class token { uri, value };
+
+template <token T>
+bool is_delimiter(uint8_t c) noexcept {
+    if constexpr (T == token::uri) {
+        return c <= ' ' || c == 0x7f;
+    } else {
+        return (c < ' ' && c != '\t') || c == 0x7f;
+    }
+}
+
+template <token T>
+const char* scan_scalar(const char* p, const char* end) noexcept {
+    while (p != end && !is_delimiter<T>(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+#if defined(__x86_64__)
+
+// Bytes up to a bound, except tab for values, and DEL are delimiters. The
+// comparison is unsigned (v == min(v, bound)), so obs-text passes. URIs
+// have no exception, DEL stands in for it as it is matched anyway.
+
+template <token T>
+const char* scan_sse2(const char* p, const char* end) noexcept {
+    auto bound = _mm_set1_epi8(T == token::uri ? ' ' : ' ' - 1);
+    auto tab = _mm_set1_epi8(T == token::uri ? 0x7f : '\t');
+    auto del = _mm_set1_epi8(0x7f);
+    while (end - p >= 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(_mm_min_epu8(v, bound), v));
+        auto mask = _mm_movemask_epi8(_mm_or_si128(ctl, _mm_cmpeq_epi8(v, del)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return scan_scalar<T>(p, end);
+}
+
+template <token T>
+[[gnu::target("avx2")]]
+const char* scan_avx2(const char* p, const char* end) noexcept {
+    auto bound = _mm256_set1_epi8(T == token::uri ? ' ' : ' ' - 1);
+    auto tab = _mm256_set1_epi8(T == token::uri ? 0x7f : '\t');
+    auto del = _mm256_set1_epi8(0x7f);
+    while (end - p >= 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        auto ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), _mm256_cmpeq_epi8(_mm256_min_epu8(v, bound), v));
+        auto mask = unsigned(_mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, del))));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return scan_sse2<T>(p, end);
+}
+
+#endif
+
+using scan_kernel = const char* (*)(const char* p, const char* end) noexcept;
+
+struct scan_kernels {
+    scan_kernel uri = scan_scalar<token::uri>;
+    scan_kernel value = scan_scalar<token::value>;
+};
+
+scan_kernels select_kernels() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {scan_avx2<token::uri>, scan_avx2<token::value>};
+    }
+    return {scan_sse2<token::uri>, scan_sse2<token::value>};
+#endif
+    return {};
+}
+
+const scan_kernels kernels = select_kernels();
+
+// RFC 9110, section 5.6.2
+constexpr std::array<bool, 256> tchars = [] {
+    std::array<bool, 256> ret{};
+    for (int c = '0'; c <= '9'; c++) {
+        ret[c] = true;
+    }
+    for (int c = 'a'; c <= 'z'; c++) {
+        ret[c] = true;
+        ret[c - 'a' + 'A'] = true;
+    }
+    for (char c : std::string_view("!#$%&'*+-.^_`|~")) {
+        ret[uint8_t(c)] = true;
+    }
+    return ret;
+}();
+
+bool is_digit(char c) noexcept {
+    return c >= '0' && c <= '9';
+}
+
+bool is_crlf(const char* p, const char* end) noexcept {
+    return end - p >= 2 && p[0] == '\r' && p[1] == '\n';
+}
+
+struct field {
+    std::string_view name;
+    std::string_view value;
+};
+
+// Fields are collected before anything is copied into the request, so that
+// a head can still be handed to the full parser half way through
+constexpr size_t max_fields = 64;
+
+sstring to_sstring(std::string_view s) {
+    return sstring(s.data(), s.size());
+}
+
+}
+
+const char* parse_request_head(const char* p, const char* end, request& req) {
+    auto method = p;
+    while (p != end && *p >= 'A' && *p <= 'Z') {
+        ++p;
+    }
+    if (p == method || p == end || *p != ' ') {
+        return nullptr;
+    }
+    auto method_end = p++;
+
+    auto url = p;
+    p = kernels.uri(p, end);
+    if (p == url || p == end || *p != ' ') {
+        return nullptr;
+    }
+    auto url_end = p++;
+
+    constexpr std::string_view http = "HTTP/";
+    if (end - p < 10 || std::memcmp(p, http.data(), http.size())
+            || !is_digit(p[5]) || p[6] != '.' || !is_digit(p[7]) || !is_crlf(p + 8, end)) {
+        return nullptr;
+    }
+    auto version = p + 5;
+    p += 10;
+
+    std::array<field, max_fields> fields;
+    size_t nr_fields = 0;
+    while (!is_crlf(p, end)) {
+        if (nr_fields == max_fields) {
+            return nullptr;
+        }
+        auto name = p;
+        while (p != end && tchars[uint8_t(*p)]) {
+            ++p;
+        }
+        if (p == name || p == end || *p != ':') {
+            return nullptr;
+        }
+        auto name_end = p++;
+        while (p != end && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        auto value = p;
+        p = kernels.value(p, end);
+        if (!is_crlf(p, end)) {
+            return nullptr;
+        }
+        auto value_end = p;
+        while (value_end != value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            --value_end;
+        }
+        p += 2;
+        if (p != end && (*p == ' ' || *p == '\t')) {
+            // obs-fold
+            return nullptr;
+        }
+        fields[nr_fields++] = {{name, size_t(name_end - name)}, {value, size_t(value_end - value)}};
+    }
+
+    req._method = sstring(method, method_end);
+    req._url = sstring(url, url_end);
+    req._version = sstring(version, 3);
+    for (size_t i = 0; i < nr_fields; i++) {
+        auto [it, inserted] = req._headers.try_emplace(to_sstring(fields[i].name), to_sstring(fields[i].value));
+        if (!inserted) {
+            // Combined as by the full parser, RFC 7230, section 3.2.2
+            it->second += sstring(",") + to_sstring(fields[i].value);
+        }
+    }
+    return p + 2;
+}
+
+}
+
+}
+
+}
@@ -25,6 +25,7 @@
 #include <memory>
 #include <unordered_map>
 #include <seastar/http/request.hh>
+#include <seastar/http/internal/request_head_parser.hh>
 
 namespace seastar {
 
@@ -133,14 +134,25 @@ public:
     sstring _field_name;
     sstring _value;
     state _state;
+    // Until the first buffer was looked at
+    bool _fast_path;
 public:
     void init() {
         init_base();
         _req.reset(new http::request());
         _state = state::eof;
+        _fast_path = true;
         %% write init;
     }
     char* parse(char* p, char* pe, char* eof) {
+        if (_fast_path && p != pe) {
+            // Most requests arrive in one piece
+            _fast_path = false;
+            if (auto end = http::internal::parse_request_head(p, pe, *_req)) {
+                _state = state::done;
+                return p + (end - p);
+            }
+        }
         sstring_builder::guard g(_builder, p, pe);
         [[maybe_unused]] auto str = [this, &g, &p] { g.mark_end(p); return get_str(); };
         bool done = false;
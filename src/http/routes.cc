@@ -22,9 +22,17 @@
 #ifdef SEASTAR_MODULE
 module;
 #include <exception>
+#include <limits>
 #include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <boost/container/small_vector.hpp>
 module seastar;
 #else
+#include <limits>
+#include <string_view>
+#include <boost/container/small_vector.hpp>
 #include <seastar/http/routes.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/http/request.hh>
@@ -38,6 +46,195 @@ namespace httpd {
 
 using namespace std;
 
+namespace internal {
+
+// The rules of an operation, compiled into a trie of path segments.
+//
+// A URL starting with a slash is split at slashes. A string matcher then
+// consumes the segments of its string and a parameter matcher one segment,
+// while a remainder parameter takes what is left. Since rules are tried
+// in order, a lookup walks all the branches that match and keeps the
+// earliest rule, skipping subtrees that only hold later ones. The rule
+// found fills the parameters itself.
+//
+// Rules with other matchers, or with strings that don't split into
+// segments, are checked one by one, before the trie's rule if they were
+// added earlier, as are all rules for URLs without a leading slash.
+class route_trie {
+    using cookie = routes::rule_cookie;
+    static constexpr cookie none = std::numeric_limits<cookie>::max();
+
+    struct target {
+        cookie c = none;
+        match_rule* rule = nullptr;
+
+        void offer(const target& t) noexcept {
+            if (t.c < c) {
+                *this = t;
+            }
+        }
+    };
+    struct node {
+        // Keys point into the string matchers of the rules
+        std::unordered_map<std::string_view, std::unique_ptr<node>> children;
+        std::unique_ptr<node> param;
+        // The earliest rule ending here, and the earliest one whose
+        // remainder parameter starts here
+        target end;
+        target remainder;
+        // The earliest cookie in the subtree
+        cookie first = none;
+    };
+    struct rule_entry {
+        cookie c;
+        match_rule* rule;
+        bool compiled;
+    };
+    using segments = boost::container::small_vector<std::string_view, 16>;
+
+    node _root;
+    std::vector<rule_entry> _rules;
+private:
+    bool insert(cookie c, match_rule* rule);
+    void lookup(const node& n, const segments& segs, size_t i, target& best) const;
+public:
+    explicit route_trie(const std::map<cookie, match_rule*>& rules);
+    handler_base* get(const sstring& url, parameters& params) const;
+};
+
+// Splits a string matcher into segments, or returns false if it doesn't
+// start with a slash or has empty segments
+static bool split_segments(std::string_view s, std::vector<std::string_view>& segs) {
+    if (s.size() < 2 || s[0] != '/' || s.back() == '/') {
+        return false;
+    }
+    s.remove_prefix(1);
+    while (true) {
+        auto pos = s.find('/');
+        auto seg = s.substr(0, pos);
+        if (seg.empty()) {
+            return false;
+        }
+        segs.push_back(seg);
+        if (pos == std::string_view::npos) {
+            return true;
+        }
+        s.remove_prefix(pos + 1);
+    }
+}
+
+bool route_trie::insert(cookie c, match_rule* rule) {
+    auto& matchers = rule->matchers();
+    if (matchers.empty()) {
+        return false;
+    }
+    // Validate the whole rule before adding any node
+    struct step {
+        std::string_view segment;
+        bool param;
+    };
+    std::vector<step> steps;
+    bool remainder = false;
+    for (size_t i = 0; i < matchers.size(); i++) {
+        if (auto str = dynamic_cast<const str_matcher*>(matchers[i])) {
+            std::vector<std::string_view> segs;
+            if (!split_segments(str->str(), segs)) {
+                return false;
+            }
+            for (auto seg : segs) {
+                steps.push_back({seg, false});
+            }
+        } else if (auto param = dynamic_cast<const param_matcher*>(matchers[i])) {
+            if (param->entire_path()) {
+                if (i + 1 != matchers.size()) {
+                    return false;
+                }
+                remainder = true;
+            } else {
+                steps.push_back({{}, true});
+            }
+        } else {
+            return false;
+        }
+    }
+
+    node* n = &_root;
+    n->first = std::min(n->first, c);
+    for (auto& s : steps) {
+        auto& next = s.param ? n->param : n->children[s.segment];
+        if (!next) {
+            next = std::make_unique<node>();
+        }
+        n = next.get();
+        n->first = std::min(n->first, c);
+    }
+    (remainder ? n->remainder : n->end).offer({c, rule});
+    return true;
+}
+
+route_trie::route_trie(const std::map<cookie, match_rule*>& rules) {
+    _rules.reserve(rules.size());
+    for (auto& [c, rule] : rules) {
+        _rules.push_back({c, rule, insert(c, rule)});
+    }
+}
+
+void route_trie::lookup(const node& n, const segments& segs, size_t i, target& best) const {
+    if (n.first >= best.c) {
+        return;
+    }
+    best.offer(n.remainder);
+    // As with the matchers, a trailing slash is ignored
+    if (i == segs.size() || (i + 1 == segs.size() && segs[i].empty())) {
+        best.offer(n.end);
+    }
+    if (i == segs.size()) {
+        return;
+    }
+    if (auto it = n.children.find(segs[i]); it != n.children.end()) {
+        lookup(*it->second, segs, i + 1, best);
+    }
+    if (n.param) {
+        lookup(*n.param, segs, i + 1, best);
+    }
+}
+
+handler_base* route_trie::get(const sstring& url, parameters& params) const {
+    target best;
+    bool compiled = !url.empty() && url[0] == '/';
+    if (compiled) {
+        segments segs;
+        std::string_view rest(url.data() + 1, url.size() - 1);
+        while (true) {
+            auto pos = rest.find('/');
+            segs.push_back(rest.substr(0, pos));
+            if (pos == std::string_view::npos) {
+                break;
+            }
+            rest.remove_prefix(pos + 1);
+        }
+        lookup(_root, segs, 0, best);
+    }
+    for (auto& r : _rules) {
+        if (r.c >= best.c) {
+            break;
+        }
+        if (r.compiled && compiled) {
+            continue;
+        }
+        if (auto handler = r.rule->get(url, params)) {
+            return handler;
+        }
+        params.clear();
+    }
+    if (best.rule) {
+        return best.rule->get(url, params);
+    }
+    return nullptr;
+}
+
+}
+
 routes::routes() : _general_handler([this](std::exception_ptr eptr) mutable {
     return exception_reply(eptr);
 }) {}
@@ -120,12 +317,14 @@ handler_base* routes::get_handler(operation_type type, const sstring& url,
         return handler;
     }
 
-    for (auto&& rule : _rules[type]) {
-        handler = rule.second->get(url, params);
-        if (handler != nullptr) {
-            return handler;
-        }
-        params.clear();
+    auto& trie = _tries[type];
+    if (!trie || _stale[type]) {
+        trie = std::make_unique<internal::route_trie>(_rules[type]);
+        _stale[type] = false;
+    }
+    handler = trie->get(url, params);
+    if (handler != nullptr) {
+        return handler;
     }
     return _default_handler;
 }
@@ -159,7 +358,9 @@ static auto delete_rule_from(operation_type type, Key& key, Map& map) {
 }
 
 handler_base* routes::drop(operation_type type, const sstring& url) {
-    return delete_rule_from(type, url, _map);
+    auto handler = delete_rule_from(type, url, _map);
+    _admission.erase(handler);
+    return handler;
 }
 
 routes& routes::put(operation_type type, const sstring& url, handler_base* handler) {
@@ -171,7 +372,30 @@ routes& routes::put(operation_type type, const sstring& url, handler_base* handl
 }
 
 match_rule* routes::del_cookie(rule_cookie cookie, operation_type type) {
-    return delete_rule_from(type, cookie, _rules);
+    _stale[type] = true;
+    auto rule = delete_rule_from(type, cookie, _rules);
+    if (rule) {
+        _admission.erase(rule->handler());
+    }
+    return rule;
+}
+
+routes& routes::set_admission(handler_base* handler, std::optional<admission_config> cfg) {
+    if (cfg) {
+        _admission[handler] = make_lw_shared<admission_controller>(*cfg);
+    } else {
+        _admission.erase(handler);
+    }
+    return *this;
+}
+
+lw_shared_ptr<admission_controller> routes::get_admission(operation_type type, const sstring& url) {
+    if (_admission.empty()) {
+        return nullptr;
+    }
+    parameters params;
+    auto it = _admission.find(get_handler(type, normalize_url(url), params));
+    return it == _admission.end() ? nullptr : it->second;
 }
 
 void routes::add_alias(const path_description& old_path, const path_description& new_path) {
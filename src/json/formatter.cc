@@ -25,16 +25,17 @@ module;
 
 #include <cmath>
 #include <algorithm>
-#include <iomanip>
-#include <ios>
-#include <sstream>
+#include <array>
+#include <charconv>
 #include <string_view>
+#include <fmt/format.h>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
 #include <seastar/json/formatter.hh>
 #include <seastar/json/json_elements.hh>
+#include <seastar/core/iostream.hh>
 #endif
 
 namespace seastar {
@@ -69,48 +70,99 @@ static bool needs_escaping(const string_view& str) {
     });
 }
 
-static sstring string_view_to_json(const string_view& str) {
-    if (!needs_escaping(str)) {
-        return format("\"{}\"", str);
-    }
-
-    ostringstream oss;
-    oss << std::hex << std::uppercase << std::setfill('0');
-    oss.put('"');
+// Length of the escaped form of str, without the quotes
+static size_t escaped_size(const string_view& str) {
+    size_t n = 0;
     for (char c : str) {
         switch (c) {
-        case '"':
-            oss.put('\\').put('"');
-            break;
-        case '\\':
-            oss.put('\\').put('\\');
-            break;
-        case '\b':
-            oss.put('\\').put('b');
-            break;
-        case '\f':
-            oss.put('\\').put('f');
-            break;
-        case '\n':
-            oss.put('\\').put('n');
+        case '"': case '\\': case '\b': case '\f': case '\n': case '\r': case '\t':
+            n += 2;
             break;
-        case '\r':
-            oss.put('\\').put('r');
-            break;
-        case '\t':
-            oss.put('\\').put('t');
+        default:
+            n += is_control_char(c) ? 6 : 1;
             break;
+        }
+    }
+    return n;
+}
+
+static char* escape(const string_view& str, char* out) {
+    static constexpr char hex[] = "0123456789ABCDEF";
+    for (char c : str) {
+        switch (c) {
+        case '"': *out++ = '\\'; *out++ = '"'; break;
+        case '\\': *out++ = '\\'; *out++ = '\\'; break;
+        case '\b': *out++ = '\\'; *out++ = 'b'; break;
+        case '\f': *out++ = '\\'; *out++ = 'f'; break;
+        case '\n': *out++ = '\\'; *out++ = 'n'; break;
+        case '\r': *out++ = '\\'; *out++ = 'r'; break;
+        case '\t': *out++ = '\\'; *out++ = 't'; break;
         default:
             if (is_control_char(c)) {
-                oss.put('\\').put('u') << std::setw(4) << static_cast<int>(c);
+                *out++ = '\\';
+                *out++ = 'u';
+                *out++ = '0';
+                *out++ = '0';
+                *out++ = hex[(c >> 4) & 0xf];
+                *out++ = hex[c & 0xf];
             } else {
-                oss.put(c);
+                *out++ = c;
             }
             break;
         }
     }
-    oss.put('"');
-    return oss.str();
+    return out;
+}
+
+static sstring string_view_to_json(const string_view& str) {
+    bool escaping = needs_escaping(str);
+    auto len = escaping ? escaped_size(str) : str.size();
+    auto res = uninitialized_string(len + 2);
+    auto out = res.data();
+    *out++ = '"';
+    out = escaping ? escape(str, out) : std::copy(str.begin(), str.end(), out);
+    *out = '"';
+    return res;
+}
+
+static future<> write_string(output_stream<char>& s, const string_view& str) {
+    // output_stream copies the data before write() returns, so short strings
+    // are quoted and escaped on the stack. Longer ones are rare enough to
+    // pay for a temporary
+    std::array<char, 256> buf;
+    bool escaping = needs_escaping(str);
+    auto len = escaping ? escaped_size(str) : str.size();
+    if (len + 2 > buf.size()) {
+        return s.write(string_view_to_json(str));
+    }
+    auto out = buf.data();
+    *out++ = '"';
+    out = escaping ? escape(str, out) : std::copy(str.begin(), str.end(), out);
+    *out++ = '"';
+    return s.write(buf.data(), out - buf.data());
+}
+
+// Big enough for any integer and for the shortest round trip form of any
+// double
+using number_buffer = std::array<char, 32>;
+
+template <typename T>
+static std::string_view format_integer(number_buffer& buf, T n) {
+    auto res = std::to_chars(buf.data(), buf.data() + buf.size(), n);
+    return {buf.data(), size_t(res.ptr - buf.data())};
+}
+
+template <typename T>
+static std::string_view format_floating(number_buffer& buf, T f, const char* type) {
+    if (std::isinf(f)) {
+        throw out_of_range(fmt::format("Infinite {} value is not supported", type));
+    } else if (std::isnan(f)) {
+        throw invalid_argument(fmt::format("Invalid {} value", type));
+    }
+    // fmt's default formatting is the shortest representation that round
+    // trips, as to_sstring() produced
+    auto res = fmt::format_to_n(buf.data(), buf.size(), "{}", f);
+    return {buf.data(), res.size};
 }
 
 sstring formatter::to_json(const sstring& str) {
@@ -126,33 +178,28 @@ sstring formatter::to_json(const char* str, size_t len) {
 }
 
 sstring formatter::to_json(int n) {
-    return to_string(n);
+    number_buffer buf;
+    return sstring(format_integer(buf, n));
 }
 
 sstring formatter::to_json(unsigned n) {
-    return to_string(n);
+    number_buffer buf;
+    return sstring(format_integer(buf, n));
 }
 
 sstring formatter::to_json(long n) {
-    return to_string(n);
+    number_buffer buf;
+    return sstring(format_integer(buf, n));
 }
 
 sstring formatter::to_json(float f) {
-    if (std::isinf(f)) {
-        throw out_of_range("Infinite float value is not supported");
-    } else if (std::isnan(f)) {
-        throw invalid_argument("Invalid float value");
-    }
-    return to_sstring(f);
+    number_buffer buf;
+    return sstring(format_floating(buf, f, "float"));
 }
 
 sstring formatter::to_json(double d) {
-    if (std::isinf(d)) {
-        throw out_of_range("Infinite double value is not supported");
-    } else if (std::isnan(d)) {
-        throw invalid_argument("Invalid double value");
-    }
-    return to_sstring(d);
+    number_buffer buf;
+    return sstring(format_floating(buf, d, "double"));
 }
 
 sstring formatter::to_json(bool b) {
@@ -178,7 +225,56 @@ sstring formatter::to_json(const jsonable& obj) {
 }
 
 sstring formatter::to_json(unsigned long l) {
-    return to_string(l);
+    number_buffer buf;
+    return sstring(format_integer(buf, l));
+}
+
+future<> formatter::write(output_stream<char>& s, const sstring& str) {
+    return write_string(s, str);
+}
+
+future<> formatter::write(output_stream<char>& s, const char* str) {
+    return write_string(s, str);
+}
+
+future<> formatter::write(output_stream<char>& s, int n) {
+    number_buffer buf;
+    auto str = format_integer(buf, n);
+    return s.write(str.data(), str.size());
+}
+
+future<> formatter::write(output_stream<char>& s, unsigned n) {
+    number_buffer buf;
+    auto str = format_integer(buf, n);
+    return s.write(str.data(), str.size());
+}
+
+future<> formatter::write(output_stream<char>& s, long n) {
+    number_buffer buf;
+    auto str = format_integer(buf, n);
+    return s.write(str.data(), str.size());
+}
+
+future<> formatter::write(output_stream<char>& s, unsigned long n) {
+    number_buffer buf;
+    auto str = format_integer(buf, n);
+    return s.write(str.data(), str.size());
+}
+
+future<> formatter::write(output_stream<char>& s, float f) {
+    number_buffer buf;
+    auto str = format_floating(buf, f, "float");
+    return s.write(str.data(), str.size());
+}
+
+future<> formatter::write(output_stream<char>& s, double d) {
+    number_buffer buf;
+    auto str = format_floating(buf, d, "double");
+    return s.write(str.data(), str.size());
+}
+
+future<> formatter::write(output_stream<char>& s, bool b) {
+    return b ? s.write("true", 4) : s.write("false", 5);
 }
 
 }
@@ -127,7 +127,12 @@ class json_stream_builder {
                 return add(name, element);
             });
         }
-        return _s.write(((first)? '"' + name : ",\"" + name) + "\":").then([this, &element] {
+        // The name outlives the writes, so it's not copied into a temporary
+        return _s.write(first ? "\"" : ",\"").then([this, &name] {
+            return _s.write(name.data(), name.size());
+        }).then([this] {
+            return _s.write("\":");
+        }).then([this, &element] {
             first = false;
             return element.write(_s);
         });
@@ -0,0 +1,428 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/json/stream_parser.hh>
+#include <seastar/core/coroutine.hh>
+#endif
+
+namespace seastar {
+
+namespace json {
+
+static bool is_whitespace(char c) noexcept {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_number_char(char c) noexcept {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static bool is_digit(char c) noexcept {
+    return c >= '0' && c <= '9';
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool is_valid_number(std::string_view s) noexcept {
+    auto p = s.begin();
+    auto e = s.end();
+    auto digits = [&] {
+        auto start = p;
+        p = std::find_if_not(p, e, is_digit);
+        return p != start;
+    };
+    if (p != e && *p == '-') {
+        ++p;
+    }
+    if (p != e && *p == '0') {
+        ++p;
+    } else if (!digits()) {
+        return false;
+    }
+    if (p != e && *p == '.') {
+        ++p;
+        if (!digits()) {
+            return false;
+        }
+    }
+    if (p != e && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p != e && (*p == '+' || *p == '-')) {
+            ++p;
+        }
+        if (!digits()) {
+            return false;
+        }
+    }
+    return p == e;
+}
+
+static void append_utf8(std::string& s, uint32_t cp) {
+    if (cp < 0x80) {
+        s.push_back(char(cp));
+    } else if (cp < 0x800) {
+        s.push_back(char(0xc0 | (cp >> 6)));
+        s.push_back(char(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+        s.push_back(char(0xe0 | (cp >> 12)));
+        s.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+        s.push_back(char(0x80 | (cp & 0x3f)));
+    } else {
+        s.push_back(char(0xf0 | (cp >> 18)));
+        s.push_back(char(0x80 | ((cp >> 12) & 0x3f)));
+        s.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+        s.push_back(char(0x80 | (cp & 0x3f)));
+    }
+}
+
+stream_parser::stream_parser(input_stream<char>& in, config cfg)
+        : _in(in), _cfg(cfg) {
+}
+
+void stream_parser::fail(std::string_view what) const {
+    throw parse_error(fmt::format("{} at offset {}", what, _offset));
+}
+
+void stream_parser::consume(size_t n) noexcept {
+    _buf.trim_front(n);
+    _offset += n;
+}
+
+void stream_parser::check_size() const {
+    if (_scratch.size() > _cfg.max_token_size) {
+        fail("token too long");
+    }
+}
+
+void stream_parser::push(char c) {
+    if (_stack.size() >= _cfg.max_depth) {
+        fail("nesting too deep");
+    }
+    _stack.push_back(c);
+}
+
+void stream_parser::pop() noexcept {
+    _stack.pop_back();
+}
+
+void stream_parser::value_done() noexcept {
+    _state = _stack.empty() ? state::done : state::comma_or_end;
+}
+
+future<bool> stream_parser::fill() {
+    if (_eof) {
+        co_return false;
+    }
+    _buf = co_await _in.read();
+    _eof = _buf.empty();
+    co_return !_eof;
+}
+
+future<char> stream_parser::get_char() {
+    if (_buf.empty() && !co_await fill()) {
+        fail("unexpected end of input");
+    }
+    char c = _buf[0];
+    consume(1);
+    co_return c;
+}
+
+future<std::string_view> stream_parser::parse_string() {
+    auto read_code_unit = [this] () -> future<uint32_t> {
+        uint32_t cu = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = co_await get_char();
+            cu <<= 4;
+            if (c >= '0' && c <= '9') {
+                cu |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                cu |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                cu |= c - 'A' + 10;
+            } else {
+                fail("invalid \\u escape");
+            }
+        }
+        co_return cu;
+    };
+
+    // The opening quote
+    consume(1);
+    bool copied = false;
+    for (;;) {
+        if (_buf.empty() && !co_await fill()) {
+            fail("unterminated string");
+        }
+        auto b = _buf.get();
+        auto e = b + _buf.size();
+        auto p = std::find_if(b, e, [] (char c) {
+            return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+        });
+        if (p == e || *p != '"') {
+            _scratch.append(b, p);
+            copied = true;
+            consume(p - b);
+            check_size();
+            if (p == e) {
+                continue;
+            }
+        } else if (!copied) {
+            // The common case, the string is in the buffer as is
+            std::string_view v(b, p - b);
+            consume(p - b + 1);
+            if (v.size() > _cfg.max_token_size) {
+                fail("token too long");
+            }
+            co_return v;
+        } else {
+            _scratch.append(b, p);
+            consume(p - b + 1);
+            check_size();
+            co_return std::string_view(_scratch);
+        }
+        if (*p != '\\') {
+            fail("control character in string");
+        }
+        consume(1);
+        switch (co_await get_char()) {
+        case '"': _scratch.push_back('"'); break;
+        case '\\': _scratch.push_back('\\'); break;
+        case '/': _scratch.push_back('/'); break;
+        case 'b': _scratch.push_back('\b'); break;
+        case 'f': _scratch.push_back('\f'); break;
+        case 'n': _scratch.push_back('\n'); break;
+        case 'r': _scratch.push_back('\r'); break;
+        case 't': _scratch.push_back('\t'); break;
+        case 'u': {
+            auto cp = co_await read_code_unit();
+            if (cp >= 0xdc00 && cp <= 0xdfff) {
+                fail("unpaired surrogate in \\u escape");
+            }
+            if (cp >= 0xd800 && cp <= 0xdbff) {
+                char backslash = co_await get_char();
+                char u = co_await get_char();
+                if (backslash != '\\' || u != 'u') {
+                    fail("unpaired surrogate in \\u escape");
+                }
+                auto low = co_await read_code_unit();
+                if (low < 0xdc00 || low > 0xdfff) {
+                    fail("unpaired surrogate in \\u escape");
+                }
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+            }
+            append_utf8(_scratch, cp);
+            break;
+        }
+        default:
+            fail("invalid escape");
+        }
+    }
+}
+
+future<std::string_view> stream_parser::parse_number() {
+    bool copied = false;
+    // A number is only terminated by the character after it, or by the end
+    // of the input
+    for (;;) {
+        if (_buf.empty() && !co_await fill()) {
+            break;
+        }
+        auto b = _buf.get();
+        auto e = b + _buf.size();
+        auto p = std::find_if_not(b, e, is_number_char);
+        if (p != e && !copied) {
+            std::string_view v(b, p - b);
+            consume(p - b);
+            if (v.size() > _cfg.max_token_size) {
+                fail("token too long");
+            }
+            if (!is_valid_number(v)) {
+                fail("invalid number");
+            }
+            co_return v;
+        }
+        _scratch.append(b, p);
+        copied = true;
+        consume(p - b);
+        check_size();
+        if (p != e) {
+            break;
+        }
+    }
+    if (!is_valid_number(_scratch)) {
+        fail("invalid number");
+    }
+    co_return std::string_view(_scratch);
+}
+
+future<> stream_parser::parse_literal(std::string_view literal) {
+    if (_buf.size() >= literal.size()) {
+        if (std::string_view(_buf.get(), literal.size()) != literal) {
+            fail("invalid literal");
+        }
+        consume(literal.size());
+        co_return;
+    }
+    for (char expected : literal) {
+        if (co_await get_char() != expected) {
+            fail("invalid literal");
+        }
+    }
+}
+
+future<token> stream_parser::next() {
+    _scratch.clear();
+    for (;;) {
+        if (_buf.empty() && !co_await fill()) {
+            if (_state != state::done) {
+                fail("unexpected end of input");
+            }
+            _last = token_type::end;
+            co_return token{token_type::end, {}};
+        }
+        auto b = _buf.get();
+        auto p = std::find_if_not(b, b + _buf.size(), is_whitespace);
+        consume(p - b);
+        if (_buf.empty()) {
+            continue;
+        }
+
+        char c = _buf[0];
+        token t{token_type::end, {}};
+        switch (_state) {
+        case state::done:
+            fail("trailing data after document");
+        case state::colon:
+            if (c != ':') {
+                fail("expected ':'");
+            }
+            consume(1);
+            _state = state::value;
+            continue;
+        case state::comma_or_end:
+            if (c == ',') {
+                consume(1);
+                _state = _stack.back() == '{' ? state::key : state::value;
+                continue;
+            }
+            if (c != (_stack.back() == '{' ? '}' : ']')) {
+                fail("expected ',' or end of container");
+            }
+            break;
+        case state::key_or_end:
+            if (c == '}') {
+                break;
+            }
+            [[fallthrough]];
+        case state::key:
+            if (c != '"') {
+                fail("expected key");
+            }
+            t = token{token_type::key, co_await parse_string()};
+            _state = state::colon;
+            _last = t.type;
+            co_return t;
+        case state::first_value_or_end:
+            if (c == ']') {
+                break;
+            }
+            [[fallthrough]];
+        case state::start:
+        case state::value:
+            switch (c) {
+            case '{':
+                push('{');
+                consume(1);
+                _state = state::key_or_end;
+                t.type = token_type::begin_object;
+                break;
+            case '[':
+                push('[');
+                consume(1);
+                _state = state::first_value_or_end;
+                t.type = token_type::begin_array;
+                break;
+            case '"':
+                t = token{token_type::string, co_await parse_string()};
+                value_done();
+                break;
+            case 't':
+                co_await parse_literal("true");
+                t = token{token_type::boolean, "true"};
+                value_done();
+                break;
+            case 'f':
+                co_await parse_literal("false");
+                t = token{token_type::boolean, "false"};
+                value_done();
+                break;
+            case 'n':
+                co_await parse_literal("null");
+                t = token{token_type::null, "null"};
+                value_done();
+                break;
+            default:
+                if (c != '-' && !is_digit(c)) {
+                    fail("unexpected character");
+                }
+                t = token{token_type::number, co_await parse_number()};
+                value_done();
+                break;
+            }
+            _last = t.type;
+            co_return t;
+        }
+
+        // Closes the innermost container
+        t.type = _stack.back() == '{' ? token_type::end_object : token_type::end_array;
+        consume(1);
+        pop();
+        value_done();
+        _last = t.type;
+        co_return t;
+    }
+}
+
+future<> stream_parser::skip() {
+    if (_last != token_type::begin_object && _last != token_type::begin_array) {
+        co_return;
+    }
+    auto depth = _stack.size() - 1;
+    while (_stack.size() > depth) {
+        co_await next();
+    }
+}
+
+}
+
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <linux/bpf.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <seastar/core/posix.hh>
+
+// Thin wrappers of the bpf() system call, which libc doesn't have
+
+namespace seastar {
+
+namespace net {
+
+inline int bpf(int cmd, union bpf_attr& attr) {
+    return ::syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+}
+
+inline file_desc bpf_fd(int cmd, union bpf_attr& attr, const char* what) {
+    int fd = bpf(cmd, attr);
+    throw_system_error_on(fd == -1, what);
+    return file_desc::from_fd(fd);
+}
+
+inline file_desc bpf_create_map(bpf_map_type type, uint32_t value_size, uint32_t max_entries, const char* what) {
+    union bpf_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.map_type = type;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = value_size;
+    attr.max_entries = max_entries;
+    return bpf_fd(BPF_MAP_CREATE, attr, what);
+}
+
+template <typename Value>
+int bpf_update_elem(const file_desc& map, uint32_t key, const Value& value) {
+    union bpf_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map.get();
+    attr.key = reinterpret_cast<uintptr_t>(&key);
+    attr.value = reinterpret_cast<uintptr_t>(&value);
+    attr.flags = BPF_ANY;
+    return bpf(BPF_MAP_UPDATE_ELEM, attr);
+}
+
+inline file_desc bpf_load_program(bpf_prog_type type, const bpf_insn* insns, size_t count, const char* what) {
+    static const char license[] = "Dual BSD/GPL";
+    union bpf_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.prog_type = type;
+    attr.insns = reinterpret_cast<uintptr_t>(insns);
+    attr.insn_cnt = count;
+    attr.license = reinterpret_cast<uintptr_t>(license);
+    return bpf_fd(BPF_PROG_LOAD, attr, what);
+}
+
+}
+
+}
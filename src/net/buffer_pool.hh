@@ -0,0 +1,158 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+#endif
+
+#include <seastar/core/align.hh>
+#include <seastar/core/deleter.hh>
+
+namespace seastar {
+
+namespace net {
+
+// Recycles the fixed size receive buffers of a device queue.
+//
+// The deleter of a buffer handed to a packet returns it to the pool when
+// the packet is destroyed. The deleter lives in a trailer after the data,
+// so neither the buffer nor its deleter is allocated in steady state.
+// Buffers outstanding when the pool is destroyed are freed as they come
+// back. Like packets, buffers must be released on the shard of the pool.
+class buffer_pool {
+    struct pool;
+    struct block_deleter final : deleter::impl {
+        block_deleter() noexcept : impl(deleter()) {}
+        // The memory is part of the block, see recycle()
+        static void operator delete(void* p) noexcept;
+    };
+    struct trailer {
+        pool* owner;
+        alignas(block_deleter) char d[sizeof(block_deleter)];
+    };
+    struct pool {
+        size_t size;
+        size_t alignment;
+        size_t max_cached;
+        std::vector<char*> cached;
+        size_t outstanding = 0;
+        bool closed = false;
+
+        size_t trailer_offset() const noexcept {
+            return align_up(size, alignof(trailer));
+        }
+        trailer* trailer_of(char* data) const noexcept {
+            return reinterpret_cast<trailer*>(data + trailer_offset());
+        }
+        char* allocate() noexcept {
+            char* data = nullptr;
+            if (!cached.empty()) {
+                data = cached.back();
+                cached.pop_back();
+            } else {
+                void* p;
+                if (posix_memalign(&p, alignment, trailer_offset() + sizeof(trailer))) {
+                    return nullptr;
+                }
+                data = static_cast<char*>(p);
+                trailer_of(data)->owner = this;
+            }
+            ++outstanding;
+            return data;
+        }
+        void recycle(char* data) noexcept {
+            --outstanding;
+            if (closed) {
+                ::free(data);
+                if (!outstanding) {
+                    delete this;
+                }
+            } else if (cached.size() < max_cached) {
+                cached.push_back(data);
+            } else {
+                ::free(data);
+            }
+        }
+        void close() noexcept {
+            closed = true;
+            for (auto data : cached) {
+                ::free(data);
+            }
+            cached.clear();
+            if (!outstanding) {
+                delete this;
+            }
+        }
+    };
+    pool* _pool;
+public:
+    explicit buffer_pool(size_t buffer_size, size_t alignment = alignof(std::max_align_t), size_t max_cached = 1024)
+        : _pool(new pool{buffer_size, std::max(alignment, alignof(trailer)), max_cached, {}}) {
+        _pool->cached.reserve(max_cached);
+    }
+    buffer_pool(const buffer_pool&) = delete;
+    ~buffer_pool() {
+        _pool->close();
+    }
+    size_t buffer_size() const noexcept {
+        return _pool->size;
+    }
+    // Returns a buffer of buffer_size() bytes, or nullptr
+    char* allocate() noexcept {
+        return _pool->allocate();
+    }
+    // Returns a buffer that wasn't handed to a packet
+    void free(char* data) noexcept {
+        _pool->recycle(data);
+    }
+    // Hands over a buffer; the deleter returns it to the pool
+    deleter make_deleter(char* data) noexcept {
+        return deleter(new (_pool->trailer_of(data)->d) block_deleter());
+    }
+    // Owning handle of a buffer, for containers that may drop them
+    struct recycler {
+        buffer_pool* bp;
+        void operator()(char* data) const noexcept {
+            bp->free(data);
+        }
+    };
+    using buffer = std::unique_ptr<char[], recycler>;
+    buffer allocate_buffer() noexcept {
+        return buffer(allocate(), recycler{this});
+    }
+};
+
+inline void buffer_pool::block_deleter::operator delete(void* p) noexcept {
+    auto t = reinterpret_cast<trailer*>(static_cast<char*>(p) - offsetof(trailer, d));
+    auto owner = t->owner;
+    owner->recycle(reinterpret_cast<char*>(t) - owner->trailer_offset());
+}
+
+}
+
+}
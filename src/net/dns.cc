@@ -36,6 +36,9 @@
 #include <seastar/core/timer.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/smp.hh>
 #include <seastar/core/print.hh>
 #include <system_error>
 
@@ -140,6 +143,7 @@ class net::dns_resolver::impl
 public:
     impl(network_stack& stack, const options& opts)
         : _stack(stack)
+        , _opts(opts)
         , _timeout(opts.timeout ? *opts.timeout : std::chrono::milliseconds(5000) /* from ares private */)
         , _timer(std::bind(&impl::poll_sockets, this))
     {
@@ -235,6 +239,24 @@ class net::dns_resolver::impl
     }
 
     future<hostent> get_host_by_name(sstring name, opt_family family)  {
+        if (!_opts.cache) {
+            return query_host_by_name(std::move(name), family);
+        }
+        if (!family) {
+            auto res = inet_address::parse_numerical(name);
+            if (res) {
+                return make_ready_future<hostent>(hostent{ {name}, {*res}});
+            }
+        }
+        if (_opts.cache->shard) {
+            return smp::submit_to(*_opts.cache->shard, [opts = _opts, name = std::move(name), family] {
+                return shared_resolver(opts).get_cached(name, family);
+            });
+        }
+        return get_cached(std::move(name), family);
+    }
+
+    future<hostent> query_host_by_name(sstring name, opt_family family)  {
         class promise_wrap : public promise<hostent> {
         public:
             promise_wrap(sstring s)
@@ -287,6 +309,52 @@ class net::dns_resolver::impl
         });
     }
 
+    // Returns the addresses of a name and the TTL of the answer
+    future<std::pair<hostent, std::chrono::seconds>> query_addrinfo(sstring name, opt_family family) {
+        using result_type = std::pair<hostent, std::chrono::seconds>;
+        class promise_wrap : public promise<result_type> {
+        public:
+            promise_wrap(sstring s)
+                : name(std::move(s))
+            {}
+            sstring name;
+        };
+
+        dns_log.debug("Query addrinfo {} ({})", name, family);
+
+        auto p = new promise_wrap(std::move(name));
+        auto f = p->get_future();
+
+        dns_call call(*this);
+
+        ares_addrinfo_hints hints = {};
+        hints.ai_family = family ? int(*family) : AF_UNSPEC;
+        hints.ai_flags = ARES_AI_CANONNAME;
+
+        ares_getaddrinfo(_channel, p->name.c_str(), nullptr, &hints, [](void* arg, int status, int timeouts, ::ares_addrinfo* res) {
+            std::unique_ptr<promise_wrap> p(reinterpret_cast<promise_wrap *>(arg));
+            std::unique_ptr<::ares_addrinfo, decltype(&ares_freeaddrinfo)> info(res, &ares_freeaddrinfo);
+
+            if (status != ARES_SUCCESS) {
+                dns_log.debug("Query failed: {}", status);
+                p->set_exception(std::system_error(status, ares_errorc, p->name));
+                return;
+            }
+            try {
+                p->set_value(make_hostent(*info, p->name));
+            } catch (...) {
+                p->set_exception(std::current_exception());
+            }
+        }, reinterpret_cast<void *>(p));
+
+
+        poll_sockets();
+
+        return f.finally([this] {
+            end_call();
+        });
+    }
+
     future<hostent> get_host_by_addr(inet_address addr) {
         class promise_wrap : public promise<hostent> {
         public:
@@ -382,6 +450,10 @@ class net::dns_resolver::impl
         });
     }
 
+    uint64_t queries() const noexcept {
+        return _queries;
+    }
+
     future<> close() {
         _closed = true;
         ares_cancel(_channel);
@@ -393,6 +465,112 @@ class net::dns_resolver::impl
         return _gate.close();
     }
 private:
+    struct cache_key {
+        sstring name;
+        int family;
+
+        bool operator==(const cache_key&) const = default;
+    };
+    struct cache_key_hash {
+        size_t operator()(const cache_key& k) const noexcept {
+            return std::hash<sstring>()(k.name) ^ std::hash<int>()(k.family);
+        }
+    };
+    struct cache_entry {
+        // Either the addresses or the error of a negative answer
+        std::optional<hostent> host;
+        std::exception_ptr error;
+        lowres_clock::time_point expiry;
+        lowres_clock::time_point refresh;
+    };
+
+    // Owned by the network stack, which closes it when the reactor stops
+    static impl& shared_resolver(options opts) {
+        auto& resolver = engine().net()._shared_resolver;
+        if (!resolver) {
+            opts.cache->shard = std::nullopt;
+            resolver = std::make_unique<dns_resolver>(opts);
+        }
+        return *resolver->_impl;
+    }
+
+    future<hostent> get_cached(sstring name, opt_family family) {
+        cache_key key{std::move(name), family ? int(*family) : AF_UNSPEC};
+        auto now = lowres_clock::now();
+        auto i = _cache.find(key);
+        if (i != _cache.end()) {
+            auto& e = i->second;
+            if (now < e.expiry) {
+                dns_log.trace("Cache hit {} ({})", key.name, family);
+                if (e.host) {
+                    auto host = *e.host;
+                    if (now >= e.refresh && !_lookups.contains(key)) {
+                        refresh(std::move(key));
+                    }
+                    return make_ready_future<hostent>(std::move(host));
+                }
+                return make_exception_future<hostent>(e.error);
+            }
+            _cache.erase(i);
+        }
+        return lookup(std::move(key));
+    }
+
+    future<hostent> lookup(cache_key key) {
+        auto i = _lookups.find(key);
+        if (i != _lookups.end()) {
+            return i->second.get_shared_future();
+        }
+        auto f = _lookups[key].get_shared_future();
+        auto family = key.family == AF_UNSPEC ? opt_family() : opt_family(inet_address::family(key.family));
+        // The promise is only resolved from here, the query can complete
+        // before the continuation is attached.
+        (void)query_addrinfo(key.name, family).then_wrapped([this, self = shared_from_this(), key = std::move(key)] (auto f) mutable {
+            auto p = std::move(_lookups.at(key));
+            _lookups.erase(key);
+            try {
+                auto [host, ttl] = f.get();
+                store(key, cache_entry{host, nullptr}, std::min(ttl, _opts.cache->max_ttl));
+                p.set_value(std::move(host));
+            } catch (const std::system_error& e) {
+                if (e.code().category() == ares_errorc
+                        && (e.code().value() == ARES_ENOTFOUND || e.code().value() == ARES_ENODATA)) {
+                    store(key, cache_entry{std::nullopt, std::current_exception()}, _opts.cache->negative_ttl);
+                }
+                p.set_exception(std::current_exception());
+            } catch (...) {
+                p.set_exception(std::current_exception());
+            }
+        });
+        return f;
+    }
+
+    void refresh(cache_key key) {
+        dns_log.trace("Refresh {}", key.name);
+        (void)try_with_gate(_gate, [this, key = std::move(key)] () mutable {
+            return lookup(std::move(key)).discard_result();
+        }).handle_exception([] (std::exception_ptr ep) {
+            // The entry stays until it expires
+            dns_log.debug("Refresh failed: {}", ep);
+        });
+    }
+
+    void store(const cache_key& key, cache_entry e, std::chrono::seconds ttl) {
+        if (ttl <= std::chrono::seconds(0) || _closed) {
+            return;
+        }
+        auto now = lowres_clock::now();
+        if (_cache.size() >= _opts.cache->max_entries && !_cache.contains(key)) {
+            std::erase_if(_cache, [now] (const auto& p) { return p.second.expiry <= now; });
+            if (_cache.size() >= _opts.cache->max_entries) {
+                _cache.erase(_cache.begin());
+            }
+        }
+        e.expiry = now + ttl;
+        e.refresh = now + std::chrono::duration_cast<lowres_clock::duration>(ttl * _opts.cache->refresh_ahead);
+        _cache.insert_or_assign(key, std::move(e));
+    }
+
     enum class type {
         none, tcp, udp
     };
@@ -400,7 +578,9 @@ class net::dns_resolver::impl
         dns_call(impl & i)
             : _i(i)
             , _c(++i._calls)
-        {}
+        {
+            ++i._queries;
+        }
         ~dns_call() {
             // If a query does not immediately complete
             // it might never do so, unless data actually
@@ -482,6 +662,37 @@ class net::dns_resolver::impl
         return records;
     }
 
+    static std::pair<hostent, std::chrono::seconds> make_hostent(const ::ares_addrinfo& info, const sstring& name) {
+        hostent e;
+        e.names.emplace_back(info.name ? sstring(info.name) : name);
+        for (auto c = info.cnames; c != nullptr; c = c->next) {
+            if (c->alias && e.names.front() != c->alias) {
+                e.names.emplace_back(c->alias);
+            }
+        }
+        int ttl = std::numeric_limits<int>::max();
+        for (auto n = info.nodes; n != nullptr; n = n->ai_next) {
+            switch (n->ai_family) {
+            case AF_INET:
+                e.addr_list.emplace_back(reinterpret_cast<const sockaddr_in*>(n->ai_addr)->sin_addr);
+                break;
+            case AF_INET6:
+                e.addr_list.emplace_back(reinterpret_cast<const sockaddr_in6*>(n->ai_addr)->sin6_addr);
+                break;
+            default:
+                continue;
+            }
+            ttl = std::min(ttl, n->ai_ttl);
+        }
+        if (e.addr_list.empty()) {
+            throw std::system_error(ARES_ENODATA, ares_errorc, name);
+        }
+
+        dns_log.debug("Query success: {}/{}, ttl {}", e.names.front(), e.addr_list.front(), ttl);
+
+        return {std::move(e), std::chrono::seconds(ttl)};
+    }
+
     static hostent make_hostent(const ::hostent& host) {
         hostent e;
         e.names.emplace_back(host.h_name);
@@ -1002,9 +1213,13 @@ class net::dns_resolver::impl
 
     socket_map _sockets;
     network_stack & _stack;
+    options _opts;
+    std::unordered_map<cache_key, cache_entry, cache_key_hash> _cache;
+    std::unordered_map<cache_key, shared_promise<hostent>, cache_key_hash> _lookups;
 
     ares_channel _channel = {};
     uint64_t _calls = 0;
+    uint64_t _queries = 0;
     std::chrono::milliseconds _timeout;
     timer<> _timer;
     gate _gate;
@@ -1045,6 +1260,10 @@ future<sstring> net::dns_resolver::resolve_addr(const inet_address& addr) {
     return _impl->resolve_addr(addr);
 }
 
+uint64_t net::dns_resolver::queries() const noexcept {
+    return _impl->queries();
+}
+
 future<net::dns_resolver::srv_records> net::dns_resolver::get_srv_records(net::dns_resolver::srv_proto proto,
                                                                           const sstring& service,
                                                                           const sstring& domain) {
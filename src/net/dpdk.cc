@@ -25,7 +25,9 @@ module;
 #endif
 
 #include <cinttypes>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <vector>
 #include <queue>
 #include <getopt.h>
@@ -37,17 +39,21 @@ module;
 #include <rte_eal.h>
 #include <rte_pci.h>
 #include <rte_ethdev.h>
+#include <rte_flow.h>
+#include <rte_mbuf_dyn.h>
 #include <rte_cycles.h>
 #include <rte_memzone.h>
 #include <rte_vfio.h>
 
 #include <boost/preprocessor.hpp>
+#include <boost/range/irange.hpp>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/net/virtio-interface.hh>
 #include <seastar/core/stream.hh>
 #include <seastar/core/circular_buffer.hh>
@@ -67,6 +73,8 @@ module seastar;
 #include <seastar/net/toeplitz.hh>
 #include <seastar/net/native-stack.hh>
 #include "core/vla.hh"
+#include "net/buffer_pool.hh"
+#include "net/rss_buckets.hh"
 #endif
 
 #if RTE_VERSION <= RTE_VERSION_NUM(2,0,0,16)
@@ -349,7 +357,13 @@ class dpdk_device : public device {
     unsigned _home_cpu;
     bool _use_lro;
     bool _enable_fc;
-    std::vector<uint8_t> _redir_table;
+    bool _hw_timestamps;
+    // Where mbufs hold their RX timestamp, and the flag telling they have one
+    int _timestamp_offset = -1;
+    uint64_t _timestamp_flag = 0;
+    // The redirection table, with its previous owners if rebalancing.
+    // Only the home shard reads it once _rss_views is set up.
+    net::rss_buckets _rss;
     rss_key_type _rss_key;
     port_stats _stats;
     timer<> _stats_collector;
@@ -360,6 +374,18 @@ class dpdk_device : public device {
     bool _is_vmxnet3_device = false;
     dpdk_xstats _xstats;
 
+    // Runtime rebalancing of the RSS redirection table, see rebalance_rss()
+    std::chrono::milliseconds _rss_rebalance_interval;
+    timer<> _rss_rebalancer;
+    bool _rss_rebalancing = false;
+    // Received packets of each RSS bucket since the last round, per queue.
+    // Each is only touched by the shard of its queue.
+    std::vector<std::vector<uint64_t>> _bucket_packets;
+    // Each shard's copy of _rss
+    std::vector<net::rss_buckets> _rss_views;
+    // Whether steer_flow() programs rte_flow rules
+    bool _flow_steering;
+
 public:
     rte_eth_dev_info _dev_info = {};
     promise<> _link_ready_promise;
@@ -404,17 +430,49 @@ class dpdk_device : public device {
      */
     void set_hw_flow_control();
 
+    /**
+     * One round of the RSS redirection table rebalancing, run on the home
+     * shard.
+     *
+     * Moves buckets of the redirection table from the busiest queues to the
+     * least busy ones, based on the packets each bucket received since the
+     * previous round. Connections can't migrate between shards, so the
+     * shards that lost a bucket are remembered as its previous owners, and
+     * segments of their established connections are forwarded back to them
+     * (see previous_flow_owner()). A previous owner is forgotten once it has
+     * no more connections in the bucket.
+     */
+    future<> rebalance_rss();
+
+    /**
+     * Copies the redirection table to all shards, then programs the entries
+     * that changed since \c old_table into the device.
+     */
+    future<> publish_rss_table(std::vector<uint8_t> old_table);
+
+    /**
+     * Creates the rte_flow rule sending a flow to a queue, or checks that
+     * the device would accept it.
+     *
+     * @return the rule, nullptr on failure or when only validating
+     */
+    rte_flow* create_flow_rule(const net::flow_tuple& flow, uint16_t qid, bool validate_only);
+
 public:
     dpdk_device(uint16_t port_idx, uint16_t num_queues, bool use_lro,
-                bool enable_fc)
+                bool enable_fc, std::chrono::milliseconds rss_rebalance_interval,
+                bool hw_timestamps, bool flow_steering)
         : _port_idx(port_idx)
         , _num_queues(num_queues)
         , _home_cpu(this_shard_id())
         , _use_lro(use_lro)
         , _enable_fc(enable_fc)
+        , _hw_timestamps(hw_timestamps)
         , _stats_plugin_name("network")
         , _stats_plugin_inst(std::string("port") + std::to_string(_port_idx))
         , _xstats(port_idx)
+        , _rss_rebalance_interval(rss_rebalance_interval)
+        , _flow_steering(flow_steering && _num_queues > 1 && _num_queues == smp::count)
     {
 
         /* now initialise the port we will use */
@@ -423,6 +481,13 @@ class dpdk_device : public device {
             rte_exit(EXIT_FAILURE, "Cannot initialise port %u\n", _port_idx);
         }
 
+        // Rebalancing relies on queue N being served by shard N
+        if (_rss_rebalance_interval.count() && _num_queues > 1 &&
+            _num_queues == smp::count && _dev_info.reta_size) {
+            _bucket_packets.assign(_num_queues, std::vector<uint64_t>(_rss.redir_table.size()));
+            _rss.previous_owners.resize(_rss.redir_table.size());
+        }
+
         // Register port statistics pollers
         namespace sm = seastar::metrics;
         _metrics.add_group(_stats_plugin_name, {
@@ -477,6 +542,7 @@ class dpdk_device : public device {
 
     ~dpdk_device() {
         _stats_collector.cancel();
+        _rss_rebalancer.cancel();
     }
 
     ethernet_address hw_address() override {
@@ -508,10 +574,33 @@ class dpdk_device : public device {
     virtual future<> link_ready() override { return _link_ready_promise.get_future(); }
     virtual std::unique_ptr<qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
     virtual unsigned hash2qid(uint32_t hash) override {
-        assert(_redir_table.size());
-        return _redir_table[hash & (_redir_table.size() - 1)];
+        assert(_rss.redir_table.size());
+        if (!_rss_views.empty()) {
+            return _rss_views[this_shard_id()].owner(hash);
+        }
+        return _rss.owner(hash);
+    }
+    virtual std::optional<unsigned> previous_flow_owner(uint32_t hash) override {
+        if (_rss_views.empty()) {
+            return std::nullopt;
+        }
+        return _rss_views[this_shard_id()].previous_owner(hash, this_shard_id());
+    }
+    virtual std::unique_ptr<net::flow_steering_rule> steer_flow(const net::flow_tuple& flow) override;
+    void count_rx_bucket(uint16_t qid, uint32_t hash) {
+        if (!_bucket_packets.empty()) {
+            auto& counts = _bucket_packets[qid];
+            counts[hash & (counts.size() - 1)]++;
+        }
     }
     uint16_t port_idx() { return _port_idx; }
+    uint64_t timestamp_flag() const {
+        return _timestamp_flag;
+    }
+    // Raw NIC clock timestamp of a received mbuf with timestamp_flag()
+    uint64_t rx_timestamp(rte_mbuf* m) const {
+        return *RTE_MBUF_DYNFIELD(m, _timestamp_offset, rte_mbuf_timestamp_t*);
+    }
     bool is_i40e_device() const {
         return _is_i40e_device;
     }
@@ -637,6 +726,11 @@ class dpdk_qp : public net::qp {
                 head->l3_len = oi.ip_hdr_len;
             }
             if (qp.port().hw_features().tx_csum_l4_offload) {
+                if (oi.ipv6) {
+                    // Unlike IPv4 ones, IPv6 packets must be flagged as such
+                    // for the L4 offloads
+                    head->ol_flags |= RTE_MBUF_F_TX_IPV6;
+                }
                 if (oi.protocol == ip_protocol_num::tcp) {
                     head->ol_flags |= RTE_MBUF_F_TX_TCP_CKSUM;
                     // TODO: Take a VLAN header into an account here
@@ -644,7 +738,7 @@ class dpdk_qp : public net::qp {
                     head->l3_len = oi.ip_hdr_len;
 
                     if (oi.tso_seg_size) {
-                        assert(oi.needs_ip_csum);
+                        assert(oi.needs_ip_csum || oi.ipv6);
                         head->ol_flags |= RTE_MBUF_F_TX_TCP_SEG;
                         head->l4_len = oi.tcp_hdr_len;
                         head->tso_segsz = oi.tso_seg_size;
@@ -1326,10 +1420,10 @@ class dpdk_qp : public net::qp {
      *
      * @param m mbuf to update
      */
-    static bool refill_rx_mbuf(rte_mbuf* m, size_t size = mbuf_data_size) {
-        char* data;
+    bool refill_rx_mbuf(rte_mbuf* m) {
+        char* data = _rx_buffers.allocate();
 
-        if (posix_memalign((void**)&data, size, size)) {
+        if (!data) {
             return false;
         }
 
@@ -1347,13 +1441,12 @@ class dpdk_qp : public net::qp {
         return true;
     }
 
-    static bool init_noninline_rx_mbuf(rte_mbuf* m,
-                                       size_t size = mbuf_data_size) {
-        if (!refill_rx_mbuf(m, size)) {
+    bool init_noninline_rx_mbuf(rte_mbuf* m) {
+        if (!refill_rx_mbuf(m)) {
             return false;
         }
         // The below fields stay constant during the execution.
-        m->buf_len       = size + RTE_PKTMBUF_HEADROOM;
+        m->buf_len       = mbuf_data_size + RTE_PKTMBUF_HEADROOM;
         m->data_off      = RTE_PKTMBUF_HEADROOM;
         return true;
     }
@@ -1415,14 +1508,48 @@ class dpdk_qp : public net::qp {
      */
     std::optional<packet> from_mbuf_lro(rte_mbuf* m);
 
+    // Samples the NIC clock against the system clock, so that RX timestamps
+    // can be converted
+    void sync_clock();
+    std::chrono::system_clock::time_point to_system_time(uint64_t ticks) const {
+        auto ns = (int64_t(ticks) - int64_t(_clock.ticks)) * _clock.ns_per_tick;
+        return _clock.time + std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(int64_t(ns)));
+    }
+
+    /**
+     * Allocates a buffer for a copy of received data, recycled through
+     * _rx_buffers when the data fits.
+     * @param len size of the data
+     * @param del deleter of the buffer (out)
+     *
+     * @return the buffer, or nullptr if the allocation failed
+     */
+    char* allocate_rx_copy(size_t len, deleter& del) {
+        char* buf;
+        if (len <= _rx_buffers.buffer_size()) {
+            buf = _rx_buffers.allocate();
+            if (buf) {
+                del = _rx_buffers.make_deleter(buf);
+            }
+        } else {
+            buf = (char*)malloc(len);
+            if (buf) {
+                del = make_free_deleter(buf);
+            }
+        }
+        return buf;
+    }
+
 private:
     dpdk_device* _dev;
     uint16_t _qid;
+    // Data buffers of received packets: the Rx ring ones, or the copies
+    // when not using hugetlbfs
+    buffer_pool _rx_buffers{mbuf_data_size, mbuf_data_size, 4096};
     rte_mempool *_pktmbuf_pool_rx;
     std::vector<rte_mbuf*> _rx_free_pkts;
     std::vector<rte_mbuf*> _rx_free_bufs;
     std::vector<fragment> _frags;
-    std::vector<char*> _bufs;
     size_t _num_rx_free_segs = 0;
     internal::poller _rx_gc_poller;
     std::unique_ptr<void, free_deleter> _rx_xmem;
@@ -1431,6 +1558,14 @@ class dpdk_qp : public net::qp {
     internal::poller _tx_gc_poller;
     std::vector<rte_mbuf*> _tx_burst;
     uint16_t _tx_burst_idx = 0;
+    // The last NIC clock sample, and the NIC clock rate measured since the
+    // one before it
+    struct {
+        uint64_t ticks = 0;
+        std::chrono::system_clock::time_point time;
+        double ns_per_tick = 0;
+    } _clock;
+    timer<> _clock_sync;
     static constexpr phys_addr_t page_mask = ~(memory::page_size - 1);
 };
 
@@ -1546,7 +1681,7 @@ int dpdk_device::init_port_start()
             assert((_dev_info.reta_size & (_dev_info.reta_size - 1)) == 0);
 
             // Set the RSS table to the correct size
-            _redir_table.resize(_dev_info.reta_size);
+            _rss.redir_table.resize(_dev_info.reta_size);
             _rss_table_bits = std::lround(std::log2(_dev_info.reta_size));
             printf("Port %d: RSS table size is %d\n",
                    _port_idx, _dev_info.reta_size);
@@ -1554,7 +1689,7 @@ int dpdk_device::init_port_start()
             _rss_table_bits = std::lround(std::log2(_dev_info.max_rx_queues));
         }
     } else {
-        _redir_table.push_back(0);
+        _rss.redir_table.push_back(0);
     }
 
     // Set Rx VLAN stripping
@@ -1572,6 +1707,15 @@ int dpdk_device::init_port_start()
 #endif
         printf("LRO is off\n");
 
+    if (_hw_timestamps && (_dev_info.rx_offload_capa & RTE_ETH_RX_OFFLOAD_TIMESTAMP)) {
+        if (rte_mbuf_dyn_rx_timestamp_register(&_timestamp_offset, &_timestamp_flag) == 0) {
+            printf("RX timestamps are on\n");
+            port_conf.rxmode.offloads |= RTE_ETH_RX_OFFLOAD_TIMESTAMP;
+        } else {
+            _timestamp_flag = 0;
+        }
+    }
+
     // Check that all CSUM features are either all set all together or not set
     // all together. If this assumption breaks we need to rework the below logic
     // by splitting the csum offload feature bit into separate bits for IPv4,
@@ -1641,6 +1785,8 @@ int dpdk_device::init_port_start()
     }
 
     //rte_eth_promiscuous_enable(port_num);
+    // IPv6 neighbor discovery is sent to solicited-node multicast groups
+    rte_eth_allmulticast_enable(_port_idx);
     printf("done: \n");
 
     return 0;
@@ -1732,6 +1878,31 @@ void dpdk_device::init_port_fini()
         set_rss_table();
     }
 
+    if (_flow_steering) {
+        // Probe with the kind of rule steer_flow() creates
+        net::flow_tuple flow{ip_protocol_num::tcp};
+        ipv4_traits::hash_address(flow.local_ip, ipv4_address(0x0a000001));
+        ipv4_traits::hash_address(flow.foreign_ip, ipv4_address(0x0a000002));
+        flow.local_port = 41952;
+        flow.foreign_port = 80;
+        create_flow_rule(flow, 0, true);
+    }
+
+    if (!_bucket_packets.empty()) {
+        _rss_views.assign(smp::count, _rss);
+        _rss_rebalancer.set_callback([this] {
+            if (_rss_rebalancing) {
+                return;
+            }
+            _rss_rebalancing = true;
+            // FIXME: future is discarded
+            (void)rebalance_rss().finally([this] {
+                _rss_rebalancing = false;
+            });
+        });
+        _rss_rebalancer.arm_periodic(_rss_rebalance_interval);
+    }
+
     // Wait for a link
     check_port_link_status();
 
@@ -1952,6 +2123,12 @@ dpdk_qp<HugetlbfsMemBackend>::dpdk_qp(dpdk_device* dev, uint16_t qid,
         rte_exit(EXIT_FAILURE, "Cannot initialize tx queue\n");
     }
 
+    if (_dev->timestamp_flag()) {
+        _clock_sync.set_callback([this] { sync_clock(); });
+        sync_clock();
+        _clock_sync.arm_periodic(std::chrono::seconds(1));
+    }
+
     // Register error statistics: Rx total and checksum errors
     namespace sm = seastar::metrics;
     _metrics.add_group(_stats_plugin_name, {
@@ -1986,7 +2163,8 @@ dpdk_qp<false>::from_mbuf_lro(rte_mbuf* m)
     // this buffer and return the mbuf to its pool.
     //
     auto pkt_len = rte_pktmbuf_pkt_len(m);
-    char* buf = (char*)malloc(pkt_len);
+    deleter del;
+    char* buf = allocate_rx_copy(pkt_len, del);
     if (buf) {
         // Copy the contents of the packet into the buffer we've just allocated
         size_t offset = 0;
@@ -2000,7 +2178,7 @@ dpdk_qp<false>::from_mbuf_lro(rte_mbuf* m)
 
         rte_pktmbuf_free(m);
 
-        return packet(fragment{buf, pkt_len}, make_free_deleter(buf));
+        return packet(fragment{buf, pkt_len}, std::move(del));
     }
 
     // Drop if allocation failed
@@ -2021,7 +2199,8 @@ dpdk_qp<false>::from_mbuf(rte_mbuf* m)
         // its pool.
         //
         auto len = rte_pktmbuf_data_len(m);
-        char* buf = (char*)malloc(len);
+        deleter del;
+        char* buf = allocate_rx_copy(len, del);
 
         if (!buf) {
             // Drop if allocation failed
@@ -2032,7 +2211,7 @@ dpdk_qp<false>::from_mbuf(rte_mbuf* m)
             rte_memcpy(buf, rte_pktmbuf_mtod(m, char*), len);
             rte_pktmbuf_free(m);
 
-            return packet(fragment{buf, len}, make_free_deleter(buf));
+            return packet(fragment{buf, len}, std::move(del));
         }
     } else {
         return from_mbuf_lro(m);
@@ -2044,22 +2223,18 @@ inline std::optional<packet>
 dpdk_qp<true>::from_mbuf_lro(rte_mbuf* m)
 {
     _frags.clear();
-    _bufs.clear();
+    deleter del;
 
     for (; m != nullptr; m = m->next) {
         char* data = rte_pktmbuf_mtod(m, char*);
 
         _frags.emplace_back(fragment{data, rte_pktmbuf_data_len(m)});
-        _bufs.push_back(data);
+        // The mbuf data starts at the beginning of the buffer, see
+        // refill_rx_mbuf()
+        del.append(_rx_buffers.make_deleter(data));
     }
 
-    return packet(_frags.begin(), _frags.end(),
-                  make_deleter(deleter(),
-                          [bufs_vec = std::move(_bufs)] {
-                              for (auto&& b : bufs_vec) {
-                                  free(b);
-                              }
-                          }));
+    return packet(_frags.begin(), _frags.end(), std::move(del));
 }
 
 template<>
@@ -2072,7 +2247,7 @@ inline std::optional<packet> dpdk_qp<true>::from_mbuf(rte_mbuf* m)
         char* data = rte_pktmbuf_mtod(m, char*);
 
         return packet(fragment{data, rte_pktmbuf_data_len(m)},
-                      make_free_deleter(data));
+                      _rx_buffers.make_deleter(data));
     } else {
         return from_mbuf_lro(m);
     }
@@ -2177,6 +2352,10 @@ void dpdk_qp<HugetlbfsMemBackend>::process_packets(
         (*p).set_offload_info(oi);
         if (m->ol_flags & RTE_MBUF_F_RX_RSS_HASH) {
             (*p).set_rss_hash(m->hash.rss);
+            _dev->count_rx_bucket(_qid, m->hash.rss);
+        }
+        if ((m->ol_flags & _dev->timestamp_flag()) && _clock.ns_per_tick) {
+            (*p).set_timestamp(to_system_time(_dev->rx_timestamp(m)));
         }
 
         _dev->l2receive(std::move(*p));
@@ -2191,6 +2370,22 @@ void dpdk_qp<HugetlbfsMemBackend>::process_packets(
     }
 }
 
+template <bool HugetlbfsMemBackend>
+void dpdk_qp<HugetlbfsMemBackend>::sync_clock()
+{
+    uint64_t ticks;
+    if (rte_eth_read_clock(_dev->port_idx(), &ticks) != 0) {
+        return;
+    }
+    auto now = std::chrono::system_clock::now();
+    if (_clock.ticks && ticks > _clock.ticks) {
+        _clock.ns_per_tick = double(std::chrono::duration_cast<std::chrono::nanoseconds>(now - _clock.time).count())
+                / (ticks - _clock.ticks);
+    }
+    _clock.ticks = ticks;
+    _clock.time = now;
+}
+
 template <bool HugetlbfsMemBackend>
 bool dpdk_qp<HugetlbfsMemBackend>::poll_rx_once()
 {
@@ -2232,11 +2427,167 @@ void dpdk_device::set_rss_table()
 
     // Fill our local indirection table. Make it in a separate loop to keep things simple.
     i = 0;
-    for (auto& r : _redir_table) {
+    for (auto& r : _rss.redir_table) {
         r = i++ % _num_queues;
     }
 }
 
+future<> dpdk_device::rebalance_rss()
+{
+    size_t nr_buckets = _rss.redir_table.size();
+    bool census = _rss.has_previous_owners();
+
+    return do_with(std::vector<uint64_t>(nr_buckets), std::vector<std::vector<bool>>(smp::count),
+            [this, census, nr_buckets] (std::vector<uint64_t>& load, std::vector<std::vector<bool>>& in_use) {
+        return parallel_for_each(boost::irange(0u, smp::count), [this, census, nr_buckets, &load, &in_use] (unsigned cpu) {
+            return smp::submit_to(cpu, [this, census, nr_buckets] {
+                std::vector<bool> used;
+                if (census) {
+                    used.resize(nr_buckets);
+                    local_queue().flow_census([&used, nr_buckets] (uint32_t hash) {
+                        used[hash & (nr_buckets - 1)] = true;
+                    });
+                }
+                auto& counts = _bucket_packets[this_shard_id()];
+                auto ret = std::make_pair(counts, std::move(used));
+                std::fill(counts.begin(), counts.end(), 0);
+                return ret;
+            }).then([cpu, &load, &in_use] (std::pair<std::vector<uint64_t>, std::vector<bool>> ret) {
+                for (size_t i = 0; i < ret.first.size(); i++) {
+                    load[i] += ret.first[i];
+                }
+                in_use[cpu] = std::move(ret.second);
+            });
+        }).then([this, census, &load, &in_use] {
+            auto old_table = _rss.redir_table;
+            bool changed = census && _rss.prune_previous_owners(in_use);
+            if (_rss.move(load, _num_queues)) {
+                changed = true;
+            }
+            if (!changed) {
+                return make_ready_future<>();
+            }
+            return publish_rss_table(std::move(old_table));
+        });
+    });
+}
+
+future<> dpdk_device::publish_rss_table(std::vector<uint8_t> old_table)
+{
+    // The new owners have to know about the previous ones before the device
+    // starts sending them the segments of connections they don't have.
+    return parallel_for_each(boost::irange(0u, smp::count), [this] (unsigned cpu) {
+        return smp::submit_to(cpu, [this, view = _rss] () mutable {
+            _rss_views[this_shard_id()] = std::move(view);
+        });
+    }).then([this, old_table = std::move(old_table)] () mutable {
+        int reta_conf_size =
+            std::max(1, _dev_info.reta_size / RTE_ETH_RETA_GROUP_SIZE);
+        std::vector<rte_eth_rss_reta_entry64> reta_conf(reta_conf_size);
+        bool changed = false;
+        for (size_t i = 0; i < _rss.redir_table.size(); i++) {
+            if (_rss.redir_table[i] != old_table[i]) {
+                auto& x = reta_conf[i / RTE_ETH_RETA_GROUP_SIZE];
+                x.mask |= uint64_t(1) << (i % RTE_ETH_RETA_GROUP_SIZE);
+                x.reta[i % RTE_ETH_RETA_GROUP_SIZE] = _rss.redir_table[i];
+                changed = true;
+            }
+        }
+        if (!changed) {
+            return make_ready_future<>();
+        }
+        if (rte_eth_dev_rss_reta_update(_port_idx, reta_conf.data(), _dev_info.reta_size)) {
+            // Go back to the table the device still uses, and leave it be
+            printf("Port %d: Failed to update an RSS indirection table, disabling rebalancing\n", _port_idx);
+            _rss_rebalancer.cancel();
+            _rss.redir_table = std::move(old_table);
+            return publish_rss_table(_rss.redir_table);
+        }
+        return make_ready_future<>();
+    });
+}
+
+rte_flow* dpdk_device::create_flow_rule(const net::flow_tuple& flow, uint16_t qid, bool validate_only)
+{
+    rte_flow_attr attr = {};
+    attr.ingress = 1;
+
+    rte_flow_item_ipv4 ip4_spec = {}, ip4_mask = {};
+    rte_flow_item_ipv6 ip6_spec = {}, ip6_mask = {};
+    rte_flow_item_tcp tcp_spec = {}, tcp_mask = {};
+    rte_flow_item_udp udp_spec = {}, udp_mask = {};
+    std::array<rte_flow_item, 4> pattern = {};
+    pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+    // Addresses and ports of the flow as received
+    auto set_addresses = [&] (auto& spec, auto& mask) {
+        std::copy_n(&flow.foreign_ip[0], flow.foreign_ip.size(), reinterpret_cast<uint8_t*>(&spec.hdr.src_addr));
+        std::copy_n(&flow.local_ip[0], flow.local_ip.size(), reinterpret_cast<uint8_t*>(&spec.hdr.dst_addr));
+        std::memset(&mask.hdr.src_addr, 0xff, sizeof(mask.hdr.src_addr));
+        std::memset(&mask.hdr.dst_addr, 0xff, sizeof(mask.hdr.dst_addr));
+    };
+    auto set_ports = [&] (auto& spec, auto& mask) {
+        spec.hdr.src_port = rte_cpu_to_be_16(flow.foreign_port);
+        spec.hdr.dst_port = rte_cpu_to_be_16(flow.local_port);
+        mask.hdr.src_port = mask.hdr.dst_port = 0xffff;
+    };
+    if (flow.ipv6) {
+        set_addresses(ip6_spec, ip6_mask);
+        pattern[1] = {RTE_FLOW_ITEM_TYPE_IPV6, &ip6_spec, nullptr, &ip6_mask};
+    } else {
+        set_addresses(ip4_spec, ip4_mask);
+        pattern[1] = {RTE_FLOW_ITEM_TYPE_IPV4, &ip4_spec, nullptr, &ip4_mask};
+    }
+    if (flow.proto == ip_protocol_num::tcp) {
+        set_ports(tcp_spec, tcp_mask);
+        pattern[2] = {RTE_FLOW_ITEM_TYPE_TCP, &tcp_spec, nullptr, &tcp_mask};
+    } else {
+        set_ports(udp_spec, udp_mask);
+        pattern[2] = {RTE_FLOW_ITEM_TYPE_UDP, &udp_spec, nullptr, &udp_mask};
+    }
+    pattern[3].type = RTE_FLOW_ITEM_TYPE_END;
+
+    rte_flow_action_queue queue = {};
+    queue.index = qid;
+    std::array<rte_flow_action, 2> actions = {};
+    actions[0] = {RTE_FLOW_ACTION_TYPE_QUEUE, &queue};
+    actions[1].type = RTE_FLOW_ACTION_TYPE_END;
+
+    rte_flow_error error = {};
+    if (validate_only) {
+        if (rte_flow_validate(_port_idx, &attr, pattern.data(), actions.data(), &error)) {
+            printf("Port %u: Flow steering is not supported (%s), disabling it\n", _port_idx,
+                   error.message ? error.message : "unknown error");
+            _flow_steering = false;
+        }
+        return nullptr;
+    }
+    // Fails when the device runs out of rules, the flow keeps its RSS queue
+    return rte_flow_create(_port_idx, &attr, pattern.data(), actions.data(), &error);
+}
+
+class dpdk_flow_steering_rule final : public net::flow_steering_rule {
+    uint16_t _port_idx;
+    rte_flow* _flow;
+public:
+    dpdk_flow_steering_rule(uint16_t port_idx, rte_flow* flow) noexcept : _port_idx(port_idx), _flow(flow) {}
+    ~dpdk_flow_steering_rule() {
+        rte_flow_error error;
+        rte_flow_destroy(_port_idx, _flow, &error);
+    }
+};
+
+std::unique_ptr<net::flow_steering_rule> dpdk_device::steer_flow(const net::flow_tuple& flow)
+{
+    if (!_flow_steering) {
+        return nullptr;
+    }
+    auto rule = create_flow_rule(flow, this_shard_id(), false);
+    if (!rule) {
+        return nullptr;
+    }
+    return std::make_unique<dpdk_flow_steering_rule>(_port_idx, rule);
+}
+
 std::unique_ptr<qp> dpdk_device::init_local_queue(const program_options::option_group& opts, uint16_t qid) {
     auto net_opts = dynamic_cast<const net::native_stack_options*>(&opts);
     assert(net_opts);
@@ -2266,7 +2617,10 @@ std::unique_ptr<net::device> create_dpdk_net_device(
                                     uint16_t port_idx,
                                     uint16_t num_queues,
                                     bool use_lro,
-                                    bool enable_fc)
+                                    bool enable_fc,
+                                    std::chrono::milliseconds rss_rebalance_interval,
+                                    bool hw_timestamps,
+                                    bool flow_steering)
 {
     static bool called = false;
 
@@ -2283,7 +2637,8 @@ std::unique_ptr<net::device> create_dpdk_net_device(
     }
 
     return std::make_unique<dpdk::dpdk_device>(port_idx, num_queues, use_lro,
-                                               enable_fc);
+                                               enable_fc, rss_rebalance_interval, hw_timestamps,
+                                               flow_steering);
 }
 
 std::unique_ptr<net::device> create_dpdk_net_device(
@@ -2319,10 +2674,18 @@ dpdk_options::dpdk_options(program_options::option_group* parent_group)
     , hw_fc(*this, "hw-fc",
                 "on",
                 "Enable HW Flow Control (on / off)")
+    , rss_rebalance_interval(*this, "rss-rebalance-interval",
+                0,
+                "Interval in milliseconds between rebalancing rounds of the RSS redirection table, 0 to disable")
+    , hw_flow_steering(*this, "hw-flow-steering",
+                "off",
+                "Steer connections opened by the native stack to their shard with rte_flow rules (on / off)")
 #else
     : program_options::option_group(parent_group, "DPDK net options", program_options::unused{})
     , dpdk_port_index(*this, "dpdk-port-index", program_options::unused{})
     , hw_fc(*this, "hw-fc", program_options::unused{})
+    , rss_rebalance_interval(*this, "rss-rebalance-interval", program_options::unused{})
+    , hw_flow_steering(*this, "hw-flow-steering", program_options::unused{})
 #endif
 #if 0
     opts.add_options()
@@ -33,6 +33,7 @@ module seastar;
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/net/toeplitz.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/make_task.hh>
 #endif
 
 namespace seastar {
@@ -78,7 +79,19 @@ ipv4::ipv4(interface* netif)
         //
         sm::make_counter("linearizations", [] { return ipv4_packet_merger::linearizations(); },
                         sm::description("Counts a number of times a buffer linearization was invoked during buffers merge process. "
-                                        "Divide it by a total IPv4 receive packet rate to get an average number of lineraizations per packet."))
+                                        "Divide it by a total IPv4 receive packet rate to get an average number of lineraizations per packet.")),
+        sm::make_counter("gro_merged_segments", _gro_merged,
+                        sm::description("Counts TCP segments merged into a preceding segment of the same flow by software GRO")),
+        sm::make_counter("tso_segments", _tso_segments,
+                        sm::description("Counts TCP segments produced by splitting larger segments in software")),
+        sm::make_gauge("arp_entries", [this] { return _arp.size(); },
+                        sm::description("Holds the number of entries of the ARP cache")),
+        sm::make_counter("arp_misses", [this] { return _arp.get_stats().misses; },
+                        sm::description("Counts lookups of addresses with no valid ARP entry, which wait for its resolution")),
+        sm::make_counter("arp_refreshes", [this] { return _arp.get_stats().refreshes; },
+                        sm::description("Counts ARP entries refreshed ahead of their expiry")),
+        sm::make_counter("arp_timeouts", [this] { return _arp.get_stats().timeouts; },
+                        sm::description("Counts ARP resolutions which got no answer")),
     });
     _frag_timer.set_callback([this] { frag_timeout(); });
 }
@@ -232,11 +245,106 @@ ipv4::handle_received_packet(packet p, ethernet_address from) {
     if (l4) {
         // Trim IP header and pass to upper layer
         p.trim_front(ip_hdr_len);
+        if (_gro && h.ip_proto == uint8_t(ip_protocol_num::tcp) && gro_receive(p, h.src_ip, h.dst_ip)) {
+            return make_ready_future<>();
+        }
         l4->received(std::move(p), h.src_ip, h.dst_ip);
     }
     return make_ready_future<>();
 }
 
+bool ipv4::gro_receive(packet& p, ipv4_address src, ipv4_address dst) {
+    auto th = p.get_header(0, 20);
+    if (!th) {
+        return false;
+    }
+    unsigned hdr_len = (uint8_t(th[12]) >> 4) * 4;
+    if (hdr_len < 20 || p.len() < hdr_len) {
+        return false;
+    }
+    th = p.get_header(0, hdr_len);
+
+    if (!hw_features().rx_csum_offload) {
+        checksummer csum;
+        ipv4_traits::tcp_pseudo_header_checksum(csum, src, dst, p.len());
+        csum.sum(p);
+        if (csum.get() != 0) {
+            // Let the TCP layer drop it
+            return false;
+        }
+    }
+    p.offload_info_ref().rx_csum_verified = true;
+
+    constexpr uint8_t f_psh = 0x08, f_ack = 0x10;
+    uint8_t flags = th[13];
+    uint32_t seq = read_be<uint32_t>(th + 4);
+    unsigned payload_len = p.len() - hdr_len;
+    bool mergeable = (flags & ~(f_psh | f_ack)) == 0 && (flags & f_ack) && payload_len;
+
+    auto same_flow = [&] (gro_flow& f) {
+        return f.src == src && f.dst == dst
+            && std::equal(th, th + 4, f.p.get_header(0, 4));
+    };
+    auto it = std::find_if(_gro_flows.begin(), _gro_flows.end(), same_flow);
+    if (it != _gro_flows.end()) {
+        auto fh = it->p.get_header(0, 20);
+        unsigned fhdr_len = (uint8_t(fh[12]) >> 4) * 4;
+        // Only segments which differ in nothing but their sequence numbers,
+        // payloads and the PSH flag are merged
+        bool merge = mergeable
+            && seq == it->next_seq
+            && fhdr_len == hdr_len
+            && it->p.len() + payload_len <= ip_packet_len_max - ipv4_hdr_len_min
+            && std::equal(th + 8, th + 12, fh + 8)
+            && std::equal(th + 14, th + 16, fh + 14)
+            && std::equal(th + 20, th + hdr_len, it->p.get_header(0, hdr_len) + 20);
+        if (merge) {
+            p.trim_front(hdr_len);
+            it->p.append(std::move(p));
+            it->next_seq += payload_len;
+            ++_gro_merged;
+            if (flags & f_psh) {
+                it->p.get_header(0, 20)[13] |= f_psh;
+                gro_deliver(*it);
+                _gro_flows.erase(it);
+            }
+            return true;
+        }
+        // Keep the order of the flow's segments
+        gro_deliver(*it);
+        _gro_flows.erase(it);
+    }
+    if (!mergeable || (flags & f_psh)) {
+        return false;
+    }
+
+    if (_gro_flows.size() == _gro_max_flows) {
+        gro_deliver(_gro_flows.front());
+        _gro_flows.erase(_gro_flows.begin());
+    }
+    _gro_flows.push_back(gro_flow{std::move(p), src, dst, seq + payload_len});
+    if (!_gro_flush_scheduled) {
+        _gro_flush_scheduled = true;
+        // Runs once the packets of the current poll were all handled
+        schedule(make_task([this] { gro_flush(); }));
+    }
+    return true;
+}
+
+void ipv4::gro_deliver(gro_flow& f) {
+    // The handler segments which weren't held would have gone to
+    _l4[uint8_t(ip_protocol_num::tcp)]->received(std::move(f.p), f.src, f.dst);
+}
+
+void ipv4::gro_flush() {
+    _gro_flush_scheduled = false;
+    // Delivering a segment can send packets, but never receive new ones
+    for (auto& f : _gro_flows) {
+        gro_deliver(f);
+    }
+    _gro_flows.clear();
+}
+
 future<ethernet_address> ipv4::get_l2_dst_address(ipv4_address to) {
     // Figure out where to send the packet to. If it is a directly connected
     // host, send to it directly, otherwise send to the default gateway.
@@ -251,6 +359,10 @@ future<ethernet_address> ipv4::get_l2_dst_address(ipv4_address to) {
 }
 
 void ipv4::send(ipv4_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst) {
+    if (proto_num == ip_protocol_num::tcp && p.offload_info_ref().tso_seg_size && !hw_features().tx_tso) {
+        send_segmented(to, std::move(p), e_dst);
+        return;
+    }
     auto needs_frag = this->needs_frag(p, proto_num, hw_features());
 
     auto send_pkt = [this, to, proto_num, needs_frag, e_dst] (packet& pkt, uint16_t remaining, uint16_t offset) mutable  {
@@ -307,6 +419,48 @@ void ipv4::send(ipv4_address to, ip_protocol_num proto_num, packet p, ethernet_a
     }
 }
 
+void ipv4::send_segmented(ipv4_address to, packet p, ethernet_address e_dst) {
+    constexpr uint8_t f_fin = 0x01, f_psh = 0x08;
+    auto oi = p.get_offload_info();
+    unsigned hdr_len = oi.tcp_hdr_len;
+    unsigned mss = oi.tso_seg_size;
+    std::array<char, 60> hdr;
+    std::copy_n(p.get_header(0, hdr_len), hdr_len, hdr.begin());
+    uint32_t seq = read_be<uint32_t>(hdr.data() + 4);
+    unsigned payload_len = p.len() - hdr_len;
+    oi.tso_seg_size = 0;
+
+    for (unsigned off = 0; off < payload_len; off += mss) {
+        auto n = std::min(mss, payload_len - off);
+        auto seg = p.share(hdr_len + off, n);
+        auto th = seg.prepend_uninitialized_header(hdr_len);
+        std::copy_n(hdr.begin(), hdr_len, th);
+        write_be<uint32_t>(th + 4, seq + off);
+        if (off + n < payload_len) {
+            // FIN and PSH belong to the last segment only
+            th[13] &= ~(f_fin | f_psh);
+        }
+        write_be<uint16_t>(th + 16, 0);
+
+        checksummer csum;
+        ipv4_traits::tcp_pseudo_header_checksum(csum, _host_address, to, seg.len());
+        uint16_t checksum;
+        if (hw_features().tx_csum_l4_offload) {
+            checksum = ~csum.get();
+            oi.needs_csum = true;
+        } else {
+            csum.sum(seg);
+            checksum = csum.get();
+            oi.needs_csum = false;
+        }
+        // The checksum is already in network byte order
+        std::copy_n(reinterpret_cast<const char*>(&checksum), 2, th + 16);
+        seg.set_offload_info(oi);
+        ++_tso_segments;
+        send(to, ip_protocol_num::tcp, std::move(seg), e_dst);
+    }
+}
+
 std::optional<l3_protocol::l3packet> ipv4::get_packet() {
     // _packetq will be mostly empty here unless it hold remnants of previously
     // fragmented packet
@@ -365,6 +519,10 @@ ip_packet_filter * ipv4::packet_filter() const {
     return _packet_filter;
 }
 
+void ipv4::register_l4(proto_type id, ip_protocol* handler) {
+    _l4.at(id) = handler;
+}
+
 void ipv4::frag_limit_mem() {
     if (_frag_mem <= _frag_high_thresh) {
         return;
@@ -445,6 +603,34 @@ bool ipv4::frag::is_complete() {
     return last_frag_received && nr_packet == 1 && offset == 0;
 }
 
+void ipv4::forward_tcp(unsigned cpu, packet p, ipv4_address from, ipv4_address to) {
+    auto iph = p.prepend_header<ip_hdr>();
+    iph->ihl = sizeof(*iph) / 4;
+    iph->ver = 4;
+    iph->dscp = 0;
+    iph->ecn = 0;
+    iph->len = p.len();
+    iph->id = 0;
+    iph->frag = 0;
+    iph->ttl = 64;
+    iph->ip_proto = uint8_t(ip_protocol_num::tcp);
+    iph->csum = 0;
+    iph->src_ip = from;
+    iph->dst_ip = to;
+    *iph = hton(*iph);
+    checksummer csum;
+    csum.sum(reinterpret_cast<char*>(iph), sizeof(*iph));
+    iph->csum = csum.get();
+    auto eh = p.prepend_header<eth_hdr>();
+    eh->src_mac = _netif->hw_address();
+    eh->dst_mac = _netif->hw_address();
+    eh->eth_proto = uint16_t(eth_protocol_num::ipv4);
+    *eh = hton(*eh);
+    // The segment checksum was verified on this shard
+    p.offload_info_ref().rx_csum_verified = true;
+    _netif->forward(cpu, std::move(p));
+}
+
 packet ipv4::frag::get_assembled_packet(ethernet_address from, ethernet_address to) {
     auto& ip_header = header;
     auto& ip_data = data.map.begin()->second;
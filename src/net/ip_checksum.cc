@@ -23,7 +23,13 @@
 module;
 #endif
 
+#include <cstring>
 #include <arpa/inet.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #ifdef SEASTAR_MODULE
 module seastar;
@@ -36,12 +42,140 @@ namespace seastar {
 
 namespace net {
 
+namespace {
+
+// Vectorized kernels add up the 32-bit words of a buffer, as they are laid
+// out in memory, and consume it in whole blocks. The ones' complement sum
+// doesn't depend on the byte order, so the result only has to be folded and
+// converted to host order at the end.
+//
+// With Copy, the data is also stored to dst as it is loaded.
+
+#if defined(__x86_64__)
+
+template <bool Copy>
+[[gnu::target("avx2")]]
+unsigned __int128 sum_avx2(const char*& src, char*& dst, size_t& len) {
+    auto zero = _mm256_setzero_si256();
+    auto acc0 = zero;
+    auto acc1 = zero;
+    while (len >= 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        if constexpr (Copy) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v);
+            dst += 32;
+        }
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+        src += 32;
+        len -= 32;
+    }
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(acc0, acc1));
+    return (unsigned __int128)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+template <bool Copy>
+[[gnu::target("avx512f")]]
+unsigned __int128 sum_avx512(const char*& src, char*& dst, size_t& len) {
+    auto zero = _mm512_setzero_si512();
+    auto acc0 = zero;
+    auto acc1 = zero;
+    while (len >= 64) {
+        auto v = _mm512_loadu_si512(src);
+        if constexpr (Copy) {
+            _mm512_storeu_si512(dst, v);
+            dst += 64;
+        }
+        acc0 = _mm512_add_epi64(acc0, _mm512_unpacklo_epi32(v, zero));
+        acc1 = _mm512_add_epi64(acc1, _mm512_unpackhi_epi32(v, zero));
+        src += 64;
+        len -= 64;
+    }
+    alignas(64) uint64_t lanes[8];
+    _mm512_store_si512(lanes, _mm512_add_epi64(acc0, acc1));
+    unsigned __int128 ret = 0;
+    for (auto lane : lanes) {
+        ret += lane;
+    }
+    return ret;
+}
+
+#elif defined(__aarch64__)
+
+template <bool Copy>
+unsigned __int128 sum_neon(const char*& src, char*& dst, size_t& len) {
+    auto acc0 = vdupq_n_u64(0);
+    auto acc1 = vdupq_n_u64(0);
+    while (len >= 32) {
+        auto v0 = vld1q_u32(reinterpret_cast<const uint32_t*>(src));
+        auto v1 = vld1q_u32(reinterpret_cast<const uint32_t*>(src + 16));
+        if constexpr (Copy) {
+            vst1q_u32(reinterpret_cast<uint32_t*>(dst), v0);
+            vst1q_u32(reinterpret_cast<uint32_t*>(dst + 16), v1);
+            dst += 32;
+        }
+        acc0 = vpadalq_u32(acc0, v0);
+        acc1 = vpadalq_u32(acc1, v1);
+        src += 32;
+        len -= 32;
+    }
+    auto acc = vaddq_u64(acc0, acc1);
+    return (unsigned __int128)vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+}
+
+#endif
+
+using sum_kernel = unsigned __int128 (*)(const char*& src, char*& dst, size_t& len);
+
+struct sum_kernels {
+    sum_kernel sum = nullptr;
+    sum_kernel sum_copy = nullptr;
+};
+
+sum_kernels select_kernels() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {sum_avx512<false>, sum_avx512<true>};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return {sum_avx2<false>, sum_avx2<true>};
+    }
+#elif defined(__aarch64__)
+    return {sum_neon<false>, sum_neon<true>};
+#endif
+    return {};
+}
+
+const sum_kernels kernels = select_kernels();
+
+// Shorter buffers, like protocol headers, aren't worth the setup
+constexpr size_t min_vector_len = 64;
+
+// Folds a sum of words in memory order into a 16-bit word in host order
+uint16_t fold(unsigned __int128 sum) {
+    uint64_t s = uint64_t(sum) + uint64_t(sum >> 64);
+    s += s < uint64_t(sum);
+    s = (s & 0xffff'ffff) + (s >> 32);
+    s = (s & 0xffff) + (s >> 16);
+    s = (s & 0xffff) + (s >> 16);
+    s = (s & 0xffff) + (s >> 16);
+    return ntohs(uint16_t(s));
+}
+
+}
+
 void checksummer::sum(const char* data, size_t len) {
     auto orig_len = len;
     if (odd) {
         csum += uint8_t(*data++);
         --len;
     }
+    if (kernels.sum && len >= min_vector_len) {
+        char* unused = nullptr;
+        csum += fold(kernels.sum(data, unused, len));
+    }
     auto p64 = reinterpret_cast<const packed<uint64_t>*>(data);
     while (len >= 8) {
         csum += ntohq(*p64++);
@@ -69,6 +203,25 @@ uint16_t checksummer::get() const {
     return htons(~csum);
 }
 
+void checksummer::sum_copy(char* dst, const char* src, size_t len) {
+    if (!len) {
+        return;
+    }
+    if (odd) {
+        csum += uint8_t(*dst++ = *src++);
+        --len;
+    }
+    if (kernels.sum_copy && len >= min_vector_len) {
+        csum += fold(kernels.sum_copy(src, dst, len));
+    }
+    // The tail is still hot in the cache once copied
+    std::memcpy(dst, src, len);
+    // Whole blocks were consumed from an even offset, so the parity is the
+    // tail's
+    odd = false;
+    sum(dst, len);
+}
+
 void checksummer::sum(const packet& p) {
     for (auto&& f : p.fragments()) {
         sum(f.base, f.size);
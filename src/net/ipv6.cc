@@ -0,0 +1,595 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/net/ipv6.hh>
+#include <seastar/net/tcp.hh>
+#include <seastar/net/tcp-stack.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/metrics.hh>
+#include "net/native-stack-impl.hh"
+#endif
+
+namespace seastar {
+
+namespace net {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+enum class extension_header : uint8_t {
+    hop_by_hop = 0,
+    routing = 43,
+    fragment = 44,
+    no_next_header = 59,
+    destination_options = 60,
+};
+
+enum class icmpv6_type : uint8_t {
+    echo_request = 128,
+    echo_reply = 129,
+    neighbor_solicitation = 135,
+    neighbor_advertisement = 136,
+};
+
+enum class nd_option : uint8_t {
+    source_link_layer_address = 1,
+    target_link_layer_address = 2,
+};
+
+struct icmpv6_hdr {
+    icmpv6_type type;
+    uint8_t code;
+    packed<uint16_t> csum;
+} __attribute__((packed));
+
+// Neighbor solicitations and advertisements: the header is followed by
+// options, in units of 8 bytes
+struct nd_hdr {
+    icmpv6_hdr icmp;
+    uint8_t flags;
+    uint8_t reserved[3];
+    ipv6_address target;
+    static constexpr uint8_t f_router = 0x80;
+    static constexpr uint8_t f_solicited = 0x40;
+    static constexpr uint8_t f_override = 0x20;
+} __attribute__((packed));
+
+struct nd_link_layer_option {
+    nd_option type;
+    uint8_t len;
+    ethernet_address addr;
+} __attribute__((packed));
+
+constexpr uint8_t nd_hop_limit = 255;
+constexpr uint8_t default_hop_limit = 64;
+
+bool is_multicast(const ipv6_address& a) {
+    return a.ip[0] == 0xff;
+}
+
+bool is_link_local(const ipv6_address& a) {
+    // fe80::/10, and the link-local scope of multicast
+    return (a.ip[0] == 0xfe && (a.ip[1] & 0xc0) == 0x80) || (is_multicast(a) && (a.ip[1] & 0x0f) == 0x02);
+}
+
+const ipv6_address all_nodes_address(ipv6_address::ipv6_bytes{0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1});
+
+// RFC8200, 4.2: unknown options whose type doesn't ask for skipping them
+// make the packet dropped
+bool options_acceptable(const char* opt, size_t len) {
+    constexpr uint8_t pad1 = 0, padn = 1;
+    while (len) {
+        auto type = uint8_t(opt[0]);
+        if (type == pad1) {
+            ++opt;
+            --len;
+            continue;
+        }
+        if (len < 2 || size_t(uint8_t(opt[1])) + 2 > len) {
+            return false;
+        }
+        if (type != padn && (type >> 6) != 0) {
+            return false;
+        }
+        auto n = size_t(uint8_t(opt[1])) + 2;
+        opt += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Returns the link-layer address option of a neighbor discovery message
+std::optional<ethernet_address> find_link_layer_option(packet& p, nd_option type) {
+    size_t off = sizeof(nd_hdr);
+    while (off + 8 <= p.len()) {
+        auto opt = p.get_header(off, 8);
+        auto units = uint8_t(opt[1]);
+        if (!units) {
+            return std::nullopt;
+        }
+        if (nd_option(opt[0]) == type) {
+            return ethernet_address::read(opt + 2);
+        }
+        off += units * 8;
+    }
+    return std::nullopt;
+}
+
+}
+
+ipv6::ipv6(interface* netif)
+    : _netif(netif)
+    , _link_local_address(make_link_local_address(netif->hw_address()))
+    , _l3(netif, eth_protocol_num::ipv6, [this] { return get_packet(); })
+    , _tcp_l4(*this)
+    , _tcp(std::make_unique<tcp<ipv6_traits>>(_tcp_l4))
+    , _neighbors([this] (const ipv6_address& target, std::optional<ethernet_address> known) {
+        send_neighbor_solicitation(target, known);
+    })
+{
+    namespace sm = seastar::metrics;
+    // FIXME: ignored future
+    (void)_l3.receive(
+        [this](packet p, ethernet_address ea) {
+            return handle_received_packet(std::move(p), ea);
+        },
+        [this](forward_hash& out_hash_data, packet& p, size_t off) {
+            return forward(out_hash_data, p, off);
+        });
+
+    register_packet_provider([this] {
+        std::optional<ipv6_traits::l4packet> l4p;
+        if (!_icmp_packetq.empty()) {
+            l4p = std::move(_icmp_packetq.front());
+            _icmp_packetq.pop_front();
+            _icmp_queue_space.signal(l4p.value().p.len());
+        }
+        return l4p;
+    });
+
+    _metrics.add_group("ipv6", {
+        sm::make_counter("dropped_extension_headers", _stats.dropped_extension_headers,
+                        sm::description("Counts packets dropped because of extension headers the stack doesn't handle, such as fragments")),
+        sm::make_counter("neighbor_solicitations_sent", _stats.neighbor_solicitations_sent,
+                        sm::description("Counts neighbor solicitations sent to resolve or refresh link-layer addresses")),
+        sm::make_counter("neighbor_solicitations_received", _stats.neighbor_solicitations_received,
+                        sm::description("Counts neighbor solicitations received for one of our addresses")),
+        sm::make_counter("neighbor_advertisements_received", _stats.neighbor_advertisements_received,
+                        sm::description("Counts neighbor advertisements received")),
+        sm::make_gauge("neighbors", [this] { return _neighbors.size(); },
+                        sm::description("Holds the number of entries of the neighbor cache")),
+        sm::make_counter("neighbor_cache_misses", [this] { return _neighbors.get_stats().misses; },
+                        sm::description("Counts lookups of neighbors with no valid link-layer address, which wait for its resolution")),
+        sm::make_counter("neighbor_cache_refreshes", [this] { return _neighbors.get_stats().refreshes; },
+                        sm::description("Counts neighbor entries refreshed ahead of their expiry")),
+        sm::make_counter("neighbor_resolution_timeouts", [this] { return _neighbors.get_stats().timeouts; },
+                        sm::description("Counts neighbor resolutions which got no answer")),
+    });
+}
+
+ipv6::~ipv6() {
+}
+
+ipv6_address ipv6::make_link_local_address(ethernet_address mac) {
+    auto& m = mac.mac;
+    return ipv6_address(ipv6_address::ipv6_bytes{0xfe, 0x80, 0, 0, 0, 0, 0, 0,
+            uint8_t(m[0] ^ 0x02), m[1], m[2], 0xff, 0xfe, m[3], m[4], m[5]});
+}
+
+ipv6_address ipv6::solicited_node_address(const ipv6_address& a) {
+    return ipv6_address(ipv6_address::ipv6_bytes{0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0xff,
+            a.ip[13], a.ip[14], a.ip[15]});
+}
+
+ethernet_address ipv6::multicast_ethernet_address(const ipv6_address& a) {
+    return ethernet_address{0x33, 0x33, a.ip[12], a.ip[13], a.ip[14], a.ip[15]};
+}
+
+void ipv6::set_host_address(ipv6_address ip, unsigned prefix_length) {
+    _host_address = ip;
+    _prefix_length = std::min(prefix_length, 128u);
+}
+
+ipv6_address ipv6::host_address() const {
+    return _host_address.is_unspecified() ? _link_local_address : _host_address;
+}
+
+ipv6_address ipv6::source_address(const ipv6_address& to) const {
+    if (is_link_local(to) || _host_address.is_unspecified()) {
+        return _link_local_address;
+    }
+    return _host_address;
+}
+
+void ipv6::set_gw_address(ipv6_address ip) {
+    _gw_address = ip;
+}
+
+ipv6_address ipv6::gw_address() const {
+    return _gw_address;
+}
+
+bool ipv6::is_my_address(const ipv6_address& a) const {
+    return a == _link_local_address || (!_host_address.is_unspecified() && a == _host_address);
+}
+
+bool ipv6::on_link(const ipv6_address& a) const {
+    if (is_link_local(a) || is_multicast(a) || _gw_address.is_unspecified()) {
+        return true;
+    }
+    if (_host_address.is_unspecified()) {
+        return false;
+    }
+    auto bytes = _prefix_length / 8;
+    auto bits = _prefix_length % 8;
+    if (!std::equal(a.ip.begin(), a.ip.begin() + bytes, _host_address.ip.begin())) {
+        return false;
+    }
+    uint8_t mask = 0xff00 >> bits;
+    return !bits || !((a.ip[bytes] ^ _host_address.ip[bytes]) & mask);
+}
+
+std::optional<std::pair<uint8_t, size_t>> ipv6::upper_layer(packet& p, size_t off, uint8_t next) {
+    // Bounds the work spent on a packet, legitimate ones carry a few
+    constexpr unsigned max_extension_headers = 8;
+    for (unsigned i = 0; i < max_extension_headers; ++i) {
+        switch (extension_header(next)) {
+        case extension_header::hop_by_hop:
+        case extension_header::destination_options: {
+            auto eh = p.get_header(off, 2);
+            if (!eh) {
+                return std::nullopt;
+            }
+            size_t len = (size_t(uint8_t(eh[1])) + 1) * 8;
+            eh = p.get_header(off, len);
+            if (!eh || !options_acceptable(eh + 2, len - 2)) {
+                return std::nullopt;
+            }
+            next = eh[0];
+            off += len;
+            break;
+        }
+        case extension_header::routing: {
+            auto eh = p.get_header(off, 4);
+            // Segments are left to visit: the packet is to be routed, and
+            // we aren't a router
+            if (!eh || eh[3] != 0) {
+                return std::nullopt;
+            }
+            next = eh[0];
+            off += (size_t(uint8_t(eh[1])) + 1) * 8;
+            break;
+        }
+        case extension_header::fragment: {
+            auto eh = p.get_header(off, 8);
+            // Only atomic fragments, with a zero offset and no more
+            // fragments (RFC6946), are accepted
+            if (!eh || (read_be<uint16_t>(eh + 2) & 0xfff9) != 0) {
+                return std::nullopt;
+            }
+            next = eh[0];
+            off += 8;
+            break;
+        }
+        default:
+            return std::make_pair(next, off);
+        }
+    }
+    return std::nullopt;
+}
+
+bool ipv6::forward(forward_hash& out_hash_data, packet& p, size_t off) {
+    auto iph = p.get_header<ipv6_hdr>(off);
+    if (!iph) {
+        return false;
+    }
+    auto next = iph->next_header;
+    ipv6_traits::hash_address(out_hash_data, iph->src_ip);
+    ipv6_traits::hash_address(out_hash_data, iph->dst_ip);
+    auto l4 = upper_layer(p, off + sizeof(ipv6_hdr), next);
+    if (l4 && l4->first == uint8_t(ip_protocol_num::tcp)) {
+        // Same shard as the connection hash, see l4connid::hash()
+        _tcp->forward(out_hash_data, p, l4->second);
+    }
+    // else forward according to ip fields only
+    return true;
+}
+
+future<> ipv6::handle_received_packet(packet p, ethernet_address from) {
+    auto iph = p.get_header<ipv6_hdr>(0);
+    if (!iph) {
+        return make_ready_future<>();
+    }
+    auto h = ntoh(*iph);
+    if (h.version() != 6) {
+        return make_ready_future<>();
+    }
+    unsigned len = sizeof(ipv6_hdr) + h.payload_len;
+    if (p.len() < len) {
+        return make_ready_future<>();
+    }
+    // Trim the Ethernet padding
+    p.trim_back(p.len() - len);
+
+    auto& dst = h.dst_ip;
+    if (!is_my_address(dst) && dst != all_nodes_address
+            && dst != solicited_node_address(_link_local_address)
+            && (_host_address.is_unspecified() || dst != solicited_node_address(_host_address))) {
+        return make_ready_future<>();
+    }
+
+    auto l4 = upper_layer(p, sizeof(ipv6_hdr), h.next_header);
+    if (!l4) {
+        ++_stats.dropped_extension_headers;
+        return make_ready_future<>();
+    }
+    auto [proto, off] = *l4;
+    p.trim_front(off);
+    switch (ip_protocol_num(proto)) {
+    case ip_protocol_num::tcp:
+        if (!is_multicast(dst)) {
+            _tcp->received(std::move(p), h.src_ip, dst);
+        }
+        break;
+    case ip_protocol_num::icmpv6:
+        icmp_received(std::move(p), from, h);
+        break;
+    default:
+        break;
+    }
+    return make_ready_future<>();
+}
+
+void ipv6::icmp_received(packet p, ethernet_address from, const ipv6_hdr& h) {
+    auto hdr = p.get_header<icmpv6_hdr>(0);
+    if (!hdr) {
+        return;
+    }
+    // The checksum is mandatory and covers a pseudo header, which devices
+    // don't verify for ICMPv6
+    checksummer csum;
+    ipv6_traits::pseudo_header_checksum(csum, ip_protocol_num::icmpv6, h.src_ip, h.dst_ip, p.len());
+    csum.sum(p);
+    if (csum.get() != 0) {
+        return;
+    }
+    switch (hdr->type) {
+    case icmpv6_type::echo_request: {
+        hdr->type = icmpv6_type::echo_reply;
+        hdr->code = 0;
+        auto to = h.src_ip;
+        if (!_icmp_queue_space.try_wait(p.len())) {
+            // drop packets that do not fit the queue
+            return;
+        }
+        // FIXME: future is discarded
+        (void)get_l2_dst_address(to).then_wrapped([this, to, p = std::move(p)] (future<ethernet_address> f) mutable {
+            if (f.failed()) {
+                f.ignore_ready_future();
+                _icmp_queue_space.signal(p.len());
+                return;
+            }
+            send_icmp(to, std::move(p), f.get());
+        });
+        break;
+    }
+    case icmpv6_type::neighbor_solicitation:
+        handle_neighbor_solicitation(p, from, h);
+        break;
+    case icmpv6_type::neighbor_advertisement:
+        handle_neighbor_advertisement(p, h);
+        break;
+    default:
+        break;
+    }
+}
+
+void ipv6::handle_neighbor_solicitation(packet& p, ethernet_address from, const ipv6_hdr& h) {
+    auto ns = p.get_header<nd_hdr>(0);
+    // RFC4861, 7.1.1: the hop limit proves the message wasn't routed
+    if (!ns || h.hop_limit != nd_hop_limit || ns->icmp.code != 0 || !is_my_address(ns->target)) {
+        return;
+    }
+    ++_stats.neighbor_solicitations_received;
+    auto target = ns->target;
+    auto source_lla = find_link_layer_option(p, nd_option::source_link_layer_address);
+    bool dad = h.src_ip.is_unspecified();
+    if (source_lla && !dad) {
+        ndisc_learn(*source_lla, h.src_ip);
+    }
+
+    // Duplicate address detection probes are answered to all nodes
+    auto to = dad ? all_nodes_address : h.src_ip;
+    auto e_dst = dad ? multicast_ethernet_address(to) : source_lla.value_or(from);
+    if (!_icmp_queue_space.try_wait(sizeof(nd_hdr) + sizeof(nd_link_layer_option))) {
+        return;
+    }
+    packet reply;
+    auto option = reply.prepend_header<nd_link_layer_option>();
+    option->type = nd_option::target_link_layer_address;
+    option->len = sizeof(nd_link_layer_option) / 8;
+    option->addr = _netif->hw_address();
+    auto na = reply.prepend_header<nd_hdr>();
+    na->icmp.type = icmpv6_type::neighbor_advertisement;
+    na->icmp.code = 0;
+    na->flags = (dad ? 0 : nd_hdr::f_solicited) | nd_hdr::f_override;
+    std::fill(std::begin(na->reserved), std::end(na->reserved), 0);
+    na->target = target;
+    send_icmp(to, std::move(reply), e_dst);
+}
+
+void ipv6::handle_neighbor_advertisement(packet& p, const ipv6_hdr& h) {
+    auto na = p.get_header<nd_hdr>(0);
+    if (!na || h.hop_limit != nd_hop_limit || na->icmp.code != 0 || is_multicast(na->target)) {
+        return;
+    }
+    ++_stats.neighbor_advertisements_received;
+    auto target = na->target;
+    auto target_lla = find_link_layer_option(p, nd_option::target_link_layer_address);
+    if (target_lla) {
+        ndisc_learn(*target_lla, target);
+    }
+}
+
+void ipv6::send_neighbor_solicitation(const ipv6_address& target, std::optional<ethernet_address> known) {
+    if (!_icmp_queue_space.try_wait(sizeof(nd_hdr) + sizeof(nd_link_layer_option))) {
+        return;
+    }
+    ++_stats.neighbor_solicitations_sent;
+    packet p;
+    auto option = p.prepend_header<nd_link_layer_option>();
+    option->type = nd_option::source_link_layer_address;
+    option->len = sizeof(nd_link_layer_option) / 8;
+    option->addr = _netif->hw_address();
+    auto ns = p.prepend_header<nd_hdr>();
+    ns->icmp.type = icmpv6_type::neighbor_solicitation;
+    ns->icmp.code = 0;
+    ns->flags = 0;
+    std::fill(std::begin(ns->reserved), std::end(ns->reserved), 0);
+    ns->target = target;
+    // RFC4861, 7.2.2: reachability is confirmed with unicast solicitations
+    auto to = known ? target : solicited_node_address(target);
+    send_icmp(to, std::move(p), known.value_or(multicast_ethernet_address(to)));
+}
+
+void ipv6::send_icmp(const ipv6_address& to, packet p, ethernet_address e_dst) {
+    auto hdr = p.get_header<icmpv6_hdr>(0);
+    hdr->csum = 0;
+    checksummer csum;
+    ipv6_traits::pseudo_header_checksum(csum, ip_protocol_num::icmpv6, source_address(to), to, p.len());
+    csum.sum(p);
+    hdr->csum = csum.get();
+    _icmp_packetq.emplace_back(ipv6_traits::l4packet{to, std::move(p), e_dst, ip_protocol_num::icmpv6});
+}
+
+future<ethernet_address> ipv6::resolve(const ipv6_address& addr) {
+    if (is_multicast(addr)) {
+        return make_ready_future<ethernet_address>(multicast_ethernet_address(addr));
+    }
+    return _neighbors.lookup(addr);
+}
+
+void ipv6::learn(ethernet_address l2, ipv6_address l3) {
+    _neighbors.learn(l3, l2);
+}
+
+future<ethernet_address> ipv6::get_l2_dst_address(const ipv6_address& to) {
+    // Directly connected hosts are sent to directly, others through the
+    // default gateway
+    return resolve(on_link(to) ? to : _gw_address);
+}
+
+void ipv6::send(const ipv6_address& to, ip_protocol_num proto_num, packet p, ethernet_address e_dst) {
+    auto payload_len = p.len();
+    auto iph = p.prepend_header<ipv6_hdr>();
+    iph->ver_tc_flow = uint32_t(6) << 28;
+    iph->payload_len = payload_len;
+    iph->next_header = uint8_t(proto_num);
+    // Neighbor discovery requires the maximal hop limit, the other ICMPv6
+    // messages don't mind
+    iph->hop_limit = proto_num == ip_protocol_num::icmpv6 ? nd_hop_limit : default_hop_limit;
+    iph->src_ip = source_address(to);
+    iph->dst_ip = to;
+    *iph = hton(*iph);
+
+    // There is no header checksum, the L4 offloads need to know where
+    // the header ends
+    auto& oi = p.offload_info_ref();
+    oi.ip_hdr_len = sizeof(ipv6_hdr);
+    oi.ipv6 = true;
+    oi.needs_ip_csum = false;
+
+    _packetq.push_back(l3_protocol::l3packet{eth_protocol_num::ipv6, e_dst, std::move(p)});
+}
+
+std::optional<l3_protocol::l3packet> ipv6::get_packet() {
+    if (_packetq.empty()) {
+        for (size_t i = 0; i < _pkt_providers.size(); i++) {
+            auto l4p = _pkt_providers[_pkt_provider_idx++]();
+            if (_pkt_provider_idx == _pkt_providers.size()) {
+                _pkt_provider_idx = 0;
+            }
+            if (l4p) {
+                auto l4pv = std::move(l4p.value());
+                send(l4pv.to, l4pv.proto_num, std::move(l4pv.p), l4pv.e_dst);
+                break;
+            }
+        }
+    }
+
+    std::optional<l3_protocol::l3packet> p;
+    if (!_packetq.empty()) {
+        p = std::move(_packetq.front());
+        _packetq.pop_front();
+    }
+    return p;
+}
+
+void ipv6::forward_tcp(unsigned cpu, packet p, ipv6_address from, ipv6_address to) {
+    auto payload_len = p.len();
+    auto iph = p.prepend_header<ipv6_hdr>();
+    iph->ver_tc_flow = uint32_t(6) << 28;
+    iph->payload_len = payload_len;
+    iph->next_header = uint8_t(ip_protocol_num::tcp);
+    iph->hop_limit = default_hop_limit;
+    iph->src_ip = from;
+    iph->dst_ip = to;
+    *iph = hton(*iph);
+    auto eh = p.prepend_header<eth_hdr>();
+    eh->src_mac = _netif->hw_address();
+    eh->dst_mac = _netif->hw_address();
+    eh->eth_proto = uint16_t(eth_protocol_num::ipv6);
+    *eh = hton(*eh);
+    // The segment checksum was verified on this shard
+    p.offload_info_ref().rx_csum_verified = true;
+    _netif->forward(cpu, std::move(p));
+}
+
+server_socket
+tcpv6_listen(tcp<ipv6_traits>& tcpv6, uint16_t port, listen_options opts) {
+    return server_socket(std::make_unique<native_server_socket_impl<tcp<ipv6_traits>>>(
+            tcpv6, port, opts));
+}
+
+::seastar::socket
+tcpv6_socket(tcp<ipv6_traits>& tcpv6) {
+    return ::seastar::socket(std::make_unique<native_socket_impl<tcp<ipv6_traits>>>(
+            tcpv6));
+}
+
+}
+
+}
@@ -22,9 +22,14 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #endif
 
+#include <seastar/core/reactor.hh>
 #include <seastar/net/stack.hh>
 #include <seastar/net/inet_address.hh>
 
@@ -65,11 +70,11 @@ native_server_socket_impl<Protocol>::accept() {
         // Save "conn" contents before call below function
         // "conn" is moved in 1st argument, and used in 2nd argument
         // It causes trouble on Arm which passes arguments from left to right
-        auto ip = conn.foreign_ip().ip;
+        auto ip = conn.foreign_ip();
         auto port = conn.foreign_port();
         return make_ready_future<accept_result>(accept_result{
                 connected_socket(std::make_unique<native_connected_socket_impl<Protocol>>(make_lw_shared(std::move(conn)))),
-                make_ipv4_address(ip, port)});
+                socket_address(net::inet_address(ip), port)});
     });
 }
 
@@ -124,7 +129,7 @@ class native_socket_impl final : public socket_impl {
         assert(proto == transport::TCP);
 
         // FIXME: local is ignored since native stack does not support multiple IPs yet
-        assert(sa.as_posix_sockaddr().sa_family == AF_INET);
+        assert(sa.as_posix_sockaddr().sa_family == Protocol::inet_traits::address_family);
 
         _conn = make_lw_shared<typename Protocol::connection>(_proto.connect(sa));
         return _conn->connected().then([conn = _conn]() mutable {
@@ -175,6 +180,12 @@ class native_connected_socket_impl<Protocol>::native_data_source_impl final
             _buf = _conn->read();
             _cur_frag = 0;
             _eof = !_buf.len();
+            auto f = internal::charge_network_receive(_buf.len());
+            if (!f.available()) {
+                return f.then([this] {
+                    return get();
+                });
+            }
             return get();
         });
     }
@@ -194,6 +205,12 @@ class native_connected_socket_impl<Protocol>::native_data_sink_impl final
         : _conn(std::move(conn)) {}
     using data_sink_impl::put;
     virtual future<> put(packet p) override {
+        auto f = internal::charge_network_send(p.len());
+        if (!f.available()) {
+            return f.then([this, p = std::move(p)] () mutable {
+                return _conn->send(std::move(p));
+            });
+        }
         return _conn->send(std::move(p));
     }
     virtual future<> close() override {
@@ -266,11 +283,26 @@ keepalive_params native_connected_socket_impl<Protocol>::get_keepalive_parameter
 
 template<typename Protocol>
 void native_connected_socket_impl<Protocol>::set_sockopt(int level, int optname, const void* data, size_t len) {
+    if (level == IPPROTO_TCP && optname == TCP_CONGESTION) {
+        auto name = static_cast<const char*>(data);
+        _conn->set_congestion_control(std::string_view(name, strnlen(name, len)));
+        return;
+    }
     throw std::runtime_error("Setting custom socket options is not supported for native stack");
 }
 
 template<typename Protocol>
 int native_connected_socket_impl<Protocol>::get_sockopt(int level, int optname, void* data, size_t len) const {
+    if (level == IPPROTO_TCP && optname == TCP_CONGESTION) {
+        auto name = _conn->congestion_control();
+        auto out = static_cast<char*>(data);
+        auto n = std::min(name.size(), len);
+        std::copy_n(name.data(), n, out);
+        if (n < len) {
+            out[n] = '\0';
+        }
+        return 0;
+    }
     throw std::runtime_error("Getting custom socket options is not supported for native stack");
 }
 
@@ -49,6 +49,7 @@ module seastar;
 #include "net/native-stack-impl.hh"
 #include <seastar/net/net.hh>
 #include <seastar/net/ip.hh>
+#include <seastar/net/ipv6.hh>
 #include <seastar/net/tcp-stack.hh>
 #include <seastar/net/tcp.hh>
 #include <seastar/net/udp.hh>
@@ -85,11 +86,17 @@ void create_native_net_device(const native_stack_options& opts) {
     std::unique_ptr<device> dev;
 
     if ( deprecated_config_used) {
+        if (!opts.xdp_opts.xdp_interface.get_value().empty()) {
+            dev = create_xdp_net_device(opts.xdp_opts);
+        } else
 #ifdef SEASTAR_HAVE_DPDK
         if ( opts.dpdk_pmd) {
              dev = create_dpdk_net_device(opts.dpdk_opts.dpdk_port_index.get_value(), smp::count,
                 !(opts.lro && opts.lro.get_value() == "off"),
-                !(opts.dpdk_opts.hw_fc && opts.dpdk_opts.hw_fc.get_value() == "off"));
+                !(opts.dpdk_opts.hw_fc && opts.dpdk_opts.hw_fc.get_value() == "off"),
+                std::chrono::milliseconds(opts.dpdk_opts.rss_rebalance_interval.get_value()),
+                opts.packet_timestamps.get_value(),
+                opts.dpdk_opts.hw_flow_steering.get_value() == "on");
        } else 
 #endif  
         dev = create_virtio_net_device(opts.virtio_opts, opts.lro);
@@ -163,6 +170,7 @@ class native_network_stack : public network_stack {
 private:
     interface _netif;
     ipv4 _inet;
+    ipv6 _inet6;
     bool _dhcp = false;
     promise<> _config;
     timer<> _timer;
@@ -193,6 +201,9 @@ class native_network_stack : public network_stack {
     void arp_learn(ethernet_address l2, ipv4_address l3) {
         _inet.learn(l2, l3);
     }
+    void ndisc_learn(ethernet_address l2, ipv6_address l3) {
+        _inet6.learn(l2, l3);
+    }
     friend class native_server_socket_impl<tcp4>;
 
     class native_network_interface;
@@ -222,8 +233,13 @@ net::datagram_channel native_network_stack::make_bound_datagram_channel(const so
 
 native_network_stack::native_network_stack(const native_stack_options& opts, std::shared_ptr<device> dev)
     : _netif(std::move(dev))
-    , _inet(&_netif) {
+    , _inet(&_netif)
+    , _inet6(&_netif) {
     _inet.get_udp().set_queue_size(opts.udpv4_queue_size.get_value());
+    _inet.set_sw_gro(opts.sw_gro.get_value());
+    _inet.set_sw_tso(opts.sw_tso.get_value());
+    _inet.get_tcp().set_congestion_control(opts.tcp_congestion_control.get_value());
+    _netif.set_packet_timestamps(opts.packet_timestamps.get_value());
     _dhcp = opts.host_ipv4_addr.defaulted()
             && opts.gw_ipv4_addr.defaulted()
             && opts.netmask_ipv4_addr.defaulted() && opts.dhcp.get_value();
@@ -232,16 +248,56 @@ native_network_stack::native_network_stack(const native_stack_options& opts, std
         _inet.set_gw_address(ipv4_address(opts.gw_ipv4_addr.get_value()));
         _inet.set_netmask_address(ipv4_address(opts.netmask_ipv4_addr.get_value()));
     }
+    if (!opts.host_ipv6_addr.get_value().empty()) {
+        _inet6.set_host_address(ipv6_address(opts.host_ipv6_addr.get_value()), opts.ipv6_prefix_length.get_value());
+    }
+    if (!opts.gw_ipv6_addr.get_value().empty()) {
+        _inet6.set_gw_address(ipv6_address(opts.gw_ipv6_addr.get_value()));
+    }
 }
 
 server_socket
 native_network_stack::listen(socket_address sa, listen_options opts) {
+    if (sa.family() == AF_INET6) {
+        return tcpv6_listen(_inet6.get_tcp(), sa.port(), opts);
+    }
     assert(sa.family() == AF_INET || sa.is_unspecified());
     return tcpv4_listen(_inet.get_tcp(), ntohs(sa.as_posix_sockaddr_in().sin_port), opts);
 }
 
+// The address family is only known once connecting
+class native_dual_stack_socket_impl final : public socket_impl {
+    tcp<ipv4_traits>& _tcp4;
+    tcp<ipv6_traits>& _tcp6;
+    std::unique_ptr<socket_impl> _impl;
+public:
+    native_dual_stack_socket_impl(tcp<ipv4_traits>& tcp4, tcp<ipv6_traits>& tcp6)
+        : _tcp4(tcp4), _tcp6(tcp6) {}
+    virtual future<connected_socket> connect(socket_address sa, socket_address local, transport proto = transport::TCP) override {
+        if (sa.family() == AF_INET6) {
+            _impl = std::make_unique<native_socket_impl<tcp<ipv6_traits>>>(_tcp6);
+        } else {
+            _impl = std::make_unique<native_socket_impl<tcp<ipv4_traits>>>(_tcp4);
+        }
+        return _impl->connect(sa, local, proto);
+    }
+    virtual void set_reuseaddr(bool reuseaddr) override {
+        // FIXME: implement
+        std::cerr << "Reuseaddr is not supported by native stack" << std::endl;
+    }
+    virtual bool get_reuseaddr() const override {
+        // FIXME: implement
+        return false;
+    }
+    virtual void shutdown() override {
+        if (_impl) {
+            _impl->shutdown();
+        }
+    }
+};
+
 seastar::socket native_network_stack::socket() {
-    return tcpv4_socket(_inet.get_tcp());
+    return seastar::socket(std::make_unique<native_dual_stack_socket_impl>(_inet.get_tcp(), _inet6.get_tcp()));
 }
 
 using namespace std::chrono_literals;
@@ -326,6 +382,15 @@ void arp_learn(ethernet_address l2, ipv4_address l3)
     });
 }
 
+void ndisc_learn(ethernet_address l2, ipv6_address l3)
+{
+    // Run ndisc_learn on all shard in the background
+    (void)smp::invoke_on_all([l2, l3] {
+        auto & ns = static_cast<native_network_stack&>(engine().net());
+        ns.ndisc_learn(l2, l3);
+    });
+}
+
 void create_native_stack(const native_stack_options& opts, std::shared_ptr<device> dev) {
     native_network_stack::ready_promise.set_value(std::unique_ptr<network_stack>(std::make_unique<native_network_stack>(opts, std::move(dev))));
 }
@@ -347,6 +412,15 @@ native_stack_options::native_stack_options()
     , netmask_ipv4_addr(*this, "netmask-ipv4-addr",
                 "255.255.255.0",
                 "static IPv4 netmask to use")
+    , host_ipv6_addr(*this, "host-ipv6-addr",
+                "",
+                "static global IPv6 address to use, besides the link-local one")
+    , ipv6_prefix_length(*this, "ipv6-prefix-length",
+                ipv6::default_prefix_length,
+                "prefix length of the static IPv6 address")
+    , gw_ipv6_addr(*this, "gw-ipv6-addr",
+                "",
+                "static IPv6 gateway to use")
     , udpv4_queue_size(*this, "udpv4-queue-size",
                 ipv4_udp::default_queue_size,
                 "Default size of the UDPv4 per-channel packet queue")
@@ -364,8 +438,21 @@ native_stack_options::native_stack_options()
     , lro(*this, "lro",
                 "on",
                 "Enable LRO")
+    , sw_gro(*this, "sw-gro",
+                false,
+                "Merge in-order TCP segments in software before processing them")
+    , sw_tso(*this, "sw-tso",
+                false,
+                "Segment large TCP packets in software when the device doesn't support TSO")
+    , tcp_congestion_control(*this, "tcp-congestion-control",
+                "reno",
+                "TCP congestion control algorithm (reno, cubic or bbr)")
+    , packet_timestamps(*this, "packet-timestamps",
+                false,
+                "Timestamp packets and export NIC-to-application and application-to-device latency histograms")
     , virtio_opts(this)
     , dpdk_opts(this)
+    , xdp_opts(this)
 {
 }
 
@@ -380,8 +467,11 @@ class native_network_stack::native_network_interface : public net::network_inter
 public:
     native_network_interface(const native_network_stack& stack)
         : _stack(stack)
-        , _addresses(1, _stack._inet.host_address())
+        , _addresses{_stack._inet.host_address(), _stack._inet6.link_local_address()}
     {
+        if (_stack._inet6.host_address() != _stack._inet6.link_local_address()) {
+            _addresses.emplace_back(_stack._inet6.host_address());
+        }
         const auto mac = _stack._inet.netif()->hw_address().mac;
         _hardware_address = std::vector<uint8_t>{mac.cbegin(), mac.cend()};
     }
@@ -416,7 +506,7 @@ class native_network_stack::native_network_interface : public net::network_inter
         return true;
     }
     bool supports_ipv6() const override {
-        return false;
+        return true;
     }
 };
 
@@ -94,6 +94,9 @@ bool qp::poll_tx() {
                 auto p = pr();
                 if (p) {
                     work++;
+                    if (auto ts = p->timestamp()) {
+                        _stats.tx.latency.add(std::chrono::system_clock::now() - *ts);
+                    }
                     _tx_packetq.push_back(std::move(p.value()));
                     if (_tx_packetq.size() == 128) {
                         break;
@@ -169,6 +172,16 @@ qp::qp(bool register_copy_stats,
         // Rx
         sm::make_counter(_queue_name + "_rx_frags", _stats.rx.good.nr_frags,
                         sm::description(format("Counts a number of received fragments. Divide this value by a {} to get an average number of fragments in an Rx packet.", _queue_name + "_rx_packets"))),
+
+        //
+        // Latency of timestamped packets, see interface::set_packet_timestamps()
+        //
+        // Rx
+        sm::make_histogram(_queue_name + "_rx_latency", [this] { return _stats.rx.latency.to_metrics_histogram(); },
+                        sm::description("A histogram of the time from the reception of a packet by the NIC to the application reading it.")).set_skip_when_empty(),
+        // Tx
+        sm::make_histogram(_queue_name + "_tx_latency", [this] { return _stats.tx.latency.to_metrics_histogram(); },
+                        sm::description("A histogram of the time from the application sending a packet to handing it to the device for transmission.")).set_skip_when_empty(),
     });
 
     if (register_copy_stats) {
@@ -304,6 +317,18 @@ unsigned interface::hash2cpu(uint32_t hash) {
     return _dev->hash2cpu(hash);
 }
 
+std::optional<unsigned> interface::previous_flow_owner(uint32_t hash) {
+    return _dev->previous_flow_owner(hash);
+}
+
+std::unique_ptr<flow_steering_rule> interface::steer_flow(const flow_tuple& flow) {
+    return _dev->steer_flow(flow);
+}
+
+void interface::register_flow_census(flow_census_type func) {
+    _dev->local_queue().register_flow_census(std::move(func));
+}
+
 uint16_t interface::hw_queues_count() {
     return _dev->hw_queues_count();
 }
@@ -327,7 +352,14 @@ void interface::forward(unsigned cpuid, packet p) {
     }
 }
 
+void interface::account_rx_latency(const packet& p) {
+    _dev->local_queue().account_rx_latency(p);
+}
+
 future<> interface::dispatch_packet(packet p) {
+    if (_timestamps && !p.timestamp()) {
+        p.set_timestamp(std::chrono::system_clock::now());
+    }
     auto eh = p.get_header<eth_hdr>();
     if (eh) {
         auto i = _proto_map.find(ntoh(eh->eth_proto));
@@ -29,6 +29,8 @@ module;
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <new>
+#include <vector>
 
 #ifdef SEASTAR_MODULE
 module seastar;
@@ -47,6 +49,70 @@ namespace net {
 
 static_assert(std::is_nothrow_move_constructible_v<packet>);
 
+namespace {
+
+// Recycles packet::impl objects with the default number of fragments
+class packet_impl_cache {
+    static constexpr size_t max_cached = 4096;
+    std::vector<void*> _free;
+public:
+    packet_impl_cache() {
+        _free.reserve(max_cached);
+    }
+    ~packet_impl_cache() {
+        for (auto p : _free) {
+            ::operator delete(p);
+        }
+        _free.clear();
+        destroyed = true;
+    }
+    // Packets may outlive the cache on exit
+    static thread_local bool destroyed;
+
+    void* allocate(size_t size) {
+        if (destroyed || _free.empty()) {
+            return ::operator new(size);
+        }
+        auto p = _free.back();
+        _free.pop_back();
+        return p;
+    }
+    void deallocate(void* p) noexcept {
+        if (destroyed || _free.size() == max_cached) {
+            ::operator delete(p);
+            return;
+        }
+        _free.push_back(p);
+    }
+};
+
+thread_local bool packet_impl_cache::destroyed = false;
+thread_local packet_impl_cache impl_cache;
+
+}
+
+void* packet::impl::operator new(size_t size, size_t nr_frags) {
+    assert(nr_frags == uint16_t(nr_frags));
+    if (nr_frags == default_nr_frags) {
+        return impl_cache.allocate(size + nr_frags * sizeof(fragment));
+    }
+    return ::operator new(size + nr_frags * sizeof(fragment));
+}
+
+void packet::impl::operator delete(void* ptr, size_t nr_frags) {
+    if (nr_frags == default_nr_frags) {
+        impl_cache.deallocate(ptr);
+    } else {
+        ::operator delete(ptr);
+    }
+}
+
+void packet::impl::operator delete(impl* ptr, std::destroying_delete_t) {
+    auto nr_frags = ptr->_allocated_frags;
+    ptr->~impl();
+    operator delete(static_cast<void*>(ptr), nr_frags);
+}
+
 void packet::linearize(size_t at_frag, size_t desired_size) {
     _impl->unuse_internal_data();
     size_t nr_frags = 0;
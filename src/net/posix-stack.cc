@@ -32,25 +32,34 @@ module;
 
 #include <unistd.h>
 #include <linux/if.h>
+#include <linux/net_tstamp.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <arpa/inet.h>
 #include <net/route.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <netinet/sctp.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <sys/socket.h>
+#include <sys/sysinfo.h>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/internal/dma_buffer_pool.hh>
 #include <seastar/net/posix-stack.hh>
 #include <seastar/net/net.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/net/api.hh>
 #include <seastar/net/inet_address.hh>
 #include <seastar/util/std-compat.hh>
+#include "core/file-impl.hh"
+#include "net/bpf.hh"
 #endif
 
 namespace std {
@@ -231,27 +240,111 @@ static void shutdown_socket_fd(pollable_fd& fd, int how) noexcept {
     }
 }
 
+// SCM_MAX_FD of the kernel
+static constexpr size_t posix_max_passed_fds = 253;
+
+static file_desc dup_cloexec(const file_desc& fd) {
+    int r = ::fcntl(fd.get(), F_DUPFD_CLOEXEC, 0);
+    throw_system_error_on(r == -1, "fcntl");
+    return file_desc::from_fd(r);
+}
+
+// The file descriptors received by a unix domain socket, which its input
+// stream reads ahead of take_received_fds()
+using received_fds = std::vector<file_desc>;
+
+// Reads a unix domain socket, keeping the file descriptors passed along
+// with the data
+class posix_unix_data_source_impl final : public data_source_impl {
+    pollable_fd _fd;
+    connected_socket_input_stream_config _config;
+    lw_shared_ptr<received_fds> _fds;
+    std::pmr::polymorphic_allocator<char>* _allocator;
+    alignas(cmsghdr) char _cmsg[CMSG_SPACE(sizeof(int) * posix_max_passed_fds)];
+public:
+    posix_unix_data_source_impl(pollable_fd fd, connected_socket_input_stream_config config, lw_shared_ptr<received_fds> fds,
+            std::pmr::polymorphic_allocator<char>* allocator)
+        : _fd(std::move(fd)), _config(config), _fds(std::move(fds)), _allocator(allocator) {}
+    future<temporary_buffer<char>> get() override {
+        auto buf = make_temporary_buffer<char>(_allocator, _config.buffer_size);
+        iovec iov{buf.get_write(), buf.size()};
+        msghdr mh{};
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = _cmsg;
+        mh.msg_controllen = sizeof(_cmsg);
+        std::optional<size_t> n;
+        while (!(n = _fd.get_file_desc().recvmsg(&mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC))) {
+            co_await _fd.readable();
+        }
+        for (auto c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            auto nr_fds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < nr_fds; ++i) {
+                _fds->push_back(file_desc::from_fd(copy_reinterpret_cast<int>(CMSG_DATA(c) + i * sizeof(int))));
+            }
+        }
+        buf.trim(*n);
+        co_await internal::charge_network_receive(*n);
+        if (*n >= _config.buffer_size) {
+            _config.buffer_size = std::min(_config.buffer_size * 2, _config.max_buffer_size);
+        } else if (*n <= _config.buffer_size / 4) {
+            _config.buffer_size = std::max(_config.buffer_size / 2, _config.min_buffer_size);
+        }
+        co_return buf;
+    }
+    future<> close() override {
+        _fd.shutdown(SHUT_RD);
+        return make_ready_future<>();
+    }
+};
+
+static connected_socket wrap_posix_connected_socket(file_desc fd);
+
 class posix_connected_socket_impl final : public connected_socket_impl {
     pollable_fd _fd;
     const posix_connected_socket_operations* _ops;
     conntrack::handle _handle;
+    reuseport_steering::connection _steering_conn;
     std::pmr::polymorphic_allocator<char>* _allocator;
+    // Null unless a unix domain socket
+    lw_shared_ptr<received_fds> _received_fds;
 private:
+    static lw_shared_ptr<received_fds> make_received_fds(sa_family_t family) {
+        return family == AF_UNIX ? make_lw_shared<received_fds>() : nullptr;
+    }
     explicit posix_connected_socket_impl(sa_family_t family, int protocol, pollable_fd fd, std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) :
-        _fd(std::move(fd)), _ops(get_posix_connected_socket_ops(family, protocol)), _allocator(allocator) {}
+        _fd(std::move(fd)), _ops(get_posix_connected_socket_ops(family, protocol)), _allocator(allocator), _received_fds(make_received_fds(family)) {}
     explicit posix_connected_socket_impl(sa_family_t family, int protocol, pollable_fd fd, conntrack::handle&& handle,
         std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) : _fd(std::move(fd))
-                , _ops(get_posix_connected_socket_ops(family, protocol)), _handle(std::move(handle)), _allocator(allocator) {}
+                , _ops(get_posix_connected_socket_ops(family, protocol)), _handle(std::move(handle)), _allocator(allocator)
+                , _received_fds(make_received_fds(family)) {}
+    explicit posix_connected_socket_impl(sa_family_t family, int protocol, pollable_fd fd, reuseport_steering::connection&& conn,
+        std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) : _fd(std::move(fd))
+                , _ops(get_posix_connected_socket_ops(family, protocol)), _steering_conn(std::move(conn)), _allocator(allocator)
+                , _received_fds(make_received_fds(family)) {}
 public:
     virtual data_source source() override {
         return source(connected_socket_input_stream_config());
     }
     virtual data_source source(connected_socket_input_stream_config csisc) override {
+        if (_received_fds) {
+            return data_source(std::make_unique<posix_unix_data_source_impl>(_fd, csisc, _received_fds, _allocator));
+        }
         return data_source(std::make_unique<posix_data_source_impl>(_fd, csisc, _allocator));
     }
     virtual data_sink sink() override {
         return data_sink(std::make_unique< posix_data_sink_impl>(_fd));
     }
+    virtual data_sink sink(connected_socket_output_stream_config cssc) override {
+        int one = 1;
+        if (cssc.zero_copy && ::setsockopt(_fd.get_file_desc().get(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+            return data_sink(std::make_unique<posix_data_sink_impl>(_fd, posix_data_sink_impl::zero_copy_tag{}));
+        }
+        return sink();
+    }
     virtual void shutdown_input() override {
         shutdown_socket_fd(_fd, SHUT_RD);
     }
@@ -291,7 +384,75 @@ class posix_connected_socket_impl final : public connected_socket_impl {
     future<> wait_input_shutdown() override {
         return _fd.poll_rdhup();
     }
+    bool can_send_file(file& f) const noexcept override {
+        return posix_file_impl::of(f);
+    }
+    future<> send_file(file& f, uint64_t pos, uint64_t len) override {
+        // Bounds the time the syscall thread spends on one request
+        static constexpr size_t max_chunk = 1 << 20;
+        auto impl = posix_file_impl::of(f);
+        if (!impl) {
+            co_await net::connected_socket_impl::send_file(f, pos, len);
+            co_return;
+        }
+        while (len) {
+            auto sent = co_await impl->send_to(_fd.get_file_desc().get(), pos, std::min<uint64_t>(len, max_chunk));
+            if (!sent) {
+                co_await _fd.writeable();
+                continue;
+            }
+            if (!*sent) {
+                throw std::runtime_error("send_file: unexpected end of file");
+            }
+            pos += *sent;
+            len -= *sent;
+        }
+    }
+    bool can_pass_fds() const noexcept override {
+        return bool(_received_fds);
+    }
+    future<> send_fds(std::vector<file_desc> fds, temporary_buffer<char> data) override {
+        if (!_received_fds) {
+            co_await net::connected_socket_impl::send_fds(std::move(fds), std::move(data));
+            co_return;
+        }
+        if (data.empty() || fds.empty() || fds.size() > posix_max_passed_fds) {
+            throw std::invalid_argument("send_fds: needs data and 1 to 253 file descriptors");
+        }
+        std::vector<cmsghdr> cmsg(CMSG_SPACE(sizeof(int) * fds.size()) / sizeof(cmsghdr) + 1);
+        iovec iov{data.get_write(), data.size()};
+        msghdr mh{};
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = cmsg.data();
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        auto c = CMSG_FIRSTHDR(&mh);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        for (size_t i = 0; i < fds.size(); ++i) {
+            int fd = fds[i].get();
+            std::memcpy(CMSG_DATA(c) + i * sizeof(int), &fd, sizeof(int));
+        }
+        co_await internal::charge_network_send(data.size());
+        std::optional<size_t> sent;
+        while (!(sent = _fd.get_file_desc().sendmsg(&mh, MSG_NOSIGNAL | MSG_DONTWAIT))) {
+            co_await _fd.writeable();
+        }
+        // The descriptors went along with the first byte
+        if (*sent < data.size()) {
+            data.trim_front(*sent);
+            co_await _fd.write_all(data.get(), data.size());
+        }
+    }
+    std::vector<file_desc> take_received_fds() override {
+        return _received_fds ? std::exchange(*_received_fds, {}) : std::vector<file_desc>();
+    }
+    file_desc dup_fd() const override {
+        return dup_cloexec(_fd.get_file_desc());
+    }
 
+    friend connected_socket wrap_posix_connected_socket(file_desc fd);
     friend class posix_server_socket_impl;
     friend class posix_ap_server_socket_impl;
     friend class posix_reuseport_server_socket_impl;
@@ -500,15 +661,208 @@ class posix_socket_impl final : public socket_impl {
     }
 };
 
+// Shard running on each CPU, plus one, recorded when the shard's stack is
+// created
+static std::array<std::atomic<unsigned>, CPU_SETSIZE> cpu_shards;
+
+static void register_shard_cpu() {
+    auto cpu = ::sched_getcpu();
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        cpu_shards[cpu].store(this_shard_id() + 1, std::memory_order_relaxed);
+    }
+}
+
+static std::optional<shard_id> shard_of_cpu(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return std::nullopt;
+    }
+    auto shard = cpu_shards[cpu].load(std::memory_order_relaxed);
+    if (!shard) {
+        return std::nullopt;
+    }
+    return shard - 1;
+}
+
+// Steered to when there is no shard to steer to: out of range of the
+// socket map, so the kernel picks a socket by hash
+static constexpr uint32_t no_shard = std::numeric_limits<uint32_t>::max();
+
+static std::mutex reuseport_steerings_mutex;
+static std::unordered_map<std::tuple<int, socket_address>, std::weak_ptr<reuseport_steering>> reuseport_steerings;
+
+reuseport_steering::reuseport_steering(server_socket::load_balancing_algorithm lba, std::tuple<int, socket_address> key)
+        : _lba(lba)
+        , _key(std::move(key))
+        , _sockets(bpf_create_map(BPF_MAP_TYPE_REUSEPORT_SOCKARRAY, sizeof(uint64_t), smp::count, "create reuseport socket map"))
+        , _shards(bpf_create_map(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t),
+                lba == server_socket::load_balancing_algorithm::incoming_cpu ? ::get_nprocs_conf() : 1, "create reuseport shard map"))
+        , _prog(load_program())
+        , _connections(std::make_unique<std::atomic<int>[]>(smp::count))
+        , _least_loaded(no_shard) {
+    for (unsigned i = 0; i < smp::count; i++) {
+        _connections[i].store(-1, std::memory_order_relaxed);
+    }
+    if (_lba == server_socket::load_balancing_algorithm::incoming_cpu) {
+        for (int cpu = 0; cpu < ::get_nprocs_conf(); cpu++) {
+            uint32_t shard = shard_of_cpu(cpu).value_or(no_shard);
+            throw_system_error_on(bpf_update_elem(_shards, cpu, shard) == -1, "update reuseport shard map");
+        }
+    } else {
+        throw_system_error_on(bpf_update_elem(_shards, 0, _least_loaded) == -1, "update reuseport shard map");
+    }
+}
+
+reuseport_steering::~reuseport_steering() {
+    std::lock_guard<std::mutex> lock(reuseport_steerings_mutex);
+    auto i = reuseport_steerings.find(_key);
+    if (i != reuseport_steerings.end() && i->second.expired()) {
+        reuseport_steerings.erase(i);
+    }
+}
+
+file_desc reuseport_steering::load_program() {
+    // key = incoming_cpu ? bpf_get_smp_processor_id() : 0;
+    // shard = bpf_map_lookup_elem(&shards, &key);
+    // if (shard) {
+    //     bpf_sk_select_reuseport(ctx, &sockets, shard, 0);
+    // }
+    // return SK_PASS;
+    //
+    // Unless a socket was selected, e.g. the shard doesn't listen yet, the
+    // kernel picks one by hash.
+    std::vector<bpf_insn> insns = {
+        // r6 = ctx
+        { BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0 },
+    };
+    if (_lba == server_socket::load_balancing_algorithm::incoming_cpu) {
+        insns.insert(insns.end(), {
+            { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_get_smp_processor_id },
+            // *(u32*)(r10 - 4) = r0
+            { BPF_STX | BPF_MEM | BPF_W, 10, 0, -4, 0 },
+        });
+    } else {
+        // *(u32*)(r10 - 4) = 0
+        insns.push_back({ BPF_ST | BPF_MEM | BPF_W, 10, 0, -4, 0 });
+    }
+    insns.insert(insns.end(), {
+        // r2 = r10 - 4
+        { BPF_ALU64 | BPF_MOV | BPF_X, 2, 10, 0, 0 },
+        { BPF_ALU64 | BPF_ADD | BPF_K, 2, 0, 0, -4 },
+        // r1 = shards
+        { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, _shards.get() },
+        { 0, 0, 0, 0, 0 },
+        { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem },
+        // if (r0 == 0) skip the selection
+        { BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 6, 0 },
+        // r1 = ctx, r2 = sockets, r3 = shard, r4 = 0
+        { BPF_ALU64 | BPF_MOV | BPF_X, 1, 6, 0, 0 },
+        { BPF_LD | BPF_DW | BPF_IMM, 2, BPF_PSEUDO_MAP_FD, 0, _sockets.get() },
+        { 0, 0, 0, 0, 0 },
+        { BPF_ALU64 | BPF_MOV | BPF_X, 3, 0, 0, 0 },
+        { BPF_ALU64 | BPF_MOV | BPF_K, 4, 0, 0, 0 },
+        { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_sk_select_reuseport },
+        // return SK_PASS
+        { BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, SK_PASS },
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+    });
+    return bpf_load_program(BPF_PROG_TYPE_SK_REUSEPORT, insns.data(), insns.size(), "load reuseport program");
+}
+
+std::shared_ptr<reuseport_steering>
+reuseport_steering::get(int protocol, socket_address sa, server_socket::load_balancing_algorithm lba) {
+    static std::atomic<bool> unsupported = false;
+    if (unsupported.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(reuseport_steerings_mutex);
+    auto key = std::make_tuple(protocol, sa);
+    auto& entry = reuseport_steerings[key];
+    auto steering = entry.lock();
+    if (!steering) {
+        try {
+            steering = std::make_shared<reuseport_steering>(lba, key);
+        } catch (std::system_error& e) {
+            reuseport_steerings.erase(key);
+            if (!unsupported.exchange(true)) {
+                seastar_logger.warn("Cannot steer connections of SO_REUSEPORT sockets, the kernel will pick sockets by hash: {}", e.what());
+            }
+            return nullptr;
+        }
+        entry = steering;
+    }
+    return steering;
+}
+
+void reuseport_steering::add_socket(file_desc& fd) {
+    uint64_t value = fd.get();
+    throw_system_error_on(bpf_update_elem(_sockets, this_shard_id(), value) == -1, "update reuseport socket map");
+    // The program belongs to the group, attaching it again is harmless
+    fd.setsockopt(SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, _prog.get());
+    _connections[this_shard_id()].store(0, std::memory_order_relaxed);
+    update_least_loaded();
+}
+
+void reuseport_steering::remove_socket() {
+    // The kernel drops closed sockets from the socket map
+    _connections[this_shard_id()].store(-1, std::memory_order_relaxed);
+    update_least_loaded();
+}
+
+void reuseport_steering::update_least_loaded() {
+    if (_lba != server_socket::load_balancing_algorithm::least_connections) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t best = no_shard;
+    int best_load = std::numeric_limits<int>::max();
+    for (unsigned i = 0; i < smp::count; i++) {
+        auto load = _connections[i].load(std::memory_order_relaxed);
+        if (load >= 0 && load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+    if (best != _least_loaded) {
+        _least_loaded = best;
+        // Nothing to do on failure, the next update retries
+        (void)bpf_update_elem(_shards, 0, best);
+    }
+}
+
+reuseport_steering::connection::connection(std::shared_ptr<reuseport_steering> steering)
+        : _steering(std::move(steering))
+        , _shard(this_shard_id()) {
+    _steering->_connections[_shard].fetch_add(1, std::memory_order_relaxed);
+    _steering->update_least_loaded();
+}
+
+reuseport_steering::connection::~connection() {
+    if (_steering) {
+        _steering->_connections[_shard].fetch_sub(1, std::memory_order_relaxed);
+        _steering->update_least_loaded();
+    }
+}
+
 future<accept_result>
 posix_server_socket_impl::accept() {
     return _lfd.accept().then([this] (std::tuple<pollable_fd, socket_address> fd_sa) {
         auto& fd = std::get<0>(fd_sa);
         auto& sa = std::get<1>(fd_sa);
-        auto cth = [this, &sa] {
+        auto cth = [this, &fd, &sa] {
             switch(_lba) {
             case server_socket::load_balancing_algorithm::connection_distribution:
+            case server_socket::load_balancing_algorithm::least_connections:
                 return _conntrack.get_handle();
+            case server_socket::load_balancing_algorithm::incoming_cpu: {
+                int cpu = -1;
+                socklen_t len = sizeof(cpu);
+                if (::getsockopt(fd.get_file_desc().get(), SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0) {
+                    if (auto shard = shard_of_cpu(cpu)) {
+                        return _conntrack.get_handle(*shard);
+                    }
+                }
+                return _conntrack.get_handle();
+            }
             case server_socket::load_balancing_algorithm::port:
                 return _conntrack.get_handle(ntoh(sa.as_posix_sockaddr_in().sin_port) % smp::count);
             case server_socket::load_balancing_algorithm::fixed:
@@ -541,6 +895,10 @@ socket_address posix_server_socket_impl::local_address() const {
     return _lfd.get_file_desc().get_address();
 }
 
+file_desc posix_server_socket_impl::dup_fd() const {
+    return dup_cloexec(_lfd.get_file_desc());
+}
+
 posix_ap_server_socket_impl::posix_ap_server_socket_impl(int protocol, socket_address sa, std::pmr::polymorphic_allocator<char>* allocator)
         : _protocol(protocol), _sa(sa), _allocator(allocator)
 {
@@ -589,13 +947,21 @@ posix_ap_server_socket_impl::abort_accept() {
     }
 }
 
+posix_reuseport_server_socket_impl::~posix_reuseport_server_socket_impl() {
+    if (_steering) {
+        _steering->remove_socket();
+    }
+}
+
 future<accept_result>
 posix_reuseport_server_socket_impl::accept() {
-    return _lfd.accept().then([allocator = _allocator, protocol = _protocol] (std::tuple<pollable_fd, socket_address> fd_sa) {
+    return _lfd.accept().then([this] (std::tuple<pollable_fd, socket_address> fd_sa) {
         auto& fd = std::get<0>(fd_sa);
         auto& sa = std::get<1>(fd_sa);
+        auto conn = _steering && _steering->lba() == server_socket::load_balancing_algorithm::least_connections
+                ? reuseport_steering::connection(_steering) : reuseport_steering::connection();
         std::unique_ptr<connected_socket_impl> csi(
-                new posix_connected_socket_impl(sa.family(), protocol, std::move(fd), allocator));
+                new posix_connected_socket_impl(sa.family(), _protocol, std::move(fd), std::move(conn), _allocator));
         return make_ready_future<accept_result>(
             accept_result{connected_socket(std::move(csi)), sa});
     });
@@ -610,6 +976,10 @@ socket_address posix_reuseport_server_socket_impl::local_address() const {
     return _lfd.get_file_desc().get_address();
 }
 
+file_desc posix_reuseport_server_socket_impl::dup_fd() const {
+    return dup_cloexec(_lfd.get_file_desc());
+}
+
 void
 posix_ap_server_socket_impl::move_connected_socket(int protocol, socket_address sa, pollable_fd fd, socket_address addr, conntrack::handle cth, std::pmr::polymorphic_allocator<char>* allocator) {
     auto t_sa = std::make_tuple(protocol, sa);
@@ -637,12 +1007,21 @@ posix_data_source_impl::get() {
             _config.buffer_size /= 2;
             _config.buffer_size = std::max(_config.buffer_size, _config.min_buffer_size);
         }
-        return b;
+        auto f = internal::charge_network_receive(b.size());
+        if (f.available()) {
+            return make_ready_future<temporary_buffer<char>>(std::move(b));
+        }
+        return f.then([b = std::move(b)] () mutable {
+            return std::move(b);
+        });
     });
 }
 
 temporary_buffer<char>
 posix_data_source_impl::allocate_buffer() {
+    if (_buffer_allocator == memory::malloc_allocator && _config.buffer_size >= internal::dma_buffer_pool::min_buffer_size) {
+        return internal::allocate_dma_buffer<char>(alignof(std::max_align_t), _config.buffer_size);
+    }
     return make_temporary_buffer<char>(_buffer_allocator, _config.buffer_size);
 }
 
@@ -671,18 +1050,49 @@ std::vector<iovec> to_iovec(std::vector<temporary_buffer<char>>& buf_vec) {
 
 future<>
 posix_data_sink_impl::put(temporary_buffer<char> buf) {
-    return _fd.write_all(buf.get(), buf.size()).then([d = buf.release()] {});
+    auto f = internal::charge_network_send(buf.size());
+    if (!f.available()) {
+        return f.then([this, buf = std::move(buf)] () mutable {
+            return do_put(std::move(buf));
+        });
+    }
+    return do_put(std::move(buf));
 }
 
 future<>
 posix_data_sink_impl::put(packet p) {
+    auto f = internal::charge_network_send(p.len());
+    if (!f.available()) {
+        return f.then([this, p = std::move(p)] () mutable {
+            return do_put(std::move(p));
+        });
+    }
+    return do_put(std::move(p));
+}
+
+future<>
+posix_data_sink_impl::do_put(temporary_buffer<char> buf) {
+    if (_zc && buf.size() >= zerocopy_min_size) {
+        return do_put(packet(std::move(buf)));
+    }
+    return _fd.write_all(buf.get(), buf.size()).then([d = buf.release()] {});
+}
+
+future<>
+posix_data_sink_impl::do_put(packet p) {
     _p = std::move(p);
+    if (_zc && _p.len() >= zerocopy_min_size) {
+        return _fd.write_all_zerocopy(_p, *_zc).then([this] { _p.reset(); });
+    }
     return _fd.write_all(_p).then([this] { _p.reset(); });
 }
 
 future<>
 posix_data_sink_impl::close() {
     _fd.shutdown(SHUT_WR);
+    if (_zc) {
+        return _fd.wait_zerocopy_sends(*_zc);
+    }
     return make_ready_future<>();
 }
 
@@ -692,6 +1102,26 @@ void posix_data_sink_impl::on_batch_flush_error() noexcept {
 
 posix_network_stack::posix_network_stack(const program_options::option_group& opts, std::pmr::polymorphic_allocator<char>* allocator)
         : _reuseport(engine().posix_reuseport_available()), _allocator(allocator) {
+    register_shard_cpu();
+}
+
+server_socket
+posix_network_stack::listen_reuseport(int protocol, socket_address sa, listen_options opt) {
+    auto lfd = engine().posix_listen(sa, opt);
+    std::shared_ptr<reuseport_steering> steering;
+    if (opt.proto == transport::TCP && (opt.lba == server_socket::load_balancing_algorithm::incoming_cpu ||
+            opt.lba == server_socket::load_balancing_algorithm::least_connections)) {
+        steering = reuseport_steering::get(protocol, sa, opt.lba);
+        if (steering) {
+            try {
+                steering->add_socket(lfd.get_file_desc());
+            } catch (std::system_error& e) {
+                seastar_logger.warn("Cannot steer connections of SO_REUSEPORT socket {}, the kernel will pick sockets by hash: {}", sa, e.what());
+                steering = nullptr;
+            }
+        }
+    }
+    return server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, std::move(lfd), _allocator, std::move(steering)));
 }
 
 server_socket
@@ -706,7 +1136,7 @@ posix_network_stack::listen(socket_address sa, listen_options opt) {
     }
     auto protocol = static_cast<int>(opt.proto);
     return _reuseport ?
-        server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), _allocator))
+        listen_reuseport(protocol, sa, opt)
         :
         server_socket(std::make_unique<posix_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator));
 }
@@ -731,54 +1161,64 @@ posix_ap_network_stack::listen(socket_address sa, listen_options opt) {
     }
     auto protocol = static_cast<int>(opt.proto);
     return _reuseport ?
-        server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), _allocator))
+        listen_reuseport(protocol, sa, opt)
         :
         server_socket(std::make_unique<posix_ap_server_socket_impl>(protocol, sa, _allocator));
 }
 
-struct cmsg_with_pktinfo {
-    struct cmsghdrcmh;
-    union {
-        struct in_pktinfo pktinfo;
-        struct in6_pktinfo pkt6info;
-    };
+// Software, legacy and hardware timestamps of SCM_TIMESTAMPING
+struct scm_timestamps {
+    timespec ts[3];
+};
+
+// Room for the control messages of a received datagram: its destination
+// address, with GRO the size of the coalesced segments, and with
+// timestamping when it was received
+struct recv_cmsg_buffer {
+    alignas(cmsghdr) char data[CMSG_SPACE(sizeof(in6_pktinfo)) + CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(scm_timestamps))];
+};
+
+// Control message carrying the GSO segment size of a sent datagram
+struct gso_cmsg_buffer {
+    alignas(cmsghdr) char data[CMSG_SPACE(sizeof(uint16_t))];
 };
 
 class posix_datagram_channel : public datagram_channel_impl {
 private:
     static constexpr int MAX_DATAGRAM_SIZE = 65507;
+    // Datagrams coalesced by GRO may exceed the largest IPv4 datagram
+    static constexpr int MAX_RECEIVE_SIZE = 65535;
+    // Kernel limit on the number of segments of a GSO send (UDP_MAX_SEGMENTS)
+    static constexpr size_t max_gso_segments = 64;
     struct recv_ctx {
         struct msghdr _hdr;
         struct iovec _iov;
         socket_address _src_addr;
         char* _buffer;
-        cmsg_with_pktinfo _cmsg;
+        recv_cmsg_buffer _cmsg;
+        bool _use_pktinfo;
+
+        recv_ctx(bool use_pktinfo) : _use_pktinfo(use_pktinfo) {}
 
-        recv_ctx(bool use_pktinfo) {
+        recv_ctx(const recv_ctx&) = delete;
+        recv_ctx(recv_ctx&&) = delete;
+
+        void prepare() {
+            _buffer = new char[MAX_RECEIVE_SIZE];
+            _iov.iov_base = _buffer;
+            _iov.iov_len = MAX_RECEIVE_SIZE;
+            // The kernel updates the lengths and the flags, so reset them
             memset(&_hdr, 0, sizeof(_hdr));
             _hdr.msg_iov = &_iov;
             _hdr.msg_iovlen = 1;
             _hdr.msg_name = &_src_addr.u.sa;
             _hdr.msg_namelen = sizeof(_src_addr.u.sas);
-
-            if (use_pktinfo) {
+            if (_use_pktinfo) {
                 memset(&_cmsg, 0, sizeof(_cmsg));
                 _hdr.msg_control = &_cmsg;
                 _hdr.msg_controllen = sizeof(_cmsg);
-            } else {
-                _hdr.msg_control = nullptr;
-                _hdr.msg_controllen = 0;
             }
         }
-
-        recv_ctx(const recv_ctx&) = delete;
-        recv_ctx(recv_ctx&&) = delete;
-
-        void prepare() {
-            _buffer = new char[MAX_DATAGRAM_SIZE];
-            _iov.iov_base = _buffer;
-            _iov.iov_len = MAX_DATAGRAM_SIZE;
-        }
     };
     struct send_ctx {
         struct msghdr _hdr;
@@ -805,6 +1245,111 @@ class posix_datagram_channel : public datagram_channel_impl {
             resolve_outgoing_address(_dst);
         }
     };
+    // Receive buffers are kept across receive_batch() calls, thus the
+    // batch size is capped
+    static constexpr size_t max_batch_size = 64;
+    struct recv_batch_ctx {
+        std::vector<struct mmsghdr> _msgs;
+        std::vector<struct iovec> _iovs;
+        std::vector<socket_address> _src_addrs;
+        std::vector<recv_cmsg_buffer> _cmsgs;
+        std::unique_ptr<char[]> _buffers;
+        bool _use_pktinfo;
+
+        explicit recv_batch_ctx(bool use_pktinfo) : _use_pktinfo(use_pktinfo) {}
+
+        char* buffer(size_t i) {
+            return _buffers.get() + i * MAX_RECEIVE_SIZE;
+        }
+
+        void prepare(size_t n) {
+            if (_msgs.size() < n) {
+                _msgs.resize(n);
+                _iovs.resize(n);
+                _src_addrs.resize(n);
+                _cmsgs.resize(n);
+                _buffers = std::make_unique<char[]>(n * MAX_RECEIVE_SIZE);
+            }
+            // The kernel updates the lengths, so reset them all
+            for (size_t i = 0; i < _msgs.size(); i++) {
+                auto& hdr = _msgs[i].msg_hdr;
+                memset(&hdr, 0, sizeof(hdr));
+                _iovs[i].iov_base = buffer(i);
+                _iovs[i].iov_len = MAX_RECEIVE_SIZE;
+                hdr.msg_iov = &_iovs[i];
+                hdr.msg_iovlen = 1;
+                hdr.msg_name = &_src_addrs[i].u.sa;
+                hdr.msg_namelen = sizeof(_src_addrs[i].u.sas);
+                if (_use_pktinfo) {
+                    memset(&_cmsgs[i], 0, sizeof(_cmsgs[i]));
+                    hdr.msg_control = &_cmsgs[i];
+                    hdr.msg_controllen = sizeof(_cmsgs[i]);
+                }
+            }
+        }
+    };
+    struct send_batch_ctx {
+        std::vector<outgoing_datagram> _datagrams;
+        std::vector<std::vector<struct iovec>> _iovecs;
+        std::vector<struct mmsghdr> _msgs;
+        size_t _sent = 0;
+
+        explicit send_batch_ctx(std::vector<outgoing_datagram> datagrams)
+                : _datagrams(std::move(datagrams))
+                , _msgs(_datagrams.size()) {
+            _iovecs.reserve(_datagrams.size());
+            for (size_t i = 0; i < _datagrams.size(); i++) {
+                auto& d = _datagrams[i];
+                resolve_outgoing_address(d.dst);
+                _iovecs.push_back(to_iovec(d.p));
+                auto& hdr = _msgs[i].msg_hdr;
+                hdr.msg_name = &d.dst.u.sa;
+                hdr.msg_namelen = d.dst.addr_length;
+                hdr.msg_iov = _iovecs.back().data();
+                hdr.msg_iovlen = _iovecs.back().size();
+            }
+        }
+    };
+    struct gso_send_ctx {
+        socket_address _dst;
+        uint16_t _segment_size;
+        // One message for each run of segments the kernel accepts at once
+        std::vector<packet> _runs;
+        std::vector<std::vector<struct iovec>> _iovecs;
+        std::vector<gso_cmsg_buffer> _cmsgs;
+        std::vector<struct mmsghdr> _msgs;
+        size_t _sent = 0;
+
+        gso_send_ctx(const socket_address& dst, packet p, uint16_t segment_size)
+                : _dst(dst), _segment_size(segment_size) {
+            resolve_outgoing_address(_dst);
+            // The kernel caps both the number of segments and the total size of a run
+            size_t run_size = std::max<size_t>(1, std::min(max_gso_segments, size_t(MAX_DATAGRAM_SIZE / segment_size))) * segment_size;
+            auto nr_runs = (p.len() + run_size - 1) / run_size;
+            _runs.reserve(nr_runs);
+            _iovecs.reserve(nr_runs);
+            _cmsgs.resize(nr_runs);
+            _msgs.resize(nr_runs);
+            for (size_t offset = 0; offset < p.len(); offset += run_size) {
+                _runs.push_back(p.share(offset, std::min(run_size, p.len() - offset)));
+            }
+            for (size_t i = 0; i < nr_runs; i++) {
+                _iovecs.push_back(to_iovec(_runs[i]));
+                auto& hdr = _msgs[i].msg_hdr;
+                hdr.msg_name = &_dst.u.sa;
+                hdr.msg_namelen = _dst.addr_length;
+                hdr.msg_iov = _iovecs.back().data();
+                hdr.msg_iovlen = _iovecs.back().size();
+                hdr.msg_control = _cmsgs[i].data;
+                hdr.msg_controllen = sizeof(_cmsgs[i].data);
+                auto* cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(uint16_t));
+            }
+        }
+    };
 
     static bool is_inet(sa_family_t family) {
         return family == AF_INET || family == AF_INET6;
@@ -815,6 +1360,7 @@ class posix_datagram_channel : public datagram_channel_impl {
 
         if (is_inet(family)) {
             fd.setsockopt(SOL_IP, IP_PKTINFO, true);
+            engine().set_busy_poll(fd);
             if (engine().posix_reuseport_available()) {
                 fd.setsockopt(SOL_SOCKET, SO_REUSEPORT, 1);
             }
@@ -823,38 +1369,68 @@ class posix_datagram_channel : public datagram_channel_impl {
         return fd;
     }
 
+    // Kernels without UDP_SEGMENT would send the whole buffer as one datagram
+    static bool gso_supported(file_desc& fd) {
+        int v;
+        socklen_t len = sizeof(v);
+        return ::getsockopt(fd.get(), SOL_UDP, UDP_SEGMENT, &v, &len) == 0;
+    }
+
     pollable_fd _fd;
     socket_address _address;
     recv_ctx _recv;
     send_ctx _send;
+    recv_batch_ctx _recv_batch;
     bool _closed;
+    bool _gso = false;
+    bool _gro = false;
+    bool _timestamping = false;
+
+    // Returns the destination address of a received message
+    socket_address dst_address(msghdr& hdr) const;
+    // Sets the timestamp of a received packet, when timestamping
+    void set_receive_timestamp(packet& p, msghdr& hdr) const;
+    // Returns the size of the segments coalesced into a received message, or
+    // 0 when it holds a single datagram
+    size_t gro_segment_size(msghdr& hdr) const;
+    // Splits a received buffer into one fragment per coalesced datagram
+    static packet make_received_packet(char* buf, size_t size, size_t segment_size, deleter d);
+    // Sends msgs from index sent on, resuming after partial sends
+    future<> sendmmsg_all(std::vector<struct mmsghdr>& msgs, size_t& sent);
 public:
     /// Creates a channel that is not bound to any socket address. The channel
     /// can be used to communicate with adressess that belong to the \param
     /// family.
     posix_datagram_channel(sa_family_t family)
-        : _recv(is_inet(family)), _closed(false) {
+        : _recv(is_inet(family)), _recv_batch(is_inet(family)), _closed(false) {
         auto fd = create_socket(family);
 
         _address = fd.get_address();
+        _gso = is_inet(family) && gso_supported(fd);
         _fd = std::move(fd);
     }
 
     /// Creates a channel that is bound to the specified local address. It can be used to
     /// communicate with addresses that belong to the family of \param local.
     posix_datagram_channel(socket_address local)
-        : _recv(is_inet(local.family())), _closed(false) {
+        : _recv(is_inet(local.family())), _recv_batch(is_inet(local.family())), _closed(false) {
         auto fd = create_socket(local.family());
         fd.bind(local.u.sa, local.addr_length);
 
         _address = fd.get_address();
+        _gso = is_inet(local.family()) && gso_supported(fd);
         _fd = std::move(fd);
     }
 
     virtual ~posix_datagram_channel() { if (!_closed) close(); };
     virtual future<datagram> receive() override;
+    virtual future<std::vector<datagram>> receive_batch(size_t max) override;
     virtual future<> send(const socket_address& dst, const char *msg) override;
     virtual future<> send(const socket_address& dst, packet p) override;
+    virtual future<> send_batch(std::vector<outgoing_datagram> datagrams) override;
+    virtual future<> send_segmented(const socket_address& dst, packet p, uint16_t segment_size) override;
+    virtual bool set_gro(bool enable) override;
+    virtual bool set_timestamping(bool enable) override;
     virtual void shutdown_input() override {
         _fd.shutdown(SHUT_RD, pollable_fd::shutdown_kernel_only::no);
     }
@@ -887,6 +1463,77 @@ future<> posix_datagram_channel::send(const socket_address& dst, packet p) {
             .then([len] (size_t size) { assert(size == len); });
 }
 
+future<> posix_datagram_channel::send_batch(std::vector<outgoing_datagram> datagrams) {
+    if (datagrams.empty()) {
+        return make_ready_future<>();
+    }
+    return do_with(std::make_unique<send_batch_ctx>(std::move(datagrams)), [this] (std::unique_ptr<send_batch_ctx>& ctx) {
+        return sendmmsg_all(ctx->_msgs, ctx->_sent);
+    });
+}
+
+future<> posix_datagram_channel::sendmmsg_all(std::vector<struct mmsghdr>& msgs, size_t& sent) {
+    return repeat([this, &msgs, &sent] {
+        return _fd.sendmmsg(msgs.data() + sent, msgs.size() - sent).then([&msgs, &sent] (size_t n) {
+            sent += n;
+            return sent == msgs.size() ? stop_iteration::yes : stop_iteration::no;
+        });
+    });
+}
+
+future<> posix_datagram_channel::send_segmented(const socket_address& dst, packet p, uint16_t segment_size) {
+    if (!_gso || p.len() <= segment_size) {
+        return datagram_channel_impl::send_segmented(dst, std::move(p), segment_size);
+    }
+    return do_with(std::make_unique<gso_send_ctx>(dst, std::move(p), segment_size), [this] (std::unique_ptr<gso_send_ctx>& ctx) {
+        return sendmmsg_all(ctx->_msgs, ctx->_sent).handle_exception([this, &ctx] (std::exception_ptr ep) {
+            try {
+                std::rethrow_exception(ep);
+            } catch (std::system_error& e) {
+                if (e.code() != std::error_code(EIO, std::system_category())) {
+                    throw;
+                }
+            }
+            // The egress device can't checksum the segments, segment in
+            // userspace from now on
+            _gso = false;
+            return do_for_each(ctx->_runs.begin() + ctx->_sent, ctx->_runs.end(), [this, &ctx] (packet& run) {
+                return datagram_channel_impl::send_segmented(ctx->_dst, std::move(run), ctx->_segment_size);
+            });
+        });
+    });
+}
+
+bool posix_datagram_channel::set_gro(bool enable) {
+    if (!is_inet(_address.family())) {
+        return false;
+    }
+    try {
+        _fd.get_file_desc().setsockopt(SOL_UDP, UDP_GRO, int(enable));
+    } catch (std::system_error&) {
+        return false;
+    }
+    _gro = enable;
+    return true;
+}
+
+bool posix_datagram_channel::set_timestamping(bool enable) {
+    if (!is_inet(_address.family())) {
+        return false;
+    }
+    // Hardware timestamps when the interface has them turned on, see
+    // SIOCSHWTSTAMP, and software ones for the rest
+    int flags = enable ? SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+            | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE : 0;
+    try {
+        _fd.get_file_desc().setsockopt(SOL_SOCKET, SO_TIMESTAMPING, flags);
+    } catch (std::system_error&) {
+        return false;
+    }
+    _timestamping = enable;
+    return true;
+}
+
 udp_channel
 posix_network_stack::make_udp_channel(const socket_address& addr) {
     if (!addr.is_unspecified()) {
@@ -940,28 +1587,100 @@ class posix_datagram : public datagram_impl {
     virtual packet& get_data() override { return _p; }
 };
 
+socket_address
+posix_datagram_channel::dst_address(msghdr& hdr) const {
+    for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+            return ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
+        } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
+            return ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
+        }
+    }
+    return _address;
+}
+
+void
+posix_datagram_channel::set_receive_timestamp(packet& p, msghdr& hdr) const {
+    if (!_timestamping) {
+        return;
+    }
+    for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            auto tss = copy_reinterpret_cast<scm_timestamps>(CMSG_DATA(cmsg));
+            auto& ts = tss.ts[2].tv_sec || tss.ts[2].tv_nsec ? tss.ts[2] : tss.ts[0];
+            p.set_timestamp(std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec))));
+            return;
+        }
+    }
+}
+
+size_t
+posix_datagram_channel::gro_segment_size(msghdr& hdr) const {
+    if (!_gro) {
+        return 0;
+    }
+    for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            return copy_reinterpret_cast<int>(CMSG_DATA(cmsg));
+        }
+    }
+    return 0;
+}
+
+packet
+posix_datagram_channel::make_received_packet(char* buf, size_t size, size_t segment_size, deleter d) {
+    if (segment_size == 0 || size <= segment_size) {
+        return packet(fragment{buf, size}, std::move(d));
+    }
+    std::vector<fragment> frags;
+    frags.reserve((size + segment_size - 1) / segment_size);
+    for (size_t offset = 0; offset < size; offset += segment_size) {
+        frags.push_back(fragment{buf + offset, std::min(segment_size, size - offset)});
+    }
+    return packet(std::move(frags), std::move(d));
+}
+
 future<datagram>
 posix_datagram_channel::receive() {
     _recv.prepare();
     return _fd.recvmsg(&_recv._hdr).then([this] (size_t size) {
-        std::optional<socket_address> dst;
-        for (auto* cmsg = CMSG_FIRSTHDR(&_recv._hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&_recv._hdr, cmsg)) {
-            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
-                dst = ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
-                break;
-            } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-                dst = ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
-                break;
-            }
-        }
+        auto buf = _recv._buffer;
+        auto p = make_received_packet(buf, size, gro_segment_size(_recv._hdr), make_deleter([buf] { delete[] buf; }));
+        set_receive_timestamp(p, _recv._hdr);
         return make_ready_future<datagram>(datagram(std::make_unique<posix_datagram>(
-            _recv._src_addr, dst ? *dst : _address, packet(fragment{_recv._buffer, size}, make_deleter([buf = _recv._buffer] { delete[] buf; })))));
+            _recv._src_addr, dst_address(_recv._hdr), std::move(p))));
     }).handle_exception([p = _recv._buffer](auto ep) {
         delete[] p;
         return make_exception_future<datagram>(std::move(ep));
     });
 }
 
+future<std::vector<datagram>>
+posix_datagram_channel::receive_batch(size_t max) {
+    _recv_batch.prepare(std::min(max, max_batch_size));
+    return _fd.recvmmsg(_recv_batch._msgs.data(), std::min(max, max_batch_size)).then([this] (size_t n) {
+        std::vector<datagram> ret;
+        ret.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            auto& msg = _recv_batch._msgs[i];
+            // The receive buffers are reused, so copy the data out
+            auto segment_size = gro_segment_size(msg.msg_hdr);
+            packet p;
+            if (segment_size) {
+                temporary_buffer<char> copy(_recv_batch.buffer(i), msg.msg_len);
+                auto data = copy.get_write();
+                p = make_received_packet(data, msg.msg_len, segment_size, copy.release());
+            } else {
+                p = packet(fragment{_recv_batch.buffer(i), msg.msg_len});
+            }
+            set_receive_timestamp(p, msg.msg_hdr);
+            ret.emplace_back(std::make_unique<posix_datagram>(_recv_batch._src_addrs[i], dst_address(msg.msg_hdr), std::move(p)));
+        }
+        return ret;
+    });
+}
+
 network_stack_entry register_posix_stack() {
     return network_stack_entry{
         "posix", std::make_unique<program_options::option_group>(nullptr, "Posix"),
@@ -1199,6 +1918,63 @@ std::vector<network_interface> posix_network_stack::network_interfaces() {
     return std::vector<network_interface>(thread_local_interfaces.begin(), thread_local_interfaces.end());
 }
 
+// Returns the protocol of a stream socket handled by the posix stack
+static int posix_stream_protocol(file_desc& fd, sa_family_t family) {
+    if (fd.getsockopt<int>(SOL_SOCKET, SO_TYPE) != SOCK_STREAM) {
+        throw std::invalid_argument("Not a stream socket");
+    }
+    if (family == AF_UNIX) {
+        return 0;
+    }
+    auto protocol = fd.getsockopt<int>(SOL_SOCKET, SO_PROTOCOL);
+    if ((family != AF_INET && family != AF_INET6) || (protocol != IPPROTO_TCP && protocol != IPPROTO_SCTP)) {
+        throw std::invalid_argument(format("Unsupported socket family {} and protocol {}", family, protocol));
+    }
+    return protocol;
+}
+
+static void set_nonblocking(file_desc& fd) {
+    int flags = ::fcntl(fd.get(), F_GETFL);
+    throw_system_error_on(flags == -1, "fcntl");
+    throw_system_error_on(::fcntl(fd.get(), F_SETFL, flags | O_NONBLOCK) == -1, "fcntl");
+}
+
+static connected_socket wrap_posix_connected_socket(file_desc fd) {
+    sa_family_t family = fd.getsockopt<int>(SOL_SOCKET, SO_DOMAIN);
+    auto protocol = posix_stream_protocol(fd, family);
+    set_nonblocking(fd);
+    std::unique_ptr<connected_socket_impl> csi(new posix_connected_socket_impl(family, protocol, pollable_fd(std::move(fd))));
+    return connected_socket(std::move(csi));
+}
+
+static server_socket wrap_posix_server_socket(file_desc fd) {
+    sa_family_t family = fd.getsockopt<int>(SOL_SOCKET, SO_DOMAIN);
+    auto protocol = posix_stream_protocol(fd, family);
+    if (!fd.getsockopt<int>(SOL_SOCKET, SO_ACCEPTCONN)) {
+        throw std::invalid_argument("Not a listening socket");
+    }
+    set_nonblocking(fd);
+    auto sa = fd.get_address();
+    // Accepts on the calling shard, as SO_REUSEPORT sockets do
+    return server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, pollable_fd(std::move(fd))));
+}
+
+}
+
+connected_socket make_connected_socket(file_desc fd) {
+    return net::wrap_posix_connected_socket(std::move(fd));
+}
+
+server_socket make_server_socket(file_desc fd) {
+    return net::wrap_posix_server_socket(std::move(fd));
+}
+
+std::tuple<connected_socket, connected_socket> make_unix_socket_pair() {
+    int sv[2];
+    throw_system_error_on(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) == -1, "socketpair");
+    auto fd0 = file_desc::from_fd(sv[0]);
+    auto fd1 = file_desc::from_fd(sv[1]);
+    return std::make_tuple(make_connected_socket(std::move(fd0)), make_connected_socket(std::move(fd1)));
 }
 
 }
@@ -0,0 +1,156 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2026 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <vector>
+#endif
+
+namespace seastar {
+
+namespace net {
+
+// The RSS redirection table of a device, as rebalanced at runtime, with
+// the bookkeeping that lets connections stay on the shard they were
+// created on. Knows nothing of the device, which programs the table and
+// counts the load of each bucket.
+//
+// Queue N is served by shard N, so both are told by the same number.
+struct rss_buckets {
+    // At most this many buckets are moved per round
+    static constexpr unsigned max_moves = 8;
+    // Rebalance when the busiest queue gets 20% more than its share
+    static constexpr double imbalance_threshold = 1.2;
+    // A bucket isn't moved again while this many previous owners still
+    // have connections in it
+    static constexpr size_t max_previous_owners = 4;
+
+    // The queue of each bucket, a power of two of them
+    std::vector<uint8_t> redir_table;
+    // Queues each bucket was moved away from that may still have
+    // connections in it, oldest first. Empty if not rebalancing.
+    std::vector<std::vector<uint8_t>> previous_owners;
+
+    size_t bucket(uint32_t hash) const noexcept {
+        return hash & (redir_table.size() - 1);
+    }
+
+    unsigned owner(uint32_t hash) const noexcept {
+        return redir_table[bucket(hash)];
+    }
+
+    bool has_previous_owners() const noexcept {
+        return std::any_of(previous_owners.begin(), previous_owners.end(),
+                           [] (const auto& owners) { return !owners.empty(); });
+    }
+
+    // The shard that \c shard forwards the segments of a flow it doesn't
+    // have to, walking back the owners of the flow's bucket one step at a
+    // time, towards the oldest one
+    std::optional<unsigned> previous_owner(uint32_t hash, unsigned shard) const {
+        auto b = bucket(hash);
+        auto& owners = previous_owners[b];
+        auto it = owners.end();
+        if (redir_table[b] != shard) {
+            it = std::find(owners.begin(), owners.end(), shard);
+        }
+        if (it == owners.begin()) {
+            return std::nullopt;
+        }
+        return *std::prev(it);
+    }
+
+    // Forgets the previous owners that have no connections left in a
+    // bucket, in_use telling the buckets each shard has connections in.
+    // Returns true if anything was forgotten.
+    bool prune_previous_owners(const std::vector<std::vector<bool>>& in_use) {
+        bool changed = false;
+        for (size_t b = 0; b < previous_owners.size(); b++) {
+            auto n = std::erase_if(previous_owners[b], [&in_use, b] (uint8_t owner) {
+                return !in_use[owner][b];
+            });
+            changed |= n > 0;
+        }
+        return changed;
+    }
+
+    // Moves buckets from the busiest queues to the least busy ones, given
+    // the packets each bucket received. Returns true if the redirection
+    // table was changed.
+    bool move(const std::vector<uint64_t>& load, unsigned nr_queues) {
+        std::vector<uint64_t> queue_load(nr_queues);
+        for (size_t b = 0; b < load.size(); b++) {
+            queue_load[redir_table[b]] += load[b];
+        }
+        auto total = std::accumulate(queue_load.begin(), queue_load.end(), uint64_t(0));
+        double avg = double(total) / nr_queues;
+
+        bool changed = false;
+        for (unsigned i = 0; i < max_moves; i++) {
+            auto [min_it, max_it] = std::minmax_element(queue_load.begin(), queue_load.end());
+            if (total == 0 || *max_it <= avg * imbalance_threshold) {
+                break;
+            }
+            uint8_t from = max_it - queue_load.begin();
+            uint8_t to = min_it - queue_load.begin();
+            auto gap = *max_it - *min_it;
+
+            // The bucket that gets both queues closest to each other
+            std::optional<size_t> best;
+            auto distance = [&] (size_t b) {
+                auto twice = 2 * load[b];
+                return twice > gap ? twice - gap : gap - twice;
+            };
+            for (size_t b = 0; b < load.size(); b++) {
+                if (redir_table[b] != from || load[b] == 0 || load[b] >= gap ||
+                    previous_owners[b].size() >= max_previous_owners) {
+                    continue;
+                }
+                if (!best || distance(b) < distance(*best)) {
+                    best = b;
+                }
+            }
+            if (!best) {
+                break;
+            }
+
+            auto& owners = previous_owners[*best];
+            std::erase(owners, to);
+            std::erase(owners, from);
+            owners.push_back(from);
+            redir_table[*best] = to;
+            queue_load[from] -= load[*best];
+            queue_load[to] += load[*best];
+            changed = true;
+        }
+        return changed;
+    }
+};
+
+}
+
+}
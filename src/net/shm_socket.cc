@@ -0,0 +1,563 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/net/shm_socket.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/internal/pollable_fd.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/weak_ptr.hh>
+#endif
+
+namespace seastar {
+
+namespace net {
+
+namespace {
+
+// Sent by the server over the unix socket along with the shared memory
+// and the eventfds
+struct shm_hello {
+    char magic[8];
+    uint32_t version;
+    uint32_t nr_fds;
+    uint64_t ring_size;
+};
+
+constexpr char shm_magic[] = "SSTARSHM";
+constexpr uint32_t shm_version = 1;
+constexpr size_t max_ring_size = size_t(1) << 30;
+// The header of each ring gets a page, the data follows
+constexpr size_t ring_header_space = 4096;
+// memfd, then the data and space eventfds of each ring
+constexpr unsigned shm_nr_fds = 5;
+
+// Lives in shared memory. Positions are free running byte counts.
+struct ring_header {
+    // Written by the producer
+    alignas(64) std::atomic<uint64_t> head{0};
+    std::atomic<uint32_t> closed{0};
+    // Written by the consumer
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint32_t> reader_closed{0};
+    // Set by a side before it sleeps, cleared by the one that wakes it
+    alignas(64) std::atomic<uint32_t> consumer_waiting{0};
+    alignas(64) std::atomic<uint32_t> producer_waiting{0};
+};
+static_assert(sizeof(ring_header) <= ring_header_space);
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+struct ring {
+    ring_header* h;
+    char* data;
+    size_t size;
+
+    void copy_in(uint64_t pos, const char* src, size_t n) noexcept {
+        auto off = pos & (size - 1);
+        auto first = std::min(n, size - off);
+        std::memcpy(data + off, src, first);
+        std::memcpy(data, src + first, n - first);
+    }
+    void copy_out(uint64_t pos, char* dst, size_t n) const noexcept {
+        auto off = pos & (size - 1);
+        auto first = std::min(n, size - off);
+        std::memcpy(dst, data + off, first);
+        std::memcpy(dst + first, data, n - first);
+    }
+};
+
+void signal(const file_desc& fd) {
+    uint64_t one = 1;
+    // Can only fail if the counter overflows, the peer is awake then
+    (void)::write(fd.get(), &one, sizeof(one));
+}
+
+// Waits until an eventfd is signalled, and resets it
+future<> wait(pollable_fd& fd) {
+    uint64_t counter;
+    co_await fd.read_some(reinterpret_cast<char*>(&counter), sizeof(counter));
+}
+
+file_desc make_eventfd() {
+    return file_desc::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+// The state of a connection shared by the socket, its source and its sink
+class shm_channel : public weakly_referencable<shm_channel> {
+    pollable_fd _control;
+    mmap_area _area;
+    ring _rx;
+    ring _tx;
+    // Waited on for data in _rx, and for space in _tx
+    pollable_fd _rx_data;
+    pollable_fd _tx_space;
+    // Signalled when consuming from _rx, and when producing to _tx
+    file_desc _rx_space;
+    file_desc _tx_data;
+    socket_address _local;
+    socket_address _remote;
+    // Our own positions: the copies in shared memory are only written, the
+    // peer could change them
+    uint64_t _rx_tail = 0;
+    uint64_t _tx_head = 0;
+    bool _peer_gone = false;
+    // The peer corrupted a ring
+    bool _broken = false;
+    shared_promise<> _input_done;
+
+    // Positions the peer gave us must leave at most a ring's worth of data
+    void check_positions(const ring& r, uint64_t head, uint64_t tail) {
+        if (head - tail > r.size) {
+            _broken = true;
+            peer_gone();
+            throw std::system_error(EPROTO, std::system_category(), "shared memory socket peer corrupted a ring");
+        }
+    }
+public:
+    static constexpr size_t max_chunk = 128 * 1024;
+
+    // fds holds the data and space eventfds of the server to client ring,
+    // then those of the client to server one
+    shm_channel(pollable_fd control, mmap_area area, size_t ring_size, bool is_server,
+            std::array<file_desc, 4> fds, socket_address local, socket_address remote)
+        : shm_channel(std::move(control), std::move(area), ring_size, is_server,
+                std::move(fds[is_server ? 2 : 0]), std::move(fds[is_server ? 3 : 1]),
+                std::move(fds[is_server ? 0 : 2]), std::move(fds[is_server ? 1 : 3]), local, remote)
+    {}
+    shm_channel(pollable_fd control, mmap_area area, size_t ring_size, bool is_server,
+            file_desc rx_data, file_desc rx_space, file_desc tx_data, file_desc tx_space,
+            socket_address local, socket_address remote)
+        : _control(std::move(control))
+        , _area(std::move(area))
+        , _rx_data(std::move(rx_data))
+        , _tx_space(std::move(tx_space))
+        , _rx_space(std::move(rx_space))
+        , _tx_data(std::move(tx_data))
+        , _local(local)
+        , _remote(remote)
+    {
+        auto region = ring_header_space + ring_size;
+        ring s2c{reinterpret_cast<ring_header*>(_area.get()), _area.get() + ring_header_space, ring_size};
+        ring c2s{reinterpret_cast<ring_header*>(_area.get() + region), _area.get() + region + ring_header_space, ring_size};
+        _rx = is_server ? c2s : s2c;
+        _tx = is_server ? s2c : c2s;
+        // The peer closes the unix socket when it's done, or when it dies
+        (void)_control.poll_rdhup().then_wrapped([control = _control, ch = weak_from_this()] (future<> f) {
+            f.ignore_ready_future();
+            if (ch) {
+                ch->peer_gone();
+            }
+        });
+    }
+    ~shm_channel() {
+        shutdown_input();
+        shutdown_output();
+        try {
+            _control.shutdown(SHUT_RDWR);
+        } catch (...) {
+            // The peer may be gone already
+        }
+    }
+
+    // Called when the control socket hangs up, and when the peer corrupts
+    // a ring, possibly both
+    void peer_gone() noexcept {
+        if (std::exchange(_peer_gone, true)) {
+            return;
+        }
+        _input_done.set_value();
+        // Wake up our own waiters
+        signal(_rx_data.get_file_desc());
+        signal(_tx_space.get_file_desc());
+    }
+
+    future<temporary_buffer<char>> get() {
+        auto& h = *_rx.h;
+        for (;;) {
+            if (_broken) {
+                throw std::system_error(EPROTO, std::system_category());
+            }
+            auto tail = _rx_tail;
+            auto head = h.head.load(std::memory_order_acquire);
+            check_positions(_rx, head, tail);
+            if (head != tail) {
+                auto n = std::min<size_t>(head - tail, max_chunk);
+                temporary_buffer<char> buf(n);
+                _rx.copy_out(tail, buf.get_write(), n);
+                _rx_tail = tail + n;
+                h.tail.store(_rx_tail);
+                if (h.producer_waiting.exchange(0)) {
+                    signal(_rx_space);
+                }
+                co_return buf;
+            }
+            if (h.reader_closed.load()) {
+                co_return temporary_buffer<char>();
+            }
+            if (h.closed.load(std::memory_order_acquire) || _peer_gone) {
+                // Whatever was written before closing is visible now
+                if (h.head.load(std::memory_order_acquire) != tail) {
+                    continue;
+                }
+                co_return temporary_buffer<char>();
+            }
+            h.consumer_waiting.store(1);
+            if (h.head.load() != tail || h.closed.load()) {
+                continue;
+            }
+            co_await wait(_rx_data);
+        }
+    }
+
+    future<> put(const char* p, size_t len) {
+        auto& h = *_tx.h;
+        while (len) {
+            if (_broken) {
+                throw std::system_error(EPROTO, std::system_category());
+            }
+            if (_peer_gone || h.reader_closed.load() || h.closed.load()) {
+                throw std::system_error(EPIPE, std::system_category());
+            }
+            auto head = _tx_head;
+            auto tail = h.tail.load(std::memory_order_acquire);
+            check_positions(_tx, head, tail);
+            auto space = _tx.size - (head - tail);
+            if (!space) {
+                h.producer_waiting.store(1);
+                if (h.tail.load() == tail && !h.reader_closed.load()) {
+                    co_await wait(_tx_space);
+                }
+                continue;
+            }
+            auto n = std::min<size_t>(space, len);
+            _tx.copy_in(head, p, n);
+            _tx_head = head + n;
+            h.head.store(_tx_head);
+            if (h.consumer_waiting.exchange(0)) {
+                signal(_tx_data);
+            }
+            p += n;
+            len -= n;
+        }
+    }
+
+    void shutdown_input() noexcept {
+        if (!_rx.h->reader_closed.exchange(1)) {
+            signal(_rx_space);
+            signal(_rx_data.get_file_desc());
+        }
+    }
+    void shutdown_output() noexcept {
+        if (!_tx.h->closed.exchange(1)) {
+            signal(_tx_data);
+            signal(_tx_space.get_file_desc());
+        }
+    }
+
+    future<> wait_input_shutdown() {
+        return _input_done.get_shared_future();
+    }
+    socket_address local_address() const noexcept {
+        return _local;
+    }
+    socket_address remote_address() const noexcept {
+        return _remote;
+    }
+};
+
+class shm_data_source_impl final : public data_source_impl {
+    lw_shared_ptr<shm_channel> _ch;
+public:
+    explicit shm_data_source_impl(lw_shared_ptr<shm_channel> ch) noexcept : _ch(std::move(ch)) {}
+    future<temporary_buffer<char>> get() override {
+        return _ch->get();
+    }
+    future<> close() override {
+        _ch->shutdown_input();
+        return make_ready_future<>();
+    }
+};
+
+class shm_data_sink_impl final : public data_sink_impl {
+    lw_shared_ptr<shm_channel> _ch;
+public:
+    explicit shm_data_sink_impl(lw_shared_ptr<shm_channel> ch) noexcept : _ch(std::move(ch)) {}
+    future<> put(packet p) override {
+        for (auto& f : p.fragments()) {
+            co_await _ch->put(f.base, f.size);
+        }
+    }
+    future<> put(temporary_buffer<char> buf) override {
+        return _ch->put(buf.get(), buf.size()).finally([buf = std::move(buf)] {});
+    }
+    future<> close() override {
+        _ch->shutdown_output();
+        return make_ready_future<>();
+    }
+    size_t buffer_size() const noexcept override {
+        return shm_channel::max_chunk;
+    }
+};
+
+class shm_connected_socket_impl final : public connected_socket_impl {
+    lw_shared_ptr<shm_channel> _ch;
+    bool _nodelay = true;
+    bool _keepalive = false;
+public:
+    explicit shm_connected_socket_impl(lw_shared_ptr<shm_channel> ch) noexcept : _ch(std::move(ch)) {}
+    data_source source() override {
+        return data_source(std::make_unique<shm_data_source_impl>(_ch));
+    }
+    data_sink sink() override {
+        return data_sink(std::make_unique<shm_data_sink_impl>(_ch));
+    }
+    void shutdown_input() override {
+        _ch->shutdown_input();
+    }
+    void shutdown_output() override {
+        _ch->shutdown_output();
+    }
+    void set_nodelay(bool nodelay) override {
+        _nodelay = nodelay;
+    }
+    bool get_nodelay() const override {
+        return _nodelay;
+    }
+    void set_keepalive(bool keepalive) override {
+        _keepalive = keepalive;
+    }
+    bool get_keepalive() const override {
+        return _keepalive;
+    }
+    void set_keepalive_parameters(const keepalive_params&) override {}
+    keepalive_params get_keepalive_parameters() const override {
+        return tcp_keepalive_params{std::chrono::seconds(0), std::chrono::seconds(0), 0};
+    }
+    void set_sockopt(int level, int optname, const void* data, size_t len) override {
+        throw std::runtime_error("Setting custom socket options is not supported for shared memory sockets");
+    }
+    int get_sockopt(int level, int optname, void* data, size_t len) const override {
+        throw std::runtime_error("Getting custom socket options is not supported for shared memory sockets");
+    }
+    socket_address local_address() const noexcept override {
+        return _ch->local_address();
+    }
+    socket_address remote_address() const noexcept override {
+        return _ch->remote_address();
+    }
+    future<> wait_input_shutdown() override {
+        return _ch->wait_input_shutdown();
+    }
+};
+
+connected_socket make_connected_socket(lw_shared_ptr<shm_channel> ch) {
+    return connected_socket(std::make_unique<shm_connected_socket_impl>(std::move(ch)));
+}
+
+// Sets up the shared memory of an accepted connection and hands it over
+future<connected_socket> serve(pollable_fd control, socket_address local, socket_address remote, size_t ring_size) {
+    auto region = ring_header_space + ring_size;
+    int memfd = ::memfd_create("seastar-shm-socket", MFD_CLOEXEC);
+    throw_system_error_on(memfd == -1, "memfd_create");
+    auto mem = file_desc::from_fd(memfd);
+    mem.truncate(2 * region);
+    auto area = mem.map(2 * region, PROT_READ | PROT_WRITE, MAP_SHARED, 0);
+    new (area.get()) ring_header;
+    new (area.get() + region) ring_header;
+    std::array<file_desc, 4> fds{make_eventfd(), make_eventfd(), make_eventfd(), make_eventfd()};
+
+    shm_hello hello{};
+    std::memcpy(hello.magic, shm_magic, sizeof(hello.magic));
+    hello.version = shm_version;
+    hello.nr_fds = shm_nr_fds;
+    hello.ring_size = ring_size;
+    iovec iov{&hello, sizeof(hello)};
+    alignas(cmsghdr) char control_buf[CMSG_SPACE(sizeof(int) * shm_nr_fds)] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control_buf;
+    msg.msg_controllen = sizeof(control_buf);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * shm_nr_fds);
+    int raw_fds[shm_nr_fds] = { mem.get(), fds[0].get(), fds[1].get(), fds[2].get(), fds[3].get() };
+    std::memcpy(CMSG_DATA(cmsg), raw_fds, sizeof(raw_fds));
+    auto sent = co_await control.sendmsg(&msg);
+    if (sent != sizeof(hello)) {
+        throw std::runtime_error("Short write of the shared memory socket handshake");
+    }
+    co_return make_connected_socket(make_lw_shared<shm_channel>(std::move(control), std::move(area), ring_size, true, std::move(fds), local, remote));
+}
+
+// Receives the shared memory of a connection from the server
+future<connected_socket> join(pollable_fd control, socket_address local, socket_address remote) {
+    shm_hello hello;
+    iovec iov{&hello, sizeof(hello)};
+    alignas(cmsghdr) char control_buf[CMSG_SPACE(sizeof(int) * shm_nr_fds)] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control_buf;
+    msg.msg_controllen = sizeof(control_buf);
+    auto received = co_await control.recvmsg(&msg);
+
+    // Take ownership of whatever was passed before validating anything
+    std::vector<file_desc> passed;
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            auto nr = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < nr; i++) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                passed.push_back(file_desc::from_fd(fd));
+            }
+        }
+    }
+    if (received != sizeof(hello) || std::memcmp(hello.magic, shm_magic, sizeof(hello.magic))) {
+        throw std::runtime_error("Peer is not a shared memory socket server");
+    }
+    if (hello.version != shm_version) {
+        throw std::runtime_error(format("Unsupported shared memory socket version {}", hello.version));
+    }
+    if ((msg.msg_flags & MSG_CTRUNC) || hello.nr_fds != shm_nr_fds || passed.size() != shm_nr_fds) {
+        throw std::runtime_error("Malformed shared memory socket handshake");
+    }
+    auto ring_size = hello.ring_size;
+    if (ring_size < 4096 || ring_size > max_ring_size || (ring_size & (ring_size - 1))) {
+        throw std::runtime_error(format("Invalid shared memory socket ring size {}", ring_size));
+    }
+    auto size = 2 * (ring_header_space + ring_size);
+    struct stat st;
+    throw_system_error_on(::fstat(passed[0].get(), &st) == -1, "fstat");
+    if (size_t(st.st_size) < size) {
+        throw std::runtime_error("Shared memory of the socket is too small");
+    }
+    auto area = passed[0].map(size, PROT_READ | PROT_WRITE, MAP_SHARED, 0);
+    std::array<file_desc, 4> fds{std::move(passed[1]), std::move(passed[2]), std::move(passed[3]), std::move(passed[4])};
+    for (auto& fd : fds) {
+        int flags = ::fcntl(fd.get(), F_GETFL);
+        throw_system_error_on(flags == -1, "fcntl");
+        throw_system_error_on(::fcntl(fd.get(), F_SETFL, flags | O_NONBLOCK) == -1, "fcntl");
+    }
+    co_return make_connected_socket(make_lw_shared<shm_channel>(std::move(control), std::move(area), ring_size, false, std::move(fds), local, remote));
+}
+
+class shm_server_socket_impl final : public server_socket_impl {
+    pollable_fd _lfd;
+    socket_address _sa;
+    size_t _ring_size;
+public:
+    shm_server_socket_impl(pollable_fd lfd, socket_address sa, size_t ring_size)
+        : _lfd(std::move(lfd)), _sa(sa), _ring_size(ring_size) {}
+    future<accept_result> accept() override {
+        auto [fd, addr] = co_await _lfd.accept();
+        auto s = co_await serve(std::move(fd), _sa, addr, _ring_size);
+        co_return accept_result{std::move(s), addr};
+    }
+    void abort_accept() override {
+        _lfd.shutdown(SHUT_RD, pollable_fd::shutdown_kernel_only::no);
+    }
+    socket_address local_address() const override {
+        return _sa;
+    }
+};
+
+class shm_socket_impl final : public socket_impl {
+    pollable_fd _fd;
+    bool _reuseaddr = false;
+public:
+    future<connected_socket> connect(socket_address sa, socket_address local, transport proto) override {
+        if (!sa.is_af_unix()) {
+            throw std::invalid_argument("Shared memory sockets connect to unix domain addresses");
+        }
+        if (local.is_unspecified()) {
+            local = socket_address{unix_domain_addr{std::string{}}};
+        }
+        _fd = engine().make_pollable_fd(sa, 0);
+        co_await engine().posix_connect(_fd, sa, local);
+        co_return co_await join(_fd, local, sa);
+    }
+    void set_reuseaddr(bool reuseaddr) override {
+        _reuseaddr = reuseaddr;
+    }
+    bool get_reuseaddr() const override {
+        return _reuseaddr;
+    }
+    void shutdown() override {
+        if (_fd) {
+            try {
+                _fd.shutdown(SHUT_RDWR);
+            } catch (std::system_error& e) {
+                if (e.code().value() != ENOTCONN) {
+                    throw;
+                }
+            }
+        }
+    }
+};
+
+}
+
+server_socket shm_listen(socket_address sa, shm_listen_options opts) {
+    auto ring_size = opts.ring_size;
+    if (ring_size < 4096 || ring_size > max_ring_size || (ring_size & (ring_size - 1))) {
+        throw std::invalid_argument(format("Invalid shared memory socket ring size {}", ring_size));
+    }
+    if (!sa.is_af_unix()) {
+        throw std::invalid_argument("Shared memory sockets listen on unix domain addresses");
+    }
+    listen_options lo;
+    lo.listen_backlog = opts.listen_backlog;
+    return server_socket(std::make_unique<shm_server_socket_impl>(engine().posix_listen(sa, lo), sa, ring_size));
+}
+
+socket make_shm_socket() {
+    return socket(std::make_unique<shm_socket_impl>());
+}
+
+}
+
+}
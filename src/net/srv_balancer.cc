@@ -0,0 +1,252 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <fmt/core.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/srv_balancer.hh>
+#endif
+
+namespace seastar {
+
+namespace net {
+
+srv_balancer::lease::lease(srv_balancer* b, lw_shared_ptr<state> s) noexcept
+        : _balancer(b)
+        , _state(std::move(s))
+        , _start(clock_type::now())
+{
+    _state->outstanding++;
+}
+
+srv_balancer::lease& srv_balancer::lease::operator=(lease&& o) noexcept {
+    if (this != &o) {
+        if (_state) {
+            _state->outstanding--;
+        }
+        _balancer = o._balancer;
+        _state = std::move(o._state);
+        _start = o._start;
+    }
+    return *this;
+}
+
+srv_balancer::lease::~lease() {
+    if (_state) {
+        _state->outstanding--;
+    }
+}
+
+void srv_balancer::lease::complete(bool success) noexcept {
+    auto now = clock_type::now();
+    complete(success, now - _start);
+    _start = now;
+}
+
+void srv_balancer::lease::complete(bool success, clock_type::duration latency) noexcept {
+    _balancer->record(*_state, latency, success);
+}
+
+srv_balancer::srv_balancer()
+        : srv_balancer(config{})
+{
+}
+
+srv_balancer::srv_balancer(config cfg)
+        : _cfg(std::move(cfg))
+        , _rng(std::random_device()())
+{
+}
+
+void srv_balancer::record(state& s, clock_type::duration latency, bool success) noexcept {
+    auto now = clock_type::now();
+    auto sample = std::chrono::duration<double>(latency).count();
+    if (success) {
+        s.failures = 0;
+    } else {
+        sample = std::max(sample, std::chrono::duration<double>(_cfg.failure_penalty).count());
+        if (++s.failures >= _cfg.max_failures) {
+            s.ejected_until = now + _cfg.ejection_time;
+        }
+    }
+    if (!s.sampled || sample > s.latency) {
+        // Slowdowns are taken at once, recoveries are smoothed
+        s.latency = sample;
+        s.sampled = true;
+    } else {
+        auto decay = std::chrono::duration<double>(_cfg.decay_time).count();
+        auto w = decay > 0 ? std::exp(-std::chrono::duration<double>(now - s.stamp).count() / decay) : 0.0;
+        s.latency = s.latency * w + sample * (1 - w);
+    }
+    s.stamp = now;
+}
+
+void srv_balancer::set_endpoints(std::vector<endpoint> endpoints) {
+    std::vector<lw_shared_ptr<state>> states;
+    states.reserve(endpoints.size());
+    for (auto& ep : endpoints) {
+        auto it = std::find_if(_endpoints.begin(), _endpoints.end(), [&ep] (const lw_shared_ptr<state>& s) {
+            return s && s->ep.address == ep.address;
+        });
+        if (it != _endpoints.end()) {
+            (*it)->ep = std::move(ep);
+            states.push_back(std::move(*it));
+        } else {
+            states.push_back(make_lw_shared<state>(std::move(ep)));
+        }
+    }
+    std::stable_sort(states.begin(), states.end(), [] (const lw_shared_ptr<state>& a, const lw_shared_ptr<state>& b) {
+        return a->ep.priority < b->ep.priority;
+    });
+    _endpoints = std::move(states);
+}
+
+future<> srv_balancer::resolve(dns_resolver::srv_proto proto, const sstring& service, const sstring& domain) {
+    auto records = co_await dns::get_srv_records(proto, service, domain);
+    // A target of "." means the service isn't available at the domain
+    std::erase_if(records, [] (const srv_record& r) { return r.target == "."; });
+    std::vector<future<inet_address>> resolving;
+    resolving.reserve(records.size());
+    for (auto& r : records) {
+        resolving.push_back(dns::resolve_name(r.target));
+    }
+    auto addresses = co_await when_all(resolving.begin(), resolving.end());
+    std::vector<endpoint> endpoints;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (addresses[i].failed()) {
+            addresses[i].ignore_ready_future();
+            continue;
+        }
+        endpoints.push_back(endpoint{socket_address(addresses[i].get(), records[i].port), records[i].priority, records[i].weight});
+    }
+    if (endpoints.empty() && !records.empty()) {
+        throw std::runtime_error(fmt::format("no SRV target of {}.{} could be resolved", service, domain));
+    }
+    set_endpoints(std::move(endpoints));
+}
+
+size_t srv_balancer::pick_weighted(const std::vector<size_t>& candidates) {
+    // Weight zero gets a small chance to be picked, as RFC 2782 asks
+    auto effective = [this] (size_t i) -> uint64_t {
+        auto w = _endpoints[i]->ep.weight;
+        return w ? uint64_t(w) << 8 : 1;
+    };
+    uint64_t total = 0;
+    for (auto i : candidates) {
+        total += effective(i);
+    }
+    auto r = std::uniform_int_distribution<uint64_t>(0, total - 1)(_rng);
+    for (auto i : candidates) {
+        auto w = effective(i);
+        if (r < w) {
+            return i;
+        }
+        r -= w;
+    }
+    return candidates.back();
+}
+
+double srv_balancer::cost(const state& s, double unsampled) const noexcept {
+    return (s.sampled ? s.latency : unsampled) * (s.outstanding + 1);
+}
+
+srv_balancer::lease srv_balancer::acquire() {
+    if (_endpoints.empty()) {
+        throw std::runtime_error("no endpoints to balance across");
+    }
+    auto now = clock_type::now();
+    std::vector<size_t> candidates;
+    for (size_t b = 0; b < _endpoints.size() && candidates.empty();) {
+        auto e = b;
+        for (; e < _endpoints.size() && _endpoints[e]->ep.priority == _endpoints[b]->ep.priority; e++) {
+            if (_endpoints[e]->ejected_until <= now) {
+                candidates.push_back(e);
+            }
+        }
+        b = e;
+    }
+    if (candidates.empty()) {
+        // Everything is ejected, better try than fail
+        for (size_t i = 0; i < _endpoints.size(); i++) {
+            candidates.push_back(i);
+        }
+    }
+
+    auto first = pick_weighted(candidates);
+    auto chosen = first;
+    if (candidates.size() > 1) {
+        // Unsampled endpoints are assumed as fast as the fastest one, so
+        // that they get probed
+        double unsampled = std::numeric_limits<double>::max();
+        for (auto i : candidates) {
+            if (_endpoints[i]->sampled) {
+                unsampled = std::min(unsampled, _endpoints[i]->latency);
+            }
+        }
+        if (unsampled == std::numeric_limits<double>::max()) {
+            unsampled = 1;
+        }
+        std::erase(candidates, first);
+        auto second = pick_weighted(candidates);
+        if (cost(*_endpoints[second], unsampled) < cost(*_endpoints[first], unsampled)) {
+            chosen = second;
+        }
+    }
+    _endpoints[chosen]->picks++;
+    return lease(this, _endpoints[chosen]);
+}
+
+std::vector<srv_balancer::endpoint_stats> srv_balancer::get_stats() const {
+    auto now = clock_type::now();
+    std::vector<endpoint_stats> ret;
+    ret.reserve(_endpoints.size());
+    for (auto& s : _endpoints) {
+        ret.push_back(endpoint_stats{
+            .address = s->ep.address,
+            .priority = s->ep.priority,
+            .weight = s->ep.weight,
+            .latency = std::chrono::duration<double>(s->latency),
+            .outstanding = s->outstanding,
+            .picks = s->picks,
+            .ejected = s->ejected_until > now,
+        });
+    }
+    return ret;
+}
+
+}
+
+}
@@ -23,7 +23,10 @@
 module;
 #endif
 
+#include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <system_error>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -33,6 +36,10 @@ module seastar;
 #else
 #include <seastar/net/stack.hh>
 #include <seastar/net/inet_address.hh>
+#include <seastar/net/dns.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/posix.hh>
 #endif
 
 namespace seastar {
@@ -70,6 +77,10 @@ future<net::datagram> net::datagram_channel::receive() {
     return _impl->receive();
 }
 
+future<std::vector<net::datagram>> net::datagram_channel::receive_batch(size_t max) {
+    return _impl->receive_batch(std::max(max, size_t(1)));
+}
+
 future<> net::datagram_channel::send(const socket_address& dst, const char* msg) {
     return _impl->send(dst, msg);
 }
@@ -78,6 +89,50 @@ future<> net::datagram_channel::send(const socket_address& dst, packet p) {
     return _impl->send(dst, std::move(p));
 }
 
+future<> net::datagram_channel::send_batch(std::vector<outgoing_datagram> datagrams) {
+    return _impl->send_batch(std::move(datagrams));
+}
+
+future<std::vector<net::datagram>> net::datagram_channel_impl::receive_batch(size_t max) {
+    return receive().then([] (datagram d) {
+        std::vector<datagram> ret;
+        ret.push_back(std::move(d));
+        return ret;
+    });
+}
+
+future<> net::datagram_channel_impl::send_batch(std::vector<outgoing_datagram> datagrams) {
+    return do_with(std::move(datagrams), [this] (std::vector<outgoing_datagram>& datagrams) {
+        return do_for_each(datagrams, [this] (outgoing_datagram& d) {
+            return send(d.dst, std::move(d.p));
+        });
+    });
+}
+
+future<> net::datagram_channel::send_segmented(const socket_address& dst, packet p, uint16_t segment_size) {
+    if (segment_size == 0) {
+        return make_exception_future<>(std::invalid_argument("segment size must be positive"));
+    }
+    return _impl->send_segmented(dst, std::move(p), segment_size);
+}
+
+bool net::datagram_channel::set_gro(bool enable) {
+    return _impl->set_gro(enable);
+}
+
+bool net::datagram_channel::set_timestamping(bool enable) {
+    return _impl->set_timestamping(enable);
+}
+
+future<> net::datagram_channel_impl::send_segmented(const socket_address& dst, packet p, uint16_t segment_size) {
+    std::vector<outgoing_datagram> datagrams;
+    datagrams.reserve((p.len() + segment_size - 1) / segment_size);
+    for (size_t offset = 0; offset < p.len(); offset += segment_size) {
+        datagrams.push_back(outgoing_datagram{dst, p.share(offset, std::min<size_t>(segment_size, p.len() - offset))});
+    }
+    return send_batch(std::move(datagrams));
+}
+
 bool net::datagram_channel::is_closed() const {
     return _impl->is_closed();
 }
@@ -120,6 +175,12 @@ output_stream<char> connected_socket::output(size_t buffer_size) {
     return output_stream<char>(_csi->sink(), buffer_size, opts);
 }
 
+output_stream<char> connected_socket::output(connected_socket_output_stream_config cssc) {
+    output_stream_options opts;
+    opts.batch_flushes = true;
+    return output_stream<char>(_csi->sink(cssc), cssc.buffer_size, opts);
+}
+
 void connected_socket::set_nodelay(bool nodelay) {
     _csi->set_nodelay(nodelay);
 }
@@ -166,12 +227,62 @@ future<> connected_socket::wait_input_shutdown() {
     return _csi->wait_input_shutdown();
 }
 
+bool connected_socket::can_send_file(file& f) const noexcept {
+    return _csi->can_send_file(f);
+}
+
+future<> connected_socket::send_file(file& f, uint64_t pos, uint64_t len) {
+    return _csi->send_file(f, pos, len);
+}
+
+bool connected_socket::can_pass_fds() const noexcept {
+    return _csi->can_pass_fds();
+}
+
+future<> connected_socket::send_fds(std::vector<file_desc> fds, temporary_buffer<char> data) {
+    return _csi->send_fds(std::move(fds), std::move(data));
+}
+
+std::vector<file_desc> connected_socket::take_received_fds() {
+    return _csi->take_received_fds();
+}
+
+file_desc connected_socket::dup_fd() const {
+    return _csi->dup_fd();
+}
+
+future<>
+net::connected_socket_impl::send_file(file& f, uint64_t pos, uint64_t len) {
+    return make_exception_future<>(std::system_error(ENOTSUP, std::system_category(), "send_file"));
+}
+
+future<>
+net::connected_socket_impl::send_fds(std::vector<file_desc> fds, temporary_buffer<char> data) {
+    return make_exception_future<>(std::system_error(ENOTSUP, std::system_category(), "send_fds"));
+}
+
+std::vector<file_desc>
+net::connected_socket_impl::take_received_fds() {
+    return {};
+}
+
+file_desc
+net::connected_socket_impl::dup_fd() const {
+    throw std::system_error(ENOTSUP, std::system_category(), "dup_fd");
+}
+
 data_source
 net::connected_socket_impl::source(connected_socket_input_stream_config csisc) {
     // Default implementation falls back to non-parameterized data_source
     return source();
 }
 
+data_sink
+net::connected_socket_impl::sink(connected_socket_output_stream_config cssc) {
+    // Default implementation falls back to non-parameterized data_sink
+    return sink();
+}
+
 socket::~socket()
 {}
 
@@ -227,6 +338,15 @@ socket_address server_socket::local_address() const noexcept {
     return _ssi->local_address();
 }
 
+file_desc server_socket::dup_fd() const {
+    return _ssi->dup_fd();
+}
+
+file_desc
+net::server_socket_impl::dup_fd() const {
+    throw std::system_error(ENOTSUP, std::system_category(), "dup_fd");
+}
+
 network_interface::network_interface(shared_ptr<net::network_interface_impl> impl) noexcept
     : _impl(std::move(impl))
 {}
@@ -282,8 +402,21 @@ network_stack::connect(socket_address sa, socket_address local, transport proto)
     });
 }
 
+network_stack::network_stack() = default;
+
+network_stack::~network_stack() = default;
+
 std::vector<network_interface> network_stack::network_interfaces() {
     return {};
 }
 
+future<> network_stack::close() {
+    if (!_shared_resolver) {
+        return make_ready_future<>();
+    }
+    return _shared_resolver->close().finally([this] {
+        _shared_resolver.reset();
+    });
+}
+
 }
@@ -0,0 +1,290 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <fmt/core.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/net/tcp-congestion.hh>
+#endif
+
+namespace seastar {
+
+namespace net {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+double to_seconds(tcp_congestion_control::clock_type::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+// RFC5681
+class reno_congestion_control final : public tcp_congestion_control {
+public:
+    std::string_view name() const noexcept override {
+        return "reno";
+    }
+    void cong_avoid(tcp_congestion_window& w, uint32_t acked_bytes) override {
+        if (w.cwnd < w.ssthresh) {
+            // In slow start phase
+            w.cwnd += std::min(acked_bytes, w.mss);
+        } else {
+            // In congestion avoidance phase
+            uint32_t round_up = 1;
+            w.cwnd += std::max(round_up, w.mss * w.mss / w.cwnd);
+        }
+    }
+    uint32_t ssthresh(const tcp_congestion_window& w, uint32_t flight_size) override {
+        return std::max(flight_size / 2, 2 * w.mss);
+    }
+};
+
+// RFC8312. Windows are computed in segments, as in the RFC.
+class cubic_congestion_control final : public tcp_congestion_control {
+    static constexpr double c = 0.4;
+    static constexpr double beta = 0.7;
+    // Window before the last reduction, and the one before it
+    double _w_max = 0;
+    double _w_last_max = 0;
+    // Time it takes to grow back to _w_max, in seconds
+    double _k = 0;
+    // Window of a standard TCP sender, for the TCP-friendly region
+    double _w_est = 0;
+    // Accumulates sub-byte increments
+    double _increment = 0;
+    bool _in_epoch = false;
+    clock_type::time_point _epoch_start;
+    rtt_type _min_rtt = rtt_type::max();
+public:
+    std::string_view name() const noexcept override {
+        return "cubic";
+    }
+    void init(tcp_congestion_window& w) override {
+        _in_epoch = false;
+    }
+    void cong_avoid(tcp_congestion_window& w, uint32_t acked_bytes) override {
+        if (w.cwnd < w.ssthresh) {
+            w.cwnd += std::min(acked_bytes, w.mss);
+            return;
+        }
+        auto now = clock_type::now();
+        double cwnd = double(w.cwnd) / w.mss;
+        if (!_in_epoch) {
+            _in_epoch = true;
+            _epoch_start = now;
+            if (cwnd < _w_max) {
+                _k = std::cbrt((_w_max - cwnd) / c);
+            } else {
+                _k = 0;
+                _w_max = cwnd;
+            }
+            _w_est = cwnd;
+        }
+        auto rtt = _min_rtt == rtt_type::max() ? 0.0 : to_seconds(_min_rtt);
+        // Aim at the window expected one round trip from now
+        auto t = to_seconds(now - _epoch_start) + rtt;
+        auto target = c * std::pow(t - _k, 3) + _w_max;
+        _w_est += 3 * (1 - beta) / (1 + beta) * (double(acked_bytes) / w.mss) / cwnd;
+        target = std::min(std::max(target, _w_est), 1.5 * cwnd);
+        if (target > cwnd) {
+            _increment += (target - cwnd) / cwnd * acked_bytes;
+            auto inc = uint32_t(_increment);
+            w.cwnd += inc;
+            _increment -= inc;
+        }
+    }
+    uint32_t ssthresh(const tcp_congestion_window& w, uint32_t flight_size) override {
+        double cwnd = double(w.cwnd) / w.mss;
+        // Fast convergence: release bandwidth to new flows sooner
+        if (cwnd < _w_last_max) {
+            _w_last_max = cwnd;
+            _w_max = cwnd * (1 + beta) / 2;
+        } else {
+            _w_last_max = cwnd;
+            _w_max = cwnd;
+        }
+        _in_epoch = false;
+        _increment = 0;
+        return std::max(uint32_t(w.cwnd * beta), 2 * w.mss);
+    }
+    void rtt_sample(rtt_type rtt) override {
+        _min_rtt = std::min(_min_rtt, rtt);
+    }
+};
+
+// A window based take on BBR: the native stack doesn't pace, so the
+// bottleneck bandwidth and round trip time model only drives the congestion
+// window. Rounds are delimited by time, one minimal RTT each, since segments
+// don't record how much was delivered when they were sent.
+class bbr_congestion_control final : public tcp_congestion_control {
+    enum class mode { startup, drain, probe_bw, probe_rtt };
+    static constexpr double high_gain = 2.885;
+    static constexpr double cwnd_gain = 2;
+    static constexpr std::array<double, 8> cycle_gains = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+    static constexpr unsigned min_cwnd_segments = 4;
+    static constexpr clock_type::duration min_round = 10ms;
+    static constexpr clock_type::duration min_rtt_expiry = 10s;
+    static constexpr clock_type::duration probe_rtt_duration = 200ms;
+
+    mode _mode = mode::startup;
+    // Delivery rate samples of the last rounds, in bytes per second
+    std::array<double, 10> _bw_samples{};
+    unsigned _round = 0;
+    uint64_t _delivered = 0;
+    uint64_t _round_start_delivered = 0;
+    clock_type::time_point _round_start;
+    rtt_type _min_rtt = rtt_type::max();
+    clock_type::time_point _min_rtt_stamp;
+    bool _min_rtt_expired = false;
+    double _full_bw = 0;
+    unsigned _full_bw_rounds = 0;
+    bool _full_bw_reached = false;
+    unsigned _cycle = 0;
+    clock_type::time_point _probe_rtt_done;
+    uint32_t _prior_cwnd = 0;
+private:
+    double max_bw() const noexcept {
+        return *std::max_element(_bw_samples.begin(), _bw_samples.end());
+    }
+    double gain() const noexcept {
+        switch (_mode) {
+        case mode::startup: return high_gain;
+        // Without pacing, a window of one BDP is what drains the queue
+        case mode::drain: return 1;
+        case mode::probe_bw: return cwnd_gain * cycle_gains[_cycle];
+        case mode::probe_rtt: return 1;
+        }
+        return 1;
+    }
+    void end_round(clock_type::time_point now) {
+        auto elapsed = to_seconds(now - _round_start);
+        _bw_samples[_round++ % _bw_samples.size()] = (_delivered - _round_start_delivered) / elapsed;
+        _round_start = now;
+        _round_start_delivered = _delivered;
+
+        if (!_full_bw_reached) {
+            // Leave startup once the bandwidth stopped growing by 25% for
+            // three rounds
+            if (max_bw() >= _full_bw * 1.25) {
+                _full_bw = max_bw();
+                _full_bw_rounds = 0;
+            } else if (++_full_bw_rounds >= 3) {
+                _full_bw_reached = true;
+                _mode = mode::drain;
+            }
+        } else if (_mode == mode::drain) {
+            _mode = mode::probe_bw;
+            _cycle = 0;
+        } else if (_mode == mode::probe_bw) {
+            _cycle = (_cycle + 1) % cycle_gains.size();
+        }
+    }
+public:
+    std::string_view name() const noexcept override {
+        return "bbr";
+    }
+    void init(tcp_congestion_window& w) override {
+        _round_start = clock_type::now();
+        _round_start_delivered = _delivered;
+    }
+    void cong_avoid(tcp_congestion_window& w, uint32_t acked_bytes) override {
+        auto now = clock_type::now();
+        _delivered += acked_bytes;
+        if (_min_rtt == rtt_type::max()) {
+            // No model yet, grow as in slow start
+            w.cwnd += acked_bytes;
+            return;
+        }
+        if (now - _round_start >= std::max<clock_type::duration>(_min_rtt, min_round)) {
+            end_round(now);
+        }
+
+        uint32_t min_cwnd = min_cwnd_segments * w.mss;
+        if (_mode != mode::probe_rtt && _min_rtt_expired) {
+            // Drain the queue to refresh the minimal RTT estimate
+            _min_rtt_expired = false;
+            _mode = mode::probe_rtt;
+            _prior_cwnd = w.cwnd;
+            _probe_rtt_done = now + probe_rtt_duration + _min_rtt;
+        }
+        if (_mode == mode::probe_rtt) {
+            if (now < _probe_rtt_done) {
+                w.cwnd = min_cwnd;
+                return;
+            }
+            _min_rtt_stamp = now;
+            _mode = _full_bw_reached ? mode::probe_bw : mode::startup;
+            w.cwnd = std::max(w.cwnd, _prior_cwnd);
+        }
+
+        auto target = std::max(min_cwnd, uint32_t(gain() * max_bw() * to_seconds(_min_rtt)));
+        if (_full_bw_reached) {
+            w.cwnd = std::min(w.cwnd + acked_bytes, target);
+        } else if (w.cwnd < target || max_bw() == 0) {
+            w.cwnd += acked_bytes;
+        }
+        w.cwnd = std::max(w.cwnd, min_cwnd);
+    }
+    uint32_t ssthresh(const tcp_congestion_window& w, uint32_t flight_size) override {
+        // Losses aren't taken as a congestion signal, the model is
+        return w.cwnd;
+    }
+    void rtt_sample(rtt_type rtt) override {
+        auto now = clock_type::now();
+        bool expired = _min_rtt != rtt_type::max() && now - _min_rtt_stamp > min_rtt_expiry;
+        if (rtt <= _min_rtt || expired) {
+            _min_rtt = rtt;
+            _min_rtt_stamp = now;
+            _min_rtt_expired = expired && _mode != mode::probe_rtt;
+        }
+    }
+};
+
+}
+
+std::unique_ptr<tcp_congestion_control> make_tcp_congestion_control(std::string_view name) {
+    if (name == "reno") {
+        return std::make_unique<reno_congestion_control>();
+    } else if (name == "cubic") {
+        return std::make_unique<cubic_congestion_control>();
+    } else if (name == "bbr") {
+        return std::make_unique<bbr_congestion_control>();
+    }
+    throw std::invalid_argument(fmt::format("Unknown TCP congestion control algorithm: {}", name));
+}
+
+}
+
+}
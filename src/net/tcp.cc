@@ -44,6 +44,7 @@ namespace net {
 void tcp_option::parse(uint8_t* beg1, uint8_t* end1) {
     const char* beg = reinterpret_cast<const char*>(beg1);
     const char* end = reinterpret_cast<const char*>(end1);
+    _remote_sack_blocks.nr_blocks = 0;
     while (beg < end) {
         auto kind = option_kind(*beg);
         if (kind != option_kind::nop && kind != option_kind::eol) {
@@ -70,6 +71,15 @@ void tcp_option::parse(uint8_t* beg1, uint8_t* end1) {
             _sack_received = true;
             beg += option_len::sack;
             break;
+        case option_kind::sack_blocks: {
+            auto len = uint8_t(beg[1]);
+            if (len < uint8_t(option_len::sack_blocks)) {
+                return;
+            }
+            _remote_sack_blocks = sack_blocks::read(beg);
+            beg += len;
+            break;
+        }
         case option_kind::nop:
             beg += option_len::nop;
             break;
@@ -110,6 +120,16 @@ uint8_t tcp_option::fill(void* h, const tcp_hdr* th, uint8_t options_size) {
             off += win_scale.len;
             size += win_scale.len;
         }
+        if (_sack_received || !ack_on) {
+            auto sack = tcp_option::sack();
+            sack.write(off);
+            off += sack.len;
+            size += sack.len;
+        }
+    } else if (_local_sack_blocks.nr_blocks) {
+        _local_sack_blocks.write(off);
+        off += _local_sack_blocks.size();
+        size += _local_sack_blocks.size();
     }
     if (size > 0) {
         // Insert NOP option
@@ -138,6 +158,11 @@ uint8_t tcp_option::get_size(bool syn_on, bool ack_on) {
         if (_win_scale_received || !ack_on) {
             size += option_len::win_scale;
         }
+        if (_sack_received || !ack_on) {
+            size += option_len::sack;
+        }
+    } else {
+        size += _local_sack_blocks.size();
     }
     if (size > 0) {
         size += option_len::eol;
@@ -23,16 +23,26 @@
 module;
 #endif
 
+#include <algorithm>
 #include <filesystem>
 #include <stdexcept>
 #include <system_error>
 #include <memory>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
 #include <sys/stat.h>
 #include <gnutls/gnutls.h>
+#include <gnutls/abstract.h>
+#include <gnutls/crypto.h>
 #include <gnutls/x509.h>
 
 #include <boost/any.hpp>
@@ -46,6 +56,7 @@ module;
 module seastar;
 #else
 #include <seastar/core/loop.hh>
+#include <seastar/core/metrics.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/file.hh>
@@ -54,11 +65,14 @@ module seastar;
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/timer.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/with_timeout.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/net/stack.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/variant_utils.hh>
+#include <seastar/util/defer.hh>
+#include <seastar/util/spinlock.hh>
 #include <seastar/core/fsnotify.hh>
 #endif
 
@@ -385,12 +399,14 @@ class tls::certificate_credentials::impl: public gnutlsobj {
         gtls_chk(
                 gnutls_certificate_set_x509_trust_mem(_creds, &w,
                         gnutls_x509_crt_fmt_t(fmt)));
+        update_verification_digest("trust", b);
     }
     void set_x509_crl(const blob& b, x509_crt_format fmt) {
         blob_wrapper w(b);
         gtls_chk(
                 gnutls_certificate_set_x509_crl_mem(_creds, &w,
                         gnutls_x509_crt_fmt_t(fmt)));
+        update_verification_digest("crl", b);
     }
     void set_x509_key(const blob& cert, const blob& key, x509_crt_format fmt) {
         blob_wrapper w1(cert);
@@ -399,12 +415,50 @@ class tls::certificate_credentials::impl: public gnutlsobj {
                 gnutls_certificate_set_x509_key_mem(_creds, &w1, &w2,
                         gnutls_x509_crt_fmt_t(fmt)));
     }
+    void set_x509_key_url(const blob& cert, const sstring& key_url, x509_crt_format fmt) {
+        if (!gnutls_url_is_supported(key_url.c_str())) {
+            throw std::invalid_argument("Unsupported private key URL: " + key_url);
+        }
+        blob_wrapper w(cert);
+        gnutls_x509_crt_t* crts;
+        unsigned int ncrts;
+        gtls_chk(gnutls_x509_crt_list_import2(&crts, &ncrts, &w, gnutls_x509_crt_fmt_t(fmt), 0));
+        auto free_crts = defer([&] () noexcept {
+            for (unsigned int i = 0; i < ncrts; ++i) {
+                gnutls_x509_crt_deinit(crts[i]);
+            }
+            gnutls_free(crts);
+        });
+        std::vector<gnutls_pcert_st> pcerts(ncrts);
+        unsigned int npcerts = ncrts;
+        gtls_chk(gnutls_pcert_import_x509_list(pcerts.data(), crts, &npcerts, 0));
+        gnutls_privkey_t key = nullptr;
+        auto res = gnutls_privkey_init(&key);
+        if (res == GNUTLS_E_SUCCESS) {
+            res = gnutls_privkey_import_url(key, key_url.c_str(), 0);
+        }
+        if (res == GNUTLS_E_SUCCESS) {
+            // Takes the certificates and the key on success
+            res = gnutls_certificate_set_key(_creds, nullptr, 0, pcerts.data(), npcerts, key);
+        }
+        if (res < 0) {
+            if (key) {
+                gnutls_privkey_deinit(key);
+            }
+            for (unsigned int i = 0; i < npcerts; ++i) {
+                gnutls_pcert_deinit(&pcerts[i]);
+            }
+            gtls_chk(res);
+        }
+    }
     void set_simple_pkcs12(const blob& b, x509_crt_format fmt,
             const sstring& password) {
         blob_wrapper w(b);
         gtls_chk(
                 gnutls_certificate_set_x509_simple_pkcs12_mem(_creds, &w,
                         gnutls_x509_crt_fmt_t(fmt), password.c_str()));
+        // May hold CRLs too
+        update_verification_digest("pkcs12", b);
     }
     void dh_params(const tls::dh_params& dh) {
 #if GNUTLS_VERSION_NUMBER >= 0x030506
@@ -421,6 +475,7 @@ class tls::certificate_credentials::impl: public gnutlsobj {
     future<> set_system_trust() {
         return async([this] {
             gtls_chk(gnutls_certificate_set_x509_system_trust(_creds));
+            update_verification_digest("system_trust");
             _load_system_trust = false; // should only do once, for whatever reason
         });
     }
@@ -444,12 +499,96 @@ class tls::certificate_credentials::impl: public gnutlsobj {
     const gnutls_datum_t* get_session_resume_key() const {
         return &_session_resume_key;
     }
+    // The "instance" label of the metrics of a scheduler: the lowest index
+    // free among the schedulers of the same name. It is given back with
+    // the metrics, so that replacing or freeing credentials doesn't leave
+    // series behind for good.
+    class metrics_instance {
+        sstring _name;
+        size_t _index;
+
+        static std::unordered_map<sstring, std::vector<bool>>& in_use() {
+            static thread_local std::unordered_map<sstring, std::vector<bool>> in_use;
+            return in_use;
+        }
+    public:
+        explicit metrics_instance(sstring name) : _name(std::move(name)) {
+            auto& used = in_use()[_name];
+            _index = std::find(used.begin(), used.end(), false) - used.begin();
+            if (_index == used.size()) {
+                used.push_back(true);
+            } else {
+                used[_index] = true;
+            }
+        }
+        metrics_instance(const metrics_instance&) = delete;
+        ~metrics_instance() {
+            auto it = in_use().find(_name);
+            auto& used = it->second;
+            used[_index] = false;
+            while (!used.empty() && !used.back()) {
+                used.pop_back();
+            }
+            if (used.empty()) {
+                in_use().erase(it);
+            }
+        }
+        size_t index() const {
+            return _index;
+        }
+    };
+    struct handshake_scheduler {
+        scheduling_group group;
+        semaphore concurrency;
+        uint64_t in_progress = 0;
+        uint64_t total = 0;
+        std::optional<metrics_instance> instance;
+        metrics::metric_groups metrics;
+
+        explicit handshake_scheduler(const handshake_scheduling& hs)
+            : group(hs.group), concurrency(hs.max_concurrency)
+        {}
+    };
+    void set_handshake_scheduling(const handshake_scheduling& hs) {
+        // Handshakes in progress keep the previous scheduler alive, but
+        // its metrics have to make room for the new ones
+        if (_handshakes) {
+            _handshakes->metrics.clear();
+            _handshakes->instance.reset();
+        }
+        auto h = make_lw_shared<handshake_scheduler>(hs);
+        namespace sm = seastar::metrics;
+        // Credentials may share a name, the instance tells their series apart
+        h->instance.emplace(hs.name);
+        auto name_l = sm::label("name")(hs.name);
+        auto instance_l = sm::label("instance")(h->instance->index());
+        h->metrics.add_group("tls", {
+            sm::make_gauge("handshakes_in_progress", [h = h.get()] { return h->in_progress; },
+                    sm::description("Number of handshakes in progress"), {name_l, instance_l}),
+            sm::make_gauge("handshakes_waiting", [h = h.get()] { return h->concurrency.waiters(); },
+                    sm::description("Number of handshakes waiting for others to complete"), {name_l, instance_l}),
+            sm::make_counter("handshakes", h->total,
+                    sm::description("Total number of handshakes run, including failed ones"), {name_l, instance_l}),
+        });
+        _handshakes = std::move(h);
+    }
+    lw_shared_ptr<handshake_scheduler> get_handshake_scheduler() const {
+        return _handshakes;
+    }
+    void set_session_resume_manager(session_resume_manager* m) {
+        _session_resume_manager = m;
+    }
+    const session_resume_manager* get_session_resume_manager() const {
+        return _session_resume_manager;
+    }
     void set_priority_string(const sstring& prio) {
         const char * err = prio.c_str();
         try {
             gnutls_priority_t p;
             gtls_chk(gnutls_priority_init(&p, prio.c_str(), &err));
             _priority.reset(p);
+            // Holds the verification profile
+            update_verification_digest("priority", prio);
         } catch (...) {
             std::throw_with_nested(std::invalid_argument(std::string("Could not set priority: ") + err));
         }
@@ -461,6 +600,15 @@ class tls::certificate_credentials::impl: public gnutlsobj {
     void set_dn_verification_callback(dn_callback cb) {
         _dn_callback = std::move(cb);
     }
+    void set_alpn_protocols(std::vector<sstring> protocols) {
+        _alpn_protocols = std::move(protocols);
+    }
+    const std::vector<sstring>& alpn_protocols() const {
+        return _alpn_protocols;
+    }
+    void set_verification_cache(std::shared_ptr<verification_cache> cache) {
+        _verification_cache = std::move(cache);
+    }
 private:
     friend class credentials_builder;
     friend class session;
@@ -485,7 +633,25 @@ class tls::certificate_credentials::impl: public gnutlsobj {
     bool _load_system_trust = false;
     semaphore _system_trust_sem {1};
     dn_callback _dn_callback;
+    std::vector<sstring> _alpn_protocols;
     gnutls_datum _session_resume_key;
+    session_resume_manager* _session_resume_manager = nullptr;
+    lw_shared_ptr<handshake_scheduler> _handshakes;
+    std::shared_ptr<verification_cache> _verification_cache;
+    // Digest of everything verifications depend on, so that credentials
+    // set up alike share verification cache entries
+    std::array<uint8_t, 32> _verification_digest = {};
+
+    void update_verification_digest(std::string_view what, std::string_view data = {}) {
+        gnutls_hash_hd_t h;
+        gtls_chk(gnutls_hash_init(&h, GNUTLS_DIG_SHA256));
+        uint64_t size = data.size();
+        gnutls_hash(h, _verification_digest.data(), _verification_digest.size());
+        gnutls_hash(h, what.data(), what.size());
+        gnutls_hash(h, &size, sizeof(size));
+        gnutls_hash(h, data.data(), data.size());
+        gnutls_hash_deinit(h, _verification_digest.data());
+    }
 };
 
 tls::certificate_credentials::certificate_credentials()
@@ -520,6 +686,11 @@ void tls::certificate_credentials::set_simple_pkcs12(const blob& b,
     _impl->set_simple_pkcs12(b, fmt, password);
 }
 
+void tls::certificate_credentials::set_x509_key_url(const blob& cert,
+        const sstring& key_url, x509_crt_format fmt) {
+    _impl->set_x509_key_url(cert, key_url, fmt);
+}
+
 future<> tls::abstract_credentials::set_x509_trust_file(
         const sstring& cafile, x509_crt_format fmt) {
     return read_fully(cafile, "trust file").then([this, fmt](temporary_buffer<char> buf) {
@@ -559,10 +730,22 @@ void tls::certificate_credentials::set_priority_string(const sstring& prio) {
     _impl->set_priority_string(prio);
 }
 
+void tls::certificate_credentials::set_alpn_protocols(std::vector<sstring> protocols) {
+    _impl->set_alpn_protocols(std::move(protocols));
+}
+
 void tls::certificate_credentials::set_dn_verification_callback(dn_callback cb) {
     _impl->set_dn_verification_callback(std::move(cb));
 }
 
+void tls::certificate_credentials::set_verification_cache(std::shared_ptr<verification_cache> cache) {
+    _impl->set_verification_cache(std::move(cache));
+}
+
+void tls::certificate_credentials::set_handshake_scheduling(handshake_scheduling hs) {
+    _impl->set_handshake_scheduling(hs);
+}
+
 tls::server_credentials::server_credentials()
 #if GNUTLS_VERSION_NUMBER < 0x030600
     : server_credentials(dh_params{})
@@ -589,6 +772,196 @@ void tls::server_credentials::set_session_resume_mode(session_resume_mode m) {
     _impl->set_session_resume_mode(m);
 }
 
+// A single instance is shared by the managers of all shards, and gnutls
+// calls into it synchronously from the handshake, so it's guarded by a lock
+// rather than owned by one shard
+class tls::session_resume_manager::session_cache {
+    util::spinlock _lock;
+    const size_t _capacity;
+    std::unordered_map<std::string, std::string> _sessions;
+    // Insertion order, for evicting the oldest sessions. May hold keys that
+    // were removed since.
+    std::deque<std::string> _order;
+
+    static session_cache& from_ptr(void* ptr) noexcept {
+        return *static_cast<session_cache*>(ptr);
+    }
+    static std::string to_string(const gnutls_datum_t& d) {
+        return std::string(reinterpret_cast<const char*>(d.data), d.size);
+    }
+public:
+    explicit session_cache(size_t capacity) noexcept : _capacity(capacity) {}
+
+    static int store(void* ptr, gnutls_datum_t key, gnutls_datum_t data) noexcept {
+        auto& c = from_ptr(ptr);
+        try {
+            auto k = to_string(key);
+            std::lock_guard<util::spinlock> g(c._lock);
+            auto [it, inserted] = c._sessions.insert_or_assign(k, to_string(data));
+            if (inserted) {
+                c._order.push_back(std::move(k));
+                while (c._order.size() > c._capacity) {
+                    c._sessions.erase(c._order.front());
+                    c._order.pop_front();
+                }
+            }
+            return 0;
+        } catch (...) {
+            return GNUTLS_E_MEMORY_ERROR;
+        }
+    }
+    static gnutls_datum_t retrieve(void* ptr, gnutls_datum_t key) noexcept {
+        auto& c = from_ptr(ptr);
+        gnutls_datum_t ret = { nullptr, 0 };
+        try {
+            auto k = to_string(key);
+            std::lock_guard<util::spinlock> g(c._lock);
+            auto it = c._sessions.find(k);
+            if (it != c._sessions.end()) {
+                ret.data = static_cast<unsigned char*>(gnutls_malloc(it->second.size()));
+                if (ret.data) {
+                    memcpy(ret.data, it->second.data(), it->second.size());
+                    ret.size = it->second.size();
+                }
+            }
+        } catch (...) {
+        }
+        return ret;
+    }
+    static int remove(void* ptr, gnutls_datum_t key) noexcept {
+        auto& c = from_ptr(ptr);
+        try {
+            auto k = to_string(key);
+            std::lock_guard<util::spinlock> g(c._lock);
+            return c._sessions.erase(k) ? 0 : GNUTLS_E_DB_ERROR;
+        } catch (...) {
+            return GNUTLS_E_DB_ERROR;
+        }
+    }
+};
+
+tls::session_resume_manager::session_resume_manager(config cfg)
+    : _config(cfg)
+    , _rotation([this] {
+        // Failing to rotate leaves the current key in use until the next attempt
+        (void)try_with_gate(_gate, [this] {
+            return rotate_key();
+        }).handle_exception([] (std::exception_ptr) {});
+    })
+{}
+
+tls::session_resume_manager::~session_resume_manager() = default;
+
+future<> tls::session_resume_manager::start() {
+    auto cache = _config.session_cache_capacity != 0 ? std::make_shared<session_cache>(_config.session_cache_capacity) : nullptr;
+    return container().invoke_on_all([cache] (session_resume_manager& m) {
+        m._cache = cache;
+    }).then([this] {
+        return rotate_key();
+    }).then([this] {
+        _rotation.arm_periodic(_config.key_rotation_interval);
+    });
+}
+
+future<> tls::session_resume_manager::stop() {
+    _rotation.cancel();
+    return _gate.close();
+}
+
+future<> tls::session_resume_manager::rotate_key() {
+    gnutls_datum_t k = { nullptr, 0 };
+    gtls_chk(gnutls_session_ticket_key_generate(&k));
+    std::vector<uint8_t> key(k.data, k.data + k.size);
+    gnutls_memset(k.data, 0, k.size);
+    gnutls_free(k.data);
+    return container().invoke_on_all([key = std::move(key)] (session_resume_manager& m) {
+        m._key = key;
+    });
+}
+
+void tls::session_resume_manager::attach(server_credentials& creds) {
+    creds._impl->set_session_resume_manager(this);
+}
+
+class tls::verification_cache::impl {
+    using clock_type = std::chrono::steady_clock;
+
+    const config _config;
+    mutable util::spinlock _lock;
+    std::unordered_map<std::string, clock_type::time_point> _entries;
+    // Insertion order, for evicting the oldest entries
+    std::deque<std::string> _order;
+    std::atomic<uint64_t> _hits = 0;
+    std::atomic<uint64_t> _misses = 0;
+public:
+    explicit impl(config cfg) noexcept : _config(cfg) {}
+
+    bool contains(const std::string& key) {
+        auto now = clock_type::now();
+        bool found;
+        {
+            std::lock_guard<util::spinlock> g(_lock);
+            auto it = _entries.find(key);
+            found = it != _entries.end() && it->second > now;
+        }
+        (found ? _hits : _misses).fetch_add(1, std::memory_order_relaxed);
+        return found;
+    }
+    void insert(std::string key, std::chrono::system_clock::time_point not_after) {
+        auto left = std::chrono::duration_cast<clock_type::duration>(not_after - std::chrono::system_clock::now());
+        if (left <= clock_type::duration::zero()) {
+            return;
+        }
+        auto expiry = clock_type::now() + std::min<clock_type::duration>(_config.ttl, left);
+        std::lock_guard<util::spinlock> g(_lock);
+        auto [it, inserted] = _entries.insert_or_assign(key, expiry);
+        if (inserted) {
+            _order.push_back(std::move(key));
+            while (_order.size() > _config.capacity) {
+                _entries.erase(_order.front());
+                _order.pop_front();
+            }
+        }
+    }
+    void clear() {
+        std::lock_guard<util::spinlock> g(_lock);
+        _entries.clear();
+        _order.clear();
+    }
+    size_t size() const {
+        std::lock_guard<util::spinlock> g(_lock);
+        return _entries.size();
+    }
+    uint64_t hits() const noexcept {
+        return _hits.load(std::memory_order_relaxed);
+    }
+    uint64_t misses() const noexcept {
+        return _misses.load(std::memory_order_relaxed);
+    }
+};
+
+tls::verification_cache::verification_cache(config cfg)
+    : _impl(std::make_unique<impl>(cfg))
+{}
+
+tls::verification_cache::~verification_cache() = default;
+
+void tls::verification_cache::clear() {
+    _impl->clear();
+}
+
+size_t tls::verification_cache::size() const {
+    return _impl->size();
+}
+
+uint64_t tls::verification_cache::hits() const {
+    return _impl->hits();
+}
+
+uint64_t tls::verification_cache::misses() const {
+    return _impl->misses();
+}
+
 
 static const sstring dh_level_key = "dh_level";
 static const sstring x509_trust_key = "x509_trust";
@@ -611,6 +984,8 @@ struct x509_key {
     tls::x509_crt_format format;
     file_info cert_file;
     file_info key_file;
+    // key is the URL of a PKCS#11 key
+    bool key_url = false;
 };
 
 struct pkcs12_simple {
@@ -636,6 +1011,10 @@ void tls::credentials_builder::set_x509_key(const blob& cert, const blob& key, x
     _blobs.emplace(x509_key_key, x509_key { std::string(cert), std::string(key), fmt });
 }
 
+void tls::credentials_builder::set_x509_key_url(const blob& cert, const sstring& key_url, x509_crt_format fmt) {
+    _blobs.emplace(x509_key_key, x509_key { std::string(cert), buffer_type(key_url.begin(), key_url.end()), fmt, {}, {}, true });
+}
+
 void tls::credentials_builder::set_simple_pkcs12(const blob& b, x509_crt_format fmt, const sstring& password) {
     _blobs.emplace(pkcs12_key, pkcs12_simple{std::string(b), fmt, password });
 }
@@ -664,6 +1043,12 @@ future<> tls::credentials_builder::set_x509_key_file(const sstring& cf, const ss
     });
 }
 
+future<> tls::credentials_builder::set_x509_key_url_file(const sstring& cf, const sstring& key_url, x509_crt_format fmt) {
+    return read_fully(cf, "certificate file").then([this, fmt, key_url = key_url](file_result cf) {
+        _blobs.emplace(x509_key_key, x509_key{ to_buffer(cf.buf), buffer_type(key_url.begin(), key_url.end()), fmt, std::move(cf.file), {}, true });
+    });
+}
+
 future<> tls::credentials_builder::set_simple_pkcs12_file(const sstring& pkcs12file, x509_crt_format fmt, const sstring& password) {
     return read_fully(pkcs12file, "pkcs12 file").then([this, fmt, password = password](file_result f) {
         _blobs.emplace(pkcs12_key, pkcs12_simple{ to_buffer(f.buf), fmt, password, std::move(f.file) });
@@ -692,10 +1077,22 @@ void tls::credentials_builder::set_priority_string(const sstring& prio) {
     _priority = prio;
 }
 
+void tls::credentials_builder::set_alpn_protocols(std::vector<sstring> protocols) {
+    _alpn_protocols = std::move(protocols);
+}
+
 void tls::credentials_builder::set_session_resume_mode(session_resume_mode m) {
     _session_resume_mode = m;
 }
 
+void tls::credentials_builder::set_verification_cache(std::shared_ptr<verification_cache> cache) {
+    _verification_cache = std::move(cache);
+}
+
+void tls::credentials_builder::set_handshake_scheduling(handshake_scheduling hs) {
+    _handshake_scheduling = std::move(hs);
+}
+
 template<typename Blobs, typename Visitor>
 static void visit_blobs(Blobs& blobs, Visitor&& visitor) {
     auto visit = [&](const sstring& key, auto* vt) {
@@ -722,7 +1119,11 @@ void tls::credentials_builder::apply_to(certificate_credentials& creds) const {
             }
         },
         [&](const sstring&, const x509_key& info) {
-            creds.set_x509_key(info.cert, info.key, info.format);
+            if (info.key_url) {
+                creds.set_x509_key_url(info.cert, sstring(info.key.begin(), info.key.end()), info.format);
+            } else {
+                creds.set_x509_key(info.cert, info.key, info.format);
+            }
         },
         [&](const sstring&, const pkcs12_simple& info) {
             creds.set_simple_pkcs12(info.data, info.format, info.password);
@@ -743,6 +1144,13 @@ void tls::credentials_builder::apply_to(certificate_credentials& creds) const {
     }
 
     creds._impl->set_client_auth(_client_auth);
+    creds._impl->set_alpn_protocols(_alpn_protocols);
+    if (_handshake_scheduling) {
+        creds._impl->set_handshake_scheduling(*_handshake_scheduling);
+    }
+    if (_verification_cache) {
+        creds._impl->set_verification_cache(_verification_cache);
+    }
     // Note: this causes server session key rotation on cert reload
     creds._impl->set_session_resume_mode(_session_resume_mode);
 }
@@ -1082,13 +1490,27 @@ class session : public enable_lw_shared_from_this<session> {
                     break;
             }
             // Maybe set up server session ticket support
-            switch (_creds->get_session_resume_mode()) {
-                case session_resume_mode::NONE: 
-                default:
-                    break;
-                case session_resume_mode::TLS13_SESSION_TICKET:
-                    gnutls_session_ticket_enable_server(*this, _creds->get_session_resume_key());
-                    break;
+            auto* resume = _creds->get_session_resume_manager();
+            if (resume && !resume->_key.empty()) {
+                // gnutls copies the key
+                gnutls_datum_t key = { const_cast<unsigned char*>(resume->_key.data()), unsigned(resume->_key.size()) };
+                gtls_chk(gnutls_session_ticket_enable_server(*this, &key));
+                gnutls_db_set_cache_expiration(*this, resume->_config.session_lifetime.count());
+                if (resume->_cache) {
+                    gnutls_db_set_ptr(*this, resume->_cache.get());
+                    gnutls_db_set_store_function(*this, &session_resume_manager::session_cache::store);
+                    gnutls_db_set_retrieve_function(*this, &session_resume_manager::session_cache::retrieve);
+                    gnutls_db_set_remove_function(*this, &session_resume_manager::session_cache::remove);
+                }
+            } else {
+                switch (_creds->get_session_resume_mode()) {
+                    case session_resume_mode::NONE: 
+                    default:
+                        break;
+                    case session_resume_mode::TLS13_SESSION_TICKET:
+                        gnutls_session_ticket_enable_server(*this, _creds->get_session_resume_key());
+                        break;
+                }
             }
         }
  
@@ -1097,6 +1519,15 @@ class session : public enable_lw_shared_from_this<session> {
             gtls_chk(gnutls_priority_set(*this, prio));
         }
 
+        if (!_creds->alpn_protocols().empty()) {
+            std::vector<gnutls_datum_t> protocols;
+            for (auto& p : _creds->alpn_protocols()) {
+                protocols.push_back({ reinterpret_cast<unsigned char*>(const_cast<char*>(p.data())), unsigned(p.size()) });
+            }
+            gtls_chk(gnutls_alpn_set_protocols(*this, protocols.data(), protocols.size(),
+                    _type == type::SERVER ? GNUTLS_ALPN_SERVER_PRECEDENCE : 0));
+        }
+
         gnutls_transport_set_ptr(*this, this);
         gnutls_transport_set_vec_push_function(*this, &vec_push_wrapper);
         gnutls_transport_set_pull_function(*this, &pull_wrapper);
@@ -1213,11 +1644,114 @@ class session : public enable_lw_shared_from_this<session> {
             }
             _connected = true;
             // make sure we reset output_pending
-            return wait_for_output();
+            return wait_for_output().then([this] {
+                // The last handshake flight is in the socket now, so the
+                // kernel can take over from the next record on
+                if (_options.kernel_tls_offload && !_ktls_tx) {
+                    _ktls_tx = offload_output_to_kernel();
+                }
+            });
         } catch (...) {
             return make_exception_future<>(std::current_exception());
         }
     }
+    // Hands the write keys of the established session to the kernel, see
+    // tls_options::kernel_tls_offload. Returns false, leaving the socket
+    // as it was, when the cipher or the socket don't support it.
+    bool offload_output_to_kernel() noexcept {
+        gnutls_datum_t mac_key, iv, cipher_key;
+        unsigned char seq[8];
+        if (gnutls_record_get_state(*this, 0, &mac_key, &iv, &cipher_key, seq) < 0) {
+            return false;
+        }
+        uint16_t version;
+        switch (gnutls_protocol_get_version(*this)) {
+        case GNUTLS_TLS1_2:
+            version = TLS_1_2_VERSION;
+            break;
+        case GNUTLS_TLS1_3:
+            version = TLS_1_3_VERSION;
+            break;
+        default:
+            return false;
+        }
+        // TLS 1.2 GCM sends the sequence number as the explicit part of the
+        // nonce, TLS 1.3 derives the whole nonce from the IV
+        auto fill_gcm = [&] (auto& info, uint16_t cipher) {
+            info.info.version = version;
+            info.info.cipher_type = cipher;
+            if (cipher_key.size != sizeof(info.key) || iv.size < sizeof(info.salt)) {
+                return false;
+            }
+            memcpy(info.salt, iv.data, sizeof(info.salt));
+            if (version == TLS_1_3_VERSION) {
+                if (iv.size != sizeof(info.salt) + sizeof(info.iv)) {
+                    return false;
+                }
+                memcpy(info.iv, iv.data + sizeof(info.salt), sizeof(info.iv));
+            } else {
+                memcpy(info.iv, seq, sizeof(info.iv));
+            }
+            memcpy(info.key, cipher_key.data, sizeof(info.key));
+            memcpy(info.rec_seq, seq, sizeof(info.rec_seq));
+            return true;
+        };
+        auto offload = [this] (const auto& info) {
+            try {
+                static constexpr char ulp[] = "tls";
+                _sock->set_sockopt(SOL_TCP, TCP_ULP, ulp, sizeof(ulp));
+                _sock->set_sockopt(SOL_TLS, TLS_TX, &info, sizeof(info));
+                return true;
+            } catch (...) {
+                return false;
+            }
+        };
+        switch (gnutls_cipher_get(*this)) {
+        case GNUTLS_CIPHER_AES_128_GCM: {
+            tls12_crypto_info_aes_gcm_128 info = {};
+            return fill_gcm(info, TLS_CIPHER_AES_GCM_128) && offload(info);
+        }
+        case GNUTLS_CIPHER_AES_256_GCM: {
+            tls12_crypto_info_aes_gcm_256 info = {};
+            return fill_gcm(info, TLS_CIPHER_AES_GCM_256) && offload(info);
+        }
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+        case GNUTLS_CIPHER_CHACHA20_POLY1305: {
+            tls12_crypto_info_chacha20_poly1305 info = {};
+            if (cipher_key.size != sizeof(info.key) || iv.size != sizeof(info.iv)) {
+                return false;
+            }
+            info.info.version = version;
+            info.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+            memcpy(info.iv, iv.data, sizeof(info.iv));
+            memcpy(info.key, cipher_key.data, sizeof(info.key));
+            memcpy(info.rec_seq, seq, sizeof(info.rec_seq));
+            return offload(info);
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    // Runs do_handshake() as configured by
+    // certificate_credentials::set_handshake_scheduling()
+    future<> scheduled_handshake() {
+        auto hs = _creds->get_handshake_scheduler();
+        if (_connected || !hs) {
+            return do_handshake();
+        }
+        return with_scheduling_group(hs->group, [this, hs] {
+            return with_semaphore(hs->concurrency, 1, [this, hs] {
+                ++hs->in_progress;
+                return do_handshake().finally([hs] {
+                    --hs->in_progress;
+                    ++hs->total;
+                });
+            });
+        });
+    }
+
     future<> handshake() {
         // maybe load system certificates before handshake, in case we
         // have not done so yet...
@@ -1229,7 +1763,7 @@ class session : public enable_lw_shared_from_this<session> {
         // acquire both semaphores to sync both read & write
         return with_semaphore(_in_sem, 1, [this] {
             return with_semaphore(_out_sem, 1, [this] {
-                return do_handshake().handle_exception([this](auto ep) {
+                return scheduled_handshake().handle_exception([this](auto ep) {
                     if (!_error) {
                         _error = ep;
                     }
@@ -1258,6 +1792,9 @@ class session : public enable_lw_shared_from_this<session> {
         });
     }
     future<> wait_for_output() {
+        if (_staged_output.len() != 0 && _output_pending.available() && !_output_pending.failed()) {
+            _output_pending = _out.put(std::exchange(_staged_output, {}));
+        }
         return std::exchange(_output_pending, make_ready_future()).handle_exception([this](auto ep) {
            _error = ep;
            return make_exception_future(ep);
@@ -1284,12 +1821,53 @@ class session : public enable_lw_shared_from_this<session> {
         return from_transport_ptr(ptr)->pull(dst, len);
     }
 
-    void verify() {
+    // Key of the peer's chain in the verification cache, if it sent one
+    std::optional<std::string> verification_cache_key() const {
+        unsigned int list_size = 0;
+        const gnutls_datum_t* certs = gnutls_certificate_get_peers(*this, &list_size);
+        if (!certs || list_size == 0) {
+            return std::nullopt;
+        }
+        auto server_name = _type == type::CLIENT ? std::string_view(_options.server_name) : std::string_view();
+        uint64_t header[] = { uint64_t(_type), server_name.size() };
+        gnutls_hash_hd_t h;
+        gtls_chk(gnutls_hash_init(&h, GNUTLS_DIG_SHA256));
+        gnutls_hash(h, _creds->_verification_digest.data(), _creds->_verification_digest.size());
+        gnutls_hash(h, header, sizeof(header));
+        gnutls_hash(h, server_name.data(), server_name.size());
+        for (unsigned int i = 0; i < list_size; ++i) {
+            uint64_t size = certs[i].size;
+            gnutls_hash(h, &size, sizeof(size));
+            gnutls_hash(h, certs[i].data, certs[i].size);
+        }
+        std::string key(32, '\0');
+        gnutls_hash_deinit(h, key.data());
+        return key;
+    }
+    // When the first certificate of the peer's chain expires
+    std::chrono::system_clock::time_point peer_chain_expiration() const {
+        unsigned int list_size = 0;
+        const gnutls_datum_t* certs = gnutls_certificate_get_peers(*this, &list_size);
+        auto expiration = std::chrono::system_clock::time_point::max();
+        for (unsigned int i = 0; i < list_size; ++i) {
+            gnutls_x509_crt_t crt;
+            gtls_chk(gnutls_x509_crt_init(&crt));
+            x509_ctr_ptr p(crt, &gnutls_x509_crt_deinit);
+            gtls_chk(gnutls_x509_crt_import(crt, &certs[i], GNUTLS_X509_FMT_DER));
+            auto t = std::chrono::system_clock::from_time_t(gnutls_x509_crt_get_expiration_time(crt));
+            expiration = std::min(expiration, t);
+        }
+        return expiration;
+    }
+
+    // Verifies the peer's certificates, returns false if it sent none and
+    // doesn't have to
+    bool verify_peers() {
         unsigned int status;
         auto res = gnutls_certificate_verify_peers3(*this, _type != type::CLIENT || _options.server_name.empty()
                         ? nullptr : _options.server_name.c_str(), &status);
         if (res == GNUTLS_E_NO_CERTIFICATE_FOUND && _type != type::CLIENT && _creds->get_client_auth() != client_auth::REQUIRE) {
-            return;
+            return false;
         }
         if (res < 0) {
             throw std::system_error(res, error_category());
@@ -1310,6 +1888,20 @@ class session : public enable_lw_shared_from_this<session> {
             }
             throw verification_error(stat_str);
         }
+        return true;
+    }
+
+    void verify() {
+        auto& cache = _creds->_verification_cache;
+        auto key = cache ? verification_cache_key() : std::nullopt;
+        if (!key || !cache->_impl->contains(*key)) {
+            if (!verify_peers()) {
+                return;
+            }
+            if (key) {
+                cache->_impl->insert(std::move(*key), peer_chain_expiration());
+            }
+        }
         if (_creds->_dn_callback) {
             // if the user registered a DN (Distinguished Name) callback
             // then extract subject and issuer from the (leaf) peer certificate and invoke the callback
@@ -1403,28 +1995,106 @@ class session : public enable_lw_shared_from_this<session> {
 
     typedef net::fragment* frag_iter;
 
-    future<> do_put(frag_iter i, frag_iter e) {
+    // Records sent after being idle for this long start over from
+    // tls_options::initial_record_size
+    static constexpr auto record_ramp_up_idle = std::chrono::seconds(1);
+    // Encrypted output is written out once this much of it was staged
+    static constexpr size_t max_staged_output = 64 << 10;
+
+    size_t record_size() noexcept {
+        size_t max = gnutls_record_get_max_size(*this);
+        if (_options.record_ramp_up_bytes == 0) {
+            return max;
+        }
+        auto now = lowres_clock::now();
+        if (now - _last_record > record_ramp_up_idle) {
+            _ramp_up_sent = 0;
+        }
+        _last_record = now;
+        return _ramp_up_sent < _options.record_ramp_up_bytes ? std::clamp<size_t>(_options.initial_record_size, 1, max) : max;
+    }
+
+    // Encrypts size bytes at ptr into records of record_size(). The records
+    // are staged and written to the socket together, rather than with one
+    // put (and syscall) each.
+    future<> send(const char* ptr, size_t size) {
         assert(_output_pending.available());
-        return do_for_each(i, e, [this](net::fragment& f) {
-            auto ptr = f.base;
-            auto size = f.size;
-            size_t off = 0; // here to appease eclipse cdt
-            return repeat([this, ptr, size, off]() mutable {
-                if (off == size) {
-                    return make_ready_future<stop_iteration>(stop_iteration::yes);
-                }
-                auto res = gnutls_record_send(*this, ptr + off, size - off);
-                if (res > 0) { // don't really need to check, but...
-                    off += res;
+        _stage_output = true;
+        return repeat([this, ptr, size, off = size_t(0)] () mutable {
+            if (off == size) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto res = gnutls_record_send(*this, ptr + off, std::min(size - off, record_size()));
+            if (res > 0) { // don't really need to check, but...
+                off += res;
+                _ramp_up_sent += res;
+                if (_staged_output.len() < max_staged_output) {
+                    return make_ready_future<stop_iteration>(stop_iteration::no);
                 }
-                // what will we wait for? error or results...
-                auto f = res < 0 ? handle_output_error(res) : wait_for_output();
+            }
+            // what will we wait for? error or results...
+            auto f = res < 0 ? handle_output_error(res) : wait_for_output();
+            return f.then([] {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            });
+        }).then([this] {
+            return wait_for_output();
+        }).finally([this] {
+            _stage_output = false;
+        });
+    }
+
+    future<> do_put(frag_iter i, frag_iter e) {
+        return do_for_each(i, e, [this](net::fragment& f) {
+            return send(f.base, f.size);
+        });
+    }
+
+    // Adds size bytes at ptr to the pending record, see
+    // tls_options::coalesce_writes. Records are sent as soon as they fill up,
+    // data which fills whole records on its own skips the copy.
+    future<> coalesce(const char* ptr, size_t size) {
+        return repeat([this, ptr, size] () mutable {
+            if (size == 0) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto rs = record_size();
+            if (_record_len == 0 && size >= rs) {
+                auto n = size - size % rs;
+                auto f = send(ptr, n);
+                ptr += n;
+                size -= n;
                 return f.then([] {
                     return make_ready_future<stop_iteration>(stop_iteration::no);
                 });
+            }
+            if (_record.empty()) {
+                _record = temporary_buffer<char>(gnutls_record_get_max_size(*this));
+            }
+            auto n = std::min(size, rs - std::min(rs, _record_len));
+            std::copy_n(ptr, n, _record.get_write() + _record_len);
+            _record_len += n;
+            ptr += n;
+            size -= n;
+            if (_record_len < rs) {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            }
+            return send_pending_record().then([] {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
             });
         });
     }
+
+    future<> send_pending_record() {
+        if (_record_len == 0) {
+            return make_ready_future<>();
+        }
+        if (_error) {
+            return make_exception_future<>(_error);
+        }
+        return send(_record.get(), std::exchange(_record_len, 0));
+    }
+
     future<> put(net::packet p) {
         if (_error) {
             return make_exception_future<>(_error);
@@ -1438,6 +2108,23 @@ class session : public enable_lw_shared_from_this<session> {
             });
         }
 
+        if (_ktls_tx) {
+            // The kernel frames and encrypts whatever is written to the socket
+            return with_semaphore(_out_sem, 1, [this, p = std::move(p)] () mutable {
+                return _out.put(std::move(p));
+            });
+        }
+
+        if (_options.coalesce_writes) {
+            return with_semaphore(_out_sem, 1, [this, p = std::move(p)] () mutable {
+                auto i = p.fragments().begin();
+                auto e = p.fragments().end();
+                return do_for_each(i, e, [this] (net::fragment& f) {
+                    return coalesce(f.base, f.size);
+                }).finally([p = std::move(p)] {});
+            });
+        }
+
         // We want to make sure that we call gnutls_record_send with as large
         // packets as possible. This is because each call to gnutls_record_send
         // translates to a sendmsg syscall. Further it results in larger TLS
@@ -1470,6 +2157,12 @@ class session : public enable_lw_shared_from_this<session> {
         return n;
     }
     ssize_t vec_push(const giovec_t * iov, int iovcnt) {
+        if (_ktls_tx) {
+            // Records encrypted by gnutls, e.g. a key update reply or a
+            // renegotiation, would break the kernel's record sequence
+            gnutls_transport_set_errno(*this, EPROTO);
+            return -1;
+        }
         if (!_output_pending.available()) {
             gnutls_transport_set_errno(*this, EAGAIN);
             return -1;
@@ -1478,12 +2171,17 @@ class session : public enable_lw_shared_from_this<session> {
             ssize_t n; // Set on the good path and unused on the bad path
 
             if (!_output_pending.failed()) {
-                scattered_message<char> msg;
+                auto staged = _staged_output.len();
                 for (int i = 0; i < iovcnt; ++i) {
-                    msg.append(std::string_view(reinterpret_cast<const char *>(iov[i].iov_base), iov[i].iov_len));
+                    if (iov[i].iov_len) {
+                        auto data = std::string_view(reinterpret_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+                        _staged_output = net::packet(std::move(_staged_output), temporary_buffer<char>::copy_of(data));
+                    }
+                }
+                n = _staged_output.len() - staged;
+                if (!_stage_output) {
+                    _output_pending = _out.put(std::exchange(_staged_output, {}));
                 }
-                n = msg.size();
-                _output_pending = _out.put(std::move(msg).release());
             }
             if (_output_pending.failed()) {
                 // exception is copied back into _output_pending
@@ -1528,7 +2226,9 @@ class session : public enable_lw_shared_from_this<session> {
         });
     }
     future<> do_shutdown() {
-        if (_error || !_connected) {
+        // The close_notify alert can't be sent once the kernel owns the
+        // output, the peer only sees the connection closing
+        if (_error || !_connected || _ktls_tx) {
             return make_ready_future();
         }
         auto res = gnutls_bye(*this, GNUTLS_SHUT_WR);
@@ -1577,8 +2277,12 @@ class session : public enable_lw_shared_from_this<session> {
         // read from input until we see EOF. Any other reader
         // before us will get it instead of us, and mark _eof = true
         // in which case we will be no-op.
-        return with_semaphore(_out_sem, 1,
-                        std::bind(&session::do_shutdown, this)).then(
+        return with_semaphore(_out_sem, 1, [this] {
+                            // A failure leaves _error set, which skips the bye
+                            return send_pending_record().handle_exception([] (std::exception_ptr) {}).then([this] {
+                                return do_shutdown();
+                            });
+                        }).then(
                         std::bind(&session::wait_for_eof, this)).finally([me = shared_from_this()] {});
         // note moved finally clause above. It is theorethically possible
         // that we could complete do_shutdown just before the close calls 
@@ -1614,7 +2318,9 @@ class session : public enable_lw_shared_from_this<session> {
     // helper for sink
     future<> flush() noexcept {
         return with_semaphore(_out_sem, 1, [this] {
-            return _out.flush();
+            return send_pending_record().then([this] {
+                return _out.flush();
+            });
         });
     }
 
@@ -1643,11 +2349,25 @@ class session : public enable_lw_shared_from_this<session> {
         return futurize_invoke(f, std::forward<Args>(args)...);
     }
 
+    future<bool> is_kernel_offloaded() {
+        return state_checked_access([this] {
+            return _ktls_tx;
+        });
+    }
     future<bool> is_resumed() {
         return state_checked_access([this] {
             return gnutls_session_is_resumed(*this) != 0;
         });
     }
+    future<std::optional<sstring>> get_alpn_protocol() {
+        return state_checked_access([this] {
+            gnutls_datum_t protocol;
+            if (gnutls_alpn_get_selected_protocol(*this, &protocol) != GNUTLS_E_SUCCESS) {
+                return std::optional<sstring>();
+            }
+            return std::optional<sstring>(sstring(reinterpret_cast<const char*>(protocol.data), protocol.size));
+        });
+    }
     future<session_data> get_session_resume_data() {
         return state_checked_access([this] {
             /**
@@ -1797,11 +2517,23 @@ class session : public enable_lw_shared_from_this<session> {
     bool _eof = false;
     bool _shutdown = false;
     bool _connected = false;
+    // Output records are encrypted by the kernel, see offload_output_to_kernel()
+    bool _ktls_tx = false;
     std::exception_ptr _error;
 
     future<> _output_pending;
+    // Encrypted output not written to the socket yet, see send()
+    net::packet _staged_output;
+    bool _stage_output = false;
     buf_type _input;
 
+    // Plaintext of the record being filled, see coalesce()
+    temporary_buffer<char> _record;
+    size_t _record_len = 0;
+    // Plaintext sent since the ramp up (re)started, see record_size()
+    size_t _ramp_up_sent = 0;
+    lowres_clock::time_point _last_record;
+
     // modify this to a unique_ptr to handle exceptions in our constructor.
     std::unique_ptr<std::remove_pointer_t<gnutls_session_t>, void(*)(gnutls_session_t)> _session;
 };
@@ -1889,6 +2621,12 @@ class tls_connected_socket_impl : public net::connected_socket_impl, public sess
     future<bool> check_session_is_resumed() {
         return _session->is_resumed();
     }
+    future<std::optional<sstring>> get_alpn_protocol() {
+        return _session->get_alpn_protocol();
+    }
+    future<bool> check_kernel_tls_offload() {
+        return _session->is_kernel_offloaded();
+    }
     future<session_data> get_session_resume_data() {
         return _session->get_session_resume_data();
     }
@@ -2078,6 +2816,14 @@ future<bool> tls::check_session_is_resumed(connected_socket& socket) {
     return get_tls_socket(socket)->check_session_is_resumed();
 }
 
+future<std::optional<sstring>> tls::get_alpn_protocol(connected_socket& socket) {
+    return get_tls_socket(socket)->get_alpn_protocol();
+}
+
+future<bool> tls::check_kernel_tls_offload(connected_socket& socket) {
+    return get_tls_socket(socket)->check_kernel_tls_offload();
+}
+
 future<tls::session_data> tls::get_session_resume_data(connected_socket& socket) {
     return get_tls_socket(socket)->get_session_resume_data();
 }
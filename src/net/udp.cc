@@ -107,7 +107,31 @@ class native_channel : public datagram_channel_impl {
     }
 
     virtual future<datagram> receive() override {
-        return _state->_queue.pop_eventually();
+        auto netif = _proto.inet().netif();
+        if (!netif->packet_timestamps()) {
+            return _state->_queue.pop_eventually();
+        }
+        return _state->_queue.pop_eventually().then([netif] (datagram d) {
+            netif->account_rx_latency(d.get_data());
+            return d;
+        });
+    }
+
+    // The queue is filled from whole RX bursts before the receiver gets to
+    // run, so a batch collects everything the last polls delivered
+    virtual future<std::vector<datagram>> receive_batch(size_t max) override {
+        return _state->_queue.not_empty().then([this, max] {
+            std::vector<datagram> ret;
+            ret.reserve(std::min(max, _state->_queue.size()));
+            auto netif = _proto.inet().netif();
+            while (ret.size() < max && !_state->_queue.empty()) {
+                ret.push_back(_state->_queue.pop());
+                if (netif->packet_timestamps()) {
+                    netif->account_rx_latency(ret.back().get_data());
+                }
+            }
+            return ret;
+        });
     }
 
     virtual future<> send(const socket_address& dst, const char* msg) override {
@@ -122,6 +146,27 @@ class native_channel : public datagram_channel_impl {
         });
     }
 
+    virtual future<> send_batch(std::vector<outgoing_datagram> datagrams) override {
+        size_t len = 0;
+        for (auto& d : datagrams) {
+            len += d.p.len();
+        }
+        if (!_state->_user_queue_space.try_wait(len)) {
+            return datagram_channel_impl::send_batch(std::move(datagrams));
+        }
+        for (auto& d : datagrams) {
+            auto dlen = d.p.len();
+            auto p = packet(std::move(d.p), make_deleter([s = _state, dlen] { s->complete_send(dlen); }));
+            _proto.send(_reg.port(), d.dst, std::move(p));
+        }
+        return make_ready_future<>();
+    }
+
+    // Timestamps are set for the whole stack, see --packet-timestamps
+    virtual bool set_timestamping(bool enable) override {
+        return _proto.inet().netif()->packet_timestamps() == enable;
+    }
+
     virtual bool is_closed() const override {
         return _closed;
     }
@@ -183,6 +228,9 @@ void ipv4_udp::received(packet p, ipv4_address from, ipv4_address to)
 
 void ipv4_udp::send(uint16_t src_port, ipv4_addr dst, packet &&p)
 {
+    if (_inet.netif()->packet_timestamps() && !p.timestamp()) {
+        p.set_timestamp(std::chrono::system_clock::now());
+    }
     auto src = _inet.host_address();
     auto hdr = p.prepend_header<udp_hdr>();
     hdr->src_port = src_port;
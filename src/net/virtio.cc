@@ -34,8 +34,11 @@ module;
 #include <fcntl.h>
 #include <seastar/net/virtio-interface.hh>
 #include <linux/vhost.h>
+#include <linux/virtio_config.h>
 #include <linux/if_tun.h>
 #include <net/if.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #ifdef HAVE_OSV
 #include <osv/virtio-assign.hh>
 #endif
@@ -53,11 +56,13 @@ module seastar;
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/align.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/memory.hh>
 #include <seastar/util/function_input_iterator.hh>
 #include <seastar/util/transform_iterator.hh>
 #include <seastar/net/ip.hh>
 #include <seastar/net/const.hh>
 #include <seastar/net/native-stack.hh>
+#include "net/buffer_pool.hh"
 #endif
 
 namespace seastar {
@@ -103,7 +108,7 @@ class device : public net::device {
             _hw_features.rx_csum_offload = false;
         }
         if (!(opts.tso && opts.tso.get_value() == "off")) {
-            seastar_supported_features |= VIRTIO_NET_F_HOST_TSO4;
+            seastar_supported_features |= VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_HOST_TSO6;
             _hw_features.tx_tso = true;
         } else {
             _hw_features.tx_tso = false;
@@ -124,6 +129,11 @@ class device : public net::device {
             _hw_features.tx_ufo = false;
         }
 
+        if (!(opts.packed_ring && opts.packed_ring.get_value() == "off")) {
+            // Packed virtqueues only exist in virtio 1.0 devices
+            seastar_supported_features |= (int64_t(1) << VIRTIO_F_RING_PACKED) | (int64_t(1) << VIRTIO_F_VERSION_1);
+        }
+
         seastar_supported_features |= VIRTIO_NET_F_MAC;
         return seastar_supported_features;
     }
@@ -203,6 +213,9 @@ struct ring_config {
     bool event_index;
     bool indirect;
     bool mergable_buffers;
+    // Packed layout: descs, then the driver (avail) and device (used)
+    // event suppression structures
+    bool packed;
 };
 
 struct buffer {
@@ -302,6 +315,36 @@ class vring {
         used_layout* _shared;
         uint16_t _tail = 0;
     };
+
+    // Packed layout, where the device writes used descriptors over the
+    // available ones, in the same ring
+    struct packed_desc {
+        phys _paddr;
+        uint32_t _len;
+        // Buffer id, only meaningful in the first descriptor of a chain
+        // and in used descriptors
+        uint16_t _id;
+        std::atomic<uint16_t> _flags;
+    };
+    struct event_suppress {
+        std::atomic<uint16_t> _off_wrap;
+        std::atomic<uint16_t> _flags;
+    };
+    struct packed_ring {
+        explicit packed_ring(ring_config conf);
+        packed_desc* _descs;
+        event_suppress* _driver;
+        event_suppress* _device;
+        uint16_t _next_avail = 0;
+        bool _avail_wrap = true;
+        uint16_t _next_used = 0;
+        bool _used_wrap = true;
+        uint16_t _added_since_kick = 0;
+        // Buffer ids not in use, and the number of descriptors of the
+        // chain of each id
+        std::vector<uint16_t> _free_ids;
+        std::vector<uint16_t> _chain_len;
+    };
 private:
     ring_config _config;
     Completion _complete;
@@ -310,6 +353,7 @@ class vring {
     desc* _descs;
     avail _avail;
     used _used;
+    packed_ring _packed;
     std::atomic<uint16_t>* _avail_event;
     std::atomic<uint16_t>* _used_event;
     semaphore _available_descriptors = { 0 };
@@ -365,7 +409,39 @@ class vring {
         }
     }
 
+    static uint16_t packed_flags(bool wrap, bool used) {
+        // A descriptor is available when its avail bit matches the driver's
+        // wrap counter and its used bit doesn't, and used when both match
+        // the device's
+        return (uint16_t(wrap) << VRING_PACKED_DESC_F_AVAIL) | (uint16_t(wrap == used) << VRING_PACKED_DESC_F_USED);
+    }
+
+    void kick_packed() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool need_kick;
+        auto flags = _packed._device->_flags.load(std::memory_order_relaxed);
+        if (flags == VRING_PACKED_EVENT_FLAG_DESC) {
+            uint16_t off_wrap = _packed._device->_off_wrap.load(std::memory_order_relaxed);
+            uint16_t event_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+            if (bool(off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) != _packed._avail_wrap) {
+                event_idx -= size();
+            }
+            uint16_t new_idx = _packed._next_avail;
+            uint16_t old_idx = new_idx - _packed._added_since_kick;
+            need_kick = (uint16_t)(new_idx - event_idx - 1) < (uint16_t)(new_idx - old_idx);
+        } else {
+            need_kick = flags != VRING_PACKED_EVENT_FLAG_DISABLE;
+        }
+        _packed._added_since_kick = 0;
+        if (need_kick) {
+            _notifier->notify();
+        }
+    }
+
+    template <typename Iterator>
+    void post_packed(Iterator begin, Iterator end);
     bool do_complete();
+    bool do_complete_packed();
     size_t mask() { return size() - 1; }
     size_t masked(size_t idx) { return idx & mask(); }
     size_t available();
@@ -383,6 +459,13 @@ vring<BufferChain, Completion>::used::used(ring_config conf)
     : _shared(reinterpret_cast<used_layout*>(conf.used)) {
 }
 
+template <typename BufferChain, typename Completion>
+vring<BufferChain, Completion>::packed_ring::packed_ring(ring_config conf)
+    : _descs(reinterpret_cast<packed_desc*>(conf.descs))
+    , _driver(reinterpret_cast<event_suppress*>(conf.avail))
+    , _device(reinterpret_cast<event_suppress*>(conf.used)) {
+}
+
 template <typename BufferChain, typename Completion>
 inline
 unsigned
@@ -405,6 +488,7 @@ vring<BufferChain, Completion>::vring(ring_config conf, Completion complete)
     , _descs(reinterpret_cast<desc*>(conf.descs))
     , _avail(conf)
     , _used(conf)
+    , _packed(conf)
     , _avail_event(reinterpret_cast<std::atomic<uint16_t>*>(&_used._shared->_used_elements[conf.size]))
     , _used_event(reinterpret_cast<std::atomic<uint16_t>*>(&_avail._shared->_ring[conf.size]))
     , _poller(reactor::poller::simple([this] {
@@ -416,11 +500,20 @@ vring<BufferChain, Completion>::vring(ring_config conf, Completion complete)
 
 template <typename BufferChain, typename Completion>
 void vring<BufferChain, Completion>::setup() {
-    for (unsigned i = 0; i < _config.size; ++i) {
-        _descs[i]._next = i + 1;
+    if (_config.packed) {
+        for (unsigned i = 0; i < _config.size; ++i) {
+            _packed._free_ids.push_back(_config.size - 1 - i);
+        }
+        _packed._chain_len.resize(_config.size);
+        // Completions are polled
+        _packed._driver->_flags.store(VRING_PACKED_EVENT_FLAG_DISABLE, std::memory_order_relaxed);
+    } else {
+        for (unsigned i = 0; i < _config.size; ++i) {
+            _descs[i]._next = i + 1;
+        }
+        _free_head = 0;
+        _free_last = _config.size - 1;
     }
-    _free_head = 0;
-    _free_last = _config.size - 1;
     _available_descriptors.signal(_config.size);
 }
 
@@ -428,6 +521,10 @@ void vring<BufferChain, Completion>::setup() {
 template <typename BufferChain, typename Completion>
 template <typename Iterator>
 void vring<BufferChain, Completion>::post(Iterator begin, Iterator end) {
+    if (_config.packed) {
+        post_packed(begin, end);
+        return;
+    }
     for (auto bci = begin; bci!= end; ++bci) {
         auto&& bc = *bci;
         desc pseudo_head = {};
@@ -453,8 +550,78 @@ void vring<BufferChain, Completion>::post(Iterator begin, Iterator end) {
     kick();
 }
 
+template <typename BufferChain, typename Completion>
+template <typename Iterator>
+void vring<BufferChain, Completion>::post_packed(Iterator begin, Iterator end) {
+    for (auto bci = begin; bci!= end; ++bci) {
+        auto&& bc = *bci;
+        auto id = _packed._free_ids.back();
+        _packed._free_ids.pop_back();
+        auto head = _packed._next_avail;
+        uint16_t head_flags = 0;
+        uint16_t n = 0;
+        for (auto i = bc.begin(); i != bc.end();) {
+            auto&& b = *i;
+            auto& d = _packed._descs[_packed._next_avail];
+            d._paddr = b.addr;
+            d._len = b.len;
+            d._id = id;
+            uint16_t flags = packed_flags(_packed._avail_wrap, false);
+            if (b.writeable) {
+                flags |= VRING_DESC_F_WRITE;
+            }
+            if (++i != bc.end()) {
+                flags |= VRING_DESC_F_NEXT;
+            }
+            // The head is made available last, with the whole chain
+            if (n++) {
+                d._flags.store(flags, std::memory_order_relaxed);
+            } else {
+                head_flags = flags;
+            }
+            if (++_packed._next_avail == _config.size) {
+                _packed._next_avail = 0;
+                _packed._avail_wrap = !_packed._avail_wrap;
+            }
+        }
+        _packed._chain_len[id] = n;
+        _packed._added_since_kick += n;
+        _buffer_chains[id] = std::move(bc);
+        _packed._descs[head]._flags.store(head_flags, std::memory_order_release);
+    }
+    kick_packed();
+}
+
+template <typename BufferChain, typename Completion>
+bool vring<BufferChain, Completion>::do_complete_packed() {
+    uint64_t count = 0;
+    while (true) {
+        auto& d = _packed._descs[_packed._next_used];
+        auto flags = d._flags.load(std::memory_order_acquire);
+        if ((flags & packed_flags(true, true)) != packed_flags(_packed._used_wrap, true)) {
+            break;
+        }
+        auto id = d._id;
+        _complete(std::move(_buffer_chains[id]), d._len);
+        _packed._next_used += _packed._chain_len[id];
+        if (_packed._next_used >= _config.size) {
+            _packed._next_used -= _config.size;
+            _packed._used_wrap = !_packed._used_wrap;
+        }
+        _packed._free_ids.push_back(id);
+        ++count;
+    }
+    if (count) {
+        _complete.bunch(count);
+    }
+    return count;
+}
+
 template <typename BufferChain, typename Completion>
 bool vring<BufferChain, Completion>::do_complete() {
+    if (_config.packed) {
+        return do_complete_packed();
+    }
     auto used_head = _used._shared->_idx.load(std::memory_order_acquire);
     auto count = _used._tail - used_head;
     _complete.bunch(count);
@@ -538,7 +705,7 @@ class qp : public net::qp {
     };
     class rxq  {
         struct buffer_and_virt : buffer {
-            std::unique_ptr<char[], free_deleter> buf;
+            buffer_pool::buffer buf;
         };
         using single_buffer = std::array<buffer_and_virt, 1>;
         struct complete {
@@ -551,10 +718,13 @@ class qp : public net::qp {
             }
         };
         qp& _dev;
+        // Outlives the buffers posted to the ring
+        buffer_pool _pool{4096};
         vring<single_buffer, complete> _ring;
         unsigned _remaining_buffers = 0;
         std::vector<fragment> _fragments;
-        std::vector<std::unique_ptr<char[], free_deleter>> _buffers;
+        // Returns the buffers of the packet being received to the pool
+        deleter _deleter;
     public:
         rxq(qp& _if, ring_config config);
         void set_notifier(std::unique_ptr<notifier> notifier) {
@@ -582,6 +752,10 @@ class qp : public net::qp {
 protected:
     device* _dev;
     size_t _header_len;
+    bool _packed_ring;
+    // Memory the backend can access, packets outside of it are copied
+    uintptr_t _dma_start = 0;
+    uintptr_t _dma_end = std::numeric_limits<uintptr_t>::max();
     std::unique_ptr<char[], free_deleter> _txq_storage;
     std::unique_ptr<char[], free_deleter> _rxq_storage;
     txq _txq;
@@ -592,7 +766,16 @@ class qp : public net::qp {
     void common_config(ring_config& r);
     size_t vring_storage_size(size_t ring_size);
 public:
-    explicit qp(device* dev, size_t rx_ring_size, size_t tx_ring_size);
+    explicit qp(device* dev, size_t rx_ring_size, size_t tx_ring_size, bool packed_ring = false);
+    bool dma_reachable(const packet& p) const {
+        for (auto& f : p.fragments()) {
+            auto start = reinterpret_cast<uintptr_t>(f.base);
+            if (start < _dma_start || start + f.size > _dma_end) {
+                return false;
+            }
+        }
+        return true;
+    }
     virtual future<> send(packet p) override {
         abort();
     }
@@ -619,6 +802,10 @@ qp::txq::post(circular_buffer<packet>& pb) {
         nr_frags += p.nr_frags();
 
         pb.pop_front();
+        if (!_dev.dma_reachable(p)) {
+            // Fragments of static data, or of other shards' memory
+            p.linearize();
+        }
         // Handle TCP checksum offload
         auto oi = p.get_offload_info();
         if (_dev._dev->hw_features().tx_csum_l4_offload) {
@@ -634,8 +821,7 @@ qp::txq::post(circular_buffer<packet>& pb) {
                     vhdr.csum_offset = 16;
                 }
                 if (oi.tso_seg_size) {
-                    // IPv4 TCP TSO
-                    vhdr.gso_type = net_hdr::gso_tcpv4;
+                    vhdr.gso_type = oi.ipv6 ? net_hdr::gso_tcpv6 : net_hdr::gso_tcpv4;
                     // Sum of Ethernet, IP and TCP header size
                     vhdr.hdr_len = eth_hdr_len + ip_hdr_len + tcp_hdr_len;
                     // Maximum segment size of packet after the offload
@@ -683,9 +869,12 @@ qp::rxq::prepare_buffers() {
         if (available.try_wait(opportunistic)) {
             count += opportunistic;
         }
-        auto make_buffer_chain = [] {
+        auto make_buffer_chain = [this] {
             single_buffer bc;
-            std::unique_ptr<char[], free_deleter> buf(reinterpret_cast<char*>(malloc(4096)));
+            auto buf = _pool.allocate_buffer();
+            if (!buf) {
+                throw std::bad_alloc();
+            }
             buffer_and_virt& b = bc[0];
             b.addr = virt_to_phys(buf.get());
             b.len = 4096;
@@ -711,7 +900,7 @@ qp::rxq::debug_mode_adjust_fragments() {
     }
     std::copy_n(last.base, sz, buf.get());
     _fragments.back() = { buf.get(), sz };
-    _buffers.back() = std::move(buf);
+    _deleter.append(make_free_deleter(buf.release()));
 #endif
 }
 
@@ -729,25 +918,18 @@ qp::rxq::complete_buffer(single_buffer&& bc, size_t len) {
         frag_buf += _dev._header_len;
         frag_len -= _dev._header_len;
         _fragments.clear();
-        _buffers.clear();
+        _deleter = deleter();
     };
 
     // Append current buffer
     _fragments.emplace_back(fragment{frag_buf, frag_len});
-    _buffers.push_back(std::move(buf));
+    _deleter.append(_pool.make_deleter(buf.release()));
     _remaining_buffers--;
 
     // Last buffer
     if (_remaining_buffers == 0) {
         debug_mode_adjust_fragments();
-        deleter del;
-        if (_buffers.size() == 1) {
-            del = make_free_deleter(_buffers[0].release());
-            _buffers.clear();
-        } else {
-            del = make_object_deleter(std::move(_buffers));
-        }
-        packet p(_fragments.begin(), _fragments.end(), std::move(del));
+        packet p(_fragments.begin(), _fragments.end(), std::move(_deleter));
 
         _dev._stats.rx.good.update_frags_stats(p.nr_frags(), p.len());
 
@@ -768,8 +950,9 @@ static std::unique_ptr<char[], free_deleter> virtio_buffer(size_t size) {
     return std::unique_ptr<char[], free_deleter>(reinterpret_cast<char*>(ret));
 }
 
-qp::qp(device* dev, size_t rx_ring_size, size_t tx_ring_size)
+qp::qp(device* dev, size_t rx_ring_size, size_t tx_ring_size, bool packed_ring)
     : _dev(dev)
+    , _packed_ring(packed_ring)
     , _txq_storage(virtio_buffer(vring_storage_size(tx_ring_size)))
     , _rxq_storage(virtio_buffer(vring_storage_size(rx_ring_size)))
     , _txq(*this, txq_config(tx_ring_size))
@@ -782,8 +965,14 @@ size_t qp::vring_storage_size(size_t ring_size) {
 }
 
 void qp::common_config(ring_config& r) {
-    r.avail = r.descs + 16 * r.size;
-    r.used = align_up(r.avail + 2 * r.size + 6, 4096);
+    r.packed = _packed_ring;
+    if (r.packed) {
+        r.avail = r.descs + 16 * r.size;
+        r.used = r.avail + 4;
+    } else {
+        r.avail = r.descs + 16 * r.size;
+        r.used = align_up(r.avail + 2 * r.size + 6, 4096);
+    }
     r.event_index = (_dev->features() & VIRTIO_RING_F_EVENT_IDX) != 0;
     r.indirect = false;
 }
@@ -840,7 +1029,8 @@ qp_vhost::qp_vhost(device *dev, const native_stack_options& opts)
     auto tap_device = opts.tap_device.get_value();
     int64_t vhost_supported_features;
     _vhost_fd.ioctl(VHOST_GET_FEATURES, vhost_supported_features);
-    vhost_supported_features &= _dev->features();
+    // vhost-net doesn't have packed virtqueues, and stays a legacy device
+    vhost_supported_features &= _dev->features() & ~((int64_t(1) << VIRTIO_F_RING_PACKED) | (int64_t(1) << VIRTIO_F_VERSION_1));
     _vhost_fd.ioctl(VHOST_SET_FEATURES, vhost_supported_features);
     if (vhost_supported_features & VIRTIO_NET_F_MRG_RXBUF) {
         _header_len = sizeof(net_hdr_mrg);
@@ -864,7 +1054,7 @@ qp_vhost::qp_vhost(device *dev, const native_stack_options& opts)
     if (hw_features.tx_csum_l4_offload && hw_features.rx_csum_offload) {
         offload = TUN_F_CSUM;
         if (hw_features.tx_tso) {
-            offload |= TUN_F_TSO4;
+            offload |= TUN_F_TSO4 | TUN_F_TSO6;
         }
         if (hw_features.tx_ufo) {
             offload |= TUN_F_UFO;
@@ -913,6 +1103,205 @@ qp_vhost::qp_vhost(device *dev, const native_stack_options& opts)
     _vhost_fd.ioctl(VHOST_NET_SET_BACKEND, vhost_vring_file{1, tap_fd.get()});
 }
 
+// Front-end side of the vhost-user protocol, which hands the rings and the
+// memory to a backend in another process over a unix socket
+class vhost_user {
+public:
+    enum class request : uint32_t {
+        get_features = 1,
+        set_features = 2,
+        set_owner = 3,
+        set_mem_table = 5,
+        set_vring_num = 8,
+        set_vring_addr = 9,
+        set_vring_base = 10,
+        set_vring_kick = 12,
+        set_vring_call = 13,
+        get_protocol_features = 15,
+        set_protocol_features = 16,
+        set_vring_enable = 18,
+    };
+    static constexpr unsigned max_regions = 8;
+    struct memory_region {
+        uint64_t guest_phys_addr;
+        uint64_t memory_size;
+        uint64_t userspace_addr;
+        uint64_t mmap_offset;
+    };
+    struct memory_table {
+        uint32_t nregions;
+        uint32_t padding;
+        memory_region regions[max_regions];
+    };
+    // Rings start disabled when negotiated, see set_vring_enable
+    static constexpr uint64_t f_protocol_features = uint64_t(1) << 30;
+private:
+    struct header {
+        uint32_t request;
+        uint32_t flags;
+        uint32_t size;
+    };
+    static constexpr uint32_t version = 0x1;
+    file_desc _fd;
+    uint64_t _features = 0;
+public:
+    explicit vhost_user(const sstring& path)
+        : _fd(file_desc::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+        sockaddr_un sun = {};
+        sun.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(sun.sun_path)) {
+            throw std::invalid_argument(format("vhost-user socket path too long: {}", path));
+        }
+        std::copy(path.begin(), path.end(), sun.sun_path);
+        auto r = ::connect(_fd.get(), reinterpret_cast<sockaddr*>(&sun), sizeof(sun));
+        throw_system_error_on(r == -1, "connect to vhost-user backend");
+    }
+    vhost_user(vhost_user&&) = default;
+
+    uint64_t features() const {
+        return _features;
+    }
+
+    // Returns the features both sides support
+    uint64_t negotiate(uint64_t wanted) {
+        send(request::set_owner);
+        auto offered = get(request::get_features);
+        _features = offered & wanted;
+        if (offered & f_protocol_features) {
+            // None of the protocol extensions is needed
+            _features |= f_protocol_features;
+            get(request::get_protocol_features);
+            send(request::set_protocol_features, uint64_t(0));
+        }
+        send(request::set_features, _features);
+        return _features;
+    }
+
+    template <typename Payload>
+    void send(request r, const Payload& payload, int fd = -1) {
+        send(r, &payload, sizeof(payload), fd);
+    }
+    void send(request r) {
+        send(r, nullptr, 0);
+    }
+    void send(request r, const void* payload, uint32_t size, int fd = -1) {
+        header h = { uint32_t(r), version, size };
+        iovec iov[2] = {
+            { &h, sizeof(h) },
+            { const_cast<void*>(payload), size },
+        };
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = size ? 2 : 1;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        if (fd != -1) {
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            auto cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        }
+        auto n = ::sendmsg(_fd.get(), &msg, MSG_NOSIGNAL);
+        throw_system_error_on(n == -1, "vhost-user sendmsg");
+        if (size_t(n) != sizeof(h) + size) {
+            throw std::runtime_error("vhost-user: short write");
+        }
+    }
+    uint64_t get(request r) {
+        send(r);
+        header h;
+        uint64_t value;
+        read_exactly(&h, sizeof(h));
+        if (h.request != uint32_t(r) || h.size != sizeof(value)) {
+            throw std::runtime_error(format("vhost-user: unexpected reply {} of size {} to request {}", h.request, h.size, uint32_t(r)));
+        }
+        read_exactly(&value, sizeof(value));
+        return value;
+    }
+private:
+    void read_exactly(void* p, size_t size) {
+        auto buf = static_cast<char*>(p);
+        while (size) {
+            auto n = ::read(_fd.get(), buf, size);
+            throw_system_error_on(n == -1, "vhost-user read");
+            if (n == 0) {
+                throw std::runtime_error("vhost-user: backend closed the connection");
+            }
+            buf += n;
+            size -= n;
+        }
+    }
+};
+
+class qp_vhost_user : public qp {
+private:
+    vhost_user _backend;
+public:
+    qp_vhost_user(device* dev, const native_stack_options& opts);
+private:
+    qp_vhost_user(device* dev, const native_stack_options& opts, vhost_user backend);
+    void setup_vring(unsigned index, const ring_config& config, writeable_eventfd& kick);
+};
+
+qp_vhost_user::qp_vhost_user(device* dev, const native_stack_options& opts)
+    : qp_vhost_user(dev, opts, vhost_user(opts.virtio_opts.vhost_user.get_value()))
+{}
+
+qp_vhost_user::qp_vhost_user(device* dev, const native_stack_options& opts, vhost_user backend)
+    : qp(dev, config_ring_size(opts.virtio_opts), config_ring_size(opts.virtio_opts),
+            backend.negotiate(dev->features()) & (uint64_t(1) << VIRTIO_F_RING_PACKED))
+    , _backend(std::move(backend))
+{
+    // Virtio 1.0 devices always have the num_buffers field
+    if (_backend.features() & (VIRTIO_NET_F_MRG_RXBUF | (uint64_t(1) << VIRTIO_F_VERSION_1))) {
+        _header_len = sizeof(net_hdr_mrg);
+    } else {
+        _header_len = sizeof(net_hdr);
+    }
+
+    // Share the shard's memory, which holds the rings and the buffers, at
+    // addresses equal to ours, so that virt_to_phys() still holds
+    auto fd = memory::internal::memory_backing_fd();
+    if (fd == -1) {
+        throw std::runtime_error("vhost-user needs memory shared with the backend, use --hugepages");
+    }
+    auto layout = memory::get_memory_layout();
+    vhost_user::memory_table table = {};
+    table.nregions = 1;
+    table.regions[0] = { layout.start, layout.end - layout.start, layout.start, 0 };
+    _backend.send(vhost_user::request::set_mem_table, table, fd);
+    _dma_start = layout.start;
+    _dma_end = layout.end;
+
+    writeable_eventfd rxq_kick;
+    writeable_eventfd txq_kick;
+    setup_vring(0, _rxq.getconfig(), rxq_kick);
+    setup_vring(1, _txq.getconfig(), txq_kick);
+    _rxq.set_notifier(std::make_unique<notifier_vhost>(std::move(rxq_kick)));
+    _txq.set_notifier(std::make_unique<notifier_vhost>(std::move(txq_kick)));
+}
+
+void qp_vhost_user::setup_vring(unsigned index, const ring_config& config, writeable_eventfd& kick) {
+    using request = vhost_user::request;
+    auto tov = [](char* x) { return reinterpret_cast<uintptr_t>(x); };
+
+    // Completions are polled, but backends want somewhere to signal them
+    readable_eventfd call;
+    _backend.send(request::set_vring_call, uint64_t(index), call.get_write_fd());
+    _backend.send(request::set_vring_num, vhost_vring_state{index, config.size});
+    // For packed virtqueues, bit 15 holds the initial wrap counter
+    _backend.send(request::set_vring_base, vhost_vring_state{index, config.packed ? 1u << 15 : 0u});
+    _backend.send(request::set_vring_addr, vhost_vring_addr{
+        index, 0, tov(config.descs), tov(config.used), tov(config.avail), 0
+    });
+    _backend.send(request::set_vring_kick, uint64_t(index), kick.get_read_fd());
+    if (_backend.features() & vhost_user::f_protocol_features) {
+        _backend.send(request::set_vring_enable, vhost_vring_state{index, 1});
+    }
+}
+
 #ifdef HAVE_OSV
 class qp_osv : public qp {
 private:
@@ -1003,6 +1392,9 @@ std::unique_ptr<net::qp> device::init_local_queue(const program_options::option_
 #endif
     auto net_opts = dynamic_cast<const net::native_stack_options*>(&opts);
     assert(net_opts);
+    if (!net_opts->virtio_opts.vhost_user.get_value().empty()) {
+        return std::make_unique<qp_vhost_user>(this, *net_opts);
+    }
     return std::make_unique<qp_vhost>(this, *net_opts);
 }
 
@@ -1025,6 +1417,12 @@ net::virtio_options::virtio_options(program_options::option_group* parent_group)
     , virtio_ring_size(*this, "virtio-ring-size",
                 256,
                 "Virtio ring size (must be power-of-two)")
+    , packed_ring(*this, "packed-ring",
+                "on",
+                "Use packed virtqueues when the backend supports them (on / off)")
+    , vhost_user(*this, "vhost-user",
+                "",
+                "Unix socket of a vhost-user backend to use instead of vhost-net")
 {
 }
 
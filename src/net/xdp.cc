@@ -0,0 +1,610 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/if_xdp.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fmt/core.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/net/xdp.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/internal/poll.hh>
+#include <seastar/core/internal/dma_buffer_pool.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/net/native-stack.hh>
+#include <seastar/util/log.hh>
+#include "net/bpf.hh"
+#endif
+
+namespace seastar {
+
+using namespace net;
+
+namespace xdp {
+
+static logger xdp_log("xdp");
+
+// ETH_RSS_HASH_TOP, which is not part of the uapi headers
+static constexpr uint8_t rss_hash_toeplitz = 1 << 0;
+
+// Issues an interface ioctl, or an ethtool command when ethtool_cmd is set
+static int interface_ioctl(const std::string& ifname, unsigned long request, ifreq& ifr, void* ethtool_cmd = nullptr) {
+    auto fd = file_desc::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC);
+    std::memset(ifr.ifr_name, 0, sizeof(ifr.ifr_name));
+    ifname.copy(ifr.ifr_name, sizeof(ifr.ifr_name) - 1);
+    if (ethtool_cmd) {
+        ifr.ifr_data = reinterpret_cast<char*>(ethtool_cmd);
+    }
+    return ::ioctl(fd.get(), request, &ifr);
+}
+
+static int ethtool_ioctl(const std::string& ifname, void* cmd) {
+    ifreq ifr;
+    return interface_ioctl(ifname, SIOCETHTOOL, ifr, cmd);
+}
+
+// A single producer, single consumer ring shared with the kernel
+template <typename Desc>
+struct ring {
+    uint32_t* producer = nullptr;
+    uint32_t* consumer = nullptr;
+    uint32_t* flags = nullptr;
+    Desc* descs = nullptr;
+    uint32_t size = 0;
+    mmap_area area;
+
+    void map(file_desc& fd, const xdp_ring_offset& off, uint32_t nr, size_t pgoff) {
+        area = fd.map_shared_rw(off.desc + nr * sizeof(Desc), pgoff);
+        producer = reinterpret_cast<uint32_t*>(area.get() + off.producer);
+        consumer = reinterpret_cast<uint32_t*>(area.get() + off.consumer);
+        flags = reinterpret_cast<uint32_t*>(area.get() + off.flags);
+        descs = reinterpret_cast<Desc*>(area.get() + off.desc);
+        size = nr;
+    }
+    Desc& operator[](uint32_t idx) noexcept {
+        return descs[idx & (size - 1)];
+    }
+    static uint32_t load(uint32_t* p) noexcept {
+        return std::atomic_ref<uint32_t>(*p).load(std::memory_order_acquire);
+    }
+    static void store(uint32_t* p, uint32_t v) noexcept {
+        std::atomic_ref<uint32_t>(*p).store(v, std::memory_order_release);
+    }
+    // Producer side: room for new entries
+    uint32_t free_entries() const noexcept {
+        return size - (*producer - load(consumer));
+    }
+    void produce(uint32_t n) noexcept {
+        store(producer, *producer + n);
+    }
+    // Consumer side: entries ready to be consumed
+    uint32_t ready_entries() const noexcept {
+        return load(producer) - *consumer;
+    }
+    void consume(uint32_t n) noexcept {
+        store(consumer, *consumer + n);
+    }
+    bool needs_wakeup() const noexcept {
+        return std::atomic_ref<uint32_t>(*flags).load(std::memory_order_relaxed) & XDP_RING_NEED_WAKEUP;
+    }
+};
+
+class device : public net::device {
+    std::string _ifname;
+    int _ifindex;
+    unsigned _zero_copy_mode;
+    uint32_t _ring_size;
+    ethernet_address _hw_address;
+    net::hw_features _hw_features;
+    uint16_t _nr_queues;
+    std::vector<uint8_t> _rss_key;
+    std::vector<uint32_t> _redir_table;
+    // The table found on the interface, when we had to change it
+    std::vector<uint32_t> _saved_redir_table;
+    std::optional<file_desc> _xsk_map;
+    std::optional<file_desc> _prog;
+    std::optional<file_desc> _link;
+private:
+    void read_hw_address();
+    void read_mtu();
+    void setup_queues();
+    void restore_queues() noexcept;
+    void attach_program();
+public:
+    explicit device(const xdp_options& opts);
+    ~device();
+
+    ethernet_address hw_address() override {
+        return _hw_address;
+    }
+    net::hw_features hw_features() override {
+        return _hw_features;
+    }
+    rss_key_type rss_key() const override {
+        if (_rss_key.empty()) {
+            return default_rsskey_40bytes;
+        }
+        return rss_key_type(_rss_key.data(), _rss_key.size());
+    }
+    uint16_t hw_queues_count() override {
+        return _nr_queues;
+    }
+    unsigned hash2qid(uint32_t hash) override {
+        if (_redir_table.empty()) {
+            return hash % hw_queues_count();
+        }
+        return _redir_table[hash % _redir_table.size()];
+    }
+    std::unique_ptr<net::qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
+
+    const std::string& ifname() const noexcept {
+        return _ifname;
+    }
+    int ifindex() const noexcept {
+        return _ifindex;
+    }
+    uint32_t ring_size() const noexcept {
+        return _ring_size;
+    }
+    unsigned zero_copy_mode() const noexcept {
+        return _zero_copy_mode;
+    }
+    // Makes the kernel redirect the packets of queue qid to the socket
+    void register_socket(uint32_t qid, int fd);
+};
+
+class qp : public net::qp {
+    static constexpr uint32_t rx_batch = 64;
+    device& _dev;
+    uint32_t _qid;
+    file_desc _fd;
+    // UMEM: packet buffers shared with the kernel, in frames of _frame_size
+    temporary_buffer<char> _umem;
+    uint32_t _frame_size;
+    std::vector<uint64_t> _free_frames;
+    // Received packets reference their frames until they are freed. Below
+    // this many free frames, packets are copied instead, so that the fill
+    // ring never runs dry.
+    size_t _copy_watermark;
+    ring<uint64_t> _fill;
+    ring<uint64_t> _comp;
+    ring<xdp_desc> _rx;
+    ring<xdp_desc> _tx;
+    bool _zero_copy = false;
+    std::optional<reactor::poller> _rx_poller;
+private:
+    void setup_umem(uint32_t nr_frames);
+    void bind();
+    char* frame(uint64_t addr) noexcept {
+        return _umem.get_write() + addr;
+    }
+    uint64_t frame_base(uint64_t addr) const noexcept {
+        return addr & ~uint64_t(_frame_size - 1);
+    }
+    void recycle(uint64_t addr) noexcept {
+        _free_frames.push_back(frame_base(addr));
+    }
+    bool refill();
+    bool reap_completions();
+    bool poll_rx();
+    void kick_tx();
+public:
+    qp(device& dev, uint16_t qid);
+    future<> send(packet p) override {
+        abort();
+    }
+    uint32_t send(circular_buffer<packet>& pb) override;
+    void rx_start() override;
+};
+
+device::device(const xdp_options& opts)
+    : _ifname(opts.xdp_interface.get_value())
+    , _ring_size(opts.xdp_ring_size.get_value()) {
+    _ifindex = ::if_nametoindex(_ifname.c_str());
+    if (!_ifindex) {
+        throw std::runtime_error(fmt::format("Unknown network interface {}", _ifname));
+    }
+    if (!_ring_size || (_ring_size & (_ring_size - 1))) {
+        throw std::invalid_argument("xdp-ring-size must be a power of two");
+    }
+    auto zc = opts.xdp_zero_copy.get_value();
+    if (zc == "on") {
+        _zero_copy_mode = XDP_ZEROCOPY;
+    } else if (zc == "off") {
+        _zero_copy_mode = XDP_COPY;
+    } else if (zc == "auto") {
+        _zero_copy_mode = 0;
+    } else {
+        throw std::invalid_argument(fmt::format("Invalid xdp-zero-copy value: {}", zc));
+    }
+    read_hw_address();
+    read_mtu();
+    // Checksums and segmentation are left to the stack, AF_XDP offers no
+    // offloads
+    _hw_features.tx_csum_ip_offload = false;
+    _hw_features.tx_csum_l4_offload = false;
+    _hw_features.rx_csum_offload = false;
+    _hw_features.rx_lro = false;
+    _hw_features.tx_tso = false;
+    _hw_features.tx_ufo = false;
+    _hw_features.max_packet_len = _hw_features.mtu;
+    setup_queues();
+    try {
+        attach_program();
+    } catch (...) {
+        restore_queues();
+        throw;
+    }
+}
+
+device::~device() {
+    restore_queues();
+}
+
+void device::read_hw_address() {
+    ifreq ifr;
+    throw_system_error_on(interface_ioctl(_ifname, SIOCGIFHWADDR, ifr) == -1, "SIOCGIFHWADDR");
+    auto* a = reinterpret_cast<const uint8_t*>(ifr.ifr_hwaddr.sa_data);
+    _hw_address = ethernet_address{a[0], a[1], a[2], a[3], a[4], a[5]};
+}
+
+void device::read_mtu() {
+    ifreq ifr;
+    throw_system_error_on(interface_ioctl(_ifname, SIOCGIFMTU, ifr) == -1, "SIOCGIFMTU");
+    // Frames are at most a page, less the headroom the kernel reserves
+    if (ifr.ifr_mtu + eth_hdr_len + XDP_PACKET_HEADROOM > 4096) {
+        throw std::runtime_error(fmt::format("MTU of {} is too large for AF_XDP: {}", _ifname, ifr.ifr_mtu));
+    }
+    _hw_features.mtu = ifr.ifr_mtu;
+}
+
+void device::setup_queues() {
+    ethtool_channels channels = {};
+    channels.cmd = ETHTOOL_GCHANNELS;
+    uint32_t nr_hw_queues = 1;
+    if (ethtool_ioctl(_ifname, &channels) == 0) {
+        nr_hw_queues = std::max({channels.combined_count, channels.rx_count, 1u});
+    }
+    _nr_queues = std::min<uint32_t>(nr_hw_queues, smp::count);
+
+    // Learn the RSS configuration, so that connections are opened from the
+    // shard their packets will arrive on
+    ethtool_rxfh rxfh = {};
+    rxfh.cmd = ETHTOOL_GRSSH;
+    if (ethtool_ioctl(_ifname, &rxfh) != 0) {
+        xdp_log.info("{}: can't read the RSS configuration, using a single queue", _ifname);
+        _nr_queues = 1;
+        return;
+    }
+    std::vector<char> buf(sizeof(ethtool_rxfh) + rxfh.indir_size * sizeof(uint32_t) + rxfh.key_size);
+    auto* full = reinterpret_cast<ethtool_rxfh*>(buf.data());
+    *full = rxfh;
+    if (ethtool_ioctl(_ifname, full) != 0 || !(full->hfunc & rss_hash_toeplitz)) {
+        xdp_log.info("{}: RSS is not Toeplitz based, using a single queue", _ifname);
+        _nr_queues = 1;
+        return;
+    }
+    _redir_table.assign(full->rss_config, full->rss_config + full->indir_size);
+    auto* key = reinterpret_cast<const uint8_t*>(full->rss_config + full->indir_size);
+    _rss_key.assign(key, key + full->key_size);
+
+    // Packets steered to queues without a socket would go to the kernel
+    // instead, so spread the table over our queues only
+    bool needs_update = std::any_of(_redir_table.begin(), _redir_table.end(), [this] (uint32_t q) {
+        return q >= _nr_queues;
+    });
+    if (needs_update && !_redir_table.empty()) {
+        auto saved = _redir_table;
+        std::vector<char> sbuf(sizeof(ethtool_rxfh) + _redir_table.size() * sizeof(uint32_t));
+        auto* set = reinterpret_cast<ethtool_rxfh*>(sbuf.data());
+        set->cmd = ETHTOOL_SRSSH;
+        set->indir_size = _redir_table.size();
+        for (size_t i = 0; i < _redir_table.size(); i++) {
+            _redir_table[i] = set->rss_config[i] = i % _nr_queues;
+        }
+        if (ethtool_ioctl(_ifname, set) != 0) {
+            xdp_log.warn("{}: failed to restrict RSS to {} queues ({}), using a single queue", _ifname, _nr_queues, strerror(errno));
+            _nr_queues = 1;
+            _redir_table.clear();
+            return;
+        }
+        _saved_redir_table = std::move(saved);
+        xdp_log.info("{}: RSS restricted to queues 0-{}", _ifname, _nr_queues - 1);
+    }
+}
+
+// Gives the interface its RSS table back, or the kernel would keep steering
+// packets only to the queues we used after we're gone
+void device::restore_queues() noexcept {
+    if (_saved_redir_table.empty()) {
+        return;
+    }
+    std::vector<char> sbuf(sizeof(ethtool_rxfh) + _saved_redir_table.size() * sizeof(uint32_t));
+    auto* set = reinterpret_cast<ethtool_rxfh*>(sbuf.data());
+    set->cmd = ETHTOOL_SRSSH;
+    set->indir_size = _saved_redir_table.size();
+    std::copy(_saved_redir_table.begin(), _saved_redir_table.end(), set->rss_config);
+    if (ethtool_ioctl(_ifname, set) != 0) {
+        xdp_log.warn("{}: failed to restore the RSS table ({})", _ifname, strerror(errno));
+    } else {
+        xdp_log.info("{}: RSS table restored", _ifname);
+    }
+    _saved_redir_table.clear();
+}
+
+void device::attach_program() {
+    _xsk_map = bpf_create_map(BPF_MAP_TYPE_XSKMAP, sizeof(uint32_t), _nr_queues, "create XSK map");
+
+    // return bpf_redirect_map(&xsk_map, ctx->rx_queue_index, XDP_PASS);
+    //
+    // Queues without a socket, and packets arriving before the shards
+    // registered theirs, are passed to the kernel.
+    bpf_insn insns[] = {
+        // r2 = ctx->rx_queue_index
+        { BPF_LDX | BPF_MEM | BPF_W, 2, 1, int16_t(offsetof(xdp_md, rx_queue_index)), 0 },
+        // r1 = xsk_map
+        { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, _xsk_map->get() },
+        { 0, 0, 0, 0, 0 },
+        // r3 = XDP_PASS
+        { BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS },
+        { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+    };
+    _prog = bpf_load_program(BPF_PROG_TYPE_XDP, insns, std::size(insns), "load XDP program");
+
+    // The link detaches the program once the process is gone
+    union bpf_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = _prog->get();
+    attr.link_create.target_ifindex = _ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    _link = bpf_fd(BPF_LINK_CREATE, attr, "attach XDP program");
+    xdp_log.info("{}: attached, {} queue(s)", _ifname, _nr_queues);
+}
+
+void device::register_socket(uint32_t qid, int fd) {
+    uint32_t value = fd;
+    throw_system_error_on(bpf_update_elem(*_xsk_map, qid, value) == -1, "register XDP socket");
+}
+
+std::unique_ptr<net::qp> device::init_local_queue(const program_options::option_group& opts, uint16_t qid) {
+    return std::make_unique<qp>(*this, qid);
+}
+
+qp::qp(device& dev, uint16_t qid)
+    : net::qp(true, "network", qid)
+    , _dev(dev)
+    , _qid(qid)
+    , _fd(file_desc::socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0))
+    , _frame_size(dev.hw_features().mtu + eth_hdr_len + XDP_PACKET_HEADROOM > 2048 ? 4096 : 2048) {
+    auto ring_size = dev.ring_size();
+    // Fill and RX rings, TX ring, and as many for packets held by the stack
+    auto nr_frames = 4 * ring_size;
+    _copy_watermark = ring_size;
+    setup_umem(nr_frames);
+    bind();
+    refill();
+    dev.register_socket(_qid, _fd.get());
+}
+
+void qp::setup_umem(uint32_t nr_frames) {
+    size_t size = size_t(nr_frames) * _frame_size;
+    _umem = internal::allocate_dma_buffer<char>(4096, size);
+    xdp_umem_reg reg = {};
+    reg.addr = reinterpret_cast<uintptr_t>(_umem.get());
+    reg.len = size;
+    reg.chunk_size = _frame_size;
+    _fd.setsockopt(SOL_XDP, XDP_UMEM_REG, reg);
+    _free_frames.reserve(nr_frames);
+    for (uint32_t i = 0; i < nr_frames; i++) {
+        _free_frames.push_back(uint64_t(nr_frames - 1 - i) * _frame_size);
+    }
+
+    int ring_size = _dev.ring_size();
+    _fd.setsockopt(SOL_XDP, XDP_UMEM_FILL_RING, ring_size);
+    _fd.setsockopt(SOL_XDP, XDP_UMEM_COMPLETION_RING, ring_size);
+    _fd.setsockopt(SOL_XDP, XDP_RX_RING, ring_size);
+    _fd.setsockopt(SOL_XDP, XDP_TX_RING, ring_size);
+
+    auto off = _fd.getsockopt<xdp_mmap_offsets>(SOL_XDP, XDP_MMAP_OFFSETS);
+    _fill.map(_fd, off.fr, ring_size, XDP_UMEM_PGOFF_FILL_RING);
+    _comp.map(_fd, off.cr, ring_size, XDP_UMEM_PGOFF_COMPLETION_RING);
+    _rx.map(_fd, off.rx, ring_size, XDP_PGOFF_RX_RING);
+    _tx.map(_fd, off.tx, ring_size, XDP_PGOFF_TX_RING);
+}
+
+void qp::bind() {
+    sockaddr_xdp sxdp = {};
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = _dev.ifindex();
+    sxdp.sxdp_queue_id = _qid;
+    auto try_bind = [&] (uint16_t mode) {
+        sxdp.sxdp_flags = mode | XDP_USE_NEED_WAKEUP;
+        return ::bind(_fd.get(), reinterpret_cast<sockaddr*>(&sxdp), sizeof(sxdp));
+    };
+    auto mode = _dev.zero_copy_mode();
+    int r;
+    if (mode) {
+        r = try_bind(mode);
+    } else if ((r = try_bind(XDP_ZEROCOPY)) == 0) {
+        mode = XDP_ZEROCOPY;
+    } else {
+        mode = XDP_COPY;
+        r = try_bind(mode);
+    }
+    throw_system_error_on(r == -1, "bind AF_XDP socket");
+    _zero_copy = mode == XDP_ZEROCOPY;
+    xdp_log.debug("{} queue {}: bound in {} mode", _dev.ifname(), _qid, _zero_copy ? "zero-copy" : "copy");
+}
+
+bool qp::refill() {
+    auto n = std::min<size_t>(_fill.free_entries(), _free_frames.size());
+    auto idx = *_fill.producer;
+    for (size_t i = 0; i < n; i++) {
+        _fill[idx++] = _free_frames.back();
+        _free_frames.pop_back();
+    }
+    if (n) {
+        _fill.produce(n);
+    }
+    if (_fill.needs_wakeup()) {
+        ::recvfrom(_fd.get(), nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+    }
+    return n;
+}
+
+bool qp::reap_completions() {
+    auto n = _comp.ready_entries();
+    auto idx = *_comp.consumer;
+    for (uint32_t i = 0; i < n; i++) {
+        recycle(_comp[idx++]);
+    }
+    if (n) {
+        _comp.consume(n);
+    }
+    return n;
+}
+
+bool qp::poll_rx() {
+    bool work = reap_completions();
+    auto n = std::min(_rx.ready_entries(), rx_batch);
+    auto idx = *_rx.consumer;
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        auto desc = _rx[idx++];
+        auto data = frame(desc.addr);
+        bytes += desc.len;
+        if (_free_frames.size() < _copy_watermark) {
+            _stats.rx.good.update_copy_stats(1, desc.len);
+            packet p(fragment{data, desc.len});
+            recycle(desc.addr);
+            _dev.l2receive(std::move(p));
+        } else {
+            _dev.l2receive(packet(fragment{data, desc.len}, make_deleter([this, addr = desc.addr] {
+                recycle(addr);
+            })));
+        }
+    }
+    if (n) {
+        _rx.consume(n);
+        _stats.rx.good.update_pkts_bunch(n);
+        _stats.rx.good.update_frags_stats(n, bytes);
+        work = true;
+    }
+    return refill() || work;
+}
+
+void qp::rx_start() {
+    _rx_poller = reactor::poller::simple([this] { return poll_rx(); });
+}
+
+void qp::kick_tx() {
+    if (_tx.needs_wakeup()) {
+        ::sendto(_fd.get(), nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+    }
+}
+
+uint32_t qp::send(circular_buffer<packet>& pb) {
+    reap_completions();
+    auto n = std::min<size_t>({pb.size(), _tx.free_entries(), _free_frames.size()});
+    auto idx = *_tx.producer;
+    uint32_t sent = 0;
+    uint64_t bytes = 0;
+    uint64_t nr_frags = 0;
+    for (size_t i = 0; i < n; i++) {
+        auto p = std::move(pb.front());
+        pb.pop_front();
+        if (p.len() > _frame_size - XDP_PACKET_HEADROOM) {
+            // Can't happen without offloads, the stack respects the MTU
+            continue;
+        }
+        // TX frames must live in the UMEM
+        auto addr = _free_frames.back();
+        _free_frames.pop_back();
+        auto dst = frame(addr);
+        for (auto& f : p.fragments()) {
+            dst = std::copy_n(f.base, f.size, dst);
+        }
+        auto& desc = _tx[idx++];
+        desc.addr = addr;
+        desc.len = p.len();
+        desc.options = 0;
+        bytes += p.len();
+        nr_frags += p.nr_frags();
+        sent++;
+    }
+    if (sent) {
+        _tx.produce(sent);
+        kick_tx();
+        _stats.tx.good.update_pkts_bunch(sent);
+        _stats.tx.good.update_frags_stats(nr_frags, bytes);
+        _stats.tx.good.update_copy_stats(nr_frags, bytes);
+    }
+    // Dropped packets are consumed as well
+    return n;
+}
+
+}
+
+net::xdp_options::xdp_options(program_options::option_group* parent_group)
+    : program_options::option_group(parent_group, "AF_XDP net options")
+    , xdp_interface(*this, "xdp-interface",
+                "",
+                "Network interface to attach to with AF_XDP (e.g. eth0)")
+    , xdp_zero_copy(*this, "xdp-zero-copy",
+                "auto",
+                "Use the driver's zero-copy mode (on / off / auto)")
+    , xdp_ring_size(*this, "xdp-ring-size",
+                2048,
+                "AF_XDP ring size (must be power-of-two)")
+{
+}
+
+std::unique_ptr<net::device> create_xdp_net_device(const xdp_options& opts) {
+    return std::make_unique<xdp::device>(opts);
+}
+
+}
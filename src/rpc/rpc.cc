@@ -4,6 +4,7 @@
 #include <seastar/core/print.hh>
 #include <seastar/core/future-util.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/net/stack.hh>
 #include <boost/range/adaptor/map.hpp>
 
 #if FMT_VERSION >= 90000
@@ -66,6 +67,43 @@ namespace rpc {
       }
   }
 
+  fragmented_buffer rcv_buf::share(size_t pos, size_t len) {
+      auto* one = std::get_if<temporary_buffer<char>>(&bufs);
+      if (one) {
+          return fragmented_buffer(one->share(pos, len));
+      }
+      std::vector<temporary_buffer<char>> fragments;
+      for (auto& b : std::get<std::vector<temporary_buffer<char>>>(bufs)) {
+          if (!len) {
+              break;
+          }
+          if (pos >= b.size()) {
+              pos -= b.size();
+              continue;
+          }
+          auto n = std::min(b.size() - pos, len);
+          fragments.push_back(b.share(pos, n));
+          len -= n;
+          pos = 0;
+      }
+      return fragmented_buffer(std::move(fragments));
+  }
+
+  temporary_buffer<char> fragmented_buffer::linearize() {
+      if (_fragments.empty()) {
+          return temporary_buffer<char>();
+      }
+      if (_fragments.size() == 1) {
+          return _fragments.front().share();
+      }
+      temporary_buffer<char> ret(_size);
+      auto p = ret.get_write();
+      for (auto& f : _fragments) {
+          p = std::copy_n(f.get(), f.size(), p);
+      }
+      return ret;
+  }
+
   // Make a copy of a remote buffer. No data is actually copied, only pointers and
   // a deleter of a new buffer takes care of deleting the original buffer
   template<typename T> // T is either snd_buf or rcv_buf
@@ -108,11 +146,176 @@ namespace rpc {
       c.get_logger()(c.peer_address(), level, std::string_view(formatted.data(), formatted.size()));
   }
 
-  snd_buf connection::compress(snd_buf buf) {
+  // Marks a frame sent as is on a compressed connection, in the size of
+  // its compression header. See protocol_features::UNCOMPRESSED_FRAMES.
+  static constexpr uint32_t uncompressed_frame_flag = uint32_t(1) << 31;
+
+  // Stream frames sizes with a special meaning, see
+  // protocol_features::STREAM_FLOW_CONTROL. The size of a frame holding
+  // several elements has its top bit set.
+  static constexpr uint32_t stream_eos_frame = -1U;
+  static constexpr uint32_t stream_credits_frame = -2U;
+  static constexpr uint32_t packed_stream_frame_flag = uint32_t(1) << 31;
+
+  bool adaptive_compression_policy::should_compress(std::optional<uint64_t> verb, size_t size) {
+      if (size < _cfg.min_size) {
+          return false;
+      }
+      if (!verb) {
+          return true;
+      }
+      auto& v = _verbs[*verb];
+      if (!v.incompressible) {
+          return true;
+      }
+      if (++v.skipped < _cfg.probe_interval) {
+          return false;
+      }
+      v.skipped = 0;
+      return true;
+  }
+
+  void adaptive_compression_policy::sample(std::optional<uint64_t> verb, size_t size, size_t compressed_size) {
+      if (!verb || !size) {
+          return;
+      }
+      auto it = _verbs.find(*verb);
+      if (it == _verbs.end()) {
+          return;
+      }
+      auto& v = it->second;
+      auto ratio = double(compressed_size) / size;
+      if (!v.sampled || v.incompressible) {
+          // A probe starts over, what the verb sends may have changed
+          v.ratio = ratio;
+          v.sampled = true;
+      } else {
+          v.ratio += (ratio - v.ratio) / 4;
+      }
+      v.incompressible = v.ratio > _cfg.max_ratio;
+  }
+
+  class verb_stats_domain {
+      sstring _group;
+      sstring _domain;
+      verb_stats_config _cfg;
+      std::unordered_set<uint64_t> _verbs;
+      std::unordered_set<sstring> _peers;
+      std::map<std::pair<sstring, sstring>, verb_stats_entry> _entries;
+      seastar::metrics::metric_groups _metric_groups;
+
+      static thread_local std::map<std::pair<sstring, sstring>, verb_stats_domain> all;
+
+      template <typename T>
+      sstring label_of(std::unordered_set<T>& seen, size_t max, T v, sstring label) {
+          if (seen.contains(v)) {
+              return label;
+          }
+          if (seen.size() < max) {
+              seen.insert(std::move(v));
+              return label;
+          }
+          return "other";
+      }
+      void add_metrics(verb_stats_entry& e, const sstring& verb, const sstring& peer) {
+          namespace sm = seastar::metrics;
+          std::vector<sm::label_instance> labels{sm::label("domain")(_domain), sm::label("verb")(verb)};
+          if (_cfg.max_peers) {
+              labels.push_back(sm::label("peer")(peer));
+          }
+          if (_group == "rpc_client") {
+              _metric_groups.add_group(_group, {
+                  sm::make_histogram("verb_latency", sm::description("Round trip time of requests"), labels,
+                          [&e] { return e.latency.to_metrics_histogram(); }).set_skip_when_empty(),
+                  sm::make_gauge("verb_in_flight", sm::description("Number of requests waiting for a reply"), labels,
+                          [&e] { return e.in_flight; }),
+              });
+          } else {
+              _metric_groups.add_group(_group, {
+                  sm::make_histogram("verb_latency", sm::description("Time from the start of the handler to the reply being sent"), labels,
+                          [&e] { return e.latency.to_metrics_histogram(); }).set_skip_when_empty(),
+                  sm::make_histogram("verb_queue_wait", sm::description("Time requests wait for resources before the handler starts"), labels,
+                          [&e] { return e.queue_wait.to_metrics_histogram(); }).set_skip_when_empty(),
+                  sm::make_gauge("verb_in_flight", sm::description("Number of requests received and not yet replied to"), labels,
+                          [&e] { return e.in_flight; }),
+              });
+          }
+      }
+  public:
+      verb_stats_domain(sstring group, sstring domain, const verb_stats_config& cfg)
+              : _group(std::move(group)), _domain(std::move(domain)), _cfg(cfg) {}
+
+      static verb_stats_domain& find_or_create(sstring group, sstring domain, const verb_stats_config& cfg) {
+          auto key = std::make_pair(group, domain);
+          return all.try_emplace(std::move(key), std::move(group), std::move(domain), cfg).first->second;
+      }
+
+      verb_stats_entry& find(uint64_t verb, const socket_address& peer) {
+          auto verb_label = label_of(_verbs, _cfg.max_verbs, verb, to_sstring(verb));
+          sstring peer_label;
+          if (_cfg.max_peers) {
+              auto p = format("{}", peer);
+              peer_label = label_of(_peers, _cfg.max_peers, p, p);
+          }
+          auto [it, inserted] = _entries.try_emplace(std::make_pair(verb_label, peer_label));
+          if (inserted) {
+              try {
+                  add_metrics(it->second, verb_label, peer_label);
+              } catch (...) {
+                  _entries.erase(it);
+                  throw;
+              }
+          }
+          return it->second;
+      }
+  };
+
+  thread_local std::map<std::pair<sstring, sstring>, verb_stats_domain> verb_stats_domain::all;
+
+  verb_stats_entry* connection::find_verb_stats(uint64_t verb) {
+      auto it = _verb_stats_entries.find(verb);
+      if (it == _verb_stats_entries.end()) {
+          it = _verb_stats_entries.emplace(verb, &_verb_stats->find(verb, peer_address())).first;
+      }
+      return it->second;
+  }
+
+  static snd_buf prepend_header(snd_buf buf, uint32_t value) {
+      temporary_buffer<char> header(4);
+      write_le<uint32_t>(header.get_write(), value);
+      std::vector<temporary_buffer<char>> bufs;
+      auto* b = std::get_if<temporary_buffer<char>>(&buf.bufs);
+      if (b) {
+          bufs.reserve(2);
+          bufs.push_back(std::move(header));
+          bufs.push_back(std::move(*b));
+      } else {
+          auto& ar = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+          bufs.reserve(ar.size() + 1);
+          bufs.push_back(std::move(header));
+          std::move(ar.begin(), ar.end(), std::back_inserter(bufs));
+      }
+      return snd_buf(std::move(bufs), buf.size + 4);
+  }
+
+  static snd_buf make_uncompressed_frame(snd_buf buf) {
+      auto size = buf.size;
+      return prepend_header(std::move(buf), size | uncompressed_frame_flag);
+  }
+
+  snd_buf connection::compress(snd_buf buf, std::optional<uint64_t> verb) {
       if (_compressor) {
+          // Empty frames carry messages between the compressors, they always go through them
+          if (_compression_policy && buf.size && !_compression_policy->should_compress(verb, buf.size)) {
+              return make_uncompressed_frame(std::move(buf));
+          }
+          auto size = buf.size;
           buf = _compressor->compress(4, std::move(buf));
           static_assert(snd_buf::chunk_size >= 4, "send buffer chunk size is too small");
           write_le<uint32_t>(buf.front().get_write(), buf.size - 4);
+          if (_compression_policy) {
+              _compression_policy->sample(verb, size, buf.size - 4);
+          }
           return buf;
       }
       return buf;
@@ -134,26 +337,110 @@ namespace rpc {
 
   future<> connection::send_entry(outgoing_entry& d) noexcept {
     return futurize_invoke([this, &d] {
+      if (d.flush_batch) {
+          return flush_batch();
+      }
+      if (d.stream_elements > 1) {
+          auto size = d.buf.size;
+          d.buf = prepend_header(std::move(d.buf), size | packed_stream_frame_flag);
+      }
       if (d.buf.size && _propagate_timeout) {
           static_assert(snd_buf::chunk_size >= sizeof(uint64_t), "send buffer chunk size is too small");
           if (_timeout_negotiated) {
               auto expire = d.t.get_timeout();
               uint64_t left = 0;
               if (expire != typename timer<rpc_clock_type>::time_point()) {
-                  left = std::chrono::duration_cast<std::chrono::milliseconds>(expire - timer<rpc_clock_type>::clock::now()).count();
+                  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(expire - timer<rpc_clock_type>::clock::now()).count();
+                  // 0 stands for no deadline, so an (almost) expired
+                  // request is sent with the shortest one
+                  left = std::max<int64_t>(ms, 1);
               }
-              write_le<uint64_t>(d.buf.front().get_write(), left);
+              // The target shard comes first with shard routing
+              write_le<uint64_t>(d.buf.front().get_write() + (_shard_routing ? sizeof(uint32_t) : 0), left);
           } else {
               d.buf.front().trim_front(sizeof(uint64_t));
               d.buf.size -= sizeof(uint64_t);
           }
       }
-      auto buf = compress(std::move(d.buf));
+      if (_batching && d.buf.size && d.buf.size <= _batching->max_frame_size) {
+          return add_to_batch(d);
+      }
+      auto send_frame = [this, &d] {
+          auto buf = compress(std::move(d.buf), d.verb);
+          return send_buffer(std::move(buf)).then([this] {
+              _stats.sent_messages++;
+              return _write_buf.flush();
+          });
+      };
+      if (!_batch.empty()) {
+          // The batch goes first, and compressors must see frames in order
+          return flush_batch().then(std::move(send_frame));
+      }
+      return send_frame();
+    });
+  }
+
+  void connection::enable_batching(const request_batching_config& cfg) {
+      _batching = cfg;
+      _batch_timer.set_callback([this] {
+          if (_error) {
+              return;
+          }
+          // Flushes once the frames queued before are sent
+          auto p = std::make_unique<outgoing_entry>(snd_buf());
+          p->flush_batch = true;
+          (void)enqueue(std::move(p), {}, nullptr).handle_exception([] (std::exception_ptr) {});
+      });
+  }
+
+  future<> connection::add_to_batch(outgoing_entry& d) {
+      auto buf = std::move(d.buf);
+      if (!_batch_compress_together) {
+          buf = compress(std::move(buf), d.verb);
+      }
+      d.batch_written = _batch_waiters.emplace_back().get_future();
+      _batch_size += buf.size;
+      auto* b = std::get_if<temporary_buffer<char>>(&buf.bufs);
+      if (b) {
+          _batch.push_back(std::move(*b));
+      } else {
+          auto& ar = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+          std::move(ar.begin(), ar.end(), std::back_inserter(_batch));
+      }
+      _stats.sent_messages++;
+      if (_batch_size >= _batching->max_bytes) {
+          return flush_batch();
+      }
+      if (!_batch_timer.armed()) {
+          _batch_timer.arm(_batching->max_delay);
+      }
+      return make_ready_future<>();
+  }
+
+  future<> connection::flush_batch() {
+      _batch_timer.cancel();
+      if (_batch.empty()) {
+          return make_ready_future<>();
+      }
+      snd_buf buf(std::exchange(_batch, {}), std::exchange(_batch_size, 0));
+      if (_batch_compress_together) {
+          buf = compress(std::move(buf));
+      }
       return send_buffer(std::move(buf)).then([this] {
-          _stats.sent_messages++;
           return _write_buf.flush();
+      }).then_wrapped([waiters = std::exchange(_batch_waiters, {})] (future<> f) mutable {
+          if (f.failed()) {
+              auto ex = f.get_exception();
+              for (auto& w : waiters) {
+                  w.set_exception(ex);
+              }
+              return make_exception_future<>(std::move(ex));
+          }
+          for (auto& w : waiters) {
+              w.set_value();
+          }
+          return make_ready_future<>();
       });
-    });
   }
 
   void connection::set_negotiated() noexcept {
@@ -169,6 +456,16 @@ namespace rpc {
       if (ex == nullptr) {
           ex = std::make_exception_ptr(closed_error());
       }
+      // The batch can't be written anymore
+      _batch_timer.cancel();
+      _batch.clear();
+      _batch_size = 0;
+      for (auto& w : std::exchange(_batch_waiters, {})) {
+          w.set_exception(ex);
+      }
+      if (_stream_credits) {
+          _stream_credits->broken(ex);
+      }
       while (!_outgoing_queue.empty()) {
           auto it = std::prev(_outgoing_queue.end());
           // Cancel all but front entry normally. The front entry is sitting in the
@@ -259,60 +556,67 @@ namespace rpc {
       }
   }
 
-  future<> connection::send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
+  future<> connection::send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel, std::optional<uint64_t> verb) {
       if (!_error) {
           if (timeout && *timeout <= rpc_clock_type::now()) {
               return make_ready_future<>();
           }
 
-          auto p = std::make_unique<outgoing_entry>(std::move(buf));
-          auto& d = *p;
-          _outgoing_queue.push_back(d);
-          _outgoing_queue_size++;
-          auto deleter = [this, it = _outgoing_queue.iterator_to(d)] {
-              // Front entry is most likely (unless _negotiated is unresolved, check enqueue_zero_frame()) sitting
-              // inside send_entry() continuations and thus it cannot be cancelled.
-              if (it != _outgoing_queue.begin()) {
-                  withdraw(it);
-              }
-          };
-
-          if (timeout) {
-              auto& t = d.t;
-              t.set_callback(deleter);
-              t.arm(timeout.value());
-          }
-          if (cancel) {
-              cancel->cancel_send = std::move(deleter);
-              cancel->send_back_pointer = &d.pcancel;
-              d.pcancel = cancel;
-          }
-
-          // New entry should continue (do its .then() lambda) after _outgoing_queue_ready
-          // resolves. Next entry will need to do the same after this entry's done resolves.
-          // Thus -- replace _outgoing_queue_ready with d's future and chain its continuation
-          // on ..._ready's old value.
-          return std::exchange(_outgoing_queue_ready, d.done.get_future()).then([this, p = std::move(p)] () mutable {
-              _outgoing_queue_size--;
-              if (__builtin_expect(!p->is_linked(), false)) {
-                  // If withdrawn the entry is unlinked and this lambda is fired right at once
-                  return make_ready_future<>();
-              }
-
-              p->uncancellable();
-              return send_entry(*p).then_wrapped([this, p = std::move(p)] (auto f) mutable {
-                  if (f.failed()) {
-                      f.ignore_ready_future();
-                      abort();
-                  }
-                  p->done.set_value();
-              });
-          });
+          return enqueue(std::make_unique<outgoing_entry>(std::move(buf), verb), timeout, cancel);
       } else {
           return make_exception_future<>(closed_error());
       }
   }
 
+  future<> connection::enqueue(std::unique_ptr<outgoing_entry> p, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
+      auto& d = *p;
+      _outgoing_queue.push_back(d);
+      _outgoing_queue_size++;
+      auto deleter = [this, it = _outgoing_queue.iterator_to(d)] {
+          // Front entry is most likely (unless _negotiated is unresolved, check enqueue_zero_frame()) sitting
+          // inside send_entry() continuations and thus it cannot be cancelled.
+          if (it != _outgoing_queue.begin()) {
+              withdraw(it);
+          }
+      };
+
+      if (timeout) {
+          auto& t = d.t;
+          t.set_callback(deleter);
+          t.arm(timeout.value());
+      }
+      if (cancel) {
+          cancel->cancel_send = std::move(deleter);
+          cancel->send_back_pointer = &d.pcancel;
+          d.pcancel = cancel;
+      }
+
+      // New entry should continue (do its .then() lambda) after _outgoing_queue_ready
+      // resolves. Next entry will need to do the same after this entry's done resolves.
+      // Thus -- replace _outgoing_queue_ready with d's future and chain its continuation
+      // on ..._ready's old value.
+      return std::exchange(_outgoing_queue_ready, d.done.get_future()).then([this, p = std::move(p)] () mutable {
+          _outgoing_queue_size--;
+          if (__builtin_expect(!p->is_linked(), false)) {
+              // If withdrawn the entry is unlinked and this lambda is fired right at once
+              return make_ready_future<>();
+          }
+
+          p->uncancellable();
+          return send_entry(*p).then_wrapped([this, p = std::move(p)] (auto f) mutable {
+              if (f.failed()) {
+                  f.ignore_ready_future();
+                  abort();
+              }
+              // A batched frame is sent once its batch is, but the next
+              // entries needn't wait for that
+              auto written = std::exchange(p->batch_written, std::nullopt);
+              p->done.set_value();
+              return written ? std::move(*written) : make_ready_future<>();
+          });
+      });
+  }
+
   void connection::abort() {
       if (!_error) {
           _error = true;
@@ -447,9 +751,37 @@ namespace rpc {
       });
   }
 
+  template<typename T>
+  static const std::optional<rcv_buf>& frame_data(const T& v) {
+      if constexpr (std::is_same_v<T, std::optional<rcv_buf>>) {
+          return v;
+      } else {
+          return std::get<std::tuple_size_v<T> - 1>(v);
+      }
+  }
+
+  template<typename FrameType>
+  future<typename FrameType::return_type>
+  connection::read_batched_frame(socket_address info) {
+      return read_frame<FrameType>(info, _batched_frames->in).then([this] (typename FrameType::return_type ret) {
+          auto& data = frame_data(ret);
+          // Stream frames mark the end of stream with a size of -1
+          size_t consumed = FrameType::header_size() + (data && data->size != -1U ? data->size : 0);
+          if (!data || consumed >= _batched_frames->left) {
+              _batched_frames.reset();
+          } else {
+              _batched_frames->left -= consumed;
+          }
+          return ret;
+      });
+  }
+
   template<typename FrameType>
   future<typename FrameType::return_type>
   connection::read_frame_compressed(socket_address info, std::unique_ptr<compressor>& compressor, input_stream<char>& in) {
+      if (_batched_frames) {
+          return read_batched_frame<FrameType>(info);
+      }
       if (compressor) {
           return in.read_exactly(4).then([this, info, &in, &compressor] (temporary_buffer<char> compress_header) {
               if (compress_header.size() != 4) {
@@ -460,12 +792,17 @@ namespace rpc {
               }
               auto ptr = compress_header.get();
               auto size = read_le<uint32_t>(ptr);
-              return read_rcv_buf(in, size).then([this, size, &compressor, info, &in] (rcv_buf compressed_data) {
+              // The frames follow as is
+              bool uncompressed = _uncompressed_frames && (size & uncompressed_frame_flag);
+              if (uncompressed) {
+                  size &= ~uncompressed_frame_flag;
+              }
+              return read_rcv_buf(in, size).then([this, size, uncompressed, &compressor, info, &in] (rcv_buf compressed_data) {
                   if (compressed_data.size != size) {
                       _logger(info, format("unexpected eof on a {} while reading compressed data: expected {:d} got {:d}", FrameType::role(), size, compressed_data.size));
                       return make_ready_future<typename FrameType::return_type>(FrameType::empty_value());
                   }
-                  auto eb = compressor->decompress(std::move(compressed_data));
+                  auto eb = uncompressed ? std::move(compressed_data) : compressor->decompress(std::move(compressed_data));
                   if (eb.size == 0) {
                       // Empty frames might be sent as means of communication between the compressors, and should be skipped by the RPC layer.
                       // We skip the empty frame here. We recursively restart the function, as if the empty frame didn't happen.
@@ -483,9 +820,9 @@ namespace rpc {
                           p = net::packet(std::move(p), std::move(b));
                       }
                   }
-                  return do_with(as_input_stream(std::move(p)), [this, info] (input_stream<char>& in) {
-                      return read_frame<FrameType>(info, in);
-                  });
+                  // A batch of requests may have been sent as a single frame
+                  _batched_frames.emplace(batched_frames{as_input_stream(std::move(p)), eb.size});
+                  return read_batched_frame<FrameType>(info);
               });
           });
       } else {
@@ -495,9 +832,10 @@ namespace rpc {
 
   struct stream_frame {
       using opt_buf_type = std::optional<rcv_buf>;
-      using return_type = opt_buf_type;
+      using return_type = std::tuple<stream_frame_type, opt_buf_type>;
       struct header_type {
           bool eos;
+          stream_frame_type type;
       };
       static size_t header_size() {
           return 4;
@@ -505,22 +843,29 @@ namespace rpc {
       static const char* role() {
           return "stream";
       }
-      static auto empty_value() {
-          return std::nullopt;
+      static return_type empty_value() {
+          return {stream_frame_type::data, std::nullopt};
       }
       static std::pair<uint32_t, header_type> decode_header(const char* ptr) {
           auto size = read_le<uint32_t>(ptr);
-          return size != -1U ? std::make_pair(size, header_type{false}) : std::make_pair(0U, header_type{true});
+          if (size == stream_eos_frame) {
+              return std::make_pair(0U, header_type{true, stream_frame_type::data});
+          } else if (size == stream_credits_frame) {
+              return std::make_pair(uint32_t(sizeof(uint32_t)), header_type{false, stream_frame_type::credits});
+          } else if (size & packed_stream_frame_flag) {
+              return std::make_pair(size & ~packed_stream_frame_flag, header_type{false, stream_frame_type::packed});
+          }
+          return std::make_pair(size, header_type{false, stream_frame_type::data});
       }
-      static auto make_value(const header_type& t, rcv_buf data) {
+      static return_type make_value(const header_type& t, rcv_buf data) {
           if (t.eos) {
               data.size = -1U;
           }
-          return data;
+          return {t.type, std::move(data)};
       }
   };
 
-  future<std::optional<rcv_buf>>
+  future<std::tuple<stream_frame_type, std::optional<rcv_buf>>>
   connection::read_stream_frame_compressed(input_stream<char>& in) {
       return read_frame_compressed<stream_frame>(peer_address(), _compressor, in);
   }
@@ -532,7 +877,10 @@ namespace rpc {
           _sink_closed_future = p.get_future();
           // stop_send_loop(), which also calls _write_buf.close(), and this code can run in parallel.
           // Use _sink_closed_future to serialize them and skip second call to close()
-          f = _write_buf.close().finally([p = std::move(p)] () mutable { p.set_value(true);});
+          // Credits being returned are written first
+          f = std::exchange(_stream_credits_returned, make_ready_future<>()).then([this] {
+              return _write_buf.close();
+          }).finally([p = std::move(p)] () mutable { p.set_value(true);});
       }
       return f.finally([this] () mutable { return stop(); });
   }
@@ -540,33 +888,199 @@ namespace rpc {
   future<> connection::stream_process_incoming(rcv_buf&& buf) {
       // we do not want to dead lock on huge packets, so let them in
       // but only one at a time
-      auto size = std::min(size_t(buf.size), max_stream_buffers_memory);
+      auto size = std::min(size_t(buf.size), _stream_window ? _stream_window : max_stream_buffers_memory);
       return get_units(_stream_sem, size).then([this, buf = std::move(buf)] (semaphore_units<>&& su) mutable {
           buf.su = std::move(su);
           return _stream_queue.push_eventually(std::move(buf));
       });
   }
 
+  // Splits a frame holding several stream elements, each one being
+  //   le32 payload size
+  //   ...  payload
+  static std::vector<rcv_buf> unpack_stream_frame(rcv_buf buf) {
+      std::vector<temporary_buffer<char>> frags;
+      if (auto* one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+          frags.push_back(std::move(*one));
+      } else {
+          frags = std::move(std::get<std::vector<temporary_buffer<char>>>(buf.bufs));
+      }
+      auto it = frags.begin();
+      auto skip_empty = [&] {
+          while (it != frags.end() && it->empty()) {
+              ++it;
+          }
+      };
+      auto take = [&] (size_t size) {
+          std::vector<temporary_buffer<char>> parts;
+          for (auto left = size; left;) {
+              skip_empty();
+              if (it == frags.end()) {
+                  throw std::runtime_error("Truncated packed stream frame");
+              }
+              auto n = std::min(left, it->size());
+              parts.push_back(it->share(0, n));
+              it->trim_front(n);
+              left -= n;
+          }
+          rcv_buf ret(size);
+          if (parts.size() == 1) {
+              ret.bufs = std::move(parts.front());
+          } else {
+              ret.bufs = std::move(parts);
+          }
+          return ret;
+      };
+      std::vector<rcv_buf> elements;
+      for (skip_empty(); it != frags.end(); skip_empty()) {
+          auto header = take(sizeof(uint32_t));
+          uint32_t size;
+          make_deserializer_stream(header).read(reinterpret_cast<char*>(&size), sizeof(size));
+          elements.push_back(take(le_to_cpu(size)));
+      }
+      return elements;
+  }
+
   future<> connection::handle_stream_frame() {
-      return read_stream_frame_compressed(_read_buf).then([this] (std::optional<rcv_buf> data) {
+      return read_stream_frame_compressed(_read_buf).then([this] (std::tuple<stream_frame_type, std::optional<rcv_buf>> frame) {
+          auto type = std::get<0>(frame);
+          auto& data = std::get<1>(frame);
           if (!data) {
               _error = true;
               return make_ready_future<>();
           }
+          switch (type) {
+          case stream_frame_type::credits: {
+              uint32_t credits;
+              make_deserializer_stream(*data).read(reinterpret_cast<char*>(&credits), sizeof(credits));
+              if (_stream_credits) {
+                  _stream_credits->signal(le_to_cpu(credits));
+              }
+              return make_ready_future<>();
+          }
+          case stream_frame_type::packed:
+              return do_with(unpack_stream_frame(std::move(*data)), [this] (std::vector<rcv_buf>& elements) {
+                  return do_for_each(elements, [this] (rcv_buf& element) {
+                      return stream_process_incoming(std::move(element));
+                  });
+              });
+          case stream_frame_type::data:
+              break;
+          }
           return stream_process_incoming(std::move(*data));
       });
   }
 
+  void connection::enable_stream_flow_control(const stream_flow_control_config& cfg, const sstring& peer_window) {
+      if (peer_window.size() != sizeof(uint32_t)) {
+          throw std::runtime_error("Malformed stream flow control feature");
+      }
+      auto p = peer_window.c_str();
+      _stream_peer_window = read_le<uint32_t>(p);
+      if (!_stream_peer_window) {
+          throw std::runtime_error("Peer advertised an empty stream window");
+      }
+      _stream_credits.emplace(_stream_peer_window);
+      _stream_window = std::clamp<size_t>(cfg.window, 1, std::numeric_limits<uint32_t>::max());
+      _stream_max_packed = cfg.max_packed_size;
+      // The peer doesn't send more than the window, every element
+      // accounting for its size header at least
+      if (_stream_window > max_stream_buffers_memory) {
+          _stream_sem.signal(_stream_window - max_stream_buffers_memory);
+      } else {
+          _stream_sem.consume(max_stream_buffers_memory - _stream_window);
+      }
+      _stream_queue.set_max_size(std::max(max_queued_stream_buffers, _stream_window / sizeof(uint32_t)));
+  }
+
+  static sstring serialize_stream_window(size_t window) {
+      sstring p = uninitialized_string(sizeof(uint32_t));
+      auto c = p.data();
+      write_le(c, uint32_t(std::clamp<size_t>(window, 1, std::numeric_limits<uint32_t>::max())));
+      return p;
+  }
+
+  future<> connection::stream_send(snd_buf buf) {
+      if (!_stream_credits) {
+          return send(std::move(buf));
+      }
+      auto credits = std::min(size_t(buf.size), _stream_peer_window);
+      promise<> queued;
+      return std::exchange(_stream_queued, queued.get_future()).then([this, credits] {
+          return _stream_credits->wait(credits);
+      }).then_wrapped([this, buf = std::move(buf), queued = std::move(queued)] (future<> f) mutable {
+          queued.set_value();
+          if (f.failed()) {
+              return f;
+          }
+          return send_stream_element(std::move(buf));
+      });
+  }
+
+  future<> connection::send_stream_element(snd_buf buf) {
+      if (_error) {
+          return make_exception_future<>(closed_error());
+      }
+      if (_stream_max_packed && !_outgoing_queue.empty()) {
+          // The front entry may be being written already
+          auto& last = _outgoing_queue.back();
+          if (&last != &_outgoing_queue.front() && last.stream_elements && last.buf.size + buf.size <= _stream_max_packed) {
+              std::vector<temporary_buffer<char>> bufs;
+              for (auto* b : {&last.buf, &buf}) {
+                  if (auto* one = std::get_if<temporary_buffer<char>>(&b->bufs)) {
+                      bufs.push_back(std::move(*one));
+                  } else {
+                      auto& ar = std::get<std::vector<temporary_buffer<char>>>(b->bufs);
+                      std::move(ar.begin(), ar.end(), std::back_inserter(bufs));
+                  }
+              }
+              last.buf = snd_buf(std::move(bufs), last.buf.size + buf.size);
+              last.stream_elements++;
+              // Completes along with the first element of the frame
+              return make_ready_future<>();
+          }
+      }
+      auto p = std::make_unique<outgoing_entry>(std::move(buf));
+      p->stream_elements = _stream_max_packed ? 1 : 0;
+      return enqueue(std::move(p), {}, nullptr);
+  }
+
+  void connection::return_stream_credits(size_t bytes) {
+      _stream_unreturned += bytes;
+      if (_stream_unreturned < _stream_window / 2) {
+          return;
+      }
+      _stream_credits_returned = _stream_credits_returned.then([this] {
+          auto credits = std::exchange(_stream_unreturned, 0);
+          if (!credits || _error) {
+              return make_ready_future<>();
+          }
+          snd_buf data(2 * sizeof(uint32_t));
+          auto p = data.front().get_write();
+          write_le<uint32_t>(p, stream_credits_frame);
+          write_le<uint32_t>(p + sizeof(uint32_t), credits);
+          return send(std::move(data));
+      }).handle_exception([] (std::exception_ptr) {
+          // The connection is going down
+      });
+  }
+
   future<> connection::stream_receive(circular_buffer<foreign_ptr<std::unique_ptr<rcv_buf>>>& bufs) {
       return _stream_queue.not_empty().then([this, &bufs] {
-          bool eof = !_stream_queue.consume([&bufs] (rcv_buf&& b) {
+          size_t consumed = 0;
+          bool eof = !_stream_queue.consume([this, &bufs, &consumed] (rcv_buf&& b) {
               if (b.size == -1U) { // max fragment length marks an end of a stream
                   return false;
               } else {
+                  // Elements are accounted as the sender does, see stream_send()
+                  consumed += std::min(size_t(b.size) + sizeof(uint32_t), _stream_window);
                   bufs.push_back(make_foreign(std::make_unique<rcv_buf>(std::move(b))));
                   return true;
               }
           });
+          if (_stream_window && consumed) {
+              return_stream_credits(consumed);
+          }
           if (eof && !bufs.empty()) {
               assert(_stream_queue.empty());
               _stream_queue.push(rcv_buf(-1U)); // push eof marker back for next read to notice it
@@ -587,6 +1101,7 @@ namespace rpc {
   }
 
   // The request frame is
+  //   le32 optional target shard (see request_frame_with_shard below)
   //   le64 optional timeout (see request_frame_with_timeout below)
   //   le64 message type a.k.a. verb ID
   //   le64 message ID
@@ -594,8 +1109,8 @@ namespace rpc {
   //   ...  payload
   struct request_frame {
       using opt_buf_type = std::optional<rcv_buf>;
-      using return_type = std::tuple<std::optional<uint64_t>, uint64_t, int64_t, opt_buf_type>;
-      using header_type = std::tuple<std::optional<uint64_t>, uint64_t, int64_t>;
+      using return_type = std::tuple<std::optional<uint64_t>, uint64_t, int64_t, std::optional<uint32_t>, opt_buf_type>;
+      using header_type = std::tuple<std::optional<uint64_t>, uint64_t, int64_t, std::optional<uint32_t>>;
       static constexpr size_t raw_header_size = sizeof(uint64_t) + sizeof(int64_t) + sizeof(uint32_t);
       static size_t header_size() {
           static_assert(request_frame_headroom >= raw_header_size);
@@ -605,13 +1120,13 @@ namespace rpc {
           return "server";
       }
       static auto empty_value() {
-          return std::make_tuple(std::nullopt, uint64_t(0), 0, std::nullopt);
+          return std::make_tuple(std::nullopt, uint64_t(0), 0, std::nullopt, std::nullopt);
       }
       static std::pair<size_t, header_type> decode_header(const char* ptr) {
           auto type = read_le<uint64_t>(ptr);
           auto msgid = read_le<int64_t>(ptr + 8);
           auto size = read_le<uint32_t>(ptr + 16);
-          return std::make_pair(size, std::make_tuple(std::nullopt, type, msgid));
+          return std::make_pair(size, std::make_tuple(std::nullopt, type, msgid, std::nullopt));
       }
       static void encode_header(uint64_t type, int64_t msg_id, snd_buf& buf, size_t off) {
           auto p = buf.front().get_write() + off;
@@ -620,7 +1135,7 @@ namespace rpc {
           write_le<uint32_t>(p + 16, buf.size - raw_header_size - off);
       }
       static auto make_value(const header_type& t, rcv_buf data) {
-          return std::make_tuple(std::get<0>(t), std::get<1>(t), std::get<2>(t), std::move(data));
+          return std::make_tuple(std::get<0>(t), std::get<1>(t), std::get<2>(t), std::get<3>(t), std::move(data));
       }
   };
 
@@ -637,16 +1152,131 @@ namespace rpc {
           std::get<0>(h.second) = read_le<uint64_t>(ptr);
           return h;
       }
-      static void encode_header(uint64_t type, int64_t msg_id, snd_buf& buf) {
+      static void encode_header(uint64_t type, int64_t msg_id, snd_buf& buf, size_t off = 0) {
           static_assert(snd_buf::chunk_size >= raw_header_size, "send buffer chunk size is too small");
           // expiration timer is encoded later
-          request_frame::encode_header(type, msg_id, buf, 8);
+          request_frame::encode_header(type, msg_id, buf, off + 8);
       }
   };
 
-  future<> client::request(uint64_t type, int64_t msg_id, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
-      request_frame_with_timeout::encode_header(type, msg_id, buf);
-      return send(std::move(buf), timeout, cancel);
+  // This frame is used if protocol_features.SHARD_ROUTING was negotiated,
+  // which requires TIMEOUT
+  struct request_frame_with_shard : request_frame_with_timeout {
+      using super = request_frame_with_timeout;
+      // Handled by the shard that received the request
+      static constexpr uint32_t any_shard = std::numeric_limits<uint32_t>::max();
+      static constexpr size_t raw_header_size = sizeof(uint32_t) + super::raw_header_size;
+      static size_t header_size() {
+          static_assert(request_frame_headroom >= raw_header_size);
+          return raw_header_size;
+      }
+      static std::pair<uint32_t, typename request_frame::header_type> decode_header(const char* ptr) {
+          auto h = super::decode_header(ptr + 4);
+          auto shard = read_le<uint32_t>(ptr);
+          if (shard != any_shard) {
+              std::get<3>(h.second) = shard;
+          }
+          return h;
+      }
+      static void encode_header(std::optional<unsigned> shard, uint64_t type, int64_t msg_id, snd_buf& buf) {
+          write_le<uint32_t>(buf.front().get_write(), shard.value_or(any_shard));
+          super::encode_header(type, msg_id, buf, 4);
+      }
+  };
+
+  future<> client::request(uint64_t type, int64_t msg_id, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel,
+          std::optional<unsigned> shard, bool one_way) {
+      if (_shared) {
+          forward_request(type, msg_id, std::move(buf), timeout, shard, one_way);
+          return make_ready_future<>();
+      }
+      if (_options.shard_routing) {
+          request_frame_with_shard::encode_header(shard, type, msg_id, buf);
+      } else {
+          if (shard) {
+              return make_exception_future<>(std::logic_error("RPC client doesn't route requests to shards"));
+          }
+          // The target shard is only sent with shard routing
+          buf.front().trim_front(sizeof(uint32_t));
+          buf.size -= sizeof(uint32_t);
+          request_frame_with_timeout::encode_header(type, msg_id, buf);
+      }
+      return send(std::move(buf), timeout, cancel, type);
+  }
+
+  void client::forwarding_handler::operator()(client&, id_type msg_id, rcv_buf data) {
+      done = true;
+      p.set_value(forwarded_reply{msg_id < 0, make_foreign(std::make_unique<rcv_buf>(std::move(data)))});
+  }
+
+  void client::forwarding_handler::timeout() {
+      done = true;
+      p.set_exception(timeout_error());
+  }
+
+  client::forwarding_handler::~forwarding_handler() {
+      if (!done) {
+          p.set_exception(closed_error());
+      }
+  }
+
+  // Runs on the shard of the shared client
+  future<client::forwarded_reply> client::forward(uint64_t type, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, std::optional<unsigned> shard, bool one_way) {
+      if (_error) {
+          return make_exception_future<forwarded_reply>(closed_error());
+      }
+      auto msg_id = next_message_id();
+      auto f = request(type, msg_id, std::move(buf), timeout, nullptr, shard);
+      if (one_way) {
+          return f.then([] {
+              return forwarded_reply{};
+          });
+      }
+      // As in send_helper, the reply (or its absence) tells the outcome
+      (void)f.handle_exception([] (std::exception_ptr) {});
+      auto h = std::make_unique<forwarding_handler>();
+      auto reply = h->p.get_future();
+      wait_for_reply(msg_id, std::move(h), timeout, nullptr);
+      return reply;
+  }
+
+  void client::forward_request(uint64_t type, int64_t msg_id, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, std::optional<unsigned> shard, bool one_way) {
+      _stats.sent_messages++;
+      // Replies, timeouts and cancellation are handled here, so that the
+      // caller doesn't wait for the other shard, which may outlive this
+      // client
+      (void)smp::submit_to(_shared.get_owner_shard(), [c = _shared.get(), type, timeout, shard, one_way, buf = make_foreign(std::make_unique<snd_buf>(std::move(buf)))] () mutable {
+          return c->forward(type, make_shard_local_buffer_copy(std::move(buf)), timeout, shard, one_way);
+      }).then_wrapped([w = weak_from_this(), msg_id] (future<forwarded_reply> f) {
+          if (!w) {
+              f.ignore_ready_future();
+              return;
+          }
+          w->handle_forwarded_reply(msg_id, std::move(f));
+      });
+  }
+
+  void client::handle_forwarded_reply(id_type msg_id, future<forwarded_reply> f) {
+      auto it = _outstanding.find(msg_id);
+      if (it == _outstanding.end()) {
+          // One way, timed out or cancelled
+          f.ignore_ready_future();
+          return;
+      }
+      try {
+          auto r = f.get();
+          auto handler = std::move(it->second);
+          _outstanding.erase(it);
+          (*handler)(*this, r.exception ? -msg_id : msg_id, make_shard_local_buffer_copy(std::move(r.data)));
+      } catch (timeout_error&) {
+          wait_timed_out(msg_id);
+      } catch (closed_error&) {
+          // The shared connection is gone, the waiter gets closed_error too
+          _error = true;
+          _outstanding.erase(msg_id);
+      } catch (...) {
+          _outstanding.erase(msg_id);
+      }
   }
 
   void
@@ -667,6 +1297,25 @@ namespace rpc {
           case protocol_features::TIMEOUT:
               _timeout_negotiated = true;
               break;
+          case protocol_features::UNCOMPRESSED_FRAMES:
+              if (_compressor) {
+                  _uncompressed_frames = true;
+                  if (_options.adaptive_compression) {
+                      _compression_policy.emplace(*_options.adaptive_compression);
+                  }
+              }
+              break;
+          case protocol_features::BATCHED_FRAMES:
+              _batch_compress_together = _compressor != nullptr;
+              break;
+          case protocol_features::STREAM_FLOW_CONTROL:
+              if (_options.stream_flow_control) {
+                  enable_stream_flow_control(*_options.stream_flow_control, e.second);
+              }
+              break;
+          case protocol_features::SHARD_ROUTING:
+              _shard_routing = _options.shard_routing;
+              break;
           case protocol_features::CONNECTION_ID: {
               _id = deserialize_connection_id(e.second);
               break;
@@ -676,6 +1325,10 @@ namespace rpc {
               ;
           }
       }
+      if (_options.shard_routing && !_shard_routing) {
+          // Requests are already encoded with their target shard
+          throw std::runtime_error("RPC server doesn't support shard routing");
+      }
   }
 
   future<> client::negotiate_protocol(feature_map features) {
@@ -736,8 +1389,9 @@ namespace rpc {
 
   void client::wait_for_reply(id_type id, std::unique_ptr<reply_handler_base>&& h, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
       if (timeout) {
-          h->t.set_callback(std::bind(std::mem_fn(&client::wait_timed_out), this, id));
-          h->t.arm(timeout.value());
+          h->owner = this;
+          h->id = id;
+          internal::deadline_queue<rpc_clock_type>::local().add(*h, timeout.value());
       }
       if (cancel) {
           cancel->cancel_wait = [this, id] {
@@ -757,6 +1411,12 @@ namespace rpc {
 
   future<> client::stop() noexcept {
       _error = true;
+      if (_shared) {
+          // Replies still on their way find the client gone, see forward_request()
+          _outstanding.clear();
+          _stopped.set_value();
+          return _stopped.get_future();
+      }
       try {
           _socket.shutdown();
       } catch(...) {
@@ -873,9 +1533,24 @@ namespace rpc {
   }
 
   client::client(const logger& l, void* s, client_options ops, socket socket, const socket_address& addr, const socket_address& local)
+  : client(l, s, std::move(ops), std::move(socket), addr, local, nullptr)
+  {}
+
+  client::client(const logger& l, void* s, client_options options, net::srv_balancer::lease endpoint, const socket_address& local)
+  : client(l, s, std::move(options), make_socket(), endpoint.address(), local, &endpoint)
+  {}
+
+  client::client(const logger& l, void* s, client_options ops, socket socket, const socket_address& addr, const socket_address& local,
+          net::srv_balancer::lease* endpoint)
   : rpc::connection(l, s), _socket(std::move(socket)), _server_addr(addr), _local_addr(local), _options(ops), _metrics(*this)
   {
+      if (endpoint) {
+          _endpoint = std::move(*endpoint);
+      }
        _socket.set_reuseaddr(ops.reuseaddr);
+      if (ops.verb_stats) {
+          _verb_stats = &verb_stats_domain::find_or_create("rpc_client", ops.metrics_domain, *ops.verb_stats);
+      }
       // Run client in the background.
       // Communicate result via _stopped.
       // The caller has to call client::stop() to synchronize.
@@ -890,20 +1565,36 @@ namespace rpc {
           feature_map features;
           if (_options.compressor_factory) {
               features[protocol_features::COMPRESS] = _options.compressor_factory->supported();
+              features[protocol_features::UNCOMPRESSED_FRAMES] = "";
+              if (_options.batching && _options.batching->compress_together) {
+                  features[protocol_features::BATCHED_FRAMES] = "";
+              }
           }
           if (_options.send_timeout_data) {
               features[protocol_features::TIMEOUT] = "";
           }
           if (_options.stream_parent) {
               features[protocol_features::STREAM_PARENT] = serialize_connection_id(_options.stream_parent);
+              if (_options.stream_flow_control) {
+                  features[protocol_features::STREAM_FLOW_CONTROL] = serialize_stream_window(_options.stream_flow_control->window);
+              }
           }
           if (!_options.isolation_cookie.empty()) {
               features[protocol_features::ISOLATION] = _options.isolation_cookie;
           }
+          if (_options.shard_routing) {
+              features[protocol_features::SHARD_ROUTING] = "";
+          }
 
           return negotiate_protocol(std::move(features)).then([this] {
               _propagate_timeout = !is_stream();
+              if (_options.batching) {
+                  enable_batching(*_options.batching);
+              }
               set_negotiated();
+              if (_endpoint) {
+                  _endpoint.complete(true);
+              }
               return do_until([this] { return _read_buf.eof() || _error; }, [this] () mutable {
                   if (is_stream()) {
                       return handle_stream_frame();
@@ -941,6 +1632,9 @@ namespace rpc {
           std::exception_ptr ep;
           if (f.failed()) {
               ep = f.get_exception();
+              if (_endpoint) {
+                  _endpoint.complete(false);
+              }
               if (_connected) {
                   if (is_stream()) {
                       log_exception(*this, log_level::error, "client stream connection dropped", ep);
@@ -974,6 +1668,16 @@ namespace rpc {
       enqueue_zero_frame();
   }
 
+  client::client(const logger& l, void* s, client_options options, foreign_ptr<shared_ptr<client>> shared)
+  : rpc::connection(l, s), _server_addr(shared->peer_address()), _options(std::move(options)), _shared(std::move(shared)), _metrics(*this)
+  {
+      _options.shard_routing = _shared->_options.shard_routing;
+      if (_options.verb_stats) {
+          _verb_stats = &verb_stats_domain::find_or_create("rpc_client", _options.metrics_domain, *_options.verb_stats);
+      }
+      set_negotiated();
+  }
+
   client::client(const logger& l, void* s, const socket_address& addr, const socket_address& local)
   : client(l, s, client_options{}, make_socket(), addr, local)
   {}
@@ -1008,6 +1712,38 @@ namespace rpc {
               _timeout_negotiated = true;
               ret[protocol_features::TIMEOUT] = "";
               break;
+          case protocol_features::UNCOMPRESSED_FRAMES:
+              // COMPRESS comes first, the map is ordered
+              if (_compressor) {
+                  _uncompressed_frames = true;
+                  if (get_server()._options.adaptive_compression) {
+                      _compression_policy.emplace(*get_server()._options.adaptive_compression);
+                  }
+                  ret[protocol_features::UNCOMPRESSED_FRAMES] = "";
+              }
+              break;
+          case protocol_features::BATCHED_FRAMES:
+              // Compressed frames holding several frames are always understood
+              if (_compressor) {
+                  ret[protocol_features::BATCHED_FRAMES] = "";
+              }
+              break;
+          case protocol_features::STREAM_FLOW_CONTROL:
+              // STREAM_PARENT comes first, the map is ordered
+              if (_is_stream && get_server()._options.stream_flow_control) {
+                  auto& cfg = *get_server()._options.stream_flow_control;
+                  enable_stream_flow_control(cfg, e.second);
+                  ret[protocol_features::STREAM_FLOW_CONTROL] = serialize_stream_window(cfg.window);
+              }
+              break;
+          case protocol_features::SHARD_ROUTING:
+              // TIMEOUT comes first, the map is ordered. The servers of the
+              // other shards are found by their streaming domain
+              if (_timeout_negotiated && get_server()._options.streaming_domain) {
+                  _shard_routing = true;
+                  ret[protocol_features::SHARD_ROUTING] = "";
+              }
+              break;
           case protocol_features::STREAM_PARENT: {
               if (!get_server()._options.streaming_domain) {
                   f = f.then([] {
@@ -1087,7 +1823,9 @@ namespace rpc {
 
   future<request_frame::return_type>
   server::connection::read_request_frame_compressed(input_stream<char>& in) {
-      if (_timeout_negotiated) {
+      if (_shard_routing) {
+          return read_frame_compressed<request_frame_with_shard>(_info.addr, _compressor, in);
+      } else if (_timeout_negotiated) {
           return read_frame_compressed<request_frame_with_timeout>(_info.addr, _compressor, in);
       } else {
           return read_frame_compressed<request_frame>(_info.addr, _compressor, in);
@@ -1095,9 +1833,24 @@ namespace rpc {
   }
 
   future<>
-  server::connection::respond(int64_t msg_id, snd_buf&& data, std::optional<rpc_clock_type::time_point> timeout) {
+  server::connection::respond(int64_t msg_id, snd_buf&& data, std::optional<rpc_clock_type::time_point> timeout, std::optional<uint64_t> verb) {
+      if (_origin) {
+          // The origin connection, which received the request, sends the reply.
+          // It waits for the gate before it goes away, see stop_routing()
+          if (_routed_replies.is_closed()) {
+              return make_ready_future<>();
+          }
+          return with_gate(_routed_replies, [this, msg_id, timeout, verb, data = make_foreign(std::make_unique<snd_buf>(std::move(data)))] () mutable {
+              return smp::submit_to(_origin->get_connection_id().shard(), [origin = _origin, msg_id, timeout, verb, data = std::move(data)] () mutable {
+                  if (origin->error()) {
+                      return make_ready_future<>();
+                  }
+                  return origin->respond(msg_id, make_shard_local_buffer_copy(std::move(data)), timeout, verb);
+              });
+          });
+      }
       response_frame::encode_header(msg_id, data);
-      return send(std::move(data), timeout);
+      return send(std::move(data), timeout, nullptr, verb);
   }
 
 future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_type::time_point> timeout, int64_t msg_id, uint64_t type) {
@@ -1121,6 +1874,98 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
     });
 }
 
+future<> server::connection::send_exception_reply(std::optional<rpc_clock_type::time_point> timeout, int64_t msg_id, sstring what) {
+    uint32_t len = what.size();
+    auto size = response_frame_headroom + 2 * sizeof(uint32_t) + len;
+    return wait_for_resources(size, timeout).then([this, timeout, msg_id, size, len, what = std::move(what)] (auto permit) {
+        // Same as a USER exception thrown by a handler, see reply()
+        snd_buf data(size);
+        auto p = data.front().get_write() + response_frame_headroom;
+        write_le<uint32_t>(p, uint32_t(exception_type::USER));
+        write_le<uint32_t>(p + 4, len);
+        std::copy_n(what.data(), len, p + 8);
+        // Send asynchronously, as send_unknown_verb_reply() does
+        (void)try_with_gate(get_server()._reply_gate, [this, timeout, msg_id, data = std::move(data), permit = std::move(permit)] () mutable {
+            auto c = shared_from_this();
+            return respond(-msg_id, std::move(data), timeout).then([c = std::move(c), permit = std::move(permit)] {});
+        }).handle_exception([] (std::exception_ptr) {});
+    });
+}
+
+  future<> server::connection::dispatch_request(std::optional<rpc_clock_type::time_point> timeout, uint64_t type, int64_t msg_id, rcv_buf data) {
+      auto h = get_server()._proto.get_handler(type);
+      if (!h) {
+          return send_unknown_verb_reply(timeout, msg_id, type);
+      }
+
+      // If the new method of per-connection scheduling group was used, honor it.
+      // Otherwise, use the old per-handler scheduling group.
+      auto sg = _isolation_config ? _isolation_config->sched_group : h->handler.sg;
+      return with_scheduling_group(sg, [this, timeout, msg_id, &h = h->handler, data = std::move(data), guard = std::move(h->holder)] () mutable {
+          return h.func(shared_from_this(), timeout, msg_id, std::move(data), std::move(guard));
+      });
+  }
+
+  // Passes a request to the server of the streaming domain on the target
+  // shard, which handles it on a connection standing for this one. The
+  // request accounts for the resources of this server until its handler
+  // accepts it, so that it doesn't read requests faster than other shards
+  // handle them.
+  future<> server::connection::route_request(unsigned shard, std::optional<rpc_clock_type::time_point> timeout, uint64_t type, int64_t msg_id, rcv_buf data) {
+      if (shard >= smp::count) {
+          return send_exception_reply(timeout, msg_id, format("RPC server has no shard {:d}", shard));
+      }
+      auto memory_consumed = std::min(estimate_request_size(data.size), max_request_size());
+      auto f = wait_for_resources(memory_consumed, timeout).then([this, shard, timeout, type, msg_id, data = std::move(data)] (resource_permit permit) mutable {
+          if (_routed_to.empty()) {
+              _routed_to.resize(smp::count);
+          }
+          _routed_to[shard] = true;
+          (void)try_with_gate(_routed_requests, [this, shard, timeout, type, msg_id, data = std::move(data), permit = std::move(permit)] () mutable {
+              return smp::submit_to(shard, [this, domain = *get_server()._options.streaming_domain, timeout, type, msg_id, data = make_foreign(std::make_unique<rcv_buf>(std::move(data)))] () mutable {
+                  auto sit = _servers.find(domain);
+                  if (sit == _servers.end()) {
+                      throw std::runtime_error(format("Shard {:d} does not have server with streaming domain {}", this_shard_id(), domain));
+                  }
+                  auto c = sit->second->routed_connection(*this);
+                  return c->dispatch_request(timeout, type, msg_id, make_shard_local_buffer_copy(std::move(data)));
+              }).handle_exception([this, timeout, msg_id] (std::exception_ptr eptr) {
+                  return send_exception_reply(timeout, msg_id, format("{}", eptr)).handle_exception([] (std::exception_ptr) {});
+              }).finally([permit = std::move(permit)] {});
+          }).handle_exception_type([] (gate_closed_exception&) {/* ignore */});
+      });
+      if (timeout) {
+          f = f.handle_exception_type([this] (semaphore_timed_out&) {
+              get_stats_internal().expired++;
+          });
+      }
+      return f;
+  }
+
+  // Drops the connections standing for this one on the other shards, once
+  // the replies they send are through
+  future<> server::connection::stop_routing() {
+      return _routed_requests.close().then([this] {
+          return parallel_for_each(boost::irange(0u, unsigned(_routed_to.size())), [this] (unsigned shard) {
+              if (!_routed_to[shard]) {
+                  return make_ready_future<>();
+              }
+              return smp::submit_to(shard, [domain = *get_server()._options.streaming_domain, id = get_connection_id()] {
+                  auto sit = _servers.find(domain);
+                  return sit != _servers.end() ? sit->second->drop_routed_connection(id) : make_ready_future<>();
+              });
+          });
+      });
+  }
+
+  future<> server::connection::stop_routed() noexcept {
+      if (!_error) {
+          _error = true;
+          _abort_source.request_abort_ex(closed_error());
+      }
+      return _routed_replies.is_closed() ? make_ready_future<>() : _routed_replies.close();
+  }
+
   future<> server::connection::process() {
       return negotiate_protocol().then([this] () mutable {
         auto sg = _isolation_config ? _isolation_config->sched_group : current_scheduling_group();
@@ -1134,7 +1979,8 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
                   auto& expire = std::get<0>(header_and_buffer);
                   auto& type = std::get<1>(header_and_buffer);
                   auto& msg_id = std::get<2>(header_and_buffer);
-                  auto& data = std::get<3>(header_and_buffer);
+                  auto& shard = std::get<3>(header_and_buffer);
+                  auto& data = std::get<4>(header_and_buffer);
                   if (!data) {
                       _error = true;
                       return make_ready_future<>();
@@ -1143,17 +1989,10 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
                       if (expire && *expire) {
                           timeout = relative_timeout_to_absolute(std::chrono::milliseconds(*expire));
                       }
-                      auto h = get_server()._proto.get_handler(type);
-                      if (!h) {
-                          return send_unknown_verb_reply(timeout, msg_id, type);
+                      if (shard && *shard != this_shard_id()) {
+                          return route_request(*shard, timeout, type, msg_id, std::move(data.value()));
                       }
-
-                      // If the new method of per-connection scheduling group was used, honor it.
-                      // Otherwise, use the old per-handler scheduling group.
-                      auto sg = _isolation_config ? _isolation_config->sched_group : h->handler.sg;
-                      return with_scheduling_group(sg, [this, timeout, msg_id, &h = h->handler, data = std::move(data.value()), guard = std::move(h->holder)] () mutable {
-                          return h.func(shared_from_this(), timeout, msg_id, std::move(data), std::move(guard));
-                      });
+                      return dispatch_request(timeout, type, msg_id, std::move(data.value()));
                   }
               });
           });
@@ -1168,7 +2007,11 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
           _fd.shutdown_input();
           _error = true;
           _stream_queue.abort(std::make_exception_ptr(stream_closed()));
+          _abort_source.request_abort_ex(closed_error());
           return stop_send_loop(ep).then_wrapped([this] (future<> f) {
+              f.ignore_ready_future();
+              return stop_routing();
+          }).then_wrapped([this] (future<> f) {
               f.ignore_ready_future();
               get_server()._conns.erase(get_connection_id());
               if (is_stream()) {
@@ -1189,6 +2032,21 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
   server::connection::connection(server& s, connected_socket&& fd, socket_address&& addr, const logger& l, void* serializer, connection_id id)
           : rpc::connection(std::move(fd), l, serializer, id)
           , _info{.addr{std::move(addr)}, .server{s}, .conn_id{id}} {
+      if (s._options.verb_stats) {
+          _verb_stats = &verb_stats_domain::find_or_create("rpc_server", s._options.metrics_domain, *s._options.verb_stats);
+      }
+  }
+
+  server::connection::connection(server& s, connection& origin, const logger& l, void* serializer)
+          : rpc::connection(l, serializer, origin.get_connection_id())
+          , _info{.addr{origin._info.addr}, .server{s}, .conn_id{origin._info.conn_id}}
+          , _isolation_config(origin._isolation_config)
+          , _origin(&origin) {
+      if (s._options.verb_stats) {
+          _verb_stats = &verb_stats_domain::find_or_create("rpc_server", s._options.metrics_domain, *s._options.verb_stats);
+      }
+      // There's no socket, replies go through the origin
+      set_negotiated();
   }
 
   future<> server::connection::deregister_this_stream() {
@@ -1274,6 +2132,25 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
       });
   }
 
+  shared_ptr<server::connection> server::routed_connection(connection& origin) {
+      auto id = origin.get_connection_id();
+      auto it = _routed_conns.find(id);
+      if (it == _routed_conns.end()) {
+          it = _routed_conns.emplace(id, _proto.make_routed_connection(*this, origin)).first;
+      }
+      return it->second;
+  }
+
+  future<> server::drop_routed_connection(connection_id id) {
+      auto it = _routed_conns.find(id);
+      if (it == _routed_conns.end()) {
+          return make_ready_future<>();
+      }
+      auto conn = std::move(it->second);
+      _routed_conns.erase(it);
+      return conn->stop_routed().finally([conn] {});
+  }
+
   future<> server::shutdown() {
       if (_shutdown) {
           return make_ready_future<>();
@@ -1288,6 +2165,11 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
           return parallel_for_each(_conns | boost::adaptors::map_values, [] (shared_ptr<connection> conn) {
               return conn->stop();
           });
+      }).then([this] {
+          // Their origins drop them, or they go away with the server
+          return parallel_for_each(std::exchange(_routed_conns, {}) | boost::adaptors::map_values, [] (shared_ptr<connection> conn) {
+              return conn->stop_routed().finally([conn] {});
+          });
       }).finally([this] {
           _shutdown = true;
       });
@@ -0,0 +1,288 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/rpc/zstd_compressor.hh>
+#include <seastar/core/print.hh>
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#ifdef SEASTAR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace seastar {
+namespace rpc {
+
+// Wire format: every message is a single zstd frame which records the
+// size of the content. With a dictionary, the frame doesn't reference it,
+// the negotiated feature selects it.
+
+static constexpr size_t chunk_size = snd_buf::chunk_size;
+
+#ifdef SEASTAR_HAVE_ZSTD
+
+static void check_zstd(size_t ret, const char* what) {
+    if (ZSTD_isError(ret)) {
+        throw std::runtime_error(format("RPC frame ZSTD {} failure: {}", what, ZSTD_getErrorName(ret)));
+    }
+}
+
+// Calls fn with every fragment of a snd_buf or a rcv_buf
+template <typename Bufs, typename Func>
+static void for_each_fragment(const Bufs& bufs, Func&& fn) {
+    if (auto single = std::get_if<temporary_buffer<char>>(&bufs)) {
+        fn(*single);
+    } else {
+        for (auto& fragment : std::get<std::vector<temporary_buffer<char>>>(bufs)) {
+            fn(fragment);
+        }
+    }
+}
+
+zstd_dictionary::zstd_dictionary(uint32_t id, const temporary_buffer<char>& data, int level)
+        : _id(id)
+        , _level(level)
+        , _cdict(ZSTD_createCDict(data.get(), data.size(), level))
+        , _ddict(ZSTD_createDDict(data.get(), data.size())) {
+    if (!_cdict || !_ddict) {
+        ZSTD_freeCDict(_cdict);
+        ZSTD_freeDDict(_ddict);
+        throw std::bad_alloc();
+    }
+}
+
+zstd_dictionary::~zstd_dictionary() {
+    ZSTD_freeCDict(_cdict);
+    ZSTD_freeDDict(_ddict);
+}
+
+bool zstd_compressor::available() noexcept {
+    return true;
+}
+
+zstd_compressor::zstd_compressor(int level, const zstd_dictionary* dict)
+        : _level(dict ? dict->level() : level)
+        , _dict(dict)
+        , _cctx(ZSTD_createCCtx())
+        , _dctx(ZSTD_createDCtx()) {
+    if (!_cctx || !_dctx) {
+        ZSTD_freeCCtx(_cctx);
+        ZSTD_freeDCtx(_dctx);
+        throw std::bad_alloc();
+    }
+    if (_dict) {
+        // The level of the dictionary applies
+        ZSTD_CCtx_refCDict(_cctx, _dict->cdict());
+        ZSTD_DCtx_refDDict(_dctx, _dict->ddict());
+    } else {
+        ZSTD_CCtx_setParameter(_cctx, ZSTD_c_compressionLevel, _level);
+    }
+    // The frames carry the content size, for the receiver to allocate
+    // exactly what it needs
+    ZSTD_CCtx_setParameter(_cctx, ZSTD_c_contentSizeFlag, 1);
+}
+
+zstd_compressor::~zstd_compressor() {
+    ZSTD_freeCCtx(_cctx);
+    ZSTD_freeDCtx(_dctx);
+}
+
+snd_buf zstd_compressor::compress(size_t head_space, snd_buf data) {
+    check_zstd(ZSTD_CCtx_reset(_cctx, ZSTD_reset_session_only), "compression");
+    check_zstd(ZSTD_CCtx_setPledgedSrcSize(_cctx, data.size), "compression");
+
+    // Small messages fit a single buffer
+    auto bound = head_space + ZSTD_compressBound(data.size);
+    std::vector<temporary_buffer<char>> dst_buffers;
+    dst_buffers.emplace_back(std::max(head_space + 1, std::min(bound, chunk_size)));
+    ZSTD_outBuffer out = { dst_buffers.back().get_write(), dst_buffers.back().size(), head_space };
+    size_t total_size = 0;
+
+    auto next_buffer = [&] {
+        total_size += out.pos;
+        dst_buffers.emplace_back(chunk_size);
+        out = { dst_buffers.back().get_write(), dst_buffers.back().size(), 0 };
+    };
+    auto feed = [&] (const char* src, size_t size, ZSTD_EndDirective directive) {
+        ZSTD_inBuffer in = { src, size, 0 };
+        for (;;) {
+            if (out.pos == out.size) {
+                next_buffer();
+            }
+            auto remaining = ZSTD_compressStream2(_cctx, &out, &in, directive);
+            check_zstd(remaining, "compression");
+            if (directive == ZSTD_e_continue ? in.pos == in.size : !remaining) {
+                break;
+            }
+        }
+    };
+
+    for_each_fragment(data.bufs, [&] (const temporary_buffer<char>& fragment) {
+        feed(fragment.get(), fragment.size(), ZSTD_e_continue);
+    });
+    feed(nullptr, 0, ZSTD_e_end);
+
+    dst_buffers.back().trim(out.pos);
+    total_size += out.pos;
+    if (dst_buffers.size() == 1) {
+        return snd_buf(std::move(dst_buffers.front()));
+    }
+    return snd_buf(std::move(dst_buffers), total_size);
+}
+
+rcv_buf zstd_compressor::decompress(rcv_buf data) {
+    if (!data.size) {
+        return rcv_buf();
+    }
+    check_zstd(ZSTD_DCtx_reset(_dctx, ZSTD_reset_session_only), "decompression");
+
+    // The frame header may be fragmented too. Its maximal size is
+    // ZSTD_FRAMEHEADERSIZE_MAX, which zstd only exposes when linked statically.
+    char header[18];
+    size_t header_size = 0;
+    for_each_fragment(data.bufs, [&] (const temporary_buffer<char>& fragment) {
+        auto n = std::min(fragment.size(), sizeof(header) - header_size);
+        std::copy_n(fragment.get(), n, header + header_size);
+        header_size += n;
+    });
+    auto content_size = ZSTD_getFrameContentSize(header, header_size);
+    if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        throw std::runtime_error("RPC frame ZSTD decompression failure: bad frame header");
+    }
+
+    std::vector<temporary_buffer<char>> dst_buffers;
+    ZSTD_outBuffer out = { nullptr, 0, 0 };
+    size_t total_size = 0;
+    size_t remaining = 1;
+
+    // Buffers are allocated as the content is produced, not up front as
+    // the header says
+    auto next_buffer = [&] {
+        total_size += out.pos;
+        if (!dst_buffers.empty() && total_size >= content_size) {
+            throw std::runtime_error("RPC frame ZSTD decompression failure: content exceeds the frame header");
+        }
+        dst_buffers.emplace_back(std::max<size_t>(1, std::min<size_t>(content_size - total_size, chunk_size)));
+        out = { dst_buffers.back().get_write(), dst_buffers.back().size(), 0 };
+    };
+    auto feed = [&] (const char* src, size_t size) {
+        ZSTD_inBuffer in = { src, size, 0 };
+        while (in.pos < in.size) {
+            if (!remaining) {
+                throw std::runtime_error("RPC frame ZSTD decompression failure: trailing data");
+            }
+            if (out.pos == out.size) {
+                next_buffer();
+            }
+            remaining = ZSTD_decompressStream(_dctx, &out, &in);
+            check_zstd(remaining, "decompression");
+        }
+    };
+
+    for_each_fragment(data.bufs, [&] (const temporary_buffer<char>& fragment) {
+        feed(fragment.get(), fragment.size());
+    });
+    // Output may still be pending after all the input was taken
+    while (remaining) {
+        if (out.pos < out.size) {
+            throw std::runtime_error("RPC frame ZSTD decompression failure: truncated frame");
+        }
+        next_buffer();
+        remaining = ZSTD_decompressStream(_dctx, &out, nullptr);
+        check_zstd(remaining, "decompression");
+    }
+
+    dst_buffers.back().trim(out.pos);
+    total_size += out.pos;
+    if (total_size != content_size) {
+        throw std::runtime_error("RPC frame ZSTD decompression failure: content size mismatch");
+    }
+    if (dst_buffers.size() == 1) {
+        return rcv_buf(std::move(dst_buffers.front()));
+    }
+    return rcv_buf(std::move(dst_buffers), total_size);
+}
+
+#else
+
+zstd_dictionary::zstd_dictionary(uint32_t id, const temporary_buffer<char>& data, int level)
+        : _id(id), _level(level), _cdict(nullptr), _ddict(nullptr) {
+    throw std::runtime_error("Seastar was built without zstd");
+}
+
+zstd_dictionary::~zstd_dictionary() {
+}
+
+bool zstd_compressor::available() noexcept {
+    return false;
+}
+
+zstd_compressor::zstd_compressor(int level, const zstd_dictionary* dict)
+        : _level(level), _dict(dict), _cctx(nullptr), _dctx(nullptr) {
+    throw std::runtime_error("Seastar was built without zstd");
+}
+
+zstd_compressor::~zstd_compressor() {
+}
+
+snd_buf zstd_compressor::compress(size_t head_space, snd_buf data) {
+    abort();
+}
+
+rcv_buf zstd_compressor::decompress(rcv_buf data) {
+    abort();
+}
+
+#endif
+
+sstring zstd_compressor::name() const {
+    return _dict ? factory(*_dict).supported() : factory(_level).supported();
+}
+
+// Without zstd the factories advertise nothing, so peers never pick them
+zstd_compressor::factory::factory(int level)
+        : _level(level), _dict(nullptr) {
+#ifdef SEASTAR_HAVE_ZSTD
+    _name = "ZSTD";
+#endif
+}
+
+zstd_compressor::factory::factory(const zstd_dictionary& dict)
+        : _level(dict.level()), _dict(&dict) {
+#ifdef SEASTAR_HAVE_ZSTD
+    _name = format("ZSTD_DICT_{}", dict.id());
+#endif
+}
+
+const sstring& zstd_compressor::factory::supported() const {
+    return _name;
+}
+
+std::unique_ptr<rpc::compressor> zstd_compressor::factory::negotiate(sstring feature, bool is_server) const {
+    if (_name.empty() || feature != _name) {
+        return nullptr;
+    }
+    return std::make_unique<zstd_compressor>(_level, _dict);
+}
+
+}
+}
@@ -162,22 +162,32 @@ export module seastar;
 #include <seastar/core/align.hh>
 #include <seastar/core/aligned_buffer.hh>
 #include <seastar/core/app-template.hh>
+#include <seastar/core/arena.hh>
 #include <seastar/core/array_map.hh>
 #include <seastar/core/bitops.hh>
 #include <seastar/core/bitset-iter.hh>
 #include <seastar/core/byteorder.hh>
+#include <seastar/core/cached_file.hh>
 #include <seastar/core/cacheline.hh>
 #include <seastar/core/checked_ptr.hh>
+#include <seastar/core/checksummed_fstream.hh>
 #include <seastar/core/chunked_fifo.hh>
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/circular_buffer_fixed_capacity.hh>
 #include <seastar/core/condition-variable.hh>
 #include <seastar/core/coroutine.hh>
+#include <seastar/core/cross_shard_buffer.hh>
+#include <seastar/core/cross_shard_channel.hh>
+// #include <seastar/core/cpu_profiler.hh>
 #include <seastar/core/deleter.hh>
+#include <seastar/core/directory_cache.hh>
+#include <seastar/core/discard_batcher.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/do_with.hh>
+#include <seastar/core/emulated_file.hh>
 #include <seastar/core/enum.hh>
 #include <seastar/core/exception_hacks.hh>
+// #include <seastar/core/event_trace.hh>
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/expiring_fifo.hh>
 #include <seastar/core/file.hh>
@@ -191,10 +201,12 @@ export module seastar;
 #include <seastar/core/idle_cpu_handler.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/iostream-impl.hh>
+#include <seastar/core/io_batch.hh>
 #include <seastar/core/io_intent.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/io_priority_class.hh>
 #include <seastar/core/layered_file.hh>
+#include <seastar/core/log_file.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/lowres_clock.hh>
 #include <seastar/core/make_task.hh>
@@ -211,14 +223,19 @@ export module seastar;
 #include <seastar/core/preempt.hh>
 #include <seastar/core/prefetch.hh>
 #include <seastar/core/print.hh>
+// #include <seastar/core/otlp.hh>
 // #include <seastar/core/prometheus.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/ragel.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/reactor_config.hh>
+#include <seastar/core/replicated.hh>
 #include <seastar/core/relabel_config.hh>
 #include <seastar/core/report_exception.hh>
 #include <seastar/core/resource.hh>
+#include <seastar/core/resource_limits.hh>
+#include <seastar/core/result.hh>
+#include <seastar/core/rope.hh>
 #include <seastar/core/rwlock.hh>
 #include <seastar/core/scattered_message.hh>
 #include <seastar/core/scheduling.hh>
@@ -227,7 +244,9 @@ export module seastar;
 #include <seastar/core/scollectd_api.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/service_graph.hh>
 #include <seastar/core/sharded.hh>
+#include <seastar/core/sharded_per_numa.hh>
 #include <seastar/core/shared_future.hh>
 #include <seastar/core/shared_mutex.hh>
 #include <seastar/core/shared_ptr.hh>
@@ -240,6 +259,7 @@ export module seastar;
 #include <seastar/core/sstring.hh>
 #include <seastar/core/stream.hh>
 #include <seastar/core/stall_sampler.hh>
+#include <seastar/core/steal_time.hh>
 #include <seastar/core/systemwide_memory_barrier.hh>
 #include <seastar/core/task.hh>
 #include <seastar/core/temporary_buffer.hh>
@@ -259,6 +279,7 @@ export module seastar;
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/conversions.hh>
+#include <seastar/util/crc32c.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/file.hh>
 #include <seastar/util/log-cli.hh>
@@ -277,27 +298,39 @@ export module seastar;
 #include <seastar/net/inet_address.hh>
 #include <seastar/net/ip.hh>
 #include <seastar/net/ipv4_address.hh>
+#include <seastar/net/ipv6.hh>
 #include <seastar/net/native-stack.hh>
+#include <seastar/net/neighbor_cache.hh>
 #include <seastar/net/posix-stack.hh>
 #include <seastar/net/socket_defs.hh>
+#include <seastar/net/srv_balancer.hh>
 #include <seastar/net/tcp.hh>
+#include <seastar/net/tcp-congestion.hh>
 #include <seastar/net/udp.hh>
 #include <seastar/net/tls.hh>
 
+#include <seastar/http/admission.hh>
+#include <seastar/http/cached_handler.hh>
 #include <seastar/http/common.hh>
 #include <seastar/http/client.hh>
+#include <seastar/http/compression.hh>
+// #include <seastar/http/cpu_profile_handler.hh>
 #include <seastar/http/exception.hh>
 #include <seastar/http/file_handler.hh>
 #include <seastar/http/httpd.hh>
 #include <seastar/http/json_path.hh>
+#include <seastar/http/memory_handler.hh>
+#include <seastar/http/multipart_upload.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/http/response_parser.hh>
 #include <seastar/http/request.hh>
 #include <seastar/http/routes.hh>
 #include <seastar/http/transformers.hh>
+#include <seastar/http/typed_params.hh>
 
 #include <seastar/json/formatter.hh>
 #include <seastar/json/json_elements.hh>
+#include <seastar/json/stream_parser.hh>
 
 module : private;
 
@@ -326,11 +359,19 @@ module : private;
 #include <seastar/net/dhcp.hh>
 #include <seastar/net/native-stack.hh>
 #include <seastar/net/proxy.hh>
+#include <seastar/net/shm_socket.hh>
 #include <seastar/net/tcp-stack.hh>
 #include <seastar/net/toeplitz.hh>
 #include <seastar/net/virtio.hh>
+#include <seastar/net/xdp.hh>
 
+#include "http/http2.hh"
+#include "http/http2_frame.hh"
+#include "net/bpf.hh"
+#include "net/buffer_pool.hh"
 #include "net/native-stack-impl.hh"
 
 #include <seastar/http/url.hh>
 #include <seastar/http/internal/content_source.hh>
+#include <seastar/http/internal/hpack.hh>
+#include <seastar/http/internal/request_head_parser.hh>
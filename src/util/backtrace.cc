@@ -102,6 +102,52 @@ simple_backtrace current_backtrace_tasklocal() noexcept {
     return simple_backtrace(std::move(v));
 }
 
+simple_backtrace fast_backtrace_tasklocal() noexcept {
+    simple_backtrace::vector_type v;
+    fast_backtrace([&] (frame f) {
+        if (v.size() < v.capacity()) {
+            v.emplace_back(std::move(f));
+        }
+    });
+    return simple_backtrace(std::move(v));
+}
+
+namespace internal {
+
+int walk_frame_pointers(uintptr_t* buffer, size_t size) noexcept {
+#if defined(SEASTAR_FRAME_POINTERS) && (defined(__x86_64__) || defined(__aarch64__))
+    // Only addresses within the current stack are read. The saved frame
+    // pointers must grow towards its top, a garbage one, left by code built
+    // without frame pointers, ends the walk.
+    auto stack = thread_impl::current_stack();
+    auto fp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    if (!stack.high || fp < stack.low || fp > stack.high - 2 * sizeof(uintptr_t)) {
+        return -1;
+    }
+    size_t n = 0;
+    while (n < size) {
+        // A frame record is the caller's frame pointer, followed by the
+        // return address
+        auto record = reinterpret_cast<const uintptr_t*>(fp);
+        auto ip = record[1];
+        if (!ip) {
+            break;
+        }
+        buffer[n++] = ip;
+        auto next = record[0];
+        if (next <= fp || next % alignof(uintptr_t) || next > stack.high - 2 * sizeof(uintptr_t)) {
+            break;
+        }
+        fp = next;
+    }
+    return n;
+#else
+    return -1;
+#endif
+}
+
+}
+
 size_t simple_backtrace::calculate_hash() const noexcept {
     size_t h = 0;
     for (auto f : _frames) {
@@ -0,0 +1,179 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/util/crc32c.hh>
+#endif
+
+namespace seastar {
+
+namespace {
+
+// The kernels work on the raw state of the reflected CRC, with neither the
+// initial nor the final inversion.
+
+constexpr uint32_t polynomial = 0x82f63b78;
+
+constexpr std::array<uint32_t, 256> make_table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (c & 1 ? polynomial : 0);
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+constexpr auto table = make_table();
+
+uint32_t crc_software(uint32_t crc, const char* data, size_t len) noexcept {
+    auto p = reinterpret_cast<const uint8_t*>(data);
+    while (len--) {
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+uint64_t load64(const char* p) noexcept {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+[[gnu::target("sse4.2")]]
+uint32_t crc_sse42(uint32_t crc, const char* data, size_t len) noexcept {
+    uint64_t c = crc;
+    while (len >= 8) {
+        c = _mm_crc32_u64(c, load64(data));
+        data += 8;
+        len -= 8;
+    }
+    crc = c;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+// The crc32 instruction has a latency of three cycles and a throughput of
+// one, so three independent streams keep it busy. Their states are merged
+// by multiplying them by x^(8 * stride) modulo the polynomial.
+constexpr size_t stride = 1024;
+
+// x^n modulo the polynomial, reflected
+constexpr uint32_t xpow(uint64_t n) {
+    uint32_t v = 0x80000000;
+    while (n--) {
+        v = (v >> 1) ^ (v & 1 ? polynomial : 0);
+    }
+    return v;
+}
+
+// The carry-less product of two reflected values is off by one bit, and
+// the crc32 instruction that reduces it multiplies by x^32
+constexpr uint32_t shift_by_stride = xpow(8 * stride - 33);
+constexpr uint32_t shift_by_two_strides = xpow(16 * stride - 33);
+
+[[gnu::target("sse4.2,pclmul")]]
+uint32_t shift(uint32_t crc, uint32_t k) noexcept {
+    auto p = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc), _mm_cvtsi32_si128(k), 0);
+    return _mm_crc32_u64(0, _mm_cvtsi128_si64(p));
+}
+
+[[gnu::target("sse4.2,pclmul")]]
+uint32_t crc_sse42_pclmul(uint32_t crc, const char* data, size_t len) noexcept {
+    while (len >= 3 * stride) {
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+        for (size_t i = 0; i < stride; i += 8) {
+            c0 = _mm_crc32_u64(c0, load64(data + i));
+            c1 = _mm_crc32_u64(c1, load64(data + stride + i));
+            c2 = _mm_crc32_u64(c2, load64(data + 2 * stride + i));
+        }
+        crc = shift(c0, shift_by_two_strides) ^ shift(c1, shift_by_stride) ^ c2;
+        data += 3 * stride;
+        len -= 3 * stride;
+    }
+    return crc_sse42(crc, data, len);
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+uint32_t crc_armv8(uint32_t crc, const char* data, size_t len) noexcept {
+    while (len >= 8) {
+        uint64_t v;
+        std::memcpy(&v, data, sizeof(v));
+        crc = __crc32cd(crc, v);
+        data += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
+
+#endif
+
+using crc_kernel = uint32_t (*)(uint32_t crc, const char* data, size_t len) noexcept;
+
+crc_kernel select_kernel() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        if (__builtin_cpu_supports("pclmul")) {
+            return crc_sse42_pclmul;
+        }
+        return crc_sse42;
+    }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    return crc_armv8;
+#endif
+    return crc_software;
+}
+
+const crc_kernel kernel = select_kernel();
+
+}
+
+uint32_t crc32c(uint32_t crc, const char* data, size_t len) noexcept {
+    return ~kernel(~crc, data, len);
+}
+
+}
@@ -31,10 +31,12 @@ module;
 #include <list>
 #include <vector>
 #include <sys/statvfs.h>
+#include <boost/range/irange.hpp>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/io_queue.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/util/file.hh>
@@ -128,6 +130,40 @@ future<uint64_t> fs_free(std::string_view name) noexcept {
     });
 }
 
+future<sstring> choose_directory(std::vector<sstring> directories, io_placement_policy policy) noexcept {
+    if (directories.empty()) {
+        return make_exception_future<sstring>(std::invalid_argument("No directory to choose from"));
+    }
+    static thread_local size_t next = 0;
+    auto first = next++ % directories.size();
+    if (policy == io_placement_policy::round_robin) {
+        return make_ready_future<sstring>(std::move(directories[first]));
+    }
+    // Start from a rotating index, so that ties go round robin too
+    return do_with(std::move(directories), std::vector<double>(), [policy, first] (auto& dirs, auto& costs) {
+        costs.resize(dirs.size());
+        return parallel_for_each(boost::irange<size_t>(0, dirs.size()), [&dirs, &costs, policy] (size_t i) {
+            if (policy == io_placement_policy::most_space) {
+                return fs_avail(dirs[i]).then([&costs, i] (uint64_t avail) {
+                    costs[i] = -double(avail);
+                });
+            }
+            return file_stat(dirs[i]).then([&costs, i] (stat_data sd) {
+                costs[i] = engine().get_io_queue(sd.device_id).pending_time().count();
+            });
+        }).then([&dirs, &costs, first] {
+            auto best = first;
+            for (size_t n = 1; n < dirs.size(); n++) {
+                auto i = (first + n) % dirs.size();
+                if (costs[i] < costs[best]) {
+                    best = i;
+                }
+            }
+            return std::move(dirs[best]);
+        });
+    });
+}
+
 future<stat_data> file_stat(std::string_view name, follow_symlink follow) noexcept {
     return engine().file_stat(name, follow);
 }
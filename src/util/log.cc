@@ -32,6 +32,12 @@ module;
 #include <system_error>
 #include <chrono>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <fmt/core.h>
 #if FMT_VERSION >= 60000
@@ -245,16 +251,32 @@ std::ostream& operator<<(std::ostream& os, logger_ostream_type lot) {
     return os;
 }
 
-static internal::log_buf::inserter_iterator print_no_timestamp(internal::log_buf::inserter_iterator it) {
+namespace {
+
+// What is printed before the message. It is captured when the message is
+// logged, so that the writer thread can print it for deferred messages.
+struct log_origin {
+    log_level level;
+    std::chrono::system_clock::time_point real_time;
+    std::chrono::steady_clock::time_point boot_time;
+    // -1 outside of reactor threads
+    int shard;
+    std::string_view group;
+    std::string_view name;
+};
+
+}
+
+static internal::log_buf::inserter_iterator print_no_timestamp(internal::log_buf::inserter_iterator it, const log_origin&) {
     return it;
 }
 
-static internal::log_buf::inserter_iterator print_boot_timestamp(internal::log_buf::inserter_iterator it) {
-    auto n = std::chrono::steady_clock::now().time_since_epoch() / 1us;
+static internal::log_buf::inserter_iterator print_boot_timestamp(internal::log_buf::inserter_iterator it, const log_origin& o) {
+    auto n = o.boot_time.time_since_epoch() / 1us;
     return fmt::format_to(it, "{:10d}.{:06d}", n / 1000000, n % 1000000);
 }
 
-static internal::log_buf::inserter_iterator print_real_timestamp(internal::log_buf::inserter_iterator it) {
+static internal::log_buf::inserter_iterator print_real_timestamp(internal::log_buf::inserter_iterator it, const log_origin& o) {
     struct a_second {
         time_t t;
         std::array<char, 32> static_buf; // big enough to hold '2023-01-14 15:06:33'
@@ -262,7 +284,7 @@ static internal::log_buf::inserter_iterator print_real_timestamp(internal::log_b
     };
     static thread_local a_second this_second;
     using clock = std::chrono::system_clock;
-    auto n = clock::now();
+    auto n = o.real_time;
     auto t = clock::to_time_t(n);
     if (this_second.t != t) {
         this_second.t = t;
@@ -273,8 +295,81 @@ static internal::log_buf::inserter_iterator print_real_timestamp(internal::log_b
     return fmt::format_to(it, "{},{:03d}", this_second.buf.view(), ms);
 }
 
-static internal::log_buf::inserter_iterator (*print_timestamp)(internal::log_buf::inserter_iterator) = print_no_timestamp;
+static internal::log_buf::inserter_iterator (*print_timestamp)(internal::log_buf::inserter_iterator, const log_origin&) = print_no_timestamp;
+
+static std::atomic<bool> json_format = { false };
+
+static internal::log_buf::inserter_iterator print_origin(internal::log_buf::inserter_iterator it, const log_origin& o, unsigned shard_field_width) {
+    if (o.shard >= 0) {
+        it = fmt::format_to(it, " [shard {:{}}:{}]", o.shard, shard_field_width, o.group);
+    }
+    return fmt::format_to(it, " {} - ", o.name);
+}
+
+static internal::log_buf::inserter_iterator print_json_string(internal::log_buf::inserter_iterator it, std::string_view s) {
+    *it++ = '"';
+    for (char c : s) {
+        switch (c) {
+        case '"': it = fmt::format_to(it, "\\\""); break;
+        case '\\': it = fmt::format_to(it, "\\\\"); break;
+        case '\n': it = fmt::format_to(it, "\\n"); break;
+        case '\r': it = fmt::format_to(it, "\\r"); break;
+        case '\t': it = fmt::format_to(it, "\\t"); break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                it = fmt::format_to(it, "\\u{:04x}", unsigned(c));
+            } else {
+                *it++ = c;
+            }
+        }
+    }
+    *it++ = '"';
+    return it;
+}
+
+static thread_local std::array<char, 8192> json_message_buf;
 
+// Prints a line for the ostream, the message is printed by body
+template <typename Body>
+static internal::log_buf::inserter_iterator print_line(internal::log_buf::inserter_iterator it, const log_origin& o, unsigned shard_field_width, Body&& body) {
+    if (!json_format.load(std::memory_order_relaxed)) {
+        it = fmt::format_to(it, "{} ", wrapped_log_level{o.level});
+        it = print_timestamp(it, o);
+        it = print_origin(it, o, shard_field_width);
+        it = body(it);
+        *it++ = '\n';
+        return it;
+    }
+    // The message is escaped, so it's printed to a buffer of its own first
+    internal::log_buf message(json_message_buf.data(), json_message_buf.size());
+    body(message.back_insert_begin());
+    it = fmt::format_to(it, "{{\"level\":\"{}\"", log_level_names.at(o.level));
+    if (print_timestamp != print_no_timestamp) {
+        it = fmt::format_to(it, ",\"time\":\"");
+        it = print_timestamp(it, o);
+        *it++ = '"';
+    }
+    if (o.shard >= 0) {
+        it = fmt::format_to(it, ",\"shard\":{},\"group\":", o.shard);
+        it = print_json_string(it, o.group);
+    }
+    it = fmt::format_to(it, ",\"logger\":");
+    it = print_json_string(it, o.name);
+    it = fmt::format_to(it, ",\"message\":");
+    it = print_json_string(it, message.view());
+    return fmt::format_to(it, "}}\n");
+}
+
+static int syslog_priority(log_level level) {
+    static array_map<int, 20> level_map = {
+            { int(log_level::debug), LOG_DEBUG },
+            { int(log_level::info), LOG_INFO },
+            { int(log_level::trace), LOG_DEBUG },  // no LOG_TRACE
+            { int(log_level::warn), LOG_WARNING },
+            { int(log_level::error), LOG_ERR },
+    };
+    return level_map[int(level)];
+}
 
 std::ostream& operator<<(std::ostream& out, log_level level) {
     return out << log_level_names.at(level);
@@ -300,6 +395,7 @@ std::ostream* logger::_out = &std::cerr;
 std::atomic<bool> logger::_ostream = { true };
 std::atomic<bool> logger::_syslog = { false };
 unsigned logger::_shard_field_width = 1;
+std::atomic<bool> logger::_deferred_formatting = { false };
 #ifdef SEASTAR_BUILD_SHARED_LIBS
 thread_local bool logger::silent = false;
 #endif
@@ -332,6 +428,269 @@ logger::rate_limit::rate_limit(std::chrono::milliseconds interval)
     : _interval(interval), _next(clock::now())
 { }
 
+// Asynchronous logging: every thread formats its messages into a single
+// producer, single consumer ring of its own, and the writer thread drains
+// the rings into the sinks.
+class logger::async_backend {
+    // A record is a 32-bit length and a sink byte, followed by the message.
+    // The sink is 0 for the ostream, or the syslog priority plus one.
+    static constexpr size_t header_size = sizeof(uint32_t) + 1;
+    static constexpr size_t max_batch = 64 * 1024;
+public:
+    // A deferred message is formatted by the writer thread, for all the
+    // sinks. Its record holds a deferred_header, the scheduling group and
+    // logger names, and the arguments.
+    static constexpr uint8_t deferred_sink = 0xff;
+    struct deferred_header {
+        log_level level;
+        int shard;
+        std::chrono::system_clock::rep real_time;
+        std::chrono::steady_clock::rep boot_time;
+        const char* format;
+        size_t format_size;
+        deferred_args::render_fn render;
+        uint32_t group_size = 0;
+        uint32_t name_size = 0;
+    };
+private:
+
+    struct ring {
+        std::unique_ptr<char[]> buf;
+        size_t size;
+        unsigned generation;
+        std::atomic<size_t> head = { 0 };
+        std::atomic<size_t> tail = { 0 };
+        std::atomic<uint64_t> dropped = { 0 };
+
+        ring(size_t size, unsigned generation) : buf(new char[size]), size(size), generation(generation) {}
+
+        void copy_in(size_t pos, const char* p, size_t len) noexcept {
+            auto off = pos % size;
+            auto first = std::min(len, size - off);
+            std::memcpy(buf.get() + off, p, first);
+            std::memcpy(buf.get(), p + first, len - first);
+        }
+        void copy_out(size_t pos, char* p, size_t len) const noexcept {
+            auto off = pos % size;
+            auto first = std::min(len, size - off);
+            std::memcpy(p, buf.get() + off, first);
+            std::memcpy(p + first, buf.get(), len - first);
+        }
+        // Called by the owning thread only
+        bool push(uint8_t sink, std::string_view msg) noexcept {
+            auto t = tail.load(std::memory_order_relaxed);
+            auto needed = header_size + msg.size();
+            if (needed > size - (t - head.load(std::memory_order_acquire))) {
+                return false;
+            }
+            uint32_t len = msg.size();
+            copy_in(t, reinterpret_cast<const char*>(&len), sizeof(len));
+            copy_in(t + sizeof(len), reinterpret_cast<const char*>(&sink), 1);
+            copy_in(t + header_size, msg.data(), msg.size());
+            tail.store(t + needed, std::memory_order_release);
+            return true;
+        }
+        // Called by the writer thread only
+        template <typename Func>
+        void drain(std::string& scratch, Func&& f) {
+            auto h = head.load(std::memory_order_relaxed);
+            auto t = tail.load(std::memory_order_acquire);
+            while (h != t) {
+                uint32_t len;
+                uint8_t sink;
+                copy_out(h, reinterpret_cast<char*>(&len), sizeof(len));
+                copy_out(h + sizeof(len), reinterpret_cast<char*>(&sink), 1);
+                scratch.resize(len);
+                copy_out(h + header_size, scratch.data(), len);
+                h += header_size + len;
+                head.store(h, std::memory_order_release);
+                f(sink, std::string_view(scratch));
+            }
+        }
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<std::shared_ptr<ring>> _rings;
+    std::thread _writer;
+    std::atomic<bool> _running = { false };
+    std::atomic<bool> _pending = { false };
+    bool _stop = false;
+    size_t _ring_size = 0;
+    std::atomic<unsigned> _generation = { 0 };
+    std::atomic<overflow_policy> _policy = { overflow_policy::drop };
+    std::atomic<uint64_t> _dropped = { 0 };
+
+    static thread_local std::shared_ptr<ring> _local;
+
+    ring* local_ring() {
+        if (!_local || _local->generation != _generation.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> g(_mutex);
+            _local = std::make_shared<ring>(_ring_size, _generation.load(std::memory_order_relaxed));
+            _rings.push_back(_local);
+        }
+        return _local.get();
+    }
+
+    void write_syslog(uint8_t sink, std::string_view msg) {
+        syslog(sink - 1, "%.*s", int(msg.size()), msg.data());
+    }
+
+    void write_deferred(std::string_view record, std::string& batch) {
+        static thread_local std::array<char, 8192> render_buf;
+        deferred_header h;
+        std::memcpy(&h, record.data(), sizeof(h));
+        auto names = record.data() + sizeof(h);
+        log_origin origin{
+            h.level,
+            std::chrono::system_clock::time_point(std::chrono::system_clock::duration(h.real_time)),
+            std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(h.boot_time)),
+            h.shard,
+            std::string_view(names, h.group_size),
+            std::string_view(names + h.group_size, h.name_size),
+        };
+        auto args = names + h.group_size + h.name_size;
+        auto body = [&] (internal::log_buf::inserter_iterator it) {
+            return h.render(it, std::string_view(h.format, h.format_size), args);
+        };
+        try {
+            if (_ostream.load(std::memory_order_relaxed)) {
+                internal::log_buf buf(render_buf.data(), render_buf.size());
+                print_line(buf.back_insert_begin(), origin, _shard_field_width, body);
+                batch.append(buf.view());
+            }
+            if (_syslog.load(std::memory_order_relaxed)) {
+                internal::log_buf buf(render_buf.data(), render_buf.size());
+                body(print_origin(buf.back_insert_begin(), origin, _shard_field_width));
+                write_syslog(syslog_priority(h.level) + 1, buf.view());
+            }
+        } catch (...) {
+            batch.append(fmt::format("ERROR failed to format a deferred log message of {}: fmt='{}': {}\n",
+                    origin.name, std::string_view(h.format, h.format_size), std::current_exception()));
+        }
+    }
+
+    void flush(std::string& batch) {
+        if (!batch.empty()) {
+            *_out << batch;
+            _out->flush();
+            batch.clear();
+        }
+    }
+
+    void run() {
+        std::string batch;
+        std::string scratch;
+        std::vector<std::shared_ptr<ring>> rings;
+        while (true) {
+            bool stop;
+            // Our references would keep the rings of exited threads alive
+            rings.clear();
+            {
+                std::unique_lock<std::mutex> lk(_mutex);
+                // Producers don't take the mutex to wake us up, so a
+                // wakeup can be missed; the timeout bounds the delay then
+                _cv.wait_for(lk, std::chrono::milliseconds(50), [this] {
+                    return _stop || _pending.load(std::memory_order_relaxed);
+                });
+                _pending.store(false, std::memory_order_relaxed);
+                stop = _stop;
+                // Rings of exited threads are dropped once drained
+                std::erase_if(_rings, [] (const std::shared_ptr<ring>& r) {
+                    return r.use_count() == 1 && r->head.load() == r->tail.load();
+                });
+                rings = _rings;
+            }
+            for (auto& r : rings) {
+                r->drain(scratch, [&] (uint8_t sink, std::string_view msg) {
+                    if (sink == deferred_sink) {
+                        write_deferred(msg, batch);
+                    } else if (sink) {
+                        write_syslog(sink, msg);
+                    } else {
+                        batch.append(msg);
+                    }
+                    if (batch.size() >= max_batch) {
+                        flush(batch);
+                    }
+                });
+                if (auto dropped = r->dropped.exchange(0, std::memory_order_relaxed)) {
+                    _dropped.fetch_add(dropped, std::memory_order_relaxed);
+                    batch.append(fmt::format("WARN  {} log messages were dropped, the asynchronous logging buffer was full\n", dropped));
+                }
+            }
+            flush(batch);
+            if (stop) {
+                break;
+            }
+        }
+    }
+public:
+    ~async_backend() {
+        stop();
+    }
+
+    void start(size_t ring_size, overflow_policy policy) {
+        _policy.store(policy, std::memory_order_relaxed);
+        if (_running.load(std::memory_order_relaxed)) {
+            return;
+        }
+        {
+            // local_ring() reads it under the mutex
+            std::lock_guard<std::mutex> g(_mutex);
+            _ring_size = std::max<size_t>(ring_size, 4096);
+            _generation++;
+            _stop = false;
+        }
+        _writer = std::thread([this] { run(); });
+        _running.store(true, std::memory_order_release);
+    }
+
+    void stop() {
+        if (!_running.exchange(false)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> g(_mutex);
+            _stop = true;
+        }
+        _cv.notify_one();
+        _writer.join();
+        std::lock_guard<std::mutex> g(_mutex);
+        _rings.clear();
+    }
+
+    bool running() const noexcept {
+        return _running.load(std::memory_order_acquire);
+    }
+
+    // Returns false if the message has to be written synchronously
+    bool enqueue(uint8_t sink, std::string_view msg) {
+        if (local_ring()->push(sink, msg)) {
+            if (!_pending.exchange(true, std::memory_order_relaxed)) {
+                _cv.notify_one();
+            }
+            return true;
+        }
+        if (_policy.load(std::memory_order_relaxed) == overflow_policy::write_through) {
+            return false;
+        }
+        _local->dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    uint64_t dropped() const noexcept {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    static async_backend& instance() {
+        static async_backend backend;
+        return backend;
+    }
+};
+
+thread_local std::shared_ptr<logger::async_backend::ring> logger::async_backend::_local;
+
 void
 logger::do_log(log_level level, log_writer& writer) {
     bool is_ostream_enabled = _ostream.load(std::memory_order_relaxed);
@@ -339,48 +698,83 @@ logger::do_log(log_level level, log_writer& writer) {
     if(!is_ostream_enabled && !is_syslog_enabled) {
       return;
     }
-    auto print_once = [&] (internal::log_buf::inserter_iterator it) {
-      if (local_engine) {
-          it = fmt::format_to(it, " [shard {:{}}:{}]", this_shard_id(), _shard_field_width, current_scheduling_group().short_name());
-      }
-      it = fmt::format_to(it, " {} - ", _name);
-      return writer(it);
-    };
+    log_origin origin{level, std::chrono::system_clock::now(), std::chrono::steady_clock::now(), -1, {}, _name};
+    if (local_engine) {
+        origin.shard = this_shard_id();
+        origin.group = current_scheduling_group().short_name();
+    }
 
     // Mainly this protects us from re-entrance via malloc()'s
     // oversized allocation warnings and failed allocation errors
     silencer be_silent;
 
+    auto& backend = async_backend::instance();
+    bool is_async = backend.running();
     if (is_ostream_enabled) {
         internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
-        auto it = buf.back_insert_begin();
-        it = fmt::format_to(it, "{} ", wrapped_log_level{level});
-        it = print_timestamp(it);
-        it = print_once(it);
-        *it++ = '\n';
-        *_out << buf.view();
-        _out->flush();
+        print_line(buf.back_insert_begin(), origin, _shard_field_width, writer);
+        if (!is_async || !backend.enqueue(0, buf.view())) {
+            *_out << buf.view();
+            _out->flush();
+        }
     }
     if (is_syslog_enabled) {
         internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
-        auto it = buf.back_insert_begin();
-        it = print_once(it);
+        auto it = print_origin(buf.back_insert_begin(), origin, _shard_field_width);
+        it = writer(it);
+        if (is_async && backend.enqueue(syslog_priority(level) + 1, buf.view())) {
+            return;
+        }
         *it = '\0';
-        static array_map<int, 20> level_map = {
-                { int(log_level::debug), LOG_DEBUG },
-                { int(log_level::info), LOG_INFO },
-                { int(log_level::trace), LOG_DEBUG },  // no LOG_TRACE
-                { int(log_level::warn), LOG_WARNING },
-                { int(log_level::error), LOG_ERR },
-        };
         // NOTE: syslog() can block, which will stall the reactor thread.
         //       this should be rare (will have to fill the pipe buffer
         //       before syslogd can clear it) but can happen.  If it does,
         //       we'll have to implement some internal buffering (which
         //       still means the problem can happen, just less frequently).
         // syslog() interprets % characters, so send msg as a parameter
-        syslog(level_map[int(level)], "%s", buf.data());
+        syslog(syslog_priority(level), "%s", buf.data());
+    }
+}
+
+static thread_local std::array<char, 8192> deferred_log_buf;
+
+void
+logger::do_log_deferred(log_level level, fmt::string_view format, deferred_args::render_fn render, log_writer& args_writer) {
+    if (!_ostream.load(std::memory_order_relaxed) && !_syslog.load(std::memory_order_relaxed)) {
+        return;
+    }
+    internal::log_buf buf(deferred_log_buf.data(), deferred_log_buf.size());
+    size_t args_offset;
+    {
+        silencer be_silent;
+        async_backend::deferred_header h{
+            .level = level,
+            .shard = local_engine ? int(this_shard_id()) : -1,
+            .real_time = std::chrono::system_clock::now().time_since_epoch().count(),
+            .boot_time = std::chrono::steady_clock::now().time_since_epoch().count(),
+            .format = format.data(),
+            .format_size = format.size(),
+            .render = render,
+        };
+        std::string_view group = local_engine ? std::string_view(current_scheduling_group().short_name()) : std::string_view();
+        h.group_size = group.size();
+        h.name_size = _name.size();
+        auto it = std::copy_n(reinterpret_cast<const char*>(&h), sizeof(h), buf.back_insert_begin());
+        it = std::copy_n(group.data(), group.size(), it);
+        it = std::copy_n(_name.data(), _name.size(), it);
+        args_offset = buf.view().size();
+        args_writer(it);
+        auto& backend = async_backend::instance();
+        if (backend.running() && backend.enqueue(async_backend::deferred_sink, buf.view())) {
+            return;
+        }
     }
+    // Asynchronous logging is disabled, or the buffer is full and messages
+    // are written through
+    lambda_log_writer writer([&] (internal::log_buf::inserter_iterator it) {
+        return render(it, std::string_view(format.data(), format.size()), buf.data() + args_offset);
+    });
+    do_log(level, writer);
 }
 
 void logger::failed_to_log(std::exception_ptr ex,
@@ -431,6 +825,30 @@ logger::set_with_color(bool enabled) noexcept {
     fmt::formatter<wrapped_log_level>::colored = enabled;
 }
 
+void
+logger::set_async(bool enabled, size_t buffer_size, overflow_policy policy) {
+    if (enabled) {
+        async_backend::instance().start(buffer_size, policy);
+    } else {
+        async_backend::instance().stop();
+    }
+}
+
+uint64_t
+logger::async_dropped_messages() noexcept {
+    return async_backend::instance().dropped();
+}
+
+void
+logger::set_deferred_formatting(bool enabled) noexcept {
+    _deferred_formatting.store(enabled, std::memory_order_relaxed);
+}
+
+void
+logger::set_json_format(bool enabled) noexcept {
+    json_format.store(enabled, std::memory_order_relaxed);
+}
+
 bool logger::is_shard_zero() noexcept {
     return this_shard_id() == 0;
 }
@@ -512,6 +930,9 @@ void apply_logging_settings(const logging_settings& s) {
     }
     logger::set_syslog_enabled(s.syslog_enabled);
     logger::set_with_color(s.with_color);
+    logger::set_async(s.async, s.async_buffer_size, s.async_overflow_policy);
+    logger::set_deferred_formatting(s.deferred_formatting);
+    logger::set_json_format(s.json_format);
 
     switch (s.stdout_timestamp_style) {
     case logger_timestamp_style::none:
@@ -601,6 +1022,13 @@ options::options(program_options::option_group* parent_group)
             "Send log output to: none|stdout|stderr")
     , log_to_syslog(*this, "log-to-syslog", false, "Send log output to syslog.")
     , log_with_color(*this, "log-with-color", isatty(STDOUT_FILENO), "Print colored tag prefix in log message written to ostream")
+    , logger_async(*this, "logger-async", false, "Write log messages from a dedicated thread, so that a slow log sink doesn't stall the reactor")
+    , logger_async_buffer_size(*this, "logger-async-buffer-size", 1 << 20, "Size of the buffer of each thread with --logger-async, in bytes")
+    , logger_async_write_through(*this, "logger-async-write-through", false,
+            "With --logger-async, write messages synchronously instead of dropping them when the buffer is full")
+    , logger_deferred_formatting(*this, "logger-deferred-formatting", false,
+            "With --logger-async, format the messages whose arguments are numbers or strings on the writer thread")
+    , logger_json(*this, "logger-json", false, "Write log messages to the output stream as JSON objects, one per line")
 {
 }
 
@@ -632,6 +1060,11 @@ logging_settings extract_settings(const options& opts) {
         opts.log_with_color.get_value(),
         opts.logger_stdout_timestamps.get_value(),
         opts.logger_ostream_type.get_value(),
+        opts.logger_async.get_value(),
+        opts.logger_async_buffer_size.get_value(),
+        opts.logger_async_write_through.get_value() ? logger::overflow_policy::write_through : logger::overflow_policy::drop,
+        opts.logger_deferred_formatting.get_value(),
+        opts.logger_json.get_value(),
     };
 }
 
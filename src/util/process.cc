@@ -22,20 +22,29 @@
 
 #ifdef SEASTAR_MODULE
 module;
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
 #include <cassert>
 #include <csignal>
 #include <cstdint>
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <vector>
 #include <utility>
 module seastar;
 #else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/fstream.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/polymorphic_temporary_buffer.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/coroutine/maybe_yield.hh>
 #include <seastar/util/process.hh>
 #endif
 
@@ -106,6 +115,43 @@ class pipe_data_sink_impl final : public data_sink_impl {
         return _buffer_size;
     }
 };
+
+// Moves everything written to the pipe from to to, see process::splice_cout()
+future<uint64_t> splice_all(file_desc from, file_desc to) {
+    static constexpr size_t splice_size = 1 << 16;
+    // Regular files can't be polled, writing to them doesn't wait
+    // for anything but the page cache
+    struct stat st;
+    throw_system_error_on(::fstat(to.get(), &st) == -1, "fstat");
+    bool poll_to = !S_ISREG(st.st_mode);
+    pollable_fd in(std::move(from));
+    std::optional<pollable_fd> out;
+    if (poll_to) {
+        out.emplace(std::move(to));
+    }
+    int to_fd = poll_to ? out->get_file_desc().get() : to.get();
+    uint64_t total = 0;
+    while (true) {
+        auto n = ::splice(in.get_file_desc().get(), nullptr, to_fd, nullptr, splice_size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            total += n;
+            co_await coroutine::maybe_yield();
+            continue;
+        }
+        if (n == 0) {
+            co_return total;
+        }
+        throw_system_error_on(errno != EAGAIN, "splice");
+        // Wait for the end that isn't ready
+        struct ::pollfd fds[2] = {{in.get_file_desc().get(), POLLIN, 0}, {to_fd, POLLOUT, 0}};
+        ::poll(fds, poll_to ? 2 : 1, 0);
+        if (!(fds[0].revents & (POLLIN | POLLHUP))) {
+            co_await in.readable();
+        } else if (poll_to) {
+            co_await out->writeable();
+        }
+    }
+}
 }
 
 process::process(create_tag, pid_t pid, file_desc&& cin, file_desc&& cout, file_desc&& cerr)
@@ -158,4 +204,12 @@ input_stream<char> process::cerr() {
     return input_stream<char>(data_source(pipe_data_source_impl::from_fd(std::move(_stderr))));
 }
 
+future<uint64_t> process::splice_cout(file_desc out) {
+    return splice_all(std::move(_stdout), std::move(out));
+}
+
+future<uint64_t> process::splice_cerr(file_desc out) {
+    return splice_all(std::move(_stderr), std::move(out));
+}
+
 }
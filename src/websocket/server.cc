@@ -20,6 +20,7 @@
  */
 
 #include <seastar/websocket/server.hh>
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/gate.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/util/defer.hh>
@@ -29,6 +30,7 @@
 #include <seastar/http/request.hh>
 #include <gnutls/crypto.h>
 #include <gnutls/gnutls.h>
+#include <zlib.h>
 
 namespace seastar::experimental::websocket {
 
@@ -42,6 +44,249 @@ static sstring http_upgrade_reply_template =
 
 static logger wlogger("websocket");
 
+// The trailer of the empty stored block a sync flush ends with
+static constexpr char deflate_tail[] = { '\0', '\0', '\xff', '\xff' };
+
+static void check_zlib_init(int ret) {
+    if (ret == Z_MEM_ERROR) {
+        throw std::bad_alloc();
+    } else if (ret != Z_OK) {
+        throw websocket::exception(fmt::format("Failed to initialize zlib: {}", ret));
+    }
+}
+
+static int deflate_level(const deflate_config& cfg) noexcept {
+    return cfg.level ? std::clamp(cfg.level, Z_BEST_SPEED, Z_BEST_COMPRESSION) : Z_DEFAULT_COMPRESSION;
+}
+
+// Compresses a whole message, as permessage-deflate sends it
+static temporary_buffer<char> deflate_message(z_stream& zs, const char* data, size_t size) {
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = size;
+    // Room for the sync flush marker comes on top of the bound
+    temporary_buffer<char> out(deflateBound(&zs, size) + 16);
+    size_t produced = 0;
+    for (;;) {
+        zs.next_out = reinterpret_cast<Bytef*>(out.get_write() + produced);
+        zs.avail_out = out.size() - produced;
+        if (::deflate(&zs, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+            throw websocket::exception("deflate failed");
+        }
+        produced = out.size() - zs.avail_out;
+        if (zs.avail_out) {
+            break;
+        }
+        temporary_buffer<char> bigger(out.size() * 2);
+        std::copy_n(out.get(), produced, bigger.get_write());
+        out = std::move(bigger);
+    }
+    auto tail_size = sizeof(deflate_tail);
+    if (produced < tail_size || !std::equal(deflate_tail, deflate_tail + tail_size, out.get() + produced - tail_size)) {
+        throw websocket::exception("deflate didn't end in a sync flush");
+    }
+    out.trim(produced - tail_size);
+    return out;
+}
+
+// The state of the permessage-deflate extension of a connection (RFC 7692).
+// Messages are compressed with raw deflate, without the zlib wrapper, and
+// end with an empty stored block whose trailer is left out.
+class permessage_deflate {
+    static constexpr size_t chunk_size = 16 * 1024;
+    z_stream _deflate = {};
+    z_stream _inflate = {};
+    bool _server_no_context_takeover;
+    int _window_bits;
+    size_t _min_size;
+    // Whether the last inflate() filled the output, so more may be pending
+    bool _pending = false;
+public:
+    permessage_deflate(const deflate_config& cfg, bool server_no_context_takeover, int window_bits)
+            : _server_no_context_takeover(server_no_context_takeover)
+            , _window_bits(window_bits)
+            , _min_size(cfg.min_size) {
+        // Negative window bits select raw deflate
+        auto ret = deflateInit2(&_deflate, deflate_level(cfg), Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY);
+        if (ret == Z_OK) {
+            // The clients' window isn't limited, see negotiate_deflate()
+            ret = inflateInit2(&_inflate, -MAX_WBITS);
+            if (ret != Z_OK) {
+                deflateEnd(&_deflate);
+            }
+        }
+        check_zlib_init(ret);
+    }
+    permessage_deflate(const permessage_deflate&) = delete;
+    ~permessage_deflate() {
+        deflateEnd(&_deflate);
+        inflateEnd(&_inflate);
+    }
+    size_t min_size() const noexcept {
+        return _min_size;
+    }
+    // Whether messages compressed from scratch, with the default window,
+    // can be sent on the connection
+    bool accepts_shared_compression() const noexcept {
+        return _server_no_context_takeover && _window_bits == MAX_WBITS;
+    }
+    // Compresses a whole message
+    temporary_buffer<char> compress(const char* data, size_t size) {
+        auto out = deflate_message(_deflate, data, size);
+        if (_server_no_context_takeover) {
+            deflateReset(&_deflate);
+        }
+        return out;
+    }
+    // Hands part of a compressed message to the inflater. The data must be
+    // kept until inflate_some() consumed it.
+    void feed(const char* data, size_t size) noexcept {
+        _inflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _inflate.avail_in = size;
+    }
+    // Hands the end of a message to the inflater
+    void feed_tail() noexcept {
+        feed(deflate_tail, sizeof(deflate_tail));
+    }
+    // Inflates up to one chunk of what was fed, so a message which
+    // decompresses to a lot is handed out piece by piece. Returns an empty
+    // buffer once all of it was inflated.
+    temporary_buffer<char> inflate_some() {
+        for (;;) {
+            if (!_inflate.avail_in && !_pending) {
+                return {};
+            }
+            temporary_buffer<char> buf(chunk_size);
+            _inflate.next_out = reinterpret_cast<Bytef*>(buf.get_write());
+            _inflate.avail_out = buf.size();
+            auto ret = ::inflate(&_inflate, Z_SYNC_FLUSH);
+            if (ret == Z_STREAM_END) {
+                // The sender ended the deflate stream, the next message
+                // starts a new one
+                inflateReset(&_inflate);
+            } else if (ret == Z_MEM_ERROR) {
+                throw std::bad_alloc();
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                throw websocket::exception("Invalid compressed message");
+            }
+            _pending = !_inflate.avail_out;
+            if (_inflate.avail_out < buf.size()) {
+                buf.trim(buf.size() - _inflate.avail_out);
+                return buf;
+            }
+        }
+    }
+};
+
+void connection::deflate_deleter::operator()(permessage_deflate* d) const noexcept {
+    delete d;
+}
+
+namespace {
+
+struct deflate_params {
+    bool server_no_context_takeover = false;
+    bool client_no_context_takeover = false;
+    std::optional<int> server_max_window_bits;
+};
+
+std::string_view trim(std::string_view s) noexcept {
+    auto b = s.find_first_not_of(" \t");
+    if (b == std::string_view::npos) {
+        return {};
+    }
+    return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+}
+
+// Parses one permessage-deflate offer, e.g. "permessage-deflate; client_max_window_bits"
+std::optional<deflate_params> parse_deflate_offer(std::string_view offer) {
+    auto next = [&offer] {
+        auto pos = offer.find(';');
+        auto part = trim(offer.substr(0, pos));
+        offer = pos == std::string_view::npos ? std::string_view() : offer.substr(pos + 1);
+        return part;
+    };
+    if (next() != "permessage-deflate") {
+        return std::nullopt;
+    }
+    deflate_params params;
+    bool client_max_window_bits = false;
+    while (!offer.empty()) {
+        auto param = next();
+        auto eq = param.find('=');
+        auto name = trim(param.substr(0, eq));
+        std::optional<std::string_view> value;
+        if (eq != std::string_view::npos) {
+            value = trim(param.substr(eq + 1));
+            if (value->size() >= 2 && value->front() == '"' && value->back() == '"') {
+                value = value->substr(1, value->size() - 2);
+            }
+        }
+        auto window_bits = [&value] () -> std::optional<int> {
+            if (value && value->size() <= 2 && !value->empty()
+                    && std::all_of(value->begin(), value->end(), [] (char c) { return c >= '0' && c <= '9'; })) {
+                auto bits = std::stoi(std::string(*value));
+                if (bits >= 8 && bits <= 15) {
+                    return bits;
+                }
+            }
+            return std::nullopt;
+        };
+        // A parameter given twice, or one we don't know, declines the offer
+        if (name == "server_no_context_takeover" && !value && !params.server_no_context_takeover) {
+            params.server_no_context_takeover = true;
+        } else if (name == "client_no_context_takeover" && !value && !params.client_no_context_takeover) {
+            params.client_no_context_takeover = true;
+        } else if (name == "server_max_window_bits" && !params.server_max_window_bits) {
+            params.server_max_window_bits = window_bits();
+            // zlib's raw deflate doesn't do with a window of 256 bytes
+            if (!params.server_max_window_bits || *params.server_max_window_bits == 8) {
+                return std::nullopt;
+            }
+        } else if (name == "client_max_window_bits" && !client_max_window_bits) {
+            // The client may limit its window, keeping it at 15 bits is
+            // fine by us
+            if (value && !window_bits()) {
+                return std::nullopt;
+            }
+            client_max_window_bits = true;
+        } else {
+            return std::nullopt;
+        }
+    }
+    return params;
+}
+
+// Picks the first acceptable offer of a Sec-WebSocket-Extensions header
+std::optional<deflate_params> negotiate_deflate(std::string_view header, const deflate_config& cfg) {
+    while (!header.empty()) {
+        auto pos = header.find(',');
+        auto params = parse_deflate_offer(header.substr(0, pos));
+        if (params) {
+            params->server_no_context_takeover |= cfg.server_no_context_takeover;
+            params->client_no_context_takeover |= cfg.client_no_context_takeover;
+            return params;
+        }
+        header = pos == std::string_view::npos ? std::string_view() : header.substr(pos + 1);
+    }
+    return std::nullopt;
+}
+
+sstring to_extension_header(const deflate_params& params) {
+    sstring res = "permessage-deflate";
+    if (params.server_no_context_takeover) {
+        res += "; server_no_context_takeover";
+    }
+    if (params.client_no_context_takeover) {
+        res += "; client_no_context_takeover";
+    }
+    if (params.server_max_window_bits) {
+        res += format("; server_max_window_bits={}", *params.server_max_window_bits);
+    }
+    return res;
+}
+
+}
+
 opcodes websocket_parser::opcode() const {
     if (_header) {
         return opcodes(_header->opcode);
@@ -119,7 +364,7 @@ void connection::on_new_connection() {
 }
 
 future<> connection::process() {
-    return when_all_succeed(read_loop(), response_loop()).discard_result().handle_exception([] (const std::exception_ptr& e) {
+    return when_all_succeed(read_loop(), response_loop(), broadcast_loop()).discard_result().handle_exception([] (const std::exception_ptr& e) {
         wlogger.debug("Processing failed: {}", e);
     });
 }
@@ -170,7 +415,7 @@ future<> connection::read_http_upgrade_request() {
         if (!_server.is_handler_registered(subprotocol)) {
             return make_exception_future<>(websocket::exception("Subprotocol not supported."));
         }
-        this->_handler = this->_server._handlers[subprotocol];
+        auto handler = this->_server._handlers[subprotocol];
         this->_subprotocol = subprotocol;
         wlogger.debug("Sec-WebSocket-Protocol: {}", subprotocol);
 
@@ -184,16 +429,33 @@ future<> connection::read_http_upgrade_request() {
         std::string sha1_output = sha1_base64(sha1_input);
         wlogger.debug("SHA1 output: {} of size {}", sha1_output, sha1_output.size());
 
+        sstring extensions;
+        if (_server._deflate_config) {
+            auto params = negotiate_deflate(req->get_header("Sec-WebSocket-Extensions"), *_server._deflate_config);
+            if (params) {
+                _deflate.reset(new permessage_deflate(*_server._deflate_config, params->server_no_context_takeover,
+                        params->server_max_window_bits.value_or(MAX_WBITS)));
+                _websocket_parser.enable_compression();
+                extensions = "\r\nSec-WebSocket-Extensions: " + to_extension_header(*params);
+                wlogger.debug("Sec-WebSocket-Extensions: {}", extensions);
+            }
+        }
+
         return _write_buf.write(http_upgrade_reply_template).then([this, sha1_output = std::move(sha1_output)] {
             return _write_buf.write(sha1_output);
         }).then([this] {
             return _write_buf.write("\r\nSec-WebSocket-Protocol: ", 26);
         }).then([this] {
             return _write_buf.write(_subprotocol);
+        }).then([this, extensions = std::move(extensions)] {
+            return _write_buf.write(extensions);
         }).then([this] {
             return _write_buf.write("\r\n\r\n", 4);
         }).then([this] {
             return _write_buf.flush();
+        }).then([this, handler = std::move(handler)] {
+            // Set once the handshake is over, broadcasts wait for it
+            _handler = std::move(handler);
         });
     });
 }
@@ -216,14 +478,20 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
 
                 // https://datatracker.ietf.org/doc/html/rfc6455#section-5.1
                 // We must close the connection if data isn't masked.
+                bool data_frame = _header->opcode == opcodes::TEXT || _header->opcode == opcodes::BINARY;
                 if ((!_header->masked) ||
-                        // RSVX must be 0
-                        (_header->rsv1 | _header->rsv2 | _header->rsv3) ||
+                        // RSVX must be 0, but for RSV1 of the first frame
+                        // of a message compressed with permessage-deflate
+                        (_header->rsv2 | _header->rsv3) ||
+                        (_header->rsv1 && !(_compression && data_frame)) ||
                         // Opcode must be known.
                         (!_header->is_opcode_known())) {
                     _cstate = connection_state::error;
                     return websocket_parser::stop(std::move(data));
                 }
+                if (data_frame) {
+                    _compressed = _header->rsv1;
+                }
             }
             _state = parsing_state::payload_length_and_mask;
         } else {
@@ -261,10 +529,12 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
             _payload_length -= data.size();
             remove_mask(data, data.size());
             _result = std::move(data);
+            _frame_done = false;
             return websocket_parser::stop(buff_t(0));
         } else {
-            _result = data.clone();
+            _result = data.share(0, _payload_length);
             remove_mask(_result, _payload_length);
+            _frame_done = true;
             data.trim_front(_payload_length);
             _payload_length = 0;
             _state = parsing_state::flags_and_payload_data;
@@ -295,7 +565,10 @@ future<> connection::read_one() {
                 case opcodes::CONTINUATION:
                 case opcodes::TEXT:
                 case opcodes::BINARY:
-                    return _input_buffer.push_eventually(_websocket_parser.result());
+                    return read_data().handle_exception([this] (std::exception_ptr ep) {
+                        wlogger.debug("Receiving a message failed: {}", ep);
+                        return close(true);
+                    });
                 case opcodes::CLOSE:
                     wlogger.debug("Received close frame.");
                     /*
@@ -320,6 +593,32 @@ future<> connection::read_one() {
     });
 }
 
+future<> connection::read_data() {
+    auto data = _websocket_parser.result();
+    if (!_websocket_parser.compressed()) {
+        // An empty buffer would read as the end of the stream
+        if (!data.empty()) {
+            co_await _input_buffer.push_eventually(std::move(data));
+        }
+        co_return;
+    }
+    // Frames are inflated as they arrive, the message isn't assembled
+    bool message_end = _websocket_parser.frame_done() && _websocket_parser.fin();
+    _deflate->feed(data.get(), data.size());
+    for (;;) {
+        auto buf = _deflate->inflate_some();
+        if (buf.empty()) {
+            if (!message_end) {
+                break;
+            }
+            message_end = false;
+            _deflate->feed_tail();
+            continue;
+        }
+        co_await _input_buffer.push_eventually(std::move(buf));
+    }
+}
+
 future<> connection::read_loop() {
     return read_http_upgrade_request().then([this] {
         return when_all_succeed(
@@ -348,38 +647,101 @@ future<> connection::close(bool send_close) {
         }
     }().finally([this] {
         _done = true;
+        _broadcast_cv.broadcast();
         return when_all_succeed(_input.close(), _output.close()).discard_result().finally([this] {
             _fd.shutdown_output();
         });
     });
 }
 
-future<> connection::send_data(opcodes opcode, temporary_buffer<char>&& buff) {
-    char header[10] = {'\x80', 0};
-    size_t header_size = 2;
+static constexpr size_t max_frame_header_size = 10;
 
-    header[0] += opcode;
+// Encodes the header of an unmasked, final frame. RSV1 marks messages
+// compressed with permessage-deflate.
+static size_t encode_frame_header(char* header, opcodes opcode, bool compressed, size_t size) {
+    size_t header_size = 2;
+    header[0] = char(0x80 | opcode | (compressed ? 0x40 : 0));
 
-    if ((126 <= buff.size()) && (buff.size() <= std::numeric_limits<uint16_t>::max())) {
+    if ((126 <= size) && (size <= std::numeric_limits<uint16_t>::max())) {
         header[1] = 0x7E;
-        write_be<uint16_t>(header + 2, buff.size());
+        write_be<uint16_t>(header + 2, size);
         header_size += sizeof(uint16_t);
-    } else if (std::numeric_limits<uint16_t>::max() < buff.size()) {
+    } else if (std::numeric_limits<uint16_t>::max() < size) {
         header[1] = 0x7F;
-        write_be<uint64_t>(header + 2, buff.size());
+        write_be<uint64_t>(header + 2, size);
         header_size += sizeof(uint64_t);
     } else {
-        header[1] = uint8_t(buff.size());
+        header[1] = uint8_t(size);
     }
+    return header_size;
+}
+
+future<> connection::send_data(opcodes opcode, temporary_buffer<char>&& buff) {
+    return with_semaphore(_send_sem, 1, [this, opcode, buff = std::move(buff)] () mutable {
+        // Compressed under the semaphore, so that messages are sent in
+        // the order they went through the compression context
+        bool compressed = false;
+        if (_deflate && (opcode == opcodes::TEXT || opcode == opcodes::BINARY) && buff.size() >= _deflate->min_size()) {
+            buff = _deflate->compress(buff.get(), buff.size());
+            compressed = true;
+        }
+        char header[max_frame_header_size];
+        auto header_size = encode_frame_header(header, opcode, compressed, buff.size());
 
-    scattered_message<char> msg;
-    msg.append(sstring(header, header_size));
-    msg.append(std::move(buff));
-    return _write_buf.write(std::move(msg)).then([this] {
-        return _write_buf.flush();
+        scattered_message<char> msg;
+        msg.append(sstring(header, header_size));
+        msg.append(std::move(buff));
+        return _write_buf.write(std::move(msg)).then([this] {
+            return _write_buf.flush();
+        });
     });
 }
 
+future<> connection::send_frame(temporary_buffer<char> frame) {
+    return with_semaphore(_send_sem, 1, [this, frame = std::move(frame)] () mutable {
+        if (_done) {
+            return make_ready_future<>();
+        }
+        scattered_message<char> msg;
+        msg.append(std::move(frame));
+        return _write_buf.write(std::move(msg)).then([this] {
+            return _write_buf.flush();
+        });
+    });
+}
+
+bool connection::enqueue_broadcast(temporary_buffer<char> frame, size_t max_pending) {
+    if (_broadcasts.size() >= max_pending) {
+        // Too slow to keep up. The reader sees the input end and closes
+        // the connection.
+        wlogger.debug("Closing a connection which doesn't keep up with broadcasts");
+        _evicted = true;
+        _broadcasts.clear();
+        _fd.shutdown_input();
+        return false;
+    }
+    _broadcasts.push_back(std::move(frame));
+    _broadcast_cv.signal();
+    return true;
+}
+
+bool connection::accepts_shared_compression() const noexcept {
+    return _deflate && _deflate->accepts_shared_compression();
+}
+
+future<> connection::broadcast_loop() {
+    for (;;) {
+        co_await _broadcast_cv.wait([this] { return _done || !_broadcasts.empty(); });
+        if (_done) {
+            _broadcasts.clear();
+            co_return;
+        }
+        auto frame = std::move(_broadcasts.front());
+        _broadcasts.pop_front();
+        co_await send_frame(std::move(frame));
+    }
+}
+
 future<> connection::response_loop() {
     return do_until([this] {return _done;}, [this] {
         // FIXME: implement error handling
@@ -388,7 +750,9 @@ future<> connection::response_loop() {
             return send_data(opcodes::BINARY, std::move(buf));
         });
     }).finally([this]() {
-        return _write_buf.close();
+        return with_semaphore(_send_sem, 1, [this] {
+            return _write_buf.close();
+        });
     });
 }
 
@@ -400,4 +764,55 @@ void server::register_handler(std::string&& name, handler_t handler) {
     _handlers[name] = handler;
 }
 
+void server::set_deflate(std::optional<deflate_config> cfg) {
+    _deflate_config = std::move(cfg);
+}
+
+void server::set_max_pending_broadcasts(size_t n) noexcept {
+    _max_pending_broadcasts = n;
+}
+
+static temporary_buffer<char> encode_frame(opcodes opcode, bool compressed, const char* data, size_t size) {
+    char header[max_frame_header_size];
+    auto header_size = encode_frame_header(header, opcode, compressed, size);
+    temporary_buffer<char> frame(header_size + size);
+    std::copy_n(header, header_size, frame.get_write());
+    std::copy_n(data, size, frame.get_write() + header_size);
+    return frame;
+}
+
+size_t server::broadcast(std::string_view subprotocol, temporary_buffer<char> message, opcodes opcode) {
+    temporary_buffer<char> plain;
+    temporary_buffer<char> compressed;
+    bool compress = _deflate_config && (opcode == opcodes::TEXT || opcode == opcodes::BINARY)
+            && message.size() >= _deflate_config->min_size;
+    size_t queued = 0;
+    for (auto it = _connections.begin(); it != _connections.end(); ) {
+        auto& c = *it++;
+        if (c._done || c._evicted || !c._handler || c._subprotocol != subprotocol) {
+            continue;
+        }
+        // Shared by all the connections, encoded on first use
+        temporary_buffer<char>* frame = &plain;
+        if (compress && c.accepts_shared_compression()) {
+            frame = &compressed;
+            if (compressed.empty()) {
+                z_stream zs = {};
+                check_zlib_init(deflateInit2(&zs, deflate_level(*_deflate_config), Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+                auto end = defer([&zs] () noexcept { deflateEnd(&zs); });
+                auto payload = deflate_message(zs, message.get(), message.size());
+                compressed = encode_frame(opcode, true, payload.get(), payload.size());
+            }
+        } else if (plain.empty()) {
+            plain = encode_frame(opcode, false, message.get(), message.size());
+        }
+        if (c.enqueue_broadcast(frame->share(), _max_pending_broadcasts)) {
+            ++queued;
+        } else {
+            ++_evicted_connections;
+        }
+    }
+    return queued;
+}
+
 }
@@ -93,6 +93,11 @@ PERF_TEST_F(alloc_bench, new_array_only)   { return alloc_test<small_alloc_size,
 PERF_TEST_F(alloc_bench, delete_array_only){ return alloc_test<small_alloc_size, MEASURE_FREE, cpp_array_funcs>(); }
 PERF_TEST_F(alloc_bench, array_new_delete) { return alloc_test<small_alloc_size, MEASURE_BOTH, cpp_array_funcs>(); }
 
+// The same on all the shards at once, where the allocator shares the
+// address space and the kernel with the others
+PERF_TEST_SHARDED_F(alloc_bench, malloc_free_sharded) { return alloc_test<small_alloc_size, MEASURE_BOTH, c_funcs>(); }
+PERF_TEST_SHARDED_F(alloc_bench, alloc_free_large_sharded) { return alloc_test<large_alloc_size, MEASURE_BOTH, c_funcs>(); }
+
 PERF_TEST_F(alloc_bench, alloc_only_large) { return alloc_test<large_alloc_size, MEASURE_ALLOC, c_funcs>(); }
 PERF_TEST_F(alloc_bench, free_only_large ) { return alloc_test<large_alloc_size, MEASURE_FREE, c_funcs>(); }
 PERF_TEST_F(alloc_bench, alloc_free_large) { return alloc_test<large_alloc_size, MEASURE_BOTH, c_funcs>(); }
@@ -23,6 +23,7 @@
 
 #include <seastar/core/coroutine.hh>
 #include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/util/later.hh>
 
 struct coroutine_test {
 };
@@ -46,3 +47,34 @@ PERF_TEST_C(coroutine_test, maybe_yield)
 {
     co_await coroutine::maybe_yield();
 }
+
+[[gnu::noinline]]
+future<> call_chain(unsigned depth)
+{
+    if (depth) {
+        co_await call_chain(depth - 1);
+    }
+}
+
+// A frame per call, most from the per shard freelists
+PERF_TEST_C(coroutine_test, call_chain_8)
+{
+    co_await call_chain(8);
+}
+
+[[gnu::noinline]]
+future<> yielding_call_chain(unsigned depth)
+{
+    if (depth) {
+        co_await yielding_call_chain(depth - 1);
+    } else {
+        co_await yield();
+    }
+}
+
+// Each level resumes the one above through the task queue, or directly
+// with --coroutine-direct-resume
+PERF_TEST_C(coroutine_test, yielding_call_chain_8)
+{
+    co_await yielding_call_chain(8);
+}
@@ -31,10 +31,13 @@
 
 static constexpr fair_queue::class_id cid = 0;
 
+enum class queue_kind { local, shared, leased };
+
 struct local_fq_and_class {
     seastar::fair_group fg;
     seastar::fair_queue fq;
     seastar::fair_queue sfq;
+    seastar::fair_queue lfq;
     unsigned executed = 0;
 
     static fair_group::config fg_config() {
@@ -42,20 +45,30 @@ struct local_fq_and_class {
         return cfg;
     }
 
-    seastar::fair_queue& queue(bool local) noexcept { return local ? fq : sfq; }
+    seastar::fair_queue& queue(queue_kind kind) noexcept {
+        switch (kind) {
+        case queue_kind::local: return fq;
+        case queue_kind::shared: return sfq;
+        case queue_kind::leased: return lfq;
+        }
+        std::abort();
+    }
 
-    local_fq_and_class(seastar::fair_group& sfg)
+    local_fq_and_class(seastar::fair_group& sfg, seastar::fair_group& lfg)
         : fg(fg_config(), 1)
         , fq(fg, seastar::fair_queue::config())
         , sfq(sfg, seastar::fair_queue::config())
+        , lfq(lfg, seastar::fair_queue::config())
     {
         fq.register_priority_class(cid, 1);
         sfq.register_priority_class(cid, 1);
+        lfq.register_priority_class(cid, 1);
     }
 
     ~local_fq_and_class() {
         fq.unregister_priority_class(cid);
         sfq.unregister_priority_class(cid);
+        lfq.unregister_priority_class(cid);
     }
 };
 
@@ -76,26 +89,34 @@ struct perf_fair_queue {
     seastar::sharded<local_fq_and_class> local_fq;
 
     seastar::fair_group shared_fg;
+    seastar::fair_group leased_fg;
 
     static fair_group::config fg_config() {
         fair_group::config cfg;
         return cfg;
     }
 
+    static fair_group::config leased_fg_config() {
+        fair_group::config cfg;
+        cfg.lease_duration = std::chrono::microseconds(100);
+        return cfg;
+    }
+
     perf_fair_queue()
         : shared_fg(fg_config(), smp::count)
+        , leased_fg(leased_fg_config(), smp::count)
     {
-        local_fq.start(std::ref(shared_fg)).get();
+        local_fq.start(std::ref(shared_fg), std::ref(leased_fg)).get();
     }
 
     ~perf_fair_queue() {
         local_fq.stop().get();
     }
 
-    future<> test(bool local);
+    future<> test(queue_kind kind);
 };
 
-future<> perf_fair_queue::test(bool loc) {
+future<> perf_fair_queue::test(queue_kind loc) {
 
     auto invokers = local_fq.invoke_on_all([loc] (local_fq_and_class& local) {
         return parallel_for_each(boost::irange(0u, requests_to_dispatch), [&local, loc] (unsigned dummy) {
@@ -135,9 +156,13 @@ future<> perf_fair_queue::test(bool loc) {
 
 PERF_TEST_F(perf_fair_queue, contended_local)
 {
-    return test(true);
+    return test(queue_kind::local);
 }
 PERF_TEST_F(perf_fair_queue, contended_shared)
 {
-    return test(false);
+    return test(queue_kind::shared);
+}
+PERF_TEST_F(perf_fair_queue, contended_leased)
+{
+    return test(queue_kind::leased);
 }
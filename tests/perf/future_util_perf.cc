@@ -26,6 +26,8 @@
 #include <seastar/core/coroutine.hh>
 #include <seastar/coroutine/parallel_for_each.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/core/smp.hh>
 #include <seastar/util/later.hh>
 
 struct parallel_for_each {
@@ -347,3 +349,28 @@ PERF_TEST_CN(parallel_for_each, cor_pfe_suspend_100)
     perf_tests::do_not_optimize(value);
     co_return range.size();
 }
+
+PERF_TEST_F(parallel_for_each, when_all_suspend_100)
+{
+    std::vector<future<>> futures;
+    futures.reserve(range.size());
+    for (auto v : range) {
+        futures.push_back(suspend(v, value));
+    }
+    return seastar::when_all_succeed(futures.begin(), futures.end()).then([this] {
+        perf_tests::do_not_optimize(value);
+        return range.size();
+    });
+}
+
+// Round trip to the next shard, and back
+PERF_TEST_LATENCY(smp, submit_to_next_shard)
+{
+    return smp::submit_to((this_shard_id() + 1) % smp::count, [] {});
+}
+
+// The same from all the shards at once
+PERF_TEST_SHARDED(smp, submit_to_next_shard_sharded)
+{
+    return smp::submit_to((this_shard_id() + 1) % smp::count, [] {});
+}
@@ -0,0 +1,377 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+// Measures the network stack the reactor is configured with
+// (--network-stack, --reactor-backend and the native stack options):
+//
+//  * latency: one message in flight on each connection, which is echoed
+//  * rate: --depth messages in flight on each connection
+//  * bulk: streams messages to the server, which discards them
+//
+// By default the server and the clients run in the same process and talk
+// over loopback, which only works with the posix stack. To measure the
+// native stack, run --role server and --role client on different machines.
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <vector>
+#include <sys/resource.h>
+#include <boost/range/irange.hpp>
+#include <fmt/core.h>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/coroutine/as_future.hh>
+#include <seastar/coroutine/parallel_for_each.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/inet_address.hh>
+#include <seastar/util/defer.hh>
+#include "../../apps/lib/stop_signal.hh"
+
+using namespace seastar;
+using namespace std::chrono;
+
+// The first byte a client sends tells the server what to do with the rest
+enum class test_type : char { latency = 'l', rate = 'r', bulk = 'b' };
+
+static test_type parse_test_type(const std::string& s) {
+    if (s == "latency") {
+        return test_type::latency;
+    }
+    if (s == "rate") {
+        return test_type::rate;
+    }
+    if (s == "bulk") {
+        return test_type::bulk;
+    }
+    throw std::runtime_error("unknown test type");
+}
+
+static duration<double> cpu_time() {
+    struct ::rusage ru;
+    ::getrusage(RUSAGE_THREAD, &ru);
+    auto tv = [] (const ::timeval& t) {
+        return duration<double>(t.tv_sec + t.tv_usec * 1e-6);
+    };
+    return tv(ru.ru_utime) + tv(ru.ru_stime);
+}
+
+class server {
+    std::optional<server_socket> _listener;
+    future<> _accepting = make_ready_future<>();
+    gate _connections;
+
+    static future<> respond(input_stream<char>& in, output_stream<char>& out) {
+        auto type = co_await in.read_exactly(1);
+        if (type.empty()) {
+            co_return;
+        }
+        bool echo = type[0] != char(test_type::bulk);
+        while (true) {
+            auto buf = co_await in.read();
+            if (buf.empty()) {
+                co_return;
+            }
+            if (echo) {
+                co_await out.write(std::move(buf));
+                co_await out.flush();
+            }
+        }
+    }
+
+    static future<> serve(connected_socket s) {
+        auto in = s.input();
+        auto out = s.output();
+        // Clients may reset their connections at the end of a test
+        auto f = co_await coroutine::as_future(respond(in, out));
+        f.ignore_ready_future();
+        f = co_await coroutine::as_future(out.close());
+        f.ignore_ready_future();
+    }
+
+    future<> accept_loop() {
+        while (true) {
+            auto f = co_await coroutine::as_future(_listener->accept());
+            if (f.failed()) {
+                // aborted by stop()
+                f.ignore_ready_future();
+                co_return;
+            }
+            auto ar = f.get();
+            ar.connection.set_nodelay(true);
+            (void)with_gate(_connections, [s = std::move(ar.connection)] () mutable {
+                return serve(std::move(s));
+            });
+        }
+    }
+
+public:
+    void start(uint16_t port) {
+        listen_options lo;
+        lo.reuse_address = true;
+        _listener = seastar::listen(make_ipv4_address({port}), lo);
+        _accepting = accept_loop();
+    }
+
+    future<> stop() {
+        if (_listener) {
+            _listener->abort_accept();
+        }
+        co_await std::move(_accepting);
+        co_await _connections.close();
+    }
+};
+
+class client {
+public:
+    struct config {
+        test_type type;
+        size_t size;
+        unsigned connections;
+        unsigned depth;
+        socket_address server;
+    };
+
+    struct result {
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        duration<double> cpu;
+        // microseconds
+        std::vector<float> latencies;
+    };
+
+private:
+    const config _cfg;
+    temporary_buffer<char> _message;
+    std::vector<connected_socket> _sockets;
+    bool _stop = false;
+    future<> _done = make_ready_future<>();
+    result _result;
+
+    // The messages in flight of a request/response connection
+    struct exchange {
+        semaphore window;
+        // Signalled once per message sent, and once more when the
+        // writer is done
+        semaphore due{0};
+        std::deque<steady_clock::time_point> sent;
+
+        explicit exchange(unsigned depth) : window(depth) {}
+    };
+
+    future<> write_requests(output_stream<char>& out, exchange& ex) {
+        while (!_stop) {
+            co_await ex.window.wait();
+            if (_stop) {
+                break;
+            }
+            ex.sent.push_back(steady_clock::now());
+            co_await out.write(_message.share());
+            co_await out.flush();
+            ex.due.signal();
+        }
+        ex.due.signal();
+    }
+
+    future<> read_responses(input_stream<char>& in, exchange& ex) {
+        while (true) {
+            co_await ex.due.wait();
+            if (ex.sent.empty()) {
+                co_return;
+            }
+            auto buf = co_await in.read_exactly(_cfg.size);
+            if (buf.size() != _cfg.size) {
+                throw std::runtime_error("connection closed by the server");
+            }
+            auto sent = ex.sent.front();
+            ex.sent.pop_front();
+            _result.latencies.push_back(duration<float, std::micro>(steady_clock::now() - sent).count());
+            _result.messages++;
+            _result.bytes += _cfg.size;
+            ex.window.signal();
+        }
+    }
+
+    future<> send_bulk(output_stream<char>& out) {
+        while (!_stop) {
+            co_await out.write(_message.share());
+            _result.messages++;
+            _result.bytes += _cfg.size;
+        }
+        co_await out.flush();
+    }
+
+    future<> run(connected_socket& s) {
+        auto in = s.input();
+        auto out = s.output();
+        char type = char(_cfg.type);
+        co_await out.write(&type, 1);
+        if (_cfg.type == test_type::bulk) {
+            co_await send_bulk(out);
+        } else {
+            exchange ex(_cfg.type == test_type::latency ? 1 : _cfg.depth);
+            co_await when_all_succeed(write_requests(out, ex), read_responses(in, ex)).discard_result();
+        }
+        co_await out.close();
+        co_await in.close();
+    }
+
+public:
+    explicit client(config cfg)
+        : _cfg(cfg)
+        , _message(cfg.size)
+    {
+        std::fill_n(_message.get_write(), _message.size(), 'x');
+    }
+
+    future<> connect() {
+        for (unsigned i = 0; i < _cfg.connections; i++) {
+            auto s = co_await seastar::connect(_cfg.server);
+            s.set_nodelay(true);
+            _sockets.push_back(std::move(s));
+        }
+    }
+
+    void start() {
+        _result.cpu = -cpu_time();
+        _done = parallel_for_each(_sockets, [this] (connected_socket& s) {
+            return run(s);
+        });
+    }
+
+    future<> finish() {
+        _stop = true;
+        co_await std::move(_done);
+        _result.cpu += cpu_time();
+    }
+
+    future<> stop() {
+        if (!_stop) {
+            co_await finish();
+        }
+    }
+
+    result get_result() const {
+        return _result;
+    }
+};
+
+static void run_clients(client::config cfg, seconds test_duration) {
+    sharded<client> clients;
+    clients.start(cfg).get();
+    auto stop_clients = defer([&] () noexcept {
+        clients.stop().get();
+    });
+    clients.invoke_on_all(&client::connect).get();
+
+    auto start = steady_clock::now();
+    clients.invoke_on_all(&client::start).get();
+    seastar::sleep(test_duration).get();
+    clients.invoke_on_all(&client::finish).get();
+    auto elapsed = duration_cast<duration<double>>(steady_clock::now() - start);
+
+    client::result total;
+    for (unsigned i = 0; i < smp::count; i++) {
+        auto r = clients.invoke_on(i, &client::get_result).get();
+        total.messages += r.messages;
+        total.bytes += r.bytes;
+        total.cpu += r.cpu;
+        total.latencies.insert(total.latencies.end(), r.latencies.begin(), r.latencies.end());
+    }
+
+    fmt::print("{} connections, {} byte messages, took {:.1f}s\n",
+            smp::count * cfg.connections, cfg.size, elapsed.count());
+    fmt::print("rate: {:.0f} messages/s\n", total.messages / elapsed.count());
+    fmt::print("throughput: {:.1f} MB/s\n", total.bytes / elapsed.count() / 1e6);
+    if (!total.latencies.empty()) {
+        auto& l = total.latencies;
+        auto percentile = [&] (double p) {
+            auto it = l.begin() + std::min(size_t(l.size() * p), l.size() - 1);
+            std::nth_element(l.begin(), it, l.end());
+            return *it;
+        };
+        fmt::print("latency: p50 {:.1f}us p99 {:.1f}us max {:.1f}us\n",
+                percentile(0.5), percentile(0.99), *std::max_element(l.begin(), l.end()));
+    }
+    // With --role both, this includes the CPU time of the server
+    fmt::print("cpu: {:.1f}% of {} shards, {:.2f} ns/byte\n",
+            total.cpu.count() * 100 / elapsed.count() / smp::count, smp::count,
+            total.bytes ? total.cpu.count() * 1e9 / total.bytes : 0.0);
+}
+
+int main(int ac, char** av) {
+    app_template at;
+    namespace bpo = boost::program_options;
+    at.add_options()
+            ("test", bpo::value<std::string>()->default_value("latency"), "what to measure (latency, rate, bulk)")
+            ("role", bpo::value<std::string>()->default_value("both"), "run the server, the client, or both over loopback (server, client, both)")
+            ("server", bpo::value<std::string>()->default_value("127.0.0.1"), "address of the server the client connects to")
+            ("port", bpo::value<uint16_t>()->default_value(10000), "port the server listens on")
+            ("size", bpo::value<size_t>()->default_value(64), "message size (bytes)")
+            ("connections", bpo::value<unsigned>()->default_value(1), "client connections per shard")
+            ("depth", bpo::value<unsigned>()->default_value(16), "messages in flight per connection, for the rate test")
+            ("duration", bpo::value<unsigned>()->default_value(10), "time to run the test (seconds)")
+        ;
+
+    return at.run(ac, av, [&at] {
+        return async([&at] {
+            auto& opts = at.configuration();
+            auto role = opts["role"].as<std::string>();
+            if (role != "server" && role != "client" && role != "both") {
+                throw std::runtime_error("unknown role");
+            }
+            auto port = opts["port"].as<uint16_t>();
+            client::config cfg;
+            cfg.type = parse_test_type(opts["test"].as<std::string>());
+            cfg.size = opts["size"].as<size_t>();
+            cfg.connections = opts["connections"].as<unsigned>();
+            cfg.depth = opts["depth"].as<unsigned>();
+            cfg.server = socket_address(net::inet_address(opts["server"].as<std::string>()), port);
+            if (cfg.size == 0) {
+                throw std::runtime_error("messages can't be empty");
+            }
+
+            sharded<server> servers;
+            servers.start().get();
+            auto stop_servers = defer([&] () noexcept {
+                servers.stop().get();
+            });
+            if (role != "client") {
+                servers.invoke_on_all(&server::start, port).get();
+            }
+            if (role == "server") {
+                seastar_apps_lib::stop_signal stop_signal;
+                fmt::print("listening on port {}\n", port);
+                stop_signal.wait().get();
+                return;
+            }
+            run_clients(cfg, seconds(opts["duration"].as<unsigned>()));
+        });
+    });
+}
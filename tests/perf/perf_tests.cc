@@ -21,13 +21,17 @@
 
 #include <seastar/testing/perf_tests.hh>
 
+#include <cmath>
 #include <cstdio>
 #include <fstream>
+#include <optional>
+#include <random>
 #include <regex>
 
 #include <boost/range.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/range/algorithm.hpp>
+#include <boost/property_tree/json_parser.hpp>
 
 #include <fmt/ostream.h>
 
@@ -133,7 +137,7 @@ perf_stats perf_stats::snapshot(linux_perf_event* instructions_retired_counter,
     );
 }
 
-time_measurement measure_time;
+thread_local time_measurement measure_time;
 
 struct config;
 struct result;
@@ -179,6 +183,14 @@ struct result {
     double tasks = 0.;
     double inst = 0.;
     double cycles = 0.;
+
+    // Per iteration values of every run, for comparisons with other results
+    std::vector<double> time_samples;
+    std::vector<double> inst_samples;
+    std::vector<double> cycles_samples;
+
+    // Of single iterations, for the latency tests
+    std::optional<latency_histogram> latencies;
 };
 
 
@@ -219,6 +231,12 @@ struct stdout_printer final : result_printer {
     fmt::print(format_string, r.test_name, name_column_length(), r.total_iterations / r.runs, duration { r.median },
                duration { r.mad }, duration { r.min }, duration { r.max },
                r.allocs, r.tasks, r.inst, r.cycles);
+    if (r.latencies) {
+        auto& l = *r.latencies;
+        fmt::print("{:<{}} latency: p50 {} p90 {} p99 {} p99.9 {} max {}\n", "", name_column_length(),
+                   duration { double(l.quantile(0.5)) }, duration { double(l.quantile(0.9)) }, duration { double(l.quantile(0.99)) },
+                   duration { double(l.quantile(0.999)) }, duration { double(l.max()) });
+    }
   }
 
 private:
@@ -231,12 +249,15 @@ class json_printer final : public result_printer {
     std::unordered_map<std::string,
                        std::unordered_map<std::string,
                                           std::unordered_map<std::string, double>>> _root;
+    std::unordered_map<std::string,
+                       std::unordered_map<std::string, std::vector<double>>> _samples;
 public:
     explicit json_printer(const std::string& file) : _output_file(file) { }
 
     ~json_printer() {
         std::ofstream out(_output_file);
-        out << json::formatter::to_json(_root);
+        out << "{\"results\": " << json::formatter::to_json(_root["results"])
+            << ", \"samples\": " << json::formatter::to_json(_samples) << "}";
     }
 
     virtual void print_configuration(const config&) override { }
@@ -253,6 +274,176 @@ class json_printer final : public result_printer {
         result["tasks"] = r.tasks;
         result["inst"] = r.inst;
         result["cycles"] = r.cycles;
+        if (r.latencies) {
+            result["p50"] = r.latencies->quantile(0.5);
+            result["p90"] = r.latencies->quantile(0.9);
+            result["p99"] = r.latencies->quantile(0.99);
+            result["p999"] = r.latencies->quantile(0.999);
+            result["latency_max"] = r.latencies->max();
+        }
+        auto& samples = _samples[r.test_name];
+        samples["time"] = r.time_samples;
+        samples["inst"] = r.inst_samples;
+        samples["cycles"] = r.cycles_samples;
+    }
+};
+
+double median_of(std::vector<double> v) {
+    auto mid = v.begin() + v.size() / 2;
+    std::nth_element(v.begin(), mid, v.end());
+    return *mid;
+}
+
+// Two-sided p-value of the Mann-Whitney U test, with the normal
+// approximation corrected for ties
+double mann_whitney_p_value(const std::vector<double>& a, const std::vector<double>& b) {
+    std::vector<std::pair<double, bool>> all;
+    for (auto x : a) {
+        all.emplace_back(x, true);
+    }
+    for (auto x : b) {
+        all.emplace_back(x, false);
+    }
+    boost::range::sort(all);
+    double n1 = a.size();
+    double n2 = b.size();
+    double n = n1 + n2;
+    double rank_sum = 0;
+    double ties = 0;
+    for (size_t i = 0; i < all.size();) {
+        auto j = i;
+        while (j < all.size() && all[j].first == all[i].first) {
+            j++;
+        }
+        // Tied values share the average of their ranks
+        double rank = (i + 1 + j) / 2.0;
+        for (auto k = i; k < j; k++) {
+            if (all[k].second) {
+                rank_sum += rank;
+            }
+        }
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    double u = rank_sum - n1 * (n1 + 1) / 2;
+    double sigma = std::sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))));
+    if (sigma == 0) {
+        return 1;
+    }
+    double z = std::max(0.0, std::abs(u - n1 * n2 / 2) - 0.5) / sigma;
+    return std::erfc(z / std::sqrt(2.0));
+}
+
+// Confidence interval of the relative change of the median from the
+// baseline, by bootstrap
+std::pair<double, double> median_change_interval(const std::vector<double>& baseline, const std::vector<double>& current,
+        double confidence, std::mt19937& rng) {
+    constexpr unsigned resamples = 2000;
+    auto resample = [&rng] (const std::vector<double>& v) {
+        std::uniform_int_distribution<size_t> pick(0, v.size() - 1);
+        std::vector<double> r(v.size());
+        for (auto& x : r) {
+            x = v[pick(rng)];
+        }
+        return median_of(std::move(r));
+    };
+    std::vector<double> changes(resamples);
+    for (auto& c : changes) {
+        c = resample(current) / resample(baseline) - 1;
+    }
+    boost::range::sort(changes);
+    auto lo = size_t((1 - confidence) / 2 * resamples);
+    auto hi = std::min(size_t((1 + confidence) / 2 * resamples), size_t(resamples - 1));
+    return {changes[lo], changes[hi]};
+}
+
+// Compares the results with the ones saved by --json-output in an
+// earlier run. A test regressed when, with the given confidence, its time
+// or instructions per iteration grew by more than the threshold.
+class baseline_comparator final : public result_printer {
+    struct samples {
+        std::vector<double> time;
+        std::vector<double> inst;
+    };
+    std::unordered_map<std::string, samples> _baseline;
+    double _threshold;
+    double _confidence;
+    std::mt19937 _rng;
+    unsigned _regressions = 0;
+    // Printed after the results of all the tests
+    std::vector<std::string> _lines;
+
+    static constexpr auto header_format_string = "{:<{}} {:>7} {:>11} {:>11} {:>8} {:>19} {:>8} {:>8} {}\n";
+    static constexpr auto format_string = "{:<{}} {:>7} {:>11} {:>11} {:>+7.1f}% [{:>+7.1f}%, {:>+7.1f}%] {:>8.4f} {:>+7.1f}% {}\n";
+private:
+    static std::vector<double> read_samples(const boost::property_tree::ptree& pt, const std::string& key) {
+        std::vector<double> ret;
+        if (auto child = pt.get_child_optional(key)) {
+            for (auto& v : *child) {
+                ret.push_back(v.second.get_value<double>());
+            }
+        }
+        return ret;
+    }
+    // Whether the change is above the threshold in the whole interval
+    bool significant(const std::vector<double>& baseline, const std::vector<double>& current, double& change, std::pair<double, double>& interval, double& p) {
+        change = median_of(current) / median_of(baseline) - 1;
+        interval = median_change_interval(baseline, current, _confidence, _rng);
+        p = mann_whitney_p_value(baseline, current);
+        return interval.first > _threshold && p < 1 - _confidence;
+    }
+public:
+    baseline_comparator(const std::string& file, double threshold, double confidence, unsigned seed)
+            : _threshold(threshold), _confidence(confidence), _rng(seed) {
+        boost::property_tree::ptree pt;
+        boost::property_tree::read_json(file, pt);
+        if (auto all = pt.get_child_optional("samples")) {
+            for (auto& [name, test] : *all) {
+                _baseline[name] = samples{read_samples(test, "time"), read_samples(test, "inst")};
+            }
+        }
+    }
+
+    // Prints the comparison, returns the number of regressions
+    unsigned print_summary() const {
+        fmt::print("\ncomparison to the baseline, {:.0f}% confidence, {:.1f}% threshold:\n", _confidence * 100, _threshold * 100);
+        fmt::print(header_format_string, "test", name_column_length(), "runs", "baseline", "median", "change", "interval", "p", "inst", "");
+        for (auto& l : _lines) {
+            fmt::print("{}", l);
+        }
+        return _regressions;
+    }
+
+    virtual void print_configuration(const config&) override { }
+
+    virtual void print_result(const result& r) override {
+        auto it = _baseline.find(r.test_name);
+        if (it == _baseline.end() || it->second.time.empty()) {
+            _lines.push_back(fmt::format("{:<{}} not in the baseline\n", r.test_name, name_column_length()));
+            return;
+        }
+        auto& b = it->second;
+        double change, p;
+        std::pair<double, double> interval;
+        bool regressed = significant(b.time, r.time_samples, change, interval, p);
+        double inst_change = 0;
+        // The counters are less noisy than time, but not always available
+        if (!b.inst.empty() && median_of(b.inst) > 0 && r.inst > 0) {
+            double inst_p;
+            std::pair<double, double> inst_interval;
+            regressed |= significant(b.inst, r.inst_samples, inst_change, inst_interval, inst_p);
+        }
+        const char* verdict = "";
+        if (regressed) {
+            verdict = "REGRESSION";
+            _regressions++;
+        } else if (interval.second < -_threshold && p < 1 - _confidence) {
+            verdict = "improvement";
+        }
+        _lines.push_back(fmt::format(format_string, r.test_name, name_column_length(), fmt::format("{}/{}", b.time.size(), r.time_samples.size()),
+                   duration { median_of(b.time) }, duration { r.median }, change * 100,
+                   interval.first * 100, interval.second * 100, p, inst_change * 100, verdict));
     }
 };
 
@@ -315,6 +506,8 @@ void performance_test::do_run(const config& conf)
     result r{};
 
     auto results = std::vector<double>(conf.number_of_runs);
+    r.inst_samples.resize(conf.number_of_runs);
+    r.cycles_samples.resize(conf.number_of_runs);
     uint64_t total_iterations = 0;
     for (auto i = 0u; i < conf.number_of_runs; i++) {
         // switch out of seastar thread
@@ -329,8 +522,16 @@ void performance_test::do_run(const config& conf)
 
                 r.allocs += double(rr.stats.allocations) / _single_run_iterations;
                 r.tasks += double(rr.stats.tasks_executed) / _single_run_iterations;
-                r.inst += double(rr.stats.instructions_retired) / _single_run_iterations;
-                r.cycles += double(rr.stats.cpu_cycles_retired) / _single_run_iterations;
+                r.inst_samples[i] = double(rr.stats.instructions_retired) / _single_run_iterations;
+                r.cycles_samples[i] = double(rr.stats.cpu_cycles_retired) / _single_run_iterations;
+                r.inst += r.inst_samples[i];
+                r.cycles += r.cycles_samples[i];
+                if (rr.latencies) {
+                    if (!r.latencies) {
+                        r.latencies.emplace();
+                    }
+                    r.latencies->merge(*rr.latencies);
+                }
             });
         }).get();
     }
@@ -341,6 +542,7 @@ void performance_test::do_run(const config& conf)
 
     auto mid = conf.number_of_runs / 2;
 
+    r.time_samples = results;
     boost::range::sort(results);
     r.median = results[mid];
 
@@ -430,11 +632,17 @@ int main(int ac, char** av)
         ("no-stdout", "do not print to stdout")
         ("json-output", bpo::value<std::string>(), "output json file")
         ("md-output", bpo::value<std::string>(), "output markdown file")
+        ("compare-to", bpo::value<std::string>(),
+            "json file of an earlier run (see --json-output) to compare the results to, fails if a test regressed")
+        ("regression-threshold", bpo::value<double>()->default_value(0.05),
+            "relative growth of the time or instructions per iteration that --compare-to reports as a regression")
+        ("confidence", bpo::value<double>()->default_value(0.95),
+            "confidence required by --compare-to to report a change")
         ("list", "list available tests")
         ;
 
     return app.run(ac, av, [&] {
-        return async([&] {
+        return async([&] () -> int {
             signal_timer::init();
 
             config conf;
@@ -454,7 +662,7 @@ int main(int ac, char** av)
                 for (auto&& t : all_tests()) {
                     fmt::print("\t{}\n", t->name());
                 }
-                return;
+                return 0;
             }
 
             if (!app.configuration().count("no-stdout")) {
@@ -476,12 +684,31 @@ int main(int ac, char** av)
             if (!conf.random_seed) {
                 conf.random_seed = std::random_device()();
             }
+
+            baseline_comparator* comparator = nullptr;
+            if (app.configuration().count("compare-to")) {
+                auto c = std::make_unique<baseline_comparator>(
+                    app.configuration()["compare-to"].as<std::string>(),
+                    app.configuration()["regression-threshold"].as<double>(),
+                    app.configuration()["confidence"].as<double>(),
+                    conf.random_seed);
+                comparator = c.get();
+                conf.printers.emplace_back(std::move(c));
+            }
             smp::invoke_on_all([seed = conf.random_seed] {
                 auto local_seed = seed + this_shard_id();
                 testing::local_random_engine.seed(local_seed);
             }).get();
 
             run_all(tests_to_run, conf);
+
+            if (comparator) {
+                if (auto regressions = comparator->print_summary()) {
+                    fmt::print("{} test(s) regressed\n", regressions);
+                    return 1;
+                }
+            }
+            return 0;
         });
     });
 }
@@ -0,0 +1,102 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/net/toeplitz.hh>
+#include <seastar/net/net.hh>
+
+#include <cstdlib>
+
+using namespace seastar;
+
+// The bit by bit implementation the tables replaced
+static uint32_t toeplitz_hash_bitwise(rss_key_type key, const net::forward_hash& data) {
+    uint32_t hash = 0;
+    uint32_t v = (key[0] << 24) + (key[1] << 16) + (key[2] << 8) + key[3];
+    for (unsigned i = 0; i < data.size(); i++) {
+        for (unsigned b = 0; b < 8; b++) {
+            if (data[i] & (1 << (7 - b))) {
+                hash ^= v;
+            }
+            v <<= 1;
+            if ((i + 4) < key.size() && (key[i + 4] & (1 << (7 - b)))) {
+                v |= 1;
+            }
+        }
+    }
+    return hash;
+}
+
+// Hashes the TCP 4-tuples tcp::connect() goes through looking for a local
+// port that lands on the current shard
+struct toeplitz_bench {
+    static constexpr unsigned ports = 1000;
+
+    static net::forward_hash tuple(uint16_t local_port) {
+        net::forward_hash data;
+        data.push_back(uint32_t(0x0a000001));
+        data.push_back(uint32_t(0x0a000002));
+        data.push_back(uint16_t(80));
+        data.push_back(local_port);
+        return data;
+    }
+
+    toeplitz_bench() {
+        for (auto key : {default_rsskey_40bytes, default_rsskey_52bytes}) {
+            for (unsigned port = 0; port < 65536; port += 7) {
+                auto data = tuple(port);
+                if (toeplitz_hash(key, data) != toeplitz_hash_bitwise(key, data)) {
+                    std::abort();
+                }
+            }
+        }
+    }
+
+    template <typename Hash>
+    size_t hash_ports(Hash&& hash) {
+        uint32_t sum = 0;
+        for (unsigned port = 0; port < ports; port++) {
+            sum += hash(default_rsskey_40bytes, tuple(32768 + port));
+        }
+        perf_tests::do_not_optimize(sum);
+        return ports;
+    }
+};
+
+PERF_TEST_F(toeplitz_bench, bitwise)
+{
+    return hash_ports(toeplitz_hash_bitwise);
+}
+
+PERF_TEST_F(toeplitz_bench, table)
+{
+    return hash_ports([] (rss_key_type key, const net::forward_hash& data) {
+        return toeplitz_hash(key, data);
+    });
+}
+
+PERF_TEST_F(toeplitz_bench, hasher)
+{
+    static const toeplitz_hasher hasher(default_rsskey_40bytes);
+    return hash_ports([] (rss_key_type, const net::forward_hash& data) {
+        return hasher(data);
+    });
+}
@@ -39,6 +39,8 @@ enum {
     ALIEN_DONE   = 42,
 };
 
+static constexpr int cq_calls = 1000;
+
 int main(int argc, char** argv)
 {
     // we need a protocol that both seastar and alien understand.
@@ -82,9 +84,40 @@ int main(int argc, char** argv)
         for (auto& count : counts) {
             total += count.get();
         }
+        // test for alien::submit_to() with a completion queue, submitting
+        // more calls than the queue holds
+        alien::completion_queue<int> cq(16);
+        int cq_total = 0;
+        unsigned failures = 0;
+        auto collect = [&] (alien::completion<int>&& c) {
+            if (c.ex) {
+                ++failures;
+            } else {
+                cq_total += *c.value;
+            }
+        };
+        for (auto i : boost::irange(0, cq_calls)) {
+            while (cq.full()) {
+                cq.wait();
+                cq.poll(collect);
+            }
+            alien::submit_to(app.alien(), i % smp::count, cq, i, [i] {
+                if (i % 10 == 0) {
+                    return seastar::make_exception_future<int>(std::runtime_error("expected"));
+                }
+                return seastar::make_ready_future<int>(i);
+            });
+        }
+        while (cq.in_flight()) {
+            cq.wait();
+            cq.poll(collect);
+        }
+        if (failures != cq_calls / 10) {
+            throw std::runtime_error("unexpected number of failures");
+        }
         // i am done. dismiss the engine
         ::eventfd_write(alien_done, ALIEN_DONE);
-        return std::make_tuple(answer.get(), total);
+        return std::make_tuple(answer.get(), total, cq_total);
     });
 
     eventfd_t result = 0;
@@ -115,7 +148,7 @@ int main(int argc, char** argv)
             seastar::engine().exit(0);
         });
     });
-    auto [everything, total] = zim.get();
+    auto [everything, total, cq_total] = zim.get();
     if (char expected = '*'; everything != '*') {
         std::cerr << "Bad everything: " << everything << " != " << expected << std::endl;
         return 1;
@@ -126,4 +159,12 @@ int main(int argc, char** argv)
         std::cerr << "Bad total: " << total << " != " << expected << std::endl;
         return 1;
     }
+    auto cq_range = boost::irange(0, cq_calls);
+    auto cq_expected = std::accumulate(std::begin(cq_range), std::end(cq_range), 0, [] (int acc, int i) {
+        return i % 10 ? acc + i : acc;
+    });
+    if (cq_total != cq_expected) {
+        std::cerr << "Bad completion queue total: " << cq_total << " != " << cq_expected << std::endl;
+        return 1;
+    }
 }
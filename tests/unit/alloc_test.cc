@@ -19,6 +19,8 @@
  * Copyright (C) 2015 Cloudius Systems, Ltd.
  */
 
+#include <seastar/core/arena.hh>
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/memory.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/temporary_buffer.hh>
@@ -27,13 +29,16 @@
 #include <seastar/util/log.hh>
 #include <seastar/util/memory_diagnostics.hh>
 
+#include <algorithm>
 #include <memory>
 #include <new>
 #include <vector>
 #include <future>
+#include <fstream>
 #include <iostream>
 
 #include <malloc.h>
+#include <unistd.h>
 
 using namespace seastar;
 
@@ -155,6 +160,166 @@ SEASTAR_TEST_CASE(test_memory_diagnostics) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(test_small_pool_stats) {
+    auto pool_of = [] (size_t object_size) {
+        for (auto& sp : memory::get_small_pool_stats()) {
+            if (sp.object_size == object_size) {
+                return sp;
+            }
+        }
+        return memory::small_pool_stats{};
+    };
+#ifdef SEASTAR_DEFAULT_ALLOCATOR
+    BOOST_REQUIRE(memory::get_small_pool_stats().empty());
+#else
+    auto before = pool_of(64);
+    BOOST_REQUIRE_EQUAL(before.object_size, 64);
+    std::vector<std::unique_ptr<char[]>> objs;
+    for (int i = 0; i < 1000; i++) {
+        objs.emplace_back(new char[64]);
+    }
+    auto after = pool_of(64);
+    BOOST_REQUIRE_GE(after.objects_in_use, before.objects_in_use + 1000);
+    BOOST_REQUIRE_GE(after.memory, after.objects_in_use * 64);
+    BOOST_REQUIRE_EQUAL(after.memory, after.objects_in_use * 64 + after.unused);
+#endif
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_arena) {
+    memory::arena a(4096);
+    std::pmr::vector<int> v(&a);
+    for (int i = 0; i < 1000; i++) {
+        v.push_back(i);
+    }
+    for (int i = 0; i < 1000; i++) {
+        BOOST_REQUIRE_EQUAL(v[i], i);
+    }
+    auto p = a.allocate(10, 64);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % 64, 0);
+    BOOST_REQUIRE_GT(a.memory(), 0);
+
+    auto buf = a.allocate_buffer(100);
+    std::fill_n(buf.get_write(), buf.size(), 'x');
+    v = std::pmr::vector<int>(&a);
+    a.reset();
+    BOOST_REQUIRE_EQUAL(a.memory(), 0);
+    // The buffer kept its memory
+    BOOST_REQUIRE(std::all_of(buf.begin(), buf.end(), [] (char c) { return c == 'x'; }));
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_batched_cross_cpu_free) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    if (smp::count < 2) {
+        BOOST_TEST_WARN(0, "Skipping this test because it needs at least two shards");
+        co_return;
+    }
+    constexpr size_t object_size = 64;
+    constexpr size_t nr_objects = 1000;
+    static auto objects_in_use = [] {
+        for (auto& sp : memory::get_small_pool_stats()) {
+            if (sp.object_size == object_size) {
+                return sp.objects_in_use;
+            }
+        }
+        return size_t(0);
+    };
+    auto [objs, in_use] = co_await smp::submit_to(1, [] {
+        auto in_use = objects_in_use();
+        std::vector<std::unique_ptr<char[]>> objs;
+        for (size_t i = 0; i < nr_objects; i++) {
+            objs.emplace_back(new char[object_size]);
+        }
+        return std::make_pair(std::move(objs), in_use);
+    });
+    objs.clear();
+    // Sends what's left of the batch
+    memory::drain_cross_cpu_freelist();
+    auto in_use_after = co_await smp::submit_to(1, [] {
+        memory::drain_cross_cpu_freelist();
+        return objects_in_use();
+    });
+    BOOST_REQUIRE_LT(in_use_after, in_use + nr_objects);
+#endif
+    co_return;
+}
+
+SEASTAR_TEST_CASE(test_defragment) {
+    constexpr size_t object_size = 512;
+    std::vector<std::unique_ptr<char[]>> objs;
+    for (int i = 0; i < 4096; i++) {
+        objs.emplace_back(new char[object_size]);
+        std::fill_n(objs.back().get(), object_size, char(i));
+    }
+    // Leave one object in 16 alive, so most spans end up sparse
+    for (size_t i = 0; i < objs.size(); i++) {
+        if (i % 16) {
+            objs[i].reset();
+        }
+    }
+    BOOST_REQUIRE(!memory::should_relocate(objs[0].get()));
+    size_t relocated = 0;
+    memory::relocator r([&] {
+        size_t n = 0;
+        for (auto& o : objs) {
+            if (o && memory::should_relocate(o.get())) {
+                auto copy = std::make_unique<char[]>(object_size);
+                std::copy_n(o.get(), object_size, copy.get());
+                o = std::move(copy);
+                n++;
+            }
+        }
+        relocated += n;
+        return n;
+    });
+    memory::defragment();
+#ifdef SEASTAR_DEFAULT_ALLOCATOR
+    BOOST_REQUIRE_EQUAL(relocated, 0);
+#else
+    BOOST_REQUIRE_GT(relocated, 0);
+#endif
+    for (size_t i = 0; i < objs.size(); i += 16) {
+        BOOST_REQUIRE(std::all_of(objs[i].get(), objs[i].get() + object_size, [i] (char c) { return c == char(i); }));
+    }
+    return make_ready_future<>();
+}
+
+// Resident set size of the process, in bytes
+static size_t resident_memory() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total = 0, resident = 0;
+    statm >> total >> resident;
+    return resident * ::getpagesize();
+}
+
+SEASTAR_TEST_CASE(test_release_free_memory) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    constexpr size_t size = 64 << 20;
+    {
+        // Backed now, and free again once the buffer is gone
+        auto buf = std::make_unique<char[]>(size);
+        std::fill_n(buf.get(), size, 1);
+    }
+    auto free_before = memory::free_memory();
+    auto rss_before = resident_memory();
+    auto released = memory::release_free_memory();
+    if (!released) {
+        BOOST_TEST_WARN(0, "Skipping this test because free memory can't be released (locked memory?)");
+        co_return;
+    }
+    BOOST_REQUIRE_GE(released, size);
+    BOOST_REQUIRE_LE(resident_memory() + size / 2, rss_before);
+    // Released memory still belongs to the shard
+    BOOST_REQUIRE_EQUAL(memory::free_memory(), free_before);
+    // Nothing is left to release, and the memory can be used again
+    BOOST_REQUIRE_LT(memory::release_free_memory(), size);
+    auto buf = std::make_unique<char[]>(size);
+    std::fill_n(buf.get(), size, 1);
+#endif
+    co_return;
+}
+
 #ifndef SEASTAR_DEFAULT_ALLOCATOR
 
 struct thread_alloc_info {
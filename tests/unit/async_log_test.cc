@@ -0,0 +1,124 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/util/log.hh>
+#include <sstream>
+#include <string>
+
+using namespace seastar;
+
+static size_t count_lines(const std::string& text, const std::string& what) {
+    size_t count = 0;
+    for (auto pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+BOOST_AUTO_TEST_CASE(test_async_log_is_written_on_stop) {
+    static seastar::logger l("async_log_test");
+    std::ostringstream out;
+    logger::set_ostream(out);
+    logger::set_async(true);
+    for (int i = 0; i < 100; i++) {
+        l.info("message {}", i);
+    }
+    logger::set_async(false);
+    logger::set_ostream(std::cerr);
+    BOOST_REQUIRE_EQUAL(count_lines(out.str(), "async_log_test - message"), 100);
+    BOOST_REQUIRE_NE(out.str().find("message 99\n"), std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_log_overflow) {
+    static seastar::logger l("async_log_overflow_test");
+    const std::string payload(512, 'x');
+    const int total = 10000;
+
+    // Messages that don't fit are written synchronously
+    {
+        std::ostringstream out;
+        logger::set_ostream(out);
+        logger::set_async(true, 4096, logger::overflow_policy::write_through);
+        for (int i = 0; i < total; i++) {
+            l.info("message {}", payload);
+        }
+        logger::set_async(false);
+        logger::set_ostream(std::cerr);
+        BOOST_REQUIRE_EQUAL(count_lines(out.str(), "async_log_overflow_test - message"), total);
+    }
+
+    // Messages that don't fit are dropped, and accounted for
+    {
+        std::ostringstream out;
+        auto dropped_before = logger::async_dropped_messages();
+        logger::set_ostream(out);
+        logger::set_async(true, 4096, logger::overflow_policy::drop);
+        for (int i = 0; i < total; i++) {
+            l.info("message {}", payload);
+        }
+        logger::set_async(false);
+        logger::set_ostream(std::cerr);
+        auto written = count_lines(out.str(), "async_log_overflow_test - message");
+        auto dropped = logger::async_dropped_messages() - dropped_before;
+        BOOST_REQUIRE_EQUAL(written + dropped, total);
+        if (dropped) {
+            BOOST_REQUIRE_NE(out.str().find("log messages were dropped"), std::string::npos);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_deferred_formatting) {
+    static seastar::logger l("deferred_log_test");
+    std::ostringstream out;
+    logger::set_ostream(out);
+    logger::set_async(true);
+    logger::set_deferred_formatting(true);
+    for (int i = 0; i < 100; i++) {
+        // The argument is gone by the time the message is formatted
+        l.info("message {} {} {:.1f} {}", i, std::string("string ") + std::to_string(i), 0.5, "literal");
+    }
+    logger::set_async(false);
+    logger::set_deferred_formatting(false);
+    logger::set_ostream(std::cerr);
+    BOOST_REQUIRE_EQUAL(count_lines(out.str(), "deferred_log_test - message"), 100);
+    BOOST_REQUIRE_NE(out.str().find("message 99 string 99 0.5 literal\n"), std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_json_format) {
+    static seastar::logger l("json_log_test");
+    for (bool deferred : {false, true}) {
+        std::ostringstream out;
+        logger::set_ostream(out);
+        logger::set_json_format(true);
+        logger::set_async(deferred);
+        logger::set_deferred_formatting(deferred);
+        l.warn("a \"quoted\" {}", "line\nbreak");
+        logger::set_async(false);
+        logger::set_deferred_formatting(false);
+        logger::set_json_format(false);
+        logger::set_ostream(std::cerr);
+        BOOST_REQUIRE_NE(out.str().find("{\"level\":\"warn\""), std::string::npos);
+        BOOST_REQUIRE_NE(out.str().find(",\"logger\":\"json_log_test\",\"message\":\"a \\\"quoted\\\" line\\nbreak\"}\n"), std::string::npos);
+    }
+}
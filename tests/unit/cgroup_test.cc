@@ -0,0 +1,68 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2026 ScyllaDB Ltd.
+ */
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <seastar/testing/thread_test_case.hh>
+#include "core/cgroup.hh"
+#include "tmpdir.hh"
+
+using namespace seastar;
+
+SEASTAR_THREAD_TEST_CASE(test_parse_cpu_max) {
+    BOOST_REQUIRE_EQUAL(cgroup::parse_cpu_max("50000 100000").value(), 0.5);
+    BOOST_REQUIRE_EQUAL(cgroup::parse_cpu_max("400000 100000").value(), 4);
+    BOOST_REQUIRE(!cgroup::parse_cpu_max("max 100000"));
+
+    // Malformed contents are taken as no quota
+    BOOST_REQUIRE(!cgroup::parse_cpu_max(""));
+    BOOST_REQUIRE(!cgroup::parse_cpu_max("50000"));
+    BOOST_REQUIRE(!cgroup::parse_cpu_max("50000 100000 1"));
+    BOOST_REQUIRE(!cgroup::parse_cpu_max("half 100000"));
+    BOOST_REQUIRE(!cgroup::parse_cpu_max("50000 0"));
+    BOOST_REQUIRE(!cgroup::parse_cpu_max("-50000 100000"));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cpu_quota_v1) {
+    tmpdir tmp;
+    auto dir = tmp.path().native();
+    auto set = [&] (const char* file, const std::string& value) {
+        std::ofstream(dir + "/" + file) << value << "\n";
+    };
+
+    set("cpu.cfs_quota_us", "150000");
+    set("cpu.cfs_period_us", "100000");
+    BOOST_REQUIRE_EQUAL(cgroup::cpu_quota_v1(dir).value(), 1.5);
+
+    // A quota of -1 is no quota
+    set("cpu.cfs_quota_us", "-1");
+    BOOST_REQUIRE(!cgroup::cpu_quota_v1(dir));
+
+    // Nor are malformed or missing files
+    set("cpu.cfs_quota_us", "150000");
+    set("cpu.cfs_period_us", "0");
+    BOOST_REQUIRE(!cgroup::cpu_quota_v1(dir));
+    set("cpu.cfs_period_us", "often");
+    BOOST_REQUIRE(!cgroup::cpu_quota_v1(dir));
+    BOOST_REQUIRE(!cgroup::cpu_quota_v1(dir + "/missing"));
+}
@@ -29,6 +29,8 @@
 #include <chrono>
 #include <deque>
 #include <iterator>
+#include <string>
+#include <vector>
 #if __has_include(<ranges>)
 #include <ranges>
 #endif
@@ -394,3 +396,70 @@ BOOST_AUTO_TEST_CASE(chunked_fifo_const_iterator) {
         BOOST_REQUIRE(std::equal(fifo.cbegin(), fifo.cend(), reference.cbegin(), reference.cend()));
     }
 }
+
+BOOST_AUTO_TEST_CASE(chunked_fifo_bulk) {
+    chunked_fifo<int, 8> fifo;
+    std::deque<int> expected;
+    int next = 0;
+    // Leave partially consumed chunks around, so the copies wrap
+    for (int round = 0; round < 20; ++round) {
+        std::vector<int> in(round * 3 % 17 + 1);
+        for (auto& x : in) {
+            x = next++;
+        }
+        fifo.push_back_range(in);
+        expected.insert(expected.end(), in.begin(), in.end());
+        std::vector<int> out(round % 11);
+        auto n = fifo.pop_front_n(out);
+        BOOST_REQUIRE_EQUAL(n, std::min(out.size(), expected.size()));
+        for (size_t i = 0; i < n; ++i) {
+            BOOST_REQUIRE_EQUAL(out[i], expected.front());
+            expected.pop_front();
+        }
+        BOOST_REQUIRE_EQUAL(fifo.size(), expected.size());
+        BOOST_REQUIRE(std::equal(fifo.begin(), fifo.end(), expected.begin(), expected.end()));
+    }
+
+    chunked_fifo<std::string, 4> strings;
+    std::vector<std::string> in{"a", "b", "c", "d", "e", "f"};
+    strings.push_back_range(in);
+    std::vector<std::string> out(10);
+    BOOST_REQUIRE_EQUAL(strings.pop_front_n(out), in.size());
+    BOOST_REQUIRE(std::equal(in.begin(), in.end(), out.begin()));
+    BOOST_REQUIRE(strings.empty());
+}
+
+template <typename T>
+struct counting_allocator {
+    using value_type = T;
+    size_t* live;
+    explicit counting_allocator(size_t* l) noexcept : live(l) {}
+    template <typename U>
+    counting_allocator(const counting_allocator<U>& o) noexcept : live(o.live) {}
+    T* allocate(size_t n) {
+        ++*live;
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        --*live;
+        std::allocator<T>().deallocate(p, n);
+    }
+    bool operator==(const counting_allocator&) const = default;
+};
+
+BOOST_AUTO_TEST_CASE(chunked_fifo_stateful_allocator) {
+    size_t live = 0;
+    {
+        chunked_fifo<int, 8, counting_allocator<int>> fifo{counting_allocator<int>(&live)};
+        for (int i = 0; i < 100; ++i) {
+            fifo.push_back(i);
+        }
+        BOOST_REQUIRE_GE(live, 100u / 8);
+        auto moved = std::move(fifo);
+        for (int i = 0; i < 100; ++i) {
+            BOOST_REQUIRE_EQUAL(moved.front(), i);
+            moved.pop_front();
+        }
+    }
+    BOOST_REQUIRE_EQUAL(live, 0u);
+}
@@ -27,6 +27,8 @@
 #include <chrono>
 #include <deque>
 #include <random>
+#include <string>
+#include <vector>
 #if __has_include(<ranges>)
 #include <ranges>
 #endif
@@ -188,3 +190,37 @@ BOOST_AUTO_TEST_CASE(test_underflow_index_iterator_comparison) {
         buf.erase(buf.begin() + offset, buf.begin() + std::min(size_t(offset + erase_count), buf.size()));
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_bulk_push_pop) {
+    circular_buffer<int> buf;
+    std::deque<int> expected;
+    int next = 0;
+    for (int round = 0; round < 20; ++round) {
+        std::vector<int> in(round * 5 % 13 + 1);
+        for (auto& x : in) {
+            x = next++;
+        }
+        buf.push_back_range(in);
+        expected.insert(expected.end(), in.begin(), in.end());
+        std::vector<int> out(round % 9);
+        auto n = buf.pop_front_n(out);
+        BOOST_REQUIRE_EQUAL(n, std::min(out.size(), expected.size()));
+        for (size_t i = 0; i < n; ++i) {
+            BOOST_REQUIRE_EQUAL(out[i], expected.front());
+            expected.pop_front();
+        }
+        BOOST_REQUIRE(std::equal(buf.begin(), buf.end(), expected.begin(), expected.end()));
+    }
+
+    circular_buffer<std::string> strings;
+    strings.push_back("x");
+    strings.pop_front();
+    std::vector<std::string> in{"a", "b", "c"};
+    strings.push_back_range(in);
+    std::vector<std::string> out(2);
+    BOOST_REQUIRE_EQUAL(strings.pop_front_n(out), 2u);
+    BOOST_REQUIRE_EQUAL(out[0], "a");
+    BOOST_REQUIRE_EQUAL(out[1], "b");
+    BOOST_REQUIRE_EQUAL(strings.size(), 1u);
+    BOOST_REQUIRE_EQUAL(strings.front(), "c");
+}
@@ -35,6 +35,7 @@
 #include <seastar/coroutine/as_future.hh>
 #include <seastar/coroutine/exception.hh>
 #include <seastar/coroutine/generator.hh>
+#include <seastar/coroutine/generator_adaptors.hh>
 #include <seastar/testing/random.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/util/later.hh>
@@ -104,6 +105,125 @@ SEASTAR_TEST_CASE(test_simple_coroutines) {
     }), 17);
 }
 
+SEASTAR_TEST_CASE(test_coroutine_frame_recycling) {
+    auto& pool = seastar::internal::coroutine_frame_pool::local();
+    auto small = [] (int x) -> future<int> {
+        co_return x + 1;
+    };
+    auto large = [] () -> future<> {
+        char buf[8192];
+        std::fill(std::begin(buf), std::end(buf), 1);
+        co_await yield();
+        BOOST_REQUIRE_EQUAL(std::accumulate(std::begin(buf), std::end(buf), 0), 8192);
+    };
+    BOOST_REQUIRE_EQUAL(co_await small(0), 1);
+    auto before = pool.stats();
+    for (int i = 0; i < 10; i++) {
+        BOOST_REQUIRE_EQUAL(co_await small(i), i + 1);
+    }
+    co_await large();
+    auto after = pool.stats();
+#ifndef SEASTAR_DEBUG
+    // The frame freed by a call is the one of the next
+    BOOST_REQUIRE_GE(after.recycled - before.recycled, 10);
+#else
+    BOOST_REQUIRE_EQUAL(after.recycled, before.recycled);
+#endif
+    BOOST_REQUIRE_EQUAL(after.large - before.large, 1);
+}
+
+SEASTAR_TEST_CASE(test_coroutine_direct_resume) {
+    std::vector<int> order;
+    promise<> started;
+    auto inner = [&order, &started] () -> future<int> {
+        co_await started.get_future();
+        order.push_back(1);
+        co_return 42;
+    };
+    auto outer = [&] () -> future<> {
+        BOOST_REQUIRE_EQUAL(co_await inner(), 42);
+        order.push_back(2);
+    };
+    auto failing = [] () -> future<> {
+        co_await yield();
+        throw std::runtime_error("failing");
+    };
+    auto run = [&] () -> future<> {
+        order.clear();
+        started = promise<>();
+        auto f = outer();
+        // Queued after inner(), which completes before it runs
+        started.set_value();
+        promise<> other;
+        schedule(make_task([&order, &other] {
+            order.push_back(3);
+            other.set_value();
+        }));
+        co_await std::move(f);
+        co_await other.get_future();
+        BOOST_REQUIRE_THROW(co_await failing(), std::runtime_error);
+    };
+
+    co_await run();
+    BOOST_REQUIRE(order == std::vector<int>({1, 3, 2}));
+
+    seastar::internal::set_coroutine_direct_resume(true);
+    std::exception_ptr ex;
+    try {
+        co_await run();
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    seastar::internal::set_coroutine_direct_resume(false);
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+#ifndef SEASTAR_DEBUG
+    // outer() ran as soon as inner() completed
+    BOOST_REQUIRE(order == std::vector<int>({1, 2, 3}));
+#else
+    // need_preempt() is always true, nothing is resumed directly
+    BOOST_REQUIRE(order == std::vector<int>({1, 3, 2}));
+#endif
+}
+
+SEASTAR_TEST_CASE(test_coroutine_direct_resume_destroys_frame) {
+    struct param {
+        std::vector<int>* order;
+        explicit param(std::vector<int>* o) noexcept : order(o) {}
+        param(param&& o) noexcept : order(std::exchange(o.order, nullptr)) {}
+        ~param() {
+            if (order) {
+                order->push_back(1);
+            }
+        }
+    };
+    std::vector<int> order;
+    promise<> started;
+    auto inner = [&started] (param p) -> future<> {
+        co_await started.get_future();
+    };
+    auto outer = [&] () -> future<> {
+        co_await inner(param(&order));
+        order.push_back(2);
+    };
+    seastar::internal::set_coroutine_direct_resume(true);
+    auto f = outer();
+    started.set_value();
+    std::exception_ptr ex;
+    try {
+        co_await std::move(f);
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    seastar::internal::set_coroutine_direct_resume(false);
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+    // The parameters of inner() are gone by the time outer() resumes
+    BOOST_REQUIRE(order == std::vector<int>({1, 2}));
+}
+
 SEASTAR_TEST_CASE(test_abandond_coroutine) {
     std::optional<future<int>> f;
     {
@@ -882,6 +1002,147 @@ SEASTAR_TEST_CASE(test_async_generator_throws_from_consumer_unbuffered) {
     return test_async_generator_throws_from_consumer<std::optional>();
 }
 
+coroutine::experimental::generator<int>
+slow_sequence(int count, int* produced = nullptr, int fail_at = -1) {
+    for (int i = 0; i < count; ++i) {
+        co_await yield();
+        if (i == fail_at) {
+            throw std::invalid_argument("Eureka from generator!");
+        }
+        if (produced) {
+            ++*produced;
+        }
+        co_yield i;
+    }
+}
+
+template <typename T>
+seastar::future<std::vector<T>> collect(coroutine::experimental::generator<T> g) {
+    std::vector<T> ret;
+    while (auto v = co_await g()) {
+        ret.push_back(std::move(*v));
+    }
+    co_return ret;
+}
+
+SEASTAR_TEST_CASE(test_generator_map_filter) {
+    namespace cx = coroutine::experimental;
+    auto squares = cx::map(slow_sequence(10), [] (int i) { return i * i; });
+    auto odd = cx::filter(std::move(squares), [] (const int& i) { return yield().then([i] { return i % 2 == 1; }); });
+    auto values = co_await collect(std::move(odd));
+    BOOST_REQUIRE(values == std::vector<int>({1, 9, 25, 49, 81}));
+
+    auto fibs = cx::map(fibonacci_sequence<buffered_container>(coroutine::experimental::buffer_size_t{2}, 6),
+            [] (int i) { return make_ready_future<int>(-i); });
+    values = co_await collect(std::move(fibs));
+    BOOST_REQUIRE(values == std::vector<int>({0, -1, -1, -2, -3, -5}));
+}
+
+SEASTAR_TEST_CASE(test_generator_batch) {
+    namespace cx = coroutine::experimental;
+    auto batches = co_await collect(cx::batch(slow_sequence(12), 5));
+    BOOST_REQUIRE_EQUAL(batches.size(), 3);
+    BOOST_REQUIRE(batches[0] == std::vector<int>({0, 1, 2, 3, 4}));
+    BOOST_REQUIRE(batches[1] == std::vector<int>({5, 6, 7, 8, 9}));
+    BOOST_REQUIRE(batches[2] == std::vector<int>({10, 11}));
+    batches = co_await collect(cx::batch(slow_sequence(0), 5));
+    BOOST_REQUIRE(batches.empty());
+}
+
+SEASTAR_TEST_CASE(test_generator_buffer_prefetches) {
+    namespace cx = coroutine::experimental;
+    int produced = 0;
+    auto g = cx::buffer(slow_sequence(100, &produced), 4);
+    auto first = co_await g();
+    BOOST_REQUIRE_EQUAL(first.value(), 0);
+    for (int i = 0; i < 100; ++i) {
+        co_await yield();
+    }
+    // Up to 4 elements in the buffer, and one waiting for room
+    BOOST_REQUIRE_GE(produced, 5);
+    BOOST_REQUIRE_LE(produced, 6);
+    for (int i = 1; i < 100; ++i) {
+        auto v = co_await g();
+        BOOST_REQUIRE_EQUAL(v.value(), i);
+    }
+    auto end = co_await g();
+    BOOST_REQUIRE(!end);
+}
+
+SEASTAR_TEST_CASE(test_generator_buffer_propagates_exception) {
+    namespace cx = coroutine::experimental;
+    auto g = cx::buffer(slow_sequence(10, nullptr, 3), 8);
+    for (int i = 0; i < 3; ++i) {
+        auto v = co_await g();
+        BOOST_REQUIRE_EQUAL(v.value(), i);
+    }
+    BOOST_REQUIRE_THROW(co_await g(), std::invalid_argument);
+}
+
+SEASTAR_TEST_CASE(test_generator_buffer_abandoned) {
+    namespace cx = coroutine::experimental;
+    int produced = 0;
+    {
+        auto g = cx::buffer(slow_sequence(100, &produced), 2);
+        auto v = co_await g();
+        BOOST_REQUIRE_EQUAL(v.value(), 0);
+    }
+    for (int i = 0; i < 10; ++i) {
+        co_await yield();
+    }
+    // The producer stopped at its next element
+    auto stopped_at = produced;
+    for (int i = 0; i < 10; ++i) {
+        co_await yield();
+    }
+    BOOST_REQUIRE_EQUAL(produced, stopped_at);
+    BOOST_REQUIRE_LE(produced, 4);
+}
+
+SEASTAR_TEST_CASE(test_generator_merge) {
+    namespace cx = coroutine::experimental;
+    std::vector<coroutine::experimental::generator<int>> sources;
+    sources.push_back(slow_sequence(5));
+    sources.push_back(cx::map(slow_sequence(7), [] (int i) { return 100 + i; }));
+    sources.push_back(slow_sequence(0));
+    auto values = co_await collect(cx::merge(std::move(sources), 2));
+    std::sort(values.begin(), values.end());
+    BOOST_REQUIRE(values == std::vector<int>({0, 1, 2, 3, 4, 100, 101, 102, 103, 104, 105, 106}));
+
+    values = co_await collect(cx::merge(std::vector<coroutine::experimental::generator<int>>()));
+    BOOST_REQUIRE(values.empty());
+}
+
+SEASTAR_TEST_CASE(test_generator_parallel_map) {
+    namespace cx = coroutine::experimental;
+    size_t in_flight = 0;
+    size_t max_in_flight = 0;
+    auto g = cx::parallel_map(slow_sequence(50), 3, [&] (int i) -> future<int> {
+        max_in_flight = std::max(max_in_flight, ++in_flight);
+        // Complete out of order
+        return sleep(std::chrono::milliseconds((i * 7) % 5)).then([&, i] {
+            --in_flight;
+            return i * 2;
+        });
+    });
+    auto values = co_await collect(std::move(g));
+    BOOST_REQUIRE_EQUAL(values.size(), 50);
+    for (int i = 0; i < 50; ++i) {
+        BOOST_REQUIRE_EQUAL(values[i], i * 2);
+    }
+    BOOST_REQUIRE_GT(max_in_flight, 1);
+    BOOST_REQUIRE_LE(max_in_flight, 3);
+
+    auto failing = cx::parallel_map(slow_sequence(10), 2, [] (int i) {
+        return i == 4 ? make_exception_future<int>(std::invalid_argument("Eureka from func!")) : make_ready_future<int>(i);
+    });
+    for (int i = 0; i < 4; ++i) {
+        auto v = co_await failing();
+        BOOST_REQUIRE_EQUAL(v.value(), i);
+    }
+    BOOST_REQUIRE_THROW(co_await failing(), std::invalid_argument);
+}
+
 SEASTAR_TEST_CASE(test_lambda_coroutine_in_continuation) {
     auto dist = std::uniform_real_distribution<>(0.0, 1.0);
     auto rand_eng = std::default_random_engine(std::random_device()());
@@ -0,0 +1,60 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/cpu_profiler.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/thread_cputime_clock.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static void spin(std::chrono::milliseconds cpu_time) {
+    auto end = thread_cputime_clock::now() + cpu_time;
+    volatile uint64_t x = 0;
+    while (thread_cputime_clock::now() < end) {
+        // Stay in user space, the kernel isn't sampled
+        for (int i = 0; i < 100000; i++) {
+            x = x + i;
+        }
+        thread::maybe_yield();
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cpu_profiler_samples_busy_thread) {
+    cpu_profiler::start(1ms).get();
+    BOOST_REQUIRE(cpu_profiler::local_period() == 1ms);
+    spin(200ms);
+    auto profile = cpu_profiler::local_profile();
+    auto dropped = cpu_profiler::local_dropped_samples();
+    cpu_profiler::stop().get();
+
+    uint64_t samples = 0;
+    for (auto& s : profile) {
+        BOOST_REQUIRE(!s.backtrace.frames().empty());
+        samples += s.samples;
+    }
+    // Expect ~200 samples, leave room for a loaded machine
+    BOOST_REQUIRE_GT(samples + dropped, 20);
+    BOOST_REQUIRE(cpu_profiler::local_period() == 0ns);
+    BOOST_REQUIRE(cpu_profiler::local_profile().empty());
+}
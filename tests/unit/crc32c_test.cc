@@ -0,0 +1,78 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/util/crc32c.hh>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace seastar;
+
+// One bit at a time
+static uint32_t reference_crc32c(uint32_t crc, const char* data, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= uint8_t(*data++);
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+        }
+    }
+    return ~crc;
+}
+
+BOOST_AUTO_TEST_CASE(test_crc32c_check_value) {
+    const char* check = "123456789";
+    BOOST_REQUIRE_EQUAL(crc32c(0, check, std::strlen(check)), 0xe3069283);
+    BOOST_REQUIRE_EQUAL(crc32c(0, nullptr, 0), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_crc32c_lengths) {
+    std::mt19937 rng(0);
+    // Around the sizes at which the kernels switch to parallel streams
+    for (size_t len : {0, 1, 7, 8, 9, 1023, 1024, 3071, 3072, 3073, 6144, 10000, 65536, 100003}) {
+        std::vector<char> data(len);
+        for (auto& c : data) {
+            c = rng();
+        }
+        BOOST_REQUIRE_EQUAL(crc32c(0, data.data(), len), reference_crc32c(0, data.data(), len));
+        BOOST_REQUIRE_EQUAL(crc32c(0x12345678, data.data(), len), reference_crc32c(0x12345678, data.data(), len));
+        // Unaligned starts
+        if (len > 3) {
+            BOOST_REQUIRE_EQUAL(crc32c(0, data.data() + 3, len - 3), reference_crc32c(0, data.data() + 3, len - 3));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_crc32c_chaining) {
+    std::mt19937 rng(1);
+    std::vector<char> data(20000);
+    for (auto& c : data) {
+        c = rng();
+    }
+    auto whole = crc32c(0, data.data(), data.size());
+    for (size_t split : {1, 100, 4096, 9999, 19999}) {
+        auto crc = crc32c(0, data.data(), split);
+        BOOST_REQUIRE_EQUAL(crc32c(crc, data.data() + split, data.size() - split), whole);
+    }
+}
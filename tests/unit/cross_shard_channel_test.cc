@@ -0,0 +1,101 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/cross_shard_channel.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/util/later.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static shard_id other_shard() {
+    return (this_shard_id() + 1) % smp::count;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cross_shard_channel_transfers_in_order) {
+    constexpr int nr_items = 100000;
+    cross_shard_channel<int> ch(other_shard(), 64);
+    ch.start().get();
+
+    auto consumer = smp::submit_to(other_shard(), [&ch] () -> future<long> {
+        long sum = 0;
+        for (int i = 0; i < nr_items; i++) {
+            auto v = co_await ch.pop();
+            BOOST_REQUIRE_EQUAL(v, i);
+            sum += v;
+        }
+        co_return sum;
+    });
+    for (int i = 0; i < nr_items; i++) {
+        ch.push(i).get();
+    }
+    BOOST_REQUIRE_EQUAL(consumer.get(), long(nr_items) * (nr_items - 1) / 2);
+    ch.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cross_shard_channel_backpressure) {
+    cross_shard_channel<int> ch(other_shard(), 4);
+    ch.start().get();
+    BOOST_REQUIRE_EQUAL(ch.capacity(), 4);
+
+    for (int i = 0; i < 4; i++) {
+        BOOST_REQUIRE(ch.try_push(int(i)));
+    }
+    BOOST_REQUIRE(!ch.try_push(4));
+    auto blocked = ch.push(4);
+    sleep(1ms).get();
+    BOOST_REQUIRE(!blocked.available());
+
+    smp::submit_to(other_shard(), [&ch] {
+        return ch.pop().then([] (int v) {
+            BOOST_REQUIRE_EQUAL(v, 0);
+        });
+    }).get();
+    blocked.get();
+
+    auto rest = smp::submit_to(other_shard(), [&ch] () -> future<std::vector<int>> {
+        std::vector<int> got;
+        for (int i = 0; i < 4; i++) {
+            got.push_back(co_await ch.pop());
+        }
+        co_return got;
+    }).get();
+    BOOST_REQUIRE(rest == std::vector<int>({1, 2, 3, 4}));
+    ch.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cross_shard_channel_stop_breaks_waiters) {
+    cross_shard_channel<sstring> ch(other_shard(), 2);
+    ch.start().get();
+    auto waiter = smp::submit_to(other_shard(), [&ch] {
+        return ch.pop().then_wrapped([] (future<sstring> f) {
+            return f.failed();
+        });
+    });
+    sleep(1ms).get();
+    ch.stop().get();
+    BOOST_REQUIRE(waiter.get());
+}
@@ -77,3 +77,19 @@ BOOST_AUTO_TEST_CASE(test_deleter_append_same_shared_object_twice) {
     }
     BOOST_REQUIRE(TestObject::deletions_called == 1);
 }
+
+BOOST_AUTO_TEST_CASE(test_shared_free_deleters_are_recycled) {
+    auto& pool = free_deleter_impl::pool;
+    {
+        deleter d = make_free_deleter(std::malloc(16));
+        auto shared = d.share();
+    }
+    auto cached = pool.count;
+    BOOST_REQUIRE_GE(cached, 1u);
+    for (int i = 0; i < 10; ++i) {
+        deleter d = make_free_deleter(std::malloc(16));
+        auto shared = d.share();
+        BOOST_REQUIRE_EQUAL(pool.count, cached - 1);
+    }
+    BOOST_REQUIRE_EQUAL(pool.count, cached);
+}
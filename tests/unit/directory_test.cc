@@ -134,10 +134,45 @@ future<> lister_generator_test() {
     co_await lister_generator_test(std::move(f2));
 }
 
+future<> lister_entries_test(file f, list_directory_options opts) {
+    auto lister = f.experimental_list_directory_entries(opts);
+    while (auto de = co_await lister()) {
+        auto sd = co_await file_stat(de->name, follow_symlink::no);
+        if (de->type) {
+            assert(*de->type == sd.type);
+        } else {
+            assert(sd.type == directory_entry_type::unknown);
+        }
+        if (opts.stat) {
+            assert(de->stat);
+            assert(de->stat->inode_number == sd.inode_number);
+            assert(de->stat->type == sd.type);
+        }
+        fmt::print("{} (type={})\n", de->name, de_type_desc(sd.type));
+    }
+    co_await f.close();
+}
+
+future<> lister_entries_test() {
+    fmt::print("--- Entries lister test ---\n");
+    co_await lister_entries_test(co_await engine().open_directory("."), {});
+
+    fmt::print("--- Entries lister with stat test ---\n");
+    // A small buffer, so that the directory is read in several batches
+    co_await lister_entries_test(co_await engine().open_directory("."), {.buffer_size = 512, .stat = true});
+
+    fmt::print("--- Entries lister fallback test ---\n");
+    auto lf = co_await engine().open_directory(".");
+    auto tf = ::seastar::make_shared<test_file_impl>(std::move(lf));
+    co_await lister_entries_test(file(std::move(tf)), {});
+}
+
 int main(int ac, char** av) {
     return app_template().run(ac, av, [] {
         return lister_test().then([] {
             return lister_generator_test();
+        }).then([] {
+            return lister_entries_test();
         });
     });
 }
@@ -24,6 +24,7 @@
 
 #include <seastar/core/do_with.hh>
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/do_with.hh>
@@ -126,6 +127,47 @@ SEASTAR_TEST_CASE(test_bad_name_tcp) {
     return test_bad_name(opts);
 }
 
+SEASTAR_TEST_CASE(test_resolve_cached) {
+    dns_resolver::options opts;
+    opts.cache = dns_resolver::cache_options{};
+    return test_resolve(opts);
+}
+
+SEASTAR_TEST_CASE(test_bad_name_cached) {
+    dns_resolver::options opts;
+    opts.cache = dns_resolver::cache_options{};
+    return test_bad_name(opts);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_coalesced_resolve) {
+    dns_resolver::options opts;
+    opts.cache = dns_resolver::cache_options{};
+    dns_resolver d(opts);
+    auto [f1, f2] = when_all(d.get_host_by_name(seastar_name, inet_address::family::INET),
+                             d.get_host_by_name(seastar_name, inet_address::family::INET)).get();
+    auto e1 = f1.get();
+    auto e2 = f2.get();
+    BOOST_REQUIRE(!e1.addr_list.empty());
+    BOOST_REQUIRE(e1.addr_list == e2.addr_list);
+    // Both lookups were answered by one query
+    BOOST_REQUIRE_EQUAL(d.queries(), 1);
+    // Answered from the cache
+    auto e3 = d.get_host_by_name(seastar_name, inet_address::family::INET).get();
+    BOOST_REQUIRE(e1.addr_list == e3.addr_list);
+    BOOST_REQUIRE_EQUAL(d.queries(), 1);
+    d.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_uncached_resolve_queries) {
+    dns_resolver d;
+    auto [f1, f2] = when_all(d.get_host_by_name(seastar_name, inet_address::family::INET),
+                             d.get_host_by_name(seastar_name, inet_address::family::INET)).get();
+    f1.get();
+    f2.get();
+    BOOST_REQUIRE_EQUAL(d.queries(), 2);
+    d.close().get();
+}
+
 static const sstring imaps_service = "imaps";
 static const sstring gmail_domain = "gmail.com";
 
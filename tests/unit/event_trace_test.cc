@@ -0,0 +1,79 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/event_trace.hh>
+#include <seastar/core/internal/event_trace.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/file.hh>
+#include <seastar/util/later.hh>
+#include <seastar/util/tmp_file.hh>
+#include <boost/property_tree/json_parser.hpp>
+#include <set>
+#include <sstream>
+
+using namespace seastar;
+
+SEASTAR_TEST_CASE(test_event_trace_ring_keeps_last_events) {
+    internal::event_trace_ring ring(3);
+    int ids[6];
+    for (auto& id : ids) {
+        ring.record(internal::trace_event_type::task_queued, &id, nullptr, 0, 0, 0);
+    }
+    auto events = ring.events();
+    // The size is rounded up to a power of two
+    BOOST_REQUIRE_EQUAL(events.size(), 4);
+    for (unsigned i = 0; i < events.size(); i++) {
+        BOOST_REQUIRE_EQUAL(events[i].id, &ids[i + 2]);
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_event_trace_dump) {
+    tmp_dir::do_with_thread([] (tmp_dir& td) {
+        event_trace::start(1024).get();
+        yield().get();
+        smp::submit_to((this_shard_id() + 1) % smp::count, [] {}).get();
+        auto path = (td.get_path() / "trace.json").native();
+        event_trace::dump(path).get();
+        event_trace::stop().get();
+
+        auto trace = util::read_entire_file_contiguous(path).get();
+        std::istringstream in(std::string(trace.data(), trace.size()));
+        boost::property_tree::ptree pt;
+        boost::property_tree::read_json(in, pt);
+        std::set<std::string> phases;
+        std::set<std::string> names;
+        for (auto& [_, e] : pt.get_child("traceEvents")) {
+            phases.insert(e.get<std::string>("ph"));
+            names.insert(e.get<std::string>("name"));
+        }
+        BOOST_REQUIRE(phases.contains("B"));
+        BOOST_REQUIRE(phases.contains("E"));
+        BOOST_REQUIRE(phases.contains("s"));
+        BOOST_REQUIRE(phases.contains("f"));
+        if (smp::count > 1) {
+            BOOST_REQUIRE(names.contains("smp send"));
+            BOOST_REQUIRE(names.contains("smp receive"));
+        }
+    }).get();
+}
@@ -333,3 +333,44 @@ SEASTAR_THREAD_TEST_CASE(test_inheriting_concrete_execution_stage_reference_para
     a_struct obj;
     es(seastar::ref(obj), &obj).get();
 }
+
+SEASTAR_THREAD_TEST_CASE(test_vectorized_stage_batches_calls) {
+    std::vector<size_t> batch_sizes;
+    vectorized_execution_stage<int, int, int> stage("test", [&] (std::span<std::tuple<int, int>> args, std::span<int> results) {
+        BOOST_REQUIRE_EQUAL(args.size(), results.size());
+        batch_sizes.push_back(args.size());
+        for (size_t i = 0; i < args.size(); i++) {
+            results[i] = std::get<0>(args[i]) + std::get<1>(args[i]);
+        }
+    });
+
+    std::vector<future<int>> fs;
+    for (int i = 0; i < 300; i++) {
+        fs.push_back(stage(i, 1));
+    }
+    for (int i = 0; i < 300; i++) {
+        BOOST_REQUIRE_EQUAL(fs[i].get(), i + 1);
+    }
+    BOOST_REQUIRE(!batch_sizes.empty());
+    BOOST_REQUIRE_LT(batch_sizes.size(), 300);
+    for (auto n : batch_sizes) {
+        BOOST_REQUIRE_LE(n, stage.max_batch_size);
+    }
+    BOOST_REQUIRE_EQUAL(stage.get_stats().function_calls_executed, 300);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_vectorized_stage_propagates_exceptions) {
+    bool fail = true;
+    vectorized_execution_stage<void, sstring> stage("test", [&] (std::span<std::tuple<sstring>> args) {
+        if (fail) {
+            throw std::runtime_error("batch failed");
+        }
+    });
+
+    auto f1 = stage(sstring("a"));
+    auto f2 = stage(sstring("b"));
+    BOOST_REQUIRE_THROW(f1.get(), std::runtime_error);
+    BOOST_REQUIRE_THROW(f2.get(), std::runtime_error);
+    fail = false;
+    stage(sstring("c")).get();
+}
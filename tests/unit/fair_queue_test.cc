@@ -446,3 +446,33 @@ SEASTAR_THREAD_TEST_CASE(test_fair_queue_random_run) {
     auto expected_error = std::max(1, int(round(reqs * 0.05)));
     env.verify(format("random_run ({:d} requests)", reqs), {1, 1}, expected_error);
 }
+
+// A queue dispatches from its lease without touching the group and
+// gives the lease back once it has nothing left to dispatch
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_capacity_lease) {
+    fair_group::config gcfg;
+    gcfg.rate_limit_duration = std::chrono::milliseconds(1);
+    gcfg.lease_duration = std::chrono::microseconds(100);
+    fair_group fg(gcfg, 2);
+    fg.replenish_capacity(fg.replenished_ts() + std::chrono::milliseconds(1));
+    BOOST_REQUIRE_GT(fg.lease_capacity(), 0);
+
+    fair_queue fq(fg, fair_queue::config());
+    fq.register_priority_class(0, 1);
+
+    auto cap = fq.tokens_capacity(double(1) / 1'000'000);
+    unsigned dispatched = 0;
+    for (unsigned i = 0; i < 2; i++) {
+        fq.queue(0, (new request(cap, 0, [&dispatched] (request&) { dispatched++; }))->fqent);
+    }
+    fq.dispatch_requests([] (fair_queue_entry& ent) {
+        boost::intrusive::get_parent_from_member(&ent, &request::fqent)->submit();
+    });
+    BOOST_REQUIRE_EQUAL(dispatched, 2);
+
+    // All the capacity but what was dispatched must be available again
+    auto head = fg.grab_capacity(fg.maximum_capacity() - 2 * cap);
+    BOOST_REQUIRE_EQUAL(fg.capacity_deficiency(head), 0);
+
+    fq.unregister_priority_class(0);
+}
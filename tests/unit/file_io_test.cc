@@ -25,13 +25,20 @@
 
 #include <seastar/core/seastar.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/smp.hh>
 #include <seastar/core/condition-variable.hh>
 #include <seastar/core/file.hh>
 #include <seastar/core/layered_file.hh>
+#include <seastar/core/cached_file.hh>
+#include <seastar/core/emulated_file.hh>
+#include <seastar/core/discard_batcher.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/io_batch.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/stall_sampler.hh>
 #include <seastar/core/aligned_buffer.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/internal/dma_buffer_pool.hh>
 #include <seastar/util/tmp_file.hh>
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/closeable.hh>
@@ -39,6 +46,7 @@
 #include <seastar/util/internal/iovec_utils.hh>
 
 #include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/irange.hpp>
 #include <iostream>
 #include <sys/statfs.h>
 #include <fcntl.h>
@@ -644,6 +652,250 @@ SEASTAR_TEST_CASE(test_underlying_file) {
     });
 }
 
+class discard_recording_file : public test_layered_file {
+public:
+    std::vector<std::pair<uint64_t, uint64_t>> discards;
+    using test_layered_file::test_layered_file;
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        discards.emplace_back(offset, length);
+        return make_ready_future<>();
+    }
+};
+
+SEASTAR_TEST_CASE(test_discard_batcher) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto oflags = open_flags::rw | open_flags::create;
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, oflags).get();
+        auto close_f = deferred_close(f);
+        auto impl = make_shared<discard_recording_file>(f);
+        auto& discards = impl->discards;
+
+        discard_batcher::config cfg;
+        cfg.max_discard_size = 64 << 10;
+        cfg.min_discard_size = 32 << 10;
+        cfg.max_delay = std::chrono::hours(1);
+        discard_batcher db(file(impl), cfg);
+
+        // Adjacent and overlapping ranges merge, and short ones wait
+        db.discard(0, 4096);
+        db.discard(8192, 4096);
+        db.discard(4096, 4096);
+        db.discard(2048, 4096);
+        BOOST_REQUIRE_EQUAL(db.queued_bytes(), 12288);
+        seastar::sleep(std::chrono::milliseconds(10)).get();
+        BOOST_REQUIRE(discards.empty());
+
+        // Long ones go right away, in pieces of at most max_discard_size
+        db.discard(1 << 20, 100 << 10);
+        for (int i = 0; i < 100 && discards.size() < 2; i++) {
+            seastar::sleep(std::chrono::milliseconds(1)).get();
+        }
+        BOOST_REQUIRE_EQUAL(discards.size(), 2);
+        BOOST_REQUIRE_EQUAL(discards[0].first, 1 << 20);
+        BOOST_REQUIRE_EQUAL(discards[0].second, 64 << 10);
+        BOOST_REQUIRE_EQUAL(discards[1].first, (1 << 20) + (64 << 10));
+        BOOST_REQUIRE_EQUAL(discards[1].second, 36 << 10);
+
+        db.flush().get();
+        BOOST_REQUIRE_EQUAL(discards.size(), 3);
+        BOOST_REQUIRE_EQUAL(discards[2].first, 0);
+        BOOST_REQUIRE_EQUAL(discards[2].second, 12288);
+        BOOST_REQUIRE_EQUAL(db.queued_bytes(), 0);
+
+        db.discard(65536, 4096);
+        db.close().get();
+        BOOST_REQUIRE_EQUAL(discards.size(), 4);
+        BOOST_REQUIRE_EQUAL(db.get_stats().discards_issued, 4);
+        BOOST_REQUIRE_EQUAL(db.get_stats().bytes_discarded, (100 << 10) + 12288 + 4096);
+    });
+}
+
+SEASTAR_TEST_CASE(test_discard_batcher_oldest_first) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto oflags = open_flags::rw | open_flags::create;
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, oflags).get();
+        auto close_f = deferred_close(f);
+        auto impl = make_shared<discard_recording_file>(f);
+        auto& discards = impl->discards;
+
+        discard_batcher::config cfg;
+        cfg.min_discard_size = 1 << 20;
+        cfg.max_delay = std::chrono::milliseconds(100);
+        discard_batcher db(file(impl), cfg);
+
+        // Short ranges go once they've waited long enough, oldest first
+        // whatever their offsets
+        db.discard(1 << 20, 4096);
+        seastar::sleep(std::chrono::milliseconds(30)).get();
+        db.discard(0, 4096);
+        db.discard(2 << 20, 4096);
+        for (int i = 0; i < 1000 && discards.size() < 3; i++) {
+            seastar::sleep(std::chrono::milliseconds(1)).get();
+        }
+        BOOST_REQUIRE_EQUAL(discards.size(), 3);
+        BOOST_REQUIRE_EQUAL(discards[0].first, 1 << 20);
+
+        // A long enough range goes first even if it's the newest
+        db.discard(4 << 20, 4096);
+        db.discard(8 << 20, 1 << 20);
+        for (int i = 0; i < 1000 && discards.size() < 4; i++) {
+            seastar::sleep(std::chrono::milliseconds(1)).get();
+        }
+        BOOST_REQUIRE_EQUAL(discards[3].first, 8 << 20);
+        db.close().get();
+        BOOST_REQUIRE_EQUAL(discards.size(), 5);
+    });
+}
+
+SEASTAR_TEST_CASE(test_cached_file) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto oflags = open_flags::rw | open_flags::create;
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, oflags).get();
+        page_cache::config cfg;
+        cfg.capacity = 4 * 4096;
+        cfg.name = "test";
+        page_cache cache(cfg);
+        auto cf = make_cached_file(f, cache);
+        auto close_f = deferred_close(cf);
+
+        auto align = cf.disk_write_dma_alignment();
+        auto size = 2 * align;
+        auto wbuf = allocate_aligned_buffer<char>(size, cf.memory_dma_alignment());
+        std::fill_n(wbuf.get(), size, 'a');
+        BOOST_REQUIRE_EQUAL(cf.dma_write(0, wbuf.get(), size).get(), size);
+
+        auto check = [&] (char c) {
+            auto rbuf = cf.dma_read<char>(0, size).get();
+            BOOST_REQUIRE_EQUAL(rbuf.size(), size);
+            BOOST_REQUIRE(std::all_of(rbuf.begin(), rbuf.end(), [c] (char x) { return x == c; }));
+        };
+
+        check('a');
+        auto misses = cache.get_stats().misses;
+        BOOST_REQUIRE_GT(misses, 0);
+        BOOST_REQUIRE_GT(cache.memory(), 0);
+        check('a');
+        BOOST_REQUIRE_EQUAL(cache.get_stats().misses, misses);
+        BOOST_REQUIRE_GT(cache.get_stats().hits, 0);
+
+        // Writing through the cached file drops the stale pages
+        std::fill_n(wbuf.get(), size, 'b');
+        BOOST_REQUIRE_EQUAL(cf.dma_write(0, wbuf.get(), size).get(), size);
+        check('b');
+
+        // Reads past the end of file are cut short
+        auto rbuf = cf.dma_read_bulk<char>(align, 2 * size).get();
+        BOOST_REQUIRE_EQUAL(rbuf.size(), size - align);
+
+        // A cached partial last page doesn't survive the file growing past
+        // it, even if the write doesn't touch it
+        cf.truncate(size + 100).get();
+        BOOST_REQUIRE_EQUAL(cf.dma_read_bulk<char>(size, 4096).get().size(), 100);
+        auto next_page = align_up<uint64_t>(size + 100, 4096);
+        BOOST_REQUIRE_EQUAL(cf.dma_write(next_page, wbuf.get(), align).get(), align);
+        rbuf = cf.dma_read_bulk<char>(size, next_page + align - size).get();
+        BOOST_REQUIRE_EQUAL(rbuf.size(), next_page + align - size);
+        BOOST_REQUIRE(std::all_of(rbuf.begin(), rbuf.begin() + (next_page - size), [] (char x) { return x == 0; }));
+        BOOST_REQUIRE(std::all_of(rbuf.begin() + (next_page - size), rbuf.end(), [] (char x) { return x == 'b'; }));
+
+        cache.clear();
+        BOOST_REQUIRE_EQUAL(cache.memory(), 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_emulated_file) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto oflags = open_flags::rw | open_flags::create;
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, oflags).get();
+        emulated_disk::config cfg;
+        cfg.read_latency = std::chrono::milliseconds(20);
+        cfg.write_iops = 10;
+        emulated_disk disk(cfg);
+        auto ef = make_emulated_file(f, disk);
+        auto close_f = deferred_close(ef);
+
+        auto align = ef.disk_write_dma_alignment();
+        auto wbuf = allocate_aligned_buffer<char>(align, ef.memory_dma_alignment());
+        std::fill_n(wbuf.get(), align, 'a');
+
+        // At 10 IOPS, the last of three writes starts 200ms after the first
+        auto start = emulated_disk::clock_type::now();
+        parallel_for_each(boost::irange(0, 3), [&] (int i) {
+            return ef.dma_write(i * align, wbuf.get(), align).then([&] (size_t size) {
+                BOOST_REQUIRE_EQUAL(size, align);
+            });
+        }).get();
+        BOOST_REQUIRE_GE(emulated_disk::clock_type::now() - start, std::chrono::milliseconds(200));
+
+        start = emulated_disk::clock_type::now();
+        auto rbuf = ef.dma_read<char>(0, align).get();
+        BOOST_REQUIRE_GE(emulated_disk::clock_type::now() - start, std::chrono::milliseconds(20));
+        BOOST_REQUIRE(std::all_of(rbuf.begin(), rbuf.end(), [] (char x) { return x == 'a'; }));
+
+        auto& st = disk.get_stats();
+        BOOST_REQUIRE_EQUAL(st.writes, 3);
+        BOOST_REQUIRE_EQUAL(st.reads, 1);
+        BOOST_REQUIRE_EQUAL(st.written_bytes, 3 * align);
+        BOOST_REQUIRE_GT(st.delay.count(), 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_io_batch) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto oflags = open_flags::rw | open_flags::create;
+        auto f1 = open_file_dma((t.get_path() / "testfile1.tmp").native(), oflags).get();
+        auto close_f1 = deferred_close(f1);
+        auto f2 = open_file_dma((t.get_path() / "testfile2.tmp").native(), oflags).get();
+        auto close_f2 = deferred_close(f2);
+
+        auto align = f1.disk_write_dma_alignment();
+        auto size = 4 * align;
+        auto wbuf1 = allocate_aligned_buffer<char>(size, f1.memory_dma_alignment());
+        auto wbuf2 = allocate_aligned_buffer<char>(size, f2.memory_dma_alignment());
+        std::fill_n(wbuf1.get(), size, 'a');
+        std::fill_n(wbuf2.get(), size, 'b');
+
+        io_batch writes;
+        writes.add_write(f1, 0, wbuf1.get(), size);
+        writes.add_write(f2, 0, std::vector<iovec>{{wbuf2.get(), size / 2}, {wbuf2.get() + size / 2, size / 2}});
+        writes.submit().get();
+        BOOST_REQUIRE_EQUAL(writes.size(), 2);
+        BOOST_REQUIRE_EQUAL(writes.bytes(0), size);
+        BOOST_REQUIRE_EQUAL(writes.bytes(1), size);
+
+        auto rbuf1 = allocate_aligned_buffer<char>(size, f1.memory_dma_alignment());
+        auto rbuf2 = allocate_aligned_buffer<char>(size, f2.memory_dma_alignment());
+        io_batch reads;
+        // Adjacent reads of the same file, and a read past its end
+        reads.add_read(f1, 0, rbuf1.get(), size / 2);
+        reads.add_read(f1, size / 2, rbuf1.get() + size / 2, size / 2);
+        reads.add_read(f2, 0, std::vector<iovec>{{rbuf2.get(), size}});
+        reads.add_read(f2, size, rbuf2.get(), align);
+        reads.submit().get();
+        BOOST_REQUIRE_EQUAL(reads.bytes(0), size / 2);
+        BOOST_REQUIRE_EQUAL(reads.bytes(1), size / 2);
+        BOOST_REQUIRE_EQUAL(reads.bytes(2), size);
+        BOOST_REQUIRE_EQUAL(reads.bytes(3), 0);
+        BOOST_REQUIRE(std::all_of(rbuf1.get(), rbuf1.get() + size, [] (char c) { return c == 'a'; }));
+        BOOST_REQUIRE(std::all_of(rbuf2.get(), rbuf2.get() + size, [] (char c) { return c == 'b'; }));
+
+        // A failed operation doesn't fail the batch
+        auto ro = open_file_dma((t.get_path() / "testfile1.tmp").native(), open_flags::ro).get();
+        auto close_ro = deferred_close(ro);
+        io_batch bad;
+        bad.add_read(ro, 0, rbuf1.get(), size);
+        bad.add_write(ro, 0, wbuf1.get(), size);
+        bad.submit().get();
+        BOOST_REQUIRE(!bad.failed(0));
+        BOOST_REQUIRE(bad.failed(1));
+        BOOST_REQUIRE_THROW(bad.bytes(1), std::system_error);
+    });
+}
+
 SEASTAR_TEST_CASE(test_file_stat_method_with_file) {
     return tmp_dir::do_with_thread([] (tmp_dir& t) {
         auto oflags = open_flags::rw | open_flags::create | open_flags::truncate;
@@ -946,3 +1198,129 @@ SEASTAR_TEST_CASE(test_oversized_io_works) {
         BOOST_REQUIRE((size_t)std::count_if(buf.get(), buf.get() + buf_size, [](auto x) { return x == 'a'; }) == buf_size);
     });
 }
+
+SEASTAR_TEST_CASE(test_dma_write_and_flush) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+
+        // The second write is larger than the maximum request length, so it gets split
+        for (size_t buf_size : {size_t(4096), f.disk_write_max_length() + 4096}) {
+            auto buf = allocate_aligned_buffer<unsigned char>(buf_size, 4096);
+            std::fill(buf.get(), buf.get() + buf_size, 'a');
+            auto written = f.dma_write_and_flush(0, buf.get(), buf_size).get();
+            BOOST_REQUIRE_EQUAL(written, buf_size);
+
+            std::fill(buf.get(), buf.get() + buf_size, 'b');
+            f.dma_read(0, buf.get(), buf_size).get();
+            BOOST_REQUIRE((size_t)std::count(buf.get(), buf.get() + buf_size, 'a') == buf_size);
+        }
+        f.close().get();
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_dma_buffer_pool) {
+    auto& pool = internal::local_dma_buffer_pool();
+    auto before = pool.get_stats();
+
+    std::vector<temporary_buffer<char>> bufs;
+    for (size_t size : {4096, 6000, 65536, 131072, 1 << 20}) {
+        for (int i = 0; i < 8; i++) {
+            auto buf = internal::allocate_dma_buffer<char>(4096, size);
+            BOOST_REQUIRE_EQUAL(buf.size(), size);
+            BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(buf.get()) % 4096, 0);
+            std::memset(buf.get_write(), i, size);
+            bufs.push_back(std::move(buf));
+        }
+    }
+    // Every buffer is intact, none of them overlap
+    for (size_t i = 0; i < bufs.size(); i++) {
+        BOOST_REQUIRE(std::all_of(bufs[i].begin(), bufs[i].end(), [i] (char c) { return c == char(i % 8); }));
+    }
+
+    auto large = internal::allocate_dma_buffer<char>(4096, 2 << 20);
+    BOOST_REQUIRE_EQUAL(pool.get_stats().fallback_allocations, before.fallback_allocations + 1
+#ifdef SEASTAR_DEFAULT_ALLOCATOR
+            + bufs.size()
+#endif
+    );
+
+    if (smp::count > 1) {
+        // Released on another shard, returned to us on the next allocation
+        smp::submit_to(1, [buf = std::move(bufs.back())] {}).get();
+        bufs.pop_back();
+        internal::allocate_dma_buffer<char>(4096, 4096);
+    }
+    bufs.clear();
+    // Each size class keeps at most one free region around
+    BOOST_REQUIRE_LE(pool.get_stats().regions, before.regions + internal::dma_buffer_pool::nr_size_classes);
+}
+
+// Files on tmpfs can't use O_DIRECT, so they're served by the buffered engine
+static future<> with_buffered_file_dir(noncopyable_function<void (tmp_dir&)> func) {
+    struct ::statfs buf;
+    if (::statfs("/dev/shm", &buf) == -1 || buf.f_type != internal::fs_magic::tmpfs) {
+        BOOST_TEST_WARN(0, "Skipping this test because /dev/shm isn't tmpfs");
+        return make_ready_future<>();
+    }
+    return tmp_dir::do_with("/dev/shm", [func = std::move(func)] (tmp_dir& t) mutable {
+        return async([&t, &func] {
+            func(t);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_buffered_file_io) {
+    return with_buffered_file_dir([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+
+        auto wbuf = allocate_aligned_buffer<unsigned char>(4 * 4096, 4096);
+        for (size_t i = 0; i < 4 * 4096; i++) {
+            wbuf.get()[i] = i % 251;
+        }
+        BOOST_REQUIRE_EQUAL(f.dma_write(0, wbuf.get(), 3 * 4096).get(), 3 * 4096);
+        // A partial last page
+        BOOST_REQUIRE_EQUAL(f.dma_write_and_flush(3 * 4096, wbuf.get() + 3 * 4096, 4096).get(), 4096);
+        f.truncate(3 * 4096 + 100).get();
+
+        auto rbuf = allocate_aligned_buffer<unsigned char>(4 * 4096, 4096);
+        std::vector<iovec> iov{{rbuf.get(), 4096}, {rbuf.get() + 4096, 2 * 4096}};
+        BOOST_REQUIRE_EQUAL(f.dma_read(0, std::move(iov)).get(), 3 * 4096);
+        BOOST_REQUIRE(std::equal(rbuf.get(), rbuf.get() + 3 * 4096, wbuf.get()));
+
+        // Short read at eof, and nothing past it
+        BOOST_REQUIRE_EQUAL(f.dma_read(3 * 4096, rbuf.get(), 4096).get(), 100);
+        BOOST_REQUIRE(std::equal(rbuf.get(), rbuf.get() + 100, wbuf.get() + 3 * 4096));
+        BOOST_REQUIRE_EQUAL(f.dma_read(4 * 4096, rbuf.get(), 4096).get(), 0);
+
+        auto bulk = f.dma_read_bulk<unsigned char>(4096, 4 * 4096).get();
+        BOOST_REQUIRE_EQUAL(bulk.size(), 2 * 4096 + 100);
+        BOOST_REQUIRE(std::equal(bulk.begin(), bulk.end(), wbuf.get() + 4096));
+    });
+}
+
+SEASTAR_TEST_CASE(test_buffered_file_intent) {
+    return with_buffered_file_dir([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        auto buf = allocate_aligned_buffer<unsigned char>(4096, 4096);
+        std::fill(buf.get(), buf.get() + 4096, 'a');
+        f.dma_write(0, buf.get(), 4096).get();
+
+        for (int i = 0; i < 16; i++) {
+            io_intent intent;
+            auto read = f.dma_read(0, buf.get(), 4096, &intent);
+            bool completed = read.available();
+            intent.cancel();
+            if (completed) {
+                // Served from the page cache right away
+                BOOST_REQUIRE_EQUAL(read.get(), 4096);
+            } else {
+                BOOST_REQUIRE_THROW(read.get(), cancelled_error);
+            }
+        }
+    });
+}
@@ -20,6 +20,8 @@
  * Copyright (C) 2020 ScyllaDB
  */
 
+#include <algorithm>
+#include <set>
 #include <stdlib.h>
 
 #include <seastar/testing/test_case.hh>
@@ -304,3 +306,28 @@ SEASTAR_TEST_CASE(test_read_entire_file_contiguous) {
         });
     });
 }
+
+SEASTAR_THREAD_TEST_CASE(test_choose_directory) {
+    tmp_dir::do_with_thread([] (tmp_dir& td) {
+        std::vector<sstring> dirs;
+        for (auto name : {"a", "b", "c"}) {
+            dirs.push_back((td.get_path() / name).native());
+            make_directory(dirs.back()).get();
+        }
+
+        // Round robin visits every directory
+        std::set<sstring> chosen;
+        for (size_t i = 0; i < dirs.size(); i++) {
+            chosen.insert(choose_directory(dirs, io_placement_policy::round_robin).get());
+        }
+        BOOST_REQUIRE_EQUAL(chosen.size(), dirs.size());
+
+        // The other policies pick one of them as well
+        for (auto policy : {io_placement_policy::least_loaded, io_placement_policy::most_space}) {
+            auto dir = choose_directory(dirs, policy).get();
+            BOOST_REQUIRE(std::find(dirs.begin(), dirs.end(), dir) != dirs.end());
+        }
+
+        BOOST_REQUIRE_THROW(choose_directory({}).get(), std::invalid_argument);
+    }).get();
+}
@@ -22,6 +22,7 @@
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 
+#include <seastar/core/cross_shard_buffer.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/thread.hh>
@@ -173,3 +174,35 @@ SEASTAR_THREAD_TEST_CASE(foreign_ptr_destroy_test) {
     BOOST_REQUIRE_EQUAL(done[1].get_future().get(), true);
     BOOST_REQUIRE_EQUAL(done[0].get_future().get(), false);
 }
+
+SEASTAR_THREAD_TEST_CASE(cross_shard_buffer_test) {
+    auto other = (this_shard_id() + 1) % smp::count;
+
+    auto buf = make_temporary_buffer_on_shard<char>(other, 4096).get();
+    BOOST_REQUIRE_EQUAL(buf.size(), 4096);
+    std::fill(buf.get_write(), buf.get_write() + buf.size(), 'x');
+    auto received = smp::submit_to(other, [buf = std::move(buf)] () mutable {
+        auto local = migrate_on_receive(std::move(buf), 0);
+        return std::count(local.begin(), local.end(), 'x');
+    }).get();
+    BOOST_REQUIRE_EQUAL(received, 4096);
+
+    auto p = smp::submit_to(other, [] {
+        return make_foreign(std::make_unique<temporary_buffer<char>>(temporary_buffer<char>::copy_of("foreign")));
+    }).get();
+    auto data = p->get();
+    auto local = migrate_on_receive(std::move(p));
+    BOOST_REQUIRE_EQUAL(std::string_view(local.get(), local.size()), "foreign");
+    // Small buffers are shared, not copied
+    BOOST_REQUIRE_EQUAL(local.get(), data);
+
+    auto shared = smp::submit_to(other, [] {
+        return make_foreign(make_lw_shared<temporary_buffer<char>>(temporary_buffer<char>::copy_of("shared")));
+    }).get();
+    local = migrate_on_receive(std::move(shared), 0);
+    BOOST_REQUIRE_EQUAL(std::string_view(local.get(), local.size()), "shared");
+
+    auto ptr = memory::allocate_on_shard(other, 1000, 256).get();
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(ptr) % 256, 0);
+    ::free(ptr);
+}
@@ -28,6 +28,8 @@
 #include <seastar/core/seastar.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/core/fsnotify.hh>
+#include <seastar/core/directory_cache.hh>
+#include <seastar/core/sleep.hh>
 
 #include "tmpdir.hh"
 
@@ -226,3 +228,69 @@ SEASTAR_THREAD_TEST_CASE(test_shutdown_notifier) {
     auto events = fut.get();
     BOOST_REQUIRE(events.empty());
 }
+
+static void touch(const fs::path& p) {
+    auto f = open_file_dma(p.native(), open_flags::create|open_flags::rw).get();
+    f.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_directory_cache) {
+    using experimental::directory_cache;
+
+    tmpdir tmp;
+    auto dir = (tmp.path() / "dir").native();
+    make_directory(dir).get();
+    touch(tmp.path() / "dir" / "a");
+    touch(tmp.path() / "dir" / "b");
+
+    directory_cache cache;
+    std::vector<std::pair<sstring, bool>> changes;
+    cache.set_listener([&] (const sstring& d, const sstring& name, const stat_data* st) {
+        BOOST_REQUIRE_EQUAL(d, dir);
+        changes.emplace_back(name, st != nullptr);
+    });
+    cache.watch(dir).get();
+    BOOST_REQUIRE_EQUAL(cache.entries(dir).size(), 2);
+    BOOST_REQUIRE(cache.entries(dir).at("a").type == directory_entry_type::regular);
+    BOOST_REQUIRE_EQUAL(cache.get_stats().rescans, 1);
+
+    auto wait_for = [&] (auto cond) {
+        for (int i = 0; i < 500 && !cond(); i++) {
+            sleep(std::chrono::milliseconds(10)).get();
+        }
+        BOOST_REQUIRE(cond());
+    };
+
+    changes.clear();
+    touch(tmp.path() / "dir" / "c");
+    remove_file((tmp.path() / "dir" / "a").native()).get();
+    rename_file((tmp.path() / "dir" / "b").native(), (tmp.path() / "dir" / "d").native()).get();
+    make_directory((tmp.path() / "dir" / "e").native()).get();
+    wait_for([&] {
+        auto& e = cache.entries(dir);
+        return e.size() == 3 && e.contains("c") && e.contains("d") && e.contains("e");
+    });
+    BOOST_REQUIRE(cache.entries(dir).at("e").type == directory_entry_type::directory);
+    BOOST_REQUIRE(std::count(changes.begin(), changes.end(), std::make_pair(sstring("a"), false)));
+    BOOST_REQUIRE(std::count(changes.begin(), changes.end(), std::make_pair(sstring("c"), true)));
+    // Changes are picked up without listing the directory again
+    BOOST_REQUIRE_EQUAL(cache.get_stats().rescans, 1);
+
+    // Writes are seen once the file is closed
+    {
+        auto f = open_file_dma((tmp.path() / "dir" / "c").native(), open_flags::rw).get();
+        auto os = make_file_output_stream(f).get();
+        os.write("kossa").get();
+        os.close().get();
+    }
+    wait_for([&] { return cache.entries(dir).at("c").size == 5; });
+
+    // Removing the directory empties its entries
+    for (auto name : {"c", "d", "e"}) {
+        remove_file((tmp.path() / "dir" / name).native()).get();
+    }
+    remove_file(dir).get();
+    wait_for([&] { return cache.entries(dir).empty(); });
+
+    cache.close().get();
+}
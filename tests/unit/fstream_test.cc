@@ -22,6 +22,8 @@
 #include <algorithm>
 #include <iostream>
 #include <numeric>
+#include <random>
+#include <seastar/core/checksummed_fstream.hh>
 #include <seastar/core/fstream.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/shared_ptr.hh>
@@ -30,6 +32,7 @@
 #include <seastar/core/seastar.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/testing/test_runner.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/print.hh>
@@ -537,6 +540,231 @@ SEASTAR_TEST_CASE(test_fstream_slow_start) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_fstream_strided_read_ahead) {
+    static constexpr size_t record = 4096;
+    static constexpr size_t gap = 3 * record;
+    static constexpr size_t file_size = 1024 * (record + gap);
+
+    auto mock_file = make_shared<mock_read_only_file>(file_size);
+    mock_file->set_allowed_read_requests(std::numeric_limits<size_t>::max());
+    uint64_t bytes_read = 0;
+    mock_file->set_read_size_verifier([&] (size_t length) {
+        bytes_read += length;
+    });
+
+    file_input_stream_options options;
+    options.buffer_size = record;
+    options.read_ahead = 4;
+    options.adaptive_read_ahead = true;
+    auto in = make_file_input_stream(file(mock_file), 0, file_size, options);
+    auto close = deferred_close(in);
+
+    uint64_t consumed = 0;
+    while (true) {
+        auto buf = in.read_exactly(record).get();
+        if (buf.empty()) {
+            break;
+        }
+        BOOST_REQUIRE_EQUAL(buf.size(), record);
+        consumed += buf.size();
+        in.skip(gap).get();
+    }
+    BOOST_REQUIRE_EQUAL(consumed, file_size / 4);
+    // Once the stride is detected only the records are read, not the gaps
+    BOOST_REQUIRE_LT(bytes_read, file_size / 2);
+}
+
+SEASTAR_TEST_CASE(test_fstream_write_behind_budget) {
+    static constexpr size_t buffer_size = 4096;
+    static constexpr size_t file_size = 64 * buffer_size;
+    static constexpr unsigned nr_streams = 4;
+
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        write_behind_budget budget(3 * buffer_size);
+        size_t max_dirty = 0;
+
+        parallel_for_each(boost::irange(0u, nr_streams), [&] (unsigned i) {
+            return async([&, i] {
+                auto f = open_file_dma((t.get_path() / fmt::format("file{}", i)).native(), open_flags::rw | open_flags::create).get();
+                file_output_stream_options options;
+                options.buffer_size = buffer_size;
+                options.write_behind = 2;
+                options.dirty_budget = &budget;
+                options.dirty_priority = i;
+                auto out = make_file_output_stream(std::move(f), options).get();
+                for (size_t pos = 0; pos < file_size; pos += buffer_size) {
+                    out.write(sstring(buffer_size, char('a' + i))).get();
+                    max_dirty = std::max(max_dirty, budget.dirty());
+                }
+                out.close().get();
+            });
+        }).get();
+
+        BOOST_REQUIRE_LE(max_dirty, budget.limit());
+        BOOST_REQUIRE_GT(budget.throttled(), 0);
+        BOOST_REQUIRE_EQUAL(budget.dirty(), 0);
+        BOOST_REQUIRE_EQUAL(budget.waiters(), 0);
+
+        for (unsigned i = 0; i < nr_streams; i++) {
+            auto f = open_file_dma((t.get_path() / fmt::format("file{}", i)).native(), open_flags::ro).get();
+            auto close_f = deferred_close(f);
+            BOOST_REQUIRE_EQUAL(f.size().get(), file_size);
+            auto buf = f.dma_read<char>(0, file_size).get();
+            BOOST_REQUIRE(std::all_of(buf.begin(), buf.end(), [i] (char c) { return c == char('a' + i); }));
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_mmap_input_stream) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        static constexpr size_t file_size = 3 * 1024 * 1024 + 123;
+        auto filename = (t.get_path() / "testfile.tmp").native();
+        sstring data = uninitialized_string(file_size);
+        std::iota(data.begin(), data.end(), 0);
+        {
+            auto f = open_file_dma(filename, open_flags::wo | open_flags::create).get();
+            auto out = make_file_output_stream(std::move(f)).get();
+            out.write(data).get();
+            out.close().get();
+        }
+
+        auto f = open_file_dma(filename, open_flags::ro).get();
+        auto close_f = deferred_close(f);
+        mmap_input_stream_options options;
+        options.buffer_size = 100000;
+        options.read_ahead = 256 * 1024;
+        auto in = make_mmap_input_stream(f, options);
+        sstring read;
+        temporary_buffer<char> first;
+        for (;;) {
+            auto buf = in.read().get();
+            if (buf.empty()) {
+                break;
+            }
+            BOOST_REQUIRE_LE(buf.size(), options.buffer_size);
+            if (!first) {
+                first = buf.share();
+            }
+            read.append(buf.get(), buf.size());
+        }
+        in.close().get();
+        BOOST_REQUIRE(read == data);
+        // Buffers keep the mapping after the stream is gone
+        BOOST_REQUIRE(std::equal(first.begin(), first.end(), data.begin()));
+
+        auto range = make_mmap_input_stream(f, 1000, 5000, options);
+        auto close_range = deferred_close(range);
+        range.skip(1000).get();
+        auto buf = range.read_exactly(3000).get();
+        BOOST_REQUIRE_EQUAL(buf.size(), 3000);
+        BOOST_REQUIRE(std::equal(buf.begin(), buf.end(), data.begin() + 2000));
+        BOOST_REQUIRE_EQUAL(range.read_exactly(2000).get().size(), 1000);
+
+        // A length past the end of the file stops at it, like file input
+        // streams do, rather than mapping pages past it
+        auto tail = make_mmap_input_stream(f, file_size - 5000, uint64_t(1) << 30, options);
+        auto close_tail = deferred_close(tail);
+        buf = tail.read_exactly(10000).get();
+        BOOST_REQUIRE_EQUAL(buf.size(), 5000);
+        BOOST_REQUIRE(std::equal(buf.begin(), buf.end(), data.end() - 5000));
+        BOOST_REQUIRE(tail.eof());
+
+        auto past_eof = make_mmap_input_stream(f, file_size + 1000, 1000, options);
+        auto close_past_eof = deferred_close(past_eof);
+        BOOST_REQUIRE(past_eof.read().get().empty());
+    });
+}
+
+static sstring read_all(input_stream<char>& in) {
+    sstring ret;
+    for (;;) {
+        auto buf = in.read().get();
+        if (buf.empty()) {
+            return ret;
+        }
+        ret.append(buf.get(), buf.size());
+    }
+}
+
+SEASTAR_TEST_CASE(test_checksummed_fstream) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        static constexpr size_t file_size = 1024 * 1024 + 123;
+        // Compressible, but not trivially so
+        sstring data = uninitialized_string(file_size);
+        std::mt19937 rng(0);
+        std::generate(data.begin(), data.end(), [&] { return char('a' + rng() % 4); });
+
+        for (auto compression : {block_compression::none, block_compression::lz4, block_compression::zstd}) {
+            if (!block_compression_supported(compression)) {
+                continue;
+            }
+            for (bool index : {false, true}) {
+                auto filename = (t.get_path() / fmt::format("file-{}-{}", int(compression), index)).native();
+                checksummed_stream_options options;
+                options.block_size = 16384;
+                options.compression = compression;
+                options.index = index;
+                {
+                    auto f = open_file_dma(filename, open_flags::wo | open_flags::create).get();
+                    auto out = make_checksummed_file_output_stream(std::move(f), options).get();
+                    // Both unaligned pieces and ones spanning several blocks
+                    out.write(data.data(), 1000).get();
+                    out.write(data.data() + 1000, file_size - 1000).get();
+                    out.close().get();
+                }
+
+                auto f = open_file_dma(filename, open_flags::ro).get();
+                auto close_f = deferred_close(f);
+                if (compression != block_compression::none) {
+                    BOOST_REQUIRE_LT(f.size().get(), file_size);
+                }
+                auto in = make_checksummed_file_input_stream(f);
+                BOOST_REQUIRE(read_all(in) == data);
+                in.close().get();
+
+                for (uint64_t offset : {uint64_t(1), uint64_t(16384), uint64_t(500000), uint64_t(file_size - 1), uint64_t(file_size)}) {
+                    auto in = make_checksummed_file_input_stream(f, offset);
+                    auto read = read_all(in);
+                    in.close().get();
+                    BOOST_REQUIRE(read == data.substr(offset));
+                }
+            }
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_checksummed_fstream_corruption) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto filename = (t.get_path() / "testfile.tmp").native();
+        sstring data(100000, 'x');
+        {
+            auto f = open_file_dma(filename, open_flags::wo | open_flags::create).get();
+            auto out = make_checksummed_file_output_stream(std::move(f)).get();
+            out.write(data).get();
+            out.close().get();
+        }
+        {
+            // Flip a byte of the stored data of the second block
+            auto f = open_file_dma(filename, open_flags::rw).get();
+            auto close_f = deferred_close(f);
+            auto size = f.size().get();
+            auto buf = f.dma_read<char>(0, size).get();
+            auto copy = temporary_buffer<char>::aligned(f.memory_dma_alignment(), align_up<size_t>(size, f.disk_write_dma_alignment()));
+            std::copy(buf.begin(), buf.end(), copy.get_write());
+            copy.get_write()[65536 + 100] ^= 1;
+            f.dma_write(0, copy.get(), copy.size()).get();
+            f.truncate(size).get();
+        }
+        auto f = open_file_dma(filename, open_flags::ro).get();
+        auto close_f = deferred_close(f);
+        auto in = make_checksummed_file_input_stream(f);
+        auto close_in = deferred_close(in);
+        // The first block is still fine
+        BOOST_REQUIRE_EQUAL(in.read().get().size(), 65536);
+        BOOST_REQUIRE_THROW(in.read().get(), checksum_mismatch_error);
+    });
+}
+
 #ifdef SEASTAR_ENABLE_ALLOC_FAILURE_INJECTION
 
 SEASTAR_TEST_CASE(test_close_error) {
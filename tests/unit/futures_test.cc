@@ -532,6 +532,34 @@ SEASTAR_TEST_CASE(test_when_all_iterator_range) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_when_all_iterator_range_out_of_order) {
+    // Resolve the futures front to back, the opposite of the order in
+    // which when_all() waits for them, and fail some of them
+    std::vector<promise<int>> promises(100);
+    std::vector<future<int>> futures;
+    for (auto& p : promises) {
+        futures.push_back(p.get_future());
+    }
+    auto f = when_all(futures.begin(), futures.end());
+    for (size_t i = 0; i != promises.size(); ++i) {
+        if (i % 10 == 3) {
+            promises[i].set_exception(expected_exception());
+        } else {
+            promises[i].set_value(i);
+        }
+        yield().get();
+    }
+    auto ret = f.get();
+    BOOST_REQUIRE_EQUAL(ret.size(), promises.size());
+    for (size_t i = 0; i != ret.size(); ++i) {
+        if (i % 10 == 3) {
+            BOOST_REQUIRE_THROW(ret[i].get(), expected_exception);
+        } else {
+            BOOST_REQUIRE_EQUAL(ret[i].get(), int(i));
+        }
+    }
+}
+
 template<typename Container>
 void test_iterator_range_estimate() {
     using iter_traits = std::iterator_traits<typename Container::iterator>;
@@ -1501,6 +1529,55 @@ SEASTAR_TEST_CASE(test_with_timeout_when_it_does_not_time_out) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_with_deadline) {
+    auto deadline = manual_clock::now() + 1s;
+    std::vector<promise<int>> prs(10);
+    std::vector<future<int>> fs;
+    auto& queue = internal::deadline_queue<manual_clock>::local();
+    fs.push_back(with_deadline(deadline, prs[0].get_future()));
+    auto nr_deadlines = queue.deadlines();
+    for (int i = 1; i < 10; i++) {
+        fs.push_back(with_deadline(deadline, prs[i].get_future()));
+    }
+    // All calls share the deadline
+    BOOST_REQUIRE_EQUAL(queue.deadlines(), nr_deadlines);
+
+    for (int i = 0; i < 5; i++) {
+        prs[i].set_value(i);
+    }
+    for (int i = 0; i < 5; i++) {
+        BOOST_REQUIRE_EQUAL(fs[i].get(), i);
+    }
+    BOOST_REQUIRE(!fs[5].available());
+
+    manual_clock::advance(1s);
+    yield().get();
+
+    for (int i = 5; i < 10; i++) {
+        check_timed_out(std::move(fs[i]));
+        prs[i].set_value(i);
+    }
+    // Earlier deadlines were reached too
+    BOOST_REQUIRE_EQUAL(queue.deadlines(), 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_with_deadline_releases_deadlines) {
+    auto& queue = internal::deadline_queue<manual_clock>::local();
+    auto nr_deadlines = queue.deadlines();
+    std::vector<promise<int>> prs(10);
+    std::vector<future<int>> fs;
+    for (int i = 0; i < 10; i++) {
+        fs.push_back(with_deadline(manual_clock::now() + std::chrono::seconds(i + 1), prs[i].get_future()));
+    }
+    BOOST_REQUIRE_EQUAL(queue.deadlines(), nr_deadlines + 10);
+    // A deadline goes away with its last waiter, not when it's reached
+    for (int i = 0; i < 10; i++) {
+        prs[i].set_value(i);
+        BOOST_REQUIRE_EQUAL(fs[i].get(), i);
+        BOOST_REQUIRE_EQUAL(queue.deadlines(), nr_deadlines + 9 - i);
+    }
+}
+
 template<typename... T>
 static void check_aborted(future<T...>&& f) {
     check_failed_with<abort_requested_exception>(std::move(f));
@@ -2220,3 +2297,31 @@ SEASTAR_THREAD_TEST_CASE(test_foreign_promise_set_value) {
 
     BOOST_REQUIRE_EQUAL(getter.get(), other_shard);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_submit_stealable) {
+    struct destroyed_on {
+        shard_id origin = this_shard_id();
+        destroyed_on() = default;
+        destroyed_on(destroyed_on&&) = default;
+        ~destroyed_on() {
+            BOOST_REQUIRE_EQUAL(this_shard_id(), origin);
+        }
+    };
+
+    std::vector<future<int>> results;
+    for (int i = 0; i < 100; i++) {
+        results.push_back(smp::submit_stealable([i, d = destroyed_on()] {
+            return i;
+        }));
+    }
+    for (int i = 0; i < 100; i++) {
+        BOOST_REQUIRE_EQUAL(results[i].get(), i);
+    }
+
+    auto f = smp::submit_stealable([] {
+        return yield().then([] {
+            return make_exception_future<>(std::runtime_error("stolen"));
+        });
+    });
+    BOOST_REQUIRE_THROW(f.get(), std::runtime_error);
+}
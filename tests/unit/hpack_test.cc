@@ -0,0 +1,147 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE hpack
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <seastar/http/internal/hpack.hh>
+
+using namespace seastar;
+using namespace seastar::http::internal;
+
+static std::string from_hex(std::string_view hex) {
+    std::string out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        out.push_back(char(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16)));
+    }
+    return out;
+}
+
+using headers = std::vector<hpack_decoder::header>;
+
+// RFC 7541 C.3, requests without Huffman coding
+BOOST_AUTO_TEST_CASE(test_decode_requests) {
+    hpack_decoder d;
+    BOOST_REQUIRE(d.decode(from_hex("828684410f7777772e6578616d706c652e636f6d")) == (headers{
+        {":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}}));
+    BOOST_REQUIRE_EQUAL(d.table_size(), 57);
+    BOOST_REQUIRE(d.decode(from_hex("828684be58086e6f2d6361636865")) == (headers{
+        {":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"},
+        {"cache-control", "no-cache"}}));
+    BOOST_REQUIRE_EQUAL(d.table_size(), 110);
+    BOOST_REQUIRE(d.decode(from_hex("828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565")) == (headers{
+        {":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"},
+        {"custom-key", "custom-value"}}));
+    BOOST_REQUIRE_EQUAL(d.table_size(), 164);
+}
+
+// RFC 7541 C.4, the same requests with Huffman coding
+BOOST_AUTO_TEST_CASE(test_decode_huffman_requests) {
+    hpack_decoder d;
+    BOOST_REQUIRE(d.decode(from_hex("828684418cf1e3c2e5f23a6ba0ab90f4ff")) == (headers{
+        {":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}}));
+    BOOST_REQUIRE(d.decode(from_hex("828684be5886a8eb10649cbf")) == (headers{
+        {":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"},
+        {"cache-control", "no-cache"}}));
+    BOOST_REQUIRE(d.decode(from_hex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf")) == (headers{
+        {":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"},
+        {"custom-key", "custom-value"}}));
+    BOOST_REQUIRE_EQUAL(d.table_size(), 164);
+}
+
+BOOST_AUTO_TEST_CASE(test_table_size_update) {
+    hpack_decoder d;
+    d.decode(from_hex("828684410f7777772e6578616d706c652e636f6d"));
+    BOOST_REQUIRE_EQUAL(d.table_size(), 57);
+    // Shrinking to 0 empties the table
+    d.decode(from_hex("20"));
+    BOOST_REQUIRE_EQUAL(d.table_size(), 0);
+    BOOST_REQUIRE_THROW(d.decode(from_hex("be")), hpack_error);
+    // Above the 4096 limit
+    BOOST_REQUIRE_THROW(hpack_decoder().decode(from_hex("3fe13f")), hpack_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_invalid_blocks) {
+    // Index 0
+    BOOST_REQUIRE_THROW(hpack_decoder().decode(from_hex("80")), hpack_error);
+    // Truncated literal
+    BOOST_REQUIRE_THROW(hpack_decoder().decode(from_hex("410f7777")), hpack_error);
+    // Truncated integer
+    BOOST_REQUIRE_THROW(hpack_decoder().decode(from_hex("ff")), hpack_error);
+    // Integer overflow
+    BOOST_REQUIRE_THROW(hpack_decoder().decode(from_hex("ffffffffffffffff7f")), hpack_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_huffman) {
+    BOOST_REQUIRE_EQUAL(huffman_encode("www.example.com"), from_hex("f1e3c2e5f23a6ba0ab90f4ff"));
+    BOOST_REQUIRE_EQUAL(huffman_decode(from_hex("f1e3c2e5f23a6ba0ab90f4ff")), "www.example.com");
+    BOOST_REQUIRE_EQUAL(huffman_decode(""), "");
+
+    std::string all;
+    for (int c = 0; c < 256; c++) {
+        all.push_back(char(c));
+    }
+    BOOST_REQUIRE_EQUAL(huffman_decode(huffman_encode(all)), sstring(all.data(), all.size()));
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (int i = 0; i < 1000; i++) {
+        std::string s(i % 64, '\0');
+        for (auto& c : s) {
+            c = char(byte(rng));
+        }
+        BOOST_REQUIRE_EQUAL(huffman_decode(huffman_encode(s)), sstring(s.data(), s.size()));
+    }
+
+    // 'a' (00011) followed by a padding of zeros
+    BOOST_REQUIRE_THROW(huffman_decode(from_hex("18")), hpack_error);
+    // A whole byte of padding
+    BOOST_REQUIRE_THROW(huffman_decode(from_hex("1fff")), hpack_error);
+    // EOS
+    BOOST_REQUIRE_THROW(huffman_decode(from_hex("fffffffc")), hpack_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_encode) {
+    std::string block;
+    hpack_encode(block, ":status", "200");
+    // Fully indexed
+    BOOST_REQUIRE_EQUAL(block, from_hex("88"));
+
+    headers h = {
+        {":status", "404"},
+        {"content-type", "application/json"},
+        {"x-custom", "some value"},
+        {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+        {"content-length", std::string(200, 'x')},
+    };
+    block.clear();
+    for (auto& [name, value] : h) {
+        hpack_encode(block, name, value);
+    }
+    hpack_decoder d;
+    BOOST_REQUIRE(d.decode(block) == h);
+    // Nothing is indexed
+    BOOST_REQUIRE_EQUAL(d.table_size(), 0);
+}
@@ -3,31 +3,43 @@
  */
 
 #include <seastar/http/httpd.hh>
+#include <seastar/http/internal/hpack.hh>
 #include <seastar/http/handlers.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/http/file_handler.hh>
+#include <seastar/http/cached_handler.hh>
 #include <seastar/http/matcher.hh>
 #include <seastar/http/matchrules.hh>
 #include <seastar/json/formatter.hh>
 #include <seastar/http/routes.hh>
 #include <seastar/http/exception.hh>
 #include <seastar/http/transformers.hh>
+#include <seastar/core/byteorder.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/when_all.hh>
+#include <seastar/core/with_timeout.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 #include "loopback_socket.hh"
 #include "seastar/http/reply.hh"
 #include <boost/algorithm/string.hpp>
+#include <boost/range/irange.hpp>
 #include <seastar/core/thread.hh>
 #include <seastar/util/noncopyable_function.hh>
 #include <seastar/http/json_path.hh>
 #include <seastar/http/response_parser.hh>
 #include <sstream>
+#include <zlib.h>
 #include <seastar/core/shared_future.hh>
 #include <seastar/http/client.hh>
+#include <seastar/http/compression.hh>
+#include <seastar/http/multipart_upload.hh>
 #include <seastar/http/url.hh>
 #include <seastar/util/later.hh>
 #include <seastar/util/short_streams.hh>
+#include <seastar/util/tmp_file.hh>
+#include <seastar/core/fstream.hh>
 
 using namespace seastar;
 using namespace httpd;
@@ -108,6 +120,98 @@ SEASTAR_TEST_CASE(test_match_rule_order)
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(test_route_trie)
+{
+    // Matches URLs that end with a suffix, which the trie can't compile
+    class suffix_matcher : public matcher {
+        sstring _suffix;
+    public:
+        explicit suffix_matcher(sstring suffix) : _suffix(std::move(suffix)) {}
+        size_t match(const sstring& url, size_t ind, parameters& param) override {
+            return boost::ends_with(url, _suffix) ? url.size() : sstring::npos;
+        }
+    };
+
+    routes route;
+    std::vector<match_rule*> rules;
+    auto add = [&] (auto&& build) {
+        auto rule = new match_rule(new handl());
+        build(*rule);
+        rules.push_back(rule);
+        route.add(rule, GET);
+    };
+    add([] (match_rule& r) { r.add_str("/api/v1/keyspaces").add_param("ks").add_str("/tables"); });
+    add([] (match_rule& r) { r.add_str("/api/v1").add_param("resource").add_param("id"); });
+    add([] (match_rule& r) { r.add_matcher(new suffix_matcher(".json")); });
+    add([] (match_rule& r) { r.add_str("/api/v1/keyspaces/system").add_str("/tables"); });
+    add([] (match_rule& r) { r.add_str("/api/v1/keyspaces").add_param("ks"); });
+    add([] (match_rule& r) { r.add_str("/files").add_param("path", true); });
+    add([] (match_rule& r) { r.add_str("/api/").add_param("x"); });
+    add([] (match_rule& r) { r.add_str("/api").add_param("rest", true); });
+    add([] (match_rule& r) { r.add_param("any"); });
+
+    auto reference = [&] (const sstring& url, parameters& params) -> httpd::handler_base* {
+        for (auto rule : rules) {
+            if (auto h = rule->get(url, params)) {
+                return h;
+            }
+            params.clear();
+        }
+        return nullptr;
+    };
+    for (sstring url : {"/api/v1/keyspaces/ks1/tables", "/api/v1/keyspaces/system/tables", "/api/v1/keyspaces/ks1",
+            "/api/v1/keyspaces/ks1/", "/api/v1/keyspaces", "/api/v1/x/y", "/api/v1/x/y/z", "/api/v1/x/y.json",
+            "/files", "/files/", "/files/a/b/c", "/filesx/a", "/api", "/api/", "/api//", "/api/v2/keyspaces",
+            "/", "", "//", "x", "/x", "/x/y", "/api/v1//tables"}) {
+        parameters expected_params;
+        auto expected = reference(url, expected_params);
+        for (int twice = 0; twice < 2; twice++) {
+            parameters params;
+            auto h = route.get_handler(GET, url, params);
+            BOOST_REQUIRE_MESSAGE(h == expected, url);
+            for (auto key : {"ks", "resource", "id", "path", "x", "rest", "any"}) {
+                BOOST_REQUIRE_EQUAL(params.exists(key), expected_params.exists(key));
+                if (params.exists(key)) {
+                    BOOST_REQUIRE_EQUAL(params.path(key), expected_params.path(key));
+                }
+            }
+        }
+    }
+
+    // Lookups see rules added and removed after the trie was built
+    parameters params;
+    auto h = new handl();
+    match_rule late(h);
+    late.add_str("/new").add_param("p");
+    auto cookie = route.add_cookie(&late, GET);
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/new/x", params), h);
+    BOOST_REQUIRE_EQUAL(params.path("p"), "/x");
+    route.del_cookie(cookie, GET);
+    params.clear();
+    httpd::handler_base* nl = nullptr;
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/new/x", params), nl);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_route_admission)
+{
+    routes route;
+    auto limited = new handl();
+    route.put(GET, "/limited", limited);
+    route.put(GET, "/free", new handl());
+    route.set_admission(limited, httpd::admission_config{.max_concurrency = 4});
+
+    auto controller = route.get_admission(GET, "/limited");
+    BOOST_REQUIRE(controller);
+    BOOST_REQUIRE_EQUAL(controller->config().max_concurrency, 4);
+    BOOST_REQUIRE(!route.get_admission(GET, "/free"));
+    BOOST_REQUIRE(!route.get_admission(POST, "/limited"));
+
+    delete route.drop(GET, "/limited");
+    BOOST_REQUIRE(!route.get_admission(GET, "/limited"));
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(test_put_drop_rule)
 {
     routes rts;
@@ -952,6 +1056,182 @@ SEASTAR_TEST_CASE(test_100_continue) {
 }
 
 
+BOOST_AUTO_TEST_CASE(test_hpack_header_list_limit) {
+    auto string_literal = [] (std::string& block, std::string_view s) {
+        // Without Huffman coding, the length has a 7 bit prefix
+        if (s.size() < 127) {
+            block += char(s.size());
+        } else {
+            block += char(127);
+            for (auto n = s.size() - 127; ; n >>= 7) {
+                if (n < 128) {
+                    block += char(n);
+                    break;
+                }
+                block += char(0x80 | (n & 0x7f));
+            }
+        }
+        block += s;
+    };
+    // An entry filling most of the dynamic table, then referenced by one
+    // byte each time
+    std::string block;
+    block += char(0x40);
+    string_literal(block, "x-big");
+    string_literal(block, std::string(4000, 'a'));
+    block += std::string(100, char(0x80 | 62));
+
+    http::internal::hpack_decoder decoder;
+    BOOST_REQUIRE_THROW(decoder.decode(block, 64 << 10), http::internal::hpack_header_list_too_large);
+    // The table is in sync, the next block may use it
+    auto headers = decoder.decode(std::string(1, char(0x80 | 62)), 64 << 10);
+    BOOST_REQUIRE_EQUAL(headers.size(), 1);
+    BOOST_REQUIRE_EQUAL(headers[0].first, "x-big");
+    BOOST_REQUIRE_EQUAL(headers[0].second.size(), 4000);
+}
+
+static std::string http2_frame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload) {
+    std::string f(9, '\0');
+    f[0] = char(payload.size() >> 16);
+    f[1] = char(payload.size() >> 8);
+    f[2] = char(payload.size());
+    f[3] = char(type);
+    f[4] = char(flags);
+    write_be<uint32_t>(f.data() + 5, id);
+    f += payload;
+    return f;
+}
+
+// Reads the frames of the response to stream 1, acknowledging the server
+// settings, and checks it is the json_test_handler one
+static void check_http2_response(input_stream<char>& input, output_stream<char>& output) {
+    http::internal::hpack_decoder decoder;
+    std::vector<http::internal::hpack_decoder::header> headers;
+    std::string body;
+    bool got_settings = false;
+    bool end_stream = false;
+    while (!end_stream) {
+        auto h = input.read_exactly(9).get();
+        BOOST_REQUIRE_EQUAL(h.size(), 9);
+        uint32_t length = (uint8_t(h[0]) << 16) | (uint8_t(h[1]) << 8) | uint8_t(h[2]);
+        uint8_t type = h[3];
+        uint8_t flags = h[4];
+        uint32_t id = read_be<uint32_t>(h.get() + 5);
+        auto payload = input.read_exactly(length).get();
+        BOOST_REQUIRE_EQUAL(payload.size(), length);
+        switch (type) {
+        case 0x4: // SETTINGS
+            if (!(flags & 0x1)) {
+                got_settings = true;
+                output.write(http2_frame(0x4, 0x1, 0, "")).get();
+                output.flush().get();
+            }
+            break;
+        case 0x1: // HEADERS
+            BOOST_REQUIRE_EQUAL(id, 1);
+            BOOST_REQUIRE(flags & 0x4);
+            headers = decoder.decode(std::string_view(payload.get(), payload.size()));
+            end_stream = flags & 0x1;
+            break;
+        case 0x0: // DATA
+            BOOST_REQUIRE_EQUAL(id, 1);
+            body.append(payload.get(), payload.size());
+            end_stream = flags & 0x1;
+            break;
+        }
+    }
+    BOOST_REQUIRE(got_settings);
+    BOOST_REQUIRE(!headers.empty());
+    BOOST_REQUIRE_EQUAL(headers[0].first, ":status");
+    BOOST_REQUIRE_EQUAL(headers[0].second, "200");
+    for (auto& [name, value] : headers) {
+        BOOST_REQUIRE_NE(name, "transfer-encoding");
+    }
+    BOOST_REQUIRE_EQUAL(body, "\"hello\"");
+}
+
+SEASTAR_TEST_CASE(test_http2_prior_knowledge) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = seastar::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+
+            std::string block;
+            http::internal::hpack_encode(block, ":method", "GET");
+            http::internal::hpack_encode(block, ":scheme", "http");
+            http::internal::hpack_encode(block, ":path", "/test");
+            http::internal::hpack_encode(block, ":authority", "test");
+            std::string req = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+            req += http2_frame(0x4, 0, 0, "");
+            // END_STREAM | END_HEADERS
+            req += http2_frame(0x1, 0x5, 1, block);
+            output.write(req).get();
+            output.flush().get();
+
+            check_http2_response(input, output);
+
+            input.close().get();
+            output.close().get();
+        });
+
+        auto handler = new json_test_handler(json::stream_object("hello"));
+        server._routes.put(GET, "/test", handler);
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_http2_upgrade) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = seastar::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+
+            // SETTINGS_MAX_CONCURRENT_STREAMS = 100, SETTINGS_INITIAL_WINDOW_SIZE = 65535
+            output.write(sstring("GET /test HTTP/1.1\r\nHost: test\r\nConnection: Upgrade, HTTP2-Settings\r\n"
+                    "Upgrade: h2c\r\nHTTP2-Settings: AAMAAABkAAQAAP__\r\n\r\n")).get();
+            output.flush().get();
+
+            // Byte by byte, not to consume the frames that follow
+            std::string resp;
+            while (!resp.ends_with("\r\n\r\n")) {
+                auto b = input.read_exactly(1).get();
+                BOOST_REQUIRE_EQUAL(b.size(), 1);
+                resp += b[0];
+            }
+            BOOST_REQUIRE_NE(resp.find("101 Switching Protocols"), std::string::npos);
+
+            output.write(sstring("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n")).get();
+            output.write(http2_frame(0x4, 0, 0, "")).get();
+            output.flush().get();
+
+            check_http2_response(input, output);
+
+            input.close().get();
+            output.close().get();
+        });
+
+        auto handler = new json_test_handler(json::stream_object("hello"));
+        server._routes.put(GET, "/test", handler);
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
 SEASTAR_TEST_CASE(test_unparsable_request) {
     // Test if a message that cannot be parsed as a http request is being replied with a 400 Bad Request response
     return seastar::async([] {
@@ -1293,6 +1573,507 @@ SEASTAR_TEST_CASE(test_stream_content_chunked) {
     return test_basic_content(true, true);
 }
 
+SEASTAR_TEST_CASE(test_http2_client) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = seastar::async([&lcf] {
+            class connection_factory : public http::experimental::connection_factory {
+                loopback_socket_impl lsi;
+            public:
+                explicit connection_factory(loopback_connection_factory& f) : lsi(f) {}
+                virtual future<connected_socket> make() override {
+                    return lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+                }
+            };
+            auto cln = http::experimental::client(std::make_unique<connection_factory>(lcf), 1, http::experimental::client::protocol::http2);
+
+            // All of them share the single connection
+            parallel_for_each(boost::irange(0, 16), [&cln] (int i) {
+                auto req = http::request::make("GET", "test", "/test");
+                req.write_body("txt", format("request {}", i));
+                return cln.make_request(std::move(req), [i] (const http::reply& resp, input_stream<char>&& in) {
+                    BOOST_REQUIRE_EQUAL(resp._version, "2.0");
+                    return seastar::async([in = std::move(in), i] () mutable {
+                        sstring body = util::read_entire_stream_contiguous(in).get();
+                        BOOST_REQUIRE_EQUAL(body, format("request {}", i));
+                    });
+                }, http::reply::status_type::ok);
+            }).get();
+            BOOST_REQUIRE_EQUAL(cln.connections_nr(), 1);
+
+            // Larger than the flow control windows
+            constexpr size_t size = 256*1024;
+            sstring jumbo(size, 'a');
+            auto req = http::request::make("GET", "test", "/test");
+            req.write_body("txt", size, [jumbo] (output_stream<char>&& out) {
+                return seastar::async([out = std::move(out), jumbo] () mutable {
+                    out.write(jumbo).get();
+                    out.close().get();
+                });
+            });
+            cln.make_request(std::move(req), [jumbo] (const http::reply& resp, input_stream<char>&& in) {
+                BOOST_REQUIRE_EQUAL(resp.content_length, jumbo.size());
+                return seastar::async([in = std::move(in), jumbo] () mutable {
+                    sstring body = util::read_entire_stream_contiguous(in).get();
+                    BOOST_REQUIRE_EQUAL(body, jumbo);
+                });
+            }, http::reply::status_type::ok).get();
+
+            cln.close().get();
+        });
+
+        server._routes.put(GET, "/test", new echo_string_handler());
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_content_encoding_negotiation) {
+    using http::content_encoding;
+    auto negotiate = [] (std::string_view accept) {
+        return http::internal::negotiate_content_encoding(accept, { content_encoding::gzip, content_encoding::deflate });
+    };
+    BOOST_REQUIRE(!negotiate(""));
+    BOOST_REQUIRE(!negotiate("identity"));
+    BOOST_REQUIRE(negotiate("gzip") == content_encoding::gzip);
+    BOOST_REQUIRE(negotiate("x-gzip") == content_encoding::gzip);
+    BOOST_REQUIRE(negotiate("deflate, gzip") == content_encoding::gzip);
+    BOOST_REQUIRE(negotiate("deflate, gzip;q=0.5") == content_encoding::deflate);
+    BOOST_REQUIRE(negotiate("GZIP ; q=0.2 , *;q=0.1") == content_encoding::gzip);
+    BOOST_REQUIRE(negotiate("*") == content_encoding::gzip);
+    BOOST_REQUIRE(negotiate("gzip;q=0, *") == content_encoding::deflate);
+    BOOST_REQUIRE(!negotiate("gzip;q=0, deflate;q=0"));
+}
+
+static sstring inflate_body(const sstring& body) {
+    z_stream zs = {};
+    // Detects the gzip and zlib wrappers
+    BOOST_REQUIRE_EQUAL(inflateInit2(&zs, MAX_WBITS + 32), Z_OK);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    zs.avail_in = body.size();
+    sstring out;
+    int ret;
+    do {
+        char buf[4096];
+        zs.next_out = reinterpret_cast<Bytef*>(buf);
+        zs.avail_out = sizeof(buf);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        BOOST_REQUIRE(ret == Z_OK || ret == Z_STREAM_END);
+        out += sstring(buf, sizeof(buf) - zs.avail_out);
+    } while (ret != Z_STREAM_END);
+    inflateEnd(&zs);
+    return out;
+}
+
+static future<> test_compressed_reply(bool chunked_reply) {
+    return seastar::async([chunked_reply] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        http::compression_config cfg;
+        cfg.encodings = { http::content_encoding::gzip, http::content_encoding::deflate };
+        cfg.min_size = 100;
+        server.set_compression(cfg);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = seastar::async([&lcf, chunked_reply] {
+            class connection_factory : public http::experimental::connection_factory {
+                loopback_socket_impl lsi;
+            public:
+                explicit connection_factory(loopback_connection_factory& f) : lsi(f) {}
+                virtual future<connected_socket> make() override {
+                    return lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+                }
+            };
+            auto cln = http::experimental::client(std::make_unique<connection_factory>(lcf));
+
+            sstring large;
+            for (int i = 0; i < 10000; i++) {
+                large += format("{{\"key\": {}}}, ", i % 100);
+            }
+            auto request = [&cln] (sstring body, sstring accept) {
+                auto req = http::request::make("GET", "test", "/test");
+                if (!accept.empty()) {
+                    req._headers["Accept-Encoding"] = accept;
+                }
+                req.write_body("txt", std::move(body));
+                std::pair<sstring, sstring> ret;
+                cln.make_request(std::move(req), [&ret] (const http::reply& resp, input_stream<char>&& in) {
+                    ret.first = resp.get_header("Content-Encoding");
+                    return seastar::async([in = std::move(in), &ret] () mutable {
+                        ret.second = util::read_entire_stream_contiguous(in).get();
+                    });
+                }, http::reply::status_type::ok).get();
+                return ret;
+            };
+
+            auto [encoding, body] = request(large, "deflate;q=0.5, gzip");
+            BOOST_REQUIRE_EQUAL(encoding, "gzip");
+            BOOST_REQUIRE_LT(body.size(), large.size() / 10);
+            BOOST_REQUIRE_EQUAL(inflate_body(body), large);
+
+            std::tie(encoding, body) = request(large, "deflate");
+            BOOST_REQUIRE_EQUAL(encoding, "deflate");
+            BOOST_REQUIRE_EQUAL(inflate_body(body), large);
+
+            std::tie(encoding, body) = request(large, "");
+            BOOST_REQUIRE_EQUAL(encoding, "");
+            BOOST_REQUIRE_EQUAL(body, large);
+
+            if (!chunked_reply) {
+                // Below the minimum size
+                std::tie(encoding, body) = request("short", "gzip");
+                BOOST_REQUIRE_EQUAL(encoding, "");
+                BOOST_REQUIRE_EQUAL(body, "short");
+            }
+
+            cln.close().get();
+        });
+
+        server._routes.put(GET, "/test", new echo_string_handler(chunked_reply));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_compressed_string_reply) {
+    return test_compressed_reply(false);
+}
+
+SEASTAR_TEST_CASE(test_compressed_streamed_reply) {
+    return test_compressed_reply(true);
+}
+
+SEASTAR_TEST_CASE(test_file_handler_range) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "range.txt").native();
+        sstring content = "0123456789abcdef";
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto out = make_file_output_stream(f).get();
+        out.write(content).get();
+        out.close().get();
+
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = seastar::async([&lcf, &content] {
+            class connection_factory : public http::experimental::connection_factory {
+                loopback_socket_impl lsi;
+            public:
+                explicit connection_factory(loopback_connection_factory& f) : lsi(f) {}
+                virtual future<connected_socket> make() override {
+                    return lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+                }
+            };
+            auto cln = http::experimental::client(std::make_unique<connection_factory>(lcf));
+
+            struct result {
+                http::reply::status_type status;
+                sstring accept_ranges;
+                sstring content_range;
+                sstring body;
+            };
+            auto request = [&cln] (sstring range) {
+                auto req = http::request::make("GET", "test", "/file.txt");
+                if (!range.empty()) {
+                    req._headers["Range"] = range;
+                }
+                result ret;
+                cln.make_request(std::move(req), [&ret] (const http::reply& resp, input_stream<char>&& in) {
+                    ret.status = resp._status;
+                    ret.accept_ranges = resp.get_header("Accept-Ranges");
+                    ret.content_range = resp.get_header("Content-Range");
+                    return seastar::async([in = std::move(in), &ret] () mutable {
+                        ret.body = util::read_entire_stream_contiguous(in).get();
+                    });
+                }).get();
+                return ret;
+            };
+
+            auto r = request("");
+            BOOST_REQUIRE_EQUAL(r.status, http::reply::status_type::ok);
+            BOOST_REQUIRE_EQUAL(r.accept_ranges, "bytes");
+            BOOST_REQUIRE_EQUAL(r.body, content);
+
+            r = request("bytes=2-5");
+            BOOST_REQUIRE_EQUAL(r.status, http::reply::status_type::partial_content);
+            BOOST_REQUIRE_EQUAL(r.content_range, "bytes 2-5/16");
+            BOOST_REQUIRE_EQUAL(r.body, "2345");
+
+            r = request("bytes=-3");
+            BOOST_REQUIRE_EQUAL(r.status, http::reply::status_type::partial_content);
+            BOOST_REQUIRE_EQUAL(r.content_range, "bytes 13-15/16");
+            BOOST_REQUIRE_EQUAL(r.body, "def");
+
+            r = request("bytes=10-100");
+            BOOST_REQUIRE_EQUAL(r.status, http::reply::status_type::partial_content);
+            BOOST_REQUIRE_EQUAL(r.body, "abcdef");
+
+            // Multiple ranges aren't supported, the whole file is sent
+            r = request("bytes=0-1,4-5");
+            BOOST_REQUIRE_EQUAL(r.status, http::reply::status_type::ok);
+            BOOST_REQUIRE_EQUAL(r.body, content);
+
+            r = request("bytes=100-");
+            BOOST_REQUIRE_EQUAL(r.status, http::reply::status_type::range_not_satisfiable);
+            BOOST_REQUIRE_EQUAL(r.content_range, "bytes */16");
+
+            cln.close().get();
+        });
+
+        server._routes.put(GET, "/file.txt", new httpd::file_handler(filename, nullptr, false));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_file_handler_sendfile) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "sendfile.txt").native();
+        sstring content;
+        for (int i = 0; i < 10000; i++) {
+            content += to_sstring(i);
+        }
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto out = make_file_output_stream(f).get();
+        out.write(content).get();
+        out.close().get();
+
+        // Loopback sockets can't send files, a real one is needed
+        http_server server("test");
+        server._routes.put(GET, "/file.txt", new httpd::file_handler(filename, nullptr, false));
+        server.listen(socket_address(ipv4_addr("127.0.0.1", 0))).get();
+        auto addr = httpd::http_server_tester::listeners(server).back().local_address();
+
+        auto cln = http::experimental::client(addr);
+        auto request = [&cln] (sstring range) {
+            auto req = http::request::make("GET", "test", "/file.txt");
+            if (!range.empty()) {
+                req._headers["Range"] = range;
+            }
+            sstring body;
+            cln.make_request(std::move(req), [&body] (const http::reply& resp, input_stream<char>&& in) {
+                return seastar::async([in = std::move(in), &body] () mutable {
+                    body = util::read_entire_stream_contiguous(in).get();
+                });
+            }).get();
+            return body;
+        };
+
+        BOOST_REQUIRE_EQUAL(request(""), content);
+        BOOST_REQUIRE_EQUAL(server.files_sent(), 1);
+        BOOST_REQUIRE_EQUAL(request("bytes=100-199"), content.substr(100, 100));
+        BOOST_REQUIRE_EQUAL(server.files_sent(), 2);
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_pipelined_requests) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        server.set_pipeline_depth(4);
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        // The slow handler only completes once the one of the next request ran
+        promise<> fast_done;
+        auto slow_done = fast_done.get_future();
+        server._routes.put(GET, "/slow", new function_handler([&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            return with_timeout(lowres_clock::now() + 10s, std::move(slow_done)).then([rep = std::move(rep)] () mutable {
+                rep->_content = "slow";
+                return std::move(rep);
+            }).handle_exception_type([] (const timed_out_error&) {
+                auto rep = std::make_unique<http::reply>();
+                rep->_content = "serialized";
+                return rep;
+            });
+        }, "txt"));
+        server._routes.put(GET, "/fast", new function_handler([&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            fast_done.set_value();
+            rep->_content = "fast";
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "txt"));
+        server._routes.put(POST, "/echo", new function_handler([&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            rep->_content = "echo:" + req->content;
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get();
+        input_stream<char> input(c_socket.input());
+        output_stream<char> output(c_socket.output());
+        output.write("GET /slow HTTP/1.1\r\nHost: test\r\n\r\n"
+                "GET /fast HTTP/1.1\r\nHost: test\r\n\r\n"
+                "POST /echo HTTP/1.1\r\nHost: test\r\nContent-Length: 5\r\n\r\nhello"
+                "GET /missing HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n").get();
+        output.flush().get();
+        auto resp = util::read_entire_stream_contiguous(input).get();
+
+        auto slow = resp.find("\r\n\r\nslow");
+        auto fast = resp.find("\r\n\r\nfast");
+        auto echo = resp.find("\r\n\r\necho:hello");
+        auto missing = resp.find("404 Not Found");
+        BOOST_REQUIRE_NE(slow, sstring::npos);
+        BOOST_REQUIRE_NE(fast, sstring::npos);
+        BOOST_REQUIRE_NE(echo, sstring::npos);
+        BOOST_REQUIRE_NE(missing, sstring::npos);
+        BOOST_REQUIRE_LT(slow, fast);
+        BOOST_REQUIRE_LT(fast, echo);
+        BOOST_REQUIRE_LT(echo, missing);
+
+        input.close().get();
+        output.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_cached_handler) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        unsigned calls = 0;
+        auto cached = new cached_handler(std::make_unique<function_handler>([&calls] (const_req req) {
+            return format("config {} {}", ++calls, req.get_header("Accept"));
+        }, "txt"), cached_handler::config{ .vary = { "Accept" } });
+        server._routes.put(GET, "/config", cached);
+        server.do_accepts(0).get();
+
+        auto request = [&lsi] (sstring headers) {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+            output.write("GET /config HTTP/1.1\r\nHost: test\r\nConnection: close\r\n" + headers + "\r\n").get();
+            output.flush().get();
+            auto resp = util::read_entire_stream_contiguous(input).get();
+            input.close().get();
+            output.close().get();
+            return resp;
+        };
+        auto etag_of = [] (const sstring& resp) {
+            auto begin = resp.find("ETag: ");
+            BOOST_REQUIRE_NE(begin, sstring::npos);
+            begin += 6;
+            return resp.substr(begin, resp.find("\r\n", begin) - begin);
+        };
+
+        auto first = request("");
+        BOOST_REQUIRE(first.starts_with("HTTP/1.1 200 OK\r\n"));
+        BOOST_REQUIRE(first.ends_with("\r\n\r\nconfig 1 "));
+        BOOST_REQUIRE_NE(first.find("Content-Length: 9\r\n"), sstring::npos);
+        BOOST_REQUIRE_NE(first.find("Server: Seastar httpd\r\n"), sstring::npos);
+        auto second = request("");
+        BOOST_REQUIRE(second.ends_with("\r\n\r\nconfig 1 "));
+        BOOST_REQUIRE_EQUAL(etag_of(first), etag_of(second));
+        BOOST_REQUIRE_EQUAL(calls, 1);
+        BOOST_REQUIRE_EQUAL(cached->get_stats().hits, 1);
+
+        // Each value of the varying header is a reply of its own
+        BOOST_REQUIRE(request("Accept: text/plain\r\n").ends_with("\r\n\r\nconfig 2 text/plain"));
+        BOOST_REQUIRE_EQUAL(cached->size(), 2);
+
+        auto not_modified = request("If-None-Match: \"other\", " + etag_of(first) + "\r\n");
+        BOOST_REQUIRE(not_modified.starts_with("HTTP/1.1 304 Not Modified\r\n"));
+        BOOST_REQUIRE(not_modified.ends_with("\r\n\r\n"));
+        BOOST_REQUIRE_EQUAL(etag_of(not_modified), etag_of(first));
+        BOOST_REQUIRE(request("If-None-Match: \"other\"\r\n").starts_with("HTTP/1.1 200 OK\r\n"));
+        BOOST_REQUIRE_EQUAL(calls, 2);
+
+        cached->invalidate("/config");
+        BOOST_REQUIRE_EQUAL(cached->size(), 0);
+        auto third = request("");
+        BOOST_REQUIRE(third.ends_with("\r\n\r\nconfig 3 "));
+        BOOST_REQUIRE_NE(etag_of(third), etag_of(first));
+        BOOST_REQUIRE_EQUAL(calls, 3);
+
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_admission_control) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        server.set_admission(httpd::admission_config{
+            .max_concurrency = 1,
+            .max_queue_length = 1,
+            .max_queue_time = std::chrono::seconds(10),
+            .retry_after = std::chrono::seconds(3),
+        });
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        unsigned entered = 0;
+        promise<> release;
+        shared_future<> released(release.get_future());
+        server._routes.put(GET, "/slow", new function_handler([&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            ++entered;
+            return released.get_future().then([rep = std::move(rep)] () mutable {
+                rep->_content = "done";
+                return std::move(rep);
+            });
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        struct client {
+            connected_socket socket;
+            input_stream<char> in;
+            output_stream<char> out;
+            explicit client(connected_socket s) : socket(std::move(s)), in(socket.input()), out(socket.output()) {}
+            void send() {
+                out.write("GET /slow HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n").get();
+                out.flush().get();
+            }
+            sstring receive() {
+                auto resp = util::read_entire_stream_contiguous(in).get();
+                in.close().get();
+                out.close().get();
+                return resp;
+            }
+        };
+        auto connect = [&] {
+            return std::make_unique<client>(lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get());
+        };
+
+        auto admitted = connect();
+        admitted->send();
+        while (entered == 0) {
+            yield().get();
+        }
+        auto queued = connect();
+        queued->send();
+        while (server.requests_queued() == 0) {
+            yield().get();
+        }
+        auto shed = connect();
+        shed->send();
+        auto resp = shed->receive();
+        BOOST_REQUIRE_NE(resp.find("503 Service Unavailable"), sstring::npos);
+        BOOST_REQUIRE_NE(resp.find("Retry-After: 3"), sstring::npos);
+        BOOST_REQUIRE_EQUAL(entered, 1);
+
+        release.set_value();
+        BOOST_REQUIRE_NE(admitted->receive().find("\r\n\r\ndone"), sstring::npos);
+        BOOST_REQUIRE_NE(queued->receive().find("\r\n\r\ndone"), sstring::npos);
+        BOOST_REQUIRE_EQUAL(entered, 2);
+        BOOST_REQUIRE_EQUAL(server.requests_queued(), 1);
+        BOOST_REQUIRE_EQUAL(server.requests_shed(), 1);
+
+        server.stop().get();
+    });
+}
+
 SEASTAR_TEST_CASE(test_not_implemented_encoding) {
     return check_http_reply({
         "GET /test HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: gzip, chunked\r\n\r\n",
@@ -1550,6 +2331,212 @@ SEASTAR_TEST_CASE(test_redirect_exception) {
     });
 }
 
+SEASTAR_TEST_CASE(test_client_retries_and_hedging) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        unsigned calls = 0;
+        promise<> release_first;
+        server._routes.put(GET, "/test", new function_handler([&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            // The 17th request waits, and gets hedged once the client has
+            // enough latency samples
+            if (++calls == 17) {
+                return release_first.get_future().then([rep = std::move(rep)] () mutable {
+                    rep->_content = "first";
+                    return std::move(rep);
+                });
+            }
+            rep->_content = calls == 18 ? "hedge" : "ok";
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        class connection_factory : public http::experimental::connection_factory {
+            loopback_socket_impl lsi;
+            unsigned& _failures;
+        public:
+            connection_factory(loopback_connection_factory& f, unsigned& failures) : lsi(f), _failures(failures) {}
+            virtual future<connected_socket> make() override {
+                if (_failures) {
+                    _failures--;
+                    return make_exception_future<connected_socket>(std::runtime_error("connection refused"));
+                }
+                return lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+            }
+        };
+        unsigned failures = 1;
+        auto cln = http::experimental::client(std::make_unique<connection_factory>(lcf, failures));
+        auto get = [&cln] {
+            sstring body;
+            cln.make_request(http::request::make("GET", "test", "/test"), [&body] (const http::reply& rep, input_stream<char>&& in) {
+                return do_with(std::move(in), [&body] (input_stream<char>& in) {
+                    return util::read_entire_stream_contiguous(in).then([&body] (sstring b) {
+                        body = std::move(b);
+                    });
+                });
+            }, http::reply::status_type::ok).get();
+            return body;
+        };
+
+        // Not retried by default
+        BOOST_REQUIRE_THROW(get(), std::runtime_error);
+        failures = 2;
+        cln.set_retry_options({ .max_retries = 2, .backoff = 1ms, .hedge_quantile = 0.9 });
+        BOOST_REQUIRE_EQUAL(get(), "ok");
+        BOOST_REQUIRE_EQUAL(cln.total_retries_nr(), 2);
+
+        for (int i = 0; i < 15; i++) {
+            BOOST_REQUIRE_EQUAL(get(), "ok");
+        }
+        BOOST_REQUIRE_EQUAL(cln.total_hedged_nr(), 0);
+        BOOST_REQUIRE_EQUAL(get(), "hedge");
+        BOOST_REQUIRE_EQUAL(cln.total_hedged_nr(), 1);
+
+        release_first.set_value();
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_client_pool) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        server._routes.put(GET, "/test", new function_handler([] (const_req req) {
+            return "ok";
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        class connection_factory : public http::experimental::connection_factory {
+            loopback_socket_impl lsi;
+        public:
+            explicit connection_factory(loopback_connection_factory& f) : lsi(f) {}
+            virtual future<connected_socket> make() override {
+                return lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+            }
+        };
+        std::vector<sstring> endpoints;
+        http::experimental::client_pool pool([&] (const sstring& endpoint) {
+            endpoints.push_back(endpoint);
+            return std::make_unique<http::experimental::client>(std::make_unique<connection_factory>(lcf), 4);
+        }, 2);
+
+        auto& a = pool.get("a:80");
+        BOOST_REQUIRE_EQUAL(&pool.get("a:80"), &a);
+        pool.warm_up().get();
+        BOOST_REQUIRE_EQUAL(a.idle_connections_nr(), 2);
+
+        pool.make_request("b:80", http::request::make("GET", "test", "/test"), [] (const http::reply& rep, input_stream<char>&& in) {
+            return do_with(std::move(in), [] (input_stream<char>& in) {
+                return util::skip_entire_stream(in);
+            });
+        }, http::reply::status_type::ok).get();
+        BOOST_REQUIRE_EQUAL(pool.endpoints_nr(), 2);
+        BOOST_REQUIRE(endpoints == std::vector<sstring>({"a:80", "b:80"}));
+        BOOST_REQUIRE_LE(pool.get("b:80").connections_nr(), 4);
+
+        pool.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_client_multipart_upload) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "upload.bin").native();
+        sstring content = uninitialized_string(3 * 4096 + 100);
+        for (unsigned i = 0; i < content.size(); i++) {
+            content[i] = 'a' + i % 26;
+        }
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto out = make_file_output_stream(f).get();
+        out.write(content).get();
+        out.close().get();
+        f = open_file_dma(filename, open_flags::ro).get();
+
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        std::map<unsigned, sstring> parts;
+        sstring object;
+        sstring completion;
+        unsigned puts = 0;
+        server._routes.put(POST, "/obj", new function_handler([&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            if (req->query_parameters.contains("uploads")) {
+                rep->_content = "<InitiateMultipartUploadResult><UploadId>42</UploadId></InitiateMultipartUploadResult>";
+            } else {
+                BOOST_REQUIRE_EQUAL(req->get_query_param("uploadId"), "42");
+                completion = req->content;
+                object = "";
+                for (auto& [nr, data] : parts) {
+                    object += data;
+                }
+                rep->_content = "<CompleteMultipartUploadResult></CompleteMultipartUploadResult>";
+            }
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "xml"));
+        server._routes.put(PUT, "/obj", new function_handler([&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            puts++;
+            BOOST_REQUIRE_EQUAL(req->get_header("X-Test"), "signed");
+            if (req->query_parameters.contains("partNumber")) {
+                BOOST_REQUIRE_EQUAL(req->get_query_param("uploadId"), "42");
+                auto nr = std::stoul(req->get_query_param("partNumber"));
+                parts[nr] = req->content;
+                rep->add_header("ETag", fmt::format("etag-{}", nr));
+            } else {
+                object = req->content;
+            }
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        class connection_factory : public http::experimental::connection_factory {
+            loopback_socket_impl lsi;
+        public:
+            explicit connection_factory(loopback_connection_factory& f) : lsi(f) {}
+            virtual future<connected_socket> make() override {
+                return lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+            }
+        };
+        auto cln = http::experimental::client(std::make_unique<connection_factory>(lcf), 2);
+
+        http::experimental::multipart_upload_options opts;
+        // Like a signer, the decorator needs the complete request
+        opts.decorate = [] (http::request& req) {
+            if (req._method == "PUT") {
+                BOOST_REQUIRE(req.body_writer);
+                BOOST_REQUIRE_GT(req.content_length, 0);
+                if (req.query_parameters.contains("partNumber")) {
+                    BOOST_REQUIRE(req.query_parameters.contains("uploadId"));
+                }
+            } else if (req._method == "POST" && !req.query_parameters.contains("uploads")) {
+                BOOST_REQUIRE(req.query_parameters.contains("uploadId"));
+                BOOST_REQUIRE(!req.content.empty());
+            }
+            req._headers["X-Test"] = "signed";
+        };
+        http::experimental::upload_file(cln, "test", "/obj", f, opts).get();
+        BOOST_REQUIRE_EQUAL(puts, 1);
+        BOOST_REQUIRE_EQUAL(object, content);
+
+        opts.part_size = 4096;
+        opts.parallelism = 2;
+        object = "";
+        http::experimental::upload_file(cln, "test", "/obj", f, opts).get();
+        BOOST_REQUIRE_EQUAL(puts, 5);
+        BOOST_REQUIRE_EQUAL(parts.size(), 4);
+        BOOST_REQUIRE_EQUAL(parts[4].size(), 100);
+        BOOST_REQUIRE_EQUAL(object, content);
+        BOOST_REQUIRE_NE(completion.find("<Part><PartNumber>4</PartNumber><ETag>etag-4</ETag></Part>"), sstring::npos);
+
+        cln.close().get();
+        f.close().get();
+        server.stop().get();
+    });
+}
+
 BOOST_AUTO_TEST_CASE(test_path_decode_unchanged) {
     auto unchanged_chars = seastar::sstring{
       "~abcdefghijklmnopqrstuvwhyz-ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789.+"};
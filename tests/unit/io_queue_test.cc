@@ -75,8 +75,8 @@ struct io_queue_for_tests {
     io_queue queue;
     timer<> kicker;
 
-    io_queue_for_tests()
-        : group(std::make_shared<io_group>(io_queue::config{0}, 1))
+    io_queue_for_tests(io_queue::config cfg = io_queue::config{0})
+        : group(std::make_shared<io_group>(std::move(cfg), 1))
         , sink()
         , queue(group, sink)
         , kicker([this] { kick(); })
@@ -90,9 +90,22 @@ struct io_queue_for_tests {
         }
     }
 
+    void report_latency(std::chrono::duration<double> lat) {
+        group->report_latency(0, lat);
+    }
+
+    double adjust_rate() {
+        group->adjust_rate(0);
+        return group->_adaptive_rate[0].factor;
+    }
+
     future<size_t> queue_request(internal::priority_class pc, internal::io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept {
         return queue.queue_request(pc, dnl, std::move(req), intent, std::move(iovs));
     }
+
+    size_t queued() const noexcept { return queue._queued_requests; }
+    size_t executing() const noexcept { return queue._requests_executing; }
+    fair_queue_entry::capacity_t pending_capacity() const noexcept { return queue._pending_capacity; }
 };
 
 internal::priority_class get_default_pc() {
@@ -324,6 +337,34 @@ SEASTAR_THREAD_TEST_CASE(test_io_cancellation) {
     when_all_succeed(finished.begin(), finished.end()).get();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_io_cancellation_in_flight) {
+    fake_file file;
+    io_queue_for_tests tio;
+    io_intent intent;
+    int val = 42;
+
+    auto f = tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 1), file.make_write_req(0, &val), &intent, {});
+    seastar::sleep(std::chrono::milliseconds(100)).get();
+    tio.queue.poll_io_queue();
+    BOOST_REQUIRE_EQUAL(tio.queued(), 0);
+    BOOST_REQUIRE_EQUAL(tio.executing(), 1);
+    BOOST_REQUIRE_GT(tio.pending_capacity(), 0);
+
+    // The dispatched request gives its capacity back at once, but only
+    // resolves once the device is done with its buffer
+    intent.cancel();
+    BOOST_REQUIRE_EQUAL(tio.pending_capacity(), 0);
+    BOOST_REQUIRE_EQUAL(tio.executing(), 1);
+    BOOST_REQUIRE(!f.available());
+
+    tio.sink.drain([&file] (const internal::io_request& rq, io_completion* desc) -> bool {
+        file.execute_write_req(rq, desc);
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(tio.executing(), 0);
+    BOOST_REQUIRE_THROW(f.get(), cancelled_error);
+}
+
 SEASTAR_TEST_CASE(test_request_buffer_split) {
     auto ensure = [] (const std::vector<internal::io_request::part>& parts, const internal::io_request& req, int idx, uint64_t pos, size_t size, uintptr_t mem) {
         BOOST_REQUIRE(parts[idx].req.opcode() == req.opcode());
@@ -368,6 +409,32 @@ SEASTAR_TEST_CASE(test_request_buffer_split) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(test_request_nvme_cmd_split) {
+    using o = internal::io_request::operation;
+    // 4k blocks, the maximum length is not a multiple of the block size
+    auto req = internal::io_request::make_nvme_cmd(3, 1, internal::io_request::nvme_cmd_write, 12, 8192, reinterpret_cast<void*>(0x10000), 5 * 4096, true);
+    BOOST_REQUIRE(req.is_write());
+    auto parts = req.split(10000);
+    BOOST_REQUIRE_EQUAL(parts.size(), 3);
+    uint64_t pos = 8192;
+    for (unsigned i = 0; i < parts.size(); i++) {
+        const auto& sub_op = parts[i].req.as<o::nvme_cmd>();
+        size_t size = i < 2 ? 8192 : 4096;
+        BOOST_REQUIRE(parts[i].req.opcode() == o::nvme_cmd);
+        BOOST_REQUIRE_EQUAL(sub_op.fd, 3);
+        BOOST_REQUIRE_EQUAL(sub_op.nsid, 1);
+        BOOST_REQUIRE_EQUAL(sub_op.lba_shift, 12);
+        BOOST_REQUIRE(sub_op.fua);
+        BOOST_REQUIRE_EQUAL(sub_op.pos, pos);
+        BOOST_REQUIRE_EQUAL(sub_op.size, size);
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(sub_op.addr), 0x10000 + pos - 8192);
+        BOOST_REQUIRE_EQUAL(parts[i].size, size);
+        pos += size;
+    }
+
+    return make_ready_future<>();
+}
+
 static void show_request(const internal::io_request& req, void* buf_off, std::string pfx = "") {
     if (!seastar_logger.is_enabled(log_level::trace)) {
         return;
@@ -509,3 +576,193 @@ SEASTAR_TEST_CASE(test_request_iovec_split) {
 
     return make_ready_future<>();
 }
+
+SEASTAR_THREAD_TEST_CASE(test_adaptive_rate) {
+    io_queue::config cfg{0};
+    cfg.adaptive_rate = true;
+    io_queue_for_tests tio(cfg);
+    const auto& fg = internal::get_fair_group(tio.queue, 0);
+    auto rate = fg.token_bucket().rate();
+    auto goal = cfg.rate_limit_duration;
+
+    // No completions, no evidence to act upon
+    BOOST_REQUIRE_EQUAL(tio.adjust_rate(), 1.0);
+
+    // The worst shard's latency counts
+    tio.report_latency(goal / 10);
+    tio.report_latency(goal * 2);
+    auto factor = tio.adjust_rate();
+    BOOST_REQUIRE_LT(factor, 1.0);
+    BOOST_REQUIRE_LT(fg.token_bucket().rate(), rate);
+
+    tio.report_latency(goal / 10);
+    BOOST_REQUIRE_GT(tio.adjust_rate(), factor);
+
+    for (int i = 0; i < 1000; i++) {
+        tio.report_latency(goal * 10);
+        tio.adjust_rate();
+    }
+    BOOST_REQUIRE_EQUAL(tio.adjust_rate(), cfg.adaptive_rate_min_factor);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_read_coalescing) {
+    io_queue::config cfg{0};
+    cfg.coalesce_reads = true;
+    io_queue_for_tests tio(cfg);
+
+    constexpr size_t block = 512;
+    auto buf = std::make_unique<char[]>(5 * block);
+    auto dnl = internal::io_direction_and_length(internal::io_direction_and_length::read_idx, block);
+    std::vector<future<size_t>> reads;
+    // Adjacent reads out of order, plus one that isn't and one of another file
+    for (uint64_t pos : { 1, 0, 2, 4 }) {
+        reads.push_back(tio.queue_request(get_default_pc(), dnl, internal::io_request::make_read(0, pos * block, buf.get() + pos * block, block, false), nullptr, {}));
+    }
+    reads.push_back(tio.queue_request(get_default_pc(), dnl, internal::io_request::make_read(1, 3 * block, buf.get() + 3 * block, block, false), nullptr, {}));
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+
+    unsigned nr_reads = 0, nr_readvs = 0;
+    tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+        if (rq.opcode() == internal::io_request::operation::readv) {
+            const auto& op = rq.as<internal::io_request::operation::readv>();
+            BOOST_REQUIRE_EQUAL(op.pos, 0);
+            BOOST_REQUIRE_EQUAL(op.iov_len, 3);
+            for (unsigned i = 0; i < op.iov_len; i++) {
+                BOOST_REQUIRE_EQUAL(op.iovec[i].iov_base, buf.get() + i * block);
+            }
+            nr_readvs++;
+            // A short read leaves the last part with nothing
+            desc->complete_with(2 * block);
+        } else {
+            BOOST_REQUIRE(rq.opcode() == internal::io_request::operation::read);
+            nr_reads++;
+            desc->complete_with(block);
+        }
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(nr_readvs, 1);
+    BOOST_REQUIRE_EQUAL(nr_reads, 2);
+
+    BOOST_REQUIRE_EQUAL(reads[0].get(), block);
+    BOOST_REQUIRE_EQUAL(reads[1].get(), block);
+    BOOST_REQUIRE_EQUAL(reads[2].get(), 0);
+    BOOST_REQUIRE_EQUAL(reads[3].get(), block);
+    BOOST_REQUIRE_EQUAL(reads[4].get(), block);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_request_sampling) {
+    io_queue::config cfg{0};
+    cfg.request_sample_rate = 2;
+    cfg.request_log_size = 3;
+    io_queue_for_tests tio(cfg);
+
+    constexpr size_t block = 512;
+    auto buf = std::make_unique<char[]>(8 * block);
+    auto dnl = internal::io_direction_and_length(internal::io_direction_and_length::read_idx, block);
+    std::vector<future<size_t>> reads;
+    for (uint64_t pos = 0; pos < 8; pos++) {
+        reads.push_back(tio.queue_request(get_default_pc(), dnl, internal::io_request::make_read(0, pos * block, buf.get() + pos * block, block, false), nullptr, {}));
+    }
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+        desc->complete_with(block);
+        return true;
+    });
+    for (auto& f : reads) {
+        BOOST_REQUIRE_EQUAL(f.get(), block);
+    }
+
+    // Every other request is sampled, the log keeps the last three of them
+    auto sampled = tio.queue.sampled_requests();
+    BOOST_REQUIRE_EQUAL(sampled.size(), 3);
+    for (auto& sr : sampled) {
+        BOOST_REQUIRE(!sr.write);
+        BOOST_REQUIRE_EQUAL(sr.length, block);
+        BOOST_REQUIRE_EQUAL(sr.class_id, get_default_pc().id());
+        BOOST_REQUIRE(sr.queued <= sr.dispatched);
+        BOOST_REQUIRE(sr.dispatched <= sr.completed);
+        // Requests were queued before the sleep and dispatched after it
+        BOOST_REQUIRE(sr.dispatched - sr.queued >= std::chrono::milliseconds(500));
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_iops_limit) {
+    io_queue_for_tests tio;
+    io_limits limits;
+    limits.iops = 10;
+    limits.iops_burst = 2;
+    tio.queue.update_limits_for_class(get_default_pc(), limits).get();
+
+    constexpr size_t block = 512;
+    constexpr unsigned nr_reads = 20;
+    auto buf = std::make_unique<char[]>(block);
+    auto dnl = internal::io_direction_and_length(internal::io_direction_and_length::read_idx, block);
+    std::vector<future<size_t>> reads;
+    for (unsigned i = 0; i < nr_reads; i++) {
+        reads.push_back(tio.queue_request(get_default_pc(), dnl, internal::io_request::make_read(0, 0, buf.get(), block, false), nullptr, {}));
+    }
+
+    unsigned dispatched = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(300)) {
+        tio.queue.poll_io_queue();
+        tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+            desc->complete_with(block);
+            dispatched++;
+            return true;
+        });
+        seastar::sleep(std::chrono::milliseconds(10)).get();
+    }
+    // About three requests worth of rate, plus the burst
+    BOOST_REQUIRE_GE(dispatched, 1);
+    BOOST_REQUIRE_LT(dispatched, 10);
+
+    // Lifting the limit lets the rest through
+    tio.queue.update_limits_for_class(get_default_pc(), io_limits{}).get();
+    while (dispatched < nr_reads) {
+        seastar::sleep(std::chrono::milliseconds(10)).get();
+        tio.queue.poll_io_queue();
+        tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+            desc->complete_with(block);
+            dispatched++;
+            return true;
+        });
+    }
+    for (auto& f : reads) {
+        BOOST_REQUIRE_EQUAL(f.get(), block);
+    }
+}
+
+SEASTAR_TEST_CASE(test_request_cost_curve) {
+    io_queue::config cfg{0};
+    cfg.req_count_rate = io_queue::read_request_base_count * 1000;
+    cfg.blocks_count_rate = (io_queue::read_request_base_count * (100ul << 20)) >> io_queue::block_size_shift;
+    auto tokens = [&cfg] (int dir, size_t len) {
+        return internal::request_tokens(internal::io_direction_and_length(dir, len), cfg);
+    };
+    auto linear = tokens(internal::io_direction_and_length::read_idx, 4096);
+
+    cfg.read_costs = {{4096, 0.001}, {65536, 0.004}};
+    cfg.write_costs = {{4096, 0.002}, {65536, 0.008}};
+    // Below and at the measured points
+    BOOST_REQUIRE_EQUAL(tokens(internal::io_direction_and_length::read_idx, 512), 0.001);
+    BOOST_REQUIRE_EQUAL(tokens(internal::io_direction_and_length::read_idx, 65536), 0.004);
+    BOOST_REQUIRE_EQUAL(tokens(internal::io_direction_and_length::write_idx, 4096), 0.002);
+    // Interpolated in between, and charged at the bandwidth past the last one
+    auto mid = tokens(internal::io_direction_and_length::read_idx, 4096 + 30720);
+    BOOST_REQUIRE_CLOSE(mid, 0.0025, 0.01);
+    auto big = tokens(internal::io_direction_and_length::read_idx, 65536 + (1 << 20));
+    BOOST_REQUIRE_CLOSE(big, 0.004 + 0.01, 0.01);
+
+    cfg.write_interference_factor = 2.0;
+    BOOST_REQUIRE_EQUAL(tokens(internal::io_direction_and_length::write_idx, 4096), 0.004);
+    BOOST_REQUIRE_EQUAL(tokens(internal::io_direction_and_length::read_idx, 4096), 0.001);
+
+    cfg.read_costs.clear();
+    BOOST_REQUIRE_EQUAL(tokens(internal::io_direction_and_length::read_idx, 4096), linear);
+    return make_ready_future<>();
+}
@@ -0,0 +1,92 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/net/ip_checksum.hh>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace seastar;
+using namespace net;
+
+// RFC1071, one 16-bit word at a time
+static uint16_t reference_checksum(const std::vector<uint8_t>& data) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        sum += i % 2 ? data[i] : data[i] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(~sum);
+}
+
+static std::vector<uint8_t> random_data(std::mt19937& rng, size_t len) {
+    std::vector<uint8_t> data(len);
+    // Plenty of 0xff bytes to exercise the carries
+    for (auto& c : data) {
+        c = rng() % 4 ? 0xff : rng();
+    }
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE(test_checksum_lengths) {
+    std::mt19937 rng(0);
+    for (size_t len = 0; len < 1100; len++) {
+        auto data = random_data(rng, len);
+        BOOST_REQUIRE_EQUAL(ip_checksum(data.data(), data.size()), reference_checksum(data));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_checksum_pieces) {
+    std::mt19937 rng(1);
+    for (int i = 0; i < 1000; i++) {
+        auto data = random_data(rng, rng() % 3000);
+        checksummer csum;
+        // Odd sized and misaligned pieces
+        for (size_t off = 0; off < data.size();) {
+            auto n = std::min<size_t>(data.size() - off, rng() % 700 + 1);
+            csum.sum(reinterpret_cast<const char*>(data.data() + off), n);
+            off += n;
+        }
+        BOOST_REQUIRE_EQUAL(csum.get(), reference_checksum(data));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_checksum_copy) {
+    std::mt19937 rng(2);
+    for (int i = 0; i < 1000; i++) {
+        auto data = random_data(rng, rng() % 3000);
+        std::vector<char> copy(data.size());
+        checksummer csum;
+        for (size_t off = 0; off < data.size();) {
+            auto n = std::min<size_t>(data.size() - off, rng() % 700 + 1);
+            csum.sum_copy(copy.data() + off, reinterpret_cast<const char*>(data.data() + off), n);
+            off += n;
+        }
+        BOOST_REQUIRE_EQUAL(csum.get(), reference_checksum(data));
+        BOOST_REQUIRE(std::equal(copy.begin(), copy.end(), data.begin(), data.end(),
+                [] (char a, uint8_t b) { return uint8_t(a) == b; }));
+    }
+}
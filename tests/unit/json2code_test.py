@@ -85,6 +85,36 @@ class TestJson2Code(unittest.TestCase):
             self.assertEqual(response['message'], 'Not found')
             self.assertEqual(response['code'], 404)
 
+    def test_typed_params(self):
+        params = urllib.parse.urlencode({'count': 3, 'verbose': 'true', 'mode': 'SLOW'})
+        url = f'http://localhost:{self.port}/hello/typed/bon%20jour/42?{params}'
+        with urllib.request.urlopen(url) as f:
+            response = json.loads(f.read().decode('utf-8'))
+            self.assertEqual(response['name'], 'bon jour')
+            self.assertEqual(response['id'], 42)
+            self.assertEqual(response['count'], 3)
+            self.assertEqual(response['verbose'], True)
+            self.assertEqual(response['mode'], 'SLOW')
+
+    def test_optional_typed_params(self):
+        params = urllib.parse.urlencode({'count': 3})
+        url = f'http://localhost:{self.port}/hello/typed/bon/42?{params}'
+        with urllib.request.urlopen(url) as f:
+            response = json.loads(f.read().decode('utf-8'))
+            self.assertEqual(response['verbose'], False)
+            self.assertNotIn('mode', response)
+
+    def test_bad_typed_params(self):
+        for path, query in [('bon/abc', {'count': 3}),
+                            ('bon/42', {'count': '3x'}),
+                            ('bon/42', {'count': 3, 'verbose': 'maybe'})]:
+            params = urllib.parse.urlencode(query)
+            url = f'http://localhost:{self.port}/hello/typed/{path}?{params}'
+            with self.assertRaises(urllib.error.HTTPError) as e:
+                with urllib.request.urlopen(url):
+                    pass
+            self.assertEqual(e.exception.code, 400)
+
 
 if __name__ == '__main__':
     parser = argparse.ArgumentParser()
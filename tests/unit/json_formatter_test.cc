@@ -19,17 +19,37 @@
 /*
  * Copyright (C) 2016 ScyllaDB.
  */
+#include <cmath>
+#include <limits>
 #include <vector>
 
 #include <seastar/core/do_with.hh>
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/do_with.hh>
+#include <seastar/core/vector-data-sink.hh>
 #include <seastar/json/formatter.hh>
 
 using namespace seastar;
 using namespace json;
 
+template <typename T>
+static sstring write_json(const T& value) {
+    std::vector<net::packet> v;
+    // A small buffer exercises writes that span several packets
+    output_stream<char> out(data_sink(std::make_unique<vector_data_sink>(v)), 8);
+    formatter::write(out, value).get();
+    out.close().get();
+    sstring res;
+    for (auto& p : v) {
+        for (auto& f : p.fragments()) {
+            res += sstring(f.base, f.size);
+        }
+    }
+    return res;
+}
+
 SEASTAR_TEST_CASE(test_simple_values) {
     BOOST_CHECK_EQUAL("3", formatter::to_json(3));
     BOOST_CHECK_EQUAL("3", formatter::to_json(3.0));
@@ -59,3 +79,34 @@ SEASTAR_TEST_CASE(test_collections) {
 
     return make_ready_future();
 }
+
+SEASTAR_THREAD_TEST_CASE(test_stream_write) {
+    using namespace std::string_literals;
+    auto check = [] (const auto& value) {
+        BOOST_CHECK_EQUAL(formatter::to_json(value), write_json(value));
+    };
+    check(3);
+    check(-17);
+    check(42u);
+    check(std::numeric_limits<long>::min());
+    check(std::numeric_limits<unsigned long>::max());
+    check(3.0);
+    check(3.5);
+    check(0.1);
+    check(-1e300);
+    check(std::numeric_limits<double>::denorm_min());
+    check(2.5f);
+    check(true);
+    check(false);
+    check("apa");
+    check(sstring("\0 COWA\bU\nGA [{\r}]\x1a"s));
+    check(sstring(200, '"'));
+    check(sstring(1000, 'x'));
+    check(std::vector<int>({1, 2, 3, 4}));
+    check(std::vector<sstring>({"a", "b\n"}));
+
+    BOOST_CHECK_EQUAL("0.1", formatter::to_json(0.1));
+    BOOST_CHECK_EQUAL("-9223372036854775808", formatter::to_json(std::numeric_limits<long>::min()));
+    BOOST_CHECK_THROW(write_json(std::numeric_limits<double>::infinity()), std::out_of_range);
+    BOOST_CHECK_THROW(write_json(std::nan("")), std::invalid_argument);
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <string>
+#include <vector>
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/http/internal/content_source.hh>
+#include <seastar/json/stream_parser.hh>
+
+using namespace seastar;
+using namespace json;
+
+// Hands out the document in chunk_size pieces
+class split_source_impl : public data_source_impl {
+    sstring _data;
+    size_t _chunk_size;
+    size_t _pos = 0;
+public:
+    split_source_impl(sstring data, size_t chunk_size) : _data(std::move(data)), _chunk_size(chunk_size) {}
+    virtual future<temporary_buffer<char>> get() override {
+        auto len = std::min(_chunk_size, _data.size() - _pos);
+        temporary_buffer<char> buf(_data.data() + _pos, len);
+        _pos += len;
+        return make_ready_future<temporary_buffer<char>>(std::move(buf));
+    }
+};
+
+static input_stream<char> make_stream(sstring data, size_t chunk_size) {
+    return input_stream<char>(data_source(std::make_unique<split_source_impl>(std::move(data), chunk_size)));
+}
+
+static const char* type_name(token_type t) {
+    switch (t) {
+    case token_type::begin_object: return "{";
+    case token_type::end_object: return "}";
+    case token_type::begin_array: return "[";
+    case token_type::end_array: return "]";
+    case token_type::key: return "key";
+    case token_type::string: return "string";
+    case token_type::number: return "number";
+    case token_type::boolean: return "boolean";
+    case token_type::null: return "null";
+    case token_type::end: return "end";
+    }
+    return "?";
+}
+
+static std::vector<std::string> tokens(input_stream<char>& in) {
+    std::vector<std::string> res;
+    stream_parser parser(in);
+    for (auto t = parser.next().get(); t.type != token_type::end; t = parser.next().get()) {
+        res.push_back(std::string(type_name(t.type)) + (t.value.empty() ? "" : ":") + std::string(t.value));
+    }
+    return res;
+}
+
+static std::vector<std::string> tokens(sstring doc, size_t chunk_size) {
+    auto in = make_stream(std::move(doc), chunk_size);
+    return tokens(in);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_tokens) {
+    sstring doc = R"( {"name": "apa", "values": [1, -2.5e3, 0, true, false, null],
+        "nested": {"empty": {}, "list": [[]], "esc": "a\"b\\c\/\n\u00e9\ud83d\ude00"}} )";
+    std::vector<std::string> expected = {
+        "{", "key:name", "string:apa", "key:values",
+        "[", "number:1", "number:-2.5e3", "number:0", "boolean:true", "boolean:false", "null:null", "]",
+        "key:nested", "{", "key:empty", "{", "}", "key:list", "[", "[", "]", "]",
+        "key:esc", "string:a\"b\\c/\n\xc3\xa9\xf0\x9f\x98\x80", "}", "}",
+    };
+    // Every token has to come out the same however the input is split
+    for (size_t chunk_size : {doc.size(), size_t(1), size_t(2), size_t(3), size_t(7)}) {
+        BOOST_REQUIRE(tokens(doc, chunk_size) == expected);
+    }
+
+    BOOST_REQUIRE(tokens("42", 1) == std::vector<std::string>({"number:42"}));
+    BOOST_REQUIRE(tokens(" \"\" ", 1) == std::vector<std::string>({"string"}));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_malformed) {
+    for (auto doc : {"", "   ", "{", "[1,]", "[1 2]", "{\"a\" 1}", "{1: 2}", "{\"a\": 1,}", "[1}", "{]",
+            "01", "-", "1.", "1e", "+1", "tru", "nul", "\"abc", "\"a\\x\"", "\"\\u12g4\"", "\"\\ud83d\"",
+            "\"\\ude00\"", "\"a\nb\"", "1 2", "{} x", "[]]"}) {
+        for (size_t chunk_size : {size_t(1), size_t(100)}) {
+            BOOST_TEST_INFO(doc);
+            BOOST_REQUIRE_THROW(tokens(doc, chunk_size), parse_error);
+        }
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_limits) {
+    auto deep = sstring(65, '[') + sstring(65, ']');
+    BOOST_REQUIRE_THROW(tokens(deep, 10), parse_error);
+    BOOST_REQUIRE_EQUAL(tokens(sstring(64, '[') + sstring(64, ']'), 10).size(), 128);
+
+    auto in = make_stream("[\"" + sstring(100, 'x') + "\"]", 16);
+    stream_parser parser(in, stream_parser::config{.max_token_size = 99});
+    BOOST_REQUIRE(parser.next().get().type == token_type::begin_array);
+    BOOST_REQUIRE_THROW(parser.next().get(), parse_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_skip) {
+    auto in = make_stream(R"({"skipped": {"a": [1, {"b": 2}], "c": "d"}, "kept": [3]})", 5);
+    stream_parser parser(in);
+    BOOST_REQUIRE(parser.next().get().type == token_type::begin_object);
+    BOOST_REQUIRE_EQUAL(parser.next().get().value, "skipped");
+    BOOST_REQUIRE(parser.next().get().type == token_type::begin_object);
+    BOOST_REQUIRE_EQUAL(parser.depth(), 2);
+    parser.skip().get();
+    BOOST_REQUIRE_EQUAL(parser.depth(), 1);
+    BOOST_REQUIRE_EQUAL(parser.next().get().value, "kept");
+    BOOST_REQUIRE(parser.next().get().type == token_type::begin_array);
+    BOOST_REQUIRE_EQUAL(parser.next().get().value, "3");
+    // Not after an opening token
+    parser.skip().get();
+    BOOST_REQUIRE(parser.next().get().type == token_type::end_array);
+    BOOST_REQUIRE(parser.next().get().type == token_type::end_object);
+    BOOST_REQUIRE(parser.next().get().type == token_type::end);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_request_body) {
+    // As a handler would read a streamed request body
+    sstring doc = R"([{"id": 1}, {"id": 2}])";
+    auto in = make_stream(doc + "GET / HTTP/1.1\r\n\r\n", 4);
+    auto body = input_stream<char>(data_source(std::make_unique<httpd::internal::content_length_source_impl>(in, doc.size())));
+    BOOST_REQUIRE(tokens(body) == std::vector<std::string>({"[", "{", "key:id", "number:1", "}", "{", "key:id", "number:2", "}", "]"}));
+}
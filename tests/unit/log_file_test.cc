@@ -0,0 +1,134 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/log_file.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/util/closeable.hh>
+#include <seastar/util/tmp_file.hh>
+
+#include <algorithm>
+#include <vector>
+
+using namespace seastar;
+
+static temporary_buffer<char> make_record(size_t size, char c) {
+    temporary_buffer<char> buf(size);
+    std::fill(buf.get_write(), buf.get_write() + size, c);
+    return buf;
+}
+
+static temporary_buffer<char> read_segment(const log_file& log, uint64_t segment) {
+    auto f = open_file_dma(log.segment_path(segment), open_flags::ro).get();
+    auto close_f = deferred_close(f);
+    return f.dma_read<char>(0, f.size().get()).get();
+}
+
+SEASTAR_TEST_CASE(test_log_file_group_commit) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        log_file_options options;
+        options.segment_size = 1 << 20;
+        auto log = log_file::open(t.get_path().native(), options).get();
+
+        std::vector<future<log_position>> appends;
+        for (unsigned i = 0; i < 100; i++) {
+            appends.push_back(log.append(make_record(100 + i, 'a' + i % 26)));
+        }
+        auto positions = when_all_succeed(appends.begin(), appends.end()).get();
+
+        // Records are laid out in the order of the appends, and the ones
+        // queued behind a commit share the next one
+        uint64_t offset = 0;
+        for (unsigned i = 0; i < positions.size(); i++) {
+            BOOST_REQUIRE_EQUAL(positions[i].segment, positions[0].segment);
+            BOOST_REQUIRE_EQUAL(positions[i].offset, offset);
+            offset += 100 + i;
+        }
+        BOOST_REQUIRE_EQUAL(log.get_stats().records, 100);
+        BOOST_REQUIRE_LT(log.get_stats().commits, 100);
+
+        // Appends after a commit extend the partially written block
+        auto pos = log.append(make_record(10, 'z')).get();
+        BOOST_REQUIRE_EQUAL(pos.offset, offset);
+
+        auto data = read_segment(log, pos.segment);
+        BOOST_REQUIRE_EQUAL(data.size(), options.segment_size);
+        for (unsigned i = 0; i < positions.size(); i++) {
+            auto p = data.get() + positions[i].offset;
+            BOOST_REQUIRE(std::all_of(p, p + 100 + i, [i] (char c) { return c == char('a' + i % 26); }));
+        }
+        BOOST_REQUIRE(std::all_of(data.get() + pos.offset, data.get() + pos.offset + 10, [] (char c) { return c == 'z'; }));
+        BOOST_REQUIRE(std::all_of(data.get() + pos.offset + 10, data.end(), [] (char c) { return c == 0; }));
+        BOOST_REQUIRE_GT(log.commit_latency().count(), 0);
+
+        BOOST_REQUIRE_THROW(log.append(make_record(options.segment_size + 1, 'x')).get(), std::invalid_argument);
+        log.close().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_log_file_segments) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        log_file_options options;
+        options.segment_size = 16384;
+        options.preallocation_size = 8192;
+        options.recycled_segments = 1;
+        auto log = log_file::open(t.get_path().native(), options).get();
+
+        // Three records fit in a segment
+        std::vector<log_position> positions;
+        for (unsigned i = 0; i < 7; i++) {
+            positions.push_back(log.append(make_record(5000, 'a' + i)).get());
+        }
+        auto first = positions[0].segment;
+        for (unsigned i = 0; i < positions.size(); i++) {
+            BOOST_REQUIRE_EQUAL(positions[i].segment, first + i / 3);
+            BOOST_REQUIRE_EQUAL(positions[i].offset, i % 3 * 5000);
+        }
+        BOOST_REQUIRE_EQUAL(log.active_segment(), first + 2);
+
+        // One is kept, zeroed, for reuse, the other one is removed
+        log.release_segments(log.active_segment()).get();
+        BOOST_REQUIRE(!file_exists(log.segment_path(first)).get());
+        BOOST_REQUIRE(!file_exists(log.segment_path(first + 1)).get());
+
+        // The segment prepared in the background was created before the
+        // release, the one after it is recycled
+        for (unsigned i = 0; i < 6; i++) {
+            positions.push_back(log.append(make_record(5000, 'h' + i)).get());
+        }
+        BOOST_REQUIRE_EQUAL(log.get_stats().segments_recycled, 1);
+        auto last = positions.back();
+        auto data = read_segment(log, last.segment);
+        BOOST_REQUIRE_EQUAL(data.size(), options.segment_size);
+        BOOST_REQUIRE(std::all_of(data.get() + last.offset, data.get() + last.offset + 5000, [] (char c) { return c == 'm'; }));
+        BOOST_REQUIRE(std::all_of(data.get() + last.offset + 5000, data.end(), [] (char c) { return c == 0; }));
+        log.close().get();
+
+        // Reopening appends to a new segment, and picks up the old ones
+        log = log_file::open(t.get_path().native(), options).get();
+        BOOST_REQUIRE_GT(log.active_segment(), last.segment);
+        log.release_segments(log.active_segment()).get();
+        BOOST_REQUIRE(!file_exists(log.segment_path(last.segment)).get());
+        log.close().get();
+    });
+}
@@ -441,3 +441,106 @@ SEASTAR_THREAD_TEST_CASE(test_estimated_histogram) {
         BOOST_CHECK_EQUAL(mh.buckets[i].count, 33 + i);
     }
 }
+
+SEASTAR_THREAD_TEST_CASE(test_sparse_exponential_histogram) {
+    using namespace seastar::metrics;
+    // Schema 0: bucket i holds (2^(i-1), 2^i]
+    internal::sparse_exponential_histogram h(0, 0, 4);
+    BOOST_CHECK_EQUAL(internal::sparse_exponential_histogram::bucket_id(1, 0), 0);
+    BOOST_CHECK_EQUAL(internal::sparse_exponential_histogram::bucket_id(3, 0), 2);
+    BOOST_CHECK_EQUAL(internal::sparse_exponential_histogram::bucket_id(4, 0), 2);
+    BOOST_CHECK_EQUAL(internal::sparse_exponential_histogram::bucket_id(0.25, 0), -2);
+    BOOST_CHECK_EQUAL(internal::sparse_exponential_histogram::bucket_id(3, 1), 4);
+
+    h.add(0);
+    h.add(1);
+    h.add(3);
+    h.add(4);
+    BOOST_CHECK_EQUAL(h.count(), 4);
+    BOOST_CHECK_EQUAL(h.zero_count(), 1);
+    BOOST_CHECK_EQUAL(h.get(0), 1);
+    BOOST_CHECK_EQUAL(h.get(2), 2);
+
+    auto mh = h.to_metrics_histogram();
+    BOOST_REQUIRE(mh.native_histogram);
+    BOOST_CHECK_EQUAL(mh.native_histogram->min_id, 0);
+    BOOST_CHECK_EQUAL(mh.native_histogram->zero_count, 1);
+    BOOST_REQUIRE_EQUAL(mh.buckets.size(), 3);
+    BOOST_CHECK_EQUAL(mh.buckets[0].upper_bound, 1);
+    BOOST_CHECK_EQUAL(mh.buckets[0].count, 2);
+    BOOST_CHECK_EQUAL(mh.buckets[1].count, 2);
+    BOOST_CHECK_EQUAL(mh.buckets[2].upper_bound, 4);
+    BOOST_CHECK_EQUAL(mh.buckets[2].count, 4);
+
+    // Buckets 0..4 don't fit in 4 buckets, pairs are merged
+    h.add(16);
+    BOOST_CHECK_EQUAL(h.schema(), -1);
+    BOOST_CHECK_EQUAL(h.get(0), 1);
+    BOOST_CHECK_EQUAL(h.get(1), 2);
+    BOOST_CHECK_EQUAL(h.get(2), 1);
+    BOOST_CHECK_EQUAL(h.count(), 5);
+
+    // Histograms with different ranges and schemas are merged in the coarser one
+    internal::sparse_exponential_histogram other(0);
+    other.add(64);
+    auto merged = h.to_metrics_histogram() + other.to_metrics_histogram();
+    BOOST_REQUIRE(merged.native_histogram);
+    BOOST_CHECK_EQUAL(merged.native_histogram->schema, -1);
+    BOOST_CHECK_EQUAL(merged.native_histogram->zero_count, 1);
+    BOOST_CHECK_EQUAL(merged.sample_count, 6);
+    BOOST_REQUIRE_EQUAL(merged.buckets.size(), 4);
+    BOOST_CHECK_EQUAL(merged.buckets[2].upper_bound, 16);
+    BOOST_CHECK_EQUAL(merged.buckets[2].count, 5);
+    BOOST_CHECK_EQUAL(merged.buckets[3].upper_bound, 64);
+    BOOST_CHECK_EQUAL(merged.buckets[3].count, 6);
+
+    h.merge(other);
+    BOOST_CHECK_EQUAL(h.get(3), 1);
+    BOOST_CHECK_EQUAL(h.count(), 6);
+}
+
+static std::map<seastar::sstring, double> get_values_by_label(seastar::sstring metric_name, seastar::sstring label_name) {
+    auto values = seastar::metrics::impl::get_values();
+    std::map<seastar::sstring, double> ret;
+    for (size_t i = 0; i < values->metadata->size(); ++i) {
+        const auto& md = (*values->metadata)[i];
+        if (md.mf.name != metric_name) {
+            continue;
+        }
+        for (size_t j = 0; j < md.metrics.size(); ++j) {
+            auto found = md.metrics[j].id.labels().find(label_name);
+            ret[found == md.metrics[j].id.labels().end() ? "" : found->second] = values->values[i][j].d();
+        }
+    }
+    return ret;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_bound_values) {
+    namespace sm = seastar::metrics;
+    enum class op { read, write, count };
+    sm::counter requests;
+    sm::gauge in_flight;
+    sm::counter_array<op> ops;
+    static_assert(alignof(sm::counter_array<op>) == seastar::cache_line_size);
+
+    sm::metric_groups app_metrics;
+    app_metrics.add_group("test_values", {
+        sm::make_counter("requests", requests, sm::description("requests")),
+        sm::make_gauge("in_flight", in_flight, sm::description("in flight")),
+    });
+    app_metrics.add_group("test_values", sm::make_counters("ops", ops, sm::description("ops"), sm::label("op"), {"read", "write"}));
+
+    ++requests;
+    requests += 2;
+    in_flight.inc(3);
+    in_flight.dec();
+    ops.inc(op::read);
+    ops.inc(op::write, 5);
+
+    BOOST_REQUIRE_EQUAL(get_values_by_label("test_values_requests", "op")[""], 3);
+    BOOST_REQUIRE_EQUAL(get_values_by_label("test_values_in_flight", "op")[""], 2);
+    auto op_values = get_values_by_label("test_values_ops", "op");
+    BOOST_REQUIRE_EQUAL(op_values.size(), 2);
+    BOOST_REQUIRE_EQUAL(op_values["read"], 1);
+    BOOST_REQUIRE_EQUAL(op_values["write"], 5);
+}
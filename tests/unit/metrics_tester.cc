@@ -40,6 +40,9 @@ struct metric_def {
     sstring type;
     std::vector<double> values;
     std::vector<sm::label_instance> labels;
+    // When set, the metric has that many series, told apart by a "series"
+    // label, the value of each one is its index added to the first value
+    unsigned count = 0;
 };
 
 struct config {
@@ -60,6 +63,9 @@ struct convert<metric_def> {
         if (node["values"]) {
             cfg.values = node["values"].as<std::vector<double>>();
         }
+        if (node["count"]) {
+            cfg.count = node["count"].as<unsigned>();
+        }
         if (node["labels"]) {
             const auto labels = node["labels"].as<std::map<std::string, std::string>>();
             for (auto& [key, value]: labels) {
@@ -150,6 +156,17 @@ int main(int ac, char** av) {
             auto cfg = doc.as<config>();
 
             for (auto&& jc : cfg.metrics) {
+                if (jc.count) {
+                    for (unsigned i = 0; i < jc.count; i++) {
+                        auto series = jc;
+                        series.values = {jc.values[0] + i};
+                        series.labels.emplace_back("series", std::to_string(i));
+                        _metrics.add_group("test_group", {
+                                make_metrics_definition(series)
+                        });
+                    }
+                    continue;
+                }
                 _metrics.add_group("test_group", {
                         make_metrics_definition(jc)
                 });
@@ -0,0 +1,425 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/net/ipv6.hh>
+#include <seastar/net/tcp.hh>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace seastar;
+using namespace seastar::net;
+using namespace std::chrono_literals;
+
+namespace {
+
+const ethernet_address local_mac{0x02, 0, 0, 0, 0, 0x01};
+const ethernet_address peer_mac{0x02, 0, 0, 0, 0, 0x02};
+const ipv6_address local_ll("fe80::ff:fe00:1");
+const ipv6_address peer_ll("fe80::ff:fe00:2");
+
+constexpr uint8_t icmpv6 = uint8_t(ip_protocol_num::icmpv6);
+constexpr uint8_t neighbor_solicitation = 135;
+constexpr uint8_t neighbor_advertisement = 136;
+constexpr uint8_t echo_request = 128;
+constexpr uint8_t echo_reply = 129;
+
+// Builds the bytes of the packets the tests receive
+struct writer {
+    std::string b;
+    writer& u8(uint8_t v) { b.push_back(char(v)); return *this; }
+    writer& u16(uint16_t v) { return u8(v >> 8).u8(v); }
+    writer& u32(uint32_t v) { return u16(v >> 16).u16(v); }
+    writer& zeros(size_t n) { b.append(n, '\0'); return *this; }
+    writer& append(std::string_view s) { b.append(s); return *this; }
+    writer& addr(const ipv6_address& a) {
+        return append(std::string_view(reinterpret_cast<const char*>(a.ip.data()), a.size()));
+    }
+    writer& mac(const ethernet_address& a) {
+        return append(std::string_view(reinterpret_cast<const char*>(a.mac.data()), a.mac.size()));
+    }
+};
+
+// RFC8200, 8.1: the upper-layer checksum covers a pseudo header. Summed
+// here one byte at a time, independently of checksummer.
+uint16_t reference_checksum(const ipv6_address& src, const ipv6_address& dst, uint8_t proto, std::string_view l4) {
+    auto data = writer().addr(src).addr(dst).u32(l4.size()).zeros(3).u8(proto).append(l4).b;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        auto c = uint8_t(data[i]);
+        sum += i % 2 ? c : c << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(~sum);
+}
+
+void set_checksum(std::string& l4, size_t off, const ipv6_address& src, const ipv6_address& dst, uint8_t proto) {
+    l4[off] = l4[off + 1] = 0;
+    auto csum = reference_checksum(src, dst, proto, l4);
+    std::memcpy(&l4[off], &csum, sizeof(csum));
+}
+
+std::string icmp_message(uint8_t type, std::string_view body, const ipv6_address& src, const ipv6_address& dst) {
+    auto l4 = writer().u8(type).u8(0).u16(0).append(body).b;
+    set_checksum(l4, 2, src, dst, icmpv6);
+    return l4;
+}
+
+std::string neighbor_solicitation_message(const ipv6_address& target, const ipv6_address& src, const ipv6_address& dst) {
+    return icmp_message(neighbor_solicitation, writer().zeros(4).addr(target).b, src, dst);
+}
+
+// The echo request body: identifier, sequence number and data
+const std::string echo_body = writer().u16(7).u16(1).append("ping").b;
+
+struct sent_packet {
+    ethernet_address e_dst;
+    uint16_t eth_proto;
+    ipv6_hdr ip;
+    std::string l4;
+};
+
+// A device queue which keeps the packets the stack sends
+class fake_qp : public qp {
+public:
+    std::vector<packet> sent;
+    virtual future<> send(packet p) override {
+        sent.push_back(std::move(p));
+        return make_ready_future<>();
+    }
+};
+
+// A device without any offload, so that the stack computes and verifies
+// all the checksums
+class fake_device : public device {
+    std::unique_ptr<fake_qp> _qp = std::make_unique<fake_qp>();
+public:
+    fake_device() {
+        // Owned by the device rather than by the reactor, unlike what
+        // set_local_queue() does, so that each test starts afresh
+        _queues[this_shard_id()] = _qp.get();
+    }
+    virtual ethernet_address hw_address() override { return local_mac; }
+    virtual net::hw_features hw_features() override { return {}; }
+    virtual std::unique_ptr<qp> init_local_queue(const program_options::option_group&, uint16_t) override { return nullptr; }
+    fake_qp& queue() { return *_qp; }
+};
+
+// The IPv6 layer of the native stack on a fake device. Tests let the
+// resolutions they start complete, they would outlive the stack otherwise.
+struct harness {
+    std::shared_ptr<fake_device> dev = std::make_shared<fake_device>();
+    interface netif{dev};
+    ipv6 ip{&netif};
+
+    void receive(const ipv6_address& src, const ipv6_address& dst, uint8_t next_header, std::string_view payload, uint8_t hop_limit = 255) {
+        auto b = writer().mac(local_mac).mac(peer_mac).u16(uint16_t(eth_protocol_num::ipv6))
+                .u32(uint32_t(6) << 28).u16(payload.size()).u8(next_header).u8(hop_limit)
+                .addr(src).addr(dst).append(payload).b;
+        dev->l2receive(packet(b.data(), b.size()));
+    }
+
+    // Packets sent since the last call
+    std::vector<sent_packet> sent() {
+        // Lets the transmit poller run
+        sleep(1ms).get();
+        std::vector<sent_packet> ret;
+        for (auto& p : std::exchange(dev->queue().sent, {})) {
+            std::string b;
+            for (auto& f : p.fragments()) {
+                b.append(f.base, f.size);
+            }
+            BOOST_REQUIRE_GE(b.size(), sizeof(eth_hdr) + sizeof(ipv6_hdr));
+            auto eh = ntoh(*reinterpret_cast<const eth_hdr*>(b.data()));
+            auto iph = ntoh(*reinterpret_cast<const ipv6_hdr*>(b.data() + sizeof(eth_hdr)));
+            auto l4 = b.substr(sizeof(eth_hdr) + sizeof(ipv6_hdr));
+            BOOST_REQUIRE_EQUAL(iph.version(), 6);
+            BOOST_REQUIRE_EQUAL(uint16_t(iph.payload_len), l4.size());
+            ret.push_back(sent_packet{eh.dst_mac, eh.eth_proto, iph, std::move(l4)});
+        }
+        return ret;
+    }
+
+    // Checks that a single ICMPv6 message of type \c type, with a valid
+    // checksum, was sent to \c to, and returns it
+    sent_packet sent_icmp(uint8_t type, const ipv6_address& to) {
+        auto sent = this->sent();
+        BOOST_REQUIRE_EQUAL(sent.size(), 1);
+        auto& p = sent.front();
+        BOOST_REQUIRE_EQUAL(p.eth_proto, uint16_t(eth_protocol_num::ipv6));
+        BOOST_REQUIRE_EQUAL(p.ip.next_header, icmpv6);
+        BOOST_REQUIRE_EQUAL(p.ip.hop_limit, 255);
+        BOOST_REQUIRE_EQUAL(p.ip.dst_ip, to);
+        BOOST_REQUIRE_GE(p.l4.size(), 4);
+        BOOST_REQUIRE_EQUAL(uint8_t(p.l4[0]), type);
+        BOOST_REQUIRE_EQUAL(reference_checksum(p.ip.src_ip, p.ip.dst_ip, icmpv6, p.l4), 0);
+        return p;
+    }
+};
+
+std::optional<std::pair<uint8_t, size_t>> upper_layer(std::string_view headers, uint8_t next) {
+    packet p(headers.data(), headers.size());
+    return ipv6::upper_layer(p, 0, next);
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_addresses) {
+    BOOST_REQUIRE_EQUAL(ipv6::make_link_local_address(local_mac), local_ll);
+    BOOST_REQUIRE_EQUAL(ipv6::make_link_local_address(ethernet_address{0x52, 0x54, 0x00, 0x12, 0x34, 0x56}),
+            ipv6_address("fe80::5054:ff:fe12:3456"));
+    BOOST_REQUIRE_EQUAL(ipv6::solicited_node_address(ipv6_address("2001:db8::12:3456")), ipv6_address("ff02::1:ff12:3456"));
+    BOOST_REQUIRE(ipv6::multicast_ethernet_address(ipv6_address("ff02::1:ff12:3456"))
+            == (ethernet_address{0x33, 0x33, 0xff, 0x12, 0x34, 0x56}));
+
+    harness h;
+    BOOST_REQUIRE_EQUAL(h.ip.link_local_address(), local_ll);
+    BOOST_REQUIRE_EQUAL(h.ip.host_address(), local_ll);
+    h.ip.set_host_address(ipv6_address("2001:db8::1"));
+    BOOST_REQUIRE_EQUAL(h.ip.host_address(), ipv6_address("2001:db8::1"));
+    BOOST_REQUIRE_EQUAL(h.ip.source_address(peer_ll), local_ll);
+    BOOST_REQUIRE_EQUAL(h.ip.source_address(ipv6_address("2001:db8::2")), ipv6_address("2001:db8::1"));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_extension_headers) {
+    constexpr uint8_t tcp = uint8_t(ip_protocol_num::tcp);
+    constexpr uint8_t hop_by_hop = 0, routing = 43, fragment = 44, destination_options = 60;
+
+    auto none = upper_layer("", tcp);
+    BOOST_REQUIRE(none && none->first == tcp && none->second == 0);
+
+    // Padding, and an unknown option whose type asks for skipping it
+    auto options = writer().u8(destination_options).u8(0).u8(1).u8(0).u8(0x05).u8(2).zeros(2).b;
+    options += writer().u8(tcp).u8(1).u8(1).u8(12).zeros(12).b;
+    auto skipped = upper_layer(options, hop_by_hop);
+    BOOST_REQUIRE(skipped && skipped->first == tcp && skipped->second == 24);
+
+    // An unknown option whose type asks for dropping the packet
+    BOOST_REQUIRE(!upper_layer(writer().u8(tcp).u8(0).u8(0x85).u8(4).zeros(4).b, hop_by_hop));
+    // An option overrunning its header
+    BOOST_REQUIRE(!upper_layer(writer().u8(tcp).u8(0).u8(0x05).u8(5).zeros(4).b, destination_options));
+    // A truncated header
+    BOOST_REQUIRE(!upper_layer(writer().u8(tcp).u8(1).zeros(6).b, hop_by_hop));
+
+    // Routing headers are skipped once there are no segments left
+    auto routed = upper_layer(writer().u8(tcp).u8(0).u8(4).u8(0).zeros(4).b, routing);
+    BOOST_REQUIRE(routed && routed->first == tcp && routed->second == 8);
+    BOOST_REQUIRE(!upper_layer(writer().u8(tcp).u8(2).u8(0).u8(1).zeros(20).b, routing));
+
+    // Atomic fragments are skipped, actual fragments dropped
+    auto atomic = upper_layer(writer().u8(tcp).u8(0).u16(0).u32(1234).b, fragment);
+    BOOST_REQUIRE(atomic && atomic->first == tcp && atomic->second == 8);
+    BOOST_REQUIRE(!upper_layer(writer().u8(tcp).u8(0).u16(1).u32(1234).b, fragment));
+    BOOST_REQUIRE(!upper_layer(writer().u8(tcp).u8(0).u16(8 << 3).u32(1234).b, fragment));
+
+    // Long chains of headers are dropped
+    std::string chain;
+    for (int i = 0; i < 9; i++) {
+        chain += writer().u8(i < 8 ? destination_options : tcp).u8(0).u8(1).u8(4).zeros(4).b;
+    }
+    BOOST_REQUIRE(!upper_layer(chain, destination_options));
+    auto short_chain = upper_layer(std::string_view(chain).substr(16), destination_options);
+    BOOST_REQUIRE(short_chain && short_chain->first == tcp && short_chain->second == 56);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_neighbor_solicitation_answered) {
+    harness h;
+    auto group = ipv6::solicited_node_address(local_ll);
+
+    h.receive(peer_ll, group, icmpv6, neighbor_solicitation_message(local_ll, peer_ll, group));
+    auto na = h.sent_icmp(neighbor_advertisement, peer_ll);
+    // Answered to the link-layer address it came from, with ours
+    BOOST_REQUIRE(na.e_dst == peer_mac);
+    BOOST_REQUIRE_EQUAL(na.ip.src_ip, local_ll);
+    auto expected = writer().u8(neighbor_advertisement).u8(0).u16(0)
+            .u8(0x60).zeros(3).addr(local_ll)
+            .u8(2).u8(1).mac(local_mac).b;
+    BOOST_REQUIRE_EQUAL(na.l4.substr(4), expected.substr(4));
+
+    // Solicitations which were routed, for another target, or corrupted
+    // aren't answered
+    h.receive(peer_ll, group, icmpv6, neighbor_solicitation_message(local_ll, peer_ll, group), 64);
+    h.receive(peer_ll, group, icmpv6, neighbor_solicitation_message(peer_ll, peer_ll, group));
+    auto corrupted = neighbor_solicitation_message(local_ll, peer_ll, group);
+    corrupted[2] ^= 1;
+    h.receive(peer_ll, group, icmpv6, corrupted);
+    BOOST_REQUIRE(h.sent().empty());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_duplicate_address_detection) {
+    harness h;
+    auto group = ipv6::solicited_node_address(local_ll);
+    auto all_nodes = ipv6_address("ff02::1");
+
+    // Probes come from the unspecified address, they are answered to all
+    // nodes and not as solicited
+    h.receive(ipv6_address(), group, icmpv6, neighbor_solicitation_message(local_ll, ipv6_address(), group));
+    auto na = h.sent_icmp(neighbor_advertisement, all_nodes);
+    BOOST_REQUIRE(na.e_dst == (ethernet_address{0x33, 0x33, 0, 0, 0, 1}));
+    BOOST_REQUIRE_EQUAL(uint8_t(na.l4[4]), 0x20);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_neighbor_resolution) {
+    harness h;
+    auto f = h.ip.get_l2_dst_address(peer_ll);
+    BOOST_REQUIRE(!f.available());
+
+    // Solicited at its solicited-node group, with our link-layer address
+    auto group = ipv6::solicited_node_address(peer_ll);
+    auto ns = h.sent_icmp(neighbor_solicitation, group);
+    BOOST_REQUIRE(ns.e_dst == ipv6::multicast_ethernet_address(group));
+    BOOST_REQUIRE_EQUAL(ns.ip.src_ip, local_ll);
+    auto expected = writer().u8(neighbor_solicitation).u8(0).u16(0)
+            .zeros(4).addr(peer_ll)
+            .u8(1).u8(1).mac(local_mac).b;
+    BOOST_REQUIRE_EQUAL(ns.l4.substr(4), expected.substr(4));
+
+    h.ip.learn(peer_mac, peer_ll);
+    BOOST_REQUIRE(f.get() == peer_mac);
+    BOOST_REQUIRE(h.ip.get_l2_dst_address(peer_ll).get() == peer_mac);
+    BOOST_REQUIRE(h.sent().empty());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_gateway_resolution) {
+    harness h;
+    auto gw = ipv6_address("fe80::1");
+    auto gw_mac = ethernet_address{0x02, 0, 0, 0, 0, 0x03};
+    h.ip.set_host_address(ipv6_address("2001:db8::1"), 64);
+    h.ip.set_gw_address(gw);
+
+    // Addresses out of the prefix are reached through the gateway
+    auto off_link = h.ip.get_l2_dst_address(ipv6_address("2001:db8:1::2"));
+    auto ns = h.sent_icmp(neighbor_solicitation, ipv6::solicited_node_address(gw));
+    BOOST_REQUIRE_EQUAL(ipv6_address::read(ns.l4.data() + 8), gw);
+    h.ip.learn(gw_mac, gw);
+    BOOST_REQUIRE(off_link.get() == gw_mac);
+
+    // The ones in the prefix directly
+    auto on_link = h.ip.get_l2_dst_address(ipv6_address("2001:db8::2"));
+    ns = h.sent_icmp(neighbor_solicitation, ipv6::solicited_node_address(ipv6_address("2001:db8::2")));
+    BOOST_REQUIRE_EQUAL(ipv6_address::read(ns.l4.data() + 8), ipv6_address("2001:db8::2"));
+    h.ip.learn(peer_mac, ipv6_address("2001:db8::2"));
+    BOOST_REQUIRE(on_link.get() == peer_mac);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_echo) {
+    harness h;
+    h.ip.learn(peer_mac, peer_ll);
+
+    h.receive(peer_ll, local_ll, icmpv6, icmp_message(echo_request, echo_body, peer_ll, local_ll));
+    auto reply = h.sent_icmp(echo_reply, peer_ll);
+    BOOST_REQUIRE(reply.e_dst == peer_mac);
+    BOOST_REQUIRE_EQUAL(reply.l4.substr(4), echo_body);
+
+    // Corrupted requests aren't answered
+    auto corrupted = icmp_message(echo_request, echo_body, peer_ll, local_ll);
+    corrupted.back() ^= 1;
+    h.receive(peer_ll, local_ll, icmpv6, corrupted);
+    BOOST_REQUIRE(h.sent().empty());
+
+    // Nor those for addresses which aren't ours
+    h.receive(peer_ll, peer_ll, icmpv6, icmp_message(echo_request, echo_body, peer_ll, peer_ll));
+    BOOST_REQUIRE(h.sent().empty());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_echo_extension_headers) {
+    constexpr uint8_t hop_by_hop = 0, fragment = 44;
+    harness h;
+    h.ip.learn(peer_mac, peer_ll);
+    auto request = icmp_message(echo_request, echo_body, peer_ll, local_ll);
+
+    // Options are skipped
+    h.receive(peer_ll, local_ll, hop_by_hop, writer().u8(icmpv6).u8(0).u8(1).u8(4).zeros(4).append(request).b);
+    h.sent_icmp(echo_reply, peer_ll);
+
+    // Fragments aren't reassembled
+    h.receive(peer_ll, local_ll, fragment, writer().u8(icmpv6).u8(0).u16(1).u32(1234).append(request).b);
+    BOOST_REQUIRE(h.sent().empty());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_tcp_checksum) {
+    constexpr uint8_t tcp = uint8_t(ip_protocol_num::tcp);
+    harness h;
+    h.ip.learn(peer_mac, peer_ll);
+
+    // A SYN to a closed port is answered with a reset
+    auto syn = std::string(tcp_hdr::len, '\0');
+    auto th = tcp_hdr{};
+    th.src_port = 4000;
+    th.dst_port = 9;
+    th.seq = make_seq(1000);
+    th.ack = make_seq(0);
+    th.data_offset = tcp_hdr::len / 4;
+    th.f_syn = true;
+    th.window = 65535;
+    th.checksum = 0;
+    th.write(syn.data());
+    set_checksum(syn, 16, peer_ll, local_ll, tcp);
+
+    h.receive(peer_ll, local_ll, tcp, syn);
+    auto sent = h.sent();
+    BOOST_REQUIRE_EQUAL(sent.size(), 1);
+    auto& rst = sent.front();
+    BOOST_REQUIRE_EQUAL(rst.ip.next_header, tcp);
+    BOOST_REQUIRE_EQUAL(rst.ip.src_ip, local_ll);
+    BOOST_REQUIRE_EQUAL(rst.ip.dst_ip, peer_ll);
+    BOOST_REQUIRE_GE(rst.l4.size(), tcp_hdr::len);
+    auto rh = tcp_hdr::read(rst.l4.data());
+    BOOST_REQUIRE(rh.f_rst);
+    BOOST_REQUIRE_EQUAL(rh.src_port, 9);
+    BOOST_REQUIRE_EQUAL(rh.dst_port, 4000);
+    BOOST_REQUIRE_EQUAL(reference_checksum(local_ll, peer_ll, tcp, rst.l4), 0);
+
+    // Segments with a bad checksum are dropped
+    syn[16] ^= 1;
+    h.receive(peer_ll, local_ll, tcp, syn);
+    BOOST_REQUIRE(h.sent().empty());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ipv6_udp_checksum) {
+    constexpr uint8_t udp = uint8_t(ip_protocol_num::udp);
+    auto src = ipv6_address("2001:db8::1");
+    auto dst = ipv6_address("2001:db8:ffff::2");
+    // Odd-sized, so that the checksum pads the last byte
+    auto datagram = writer().u16(5000).u16(53).u16(8 + 5).u16(0).append("hello").b;
+
+    checksummer csum;
+    ipv6_traits::udp_pseudo_header_checksum(csum, src, dst, datagram.size());
+    csum.sum(datagram.data(), datagram.size());
+    BOOST_REQUIRE_EQUAL(csum.get(), reference_checksum(src, dst, udp, datagram));
+
+    // A datagram carrying its checksum sums to zero
+    auto c = csum.get();
+    std::memcpy(&datagram[6], &c, sizeof(c));
+    checksummer verify;
+    ipv6_traits::udp_pseudo_header_checksum(verify, src, dst, datagram.size());
+    verify.sum(datagram.data(), datagram.size());
+    BOOST_REQUIRE_EQUAL(verify.get(), 0);
+}
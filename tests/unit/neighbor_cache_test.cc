@@ -0,0 +1,126 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/net/ip.hh>
+#include <seastar/net/neighbor_cache.hh>
+#include <seastar/testing/test_case.hh>
+
+using namespace seastar;
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct query {
+    ipv4_address addr;
+    std::optional<ethernet_address> known;
+};
+
+const ethernet_address mac_a{0x02, 0, 0, 0, 0, 0x0a};
+const ethernet_address mac_b{0x02, 0, 0, 0, 0, 0x0b};
+
+}
+
+SEASTAR_TEST_CASE(test_neighbor_cache_resolution) {
+    std::vector<query> queries;
+    neighbor_cache<ipv4_address> cache([&] (const ipv4_address& a, std::optional<ethernet_address> known) {
+        queries.push_back({a, known});
+    });
+    ipv4_address a("10.0.0.1");
+
+    // Lookups of an unknown neighbor share one resolution
+    auto f1 = cache.lookup(a);
+    auto f2 = cache.lookup(a);
+    BOOST_REQUIRE_EQUAL(queries.size(), 1);
+    BOOST_REQUIRE(!queries[0].known);
+    BOOST_REQUIRE(!f1.available());
+
+    cache.learn(a, mac_a);
+    BOOST_REQUIRE(co_await std::move(f1) == mac_a);
+    BOOST_REQUIRE(co_await std::move(f2) == mac_a);
+    BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 2);
+
+    // Known neighbors are answered right away
+    auto f3 = cache.lookup(a);
+    BOOST_REQUIRE(f3.available());
+    BOOST_REQUIRE(f3.get() == mac_a);
+    BOOST_REQUIRE_EQUAL(queries.size(), 1);
+    BOOST_REQUIRE(cache.get(a) == mac_a);
+    BOOST_REQUIRE(!cache.get(ipv4_address("10.0.0.2")));
+}
+
+SEASTAR_TEST_CASE(test_neighbor_cache_refresh) {
+    std::vector<query> queries;
+    neighbor_cache<ipv4_address> cache([&] (const ipv4_address& a, std::optional<ethernet_address> known) {
+        queries.push_back({a, known});
+    });
+    cache.set_reachable_time(500ms);
+    ipv4_address a("10.0.0.1");
+    cache.learn(a, mac_a);
+
+    // Close to the expiry the entry is still used, and queried at its
+    // known address
+    co_await sleep(450ms);
+    auto f = cache.lookup(a);
+    BOOST_REQUIRE(f.available());
+    BOOST_REQUIRE(f.get() == mac_a);
+    BOOST_REQUIRE_EQUAL(queries.size(), 1);
+    BOOST_REQUIRE(queries[0].known == mac_a);
+    BOOST_REQUIRE_EQUAL(cache.get_stats().refreshes, 1);
+
+    // The answer renews the entry
+    cache.learn(a, mac_b);
+    co_await sleep(200ms);
+    BOOST_REQUIRE(cache.get(a) == mac_b);
+
+    // Without refresh the entry expires
+    co_await sleep(400ms);
+    BOOST_REQUIRE(!cache.get(a));
+}
+
+SEASTAR_TEST_CASE(test_neighbor_cache_timeout) {
+    unsigned queries = 0;
+    neighbor_cache<ipv4_address> cache([&] (const ipv4_address&, std::optional<ethernet_address>) {
+        ++queries;
+    });
+    ipv4_address a("10.0.0.1");
+    ipv4_address p("10.0.0.254");
+    cache.add_permanent(p, mac_b);
+    cache.learn(p, mac_a);
+    BOOST_REQUIRE(cache.get(p) == mac_b);
+
+    auto f = cache.lookup(a);
+    bool timed_out = false;
+    try {
+        co_await std::move(f);
+    } catch (arp_timeout_error&) {
+        timed_out = true;
+    }
+    BOOST_REQUIRE(timed_out);
+    BOOST_REQUIRE_EQUAL(queries, neighbor_cache<ipv4_address>::max_probes);
+    BOOST_REQUIRE_EQUAL(cache.get_stats().timeouts, 1);
+}
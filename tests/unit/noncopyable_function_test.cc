@@ -85,3 +85,30 @@ BOOST_AUTO_TEST_CASE(large_move_tests) {
     do_move_tests<1000>();
 }
 
+
+template <size_t Size>
+struct address_probe {
+    char data[Size] = {};
+    const void* operator()() const { return this; }
+};
+
+template <typename Function>
+static bool stored_inline(const Function& f) {
+    auto p = static_cast<const char*>(f());
+    auto begin = reinterpret_cast<const char*>(&f);
+    return p >= begin && p < begin + sizeof(f);
+}
+
+BOOST_AUTO_TEST_CASE(inline_size_tests) {
+    auto small = noncopyable_function<const void* ()>(address_probe<24>());
+    BOOST_REQUIRE(stored_inline(small));
+    auto large = noncopyable_function<const void* ()>(address_probe<48>());
+    BOOST_REQUIRE(!stored_inline(large));
+    auto sized = basic_noncopyable_function<const void* (), 64>(address_probe<48>());
+    BOOST_REQUIRE(stored_inline(sized));
+    auto moved = std::move(sized);
+    BOOST_REQUIRE(stored_inline(moved));
+    BOOST_CHECK_THROW(sized(), std::bad_function_call);
+    auto too_large = basic_noncopyable_function<const void* (), 64>(address_probe<100>());
+    BOOST_REQUIRE(!stored_inline(too_large));
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/otlp.hh>
+
+using namespace seastar;
+namespace mi = seastar::metrics::impl;
+
+namespace {
+
+metrics::histogram make_histogram(std::vector<std::pair<double, uint64_t>> buckets, uint64_t count, double sum) {
+    metrics::histogram h;
+    h.sample_count = count;
+    h.sample_sum = sum;
+    for (auto [bound, c] : buckets) {
+        h.buckets.push_back(metrics::histogram_bucket{c, bound});
+    }
+    return h;
+}
+
+std::vector<uint64_t> bucket_counts(const metrics::histogram& h) {
+    std::vector<uint64_t> ret;
+    for (auto& b : h.buckets) {
+        ret.push_back(b.count);
+    }
+    return ret;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_counter_delta) {
+    mi::metric_value prev(10, mi::data_type::COUNTER);
+    BOOST_REQUIRE_EQUAL(otlp::internal::to_delta(mi::metric_value(25, mi::data_type::COUNTER), &prev).d(), 15);
+    BOOST_REQUIRE_EQUAL(otlp::internal::to_delta(mi::metric_value(10, mi::data_type::COUNTER), &prev).d(), 0);
+    // A counter that went back was reset, and counted from 0 since
+    BOOST_REQUIRE_EQUAL(otlp::internal::to_delta(mi::metric_value(4, mi::data_type::COUNTER), &prev).d(), 4);
+    mi::metric_value real_prev(1.5, mi::data_type::REAL_COUNTER);
+    BOOST_REQUIRE_EQUAL(otlp::internal::to_delta(mi::metric_value(4, mi::data_type::REAL_COUNTER), &real_prev).d(), 2.5);
+}
+
+BOOST_AUTO_TEST_CASE(test_new_series_reported_whole) {
+    mi::metric_value cur(25, mi::data_type::COUNTER);
+    BOOST_REQUIRE_EQUAL(otlp::internal::to_delta(cur, nullptr).d(), 25);
+    // The series was re-registered with another type
+    mi::metric_value gauge(10, mi::data_type::GAUGE);
+    BOOST_REQUIRE_EQUAL(otlp::internal::to_delta(cur, &gauge).d(), 25);
+    auto h = make_histogram({{1, 2}, {10, 5}}, 5, 20);
+    auto d = otlp::internal::to_delta(mi::metric_value(h), nullptr).get_histogram();
+    BOOST_REQUIRE_EQUAL(d.sample_count, 5);
+    BOOST_REQUIRE(bucket_counts(d) == bucket_counts(h));
+}
+
+BOOST_AUTO_TEST_CASE(test_gauge_not_converted) {
+    mi::metric_value prev(10, mi::data_type::GAUGE);
+    BOOST_REQUIRE_EQUAL(otlp::internal::to_delta(mi::metric_value(7, mi::data_type::GAUGE), &prev).d(), 7);
+}
+
+BOOST_AUTO_TEST_CASE(test_histogram_delta) {
+    auto prev = make_histogram({{1, 2}, {10, 5}, {100, 6}}, 6, 100);
+    auto cur = make_histogram({{1, 3}, {10, 9}, {100, 12}}, 13, 250);
+    mi::metric_value prev_value(prev);
+    auto d = otlp::internal::to_delta(mi::metric_value(cur), &prev_value).get_histogram();
+    BOOST_REQUIRE_EQUAL(d.sample_count, 7);
+    BOOST_REQUIRE_EQUAL(d.sample_sum, 150);
+    BOOST_REQUIRE(bucket_counts(d) == (std::vector<uint64_t>{1, 4, 6}));
+}
+
+BOOST_AUTO_TEST_CASE(test_histogram_reset) {
+    auto prev = make_histogram({{1, 2}, {10, 5}}, 5, 20);
+    auto cur = make_histogram({{1, 1}, {10, 1}}, 1, 0.5);
+    auto d = otlp::internal::histogram_delta(cur, prev);
+    BOOST_REQUIRE_EQUAL(d.sample_count, 1);
+    BOOST_REQUIRE_EQUAL(d.sample_sum, 0.5);
+    BOOST_REQUIRE(bucket_counts(d) == bucket_counts(cur));
+}
+
+BOOST_AUTO_TEST_CASE(test_histogram_delta_new_buckets) {
+    // The histogram grew a bucket between the pushes
+    auto prev = make_histogram({{1, 2}, {10, 5}}, 5, 20);
+    auto cur = make_histogram({{1, 3}, {10, 7}, {100, 9}}, 9, 300);
+    auto d = otlp::internal::histogram_delta(cur, prev);
+    BOOST_REQUIRE_EQUAL(d.sample_count, 4);
+    BOOST_REQUIRE(bucket_counts(d) == (std::vector<uint64_t>{1, 2, 4}));
+}
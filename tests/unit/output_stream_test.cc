@@ -157,3 +157,38 @@ SEASTAR_THREAD_TEST_CASE(test_simple_write) {
     BOOST_REQUIRE_EQUAL(buf.size(), 1);
     BOOST_REQUIRE_EQUAL(sstring(buf.front().get(), buf.front().size()), value);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_gather_writes) {
+    auto vec = std::vector<net::packet>{};
+    output_stream_options opts;
+    opts.gather_writes = true;
+    auto out = output_stream<char>(data_sink(std::make_unique<vector_data_sink>(vec)), 8, opts);
+
+    // Buffered and zero-copy writes, mixed
+    out.write("ab").get();
+    out.write(temporary_buffer<char>::copy_of("zero-copy")).get();
+    out.write("cd").get();
+    out.write("0123456789abcdef").get();
+    out.write("efghijk").get();
+    BOOST_REQUIRE(vec.empty());
+    out.flush().get();
+    BOOST_REQUIRE_EQUAL(vec.size(), 1u);
+    BOOST_REQUIRE_EQUAL(to_sstring(vec[0]), "abzero-copycd0123456789abcdefefghijk");
+
+    out.write("x").get();
+    out.flush().get();
+    BOOST_REQUIRE_EQUAL(vec.size(), 2u);
+    BOOST_REQUIRE_EQUAL(to_sstring(vec[1]), "x");
+
+    // Writers that don't flush are pushed back on
+    for (int i = 0; i < 20; ++i) {
+        out.write("12345678").get();
+    }
+    BOOST_REQUIRE_GT(vec.size(), 2u);
+    out.close().get();
+    size_t total = 0;
+    for (auto& p : vec) {
+        total += p.len();
+    }
+    BOOST_REQUIRE_EQUAL(total, 36u + 1 + 20 * 8);
+}
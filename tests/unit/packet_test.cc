@@ -24,6 +24,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <seastar/net/packet.hh>
+#include "net/buffer_pool.hh"
 #include <array>
 
 using namespace seastar;
@@ -119,3 +120,38 @@ BOOST_AUTO_TEST_CASE(test_headers_are_contiguous_even_with_many_fragments) {
     BOOST_REQUIRE_EQUAL(p.nr_frags(), 9u);
 }
 
+
+BOOST_AUTO_TEST_CASE(test_buffer_pool_recycles_buffers) {
+    auto bp = std::make_unique<buffer_pool>(2048, 2048, 1);
+    char* buf = bp->allocate();
+    BOOST_REQUIRE(buf);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(buf) % 2048, 0u);
+    {
+        packet p(fragment{buf, 100}, bp->make_deleter(buf));
+        auto shared = p.share();
+    }
+    // Returned when the last packet referring to it was destroyed
+    BOOST_REQUIRE_EQUAL(bp->allocate(), buf);
+
+    char* other = bp->allocate();
+    BOOST_REQUIRE(other && other != buf);
+    deleter d = bp->make_deleter(buf);
+    d.append(bp->make_deleter(other));
+    packet p(fragment{buf, 100}, std::move(d));
+    // Outstanding buffers outlive the pool
+    bp.reset();
+    p = packet();
+}
+
+BOOST_AUTO_TEST_CASE(test_timestamp_follows_data) {
+    auto ts = std::chrono::system_clock::now();
+    packet p(fragment{const_cast<char*>("hello world"), 11}, make_deleter([] {}));
+    BOOST_REQUIRE(!p.timestamp());
+    p.set_timestamp(ts);
+    // Kept by headers, slices and copies of the packet
+    p = packet(fragment{const_cast<char*>("header"), 6}, std::move(p));
+    BOOST_REQUIRE(p.timestamp() == ts);
+    BOOST_REQUIRE(p.share(6, 5).timestamp() == ts);
+    p.linearize();
+    BOOST_REQUIRE(p.timestamp() == ts);
+}
@@ -218,6 +218,23 @@ class TestPrometheus(unittest.TestCase):
                 else:
                     self.assertIsNone(msg)
 
+    def test_many_series(self) -> None:
+        # the family of many_series is rendered in several chunks, see
+        # conf-example.yaml
+        name = 'many_series'
+        count = 1000
+        metrics = self._get_metrics()
+        headers = [line for line in metrics.lines if line.startswith('#')]
+        self.assertEqual(len(headers), len(set(headers)))
+        self.assertIn(f'# TYPE {Metrics.prefix}_{Metrics.full_name(name)} counter', headers)
+        samples = [line for line in metrics.lines if line and not line.startswith('#')]
+        self.assertEqual(len(samples), len(set(samples)))
+        expositions = metrics.get(name)
+        series = sorted(int(e.labels['series'].strip('"')) for e in expositions)
+        self.assertEqual(series, list(range(count)))
+        for e in expositions:
+            self.assertEqual(e.value, int(e.labels['series'].strip('"')))
+
 
 if __name__ == '__main__':
     parser = argparse.ArgumentParser()
@@ -0,0 +1,112 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/replicated.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/later.hh>
+
+#include <atomic>
+#include <unordered_map>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::atomic<int> nr_destroyed{0};
+
+struct tracked {
+    int value;
+    explicit tracked(int v) noexcept : value(v) {}
+    tracked(const tracked&) = default;
+    tracked(tracked&& o) noexcept : value(o.value) {
+        o.value = -1;
+    }
+    ~tracked() {
+        if (value >= 0) {
+            nr_destroyed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated_read_on_all_shards) {
+    using table = std::unordered_map<sstring, int>;
+    replicated<table> t(table{{"a", 1}});
+    smp::invoke_on_all([&t] {
+        BOOST_REQUIRE_EQUAL(t->at("a"), 1);
+    }).get();
+
+    t.update([] (table& t) { t["b"] = 2; });
+    smp::invoke_on_all([&t] {
+        BOOST_REQUIRE_EQUAL(t->at("a"), 1);
+        BOOST_REQUIRE_EQUAL(t->at("b"), 2);
+    }).get();
+
+    t.publish(table{{"c", 3}});
+    smp::invoke_on_all([&t] {
+        BOOST_REQUIRE_EQUAL(t->size(), 1);
+        BOOST_REQUIRE_EQUAL(t->at("c"), 3);
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated_reclaims_after_quiescence) {
+    nr_destroyed = 0;
+    {
+        replicated<tracked> t(std::in_place, 1);
+        auto& first = t.get();
+        t.publish(tracked(2));
+        // Readers of the task which published may still use the old version
+        BOOST_REQUIRE_EQUAL(first.value, 1);
+        BOOST_REQUIRE_EQUAL(nr_destroyed.load(), 0);
+        BOOST_REQUIRE_EQUAL(t->value, 2);
+
+        for (int i = 0; i < 1000 && nr_destroyed.load() == 0; ++i) {
+            smp::invoke_on_all([] {}).get();
+            sleep(1ms).get();
+        }
+        BOOST_REQUIRE_EQUAL(nr_destroyed.load(), 1);
+    }
+    // The last version is retired by the destructor
+    for (int i = 0; i < 1000 && nr_destroyed.load() == 1; ++i) {
+        smp::invoke_on_all([] {}).get();
+        sleep(1ms).get();
+    }
+    BOOST_REQUIRE_EQUAL(nr_destroyed.load(), 2);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated_reclaims_with_idle_shards) {
+    // The shards other than this one are left alone, and may go to sleep,
+    // which doesn't hold up reclamation
+    nr_destroyed = 0;
+    replicated<tracked> t(std::in_place, 1);
+    sleep(100ms).get();
+    t.publish(tracked(2));
+    for (int i = 0; i < 1000 && nr_destroyed.load() == 0; ++i) {
+        sleep(1ms).get();
+    }
+    BOOST_REQUIRE_EQUAL(nr_destroyed.load(), 1);
+}
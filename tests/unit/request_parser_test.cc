@@ -21,10 +21,12 @@
  */
 
 #include <seastar/core/ragel.hh>
+#include <seastar/core/print.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/http/request.hh>
 #include <seastar/http/request_parser.hh>
+#include <seastar/http/internal/request_head_parser.hh>
 #include <seastar/testing/test_case.hh>
 #include <tuple>
 #include <utility>
@@ -72,3 +74,76 @@ SEASTAR_TEST_CASE(test_header_parsing) {
     }
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(test_request_head_fast_path) {
+    auto parse = [] (std::string_view msg, http::request& req) {
+        return http::internal::parse_request_head(msg.data(), msg.data() + msg.size(), req);
+    };
+
+    std::string_view msg = "POST /path?x=1 HTTP/1.1\r\nHost: test\r\nA: 1\r\na:\t2 \r\nEmpty:\r\n\r\nbody";
+    http::request req;
+    auto end = parse(msg, req);
+    BOOST_REQUIRE(end);
+    BOOST_REQUIRE_EQUAL(std::string_view(end), "body");
+    BOOST_REQUIRE_EQUAL(req._method, "POST");
+    BOOST_REQUIRE_EQUAL(req._url, "/path?x=1");
+    BOOST_REQUIRE_EQUAL(req._version, "1.1");
+    BOOST_REQUIRE_EQUAL(req._headers.size(), 3);
+    BOOST_REQUIRE_EQUAL(req.get_header("Host"), "test");
+    BOOST_REQUIRE_EQUAL(req.get_header("A"), "1,2");
+    BOOST_REQUIRE_EQUAL(req.get_header("Empty"), "");
+
+    // Values long enough for the vector scans, with obs-text
+    for (size_t len : {15, 16, 31, 32, 33, 63, 100, 1000}) {
+        sstring value(len, 'v');
+        value[len / 2] = '\x80';
+        sstring url = "/" + sstring(len, 'u');
+        sstring msg = format("GET {} HTTP/1.0\r\nName: {}\r\n\r\n", url, value);
+        http::request req;
+        BOOST_REQUIRE(parse(msg, req) == msg.data() + msg.size());
+        BOOST_REQUIRE_EQUAL(req._url, url);
+        BOOST_REQUIRE_EQUAL(req.get_header("Name"), value);
+
+        // Control characters aren't taken by the fast path
+        for (auto pos : {size_t(0), len / 3, len - 1}) {
+            auto bad = value;
+            bad[pos] = '\x01';
+            http::request req;
+            BOOST_REQUIRE(!parse(format("GET / HTTP/1.0\r\nName: {}\r\n\r\n", bad), req));
+            BOOST_REQUIRE(req._method.empty());
+        }
+    }
+
+    // Left to the full parser
+    for (std::string_view msg : {
+            "GET /hello HTTP/1.0\r\nHeader: fiel\r\n    d\r\n\r\n",
+            "GET /hello HTTP/1.0\r\nHeader: Field\r\n",
+            "GET /hello HTTP/1.0\r\nHeader : Field\r\n\r\n",
+            "GET /hello HTTP/1.0\r\nHeader: Fi\x7f" "eld\r\n\r\n",
+            "GET /he\tllo HTTP/1.0\r\n\r\n",
+            "GET /hello HTTP/1.0\n\n",
+            "get /hello HTTP/1.0\r\n\r\n",
+            "GET /hello HTTP/1.10\r\n\r\n",
+            "GET /hello HTTP/1.1"}) {
+        http::request req;
+        BOOST_REQUIRE(!parse(msg, req));
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_request_split_across_buffers) {
+    sstring msg = "GET /test HTTP/1.1\r\nHost: test\r\nHeader: fiel\r\n d\r\nA: 1\r\nA: 2\r\n\r\n";
+    http_request_parser parser;
+    for (size_t split = 1; split < msg.size(); split++) {
+        parser.init();
+        BOOST_REQUIRE(!parser(temporary_buffer<char>(msg.data(), split)).get().has_value());
+        BOOST_REQUIRE(parser(temporary_buffer<char>(msg.data() + split, msg.size() - split)).get().has_value());
+        BOOST_REQUIRE(!parser.failed());
+        auto req = parser.get_parsed_request();
+        BOOST_REQUIRE_EQUAL(req->_url, "/test");
+        BOOST_REQUIRE_EQUAL(req->get_header("Host"), "test");
+        BOOST_REQUIRE_EQUAL(req->get_header("Header"), "fiel d");
+        BOOST_REQUIRE_EQUAL(req->get_header("A"), "1,2");
+    }
+    return make_ready_future<>();
+}
@@ -50,6 +50,18 @@ void set_routes(routes& r) {
         obj.enum_var = v;
         return obj;
     });
+    api_json::hello_typed.set(r, [] (const_req req) {
+        api_json::ns_hello_typed::params params{req};
+        api_json::typed_object obj;
+        obj.name = params.get_name();
+        obj.id = params.get_id();
+        obj.count = params.get_count();
+        obj.verbose = params.get_verbose().value_or(false);
+        if (auto mode = params.get_mode()) {
+            obj.mode = *mode;
+        }
+        return obj;
+    });
 }
 
 int main(int ac, char** av) {
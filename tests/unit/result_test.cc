@@ -0,0 +1,128 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <stdexcept>
+#include <string>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/result.hh>
+#include <seastar/coroutine/as_future.hh>
+#include <seastar/testing/test_case.hh>
+
+using namespace seastar;
+
+namespace {
+
+enum class lookup_error { not_found, overloaded };
+
+future<result<int, lookup_error>> lookup(int key) {
+    if (key < 0) {
+        co_return unexpected(lookup_error::not_found);
+    }
+    co_return key * 2;
+}
+
+future<result<std::string, lookup_error>> lookup_and_format(int key) {
+    auto r = co_await lookup(key);
+    if (!r) {
+        co_return unexpected(r.error());
+    }
+    co_return std::to_string(*r);
+}
+
+}
+
+SEASTAR_TEST_CASE(test_result_basics) {
+    result<int, lookup_error> ok = 3;
+    BOOST_REQUIRE(ok.has_value());
+    BOOST_REQUIRE_EQUAL(*ok, 3);
+    BOOST_REQUIRE_EQUAL(ok.value(), 3);
+
+    result<int, lookup_error> err = unexpected(lookup_error::overloaded);
+    BOOST_REQUIRE(!err);
+    BOOST_REQUIRE(err.error() == lookup_error::overloaded);
+    BOOST_REQUIRE_EQUAL(err.value_or(7), 7);
+    BOOST_REQUIRE_THROW(err.value(), bad_result_access<lookup_error>);
+
+    result<void, lookup_error> done;
+    BOOST_REQUIRE(done.has_value());
+    result<std::string, std::string> same_types = unexpected(std::string("error"));
+    BOOST_REQUIRE(!same_types);
+    BOOST_REQUIRE_EQUAL(same_types.error(), "error");
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_result_coroutines) {
+    auto r = co_await lookup_and_format(21);
+    BOOST_REQUIRE(r);
+    BOOST_REQUIRE_EQUAL(*r, "42");
+
+    r = co_await lookup_and_format(-1);
+    BOOST_REQUIRE(!r);
+    BOOST_REQUIRE(r.error() == lookup_error::not_found);
+}
+
+SEASTAR_TEST_CASE(test_result_then_ok) {
+    bool called = false;
+    // The continuation is skipped for errors
+    auto r = co_await then_ok(lookup(-1), [&] (int v) {
+        called = true;
+        return v + 1;
+    });
+    BOOST_REQUIRE(!called);
+    BOOST_REQUIRE(r.error() == lookup_error::not_found);
+
+    // Values, results and futures of them are all fine
+    auto r1 = co_await then_ok(lookup(1), [] (int v) { return v + 1; });
+    BOOST_REQUIRE_EQUAL(*r1, 3);
+    auto r2 = co_await then_ok(lookup(1), [] (int v) -> result<int, lookup_error> { return unexpected(lookup_error::overloaded); });
+    BOOST_REQUIRE(r2.error() == lookup_error::overloaded);
+    auto r3 = co_await then_ok(lookup(1), [] (int v) { return lookup(v); });
+    BOOST_REQUIRE_EQUAL(*r3, 4);
+    auto r4 = co_await then_ok(lookup(1), [] (int v) { return make_ready_future<sstring>("x"); });
+    BOOST_REQUIRE_EQUAL(*r4, "x");
+    result<void, lookup_error> r5 = co_await then_ok(lookup(1), [] (int) {});
+    BOOST_REQUIRE(r5);
+
+    // Exceptions still fail the future
+    auto f = co_await coroutine::as_future(then_ok(lookup(1), [] (int) -> int { throw std::runtime_error("unexpected"); }));
+    BOOST_REQUIRE_THROW(f.get(), std::runtime_error);
+}
+
+SEASTAR_TEST_CASE(test_result_then_error) {
+    auto r = co_await then_error(lookup(-1), [] (lookup_error e) {
+        return e == lookup_error::not_found ? 0 : 1;
+    });
+    BOOST_REQUIRE_EQUAL(*r, 0);
+    r = co_await then_error(lookup(2), [] (lookup_error) { return 0; });
+    BOOST_REQUIRE_EQUAL(*r, 4);
+}
+
+SEASTAR_TEST_CASE(test_result_to_exception) {
+    auto v = co_await result_to_exception(lookup(3));
+    BOOST_REQUIRE_EQUAL(v, 6);
+    auto f = co_await coroutine::as_future(result_to_exception(lookup(-1), [] (lookup_error) {
+        return std::make_exception_ptr(std::out_of_range("not found"));
+    }));
+    BOOST_REQUIRE_THROW(f.get(), std::out_of_range);
+    f = co_await coroutine::as_future(result_to_exception(lookup(-1)));
+    BOOST_REQUIRE_THROW(f.get(), bad_result_access<lookup_error>);
+}
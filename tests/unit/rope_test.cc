@@ -0,0 +1,91 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/rope.hh>
+#include <string>
+
+using namespace seastar;
+
+static temporary_buffer<char> buf(std::string_view s) {
+    return temporary_buffer<char>::copy_of(s);
+}
+
+BOOST_AUTO_TEST_CASE(test_rope_append_does_not_copy) {
+    auto hello = buf("hello ");
+    auto hello_data = hello.get();
+    rope r(std::move(hello));
+    r.append(buf("world"));
+    r += std::string_view("!");
+    r.append(temporary_buffer<char>());
+    BOOST_REQUIRE_EQUAL(r.size(), 12u);
+    BOOST_REQUIRE_EQUAL(r.fragments().size(), 3u);
+    BOOST_REQUIRE_EQUAL(r.fragments().front().get(), hello_data);
+    BOOST_REQUIRE(r == std::string_view("hello world!"));
+    BOOST_REQUIRE_EQUAL(r.to_string(), "hello world!");
+
+    auto both = rope(buf("a")) + std::move(r);
+    BOOST_REQUIRE_EQUAL(both.fragments().size(), 4u);
+    BOOST_REQUIRE_EQUAL(both.fragments()[1].get(), hello_data);
+    BOOST_REQUIRE(both == std::string_view("ahello world!"));
+}
+
+BOOST_AUTO_TEST_CASE(test_rope_share_and_trim) {
+    rope r;
+    r.append(buf("abc")).append(buf("defg")).append(buf("hi"));
+    auto mid = r.share(2, 6);
+    BOOST_REQUIRE(mid == std::string_view("cdefgh"));
+    BOOST_REQUIRE_EQUAL(mid.fragments().size(), 3u);
+    BOOST_REQUIRE_EQUAL(mid.fragments()[1].get(), r.fragments()[1].get());
+    BOOST_REQUIRE(r.share(3, 4) == std::string_view("defg"));
+    BOOST_REQUIRE(r.share(8, 10) == std::string_view("i"));
+
+    r.trim_front(4);
+    BOOST_REQUIRE(r == std::string_view("efghi"));
+    BOOST_REQUIRE_EQUAL(r.fragments().size(), 2u);
+    r.trim_front(3);
+    BOOST_REQUIRE(r == std::string_view("hi"));
+    r.trim_front(10);
+    BOOST_REQUIRE(r.empty());
+    BOOST_REQUIRE(r.fragments().empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_rope_linearize_and_compare) {
+    rope one(buf("single"));
+    auto data = one.fragments().front().get();
+    BOOST_REQUIRE_EQUAL(one.linearize().get(), data);
+
+    rope a;
+    a.append(buf("ab")).append(buf("cdef"));
+    rope b;
+    b.append(buf("abc")).append(buf("d")).append(buf("ef"));
+    BOOST_REQUIRE(a == b);
+    auto flat = a.linearize();
+    BOOST_REQUIRE_EQUAL(std::string_view(flat.get(), flat.size()), "abcdef");
+    b.trim_front(1);
+    BOOST_REQUIRE(!(a == b));
+
+    auto fragments = std::move(a).release();
+    BOOST_REQUIRE_EQUAL(fragments.size(), 2u);
+    BOOST_REQUIRE(a.empty());
+}
@@ -27,6 +27,8 @@
 #include <seastar/rpc/lz4_compressor.hh>
 #include <seastar/rpc/lz4_fragmented_compressor.hh>
 #include <seastar/rpc/multi_algo_compressor_factory.hh>
+#include <seastar/rpc/zstd_compressor.hh>
+#include <seastar/net/shm_socket.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/testing/test_runner.hh>
@@ -397,6 +399,151 @@ SEASTAR_TEST_CASE(test_rpc_connect_multi_compression_algo) {
     });
 }
 
+// Counts the frames that went through compression
+struct counting_cfactory : rpc::compressor::factory {
+    const sstring name = "LZ4";
+    mutable unsigned compressed = 0;
+    const sstring& supported() const override {
+        return name;
+    }
+    class counting_lz4 : public rpc::lz4_compressor {
+        unsigned& _compressed;
+    public:
+        counting_lz4(unsigned& c) : _compressed(c) {}
+        rpc::snd_buf compress(size_t head_space, rpc::snd_buf data) override {
+            if (data.size) {
+                _compressed++;
+            }
+            return rpc::lz4_compressor::compress(head_space, std::move(data));
+        }
+    };
+    std::unique_ptr<rpc::compressor> negotiate(sstring feature, bool is_server) const override {
+        return feature == name ? std::make_unique<counting_lz4>(compressed) : nullptr;
+    }
+};
+
+SEASTAR_TEST_CASE(test_rpc_adaptive_compression) {
+    auto sfactory = std::make_unique<counting_cfactory>();
+    auto cfactory = std::make_unique<counting_cfactory>();
+    rpc::adaptive_compression_config acfg;
+    acfg.min_size = 256;
+    acfg.probe_interval = 8;
+    rpc::server_options so;
+    rpc::client_options co;
+    so.compressor_factory = sfactory.get();
+    so.adaptive_compression = acfg;
+    co.compressor_factory = cfactory.get();
+    co.adaptive_compression = acfg;
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    auto sf = sfactory.get();
+    auto cf = cfactory.get();
+    return rpc_test_env<>::do_with_thread(cfg, co, [sf, cf] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (sstring s) { return s; }).get();
+        auto echo = env.proto().make_client<sstring (sstring)>(1);
+
+        auto check = [&] (sstring payload, unsigned count) {
+            for (unsigned i = 0; i < count; i++) {
+                BOOST_REQUIRE(echo(c1, payload).get() == payload);
+            }
+        };
+
+        // Too small to be worth it
+        check("small", 16);
+        BOOST_REQUIRE_EQUAL(cf->compressed, 0);
+        BOOST_REQUIRE_EQUAL(sf->compressed, 0);
+
+        // Incompressible, only the first frame and the probes are compressed
+        auto& eng = testing::local_random_engine;
+        auto dist = std::uniform_int_distribution<int>(0, 255);
+        sstring random = uninitialized_string(4096);
+        std::generate(random.begin(), random.end(), [&] { return char(dist(eng)); });
+        check(random, 33);
+        BOOST_REQUIRE_EQUAL(cf->compressed, 5);
+        BOOST_REQUIRE_EQUAL(sf->compressed, 5);
+
+        // The next probe, on the 8th frame, finds the verb compressible again
+        check(sstring(4096, 'a'), 16);
+        BOOST_REQUIRE_EQUAL(cf->compressed, 5 + 1 + 8);
+        BOOST_REQUIRE_EQUAL(sf->compressed, 5 + 1 + 8);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_request_batching) {
+    std::vector<future<>> fs;
+    for (auto compress : {false, true}) {
+        auto sfactory = std::make_unique<counting_cfactory>();
+        auto cfactory = std::make_unique<counting_cfactory>();
+        rpc::server_options so;
+        rpc::client_options co;
+        if (compress) {
+            so.compressor_factory = sfactory.get();
+            co.compressor_factory = cfactory.get();
+        }
+        rpc::request_batching_config bcfg;
+        bcfg.max_delay = std::chrono::milliseconds(10);
+        co.batching = bcfg;
+        rpc_test_config cfg;
+        cfg.server_options = so;
+        auto cf = cfactory.get();
+        fs.push_back(rpc_test_env<>::do_with_thread(cfg, co, [cf, compress] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+            std::vector<int> seen;
+            env.register_handler(1, [&seen] (int i) {
+                seen.push_back(i);
+                return rpc::no_wait;
+            }).get();
+            env.register_handler(2, [] (sstring s) { return s; }).get();
+            auto notify = env.proto().make_client<rpc::no_wait_type (int)>(1);
+            auto echo = env.proto().make_client<sstring (sstring)>(2);
+
+            std::vector<future<>> sent;
+            for (int i = 0; i < 100; i++) {
+                sent.push_back(notify(c1, i));
+            }
+            when_all_succeed(sent.begin(), sent.end()).get();
+            // Too big to be batched, flushes the batch before it
+            sstring big(4096, 'a');
+            BOOST_REQUIRE(echo(c1, big).get() == big);
+            while (seen.size() < 100) {
+                sleep(std::chrono::milliseconds(1)).get();
+            }
+            std::vector<int> expected(100);
+            std::iota(expected.begin(), expected.end(), 0);
+            BOOST_REQUIRE(seen == expected);
+            if (compress) {
+                // The batch got compressed as a whole, and so did the big request
+                BOOST_REQUIRE_LT(cf->compressed, 10);
+            }
+
+            // A lone small request waits for the timer
+            BOOST_REQUIRE(echo(c1, "small").get() == "small");
+        }).finally([sfactory = std::move(sfactory), cfactory = std::move(cfactory)] {}));
+    }
+    return when_all_succeed(fs.begin(), fs.end()).discard_result();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_shm_transport) {
+    test_rpc_proto proto(serializer{});
+    auto addr = socket_address{unix_domain_addr{std::string(1, '\0') + "seastar-rpc-shm-test"}};
+    net::shm_listen_options opts;
+    opts.ring_size = 64 * 1024;
+    test_rpc_proto::server server(proto, net::shm_listen(addr, opts));
+    auto stop_server = deferred_stop(server);
+    proto.register_handler(1, [] (int a, int b) { return a + b; });
+    proto.register_handler(2, [] (sstring s) { return s; });
+
+    test_rpc_proto::client client(proto, {}, net::make_shm_socket(), addr);
+    auto stop_client = deferred_stop(client);
+    auto sum = proto.make_client<int (int, int)>(1);
+    for (int i = 0; i < 100; i++) {
+        BOOST_REQUIRE_EQUAL(sum(client, i, 1).get(), i + 1);
+    }
+    // Larger than the rings
+    auto echo = proto.make_client<sstring (sstring)>(2);
+    sstring big(1 << 20, 'x');
+    BOOST_REQUIRE(echo(client, big).get() == big);
+}
+
 SEASTAR_TEST_CASE(test_rpc_connect_abort) {
     rpc_test_config cfg;
     rpc_loopback_error_injector::config ecfg;
@@ -487,6 +634,59 @@ SEASTAR_TEST_CASE(test_rpc_remote_verb_error) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rpc_shard_routing) {
+    rpc_test_config cfg;
+    cfg.server_options.streaming_domain = rpc::streaming_domain_type(1);
+    rpc::client_options co;
+    co.shard_routing = true;
+    return rpc_test_env<>::do_with_thread(cfg, co, [co] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        env.register_handler(1, [] { return uint32_t(this_shard_id()); }).get();
+        auto where = env.proto().make_client<uint32_t ()>(1);
+        for (unsigned shard = 0; shard < smp::count; shard++) {
+            BOOST_REQUIRE_EQUAL(where(c, rpc::target_shard{shard}).get(), shard);
+            BOOST_REQUIRE_EQUAL(where(c, rpc::target_shard{shard}, std::chrono::seconds(10)).get(), shard);
+        }
+        BOOST_REQUIRE_LT(where(c).get(), smp::count);
+        BOOST_REQUIRE_THROW(where(c, rpc::target_shard{smp::count}).get(), rpc::remote_verb_error);
+
+        // Clients of other shards share the connection
+        auto shared = make_foreign(static_pointer_cast<rpc::client>(make_shared<test_rpc_proto::client>(env.proto(), co, env.make_socket(), ipv4_addr())));
+        auto& shared_client = *shared;
+        smp::submit_to(smp::count - 1, [&env, &where, shared = shared.copy().get()] () mutable {
+            return seastar::async([&env, &where, shared = std::move(shared)] () mutable {
+                test_rpc_proto::client c(env.proto(), {}, std::move(shared));
+                auto stop = deferred_stop(c);
+                for (unsigned shard = 0; shard < smp::count; shard++) {
+                    BOOST_REQUIRE_EQUAL(where(c, rpc::target_shard{shard}).get(), shard);
+                }
+                BOOST_REQUIRE_THROW(where(c, rpc::target_shard{smp::count}).get(), rpc::remote_verb_error);
+            });
+        }).get();
+        shared_client.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_shard_routing_unsupported) {
+    rpc_test_config cfg;
+    return rpc_test_env<>::do_with_thread(cfg, [] (rpc_test_env<>& env) {
+        env.register_handler(1, [] { return uint32_t(this_shard_id()); }).get();
+        auto where = env.proto().make_client<uint32_t ()>(1);
+
+        // The client doesn't route requests
+        test_rpc_proto::client c1(env.proto(), {}, env.make_socket(), ipv4_addr());
+        BOOST_REQUIRE_THROW(where(c1, rpc::target_shard{0}).get(), std::logic_error);
+        BOOST_REQUIRE_LT(where(c1).get(), smp::count);
+        c1.stop().get();
+
+        // The server has no streaming domain
+        rpc::client_options co;
+        co.shard_routing = true;
+        test_rpc_proto::client c2(env.proto(), co, env.make_socket(), ipv4_addr());
+        BOOST_REQUIRE_THROW(where(c2, rpc::target_shard{0}).get(), rpc::closed_error);
+        c2.stop().get();
+    });
+}
+
 struct stream_test_result {
     bool client_source_closed = false;
     bool server_source_closed = false;
@@ -701,6 +901,47 @@ SEASTAR_TEST_CASE(test_stream_negotiation_error) {
     });
 }
 
+SEASTAR_TEST_CASE(test_stream_flow_control) {
+    rpc::stream_flow_control_config fc;
+    fc.window = 1024;
+    fc.max_packed_size = 512;
+    rpc::server_options so;
+    so.streaming_domain = rpc::streaming_domain_type(1);
+    so.stream_flow_control = fc;
+    rpc::client_options co;
+    co.stream_flow_control = fc;
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    return rpc_test_env<>::do_with_thread(cfg, co, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (rpc::source<sstring> source) {
+            return seastar::async([source] () mutable {
+                uint64_t received = 0;
+                int elements = 0;
+                while (auto data = source().get()) {
+                    received += std::get<0>(*data).size();
+                    // A slow reader makes the sender wait for credits
+                    if (++elements % 100 == 0) {
+                        sleep(std::chrono::milliseconds(1)).get();
+                    }
+                }
+                return received;
+            });
+        }).get();
+        auto call = env.proto().make_client<uint64_t (rpc::sink<sstring>)>(1);
+        auto sink = c1.make_stream_sink<serializer, sstring>(env.make_socket()).get();
+        auto received = call(c1, sink);
+        uint64_t sent = 0;
+        for (int i = 0; i < 1000; i++) {
+            // Elements bigger than the window get through too
+            sstring data(i % 100 ? 8 : 4096, 'x');
+            sent += data.size();
+            sink(data).get();
+        }
+        sink.close().get();
+        BOOST_REQUIRE_EQUAL(received.get(), sent);
+    });
+}
+
 static future<> test_rpc_connection_send_glitch(bool on_client) {
     struct context {
         int limit;
@@ -1268,6 +1509,68 @@ SEASTAR_THREAD_TEST_CASE(test_lz4_fragmented_compressor) {
     test_compressor([] { return std::make_unique<rpc::lz4_fragmented_compressor>(); });
 }
 
+// Raw content works as a dictionary too
+static temporary_buffer<char> make_zstd_dictionary(char seed) {
+    temporary_buffer<char> dict(16 * 1024);
+    for (size_t i = 0; i < dict.size(); ++i) {
+        dict.get_write()[i] = seed + i % 61;
+    }
+    return dict;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor) {
+    if (!rpc::zstd_compressor::available()) {
+        return;
+    }
+    test_compressor([] { return std::make_unique<rpc::zstd_compressor>(); });
+    test_compressor([] { return std::make_unique<rpc::zstd_compressor>(3); });
+    rpc::zstd_dictionary dict(1, make_zstd_dictionary('a'), 3);
+    test_compressor([&dict] { return std::make_unique<rpc::zstd_compressor>(1, &dict); });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_dictionary_negotiation) {
+    if (!rpc::zstd_compressor::available()) {
+        // Not advertised, peers fall back to what else there is
+        rpc::zstd_compressor::factory plain;
+        rpc::lz4_fragmented_compressor::factory lz4;
+        rpc::multi_algo_compressor_factory client({&plain, &lz4});
+        BOOST_REQUIRE_EQUAL(client.supported(), "LZ4_FRAGMENTED");
+        BOOST_REQUIRE(!plain.negotiate("ZSTD", true));
+        return;
+    }
+    rpc::zstd_dictionary dict1(1, make_zstd_dictionary('a'));
+    rpc::zstd_dictionary dict2(2, make_zstd_dictionary('A'));
+    rpc::zstd_compressor::factory with_dict1(dict1);
+    rpc::zstd_compressor::factory with_dict2(dict2);
+    rpc::zstd_compressor::factory plain;
+    rpc::lz4_fragmented_compressor::factory lz4;
+
+    rpc::multi_algo_compressor_factory client({&with_dict1, &plain, &lz4});
+    BOOST_REQUIRE_EQUAL(client.supported(), "ZSTD_DICT_1,ZSTD,LZ4_FRAGMENTED");
+
+    rpc::multi_algo_compressor_factory server({&with_dict2, &with_dict1, &plain});
+    auto c = server.negotiate(client.supported(), true);
+    BOOST_REQUIRE(c);
+    BOOST_REQUIRE_EQUAL(c->name(), "ZSTD_DICT_1");
+
+    // No dictionary in common
+    rpc::multi_algo_compressor_factory other_server({&with_dict2, &plain});
+    c = other_server.negotiate(client.supported(), true);
+    BOOST_REQUIRE(c);
+    BOOST_REQUIRE_EQUAL(c->name(), "ZSTD");
+
+    // Both sides agree, and compress with the same dictionary
+    auto sender = client.negotiate(server.supported(), false);
+    auto receiver = server.negotiate(client.supported(), true);
+    BOOST_REQUIRE_EQUAL(sender->name(), receiver->name());
+    auto message = make_zstd_dictionary('a');
+    auto compressed = sender->compress(0, rpc::snd_buf(message.share()));
+    BOOST_REQUIRE_LT(compressed.size, message.size() / 10);
+    auto& buf = std::get<temporary_buffer<char>>(compressed.bufs);
+    auto decompressed = receiver->decompress(rpc::rcv_buf(std::move(buf)));
+    BOOST_REQUIRE(std::get<temporary_buffer<char>>(decompressed.bufs) == message);
+}
+
 // Test reproducing issue #671: If timeout is time_point::max(), translating
 // it to relative timeout in the sender and then back in the receiver, when
 // these calculations happen across a millisecond boundary, overflowed the
@@ -1355,6 +1658,35 @@ SEASTAR_TEST_CASE(test_rpc_tuple) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rpc_fragmented_buffer) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (int tag, rpc::fragmented_buffer data, rpc::fragmented_buffer empty) {
+            BOOST_REQUIRE(empty.empty());
+            // Sent back as received, without linearizing
+            return make_ready_future<rpc::tuple<int, rpc::fragmented_buffer>>(rpc::tuple<int, rpc::fragmented_buffer>(tag + 1, std::move(data)));
+        }).get();
+        auto echo = env.proto().make_client<rpc::tuple<int, rpc::fragmented_buffer> (int, rpc::fragmented_buffer, rpc::fragmented_buffer)>(1);
+
+        std::vector<temporary_buffer<char>> fragments;
+        size_t size = 0;
+        for (auto len : {size_t(1), rpc::snd_buf::chunk_size, size_t(100'000), size_t(7)}) {
+            temporary_buffer<char> b(len);
+            for (size_t i = 0; i < len; i++) {
+                b.get_write()[i] = char(size + i);
+            }
+            size += len;
+            fragments.push_back(std::move(b));
+        }
+        auto [tag, data] = echo(c1, 41, rpc::fragmented_buffer(std::move(fragments)), rpc::fragmented_buffer()).get();
+        BOOST_REQUIRE_EQUAL(tag, 42);
+        BOOST_REQUIRE_EQUAL(data.size(), size);
+        auto linear = data.linearize();
+        BOOST_REQUIRE_EQUAL(linear.size(), size);
+        size_t i = 0;
+        BOOST_REQUIRE(std::all_of(linear.begin(), linear.end(), [&i] (char c) { return c == char(i++); }));
+    });
+}
+
 SEASTAR_TEST_CASE(test_rpc_nonvariadic_client_variadic_server) {
     return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
         // Server is variadic
@@ -1677,6 +2009,88 @@ SEASTAR_THREAD_TEST_CASE(test_rpc_metric_domains) {
     BOOST_CHECK_EQUAL(get_metrics("rpc_client_sent_messages", "dom2"), 9);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_rpc_expired_requests) {
+    rpc_test_config cfg;
+    // Only one request fits at a time
+    cfg.resource_limits.basic_request_size = 1000;
+    cfg.resource_limits.max_memory = 1500;
+    rpc_test_env<>::do_with_thread(cfg, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        bool aborted = false;
+        env.register_handler(1, [&aborted] (rpc::opt_time_point, abort_source& as, int v) {
+            return sleep_abortable(std::chrono::seconds(10), as).then_wrapped([&aborted, v] (future<> f) {
+                aborted = f.failed();
+                f.ignore_ready_future();
+                return v;
+            });
+        }).get();
+        auto call = env.proto().make_client<int (int)>(1);
+        // The handler is aborted once the deadline passes
+        auto f1 = call(c1, std::chrono::milliseconds(100), 1);
+        // Expires while waiting for the first one to release its memory
+        auto f2 = call(c1, std::chrono::milliseconds(50), 2);
+        BOOST_REQUIRE_THROW(f1.get(), rpc::timeout_error);
+        BOOST_REQUIRE_THROW(f2.get(), rpc::timeout_error);
+        while (!aborted) {
+            sleep(std::chrono::milliseconds(1)).get();
+        }
+        uint64_t expired = 0;
+        env.server().foreach_connection([&expired] (rpc::server::connection& c) {
+            expired += c.get_stats().expired;
+        });
+        BOOST_REQUIRE_EQUAL(expired, 1);
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_verb_stats) {
+    rpc::client_options co;
+    co.metrics_domain = "verb_stats";
+    co.verb_stats = rpc::verb_stats_config{.max_verbs = 2};
+    rpc_test_config cfg;
+    cfg.server_options.metrics_domain = "verb_stats";
+    cfg.server_options.verb_stats = rpc::verb_stats_config{.max_verbs = 2};
+    rpc_test_env<>::do_with_thread(cfg, co, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        for (int verb = 1; verb <= 4; verb++) {
+            env.register_handler(verb, [] (int v) {
+                return sleep(std::chrono::milliseconds(1)).then([v] { return v; });
+            }).get();
+        }
+        for (int verb = 1; verb <= 4; verb++) {
+            auto call = env.proto().make_client<int (int)>(verb);
+            for (int i = 0; i < verb; i++) {
+                BOOST_REQUIRE_EQUAL(call(c1, i).get(), i);
+            }
+        }
+        // Verbs beyond max_verbs share the "other" entry
+        BOOST_REQUIRE(c1.get_verb_stats(1) != c1.get_verb_stats(2));
+        BOOST_REQUIRE(c1.get_verb_stats(3) == c1.get_verb_stats(4));
+        BOOST_REQUIRE_EQUAL(c1.get_verb_stats(2)->latency.count(), 2);
+        BOOST_REQUIRE_EQUAL(c1.get_verb_stats(3)->latency.count(), 7);
+        BOOST_REQUIRE_EQUAL(c1.get_verb_stats(1)->in_flight, 0);
+        BOOST_REQUIRE_GE(c1.get_verb_stats(2)->latency.min(), 512);
+    }).get();
+
+    auto get_count = [] (std::string name, std::string verb) -> uint64_t {
+        const auto& values = seastar::metrics::impl::get_value_map();
+        const auto& mf = values.find(name);
+        BOOST_REQUIRE(mf != values.end());
+        for (auto&& mi : mf->second) {
+            auto& labels = mi.first;
+            auto d = labels.find("domain");
+            auto v = labels.find("verb");
+            if (d != labels.end() && d->second == "verb_stats" && v != labels.end() && v->second == verb) {
+                return mi.second->get_function()().get_histogram().sample_count;
+            }
+        }
+        BOOST_FAIL("cannot find requested metrics");
+        return 0;
+    };
+
+    BOOST_CHECK_EQUAL(get_count("rpc_client_verb_latency", "1"), 1);
+    BOOST_CHECK_EQUAL(get_count("rpc_client_verb_latency", "other"), 7);
+    BOOST_CHECK_EQUAL(get_count("rpc_server_verb_latency", "2"), 2);
+    BOOST_CHECK_EQUAL(get_count("rpc_server_verb_queue_wait", "other"), 7);
+}
+
 // Extract a piece of contiguous data from the front of the buffer (and trim the extracted front away).
 template <typename T>
 requires std::is_trivially_copyable_v<T>
@@ -0,0 +1,143 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2026 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE net
+
+#include <boost/test/unit_test.hpp>
+#include "net/rss_buckets.hh"
+#include <algorithm>
+#include <vector>
+
+using namespace seastar;
+
+using owners_type = std::vector<std::vector<uint8_t>>;
+
+// nr_buckets buckets spread over nr_queues queues the way the device
+// starts, round-robin
+static net::rss_buckets make_buckets(size_t nr_buckets, unsigned nr_queues) {
+    net::rss_buckets rss;
+    for (size_t b = 0; b < nr_buckets; b++) {
+        rss.redir_table.push_back(b % nr_queues);
+    }
+    rss.previous_owners.resize(nr_buckets);
+    return rss;
+}
+
+BOOST_AUTO_TEST_CASE(test_move_to_least_busy_queue) {
+    auto rss = make_buckets(4, 2);
+    // Queue 0 gets 80 packets, queue 1 gets 20. Bucket 0 alone is more
+    // than the gap, so only bucket 2 can go.
+    BOOST_REQUIRE(rss.move({60, 10, 20, 10}, 2));
+    BOOST_REQUIRE(rss.redir_table == std::vector<uint8_t>({0, 1, 1, 1}));
+    BOOST_REQUIRE(rss.previous_owners == owners_type({{}, {}, {0}, {}}));
+    BOOST_REQUIRE(rss.has_previous_owners());
+
+    // 60 against 40 is within the threshold
+    BOOST_REQUIRE(!rss.move({60, 10, 20, 10}, 2));
+    BOOST_REQUIRE(rss.redir_table == std::vector<uint8_t>({0, 1, 1, 1}));
+}
+
+BOOST_AUTO_TEST_CASE(test_move_balanced_or_idle) {
+    auto rss = make_buckets(8, 4);
+    BOOST_REQUIRE(!rss.move(std::vector<uint64_t>(8, 0), 4));
+    BOOST_REQUIRE(!rss.move(std::vector<uint64_t>(8, 100), 4));
+    BOOST_REQUIRE(!rss.move({0, 0, 0, 0, 100, 0, 0, 0}, 4));
+    BOOST_REQUIRE(rss.redir_table == make_buckets(8, 4).redir_table);
+    BOOST_REQUIRE(!rss.has_previous_owners());
+}
+
+BOOST_AUTO_TEST_CASE(test_move_at_most_max_moves) {
+    auto rss = make_buckets(64, 2);
+    std::vector<uint64_t> load(64);
+    for (size_t b = 0; b < load.size(); b += 2) {
+        load[b] = 10;
+    }
+    // Balancing would take 13 moves
+    BOOST_REQUIRE(rss.move(load, 2));
+    BOOST_REQUIRE_EQUAL(std::count(rss.redir_table.begin(), rss.redir_table.end(), 1), 32 + net::rss_buckets::max_moves);
+
+    // The next round carries on
+    BOOST_REQUIRE(rss.move(load, 2));
+    BOOST_REQUIRE_EQUAL(std::count(rss.redir_table.begin(), rss.redir_table.end(), 1), 45);
+}
+
+BOOST_AUTO_TEST_CASE(test_move_skips_buckets_with_many_owners) {
+    std::vector<uint64_t> load = {30, 0, 0, 0, 0, 10, 0, 0};
+
+    // Both buckets of queue 0 get as close, the first one is moved
+    auto rss = make_buckets(8, 5);
+    BOOST_REQUIRE(rss.move(load, 5));
+    BOOST_REQUIRE_EQUAL(rss.redir_table[0], 1);
+    BOOST_REQUIRE_EQUAL(rss.redir_table[5], 0);
+
+    rss = make_buckets(8, 5);
+    rss.previous_owners[0] = {1, 2, 3, 4};
+    BOOST_REQUIRE_EQUAL(rss.previous_owners[0].size(), net::rss_buckets::max_previous_owners);
+    BOOST_REQUIRE(rss.move(load, 5));
+    BOOST_REQUIRE_EQUAL(rss.redir_table[0], 0);
+    BOOST_REQUIRE_EQUAL(rss.redir_table[5], 1);
+    BOOST_REQUIRE(rss.previous_owners[0] == std::vector<uint8_t>({1, 2, 3, 4}));
+    BOOST_REQUIRE(rss.previous_owners[5] == std::vector<uint8_t>({0}));
+}
+
+BOOST_AUTO_TEST_CASE(test_move_back_to_previous_owner) {
+    auto rss = make_buckets(4, 2);
+    rss.previous_owners[0] = {1};
+    BOOST_REQUIRE(rss.move({10, 0, 30, 0}, 2));
+    BOOST_REQUIRE_EQUAL(rss.redir_table[0], 1);
+    // The new owner isn't a previous one anymore
+    BOOST_REQUIRE(rss.previous_owners[0] == std::vector<uint8_t>({0}));
+}
+
+BOOST_AUTO_TEST_CASE(test_prune_previous_owners) {
+    auto rss = make_buckets(4, 3);
+    rss.previous_owners = {{1, 2}, {}, {0}, {}};
+    std::vector<std::vector<bool>> in_use(3, std::vector<bool>(4));
+    in_use[1][0] = true;
+    // Connections of another bucket don't keep a previous owner
+    in_use[0][1] = true;
+
+    BOOST_REQUIRE(rss.prune_previous_owners(in_use));
+    BOOST_REQUIRE(rss.previous_owners == owners_type({{1}, {}, {}, {}}));
+    BOOST_REQUIRE(!rss.prune_previous_owners(in_use));
+
+    in_use[1][0] = false;
+    BOOST_REQUIRE(rss.prune_previous_owners(in_use));
+    BOOST_REQUIRE(!rss.has_previous_owners());
+}
+
+BOOST_AUTO_TEST_CASE(test_previous_owner) {
+    auto rss = make_buckets(8, 4);
+    rss.redir_table[1] = 3;
+    rss.previous_owners[1] = {0, 1, 2};
+    uint32_t hash = 8 * 1234 + 1;
+
+    BOOST_REQUIRE_EQUAL(rss.owner(hash), 3);
+    // From the current owner down to the oldest one
+    BOOST_REQUIRE_EQUAL(rss.previous_owner(hash, 3).value(), 2);
+    BOOST_REQUIRE_EQUAL(rss.previous_owner(hash, 2).value(), 1);
+    BOOST_REQUIRE_EQUAL(rss.previous_owner(hash, 1).value(), 0);
+    BOOST_REQUIRE(!rss.previous_owner(hash, 0));
+
+    // Buckets that never moved stay with their owner
+    BOOST_REQUIRE_EQUAL(rss.owner(2), 2);
+    BOOST_REQUIRE(!rss.previous_owner(2, 2));
+}
@@ -33,6 +33,7 @@
 #include <seastar/core/scheduling_specific.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/with_scheduling_group.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/util/later.hh>
 #include <seastar/util/defer.hh>
@@ -381,3 +382,154 @@ SEASTAR_THREAD_TEST_CASE(sg_create_check_unique_constructor_invocation) {
         groups = {};
     }).get();
 }
+
+SEASTAR_THREAD_TEST_CASE(sg_memory_soft_limit) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    scheduling_group sg = create_scheduling_group("sg_memory", 100).get();
+    auto cleanup = defer([&] () noexcept { destroy_scheduling_group(sg).get(); });
+    constexpr size_t size = 1 << 20;
+    sg.set_memory_soft_limit(size);
+    auto usage = sg.memory_usage();
+    auto buf = with_scheduling_group(sg, [] {
+        return std::make_unique<char[]>(size);
+    }).get();
+    BOOST_REQUIRE_GE(sg.memory_usage(), usage + size);
+    auto wait = sg.wait_for_memory();
+    BOOST_REQUIRE(!wait.available());
+    buf.reset();
+    BOOST_REQUIRE_EQUAL(sg.memory_usage(), usage);
+    wait.get();
+    BOOST_REQUIRE(sg.wait_for_memory().available());
+#endif
+}
+
+// Burns cpu of CPU time in sg, returns the wall time it took
+static sched_clock::duration burn_cpu(scheduling_group sg, sched_clock::duration cpu) {
+    thread_attributes attr;
+    attr.sched_group = sg;
+    return async(attr, [cpu] {
+        auto start = sched_clock::now();
+        sched_clock::duration ran = {};
+        while (ran < cpu) {
+            auto slice_start = sched_clock::now();
+            while (!need_preempt() && sched_clock::now() - slice_start < 1ms) {
+            }
+            ran += sched_clock::now() - slice_start;
+            thread::yield();
+        }
+        return sched_clock::now() - start;
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_supergroup) {
+    auto batch = create_scheduling_supergroup("batch", 200).get();
+    auto sg1 = create_scheduling_group("batch1", "b1", 100, batch).get();
+    auto sg2 = create_scheduling_group("batch2", "b2", 100, batch).get();
+    auto cleanup = defer([&] () noexcept {
+        destroy_scheduling_group(sg1).get();
+        destroy_scheduling_group(sg2).get();
+        destroy_scheduling_supergroup(batch).get();
+    });
+    BOOST_REQUIRE(batch.name() == "batch");
+    BOOST_REQUIRE_EQUAL(batch.get_shares(), 200);
+    BOOST_REQUIRE(sg1.get_supergroup() == batch);
+    BOOST_REQUIRE(default_scheduling_group().get_supergroup().is_root());
+    BOOST_REQUIRE_THROW(destroy_scheduling_supergroup(batch).get(), std::runtime_error);
+
+    // Both groups of the supergroup make progress
+    parallel_for_each(std::vector<scheduling_group>{sg1, sg2}, [] (scheduling_group sg) {
+        return async([sg] { burn_cpu(sg, 20ms); });
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_cpu_limit) {
+    auto batch = create_scheduling_supergroup("batch", 1000).get();
+    auto sg = create_scheduling_group("capped", "cap", 1000, batch).get();
+    auto cleanup = defer([&] () noexcept {
+        destroy_scheduling_group(sg).get();
+        destroy_scheduling_supergroup(batch).get();
+    });
+
+    BOOST_REQUIRE_EQUAL(sg.get_cpu_limit(), 1);
+    sg.set_cpu_limit(0.2);
+    BOOST_REQUIRE_CLOSE(sg.get_cpu_limit(), 0.2, 1);
+    // Without competition, a capped group still gets at most its limit
+    BOOST_REQUIRE_GE(burn_cpu(sg, 40ms), 120ms);
+    sg.set_cpu_limit(1);
+
+    batch.set_cpu_limit(0.2);
+    BOOST_REQUIRE_GE(burn_cpu(sg, 40ms), 120ms);
+    batch.set_cpu_limit(1);
+
+    BOOST_REQUIRE_LT(burn_cpu(sg, 40ms), 120ms);
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_latency_critical) {
+    auto crit = create_scheduling_group("critical", "crit", 1).get();
+    auto hog = create_scheduling_group("hog", 1000).get();
+    auto cleanup = defer([&] () noexcept {
+        destroy_scheduling_group(crit).get();
+        destroy_scheduling_group(hog).get();
+    });
+    BOOST_REQUIRE(!crit.is_latency_critical());
+    crit.set_latency_critical(100us, 0.25);
+    BOOST_REQUIRE(crit.is_latency_critical());
+
+    // The critical group runs ahead of the hog despite its single share,
+    // but only for its budget, so the hog isn't starved.
+    sched_clock::duration crit_time, hog_time;
+    when_all(
+        async([&] { crit_time = burn_cpu(crit, 40ms); }),
+        async([&] { hog_time = burn_cpu(hog, 40ms); })
+    ).get();
+    BOOST_REQUIRE_LT(hog_time, crit_time);
+
+    crit.clear_latency_critical();
+    BOOST_REQUIRE(!crit.is_latency_critical());
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_network_bandwidth_limit) {
+    auto sg = create_scheduling_group("streaming", "strm", 100).get();
+    auto cleanup = defer([&] () noexcept {
+        destroy_scheduling_group(sg).get();
+    });
+    auto ss = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)));
+    auto accepted = ss.accept();
+    auto client = seastar::connect(ss.local_address()).get();
+    auto server = accepted.get().connection;
+    auto in = server.input();
+    auto reader = async([&] {
+        uint64_t received = 0;
+        while (received < 200'000) {
+            auto buf = in.read().get();
+            BOOST_REQUIRE(buf.size());
+            received += buf.size();
+        }
+    });
+
+    // 200K at 1M/s takes 200ms, less the 10ms burst
+    sg.set_network_bandwidth_limit(1'000'000, 0);
+    auto before = sg.get_network_usage();
+    auto start = std::chrono::steady_clock::now();
+    with_scheduling_group(sg, [&] {
+        return async([&] {
+            auto out = client.output();
+            temporary_buffer<char> chunk(10'000);
+            for (int i = 0; i < 20; i++) {
+                out.write(chunk.get(), chunk.size()).get();
+                out.flush().get();
+            }
+            out.close().get();
+        });
+    }).get();
+    reader.get();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    auto usage = sg.get_network_usage();
+    BOOST_REQUIRE_EQUAL(usage.bytes_sent - before.bytes_sent, 200'000);
+    BOOST_REQUIRE_GE(usage.sends - before.sends, 20);
+    BOOST_REQUIRE(usage.send_throttled > before.send_throttled);
+    BOOST_REQUIRE_GE(elapsed, 150ms);
+    sg.set_network_bandwidth_limit(0, 0);
+    in.close().get();
+}
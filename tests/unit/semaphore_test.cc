@@ -30,6 +30,8 @@
 #include <seastar/core/loop.hh>
 #include <seastar/core/map_reduce.hh>
 #include <seastar/core/sleep.hh>
+#include <seastar/core/manual_clock.hh>
+#include <seastar/util/later.hh>
 #include <seastar/core/shared_mutex.hh>
 #include <boost/range/irange.hpp>
 
@@ -107,6 +109,48 @@ SEASTAR_THREAD_TEST_CASE(test_semaphore_timeout_2) {
     BOOST_REQUIRE_EQUAL(x, 0);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_semaphore_timeouts_share_deadline) {
+    auto sem = basic_semaphore<semaphore_default_exception_factory, manual_clock>(0);
+    auto& queue = internal::deadline_queue<manual_clock>::local();
+    auto deadline = manual_clock::now() + 1s;
+    std::vector<future<>> futs;
+    futs.push_back(sem.wait(deadline));
+    auto nr_deadlines = queue.deadlines();
+    for (int i = 1; i < 100; ++i) {
+        futs.push_back(sem.wait(deadline));
+    }
+    BOOST_REQUIRE_EQUAL(queue.deadlines(), nr_deadlines);
+
+    sem.signal(50);
+    for (int i = 0; i < 50; ++i) {
+        futs[i].get();
+    }
+    manual_clock::advance(1s);
+    yield().get();
+    for (int i = 50; i < 100; ++i) {
+        BOOST_CHECK_THROW(futs[i].get(), semaphore_timed_out);
+    }
+    BOOST_REQUIRE_EQUAL(sem.waiters(), 0);
+    BOOST_REQUIRE_EQUAL(sem.current(), 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_semaphore_granted_waits_release_deadlines) {
+    auto sem = basic_semaphore<semaphore_default_exception_factory, manual_clock>(0);
+    auto& queue = internal::deadline_queue<manual_clock>::local();
+    auto nr_deadlines = queue.deadlines();
+    std::vector<future<>> futs;
+    for (int i = 0; i < 100; ++i) {
+        futs.push_back(sem.wait(manual_clock::now() + std::chrono::seconds(i + 1)));
+    }
+    BOOST_REQUIRE_EQUAL(queue.deadlines(), nr_deadlines + 100);
+    // Granted waiters don't leave their deadline behind
+    sem.signal(100);
+    for (auto& f : futs) {
+        f.get();
+    }
+    BOOST_REQUIRE_EQUAL(queue.deadlines(), nr_deadlines);
+}
+
 SEASTAR_THREAD_TEST_CASE(test_semaphore_mix_1) {
     auto sem = semaphore(0);
     int x = 0;
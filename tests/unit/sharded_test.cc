@@ -21,7 +21,14 @@
 
 #include <seastar/testing/thread_test_case.hh>
 
+#include <seastar/core/service_graph.hh>
 #include <seastar/core/sharded.hh>
+#include <seastar/core/sharded_per_numa.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
 
 using namespace seastar;
 
@@ -201,3 +208,150 @@ SEASTAR_THREAD_TEST_CASE(invoke_on_all_sharded_arg) {
     srv.stop().get();
     arg.stop().get();
 }
+
+SEASTAR_THREAD_TEST_CASE(hierarchical_fan_out) {
+    size_t grouped = 0;
+    for (auto& group : smp::fan_out_groups()) {
+        BOOST_REQUIRE(!group.empty());
+        BOOST_REQUIRE_LE(group.size(), smp::max_fan_out_group_size);
+        grouped += group.size();
+    }
+    BOOST_REQUIRE_EQUAL(grouped, smp::count);
+
+    seastar::sharded<mydata> s;
+    s.start().get();
+    s.invoke_on_all_hierarchical([] (mydata& m) {
+        m.x = this_shard_id() + 1;
+        return make_ready_future<>();
+    }).get();
+    auto sum = s.map_reduce0_hierarchical([] (mydata& m) {
+        return m.x;
+    }, 10, std::plus<int>()).get();
+    BOOST_REQUIRE_EQUAL(sum, 10 + smp::count * (smp::count + 1) / 2);
+    s.stop().get();
+}
+
+namespace {
+
+struct per_node_data {
+    std::atomic<int> hits{0};
+    shard_id creator = this_shard_id();
+    future<> stop() {
+        BOOST_REQUIRE_EQUAL(this_shard_id(), creator);
+        return make_ready_future<>();
+    }
+};
+
+}
+
+SEASTAR_THREAD_TEST_CASE(sharded_per_numa_shares_node_instances) {
+    size_t nr_shards = 0;
+    for (auto& shards : smp::numa_node_shards()) {
+        BOOST_REQUIRE(!shards.empty());
+        for (auto s : shards) {
+            BOOST_REQUIRE_EQUAL(&smp::numa_node_shards()[smp::numa_node_of(s)], &shards);
+        }
+        nr_shards += shards.size();
+    }
+    BOOST_REQUIRE_EQUAL(nr_shards, smp::count);
+
+    sharded_per_numa<per_node_data> s;
+    s.start().get();
+    smp::invoke_on_all([&s] {
+        BOOST_REQUIRE(s.local_is_initialized());
+        auto node = smp::numa_node_of(this_shard_id());
+        BOOST_REQUIRE_EQUAL(s.local().creator, smp::numa_node_shards()[node].front());
+        return s.invoke_on_numa_local([] (per_node_data& d) {
+            d.hits.fetch_add(1, std::memory_order_relaxed);
+        });
+    }).get();
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> instances{0};
+    s.invoke_on_all([&] (per_node_data& d) {
+        BOOST_REQUIRE_EQUAL(this_shard_id(), d.creator);
+        hits += d.hits.load();
+        ++instances;
+    }).get();
+    BOOST_REQUIRE_EQUAL(hits.load(), smp::count);
+    BOOST_REQUIRE_EQUAL(instances.load(), smp::numa_node_shards().size());
+    s.stop().get();
+    BOOST_REQUIRE(!s.local_is_initialized());
+}
+
+SEASTAR_THREAD_TEST_CASE(service_graph_starts_independent_services_concurrently) {
+    std::vector<std::string> log;
+    promise<> b_started;
+    service_graph g;
+    // a can only finish starting once b started, so they must overlap
+    auto a = g.add([&] {
+        log.push_back("start a");
+        return b_started.get_future();
+    }, [&] {
+        log.push_back("stop a");
+        return make_ready_future<>();
+    });
+    auto b = g.add([&] {
+        log.push_back("start b");
+        b_started.set_value();
+        return make_ready_future<>();
+    }, [&] {
+        log.push_back("stop b");
+        return make_ready_future<>();
+    });
+    sharded<argument> args;
+    g.add(args, {a, b});
+    g.start().get();
+    BOOST_REQUIRE_EQUAL(log.size(), 2);
+    smp::invoke_on_all([&args] {
+        BOOST_REQUIRE_EQUAL(args.local().get(), this_shard_id());
+    }).get();
+
+    g.add([&] {
+        log.push_back("start c");
+        return make_ready_future<>();
+    }, [&] {
+        // args depends on both, and is stopped first
+        BOOST_REQUIRE(!args.local_is_initialized());
+        log.push_back("stop c");
+        return make_ready_future<>();
+    }, {a});
+    g.stop().get();
+    BOOST_REQUIRE(!args.local_is_initialized());
+    // c was never started, so isn't stopped either
+    BOOST_REQUIRE_EQUAL(log.size(), 4);
+    BOOST_REQUIRE(std::find(log.begin(), log.end(), "stop c") == log.end());
+
+    BOOST_REQUIRE_THROW(g.add([] { return make_ready_future<>(); }, [] { return make_ready_future<>(); }, {42}), std::invalid_argument);
+}
+
+SEASTAR_THREAD_TEST_CASE(service_graph_failed_start) {
+    std::vector<std::string> log;
+    auto add = [&] (service_graph& g, std::string name, bool fail, std::vector<service_graph::service_id> deps) {
+        return g.add([&log, name, fail] {
+            log.push_back("start " + name);
+            return fail ? make_exception_future<>(std::runtime_error(name)) : make_ready_future<>();
+        }, [&log, name] {
+            log.push_back("stop " + name);
+            return make_ready_future<>();
+        }, std::move(deps));
+    };
+    service_graph g;
+    auto a = add(g, "a", false, {});
+    auto b = add(g, "b", true, {a});
+    add(g, "c", false, {b});
+    add(g, "d", false, {a});
+    BOOST_REQUIRE_EXCEPTION(g.start().get(), std::runtime_error, [] (const std::runtime_error& e) {
+        return e.what() == std::string("b");
+    });
+    // c depends on the failed b, so never started
+    BOOST_REQUIRE(std::find(log.begin(), log.end(), "start c") == log.end());
+    auto pos = [&log] (const char* what) {
+        auto it = std::find(log.begin(), log.end(), what);
+        BOOST_REQUIRE(it != log.end());
+        return it - log.begin();
+    };
+    BOOST_REQUIRE_LT(pos("stop d"), pos("stop a"));
+    BOOST_REQUIRE_EQUAL(log.size(), 5);
+    g.stop().get();
+    BOOST_REQUIRE_EQUAL(log.size(), 5);
+}
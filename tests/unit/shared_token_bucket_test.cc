@@ -24,6 +24,9 @@
 #include <seastar/core/manual_clock.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/util/shared_token_bucket.hh>
+#include <seastar/util/defer.hh>
+#include <atomic>
+#include <thread>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -71,3 +74,52 @@ SEASTAR_TEST_CASE(test_basic_capped_loop) {
 
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(test_update_limit) {
+    internal::shared_token_bucket<uint64_t, std::ratio<1>, internal::capped_release::no, manual_clock> tb(1, 1, 0, false);
+
+    // A larger limit lets more tokens accumulate while nobody grabs them
+    tb.update_limit(4);
+    manual_clock::advance(10s);
+    tb.replenish(manual_clock::now());
+    auto th = tb.grab(4);
+    BOOST_REQUIRE(tb.deficiency(th) == 0);
+    th = tb.grab(1);
+    BOOST_REQUIRE(tb.deficiency(th) > 0);
+
+    // And a smaller one caps them again
+    tb.update_limit(1);
+    manual_clock::advance(10s);
+    tb.replenish(manual_clock::now());
+    BOOST_REQUIRE(tb.deficiency(th) == 0);
+    th = tb.grab(2);
+    BOOST_REQUIRE(tb.deficiency(th) > 0);
+
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_update_limit_while_replenishing) {
+    // The shard updating the limits of an I/O class races with the other
+    // shards replenishing and refunding, as with them on threads here
+    internal::shared_token_bucket<uint64_t, std::ratio<1>, internal::capped_release::no> tb(1000000, 1000, 1, false);
+    std::atomic<bool> stop = false;
+    std::thread updater([&] {
+        for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); i++) {
+            tb.update_limit(i % 2000);
+            tb.update_rate(1000000 + i % 1000);
+        }
+    });
+    auto join = defer([&] () noexcept {
+        stop.store(true, std::memory_order_relaxed);
+        updater.join();
+    });
+    for (int i = 0; i < 100000; i++) {
+        tb.replenish(std::chrono::steady_clock::now());
+        tb.refund(1);
+        // Never below the threshold
+        auto limit = tb.limit();
+        BOOST_REQUIRE(limit >= 1 && limit < 2000);
+    }
+
+    return make_ready_future<>();
+}
@@ -118,10 +118,84 @@ static void test_allocation_with_lru(const double growth_factor, const unsigned
     std::cout << __FUNCTION__ << " done!\n";
 }
 
+// Items used again since their insertion survive a scan of new ones
+static void test_segmented_lru(slab_eviction_policy policy) {
+    bi::list<item, bi::member_hook<item, bi::list_member_hook<>, &item::_cache_link>> _cache;
+    std::vector<item*> evicted;
+    const unsigned slab_limit_size = 1024*1024;
+    const size_t size = 1024;
+
+    slab_allocator<item> slab(1.25, slab_limit_size, max_object_size,
+        [&](item& item_ref) { _cache.erase(_cache.iterator_to(item_ref)); evicted.push_back(&item_ref); });
+    slab.set_eviction_policy(policy, [] (item& candidate, item& victim) { return false; });
+
+    std::vector<item*> hot;
+    for (;;) {
+        auto item = slab.create(size);
+        _cache.push_front(*item);
+        if (!evicted.empty()) {
+            break;
+        }
+        if (hot.size() < 100) {
+            hot.push_back(item);
+        }
+    }
+    for (auto item : hot) {
+        slab.touch(item);
+    }
+    for (auto i = 0u; i < 10000; i++) {
+        _cache.push_front(*slab.create(size));
+    }
+    for (auto item : hot) {
+        assert(std::find(evicted.begin(), evicted.end(), item) == evicted.end());
+    }
+
+    _cache.clear();
+    std::cout << __FUNCTION__ << " done!\n";
+}
+
+// A page of a class that holds no items moves to one that is evicting
+static void test_rebalance() {
+    bi::list<item, bi::member_hook<item, bi::list_member_hook<>, &item::_cache_link>> _cache;
+    unsigned evictions = 0;
+    const unsigned slab_limit_size = 3*1024*1024;
+
+    slab_allocator<item> slab(1.25, slab_limit_size, max_object_size,
+        [&](item& item_ref) { _cache.erase(_cache.iterator_to(item_ref)); evictions++; });
+    assert(!slab.rebalance());
+
+    const size_t idle_size = 1024;
+    auto idle_per_page = max_object_size / slab.class_size(idle_size);
+    std::vector<item*> idle;
+    for (auto i = 0u; i < 2 * idle_per_page; i++) {
+        idle.push_back(slab.create(idle_size));
+    }
+    free_vector<item>(slab, idle);
+
+    const size_t busy_size = 4096;
+    auto busy_per_page = max_object_size / slab.class_size(busy_size);
+    while (!evictions) {
+        _cache.push_front(*slab.create(busy_size));
+    }
+    assert(slab.rebalance());
+    assert(!slab.rebalance());
+    evictions = 0;
+    for (auto i = 0u; i < busy_per_page; i++) {
+        _cache.push_front(*slab.create(busy_size));
+    }
+    assert(evictions == 0);
+
+    _cache.clear();
+    std::cout << __FUNCTION__ << " done!\n";
+}
+
 int main(int ac, char** av) {
     test_allocation_1(1.25, 5*1024*1024);
     test_allocation_2(1.07, 5*1024*1024); // 1.07 is the growth factor used by facebook.
     test_allocation_with_lru(1.25, 5*1024*1024);
+    test_segmented_lru(slab_eviction_policy::segmented_lru);
+    test_segmented_lru(slab_eviction_policy::w_tinylfu);
+    test_rebalance();
 
     return 0;
 }
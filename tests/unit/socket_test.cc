@@ -33,6 +33,8 @@
 #include <seastar/core/when_all.hh>
 
 #include <seastar/net/posix-stack.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/util/tmp_file.hh>
 
 using namespace seastar;
 
@@ -224,3 +226,132 @@ SEASTAR_TEST_CASE(socket_on_close_local_shutdown_test) {
         when_all(std::move(client), std::move(server)).discard_result().get();
     });
 }
+
+SEASTAR_TEST_CASE(socket_zero_copy_output_test) {
+    return seastar::async([&] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12346), lo);
+
+        constexpr size_t chunk_size = 64 * 1024;
+        constexpr size_t nr_chunks = 64;
+
+        auto client = seastar::async([&] {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", 12346)).get();
+            auto out = cln.output(connected_socket_output_stream_config{.buffer_size = chunk_size, .zero_copy = true});
+            for (size_t i = 0; i < nr_chunks; i++) {
+                temporary_buffer<char> buf(chunk_size);
+                std::fill_n(buf.get_write(), chunk_size, char('a' + i % 26));
+                out.write(std::move(buf)).get();
+            }
+            out.flush().get();
+            // Waits for the kernel to release all the buffers
+            out.close().get();
+        });
+
+        accept_result acc = ss.accept().get();
+        auto in = acc.connection.input();
+        size_t received = 0;
+        while (auto buf = in.read().get()) {
+            for (size_t i = 0; i < buf.size(); i++) {
+                BOOST_REQUIRE_EQUAL(buf[i], char('a' + (received + i) / chunk_size % 26));
+            }
+            received += buf.size();
+        }
+        BOOST_REQUIRE_EQUAL(received, chunk_size * nr_chunks);
+        in.close().get();
+        client.get();
+    });
+}
+
+SEASTAR_TEST_CASE(socket_send_file_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        constexpr size_t size = 4 << 20;
+        constexpr uint64_t pos = 1000;
+        constexpr uint64_t len = 3 << 20;
+        auto pattern = [] (uint64_t i) { return char(i * 7 % 251); };
+
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto out = make_file_output_stream(f).get();
+        temporary_buffer<char> data(size);
+        for (size_t i = 0; i < size; i++) {
+            data.get_write()[i] = pattern(i);
+        }
+        out.write(data.get(), data.size()).get();
+        out.close().get();
+
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12348), lo);
+
+        auto client = seastar::async([&] {
+            connected_socket cln = connect(ipv4_addr("127.0.0.1", 12348)).get();
+            auto f = open_file_dma(filename, open_flags::ro).get();
+            BOOST_REQUIRE(cln.can_send_file(f));
+            // More than fits the socket buffers, so that sending waits for the reader
+            cln.send_file(f, pos, len).get();
+            f.close().get();
+            cln.shutdown_output();
+        });
+
+        accept_result acc = ss.accept().get();
+        auto in = acc.connection.input();
+        uint64_t received = 0;
+        while (auto buf = in.read().get()) {
+            for (size_t i = 0; i < buf.size(); i++) {
+                BOOST_REQUIRE_EQUAL(buf[i], pattern(pos + received + i));
+            }
+            received += buf.size();
+        }
+        BOOST_REQUIRE_EQUAL(received, len);
+        in.close().get();
+        client.get();
+    });
+}
+
+SEASTAR_TEST_CASE(socket_steering_test) {
+    return seastar::async([&] {
+        // Whether the kernel lets us steer or not, connections are accepted
+        uint16_t port = 12347;
+        for (auto lba : {server_socket::load_balancing_algorithm::incoming_cpu, server_socket::load_balancing_algorithm::least_connections}) {
+            listen_options lo;
+            lo.reuse_address = true;
+            lo.lba = lba;
+            server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", port), lo);
+            for (int i = 0; i < 4; i++) {
+                auto client = connect(ipv4_addr("127.0.0.1", port));
+                accept_result acc = ss.accept().get();
+                connected_socket cln = client.get();
+                auto out = cln.output();
+                out.write("ping").get();
+                out.close().get();
+                auto in = acc.connection.input();
+                auto buf = in.read().get();
+                BOOST_REQUIRE_EQUAL(std::string_view(buf.get(), buf.size()), "ping");
+            }
+            ss.abort_accept();
+            port++;
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(connect_any_test) {
+    return seastar::async([&] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 12349), lo);
+        // The first address refuses the connection, the next one is raced
+        // right away instead of after the attempt delay
+        connect_options co;
+        co.attempt_delay = std::chrono::seconds(10);
+        auto client = connect_any({ipv4_addr("127.0.0.1", 12350), ipv4_addr("127.0.0.1", 12349)}, co);
+        accept_result acc = ss.accept().get();
+        connected_socket cln = client.get();
+        BOOST_REQUIRE_EQUAL(cln.remote_address(), socket_address(ipv4_addr("127.0.0.1", 12349)));
+        ss.abort_accept();
+
+        BOOST_REQUIRE_THROW(connect_any({ipv4_addr("127.0.0.1", 12350), ipv4_addr("127.0.0.1", 12351)}).get(), std::system_error);
+        BOOST_REQUIRE_THROW(connect_any({}).get(), std::invalid_argument);
+    });
+}
@@ -19,6 +19,7 @@
 /*
  * Copyright (C) 2022 Kefu Chai ( tchaikov@gmail.com )
  */
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/testing/test_case.hh>
@@ -124,6 +125,22 @@ SEASTAR_TEST_CASE(test_spawn_input) {
     });
 }
 
+SEASTAR_TEST_CASE(test_spawn_splice_cout) {
+    const char* echo_cmd = "/bin/echo";
+    std::vector<sstring> argv{echo_cmd, sstring("-n"), sstring("hello"), sstring("world")};
+    auto p = co_await spawn_process(echo_cmd, {.argv = std::move(argv)});
+    auto out = file_desc::temporary("/tmp");
+    // splice_cout() closes the descriptor it's passed
+    auto check = out.dup();
+    auto moved = co_await p.splice_cout(std::move(out));
+    auto wstatus = co_await p.wait();
+    BOOST_REQUIRE(std::holds_alternative<process::wait_exited>(wstatus));
+    BOOST_REQUIRE_EQUAL(moved, 11);
+    std::array<char, 16> buf;
+    auto n = ::pread(check.get(), buf.data(), buf.size(), 0);
+    BOOST_REQUIRE_EQUAL(std::string_view(buf.data(), std::max<ssize_t>(n, 0)), "hello world");
+}
+
 SEASTAR_TEST_CASE(test_spawn_kill) {
     const char* sleep_cmd = "/bin/sleep";
     // sleep for 10s, but terminate it right away.
@@ -0,0 +1,117 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/net/srv_balancer.hh>
+#include <seastar/testing/test_case.hh>
+
+using namespace seastar;
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+socket_address addr(uint16_t port) {
+    return socket_address(ipv4_addr("127.0.0.1", port));
+}
+
+}
+
+SEASTAR_TEST_CASE(test_srv_balancer_priorities) {
+    srv_balancer b;
+    BOOST_REQUIRE_THROW(b.acquire(), std::runtime_error);
+    b.set_endpoints({{addr(3), 1, 10}, {addr(1), 0, 10}, {addr(2), 0, 0}});
+    BOOST_REQUIRE_EQUAL(b.size(), 3);
+    for (int i = 0; i < 100; i++) {
+        BOOST_REQUIRE_NE(b.acquire().address(), addr(3));
+    }
+    // Eject the endpoints of priority 0
+    for (auto port : {1, 2}) {
+        for (int i = 0; i < 3; i++) {
+            srv_balancer::lease l;
+            do {
+                l = b.acquire();
+            } while (l.address() != addr(port));
+            l.complete(false);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(b.acquire().address(), addr(3));
+    for (auto& s : b.get_stats()) {
+        BOOST_REQUIRE_EQUAL(s.ejected, s.priority == 0);
+    }
+    co_return;
+}
+
+SEASTAR_TEST_CASE(test_srv_balancer_latency) {
+    srv_balancer b;
+    b.set_endpoints({{addr(1), 0, 1}, {addr(2), 0, 1}});
+
+    // Without samples, outstanding leases spread evenly
+    std::vector<srv_balancer::lease> leases;
+    for (int i = 0; i < 10; i++) {
+        leases.push_back(b.acquire());
+    }
+    for (auto& s : b.get_stats()) {
+        BOOST_REQUIRE_EQUAL(s.outstanding, 5);
+    }
+
+    for (auto& l : leases) {
+        l.complete(true, l.address() == addr(1) ? 50ms : 1ms);
+    }
+    leases.clear();
+    for (int i = 0; i < 100; i++) {
+        BOOST_REQUIRE_EQUAL(b.acquire().address(), addr(2));
+    }
+
+    // Known endpoints keep their latency
+    b.set_endpoints({{addr(2), 0, 1}, {addr(1), 0, 1}, {addr(4), 0, 1}});
+    auto stats = b.get_stats();
+    BOOST_REQUIRE_EQUAL(stats.size(), 3);
+    BOOST_REQUIRE_EQUAL(stats[0].address, addr(2));
+    BOOST_REQUIRE_GT(stats[0].picks, 100);
+    BOOST_REQUIRE(stats[1].latency > stats[0].latency);
+    BOOST_REQUIRE_EQUAL(stats[2].picks, 0);
+    co_return;
+}
+
+SEASTAR_TEST_CASE(test_srv_balancer_with_endpoint) {
+    srv_balancer::config cfg;
+    cfg.max_failures = 1;
+    srv_balancer b(cfg);
+    b.set_endpoints({{addr(1), 0, 1}});
+    auto a = co_await b.with_endpoint([] (const socket_address& a) {
+        return make_ready_future<socket_address>(a);
+    });
+    BOOST_REQUIRE_EQUAL(a, addr(1));
+    BOOST_REQUIRE(!b.get_stats()[0].ejected);
+    auto f = b.with_endpoint([] (const socket_address&) {
+        return make_exception_future<>(std::runtime_error("failed"));
+    });
+    BOOST_REQUIRE_THROW(co_await std::move(f), std::runtime_error);
+    auto stats = b.get_stats();
+    BOOST_REQUIRE(stats[0].ejected);
+    BOOST_REQUIRE_EQUAL(stats[0].outstanding, 0);
+    BOOST_REQUIRE(stats[0].latency >= 1s);
+}
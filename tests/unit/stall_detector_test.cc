@@ -175,6 +175,19 @@ SEASTAR_THREAD_TEST_CASE(spin_in_kernel) {
     test_spin_with_body("kernel", [] { mmap_populate(128 * 1024); });
 }
 
+SEASTAR_THREAD_TEST_CASE(classify_stalls) {
+    using cause = internal::cpu_stall_detector::stall_cause;
+    using usage = internal::cpu_stall_detector::usage_snapshot;
+    auto classify = [] (usage end, sched_clock::duration wall) {
+        return internal::cpu_stall_detector::classify(usage{}, end, wall);
+    };
+    BOOST_REQUIRE(classify({.user = 90ms, .system = 10ms}, 100ms) == cause::user_code);
+    BOOST_REQUIRE(classify({.user = 10ms, .system = 90ms, .minor_faults = 1000}, 100ms) == cause::kernel);
+    BOOST_REQUIRE(classify({.user = 10ms, .system = 10ms, .major_faults = 3, .voluntary_switches = 3}, 100ms) == cause::page_faults);
+    BOOST_REQUIRE(classify({.user = 20ms, .involuntary_switches = 2, .runqueue_wait = 75ms}, 100ms) == cause::preemption);
+    BOOST_REQUIRE(classify({.user = 20ms, .voluntary_switches = 1}, 100ms) == cause::blocking);
+}
+
 
 #else
 
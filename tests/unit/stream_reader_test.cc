@@ -27,7 +27,9 @@
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/http/request.hh>
 #include <seastar/util/short_streams.hh>
+#include <seastar/util/later.hh>
 #include <string>
+#include <vector>
 
 using namespace seastar;
 using namespace util;
@@ -109,3 +111,94 @@ SEASTAR_TEST_CASE(test_skip_all) {
         BOOST_REQUIRE(to_sstring(empty_inp.read().get()).empty());
     });
 }
+
+// Data source returning the given buffers, in order
+class chunks_source_impl : public data_source_impl {
+    std::vector<std::string> _chunks;
+    size_t _next = 0;
+public:
+    explicit chunks_source_impl(std::vector<std::string> chunks) : _chunks(std::move(chunks)) {}
+    virtual future<temporary_buffer<char>> get() override {
+        if (_next == _chunks.size()) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        auto& c = _chunks[_next++];
+        return make_ready_future<temporary_buffer<char>>(temporary_buffer<char>(c.data(), c.size()));
+    }
+};
+
+static input_stream<char> make_chunks_stream(std::vector<std::string> chunks) {
+    return input_stream<char>(data_source(std::make_unique<chunks_source_impl>(std::move(chunks))));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_consume_lines) {
+    auto in = make_chunks_stream({"first\r\nsec", "ond", "\n\nth", "ird\r", "\nlast"});
+    std::vector<std::string> lines;
+    in.consume_lines([&] (temporary_buffer<char> line) {
+        lines.emplace_back(line.get(), line.size());
+        return stop_iteration::no;
+    }).get();
+    BOOST_REQUIRE(lines == (std::vector<std::string>{"first", "second", "", "third", "last"}));
+    BOOST_REQUIRE(in.eof());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_consume_until_stops) {
+    auto in = make_chunks_stream({"a,bb,", "ccc,rest", "more"});
+    std::vector<std::string> pieces;
+    in.consume_until(',', [&] (temporary_buffer<char> piece) {
+        pieces.emplace_back(piece.get(), piece.size());
+        // Deliver asynchronously too
+        return yield().then([&] {
+            return stop_iteration(pieces.size() == 3);
+        });
+    }).get();
+    BOOST_REQUIRE(pieces == (std::vector<std::string>{"a", "bb", "ccc"}));
+    // The rest stays in the stream
+    auto rest = read_entire_stream_contiguous(in).get();
+    BOOST_REQUIRE_EQUAL(rest, "restmore");
+
+    auto too_long = make_chunks_stream({"abcd", "efgh", ",x"});
+    BOOST_REQUIRE_THROW(too_long.consume_until(',', [] (temporary_buffer<char>) {
+        return stop_iteration::no;
+    }, 6).get(), std::length_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_release_idle_buffer) {
+    // Data source of buffers which count their frees
+    class counting_source_impl : public data_source_impl {
+        std::vector<std::string> _chunks;
+        size_t _next = 0;
+        size_t& _freed;
+    public:
+        counting_source_impl(std::vector<std::string> chunks, size_t& freed) : _chunks(std::move(chunks)), _freed(freed) {}
+        virtual future<temporary_buffer<char>> get() override {
+            if (_next == _chunks.size()) {
+                return make_ready_future<temporary_buffer<char>>();
+            }
+            auto& c = _chunks[_next++];
+            return make_ready_future<temporary_buffer<char>>(temporary_buffer<char>(c.data(), c.size(), make_deleter([this] { ++_freed; })));
+        }
+    };
+    size_t freed = 0;
+    input_stream<char> in(data_source(std::make_unique<counting_source_impl>(std::vector<std::string>{"abc", "def"}, freed)));
+    BOOST_REQUIRE(in.release_idle_buffer());
+
+    // Consumes n bytes, like a parser stopping at the end of a message does
+    auto consume = [&in] (size_t n) {
+        in.consume([n] (temporary_buffer<char> buf) {
+            buf.trim_front(n);
+            return make_ready_future<consumption_result<char>>(stop_consuming<char>(std::move(buf)));
+        }).get();
+    };
+    consume(3);
+    // The stream holds on to the consumed buffer
+    BOOST_REQUIRE_EQUAL(freed, 0);
+    BOOST_REQUIRE(in.release_idle_buffer());
+    BOOST_REQUIRE_EQUAL(freed, 1);
+
+    consume(1);
+    BOOST_REQUIRE(!in.release_idle_buffer());
+    BOOST_REQUIRE_EQUAL(freed, 1);
+    auto b = in.read_exactly(2).get();
+    BOOST_REQUIRE_EQUAL(std::string(b.get(), b.size()), "ef");
+}
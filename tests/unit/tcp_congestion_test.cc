@@ -0,0 +1,104 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/net/tcp-congestion.hh>
+#include <chrono>
+#include <thread>
+
+using namespace seastar;
+using namespace seastar::net;
+
+BOOST_AUTO_TEST_CASE(test_congestion_control_names) {
+    for (auto name : {"reno", "cubic", "bbr"}) {
+        BOOST_REQUIRE_EQUAL(make_tcp_congestion_control(name)->name(), name);
+    }
+    BOOST_REQUIRE_THROW(make_tcp_congestion_control("vegas"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(test_reno) {
+    auto cc = make_tcp_congestion_control("reno");
+    tcp_congestion_window w{4 * 1000, 8 * 1000, 1000};
+    cc->init(w);
+    // Slow start grows by at most one segment per ACK
+    cc->cong_avoid(w, 3000);
+    BOOST_REQUIRE_EQUAL(w.cwnd, 5000);
+    // Congestion avoidance grows by about a segment per window
+    w.cwnd = 10000;
+    cc->cong_avoid(w, 1000);
+    BOOST_REQUIRE_EQUAL(w.cwnd, 10100);
+    BOOST_REQUIRE_EQUAL(cc->ssthresh(w, 10000), 5000);
+    BOOST_REQUIRE_EQUAL(cc->ssthresh(w, 1000), 2000);
+}
+
+BOOST_AUTO_TEST_CASE(test_cubic) {
+    auto cc = make_tcp_congestion_control("cubic");
+    tcp_congestion_window w{100 * 1000, 50 * 1000, 1000};
+    cc->init(w);
+    // Multiplicative decrease by beta = 0.7
+    w.ssthresh = cc->ssthresh(w, w.cwnd);
+    BOOST_REQUIRE_EQUAL(w.ssthresh, 70 * 1000);
+    w.cwnd = w.ssthresh;
+    // Right after the reduction, the window is far from the cubic plateau
+    // and grows, but by less than half of the acked bytes
+    cc->rtt_sample(std::chrono::milliseconds(100));
+    cc->cong_avoid(w, 1000);
+    BOOST_REQUIRE_GE(w.cwnd, 70 * 1000);
+    BOOST_REQUIRE_LE(w.cwnd, 70 * 1000 + 500);
+}
+
+BOOST_AUTO_TEST_CASE(test_bbr) {
+    auto cc = make_tcp_congestion_control("bbr");
+    tcp_congestion_window w{10 * 1000, 20 * 1000, 1000};
+    cc->init(w);
+    // Until it has a model, BBR grows like slow start, regardless of ssthresh
+    cc->cong_avoid(w, 4000);
+    BOOST_REQUIRE_EQUAL(w.cwnd, 14 * 1000);
+    // Losses don't shrink the window
+    BOOST_REQUIRE_EQUAL(cc->ssthresh(w, w.cwnd), w.cwnd);
+    // The window never gets below four segments
+    cc->rtt_sample(std::chrono::milliseconds(10));
+    w.cwnd = 1000;
+    cc->cong_avoid(w, 1000);
+    BOOST_REQUIRE_GE(w.cwnd, 4 * 1000);
+}
+
+BOOST_AUTO_TEST_CASE(test_bbr_sub_millisecond_rtt) {
+    auto cc = make_tcp_congestion_control("bbr");
+    tcp_congestion_window w{10 * 1000, 20 * 1000, 1000};
+    lowres_clock::update();
+    cc->init(w);
+    // A LAN round trip, which rounds to zero milliseconds
+    cc->rtt_sample(std::chrono::microseconds(200));
+    // Rounds last at least 10ms, each delivers 10MB, so the bandwidth is
+    // at least a few hundred MB/s and the BDP tens of kB
+    for (int round = 0; round < 10; round++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(11));
+        lowres_clock::update();
+        cc->cong_avoid(w, 10 * 1000 * 1000);
+    }
+    // Out of startup, the window follows the model rather than the acks,
+    // and isn't stuck at the four segments floor
+    BOOST_REQUIRE_LT(w.cwnd, 10 * 1000 * 1000);
+    BOOST_REQUIRE_GT(w.cwnd, 4 * w.mss);
+}
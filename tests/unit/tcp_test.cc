@@ -0,0 +1,640 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/net/ip.hh>
+#include <seastar/net/tcp.hh>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace seastar;
+using namespace seastar::net;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Just enough of the IPv4 layer for tcp<> to run on, with the segments it
+// sends kept for the test to look at
+
+struct fake_netif {
+    std::optional<unsigned> previous_flow_owner(uint32_t) { return std::nullopt; }
+    rss_key_type rss_key() const { return default_rsskey_40bytes; }
+    unsigned hash2cpu(uint32_t) { return this_shard_id(); }
+    uint16_t hw_queues_count() { return 1; }
+    std::unique_ptr<flow_steering_rule> steer_flow(const flow_tuple&) { return nullptr; }
+    bool packet_timestamps() const noexcept { return false; }
+    void account_rx_latency(const packet&) {}
+    void register_flow_census(flow_census_type) {}
+};
+
+struct fake_ipv4 {
+    fake_netif _netif;
+    net::hw_features _hw;
+    fake_ipv4() {
+        _hw.rx_csum_offload = true;
+        _hw.tx_csum_l4_offload = true;
+    }
+    fake_netif* netif() { return &_netif; }
+    const net::hw_features& hw_features() const { return _hw; }
+    bool sw_tso() const { return false; }
+    ipv4_address source_address(ipv4_address) { return ipv4_address("10.0.0.1"); }
+    void forward_tcp(unsigned, packet, ipv4_address, ipv4_address) {}
+};
+
+struct fake_l4 {
+    fake_ipv4& _inet;
+    ipv4_traits::packet_provider_type _provider;
+    void register_packet_provider(ipv4_traits::packet_provider_type func) {
+        _provider = std::move(func);
+    }
+    future<ethernet_address> get_l2_dst_address(ipv4_address) {
+        return make_ready_future<ethernet_address>();
+    }
+};
+
+struct fake_traits : ipv4_traits {
+    using inet_type = fake_l4;
+};
+
+using fake_tcp = tcp<fake_traits>;
+
+const ipv4_address local_ip("10.0.0.1");
+const ipv4_address peer_ip("10.0.0.2");
+constexpr uint16_t local_port = 80;
+
+struct segment {
+    tcp_hdr h;
+    size_t data_len;
+    // SACK blocks, as relative sequence numbers would make no sense here
+    std::vector<std::pair<uint32_t, uint32_t>> sack;
+};
+
+// Options of a SYN offering an MSS, and SACK if asked to
+std::string syn_options(uint16_t mss, bool sack) {
+    std::string opts(sack ? 8 : 4, char(tcp_option::option_kind::nop));
+    tcp_option::mss{mss}.write(opts.data());
+    if (sack) {
+        tcp_option::sack().write(opts.data() + 6);
+    }
+    return opts;
+}
+
+// Options carrying SACK blocks, padded with NOPs
+std::string sack_options(std::vector<std::pair<net::tcp_seq, net::tcp_seq>> blocks) {
+    tcp_option::sack_blocks sack;
+    for (auto& [left, right] : blocks) {
+        sack.blocks[sack.nr_blocks++] = {left.raw, right.raw};
+    }
+    std::string opts(2, char(tcp_option::option_kind::nop));
+    opts.resize(2 + sack.size());
+    sack.write(opts.data() + 2);
+    return opts;
+}
+
+struct harness {
+    fake_ipv4 ip;
+    fake_l4 l4{ip};
+    fake_tcp tcp{l4};
+
+    void receive(uint16_t peer_port, net::tcp_seq seq, net::tcp_seq ack, bool syn, bool with_ack, std::optional<uint16_t> mss = {}) {
+        receive_segment(peer_port, seq, ack, mss ? syn_options(*mss, false) : "", 0, syn, with_ack);
+    }
+
+    // Options are padded to a multiple of 4 bytes by the caller
+    void receive_segment(uint16_t peer_port, net::tcp_seq seq, net::tcp_seq ack, std::string_view options, size_t data_len,
+            bool syn = false, bool with_ack = true) {
+        uint8_t hdr_len = tcp_hdr::len + options.size();
+        auto p = data_len ? packet(std::string(data_len, 'd').data(), data_len) : packet();
+        auto th = p.prepend_uninitialized_header(hdr_len);
+        auto h = tcp_hdr{};
+        h.src_port = peer_port;
+        h.dst_port = local_port;
+        h.seq = seq;
+        h.ack = ack;
+        h.f_syn = syn;
+        h.f_ack = with_ack;
+        h.window = 65535;
+        h.data_offset = hdr_len / 4;
+        h.checksum = 0;
+        h.write(th);
+        std::copy(options.begin(), options.end(), th + tcp_hdr::len);
+        tcp.received(std::move(p), peer_ip, local_ip);
+    }
+
+    // Segments sent to peer_port since the last call
+    std::vector<segment> sent(uint16_t peer_port) {
+        // Let the continuations queueing the segments run
+        thread::yield();
+        std::vector<segment> ret;
+        while (auto l4p = l4._provider()) {
+            auto& p = l4p->p;
+            auto h = tcp_hdr::read(p.get_header(0, tcp_hdr::len));
+            if (h.dst_port == peer_port) {
+                ret.push_back(segment{h, p.len() - h.data_offset * 4, parse_sack(p, h)});
+            }
+        }
+        return ret;
+    }
+
+    static std::vector<std::pair<uint32_t, uint32_t>> parse_sack(packet& p, const tcp_hdr& h) {
+        std::vector<std::pair<uint32_t, uint32_t>> ret;
+        auto opts = p.get_header(0, h.data_offset * 4);
+        for (size_t off = tcp_hdr::len; off < size_t(h.data_offset * 4);) {
+            auto kind = tcp_option::option_kind(opts[off]);
+            if (kind == tcp_option::option_kind::nop) {
+                off++;
+                continue;
+            }
+            if (kind == tcp_option::option_kind::eol) {
+                break;
+            }
+            if (kind == tcp_option::option_kind::sack_blocks) {
+                auto sack = tcp_option::sack_blocks::read(opts + off);
+                ret.assign(sack.blocks.begin(), sack.blocks.begin() + sack.nr_blocks);
+            }
+            off += uint8_t(opts[off + 1]);
+        }
+        return ret;
+    }
+
+    // Completes the handshake of a connection from peer_port which
+    // negotiated SACK, returns it and the ISN we chose
+    std::pair<fake_tcp::connection, net::tcp_seq> accept_sack_connection(fake_tcp::listener& l, uint16_t peer_port, net::tcp_seq isn, uint16_t mss) {
+        receive_segment(peer_port, isn, make_seq(0), syn_options(mss, true), 0, true, false);
+        auto synack = sent(peer_port);
+        BOOST_REQUIRE_EQUAL(synack.size(), 1);
+        BOOST_REQUIRE(synack.front().h.f_syn);
+        auto our_isn = synack.front().h.seq;
+        receive_segment(peer_port, isn + 1, our_isn + 1, "", 0);
+        return {l.accept().get(), our_isn};
+    }
+
+    // Overflows the backlog of a listener taking a single connection,
+    // with a SYN that is kept as a half-open connection
+    fake_tcp::listener overflowing_listener() {
+        auto l = tcp.listen(local_port, 1);
+        receive(2000, make_seq(1000), make_seq(0), true, false, 1460);
+        BOOST_REQUIRE(l.full());
+        return l;
+    }
+};
+
+// Sends the SYN of a handshake the backlog has no room for, returns the
+// cookie of the <SYN,ACK>
+net::tcp_seq cookie_handshake(harness& h, uint16_t peer_port, net::tcp_seq isn, uint16_t mss) {
+    h.receive(peer_port, isn, make_seq(0), true, false, mss);
+    auto sent = h.sent(peer_port);
+    BOOST_REQUIRE_EQUAL(sent.size(), 1);
+    auto& synack = sent.front().h;
+    BOOST_REQUIRE(synack.f_syn);
+    BOOST_REQUIRE(synack.f_ack);
+    BOOST_REQUIRE(!synack.f_rst);
+    BOOST_REQUIRE(synack.ack == isn + 1);
+    return synack.seq;
+}
+
+// The IPv4 layer of the native stack on a fake device, for the software
+// GRO and TSO which sit below tcp<>
+
+const ethernet_address local_mac{0x02, 0, 0, 0, 0, 0x01};
+const ethernet_address peer_mac{0x02, 0, 0, 0, 0, 0x02};
+
+constexpr uint8_t f_fin = 0x01, f_psh = 0x08, f_ack = 0x10;
+
+// A device queue which keeps the packets the stack sends
+class fake_qp : public qp {
+public:
+    std::vector<packet> sent;
+    virtual future<> send(packet p) override {
+        sent.push_back(std::move(p));
+        return make_ready_future<>();
+    }
+};
+
+// A device without any offload, so that the checksums are all computed
+// and verified in software
+class fake_device : public device {
+    std::unique_ptr<fake_qp> _qp = std::make_unique<fake_qp>();
+public:
+    fake_device() {
+        _queues[this_shard_id()] = _qp.get();
+    }
+    virtual ethernet_address hw_address() override { return local_mac; }
+    virtual net::hw_features hw_features() override { return {}; }
+    virtual std::unique_ptr<qp> init_local_queue(const program_options::option_group&, uint16_t) override { return nullptr; }
+    fake_qp& queue() { return *_qp; }
+};
+
+// Takes the place of the TCP layer, keeping the segments handed to it
+struct fake_tcp_layer : ip_protocol {
+    std::vector<packet> segments;
+    virtual void received(packet p, ipv4_address, ipv4_address) override {
+        segments.push_back(std::move(p));
+    }
+};
+
+struct tcp_segment {
+    tcp_hdr h;
+    uint8_t flags;
+    std::string data;
+};
+
+std::string flatten(const packet& p) {
+    std::string b;
+    for (auto& f : p.fragments()) {
+        b.append(f.base, f.size);
+    }
+    return b;
+}
+
+tcp_segment parse_segment(std::string_view b) {
+    BOOST_REQUIRE_GE(b.size(), tcp_hdr::len);
+    auto h = tcp_hdr::read(b.data());
+    return tcp_segment{h, uint8_t(b[13]), std::string(b.substr(h.data_offset * 4))};
+}
+
+// Sums to zero over a segment carrying a valid checksum
+uint16_t tcp_checksum(ipv4_address src, ipv4_address dst, std::string_view segment) {
+    checksummer csum;
+    ipv4_traits::tcp_pseudo_header_checksum(csum, src, dst, segment.size());
+    csum.sum(segment.data(), segment.size());
+    return csum.get();
+}
+
+struct ip_harness {
+    std::shared_ptr<fake_device> dev = std::make_shared<fake_device>();
+    interface netif{dev};
+    ipv4 ip{&netif};
+    fake_tcp_layer tcp;
+
+    ip_harness() {
+        ip.set_host_address(local_ip);
+        ip.set_netmask_address(ipv4_address("255.255.255.0"));
+        ip.register_l4(uint8_t(ip_protocol_num::tcp), &tcp);
+        ip.set_sw_gro(true);
+    }
+
+    // Receives a segment of len bytes of c from peer_port at seq. The
+    // segments received in a row are handled as being of one poll.
+    void receive(uint16_t peer_port, uint32_t seq, size_t len, char c, uint8_t flags = f_ack, uint32_t ack = 1) {
+        auto h = tcp_hdr{};
+        h.src_port = peer_port;
+        h.dst_port = local_port;
+        h.seq = make_seq(seq);
+        h.ack = make_seq(ack);
+        h.data_offset = tcp_hdr::len / 4;
+        h.window = 65535;
+        h.checksum = 0;
+        std::string l4(tcp_hdr::len, '\0');
+        h.write(l4.data());
+        l4[13] = char(flags);
+        l4.append(len, c);
+        auto csum = tcp_checksum(peer_ip, local_ip, l4);
+        std::memcpy(&l4[16], &csum, sizeof(csum));
+
+        auto iph = ip_hdr{};
+        iph.ihl = sizeof(iph) / 4;
+        iph.ver = 4;
+        iph.len = sizeof(iph) + l4.size();
+        iph.ttl = 64;
+        iph.ip_proto = uint8_t(ip_protocol_num::tcp);
+        iph.src_ip = peer_ip;
+        iph.dst_ip = local_ip;
+        iph = hton(iph);
+        checksummer ip_csum;
+        ip_csum.sum(reinterpret_cast<char*>(&iph), sizeof(iph));
+        iph.csum = ip_csum.get();
+
+        auto eh = hton(eth_hdr{local_mac, peer_mac, uint16_t(eth_protocol_num::ipv4)});
+        std::string b(reinterpret_cast<const char*>(&eh), sizeof(eh));
+        b.append(reinterpret_cast<const char*>(&iph), sizeof(iph));
+        b.append(l4);
+        dev->l2receive(packet(b.data(), b.size()));
+    }
+
+    // Segments handed to the TCP layer since the last call, once the
+    // ones held by GRO were flushed
+    std::vector<tcp_segment> delivered() {
+        thread::yield();
+        std::vector<tcp_segment> ret;
+        for (auto& p : std::exchange(tcp.segments, {})) {
+            ret.push_back(parse_segment(flatten(p)));
+        }
+        return ret;
+    }
+
+    // TCP segments sent since the last call, with their IPv4 header
+    std::vector<std::pair<ip_hdr, std::string>> sent() {
+        // Lets the transmit poller run
+        sleep(1ms).get();
+        std::vector<std::pair<ip_hdr, std::string>> ret;
+        for (auto& p : std::exchange(dev->queue().sent, {})) {
+            auto b = flatten(p);
+            BOOST_REQUIRE_GE(b.size(), sizeof(eth_hdr) + sizeof(ip_hdr));
+            ip_hdr iph;
+            std::memcpy(&iph, b.data() + sizeof(eth_hdr), sizeof(iph));
+            checksummer csum;
+            csum.sum(reinterpret_cast<char*>(&iph), sizeof(iph));
+            BOOST_REQUIRE_EQUAL(csum.get(), 0);
+            iph = ntoh(iph);
+            auto l4 = b.substr(sizeof(eth_hdr) + sizeof(ip_hdr));
+            BOOST_REQUIRE_EQUAL(uint16_t(iph.len), sizeof(ip_hdr) + l4.size());
+            BOOST_REQUIRE_EQUAL(iph.ip_proto, uint8_t(ip_protocol_num::tcp));
+            ret.emplace_back(iph, std::move(l4));
+        }
+        return ret;
+    }
+};
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_syn_cookie_on_backlog_overflow) {
+    harness h;
+    auto l = h.overflowing_listener();
+    cookie_handshake(h, 3000, make_seq(5000), 1400);
+    // No state was kept for it: the backlog holds the first SYN only
+    BOOST_REQUIRE(l.full());
+    BOOST_REQUIRE(!l.accept_queue_full());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_syn_cookie_creates_connection) {
+    harness h;
+    auto l = h.overflowing_listener();
+    auto isn = make_seq(5000);
+    auto cookie = cookie_handshake(h, 3000, isn, 1400);
+
+    h.receive(3000, isn + 1, cookie + 1, false, true);
+    BOOST_REQUIRE(l.accept_queue_full());
+    auto conn = l.accept().get();
+    BOOST_REQUIRE_EQUAL(conn.foreign_port(), 3000);
+
+    // Segments are sized from the MSS the cookie encoded
+    (void)h.sent(3000);
+    conn.send(packet(temporary_buffer<char>(4096))).get();
+    auto sent = h.sent(3000);
+    BOOST_REQUIRE(!sent.empty());
+    BOOST_REQUIRE(sent.front().h.seq == cookie + 1);
+    BOOST_REQUIRE_EQUAL(sent.front().data_len, 1400);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_syn_cookie_forged_ack_dropped) {
+    harness h;
+    auto l = h.overflowing_listener();
+    auto isn = make_seq(5000);
+    auto cookie = cookie_handshake(h, 3000, isn, 1400);
+
+    // A corrupted cookie, a cookie of another connection, and an ACK of
+    // another sequence number than the one the cookie was made for
+    h.receive(3000, isn + 1, cookie + 2, false, true);
+    h.receive(3001, isn + 1, cookie + 1, false, true);
+    h.receive(3000, isn + 2, cookie + 1, false, true);
+    BOOST_REQUIRE(h.sent(3000).empty());
+    BOOST_REQUIRE(h.sent(3001).empty());
+    BOOST_REQUIRE(!l.accept_queue_full());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_ack_without_overflow_reset) {
+    harness h;
+    auto l = h.tcp.listen(local_port, 1);
+    // Without a recent overflow, ACKs aren't checked for cookies
+    h.receive(3000, make_seq(5001), make_seq(1234), false, true);
+    auto sent = h.sent(3000);
+    BOOST_REQUIRE_EQUAL(sent.size(), 1);
+    BOOST_REQUIRE(sent.front().h.f_rst);
+    BOOST_REQUIRE(!l.accept_queue_full());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sack_blocks_reported) {
+    using blocks = std::vector<std::pair<uint32_t, uint32_t>>;
+    harness h;
+    auto l = h.tcp.listen(local_port);
+    auto isn = make_seq(5000);
+    auto accepted = h.accept_sack_connection(l, 3000, isn, 1000);
+    auto data = isn + 1;
+    auto ack = accepted.second + 1;
+
+    // Receives len bytes at off from the start of the data, and returns the
+    // SACK blocks of the immediate ACK, relative to the start of the data
+    auto receive = [&] (uint32_t off, size_t len) {
+        h.receive_segment(3000, data + off, ack, "", len);
+        auto sent = h.sent(3000);
+        BOOST_REQUIRE_EQUAL(sent.size(), 1);
+        BOOST_REQUIRE(sent.front().h.ack == data);
+        blocks ret;
+        for (auto& [left, right] : sent.front().sack) {
+            ret.emplace_back(left - data.raw, right - data.raw);
+        }
+        return ret;
+    };
+
+    // A hole before the data
+    BOOST_REQUIRE(receive(1000, 1000) == blocks({{1000, 2000}}));
+    // The block of the most recent segment comes first
+    BOOST_REQUIRE(receive(3000, 1000) == blocks({{3000, 4000}, {1000, 2000}}));
+    // Overlapping data extends a block
+    BOOST_REQUIRE(receive(1500, 1000) == blocks({{1000, 2500}, {3000, 4000}}));
+    BOOST_REQUIRE(receive(500, 200) == blocks({{500, 700}, {1000, 2500}, {3000, 4000}}));
+    // At most 4 blocks are reported, the most recent one included
+    for (uint32_t off = 5000; off < 9000; off += 1000) {
+        receive(off, 500);
+    }
+    BOOST_REQUIRE(receive(10000, 500) == blocks({{10000, 10500}, {500, 700}, {1000, 2500}, {3000, 4000}}));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sack_retransmits_holes) {
+    using blocks = std::vector<std::pair<net::tcp_seq, net::tcp_seq>>;
+    constexpr size_t total = 12000;
+    harness h;
+    auto l = h.tcp.listen(local_port);
+    auto isn = make_seq(5000);
+    auto accepted = h.accept_sack_connection(l, 3000, isn, 1000);
+    auto& conn = accepted.first;
+    auto peer_seq = isn + 1;
+    auto end = accepted.second + 1 + total;
+    conn.send(packet(temporary_buffer<char>(total))).get();
+
+    // Acknowledges the segments one by one for the window to open, until
+    // all the data is in flight
+    std::vector<segment> flight;
+    auto collect = [&] {
+        for (auto& seg : h.sent(3000)) {
+            if (seg.data_len) {
+                flight.push_back(seg);
+            }
+        }
+    };
+    collect();
+    auto una = accepted.second + 1;
+    while (!flight.empty() && !(flight.back().h.seq + flight.back().data_len == end)) {
+        una = flight.front().h.seq + flight.front().data_len;
+        flight.erase(flight.begin());
+        h.receive_segment(3000, peer_seq, una, "", 0);
+        collect();
+    }
+    // Enough for the segments above the second hole to make it lost
+    BOOST_REQUIRE_GE(flight.size(), 7);
+    for (size_t i = 0; i < flight.size(); i++) {
+        BOOST_REQUIRE_EQUAL(flight[i].data_len, 1000);
+    }
+
+    // Segments 0 and 3 are lost, duplicate ACKs report the others. Returns
+    // the sequence numbers of the segments retransmitted in response.
+    auto seq = [&] (size_t i) { return flight[i].h.seq; };
+    auto dupack = [&] (blocks b) {
+        h.receive_segment(3000, peer_seq, una, sack_options(std::move(b)), 0);
+        std::vector<uint32_t> ret;
+        for (auto& seg : h.sent(3000)) {
+            if (seg.data_len) {
+                ret.push_back(seg.h.seq.raw);
+            }
+        }
+        return ret;
+    };
+    // Blocks beyond the data sent are ignored
+    BOOST_REQUIRE(dupack({{seq(1), seq(3)}, {end, end + 1000}}).empty());
+    BOOST_REQUIRE(dupack({{seq(4), end}, {seq(1), seq(2) + 500}}).empty());
+    // Out of order and overlapping blocks, which cover segments 1 and 2
+    // together. The third duplicate ACK retransmits the first hole.
+    blocks all = {{seq(4), end}, {seq(1), seq(2) + 500}, {seq(2), seq(3)}};
+    BOOST_REQUIRE(dupack(all) == std::vector<uint32_t>({seq(0).raw}));
+    // The next ones the other hole, there is enough SACKed data above it
+    BOOST_REQUIRE(dupack(all) == std::vector<uint32_t>({seq(3).raw}));
+    // And SACKed data is never retransmitted
+    BOOST_REQUIRE(dupack(all).empty());
+    BOOST_REQUIRE(dupack(all).empty());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_gro_merges_in_order_segments) {
+    ip_harness h;
+    h.receive(3000, 1000, 100, 'a');
+    h.receive(3000, 1100, 100, 'b');
+    h.receive(3000, 1200, 100, 'c');
+    auto d = h.delivered();
+    BOOST_REQUIRE_EQUAL(d.size(), 1);
+    BOOST_REQUIRE_EQUAL(d[0].h.seq.raw, 1000);
+    BOOST_REQUIRE_EQUAL(d[0].flags, f_ack);
+    BOOST_REQUIRE_EQUAL(d[0].data, std::string(100, 'a') + std::string(100, 'b') + std::string(100, 'c'));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_gro_keeps_flows_and_gaps_apart) {
+    ip_harness h;
+    h.receive(3000, 1000, 100, 'a');
+    h.receive(3001, 5000, 100, 'x');
+    // A gap, which delivers what the flow held
+    h.receive(3000, 1200, 100, 'b');
+    h.receive(3001, 5100, 100, 'y');
+    // An in-order segment acknowledging other data
+    h.receive(3000, 1300, 100, 'c', f_ack, 2);
+    // And one which isn't a plain data segment
+    h.receive(3001, 5200, 100, 'z', f_ack | 0x20);
+    auto d = h.delivered();
+    BOOST_REQUIRE_EQUAL(d.size(), 5);
+    BOOST_REQUIRE_EQUAL(d[0].h.src_port, 3000);
+    BOOST_REQUIRE_EQUAL(d[0].h.seq.raw, 1000);
+    BOOST_REQUIRE_EQUAL(d[0].data, std::string(100, 'a'));
+    BOOST_REQUIRE_EQUAL(d[1].h.src_port, 3000);
+    BOOST_REQUIRE_EQUAL(d[1].h.seq.raw, 1200);
+    BOOST_REQUIRE_EQUAL(d[1].data, std::string(100, 'b'));
+    BOOST_REQUIRE_EQUAL(d[2].h.src_port, 3001);
+    BOOST_REQUIRE_EQUAL(d[2].h.seq.raw, 5000);
+    BOOST_REQUIRE_EQUAL(d[2].data, std::string(100, 'x') + std::string(100, 'y'));
+    BOOST_REQUIRE_EQUAL(d[3].h.src_port, 3001);
+    BOOST_REQUIRE_EQUAL(d[3].h.seq.raw, 5200);
+    BOOST_REQUIRE_EQUAL(d[3].data, std::string(100, 'z'));
+    BOOST_REQUIRE_EQUAL(d[4].h.src_port, 3000);
+    BOOST_REQUIRE_EQUAL(d[4].h.seq.raw, 1300);
+    BOOST_REQUIRE_EQUAL(d[4].h.ack.raw, 2);
+    BOOST_REQUIRE_EQUAL(d[4].data, std::string(100, 'c'));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_gro_flushes_on_psh_and_fin) {
+    ip_harness h;
+    // PSH ends a merged segment, which carries it
+    h.receive(3000, 1000, 100, 'a');
+    h.receive(3000, 1100, 100, 'b', f_ack | f_psh);
+    h.receive(3000, 1200, 100, 'c');
+    // FIN segments aren't merged, but come after the data held before them
+    h.receive(3000, 1300, 100, 'd', f_ack | f_fin);
+    auto d = h.delivered();
+    BOOST_REQUIRE_EQUAL(d.size(), 3);
+    BOOST_REQUIRE_EQUAL(d[0].h.seq.raw, 1000);
+    BOOST_REQUIRE_EQUAL(d[0].flags, f_ack | f_psh);
+    BOOST_REQUIRE_EQUAL(d[0].data, std::string(100, 'a') + std::string(100, 'b'));
+    BOOST_REQUIRE_EQUAL(d[1].h.seq.raw, 1200);
+    BOOST_REQUIRE_EQUAL(d[1].flags, f_ack);
+    BOOST_REQUIRE_EQUAL(d[1].data, std::string(100, 'c'));
+    BOOST_REQUIRE_EQUAL(d[2].h.seq.raw, 1300);
+    BOOST_REQUIRE_EQUAL(d[2].flags, f_ack | f_fin);
+    BOOST_REQUIRE_EQUAL(d[2].data, std::string(100, 'd'));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_software_tso_segments) {
+    constexpr unsigned mss = 1000;
+    ip_harness h;
+    std::string data;
+    for (unsigned i = 0; i < 2500; i++) {
+        data.push_back(char('a' + i % 26));
+    }
+    auto th = tcp_hdr{};
+    th.src_port = local_port;
+    th.dst_port = 3000;
+    th.seq = make_seq(1000);
+    th.ack = make_seq(1);
+    th.data_offset = tcp_hdr::len / 4;
+    th.window = 65535;
+    th.checksum = 0;
+    std::string l4(tcp_hdr::len, '\0');
+    th.write(l4.data());
+    l4[13] = char(f_ack | f_psh | f_fin);
+    l4 += data;
+    packet p(l4.data(), l4.size());
+    auto oi = p.get_offload_info();
+    oi.protocol = ip_protocol_num::tcp;
+    oi.tcp_hdr_len = tcp_hdr::len;
+    oi.tso_seg_size = mss;
+    p.set_offload_info(oi);
+    h.ip.send(peer_ip, ip_protocol_num::tcp, std::move(p), peer_mac);
+
+    auto sent = h.sent();
+    BOOST_REQUIRE_EQUAL(sent.size(), 3);
+    for (unsigned i = 0; i < sent.size(); i++) {
+        auto& [iph, seg] = sent[i];
+        BOOST_REQUIRE_EQUAL(iph.src_ip, local_ip);
+        BOOST_REQUIRE_EQUAL(iph.dst_ip, peer_ip);
+        BOOST_REQUIRE_EQUAL(tcp_checksum(local_ip, peer_ip, seg), 0);
+        auto s = parse_segment(seg);
+        BOOST_REQUIRE_EQUAL(s.h.seq.raw, 1000 + i * mss);
+        BOOST_REQUIRE_EQUAL(s.h.ack.raw, 1);
+        BOOST_REQUIRE_EQUAL(s.h.src_port, local_port);
+        BOOST_REQUIRE_EQUAL(s.h.dst_port, 3000);
+        // PSH and FIN go with the last segment only
+        BOOST_REQUIRE_EQUAL(s.flags, i + 1 < sent.size() ? f_ack : f_ack | f_psh | f_fin);
+        BOOST_REQUIRE_EQUAL(s.data, data.substr(i * mss, mss));
+    }
+}
@@ -29,6 +29,7 @@
 #include <seastar/core/do_with.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/sleep.hh>
+#include <seastar/util/backtrace.hh>
 #include <sys/mman.h>
 #include <signal.h>
 
@@ -103,6 +104,49 @@ SEASTAR_TEST_CASE(test_thread_async_nested) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_thread_stacks_are_recycled) {
+    thread_attributes attr;
+    // A size no other test uses, so that the pool has no other stack of it
+    attr.stack_size = 40 * 1024;
+    auto stack_of = [] {
+        return reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    };
+    auto first = async(attr, stack_of).get();
+    auto second = async(attr, stack_of).get();
+    BOOST_REQUIRE_EQUAL(first, second);
+
+    // A thread still running keeps its stack
+    promise<> pr;
+    auto running = async(attr, [&] {
+        auto frame = stack_of();
+        pr.get_future().get();
+        return frame;
+    });
+    auto third = async(attr, stack_of).get();
+    BOOST_REQUIRE_NE(third, first);
+    pr.set_value();
+    // Same stack as the first thread
+    auto frame = running.get();
+    BOOST_REQUIRE_LT(frame > first ? frame - first : first - frame, attr.stack_size);
+}
+
+SEASTAR_TEST_CASE(test_fast_backtrace) {
+    // Frame pointers are only walked within the stack the code runs on
+    auto check = [] {
+        auto stack = thread_impl::current_stack();
+        auto fp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+        BOOST_REQUIRE_LE(stack.low, fp);
+        BOOST_REQUIRE_LT(fp, stack.high);
+        size_t count = 0;
+        fast_backtrace([&count] (frame) { ++count; });
+#ifndef SEASTAR_BACKTRACE_UNIMPLEMENTED
+        BOOST_REQUIRE_GT(count, 0);
+#endif
+    };
+    check();
+    return async(check);
+}
+
 void compute(float& result, bool& done, uint64_t& ctr) {
     while (!done) {
         for (int n = 0; n < 10000; ++n) {
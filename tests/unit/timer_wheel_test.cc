@@ -0,0 +1,170 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB Ltd.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <seastar/core/timer-wheel.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct test_timer;
+using test_clock = std::chrono::steady_clock;
+
+struct test_timer {
+    using clock = test_clock;
+    using time_point = test_clock::time_point;
+    using duration = test_clock::duration;
+
+    boost::intrusive::list_member_hook<> link;
+    uint16_t slot = 0;
+    time_point timeout;
+    int id = 0;
+    timer_wheel<test_timer, &test_timer::link, &test_timer::slot>* wheel = nullptr;
+
+    time_point get_timeout() const noexcept {
+        return timeout;
+    }
+    void cancel() noexcept {
+        wheel->remove(*this);
+    }
+};
+
+using wheel_type = timer_wheel<test_timer, &test_timer::link, &test_timer::slot>;
+
+test_clock::time_point at(test_clock::duration d) {
+    return test_clock::time_point(d);
+}
+
+std::set<int> expire(wheel_type& w, test_clock::time_point now) {
+    std::set<int> ids;
+    auto list = w.expire(now);
+    while (!list.empty()) {
+        ids.insert(list.front().id);
+        list.pop_front();
+    }
+    return ids;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_timeouts_are_rounded_up_to_the_resolution) {
+    wheel_type w(10ms);
+    test_timer t1{.timeout = at(15ms), .id = 1, .wheel = &w};
+    test_timer t2{.timeout = at(30ms), .id = 2, .wheel = &w};
+    BOOST_REQUIRE(w.insert(t2));
+    BOOST_REQUIRE(w.insert(t1));
+    BOOST_REQUIRE(w.get_next_timeout() == at(20ms));
+    BOOST_REQUIRE(expire(w, at(19ms)).empty());
+    BOOST_REQUIRE(expire(w, at(20ms)) == std::set<int>({1}));
+    BOOST_REQUIRE_EQUAL(w.size(), 1);
+    BOOST_REQUIRE(expire(w, at(35ms)) == std::set<int>({2}));
+    BOOST_REQUIRE(w.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_removed_timers_do_not_expire) {
+    wheel_type w(1ms);
+    std::vector<test_timer> timers(100);
+    for (int i = 0; i < 100; i++) {
+        timers[i].timeout = at(std::chrono::milliseconds(i * 1000 + 1));
+        timers[i].id = i;
+        timers[i].wheel = &w;
+        w.insert(timers[i]);
+    }
+    for (int i = 0; i < 100; i += 2) {
+        w.remove(timers[i]);
+    }
+    auto expired = expire(w, at(1000s));
+    BOOST_REQUIRE_EQUAL(expired.size(), 50);
+    for (auto id : expired) {
+        BOOST_REQUIRE_EQUAL(id % 2, 1);
+    }
+    BOOST_REQUIRE(w.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_timers_beyond_the_last_level) {
+    // With a resolution of 1ns the levels cover less than 70 seconds
+    wheel_type w(1ns);
+    test_timer near{.timeout = at(1s), .id = 1, .wheel = &w};
+    test_timer far{.timeout = at(24h), .id = 2, .wheel = &w};
+    w.insert(far);
+    w.insert(near);
+    BOOST_REQUIRE(expire(w, at(1s)) == std::set<int>({1}));
+    BOOST_REQUIRE(expire(w, at(24h - 1ns)).empty());
+    BOOST_REQUIRE(expire(w, at(24h)) == std::set<int>({2}));
+}
+
+BOOST_AUTO_TEST_CASE(test_set_resolution_keeps_timers) {
+    wheel_type w;
+    test_timer t{.timeout = at(5ms), .id = 1, .wheel = &w};
+    w.insert(t);
+    w.set_resolution(2ms);
+    BOOST_REQUIRE(w.resolution() == 2ms);
+    BOOST_REQUIRE_EQUAL(w.size(), 1);
+    BOOST_REQUIRE(expire(w, at(5ms)).empty());
+    BOOST_REQUIRE(expire(w, at(6ms)) == std::set<int>({1}));
+}
+
+BOOST_AUTO_TEST_CASE(test_random_timers_expire_on_time) {
+    constexpr auto resolution = 1ms;
+    wheel_type w(resolution);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int64_t> timeout_dist(0, 10'000'000);
+    std::uniform_int_distribution<int64_t> step_dist(0, 50'000);
+
+    std::vector<test_timer> timers(10'000);
+    std::set<int> active;
+    auto now = at(0ms);
+    for (int i = 0; i < int(timers.size()); i++) {
+        timers[i].timeout = now + std::chrono::microseconds(timeout_dist(rng));
+        timers[i].id = i;
+        timers[i].wheel = &w;
+        w.insert(timers[i]);
+        active.insert(i);
+        if (i % 3 == 0) {
+            w.remove(timers[i / 2]);
+            active.erase(i / 2);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(w.size(), active.size());
+
+    while (!active.empty()) {
+        now += std::chrono::microseconds(step_dist(rng));
+        auto expired = expire(w, now);
+        for (auto id : expired) {
+            BOOST_REQUIRE(active.erase(id));
+            BOOST_REQUIRE(timers[id].timeout <= now);
+        }
+        for (auto id : active) {
+            // Not expired, so not due a whole tick ago
+            BOOST_REQUIRE(timers[id].timeout > now - resolution);
+        }
+        BOOST_REQUIRE_EQUAL(w.size(), active.size());
+    }
+}
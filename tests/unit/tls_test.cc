@@ -21,11 +21,13 @@
  */
 
 #include <iostream>
+#include <set>
 
 #include <seastar/core/do_with.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/metrics_api.hh>
 #include <seastar/core/sharded.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/gate.hh>
@@ -33,6 +35,7 @@
 #include <seastar/core/iostream.hh>
 #include <seastar/core/with_timeout.hh>
 #include <seastar/util/std-compat.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/util/process.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/net/dns.hh>
@@ -1594,3 +1597,360 @@ SEASTAR_THREAD_TEST_CASE(test_tls13_session_tickets) {
     }
 
 }
+
+SEASTAR_THREAD_TEST_CASE(test_kernel_tls_offload) {
+    tls::credentials_builder b;
+
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+
+    auto serv = b.build_server_credentials();
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+
+    auto addr = ::make_ipv4_address({0x7f000001, 4712});
+    auto server = tls::listen(serv, addr, opts);
+
+    for (auto prio : { "SECURE128:-VERS-TLS-ALL:+VERS-TLS1.2", "SECURE128:-VERS-TLS-ALL:+VERS-TLS1.3" }) {
+        b.set_priority_string(prio);
+        auto creds = b.build_certificate_credentials();
+
+        auto sa = server.accept();
+        // The kernel may not support offloading, in which case the session
+        // must keep working in userspace
+        auto c = tls::connect(creds, addr, tls::tls_options{.wait_for_eof_on_shutdown = false, .kernel_tls_offload = true}).get();
+        auto s = sa.get();
+
+        auto in = s.connection.input();
+        auto cin = c.input();
+        output_stream<char> out(c.output().detach(), 1024);
+        output_stream<char> sout(s.connection.output().detach(), 1024);
+
+        auto offloaded = tls::check_kernel_tls_offload(c);
+        for (int i = 0; i < 10; i++) {
+            auto msg = fmt::format("message {} over {}", i, prio);
+            out.write(msg).get();
+            auto fout = out.flush();
+            auto buf = in.read_exactly(msg.size()).get();
+            fout.get();
+            BOOST_REQUIRE_EQUAL(sstring(buf.begin(), buf.end()), msg);
+
+            sout.write(msg).get();
+            fout = sout.flush();
+            buf = cin.read_exactly(msg.size()).get();
+            fout.get();
+            BOOST_REQUIRE_EQUAL(sstring(buf.begin(), buf.end()), msg);
+        }
+        BOOST_TEST_MESSAGE(fmt::format("{}: kernel offload {}", prio, offloaded.get()));
+
+        out.close().get();
+        s.connection.shutdown_input();
+        s.connection.shutdown_output();
+        c.shutdown_input();
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shared_session_resume) {
+    tls::credentials_builder b;
+
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+    b.set_session_resume_mode(tls::session_resume_mode::TLS13_SESSION_TICKET);
+    b.set_priority_string("SECURE128:+SECURE192:-VERS-TLS-ALL:+VERS-TLS1.3");
+
+    auto creds = b.build_certificate_credentials();
+    // Each with its own ticket key, as the credentials of different shards
+    auto serv1 = b.build_server_credentials();
+    auto serv2 = b.build_server_credentials();
+
+    sharded<tls::session_resume_manager> resume;
+    resume.start(tls::session_resume_manager::config{}).get();
+    auto stop_resume = defer([&resume] () noexcept { resume.stop().get(); });
+    resume.local().attach(*serv1);
+    resume.local().attach(*serv2);
+    resume.invoke_on(0, &tls::session_resume_manager::start).get();
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+
+    auto addr1 = ::make_ipv4_address({0x7f000001, 4712});
+    auto addr2 = ::make_ipv4_address({0x7f000001, 4713});
+    auto server1 = tls::listen(serv1, addr1, opts);
+    auto server2 = tls::listen(serv2, addr2, opts);
+
+    auto exchange = [] (connected_socket& c, connected_socket& s) {
+        auto in = s.input();
+        auto cin = c.input();
+        output_stream<char> out(c.output().detach(), 1024);
+        output_stream<char> sout(s.output().detach(), 1024);
+
+        // Data in both directions makes the ticket reach the client
+        out.write("nils").get();
+        auto fin = in.read();
+        out.flush().get();
+        fin.get();
+        sout.write("banan").get();
+        fin = cin.read();
+        sout.flush().get();
+        fin.get();
+    };
+
+    tls::session_data sess_data;
+    {
+        auto sa = server1.accept();
+        auto c = tls::connect(creds, addr1).get();
+        auto s = sa.get();
+        exchange(c, s.connection);
+        BOOST_REQUIRE(!tls::check_session_is_resumed(c).get());
+        sess_data = tls::get_session_resume_data(c).get();
+        BOOST_REQUIRE(!sess_data.empty());
+        s.connection.shutdown_input();
+        s.connection.shutdown_output();
+        c.shutdown_input();
+        c.shutdown_output();
+    }
+    {
+        // The ticket issued by the first server is good for the second one
+        auto sa = server2.accept();
+        auto c = tls::connect(creds, addr2, tls::tls_options{.session_resume_data = sess_data}).get();
+        auto s = sa.get();
+        exchange(c, s.connection);
+        BOOST_REQUIRE(tls::check_session_is_resumed(c).get());
+        s.connection.shutdown_input();
+        s.connection.shutdown_output();
+        c.shutdown_input();
+        c.shutdown_output();
+    }
+
+    // Rotating the key invalidates the tickets issued before
+    resume.local().rotate_key().get();
+    {
+        auto sa = server2.accept();
+        auto c = tls::connect(creds, addr2, tls::tls_options{.session_resume_data = sess_data}).get();
+        auto s = sa.get();
+        exchange(c, s.connection);
+        BOOST_REQUIRE(!tls::check_session_is_resumed(c).get());
+        s.connection.shutdown_input();
+        s.connection.shutdown_output();
+        c.shutdown_input();
+        c.shutdown_output();
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_coalesced_writes_and_record_ramp_up) {
+    tls::credentials_builder b;
+
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+
+    auto creds = b.build_certificate_credentials();
+    auto serv = b.build_server_credentials();
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+
+    auto addr = ::make_ipv4_address({0x7f000001, 4712});
+    auto server = tls::listen(serv, addr, opts);
+
+    std::vector<tls::tls_options> variants = {
+        { .coalesce_writes = true },
+        { .initial_record_size = 100, .record_ramp_up_bytes = 10000 },
+        { .coalesce_writes = true, .initial_record_size = 100, .record_ramp_up_bytes = 10000 },
+    };
+    for (auto& o : variants) {
+        auto sa = server.accept();
+        auto c = tls::connect(creds, addr, o).get();
+        auto s = sa.get();
+
+        auto in = s.connection.input();
+        auto sink = c.output().detach();
+
+        // Small writes, a large one spanning several records and small ones again
+        sstring expected;
+        auto put = [&] (sstring data) {
+            expected += data;
+            sink.put(temporary_buffer<char>(data.data(), data.size())).get();
+        };
+        for (int i = 0; i < 100; i++) {
+            put(fmt::format("small write {}\n", i));
+        }
+        put(sstring(100000, 'x'));
+        for (int i = 0; i < 10; i++) {
+            put(fmt::format("and another {}\n", i));
+        }
+        auto f = sink.flush();
+        auto buf = in.read_exactly(expected.size()).get();
+        f.get();
+        BOOST_REQUIRE_EQUAL(sstring(buf.begin(), buf.end()), expected);
+
+        sink.close().get();
+        s.connection.shutdown_input();
+        s.connection.shutdown_output();
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_handshake_scheduling) {
+    auto sg = create_scheduling_group("tls_handshakes", 100).get();
+    auto destroy_sg = defer([sg] () noexcept { destroy_scheduling_group(sg).get(); });
+
+    tls::credentials_builder b;
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+
+    auto serv = b.build_server_credentials();
+    b.set_handshake_scheduling(tls::handshake_scheduling{ .group = sg, .max_concurrency = 1, .name = "test" });
+    auto creds = b.build_certificate_credentials();
+
+    // Called from the handshake's certificate verification
+    unsigned handshakes = 0;
+    creds->set_dn_verification_callback([&] (tls::session_type, sstring, sstring) {
+        BOOST_REQUIRE(current_scheduling_group() == sg);
+        handshakes++;
+    });
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+
+    auto addr = ::make_ipv4_address({0x7f000001, 4712});
+    auto server = tls::listen(serv, addr, opts);
+
+    for (int i = 0; i < 3; i++) {
+        auto sa = server.accept();
+        auto c = tls::connect(creds, addr).get();
+        auto s = sa.get();
+
+        auto in = s.connection.input();
+        output_stream<char> out(c.output().detach(), 1024);
+        out.write("apa").get();
+        auto f = out.flush();
+        auto buf = in.read().get();
+        f.get();
+        BOOST_REQUIRE_EQUAL(sstring(buf.begin(), buf.end()), "apa");
+        // The writer itself stays in its own group
+        BOOST_REQUIRE(current_scheduling_group() != sg);
+
+        out.close().get();
+        s.connection.shutdown_input();
+        s.connection.shutdown_output();
+    }
+    BOOST_REQUIRE_EQUAL(handshakes, 3);
+}
+
+// The "instance" labels of the handshake metrics of the credentials named name
+static std::set<sstring> handshake_metric_instances(const sstring& name) {
+    std::set<sstring> ret;
+    auto values = metrics::impl::get_values();
+    for (auto& md : *values->metadata) {
+        if (md.mf.name != "tls_handshakes") {
+            continue;
+        }
+        for (auto& mi : md.metrics) {
+            auto& labels = mi.id.labels();
+            auto it = labels.find("name");
+            if (it != labels.end() && it->second == name) {
+                ret.insert(labels.at("instance"));
+            }
+        }
+    }
+    return ret;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_handshake_scheduling_metric_instances) {
+    auto hs = tls::handshake_scheduling{ .name = "instances" };
+    auto c1 = ::make_shared<tls::certificate_credentials>();
+    auto c2 = ::make_shared<tls::certificate_credentials>();
+    c1->set_handshake_scheduling(hs);
+    c2->set_handshake_scheduling(hs);
+    BOOST_REQUIRE(handshake_metric_instances("instances") == std::set<sstring>({"0", "1"}));
+
+    // Scheduling anew keeps the instance
+    c1->set_handshake_scheduling(hs);
+    BOOST_REQUIRE(handshake_metric_instances("instances") == std::set<sstring>({"0", "1"}));
+
+    // The instances of freed credentials are reused
+    c1 = nullptr;
+    BOOST_REQUIRE(handshake_metric_instances("instances") == std::set<sstring>({"1"}));
+    auto c3 = ::make_shared<tls::certificate_credentials>();
+    c3->set_handshake_scheduling(hs);
+    BOOST_REQUIRE(handshake_metric_instances("instances") == std::set<sstring>({"0", "1"}));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_x509_key_url) {
+    tls::credentials_builder b;
+    // Only the certificate is read, the key is looked up when building
+    b.set_x509_key_url_file(certfile("test.crt"), "nosuchscheme:object=key", tls::x509_crt_format::PEM).get();
+    BOOST_REQUIRE_THROW(b.build_certificate_credentials(), std::invalid_argument);
+
+    tls::certificate_credentials creds;
+    BOOST_REQUIRE_THROW(creds.set_x509_key_url(tls::blob("not a certificate"), "pkcs11:object=key", tls::x509_crt_format::PEM), std::exception);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_verification_cache) {
+    tls::credentials_builder b;
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+    b.set_dh_level();
+    b.set_client_auth(tls::client_auth::REQUIRE);
+
+    auto creds = b.build_certificate_credentials();
+    auto cache = std::make_shared<tls::verification_cache>(tls::verification_cache::config{});
+    b.set_verification_cache(cache);
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+    auto addr = ::make_ipv4_address({0x7f000001, 4712});
+
+    auto echo = [&] (shared_ptr<tls::server_credentials> serv, int connections) {
+        auto server = tls::listen(serv, addr, opts);
+        for (int i = 0; i < connections; i++) {
+            auto sa = server.accept();
+            auto c = tls::connect(creds, addr, tls::tls_options{ .server_name = "test.scylladb.org" }).get();
+            auto s = sa.get();
+
+            auto in = s.connection.input();
+            output_stream<char> out(c.output().detach(), 1024);
+            out.write("apa").get();
+            auto f = out.flush();
+            // The server verified the client once it reads
+            auto buf = in.read().get();
+            f.get();
+            BOOST_REQUIRE_EQUAL(sstring(buf.begin(), buf.end()), "apa");
+
+            out.close().get();
+            s.connection.shutdown_input();
+            s.connection.shutdown_output();
+        }
+    };
+
+    unsigned callbacks = 0;
+    auto serv = b.build_server_credentials();
+    serv->set_dn_verification_callback([&] (tls::session_type, sstring, sstring) {
+        callbacks++;
+    });
+    echo(serv, 3);
+    BOOST_REQUIRE_EQUAL(cache->misses(), 1);
+    BOOST_REQUIRE_EQUAL(cache->hits(), 2);
+    BOOST_REQUIRE_EQUAL(cache->size(), 1);
+    // Still called for cached verifications
+    BOOST_REQUIRE_EQUAL(callbacks, 3);
+
+    // Credentials set up alike share the entries
+    echo(b.build_server_credentials(), 1);
+    BOOST_REQUIRE_EQUAL(cache->misses(), 1);
+    BOOST_REQUIRE_EQUAL(cache->hits(), 3);
+
+    // Other trust doesn't
+    b.set_x509_trust_file(certfile("tls-ca-bundle.pem"), tls::x509_crt_format::PEM).get();
+    echo(b.build_server_credentials(), 1);
+    BOOST_REQUIRE_EQUAL(cache->misses(), 2);
+    BOOST_REQUIRE_EQUAL(cache->size(), 2);
+
+    cache->clear();
+    BOOST_REQUIRE_EQUAL(cache->size(), 0);
+}
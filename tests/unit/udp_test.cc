@@ -0,0 +1,192 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2026 ScyllaDB Ltd.
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/inet_address.hh>
+#include <seastar/core/reactor.hh>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace seastar;
+
+constexpr size_t segment_size = 100;
+constexpr size_t nr_segments = 10;
+
+static void send_segments(net::datagram_channel& cc, const net::datagram_channel& sc) {
+    std::string data;
+    for (size_t i = 0; i < nr_segments; i++) {
+        data.append(segment_size, char('a' + i));
+    }
+    cc.send_segmented(sc.local_address(), net::packet(data.data(), data.size()), segment_size).get();
+}
+
+// Checks the segments of a received datagram, counting them in received
+static void check_segments(net::datagram& dgram, const net::datagram_channel& cc, size_t& received) {
+    BOOST_REQUIRE_EQUAL(dgram.get_src(), cc.local_address());
+    for (auto& frag : dgram.get_data().fragments()) {
+        BOOST_REQUIRE_EQUAL(frag.size, segment_size);
+        BOOST_REQUIRE_EQUAL(std::string(frag.base, frag.size), std::string(segment_size, char('a' + received)));
+        received++;
+    }
+}
+
+// Payloads tell the channel a datagram was sent for, and its index
+static std::string payload(size_t channel, size_t i) {
+    return std::string(1, char('0' + channel)) + ":" + std::to_string(i);
+}
+
+static std::string contents(net::datagram& dgram) {
+    std::string ret;
+    for (auto& frag : dgram.get_data().fragments()) {
+        ret.append(frag.base, frag.size);
+    }
+    return ret;
+}
+
+static void test_segmented(socket_address addr, bool gro) {
+    auto sc = make_bound_datagram_channel(addr);
+    auto cc = make_bound_datagram_channel(addr);
+    // Segments are received one by one when coalescing is not available
+    sc.set_gro(gro);
+    send_segments(cc, sc);
+
+    size_t received = 0;
+    while (received < nr_segments) {
+        for (auto& dgram : sc.receive_batch().get()) {
+            check_segments(dgram, cc, received);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(received, nr_segments);
+
+    cc.close();
+    sc.close();
+}
+
+SEASTAR_THREAD_TEST_CASE(udp_segmented_test) {
+    test_segmented(ipv4_addr{"127.0.0.1"}, true);
+}
+
+SEASTAR_THREAD_TEST_CASE(udp_segmented_no_gro_test) {
+    test_segmented(ipv4_addr{"127.0.0.1"}, false);
+}
+
+SEASTAR_THREAD_TEST_CASE(udp_segmented_repeated_receive_test) {
+    auto sc = make_bound_datagram_channel(ipv4_addr{"127.0.0.1"});
+    auto cc = make_bound_datagram_channel(ipv4_addr{"127.0.0.1"});
+    sc.set_gro(true);
+
+    // The receive context is reused, each receive gets the whole control
+    // buffer again for the coalesced segment size
+    for (int round = 0; round < 3; round++) {
+        send_segments(cc, sc);
+        size_t received = 0;
+        while (received < nr_segments) {
+            auto dgram = sc.receive().get();
+            check_segments(dgram, cc, received);
+        }
+        BOOST_REQUIRE_EQUAL(received, nr_segments);
+    }
+
+    cc.close();
+    sc.close();
+}
+
+SEASTAR_THREAD_TEST_CASE(udp_segmented_ipv6_test) {
+    if (!engine().net().supports_ipv6()) {
+        BOOST_TEST_WARN(0, "Skipping this test because IPv6 is not supported");
+        return;
+    }
+    test_segmented(ipv6_addr{"::1"}, true);
+}
+
+SEASTAR_THREAD_TEST_CASE(udp_batch_test) {
+    constexpr size_t nr_senders = 3, per_sender = 100;
+    auto sc = make_bound_datagram_channel(ipv4_addr{"127.0.0.1"});
+    std::vector<net::datagram_channel> senders;
+    for (size_t s = 0; s < nr_senders; s++) {
+        senders.push_back(make_bound_datagram_channel(ipv4_addr{"127.0.0.1"}));
+        std::vector<net::outgoing_datagram> batch;
+        for (size_t i = 0; i < per_sender; i++) {
+            auto data = payload(s, i);
+            batch.push_back(net::outgoing_datagram{sc.local_address(), net::packet(data.data(), data.size())});
+        }
+        senders.back().send_batch(std::move(batch)).get();
+    }
+
+    // All of them wait to be received, more than a batch holds
+    std::vector<size_t> next(nr_senders);
+    size_t received = 0, largest_batch = 0;
+    while (received < nr_senders * per_sender) {
+        auto batch = sc.receive_batch(1000).get();
+        largest_batch = std::max(largest_batch, batch.size());
+        for (auto& dgram : batch) {
+            auto data = contents(dgram);
+            size_t s = data[0] - '0';
+            BOOST_REQUIRE_LT(s, nr_senders);
+            // Each with the address of its own sender
+            BOOST_REQUIRE_EQUAL(dgram.get_src(), senders[s].local_address());
+            BOOST_REQUIRE_EQUAL(data, payload(s, next[s]++));
+            received++;
+        }
+    }
+    BOOST_REQUIRE_EQUAL(largest_batch, 64);
+    BOOST_REQUIRE_EQUAL(received, nr_senders * per_sender);
+
+    for (auto& c : senders) {
+        c.close();
+    }
+    sc.close();
+}
+
+SEASTAR_THREAD_TEST_CASE(udp_batch_partial_send_test) {
+    // More datagrams than a single sendmmsg() takes (UIO_MAXIOV), spread
+    // over enough receivers for their buffers to hold them all
+    constexpr size_t nr_receivers = 16, per_receiver = 100;
+    auto cc = make_bound_datagram_channel(ipv4_addr{"127.0.0.1"});
+    std::vector<net::datagram_channel> receivers;
+    for (size_t r = 0; r < nr_receivers; r++) {
+        receivers.push_back(make_bound_datagram_channel(ipv4_addr{"127.0.0.1"}));
+    }
+    std::vector<net::outgoing_datagram> batch;
+    for (size_t i = 0; i < per_receiver; i++) {
+        for (size_t r = 0; r < nr_receivers; r++) {
+            auto data = payload(r, i);
+            batch.push_back(net::outgoing_datagram{receivers[r].local_address(), net::packet(data.data(), data.size())});
+        }
+    }
+    cc.send_batch(std::move(batch)).get();
+
+    for (size_t r = 0; r < nr_receivers; r++) {
+        size_t received = 0;
+        while (received < per_receiver) {
+            for (auto& dgram : receivers[r].receive_batch().get()) {
+                BOOST_REQUIRE_EQUAL(dgram.get_src(), cc.local_address());
+                BOOST_REQUIRE_EQUAL(contents(dgram), payload(r, received));
+                received++;
+            }
+        }
+        BOOST_REQUIRE_EQUAL(received, per_receiver);
+        receivers[r].close();
+    }
+    cc.close();
+}
@@ -288,3 +288,60 @@ SEASTAR_THREAD_TEST_CASE(unixdomain_datagram_named_bound) {
     // Try to be nice and remove the temporary directory.
     std::filesystem::remove_all(tmpdir_ptr);
 }
+
+static string as_string(temporary_buffer<char> b) {
+    return string(b.get(), b.size());
+}
+
+SEASTAR_THREAD_TEST_CASE(unixdomain_pass_fds) {
+    auto [a, b] = make_unix_socket_pair();
+    BOOST_REQUIRE(a.can_pass_fds());
+    int p[2];
+    BOOST_REQUIRE_EQUAL(::pipe2(p, O_CLOEXEC), 0);
+    auto pipe_read = file_desc::from_fd(p[0]);
+    std::vector<file_desc> fds;
+    fds.push_back(file_desc::from_fd(p[1]));
+
+    // The descriptors keep their place in the stream
+    auto out = a.output();
+    out.write("before").get();
+    out.flush().get();
+    a.send_fds(std::move(fds), temporary_buffer<char>::copy_of("fds")).get();
+    out.write("after").get();
+    out.close().get();
+
+    auto in = b.input();
+    BOOST_REQUIRE_EQUAL(as_string(in.read_exactly(6).get()), "before");
+    BOOST_REQUIRE_EQUAL(as_string(in.read_exactly(3).get()), "fds");
+    auto received = b.take_received_fds();
+    BOOST_REQUIRE_EQUAL(received.size(), 1);
+    BOOST_REQUIRE(b.take_received_fds().empty());
+    BOOST_REQUIRE_EQUAL(as_string(in.read_exactly(5).get()), "after");
+
+    // The write end of the pipe came through
+    BOOST_REQUIRE_EQUAL(::write(received[0].get(), "x", 1), 1);
+    char c;
+    BOOST_REQUIRE_EQUAL(::read(pipe_read.get(), &c, 1), 1);
+    BOOST_REQUIRE_EQUAL(c, 'x');
+    in.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(unixdomain_adopt_sockets) {
+    auto name = std::string(1, '\0') + fmt::format("seastar-test-adopt-{}", ::getpid());
+    socket_address addr{unix_domain_addr{name}};
+    auto listener = listen(addr);
+    auto adopted = make_server_socket(listener.dup_fd());
+
+    auto client = connect(addr).get();
+    auto server = adopted.accept().get().connection;
+    // A duplicate of the accepted socket stands for the connection
+    auto server2 = make_connected_socket(server.dup_fd());
+    auto out = client.output();
+    out.write("hello").get();
+    out.close().get();
+    auto in = server2.input();
+    BOOST_REQUIRE_EQUAL(as_string(in.read_exactly(5).get()), "hello");
+    in.close().get();
+
+    BOOST_REQUIRE_THROW(make_server_socket(client.dup_fd()), std::invalid_argument);
+}
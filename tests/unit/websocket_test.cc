@@ -8,6 +8,7 @@
 #include <seastar/http/response_parser.hh>
 #include <seastar/util/defer.hh>
 #include "loopback_socket.hh"
+#include <zlib.h>
 
 using namespace seastar;
 using namespace seastar::experimental;
@@ -152,3 +153,209 @@ SEASTAR_TEST_CASE(test_websocket_handler_registration) {
         BOOST_REQUIRE_EQUAL(rs_frame, response_str);
     });
 }
+
+// Frames a message as a client does, with a mask
+static std::string client_frame(uint8_t first_byte, std::string_view payload) {
+    assert(payload.size() <= std::numeric_limits<uint16_t>::max());
+    const char mask[] = { '\x11', '\x22', '\x33', '\x44' };
+    std::string frame;
+    frame.push_back(char(first_byte));
+    if (payload.size() < 126) {
+        frame.push_back(char(0x80 | payload.size()));
+    } else {
+        frame.push_back(char(0x80 | 126));
+        frame.push_back(char(payload.size() >> 8));
+        frame.push_back(char(payload.size() & 0xff));
+    }
+    frame.append(mask, 4);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        frame.push_back(payload[i] ^ mask[i % 4]);
+    }
+    return frame;
+}
+
+SEASTAR_TEST_CASE(test_websocket_permessage_deflate) {
+    return seastar::async([] {
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        auto acceptor = factory.get_server_socket().accept();
+        auto connector = lsi.connect(socket_address(), socket_address());
+        connected_socket sock = connector.get();
+        auto input = sock.input();
+        auto output = sock.output();
+
+        websocket::server ws;
+        ws.set_deflate(websocket::deflate_config{.server_no_context_takeover = true, .min_size = 0});
+        ws.register_handler("echo", [] (input_stream<char>& in,
+                        output_stream<char>& out) {
+            return repeat([&in, &out]() {
+                return in.read().then([&out](temporary_buffer<char> f) {
+                    if (f.empty()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    } else {
+                        return out.write(std::move(f)).then([&out]() {
+                            return out.flush().then([] {
+                                return make_ready_future<stop_iteration>(stop_iteration::no);
+                            });
+                        });
+                    }
+                });
+            });
+        });
+        websocket::connection conn(ws, acceptor.get().connection);
+        future<> serve = conn.process();
+
+        auto close = defer([&conn, &input, &output, &serve] () noexcept {
+            conn.close().get();
+            input.close().get();
+            output.close().get();
+            serve.get();
+         });
+
+        const std::string request =
+                "GET / HTTP/1.1\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "Sec-WebSocket-Version: 13\r\n"
+                "Sec-WebSocket-Protocol: echo\r\n"
+                "Sec-WebSocket-Extensions: x-unknown, permessage-deflate; server_max_window_bits=20, permessage-deflate; client_max_window_bits\r\n"
+                "\r\n";
+        output.write(request).get();
+        output.flush().get();
+        http_response_parser parser;
+        parser.init();
+        input.consume(parser).get();
+        std::unique_ptr<http::reply> resp = parser.get_parsed_response();
+        BOOST_REQUIRE(resp);
+        auto extensions = resp->_headers["Sec-WebSocket-Extensions"];
+        extensions.erase(extensions.begin(), std::find_if(extensions.begin(), extensions.end(), ::isalnum));
+        BOOST_REQUIRE_EQUAL(extensions, "permessage-deflate; server_no_context_takeover");
+
+        // A message compressed as RFC 7692 describes, in two fragments
+        std::string message;
+        for (int i = 0; i < 2000; ++i) {
+            message += fmt::format("{{\"id\": {}, \"status\": \"ok\"}},", i % 10);
+        }
+        z_stream zs = {};
+        BOOST_REQUIRE_EQUAL(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY), Z_OK);
+        std::string compressed(deflateBound(&zs, message.size()) + 16, '\0');
+        zs.next_in = reinterpret_cast<Bytef*>(message.data());
+        zs.avail_in = message.size();
+        zs.next_out = reinterpret_cast<Bytef*>(compressed.data());
+        zs.avail_out = compressed.size();
+        BOOST_REQUIRE_EQUAL(deflate(&zs, Z_SYNC_FLUSH), Z_OK);
+        compressed.resize(compressed.size() - zs.avail_out - 4);
+        deflateEnd(&zs);
+        auto split = compressed.size() / 2;
+        // TEXT with RSV1 set, then the final CONTINUATION frame
+        output.write(client_frame(0x41, std::string_view(compressed).substr(0, split))).get();
+        output.write(client_frame(0x80, std::string_view(compressed).substr(split))).get();
+        output.flush().get();
+
+        // The echo comes back in compressed messages, as the handler read it
+        BOOST_REQUIRE_EQUAL(inflateInit2(&zs, -MAX_WBITS), Z_OK);
+        std::string echoed;
+        while (echoed.size() < message.size()) {
+            auto header = input.read_exactly(2).get();
+            BOOST_REQUIRE_EQUAL(uint8_t(header[0]), 0xc2);
+            uint64_t len = header[1];
+            BOOST_REQUIRE_LT(len, 127);
+            if (len == 126) {
+                auto ext = input.read_exactly(2).get();
+                len = uint8_t(ext[0]) << 8 | uint8_t(ext[1]);
+            }
+            auto payload = input.read_exactly(len).get();
+            std::string data(payload.get(), payload.size());
+            data.append("\0\0\xff\xff", 4);
+            zs.next_in = reinterpret_cast<Bytef*>(data.data());
+            zs.avail_in = data.size();
+            do {
+                char buf[4096];
+                zs.next_out = reinterpret_cast<Bytef*>(buf);
+                zs.avail_out = sizeof(buf);
+                auto ret = inflate(&zs, Z_SYNC_FLUSH);
+                BOOST_REQUIRE(ret == Z_OK || ret == Z_BUF_ERROR);
+                echoed.append(buf, sizeof(buf) - zs.avail_out);
+            } while (zs.avail_in || !zs.avail_out);
+        }
+        inflateEnd(&zs);
+        BOOST_REQUIRE_EQUAL(echoed, message);
+    });
+}
+
+SEASTAR_TEST_CASE(test_websocket_broadcast) {
+    return seastar::async([] {
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        websocket::server ws;
+        ws.register_handler("feed", [] (input_stream<char>& in, output_stream<char>& out) {
+            return repeat([&in] {
+                return in.read().then([] (temporary_buffer<char> f) {
+                    return f.empty() ? stop_iteration::yes : stop_iteration::no;
+                });
+            });
+        });
+
+        struct client {
+            connected_socket sock;
+            input_stream<char> input;
+            output_stream<char> output;
+            std::unique_ptr<websocket::connection> conn;
+            future<> serve = make_ready_future<>();
+        };
+        std::vector<client> clients(2);
+        for (auto& c : clients) {
+            auto acceptor = factory.get_server_socket().accept();
+            c.sock = lsi.connect(socket_address(), socket_address()).get();
+            c.input = c.sock.input();
+            c.output = c.sock.output();
+            c.conn = std::make_unique<websocket::connection>(ws, acceptor.get().connection);
+            c.serve = c.conn->process();
+        }
+        auto close = defer([&clients] () noexcept {
+            for (auto& c : clients) {
+                c.conn->close().handle_exception([] (auto) {}).get();
+                c.input.close().get();
+                c.output.close().get();
+                c.serve.get();
+            }
+        });
+
+        const std::string request =
+                "GET / HTTP/1.1\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "Sec-WebSocket-Version: 13\r\n"
+                "Sec-WebSocket-Protocol: feed\r\n"
+                "\r\n";
+        for (auto& c : clients) {
+            c.output.write(request).get();
+            c.output.flush().get();
+            c.input.read_exactly(186).get();
+        }
+        // The handshake completes after the reply was sent
+        while (ws.broadcast("feed", temporary_buffer<char>("x", 1)) != clients.size()) {
+            thread::yield();
+        }
+        for (auto& c : clients) {
+            BOOST_REQUIRE_EQUAL(std::string(c.input.read_exactly(3).get().get(), 3), "\x82\x01x");
+        }
+
+        BOOST_REQUIRE_EQUAL(ws.broadcast("other", temporary_buffer<char>("x", 1)), 0);
+        BOOST_REQUIRE_EQUAL(ws.broadcast("feed", temporary_buffer<char>("hello", 5), websocket::opcodes::TEXT), 2);
+        for (auto& c : clients) {
+            BOOST_REQUIRE_EQUAL(std::string(c.input.read_exactly(7).get().get(), 7), "\x81\x05hello");
+        }
+
+        // Nothing can be queued, both connections are too slow
+        ws.set_max_pending_broadcasts(0);
+        BOOST_REQUIRE_EQUAL(ws.broadcast("feed", temporary_buffer<char>("x", 1)), 0);
+        BOOST_REQUIRE_EQUAL(ws.evicted_connections(), 2);
+        BOOST_REQUIRE_EQUAL(ws.broadcast("feed", temporary_buffer<char>("x", 1)), 0);
+        BOOST_REQUIRE_EQUAL(ws.evicted_connections(), 2);
+    });
+}